@@ -51,6 +51,7 @@ EFI_SOURCES += \
     $(LOCAL_DIR)/lib/efi/guids.c \
     $(LOCAL_DIR)/lib/xefi.c \
     $(LOCAL_DIR)/lib/loadfile.c \
+    $(LOCAL_DIR)/lib/lz4.c \
     $(LOCAL_DIR)/lib/console-printf.c \
     $(LOCAL_DIR)/lib/ctype.c \
     $(LOCAL_DIR)/lib/printf.c \
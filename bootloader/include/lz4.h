@@ -0,0 +1,19 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+// Returns true if data starts with an LZ4 frame.
+bool lz4_is_frame(const void* data, size_t len);
+
+// Returns the size the LZ4 frame in data decompresses to, or 0 if its
+// header doesn't record it (lz4 --content-size) or is invalid.
+size_t lz4_frame_content_size(const void* data, size_t len);
+
+// Decompresses the LZ4 frame in data into out, which must be exactly the
+// frame's content size.  Block and content checksums aren't checked.
+// Returns 0 on success, -1 if the frame is corrupt or the wrong size.
+int lz4_frame_decompress(const void* data, size_t len, void* out, size_t outlen);
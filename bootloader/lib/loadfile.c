@@ -55,6 +55,11 @@ exit0:
     return file;
 }
 
+// Some firmware bounces every read through a small buffer of its own, or
+// gives up on very large ones, so files are read a chunk at a time, each
+// going to a page aligned spot.
+#define READ_CHUNK_SIZE (1024 * 1024)
+
 void* xefi_read_file(efi_file_protocol* file, size_t* _sz) {
     efi_status r;
     size_t pages = 0;
@@ -69,24 +74,36 @@ void* xefi_read_file(efi_file_protocol* file, size_t* _sz) {
         return NULL;
     }
 
+    // below 4GB, as the kernel is only given 32bit addresses for things
+    // like the ramdisk
     pages = (finfo->FileSize + 4095) / 4096;
-    r = gBS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, (efi_physical_addr *)&data);
+    efi_physical_addr mem = 0xFFFFFFFF;
+    r = gBS->AllocatePages(AllocateMaxAddress, EfiLoaderData, pages, &mem);
     if (r) {
         printf("LoadFile: Cannot allocate buffer (%s)\n", xefi_strerror(r));
         return NULL;
     }
+    data = (void*)mem;
 
-    sz = finfo->FileSize;
-    r = file->Read(file, &sz, data);
-    if (r) {
-        printf("LoadFile: Error reading file (%s)\n", xefi_strerror(r));
-        gBS->FreePages((efi_physical_addr)data, pages);
-        return NULL;
-    }
-    if (sz != finfo->FileSize) {
-        printf("LoadFile: Short read\n");
-        gBS->FreePages((efi_physical_addr)data, pages);
-        return NULL;
+    size_t off = 0;
+    while (off < finfo->FileSize) {
+        size_t want = finfo->FileSize - off;
+        if (want > READ_CHUNK_SIZE) {
+            want = READ_CHUNK_SIZE;
+        }
+        sz = want;
+        r = file->Read(file, &sz, (uint8_t*)data + off);
+        if (r) {
+            printf("LoadFile: Error reading file (%s)\n", xefi_strerror(r));
+            gBS->FreePages((efi_physical_addr)data, pages);
+            return NULL;
+        }
+        if (sz != want) {
+            printf("LoadFile: Short read\n");
+            gBS->FreePages((efi_physical_addr)data, pages);
+            return NULL;
+        }
+        off += sz;
     }
     *_sz = finfo->FileSize;
 
@@ -0,0 +1,190 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lz4.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// A decoder for the LZ4 frame format, decompressing straight into one
+// contiguous buffer, so linked blocks work as well as independent ones.
+// Dictionaries aren't supported.
+//
+// See https://github.com/lz4/lz4/blob/dev/lz4_Frame_format.md for details.
+#define LZ4_MAGIC 0x184D2204
+
+#define LZ4_FLAG_VERSION_MASK   (3 << 6)
+#define LZ4_FLAG_VERSION        (1 << 6)
+#define LZ4_FLAG_BLOCK_CKSUM    (1 << 4)
+#define LZ4_FLAG_CONTENT_SZ     (1 << 3)
+#define LZ4_FLAG_CONTENT_CKSUM  (1 << 2)
+#define LZ4_FLAG_DICT_ID        (1 << 0)
+
+#define LZ4_BLOCK_UNCOMPRESSED  0x80000000u
+#define LZ4_MIN_MATCH           4
+
+static uint32_t get_le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t* p) {
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+bool lz4_is_frame(const void* data, size_t len) {
+    return (len >= 4) && (get_le32(data) == LZ4_MAGIC);
+}
+
+// Checks the frame header, returning its length, or 0 if it's unusable.
+static size_t lz4_frame_header(const uint8_t* in, size_t len, uint64_t* content_size) {
+    if (!lz4_is_frame(in, len) || (len < 7)) {
+        return 0;
+    }
+    uint8_t flag = in[4];
+    if ((flag & LZ4_FLAG_VERSION_MASK) != LZ4_FLAG_VERSION) {
+        return 0;
+    }
+    if (flag & LZ4_FLAG_DICT_ID) {
+        return 0;
+    }
+    size_t hdr = 6;
+    *content_size = 0;
+    if (flag & LZ4_FLAG_CONTENT_SZ) {
+        if (len < hdr + 8 + 1) {
+            return 0;
+        }
+        *content_size = get_le64(in + hdr);
+        hdr += 8;
+    }
+    // and the header checksum
+    return hdr + 1;
+}
+
+size_t lz4_frame_content_size(const void* data, size_t len) {
+    uint64_t content_size;
+    if (lz4_frame_header(data, len, &content_size) == 0) {
+        return 0;
+    }
+    if (content_size != (size_t)content_size) {
+        return 0;
+    }
+    return content_size;
+}
+
+// Decompresses one block to op, which matches may refer back from as far as
+// base.  Returns the end of what was written, or NULL if the block is bad.
+static uint8_t* lz4_block(const uint8_t* ip, size_t len, uint8_t* base, uint8_t* op, uint8_t* oend) {
+    const uint8_t* iend = ip + len;
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t n = token >> 4;
+        if (n == 15) {
+            uint8_t b;
+            do {
+                if (ip == iend) {
+                    return NULL;
+                }
+                b = *ip++;
+                n += b;
+            } while (b == 255);
+        }
+        if (((size_t)(iend - ip) < n) || ((size_t)(oend - op) < n)) {
+            return NULL;
+        }
+        memcpy(op, ip, n);
+        ip += n;
+        op += n;
+
+        // the last sequence is just literals
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return NULL;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ((offset == 0) || (offset > (size_t)(op - base))) {
+            return NULL;
+        }
+        n = token & 15;
+        if (n == 15) {
+            uint8_t b;
+            do {
+                if (ip == iend) {
+                    return NULL;
+                }
+                b = *ip++;
+                n += b;
+            } while (b == 255);
+        }
+        n += LZ4_MIN_MATCH;
+        if ((size_t)(oend - op) < n) {
+            return NULL;
+        }
+        // the match may overlap what it's making, so a byte at a time
+        const uint8_t* match = op - offset;
+        while (n-- > 0) {
+            *op++ = *match++;
+        }
+    }
+    return op;
+}
+
+int lz4_frame_decompress(const void* data, size_t len, void* out, size_t outlen) {
+    const uint8_t* ip = data;
+    const uint8_t* iend = ip + len;
+    uint8_t* base = out;
+    uint8_t* op = out;
+    uint8_t* oend = op + outlen;
+
+    uint64_t content_size;
+    size_t hdr = lz4_frame_header(ip, len, &content_size);
+    if (hdr == 0) {
+        printf("lz4: bad frame header\n");
+        return -1;
+    }
+    uint8_t flag = ip[4];
+    ip += hdr;
+
+    for (;;) {
+        if (iend - ip < 4) {
+            printf("lz4: truncated frame\n");
+            return -1;
+        }
+        uint32_t bsize = get_le32(ip);
+        ip += 4;
+        if (bsize == 0) {
+            break;
+        }
+        bool raw = bsize & LZ4_BLOCK_UNCOMPRESSED;
+        bsize &= ~LZ4_BLOCK_UNCOMPRESSED;
+        if ((size_t)(iend - ip) < bsize) {
+            printf("lz4: truncated block\n");
+            return -1;
+        }
+        if (raw) {
+            if ((size_t)(oend - op) < bsize) {
+                printf("lz4: too much data\n");
+                return -1;
+            }
+            memcpy(op, ip, bsize);
+            op += bsize;
+        } else if ((op = lz4_block(ip, bsize, base, op, oend)) == NULL) {
+            printf("lz4: corrupt block\n");
+            return -1;
+        }
+        ip += bsize;
+        if (flag & LZ4_FLAG_BLOCK_CKSUM) {
+            ip += 4;
+        }
+    }
+    if ((op != oend) || ((flag & LZ4_FLAG_CONTENT_SZ) && (content_size != outlen))) {
+        printf("lz4: decompressed %zu bytes, not %zu\n", (size_t)(op - base), outlen);
+        return -1;
+    }
+    return 0;
+}
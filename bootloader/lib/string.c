@@ -15,6 +15,22 @@ void* memset(void* _dst, int c, size_t n) {
 void* memcpy(void* _dst, const void* _src, size_t n) {
     uint8_t* dst = _dst;
     const uint8_t* src = _src;
+    // the kernel image is copied into place with this, so a word at a time
+    // where the two line up
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 7) == 0) {
+        while ((n > 0) && ((uintptr_t)dst & 7)) {
+            *dst++ = *src++;
+            n--;
+        }
+        uint64_t* wdst = (uint64_t*)dst;
+        const uint64_t* wsrc = (const uint64_t*)src;
+        while (n >= 8) {
+            *wdst++ = *wsrc++;
+            n -= 8;
+        }
+        dst = (uint8_t*)wdst;
+        src = (const uint8_t*)wsrc;
+    }
     while (n-- > 0) {
         *dst++ = *src++;
     }
@@ -130,19 +130,45 @@ static int resolve_ip6(mac_addr* _mac, const ip6_addr* _ip) {
     return -1;
 }
 
+// As in system/ulib/inet6: 32 bit words into four 64 bit sums, which
+// fold to the same 16 bit one's complement sum.
 static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
-    while (len > 1) {
-        sum += *data++;
+    const uint8_t* data = _data;
+    uint64_t s0 = _sum, s1 = 0, s2 = 0, s3 = 0;
+    while (len >= 32) {
+        uint32_t w[8];
+        memcpy(w, data, sizeof(w));
+        s0 += (uint64_t)w[0] + w[4];
+        s1 += (uint64_t)w[1] + w[5];
+        s2 += (uint64_t)w[2] + w[6];
+        s3 += (uint64_t)w[3] + w[7];
+        data += 32;
+        len -= 32;
+    }
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, data, sizeof(w));
+        s0 += w;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        memcpy(&w, data, sizeof(w));
+        s1 += w;
+        data += 2;
         len -= 2;
     }
     if (len) {
-        sum += (*data & 0xFF);
-    }
-    while (sum > 0xFFFF) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+        uint16_t w = 0;
+        memcpy(&w, data, 1);
+        s2 += w;
     }
+    uint64_t sum = s0 + s1 + s2 + s3;
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
     return sum;
 }
 
@@ -228,7 +254,9 @@ fail:
 
 #define ICMP6_MAX_PAYLOAD (ETH_MTU - ETH_HDR_LEN - IP6_HDR_LEN)
 
-static int icmp6_send(const void* data, size_t length, const ip6_addr* daddr) {
+// the message is copied in, with type and checksum filled in, so the
+// source can be a received frame that is left as it was
+static int icmp6_send(uint8_t type, const void* data, size_t length, const ip6_addr* daddr) {
     ip6_pkt* p;
     icmp6_hdr* icmp;
 
@@ -242,6 +270,8 @@ static int icmp6_send(const void* data, size_t length, const ip6_addr* daddr) {
 
     icmp = (void*)p->data;
     memcpy(icmp, data, length);
+    icmp->type = type;
+    icmp->checksum = 0;
     icmp->checksum = ip6_checksum(&p->ip6, HDR_ICMP6, length);
     return eth_send(p->eth + 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
 
@@ -256,10 +286,10 @@ void _udp6_recv(ip6_hdr* ip, void* _data, size_t len) {
 
     if (len < UDP_HDR_LEN)
         BAD("Bogus Header Len");
+    // 0xFFFF stands for a computed 0 and sums the same, so the frame
+    // is checked as it is, without writing to it
     if (udp->checksum == 0)
         BAD("Checksum Invalid");
-    if (udp->checksum == 0xFFFF)
-        udp->checksum = 0;
 
     sum = checksum(&ip->length, 2, htons(HDR_UDP));
     sum = checksum(ip->src, 32 + len, sum);
@@ -284,8 +314,6 @@ void icmp6_recv(ip6_hdr* ip, void* _data, size_t len) {
 
     if (icmp->checksum == 0)
         BAD("Checksum Invalid");
-    if (icmp->checksum == 0xFFFF)
-        icmp->checksum = 0;
 
     sum = checksum(&ip->length, 2, htons(HDR_ICMP6));
     sum = checksum(ip->src, 32 + len, sum);
@@ -315,14 +343,12 @@ void icmp6_recv(ip6_hdr* ip, void* _data, size_t len) {
         msg.opt[1] = 1;
         memcpy(msg.opt + 2, &ll_mac_addr, ETH_ADDR_LEN);
 
-        icmp6_send(&msg, sizeof(msg), (void*)ip->src);
+        icmp6_send(ICMP6_NDP_N_ADVERTISE, &msg, sizeof(msg), (void*)ip->src);
         return;
     }
 
     if (icmp->type == ICMP6_ECHO_REQUEST) {
-        icmp->checksum = 0;
-        icmp->type = ICMP6_ECHO_REPLY;
-        icmp6_send(_data, len, (void*)ip->src);
+        icmp6_send(ICMP6_ECHO_REPLY, _data, len, (void*)ip->src);
         return;
     }
 
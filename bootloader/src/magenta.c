@@ -7,12 +7,46 @@
 #include <efi/protocol/graphics-output.h>
 
 #include <inttypes.h>
+#include <lz4.h>
 #include <stdio.h>
 #include <string.h>
 #include <xefi.h>
 
 #include <magenta/pixelformat.h>
 
+#define BOOT_STAGES 8
+
+static struct {
+    const char* name;
+    uint64_t ts;
+} boot_stages[BOOT_STAGES];
+static int boot_stage_count;
+
+void boot_timestamp(const char* name) {
+    if (boot_stage_count < BOOT_STAGES) {
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        boot_stages[boot_stage_count].name = name;
+        boot_stages[boot_stage_count].ts = ((uint64_t)hi << 32) | lo;
+        boot_stage_count++;
+    }
+}
+
+// appends bootloader.timeline=<name>:<tsc>,... to the kernel cmdline,
+// if it fits in its page
+static void append_timeline(kernel_t* k) {
+    char buf[32 * BOOT_STAGES];
+    char* p = buf;
+    p += sprintf(p, " bootloader.timeline=");
+    for (int i = 0; i < boot_stage_count; i++) {
+        p += sprintf(p, "%s%s:%" PRIx64, i ? "," : "", boot_stages[i].name, boot_stages[i].ts);
+    }
+    size_t len = strlen((char*)k->cmdline);
+    if (len + (p - buf) < 4096) {
+        memcpy(k->cmdline + len, buf, (p - buf) + 1);
+    }
+}
+
 static efi_guid AcpiTableGUID = ACPI_TABLE_GUID;
 static efi_guid Acpi2TableGUID = ACPI_20_TABLE_GUID;
 static uint8_t ACPI_RSD_PTR[8] = "RSD PTR ";
@@ -371,10 +405,41 @@ int boot_kernel(efi_handle img, efi_system_table* sys,
         printf("ramdisk at %p (%zu bytes)\n", ramdisk, rsz);
     }
 
-    if (load_kernel(sys->BootServices, image, sz, &kernel)) {
+    // a compressed kernel is unpacked to pages of its own, which load_kernel
+    // copies it from like any other
+    efi_physical_addr unpacked = 0;
+    size_t unpacked_pages = 0;
+    if (lz4_is_frame(image, sz)) {
+        size_t usz = lz4_frame_content_size(image, sz);
+        if (usz == 0) {
+            printf("kernel: compressed without its size (lz4 --content-size)\n");
+            return -1;
+        }
+        unpacked_pages = (usz + 4095) / 4096;
+        if (bs->AllocatePages(AllocateAnyPages, EfiLoaderData, unpacked_pages, &unpacked)) {
+            printf("kernel: cannot allocate %zu bytes to decompress into\n", usz);
+            return -1;
+        }
+        if (lz4_frame_decompress(image, sz, (void*)unpacked, usz) < 0) {
+            printf("kernel: cannot decompress\n");
+            bs->FreePages(unpacked, unpacked_pages);
+            return -1;
+        }
+        printf("kernel decompressed from %zu to %zu bytes\n", sz, usz);
+        image = (void*)unpacked;
+        sz = usz;
+        boot_timestamp("unpack");
+    }
+
+    int status = load_kernel(sys->BootServices, image, sz, &kernel);
+    if (unpacked) {
+        bs->FreePages(unpacked, unpacked_pages);
+    }
+    if (status) {
         printf("Failed to load kernel image\n");
         return -1;
     }
+    boot_timestamp("load");
 
     ZP32(kernel.zeropage, ZP_EXTRA_MAGIC) = ZP_MAGIC_VALUE;
     ZP32(kernel.zeropage, ZP_ACPI_RSD) = find_acpi_root(img, sys);
@@ -430,6 +495,9 @@ int boot_kernel(efi_handle img, efi_system_table* sys,
         return -1;
     }
 
+    boot_timestamp("exit");
+    append_timeline(&kernel);
+
     install_memmap(&kernel, e820table, n);
     start_kernel(&kernel);
 
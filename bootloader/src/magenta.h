@@ -12,6 +12,11 @@ typedef struct {
     uint32_t pages;
 } kernel_t;
 
+// Notes that the bootloader got to the stage |name|, which must be a
+// string constant.  The stages are passed to the kernel for its boot
+// timeline, timed by the TSC the kernel's traces are timed by.
+void boot_timestamp(const char* name);
+
 int boot_kernel(efi_handle img, efi_system_table* sys,
                 void* image, size_t sz, void* ramdisk, size_t rsz,
                 void* cmdline, size_t csz, void* cmdline2, size_t csz2);
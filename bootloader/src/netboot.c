@@ -19,8 +19,9 @@ static uint32_t last_ack_arg = 0;
 static int nb_boot_now = 0;
 static int nb_active = 0;
 
-// item being downloaded
+// item being downloaded, and where it's up to
 static nbfile* item;
+static nbwindow window;
 
 void udp6_recv(void* data, size_t len,
                const ip6_addr* daddr, uint16_t dport,
@@ -70,6 +71,7 @@ void udp6_recv(void* data, size_t len,
         item = netboot_get_buffer((const char*)msg->data, msg->arg);
         if (item) {
             item->offset = 0;
+            nb_window_init(&window, 0);
             ack.arg = msg->arg;
             printf("netboot: Receive File '%s'...\n", (char*) msg->data);
         } else {
@@ -84,20 +86,26 @@ void udp6_recv(void* data, size_t len,
             printf("netboot: > received chunk before NB_FILE\n");
             return;
         }
-        if (msg->arg != item->offset) {
-            printf("netboot: < received chunk at offset %d but current offset is %zu\n", msg->arg, item->offset);
+        // the host sends ahead, and goes back to the offset in an ack
+        // for anything but what was expected
+        switch (nb_window_check(&window, msg->arg)) {
+        case NB_WINDOW_DROP:
+            return;
+        case NB_WINDOW_ACK:
             ack.arg = item->offset;
-            ack.cmd = NB_ACK;
-        } else if ((item->offset + len) > item->size) {
-            ack.cmd = NB_ERROR_TOO_LARGE;
-            ack.arg = msg->arg;
-        } else {
+            break;
+        case NB_WINDOW_TAKE:
+            if ((item->offset + len) > item->size) {
+                ack.cmd = NB_ERROR_TOO_LARGE;
+                ack.arg = msg->arg;
+                break;
+            }
             memcpy(item->data + item->offset, msg->data, len);
             item->offset += len;
             ack.cmd = msg->cmd == NB_LAST_DATA ? NB_FILE_RECEIVED : NB_ACK;
-            if (msg->cmd != NB_LAST_DATA) {
-                do_transmit = 0;
-            }
+            ack.arg = item->offset;
+            do_transmit = nb_window_advance(&window, item->offset, msg->cmd == NB_LAST_DATA);
+            break;
         }
         break;
     case NB_BOOT:
@@ -120,15 +128,18 @@ void udp6_recv(void* data, size_t len,
 transmit:
     nb_active = 1;
     if (do_transmit) {
-        printf("netboot: MSG %08x %08x %08x %08x\n",
-           ack.magic, ack.cookie, ack.cmd, ack.arg);
+        // plain acks for data are too many to log
+        if ((ack.cmd != NB_ACK) || ((last_cmd != NB_DATA) && (last_cmd != NB_LAST_DATA))) {
+            printf("netboot: MSG %08x %08x %08x %08x\n",
+                   ack.magic, ack.cookie, ack.cmd, ack.arg);
+        }
 
         udp6_send(&ack, sizeof(ack), saddr, sport, NB_SERVER_PORT);
     }
 }
 
 static char advertise_data[] =
-    "version\01.1\0"
+    "version\01.2\0"
     "serialno\0unknown\0"
     "board\0unknown\0";
 
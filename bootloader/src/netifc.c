@@ -325,41 +325,51 @@ int netifc_active(void) {
     return (snp != 0);
 }
 
+// frames taken from the device per poll, so a burst is worked through
+// without a trip back through the caller's loop for each one
+#define RX_BATCH 16
+
 void netifc_poll(void) {
-    uint8_t data[1514];
+    static uint8_t data[1514];
     efi_status r;
     size_t hsz, bsz;
     uint32_t irq;
     void* txdone;
 
-    if ((r = snp->GetStatus(snp, &irq, &txdone))) {
-        return;
-    }
-
-    if (txdone) {
+    // each call hands back at most one sent buffer
+    for (;;) {
+        txdone = NULL;
+        if ((r = snp->GetStatus(snp, &irq, &txdone))) {
+            return;
+        }
+        if (txdone == NULL) {
+            break;
+        }
         eth_put_buffer(txdone);
     }
 
-    hsz = 0;
-    bsz = sizeof(data);
-    r = snp->Receive(snp, &hsz, &bsz, data, NULL, NULL, NULL);
-    if (r != EFI_SUCCESS) {
-        return;
-    }
+    for (int i = 0; i < RX_BATCH; i++) {
+        hsz = 0;
+        bsz = sizeof(data);
+        r = snp->Receive(snp, &hsz, &bsz, data, NULL, NULL, NULL);
+        if (r != EFI_SUCCESS) {
+            return;
+        }
 
 #if DROP_PACKETS
-    rxc++;
-    if ((random() % DROP_PACKETS) == 0) {
-        printf("rx drop %d\n", rxc);
-        return;
-    }
+        rxc++;
+        if ((random() % DROP_PACKETS) == 0) {
+            printf("rx drop %d\n", rxc);
+            continue;
+        }
 #endif
 
 #if TRACE
-    printf("RX %02x:%02x:%02x:%02x:%02x:%02x < %02x:%02x:%02x:%02x:%02x:%02x %02x%02x %d\n",
-            data[0], data[1], data[2], data[3], data[4], data[5],
-            data[6], data[7], data[8], data[9], data[10], data[11],
-            data[12], data[13], (int)(bsz - hsz));
+        printf("RX %02x:%02x:%02x:%02x:%02x:%02x < %02x:%02x:%02x:%02x:%02x:%02x %02x%02x %d\n",
+                data[0], data[1], data[2], data[3], data[4], data[5],
+                data[6], data[7], data[8], data[9], data[10], data[11],
+                data[12], data[13], (int)(bsz - hsz));
 #endif
-    eth_recv(data, bsz);
+        eth_recv(data, bsz);
+    }
 }
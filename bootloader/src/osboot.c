@@ -301,6 +301,7 @@ void do_netboot() {
 }
 
 EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
+    boot_timestamp("start");
     xefi_init(img, sys);
     gConOut->ClearScreen(gConOut);
 
@@ -395,6 +396,7 @@ EFIAPI efi_status efi_main(efi_handle img, efi_system_table* sys) {
 
         char key = key_prompt(valid_keys, timeout_s);
         printf("\n\n");
+        boot_timestamp("menu");
 
         switch (key) {
         case 'b':
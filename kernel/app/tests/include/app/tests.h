@@ -19,6 +19,7 @@ int port_tests(void);
 void printf_tests(void);
 void clock_tests(void);
 void benchmarks(void);
+int kernel_benchmarks(int argc, const cmd_args *argv);
 int fibo(int argc, const cmd_args *argv);
 int spinner(int argc, const cmd_args *argv);
 int ref_counted_tests(int argc, const cmd_args *argv);
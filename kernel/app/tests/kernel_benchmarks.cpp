@@ -0,0 +1,334 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <app/tests.h>
+#include <arch/ops.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_aspace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if ARCH_X86_64
+#include <arch/x86.h>
+#endif
+
+// Cycle counts for the kernel's core primitives, so that a change to one of
+// them can be checked against the numbers from before it. Every benchmark
+// runs its operation many times and reports the mean cost of one.
+
+namespace {
+
+// arch_cycle_count() is only 32 bits, which wraps in about a second on x86,
+// so read the whole TSC there. Elsewhere the runs are kept short enough.
+inline uint64_t bench_cycles() {
+#if ARCH_X86_64
+    return rdtsc();
+#else
+    return arch_cycle_count();
+#endif
+}
+
+void report(const char* name, uint64_t cycles, uint64_t ops) {
+    printf("%-32s %10" PRIu64 " ops %10" PRIu64 " cycles/op\n", name, ops, ops ? cycles / ops : 0);
+}
+
+// Keeps the current thread on one cpu for the duration of a benchmark.
+class PinCurrentThread {
+public:
+    explicit PinCurrentThread(int cpu) { thread_pin_cpu(get_current_thread(), cpu); }
+    ~PinCurrentThread() { thread_pin_cpu(get_current_thread(), -1); }
+};
+
+thread_t* create_pinned_thread(const char* name, thread_start_routine entry, void* arg, int cpu) {
+    thread_t* t = thread_create(name, entry, arg, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    if (t) {
+        thread_set_pinned_cpu(t, cpu);
+        thread_resume(t);
+    }
+    return t;
+}
+
+// The cpu other than |cpu| with the lowest number, or -1 if there is none.
+int other_active_cpu(uint cpu) {
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        if (i != cpu && mp_is_cpu_active(i))
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+constexpr uint kSwitchIters = 10000;
+
+struct PingPong {
+    event_t ping;
+    event_t pong;
+    uint iters;
+    uint64_t cycles;
+};
+
+int ping_thread(void* arg) {
+    PingPong* pp = static_cast<PingPong*>(arg);
+    uint64_t start = bench_cycles();
+    for (uint i = 0; i < pp->iters; i++) {
+        event_signal(&pp->pong, true);
+        event_wait(&pp->ping);
+    }
+    pp->cycles = bench_cycles() - start;
+    return 0;
+}
+
+int pong_thread(void* arg) {
+    PingPong* pp = static_cast<PingPong*>(arg);
+    for (uint i = 0; i < pp->iters; i++) {
+        event_wait(&pp->pong);
+        event_signal(&pp->ping, true);
+    }
+    return 0;
+}
+
+// Two threads on one cpu waking each other, so each round trip is two
+// context switches, each with an event signal and wait.
+void bench_context_switch() {
+    PingPong pp;
+    event_init(&pp.ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+    event_init(&pp.pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+    pp.iters = kSwitchIters;
+    pp.cycles = 0;
+
+    int cpu = static_cast<int>(arch_curr_cpu_num());
+    thread_t* pong = create_pinned_thread("bench pong", pong_thread, &pp, cpu);
+    thread_t* ping = create_pinned_thread("bench ping", ping_thread, &pp, cpu);
+    if (!ping || !pong) {
+        printf("context switch: out of threads\n");
+        return;
+    }
+    thread_join(ping, nullptr, INFINITE_TIME);
+    thread_join(pong, nullptr, INFINITE_TIME);
+    event_destroy(&pp.ping);
+    event_destroy(&pp.pong);
+
+    report("context switch", pp.cycles, 2ull * pp.iters);
+}
+
+void ipi_noop(void* arg) {}
+
+// A synchronous cross-cpu call that does nothing, so the IPI, the remote
+// handler dispatch and the wait for its completion.
+void bench_mp_sync_exec() {
+    PinCurrentThread pin(static_cast<int>(arch_curr_cpu_num()));
+    int target = other_active_cpu(arch_curr_cpu_num());
+    if (target < 0) {
+        printf("mp_sync_exec: needs a second cpu\n");
+        return;
+    }
+
+    constexpr uint kIters = 10000;
+    uint64_t start = bench_cycles();
+    for (uint i = 0; i < kIters; i++)
+        mp_sync_exec(1u << target, ipi_noop, nullptr);
+    report("mp_sync_exec round trip", bench_cycles() - start, kIters);
+}
+
+// Demand faults on a fresh kernel mapping, each allocating, zeroing and
+// mapping a page.
+void bench_page_fault() {
+    constexpr size_t kSize = 4 * 1024 * 1024;
+    constexpr uint kRuns = 8;
+    VmAspace* aspace = VmAspace::kernel_aspace();
+
+    uint64_t cycles = 0, faults = 0;
+    for (uint run = 0; run < kRuns; run++) {
+        void* ptr;
+        status_t err = aspace->Alloc("bench page fault", kSize, &ptr, 0, 0, 0,
+                                     ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
+        if (err != NO_ERROR) {
+            printf("page fault: cannot allocate a mapping: %d\n", err);
+            return;
+        }
+        volatile uint8_t* p = static_cast<volatile uint8_t*>(ptr);
+        uint64_t start = bench_cycles();
+        for (size_t off = 0; off < kSize; off += PAGE_SIZE)
+            p[off] = 1;
+        cycles += bench_cycles() - start;
+        faults += kSize / PAGE_SIZE;
+        aspace->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+    }
+    report("page fault", cycles, faults);
+}
+
+void bench_pmm() {
+    constexpr uint kIters = 10000;
+    uint64_t start = bench_cycles();
+    for (uint i = 0; i < kIters; i++) {
+        vm_page_t* page = pmm_alloc_page(0, nullptr);
+        if (!page) {
+            printf("pmm: out of pages\n");
+            return;
+        }
+        pmm_free_page(page);
+    }
+    report("pmm_alloc_page + free", bench_cycles() - start, kIters);
+
+    // in batches, so the pages don't just go back and forth to the same spot
+    constexpr size_t kBatch = 256;
+    uint64_t cycles = 0, pages = 0;
+    for (uint i = 0; i < kIters / kBatch; i++) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        start = bench_cycles();
+        size_t got = pmm_alloc_pages(kBatch, 0, &list);
+        pmm_free(&list);
+        cycles += bench_cycles() - start;
+        pages += got;
+    }
+    report("pmm_alloc_pages + free, per page", cycles, pages);
+}
+
+void bench_heap() {
+    static const size_t kSizes[] = {16, 64, 256, 1024, 4096, 16384, 65536};
+    constexpr uint kIters = 10000;
+    constexpr uint kBatch = 64;
+
+    for (size_t s = 0; s < countof(kSizes); s++) {
+        char name[48];
+
+        uint64_t start = bench_cycles();
+        for (uint i = 0; i < kIters; i++) {
+            void* volatile p = malloc(kSizes[s]);
+            free(p);
+        }
+        snprintf(name, sizeof(name), "malloc + free %zu", kSizes[s]);
+        report(name, bench_cycles() - start, kIters);
+
+        // a batch at a time, to see the cost when the free lists move
+        void* ptrs[kBatch];
+        uint64_t cycles = 0;
+        for (uint i = 0; i < kIters / kBatch; i++) {
+            start = bench_cycles();
+            for (uint j = 0; j < kBatch; j++)
+                ptrs[j] = malloc(kSizes[s]);
+            for (uint j = 0; j < kBatch; j++)
+                free(ptrs[j]);
+            cycles += bench_cycles() - start;
+        }
+        snprintf(name, sizeof(name), "malloc + free %zu, batched", kSizes[s]);
+        report(name, cycles, (kIters / kBatch) * kBatch);
+    }
+}
+
+enum handler_return timer_noop(timer_t* timer, lk_time_t now, void* arg) {
+    return INT_NO_RESCHEDULE;
+}
+
+// Arming a timer that won't fire before it is cancelled, the common case
+// for timeouts.
+void bench_timer() {
+    constexpr uint kIters = 10000;
+    timer_t timer;
+    timer_initialize(&timer);
+
+    uint64_t start = bench_cycles();
+    for (uint i = 0; i < kIters; i++) {
+        timer_set_oneshot(&timer, 10000, timer_noop, nullptr);
+        timer_cancel(&timer);
+    }
+    report("timer set + cancel", bench_cycles() - start, kIters);
+}
+
+constexpr uint kMutexIters = 100000;
+
+struct MutexBench {
+    mutex_t lock;
+    event_t start;
+};
+
+int mutex_thread(void* arg) {
+    MutexBench* mb = static_cast<MutexBench*>(arg);
+    event_wait(&mb->start);
+    for (uint i = 0; i < kMutexIters; i++) {
+        mutex_acquire(&mb->lock);
+        mutex_release(&mb->lock);
+    }
+    return 0;
+}
+
+// Uncontended, then two threads on different cpus fighting over one mutex,
+// where most acquisitions block and are handed the lock by the releaser.
+void bench_mutex() {
+    MutexBench mb;
+    mutex_init(&mb.lock);
+    event_init(&mb.start, false, 0);
+
+    uint64_t start = bench_cycles();
+    for (uint i = 0; i < kMutexIters; i++) {
+        mutex_acquire(&mb.lock);
+        mutex_release(&mb.lock);
+    }
+    report("mutex acquire + release", bench_cycles() - start, kMutexIters);
+
+    int cpu = static_cast<int>(arch_curr_cpu_num());
+    int other = other_active_cpu(arch_curr_cpu_num());
+    if (other < 0) {
+        printf("mutex handoff: needs a second cpu\n");
+    } else {
+        thread_t* a = create_pinned_thread("bench mutex a", mutex_thread, &mb, cpu);
+        thread_t* b = create_pinned_thread("bench mutex b", mutex_thread, &mb, other);
+        if (!a || !b) {
+            printf("mutex handoff: out of threads\n");
+            return;
+        }
+        start = bench_cycles();
+        event_signal(&mb.start, true);
+        thread_join(a, nullptr, INFINITE_TIME);
+        thread_join(b, nullptr, INFINITE_TIME);
+        report("mutex contended, 2 cpus", bench_cycles() - start, 2ull * kMutexIters);
+    }
+
+    event_destroy(&mb.start);
+    mutex_destroy(&mb.lock);
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+    {"cswitch", bench_context_switch},
+    {"ipi", bench_mp_sync_exec},
+    {"fault", bench_page_fault},
+    {"pmm", bench_pmm},
+    {"heap", bench_heap},
+    {"timer", bench_timer},
+    {"mutex", bench_mutex},
+};
+
+} // namespace
+
+int kernel_benchmarks(int argc, const cmd_args* argv) {
+    bool ran = false;
+    for (size_t i = 0; i < countof(kBenchmarks); i++) {
+        if (argc < 2 || !strcmp(argv[1].str, kBenchmarks[i].name)) {
+            kBenchmarks[i].run();
+            ran = true;
+        }
+    }
+    if (!ran) {
+        printf("usage: %s [", argv[0].str);
+        for (size_t i = 0; i < countof(kBenchmarks); i++)
+            printf("%s%s", i ? "|" : "", kBenchmarks[i].name);
+        printf("]\n");
+        return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
@@ -24,6 +24,7 @@ STATIC_COMMAND("thread_tests", "test the scheduler", (console_cmd)&thread_tests)
 STATIC_COMMAND("clock_tests", "test clocks", (console_cmd)&clock_tests)
 STATIC_COMMAND("sleep_tests", "tests sleep", (console_cmd)&sleep_tests)
 STATIC_COMMAND("bench", "miscellaneous benchmarks", (console_cmd)&benchmarks)
+STATIC_COMMAND("kbench", "cycle costs of core kernel primitives", (console_cmd)&kernel_benchmarks)
 STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", (console_cmd)&spinner)
 STATIC_COMMAND("sync_ipi_tests", "test synchronous IPIs", (console_cmd)&sync_ipi_tests)
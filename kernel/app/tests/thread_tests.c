@@ -511,6 +511,41 @@ static void join_test(void)
     printf("thread_join returns err %d, retval %d (should be 0 and 55)\n", err, ret);
 }
 
+static int cache_tester(void *arg)
+{
+    return 0;
+}
+
+static void thread_cache_test(void)
+{
+    const int count = 100;
+    void *last_stack = NULL;
+    thread_t *last_thread = NULL;
+    int stacks_reused = 0;
+    int structs_reused = 0;
+
+    printf("testing thread structure and stack reuse\n");
+
+    for (int i = 0; i < count; i++) {
+        thread_t *t = thread_create("cache tester", &cache_tester, NULL, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        if (!t) {
+            printf("failed to create thread %d\n", i);
+            return;
+        }
+        if (t == last_thread)
+            structs_reused++;
+        if (t->stack == last_stack)
+            stacks_reused++;
+        last_thread = t;
+        last_stack = t->stack;
+        thread_resume(t);
+        thread_join(t, NULL, INFINITE_TIME);
+    }
+
+    printf("%d of %d threads reused the last structure, %d the last stack (should be about %d)\n",
+           structs_reused, count, stacks_reused, count - 1);
+}
+
 static void spinlock_test(void)
 {
     spin_lock_saved_state_t state;
@@ -685,6 +720,7 @@ int thread_tests(void)
     preempt_test();
 
     join_test();
+    thread_cache_test();
 
     return 0;
 }
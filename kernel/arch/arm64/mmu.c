@@ -7,13 +7,13 @@
 
 
 #include <arch/arm64/mmu.h>
-#include <rand.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/vm.h>
 #include <kernel/mutex.h>
+#include <lib/counters.h>
 #include <lib/heap.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +31,9 @@ static_assert(MMU_KERNEL_SIZE_SHIFT >= 25, "");
 static uint64_t asid_pool[  (1 << MMU_ARM64_ASID_BITS) / 64 ];
 static mutex_t asid_lock = MUTEX_INITIAL_VALUE(asid_lock);
 
+/* translation tables allocated after boot, in every aspace */
+KCOUNTER(page_table_bytes, "vm.page_table.bytes");
+
 uint32_t arm64_zva_shift;
 
 /* the main translation table */
@@ -40,31 +43,36 @@ pte_t arm64_kernel_translation_table[MMU_KERNEL_PAGE_TABLE_ENTRIES_TOP]
 
 static status_t arm64_mmu_alloc_asid(uint16_t* asid) {
 
-    uint16_t new_asid;
-    uint32_t retry = 1 << MMU_ARM64_ASID_BITS;
+    const uint32_t count = 1U << MMU_ARM64_ASID_BITS;
+    static uint32_t next_asid = 1;
 
+    /* hand asids out in order, starting after the last one, so a freed asid
+     * isn't reused straight away; asid 0 is never handed out */
     mutex_acquire(&asid_lock);
-    do {
-        new_asid = rand() & ~(-(1 << MMU_ARM64_ASID_BITS));
-        retry--;
-        if (retry == 0)
-            return ERR_NO_MEMORY;
-    } while ((asid_pool[new_asid >> 6] & (1 << (new_asid % 64))) || (new_asid == 0));
-
-    asid_pool[new_asid >> 6] = asid_pool[new_asid >> 6] | (1 << (new_asid % 64));
-
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t new_asid = (next_asid + i) % count;
+        if (new_asid == 0)
+            continue;
+        if (asid_pool[new_asid / 64] & (1ULL << (new_asid % 64)))
+            continue;
+
+        asid_pool[new_asid / 64] |= 1ULL << (new_asid % 64);
+        next_asid = new_asid + 1;
+        mutex_release(&asid_lock);
+
+        *asid = (uint16_t)new_asid;
+        return NO_ERROR;
+    }
     mutex_release(&asid_lock);
 
-    *asid = new_asid;
-
-    return NO_ERROR;
+    return ERR_NO_MEMORY;
 }
 
 static status_t arm64_mmu_free_asid(uint16_t asid) {
 
     mutex_acquire(&asid_lock);
 
-    asid_pool[asid >> 6] = asid_pool[asid >> 6] & ~(1 << (asid % 64));
+    asid_pool[asid / 64] &= ~(1ULL << (asid % 64));
 
     mutex_release(&asid_lock);
 
@@ -262,6 +270,7 @@ static int alloc_page_table(paddr_t *paddrp, uint page_size_shift)
         }
     }
 
+    kcounter_add(&page_table_bytes, size);
     LTRACEF("allocated 0x%lx\n", *paddrp);
     return 0;
 }
@@ -273,6 +282,7 @@ static void free_page_table(void *vaddr, paddr_t paddr, uint page_size_shift)
     size_t size = 1U << page_size_shift;
     vm_page_t *page;
 
+    kcounter_add(&page_table_bytes, -(int64_t)size);
     if (size >= PAGE_SIZE) {
         page = paddr_to_vm_page(paddr);
         if (!page)
@@ -324,6 +334,58 @@ static pte_t *arm64_mmu_get_page_table(vaddr_t index, uint page_size_shift, pte_
     }
 }
 
+/* Replace the block mapping at page_table[index] with a table of the next
+ * smaller size mapping the same range, so that part of it can be changed. */
+static pte_t *arm64_mmu_split_block(vaddr_t vaddr, vaddr_t index,
+                                    uint index_shift, uint page_size_shift,
+                                    pte_t *page_table, uint asid)
+{
+    pte_t pte = page_table[index];
+    paddr_t paddr;
+    pte_t *next_page_table;
+    uint next_index_shift = index_shift - (page_size_shift - 3);
+    uint count = 1U << (page_size_shift - 3);
+    paddr_t block_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    uint i;
+
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    LTRACEF("vaddr %#" PRIxPTR ", index shift %u, pte %#" PRIx64 "\n", vaddr, index_shift, pte);
+
+    if (alloc_page_table(&paddr, page_size_shift)) {
+        TRACEF("failed to allocate page table\n");
+        return NULL;
+    }
+    next_page_table = paddr_to_kvaddr(paddr);
+
+    for (i = 0; i < count; i++) {
+        pte_t entry = (block_paddr + ((paddr_t)i << next_index_shift)) | attrs;
+        if (next_index_shift > page_size_shift)
+            entry |= MMU_PTE_L012_DESCRIPTOR_BLOCK;
+        else
+            entry |= MMU_PTE_L3_DESCRIPTOR_PAGE;
+        next_page_table[i] = entry;
+    }
+
+    __asm__ volatile("dmb ishst" ::: "memory");
+
+    /* break before make: the block has to be out of the tlb before the table
+     * takes its place */
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    DSB;
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI(vaae1is, vaddr >> 12);
+    else
+        ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+    DSB;
+
+    page_table[index] = paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+    __asm__ volatile("dmb ishst" ::: "memory");
+
+    return next_page_table;
+}
+
 static bool page_table_is_clear(pte_t *page_table, uint page_size_shift)
 {
     int i;
@@ -372,6 +434,15 @@ static int arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        /* only part of a block is going away, split it up first */
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+                (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (!arm64_mmu_split_block(vaddr, index, index_shift, page_size_shift,
+                                       page_table, asid))
+                panic("failed to split block mapping at %#" PRIxPTR "\n", vaddr);
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
                 (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -531,6 +602,15 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        /* changing part of a block, split it up first */
+        if (index_shift > page_size_shift && chunk_size != block_size &&
+                (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK) {
+            if (!arm64_mmu_split_block(vaddr, index, index_shift, page_size_shift,
+                                       page_table, asid))
+                goto err;
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
                 (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -735,6 +815,114 @@ int arch_mmu_unmap(arch_aspace_t *aspace, vaddr_t vaddr, size_t count)
     return (ret < 0) ? ret : (ret / (int)PAGE_SIZE);
 }
 
+/* Collect every page table below page_table on list without clearing any
+ * entries, for a translation table that is being thrown away whole. */
+static void arm64_mmu_collect_tables(pte_t *page_table, size_t count,
+                                     uint index_shift, uint page_size_shift,
+                                     struct list_node *list)
+{
+    /* the entries of the last level are pages */
+    if (index_shift <= page_size_shift)
+        return;
+
+    for (size_t i = 0; i < count; i++) {
+        pte_t pte = page_table[i];
+        if ((pte & MMU_PTE_DESCRIPTOR_MASK) != MMU_PTE_L012_DESCRIPTOR_TABLE)
+            continue;
+
+        paddr_t page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+        arm64_mmu_collect_tables(paddr_to_kvaddr(page_table_paddr),
+                                 1U << (page_size_shift - 3),
+                                 index_shift - (page_size_shift - 3),
+                                 page_size_shift, list);
+
+        vm_page_t *page = paddr_to_vm_page(page_table_paddr);
+        if (!page)
+            panic("bad page table paddr 0x%lx\n", page_table_paddr);
+        list_add_tail(list, &page->free.node);
+        kcounter_add(&page_table_bytes, -(int64_t)PAGE_SIZE);
+    }
+}
+
+status_t arch_mmu_unmap_all(arch_aspace_t *aspace)
+{
+    LTRACEF("aspace %p\n", aspace);
+
+    DEBUG_ASSERT(aspace);
+    DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
+    DEBUG_ASSERT(aspace->tt_virt);
+
+    if (aspace->flags & ARCH_ASPACE_FLAG_KERNEL)
+        return ERR_NOT_SUPPORTED;
+
+    /* smaller page tables come from the heap, take them down the slow way */
+    if (MMU_USER_PAGE_SIZE_SHIFT != PAGE_SIZE_SHIFT) {
+        int ret = arch_mmu_unmap(aspace, aspace->base, aspace->size / PAGE_SIZE);
+        return (ret < 0) ? ret : NO_ERROR;
+    }
+
+    /* the top level table belongs to the aspace alone, so clear it in one
+     * go, drop everything tagged with the asid, and only then free the
+     * tables that hung off it */
+    struct list_node list = LIST_INITIAL_VALUE(list);
+    size_t count = 1UL << (MMU_USER_SIZE_SHIFT - MMU_USER_TOP_SHIFT);
+    arm64_mmu_collect_tables(aspace->tt_virt, count, MMU_USER_TOP_SHIFT,
+                             MMU_USER_PAGE_SIZE_SHIFT, &list);
+    memset(aspace->tt_virt, 0, count * sizeof(pte_t));
+
+    DSB;
+    ARM64_TLBI(aside1is, (vaddr_t)aspace->asid << 48);
+    DSB;
+
+    if (!list_is_empty(&list))
+        pmm_free(&list);
+
+    return NO_ERROR;
+}
+
+/* The size of the tables below page_table. */
+static size_t arm64_mmu_count_tables(pte_t *page_table, size_t count,
+                                     uint index_shift, uint page_size_shift)
+{
+    if (index_shift <= page_size_shift)
+        return 0;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        pte_t pte = page_table[i];
+        if ((pte & MMU_PTE_DESCRIPTOR_MASK) != MMU_PTE_L012_DESCRIPTOR_TABLE)
+            continue;
+
+        paddr_t page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+        bytes += (1UL << page_size_shift) +
+                 arm64_mmu_count_tables(paddr_to_kvaddr(page_table_paddr),
+                                        1U << (page_size_shift - 3),
+                                        index_shift - (page_size_shift - 3),
+                                        page_size_shift);
+    }
+    return bytes;
+}
+
+size_t arch_mmu_page_table_bytes(arch_aspace_t *aspace)
+{
+    DEBUG_ASSERT(aspace);
+    DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
+    DEBUG_ASSERT(aspace->tt_virt);
+
+    if (aspace->flags & ARCH_ASPACE_FLAG_KERNEL) {
+        size_t count = 1UL << (MMU_KERNEL_SIZE_SHIFT - MMU_KERNEL_TOP_SHIFT);
+        return count * sizeof(pte_t) +
+               arm64_mmu_count_tables(aspace->tt_virt, count, MMU_KERNEL_TOP_SHIFT,
+                                      MMU_KERNEL_PAGE_SIZE_SHIFT);
+    }
+
+    /* the top level table is always a whole page */
+    size_t count = 1UL << (MMU_USER_SIZE_SHIFT - MMU_USER_TOP_SHIFT);
+    return PAGE_SIZE +
+           arm64_mmu_count_tables(aspace->tt_virt, count, MMU_USER_TOP_SHIFT,
+                                  MMU_USER_PAGE_SIZE_SHIFT);
+}
+
 int arch_mmu_protect(arch_aspace_t *aspace, vaddr_t vaddr, size_t count, uint flags)
 {
     DEBUG_ASSERT(aspace);
@@ -810,6 +998,7 @@ status_t arch_mmu_init_aspace(arch_aspace_t *aspace, vaddr_t base, size_t size,
 
         aspace->tt_virt = va;
         aspace->tt_phys = pa;
+        kcounter_add(&page_table_bytes, PAGE_SIZE);
 
         /* zero the top level translation table */
         /* XXX remove when PMM starts returning pre-zeroed pages */
@@ -835,6 +1024,7 @@ status_t arch_mmu_destroy_aspace(arch_aspace_t *aspace)
     vm_page_t *page = paddr_to_vm_page(aspace->tt_phys);
     DEBUG_ASSERT(page);
     pmm_free_page(page);
+    kcounter_add(&page_table_bytes, -(int64_t)PAGE_SIZE);
 
     ARM64_TLBI(ASIDE1IS,aspace->asid);
 
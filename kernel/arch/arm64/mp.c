@@ -15,6 +15,8 @@
 
 #if WITH_DEV_INTERRUPT_ARM_GIC
 #include <dev/interrupt/arm_gic.h>
+#elif WITH_DEV_INTERRUPT_ARM_GICV3
+#include <dev/interrupt/arm_gicv3.h>
 #elif PLATFORM_BCM28XX
 /* bcm28xx has a weird custom interrupt controller for MP */
 #include <platform/bcm28xx.h>
@@ -31,14 +33,18 @@ status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi)
 {
     LTRACEF("target 0x%x, ipi %u\n", target, ipi);
 
-#if WITH_DEV_INTERRUPT_ARM_GIC
+#if WITH_DEV_INTERRUPT_ARM_GIC || WITH_DEV_INTERRUPT_ARM_GICV3
     uint gic_ipi_num = ipi + GIC_IPI_BASE;
 
     /* filter out targets outside of the range of cpus we care about */
     target &= ((1UL << SMP_MAX_CPUS) - 1);
     if (target != 0) {
         LTRACEF("target 0x%x, gic_ipi %u\n", target, gic_ipi_num);
+#if WITH_DEV_INTERRUPT_ARM_GIC
         arm_gic_sgi(gic_ipi_num, ARM_GIC_SGI_FLAG_NS, target);
+#else
+        arm_gicv3_sgi(gic_ipi_num, target);
+#endif
     }
 #elif PLATFORM_BCM28XX
     /* filter out targets outside of the range of cpus we care about */
@@ -67,7 +73,7 @@ static enum handler_return arm_ipi_reschedule_handler(void *arg)
 
 void arch_mp_init_percpu(void)
 {
-#if WITH_DEV_INTERRUPT_ARM_GIC
+#if WITH_DEV_INTERRUPT_ARM_GIC || WITH_DEV_INTERRUPT_ARM_GICV3
     register_int_handler(MP_IPI_GENERIC + GIC_IPI_BASE, &arm_ipi_generic_handler, 0);
     register_int_handler(MP_IPI_RESCHEDULE + GIC_IPI_BASE, &arm_ipi_reschedule_handler, 0);
     mp_set_curr_cpu_online(true);
@@ -32,6 +32,9 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/user_copy_c.c \
 	$(LOCAL_DIR)/uspace_entry.S
 
+MODULE_DEPS += \
+	lib/counters
+
 KERNEL_DEFINES += \
 	ARM64_CPU_$(ARM_CPU)=1 \
 	ARM_ISA_ARMV8=1 \
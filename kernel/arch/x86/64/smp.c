@@ -18,6 +18,7 @@
 #include <arch/x86/mmu_mem_types.h>
 #include <arch/x86/mp.h>
 #include <lk/main.h>
+#include <platform.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
@@ -33,6 +34,17 @@ void x86_init_smp(uint32_t *apic_ids, uint32_t num_cpus)
     lk_init_secondary_cpus(num_cpus - 1);
 }
 
+// Spins until all the APs in *mask have checked in, or |usecs| have gone
+// by.  Returns whether they all did.
+static bool x86_wait_for_aps(volatile int *mask, lk_bigtime_t usecs)
+{
+    lk_bigtime_t deadline = current_time_hires() + usecs;
+    while (*mask != 0 && current_time_hires() < deadline) {
+        arch_spinloop_pause();
+    }
+    return *mask == 0;
+}
+
 status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
 {
     volatile int aps_still_booting = 0;
@@ -95,31 +107,34 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
     // Actually send the startups
     ASSERT(PHYS_BOOTSTRAP_PAGE < 1 * MB);
     uint8_t vec = PHYS_BOOTSTRAP_PAGE >> PAGE_SIZE_SHIFT;
-    // Try up to two times per CPU, as Intel 3A recommends.
-    for (int tries = 0; tries < 2; ++tries) {
+    // Try up to two times per CPU, 200us apart, as Intel 3A recommends.  The
+    // second try only goes to the CPUs that haven't checked in by then.
+    for (int tries = 0; tries < 2 && aps_still_booting != 0; ++tries) {
+        int booting = aps_still_booting;
         for (unsigned int i = 0; i < count; ++i) {
             uint32_t apic_id = apic_ids[i];
+            if ((booting & (1U << x86_apic_id_to_cpu_num(apic_id))) == 0) {
+                continue;
+            }
 
             // This will cause the APs to begin executing at PHYS_BOOTSTRAP_PAGE in
             // physical memory.
             apic_send_ipi(vec, apic_id, DELIVERY_MODE_STARTUP);
         }
-
-        if (aps_still_booting == 0) {
-            break;
-        }
-        // Wait 1ms for cores to boot.  The docs recommend 200us between STARTUP
-        // IPIs.
-        thread_sleep(1);
+        x86_wait_for_aps(&aps_still_booting, 200);
     }
 
-    // The docs recommend waiting 200us for cores to boot.  We do a bit more
-    // work before the cores report in, so wait longer (up to 1 second).
-    for (int tries_left = 200;
-         aps_still_booting != 0 && tries_left > 0;
-         --tries_left) {
+    // All the APs run their early init at once, with their caches in no-fill
+    // mode until they check in, so give them a while.  Spin for the first
+    // 10ms, which is all it usually takes, so that the last one to check in
+    // is noticed straight away, then sleep between looks (up to 1 second).
+    if (!x86_wait_for_aps(&aps_still_booting, 10000)) {
+        for (int tries_left = 200;
+             aps_still_booting != 0 && tries_left > 0;
+             --tries_left) {
 
-        thread_sleep(5);
+            thread_sleep(5);
+        }
     }
 
     uint failed_aps = (uint)atomic_swap(&aps_still_booting, 0);
@@ -21,6 +21,7 @@
 #include <arch/x86.h>
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
+#include <arch/x86/idle.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
 #include <arch/x86/mp.h>
@@ -56,6 +57,8 @@ void arch_init(void)
     x86_feature_debug();
 
     x86_mmu_init();
+
+    x86_idle_init();
 }
 
 void arch_chain_load(void *entry, ulong arg0, ulong arg1, ulong arg2, ulong arg3)
@@ -12,6 +12,7 @@
 #include <arch/x86/apic.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/descriptor.h>
+#include <kernel/irqsoff.h>
 #include <kernel/thread.h>
 #include <platform.h>
 
@@ -303,6 +304,14 @@ void x86_exception_handler(x86_iframe_t *frame)
 
     ktrace_tiny(TAG_IRQ_ENTER, (frame->vector << 8) | arch_curr_cpu_num());
 
+#if IRQSOFF_TRACE
+    /* interrupts went off when the gate was taken, not in anything we hook,
+     * and come back on with the iret. an nmi may land inside the tracker. */
+    bool trace_irqsoff = (frame->flags & X86_FLAGS_IF) && frame->vector != X86_INT_NMI;
+    if (trace_irqsoff)
+        irqsoff_irq_enter((uint32_t)frame->vector, frame->ip);
+#endif
+
     switch (frame->vector) {
         case X86_INT_DEBUG:
             x86_debug_handler(frame);
@@ -353,6 +362,10 @@ void x86_exception_handler(x86_iframe_t *frame)
             break;
         }
         case X86_INT_APIC_TIMER: {
+#if ARCH_X86_64
+            if (unlikely(ktrace_sampling_on()))
+                ktrace_sample_irq(frame->ip, frame->rbp, from_user);
+#endif
             ret = apic_timer_interrupt_handler();
             apic_issue_eoi();
             break;
@@ -397,6 +410,11 @@ void x86_exception_handler(x86_iframe_t *frame)
     if (ret != INT_NO_RESCHEDULE)
         thread_preempt(true);
 
+#if IRQSOFF_TRACE
+    if (trace_irqsoff)
+        irqsoff_irq_exit();
+#endif
+
     ktrace_tiny(TAG_IRQ_EXIT, (frame->vector << 8) | arch_curr_cpu_num());
 
     DEBUG_ASSERT_MSG(arch_ints_disabled(),
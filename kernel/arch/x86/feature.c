@@ -23,6 +23,8 @@ uint32_t max_ext_cpuid = 0;
 
 enum x86_vendor_list x86_vendor;
 
+bool x86_erms;
+
 static struct x86_model_info model_info;
 
 static int initialized = 0;
@@ -95,6 +97,8 @@ void x86_feature_init(void)
             model_info.display_model += BITS_SHIFT(leaf->a, 19, 16) << 4;
         }
     }
+
+    x86_erms = x86_feature_test(X86_FEATURE_ERMS);
 }
 
 bool x86_get_cpuid_subleaf(
@@ -154,16 +158,20 @@ void x86_feature_debug(void)
         { X86_FEATURE_AESNI, "aesni" },
         { X86_FEATURE_TSC_ADJUST, "tsc_adj" },
         { X86_FEATURE_SMEP, "smep" },
+        { X86_FEATURE_ERMS, "erms" },
         { X86_FEATURE_SMAP, "smap" },
         { X86_FEATURE_RDRAND, "rdrand" },
         { X86_FEATURE_RDSEED, "rdseed" },
         { X86_FEATURE_PKU, "pku" },
+        { X86_FEATURE_PCID, "pcid" },
         { X86_FEATURE_SYSCALL, "syscall" },
         { X86_FEATURE_NX, "nx" },
         { X86_FEATURE_HUGE_PAGE, "huge" },
         { X86_FEATURE_RDTSCP, "rdtscp" },
         { X86_FEATURE_INVAR_TSC, "invar_tsc" },
         { X86_FEATURE_TSC_DEADLINE, "tsc_deadline" },
+        { X86_FEATURE_MON, "monitor" },
+        { X86_FEATURE_ARAT, "arat" },
     };
 
     const char *vendor_string;
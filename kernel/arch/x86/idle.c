@@ -0,0 +1,235 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <arch/x86/idle.h>
+
+#include <arch/ops.h>
+#include <arch/x86.h>
+#include <arch/x86/feature.h>
+#include <assert.h>
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/mutex.h>
+#include <kernel/timer.h>
+#include <lib/console.h>
+#include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+#define LOCAL_TRACE 0
+
+/* a state is only worth entering for an idle period at least this many times
+ * as long as its exit latency, the rule of thumb the ACPI spec suggests */
+#define RESIDENCY_FACTOR 2
+
+/* each idle period moves the running average 1/8 of the way towards it */
+#define AVG_SHIFT 3
+
+struct idle_cpu {
+    /* the line mwait watches; nothing writes to it, interrupts wake us */
+    volatile uint32_t monitor;
+
+    bool poll;
+
+    /* how long this cpu has recently been staying idle, in ns */
+    lk_bigtime_t avg_idle_ns;
+
+    uint64_t entries[X86_IDLE_MAX_STATES];
+    lk_bigtime_t time_ns[X86_IDLE_MAX_STATES];
+} __ALIGNED(CACHE_LINE);
+
+static struct idle_cpu idle_cpus[SMP_MAX_CPUS];
+
+/* States the idle loop may pick from, C1 first. Replacing them races with
+ * cpus going idle, which may pick a state from the old table with a hint
+ * from the new one; any of them is one the cpu supports, just not
+ * necessarily the one it meant. None at all means only hlt is usable. */
+static struct x86_idle_state states[X86_IDLE_MAX_STATES];
+static uint state_count;
+static mutex_t states_lock = MUTEX_INITIAL_VALUE(states_lock);
+
+/* deeper than C1 the local apic timer or the tsc may stop, unless cpuid
+ * promises they don't */
+static bool deep_states_ok;
+
+void x86_idle_init(void)
+{
+    if (!cmdline_get_bool("kernel.idle.mwait", true) ||
+            !x86_feature_test(X86_FEATURE_MON) ||
+            !x86_feature_test(X86_FEATURE_MWAIT_EXT) ||
+            !x86_feature_test(X86_FEATURE_MWAIT_INTR)) {
+        dprintf(INFO, "idle: using hlt\n");
+    } else {
+        states[0] = (struct x86_idle_state){ .type = 1, .mwait_hint = 0, .latency_us = 1 };
+        __atomic_store_n(&state_count, 1, __ATOMIC_RELEASE);
+        deep_states_ok = x86_feature_test(X86_FEATURE_ARAT) &&
+                         x86_feature_test(X86_FEATURE_INVAR_TSC);
+        dprintf(INFO, "idle: using mwait%s\n", deep_states_ok ? "" : ", C1 only");
+    }
+
+    uint32_t poll = cmdline_get_uint32("kernel.idle.poll", 0);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        idle_cpus[cpu].poll = cpu < 32 && (poll & (1u << cpu));
+}
+
+/* whether cpuid lists the sub state the hint asks for */
+static bool mwait_hint_supported(uint32_t hint)
+{
+    const struct cpuid_leaf *leaf = x86_get_cpuid_leaf(X86_CPUID_MWAIT);
+    uint cstate = ((hint >> 4) & 0xf) + 1;
+    if (!leaf || cstate > 7)
+        return false;
+    return ((leaf->d >> (cstate * 4)) & 0xf) > (hint & 0xf);
+}
+
+status_t x86_idle_set_states(const struct x86_idle_state *new_states, uint count)
+{
+    if (count >= X86_IDLE_MAX_STATES)
+        return ERR_INVALID_ARGS;
+    for (uint i = 0; i < count; i++) {
+        if (new_states[i].type < 1 || new_states[i].type > 3)
+            return ERR_INVALID_ARGS;
+        if (i > 0 && new_states[i].latency_us < new_states[i - 1].latency_us)
+            return ERR_INVALID_ARGS;
+    }
+
+    mutex_acquire(&states_lock);
+
+    if (__atomic_load_n(&state_count, __ATOMIC_RELAXED) == 0) {
+        mutex_release(&states_lock);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    /* C1 stays the one cpuid gave us, the rest are what the firmware says */
+    __atomic_store_n(&state_count, 1, __ATOMIC_RELEASE);
+    uint n = 1;
+    for (uint i = 0; i < count; i++) {
+        const struct x86_idle_state *s = &new_states[i];
+        if (s->type == 1 || !deep_states_ok || !mwait_hint_supported(s->mwait_hint)) {
+            LTRACEF("skipping C%u hint %#x\n", s->type, s->mwait_hint);
+            continue;
+        }
+        states[n++] = *s;
+    }
+    __atomic_store_n(&state_count, n, __ATOMIC_RELEASE);
+
+    mutex_release(&states_lock);
+
+    dprintf(INFO, "idle: %u C states\n", n);
+    return NO_ERROR;
+}
+
+void x86_idle_set_poll(uint cpu, bool poll)
+{
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+    idle_cpus[cpu].poll = poll;
+}
+
+/* the deepest state whose exit latency the idle period we expect is worth */
+static uint pick_state(struct idle_cpu *ic, uint count)
+{
+    lk_bigtime_t predicted = ic->avg_idle_ns;
+
+    /* we won't sleep past the next timer, whatever the past says */
+    lk_time_t delay = timer_next_delay();
+    if (delay != INFINITE_TIME && (lk_bigtime_t)delay * 1000000 < predicted)
+        predicted = (lk_bigtime_t)delay * 1000000;
+
+    uint i = 0;
+    while (i + 1 < count &&
+           (lk_bigtime_t)states[i + 1].latency_us * 1000 * RESIDENCY_FACTOR <= predicted)
+        i++;
+    return i;
+}
+
+void arch_idle(void)
+{
+    /* nothing could wake us */
+    if (arch_ints_disabled())
+        return;
+
+    struct idle_cpu *ic = &idle_cpus[arch_curr_cpu_num()];
+
+    if (ic->poll) {
+        /* an interrupt preempts us from its handler as soon as it's taken */
+        arch_spinloop_pause();
+        return;
+    }
+
+    uint count = __atomic_load_n(&state_count, __ATOMIC_ACQUIRE);
+    /* the time asleep is left out of the interrupts off times by going
+     * around arch_disable_ints() and arch_enable_ints() */
+    if (count == 0) {
+        x86_cli();
+        x86_sti_hlt();
+        return;
+    }
+
+    /* With interrupts off an interrupt still wakes mwait, but isn't taken
+     * until we turn them back on, so the time asleep can be measured before
+     * the handler has had a chance to switch to another thread. */
+    x86_cli();
+    uint i = pick_state(ic, count);
+    lk_bigtime_t start = current_time_hires();
+
+    x86_monitor(&ic->monitor);
+    x86_mwait(states[i].mwait_hint);
+
+    lk_bigtime_t slept = current_time_hires() - start;
+    ic->avg_idle_ns += (slept >> AVG_SHIFT) - (ic->avg_idle_ns >> AVG_SHIFT);
+    ic->entries[i]++;
+    ic->time_ns[i] += slept;
+
+    x86_sti();
+}
+
+static int cmd_idle(int argc, const cmd_args *argv)
+{
+    if (argc < 2) {
+        uint count = __atomic_load_n(&state_count, __ATOMIC_ACQUIRE);
+        if (count == 0)
+            printf("hlt\n");
+        for (uint i = 0; i < count; i++) {
+            printf("state %u: C%u hint %#x latency %uus\n", i, states[i].type,
+                   states[i].mwait_hint, states[i].latency_us);
+        }
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            const struct idle_cpu *ic = &idle_cpus[cpu];
+            printf("cpu %u:%s avg idle %" PRIu64 "us\n", cpu, ic->poll ? " poll," : "",
+                   ic->avg_idle_ns / 1000);
+            for (uint i = 0; i < count; i++) {
+                if (ic->entries[i] == 0)
+                    continue;
+                printf("\tstate %u: entered %" PRIu64 " for %" PRIu64 "ms\n", i,
+                       ic->entries[i], ic->time_ns[i] / 1000000);
+            }
+        }
+        return NO_ERROR;
+    }
+
+    if (!strcmp(argv[1].str, "poll") && argc >= 4) {
+        if (argv[2].u >= SMP_MAX_CPUS) {
+            printf("bad cpu\n");
+            return ERR_INVALID_ARGS;
+        }
+        x86_idle_set_poll(argv[2].u, argv[3].u != 0);
+        return NO_ERROR;
+    }
+
+    printf("usage:\n");
+    printf("%s\n", argv[0].str);
+    printf("%s poll <cpu> <0|1>\n", argv[0].str);
+    return ERR_INVALID_ARGS;
+}
+
+STATIC_COMMAND_START
+#if LK_DEBUGLEVEL > 0
+STATIC_COMMAND("idle", "cpu idle states", &cmd_idle)
+#endif
+STATIC_COMMAND_END(idle);
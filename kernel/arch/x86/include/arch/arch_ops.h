@@ -14,6 +14,7 @@
 
 #include <arch/x86.h>
 #include <arch/x86/mp.h>
+#include <kernel/irqsoff.h>
 
 __BEGIN_CDECLS
 
@@ -21,13 +22,23 @@ __BEGIN_CDECLS
 static inline void arch_enable_ints(void)
 {
     CF;
+#if IRQSOFF_TRACE
+    irqsoff_ints_enabling();
+#endif
     __asm__ volatile("sti");
 }
 
 static inline void arch_disable_ints(void)
 {
+#if IRQSOFF_TRACE
+    x86_flags_t flags = x86_save_flags();
+#endif
     __asm__ volatile("cli");
     CF;
+#if IRQSOFF_TRACE
+    if (flags & X86_FLAGS_IF)
+        irqsoff_ints_disabled();
+#endif
 }
 
 static inline bool arch_ints_disabled(void)
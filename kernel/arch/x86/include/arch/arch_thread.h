@@ -25,6 +25,9 @@ struct arch_thread {
     vaddr_t *extended_register_state;
     uint8_t extended_register_buffer[X86_MAX_EXTENDED_REGISTER_SIZE + 64];
 
+    /* the cpu this thread's state was last loaded on, or -1 */
+    int extended_register_cpu;
+
     /* if non-NULL, address to return to on page fault */
     void *page_fault_resume;
 };
@@ -33,6 +33,13 @@ struct arch_aspace {
      * actually an mp_cpu_mask_t, but header dependencies. */
     volatile int active_cpus;
 
+    /* never reused, so cpus can tell which aspace a PCID was last used for */
+    uint64_t pcid_aspace_id;
+
+    /* bumped on every TLB invalidation in this aspace; a cpu that kept this
+     * aspace's PCID compares against it to see if its entries went stale */
+    volatile uint64_t tlb_generation;
+
     /* Pointer to a bitmap::RleBitmap representing the range of ports
      * enabled in this aspace. */
     void *io_bitmap;
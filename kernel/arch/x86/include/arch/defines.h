@@ -11,7 +11,7 @@
 #define PAGE_SIZE 4096
 #define PAGE_SIZE_SHIFT 12
 
-#define CACHE_LINE 32
+#define CACHE_LINE 64
 
 #define ARCH_DEFAULT_STACK_SIZE 8192
 #define DEFAULT_TSS 4096
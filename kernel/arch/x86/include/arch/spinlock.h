@@ -8,6 +8,7 @@
 #pragma once
 
 #include <arch/x86.h>
+#include <kernel/irqsoff.h>
 #include <magenta/compiler.h>
 #include <stdbool.h>
 
@@ -71,11 +72,19 @@ arch_interrupt_save(spin_lock_saved_state_t *statep, spin_lock_save_flags_t flag
     *statep = x86_save_flags();
     __asm__ volatile("cli");
     CF;
+#if IRQSOFF_TRACE
+    if (*statep & X86_FLAGS_IF)
+        irqsoff_ints_disabled();
+#endif
 }
 
 static inline void
 arch_interrupt_restore(spin_lock_saved_state_t old_state, spin_lock_save_flags_t flags)
 {
+#if IRQSOFF_TRACE
+    if (old_state & X86_FLAGS_IF)
+        irqsoff_ints_enabling();
+#endif
     x86_restore_flags(old_state);
 }
 
@@ -178,6 +178,17 @@ static inline void x86_clts(void) {__asm__ __volatile__ ("clts"); }
 static inline void x86_hlt(void) {__asm__ __volatile__ ("hlt"); }
 static inline void x86_sti(void) {__asm__ __volatile__ ("sti"); }
 static inline void x86_cli(void) {__asm__ __volatile__ ("cli"); }
+static inline void x86_monitor(volatile void *addr)
+{
+    __asm__ __volatile__ ("monitor" :: "a" (addr), "c" (0), "d" (0) : "memory");
+}
+/* wakes for an interrupt even with them disabled, where cpuid says it can */
+static inline void x86_mwait(uint32_t hint)
+{
+    __asm__ __volatile__ ("mwait" :: "a" (hint), "c" (1) : "memory");
+}
+/* enables interrupts in the sti shadow, so one already pending wakes it */
+static inline void x86_sti_hlt(void) {__asm__ __volatile__ ("sti; hlt"); }
 static inline void x86_ltr(uint16_t sel)
 {
     __asm__ __volatile__ ("ltr %%ax" :: "a" (sel));
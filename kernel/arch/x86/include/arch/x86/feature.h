@@ -26,6 +26,8 @@ struct cpuid_leaf {
 enum x86_cpuid_leaf_num {
     X86_CPUID_BASE = 0,
     X86_CPUID_MODEL_FEATURES = 0x1,
+    X86_CPUID_MWAIT = 0x5,
+    X86_CPUID_THERMAL_POWER = 0x6,
     X86_CPUID_TOPOLOGY = 0xb,
     X86_CPUID_XSAVE = 0xd,
 
@@ -92,7 +94,9 @@ void x86_feature_debug(void);
 
 /* add feature bits to test here */
 #define X86_FEATURE_SSE3         X86_CPUID_BIT(0x1, 2, 0)
+#define X86_FEATURE_MON          X86_CPUID_BIT(0x1, 2, 3)
 #define X86_FEATURE_SSSE3        X86_CPUID_BIT(0x1, 2, 9)
+#define X86_FEATURE_PCID         X86_CPUID_BIT(0x1, 2, 17)
 #define X86_FEATURE_SSE4_1       X86_CPUID_BIT(0x1, 2, 19)
 #define X86_FEATURE_SSE4_2       X86_CPUID_BIT(0x1, 2, 20)
 #define X86_FEATURE_TSC_DEADLINE X86_CPUID_BIT(0x1, 2, 24)
@@ -105,9 +109,13 @@ void x86_feature_debug(void);
 #define X86_FEATURE_FXSR         X86_CPUID_BIT(0x1, 3, 24)
 #define X86_FEATURE_SSE          X86_CPUID_BIT(0x1, 3, 25)
 #define X86_FEATURE_SSE2         X86_CPUID_BIT(0x1, 3, 26)
+#define X86_FEATURE_MWAIT_EXT    X86_CPUID_BIT(0x5, 2, 0)
+#define X86_FEATURE_MWAIT_INTR   X86_CPUID_BIT(0x5, 2, 1)
+#define X86_FEATURE_ARAT         X86_CPUID_BIT(0x6, 0, 2)
 #define X86_FEATURE_TSC_ADJUST   X86_CPUID_BIT(0x7, 1, 1)
 #define X86_FEATURE_AVX2         X86_CPUID_BIT(0x7, 1, 5)
 #define X86_FEATURE_SMEP         X86_CPUID_BIT(0x7, 1, 7)
+#define X86_FEATURE_ERMS         X86_CPUID_BIT(0x7, 1, 9)
 #define X86_FEATURE_RDSEED       X86_CPUID_BIT(0x7, 1, 18)
 #define X86_FEATURE_SMAP         X86_CPUID_BIT(0x7, 1, 20)
 #define X86_FEATURE_PKU          X86_CPUID_BIT(0x7, 2, 3)
@@ -153,6 +161,10 @@ enum x86_vendor_list {
 
 extern enum x86_vendor_list x86_vendor;
 
+/* set by x86_feature_init() if rep movsb/stosb are fast for any length, for
+ * the string and user copy routines */
+extern bool x86_erms;
+
 /* topology */
 
 #define X86_TOPOLOGY_INVALID 0
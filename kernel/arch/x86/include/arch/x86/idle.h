@@ -0,0 +1,36 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+#define X86_IDLE_MAX_STATES 8
+
+/* a C state the idle loop can put a cpu in, shallowest first */
+struct x86_idle_state {
+    uint32_t type;          /* ACPI C state type, 1 to 3 */
+    uint32_t mwait_hint;
+    uint32_t latency_us;    /* worst case exit latency */
+};
+
+/* picks C1 out of cpuid, called on the boot cpu once features are known */
+void x86_idle_init(void);
+
+/* replaces the states past C1 with those the firmware describes, each
+ * entered with mwait. states must be sorted by latency. */
+status_t x86_idle_set_states(const struct x86_idle_state *states, uint count);
+
+/* a polling cpu spins rather than sleeps, so it comes out of idle in the
+ * time it takes to take an interrupt */
+void x86_idle_set_poll(uint cpu, bool poll);
+
+__END_CDECLS
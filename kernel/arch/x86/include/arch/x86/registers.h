@@ -20,6 +20,7 @@
 #define X86_CR4_PGE                     0x00000080 /* page global enable */
 #define X86_CR4_OSFXSR                  0x00000200 /* os supports fxsave */
 #define X86_CR4_OSXMMEXPT               0x00000400 /* os supports xmm exception */
+#define X86_CR4_PCIDE                   0x00020000 /* process-context identifiers */
 #define X86_CR4_OSXSAVE                 0x00040000 /* os supports xsave */
 #define X86_CR4_SMEP                    0x00100000 /* SMEP protection enabling */
 #define X86_CR4_SMAP                    0x00200000 /* SMAP protection enabling */
@@ -35,6 +36,8 @@
 #define X86_MSR_IA32_GS_BASE            0xc0000101 /* gs base address */
 #define X86_MSR_IA32_KERNEL_GS_BASE     0xc0000102 /* kernel gs base */
 #define X86_CR4_PSE 0xffffffef /* Disabling PSE bit in the CR4 */
+#define X86_CR3_PCID_MASK               0xfff /* PCID field when CR4.PCIDE is set */
+#define X86_CR3_NOFLUSH                 (1ull << 63) /* keep the PCID's TLB entries */
 
 /* EFLAGS/RFLAGS */
 #define X86_FLAGS_CF                    (1<<0)
@@ -18,6 +18,7 @@
 #include <arch/x86/mmu_mem_types.h>
 #include <kernel/mp.h>
 #include <kernel/vm.h>
+#include <lib/counters.h>
 
 #include <bitmap/rle-bitmap.h>
 
@@ -63,6 +64,9 @@ pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 /* kernel base top level page table in physical space */
 static const paddr_t kernel_pt_phys = (vaddr_t)KERNEL_PT - KERNEL_BASE;
 
+/* page tables allocated after boot, in every aspace */
+KCOUNTER(page_table_bytes, "vm.page_table.bytes");
+
 /* test the vaddr against the address space's range */
 static bool is_valid_vaddr(arch_aspace_t* aspace, vaddr_t vaddr) {
     return (vaddr >= aspace->base && vaddr <= aspace->base + aspace->size - 1);
@@ -337,57 +341,200 @@ static void tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
+/* The TLB invalidations a single page table operation needs, collected so
+ * that they can all be carried out with one cross-cpu round once the page
+ * tables have been updated. */
+struct PendingTlbInvalidation {
+    /* Past this many pages it is cheaper to flush everything */
+    static constexpr size_t kMaxPages = 32;
+
+    struct Item {
+        vaddr_t vaddr;
+        enum page_table_levels level;
+        bool is_global;
+    };
+
+    PendingTlbInvalidation() { list_initialize(&freed_tables); }
+    ~PendingTlbInvalidation() {
+        DEBUG_ASSERT(count == 0 && !full_shootdown);
+        DEBUG_ASSERT(list_is_empty(&freed_tables));
+    }
+
+    void enqueue(vaddr_t vaddr, enum page_table_levels level, bool is_global) {
+        contains_global |= is_global;
+#if X86_PAGING_LEVELS > 3
+        /* invalidating a whole PML4 entry takes a full flush anyway */
+        if (level == PML4_L) {
+            full_shootdown = true;
+            contains_global = true;
+        }
+#endif
+        if (full_shootdown)
+            return;
+        if (count == kMaxPages) {
+            full_shootdown = true;
+            return;
+        }
+        items[count++] = { vaddr, level, is_global };
+    }
+
+    /* Page tables unhooked by the operation can't be reused until no cpu can
+     * still be walking them or caching their entries. */
+    void free_table(pt_entry_t* table) {
+        vm_page_t* page = paddr_to_vm_page(X86_VIRT_TO_PHYS(table));
+        DEBUG_ASSERT(page);
+        list_add_tail(&freed_tables, &page->free.node);
+        kcounter_add(&page_table_bytes, -(int64_t)PAGE_SIZE);
+    }
+
+    void clear() {
+        count = 0;
+        full_shootdown = false;
+        contains_global = false;
+        if (!list_is_empty(&freed_tables))
+            pmm_free(&freed_tables);
+    }
+
+    Item items[kMaxPages];
+    size_t count = 0;
+    bool full_shootdown = false;
+    bool contains_global = false;
+    struct list_node freed_tables;
+};
+
+#if ARCH_X86_64
+/* PCIDs tag TLB entries with the address space they belong to, so switching
+ * between user aspaces doesn't throw the TLB away.  Each cpu hands its own
+ * small set of PCIDs to the user aspaces that ran on it most recently; PCID 0
+ * is the kernel's.  A cpu keeps the generation of the aspace it last saw for
+ * each PCID, and flushes the PCID on the way back in if that has moved on,
+ * since invalidations only reach cpus where the aspace is active. */
+static const uint kNumPcids = 8;
+struct pcid_cpu_state {
+    uint64_t aspace_id[kNumPcids];
+    uint64_t generation[kNumPcids];
+    uint next_victim;
+} __CPU_ALIGN;
+static pcid_cpu_state pcid_state[SMP_MAX_CPUS];
+static bool pcid_enabled;
+static uint64_t next_pcid_aspace_id = 1;
+
+/* Returns the value to load into cr3 to switch to the given user aspace on
+ * this cpu.  Must be called after the cpu is marked active in the aspace. */
+static ulong x86_pcid_cr3(arch_aspace_t* aspace) {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    if (!pcid_enabled)
+        return aspace->pt_phys;
+
+    pcid_cpu_state* state = &pcid_state[arch_curr_cpu_num()];
+    uint64_t generation = atomic_load_u64(&aspace->tlb_generation);
+
+    uint slot;
+    for (slot = 0; slot < kNumPcids; ++slot) {
+        if (state->aspace_id[slot] == aspace->pcid_aspace_id)
+            break;
+    }
+
+    bool flush = true;
+    if (slot < kNumPcids) {
+        /* still have a PCID for this aspace, its entries are good as long as
+         * nothing was invalidated while we were away */
+        flush = state->generation[slot] != generation;
+    } else {
+        /* take over the least recently handed out PCID */
+        slot = state->next_victim;
+        state->next_victim = (slot + 1) % kNumPcids;
+        state->aspace_id[slot] = aspace->pcid_aspace_id;
+    }
+    state->generation[slot] = generation;
+
+    ulong cr3 = aspace->pt_phys | (slot + 1);
+    if (!flush)
+        cr3 |= X86_CR3_NOFLUSH;
+    return cr3;
+}
+
+/* Note that this cpu has seen the given invalidation of the aspace it is
+ * running in, so its PCID for it is still current. */
+static void x86_pcid_invalidated(uint64_t generation) {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    uint pcid = x86_get_cr3() & X86_CR3_PCID_MASK;
+    if (!pcid_enabled || pcid == 0)
+        return;
+
+    /* only if it had seen all the earlier ones, which may still be on their
+     * way to this cpu */
+    pcid_cpu_state* state = &pcid_state[arch_curr_cpu_num()];
+    if (state->generation[pcid - 1] == generation - 1)
+        state->generation[pcid - 1] = generation;
+}
+#endif
+
+/* Task used for invalidating TLB entries on each CPU */
 struct tlb_invalidate_page_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    uint64_t generation;
+    const PendingTlbInvalidation* pending;
 };
 static void tlb_invalidate_page_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
     ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    bool is_target_aspace = context->target_cr3 == (cr3 & X86_PG_FRAME);
+    if (!is_target_aspace && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-#if X86_PAGING_LEVELS > 3
-        case PML4_L:
+    if (pending->full_shootdown) {
+        if (pending->contains_global) {
             tlb_global_invalidate();
-            break;
-#endif
-#if X86_PAGING_LEVELS > 2
-        case PDP_L:
-#endif
-        case PD_L:
-        case PT_L:
-            __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-            break;
+        } else {
+            /* reloading cr3 drops every non-global entry of the current PCID */
+            x86_set_cr3(cr3);
+        }
+    } else {
+        for (size_t i = 0; i < pending->count; ++i) {
+            const auto& item = pending->items[i];
+            if (!item.is_global && !is_target_aspace)
+                continue;
+            __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.vaddr));
+        }
     }
+
+#if ARCH_X86_64
+    if (is_target_aspace && context->generation != 0)
+        x86_pcid_invalidated(context->generation);
+#endif
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Carry out and clear a set of pending TLB invalidations
  *
  * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
- *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param pending The invalidations to carry out
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->count == 0 && !pending->full_shootdown) {
+        pending->clear();
+        return;
+    }
+
+    ulong cr3 = aspace ? aspace->pt_phys : (x86_get_cr3() & X86_PG_FRAME);
+    uint64_t generation = 0;
+#if ARCH_X86_64
+    /* cpus where the aspace isn't active keep whatever they have tagged with
+     * its PCID; moving the generation on makes them drop it when they switch
+     * back in.  This has to happen before the active cpus are sampled. */
+    if (aspace && !(aspace->flags & ARCH_ASPACE_FLAG_KERNEL))
+        generation = atomic_add_u64(&aspace->tlb_generation, 1) + 1;
+#endif
     struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
+        .target_cr3 = cr3, .generation = generation, .pending = pending,
     };
 
     /* Target only CPUs this aspace is active on.  It may be the case that some
@@ -396,7 +543,7 @@ void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_tab
      * the write to the page table, so it will see the change.  In the latter
      * case, it will get a spurious request to flush. */
     mp_cpu_mask_t targets;
-    if (global_page || aspace == NULL) {
+    if (pending->contains_global || aspace == NULL) {
         targets = MP_CPU_ALL;
     } else {
         targets = atomic_load(&aspace->active_cpus);
@@ -404,6 +551,7 @@ void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_tab
     }
 
     mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    pending->clear();
 }
 
 struct MappingCursor {
@@ -413,8 +561,8 @@ struct MappingCursor {
 };
 
 template <int Level>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+static void update_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                         paddr_t paddr, arch_flags_t flags) {
 
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
@@ -427,12 +575,13 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        x86_tlb_invalidate_page(aspace, vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
+        pending->enqueue(vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
     }
 }
 
 template <int Level>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, bool flush) {
+static void unmap_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                        bool flush) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -441,7 +590,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, b
 
     /* attempt to invalidate the page */
     if (flush && IS_PAGE_PRESENT(olde)) {
-        x86_tlb_invalidate_page(aspace, vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
+        pending->enqueue(vaddr, (page_table_levels)Level, is_kernel_address(vaddr));
     }
 }
 
@@ -458,6 +607,7 @@ static pt_entry_t* _map_alloc_page(void) {
 
     arch_zero_page(page_ptr);
     p->state = VM_PAGE_STATE_MMU;
+    kcounter_add(&page_table_bytes, PAGE_SIZE);
 
     return page_ptr;
 }
@@ -466,7 +616,7 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <int Level>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte) {
     static_assert(Level != PT_L, "tried splitting PT_L");
 #if X86_PAGING_LEVELS > 3
     // This can't easily be a static assert without duplicating
@@ -505,14 +655,14 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<Level - 1>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<Level - 1>(pending, new_vaddr, e, new_paddr, flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + page_size<Level>());
 
     flags = get_x86_intermediate_arch_flags();
-    update_entry<Level>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<Level>(pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
     return NO_ERROR;
 }
 
@@ -531,9 +681,8 @@ static bool level_supports_ps(page_table_levels level) {
         case PD_L:
             return true;
 #if X86_PAGING_LEVELS > 2
-        // TODO(teisenbe): Technically need to feature detect this
         case PDP_L:
-            return true;
+            return x86_feature_test(X86_FEATURE_HUGE_PAGE);
 #if X86_PAGING_LEVELS > 3
         case PML4_L:
             return false;
@@ -609,8 +758,8 @@ status_t x86_mmu_get_mapping<PT_L>(pt_entry_t* table, vaddr_t vaddr,
  * @return true if at least one page was unmapped at this level
  */
 template <int Level>
-static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, const MappingCursor& start_cursor,
-                                   MappingCursor* new_cursor) {
+static bool x86_mmu_remove_mapping(PendingTlbInvalidation* pending, pt_entry_t* table,
+                                   const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
     static_assert(Level < X86_PAGING_LEVELS, "level too high");
 
@@ -646,7 +795,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             bool vaddr_level_aligned = page_aligned<Level>(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<Level>(aspace, new_cursor->vaddr, e, true);
+                unmap_entry<Level>(pending, new_cursor->vaddr, e, true);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -656,7 +805,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<Level>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<Level>(pending, page_vaddr, e);
             if (status != NO_ERROR) {
                 panic("Need to implement recovery from split failure");
             }
@@ -665,7 +814,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<Level - 1>(
-                aspace, next_table, *new_cursor, &cursor);
+                pending, next_table, *new_cursor, &cursor);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -685,8 +834,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
             }
         }
         if (unmap_page_table) {
-            unmap_entry<Level>(aspace, new_cursor->vaddr, e, false);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<Level>(pending, new_cursor->vaddr, e, true);
+            pending->free_table(next_table);
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -700,8 +849,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table, con
 
 // Base case of x86_remove_mapping for smallest page size
 template <>
-bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, const MappingCursor& start_cursor,
-                                  MappingCursor* new_cursor) {
+bool x86_mmu_remove_mapping<PT_L>(PendingTlbInvalidation* pending, pt_entry_t* table,
+                                  const MappingCursor& start_cursor, MappingCursor* new_cursor) {
 
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -713,7 +862,7 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PT_L>(aspace, new_cursor->vaddr, e, true);
+            unmap_entry<PT_L>(pending, new_cursor->vaddr, e, true);
             unmapped = true;
         }
 
@@ -724,6 +873,47 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
     return unmapped;
 }
 
+/**
+ * @brief Queue every page table below table to be freed
+ *
+ * Nothing is unmapped; this is only for tables that have already been
+ * unhooked and will never be walked again, so the leaf entries don't need
+ * clearing one by one.
+ */
+template <int Level>
+static void x86_mmu_free_tables(PendingTlbInvalidation* pending, pt_entry_t* table) {
+    for (uint i = 0; i < NO_OF_PT_ENTRIES; ++i) {
+        pt_entry_t e = table[i];
+        if (!IS_PAGE_PRESENT(e) || IS_LARGE_PAGE(e))
+            continue;
+        pt_entry_t* next_table = get_next_table_from_entry(e);
+        x86_mmu_free_tables<Level - 1>(pending, next_table);
+        pending->free_table(next_table);
+    }
+}
+
+/* The entries of the smallest page tables are pages */
+template <>
+void x86_mmu_free_tables<PT_L>(PendingTlbInvalidation* pending, pt_entry_t* table) {}
+
+/**
+ * @brief Count the page tables below table
+ */
+template <int Level>
+static size_t x86_mmu_count_tables(pt_entry_t* table) {
+    size_t count = 0;
+    for (uint i = 0; i < NO_OF_PT_ENTRIES; ++i) {
+        pt_entry_t e = table[i];
+        if (!IS_PAGE_PRESENT(e) || IS_LARGE_PAGE(e))
+            continue;
+        count += 1 + x86_mmu_count_tables<Level - 1>(get_next_table_from_entry(e));
+    }
+    return count;
+}
+
+template <>
+size_t x86_mmu_count_tables<PT_L>(pt_entry_t* table) { return 0; }
+
 /**
  * @brief Creates mappings for the range specified by start_cursor
  *
@@ -741,7 +931,8 @@ bool x86_mmu_remove_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, cons
  * @return ERR_NO_MEMORY if intermediate page tables could not be allocated
  */
 template <int Level>
-static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                    pt_entry_t* table, uint mmu_flags,
                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
     static_assert(Level < X86_PAGING_LEVELS, "level too high");
@@ -773,7 +964,7 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
         if (level_supports_large_pages && !IS_PAGE_PRESENT(*e) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<Level>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+            update_entry<Level>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                 arch_flags | X86_MMU_PG_PS);
 
             new_cursor->paddr += ps;
@@ -791,13 +982,13 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, Level);
 
-                update_entry<Level>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<Level>(pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                     interm_arch_flags);
             }
 
             MappingCursor cursor;
-            ret = x86_mmu_add_mapping<Level - 1>(aspace, get_next_table_from_entry(*e), mmu_flags,
-                                                 *new_cursor, &cursor);
+            ret = x86_mmu_add_mapping<Level - 1>(aspace, pending, get_next_table_from_entry(*e),
+                                                 mmu_flags, *new_cursor, &cursor);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -813,7 +1004,7 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(pending, table, cursor, &result);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -822,7 +1013,8 @@ err:
 
 // Base case of x86_mmu_add_mapping for smallest page size
 template <>
-status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                   pt_entry_t* table, uint mmu_flags,
                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
 
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
@@ -838,7 +1030,8 @@ status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uin
             return ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PT_L>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr, arch_flags);
+        update_entry<PT_L>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
+                           arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
         new_cursor->vaddr += PAGE_SIZE;
@@ -862,7 +1055,8 @@ status_t x86_mmu_add_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uin
  * completed.  Must be non-null.
  */
 template <int Level>
-static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     static_assert(Level >= 0, "level too low");
@@ -891,7 +1085,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<Level>(aspace, new_cursor->vaddr, e, paddr_from_pte<Level>(*e),
+                update_entry<Level>(pending, new_cursor->vaddr, e, paddr_from_pte<Level>(*e),
                                     arch_flags | X86_MMU_PG_PS);
 
                 new_cursor->vaddr += ps;
@@ -901,7 +1095,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<Level>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<Level>(pending, page_vaddr, e);
             if (ret != NO_ERROR) {
                 goto err;
             }
@@ -909,7 +1103,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
-        ret = x86_mmu_update_mapping<Level - 1>(aspace, next_table, mmu_flags, *new_cursor, &cursor);
+        ret = x86_mmu_update_mapping<Level - 1>(aspace, pending, next_table, mmu_flags,
+                                                *new_cursor, &cursor);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             goto err;
@@ -926,7 +1121,8 @@ err:
 
 // Base case of x86_update_mapping for smallest page size
 template <>
-status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                      pt_entry_t* table, uint mmu_flags,
                                       const MappingCursor& start_cursor,
                                       MappingCursor* new_cursor) {
 
@@ -944,7 +1140,7 @@ status_t x86_mmu_update_mapping<PT_L>(arch_aspace_t* aspace, pt_entry_t* table,
             // TODO: Cleanup
             return ERR_NOT_FOUND;
         }
-        update_entry<PT_L>(aspace, new_cursor->vaddr, e, paddr_from_pte<PT_L>(*e), arch_flags);
+        update_entry<PT_L>(pending, new_cursor->vaddr, e, paddr_from_pte<PT_L>(*e), arch_flags);
 
         new_cursor->vaddr += PAGE_SIZE;
         new_cursor->size -= PAGE_SIZE;
@@ -969,12 +1165,72 @@ int arch_mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, size_t count) {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
 
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt, start, &result);
+    x86_mmu_remove_mapping<MAX_PAGING_LEVEL>(&pending, aspace->pt_virt, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     DEBUG_ASSERT(result.size == 0);
     return NO_ERROR;
 }
 
+status_t arch_mmu_unmap_all(arch_aspace_t* aspace) {
+    LTRACEF("aspace %p\n", aspace);
+
+    DEBUG_ASSERT(aspace);
+    DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
+
+    if (aspace->flags & ARCH_ASPACE_FLAG_KERNEL)
+        return ERR_NOT_SUPPORTED;
+
+    /* The top level entries covering a user aspace belong to it alone, so
+     * whole subtrees can be unhooked there and freed in one go, with a single
+     * flush once nothing points at them. */
+    pt_entry_t* table = aspace->pt_virt;
+    uint start = vaddr_to_index<MAX_PAGING_LEVEL>(aspace->base);
+    uint end = vaddr_to_index<MAX_PAGING_LEVEL>(aspace->base + aspace->size - 1);
+
+    PendingTlbInvalidation pending;
+    bool unmapped = false;
+    for (uint i = start; i <= end; ++i) {
+        pt_entry_t e = table[i];
+        if (!IS_PAGE_PRESENT(e))
+            continue;
+        table[i] = 0;
+        unmapped = true;
+        if (IS_LARGE_PAGE(e))
+            continue;
+        pt_entry_t* next_table = get_next_table_from_entry(e);
+        x86_mmu_free_tables<MAX_PAGING_LEVEL - 1>(&pending, next_table);
+        pending.free_table(next_table);
+    }
+
+    /* none of it is global, so dropping the aspace's non-global entries
+     * wherever it is active covers everything */
+    if (unmapped)
+        pending.full_shootdown = true;
+    x86_tlb_invalidate(aspace, &pending);
+    return NO_ERROR;
+}
+
+size_t arch_mmu_page_table_bytes(arch_aspace_t* aspace) {
+    DEBUG_ASSERT(aspace);
+    DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
+
+    pt_entry_t* table = aspace->pt_virt;
+    uint start = vaddr_to_index<MAX_PAGING_LEVEL>(aspace->base);
+    uint end = vaddr_to_index<MAX_PAGING_LEVEL>(aspace->base + aspace->size - 1);
+
+    /* the top level table, then whatever hangs off the aspace's part of it */
+    size_t count = 1;
+    for (uint i = start; i <= end; ++i) {
+        pt_entry_t e = table[i];
+        if (!IS_PAGE_PRESENT(e) || IS_LARGE_PAGE(e))
+            continue;
+        count += 1 + x86_mmu_count_tables<MAX_PAGING_LEVEL - 1>(get_next_table_from_entry(e));
+    }
+    return count * PAGE_SIZE;
+}
+
 int arch_mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, size_t count, uint flags) {
     DEBUG_ASSERT(aspace);
     DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
@@ -995,9 +1251,11 @@ int arch_mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, size_t cou
     MappingCursor start = {
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    status_t status = x86_mmu_add_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt, flags,
-                                                            start, &result);
+    status_t status = x86_mmu_add_mapping<MAX_PAGING_LEVEL>(aspace, &pending, aspace->pt_virt,
+                                                            flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1022,9 +1280,11 @@ int arch_mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count, uint fl
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    status_t status = x86_mmu_update_mapping<MAX_PAGING_LEVEL>(aspace, aspace->pt_virt,
+    status_t status = x86_mmu_update_mapping<MAX_PAGING_LEVEL>(aspace, &pending, aspace->pt_virt,
                                                                flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         return status;
     }
@@ -1038,7 +1298,9 @@ void x86_mmu_early_init() {
 
 #if ARCH_X86_64
     /* unmap the lower identity mapping */
-    unmap_entry<PML4_L>(nullptr, 0, &pml4[0], true);
+    PendingTlbInvalidation pending;
+    unmap_entry<PML4_L>(&pending, 0, &pml4[0], true);
+    x86_tlb_invalidate(nullptr, &pending);
 #else
     /* unmap the lower identity mapping */
     for (uint i = 0; i < (1 * GB) / (4 * MB); i++) {
@@ -1097,6 +1359,7 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
         aspace->pt_phys = pa;
 
         p->state = VM_PAGE_STATE_MMU;
+        kcounter_add(&page_table_bytes, PAGE_SIZE);
 
         /* zero out the user space half of it */
         memset(aspace->pt_virt, 0, sizeof(pt_entry_t) * NO_OF_PT_ENTRIES / 2);
@@ -1111,6 +1374,10 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
     aspace->io_bitmap = nullptr;
     aspace->active_cpus = 0;
     spin_lock_init(&aspace->io_bitmap_lock);
+#if ARCH_X86_64
+    aspace->pcid_aspace_id = atomic_add_u64(&next_pcid_aspace_id, 1);
+    aspace->tlb_generation = 0;
+#endif
 
     return NO_ERROR;
 }
@@ -1143,6 +1410,7 @@ status_t arch_mmu_destroy_aspace(arch_aspace_t* aspace) {
     }
 
     pmm_free_page(paddr_to_vm_page(aspace->pt_phys));
+    kcounter_add(&page_table_bytes, -(int64_t)PAGE_SIZE);
 
     aspace->magic = 0;
 
@@ -1154,12 +1422,19 @@ void arch_mmu_context_switch(arch_aspace_t *old_aspace, arch_aspace_t *aspace) {
     if (aspace != NULL) {
         DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys);
+
+        /* become a shootdown target before deciding whether the PCID's
+         * entries can be kept */
+        atomic_or(&aspace->active_cpus, cpu_bit);
+#if ARCH_X86_64
+        x86_set_cr3(x86_pcid_cr3(aspace));
+#else
         x86_set_cr3(aspace->pt_phys);
+#endif
 
         if (old_aspace != NULL) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
-        atomic_or(&aspace->active_cpus, cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -1247,6 +1522,14 @@ void x86_mmu_percpu_init(void) {
     ulong cr4 = x86_get_cr4();
     if (x86_feature_test(X86_FEATURE_SMEP)) cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP)) cr4 |= X86_CR4_SMAP;
+#if ARCH_X86_64
+    /* PCIDE can only be turned on while running with PCID 0 */
+    DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+    if (x86_feature_test(X86_FEATURE_PCID)) {
+        cr4 |= X86_CR4_PCIDE;
+        pcid_enabled = true;
+    }
+#endif
     x86_set_cr4(cr4);
 
     /* Set NXE bit in MSR_EFER*/
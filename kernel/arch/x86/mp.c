@@ -40,6 +40,38 @@ struct x86_percpu bp_percpu = {
 static struct x86_percpu *ap_percpus;
 uint8_t x86_num_cpus = 1;
 
+#if WITH_SMP
+/* per cpu masks of the cpus sharing a core and a package, indexed by cpu number */
+static mp_cpu_mask_t smt_siblings[SMP_MAX_CPUS];
+static mp_cpu_mask_t package_siblings[SMP_MAX_CPUS];
+
+/* cpu_apic_ids is indexed by cpu number */
+static void x86_init_cpu_sibling_masks(const uint32_t *cpu_apic_ids, uint cpu_count)
+{
+    x86_cpu_topology_t topo[SMP_MAX_CPUS];
+
+    for (uint i = 0; i < cpu_count; ++i) {
+        x86_cpu_topology_decode(cpu_apic_ids[i], &topo[i]);
+    }
+
+    for (uint i = 0; i < cpu_count; ++i) {
+        smt_siblings[i] = 0;
+        package_siblings[i] = 0;
+        for (uint j = 0; j < cpu_count; ++j) {
+            if (topo[j].package_id != topo[i].package_id) {
+                continue;
+            }
+            package_siblings[i] |= 1U << j;
+            if (topo[j].core_id == topo[i].core_id) {
+                smt_siblings[i] |= 1U << j;
+            }
+        }
+        LTRACEF("cpu %u: smt siblings 0x%x package siblings 0x%x\n",
+                i, smt_siblings[i], package_siblings[i]);
+    }
+}
+#endif
+
 status_t x86_allocate_ap_structures(uint32_t *apic_ids, uint8_t cpu_count)
 {
     ASSERT(ap_percpus == NULL);
@@ -75,6 +107,17 @@ status_t x86_allocate_ap_structures(uint32_t *apic_ids, uint8_t cpu_count)
     }
 
     x86_num_cpus = cpu_count;
+
+#if WITH_SMP
+    uint32_t cpu_apic_ids[SMP_MAX_CPUS];
+    uint topo_count = MIN((uint)cpu_count, (uint)SMP_MAX_CPUS);
+    cpu_apic_ids[0] = bootstrap_ap;
+    for (uint i = 1; i < topo_count; ++i) {
+        cpu_apic_ids[i] = ap_percpus[i - 1].apic_id;
+    }
+    x86_init_cpu_sibling_masks(cpu_apic_ids, topo_count);
+#endif
+
     return NO_ERROR;
 }
 
@@ -173,7 +216,31 @@ int x86_apic_id_to_cpu_num(uint32_t apic_id)
     return -1;
 }
 
+uint32_t x86_cpu_num_to_apic_id(uint cpu_num)
+{
+    if (cpu_num == 0) {
+        return bp_percpu.apic_id;
+    }
+    if (cpu_num >= x86_num_cpus) {
+        return INVALID_APIC_ID;
+    }
+    return ap_percpus[cpu_num - 1].apic_id;
+}
+
 #if WITH_SMP
+mp_cpu_mask_t arch_mp_cpu_smt_siblings(uint cpu_id)
+{
+    DEBUG_ASSERT(cpu_id < SMP_MAX_CPUS);
+    /* fall back to just the cpu itself if topology was never computed */
+    return smt_siblings[cpu_id] ? smt_siblings[cpu_id] : 1U << cpu_id;
+}
+
+mp_cpu_mask_t arch_mp_cpu_package_siblings(uint cpu_id)
+{
+    DEBUG_ASSERT(cpu_id < SMP_MAX_CPUS);
+    return package_siblings[cpu_id] ? package_siblings[cpu_id] : 1U << cpu_id;
+}
+
 status_t arch_mp_send_ipi(mp_cpu_mask_t target, mp_ipi_t ipi)
 {
     uint8_t vector = 0;
@@ -81,6 +81,10 @@ static size_t register_state_size = 0;
 /* Spinlock to guard register state size changes */
 static spin_lock_t state_lock = SPIN_LOCK_INITIAL_VALUE;
 
+/* The thread whose state was last loaded on each cpu.  See
+ * x86_extended_register_context_switch. */
+static thread_t *extended_register_owner[SMP_MAX_CPUS];
+
 /* For FXRSTOR, we need 512 bytes to save the state.  For XSAVE-based
  * mechanisms, we only need 512 + 64 bytes for the initial state, since
  * our initial state only needs to specify some SSE state (masking exceptions),
@@ -334,13 +338,30 @@ void x86_extended_register_restore_state(void *register_state)
     }
 }
 
+/* The kernel is built without FP/SIMD, so kernel threads never touch the
+ * extended registers, and have nothing in them to save or load; while they
+ * run the registers keep the state of the last user thread on the cpu.
+ * User threads are saved whenever they leave a cpu, so if one comes back
+ * to a cpu where it was the last thread loaded, the registers still hold
+ * what it was saved with, and there is nothing to load. */
 void x86_extended_register_context_switch(
         thread_t *old_thread, thread_t *new_thread)
 {
-    if (likely(old_thread)) {
+    if (likely(old_thread) && old_thread->user_thread) {
         x86_extended_register_save_state(old_thread->arch.extended_register_state);
     }
+    if (!new_thread->user_thread) {
+        return;
+    }
+
+    uint cpu = arch_curr_cpu_num();
+    if (extended_register_owner[cpu] == new_thread &&
+        new_thread->arch.extended_register_cpu == (int)cpu) {
+        return;
+    }
     x86_extended_register_restore_state(new_thread->arch.extended_register_state);
+    extended_register_owner[cpu] = new_thread;
+    new_thread->arch.extended_register_cpu = cpu;
 }
 
 static void read_xsave_state_info(void)
@@ -73,6 +73,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/feature.c \
 	$(LOCAL_DIR)/gdt.S \
 	$(LOCAL_DIR)/header.S \
+	$(LOCAL_DIR)/idle.c \
 	$(LOCAL_DIR)/idt.c \
 	$(LOCAL_DIR)/ioapic.c \
 	$(LOCAL_DIR)/ioport.cpp \
@@ -92,7 +93,9 @@ MODULE_SRCS += \
 	$(SUBARCH_DIR)/user_copy.S
 endif
 
-MODULE_DEPS += lib/bitmap
+MODULE_DEPS += \
+	lib/bitmap \
+	lib/counters \
 
 include $(LOCAL_DIR)/toolchain.mk
 
@@ -63,6 +63,7 @@ void arch_thread_initialize(thread_t *t, vaddr_t entry_point)
             x86_extended_register_size());
     t->arch.extended_register_state = (vaddr_t *)buf;
     x86_extended_register_init_state(t->arch.extended_register_state);
+    t->arch.extended_register_cpu = -1;
 
     // set the stack pointer
     t->arch.sp = (vaddr_t)frame;
@@ -354,6 +354,23 @@ unsigned int remap_interrupt(unsigned int vector)
     return vector;
 }
 
+status_t set_interrupt_target_cpu(unsigned int vector, int cpu)
+{
+    // Only shared peripheral interrupts have a target, and GICv2 can only
+    // name the first 8 cpus.
+    if ((vector < GIC_MAX_PER_CPU_INT) || (vector >= MAX_INT))
+        return ERR_INVALID_ARGS;
+    if (cpu >= 8 || cpu > arm_gic_max_cpu())
+        return ERR_NOT_SUPPORTED;
+
+    spin_lock_saved_state_t state;
+    spin_lock_save(&gicd_lock, &state, GICD_LOCK_FLAGS);
+    arm_gic_set_target_locked(vector, ~0, (cpu < 0) ? ~0 : (1U << cpu));
+    spin_unlock_restore(&gicd_lock, state, GICD_LOCK_FLAGS);
+
+    return NO_ERROR;
+}
+
 static
 enum handler_return __platform_irq(struct iframe *frame)
 {
@@ -0,0 +1,367 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <debug.h>
+#include <dev/interrupt/arm_gicv3.h>
+#include <dev/interrupt/arm_gicv3_regs.h>
+#include <reg.h>
+#include <kernel/thread.h>
+#include <lk/init.h>
+#include <dev/interrupt.h>
+#include <arch/ops.h>
+#include <arch/arm64.h>
+#include <trace.h>
+
+#include <lib/ktrace.h>
+
+#define LOCAL_TRACE 0
+
+#define GIC_MAX_PER_CPU_INT 32
+
+// Everything gets the same priority, in the middle of the range so that
+// nothing is lost if the priority bits implemented are only the top few.
+#define GIC_DEFAULT_PRIORITY 0xa0
+
+// The redistributor, and the SGIs and PPIs it holds, of each cpu.
+static uintptr_t gicr_base[SMP_MAX_CPUS];
+#define GICRREG(cpu, reg) (*REG32(gicr_base[cpu] + (reg)))
+
+struct int_handler_struct {
+    int_handler handler;
+    void *arg;
+};
+
+static struct int_handler_struct int_handler_table_per_cpu[GIC_MAX_PER_CPU_INT][SMP_MAX_CPUS];
+static struct int_handler_struct int_handler_table_shared[MAX_INT-GIC_MAX_PER_CPU_INT];
+
+static spin_lock_t gicd_lock;
+
+static struct int_handler_struct *get_int_handler(unsigned int vector, uint cpu)
+{
+    if (vector < GIC_MAX_PER_CPU_INT)
+        return &int_handler_table_per_cpu[vector][cpu];
+    else
+        return &int_handler_table_shared[vector - GIC_MAX_PER_CPU_INT];
+}
+
+void register_int_handler(unsigned int vector, int_handler handler, void *arg)
+{
+    struct int_handler_struct *h;
+    uint cpu = arch_curr_cpu_num();
+
+    spin_lock_saved_state_t state;
+
+    if (vector >= MAX_INT)
+        panic("register_int_handler: vector out of range %u\n", vector);
+
+    spin_lock_irqsave(&gicd_lock, state);
+
+    h = get_int_handler(vector, cpu);
+    h->handler = handler;
+    h->arg = arg;
+
+    spin_unlock_irqrestore(&gicd_lock, state);
+}
+
+bool is_valid_interrupt(unsigned int vector, uint32_t flags)
+{
+    return (vector < MAX_INT);
+}
+
+// The inverse of arch_curr_cpu_num(): aff0 is in the low
+// SMP_CPU_CLUSTER_SHIFT bits of the cpu number and aff2:aff1 above them.
+// The result is laid out as in MPIDR_EL1 and GICD_IROUTER.
+static uint64_t gic_cpu_affinity(uint cpu)
+{
+    uint cluster = cpu >> SMP_CPU_CLUSTER_SHIFT;
+    uint aff0 = cpu & ((1U << SMP_CPU_CLUSTER_SHIFT) - 1);
+    return ((uint64_t)cluster << 8) | aff0;
+}
+
+static void gicd_wait_rwp(void)
+{
+    while (GICREG(0, GICD_CTLR) & GICD_CTLR_RWP)
+        ;
+}
+
+static void gicr_wait_rwp(uint cpu)
+{
+    while (GICRREG(cpu, GICR_CTLR) & GICR_CTLR_RWP)
+        ;
+}
+
+static void gic_set_enable(uint vector, bool enable)
+{
+    uint32_t mask = 1U << (vector % 32);
+
+    if (vector < GIC_MAX_PER_CPU_INT) {
+        // SGIs and PPIs are the current cpu's own
+        uint cpu = arch_curr_cpu_num();
+        if (enable) {
+            GICRREG(cpu, GICR_ISENABLER0) = mask;
+        } else {
+            GICRREG(cpu, GICR_ICENABLER0) = mask;
+            gicr_wait_rwp(cpu);
+        }
+    } else {
+        if (enable) {
+            GICREG(0, GICD_ISENABLER(vector / 32)) = mask;
+        } else {
+            GICREG(0, GICD_ICENABLER(vector / 32)) = mask;
+            gicd_wait_rwp();
+        }
+    }
+}
+
+// Redistributors are in a contiguous run, each saying which cpu it's for
+// and whether it's the last.
+static uintptr_t gic_find_redistributor(uint32_t affinity)
+{
+    uintptr_t base = GICBASE(0) + GICR_OFFSET;
+    for (;;) {
+        uint64_t typer = *REG64(base + GICR_TYPER);
+        if (GICR_TYPER_AFFINITY(typer) == affinity)
+            return base;
+        if (typer & GICR_TYPER_LAST)
+            return 0;
+        base += (typer & GICR_TYPER_VLPIS) ? GICR_FRAME_SIZE_VLPI : GICR_FRAME_SIZE;
+    }
+}
+
+static void arm_gicv3_init_percpu(uint level)
+{
+    uint cpu = arch_curr_cpu_num();
+    uint64_t mpidr = ARM64_READ_SYSREG(mpidr_el1);
+    uint32_t affinity = (uint32_t)(mpidr & 0xffffff) | (uint32_t)((mpidr >> 32) & 0xff) << 24;
+
+    if ((gicr_base[cpu] = gic_find_redistributor(affinity)) == 0)
+        panic("gicv3: no redistributor for cpu %u (affinity %#x)\n", cpu, affinity);
+
+    // wake it up
+    GICRREG(cpu, GICR_WAKER) &= ~GICR_WAKER_PROCESSOR_SLEEP;
+    while (GICRREG(cpu, GICR_WAKER) & GICR_WAKER_CHILDREN_ASLEEP)
+        ;
+
+    // SGIs and PPIs are non-secure group 1 like everything else, and only
+    // the SGIs are enabled to start with, so IPIs work as they do on GICv2
+    GICRREG(cpu, GICR_ICENABLER0) = ~0U;
+    gicr_wait_rwp(cpu);
+    GICRREG(cpu, GICR_ICPENDR0) = ~0U;
+    GICRREG(cpu, GICR_IGROUPR0) = ~0U;
+    for (uint i = 0; i < GIC_MAX_PER_CPU_INT; i += 4)
+        GICRREG(cpu, GICR_IPRIORITYR(i / 4)) = GIC_DEFAULT_PRIORITY * 0x01010101U;
+    GICRREG(cpu, GICR_ISENABLER0) = 0xffff;
+
+    // the cpu interface is the system registers, with EOI both dropping the
+    // priority and deactivating
+    ARM64_WRITE_SYSREG(ICC_SRE_EL1, ARM64_READ_SYSREG(ICC_SRE_EL1) | ICC_SRE_EL1_SRE);
+    ARM64_WRITE_SYSREG(ICC_PMR_EL1, (uint64_t)0xff);
+    ARM64_WRITE_SYSREG(ICC_BPR1_EL1, (uint64_t)0);
+    ARM64_WRITE_SYSREG(ICC_CTLR_EL1, (uint64_t)0);
+    ARM64_WRITE_SYSREG(ICC_IGRPEN1_EL1, (uint64_t)1);
+}
+
+LK_INIT_HOOK_FLAGS(arm_gicv3_init_percpu,
+                   arm_gicv3_init_percpu,
+                   LK_INIT_LEVEL_PLATFORM_EARLY, LK_INIT_FLAG_SECONDARY_CPUS);
+
+LK_INIT_HOOK_FLAGS(arm_gicv3_resume_cpu, arm_gicv3_init_percpu,
+                   LK_INIT_LEVEL_PLATFORM, LK_INIT_FLAG_CPU_RESUME);
+
+void arm_gicv3_init(void)
+{
+    uint i;
+
+    GICREG(0, GICD_CTLR) = 0;
+    gicd_wait_rwp();
+
+    for (i = GIC_MAX_PER_CPU_INT; i < MAX_INT; i += 32) {
+        GICREG(0, GICD_ICENABLER(i / 32)) = ~0U;
+        GICREG(0, GICD_ICPENDR(i / 32)) = ~0U;
+        GICREG(0, GICD_IGROUPR(i / 32)) = ~0U;
+    }
+    gicd_wait_rwp();
+    for (i = GIC_MAX_PER_CPU_INT; i < MAX_INT; i += 4)
+        GICREG(0, GICD_IPRIORITYR(i / 4)) = GIC_DEFAULT_PRIORITY * 0x01010101U;
+
+    // affinity routing has to be on before the groups are
+    GICREG(0, GICD_CTLR) = GICD_CTLR_ARE;
+    gicd_wait_rwp();
+    GICREG(0, GICD_CTLR) = GICD_CTLR_ARE | GICD_CTLR_ENABLE_G1 | GICD_CTLR_ENABLE_G0;
+    gicd_wait_rwp();
+
+    // external interrupts go to the boot cpu until they're steered elsewhere
+    uint64_t boot_cpu = gic_cpu_affinity(arch_curr_cpu_num());
+    for (i = GIC_MAX_PER_CPU_INT; i < MAX_INT; i++)
+        GICREG64(0, GICD_IROUTER(i)) = boot_cpu;
+
+    arm_gicv3_init_percpu(0);
+}
+
+status_t arm_gicv3_sgi(u_int irq, u_int cpu_mask)
+{
+    const uint aff0_mask = (1U << SMP_CPU_CLUSTER_SHIFT) - 1;
+
+    if (irq >= 16)
+        return ERR_INVALID_ARGS;
+
+    // whatever the interrupt tells the targets to look at has to be there
+    // when they do
+    DSB;
+
+    // one write reaches every cpu it's sent to in a cluster
+    while (cpu_mask != 0) {
+        uint cluster = (uint)__builtin_ctz(cpu_mask) & ~aff0_mask;
+        uint64_t targets = 0;
+        while (cpu_mask != 0) {
+            uint cpu = (uint)__builtin_ctz(cpu_mask);
+            if ((cpu & ~aff0_mask) != cluster)
+                break;
+            cpu_mask &= cpu_mask - 1;
+            if ((cpu & aff0_mask) >= ICC_SGI1R_TARGET_LIST_MAX) {
+                TRACEF("cpu %u can't be sent SGIs\n", cpu);
+                continue;
+            }
+            targets |= 1U << (cpu & aff0_mask);
+        }
+        if (targets == 0)
+            continue;
+
+        uint64_t affinity = gic_cpu_affinity(cluster);
+        uint64_t val = targets |
+            (((affinity >> 8) & 0xff) << ICC_SGI1R_AFF1_SHIFT) |
+            ((uint64_t)irq << ICC_SGI1R_INTID_SHIFT) |
+            (((affinity >> 16) & 0xff) << ICC_SGI1R_AFF2_SHIFT);
+
+        LTRACEF("ICC_SGI1R_EL1: %#" PRIx64 "\n", val);
+        ARM64_WRITE_SYSREG(ICC_SGI1R_EL1, val);
+    }
+
+    return NO_ERROR;
+}
+
+status_t mask_interrupt(unsigned int vector)
+{
+    if (vector >= MAX_INT)
+        return ERR_INVALID_ARGS;
+
+    gic_set_enable(vector, false);
+
+    return NO_ERROR;
+}
+
+status_t unmask_interrupt(unsigned int vector)
+{
+    if (vector >= MAX_INT)
+        return ERR_INVALID_ARGS;
+
+    gic_set_enable(vector, true);
+
+    return NO_ERROR;
+}
+
+status_t configure_interrupt(unsigned int vector,
+                             enum interrupt_trigger_mode tm,
+                             enum interrupt_polarity pol)
+{
+    if (vector >= MAX_INT)
+        return ERR_INVALID_ARGS;
+
+    if (tm != IRQ_TRIGGER_MODE_EDGE) {
+        // Like the GICv2 driver, everything is left edge triggered.
+        return ERR_NOT_SUPPORTED;
+    }
+
+    if (pol != IRQ_POLARITY_ACTIVE_HIGH) {
+        // TODO: polarity should actually be configure through a GPIO controller
+        return ERR_NOT_SUPPORTED;
+    }
+
+    return NO_ERROR;
+}
+
+status_t get_interrupt_config(unsigned int vector,
+                              enum interrupt_trigger_mode* tm,
+                              enum interrupt_polarity* pol)
+{
+    if (vector >= MAX_INT)
+        return ERR_INVALID_ARGS;
+
+    if (tm)  *tm  = IRQ_TRIGGER_MODE_EDGE;
+    if (pol) *pol = IRQ_POLARITY_ACTIVE_HIGH;
+
+    return NO_ERROR;
+}
+
+unsigned int remap_interrupt(unsigned int vector)
+{
+    return vector;
+}
+
+status_t set_interrupt_target_cpu(unsigned int vector, int cpu)
+{
+    // Only shared peripheral interrupts have a target, but with affinity
+    // routing any cpu can be named.
+    if ((vector < GIC_MAX_PER_CPU_INT) || (vector >= MAX_INT))
+        return ERR_INVALID_ARGS;
+    if (cpu >= (int)arch_max_num_cpus())
+        return ERR_NOT_SUPPORTED;
+
+    // -1 lets the distributor pick any cpu that's taking interrupts
+    GICREG64(0, GICD_IROUTER(vector)) =
+        (cpu < 0) ? GICD_IROUTER_IRM : gic_cpu_affinity((uint)cpu);
+
+    return NO_ERROR;
+}
+
+// called from assembly
+enum handler_return platform_irq(struct arm64_iframe_short *frame)
+{
+    // get the current vector
+    uint64_t iar = ARM64_READ_SYSREG(ICC_IAR1_EL1);
+    unsigned int vector = iar & 0xffffff;
+
+    if ((vector >= GIC_SPURIOUS_MIN) && (vector <= GIC_SPURIOUS_MAX)) {
+        // spurious
+        return INT_NO_RESCHEDULE;
+    }
+
+    THREAD_STATS_INC(interrupts);
+
+    uint cpu = arch_curr_cpu_num();
+
+    ktrace_tiny(TAG_IRQ_ENTER, (vector << 8) | cpu);
+
+    LTRACEF_LEVEL(2, "iar 0x%" PRIx64 " cpu %u currthread %p vector %u pc %#"
+                  PRIxPTR "\n", iar, cpu,
+                  get_current_thread(), vector, (uintptr_t)frame->elr);
+
+    // deliver the interrupt
+    enum handler_return ret = INT_NO_RESCHEDULE;
+    if (vector < MAX_INT) {
+        struct int_handler_struct *handler = get_int_handler(vector, cpu);
+        if (handler->handler)
+            ret = handler->handler(handler->arg);
+    }
+
+    ARM64_WRITE_SYSREG(ICC_EOIR1_EL1, iar);
+
+    LTRACEF_LEVEL(2, "cpu %u exit %u\n", cpu, ret);
+
+    ktrace_tiny(TAG_IRQ_EXIT, (vector << 8) | cpu);
+
+    return ret;
+}
+
+// called from assembly
+enum handler_return platform_fiq(struct arm64_iframe_short *frame)
+{
+    PANIC_UNIMPLEMENTED;
+}
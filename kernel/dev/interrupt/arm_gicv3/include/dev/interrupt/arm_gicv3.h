@@ -0,0 +1,19 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+void arm_gicv3_init(void);
+
+// Send software generated interrupt |irq| (0-15) to every cpu in |cpu_mask|.
+status_t arm_gicv3_sgi(u_int irq, u_int cpu_mask);
+
+__END_CDECLS
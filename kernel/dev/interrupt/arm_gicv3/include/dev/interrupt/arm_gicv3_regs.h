@@ -0,0 +1,78 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <platform/gic.h>
+#include <reg.h>
+
+#define GICREG(gic, reg)        (*REG32(GICBASE(gic) + (reg)))
+#define GICREG64(gic, reg)      (*REG64(GICBASE(gic) + (reg)))
+
+/* distributor regs */
+#define GICD_CTLR               (GICD_OFFSET + 0x0000)
+#define GICD_TYPER              (GICD_OFFSET + 0x0004)
+#define GICD_IIDR               (GICD_OFFSET + 0x0008)
+#define GICD_IGROUPR(n)         (GICD_OFFSET + 0x0080 + (n) * 4)
+#define GICD_ISENABLER(n)       (GICD_OFFSET + 0x0100 + (n) * 4)
+#define GICD_ICENABLER(n)       (GICD_OFFSET + 0x0180 + (n) * 4)
+#define GICD_ISPENDR(n)         (GICD_OFFSET + 0x0200 + (n) * 4)
+#define GICD_ICPENDR(n)         (GICD_OFFSET + 0x0280 + (n) * 4)
+#define GICD_ISACTIVER(n)       (GICD_OFFSET + 0x0300 + (n) * 4)
+#define GICD_ICACTIVER(n)       (GICD_OFFSET + 0x0380 + (n) * 4)
+#define GICD_IPRIORITYR(n)      (GICD_OFFSET + 0x0400 + (n) * 4)
+#define GICD_ICFGR(n)           (GICD_OFFSET + 0x0c00 + (n) * 4)
+#define GICD_IROUTER(n)         (GICD_OFFSET + 0x6000 + (n) * 8)
+
+#define GICD_CTLR_ENABLE_G0     (1u << 0)
+#define GICD_CTLR_ENABLE_G1     (1u << 1)   /* G1A from the non-secure side */
+#define GICD_CTLR_ARE           (1u << 4)   /* ARE_NS from the non-secure side */
+#define GICD_CTLR_RWP           (1u << 31)
+
+#define GICD_IROUTER_IRM        (1ull << 31)
+
+/* redistributor regs, a pair of 64k frames per cpu (more for GICv4) */
+#define GICR_FRAME_SIZE         (0x20000)
+#define GICR_FRAME_SIZE_VLPI    (0x40000)
+#define GICR_SGI_OFFSET         (0x10000)
+
+#define GICR_CTLR               (0x0000)
+#define GICR_TYPER              (0x0008)
+#define GICR_WAKER              (0x0014)
+#define GICR_IGROUPR0           (GICR_SGI_OFFSET + 0x0080)
+#define GICR_ISENABLER0         (GICR_SGI_OFFSET + 0x0100)
+#define GICR_ICENABLER0         (GICR_SGI_OFFSET + 0x0180)
+#define GICR_ICPENDR0           (GICR_SGI_OFFSET + 0x0280)
+#define GICR_IPRIORITYR(n)      (GICR_SGI_OFFSET + 0x0400 + (n) * 4)
+
+#define GICR_CTLR_RWP           (1u << 3)
+#define GICR_TYPER_VLPIS        (1ull << 1)
+#define GICR_TYPER_LAST         (1ull << 4)
+#define GICR_TYPER_AFFINITY(t)  ((uint32_t)((t) >> 32))
+#define GICR_WAKER_PROCESSOR_SLEEP (1u << 1)
+#define GICR_WAKER_CHILDREN_ASLEEP (1u << 2)
+
+/* cpu interface system registers, by encoding so any assembler takes them */
+#define ICC_PMR_EL1             S3_0_C4_C6_0
+#define ICC_IAR1_EL1            S3_0_C12_C12_0
+#define ICC_EOIR1_EL1           S3_0_C12_C12_1
+#define ICC_BPR1_EL1            S3_0_C12_C12_3
+#define ICC_CTLR_EL1            S3_0_C12_C12_4
+#define ICC_SRE_EL1             S3_0_C12_C12_5
+#define ICC_IGRPEN1_EL1         S3_0_C12_C12_7
+#define ICC_SGI1R_EL1           S3_0_C12_C11_5
+
+#define ICC_SRE_EL1_SRE         (1u << 0)
+
+#define ICC_SGI1R_TARGET_LIST_MAX (16)
+#define ICC_SGI1R_AFF1_SHIFT    (16)
+#define ICC_SGI1R_INTID_SHIFT   (24)
+#define ICC_SGI1R_AFF2_SHIFT    (32)
+#define ICC_SGI1R_AFF3_SHIFT    (48)
+
+/* interrupt ids from 1020 to 1023 are special, meaning there was none */
+#define GIC_SPURIOUS_MIN        (1020)
+#define GIC_SPURIOUS_MAX        (1023)
@@ -43,4 +43,9 @@ bool is_valid_interrupt(unsigned int vector, uint32_t flags);
 
 unsigned int remap_interrupt(unsigned int vector);
 
+// Deliver the specified interrupt vector to |cpu|, or to whichever cpu the
+// interrupt controller would pick by default if |cpu| is -1.  Returns
+// ERR_NOT_SUPPORTED if the interrupt controller cannot steer the vector.
+status_t set_interrupt_target_cpu(unsigned int vector, int cpu);
+
 __END_CDECLS
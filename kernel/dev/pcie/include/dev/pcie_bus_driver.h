@@ -183,6 +183,11 @@ private:
     mutable Mutex                       ecam_region_lock_;
     mxtl::WAVLTree<uint8_t, mxtl::unique_ptr<MappedEcamRegion>> ecam_regions_;
 
+    // The region holding each bus's config, so GetConfig doesn't need the
+    // lock or the tree.  Entries are set (under the lock) as regions are
+    // added, and only cleared when the driver goes away.
+    const MappedEcamRegion*             ecam_bus_regions_[PCIE_MAX_BUSSES] = { };
+
     Mutex                               legacy_irq_list_lock_;
     mxtl::SinglyLinkedList<mxtl::RefPtr<SharedLegacyIrqHandler>> legacy_irq_list_;
     PciePlatformInterface&              platform_;
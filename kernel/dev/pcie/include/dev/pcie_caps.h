@@ -125,6 +125,15 @@ typedef struct pcie_msix_vector_entry {
     uint32_t vector_ctrl;
 } __PACKED pcie_msix_vector_entry_t;
 
+#define PCIE_CAP_MSIX_CTRL_GET_TABLE_SIZE(ctrl) ((uint)((ctrl) & 0x07FF) + 1u)
+#define PCIE_CAP_MSIX_CTRL_FUNCTION_MASK        ((uint16_t)0x4000)
+#define PCIE_CAP_MSIX_CTRL_ENABLE               ((uint16_t)0x8000)
+
+#define PCIE_CAP_MSIX_BIR(bir_offset)           ((uint)((bir_offset) & 0x7))
+#define PCIE_CAP_MSIX_OFFSET(bir_offset)        ((uint32_t)((bir_offset) & ~0x7u))
+
+#define PCIE_MSIX_VECTOR_CTRL_MASKED            (0x00000001u)
+
 /**
  * Structure and type definitions for capability PCIE_CAP_ID_PCI_EXPRESS
  *
@@ -266,11 +266,36 @@ public:
      */
     status_t MaskUnmaskIrq(uint irq_id, bool mask);
 
+    /**
+     * Steer the device's IRQs to the specified CPU.  In MSI-X mode each vector
+     * has its own target address, and only the given one moves.  In MSI mode
+     * every vector of the device shares one target address, so they all move
+     * together.  In legacy mode the system IRQ is shared, and moves for every
+     * device on it.
+     *
+     * @param irq_id The ID of the IRQ to steer.  Only meaningful in MSI-X mode.
+     * @param cpu The CPU to deliver IRQs to, or -1 for the platform default.
+     *
+     * @return A status_t indicating the success or failure of the operation.
+     * Status codes may include (but are not limited to)...
+     *
+     * ++ ERR_UNAVAILABLE
+     *    The device has become unplugged and is waiting to be released.
+     * ++ ERR_BAD_STATE
+     *    The device is in DISABLED IRQ mode.
+     * ++ ERR_INVALID_ARGS
+     *    The irq_id parameter is out of range for the currently configured mode.
+     * ++ ERR_NOT_SUPPORTED
+     *    The platform cannot steer IRQs in the current mode.
+     */
+    status_t SetIrqTargetCpu(uint irq_id, int cpu);
+
     // Capability parsing
     //
     // TODO(johngro): these needs to be refactored to use non-static methods,
     // and to be private.
     static status_t ParseMsiCaps(PcieDevice* dev, void* hdr, uint version, uint space_left);
+    static status_t ParseMsixCaps(PcieDevice* dev, void* hdr, uint version, uint space_left);
     static status_t ParsePciExpressCaps(PcieDevice* dev, void* hdr, uint version, uint space_left);
     static status_t ParsePciAdvFeatures(PcieDevice* dev, void* hdr, uint version, uint space_left);
 
@@ -376,6 +401,7 @@ private:
     status_t SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs);
     status_t RegisterIrqHandlerLocked(uint irq_id, pcie_irq_handler_fn_t handler, void* ctx);
     status_t MaskUnmaskIrqLocked(uint irq_id, bool mask);
+    status_t SetIrqTargetCpuLocked(uint irq_id, int cpu);
 
     // Internal Legacy IRQ support.
     status_t MaskUnmaskLegacyIrq(bool mask);
@@ -401,6 +427,34 @@ private:
     enum handler_return        MsiIrqHandler(pcie_irq_handler_state_t& hstate);
     static enum handler_return MsiIrqHandlerThunk(void *arg);
 
+    // Internal MSI-X IRQ support.
+    void SetMsixCtrl(uint16_t clr_bits, uint16_t set_bits) {
+        DEBUG_ASSERT(irq_.msi_x.ctrl_reg);
+        volatile uint16_t* ctrl_reg = irq_.msi_x.ctrl_reg;
+        pcie_write16(ctrl_reg, static_cast<uint16_t>((pcie_read16(ctrl_reg) & ~clr_bits)
+                                                                            |  set_bits));
+    }
+
+    volatile uint32_t* MsixEntryReg(uint irq_id, size_t offset) {
+        DEBUG_ASSERT(irq_.msi_x.table);
+        DEBUG_ASSERT(irq_id < irq_.msi_x.max_irqs);
+        return reinterpret_cast<volatile uint32_t*>(
+                reinterpret_cast<uintptr_t>(&irq_.msi_x.table[irq_id]) + offset);
+    }
+
+    uint     MaxMsixIrqs() const;
+    bool     MaskUnmaskMsixIrqLocked(uint irq_id, bool mask);
+    status_t MaskUnmaskMsixIrq(uint irq_id, bool mask);
+    void     SetMsixVectorTarget(uint irq_id, uint64_t tgt_addr, uint32_t tgt_data);
+    status_t MapMsixTable();
+    void     UnmapMsixTable();
+    void     FreeMsixBlock();
+    void     LeaveMsixIrqMode();
+    status_t EnterMsixIrqMode(uint requested_irqs);
+
+    enum handler_return        MsixIrqHandler(pcie_irq_handler_state_t& hstate);
+    static enum handler_return MsixIrqHandlerThunk(void *arg);
+
     // Common Internal IRQ support.
     void     ResetCommonIrqBookkeeping();
     status_t AllocIrqHandlers(uint requested_irqs, bool is_masked);
@@ -453,8 +507,17 @@ private:
             pcie_msi_block_t   irq_block;
         } msi;
 
-        /* TODO(johngro) : Add MSI-X state */
-        struct { } msi_x;
+        /* MSI-X state.  The vector table lives in one of the device's BARs and
+         * is only mapped while the device is in MSI-X mode. */
+        struct {
+            volatile uint16_t* ctrl_reg = nullptr;
+            uint               max_irqs = 0;
+            uint               table_bir;
+            uint32_t           table_offset;
+            void*              table_mapping = nullptr;
+            volatile pcie_msix_vector_entry_t* table = nullptr;
+            pcie_msi_block_t   irq_block;
+        } msi_x;
     } irq_;
 };
 
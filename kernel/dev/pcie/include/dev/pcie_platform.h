@@ -135,6 +135,48 @@ public:
         DEBUG_ASSERT(false);
     }
 
+    /**
+     * Method used by the bus driver to steer a block of MSI IRQs previously
+     * allocated with a call to a AllocMsiBlock implementation to a different
+     * CPU.  All of the IRQs in a block share one target address, so they all
+     * move together.  Only the block's tgt_addr and tgt_data are updated; the
+     * bus driver is responsible for writing them to the device.
+     *
+     * @param block A pointer to the block to be retargeted.
+     * @param cpu The CPU which should receive the block's IRQs, or -1 to
+     *        return to the platform's default target.
+     *
+     * @return A status code indicating the success or failure of the operation.
+     */
+    virtual status_t RetargetMsiBlock(pcie_msi_block_t* block, int cpu) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    /**
+     * Method used by the bus driver to steer a single IRQ of a block allocated
+     * for MSI-X, whose vectors each have their own target address.  The block
+     * itself is left untouched.
+     *
+     * @param block A pointer to the block the IRQ belongs to.
+     * @param cpu The CPU which should receive the IRQ, or -1 to return to the
+     *        platform's default target.
+     * @param out_tgt_addr Where to put the target address the IRQ's vector
+     *        should be programmed with.  The data is unchanged.
+     *
+     * @return A status code indicating the success or failure of the operation.
+     */
+    virtual status_t GetMsiTargetAddr(const pcie_msi_block_t* block,
+                                      int cpu,
+                                      uint64_t* out_tgt_addr) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    /**
+     * The largest block of IRQs AllocMsiBlock can hand out for MSI-X.  Blocks
+     * for plain MSI are never larger than PCIE_MAX_MSI_IRQS.
+     */
+    virtual uint max_msix_block_size() const { return PCIE_MAX_MSI_IRQS; }
+
     /**
      * Method used for registration of MSI handlers with the platform.
      *
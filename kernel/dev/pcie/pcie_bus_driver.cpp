@@ -66,6 +66,8 @@ PcieBusDriver::~PcieBusDriver() {
     // Unmap and free all of our mapped ECAM regions.
     {
         AutoLock ecam_region_lock(ecam_region_lock_);
+        for (auto& region : ecam_bus_regions_)
+            region = nullptr;
         ecam_regions_.clear();
     }
 }
@@ -477,28 +479,22 @@ pcie_config_t* PcieBusDriver::GetConfig(uint bus_id,
     if (out_cfg_phys)
         *out_cfg_phys = 0;
 
-    // Find the region which would contain this bus_id, if any.
-    // add does not overlap with any already defined regions.
-    AutoLock ecam_region_lock(ecam_region_lock_);
-    auto iter = ecam_regions_.upper_bound(static_cast<uint8_t>(bus_id));
-    --iter;
-
-    if (!iter.IsValid())
-        return nullptr;
-
-    if ((bus_id < iter->ecam().bus_start) ||
-        (bus_id > iter->ecam().bus_end))
+    // Find the region which contains this bus_id, if any.  Regions are
+    // never removed while the driver is in use, so this needs no lock.
+    const MappedEcamRegion* region =
+        __atomic_load_n(&ecam_bus_regions_[bus_id], __ATOMIC_ACQUIRE);
+    if (region == nullptr)
         return nullptr;
 
-    bus_id -= iter->ecam().bus_start;
+    bus_id -= region->ecam().bus_start;
     size_t offset = (static_cast<size_t>(bus_id)  << 20) |
                     (static_cast<size_t>(dev_id)  << 15) |
                     (static_cast<size_t>(func_id) << 12);
 
     if (out_cfg_phys)
-        *out_cfg_phys = iter->ecam().phys_base + offset;
+        *out_cfg_phys = region->ecam().phys_base + offset;
 
-    return reinterpret_cast<pcie_config_t*>(static_cast<uint8_t*>(iter->vaddr()) + offset);
+    return reinterpret_cast<pcie_config_t*>(static_cast<uint8_t*>(region->vaddr()) + offset);
 }
 
 status_t PcieBusDriver::AddEcamRegion(const EcamRegion& ecam) {
@@ -543,7 +539,10 @@ status_t PcieBusDriver::AddEcamRegion(const EcamRegion& ecam) {
         return res;
     }
 
-    // Everything checks out.  Add the new region to our set of regions and we are done.
+    // Everything checks out.  Add the new region to our set of regions, and
+    // to the lookup table for its busses, and we are done.
+    for (uint bus_id = ecam.bus_start; bus_id <= ecam.bus_end; ++bus_id)
+        __atomic_store_n(&ecam_bus_regions_[bus_id], region.get(), __ATOMIC_RELEASE);
     ecam_regions_.insert(mxtl::move(region));
     return NO_ERROR;
 }
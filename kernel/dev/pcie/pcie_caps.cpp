@@ -338,6 +338,70 @@ status_t PcieDevice::ParseMsiCaps(PcieDevice* dev,
     return NO_ERROR;
 }
 
+/*
+ * PCI Local Bus Specification 3.0 Section 6.8.2
+ */
+status_t PcieDevice::ParseMsixCaps(PcieDevice* dev,
+                                   void*       hdr,
+                                   uint        version,
+                                   uint        space_left) {
+    DEBUG_ASSERT(dev);
+    DEBUG_ASSERT(hdr);
+    DEBUG_ASSERT(!version);  // Standard capabilities do not have versions
+
+    /* Zero out the devices MSI-X IRQ state */
+    memset(&dev->irq_.msi_x, 0, sizeof(dev->irq_.msi_x));
+
+    /* Size sanity check */
+    pcie_cap_msix_t* msix_cap = (pcie_cap_msix_t*)hdr;
+    if (sizeof(*msix_cap) > space_left) {
+        TRACEF("Device %02x:%02x.%01x (%04hx:%04hx) has illegally positioned MSI-X "
+               "capability structure.  Structure is %zu bytes long, but only %u "
+               "bytes remain in ECAM standard config.\n",
+               dev->bus_id(), dev->dev_id(), dev->func_id(),
+               dev->vendor_id(), dev->device_id(),
+               sizeof(*msix_cap), space_left);
+        return ERR_INVALID_ARGS;
+    }
+
+    /* The fields are naturally aligned, even though the structure is packed */
+    uintptr_t base = reinterpret_cast<uintptr_t>(msix_cap);
+    volatile uint16_t* ctrl_reg = reinterpret_cast<volatile uint16_t*>(
+            base + offsetof(pcie_cap_msix_t, ctrl));
+    uint16_t ctrl = pcie_read16(ctrl_reg);
+    uint32_t table = pcie_read32(reinterpret_cast<volatile uint32_t*>(
+            base + offsetof(pcie_cap_msix_t, vector_table_bir_offset)));
+
+    /* Sanity check the location of the vector table.  Whether the BAR it names
+     * actually exists and is big enough can only be checked once the BARs have
+     * been allocated. */
+    uint bir = PCIE_CAP_MSIX_BIR(table);
+    if (bir >= PCIE_BAR_REGS_PER_DEVICE) {
+        TRACEF("Device %02x:%02x.%01x (%04hx:%04hx) has an invalid MSI-X vector "
+               "table BAR indicator (%u)\n",
+               dev->bus_id(), dev->dev_id(), dev->func_id(),
+               dev->vendor_id(), dev->device_id(),
+               bir);
+        return ERR_INTERNAL;
+    }
+
+    /* Success!
+     *
+     * Make sure that MSI-X is disabled, then record our capabilities in the
+     * device's bookkeeping and we are done.  Individual vectors are masked
+     * when the vector table is mapped upon entering MSI-X mode.
+     */
+    pcie_write16(ctrl_reg, static_cast<uint16_t>(ctrl & ~(PCIE_CAP_MSIX_CTRL_ENABLE |
+                                                          PCIE_CAP_MSIX_CTRL_FUNCTION_MASK)));
+
+    dev->irq_.msi_x.ctrl_reg     = ctrl_reg;
+    dev->irq_.msi_x.max_irqs     = PCIE_CAP_MSIX_CTRL_GET_TABLE_SIZE(ctrl);
+    dev->irq_.msi_x.table_bir    = bir;
+    dev->irq_.msi_x.table_offset = PCIE_CAP_MSIX_OFFSET(table);
+
+    return NO_ERROR;
+}
+
 /*
  * Advanced Capabilities for Conventional PCI ECN
  */
@@ -596,7 +660,7 @@ static const pcie_caps_parse_table_entry_t PCIE_STANDARD_CAPS_PARSE_TABLE[] = {
     PTE(PCIE_CAP_ID_AGP_8X,                   NULL),
     PTE(PCIE_CAP_ID_SECURE_DEVICE,            NULL),
     PTE(PCIE_CAP_ID_PCI_EXPRESS,              PcieDevice::ParsePciExpressCaps),
-    PTE(PCIE_CAP_ID_MSIX,                     NULL),
+    PTE(PCIE_CAP_ID_MSIX,                     PcieDevice::ParseMsixCaps),
     PTE(PCIE_CAP_ID_SATA_DATA_NDX_CFG,        NULL),
     PTE(PCIE_CAP_ID_ADVANCED_FEATURES,        PcieDevice::ParsePciAdvFeatures),
     PTE(PCIE_CAP_ID_ENHANCED_ALLOCATION,      NULL),
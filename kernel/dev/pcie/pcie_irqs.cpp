@@ -13,8 +13,10 @@
 #include <kernel/spinlock.h>
 #include <kernel/vm.h>
 #include <list.h>
+#include <mxtl/algorithm.h>
 #include <new.h>
 #include <pow2.h>
+#include <stdio.h>
 #include <string.h>
 #include <trace.h>
 
@@ -32,7 +34,7 @@ void PcieDevice::ResetCommonIrqBookkeeping() {
     if (irq_.handler_count > 1) {
         DEBUG_ASSERT(irq_.handlers != &irq_.singleton_handler);
         delete[] irq_.handlers;
-    } else {
+    } else if (irq_.handlers) {
         DEBUG_ASSERT(irq_.handlers == &irq_.singleton_handler);
         irq_.singleton_handler.handler = nullptr;
         irq_.singleton_handler.ctx = nullptr;
@@ -523,6 +525,259 @@ enum handler_return PcieDevice::MsiIrqHandlerThunk(void *arg) {
     return hstate.dev->MsiIrqHandler(hstate);
 }
 
+/******************************************************************************
+ *
+ * MSI-X IRQ mode routines.
+ *
+ ******************************************************************************/
+uint PcieDevice::MaxMsixIrqs() const {
+    /* Every vector needs its own IRQ from the platform, so a device may not use
+     * more of its table than the platform is willing to give it. */
+    return mxtl::min(irq_.msi_x.max_irqs, bus_drv_.platform().max_msix_block_size());
+}
+
+bool PcieDevice::MaskUnmaskMsixIrqLocked(uint irq_id, bool mask) {
+    DEBUG_ASSERT(irq_.mode == PCIE_IRQ_MODE_MSI_X);
+    DEBUG_ASSERT(irq_id < irq_.handler_count);
+    DEBUG_ASSERT(irq_.handlers);
+
+    pcie_irq_handler_state_t& hstate = irq_.handlers[irq_id];
+    DEBUG_ASSERT(hstate.lock.IsHeld());
+
+    volatile uint32_t* ctrl = MsixEntryReg(irq_id, offsetof(pcie_msix_vector_entry_t,
+                                                            vector_ctrl));
+    uint32_t val = pcie_read32(ctrl);
+    if (mask) val |=  PCIE_MSIX_VECTOR_CTRL_MASKED;
+    else      val &= ~PCIE_MSIX_VECTOR_CTRL_MASKED;
+    pcie_write32(ctrl, val);
+
+    /* Read back to make sure the posted write has landed before we go on to
+     * assume the vector is (un)masked. */
+    pcie_read32(ctrl);
+
+    bool ret = hstate.masked;
+    hstate.masked = mask;
+    return ret;
+}
+
+status_t PcieDevice::MaskUnmaskMsixIrq(uint irq_id, bool mask) {
+    if (irq_id >= irq_.handler_count)
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(irq_.handlers);
+
+    {
+        AutoSpinLockIrqSave handler_lock(irq_.handlers[irq_id].lock);
+        MaskUnmaskMsixIrqLocked(irq_id, mask);
+    }
+
+    return NO_ERROR;
+}
+
+void PcieDevice::SetMsixVectorTarget(uint irq_id, uint64_t tgt_addr, uint32_t tgt_data) {
+    /* The vector must be masked while its entry is rewritten; what the device
+     * does with a half written entry is undefined. */
+    pcie_write32(MsixEntryReg(irq_id, offsetof(pcie_msix_vector_entry_t, addr)),
+                 static_cast<uint32_t>(tgt_addr & 0xFFFFFFFF));
+    pcie_write32(MsixEntryReg(irq_id, offsetof(pcie_msix_vector_entry_t, addr_upper)),
+                 static_cast<uint32_t>(tgt_addr >> 32));
+    pcie_write32(MsixEntryReg(irq_id, offsetof(pcie_msix_vector_entry_t, data)), tgt_data);
+}
+
+status_t PcieDevice::MapMsixTable() {
+    DEBUG_ASSERT(!irq_.msi_x.table_mapping);
+
+    /* The vector table lives in one of the device's memory BARs, which must
+     * have been allocated and be big enough to hold it. */
+    const pcie_bar_info_t* bar = GetBarInfo(irq_.msi_x.table_bir);
+    size_t table_size = irq_.msi_x.max_irqs * sizeof(pcie_msix_vector_entry_t);
+    if (!bar || !bar->is_mmio ||
+        (static_cast<uint64_t>(irq_.msi_x.table_offset) + table_size > bar->size)) {
+        TRACEF("Device %02x:%02x.%01x (%04hx:%04hx) has an MSI-X vector table "
+               "(%u vectors at offset 0x%x of BAR %u) which is not inside an "
+               "allocated MMIO BAR\n",
+               bus_id_, dev_id_, func_id_, vendor_id_, device_id_,
+               irq_.msi_x.max_irqs, irq_.msi_x.table_offset, irq_.msi_x.table_bir);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    paddr_t table_phys = static_cast<paddr_t>(bar->bus_addr + irq_.msi_x.table_offset);
+    paddr_t map_base   = ROUNDDOWN(table_phys, PAGE_SIZE);
+    size_t  map_size   = ROUNDUP(table_phys + table_size, PAGE_SIZE) - map_base;
+
+    char name_buf[32];
+    snprintf(name_buf, sizeof(name_buf), "pcie_msix_%02x_%02x_%01x", bus_id_, dev_id_, func_id_);
+
+    status_t res = vmm_alloc_physical(vmm_get_kernel_aspace(),
+                                      name_buf,
+                                      map_size,
+                                      &irq_.msi_x.table_mapping,
+                                      PAGE_SIZE_SHIFT,
+                                      0 /* min alloc gap */,
+                                      map_base,
+                                      0 /* vmm flags */,
+                                      ARCH_MMU_FLAG_UNCACHED_DEVICE |
+                                      ARCH_MMU_FLAG_PERM_READ |
+                                      ARCH_MMU_FLAG_PERM_WRITE);
+    if (res != NO_ERROR) {
+        irq_.msi_x.table_mapping = nullptr;
+        return res;
+    }
+
+    irq_.msi_x.table = reinterpret_cast<volatile pcie_msix_vector_entry_t*>(
+            reinterpret_cast<uintptr_t>(irq_.msi_x.table_mapping) + (table_phys - map_base));
+    return NO_ERROR;
+}
+
+void PcieDevice::UnmapMsixTable() {
+    if (!irq_.msi_x.table_mapping)
+        return;
+
+    vmm_free_region(vmm_get_kernel_aspace(), reinterpret_cast<vaddr_t>(irq_.msi_x.table_mapping));
+    irq_.msi_x.table_mapping = nullptr;
+    irq_.msi_x.table         = nullptr;
+}
+
+void PcieDevice::FreeMsixBlock() {
+    /* If no block has been allocated, there is nothing to do */
+    if (!irq_.msi_x.irq_block.allocated)
+        return;
+
+    DEBUG_ASSERT(bus_drv_.platform().supports_msi());
+
+    /* Unregister handlers, synchronizing with the dispatchers in the process,
+     * then give the block of IRQs back to the platform. */
+    const pcie_msi_block_t* b = &irq_.msi_x.irq_block;
+    for (uint i = 0; i < b->num_irq; i++)
+        bus_drv_.platform().RegisterMsiHandler(b, i, NULL, NULL);
+
+    bus_drv_.platform().FreeMsiBlock(&irq_.msi_x.irq_block);
+    DEBUG_ASSERT(!irq_.msi_x.irq_block.allocated);
+}
+
+void PcieDevice::LeaveMsixIrqMode() {
+    /* Mask the whole function, and every vector in it, before turning MSI-X
+     * off so nothing is raised while the IRQs are returned. */
+    SetMsixCtrl(0, PCIE_CAP_MSIX_CTRL_FUNCTION_MASK);
+    if (irq_.msi_x.table) {
+        for (uint i = 0; i < irq_.msi_x.max_irqs; i++)
+            pcie_write32(MsixEntryReg(i, offsetof(pcie_msix_vector_entry_t, vector_ctrl)),
+                         PCIE_MSIX_VECTOR_CTRL_MASKED);
+    }
+    SetMsixCtrl(PCIE_CAP_MSIX_CTRL_ENABLE | PCIE_CAP_MSIX_CTRL_FUNCTION_MASK, 0);
+
+    FreeMsixBlock();
+    UnmapMsixTable();
+
+    /* Reset our common state, free any allocated handlers */
+    ResetCommonIrqBookkeeping();
+}
+
+status_t PcieDevice::EnterMsixIrqMode(uint requested_irqs) {
+    DEBUG_ASSERT(requested_irqs);
+
+    status_t res = NO_ERROR;
+
+    // We cannot go into MSI-X mode if we don't support MSI-X at all, or we
+    // can't support the number of IRQs requested
+    if (!irq_.msi_x.ctrl_reg                  ||
+        !bus_drv_.platform().supports_msi()   ||
+        (requested_irqs > MaxMsixIrqs()))
+        return ERR_NOT_SUPPORTED;
+
+    // The vector table is reached through the device's MMIO window.  Map it,
+    // and mask the function as a whole while its vectors are set up.
+    ModifyCmdLocked(0, PCI_COMMAND_MEM_EN);
+    res = MapMsixTable();
+    if (res != NO_ERROR)
+        goto bailout;
+
+    SetMsixCtrl(0, PCIE_CAP_MSIX_CTRL_FUNCTION_MASK);
+    for (uint i = 0; i < irq_.msi_x.max_irqs; i++)
+        pcie_write32(MsixEntryReg(i, offsetof(pcie_msix_vector_entry_t, vector_ctrl)),
+                     PCIE_MSIX_VECTOR_CTRL_MASKED);
+
+    /* Ask the platform for a chunk of MSI-X compatible IRQs.  Vector table
+     * entries always hold a 64 bit address. */
+    DEBUG_ASSERT(!irq_.msi_x.irq_block.allocated);
+    res = bus_drv_.platform().AllocMsiBlock(requested_irqs,
+                                            true,  /* can_target_64bit */
+                                            true,  /* is_msix */
+                                            &irq_.msi_x.irq_block);
+    if (res != NO_ERROR) {
+        LTRACEF("Failed to allocate a block of %u MSI-X IRQs for device "
+                "%02x:%02x.%01x (res %d)\n",
+                requested_irqs, bus_id_, dev_id_, func_id_, res);
+        goto bailout;
+    }
+
+    /* Allocate our handler table.  Every vector starts out masked, and can
+     * always be masked individually. */
+    res = AllocIrqHandlers(requested_irqs, true);
+    if (res != NO_ERROR)
+        goto bailout;
+
+    /* Record our new IRQ mode */
+    irq_.mode = PCIE_IRQ_MODE_MSI_X;
+
+    /* Program each vector initially targeting the platform's choice of CPU,
+     * and register it with the dispatcher. */
+    DEBUG_ASSERT(irq_.handler_count <= irq_.msi_x.irq_block.num_irq);
+    for (uint i = 0; i < irq_.handler_count; ++i) {
+        SetMsixVectorTarget(i, irq_.msi_x.irq_block.tgt_addr, irq_.msi_x.irq_block.tgt_data + i);
+        bus_drv_.platform().RegisterMsiHandler(&irq_.msi_x.irq_block,
+                                               i,
+                                               PcieDevice::MsixIrqHandlerThunk,
+                                               irq_.handlers + i);
+    }
+
+    /* Enable MSI-X, and let the vectors be unmasked one at a time */
+    SetMsixCtrl(0, PCIE_CAP_MSIX_CTRL_ENABLE);
+    SetMsixCtrl(PCIE_CAP_MSIX_CTRL_FUNCTION_MASK, 0);
+
+bailout:
+    if (res != NO_ERROR)
+        LeaveMsixIrqMode();
+
+    return res;
+}
+
+enum handler_return PcieDevice::MsixIrqHandler(pcie_irq_handler_state_t& hstate) {
+    /* No need to save IRQ state; we are in an IRQ handler at the moment. */
+    AutoSpinLock handler_lock(hstate.lock);
+
+    /* Unlike MSI, every vector can be masked at the device, and the masked
+     * flag always matches the vector table.  So there is no need to mask
+     * around the dispatch; each vector is edge triggered and a new one waits
+     * at the interrupt controller until we return.  A masked vector or one
+     * with no handler can only be something raised before it was masked. */
+    if (!hstate.handler) {
+        if (!hstate.masked)
+            MaskUnmaskMsixIrqLocked(hstate.pci_irq_id, true);
+        return INT_NO_RESCHEDULE;
+    }
+
+    if (hstate.masked)
+        return INT_NO_RESCHEDULE;
+
+    /* Dispatch */
+    pcie_irq_handler_retval_t irq_ret = hstate.handler(*this, hstate.pci_irq_id, hstate.ctx);
+
+    /* Mask the IRQ if asked to do so */
+    if (irq_ret & PCIE_IRQRET_MASK)
+        MaskUnmaskMsixIrqLocked(hstate.pci_irq_id, true);
+
+    /* Request a reschedule if asked to do so */
+    return (irq_ret & PCIE_IRQRET_RESCHED) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+}
+
+enum handler_return PcieDevice::MsixIrqHandlerThunk(void *arg) {
+    DEBUG_ASSERT(arg);
+    auto& hstate = *(reinterpret_cast<pcie_irq_handler_state_t*>(arg));
+    DEBUG_ASSERT(hstate.dev);
+    return hstate.dev->MsixIrqHandler(hstate);
+}
+
 /******************************************************************************
  *
  * Internal implementation of the Kernel facing API.
@@ -571,13 +826,20 @@ status_t PcieDevice::QueryIrqModeCapabilitiesLocked(pcie_irq_mode_t mode,
         break;
 
     case PCIE_IRQ_MODE_MSI_X:
-        /* If the platform does not support MSI, then we don't support MSI,
+        /* If the platform does not support MSI, then we don't support MSI-X,
          * even if the device does. */
         if (!bus_drv_.platform().supports_msi())
             return ERR_NOT_SUPPORTED;
 
-        /* TODO(johngro) : finish MSI-X implementation. */
-        return ERR_NOT_SUPPORTED;
+        /* If the device supports MSI-X, it will have a pointer to the control
+         * register in config. */
+        if (!irq_.msi_x.ctrl_reg)
+            return ERR_NOT_SUPPORTED;
+
+        /* Every MSI-X vector can be masked in the vector table. */
+        out_caps->max_irqs = MaxMsixIrqs();
+        out_caps->per_vector_masking_supported = true;
+        break;
 
     default:
         return ERR_INVALID_ARGS;
@@ -632,10 +894,14 @@ status_t PcieDevice::SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs)
             DEBUG_ASSERT(!irq_.registered_handler_count);
             return NO_ERROR;
 
-        /* Right now, there should be no way to get into MSI-X mode */
         case PCIE_IRQ_MODE_MSI_X:
-            DEBUG_ASSERT(false);
-            return ERR_NOT_SUPPORTED;
+            DEBUG_ASSERT(irq_.msi_x.ctrl_reg);
+            DEBUG_ASSERT(irq_.msi_x.irq_block.allocated);
+
+            LeaveMsixIrqMode();
+
+            DEBUG_ASSERT(!irq_.registered_handler_count);
+            return NO_ERROR;
 
         default:
             /* mode is not one of the valid enum values, this should be impossible */
@@ -656,7 +922,7 @@ status_t PcieDevice::SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs)
     switch (mode) {
     case PCIE_IRQ_MODE_LEGACY: return EnterLegacyIrqMode(requested_irqs);
     case PCIE_IRQ_MODE_MSI:    return EnterMsiIrqMode   (requested_irqs);
-    case PCIE_IRQ_MODE_MSI_X:  return ERR_NOT_SUPPORTED;
+    case PCIE_IRQ_MODE_MSI_X:  return EnterMsixIrqMode  (requested_irqs);
     default:                   return ERR_INVALID_ARGS;
     }
 }
@@ -727,7 +993,7 @@ status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     switch (irq_.mode) {
     case PCIE_IRQ_MODE_LEGACY: return MaskUnmaskLegacyIrq(mask);
     case PCIE_IRQ_MODE_MSI:    return MaskUnmaskMsiIrq(irq_id, mask);
-    case PCIE_IRQ_MODE_MSI_X:  return ERR_NOT_SUPPORTED;
+    case PCIE_IRQ_MODE_MSI_X:  return MaskUnmaskMsixIrq(irq_id, mask);
     default:
         DEBUG_ASSERT(false); /* This should be un-possible! */
         return ERR_INTERNAL;
@@ -736,6 +1002,70 @@ status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     return NO_ERROR;
 }
 
+status_t PcieDevice::SetIrqTargetCpuLocked(uint irq_id, int cpu) {
+    DEBUG_ASSERT(plugged_in_);
+    DEBUG_ASSERT(dev_lock_.IsHeld());
+
+    switch (irq_.mode) {
+    case PCIE_IRQ_MODE_DISABLED:
+        return ERR_BAD_STATE;
+
+    case PCIE_IRQ_MODE_LEGACY:
+        if (!irq_.legacy.shared_handler)
+            return ERR_BAD_STATE;
+        return set_interrupt_target_cpu(irq_.legacy.shared_handler->irq_id(), cpu);
+
+    case PCIE_IRQ_MODE_MSI: {
+        status_t res = bus_drv_.platform().RetargetMsiBlock(&irq_.msi.irq_block, cpu);
+        if (res != NO_ERROR)
+            return res;
+
+        /* Reprogramming the target masks every vector, so note which ones
+         * were unmasked once the device can no longer raise new IRQs, and
+         * unmask them again before turning MSI back on. */
+        SetMsiEnb(false);
+        uint32_t unmasked = 0;
+        for (uint i = 0; i < irq_.handler_count; i++) {
+            AutoSpinLockIrqSave handler_lock(irq_.handlers[i].lock);
+            if (!irq_.handlers[i].masked)
+                unmasked |= (1u << i);
+        }
+
+        SetMsiTarget(irq_.msi.irq_block.tgt_addr, irq_.msi.irq_block.tgt_data);
+
+        for (uint i = 0; i < irq_.handler_count; i++) {
+            if (unmasked & (1u << i))
+                MaskUnmaskMsiIrq(i, false);
+        }
+        SetMsiEnb(true);
+        return NO_ERROR;
+    }
+
+    case PCIE_IRQ_MODE_MSI_X: {
+        if (irq_id >= irq_.handler_count)
+            return ERR_INVALID_ARGS;
+
+        uint64_t tgt_addr;
+        status_t res = bus_drv_.platform().GetMsiTargetAddr(&irq_.msi_x.irq_block, cpu,
+                                                            &tgt_addr);
+        if (res != NO_ERROR)
+            return res;
+
+        /* Each vector has an entry of its own; only this one moves. */
+        AutoSpinLockIrqSave handler_lock(irq_.handlers[irq_id].lock);
+        bool was_masked = MaskUnmaskMsixIrqLocked(irq_id, true);
+        SetMsixVectorTarget(irq_id, tgt_addr, irq_.msi_x.irq_block.tgt_data + irq_id);
+        if (!was_masked)
+            MaskUnmaskMsixIrqLocked(irq_id, false);
+        return NO_ERROR;
+    }
+
+    default:
+        DEBUG_ASSERT(false); /* This should be un-possible! */
+        return ERR_INTERNAL;
+    }
+}
+
 /******************************************************************************
  *
  * Kernel API; prototypes in dev/pcie_irqs.h
@@ -788,6 +1118,14 @@ status_t PcieDevice::MaskUnmaskIrq(uint irq_id, bool mask) {
         : ERR_BAD_STATE;
 }
 
+status_t PcieDevice::SetIrqTargetCpu(uint irq_id, int cpu) {
+    AutoLock dev_lock(dev_lock_);
+
+    return (plugged_in_ && !disabled_)
+        ? SetIrqTargetCpuLocked(irq_id, cpu)
+        : ERR_BAD_STATE;
+}
+
 status_t PcieDevice::InitLegacyIrqStateLocked(PcieBridge& upstream) {
     DEBUG_ASSERT(dev_lock_.IsHeld());
     DEBUG_ASSERT(cfg_);
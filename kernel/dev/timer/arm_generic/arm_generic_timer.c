@@ -109,9 +109,21 @@
 #define TIMER_REG_TVAL      SELECTED_TIMER_REG(_TVAL)
 #define TIMER_REG_CT        SELECTED_TIMER_REG(CT)
 
+/* The vDSO reads the physical count, so user mode time matches ours unless
+ * we use the virtual timer. */
+#define TIMER_COUNT_IS_PHYSICAL_CNTP    1
+#define TIMER_COUNT_IS_PHYSICAL_CNTPS   1
+#define TIMER_COUNT_IS_PHYSICAL_CNTV    0
+#define TIMER_COUNT_IS_PHYSICAL XCOMBINE3(TIMER_COUNT_IS_PHYSICAL_, TIMER_ARM_GENERIC_SELECTED,)
+
+/* CNTKCTL bits that let EL0 read the physical and virtual counts */
+#define CNTKCTL_EL0PCTEN    (1 << 0)
+#define CNTKCTL_EL0VCTEN    (1 << 1)
+
 
 static platform_timer_callback t_callback;
 static int timer_irq;
+static uint32_t timer_cntfrq;
 
 struct fp_32_64 cntpct_per_ms;
 struct fp_32_64 ms_per_cntpct;
@@ -220,6 +232,33 @@ lk_time_t current_time(void)
     return cntpct_to_lk_time(read_cntpct());
 }
 
+uint64_t platform_user_ticks_per_second(void)
+{
+    return timer_cntfrq;
+}
+
+bool platform_user_ticks_to_ns(struct fp_32_64* ns_per_tick)
+{
+    if (!TIMER_COUNT_IS_PHYSICAL || !timer_cntfrq)
+        return false;
+    *ns_per_tick = ns_per_cntpct;
+    return true;
+}
+
+static void enable_user_counter_access(void)
+{
+#if ARCH_ARM64
+    uint64_t cntkctl = ARM64_READ_SYSREG(cntkctl_el1);
+    ARM64_WRITE_SYSREG(cntkctl_el1, cntkctl | CNTKCTL_EL0PCTEN | CNTKCTL_EL0VCTEN);
+#else
+    uint32_t cntkctl;
+    __asm__ volatile("mrc p15, 0, %0, c14, c1, 0" : "=r" (cntkctl));
+    cntkctl |= CNTKCTL_EL0PCTEN | CNTKCTL_EL0VCTEN;
+    __asm__ volatile("mcr p15, 0, %0, c14, c1, 0" :: "r" (cntkctl));
+    ISB;
+#endif
+}
+
 static uint32_t abs_int32(int32_t a)
 {
     return (a > 0) ? a : -a;
@@ -343,6 +382,8 @@ void arm_generic_timer_init(int irq, uint32_t freq_override)
 #endif
     arm_generic_timer_init_conversion_factors(cntfrq);
     test_time_conversions(cntfrq);
+    timer_cntfrq = cntfrq;
+    enable_user_counter_access();
 
     LTRACEF("register irq %d on cpu %u\n", irq, arch_curr_cpu_num());
     register_int_handler(irq, &platform_tick, NULL);
@@ -356,6 +397,7 @@ static void arm_generic_timer_init_secondary_cpu(uint level)
     LTRACEF("register irq %d on cpu %u\n", timer_irq, arch_curr_cpu_num());
     register_int_handler(timer_irq, &platform_tick, NULL);
     unmask_interrupt(timer_irq);
+    enable_user_counter_access();
 }
 
 /* secondary cpu initialize the timer just before the kernel starts with interrupts enabled */
@@ -41,6 +41,12 @@ status_t arch_mmu_destroy_aspace(arch_aspace_t *aspace) __NONNULL((1));
 /* routines to map/unmap/update permissions/query mappings per address space */
 int arch_mmu_map(arch_aspace_t *aspace, vaddr_t vaddr, paddr_t paddr, size_t count, uint flags) __NONNULL((1));
 int arch_mmu_unmap(arch_aspace_t *aspace, vaddr_t vaddr, size_t count) __NONNULL((1));
+/* unmap everything in a user address space that will not be used again,
+ * freeing its page tables wholesale rather than a page at a time */
+status_t arch_mmu_unmap_all(arch_aspace_t *aspace) __NONNULL((1));
+/* the memory held by the page tables of an address space, including its top
+ * level table; the caller keeps the tables from changing */
+size_t arch_mmu_page_table_bytes(arch_aspace_t *aspace) __NONNULL((1));
 int arch_mmu_protect(arch_aspace_t *aspace, vaddr_t vaddr, size_t count, uint flags) __NONNULL((1));
 status_t arch_mmu_query(arch_aspace_t *aspace, vaddr_t vaddr, paddr_t *paddr, uint *flags) __NONNULL((1));
 
@@ -37,3 +37,10 @@ status_t arch_mp_prep_cpu_unplug(uint cpu_id);
 status_t arch_mp_cpu_unplug(uint cpu_id);
 
 void arch_mp_init_percpu(void);
+
+/* Masks of the cpus that share a core (and so its private caches) with
+ * cpu_id, and of the cpus in the same package (sharing the last level
+ * cache).  Both include cpu_id itself.  Used by the scheduler to keep woken
+ * threads close to where they last ran. */
+mp_cpu_mask_t arch_mp_cpu_smt_siblings(uint cpu_id);
+mp_cpu_mask_t arch_mp_cpu_package_siblings(uint cpu_id);
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <kernel/mutex.h>
+#include <kernel/rwlock.h>
 #include <kernel/spinlock.h>
 #include <mxtl/auto_lock.h>
 
@@ -58,3 +59,47 @@ private:
     spin_lock_t* spinlock_;
     spin_lock_saved_state_t state_;
 };
+
+class AutoReadLock {
+public:
+    explicit AutoReadLock(rwlock_t& lock) : rwlock_(&lock) { rwlock_acquire_read(rwlock_); }
+    ~AutoReadLock() { release(); }
+
+    void release() {
+        if (rwlock_) {
+            rwlock_release_read(rwlock_);
+            rwlock_ = nullptr;
+        }
+    }
+
+    // suppress default constructors
+    AutoReadLock(const AutoReadLock& am) = delete;
+    AutoReadLock(AutoReadLock&& c) = delete;
+    AutoReadLock& operator=(const AutoReadLock& am) = delete;
+    AutoReadLock& operator=(AutoReadLock&& c) = delete;
+
+private:
+    rwlock_t* rwlock_;
+};
+
+class AutoWriteLock {
+public:
+    explicit AutoWriteLock(rwlock_t& lock) : rwlock_(&lock) { rwlock_acquire_write(rwlock_); }
+    ~AutoWriteLock() { release(); }
+
+    void release() {
+        if (rwlock_) {
+            rwlock_release_write(rwlock_);
+            rwlock_ = nullptr;
+        }
+    }
+
+    // suppress default constructors
+    AutoWriteLock(const AutoWriteLock& am) = delete;
+    AutoWriteLock(AutoWriteLock&& c) = delete;
+    AutoWriteLock& operator=(const AutoWriteLock& am) = delete;
+    AutoWriteLock& operator=(AutoWriteLock&& c) = delete;
+
+private:
+    rwlock_t* rwlock_;
+};
@@ -25,6 +25,9 @@ typedef struct event {
 } event_t;
 
 #define EVENT_FLAG_AUTOUNSIGNAL 1
+/* with EVENT_FLAG_AUTOUNSIGNAL, signaling wakes the most recent waiter, see
+ * wait_queue_wake_one_lifo() */
+#define EVENT_FLAG_WAKE_LIFO 2
 
 #define EVENT_INITIAL_VALUE(e, initial, _flags) \
 { \
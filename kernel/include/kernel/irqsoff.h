@@ -0,0 +1,76 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* Interrupts-off and spin lock hold tracking, built in with
+ * ENABLE_IRQSOFF_TRACE=true.
+ *
+ * Each cpu times how long it runs with interrupts disabled, from the
+ * arch_disable_ints() or interrupt entry that turned them off to whatever
+ * turns them back on, and how long it holds spin locks, from the outermost
+ * acquisition to the matching release. It keeps the longest few of each
+ * along with the code addresses that started and ended them. The `irqsoff`
+ * console command shows them, and stopping a trace leaves a TAG_IRQSOFF
+ * record for each.
+ *
+ * Only the arch routines see interrupts change: assembly that turns them on
+ * behind the tracker's back leaves a section open, which is dropped the
+ * next time they're turned off rather than reported.
+ *
+ * This file is included by the arch headers, so it mustn't include any.
+ */
+#ifndef IRQSOFF_TRACE
+#define IRQSOFF_TRACE 0
+#endif
+
+#define IRQSOFF_RECORDS 8
+
+#define IRQSOFF_KIND_INTS 0
+#define IRQSOFF_KIND_SPIN 1
+
+/* the vector of a record that doesn't start in an interrupt */
+#define IRQSOFF_NO_VECTOR UINT32_MAX
+
+struct irqsoff_record {
+    uintptr_t start_site;   /* where it began, or what an interrupt interrupted */
+    uintptr_t end_site;
+    const void *lock;       /* the outermost spin lock held */
+    uint32_t vector;
+    lk_bigtime_t duration;
+    lk_bigtime_t when;      /* when it ended */
+};
+
+#if IRQSOFF_TRACE
+/* called by the arch routines with interrupts already disabled and just
+ * about to be enabled, respectively. the code address they record is that
+ * of whoever inlined the arch routine. */
+void irqsoff_ints_disabled(void);
+void irqsoff_ints_enabling(void);
+
+/* for the interrupt entry and exit paths, when they interrupted code that
+ * had interrupts enabled */
+void irqsoff_irq_enter(uint32_t vector, uintptr_t ip);
+void irqsoff_irq_exit(void);
+
+/* called by the spin lock routines, inside the lock */
+void irqsoff_spin_locked(const void *lock);
+void irqsoff_spin_unlocking(void);
+
+void irqsoff_reset(void);
+void irqsoff_ktrace(void);
+#else
+static inline void irqsoff_reset(void) {}
+static inline void irqsoff_ktrace(void) {}
+#endif
+
+__END_CDECLS
@@ -0,0 +1,73 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <arch/spinlock.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+__BEGIN_CDECLS
+
+/* Lock contention statistics, built in with ENABLE_LOCK_STATS=true.
+ *
+ * Every blocking acquisition of a mutex, spin lock or ticket spin lock is
+ * counted against its lock class, the code address it was acquired from,
+ * along with whether it had to wait, for how long and how many others were
+ * ahead of it.  Mutexes and ticket spin locks also account how long they
+ * were held; plain spin locks are a single word shared with assembly, so
+ * they don't.  The `lockstat` console command lists the classes that waited
+ * the longest, and stopping a trace leaves a TAG_LOCK_STATS record for each
+ * class that was contended in it.
+ */
+#ifndef LOCK_STATS
+#define LOCK_STATS 0
+#endif
+
+#define LOCKSTAT_MUTEX  0
+#define LOCKSTAT_SPIN   1
+#define LOCKSTAT_TICKET 2
+
+struct lockstat_class {
+    uintptr_t site;         /* where the lock is acquired, 0 = free entry */
+    const void *lock;       /* the last lock acquired there */
+    uint32_t kind;          /* LOCKSTAT_* */
+    uint32_t max_contenders;
+    uint64_t acquires;
+    uint64_t contended;     /* acquires that had to wait */
+    lk_bigtime_t wait_time;
+    lk_bigtime_t max_wait;
+    lk_bigtime_t hold_time;
+    lk_bigtime_t max_hold;
+};
+
+#if LOCK_STATS
+struct ticket_spin_lock;
+
+/* returns the class for |site|, never NULL */
+struct lockstat_class *lockstat_lookup(uintptr_t site, uint32_t kind, const void *lock);
+void lockstat_acquired(struct lockstat_class *c, uint32_t contenders, lk_bigtime_t wait);
+void lockstat_released(struct lockstat_class *c, lk_bigtime_t hold);
+
+/* out of line halves of the spin lock routines, so that the call site they
+ * see is the one that inlined the lock routine */
+void lockstat_spin_lock(spin_lock_t *lock);
+void lockstat_ticket_locked(struct ticket_spin_lock *lock, uint32_t ahead, lk_bigtime_t start);
+void lockstat_ticket_unlocking(struct ticket_spin_lock *lock);
+
+void lockstat_reset(void);
+void lockstat_ktrace(void);
+
+/* for the lock types' INITIAL_VALUE macros */
+#define LOCKSTAT_INITIAL_VALUE .lockstat_class = NULL, .lockstat_time = 0,
+#else
+#define LOCKSTAT_INITIAL_VALUE
+static inline void lockstat_reset(void) {}
+static inline void lockstat_ktrace(void) {}
+#endif
+
+__END_CDECLS
@@ -70,7 +70,10 @@ struct mp_state {
     mp_cpu_mask_t idle_cpus;
     mp_cpu_mask_t realtime_cpus;
 
-    spin_lock_t ipi_task_lock;
+    /* cpus sent a reschedule ipi which have not rescheduled since */
+    volatile mp_cpu_mask_t resched_pending;
+
+    ticket_spin_lock_t ipi_task_lock;
     /* list of outstanding tasks for CPUs to execute.  Should only be
      * accessed with the ipi_task_lock held */
     struct list_node ipi_task_list[SMP_MAX_CPUS];
@@ -136,6 +139,14 @@ static inline mp_cpu_mask_t mp_get_realtime_mask(void)
 {
     return mp.realtime_cpus;
 }
+
+/* called by a cpu before it picks what to run next, after which it needs to
+ * be sent a reschedule ipi for new work again */
+static inline void mp_reschedule_done(uint cpu)
+{
+    if (mp.resched_pending & (1U << cpu))
+        atomic_and((int *)&mp.resched_pending, ~(1U << cpu));
+}
 #else
 static inline void mp_init(void) {}
 static inline void mp_reschedule(mp_cpu_mask_t target, uint flags) {}
@@ -150,6 +161,7 @@ static inline void mp_sync_exec(mp_cpu_mask_t target, mp_sync_task_t task, void
 }
 static inline void mp_set_curr_cpu_active(bool active) {}
 static inline void mp_set_curr_cpu_online(bool online) {}
+static inline void mp_reschedule_done(uint cpu) {}
 
 static inline enum handler_return mp_mbx_reschedule_irq(void) { return INT_NO_RESCHEDULE; }
 static inline enum handler_return mp_mbx_generic_irq(void) { return INT_NO_RESCHEDULE; }
@@ -12,6 +12,7 @@
 #include <magenta/compiler.h>
 #include <debug.h>
 #include <stdint.h>
+#include <kernel/lockstat.h>
 #include <kernel/thread.h>
 
 __BEGIN_CDECLS;
@@ -23,6 +24,11 @@ typedef struct mutex {
     thread_t *holder;
     int count;
     wait_queue_t wait;
+    struct list_node held_node; /* in holder's held_mutexes list */
+#if LOCK_STATS
+    struct lockstat_class *lockstat_class;  /* the holder's */
+    lk_bigtime_t lockstat_time;             /* when the holder got the mutex */
+#endif
 } mutex_t;
 
 #define MUTEX_INITIAL_VALUE(m) \
@@ -31,11 +37,15 @@ typedef struct mutex {
     .holder = NULL, \
     .count = 0, \
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+    .held_node = LIST_INITIAL_CLEARED_VALUE, \
+    LOCKSTAT_INITIAL_VALUE \
 }
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - The holder of a contended mutex runs at no lower a priority than the
+ *   threads waiting for it.
 */
 
 void mutex_init(mutex_t *);
@@ -0,0 +1,68 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef __KERNEL_RWLOCK_H
+#define __KERNEL_RWLOCK_H
+
+#include <magenta/compiler.h>
+#include <kernel/thread.h>
+#include <kernel/wait.h>
+
+__BEGIN_CDECLS;
+
+#define RWLOCK_MAGIC (0x72776c6b)  // 'rwlk'
+
+typedef struct rwlock {
+    uint32_t magic;
+    int readers;            /* threads holding the lock shared */
+    int writers_waiting;
+    thread_t *writer;       /* thread holding the lock exclusive */
+    wait_queue_t read_wait;
+    wait_queue_t write_wait;
+} rwlock_t;
+
+#define RWLOCK_INITIAL_VALUE(l) \
+{ \
+    .magic = RWLOCK_MAGIC, \
+    .readers = 0, \
+    .writers_waiting = 0, \
+    .writer = NULL, \
+    .read_wait = WAIT_QUEUE_INITIAL_VALUE((l).read_wait), \
+    .write_wait = WAIT_QUEUE_INITIAL_VALUE((l).write_wait), \
+}
+
+/* Rules for reader/writer locks:
+ * - Only safe to use from thread context.
+ * - Any number of threads may hold the lock shared, or one exclusive.
+ * - Waiting writers hold off new readers, so readers can't starve a writer;
+ *   the flip side is that taking the lock shared recursively can deadlock.
+ * - Unlike mutexes, there is no priority inheritance.
+ */
+
+void rwlock_init(rwlock_t *);
+void rwlock_destroy(rwlock_t *);
+void rwlock_acquire_read(rwlock_t *);
+void rwlock_release_read(rwlock_t *);
+void rwlock_acquire_write(rwlock_t *);
+void rwlock_release_write(rwlock_t *);
+
+/* does the current thread hold the lock exclusive? */
+static bool is_rwlock_write_held(const rwlock_t *l)
+{
+    return l->writer == get_current_thread();
+}
+
+/* is the lock held at all? Readers aren't tracked, so this can't tell
+ * whether it is the current thread that holds it shared; it is only meant
+ * for assertions. */
+static bool is_rwlock_held(const rwlock_t *l)
+{
+    return is_rwlock_write_held(l) || l->readers > 0;
+}
+
+__END_CDECLS;
+
+#endif
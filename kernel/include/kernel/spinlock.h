@@ -8,25 +8,47 @@
 #pragma once
 
 #include <magenta/compiler.h>
+#include <arch/ops.h>
 #include <arch/spinlock.h>
+#include <kernel/irqsoff.h>
+#include <kernel/lockstat.h>
+#include <platform.h>
+#include <stdint.h>
 
 __BEGIN_CDECLS
 
 /* interrupts should already be disabled */
 static inline void spin_lock(spin_lock_t *lock)
 {
+#if LOCK_STATS
+    lockstat_spin_lock(lock);
+#else
     arch_spin_lock(lock);
+#endif
+#if IRQSOFF_TRACE
+    irqsoff_spin_locked(lock);
+#endif
 }
 
 /* Returns 0 on success, non-0 on failure */
 static inline int spin_trylock(spin_lock_t *lock)
 {
+#if IRQSOFF_TRACE
+    if (arch_spin_trylock(lock))
+        return 1;
+    irqsoff_spin_locked(lock);
+    return 0;
+#else
     return arch_spin_trylock(lock);
+#endif
 }
 
 /* interrupts should already be disabled */
 static inline void spin_unlock(spin_lock_t *lock)
 {
+#if IRQSOFF_TRACE
+    irqsoff_spin_unlocking();
+#endif
     arch_spin_unlock(lock);
 }
 
@@ -75,6 +97,124 @@ static inline void spin_unlock_restore(
 #define spin_lock_irqsave(lock, statep) spin_lock_save(lock, &(statep), SPIN_LOCK_FLAG_INTERRUPTS)
 #define spin_unlock_irqrestore(lock, statep) spin_unlock_restore(lock, statep, SPIN_LOCK_FLAG_INTERRUPTS)
 
+/* Ticket spin locks, for heavily contended locks.
+ *
+ * Waiters take a ticket and are handed the lock in arrival order, so no cpu
+ * can be starved the way it can with the plain test-and-set spin_lock_t.
+ * While waiting, a cpu only reads the lock word, backing off in proportion
+ * to its place in line, instead of every waiter retrying an atomic swap on
+ * the same cache line.  Each lock counts how many acquisitions had to wait.
+ */
+typedef struct ticket_spin_lock {
+    uint32_t next;      /* next ticket to hand out */
+    uint32_t serving;   /* ticket of the current holder */
+    ulong contended;    /* acquisitions that had to wait, updated by the holder */
+#if LOCK_STATS
+    struct lockstat_class *lockstat_class;  /* the holder's, NULL after a trylock */
+    lk_bigtime_t lockstat_time;             /* when the holder got the lock */
+#endif
+} ticket_spin_lock_t;
+
+#define TICKET_SPIN_LOCK_INITIAL_VALUE \
+    { .next = 0, .serving = 0, .contended = 0, LOCKSTAT_INITIAL_VALUE }
+
+static inline void ticket_spin_lock_init(ticket_spin_lock_t *lock)
+{
+    *lock = (ticket_spin_lock_t)TICKET_SPIN_LOCK_INITIAL_VALUE;
+}
+
+/* interrupts should already be disabled */
+static inline void ticket_spin_lock(ticket_spin_lock_t *lock)
+{
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint32_t serving = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    if (likely(serving == ticket)) {
+#if LOCK_STATS
+        lockstat_ticket_locked(lock, 0, 0);
+#endif
+#if IRQSOFF_TRACE
+        irqsoff_spin_locked(lock);
+#endif
+        return;
+    }
+
+#if LOCK_STATS
+    uint32_t ahead = ticket - serving;
+    lk_bigtime_t start = current_time_hires();
+#endif
+    do {
+        for (uint32_t i = ticket - serving; i > 0; i--)
+            arch_spinloop_pause();
+        serving = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    } while (serving != ticket);
+
+    lock->contended++;
+#if LOCK_STATS
+    lockstat_ticket_locked(lock, ahead, start);
+#endif
+#if IRQSOFF_TRACE
+    irqsoff_spin_locked(lock);
+#endif
+}
+
+/* Returns 0 on success, non-0 on failure */
+static inline int ticket_spin_trylock(ticket_spin_lock_t *lock)
+{
+    uint32_t serving = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    uint32_t expected = serving;
+    int ret = !__atomic_compare_exchange_n(&lock->next, &expected, serving + 1, false,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#if LOCK_STATS
+    if (ret == 0)
+        lock->lockstat_class = NULL;
+#endif
+#if IRQSOFF_TRACE
+    if (ret == 0)
+        irqsoff_spin_locked(lock);
+#endif
+    return ret;
+}
+
+static inline void ticket_spin_unlock(ticket_spin_lock_t *lock)
+{
+#if LOCK_STATS
+    lockstat_ticket_unlocking(lock);
+#endif
+#if IRQSOFF_TRACE
+    irqsoff_spin_unlocking();
+#endif
+    __atomic_store_n(&lock->serving, lock->serving + 1, __ATOMIC_RELEASE);
+}
+
+static inline bool ticket_spin_lock_held(ticket_spin_lock_t *lock)
+{
+    return __atomic_load_n(&lock->next, __ATOMIC_RELAXED) !=
+           __atomic_load_n(&lock->serving, __ATOMIC_RELAXED);
+}
+
+static inline void ticket_spin_lock_save(
+    ticket_spin_lock_t *lock,
+    spin_lock_saved_state_t *statep,
+    spin_lock_save_flags_t flags)
+{
+    arch_interrupt_save(statep, flags);
+    ticket_spin_lock(lock);
+}
+
+static inline void ticket_spin_unlock_restore(
+    ticket_spin_lock_t *lock,
+    spin_lock_saved_state_t old_state,
+    spin_lock_save_flags_t flags)
+{
+    ticket_spin_unlock(lock);
+    arch_interrupt_restore(old_state, flags);
+}
+
+#define ticket_spin_lock_irqsave(lock, statep) \
+    ticket_spin_lock_save(lock, &(statep), SPIN_LOCK_FLAG_INTERRUPTS)
+#define ticket_spin_unlock_irqrestore(lock, statep) \
+    ticket_spin_unlock_restore(lock, statep, SPIN_LOCK_FLAG_INTERRUPTS)
+
 __END_CDECLS
 
 #ifdef __cplusplus
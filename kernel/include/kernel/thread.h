@@ -16,6 +16,7 @@
 #include <arch/thread.h>
 #include <kernel/wait.h>
 #include <kernel/spinlock.h>
+#include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <debug.h>
 
@@ -72,22 +73,60 @@ enum thread_tls_list {
 
 #define THREAD_LINEBUFFER_LENGTH 128
 
+struct mutex;
+struct thread_quota;
+
+/* what a thread in the deadline class asks for, see thread_set_deadline() */
+typedef struct thread_deadline_params {
+    lk_bigtime_t runtime_ns;
+    lk_bigtime_t deadline_ns;
+    lk_bigtime_t period_ns;
+} thread_deadline_params_t;
+
 typedef struct thread {
     int magic;
     struct list_node thread_list_node;
 
     /* active bits */
     struct list_node queue_node;
-    int priority;
+    int priority; /* effective priority, including any inherited boost */
+    int base_priority; /* priority the thread was given */
+    int user_inherited_priority; /* boost from waiters on user locks, or -1 */
     enum thread_state state;
     int remaining_quantum;
+    /* the cpu whose run queue the thread is on, or -1 */
+    int queue_cpu;
+    /* how much of the time slice is left, as of the last time the thread
+     * was accounted for what it ran, see runtime_account_current() */
+    lk_bigtime_t quantum_left_ns;
+    /* THREAD_HANDOFF_*, see thread_handoff_begin() */
+    int handoff;
+    /* nonzero if the thread is in the fair share class, see thread_set_fair_weight() */
+    uint32_t fair_weight;
+    /* runtime scaled by THREAD_FAIR_WEIGHT_DEFAULT / fair_weight */
+    lk_bigtime_t vruntime_ns;
+    /* the deadline class, see thread_set_deadline(): a zero period if the
+     * thread isn't in it, the cpu it was admitted on, and the start, absolute
+     * deadline and unused runtime of its current period */
+    thread_deadline_params_t deadline;
+    int deadline_cpu;
+    lk_bigtime_t deadline_period_start_ns;
+    lk_bigtime_t deadline_abs_ns;
+    lk_bigtime_t deadline_budget_ns;
+    /* how late, in ms, sleep and wait timeouts may fire, see thread_set_timer_slack() */
+    lk_time_t timer_slack;
     unsigned int flags;
     unsigned int signals;
 #if WITH_SMP
     int curr_cpu;
+    int last_cpu; /* cpu the thread most recently ran on, or -1 */
     int pinned_cpu; /* only run on pinned_cpu if >= 0 */
+    uint32_t cpu_affinity; /* otherwise only on these cpus, see thread_set_cpu_affinity() */
 #endif
 
+    /* the cpu quota group the thread's time counts against, or NULL */
+    struct thread_quota *quota;
+
     /* pointer to the kernel address space this thread is associated with */
     vmm_aspace_t *aspace;
 
@@ -102,10 +141,25 @@ typedef struct thread {
      * THREAD_RUNNING state, this excludes the time it has accrued since it
      * left the scheduler. */
     lk_bigtime_t runtime_ns;
+    /* Total time in THREAD_READY state waiting for a cpu, and when the
+     * current wait started, or 0 if the thread isn't waiting. */
+    lk_bigtime_t queue_time_ns;
+    lk_bigtime_t ready_since_ns;
+    /* times the thread gave up the cpu to block, sleep, suspend or exit,
+     * and times it lost the cpu while still runnable */
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    /* times the thread started running on a different cpu than last time */
+    uint64_t migrations;
 
     /* if blocked, a pointer to the wait queue */
     struct wait_queue *blocking_wait_queue;
 
+    /* priority inheritance: the mutexes this thread holds, and the one it is
+     * blocked acquiring, if any */
+    struct list_node held_mutexes;
+    struct mutex *blocking_mutex;
+
     /* return code if woken up abnornmally from suspend, sleep, or block */
     status_t blocked_status;
 
@@ -145,13 +199,17 @@ typedef struct thread {
 
 #if WITH_SMP
 #define thread_curr_cpu(t) ((t)->curr_cpu)
+#define thread_last_cpu(t) ((t)->last_cpu)
 #define thread_pinned_cpu(t) ((t)->pinned_cpu)
 #define thread_set_curr_cpu(t,c) ((t)->curr_cpu = (c))
+#define thread_set_last_cpu(t,c) ((t)->last_cpu = (c))
 #define thread_set_pinned_cpu(t, c) ((t)->pinned_cpu = (c))
 #else
 #define thread_curr_cpu(t) (0)
+#define thread_last_cpu(t) (0)
 #define thread_pinned_cpu(t) (-1)
 #define thread_set_curr_cpu(t,c) do {} while(0)
+#define thread_set_last_cpu(t,c) do {} while(0)
 #define thread_set_pinned_cpu(t, c) do {} while(0)
 #endif
 
@@ -165,6 +223,31 @@ typedef struct thread {
 #define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
 #define HIGH_PRIORITY ((NUM_PRIORITIES / 4) * 3)
 
+/* Threads in the fair share class are scheduled as a group at FAIR_PRIORITY,
+ * and among themselves by lowest virtual runtime, so that each gets cpu time
+ * in proportion to its weight.  A thread at DEFAULT_PRIORITY maps to
+ * THREAD_FAIR_WEIGHT_DEFAULT, each priority level above or below scales the
+ * weight by 1.25. */
+#define FAIR_PRIORITY DEFAULT_PRIORITY
+#define THREAD_FAIR_WEIGHT_DEFAULT 1024
+#define THREAD_FAIR_WEIGHT_MAX (THREAD_FAIR_WEIGHT_DEFAULT * 64)
+
+/* Threads in the deadline class get runtime_ns of cpu time in every period
+ * of period_ns, within deadline_ns of the period starting.  Each is admitted
+ * on one cpu, and only while the runtime to deadline ratios of the threads
+ * there add up to at most THREAD_DEADLINE_LOAD_MAX percent, which keeps the
+ * rest of the cpu for everything else.  They are scheduled as a group at
+ * DEADLINE_PRIORITY, earliest absolute deadline first, and one that uses up
+ * its runtime is held off until its next period.  Budgets are enforced by
+ * the preemption timer, so to within a millisecond. */
+#define DEADLINE_PRIORITY (DPC_PRIORITY - 1)
+#define THREAD_DEADLINE_LOAD_MAX 80
+#define THREAD_DEADLINE_PERIOD_MIN_NS (1000000ULL)        /* 1ms */
+#define THREAD_DEADLINE_PERIOD_MAX_NS (10 * 1000000000ULL) /* 10s */
+
+/* upper bound on a thread's timer slack, in ms */
+#define THREAD_TIMER_SLACK_MAX 1000
+
 /* stack size */
 #ifdef CUSTOM_DEFAULT_STACK_SIZE
 #define DEFAULT_STACK_SIZE CUSTOM_DEFAULT_STACK_SIZE
@@ -180,6 +263,9 @@ void thread_secondary_cpu_init_early(thread_t *t);
 void thread_secondary_cpu_entry(void) __NO_RETURN;
 void thread_construct_first(thread_t *t, const char *name);
 thread_t *thread_create_idle_thread(uint cpu_num);
+#if WITH_SMP
+void thread_transition_off_cpu(uint old_cpu);
+#endif
 void thread_set_name(const char *name);
 void thread_set_priority(int priority);
 void thread_set_exit_callback(thread_t *t, thread_exit_callback_t cb, void *cb_arg);
@@ -193,9 +279,74 @@ status_t thread_detach(thread_t *t);
 status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout);
 status_t thread_detach_and_resume(thread_t *t);
 status_t thread_set_real_time(thread_t *t);
+status_t thread_set_fair_weight(thread_t *t, uint32_t weight);
+uint32_t thread_fair_weight_for_priority(int priority);
+status_t thread_set_deadline(thread_t *t, const thread_deadline_params_t *params);
+status_t thread_set_timer_slack(thread_t *t, lk_time_t slack);
+status_t thread_pin_cpu(thread_t *t, int cpu);
+status_t thread_set_cpu_affinity(thread_t *t, uint32_t mask);
+void thread_set_user_inherited_priority(thread_t *t, int priority);
 
 void thread_owner_name(thread_t *t, char out_name[THREAD_NAME_LENGTH]);
+
+typedef struct thread_runtime {
+    lk_bigtime_t cpu_time;
+    lk_bigtime_t queue_time;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t migrations;
+} thread_runtime_t;
+
+/* t's accounting, up to date to the present */
+void thread_get_runtime(thread_t *t, thread_runtime_t *out);
+
+/* A cap on the cpu time a group of threads may use between them.  Every
+ * period_ns the threads in the group may run for quota_ns in total, and once
+ * they have none of them is picked to run again until the next period starts.
+ * Groups nest: a thread's time counts against its own group and every group
+ * above it.  Each cpu checks on its own, so a group running on several cpus
+ * at once can overshoot its quota by up to a quantum per cpu.
+ *
+ * Protected by the thread lock. */
+typedef struct thread_quota {
+    struct thread_quota *parent;
+    /* 0 if the group is unlimited */
+    lk_bigtime_t period_ns;
+    lk_bigtime_t quota_ns;
+    /* the current period, and how much of it the group has used */
+    lk_bigtime_t period_start_ns;
+    lk_bigtime_t used_ns;
+    /* when the group ran out of quota in the current period, or 0 */
+    lk_bigtime_t throttled_since_ns;
+    /* periods the group ran out of quota in, and the time it was held off */
+    uint64_t throttled_count;
+    lk_bigtime_t throttled_ns;
+    /* kicks the cpus once the period the group ran out in is over */
+    timer_t refill_timer;
+} thread_quota_t;
+
+#define THREAD_QUOTA_PERIOD_MIN_NS (1000000ULL)        /* 1ms */
+#define THREAD_QUOTA_PERIOD_MAX_NS (10 * 1000000000ULL) /* 10s */
+
+typedef struct thread_quota_info {
+    lk_bigtime_t period_ns;
+    lk_bigtime_t quota_ns;
+    uint64_t throttled_count;
+    lk_bigtime_t throttled_ns;
+} thread_quota_info_t;
+
+void thread_quota_init(thread_quota_t *q, thread_quota_t *parent);
+/* no thread may still be in the group */
+void thread_quota_destroy(thread_quota_t *q);
+status_t thread_quota_set(thread_quota_t *q, lk_bigtime_t period_ns, lk_bigtime_t quota_ns);
+void thread_quota_get_info(thread_quota_t *q, thread_quota_info_t *out);
+/* put a thread that hasn't started yet in a group */
+void thread_set_quota(thread_t *t, thread_quota_t *q);
+
 void thread_print_backtrace(thread_t* t, void* fp);
+/* fills |pcs| with up to |max| return addresses found by walking the frame
+ * pointers from |fp| on t's stack, returns how many */
+size_t thread_get_backtrace(thread_t* t, void* fp, uintptr_t* pcs, size_t max);
 
 /* wait for at least delay amount of time. interruptable may return early with ERR_INTERRUPTED
  * if thread is signaled for kill.
@@ -219,6 +370,20 @@ void dump_all_threads(bool full);
 void thread_yield(void);             /* give up the cpu and time slice voluntarily */
 void thread_preempt(bool interrupt); /* get preempted (return to head of queue and reschedule) */
 
+/* Directed handoff. Between thread_handoff_begin() and thread_handoff_end(),
+ * the first thread the current thread wakes that may run on this cpu, at no
+ * lower a priority than the current thread's, is queued here ahead of
+ * anything else at its priority instead of going to an idle cpu, and no
+ * other cpu is kicked to take it. The current thread is then expected to
+ * give up the cpu: thread_handoff_end() does that for it if |yield| is set
+ * and some thread was handed off, and otherwise it should block right after.
+ * Neither may be called from an interrupt or with the thread lock held. */
+#define THREAD_HANDOFF_NONE 0
+#define THREAD_HANDOFF_OPEN 1
+#define THREAD_HANDOFF_DONE 2
+void thread_handoff_begin(void);
+void thread_handoff_end(bool yield);
+
 #ifdef WITH_LIB_UTHREAD
 void uthread_context_switch(thread_t *oldthread, thread_t *newthread);
 #endif
@@ -226,19 +391,28 @@ void uthread_context_switch(thread_t *oldthread, thread_t *newthread);
 /* called on every timer tick for the scheduler to do quantum expiration */
 enum handler_return thread_timer_tick(void);
 
+/* priority inheritance, for mutex.c. both require the thread lock */
+void thread_inherit_priority_locked(thread_t *t, int priority);
+void thread_update_priority_locked(thread_t *t);
+
+/* whether t is the thread running on cpu, for mutex.c.  Safe without the
+ * thread lock, and even if t has exited, since t is never dereferenced;
+ * the answer is stale as soon as it is returned */
+bool thread_is_running_on(const thread_t *t, uint cpu);
+
 /* the current thread */
 thread_t *get_current_thread(void);
 void set_current_thread(thread_t *);
 
 /* scheduler lock */
-extern spin_lock_t thread_lock;
+extern ticket_spin_lock_t thread_lock;
 
-#define THREAD_LOCK(state) spin_lock_saved_state_t state; spin_lock_irqsave(&thread_lock, state)
-#define THREAD_UNLOCK(state) spin_unlock_irqrestore(&thread_lock, state)
+#define THREAD_LOCK(state) spin_lock_saved_state_t state; ticket_spin_lock_irqsave(&thread_lock, state)
+#define THREAD_UNLOCK(state) ticket_spin_unlock_irqrestore(&thread_lock, state)
 
 static inline bool thread_lock_held(void)
 {
-    return spin_lock_held(&thread_lock);
+    return ticket_spin_lock_held(&thread_lock);
 }
 
 /* thread level statistics */
@@ -251,25 +425,47 @@ struct thread_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong handoffs; /* threads woken onto the waker's cpu to take it over */
     ulong interrupts; /* platform code increment this */
     ulong timer_ints; /* timer code increment this */
     ulong timers; /* timer code increment this */
 
 #if WITH_SMP
     ulong reschedule_ipis;
+    ulong reschedule_ipis_skipped; /* not sent, the target had one pending */
+    ulong steals; /* threads taken from another cpu's run queue */
+    ulong mutex_spin_acquires; /* contended mutexes acquired by spinning */
+    ulong mutex_spin_blocks; /* contended mutexes that blocked after spinning */
 #endif
 };
 
 extern struct thread_stats thread_stats[SMP_MAX_CPUS];
 
 #define THREAD_STATS_INC(name) do { thread_stats[arch_curr_cpu_num()].name++; } while(0)
+#define THREAD_STATS_ADD(name, n) do { thread_stats[arch_curr_cpu_num()].name += (n); } while(0)
 
 #else
 
 #define THREAD_STATS_INC(name) do { } while (0)
+#define THREAD_STATS_ADD(name, n) do { } while (0)
 
 #endif
 
+/* Scheduler latency histograms, always collected for each cpu.  Bucket i
+ * counts intervals of [2^(i+9), 2^(i+10)) ns, except that the first and last
+ * buckets are open ended. */
+#define SCHED_LATENCY_BUCKETS 24
+
+struct sched_latency {
+    /* from being made ready (woken, preempted, yielded) to running */
+    uint64_t wakeup[SCHED_LATENCY_BUCKETS];
+    /* from being switched to until being switched away from, idle excluded */
+    uint64_t slice[SCHED_LATENCY_BUCKETS];
+};
+
+void sched_latency_get(uint cpu, struct sched_latency *out);
+void sched_latency_reset(void);
+
 __END_CDECLS;
 
 #endif
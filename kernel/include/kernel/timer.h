@@ -9,6 +9,7 @@
 #define __KERNEL_TIMER_H
 
 #include <magenta/compiler.h>
+#include <kernel/spinlock.h>
 #include <list.h>
 #include <sys/types.h>
 
@@ -16,6 +17,9 @@ __BEGIN_CDECLS
 
 void timer_init(void);
 
+/* protects every cpu's timer queue */
+extern ticket_spin_lock_t timer_lock;
+
 struct timer;
 typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, void *arg);
 
@@ -23,9 +27,15 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
     int magic;
-    struct list_node node;
 
-    lk_time_t scheduled_time;
+    /* linkage in the per cpu pairing heap of pending timers */
+    struct timer *heap_child;   /* first child */
+    struct timer *heap_next;    /* next sibling */
+    struct timer *heap_prev;    /* previous sibling, or parent if first child */
+    int queue_cpu;              /* cpu whose queue the timer is on, <0 if none */
+
+    lk_time_t scheduled_time;   /* latest time the timer may fire */
+    lk_time_t slack;            /* how far before scheduled_time it may fire */
     lk_time_t periodic_time;
 
     timer_callback callback;
@@ -38,8 +48,12 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .heap_child = NULL, \
+    .heap_next = NULL, \
+    .heap_prev = NULL, \
+    .queue_cpu = -1, \
     .scheduled_time = 0, \
+    .slack = 0, \
     .periodic_time = 0, \
     .callback = NULL, \
     .arg = NULL, \
@@ -53,12 +67,27 @@ typedef struct timer {
  * - Timers may be canceled or reprogrammed from within their callback
  * - Setting and canceling timers is not thread safe and cannot be done concurrently
  * - timer_cancel() may spin waiting for a pending timer to complete on another cpu
+ * - A timer with slack fires no earlier than delay and no later than delay + slack,
+ *   letting nearby deadlines share one interrupt
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t delay, timer_callback, void *arg);
+void timer_set_oneshot_slack(timer_t *, lk_time_t delay, lk_time_t slack, timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
+/* true if the timer is queued and has not started firing yet. only stable
+ * with interrupts disabled on the cpu the timer was set on. */
+static inline bool timer_is_queued(const timer_t *timer)
+{
+    return timer->queue_cpu >= 0;
+}
+
+/* how long until the next timer on this cpu is due, INFINITE_TIME if there
+ * are none. called with interrupts disabled, by the idle loop to judge how
+ * deeply it can sleep. */
+lk_time_t timer_next_delay(void);
+
 void timer_transition_off_cpu(uint old_cpu);
 void timer_thaw_percpu(void);
 
@@ -111,9 +111,34 @@ typedef struct pmm_arena_info {
 /* Add a pre-filled memory arena to the physical allocator. */
 status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 
+/* Numa support. Arenas and cpus belong to node 0 until the platform tags them
+ * with the topology it discovers, and allocations prefer the arenas on the
+ * current cpu's node before falling back to the others.
+ */
+#define PMM_MAX_NUMA_NODES 8
+
+/* Tag the physical range [base, base + size) as belonging to a numa node,
+ * splitting any arena that straddles its edges. Must be called before the
+ * secondary cpus are started.
+ */
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint node);
+
+/* Record the numa node of a cpu. */
+void pmm_set_cpu_numa_node(uint cpu_num, uint node);
+
+/* The number of numa nodes memory has been tagged with, at least 1. */
+uint pmm_numa_node_count(void);
+
 /* flags for allocation routines below */
 #define PMM_ALLOC_FLAG_ANY (0x0)  /* no restrictions on which arena to allocate from */
 #define PMM_ALLOC_FLAG_KMAP (0x1) /* allocate only from arenas marked KMAP */
+#define PMM_ALLOC_FLAG_ZEROED (0x2) /* return pages that are already zero filled */
+#define PMM_ALLOC_FLAG_BIND (0x4) /* fail rather than fall back to another numa node */
+
+/* prefer numa node n over the current cpu's node */
+#define PMM_ALLOC_FLAG_NODE_SHIFT 8
+#define PMM_ALLOC_FLAG_NODE_MASK (0xffu << PMM_ALLOC_FLAG_NODE_SHIFT)
+#define PMM_ALLOC_FLAG_NODE(n) ((((n) + 1u) << PMM_ALLOC_FLAG_NODE_SHIFT) & PMM_ALLOC_FLAG_NODE_MASK)
 
 /* Allocate count pages of physical memory, adding to the tail of the passed list.
  * The list must be initialized.
@@ -148,6 +173,15 @@ size_t pmm_free_page(vm_page_t* page) __NONNULL((1));
 /* Return count of unallocated physical pages in system */
 size_t pmm_count_free_pages(void);
 
+/* Memory pressure. The pmm comes under pressure when its free pages drop
+ * below a low watermark and leaves it once they climb back over a high one.
+ * While under pressure a reclaim thread purges unlocked purgeable vm objects,
+ * then reports each change of state to the callback, if one is set.
+ */
+typedef void (*pmm_pressure_callback_t)(bool under_pressure);
+void pmm_set_pressure_callback(pmm_pressure_callback_t callback);
+bool pmm_under_pressure(void);
+
 /* Allocate a run of pages out of the kernel area and return the pointer in kernel space.
  * If the optional list is passed, append the allocate page structures to the tail of the list.
  * If the optional physical address pointer is passed, return the address.
@@ -193,6 +227,13 @@ status_t vmm_reserve_space(vmm_aspace_t* aspace, const char* name, size_t size,
 #define VMM_FLAG_VALLOC_SPECIFIC (1u << 0) /* allocate at specific address */
 #define VMM_FLAG_VALLOC_BASE (1u << 1)     /* allocate starting at base address */
 #define VMM_FLAG_COMMIT (1u << 2)          /* commit memory up front (no demand paging) */
+#define VMM_FLAG_FAULT_AROUND (1u << 3)    /* map resident neighbors on a page fault */
+#define VMM_FLAG_LARGE_PAGES (1u << 4)     /* use large pages where the object allows */
+
+/* physically contiguous runs aligned to these can be mapped with a single
+ * large page entry (2MB and 1GB on x86-64 and on arm64 with a 4K granule) */
+#define VM_LARGE_PAGE_SHIFT 21
+#define VM_HUGE_PAGE_SHIFT 30
 
 /* allocate a region of virtual space that maps a physical piece of address space.
    the physical pages that back this are not allocated from the pmm. */
@@ -10,6 +10,7 @@
 #include <list.h>
 #include <magenta/compiler.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #if __cplusplus
 class VmObject;
@@ -23,7 +24,12 @@ typedef struct vm_page {
         uint32_t flags : 8;
         uint32_t state : 3;
     };
-    uint32_t map_count;
+    // copies in flight using the page without its object's lock held; see
+    // VmObjectPaged::ReadWriteInternal()
+    uint32_t pin_count;
+
+    // physical address of the page, set once when the arena is created
+    paddr_t paddr;
 
     union {
         struct {
@@ -38,7 +44,7 @@ typedef struct vm_page {
         } object;
 #endif
 
-        uint8_t pad[24]; // pad out to 32 bytes
+        uint8_t pad[16]; // pad out to 32 bytes
     };
 } vm_page_t;
 
@@ -57,6 +63,14 @@ enum vm_page_state {
     _VM_PAGE_STATE_COUNT
 };
 
+// page flags
+// an object's page unmapped to see whether anything still uses it, cleared
+// by the next fault on it; see VmObjectPaged::CompressIdlePages()
+#define VM_PAGE_FLAG_IDLE (1u << 0)
+// an object's page written since the object got it, so it can't be had back
+// from the object's page source; see VmObjectPaged::IsPageCleanLocked()
+#define VM_PAGE_FLAG_DIRTY (1u << 1)
+
 // helpers
 static inline bool page_is_free(const vm_page_t* page) {
     return page->state == VM_PAGE_STATE_FREE;
@@ -0,0 +1,88 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/macros.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+#include <stdint.h>
+
+class PageSource;
+
+// One thread's wait for a page source to supply the page at an offset.
+// It lives on the waiting thread's stack and may be reused once Wait()
+// returns.
+class PageRequest : public mxtl::DoublyLinkedListable<PageRequest*> {
+public:
+    PageRequest();
+    ~PageRequest();
+
+    // Block until the page has been supplied or the source gave up on it.
+    // Must be called with no locks held. Returns ERR_INTERRUPTED if the
+    // thread is killed meanwhile.
+    status_t Wait();
+
+private:
+    friend class PageSource;
+
+    event_t event_;
+    uint64_t offset_ = 0;
+    status_t status_ = NO_ERROR;
+    // the source it is queued on, until Wait() returns
+    mxtl::RefPtr<PageSource> source_;
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PageRequest);
+};
+
+// Something outside of the vm that fills in the pages of an object on
+// demand. A fault on a page the object doesn't have queues a PageRequest
+// here instead of allocating, and the source is asked for the page the
+// first time anyone waits on it. Once the pages have been added to the
+// object, OnPagesSupplied() wakes the waiters, which fault again.
+class PageSource : public mxtl::RefCounted<PageSource> {
+public:
+    virtual ~PageSource();
+
+    // Queue |request| for the page at |offset|, asking for the pages in
+    // [offset, offset + len) if nobody has asked for it yet. Returns
+    // ERR_SHOULD_WAIT if the caller should Wait() on it, or an error if the
+    // source is closed or couldn't be asked.
+    status_t GetPage(uint64_t offset, uint64_t len, PageRequest* request);
+
+    // Ask for the pages in [offset, offset + len) without waiting for them.
+    // Nothing keeps track of them meanwhile, so a fault on one before it
+    // arrives asks for it again, and the source supplies it twice.
+    status_t Prefetch(uint64_t offset, uint64_t len);
+
+    // Wake the requests for pages in [offset, offset + len).
+    void OnPagesSupplied(uint64_t offset, uint64_t len);
+
+    // Fail all current and future requests with ERR_BAD_STATE.
+    void Close();
+
+protected:
+    PageSource() = default;
+
+    // Ask for the pages in [offset, offset + len). Called with the source's
+    // lock, and the lock of the object it backs, held.
+    virtual status_t SendRequest(uint64_t offset, uint64_t len) = 0;
+
+private:
+    friend class PageRequest;
+
+    void CompleteLocked(PageRequest* request, status_t status);
+
+    Mutex lock_;
+    bool closed_ = false;
+    mxtl::DoublyLinkedList<PageRequest*> requests_;
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PageSource);
+};
@@ -12,6 +12,7 @@
 #include <mxtl/deleter.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/object_cache.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <stdint.h>
@@ -43,6 +44,13 @@
 // This flag is a hint to try to create the mapping high up in the address
 // space.
 #define VMAR_FLAG_MAP_HIGH (1 << 6)
+// When on a VmMapping, a page fault also maps any neighboring pages that the
+// object already has resident, so sequential access takes fewer faults.
+#define VMAR_FLAG_FAULT_AROUND (1 << 7)
+// When on a VmMapping, place the mapping so it lines up with large pages and
+// hand physically contiguous runs of the object to the arch layer together,
+// letting it use large page entries for them.
+#define VMAR_FLAG_LARGE_PAGES (1 << 8)
 
 #define VMAR_CAN_RWX_FLAGS (VMAR_FLAG_CAN_MAP_READ | \
                             VMAR_FLAG_CAN_MAP_WRITE | \
@@ -50,6 +58,16 @@
 
 class VmAspace;
 
+// A snapshot of one mapping, filled in by VmAddressRegion::GetMappingInfo()
+struct VmMappingInfo {
+    char name[32];
+    vaddr_t base;
+    size_t size;
+    uint arch_mmu_flags;
+    // pages of the mapped object committed within the mapping
+    size_t committed_pages;
+};
+
 // forward declarations
 class VmAddressRegion;
 class VmMapping;
@@ -68,6 +86,8 @@ class VmMapping;
 // DEAD, then the VmAddressRegion is invalid and has no meaning.
 //
 // All VmAddressRegion and VmMapping state is protected by the aspace lock.
+// The lock is taken shared by page faults and other lookups, and exclusive
+// by anything that changes a region's state or its list of children.
 class VmAddressRegionOrMapping : public mxtl::RefCounted<VmAddressRegionOrMapping> {
 public:
     // If a VMO-mapping, unmap all pages and remove dependency on vm object it has a ref to.
@@ -83,7 +103,7 @@ public:
     uint32_t flags() const { return flags_; }
 
     // Recursively compute the number of allocated pages within this region
-    virtual size_t AllocatedPages() const = 0;
+    size_t AllocatedPages() const;
 
     // Subtype information and safe down-casting
     virtual bool is_mapping() const = 0;
@@ -91,8 +111,10 @@ public:
     mxtl::RefPtr<VmMapping> as_vm_mapping();
 
     // Page fault in an address within the region.  Recursively traverses
-    // the regions to find the target mapping, if it exists.
-    virtual status_t PageFault(vaddr_t va, uint pf_flags) = 0;
+    // the regions to find the target mapping, if it exists.  Returns
+    // ERR_SHOULD_WAIT if the page has to come from a page source, in which
+    // case the caller must drop its locks, wait on |request| and retry.
+    virtual status_t PageFault(vaddr_t va, uint pf_flags, PageRequest* request) = 0;
 
     // WAVL tree key function
     vaddr_t GetKey() const { return base(); }
@@ -128,6 +150,9 @@ protected:
     // Version of Destroy() that does not acquire the aspace lock
     virtual status_t DestroyLocked() = 0;
 
+    // Version of AllocatedPages() that does not acquire the aspace lock
+    virtual size_t AllocatedPagesLocked() const = 0;
+
     // Transition from NOT_READY to READY, and add references to self to related
     // structures.
     virtual void Activate() = 0;
@@ -159,9 +184,25 @@ protected:
         }
     };
 
+    // keeps the subtree_* summaries below up to date as the parent's child
+    // tree changes shape
+    struct WAVLTreeAugmentTraits {
+        static constexpr bool kEnabled = true;
+        static void Update(VmAddressRegionOrMapping* node, VmAddressRegionOrMapping* left,
+                           VmAddressRegionOrMapping* right);
+    };
+
     // node for element in list of parent's children.
     mxtl::WAVLTreeNodeState<mxtl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
 
+    // summary of the subtree rooted at this node in the parent's child tree:
+    // the first and last bytes covered by its regions, and the largest gap
+    // between two adjacent regions within it.  Used to find free space in
+    // O(log n) without visiting every child.
+    vaddr_t subtree_first_byte_ = 0;
+    vaddr_t subtree_last_byte_ = 0;
+    size_t subtree_max_gap_ = 0;
+
     char name_[32];
 };
 
@@ -186,11 +227,14 @@ public:
     // returns nullptr.  This is a non-recursive search.
     mxtl::RefPtr<VmAddressRegionOrMapping> FindRegion(vaddr_t addr);
 
+    // Fill in |info| for up to |max| of the mappings anywhere within this
+    // region, in address order.  Returns how many mappings there are in all.
+    size_t GetMappingInfo(VmMappingInfo* info, size_t max);
+
     bool is_mapping() const override { return false; }
 
-    size_t AllocatedPages() const override;
     void Dump(uint depth) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+    status_t PageFault(vaddr_t va, uint pf_flags, PageRequest* request) override;
 
 protected:
     static const uint32_t kMagic = 0x564d4152; // VMAR
@@ -208,9 +252,9 @@ protected:
 
 private:
     // utility so WAVL tree can find the intrusive node for the child list
-    using ChildList = mxtl::WAVLTree<vaddr_t, mxtl::RefPtr<VmAddressRegionOrMapping>,
-                                     mxtl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                     WAVLTreeTraits>;
+    using ChildList = mxtl::AugmentedWAVLTree<vaddr_t, mxtl::RefPtr<VmAddressRegionOrMapping>,
+                                              mxtl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
+                                              WAVLTreeTraits, WAVLTreeAugmentTraits>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -224,6 +268,12 @@ private:
     // Version of Destroy() that does not acquire the aspace lock
     status_t DestroyLocked() override;
 
+    size_t AllocatedPagesLocked() const override;
+
+    // Version of GetMappingInfo() that does not acquire the aspace lock;
+    // |count| is the number of mappings seen so far
+    void GetMappingInfoLocked(VmMappingInfo* info, size_t max, size_t* count);
+
     void Activate() override;
 
     // Helper to share code between CreateSubVmar and CreateVmMapping
@@ -246,6 +296,13 @@ private:
                         vaddr_t* pva, vaddr_t search_base, vaddr_t align,
                         size_t region_size, size_t min_gap, uint arch_mmu_flags);
 
+    // search the subtree of children rooted at |node| for the first gap
+    // between two of them which satisfies the allocation, skipping subtrees
+    // whose largest gap is too small.  Returns true to stop the search, in
+    // which case *pva is the spot or -1.
+    bool FindGapLocked(VmAddressRegionOrMapping* node, vaddr_t* pva, vaddr_t search_base,
+                       vaddr_t align, size_t region_size, size_t min_gap, uint arch_mmu_flags);
+
     // search for a spot to allocate for a region of a given size
     vaddr_t AllocSpotLocked(vaddr_t base, size_t size, uint8_t align_pow2,
                             size_t min_alloc_gap, uint arch_mmu_flags);
@@ -256,7 +313,8 @@ private:
 
 // A representation of the mapping of a VMO into the address space
 class VmMapping final : public VmAddressRegionOrMapping,
-                        public mxtl::DoublyLinkedListable<VmMapping *> {
+                        public mxtl::DoublyLinkedListable<VmMapping *>,
+                        public mxtl::ObjectCacheAllocated<VmMapping> {
 public:
     // Accessors for VMO-mapping state
     uint arch_mmu_flags() const { return arch_mmu_flags_; }
@@ -274,11 +332,23 @@ public:
     // mapping was created with.
     status_t Protect(uint arch_mmu_flags);
 
+    // How the mapping is expected to be accessed, which decides what a page
+    // fault maps besides the faulting page.
+    enum class Advice {
+        // fault around if the mapping was created with VMAR_FLAG_FAULT_AROUND
+        NORMAL,
+        // map the resident pages after the fault, and ask the object's page
+        // source for the rest of them
+        SEQUENTIAL,
+        // map only the faulting page
+        RANDOM,
+    };
+    status_t Advise(Advice advice);
+
     bool is_mapping() const override { return true; }
 
-    size_t AllocatedPages() const override;
     void Dump(uint depth) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+    status_t PageFault(vaddr_t va, uint pf_flags, PageRequest* request) override;
 
 protected:
     static const uint32_t kMagic = 0x564d4150; // VMAP
@@ -289,7 +359,8 @@ protected:
     // private apis from VmObject land
     friend class VmObjectPaged;
 
-    // unmap any pages that map the passed in vmo range. May not intersect with this range
+    // unmap any pages that map the passed in vmo range. May not intersect with this range.
+    // Needs only the object's lock, not the aspace lock.
     status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size);
 
 private:
@@ -307,18 +378,37 @@ private:
     // Version of Destroy() that does not acquire the aspace lock
     status_t DestroyLocked() override;
 
+    // only counts the part of the object that is mapped
+    size_t AllocatedPagesLocked() const override;
+
     // Version of Unmap() that does not acquire the aspace lock
     status_t UnmapLocked();
 
+    // Map the pages around |va| that the object already has resident, or
+    // the ones after it if the access is sequential.  Called from PageFault()
+    // with the aspace lock held shared and the object lock held.
+    void FaultAroundLocked(vaddr_t va);
+
     void Activate() override;
 
     // Version of Activate that does not take the object_ lock
     void ActivateLocked();
 
+    // number of pages (a power of two) that FaultAroundLocked() tries to map
+    // around a faulting address
+    static const size_t kFaultAroundPages = 16;
+
+    // number of pages after a fault in a sequential mapping that the object
+    // is asked to bring in ahead of use
+    static const size_t kReadAheadPages = 32;
+
     // pointer and region of the object we are mapping
     mxtl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
 
     // cached mapping flags (read/write/user/etc)
     uint arch_mmu_flags_;
+
+    // set with the aspace lock held exclusive, so it's stable during a fault
+    Advice advice_ = Advice::NORMAL;
 };
@@ -9,6 +9,7 @@
 #include <arch/mmu.h>
 #include <assert.h>
 #include <kernel/mutex.h>
+#include <kernel/rwlock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_address_region.h>
 #include <mxtl/deleter.h>
@@ -60,6 +61,20 @@ public:
 
     size_t AllocatedPages() const;
 
+    // the kernel memory held by the aspace's page tables
+    size_t PageTableBytes() const;
+
+    // page fault statistics
+    struct FaultStats {
+        // faults on pages the mapped object already had, which only needed mapping
+        uint64_t minor_faults;
+        // faults that had to allocate, zero or copy a page
+        uint64_t major_faults;
+        // time spent in the fault handler, in nanoseconds
+        lk_bigtime_t fault_time;
+    };
+    FaultStats GetFaultStats() const;
+
     // legacy functions to assist in the transition to VMARs
     // These all assume a flat VMAR structure in which all VMOs are mapped
     // as children of the root.
@@ -81,11 +96,21 @@ public:
 
 protected:
     // Share the aspace lock with VmAddressRegion/VmMapping so they can serialize
-    // changes to the aspace.
+    // changes to the aspace.  Page faults and other lookups take it shared,
+    // anything that changes the region tree takes it exclusive.
     friend class VmAddressRegionOrMapping;
     friend class VmAddressRegion;
     friend class VmMapping;
-    mutex_t& lock() { return lock_; }
+    rwlock_t& lock() { return lock_; }
+    // Serializes changes to the page tables, which faults holding the aspace
+    // lock shared may make concurrently.  Taken after any VMO lock.
+    mutex_t& mmu_lock() { return mmu_lock_; }
+    // called from faults that may be running in parallel
+    void CountFaultLocked(bool major) {
+        __atomic_fetch_add(major ? &fault_stats_.major_faults : &fault_stats_.minor_faults, 1,
+                           __ATOMIC_RELAXED);
+    }
+    bool page_tables_released() const { return page_tables_released_; }
 
 private:
     // can only be constructed via factory
@@ -112,8 +137,15 @@ private:
     uint32_t flags_;
     char name_[32];
     bool aspace_destroyed_ = false;
+    // set once Destroy() has dropped every page table at once, after which
+    // mappings being destroyed have nothing left to unmap
+    bool page_tables_released_ = false;
+
+    mutable rwlock_t lock_ = RWLOCK_INITIAL_VALUE(lock_);
+    mutable mutex_t mmu_lock_ = MUTEX_INITIAL_VALUE(mmu_lock_);
 
-    mutable mutex_t lock_ = MUTEX_INITIAL_VALUE(lock_);
+    // updated atomically by faults holding lock_ shared
+    FaultStats fault_stats_ = {};
 
     // root of virtual address space
     // TODO(teisenbe): maybe embed this
@@ -0,0 +1,52 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <mxtl/macros.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+#include <stddef.h>
+
+// Counts the pages committed to a group of VMOs and optionally caps them.
+// Accounts nest: a page charged to an account is charged to each of its
+// ancestors as well, and has to fit under every one of their limits.
+//
+// The VmPageList of each VMO in the group charges and uncharges its pages as
+// they come and go. Limits are checked by HasRoom() ahead of allocating, so
+// commits racing on other objects in the same group can overshoot a limit
+// by what they commit at once.
+class VmCommitAccount final : public mxtl::RefCounted<VmCommitAccount> {
+public:
+    // Returns nullptr if there's no memory for it.
+    static mxtl::RefPtr<VmCommitAccount> Create(mxtl::RefPtr<VmCommitAccount> parent);
+
+    ~VmCommitAccount();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmCommitAccount);
+
+    // Whether |count| more pages fit under our limit and our ancestors'.
+    bool HasRoom(size_t count) const;
+
+    void Charge(size_t count);
+    void Uncharge(size_t count);
+
+    size_t committed_pages() const { return __atomic_load_n(&committed_pages_, __ATOMIC_RELAXED); }
+
+    // 0 if there's no limit of our own
+    size_t limit_pages() const { return __atomic_load_n(&limit_pages_, __ATOMIC_RELAXED); }
+
+    // Pages already committed past a new limit stay, but no more can be
+    // committed until enough of them are gone.
+    void set_limit_pages(size_t limit) { __atomic_store_n(&limit_pages_, limit, __ATOMIC_RELAXED); }
+
+private:
+    explicit VmCommitAccount(mxtl::RefPtr<VmCommitAccount> parent);
+
+    const mxtl::RefPtr<VmCommitAccount> parent_;
+    size_t committed_pages_ = 0;
+    size_t limit_pages_ = 0;
+};
@@ -0,0 +1,46 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <mxtl/intrusive_wavl_tree.h>
+#include <mxtl/macros.h>
+#include <mxtl/unique_ptr.h>
+#include <stdint.h>
+
+// The contents of a page of a VmObjectPaged that nothing has touched in a
+// while, compressed with lz4 into the kernel heap so the page itself can go
+// back to the pmm. The object keeps these in a tree keyed by offset and
+// inflates one back into a fresh page the next time the offset is used.
+class VmCompressedPage final
+    : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<VmCompressedPage>> {
+public:
+    // whether compressible objects are to be compressed at all, set by the
+    // vm.compress kernel command line option
+    static bool Enabled();
+
+    // Compress the page at |src|. Returns nullptr if it doesn't shrink
+    // enough to be worth it or there's no memory to hold the result.
+    static mxtl::unique_ptr<VmCompressedPage> Compress(uint64_t offset, const void* src);
+
+    ~VmCompressedPage();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmCompressedPage);
+
+    // Inflate the page into |dst|, a page of its own.
+    status_t Decompress(void* dst) const;
+
+    uint64_t offset() const { return offset_; }
+    uint64_t GetKey() const { return offset_; }
+
+private:
+    VmCompressedPage(uint64_t offset, mxtl::unique_ptr<uint8_t[]> data, size_t size);
+
+    const uint64_t offset_;
+    const mxtl::unique_ptr<uint8_t[]> data_;
+    const size_t size_;
+};
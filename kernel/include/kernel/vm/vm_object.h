@@ -9,6 +9,8 @@
 #include <assert.h>
 #include <kernel/mutex.h>
 #include <kernel/vm.h>
+#include <kernel/vm/page_source.h>
+#include <kernel/vm/vm_compressed_page.h>
 #include <kernel/vm/vm_page_list.h>
 #include <lib/user_copy/user_ptr.h>
 #include <list.h>
@@ -16,6 +18,7 @@
 #include <mxtl/deleter.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/macros.h>
+#include <mxtl/object_cache.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <stdint.h>
@@ -34,6 +37,12 @@ public:
     virtual uint64_t size() const { return 0; }
     virtual size_t AllocatedPages() const { return 0; }
 
+    // true if the caller's reference is the only one, which stays true
+    // unless the caller makes another: no handle or mapping can get it back
+    bool only_reference() const { return ref_count_debug() == 1; }
+    // number of pages committed at offsets within [offset, offset + len)
+    virtual size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) { return 0; }
+
     // find physical pages to back the range of the object
     virtual status_t CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
         return ERR_NOT_SUPPORTED;
@@ -50,6 +59,32 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // hint that the range will be used soon, so bring in what it's missing
+    virtual status_t PrefetchRange(uint64_t offset, uint64_t len) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // hint that the range won't be used for a while, so let go of what in it
+    // can be had back as it was, and let the rest be reclaimed first
+    virtual status_t DontNeedRange(uint64_t offset, uint64_t len) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // move the pages backing a page aligned range out of the object and onto
+    // |pages|, in offset order, committing any that are missing first; the
+    // range is left decommitted
+    virtual status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // hand the pages on |pages|, in offset order, to a page aligned range of
+    // an object backed by a page source, waking any faults waiting on them;
+    // offsets the object already has a page for keep it. Any pages left on
+    // the list belong to the caller.
+    virtual status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     // read/write operators against kernel pointers only
     virtual status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) {
         return ERR_NOT_SUPPORTED;
@@ -72,12 +107,30 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // create a copy-on-write clone of a range of the vmo
+    virtual status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // keep the pages of a purgeable vmo from being reclaimed until a matching
+    // unlock, reporting whether they were reclaimed since it was last locked
+    virtual status_t LockPurgeable(bool* was_purged) { return ERR_NOT_SUPPORTED; }
+    virtual status_t UnlockPurgeable() { return ERR_NOT_SUPPORTED; }
+
+    // charge the pages committed to the vmo to |account| from here on, and
+    // hold further commits to its limits
+    virtual void SetCommitAccount(mxtl::RefPtr<VmCommitAccount> account) {}
+
     virtual void Dump(uint depth = 0, bool page_dump = false) {}
 
 protected:
     // private constructor (use Create())
     VmObject();
 
+    // private constructor for objects that share the lock of a related object,
+    // which must outlive this one
+    explicit VmObject(Mutex& shared_lock);
+
     // private destructor, only called from refptr
     virtual ~VmObject();
     friend mxtl::default_delete<VmObject>;
@@ -111,6 +164,23 @@ protected:
         return NO_ERROR;
     }
 
+    // ask the object's page source for the page at offset, after
+    // FaultPageLocked() found none, along with the missing pages after it in
+    // the next |len| bytes. Returns ERR_SHOULD_WAIT if the caller should drop
+    // its locks, wait on |request| and fault again.
+    virtual status_t RequestPageLocked(uint64_t offset, uint64_t len, PageRequest* request) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // returns true if the page at offset belongs to another object, or is the
+    // shared zero page, and must only be mapped read only
+    virtual bool IsPageSharedLocked(uint64_t offset) { return false; }
+
+    // returns true if the page at offset came from the object's page source
+    // and hasn't been written since, so it may be given up and asked for
+    // again. It's mapped read only until the first write faults on it.
+    virtual bool IsPageCleanLocked(uint64_t offset) { return false; }
+
     Mutex& lock() { return lock_; }
 
     // TODO(teisenbe): Rename these to s/Region/Mapping/
@@ -122,26 +192,65 @@ protected:
     uint32_t magic_ = MAGIC;
 
     // members
-    mutable Mutex lock_;
+    mutable Mutex local_lock_;
+    // either local_lock_ or the lock shared by a tree of clones
+    Mutex& lock_;
     mxtl::DoublyLinkedList<VmMapping*> region_list_;
 };
 
 // the main VM object type, holding a list of pages
-class VmObjectPaged final : public VmObject {
+//
+// A copy-on-write clone starts out with no pages of its own and reads through
+// to its parent. Writing to a page of the clone gives it a private copy of the
+// parent's page at that offset; until then it sees any changes the parent
+// makes. Touching a page the parent has no page for gives the clone its own
+// zero page. A clone and all of its ancestors share a single lock.
+//
+// The pages of a purgeable object may be freed under memory pressure while
+// it is unlocked, after which it reads back as zeros. It starts out locked.
+//
+// Pages come from the numa node named in the pmm allocation flags, or that of
+// the cpu which faults or commits them, unless the object is interleaved, in
+// which case consecutive pages come from consecutive nodes.
+//
+// An object created with a page source never allocates pages of its own or
+// reads as zeros; a fault on a page it doesn't have waits for the source to
+// supply one. Such objects can't be resized, committed or cloned.
+//
+// A compressible object's pages that go unused for a while may be compressed
+// into the kernel heap under memory pressure, and are inflated back into
+// fresh pages on their next use; see CompressIdlePages().
+class VmObjectPaged final : public VmObject,
+                            public mxtl::DoublyLinkedListable<VmObjectPaged*>,
+                            public mxtl::ObjectCacheAllocated<VmObjectPaged> {
 public:
-    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
+    // options for Create()
+    static const uint32_t kPurgeable = (1u << 0);
+    static const uint32_t kNumaInterleave = (1u << 1);
+    static const uint32_t kCompressible = (1u << 2);
+
+    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                         uint32_t options = 0);
 
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
+    static mxtl::RefPtr<VmObject> CreateWithSource(uint32_t pmm_alloc_flags, uint64_t size,
+                                                   mxtl::RefPtr<PageSource> source);
+
     status_t Resize(uint64_t size) override;
 
     uint64_t size() const override { return size_; }
     size_t AllocatedPages() const override;
+    size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) override;
 
     status_t CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) override;
     status_t CommitRangeContiguous(uint64_t offset, uint64_t len, uint64_t* committed,
                                            uint8_t alignment_log2) override;
     status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) override;
+    status_t PrefetchRange(uint64_t offset, uint64_t len) override;
+    status_t DontNeedRange(uint64_t offset, uint64_t len) override;
+    status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) override;
+    status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) override;
 
     status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) override;
     status_t Write(const void* ptr, uint64_t offset, size_t len, size_t* bytes_written) override;
@@ -153,17 +262,57 @@ public:
 
     status_t Lookup(uint64_t offset, uint64_t len, user_ptr<paddr_t>, size_t) override;
 
+    status_t CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) override;
+
+    status_t LockPurgeable(bool* was_purged) override;
+    status_t UnlockPurgeable() override;
+
+    void SetCommitAccount(mxtl::RefPtr<VmCommitAccount> account) override;
+
+    // free the pages of unlocked purgeable objects, least recently unlocked
+    // first, until at least target_pages have been freed or there are none
+    // left. Returns the number of pages freed.
+    static size_t PurgeUnlockedObjects(size_t target_pages);
+
+    // Look for idle pages of compressible objects with a second chance
+    // scan: a page is unmapped and marked idle the first time it's seen, and
+    // compressed the next time if nothing has faulted on it since. Stops once
+    // target_pages have been freed. Returns the number of pages freed.
+    static size_t CompressIdlePages(size_t target_pages);
+
     void Dump(uint depth = 0, bool page_dump = false) override;
 
     vm_page_t* GetPageLocked(uint64_t offset) override;
     vm_page_t* FaultPageLocked(uint64_t offset, uint pf_flags) override;
+    status_t RequestPageLocked(uint64_t offset, uint64_t len, PageRequest* request) override;
+    bool IsPageSharedLocked(uint64_t offset) override;
+    bool IsPageCleanLocked(uint64_t offset) override;
+
+    // traits to belong to the global list of purgeable objects
+    struct PurgeableListTraits {
+        static mxtl::DoublyLinkedListNodeState<VmObjectPaged*>& node_state(VmObjectPaged& obj) {
+            return obj.purgeable_node_;
+        }
+    };
+
+    // traits to belong to the global list of compressible objects
+    struct CompressibleListTraits {
+        static mxtl::DoublyLinkedListNodeState<VmObjectPaged*>& node_state(VmObjectPaged& obj) {
+            return obj.compressible_node_;
+        }
+    };
 
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags);
+    explicit VmObjectPaged(uint32_t pmm_alloc_flags, bool purgeable = false);
+
+    // private constructor for a clone (use CloneCOW())
+    VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObjectPaged> parent,
+                  uint64_t parent_offset);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
+    friend mxtl::default_delete<VmObjectPaged>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmObjectPaged);
 
@@ -173,6 +322,32 @@ private:
     // internal page list routine
     void AddPageToArray(size_t index, vm_page_t* p);
 
+    // the pmm allocation flags for the page at offset
+    uint32_t PageAllocFlags(uint64_t offset) const;
+
+    // unmap the range from our clones' mappings, so they fault back in and pick
+    // up whatever page now backs it
+    void UnmapClonesRangeLocked(uint64_t offset, uint64_t len);
+
+    // unmap the range from our own mappings if they may have the zero page
+    // there, now that we have real pages for it
+    void UnmapZeroPageRangeLocked(uint64_t offset, uint64_t len);
+
+    using CompressedPageTree = mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmCompressedPage>>;
+
+    // inflate a compressed page back into a page of the object, returning
+    // nullptr if there's no memory for it
+    vm_page_t* DecompressPageLocked(CompressedPageTree::iterator compressed);
+
+    // inflate every compressed page in [start, end)
+    status_t DecompressRangeLocked(uint64_t start, uint64_t end);
+
+    // drop every compressed page in [start, end), returning how many
+    size_t FreeCompressedRangeLocked(uint64_t start, uint64_t end);
+
+    // one object's part of CompressIdlePages()
+    size_t CompressIdlePagesLocked(size_t target_pages);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
@@ -188,9 +363,38 @@ private:
     // members
     uint64_t size_ = 0;
     uint32_t pmm_alloc_flags_ = PMM_ALLOC_FLAG_ANY;
+    bool numa_interleave_ = false;
+    // set once a fault has been given the zero page
+    bool zero_page_used_ = false;
 
     // a tree of pages
     VmPageList page_list_;
+
+    // the object we are a clone of, and where in it our offset 0 lies
+    mxtl::RefPtr<VmObjectPaged> parent_;
+    uint64_t parent_offset_ = 0;
+
+    // our clones, protected by the shared lock
+    mxtl::DoublyLinkedList<VmObjectPaged*> children_;
+
+    // fills in our pages on demand, if set
+    mxtl::RefPtr<PageSource> page_source_;
+
+    // purgeable state; the list node is protected by the global purgeable
+    // list lock, the rest by our lock
+    const bool purgeable_ = false;
+    uint32_t purgeable_lock_count_ = 0;
+    bool purged_ = false;
+    mxtl::DoublyLinkedListNodeState<VmObjectPaged*> purgeable_node_;
+
+    // compression state; the list node is protected by the global
+    // compressible list lock, the rest by our lock
+    bool compressible_ = false;
+    // the physical address of a page has been handed out, so pages have to
+    // stay where they are
+    bool pages_exposed_ = false;
+    CompressedPageTree compressed_pages_;
+    mxtl::DoublyLinkedListNodeState<VmObjectPaged*> compressible_node_;
 };
 
 // VMO representing a physical range of memory
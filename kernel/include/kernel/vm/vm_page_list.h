@@ -6,8 +6,11 @@
 
 #pragma once
 
+#include <kernel/vm/vm_commit_account.h>
+#include <list.h>
 #include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/macros.h>
+#include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 struct vm_page;
@@ -19,7 +22,8 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListNode);
 
-    static const size_t kPageFanOut = 16;
+    // wide enough that large objects don't end up with deep trees of nodes
+    static const size_t kPageFanOut = 64;
 
     // accessors
     uint64_t offset() const { return obj_offset_; }
@@ -43,6 +47,21 @@ public:
         }
     }
 
+    // for every valid page in the node with an offset in [start_offset, end_offset)
+    // call the passed in function
+    template <typename T>
+    void ForEveryPageInRange(T func, uint64_t start_offset, uint64_t end_offset) {
+        size_t first = (start_offset > obj_offset_) ? (start_offset - obj_offset_) / PAGE_SIZE : 0;
+        size_t last = (end_offset - obj_offset_ + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (last > kPageFanOut)
+            last = kPageFanOut;
+        for (size_t i = first; i < last; i++) {
+            if (pages_[i]) {
+                func(pages_[i], obj_offset_ + i * PAGE_SIZE);
+            }
+        }
+    }
+
     vm_page* GetPage(size_t index);
     vm_page* RemovePage(size_t index);
     status_t AddPage(vm_page* p, size_t index);
@@ -84,11 +103,59 @@ public:
         }
     }
 
+    // walk the pages with offsets in [start_offset, end_offset) in order, only
+    // visiting the tree nodes that cover the range
+    template <typename T>
+    void ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
+        for (auto pl = list_.lower_bound(NodeOffset(start_offset));
+             pl.IsValid() && pl->offset() < end_offset; ++pl) {
+            pl->ForEveryPageInRange(per_page_func, start_offset, end_offset);
+        }
+    }
+
     status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
     status_t FreePage(uint64_t offset);
+
+    // free every page with an offset in [start_offset, end_offset), returning
+    // the number freed
+    size_t FreePages(uint64_t start_offset, uint64_t end_offset);
+
+    // remove every page with an offset in [start_offset, end_offset) and
+    // append them to |pages| in offset order, returning the number removed
+    size_t TakePages(uint64_t start_offset, uint64_t end_offset, list_node* pages);
     size_t FreeAllPages();
 
+    // The account the pages in the list are charged to, if any. Every page
+    // added is charged to it and every page removed, however it goes, is
+    // uncharged; setting a new one moves the pages already here over to it.
+    VmCommitAccount* account() const { return account_.get(); }
+    void SetAccount(mxtl::RefPtr<VmCommitAccount> account);
+
+    // whether |count| more pages fit under the account's limits
+    bool HasRoom(size_t count) const { return !account_ || account_->HasRoom(count); }
+
 private:
+    static uint64_t NodeOffset(uint64_t offset) {
+        return ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    }
+    static size_t NodeIndex(uint64_t offset) {
+        return (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+    }
+
+    // look up the node covering node_offset, or nullptr
+    VmPageListNode* FindNode(uint64_t node_offset);
+
+    // remove an empty node from the tree
+    void EraseNode(VmPageListNode* node);
+
     mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
+
+    // the node most recently looked up; most accesses walk an object in order
+    // so this saves a trip down the tree for all but one page per node
+    VmPageListNode* last_node_ = nullptr;
+
+    mxtl::RefPtr<VmCommitAccount> account_;
+    // pages in the list, as charged to |account_|
+    size_t count_ = 0;
 };
@@ -55,6 +55,13 @@ status_t wait_queue_block(wait_queue_t *, lk_time_t timeout);
 int wait_queue_wake_one(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 int wait_queue_wake_all(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 
+/*
+ * release the thread which blocked most recently, preferring one of the last
+ * WAIT_QUEUE_LIFO_SCAN waiters which last ran on this cpu.
+ */
+#define WAIT_QUEUE_LIFO_SCAN 4
+int wait_queue_wake_one_lifo(wait_queue_t *, bool reschedule, status_t wait_queue_error);
+
 /*
  * remove the thread from whatever wait queue it's in.
  * return an error if the thread is not currently blocked (or is the current thread)
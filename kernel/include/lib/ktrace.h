@@ -43,8 +43,22 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
     } \
 }
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
+
+// Adds the stage |name| to the boot timeline, at |ts| in trace ticks, or
+// now if |ts| is 0. Works before the trace buffer exists.
+void ktrace_boot_stage(const char* name, uint32_t arg, uint64_t ts);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
+
+// KTRACE_ACTION_SAMPLE, |rate| samples per second on each cpu or 0 to stop
+status_t ktrace_sample_control(uint32_t rate);
+
+// called by the arch code from the timer interrupt while sampling
+extern bool ktrace_sampling;
+void ktrace_sample_irq(uintptr_t pc, uintptr_t fp, bool user);
+static inline bool ktrace_sampling_on(void) {
+    return __atomic_load_n(&ktrace_sampling, __ATOMIC_RELAXED);
+}
 #else
 static inline void* ktrace_open(uint32_t tag) { return NULL; }
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
@@ -52,6 +66,7 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
 static inline void ktrace_probe0(uint32_t n, const char* name) {}
 static inline void ktrace_probe2(uint32_t n, const char* name, uint32_t arg0, uint32_t arg1) {}
 static inline void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {}
+static inline void ktrace_boot_stage(const char* name, uint32_t arg, uint64_t ts) {}
 static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     if ((len == 0) && (off == 0)) {
         return 0;
@@ -62,6 +77,8 @@ static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
 static inline status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     return ERR_NOT_SUPPORTED;
 }
+static inline bool ktrace_sampling_on(void) { return false; }
+static inline void ktrace_sample_irq(uintptr_t pc, uintptr_t fp, bool user) {}
 #endif
 
 #define KTRACE_DEFAULT_BUFSIZE 32 // MB
@@ -70,3 +87,28 @@ static inline status_t ktrace_control(uint32_t action, uint32_t options, void* p
 void ktrace_report_live_threads(void);
 
 __END_CDECLS
+
+#ifdef __cplusplus
+#include <mxtl/ref_ptr.h>
+
+class VmObject;
+
+// Returns the VMO holding the trace buffer, see ktrace_buffer_header_t.
+// KTRACE_ACTION_ADD/REMOVE_USER_BUFFER, for the user trace buffer in |vmo|,
+// see ktrace_user_header_t.
+#if WITH_LIB_KTRACE
+status_t ktrace_get_vmo(mxtl::RefPtr<VmObject>* vmo);
+status_t ktrace_add_user_buffer(mxtl::RefPtr<VmObject> vmo);
+status_t ktrace_remove_user_buffer(const mxtl::RefPtr<VmObject>& vmo);
+#else
+static inline status_t ktrace_get_vmo(mxtl::RefPtr<VmObject>* vmo) {
+    return ERR_NOT_SUPPORTED;
+}
+static inline status_t ktrace_add_user_buffer(mxtl::RefPtr<VmObject> vmo) {
+    return ERR_NOT_SUPPORTED;
+}
+static inline status_t ktrace_remove_user_buffer(const mxtl::RefPtr<VmObject>& vmo) {
+    return ERR_NOT_SUPPORTED;
+}
+#endif
+#endif
@@ -39,6 +39,16 @@ lk_time_t current_time(void);
 /* current time in nanoseconds */
 lk_bigtime_t current_time_hires(void);
 
+struct fp_32_64;
+
+/* frequency of the counter that user mode reads directly for mx_ticks_get(),
+ * or 0 if there is no such counter */
+uint64_t platform_user_ticks_per_second(void);
+
+/* if current_time_hires() is that counter times a constant, stores the
+ * constant in |ns_per_tick| and returns true */
+bool platform_user_ticks_to_ns(struct fp_32_64* ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
@@ -33,6 +33,7 @@ static int cmd_thread(int argc, const cmd_args *argv);
 static int cmd_threadstats(int argc, const cmd_args *argv);
 static int cmd_threadload(int argc, const cmd_args *argv);
 static int cmd_kill(int argc, const cmd_args *argv);
+static int cmd_schedlat(int argc, const cmd_args *argv);
 
 STATIC_COMMAND_START
 #if LK_DEBUGLEVEL > 1
@@ -43,6 +44,7 @@ STATIC_COMMAND("threadstats", "thread level statistics", &cmd_threadstats)
 STATIC_COMMAND("threadload", "toggle thread load display", &cmd_threadload)
 #endif
 STATIC_COMMAND("kill", "kill a thread", &cmd_kill)
+STATIC_COMMAND("schedlat", "scheduler wakeup latency and time slice histograms", &cmd_schedlat)
 STATIC_COMMAND_END(kernel);
 
 #if LK_DEBUGLEVEL > 1
@@ -85,15 +87,27 @@ static int cmd_threadstats(int argc, const cmd_args *argv)
         printf("\treschedules: %lu\n", thread_stats[i].reschedules);
 #if WITH_SMP
         printf("\treschedule_ipis: %lu\n", thread_stats[i].reschedule_ipis);
+        printf("\treschedule_ipis_skipped: %lu\n", thread_stats[i].reschedule_ipis_skipped);
+        printf("\tsteals: %lu\n", thread_stats[i].steals);
+        printf("\tmutex_spin_acquires: %lu\n", thread_stats[i].mutex_spin_acquires);
+        printf("\tmutex_spin_blocks: %lu\n", thread_stats[i].mutex_spin_blocks);
 #endif
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
         printf("\tyields: %lu\n", thread_stats[i].yields);
+        printf("\thandoffs: %lu\n", thread_stats[i].handoffs);
         printf("\tinterrupts: %lu\n", thread_stats[i].interrupts);
         printf("\ttimer interrupts: %lu\n", thread_stats[i].timer_ints);
         printf("\ttimers: %lu\n", thread_stats[i].timers);
     }
 
+    printf("contended lock acquisitions:\n");
+    printf("\tthread_lock: %lu\n", thread_lock.contended);
+    printf("\ttimer_lock: %lu\n", timer_lock.contended);
+#if WITH_SMP
+    printf("\tipi_task_lock: %lu\n", mp.ipi_task_lock.contended);
+#endif
+
     return 0;
 }
 
@@ -186,4 +200,35 @@ static int cmd_kill(int argc, const cmd_args *argv)
     return 0;
 }
 
+static int cmd_schedlat(int argc, const cmd_args *argv)
+{
+    if (argc >= 2 && !strcmp(argv[1].str, "reset")) {
+        sched_latency_reset();
+        return 0;
+    } else if (argc >= 2) {
+        printf("usage:\n");
+        printf("%s       : show the histograms\n", argv[0].str);
+        printf("%s reset : zero them\n", argv[0].str);
+        return -1;
+    }
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_active(i))
+            continue;
+
+        struct sched_latency lat;
+        sched_latency_get(i, &lat);
+        printf("cpu %u:\n", i);
+        printf("\t%12s %12s %12s\n", "ns >=", "wakeup", "slice");
+        for (uint b = 0; b < SCHED_LATENCY_BUCKETS; b++) {
+            if (lat.wakeup[b] == 0 && lat.slice[b] == 0)
+                continue;
+            printf("\t%12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+                   b ? (uint64_t)1 << (b + 9) : 0, lat.wakeup[b], lat.slice[b]);
+        }
+    }
+
+    return 0;
+}
+
 #endif // WITH_LIB_CONSOLE
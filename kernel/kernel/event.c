@@ -36,7 +36,7 @@
  *
  * @param e        Event object to initialize
  * @param initial  Initial value for "signaled" state
- * @param flags    0 or EVENT_FLAG_AUTOUNSIGNAL
+ * @param flags    0 or EVENT_FLAG_AUTOUNSIGNAL, optionally with EVENT_FLAG_WAKE_LIFO
  */
 void event_init(event_t *e, bool initial, uint flags)
 {
@@ -151,7 +151,11 @@ int event_signal_etc(event_t *e, bool reschedule, status_t wait_result)
     if (!e->signaled) {
         if (e->flags & EVENT_FLAG_AUTOUNSIGNAL) {
             /* try to release one thread and leave unsignaled if successful */
-            if ((wake_count = wait_queue_wake_one(&e->wait, reschedule, wait_result)) <= 0) {
+            if (e->flags & EVENT_FLAG_WAKE_LIFO)
+                wake_count = wait_queue_wake_one_lifo(&e->wait, reschedule, wait_result);
+            else
+                wake_count = wait_queue_wake_one(&e->wait, reschedule, wait_result);
+            if (wake_count <= 0) {
                 /*
                  * if we didn't actually find a thread to wake up, go to
                  * signaled state and let the next call to event_wait
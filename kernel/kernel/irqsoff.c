@@ -0,0 +1,235 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/irqsoff.h>
+
+#if IRQSOFF_TRACE
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <lk/init.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+#endif
+
+/* Each cpu only ever touches its own slot, and always with interrupts
+ * disabled, so nothing here takes a lock or needs an atomic: it runs inside
+ * every spin lock and every change of the interrupt flag. Readers on other
+ * cpus race with the updates, which is fine for statistics. */
+struct irqsoff_cpu {
+    /* the interrupts-off section in progress */
+    bool off_open;
+    uint32_t off_vector;
+    uintptr_t off_site;
+    lk_bigtime_t off_start;
+
+    /* the outermost spin lock held */
+    uint32_t spin_depth;
+    uintptr_t spin_site;
+    const void *spin_lock;
+    lk_bigtime_t spin_start;
+
+    /* longest first */
+    struct irqsoff_record worst[2][IRQSOFF_RECORDS];
+} __ALIGNED(CACHE_LINE);
+
+static struct irqsoff_cpu irqsoff_cpus[SMP_MAX_CPUS];
+
+/* the cpu number and the clock are only usable once the platform is up */
+static bool ready;
+
+static const char *kind_names[] = {
+    [IRQSOFF_KIND_INTS] = "ints",
+    [IRQSOFF_KIND_SPIN] = "spin",
+};
+
+static struct irqsoff_cpu *this_cpu(void)
+{
+    if (!__atomic_load_n(&ready, __ATOMIC_RELAXED))
+        return NULL;
+    uint cpu = arch_curr_cpu_num();
+    return cpu < SMP_MAX_CPUS ? &irqsoff_cpus[cpu] : NULL;
+}
+
+static void record(struct irqsoff_cpu *c, uint32_t kind, uintptr_t start_site,
+                   const void *lock, uint32_t vector, lk_bigtime_t start, uintptr_t end_site)
+{
+    lk_bigtime_t now = current_time_hires();
+    lk_bigtime_t duration = now - start;
+
+    struct irqsoff_record *worst = c->worst[kind];
+    if (duration <= worst[IRQSOFF_RECORDS - 1].duration)
+        return;
+
+    uint i = IRQSOFF_RECORDS - 1;
+    for (; i > 0 && duration > worst[i - 1].duration; i--)
+        worst[i] = worst[i - 1];
+    worst[i] = (struct irqsoff_record){
+        .start_site = start_site,
+        .end_site = end_site,
+        .lock = lock,
+        .vector = vector,
+        .duration = duration,
+        .when = now,
+    };
+}
+
+static void start_off(struct irqsoff_cpu *c, uint32_t vector, uintptr_t site)
+{
+    /* Interrupts were on, so a section still open was ended by something
+     * we don't see, iret or an assembly sti. Whatever it measured is wrong. */
+    c->off_open = true;
+    c->off_vector = vector;
+    c->off_site = site;
+    c->off_start = current_time_hires();
+}
+
+static void end_off(struct irqsoff_cpu *c, uintptr_t site)
+{
+    if (!c->off_open)
+        return;
+    c->off_open = false;
+    record(c, IRQSOFF_KIND_INTS, c->off_site, NULL, c->off_vector, c->off_start, site);
+}
+
+__NO_INLINE void irqsoff_ints_disabled(void)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    if (c)
+        start_off(c, IRQSOFF_NO_VECTOR, (uintptr_t)__GET_CALLER());
+}
+
+__NO_INLINE void irqsoff_ints_enabling(void)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    if (c && arch_ints_disabled())
+        end_off(c, (uintptr_t)__GET_CALLER());
+}
+
+void irqsoff_irq_enter(uint32_t vector, uintptr_t ip)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    if (c)
+        start_off(c, vector, ip);
+}
+
+__NO_INLINE void irqsoff_irq_exit(void)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    if (c)
+        end_off(c, (uintptr_t)__GET_CALLER());
+}
+
+__NO_INLINE void irqsoff_spin_locked(const void *lock)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    if (!c || c->spin_depth++ > 0)
+        return;
+    c->spin_site = (uintptr_t)__GET_CALLER();
+    c->spin_lock = lock;
+    c->spin_start = current_time_hires();
+}
+
+__NO_INLINE void irqsoff_spin_unlocking(void)
+{
+    struct irqsoff_cpu *c = this_cpu();
+    /* zero if the lock was taken before we were ready */
+    if (!c || c->spin_depth == 0 || --c->spin_depth > 0)
+        return;
+    record(c, IRQSOFF_KIND_SPIN, c->spin_site, c->spin_lock, IRQSOFF_NO_VECTOR,
+           c->spin_start, (uintptr_t)__GET_CALLER());
+}
+
+void irqsoff_reset(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        memset(irqsoff_cpus[cpu].worst, 0, sizeof(irqsoff_cpus[cpu].worst));
+}
+
+static uint32_t to_us(lk_bigtime_t ns)
+{
+    return (uint32_t)MIN(ns / 1000, UINT32_MAX);
+}
+
+void irqsoff_ktrace(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (uint32_t kind = 0; kind < countof(kind_names); kind++) {
+            const struct irqsoff_record *worst = irqsoff_cpus[cpu].worst[kind];
+            for (uint i = 0; i < IRQSOFF_RECORDS && worst[i].duration; i++) {
+                ktrace(TAG_IRQSOFF, (uint32_t)worst[i].start_site, (uint32_t)worst[i].end_site,
+                       to_us(worst[i].duration), (kind << 8) | cpu);
+            }
+        }
+    }
+}
+
+static void irqsoff_init(uint level)
+{
+    __atomic_store_n(&ready, true, __ATOMIC_RELAXED);
+}
+
+LK_INIT_HOOK(irqsoff, irqsoff_init, LK_INIT_LEVEL_PLATFORM);
+
+#if WITH_LIB_CONSOLE
+
+static void dump_irqsoff(uint32_t kind)
+{
+    printf("longest %s:\n", kind == IRQSOFF_KIND_INTS ? "with interrupts off" : "spin lock holds");
+    printf("%3s %10s %18s %18s %-18s %6s %12s\n",
+           "cpu", "ns", "start", "end", "lock", "vector", "at ms");
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const struct irqsoff_record *worst = irqsoff_cpus[cpu].worst[kind];
+        for (uint i = 0; i < IRQSOFF_RECORDS && worst[i].duration; i++) {
+            const struct irqsoff_record *r = &worst[i];
+            printf("%3u %10" PRIu64 " %#18" PRIxPTR " %#18" PRIxPTR " %-18p ",
+                   cpu, r->duration, r->start_site, r->end_site, r->lock);
+            if (r->vector == IRQSOFF_NO_VECTOR)
+                printf("%6s", "-");
+            else
+                printf("%6u", r->vector);
+            printf(" %12" PRIu64 "\n", r->when / 1000000);
+        }
+    }
+}
+
+static int cmd_irqsoff(int argc, const cmd_args *argv)
+{
+    if (argc < 2) {
+usage:
+        printf("usage:\n");
+        printf("%s dump  : show the longest times with interrupts off or spin locks held\n",
+               argv[0].str);
+        printf("%s reset : forget them\n", argv[0].str);
+        return -1;
+    }
+
+    if (!strcmp(argv[1].str, "dump")) {
+        dump_irqsoff(IRQSOFF_KIND_INTS);
+        dump_irqsoff(IRQSOFF_KIND_SPIN);
+    } else if (!strcmp(argv[1].str, "reset")) {
+        irqsoff_reset();
+    } else {
+        printf("unrecognized subcommand\n");
+        goto usage;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("irqsoff", "longest interrupts off and spin lock hold times", &cmd_irqsoff)
+STATIC_COMMAND_END(irqsoff);
+
+#endif // WITH_LIB_CONSOLE
+
+#endif // IRQSOFF_TRACE
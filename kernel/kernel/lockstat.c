@@ -0,0 +1,226 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/lockstat.h>
+
+#if LOCK_STATS
+
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kernel/spinlock.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+#endif
+
+/* An open addressed table of classes, keyed by call site.  Entries are
+ * claimed with a compare and swap on |site| and never given back, and the
+ * counters are bumped with atomics, so recording never takes a lock of its
+ * own: it runs inside every lock routine, including the thread lock's.
+ * Sites that don't fit are all counted in the overflow class. */
+#define LOCKSTAT_CLASSES_SHIFT 10
+#define LOCKSTAT_CLASSES (1u << LOCKSTAT_CLASSES_SHIFT)
+#define LOCKSTAT_PROBES 16
+
+static struct lockstat_class classes[LOCKSTAT_CLASSES];
+static struct lockstat_class overflow;
+
+static const char *kind_names[] = {
+    [LOCKSTAT_MUTEX] = "mutex",
+    [LOCKSTAT_SPIN] = "spin",
+    [LOCKSTAT_TICKET] = "ticket",
+};
+
+static void update_max32(uint32_t *max, uint32_t val)
+{
+    uint32_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (val > old &&
+           !__atomic_compare_exchange_n(max, &old, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void update_max64(lk_bigtime_t *max, lk_bigtime_t val)
+{
+    lk_bigtime_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (val > old &&
+           !__atomic_compare_exchange_n(max, &old, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+struct lockstat_class *lockstat_lookup(uintptr_t site, uint32_t kind, const void *lock)
+{
+    uint32_t i = (uint32_t)(((uint64_t)site * 0x9E3779B97F4A7C15ull) >> (64 - LOCKSTAT_CLASSES_SHIFT));
+    for (uint32_t n = 0; n < LOCKSTAT_PROBES; n++) {
+        struct lockstat_class *c = &classes[(i + n) % LOCKSTAT_CLASSES];
+        uintptr_t s = __atomic_load_n(&c->site, __ATOMIC_ACQUIRE);
+        if (s == 0) {
+            if (__atomic_compare_exchange_n(&c->site, &s, site, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                c->kind = kind;
+                s = site;
+            }
+        }
+        if (s == site) {
+            __atomic_store_n(&c->lock, lock, __ATOMIC_RELAXED);
+            return c;
+        }
+    }
+    return &overflow;
+}
+
+void lockstat_acquired(struct lockstat_class *c, uint32_t contenders, lk_bigtime_t wait)
+{
+    __atomic_fetch_add(&c->acquires, 1, __ATOMIC_RELAXED);
+    if (contenders == 0)
+        return;
+    __atomic_fetch_add(&c->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->wait_time, wait, __ATOMIC_RELAXED);
+    update_max32(&c->max_contenders, contenders);
+    update_max64(&c->max_wait, wait);
+}
+
+void lockstat_released(struct lockstat_class *c, lk_bigtime_t hold)
+{
+    __atomic_fetch_add(&c->hold_time, hold, __ATOMIC_RELAXED);
+    update_max64(&c->max_hold, hold);
+}
+
+__NO_INLINE void lockstat_spin_lock(spin_lock_t *lock)
+{
+    struct lockstat_class *c = lockstat_lookup((uintptr_t)__GET_CALLER(), LOCKSTAT_SPIN, lock);
+    if (arch_spin_trylock(lock) == 0) {
+        lockstat_acquired(c, 0, 0);
+        return;
+    }
+
+    /* how many others want it isn't known, count ourselves only */
+    lk_bigtime_t start = current_time_hires();
+    arch_spin_lock(lock);
+    lockstat_acquired(c, 1, current_time_hires() - start);
+}
+
+__NO_INLINE void lockstat_ticket_locked(struct ticket_spin_lock *lock, uint32_t ahead,
+                                        lk_bigtime_t start)
+{
+    lk_bigtime_t now = current_time_hires();
+    struct lockstat_class *c = lockstat_lookup((uintptr_t)__GET_CALLER(), LOCKSTAT_TICKET, lock);
+    lockstat_acquired(c, ahead, ahead ? now - start : 0);
+    lock->lockstat_class = c;
+    lock->lockstat_time = now;
+}
+
+__NO_INLINE void lockstat_ticket_unlocking(struct ticket_spin_lock *lock)
+{
+    if (lock->lockstat_class)
+        lockstat_released(lock->lockstat_class, current_time_hires() - lock->lockstat_time);
+}
+
+static void reset_class(struct lockstat_class *c)
+{
+    /* keep the site, locks still point at their class */
+    c->max_contenders = 0;
+    c->acquires = 0;
+    c->contended = 0;
+    c->wait_time = 0;
+    c->max_wait = 0;
+    c->hold_time = 0;
+    c->max_hold = 0;
+}
+
+void lockstat_reset(void)
+{
+    /* this races with the lock routines, which is fine for statistics */
+    for (uint32_t i = 0; i < LOCKSTAT_CLASSES; i++)
+        reset_class(&classes[i]);
+    reset_class(&overflow);
+}
+
+static uint32_t to_us(lk_bigtime_t ns)
+{
+    return (uint32_t)MIN(ns / 1000, UINT32_MAX);
+}
+
+void lockstat_ktrace(void)
+{
+    for (uint32_t i = 0; i < LOCKSTAT_CLASSES; i++) {
+        const struct lockstat_class *c = &classes[i];
+        if (c->site == 0 || c->contended == 0)
+            continue;
+        ktrace(TAG_LOCK_STATS, (uint32_t)c->site, (uint32_t)MIN(c->contended, UINT32_MAX),
+               to_us(c->wait_time), to_us(c->hold_time));
+    }
+}
+
+#if WITH_LIB_CONSOLE
+
+static void print_class(const struct lockstat_class *c)
+{
+    printf("%#18" PRIxPTR " %-6s %p %10" PRIu64 " %10" PRIu64 " %4u %12" PRIu64 " %10" PRIu64
+           " %12" PRIu64 " %10" PRIu64 "\n",
+           c->site, kind_names[c->kind], c->lock, c->acquires, c->contended, c->max_contenders,
+           c->wait_time, c->max_wait, c->hold_time, c->max_hold);
+}
+
+/* the |n| classes that waited the longest, most first */
+static void dump_lockstat(uint32_t n)
+{
+    printf("%18s %-6s %-18s %10s %10s %4s %12s %10s %12s %10s\n",
+           "site", "kind", "lock", "acquires", "contended", "max",
+           "wait ns", "max wait", "hold ns", "max hold");
+
+    lk_bigtime_t below = UINT64_MAX;
+    while (n-- > 0) {
+        const struct lockstat_class *best = NULL;
+        for (uint32_t i = 0; i < LOCKSTAT_CLASSES; i++) {
+            const struct lockstat_class *c = &classes[i];
+            if (c->site == 0 || c->contended == 0 || c->wait_time >= below)
+                continue;
+            if (!best || c->wait_time > best->wait_time)
+                best = c;
+        }
+        if (!best)
+            break;
+        print_class(best);
+        below = best->wait_time;
+    }
+    if (overflow.acquires)
+        printf("%" PRIu64 " acquires from sites that didn't fit in the table\n",
+               overflow.acquires);
+}
+
+static int cmd_lockstat(int argc, const cmd_args *argv)
+{
+    if (argc < 2) {
+usage:
+        printf("usage:\n");
+        printf("%s dump [count] : show the most contended lock sites\n", argv[0].str);
+        printf("%s reset        : zero the counts\n", argv[0].str);
+        return -1;
+    }
+
+    if (!strcmp(argv[1].str, "dump")) {
+        dump_lockstat(argc > 2 ? (uint32_t)argv[2].u : 20);
+    } else if (!strcmp(argv[1].str, "reset")) {
+        lockstat_reset();
+    } else {
+        printf("unrecognized subcommand\n");
+        goto usage;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("lockstat", "lock contention by call site", &cmd_lockstat)
+STATIC_COMMAND_END(lockstat);
+
+#endif // WITH_LIB_CONSOLE
+
+#endif // LOCK_STATS
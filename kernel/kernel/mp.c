@@ -20,6 +20,7 @@
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/timer.h>
+#include <lib/dpc.h>
 
 #define LOCAL_TRACE 0
 
@@ -27,7 +28,7 @@
 /* a global state structure, aligned on cpu cache line to minimize aliasing */
 struct mp_state mp __CPU_ALIGN = {
     .hotplug_lock = MUTEX_INITIAL_VALUE(mp.hotplug_lock),
-    .ipi_task_lock = SPIN_LOCK_INITIAL_VALUE,
+    .ipi_task_lock = TICKET_SPIN_LOCK_INITIAL_VALUE,
 };
 
 /* Helpers used for implementing mp_sync */
@@ -36,7 +37,7 @@ static void mp_sync_task(void *context);
 
 void mp_init(void)
 {
-    mp.ipi_task_lock = SPIN_LOCK_INITIAL_VALUE;
+    ticket_spin_lock_init(&mp.ipi_task_lock);
     for (uint i = 0; i < countof(mp.ipi_task_list); ++i) {
         list_initialize(&mp.ipi_task_list[i]);
     }
@@ -61,9 +62,18 @@ void mp_reschedule(mp_cpu_mask_t target, uint flags)
     }
     target &= ~(1U << local_cpu);
 
+    /* a cpu that has not rescheduled since its last ipi will still see
+     * whatever was queued for it before this call */
+    mp_cpu_mask_t pending = atomic_or((int *)&mp.resched_pending, target);
+    if (target & pending) {
+        THREAD_STATS_ADD(reschedule_ipis_skipped, __builtin_popcount(target & pending));
+        target &= ~pending;
+    }
+
     LTRACEF("local %u, post mask target now 0x%x\n", local_cpu, target);
 
-    arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
+    if (target)
+        arch_mp_send_ipi(target, MP_IPI_RESCHEDULE);
 }
 
 struct mp_sync_context {
@@ -133,7 +143,7 @@ void mp_sync_exec(mp_cpu_mask_t target, mp_sync_task_t task, void *context)
     }
 
     /* enqueue tasks */
-    spin_lock(&mp.ipi_task_lock);
+    ticket_spin_lock(&mp.ipi_task_lock);
     mp_cpu_mask_t remaining = target;
     uint cpu_id = 0;
     while (remaining && cpu_id < num_cpus) {
@@ -143,7 +153,7 @@ void mp_sync_exec(mp_cpu_mask_t target, mp_sync_task_t task, void *context)
         remaining >>= 1;
         cpu_id++;
     }
-    spin_unlock(&mp.ipi_task_lock);
+    ticket_spin_unlock(&mp.ipi_task_lock);
 
     /* let CPUs know to begin executing */
     __UNUSED status_t status = arch_mp_send_ipi(target, MP_IPI_GENERIC);
@@ -186,20 +196,20 @@ void mp_sync_exec(mp_cpu_mask_t target, mp_sync_task_t task, void *context)
 
     /* make sure the sync_tasks aren't in lists anymore, since they're
      * stack allocated */
-    spin_lock_irqsave(&mp.ipi_task_lock, irqstate);
+    ticket_spin_lock_irqsave(&mp.ipi_task_lock, irqstate);
     for (uint i = 0; i < num_cpus; ++i) {
         /* If a task is still around, it's because the CPU went offline. */
         if (list_in_list(&sync_tasks[i].node)) {
             list_delete(&sync_tasks[i].node);
         }
     }
-    spin_unlock_irqrestore(&mp.ipi_task_lock, irqstate);
+    ticket_spin_unlock_irqrestore(&mp.ipi_task_lock, irqstate);
 }
 
 static void mp_unplug_trampoline(void) __NO_RETURN;
 static void mp_unplug_trampoline(void) {
     /* release the thread lock that was implicitly held across the reschedule */
-    spin_unlock(&thread_lock);
+    ticket_spin_unlock(&thread_lock);
 
     /* do *not* enable interrupts, we want this CPU to never receive another
      * interrupt */
@@ -310,6 +320,12 @@ status_t mp_unplug_cpu(uint cpu_id) {
     /* Now that the CPU is no longer processing tasks, move all of its timers */
     timer_transition_off_cpu(cpu_id);
 
+    /* and hand its runnable threads to the cpus that remain */
+    thread_transition_off_cpu(cpu_id);
+
+    /* and run its pending deferred calls here */
+    dpc_transition_off_cpu(cpu_id);
+
     status = platform_mp_cpu_unplug(cpu_id);
     if (status != NO_ERROR) {
         /* Do not cleanup the unplug thread in this case.  We have successfully
@@ -354,9 +370,9 @@ enum handler_return mp_mbx_generic_irq(void)
 
     while (1) {
         struct mp_ipi_task *task;
-        spin_lock(&mp.ipi_task_lock);
+        ticket_spin_lock(&mp.ipi_task_lock);
         task = list_remove_head_type(&mp.ipi_task_list[local_cpu], struct mp_ipi_task, node);
-        spin_unlock(&mp.ipi_task_lock);
+        ticket_spin_unlock(&mp.ipi_task_lock);
         if (task == NULL) {
             break;
         }
@@ -374,7 +390,11 @@ enum handler_return mp_mbx_reschedule_irq(void)
 
     THREAD_STATS_INC(reschedule_ipis);
 
-    return (mp.active_cpus & (1U << cpu)) ? INT_RESCHEDULE : INT_NO_RESCHEDULE;
+    if (!(mp.active_cpus & (1U << cpu))) {
+        mp_reschedule_done(cpu);
+        return INT_NO_RESCHEDULE;
+    }
+    return INT_RESCHEDULE;
 }
 
 __WEAK status_t arch_mp_cpu_hotplug(uint cpu_id) { return ERR_NOT_SUPPORTED; }
@@ -383,5 +403,7 @@ __WEAK status_t arch_mp_cpu_unplug(uint cpu_id) { return ERR_NOT_SUPPORTED; }
 __WEAK status_t platform_mp_cpu_hotplug(uint cpu_id) { return arch_mp_cpu_hotplug(cpu_id); }
 __WEAK status_t platform_mp_prep_cpu_unplug(uint cpu_id) { return arch_mp_prep_cpu_unplug(cpu_id); }
 __WEAK status_t platform_mp_cpu_unplug(uint cpu_id) { return arch_mp_cpu_unplug(cpu_id); }
+__WEAK mp_cpu_mask_t arch_mp_cpu_smt_siblings(uint cpu_id) { return 1U << cpu_id; }
+__WEAK mp_cpu_mask_t arch_mp_cpu_package_siblings(uint cpu_id) { return 1U << cpu_id; }
 
 #endif
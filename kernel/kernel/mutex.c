@@ -20,6 +20,12 @@
 #include <assert.h>
 #include <err.h>
 #include <kernel/thread.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+/* how long a contended acquire may spin on an owner that is running on
+ * another cpu before giving up and blocking */
+#define MUTEX_SPIN_MAX_NS 10000
 
 /**
  * @brief  Initialize a mutex_t
@@ -57,10 +63,20 @@ void mutex_destroy(mutex_t *m)
 status_t mutex_acquire_internal(mutex_t *m)
 {
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
+
+    thread_t *current_thread = get_current_thread();
 
     if (unlikely(++m->count > 1)) {
+        /* lend our priority to the holder while we wait for it.  the holder
+         * may be NULL if the mutex is being handed to another waiter, which
+         * will pick up our priority when it takes ownership. */
+        if (m->holder)
+            thread_inherit_priority_locked(m->holder, current_thread->priority);
+
+        current_thread->blocking_mutex = m;
         status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
+        current_thread->blocking_mutex = NULL;
         if (unlikely(ret < NO_ERROR)) {
             /* mutexes are not interruptable and cannot time out, so it
              * is illegal to return with any error state.
@@ -70,14 +86,65 @@ status_t mutex_acquire_internal(mutex_t *m)
         }
     }
 
-    m->holder = get_current_thread();
+    m->holder = current_thread;
+    list_add_tail(&current_thread->held_mutexes, &m->held_node);
+#if LOCK_STATS
+    m->lockstat_time = current_time_hires();
+#endif
+
+    /* inherit from whoever is still waiting */
+    if (unlikely(m->count > 1))
+        thread_update_priority_locked(current_thread);
 
     return NO_ERROR;
 }
 
+#if WITH_SMP
+/* Called with the thread lock held when the mutex is contended.  If the
+ * owner is running, drop the lock and spin until the mutex is released, the
+ * owner stops running or MUTEX_SPIN_MAX_NS passes, since the owner is likely
+ * to release it sooner than a block and wakeup would take.  Returns with the
+ * thread lock held again. */
+static void mutex_spin_on_owner(mutex_t *m, spin_lock_saved_state_t *state)
+{
+    thread_t *holder = m->holder;
+    if (!holder || holder->state != THREAD_RUNNING)
+        return;
+
+    /* the holder is only looked at while the thread lock is held; once it
+     * is dropped, the holder may release the mutex and exit at any time, so
+     * the spin only compares pointers, to the mutex's holder and to the
+     * thread running on the cpu the holder was running on */
+    uint cpu = (uint)thread_curr_cpu(holder);
+
+    ticket_spin_unlock_irqrestore(&thread_lock, *state);
+
+    lk_bigtime_t start = current_time_hires();
+    lk_bigtime_t now = start;
+    while (__atomic_load_n(&m->holder, __ATOMIC_RELAXED) == holder &&
+           thread_is_running_on(holder, cpu) && now - start < MUTEX_SPIN_MAX_NS) {
+        arch_spinloop_pause();
+        now = current_time_hires();
+    }
+
+    ticket_spin_lock_irqsave(&thread_lock, *state);
+
+    bool acquired = (m->count == 0);
+    if (acquired) {
+        THREAD_STATS_INC(mutex_spin_acquires);
+    } else {
+        THREAD_STATS_INC(mutex_spin_blocks);
+    }
+    ktrace(TAG_MUTEX_SPIN, (uint32_t)(uintptr_t)m, (uint32_t)(now - start), acquired, 0);
+}
+#endif
+
 /**
  * @brief  Acquire the mutex
  *
+ * If the mutex is held by a thread running on another cpu, spin briefly
+ * before blocking.
+ *
  * @return  NO_ERROR on success, other values on error
  */
 status_t mutex_acquire(mutex_t *m)
@@ -91,8 +158,23 @@ status_t mutex_acquire(mutex_t *m)
               get_current_thread(), get_current_thread()->name, m);
 #endif
 
+#if LOCK_STATS
+    lk_bigtime_t start = current_time_hires();
+#endif
     THREAD_LOCK(state);
+#if LOCK_STATS
+    uint32_t contenders = (uint32_t)m->count;
+#endif
+#if WITH_SMP
+    if (unlikely(m->count > 0))
+        mutex_spin_on_owner(m, &state);
+#endif
     status_t ret = mutex_acquire_internal(m);
+#if LOCK_STATS
+    m->lockstat_class = lockstat_lookup((uintptr_t)__GET_CALLER(), LOCKSTAT_MUTEX, m);
+    lockstat_acquired(m->lockstat_class, contenders,
+                      contenders ? m->lockstat_time - start : 0);
+#endif
     THREAD_UNLOCK(state);
     return ret;
 }
@@ -100,11 +182,21 @@ status_t mutex_acquire(mutex_t *m)
 void mutex_release_internal(mutex_t *m, bool reschedule)
 {
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
+    thread_t *holder = m->holder;
     m->holder = 0;
+    list_delete(&m->held_node);
+#if LOCK_STATS
+    /* a condition variable also lets go of the mutex through here */
+    if (m->lockstat_class)
+        lockstat_released(m->lockstat_class, current_time_hires() - m->lockstat_time);
+#endif
 
     if (unlikely(--m->count >= 1)) {
+        /* drop any priority we inherited through this mutex */
+        thread_update_priority_locked(holder);
+
         /* release a thread */
         wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
     }
@@ -12,7 +12,9 @@ MODULE := $(LOCAL_DIR)
 MODULE_DEPS := \
 	lib/libc \
 	lib/debug \
+	lib/counters \
 	lib/heap \
+	lib/dpc \
     lib/mxtl \
 
 
@@ -21,7 +23,10 @@ MODULE_SRCS := \
 	$(LOCAL_DIR)/debug.c \
 	$(LOCAL_DIR)/event.c \
 	$(LOCAL_DIR)/init.c \
+	$(LOCAL_DIR)/irqsoff.c \
+	$(LOCAL_DIR)/lockstat.c \
 	$(LOCAL_DIR)/mutex.c \
+	$(LOCAL_DIR)/rwlock.c \
 	$(LOCAL_DIR)/thread.c \
 	$(LOCAL_DIR)/timer.c \
 	$(LOCAL_DIR)/semaphore.c \
@@ -30,4 +35,16 @@ MODULE_SRCS := \
 
 MODULE_DEPS += kernel/vm
 
+# per call site lock contention statistics, see kernel/lockstat.h
+ENABLE_LOCK_STATS ?= false
+ifeq ($(call TOBOOL,$(ENABLE_LOCK_STATS)),true)
+KERNEL_DEFINES += LOCK_STATS=1
+endif
+
+# longest interrupts off and spin lock hold times, see kernel/irqsoff.h
+ENABLE_IRQSOFF_TRACE ?= false
+ifeq ($(call TOBOOL,$(ENABLE_IRQSOFF_TRACE)),true)
+KERNEL_DEFINES += IRQSOFF_TRACE=1
+endif
+
 include make/module.mk
@@ -0,0 +1,95 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/rwlock.h>
+
+#include <assert.h>
+#include <debug.h>
+#include <err.h>
+#include <kernel/thread.h>
+
+void rwlock_init(rwlock_t *l)
+{
+    *l = (rwlock_t)RWLOCK_INITIAL_VALUE(*l);
+}
+
+void rwlock_destroy(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(l->readers == 0 && l->writer == NULL);
+
+    THREAD_LOCK(state);
+
+    l->magic = 0;
+    wait_queue_destroy(&l->read_wait);
+    wait_queue_destroy(&l->write_wait);
+
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_acquire_read(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+    DEBUG_ASSERT(!is_rwlock_write_held(l));
+
+    THREAD_LOCK(state);
+
+    while (l->writer || l->writers_waiting > 0)
+        wait_queue_block(&l->read_wait, INFINITE_TIME);
+    l->readers++;
+
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_release_read(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(l->readers > 0);
+
+    THREAD_LOCK(state);
+
+    if (--l->readers == 0 && l->writers_waiting > 0)
+        wait_queue_wake_one(&l->write_wait, true, NO_ERROR);
+
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_acquire_write(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+    DEBUG_ASSERT(!is_rwlock_write_held(l));
+
+    THREAD_LOCK(state);
+
+    while (l->writer || l->readers > 0) {
+        l->writers_waiting++;
+        wait_queue_block(&l->write_wait, INFINITE_TIME);
+        l->writers_waiting--;
+    }
+    l->writer = get_current_thread();
+
+    THREAD_UNLOCK(state);
+}
+
+void rwlock_release_write(rwlock_t *l)
+{
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(is_rwlock_write_held(l));
+
+    THREAD_LOCK(state);
+
+    l->writer = NULL;
+    // hand the lock to the next writer if there is one, otherwise let every
+    // waiting reader in at once
+    if (l->writers_waiting > 0)
+        wait_queue_wake_one(&l->write_wait, true, NO_ERROR);
+    else
+        wait_queue_wake_all(&l->read_wait, true, NO_ERROR);
+
+    THREAD_UNLOCK(state);
+}
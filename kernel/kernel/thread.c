@@ -26,9 +26,12 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/mp.h>
+#include <kernel/mutex.h>
 #include <kernel/vm.h>
+#include <arch/mp.h>
 #include <platform.h>
 #include <target.h>
+#include <lib/counters.h>
 #include <lib/heap.h>
 #include <lib/ktrace.h>
 
@@ -45,18 +48,114 @@ struct thread_stats thread_stats[SMP_MAX_CPUS];
 
 #define DEBUG_THREAD_CONTEXT_SWITCH 0
 
+/* a thread's time slice, in scheduler ticks */
+#define THREAD_INITIAL_QUANTUM 5
+#define THREAD_TICK_MS 10
+#define THREAD_QUANTUM_NS ((lk_bigtime_t)THREAD_INITIAL_QUANTUM * THREAD_TICK_MS * 1000000)
+
 /* global thread list */
 static struct list_node thread_list;
 
 /* master thread spinlock */
-spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
+ticket_spin_lock_t thread_lock = TICKET_SPIN_LOCK_INITIAL_VALUE;
+
+/* thread structures and default sized stacks allocated by thread_create_etc()
+ * are kept on these caches when their thread goes away, so creating the next
+ * thread usually doesn't go to the heap. they are protected by the thread
+ * lock: a detached thread caches its own stack and structure on the way out
+ * while still running on them, but it holds the thread lock until it has
+ * switched away, so nobody can pick them up before then.
+ *
+ * a cache grows its limit each time thread creation finds it empty and
+ * shrinks it each time an exiting thread finds it full, between
+ * THREAD_CACHE_MIN and THREAD_CACHE_MAX entries. */
+#define THREAD_CACHE_MIN 4
+#define THREAD_CACHE_MAX 64
+
+#if THREAD_STACK_BOUNDS_CHECK
+#define THREAD_CACHE_STACK_SIZE (DEFAULT_STACK_SIZE + THREAD_STACK_PADDING_SIZE)
+#else
+#define THREAD_CACHE_STACK_SIZE DEFAULT_STACK_SIZE
+#endif
+
+struct thread_cache {
+    struct list_node list;
+    size_t count;
+    size_t limit;
+};
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+#define THREAD_CACHE_INITIAL_VALUE(c) \
+    { .list = LIST_INITIAL_VALUE((c).list), .count = 0, .limit = THREAD_CACHE_MIN }
+
+/* structures are linked through their thread_list_node, stacks through a
+ * list node written at their base */
+static struct thread_cache thread_struct_cache = THREAD_CACHE_INITIAL_VALUE(thread_struct_cache);
+static struct thread_cache thread_stack_cache = THREAD_CACHE_INITIAL_VALUE(thread_stack_cache);
+
+/* heap allocated stacks belonging to live threads; cached stacks don't count */
+KCOUNTER(thread_stack_bytes, "kernel.thread.stack_bytes");
+
+/* per cpu run queues, each with a bitmap of the non-empty priority levels.
+ * fair share threads are kept sorted by virtual runtime on their own list,
+ * which counts as part of the FAIR_PRIORITY level, and deadline threads on
+ * one of their own as part of the DEADLINE_PRIORITY level.
+ *
+ * the queues have no locks of their own: like the rest of the scheduler
+ * state they are guarded by thread_lock, which every block, wakeup and
+ * reschedule already holds. splitting them out doesn't help until those
+ * paths stop needing thread_lock, so scheduling still serializes on it. */
+struct run_queue {
+    struct list_node queue[NUM_PRIORITIES];
+    uint32_t bitmap;
+    struct list_node fair_queue;
+    /* monotonic floor for the virtual runtime of threads queued here */
+    lk_bigtime_t fair_min_vruntime;
+    /* unordered, since few threads fit in a cpu's deadline load and their
+     * deadlines move as their periods roll over */
+    struct list_node deadline_queue;
+    /* summed runtime to deadline ratios, in millionths, of the deadline
+     * threads admitted on this cpu, queued or not */
+    uint32_t deadline_load;
+    /* kicks the cpu when a deadline thread held off here gets its runtime
+     * back, at deadline_refill_ns */
+    timer_t deadline_timer;
+    lk_bigtime_t deadline_refill_ns;
+} __CPU_ALIGN;
+
+/* how far below fair_min_vruntime a thread that slept may be placed, which
+ * lets threads that mostly block get in ahead of cpu bound ones without
+ * letting them bank an unbounded amount of credit */
+#define FAIR_WAKEUP_CREDIT_NS (5 * 1000000ULL)
+
+/* fair share weight per priority level, 1024 * 1.25^(priority - DEFAULT_PRIORITY) */
+static const uint32_t fair_priority_weights[NUM_PRIORITIES] = {
+       29,    36,    45,    56,    70,    88,   110,   137,
+      172,   215,   268,   336,   419,   524,   655,   819,
+     1024,  1280,  1600,  2000,  2500,  3125,  3906,  4883,
+     6104,  7629,  9537, 11921, 14901, 18626, 23283, 29104,
+};
+static_assert(DEFAULT_PRIORITY == 16 && NUM_PRIORITIES == 32, "update fair_priority_weights");
+
+static struct run_queue run_queue[SMP_MAX_CPUS];
+
+/* the cpus whose run queues hold any threads, so nothing has to look at the
+ * empty ones */
+static mp_cpu_mask_t run_queue_ready_mask;
+
+/* the thread each cpu is running, for lockless checks from other cpus */
+static thread_t *running_thread[SMP_MAX_CPUS];
+
+/* only ever written by its own cpu, with the thread lock held */
+struct sched_latency_cpu {
+    struct sched_latency lat;
+    /* when the running thread was switched to */
+    lk_bigtime_t slice_start;
+} __CPU_ALIGN;
+
+static struct sched_latency_cpu sched_latency_cpu[SMP_MAX_CPUS];
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * 8, "");
+static_assert(NUM_PRIORITIES <= sizeof(run_queue[0].bitmap) * 8, "");
 
 /* the idle thread(s) (statically allocated) */
 #if WITH_SMP
@@ -73,42 +172,620 @@ static int idle_thread_routine(void *) __NO_RETURN;
 static void thread_exit_locked(thread_t *current_thread, int retcode) __NO_RETURN;
 static void thread_block(void);
 static void thread_unblock(thread_t *t, bool resched);
+static void deadline_wakeup(thread_t *t, lk_bigtime_t now);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-/* preemption timer */
+/* preemption timer, programmed one-shot to the running thread's quantum
+ * expiry, and only while other threads are waiting for the cpu */
 static timer_t preempt_timer[SMP_MAX_CPUS];
+
+static void preempt_timer_update(uint cpu, thread_t *t);
+#endif
+
+/* return the highest priority level set in a run queue bitmap */
+static inline uint run_queue_highest_priority(uint32_t bitmap)
+{
+    DEBUG_ASSERT(bitmap != 0);
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * 8 - NUM_PRIORITIES);
+}
+
+/* whether t may be scheduled on cpu at all: only on the cpu it is pinned to,
+ * if it is pinned, and otherwise on the cpus in its affinity mask */
+static bool thread_can_run_on(thread_t *t, uint cpu)
+{
+#if WITH_SMP
+    if (t->deadline.period_ns)
+        return t->deadline_cpu == (int)cpu;
+    if (t->pinned_cpu >= 0)
+        return t->pinned_cpu == (int)cpu;
+    return (t->cpu_affinity & (1u << cpu)) != 0;
+#else
+    return true;
+#endif
+}
+
+/* pick the cpu whose run queue a thread that just became ready should go on.
+ * threads pinned to a cpu, or admitted on one in the deadline class, always
+ * go on that cpu's queue, everything else is
+ * queued locally and left for idle cpus to steal, unless the local cpu is
+ * outside its affinity mask, in which case it goes to the first active cpu
+ * inside it. */
+static uint run_queue_target_cpu(thread_t *t)
+{
+#if WITH_SMP
+    if (t->deadline.period_ns)
+        return (uint)t->deadline_cpu;
+    if (t->pinned_cpu >= 0)
+        return (uint)t->pinned_cpu;
+    uint cpu = arch_curr_cpu_num();
+    if (!thread_can_run_on(t, cpu)) {
+        mp_cpu_mask_t allowed = t->cpu_affinity & mp_get_active_mask();
+        if (allowed)
+            return (uint)__builtin_ctz(allowed);
+    }
+    return cpu;
+#else
+    return arch_curr_cpu_num();
 #endif
+}
+
+/* a fair share or deadline thread that has inherited a priority is
+ * scheduled at that fixed priority until the boost is dropped.  The deadline
+ * class takes precedence over a fair share weight. */
+static bool thread_is_fair(thread_t *t)
+{
+    return t->fair_weight != 0 && t->deadline.period_ns == 0 &&
+           t->priority == t->base_priority;
+}
+
+static bool thread_is_deadline(thread_t *t)
+{
+    return t->deadline.period_ns != 0 && t->priority == t->base_priority;
+}
+
+/* the priority level a thread is queued at */
+static uint run_queue_level(thread_t *t)
+{
+    if (thread_is_deadline(t))
+        return DEADLINE_PRIORITY;
+    return thread_is_fair(t) ? FAIR_PRIORITY : (uint)t->priority;
+}
+
+/* the run queue list a thread is queued on */
+static struct list_node *run_queue_list(struct run_queue *rq, thread_t *t)
+{
+    if (thread_is_deadline(t))
+        return &rq->deadline_queue;
+    return thread_is_fair(t) ? &rq->fair_queue : &rq->queue[t->priority];
+}
+
+static bool run_queue_level_empty(struct run_queue *rq, uint priority)
+{
+    return list_is_empty(&rq->queue[priority]) &&
+           (priority != FAIR_PRIORITY || list_is_empty(&rq->fair_queue)) &&
+           (priority != DEADLINE_PRIORITY || list_is_empty(&rq->deadline_queue));
+}
+
+/* insert a fair share thread into rq's fair queue, keeping it sorted by
+ * virtual runtime. equal runtimes stay in fifo order. */
+static void insert_in_fair_queue(struct run_queue *rq, thread_t *t)
+{
+    if (rq->fair_min_vruntime > FAIR_WAKEUP_CREDIT_NS &&
+        t->vruntime_ns < rq->fair_min_vruntime - FAIR_WAKEUP_CREDIT_NS) {
+        t->vruntime_ns = rq->fair_min_vruntime - FAIR_WAKEUP_CREDIT_NS;
+    }
+
+    /* most insertions are of threads that just ran, so search from the tail */
+    thread_t *pos;
+    for (pos = list_peek_tail_type(&rq->fair_queue, thread_t, queue_node); pos;
+         pos = list_prev_type(&rq->fair_queue, &pos->queue_node, thread_t, queue_node)) {
+        if (pos->vruntime_ns <= t->vruntime_ns) {
+            list_add_after(&pos->queue_node, &t->queue_node);
+            return;
+        }
+    }
+    list_add_head(&rq->fair_queue, &t->queue_node);
+}
+
+/* rebase a fair share thread's virtual runtime when it moves between cpus,
+ * since each run queue's virtual clock advances independently */
+static void fair_migrate(thread_t *t, struct run_queue *from, struct run_queue *to)
+{
+    if (!thread_is_fair(t) || from == to)
+        return;
+
+    int64_t lag = (int64_t)(t->vruntime_ns - from->fair_min_vruntime);
+    t->vruntime_ns = (lag < 0 && (lk_bigtime_t)-lag > to->fair_min_vruntime) ?
+                     0 : (lk_bigtime_t)((int64_t)to->fair_min_vruntime + lag);
+}
 
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_cpu(thread_t *t, uint cpu, bool head)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+
+    /* a thread moved between run queues keeps waiting since it first did */
+    if (t->ready_since_ns == 0)
+        t->ready_since_ns = current_time_hires();
+
+    struct run_queue *rq = &run_queue[cpu];
+    if (thread_is_deadline(t)) {
+        /* the deadline queue is searched by deadline when picking */
+        list_add_tail(&rq->deadline_queue, &t->queue_node);
+    } else if (thread_is_fair(t)) {
+        /* position in the fair queue is by virtual runtime alone */
+        insert_in_fair_queue(rq, t);
+    } else if (head) {
+        list_add_head(&rq->queue[t->priority], &t->queue_node);
+    } else {
+        list_add_tail(&rq->queue[t->priority], &t->queue_node);
+    }
+    rq->bitmap |= (1u << run_queue_level(t));
+    run_queue_ready_mask |= (1u << cpu);
+    t->queue_cpu = (int)cpu;
+
+#if WITH_LIB_KTRACE
+    ktrace(TAG_RUNQ_ENQUEUE, (uint32_t)t->user_tid, cpu | (head ? (1u << 16) : 0),
+           (uint32_t)(uintptr_t)t, run_queue_level(t));
+#endif
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+    /* the running thread may have been going without a preemption tick since
+     * it had the cpu to itself; now that it has company, make sure its
+     * quantum is enforced */
+    if (cpu == arch_curr_cpu_num()) {
+        thread_t *current_thread = get_current_thread();
+        if (current_thread != t && current_thread->state == THREAD_RUNNING &&
+            !timer_is_queued(&preempt_timer[cpu])) {
+            preempt_timer_update(cpu, current_thread);
+        }
+    }
+#endif
+}
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+static void insert_in_run_queue_head(thread_t *t)
+{
+    insert_in_run_queue_cpu(t, run_queue_target_cpu(t), true);
 }
 
 static void insert_in_run_queue_tail(thread_t *t)
 {
-    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
-    DEBUG_ASSERT(t->state == THREAD_READY);
-    DEBUG_ASSERT(!list_in_list(&t->queue_node));
-    DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    insert_in_run_queue_cpu(t, run_queue_target_cpu(t), false);
+}
+
+#if WITH_SMP
+/* Find an idle cpu close to where t last ran: the last cpu itself, then an
+ * SMT sibling, then a core in the same package, then any idle cpu.
+ * The local cpu is never picked since it cannot be kicked with an ipi; if it
+ * is idle it will find the thread through the fallback path anyway.
+ * Returns -1 if no other active cpu is idle.
+ */
+static int find_idle_cpu_for_wakeup(thread_t *t)
+{
+    mp_cpu_mask_t idle = mp_get_idle_mask() & mp_get_active_mask() & t->cpu_affinity;
+    idle &= ~(1u << arch_curr_cpu_num());
+    if (idle == 0)
+        return -1;
+
+    int last = t->last_cpu;
+    if (last >= 0) {
+        if (idle & (1u << last))
+            return last;
+
+        mp_cpu_mask_t candidates = idle & arch_mp_cpu_smt_siblings(last);
+        if (candidates == 0)
+            candidates = idle & arch_mp_cpu_package_siblings(last);
+        if (candidates)
+            return __builtin_ctz(candidates);
+    }
+
+    return __builtin_ctz(idle);
+}
+#endif
+
+/* Queue a thread that was just made runnable (woken, resumed or timed out) on
+ * the cpu it is most likely to run well on, and return the mask of cpus that
+ * should be sent a reschedule.
+ *
+ * If an idle cpu near the thread's last cpu is available the thread goes
+ * straight there.  Otherwise it is queued on its last cpu, where its cache
+ * footprint most likely still is, and preempts whatever runs there at a lower
+ * priority.  Either way only that cpu is kicked: busy cpus don't steal, the
+ * thread moves again only if some cpu goes idle while it is still queued.
+ */
+static mp_cpu_mask_t insert_in_run_queue_wakeup(thread_t *t)
+{
+    deadline_wakeup(t, current_time_hires());
+
+    /* the waker is about to give this cpu up to t, see thread_handoff_begin() */
+    thread_t *current_thread = get_current_thread();
+    uint cpu = arch_curr_cpu_num();
+    if (current_thread->handoff == THREAD_HANDOFF_OPEN && !arch_in_int_handler() &&
+        thread_can_run_on(t, cpu) && t->priority >= current_thread->priority) {
+        current_thread->handoff = THREAD_HANDOFF_DONE;
+        THREAD_STATS_INC(handoffs);
+        insert_in_run_queue_cpu(t, cpu, true);
+        return 0;
+    }
+
+#if WITH_SMP
+    if (t->pinned_cpu < 0 && t->deadline.period_ns == 0) {
+        int target = find_idle_cpu_for_wakeup(t);
+        if (target >= 0) {
+            /* claim the cpu so a burst of wakeups spreads out instead of
+             * piling onto the same idle cpu; it goes back to idle in
+             * thread_resched() if it finds nothing to run */
+            mp_set_cpu_busy(target);
+            insert_in_run_queue_cpu(t, target, true);
+            return 1u << target;
+        }
+
+        if (t->last_cpu >= 0 && mp_is_cpu_active(t->last_cpu) &&
+            thread_can_run_on(t, (uint)t->last_cpu)) {
+            insert_in_run_queue_cpu(t, t->last_cpu, true);
+            return 1u << t->last_cpu;
+        }
+    }
+#endif
+    uint target = run_queue_target_cpu(t);
+    insert_in_run_queue_cpu(t, target, true);
+    return 1u << target;
+}
+
+static uint sched_latency_bucket(lk_bigtime_t ns)
+{
+    if (ns < (1u << 10))
+        return 0;
+    uint bucket = (63 - __builtin_clzll(ns)) - 9;
+    return MIN(bucket, SCHED_LATENCY_BUCKETS - 1u);
+}
+
+void sched_latency_get(uint cpu, struct sched_latency *out)
+{
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+
+    /* races with the cpu updating it, which is fine for statistics */
+    *out = sched_latency_cpu[cpu].lat;
+}
+
+void sched_latency_reset(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        memset(&sched_latency_cpu[cpu].lat, 0, sizeof(sched_latency_cpu[cpu].lat));
+}
+
+/* remove a thread from the given priority level of a run queue */
+static void remove_from_run_queue(struct run_queue *rq, thread_t *t, uint priority)
+{
+    DEBUG_ASSERT(thread_lock_held());
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+#if WITH_LIB_KTRACE
+    ktrace(TAG_RUNQ_DEQUEUE, (uint32_t)t->user_tid, (uint32_t)(rq - run_queue),
+           (uint32_t)(uintptr_t)t, priority);
+#endif
+
+    list_delete(&t->queue_node);
+    t->queue_cpu = -1;
+    if (run_queue_level_empty(rq, priority)) {
+        rq->bitmap &= ~(1u << priority);
+        if (rq->bitmap == 0)
+            run_queue_ready_mask &= ~(1u << (rq - run_queue));
+    }
+}
+
+/* find the cpu whose run queue a ready thread is on, or -1 */
+static int find_run_queue_cpu(thread_t *t)
+{
+    DEBUG_ASSERT(thread_lock_held());
+
+    return t->queue_cpu;
+}
+
+/* start a quota group's next period if the current one is over, closing out
+ * the time it spent held off in the one that ended */
+static void quota_refill(thread_quota_t *q, lk_bigtime_t now)
+{
+    if (now - q->period_start_ns < q->period_ns)
+        return;
+
+    if (q->throttled_since_ns) {
+        lk_bigtime_t end = q->period_start_ns + q->period_ns;
+        if (end > q->throttled_since_ns)
+            q->throttled_ns += end - q->throttled_since_ns;
+        q->throttled_since_ns = 0;
+    }
+    q->period_start_ns += (now - q->period_start_ns) / q->period_ns * q->period_ns;
+    q->used_ns = 0;
+}
+
+/* count delta ns of cpu time against a thread's quota group and every one
+ * above it */
+static void quota_charge(thread_quota_t *q, lk_bigtime_t delta, lk_bigtime_t now)
+{
+    DEBUG_ASSERT(thread_lock_held());
+
+    for (; q; q = q->parent) {
+        if (q->period_ns == 0)
+            continue;
+        quota_refill(q, now);
+        q->used_ns += delta;
+        if (q->used_ns >= q->quota_ns && !q->throttled_since_ns) {
+            q->throttled_since_ns = now;
+            q->throttled_count++;
+        }
+    }
+}
+
+/* the first of a thread's quota groups, going up, that has used up its quota
+ * for the current period, or NULL if the thread may run */
+static thread_quota_t *quota_exhausted(thread_t *t, lk_bigtime_t now)
+{
+    for (thread_quota_t *q = t->quota; q; q = q->parent) {
+        if (q->period_ns == 0)
+            continue;
+        quota_refill(q, now);
+        if (q->used_ns >= q->quota_ns)
+            return q;
+    }
+    return NULL;
+}
+
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* how long a thread may run before one of its quota groups runs out, or
+ * UINT64_MAX if none of them limit it */
+static lk_bigtime_t quota_remaining(thread_t *t, lk_bigtime_t now)
+{
+    lk_bigtime_t remaining = UINT64_MAX;
+    for (thread_quota_t *q = t->quota; q; q = q->parent) {
+        if (q->period_ns == 0)
+            continue;
+        quota_refill(q, now);
+        lk_bigtime_t left = (q->used_ns < q->quota_ns) ? q->quota_ns - q->used_ns : 0;
+        remaining = MIN(remaining, left);
+    }
+    return remaining;
+}
+#endif
+
+/* the threads of a throttled group are left in the run queues, where nothing
+ * picks them until their next period; kick every cpu then so they're found */
+static enum handler_return quota_refill_tick(timer_t *timer, lk_time_t now, void *arg)
+{
+    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    return INT_RESCHEDULE;
+}
+
+static void quota_arm_refill(thread_quota_t *q, lk_bigtime_t now)
+{
+    if (timer_is_queued(&q->refill_timer))
+        return;
+
+    lk_bigtime_t left = q->period_start_ns + q->period_ns - now;
+    lk_time_t delay = (lk_time_t)((left + 999999) / 1000000);
+    timer_set_oneshot(&q->refill_timer, MAX(delay, 1u), quota_refill_tick, NULL);
+}
+
+/* a deadline thread's share of a cpu, in millionths */
+static uint32_t deadline_load(const thread_deadline_params_t *params)
+{
+    return (uint32_t)(params->runtime_ns * 1000000u / params->deadline_ns);
+}
+
+/* start a deadline thread's next period if the current one is over */
+static void deadline_refill(thread_t *t, lk_bigtime_t now)
+{
+    if (now - t->deadline_period_start_ns < t->deadline.period_ns)
+        return;
+
+    t->deadline_period_start_ns = now;
+    t->deadline_abs_ns = now + t->deadline.deadline_ns;
+    t->deadline_budget_ns = t->deadline.runtime_ns;
+}
+
+/* A deadline thread waking up late in its period can't be left to use the
+ * rest of its runtime before the old deadline, since that could take more
+ * of the cpu than it was admitted with.  If it has more runtime left than
+ * its share of the time to the deadline, it starts a new period instead. */
+static void deadline_wakeup(thread_t *t, lk_bigtime_t now)
+{
+    if (!t->deadline.period_ns)
+        return;
+
+    if (now >= t->deadline_abs_ns ||
+        t->deadline_budget_ns * t->deadline.deadline_ns >
+            (t->deadline_abs_ns - now) * t->deadline.runtime_ns) {
+        t->deadline_period_start_ns = now;
+        t->deadline_abs_ns = now + t->deadline.deadline_ns;
+        t->deadline_budget_ns = t->deadline.runtime_ns;
+    }
+}
+
+/* how much of its runtime a deadline thread has left, counting what it has
+ * run since it was last accounted if it is running */
+static lk_bigtime_t deadline_budget_left(thread_t *t, lk_bigtime_t now)
+{
+    lk_bigtime_t ran = (t->state == THREAD_RUNNING) ? now - t->last_started_running_ns : 0;
+    return (t->deadline_budget_ns > ran) ? t->deadline_budget_ns - ran : 0;
+}
+
+/* deadline threads that are out of runtime are left in their run queue,
+ * where nothing picks them until their next period; kick the cpu then */
+static enum handler_return deadline_refill_tick(timer_t *timer, lk_time_t now, void *arg)
+{
+    return INT_RESCHEDULE;
+}
+
+static void deadline_arm_refill(thread_t *t, lk_bigtime_t now)
+{
+    DEBUG_ASSERT(t->deadline_cpu == (int)arch_curr_cpu_num());
+
+    struct run_queue *rq = &run_queue[t->deadline_cpu];
+    lk_bigtime_t refill = t->deadline_period_start_ns + t->deadline.period_ns;
+    if (timer_is_queued(&rq->deadline_timer)) {
+        if (rq->deadline_refill_ns <= refill)
+            return;
+        timer_cancel(&rq->deadline_timer);
+    }
+
+    rq->deadline_refill_ns = refill;
+    lk_time_t delay = (lk_time_t)((refill - now + 999999) / 1000000);
+    timer_set_oneshot(&rq->deadline_timer, MAX(delay, 1u), deadline_refill_tick, NULL);
+}
+
+/* whether a deadline thread has runtime left in its current period */
+static bool deadline_runnable(thread_t *t, lk_bigtime_t now)
+{
+    deadline_refill(t, now);
+    if (t->deadline_budget_ns > 0)
+        return true;
+
+    deadline_arm_refill(t, now);
+    return false;
+}
+
+/* take a thread out of the deadline class, giving back its share of its cpu */
+static void deadline_release(thread_t *t)
+{
+    DEBUG_ASSERT(thread_lock_held());
+
+    if (!t->deadline.period_ns)
+        return;
+
+    run_queue[t->deadline_cpu].deadline_load -= deadline_load(&t->deadline);
+    memset(&t->deadline, 0, sizeof(t->deadline));
+    t->deadline_cpu = -1;
+}
+
+/* whether a queued thread may be picked to run on cpu now */
+static bool thread_runnable_on(thread_t *t, uint cpu, lk_bigtime_t now)
+{
+    if (!thread_can_run_on(t, cpu))
+        return false;
+    if (thread_is_deadline(t) && !deadline_runnable(t, now))
+        return false;
+    if (likely(!t->quota))
+        return true;
+
+    thread_quota_t *q = quota_exhausted(t, now);
+    if (q) {
+        quota_arm_refill(q, now);
+        return false;
+    }
+    return true;
+}
+
+/* charge the current thread for the time it has run since it was last
+ * accounted, returning how much that was */
+static lk_bigtime_t runtime_account_current(thread_t *t, lk_bigtime_t now)
+{
+    lk_bigtime_t delta = now - t->last_started_running_ns;
+    t->runtime_ns += delta;
+    t->last_started_running_ns = now;
+    if (t->quota)
+        quota_charge(t->quota, delta, now);
+    if (t->deadline.period_ns)
+        t->deadline_budget_ns -= MIN(delta, t->deadline_budget_ns);
+    t->quantum_left_ns -= MIN(delta, t->quantum_left_ns);
+    return delta;
+}
+
+/* give t a fresh time slice if it has used up its last one */
+static void quantum_refill(thread_t *t)
+{
+    if (t->remaining_quantum <= 0 || t->quantum_left_ns == 0) {
+        t->remaining_quantum = THREAD_INITIAL_QUANTUM;
+        t->quantum_left_ns = THREAD_QUANTUM_NS;
+    }
+}
+
+/* how much of its time slice t has left, counting what it has run since it
+ * was last accounted if it is running */
+static lk_bigtime_t quantum_left(thread_t *t, lk_bigtime_t now)
+{
+    lk_bigtime_t ran = (t->state == THREAD_RUNNING) ? now - t->last_started_running_ns : 0;
+    return (t->quantum_left_ns > ran) ? t->quantum_left_ns - ran : 0;
+}
+
+/* charge the current fair share thread for the time it has run since it was
+ * last accounted, and move it to its new spot if it was already requeued,
+ * which is on the cpu it is pinned to if it has one */
+static void fair_account_current(thread_t *t, lk_bigtime_t now)
+{
+    DEBUG_ASSERT(thread_is_fair(t));
+
+    lk_bigtime_t delta = runtime_account_current(t, now);
+    t->vruntime_ns += delta * THREAD_FAIR_WEIGHT_DEFAULT / t->fair_weight;
+
+    if (t->state == THREAD_READY && t->queue_cpu >= 0) {
+        struct run_queue *rq = &run_queue[t->queue_cpu];
+        list_delete(&t->queue_node);
+        insert_in_fair_queue(rq, t);
+    }
+}
+
+static struct list_node *thread_cache_get_locked(struct thread_cache *c)
+{
+    struct list_node *node = list_remove_head(&c->list);
+    if (node)
+        c->count--;
+    else if (c->limit < THREAD_CACHE_MAX)
+        c->limit++;
+    return node;
+}
+
+static bool thread_cache_put_locked(struct thread_cache *c, struct list_node *node)
+{
+    if (c->count >= c->limit) {
+        if (c->limit > THREAD_CACHE_MIN)
+            c->limit--;
+        return false;
+    }
+    list_add_head(&c->list, node);
+    c->count++;
+    return true;
+}
+
+/* a thread that is going away no longer holds its stack, cached or not */
+static void thread_stack_release_count(thread_t *t)
+{
+    if ((t->flags & THREAD_FLAG_FREE_STACK) && t->stack)
+        kcounter_add(&thread_stack_bytes, -(int64_t)t->stack_size);
+}
+
+/* try to cache the stack and structure of a thread that is going away,
+ * clearing the free flags of whatever was cached */
+static void thread_cache_release_locked(thread_t *t)
+{
+    if ((t->flags & THREAD_FLAG_FREE_STACK) && t->stack &&
+            t->stack_size == THREAD_CACHE_STACK_SIZE) {
+        if (thread_cache_put_locked(&thread_stack_cache, (struct list_node *)t->stack))
+            t->flags &= ~THREAD_FLAG_FREE_STACK;
+    }
+
+    if (t->flags & THREAD_FLAG_FREE_STRUCT) {
+        if (thread_cache_put_locked(&thread_struct_cache, &t->thread_list_node))
+            t->flags &= ~THREAD_FLAG_FREE_STRUCT;
+    }
 }
 
 static void init_thread_struct(thread_t *t, const char *name)
 {
     memset(t, 0, sizeof(thread_t));
     t->magic = THREAD_MAGIC;
+    t->user_inherited_priority = -1;
+    list_initialize(&t->held_mutexes);
     thread_set_pinned_cpu(t, -1);
+    t->queue_cpu = -1;
+    t->deadline_cpu = -1;
+#if WITH_SMP
+    t->cpu_affinity = UINT32_MAX;
+#endif
     strlcpy(t->name, name, sizeof(t->name));
     wait_queue_init(&t->retcode_wait_queue);
 }
@@ -119,7 +796,7 @@ static void initial_thread_func(void)
     int ret;
 
     /* release the thread lock that was implicitly held across the reschedule */
-    spin_unlock(&thread_lock);
+    ticket_spin_unlock(&thread_lock);
     arch_enable_ints();
 
     thread_t *ct = get_current_thread();
@@ -166,11 +843,29 @@ thread_t *thread_create_etc(
         thread_trampoline_routine alt_trampoline)
 {
     unsigned int flags = 0;
+    void *cached_stack = NULL;
+
+    /* see if there is a structure and a stack left behind by an old thread */
+    if (!t || (!stack && stack_size == DEFAULT_STACK_SIZE)) {
+        THREAD_LOCK(state);
+        if (!t) {
+            struct list_node *node = thread_cache_get_locked(&thread_struct_cache);
+            if (node) {
+                t = containerof(node, thread_t, thread_list_node);
+                flags |= THREAD_FLAG_FREE_STRUCT;
+            }
+        }
+        if (!stack && stack_size == DEFAULT_STACK_SIZE)
+            cached_stack = thread_cache_get_locked(&thread_stack_cache);
+        THREAD_UNLOCK(state);
+    }
 
     if (!t) {
         t = malloc(sizeof(thread_t));
-        if (!t)
+        if (!t) {
+            free(cached_stack);
             return NULL;
+        }
         flags |= THREAD_FLAG_FREE_STRUCT;
     }
 
@@ -179,12 +874,14 @@ thread_t *thread_create_etc(
     t->entry = entry;
     t->arg = arg;
     t->priority = priority;
+    t->base_priority = priority;
     t->state = THREAD_SUSPENDED;
     t->signals = 0;
     t->blocking_wait_queue = NULL;
     t->blocked_status = NO_ERROR;
     t->interruptable = false;
     thread_set_curr_cpu(t, -1);
+    thread_set_last_cpu(t, -1);
 
     t->retcode = 0;
     wait_queue_init(&t->retcode_wait_queue);
@@ -195,13 +892,14 @@ thread_t *thread_create_etc(
         stack_size += THREAD_STACK_PADDING_SIZE;
         flags |= THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK;
 #endif
-        t->stack = malloc(stack_size);
+        t->stack = cached_stack ? cached_stack : malloc(stack_size);
         if (!t->stack) {
             if (flags & THREAD_FLAG_FREE_STRUCT)
                 free(t);
             return NULL;
         }
         flags |= THREAD_FLAG_FREE_STACK;
+        kcounter_add(&thread_stack_bytes, stack_size);
 #if THREAD_STACK_BOUNDS_CHECK
         memset(t->stack, STACK_DEBUG_BYTE, THREAD_STACK_PADDING_SIZE);
 #endif
@@ -261,14 +959,512 @@ status_t thread_set_real_time(thread_t *t)
     return NO_ERROR;
 }
 
+/**
+ * @brief Return the fair share weight that corresponds to a priority
+ */
+uint32_t thread_fair_weight_for_priority(int priority)
+{
+    if (priority < LOWEST_PRIORITY)
+        priority = LOWEST_PRIORITY;
+    if (priority > HIGHEST_PRIORITY)
+        priority = HIGHEST_PRIORITY;
+    return fair_priority_weights[priority];
+}
+
+/**
+ * @brief Move a thread into or out of the fair share scheduling class
+ *
+ * @param t Thread to change
+ * @param weight Relative share of cpu time, up to THREAD_FAIR_WEIGHT_MAX, or
+ * 0 to return the thread to fixed priority scheduling.
+ *
+ * The change takes effect the next time the thread is queued.
+ *
+ * @return NO_ERROR on success
+ */
+status_t thread_set_fair_weight(thread_t *t, uint32_t weight)
+{
+    if (!t || weight > THREAD_FAIR_WEIGHT_MAX)
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    THREAD_LOCK(state);
+    int cpu = (t->state == THREAD_READY) ? find_run_queue_cpu(t) : -1;
+    if (cpu >= 0) {
+        /* it is sitting in a run queue, so requeue it on the right list */
+        remove_from_run_queue(&run_queue[cpu], t, run_queue_level(t));
+        t->fair_weight = weight;
+        insert_in_run_queue_cpu(t, cpu, false);
+    } else {
+        t->fair_weight = weight;
+    }
+    THREAD_UNLOCK(state);
+
+    return NO_ERROR;
+}
+
+/**
+ * @brief Let a thread's timeouts fire late so they can be coalesced
+ *
+ * @param t Thread to change
+ * @param slack How long, in ms, after its deadline a sleep or wait timeout of
+ * this thread may expire, up to THREAD_TIMER_SLACK_MAX.  Real time threads
+ * ignore their slack.
+ *
+ * @return NO_ERROR on success
+ */
+status_t thread_set_timer_slack(thread_t *t, lk_time_t slack)
+{
+    if (!t || slack > THREAD_TIMER_SLACK_MAX)
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    t->timer_slack = slack;
+
+    return NO_ERROR;
+}
+
 static bool thread_is_realtime(thread_t *t)
 {
-    return (t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY;
+    return (t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY;
+}
+
+static lk_time_t thread_timer_slack(thread_t *t)
+{
+    return (t->flags & THREAD_FLAG_REAL_TIME) ? 0 : t->timer_slack;
+}
+
+static bool thread_is_idle(thread_t *t)
+{
+    return !!(t->flags & THREAD_FLAG_IDLE);
+}
+
+/**
+ * @brief Restrict a thread to one cpu, or let it run on any again
+ *
+ * @param t Thread to change
+ * @param cpu The active cpu to run on, or -1 for any cpu
+ *
+ * A thread waiting in a run queue is moved to the cpu's right away, the
+ * current thread switches over before returning, and a thread running on
+ * some other cpu moves when that cpu is made to reschedule.
+ *
+ * @return NO_ERROR on success, or ERR_BAD_STATE if t is in the deadline class
+ */
+status_t thread_pin_cpu(thread_t *t, int cpu)
+{
+    if (!t || cpu < -1 || (cpu >= 0 && ((uint)cpu >= arch_max_num_cpus() || !mp_is_cpu_active(cpu))))
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+#if WITH_SMP
+    THREAD_LOCK(state);
+    /* pinning can't get a thread out of its affinity mask, nor off the cpu
+     * its deadline reservation is on */
+    if (cpu >= 0 && !(t->cpu_affinity & (1u << cpu))) {
+        THREAD_UNLOCK(state);
+        return ERR_ACCESS_DENIED;
+    }
+    if (t->deadline.period_ns) {
+        THREAD_UNLOCK(state);
+        return ERR_BAD_STATE;
+    }
+    thread_set_pinned_cpu(t, cpu);
+    if (cpu >= 0 && !thread_is_idle(t)) {
+        if (t->state == THREAD_READY) {
+            int queued = find_run_queue_cpu(t);
+            if (queued >= 0 && queued != cpu) {
+                remove_from_run_queue(&run_queue[queued], t, run_queue_level(t));
+                fair_migrate(t, &run_queue[queued], &run_queue[cpu]);
+                insert_in_run_queue_cpu(t, cpu, false);
+                mp_reschedule(1u << cpu, 0);
+            }
+        } else if (t->state == THREAD_RUNNING && t->curr_cpu != cpu) {
+            if (t == get_current_thread()) {
+                if (thread_is_fair(t))
+                    fair_account_current(t, current_time_hires());
+                fair_migrate(t, &run_queue[arch_curr_cpu_num()], &run_queue[cpu]);
+                t->state = THREAD_READY;
+                insert_in_run_queue_cpu(t, cpu, true);
+                mp_reschedule(1u << cpu, 0);
+                thread_resched();
+            } else {
+                /* thread_preempt() requeues it on the pinned cpu */
+                mp_reschedule(1u << t->curr_cpu, 0);
+            }
+        }
+    }
+    THREAD_UNLOCK(state);
+#endif
+
+    return NO_ERROR;
+}
+
+/**
+ * @brief Restrict the cpus a thread may run on
+ *
+ * @param t Thread to change
+ * @param mask The cpus it may run on, of which at least one has to be active
+ *
+ * A thread pinned to a cpu outside the mask is unpinned.  One that is queued
+ * or running on a cpu outside the mask moves the same way a thread being
+ * pinned does, see thread_pin_cpu().
+ *
+ * @return NO_ERROR on success, or ERR_BAD_STATE if t is in the deadline class
+ */
+status_t thread_set_cpu_affinity(thread_t *t, uint32_t mask)
+{
+    if (!t || (mask & mp_get_active_mask()) == 0)
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+#if WITH_SMP
+    THREAD_LOCK(state);
+    if (t->deadline.period_ns) {
+        THREAD_UNLOCK(state);
+        return ERR_BAD_STATE;
+    }
+    t->cpu_affinity = mask;
+    if (t->pinned_cpu >= 0 && !(mask & (1u << t->pinned_cpu)))
+        thread_set_pinned_cpu(t, -1);
+    if (!thread_is_idle(t)) {
+        if (t->state == THREAD_READY) {
+            int queued = find_run_queue_cpu(t);
+            if (queued >= 0 && !thread_can_run_on(t, (uint)queued)) {
+                remove_from_run_queue(&run_queue[queued], t, run_queue_level(t));
+                uint cpu = run_queue_target_cpu(t);
+                fair_migrate(t, &run_queue[queued], &run_queue[cpu]);
+                insert_in_run_queue_cpu(t, cpu, false);
+                mp_reschedule(1u << cpu, 0);
+            }
+        } else if (t->state == THREAD_RUNNING && !thread_can_run_on(t, (uint)t->curr_cpu)) {
+            if (t == get_current_thread()) {
+                if (thread_is_fair(t))
+                    fair_account_current(t, current_time_hires());
+                uint cpu = run_queue_target_cpu(t);
+                fair_migrate(t, &run_queue[arch_curr_cpu_num()], &run_queue[cpu]);
+                t->state = THREAD_READY;
+                insert_in_run_queue_cpu(t, cpu, true);
+                mp_reschedule(1u << cpu, 0);
+                thread_resched();
+            } else {
+                /* thread_preempt() requeues it inside the mask */
+                mp_reschedule(1u << t->curr_cpu, 0);
+            }
+        }
+    }
+    THREAD_UNLOCK(state);
+#endif
+
+    return NO_ERROR;
+}
+
+/* the cpu to admit a deadline thread with params on: the least loaded one it
+ * may run on that its share of still fits in, or -1 if none does */
+static int deadline_admit_cpu(thread_t *t, const thread_deadline_params_t *params)
+{
+    uint32_t load = deadline_load(params);
+    int best = -1;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+#if WITH_SMP
+        if (!mp_is_cpu_active(cpu) || !(t->cpu_affinity & (1u << cpu)) ||
+            (t->pinned_cpu >= 0 && t->pinned_cpu != (int)cpu))
+            continue;
+#endif
+        uint32_t cpu_load = run_queue[cpu].deadline_load;
+        if (cpu_load + load > THREAD_DEADLINE_LOAD_MAX * 10000u)
+            continue;
+        if (best < 0 || cpu_load < run_queue[best].deadline_load)
+            best = cpu;
+    }
+    return best;
+}
+
+/**
+ * @brief Move a thread into or out of the deadline scheduling class
+ *
+ * @param t Thread to change
+ * @param params The runtime the thread needs every period, and how soon
+ * after the period starts it has to have had it, which is also the share
+ * of a cpu it reserves.  A period of 0 returns the thread to the class it
+ * was in before.
+ *
+ * The thread is admitted on the least loaded cpu it may run on where the
+ * reserved shares stay within THREAD_DEADLINE_LOAD_MAX percent, and stays on
+ * that cpu while it is in the class, unless the cpu is unplugged, see
+ * thread_transition_off_cpu().  Its first period starts right away.
+ * Within a period the thread runs ahead of anything below DEADLINE_PRIORITY
+ * until it has used its runtime, after which it waits for its next period.
+ *
+ * @return NO_ERROR on success, ERR_INVALID_ARGS for parameters out of range,
+ * or ERR_NO_RESOURCES if no cpu has room for it, in which case the thread
+ * keeps whatever reservation it had.
+ */
+status_t thread_set_deadline(thread_t *t, const thread_deadline_params_t *params)
+{
+    if (!t || !params)
+        return ERR_INVALID_ARGS;
+    if (params->period_ns != 0 &&
+        (params->runtime_ns == 0 || params->runtime_ns > params->deadline_ns ||
+         params->deadline_ns > params->period_ns ||
+         params->period_ns < THREAD_DEADLINE_PERIOD_MIN_NS ||
+         params->period_ns > THREAD_DEADLINE_PERIOD_MAX_NS))
+        return ERR_INVALID_ARGS;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    if (thread_is_idle(t))
+        return ERR_NOT_SUPPORTED;
+
+    THREAD_LOCK(state);
+    lk_bigtime_t now = current_time_hires();
+    bool current = (t == get_current_thread());
+    if (current) {
+        /* charge what it ran so far to the class it ran in */
+        if (thread_is_fair(t))
+            fair_account_current(t, now);
+        else
+            runtime_account_current(t, now);
+    }
+
+    int queued = (t->state == THREAD_READY) ? find_run_queue_cpu(t) : -1;
+    if (queued >= 0)
+        remove_from_run_queue(&run_queue[queued], t, run_queue_level(t));
+
+    thread_deadline_params_t old = t->deadline;
+    int old_cpu = t->deadline_cpu;
+    deadline_release(t);
+
+    status_t status = NO_ERROR;
+    if (params->period_ns != 0) {
+        int cpu = deadline_admit_cpu(t, params);
+        if (cpu >= 0) {
+            t->deadline = *params;
+            t->deadline_cpu = cpu;
+        } else {
+            t->deadline = old;
+            t->deadline_cpu = old_cpu;
+            status = ERR_NO_RESOURCES;
+        }
+        if (t->deadline.period_ns) {
+            run_queue[t->deadline_cpu].deadline_load += deadline_load(&t->deadline);
+            if (status == NO_ERROR) {
+                t->deadline_period_start_ns = now;
+                t->deadline_abs_ns = now + t->deadline.deadline_ns;
+                t->deadline_budget_ns = t->deadline.runtime_ns;
+            }
+        }
+    }
+
+    if (queued >= 0) {
+        uint cpu = run_queue_target_cpu(t);
+        fair_migrate(t, &run_queue[queued], &run_queue[cpu]);
+        insert_in_run_queue_cpu(t, cpu, false);
+        mp_reschedule(1u << cpu, 0);
+    } else if (t->state == THREAD_RUNNING) {
+        uint cpu = arch_curr_cpu_num();
+        if (!current) {
+            /* thread_preempt() requeues it where it now belongs */
+            mp_reschedule(1u << t->curr_cpu, 0);
+        } else if (!thread_can_run_on(t, cpu)) {
+            uint target = run_queue_target_cpu(t);
+            fair_migrate(t, &run_queue[cpu], &run_queue[target]);
+            t->state = THREAD_READY;
+            insert_in_run_queue_cpu(t, target, true);
+            mp_reschedule(1u << target, 0);
+            thread_resched();
+        } else {
+#if PLATFORM_HAS_DYNAMIC_TIMER
+            preempt_timer_update(cpu, t);
+#endif
+        }
+    }
+    THREAD_UNLOCK(state);
+
+    return status;
+}
+
+/**
+ * @brief Set up an unlimited cpu quota group
+ *
+ * @param q The group
+ * @param parent The group it nests in, which has to outlive it, or NULL
+ */
+void thread_quota_init(thread_quota_t *q, thread_quota_t *parent)
+{
+    memset(q, 0, sizeof(*q));
+    q->parent = parent;
+    timer_initialize(&q->refill_timer);
+}
+
+void thread_quota_destroy(thread_quota_t *q)
+{
+    timer_cancel(&q->refill_timer);
+}
+
+/**
+ * @brief Limit the cpu time a group of threads may use
+ *
+ * @param q The group
+ * @param period_ns Length of each period, from THREAD_QUOTA_PERIOD_MIN_NS to
+ * THREAD_QUOTA_PERIOD_MAX_NS, or 0 to lift the limit
+ * @param quota_ns cpu time the group may use each period, which can be more
+ * than the period itself for a group running on several cpus, up to the
+ * period times the number of cpus
+ *
+ * The group starts a fresh period with nothing used.
+ *
+ * @return NO_ERROR on success
+ */
+status_t thread_quota_set(thread_quota_t *q, lk_bigtime_t period_ns, lk_bigtime_t quota_ns)
+{
+    if (period_ns != 0 &&
+        (period_ns < THREAD_QUOTA_PERIOD_MIN_NS || period_ns > THREAD_QUOTA_PERIOD_MAX_NS ||
+         quota_ns == 0 || quota_ns > period_ns * arch_max_num_cpus()))
+        return ERR_INVALID_ARGS;
+
+    THREAD_LOCK(state);
+    lk_bigtime_t now = current_time_hires();
+    if (q->throttled_since_ns) {
+        q->throttled_ns += now - q->throttled_since_ns;
+        q->throttled_since_ns = 0;
+    }
+    q->period_ns = period_ns;
+    q->quota_ns = period_ns ? quota_ns : 0;
+    q->period_start_ns = now;
+    q->used_ns = 0;
+    THREAD_UNLOCK(state);
+
+    /* anything it was holding off can run now, or at least be looked at */
+    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+
+    return NO_ERROR;
+}
+
+void thread_quota_get_info(thread_quota_t *q, thread_quota_info_t *out)
+{
+    THREAD_LOCK(state);
+    lk_bigtime_t now = current_time_hires();
+    if (q->period_ns)
+        quota_refill(q, now);
+    out->period_ns = q->period_ns;
+    out->quota_ns = q->quota_ns;
+    out->throttled_count = q->throttled_count;
+    out->throttled_ns = q->throttled_ns;
+    if (q->throttled_since_ns)
+        out->throttled_ns += now - q->throttled_since_ns;
+    THREAD_UNLOCK(state);
+}
+
+void thread_set_quota(thread_t *t, thread_quota_t *q)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(t->state == THREAD_SUSPENDED);
+
+    THREAD_LOCK(state);
+    t->quota = q;
+    THREAD_UNLOCK(state);
+}
+
+/* how many owners deep a priority boost is passed along a chain of blocked
+ * mutex owners, which also keeps a deadlock cycle from looping forever */
+#define THREAD_PI_MAX_DEPTH 16
+
+/* the priority t should run at: its own, or that of the highest priority
+ * thread waiting on a lock it holds */
+static int thread_inherited_priority(thread_t *t)
+{
+    int priority = t->base_priority;
+    if (t->user_inherited_priority > priority)
+        priority = t->user_inherited_priority;
+
+    mutex_t *m;
+    list_for_every_entry(&t->held_mutexes, m, mutex_t, held_node) {
+        thread_t *waiter;
+        list_for_every_entry(&m->wait.list, waiter, thread_t, queue_node) {
+            if (waiter->priority > priority)
+                priority = waiter->priority;
+        }
+    }
+    return priority;
+}
+
+/* change the priority t runs at, moving it within the run queues if needed */
+static void thread_set_effective_priority(thread_t *t, int priority)
+{
+    int cpu = (t->state == THREAD_READY && !thread_is_idle(t)) ? find_run_queue_cpu(t) : -1;
+    if (cpu < 0) {
+        t->priority = priority;
+        return;
+    }
+
+    remove_from_run_queue(&run_queue[cpu], t, run_queue_level(t));
+    t->priority = priority;
+    insert_in_run_queue_cpu(t, cpu, false);
+    if ((uint)cpu != arch_curr_cpu_num())
+        mp_reschedule(1u << cpu, 0);
+}
+
+/**
+ * @brief Raise a lock owner's priority to that of a thread about to wait on it
+ *
+ * The boost is passed on to the owner of any mutex that t is itself blocked
+ * on.  It lasts until the lock is released and thread_update_priority_locked()
+ * recomputes the owner's priority.
+ */
+void thread_inherit_priority_locked(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(thread_lock_held());
+
+    for (int depth = 0; t && depth < THREAD_PI_MAX_DEPTH; depth++) {
+        if (t->priority >= priority)
+            return;
+        thread_set_effective_priority(t, priority);
+        t = t->blocking_mutex ? t->blocking_mutex->holder : NULL;
+    }
+}
+
+/**
+ * @brief Recompute a thread's priority from its own and its lock waiters'
+ *
+ * Called when the set of locks t holds or the threads waiting on them
+ * changes.  Any change is passed on along the chain of mutex owners.
+ */
+void thread_update_priority_locked(thread_t *t)
+{
+    DEBUG_ASSERT(thread_lock_held());
+
+    for (int depth = 0; t && depth < THREAD_PI_MAX_DEPTH; depth++) {
+        int priority = thread_inherited_priority(t);
+        if (priority == t->priority)
+            return;
+        thread_set_effective_priority(t, priority);
+        t = t->blocking_mutex ? t->blocking_mutex->holder : NULL;
+    }
 }
 
-static bool thread_is_idle(thread_t *t)
+/**
+ * @brief Set the priority a thread inherits from waiters on user mode locks
+ *
+ * @param t Thread to change
+ * @param priority Highest priority of the threads waiting on locks owned by
+ * t, or -1 if there are none.
+ */
+void thread_set_user_inherited_priority(thread_t *t, int priority)
 {
-    return !!(t->flags & THREAD_FLAG_IDLE);
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    if (priority > HIGHEST_PRIORITY)
+        priority = HIGHEST_PRIORITY;
+
+    THREAD_LOCK(state);
+    t->user_inherited_priority = priority;
+    thread_update_priority_locked(t);
+    THREAD_UNLOCK(state);
 }
 
 static bool thread_is_real_time_or_idle(thread_t *t)
@@ -293,15 +1489,16 @@ status_t thread_resume(thread_t *t)
 
     bool resched = false;
     bool ints_disabled = arch_ints_disabled();
+    mp_cpu_mask_t kick = MP_CPU_ALL_BUT_LOCAL;
     THREAD_LOCK(state);
     if (t->state == THREAD_SUSPENDED) {
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        kick = insert_in_run_queue_wakeup(t);
         if (!ints_disabled) /* HACK, don't resced into bootstrap thread before idle thread is set up */
             resched = true;
     }
 
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    mp_reschedule(kick, 0);
 
     THREAD_UNLOCK(state);
 
@@ -356,6 +1553,10 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout)
     /* clear the structure's magic */
     t->magic = 0;
 
+    /* hang on to its stack and structure for the next thread if we can */
+    thread_stack_release_count(t);
+    thread_cache_release_locked(t);
+
     THREAD_UNLOCK(state);
 
     /* free its stack and the thread structure itself */
@@ -392,6 +1593,9 @@ status_t thread_detach(thread_t *t)
 
 __NO_RETURN static void thread_exit_locked(thread_t *current_thread, int retcode)
 {
+    /* give back its share of its cpu */
+    deadline_release(current_thread);
+
     /* enter the dead state */
     current_thread->state = THREAD_DEATH;
     current_thread->retcode = retcode;
@@ -404,13 +1608,17 @@ __NO_RETURN static void thread_exit_locked(thread_t *current_thread, int retcode
         /* clear the structure's magic */
         current_thread->magic = 0;
 
-        /* free its stack and the thread structure itself */
-        if (current_thread->flags & THREAD_FLAG_FREE_STACK && current_thread->stack) {
-            heap_delayed_free(current_thread->stack);
+        /* make sure its not going to get a bounds check performed on the
+         * half-freed or cached stack */
+        current_thread->flags &= ~THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK;
 
-            /* make sure its not going to get a bounds check performed on the half-freed stack */
-            current_thread->flags &= ~THREAD_FLAG_DEBUG_STACK_BOUNDS_CHECK;
-        }
+        /* hang on to its stack and structure for the next thread if we can */
+        thread_stack_release_count(current_thread);
+        thread_cache_release_locked(current_thread);
+
+        /* free whatever is left of its stack and the thread structure itself */
+        if (current_thread->flags & THREAD_FLAG_FREE_STACK && current_thread->stack)
+            heap_delayed_free(current_thread->stack);
 
         if (current_thread->flags & THREAD_FLAG_FREE_STRUCT)
             heap_delayed_free(current_thread);
@@ -442,10 +1650,12 @@ void thread_forget(thread_t *t)
     DEBUG_ASSERT(current_thread != t);
 
     list_delete(&t->thread_list_node);
+    deadline_release(t);
     THREAD_UNLOCK(state);
 
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
+    thread_stack_release_count(t);
     if (t->flags & THREAD_FLAG_FREE_STACK && t->stack)
         free(t->stack);
 
@@ -468,6 +1678,15 @@ void thread_exit(int retcode)
     DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
     DEBUG_ASSERT(!thread_is_idle(current_thread));
 
+    /* the quota group may go away along with whatever the exit callback
+     * lets go of, so settle up with it first */
+    if (current_thread->quota) {
+        THREAD_LOCK(state);
+        runtime_account_current(current_thread, current_time_hires());
+        current_thread->quota = NULL;
+        THREAD_UNLOCK(state);
+    }
+
     /* if the thread has a callback set, call it here */
     if (current_thread->exit_callback) {
         current_thread->exit_callback(current_thread->exit_callback_arg);
@@ -528,7 +1747,7 @@ void thread_kill(thread_t *t, bool block)
             if (t->interruptable) {
                 t->state = THREAD_READY;
                 t->blocked_status = ERR_INTERRUPTED;
-                insert_in_run_queue_head(t);
+                mp_reschedule(insert_in_run_queue_wakeup(t), 0);
             }
             break;
         case THREAD_DEATH:
@@ -572,36 +1791,244 @@ __NO_RETURN static int idle_thread_routine(void *arg)
         arch_idle();
 }
 
-static thread_t *get_top_thread(int cpu)
+#if WITH_SMP
+/* return the last thread on a run queue list that may run on cpu now */
+static thread_t *steal_from_list(struct list_node *list, uint cpu, lk_bigtime_t now)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    thread_t *t;
+    for (t = list_peek_tail_type(list, thread_t, queue_node); t;
+         t = list_prev_type(list, &t->queue_node, thread_t, queue_node)) {
+        if (thread_runnable_on(t, cpu, now))
+            return t;
+    }
+    return NULL;
+}
 
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * 8 - NUM_PRIORITIES);
+/* Look through the other cpus' run queues for the highest priority thread
+ * that is allowed to run on cpu, which is about to go idle otherwise. Only
+ * the cpus with anything queued are looked at. The tail of each queue is
+ * taken since that thread would run last where it is and is the least
+ * likely to still be cache hot there.
+ */
+static thread_t *steal_thread(uint cpu, lk_bigtime_t now)
+{
+    mp_cpu_mask_t remote = run_queue_ready_mask & ~(1u << cpu);
+    if (remote == 0)
+        return NULL;
+
+    uint32_t remote_bitmap = 0;
+    for (mp_cpu_mask_t m = remote; m; m &= m - 1)
+        remote_bitmap |= run_queue[__builtin_ctz(m)].bitmap;
+
+    while (remote_bitmap) {
+        uint priority = run_queue_highest_priority(remote_bitmap);
+
+        for (mp_cpu_mask_t m = remote; m; m &= m - 1) {
+            uint i = __builtin_ctz(m);
+            struct run_queue *rq = &run_queue[i];
+            if (!(rq->bitmap & (1u << priority)))
+                continue;
+
+            thread_t *t = steal_from_list(&rq->queue[priority], cpu, now);
+            if (!t && priority == FAIR_PRIORITY)
+                t = steal_from_list(&rq->fair_queue, cpu, now);
+            if (t) {
+                remove_from_run_queue(rq, t, priority);
+                fair_migrate(t, rq, &run_queue[cpu]);
+#if WITH_LIB_KTRACE
+                ktrace(TAG_RUNQ_MIGRATE, (uint32_t)t->user_tid, i, cpu, (uint32_t)(uintptr_t)t);
+#endif
+                THREAD_STATS_INC(steals);
+                return t;
+            }
+        }
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
-#if WITH_SMP
-            if (newthread->pinned_cpu < 0 || newthread->pinned_cpu == cpu)
+        remote_bitmap &= ~(1u << priority);
+    }
+
+    return NULL;
+}
 #endif
-            {
-                list_delete(&newthread->queue_node);
 
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+/* pick the next thread for cpu, skipping threads that may not run there and
+ * those whose quota group is out of time */
+static thread_t *get_top_thread(uint cpu, lk_bigtime_t now)
+{
+    struct run_queue *rq = &run_queue[cpu];
+    uint32_t local_bitmap = rq->bitmap;
+
+    while (local_bitmap) {
+        /* find the first (remaining) queue with a thread in it */
+        uint next_queue = run_queue_highest_priority(local_bitmap);
 
+        thread_t *newthread;
+        list_for_every_entry(&rq->queue[next_queue], newthread, thread_t, queue_node) {
+            if (thread_runnable_on(newthread, cpu, now)) {
+                remove_from_run_queue(rq, newthread, next_queue);
                 return newthread;
             }
         }
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+        /* the fair class runs after any fixed priority threads at its level,
+         * lowest virtual runtime first */
+        if (next_queue == FAIR_PRIORITY) {
+            list_for_every_entry(&rq->fair_queue, newthread, thread_t, queue_node) {
+                if (thread_runnable_on(newthread, cpu, now)) {
+                    remove_from_run_queue(rq, newthread, next_queue);
+                    if (newthread->vruntime_ns > rq->fair_min_vruntime)
+                        rq->fair_min_vruntime = newthread->vruntime_ns;
+                    return newthread;
+                }
+            }
+        }
+
+        /* and the deadline class after those at its level, earliest
+         * deadline first */
+        if (next_queue == DEADLINE_PRIORITY) {
+            thread_t *earliest = NULL;
+            list_for_every_entry(&rq->deadline_queue, newthread, thread_t, queue_node) {
+                if (thread_runnable_on(newthread, cpu, now) &&
+                    (!earliest || newthread->deadline_abs_ns < earliest->deadline_abs_ns))
+                    earliest = newthread;
+            }
+            if (earliest) {
+                remove_from_run_queue(rq, earliest, next_queue);
+                return earliest;
+            }
+        }
+
+        local_bitmap &= ~(1u << next_queue);
     }
+
+#if WITH_SMP
+    /* nothing queued here can run, either because there is nothing or because
+     * it is all held off by quotas or affinity, so rather than go idle take
+     * work from a cpu that has more than it can run */
+    thread_t *stolen = steal_thread(cpu, now);
+    if (stolen)
+        return stolen;
+#endif
+
     /* no threads to run, select the idle thread for this cpu */
     return idle_thread(cpu);
 }
 
+#if WITH_SMP
+/* whether t may run on some cpu other than cpu */
+static bool thread_can_run_elsewhere(thread_t *t, uint cpu)
+{
+    if (t->deadline.period_ns)
+        return t->deadline_cpu != (int)cpu;
+    if (t->pinned_cpu >= 0)
+        return t->pinned_cpu != (int)cpu;
+    return (t->cpu_affinity & ~(1u << cpu)) != 0;
+}
+
+/* admit a deadline thread whose cpu is going away on one that remains,
+ * carrying its share of the cpu and its current period over, or take it out
+ * of the class if none has room for it.  A queued thread is moved to the run
+ * queue it now belongs on. */
+static void deadline_readmit(thread_t *t, uint old_cpu)
+{
+    int queued = (t->state == THREAD_READY) ? find_run_queue_cpu(t) : -1;
+    if (queued >= 0)
+        remove_from_run_queue(&run_queue[queued], t, run_queue_level(t));
+
+    /* old_cpu is no longer active, so it is never picked again */
+    int cpu = deadline_admit_cpu(t, &t->deadline);
+    if (cpu >= 0) {
+        uint32_t load = deadline_load(&t->deadline);
+        run_queue[old_cpu].deadline_load -= load;
+        run_queue[cpu].deadline_load += load;
+        t->deadline_cpu = cpu;
+    } else {
+        deadline_release(t);
+    }
+
+#if WITH_LIB_KTRACE
+    ktrace(TAG_RUNQ_MIGRATE, (uint32_t)t->user_tid, old_cpu, (uint32_t)cpu,
+           (uint32_t)(uintptr_t)t);
+#endif
+
+    if (queued >= 0) {
+        uint target = run_queue_target_cpu(t);
+        fair_migrate(t, &run_queue[queued], &run_queue[target]);
+        insert_in_run_queue_cpu(t, target, false);
+    }
+}
+
+/**
+ * @brief  Move the ready threads queued on a cpu that is going away
+ *
+ * Called after old_cpu has stopped scheduling. Deadline threads admitted on
+ * it, queued or not, are admitted again on a cpu that remains, or leave the
+ * class if none has room.  Every other thread on its run queue that is not
+ * pinned to it is moved to the current cpu's run queue, and other cpus are
+ * kicked so they can steal from there.
+ */
+void thread_transition_off_cpu(uint old_cpu)
+{
+    DEBUG_ASSERT(old_cpu < SMP_MAX_CPUS);
+
+    THREAD_LOCK(state);
+
+    DEBUG_ASSERT(old_cpu != arch_curr_cpu_num());
+    DEBUG_ASSERT(!mp_is_cpu_active(old_cpu));
+
+    struct run_queue *rq = &run_queue[old_cpu];
+    bool moved = false;
+
+    thread_t *dt;
+    list_for_every_entry(&thread_list, dt, thread_t, thread_list_node) {
+        if (dt->deadline.period_ns && dt->deadline_cpu == (int)old_cpu) {
+            deadline_readmit(dt, old_cpu);
+            moved = true;
+        }
+    }
+    DEBUG_ASSERT(rq->deadline_load == 0);
+    DEBUG_ASSERT(list_is_empty(&rq->deadline_queue));
+    /* nothing is left here for the refill timer to kick the cpu for; it was
+     * moved to this cpu along with the others */
+    timer_cancel(&rq->deadline_timer);
+    for (uint priority = 0; priority < NUM_PRIORITIES; priority++) {
+        thread_t *t;
+        thread_t *temp;
+        list_for_every_entry_safe(&rq->queue[priority], t, temp, thread_t, queue_node) {
+            if (!thread_can_run_elsewhere(t, old_cpu))
+                continue;
+
+            remove_from_run_queue(rq, t, priority);
+#if WITH_LIB_KTRACE
+            ktrace(TAG_RUNQ_MIGRATE, (uint32_t)t->user_tid, old_cpu, run_queue_target_cpu(t),
+                   (uint32_t)(uintptr_t)t);
+#endif
+            insert_in_run_queue_tail(t);
+            moved = true;
+        }
+    }
+    thread_t *t;
+    thread_t *temp;
+    list_for_every_entry_safe(&rq->fair_queue, t, temp, thread_t, queue_node) {
+        if (!thread_can_run_elsewhere(t, old_cpu))
+            continue;
+
+        remove_from_run_queue(rq, t, FAIR_PRIORITY);
+        fair_migrate(t, rq, &run_queue[run_queue_target_cpu(t)]);
+#if WITH_LIB_KTRACE
+        ktrace(TAG_RUNQ_MIGRATE, (uint32_t)t->user_tid, old_cpu, run_queue_target_cpu(t),
+               (uint32_t)(uintptr_t)t);
+#endif
+        insert_in_run_queue_tail(t);
+        moved = true;
+    }
+
+    if (moved)
+        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+
+    THREAD_UNLOCK(state);
+}
+#endif
+
 /**
  * @brief  Cause another thread to be executed.
  *
@@ -621,34 +2048,80 @@ static void thread_resched(void)
     uint cpu = arch_curr_cpu_num();
 
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
     DEBUG_ASSERT(current_thread->state != THREAD_RUNNING);
 
     THREAD_STATS_INC(reschedules);
 
-    newthread = get_top_thread(cpu);
+    mp_reschedule_done(cpu);
+
+    lk_bigtime_t now = current_time_hires();
+
+    /* bring a fair share thread's virtual runtime up to date before picking,
+     * so that it competes with what it has actually used, and charge a thread
+     * in a quota group or the deadline class so it is held off if that uses
+     * up the group's quota or its own runtime.  Every thread is charged
+     * against its time slice, which it keeps if it keeps the cpu. */
+    if (thread_is_fair(current_thread))
+        fair_account_current(current_thread, now);
+    else
+        runtime_account_current(current_thread, now);
+
+    newthread = get_top_thread(cpu, now);
 
     DEBUG_ASSERT(newthread);
 
     newthread->state = THREAD_RUNNING;
+    struct sched_latency_cpu *slc = &sched_latency_cpu[cpu];
+    if (newthread->ready_since_ns) {
+        lk_bigtime_t waited = now - newthread->ready_since_ns;
+        newthread->queue_time_ns += waited;
+        newthread->ready_since_ns = 0;
+        slc->lat.wakeup[sched_latency_bucket(waited)]++;
+    }
 
     oldthread = current_thread;
 
-    if (newthread == oldthread)
+    if (newthread == oldthread) {
+#if WITH_SMP
+        /* a wakeup may have claimed this cpu and then had its thread stolen */
+        if (thread_is_idle(newthread))
+            mp_set_cpu_idle(cpu);
+#endif
+        quantum_refill(newthread);
+#if PLATFORM_HAS_DYNAMIC_TIMER
+        /* a running preemption timer already expires at the end of the
+         * thread's slice; only arm it if it went off or was never set */
+        if (!timer_is_queued(&preempt_timer[cpu]))
+            preempt_timer_update(cpu, newthread);
+#endif
         return;
+    }
 
-    lk_bigtime_t now = current_time_hires();
-    oldthread->runtime_ns += now - oldthread->last_started_running_ns;
+    runtime_account_current(oldthread, now);
     newthread->last_started_running_ns = now;
 
-    /* set up quantum for the new thread if it was consumed */
-    if (newthread->remaining_quantum <= 0) {
-        newthread->remaining_quantum = 5; // XXX make this smarter
+    if (slc->slice_start && !thread_is_idle(oldthread))
+        slc->lat.slice[sched_latency_bucket(now - slc->slice_start)]++;
+    slc->slice_start = now;
+
+    /* a thread that is still ready was preempted, or yielded */
+    if (oldthread->state == THREAD_READY) {
+        oldthread->involuntary_switches++;
+    } else {
+        oldthread->voluntary_switches++;
     }
 
+    /* set up quantum for the new thread if it was consumed */
+    quantum_refill(newthread);
+
     /* mark the cpu ownership of the threads */
     thread_set_curr_cpu(oldthread, -1);
     thread_set_curr_cpu(newthread, cpu);
+    __atomic_store_n(&running_thread[cpu], newthread, __ATOMIC_RELAXED);
+    if (thread_last_cpu(newthread) != -1 && thread_last_cpu(newthread) != (int)cpu)
+        newthread->migrations++;
+    thread_set_last_cpu(newthread, cpu);
 
 #if WITH_SMP
     if (thread_is_idle(newthread)) {
@@ -681,25 +2154,11 @@ static void thread_resched(void)
 #endif
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (thread_is_real_time_or_idle(newthread)) {
-        if (!thread_is_real_time_or_idle(oldthread)) {
-            /* if we're switching from a non real time to a real time, cancel
-             * the preemption timer. */
-#if DEBUG_THREAD_CONTEXT_SWITCH
-            dprintf(ALWAYS, "arch_context_switch: stop preempt, cpu %u, old %p (%s), new %p (%s)\n",
-                    cpu, oldthread, oldthread->name, newthread, newthread->name);
-#endif
-            timer_cancel(&preempt_timer[cpu]);
-        }
-    } else if (thread_is_real_time_or_idle(oldthread)) {
-        /* if we're switching from a real time (or idle thread) to a regular one,
-         * set up a periodic timer to run our preemption tick. */
 #if DEBUG_THREAD_CONTEXT_SWITCH
-        dprintf(ALWAYS, "arch_context_switch: start preempt, cpu %u, old %p (%s), new %p (%s)\n",
-                cpu, oldthread, oldthread->name, newthread, newthread->name);
+    dprintf(ALWAYS, "arch_context_switch: update preempt, cpu %u, old %p (%s), new %p (%s)\n",
+            cpu, oldthread, oldthread->name, newthread, newthread->name);
 #endif
-        timer_set_periodic(&preempt_timer[cpu], 10, (timer_callback)thread_timer_tick, NULL);
-    }
+    preempt_timer_update(cpu, newthread);
 #endif
 
     /* set some optional target debug leds */
@@ -777,6 +2236,43 @@ void thread_yield(void)
     THREAD_UNLOCK(state);
 }
 
+void thread_handoff_begin(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    DEBUG_ASSERT(!arch_in_int_handler());
+    DEBUG_ASSERT(current_thread->handoff == THREAD_HANDOFF_NONE);
+
+    /* only the current thread ever looks at it */
+    current_thread->handoff = THREAD_HANDOFF_OPEN;
+}
+
+void thread_handoff_end(bool yield)
+{
+    thread_t *current_thread = get_current_thread();
+
+    DEBUG_ASSERT(current_thread->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    THREAD_LOCK(state);
+
+    bool handed_off = current_thread->handoff == THREAD_HANDOFF_DONE;
+    current_thread->handoff = THREAD_HANDOFF_NONE;
+
+    /* Like a yield, but keeping the rest of the quantum. The woken thread is
+     * at the head of its priority here, so unless something of a higher
+     * priority is ready it runs next, and this thread runs again once it and
+     * anything else queued ahead have had their turn. */
+    if (handed_off && yield) {
+        current_thread->state = THREAD_READY;
+        insert_in_run_queue_tail(current_thread);
+        thread_resched();
+    }
+
+    THREAD_UNLOCK(state);
+}
+
 /**
  * @brief Preempt the current thread, usually from an interrupt
  *
@@ -815,12 +2311,20 @@ void thread_preempt(bool interrupt)
     THREAD_LOCK(state);
 
     /* we are being preempted, so we get to go back into the front of the run queue if we have quantum left */
+    bool quantum_remains = current_thread->remaining_quantum > 0 &&
+                           quantum_left(current_thread, current_time_hires()) > 0;
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        if (current_thread->remaining_quantum > 0)
+        if (quantum_remains)
             insert_in_run_queue_head(current_thread);
         else
             insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+#if WITH_SMP
+        /* it was just pinned or restricted somewhere else, that cpu has to
+         * pick it up */
+        if (!thread_can_run_on(current_thread, arch_curr_cpu_num()))
+            mp_reschedule(1u << run_queue_target_cpu(current_thread), 0);
+#endif
     }
     thread_resched();
 
@@ -843,7 +2347,7 @@ static void thread_block(void)
 
     DEBUG_ASSERT(current_thread->magic == THREAD_MAGIC);
     DEBUG_ASSERT(current_thread->state == THREAD_BLOCKED);
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
     DEBUG_ASSERT(!thread_is_idle(current_thread));
 
     /* we are blocking on something. the blocking code should have already stuck us on a queue */
@@ -854,20 +2358,85 @@ static void thread_unblock(thread_t *t, bool resched)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_BLOCKED);
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
     DEBUG_ASSERT(!thread_is_idle(t));
 
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    mp_reschedule(insert_in_run_queue_wakeup(t), 0);
     if (resched)
         thread_resched();
 }
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* the running thread has used up its quantum, or its deadline runtime */
+static enum handler_return thread_preempt_timer_tick(timer_t *timer, lk_time_t now, void *arg)
+{
+    thread_t *current_thread = get_current_thread();
+
+    if (thread_is_real_time_or_idle(current_thread) && !thread_is_deadline(current_thread))
+        return INT_NO_RESCHEDULE;
+
+    current_thread->remaining_quantum = 0;
+    current_thread->quantum_left_ns = 0;
+    return INT_RESCHEDULE;
+}
+
+/* Program or stop the preemption timer for thread t, which is running or
+ * about to run on cpu.  Real time and idle threads are never preempted for
+ * quantum expiry, and a thread with nothing else queued behind it runs
+ * without any timer until something else becomes ready, or until its quota
+ * group runs out.  Otherwise the timer is armed one-shot for what is left of
+ * the thread's slice after the time it has already run, or its group's quota
+ * if that is less.  A deadline thread, real time or not, always gets the
+ * timer for the rest of its runtime.
+ */
+static void preempt_timer_update(uint cpu, thread_t *t)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(thread_lock_held());
+    DEBUG_ASSERT(cpu == arch_curr_cpu_num());
+
+    timer_t *timer = &preempt_timer[cpu];
+    if (timer_is_queued(timer))
+        timer_cancel(timer);
+
+    lk_time_t delay = INFINITE_TIME;
+    if (thread_is_deadline(t)) {
+        lk_bigtime_t left = deadline_budget_left(t, current_time_hires());
+        delay = MAX((lk_time_t)((left + 999999) / 1000000), 1u);
+    }
+
+    if (thread_is_real_time_or_idle(t)) {
+        if (delay != INFINITE_TIME)
+            timer_set_oneshot(timer, delay, thread_preempt_timer_tick, NULL);
+        return;
+    }
+
+    if (run_queue[cpu].bitmap != 0) {
+        quantum_refill(t);
+        lk_bigtime_t left = quantum_left(t, current_time_hires());
+        delay = MIN(delay, MAX((lk_time_t)((left + 999999) / 1000000), 1u));
+    }
+    if (t->quota) {
+        lk_bigtime_t left = quota_remaining(t, current_time_hires());
+        if (left != UINT64_MAX)
+            delay = MIN(delay, MAX((lk_time_t)((left + 999999) / 1000000), 1u));
+    }
+    if (delay == INFINITE_TIME)
+        return;
+
+    timer_set_oneshot(timer, delay, thread_preempt_timer_tick, NULL);
+}
+#endif
+
 enum handler_return thread_timer_tick(void)
 {
     thread_t *current_thread = get_current_thread();
 
+    if (thread_is_deadline(current_thread) &&
+        deadline_budget_left(current_thread, current_time_hires()) == 0)
+        return INT_RESCHEDULE;
+
     if (thread_is_real_time_or_idle(current_thread))
         return INT_NO_RESCHEDULE;
 
@@ -890,7 +2459,7 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
      * thread_sleep_etc, may be trying to simultaneously cancel this timer while holding the
      * thread_lock.
      */
-    while (unlikely(spin_trylock(&thread_lock))) {
+    while (unlikely(ticket_spin_trylock(&thread_lock))) {
         /* we failed to grab it, check for cancel */
         if (timer->cancel) {
             /* we were cancelled, so bail immediately */
@@ -899,15 +2468,15 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
     }
 
     if (t->state != THREAD_SLEEPING) {
-        spin_unlock(&thread_lock);
+        ticket_spin_unlock(&thread_lock);
         return INT_NO_RESCHEDULE;
     }
 
     t->state = THREAD_READY;
     t->blocked_status = NO_ERROR;
-    insert_in_run_queue_head(t);
+    mp_reschedule(insert_in_run_queue_wakeup(t), 0);
 
-    spin_unlock(&thread_lock);
+    ticket_spin_unlock(&thread_lock);
 
     return INT_RESCHEDULE;
 }
@@ -946,7 +2515,8 @@ status_t thread_sleep_etc(lk_time_t delay, bool interruptable)
         goto out;
     }
 
-    timer_set_oneshot(&timer, delay, thread_sleep_handler, (void *)current_thread);
+    timer_set_oneshot_slack(&timer, delay, thread_timer_slack(current_thread),
+                            thread_sleep_handler, (void *)current_thread);
     current_thread->state = THREAD_SLEEPING;
     current_thread->blocked_status = NO_ERROR;
 
@@ -981,6 +2551,7 @@ void thread_construct_first(thread_t *t, const char *name)
 
     init_thread_struct(t, name);
     t->priority = HIGHEST_PRIORITY;
+    t->base_priority = HIGHEST_PRIORITY;
     t->state = THREAD_RUNNING;
     t->flags = THREAD_FLAG_DETACHED;
     t->signals = 0;
@@ -989,10 +2560,18 @@ void thread_construct_first(thread_t *t, const char *name)
 
     THREAD_LOCK(state);
     list_add_head(&thread_list, &t->thread_list_node);
+    __atomic_store_n(&running_thread[cpu], t, __ATOMIC_RELAXED);
     set_current_thread(t);
     THREAD_UNLOCK(state);
 }
 
+bool thread_is_running_on(const thread_t *t, uint cpu)
+{
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+
+    return __atomic_load_n(&running_thread[cpu], __ATOMIC_RELAXED) == t;
+}
+
 /**
  * @brief  Initialize threading system
  *
@@ -1005,8 +2584,13 @@ void thread_init_early(void)
     DEBUG_ASSERT(arch_curr_cpu_num() == 0);
 
     /* initialize the run queues */
-    for (i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (i=0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queue[cpu].queue[i]);
+        list_initialize(&run_queue[cpu].fair_queue);
+        list_initialize(&run_queue[cpu].deadline_queue);
+        timer_initialize(&run_queue[cpu].deadline_timer);
+    }
 
     /* initialize the thread list */
     list_initialize(&thread_list);
@@ -1063,7 +2647,9 @@ void thread_set_priority(int priority)
         priority = IDLE_PRIORITY + 1;
     if (priority > HIGHEST_PRIORITY)
         priority = HIGHEST_PRIORITY;
+    current_thread->base_priority = priority;
     current_thread->priority = priority;
+    thread_update_priority_locked(current_thread);
 
     current_thread->state = THREAD_READY;
     insert_in_run_queue_head(current_thread);
@@ -1095,6 +2681,7 @@ void thread_become_idle(void)
 
     /* mark ourself as idle */
     t->priority = IDLE_PRIORITY;
+    t->base_priority = IDLE_PRIORITY;
     t->flags |= THREAD_FLAG_IDLE;
     thread_set_pinned_cpu(t, arch_curr_cpu_num());
 
@@ -1194,6 +2781,22 @@ static const char *thread_state_to_str(enum thread_state state)
     }
 }
 
+void thread_get_runtime(thread_t *t, thread_runtime_t *out)
+{
+    THREAD_LOCK(state);
+    lk_bigtime_t now = current_time_hires();
+    out->cpu_time = t->runtime_ns;
+    if (t->state == THREAD_RUNNING)
+        out->cpu_time += now - t->last_started_running_ns;
+    out->queue_time = t->queue_time_ns;
+    if (t->ready_since_ns)
+        out->queue_time += now - t->ready_since_ns;
+    out->voluntary_switches = t->voluntary_switches;
+    out->involuntary_switches = t->involuntary_switches;
+    out->migrations = t->migrations;
+    THREAD_UNLOCK(state);
+}
+
 /**
  * @brief  Dump debugging info about the specified thread.
  */
@@ -1214,14 +2817,25 @@ void dump_thread(thread_t *t, bool full_dump)
     if (full_dump) {
         dprintf(INFO, "dump_thread: t %p (%s:%s)\n", t, oname, t->name);
 #if WITH_SMP
-        dprintf(INFO, "\tstate %s, curr_cpu %d, pinned_cpu %d, priority %d, remaining quantum %d\n",
-                thread_state_to_str(t->state), t->curr_cpu, t->pinned_cpu, t->priority, t->remaining_quantum);
+        dprintf(INFO, "\tstate %s, curr_cpu %d, last_cpu %d, pinned_cpu %d, priority %d, remaining quantum %d\n",
+                thread_state_to_str(t->state), t->curr_cpu, t->last_cpu, t->pinned_cpu, t->priority,
+                t->remaining_quantum);
 #else
         dprintf(INFO, "\tstate %s, priority %d, remaining quantum %d\n",
                 thread_state_to_str(t->state), t->priority, t->remaining_quantum);
 #endif
         dprintf(INFO, "\truntime_ns %" PRIu64 ", runtime_s %" PRIu64 "\n",
                 runtime, runtime / 1000000000);
+        if (thread_is_fair(t)) {
+            dprintf(INFO, "\tfair weight %u, vruntime_ns %" PRIu64 "\n",
+                    t->fair_weight, t->vruntime_ns);
+        }
+        if (t->deadline.period_ns) {
+            dprintf(INFO, "\tdeadline cpu %d, runtime_ns %" PRIu64 ", deadline_ns %" PRIu64
+                    ", period_ns %" PRIu64 ", budget_ns %" PRIu64 "\n",
+                    t->deadline_cpu, t->deadline.runtime_ns, t->deadline.deadline_ns,
+                    t->deadline.period_ns, t->deadline_budget_ns);
+        }
         dprintf(INFO, "\tstack %p, stack_size %zu\n", t->stack, t->stack_size);
         dprintf(INFO, "\tentry %p, arg %p, flags 0x%x %s%s%s%s%s%s\n", t->entry, t->arg, t->flags,
                 (t->flags & THREAD_FLAG_DETACHED) ? "Dt" :"",
@@ -1300,7 +2914,7 @@ static enum handler_return wait_queue_timeout_handler(timer_t *timer, lk_time_t
      * wait_queue_block, may be trying to simultaneously cancel this timer while holding the
      * thread_lock.
      */
-    while (unlikely(spin_trylock(&thread_lock))) {
+    while (unlikely(ticket_spin_trylock(&thread_lock))) {
         /* we failed to grab it, check for cancel */
         if (timer->cancel) {
             /* we were cancelled, so bail immediately */
@@ -1313,7 +2927,7 @@ static enum handler_return wait_queue_timeout_handler(timer_t *timer, lk_time_t
         ret = INT_RESCHEDULE;
     }
 
-    spin_unlock(&thread_lock);
+    ticket_spin_unlock(&thread_lock);
 
     return ret;
 }
@@ -1345,7 +2959,7 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
     DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(current_thread->state == THREAD_RUNNING);
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
     if (timeout == 0)
         return ERR_TIMED_OUT;
@@ -1359,7 +2973,8 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
     /* if the timeout is nonzero or noninfinite, set a callback to yank us out of the queue */
     if (timeout != INFINITE_TIME) {
         timer_initialize(&timer);
-        timer_set_oneshot(&timer, timeout, wait_queue_timeout_handler, (void *)current_thread);
+        timer_set_oneshot_slack(&timer, timeout, thread_timer_slack(current_thread),
+                                wait_queue_timeout_handler, (void *)current_thread);
     }
 
     thread_resched();
@@ -1372,6 +2987,35 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
     return current_thread->blocked_status;
 }
 
+/* makes |t|, just taken off |wait|, runnable for wait_queue_wake_one() and
+ * wait_queue_wake_one_lifo() */
+static void wait_queue_wake_thread(wait_queue_t *wait, thread_t *t, bool reschedule,
+                                   status_t wait_queue_error)
+{
+    thread_t *current_thread = get_current_thread();
+
+    wait->count--;
+    DEBUG_ASSERT(t->state == THREAD_BLOCKED);
+    t->state = THREAD_READY;
+    t->blocked_status = wait_queue_error;
+    t->blocking_wait_queue = NULL;
+
+    /* if we're instructed to reschedule, stick the current thread on the head
+     * of the run queue first, so that the newly awakened thread gets a chance to run
+     * before the current one, but the current one doesn't get unnecessarilly punished.
+     */
+    if (reschedule) {
+        current_thread->state = THREAD_READY;
+        insert_in_run_queue_head(current_thread);
+        deadline_wakeup(t, current_time_hires());
+        insert_in_run_queue_head(t);
+        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+        thread_resched();
+    } else {
+        mp_reschedule(insert_in_run_queue_wakeup(t), 0);
+    }
+}
+
 /**
  * @brief  Wake up one thread sleeping on a wait queue
  *
@@ -1389,40 +3033,53 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
 int wait_queue_wake_one(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
 {
     thread_t *t;
-    int ret = 0;
-
-    thread_t *current_thread = get_current_thread();
 
     DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
     t = list_remove_head_type(&wait->list, thread_t, queue_node);
-    if (t) {
-        wait->count--;
-        DEBUG_ASSERT(t->state == THREAD_BLOCKED);
-        t->state = THREAD_READY;
-        t->blocked_status = wait_queue_error;
-        t->blocking_wait_queue = NULL;
+    if (!t)
+        return 0;
 
-        /* if we're instructed to reschedule, stick the current thread on the head
-         * of the run queue first, so that the newly awakened thread gets a chance to run
-         * before the current one, but the current one doesn't get unnecessarilly punished.
-         */
-        if (reschedule) {
-            current_thread->state = THREAD_READY;
-            insert_in_run_queue_head(current_thread);
-        }
-        insert_in_run_queue_head(t);
-        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
-        if (reschedule) {
-            thread_resched();
-        }
-        ret = 1;
+    wait_queue_wake_thread(wait, t, reschedule, wait_queue_error);
+    return 1;
+}
+
+/**
+ * @brief  Wake up the thread which has slept on a wait queue the least
+ *
+ * Like wait_queue_wake_one(), but takes the thread from the tail of the wait
+ * queue: the one which blocked most recently and whose cache is likely still
+ * warm.  Among the last WAIT_QUEUE_LIFO_SCAN waiters, one which last ran on
+ * this cpu is preferred.  The threads which have waited longer can stay idle
+ * while there is not enough work for them.
+ *
+ * @return  The number of threads woken (zero or one)
+ */
+int wait_queue_wake_one_lifo(wait_queue_t *wait, bool reschedule, status_t wait_queue_error)
+{
+    DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(thread_lock_held());
+
+    thread_t *t = list_peek_tail_type(&wait->list, thread_t, queue_node);
+    if (!t)
+        return 0;
 
+    int cpu = arch_curr_cpu_num();
+    thread_t *pick = t;
+    for (int i = 0; t && i < WAIT_QUEUE_LIFO_SCAN; i++) {
+        if (thread_last_cpu(t) == cpu) {
+            pick = t;
+            break;
+        }
+        t = list_prev_type(&wait->list, &t->queue_node, thread_t, queue_node);
     }
 
-    return ret;
+    list_delete(&pick->queue_node);
+    wait_queue_wake_thread(wait, pick, reschedule, wait_queue_error);
+    return 1;
 }
 
 
@@ -1449,7 +3106,7 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
 
     DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
     if (reschedule && wait->count > 0) {
         /* if we're instructed to reschedule, stick the current thread on the head
@@ -1461,6 +3118,7 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
     }
 
     /* pop all the threads off the wait queue into the run queue */
+    mp_cpu_mask_t kick = 0;
     while ((t = list_remove_head_type(&wait->list, thread_t, queue_node))) {
         wait->count--;
         DEBUG_ASSERT(t->state == THREAD_BLOCKED);
@@ -1468,14 +3126,20 @@ int wait_queue_wake_all(wait_queue_t *wait, bool reschedule, status_t wait_queue
         t->blocked_status = wait_queue_error;
         t->blocking_wait_queue = NULL;
 
-        insert_in_run_queue_head(t);
+        if (reschedule) {
+            deadline_wakeup(t, current_time_hires());
+            insert_in_run_queue_head(t);
+            kick = MP_CPU_ALL_BUT_LOCAL;
+        } else {
+            kick |= insert_in_run_queue_wakeup(t);
+        }
         ret++;
     }
 
     DEBUG_ASSERT(wait->count == 0);
 
     if (ret > 0) {
-        mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+        mp_reschedule(kick, 0);
         if (reschedule) {
             thread_resched();
         }
@@ -1497,7 +3161,7 @@ void wait_queue_destroy(wait_queue_t *wait)
 {
     DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
     if (!list_is_empty(&wait->list)) {
         panic("wait_queue_destroy() called on non-empty wait_queue_t\n");
@@ -1522,7 +3186,7 @@ status_t thread_unblock_from_wait_queue(thread_t *t, status_t wait_queue_error)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(thread_lock_held());
 
     if (t->state != THREAD_BLOCKED)
         return ERR_BAD_STATE;
@@ -1536,8 +3200,7 @@ status_t thread_unblock_from_wait_queue(thread_t *t, status_t wait_queue_error)
     t->blocking_wait_queue = NULL;
     t->state = THREAD_READY;
     t->blocked_status = wait_queue_error;
-    insert_in_run_queue_head(t);
-    mp_reschedule(MP_CPU_ALL_BUT_LOCAL, 0);
+    mp_reschedule(insert_in_run_queue_wakeup(t), 0);
 
     return NO_ERROR;
 }
@@ -1552,20 +3215,36 @@ static status_t thread_read_stack(thread_t* t, void* ptr, void* out, size_t sz)
     return NO_ERROR;
 }
 
-void thread_print_backtrace(thread_t* t, void* fp)
+size_t thread_get_backtrace(thread_t* t, void* fp, uintptr_t* pcs, size_t max)
 {
     void* pc;
+    size_t n = 0;
     if (t == NULL) {
-        return;
+        return 0;
     }
-    for (int n = 0; n < 10; n++) {
+    while (n < max) {
         if (thread_read_stack(t, fp + 8, &pc, sizeof(void*))) {
             break;
         }
-        printf("bt#%02d: %p\n", n, pc);
+        pcs[n++] = (uintptr_t)pc;
         if (thread_read_stack(t, fp, &fp, sizeof(void*))) {
             break;
         }
     }
+    return n;
+}
+
+void thread_print_backtrace(thread_t* t, void* fp)
+{
+    uintptr_t pcs[10];
+    size_t n = thread_get_backtrace(t, fp, pcs, countof(pcs));
+    for (size_t i = 0; i < n; i++) {
+        printf("bt#%02zu: %p\n", i, (void*)pcs[i]);
+    }
+}
+#else
+size_t thread_get_backtrace(thread_t* t, void* fp, uintptr_t* pcs, size_t max)
+{
+    return 0;
 }
 #endif
@@ -17,6 +17,14 @@
  *
  * Timer callback functions are called in interrupt context.
  *
+ * Pending timers are kept in a per cpu pairing heap ordered by scheduled
+ * time, so setting a timer is O(1), the next deadline is always at the root,
+ * and firing or cancelling a timer is O(log n) amortized.
+ *
+ * Timers with slack are queued at the end of their window. Whenever the
+ * queue is serviced every timer at the front whose window has opened is
+ * fired too, so a burst of approximate deadlines costs a single interrupt.
+ *
  * @{
  */
 #include <debug.h>
@@ -31,10 +39,11 @@
 
 #define LOCAL_TRACE 0
 
-spin_lock_t timer_lock;
+ticket_spin_lock_t timer_lock = TICKET_SPIN_LOCK_INITIAL_VALUE;
 
 struct timer_state {
-    struct list_node timer_queue;
+    /* root of the pairing heap, the earliest pending timer */
+    timer_t *timer_queue;
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -49,44 +58,130 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t *timer)
+/* combine two detached heaps, returning the new root */
+static timer_t *timer_heap_meld(timer_t *a, timer_t *b)
 {
-    timer_t *entry;
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (TIME_LT(b->scheduled_time, a->scheduled_time)) {
+        timer_t *temp = a;
+        a = b;
+        b = temp;
+    }
+
+    /* b becomes the first child of a */
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
 
+    return a;
+}
+
+/* standard two pass pairing of a list of sibling subheaps into one heap */
+static timer_t *timer_heap_merge_pairs(timer_t *first)
+{
+    /* first pass, meld pairs left to right, building a reversed list of the results */
+    timer_t *paired = NULL;
+    while (first) {
+        timer_t *a = first;
+        timer_t *b = a->heap_next;
+        first = b ? b->heap_next : NULL;
+
+        a->heap_next = a->heap_prev = NULL;
+        if (b)
+            b->heap_next = b->heap_prev = NULL;
+
+        timer_t *m = timer_heap_meld(a, b);
+        m->heap_next = paired;
+        paired = m;
+    }
+
+    /* second pass, meld the results right to left */
+    timer_t *root = NULL;
+    while (paired) {
+        timer_t *next = paired->heap_next;
+        paired->heap_next = NULL;
+        root = timer_heap_meld(root, paired);
+        paired = next;
+    }
+
+    return root;
+}
+
+static inline timer_t *timer_queue_peek(uint cpu)
+{
+    return timers[cpu].timer_queue;
+}
+
+static void insert_timer_in_queue(uint cpu, timer_t *timer)
+{
     DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(!timer_is_queued(timer));
 
     LTRACEF("timer %p, cpu %u, scheduled %u, periodic %u\n", timer, cpu, timer->scheduled_time, timer->periodic_time);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queue_cpu = cpu;
+    timers[cpu].timer_queue = timer_heap_meld(timers[cpu].timer_queue, timer);
+}
+
+/* take a timer out of whichever cpu's queue it is on */
+static void remove_timer_from_queue(timer_t *timer)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer_is_queued(timer));
+
+    struct timer_state *ts = &timers[timer->queue_cpu];
+
+    if (ts->timer_queue == timer) {
+        ts->timer_queue = timer_heap_merge_pairs(timer->heap_child);
+    } else {
+        /* unlink from the parent or previous sibling */
+        if (timer->heap_prev->heap_child == timer) {
+            timer->heap_prev->heap_child = timer->heap_next;
+        } else {
+            timer->heap_prev->heap_next = timer->heap_next;
         }
+        if (timer->heap_next)
+            timer->heap_next->heap_prev = timer->heap_prev;
+
+        /* put our children back into the heap */
+        timer_t *sub = timer_heap_merge_pairs(timer->heap_child);
+        ts->timer_queue = timer_heap_meld(ts->timer_queue, sub);
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queue_cpu = -1;
 }
 
-static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_callback callback, void *arg)
+static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t slack, lk_time_t period,
+                      timer_callback callback, void *arg)
 {
     lk_time_t now;
 
-    LTRACEF("timer %p, delay %u, period %u, callback %p, arg %p\n", timer, delay, period, callback, arg);
+    LTRACEF("timer %p, delay %u, slack %u, period %u, callback %p, arg %p\n", timer, delay, slack, period, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
+    if (timer_is_queued(timer)) {
         panic("timer %p already in list\n", timer);
     }
 
     /* Bump the delay, since we're probably straddling a millisecond */
     delay += 1;
 
+    /* queue it at the end of its window */
+    delay += slack;
+
     now = current_time();
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    ticket_spin_lock_irqsave(&timer_lock, state);
 
     uint cpu = arch_curr_cpu_num();
 
@@ -100,6 +195,7 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
 
     /* set up the structure */
     timer->scheduled_time = now + delay;
+    timer->slack = slack;
     timer->periodic_time = period;
     timer->callback = callback;
     timer->arg = arg;
@@ -111,7 +207,7 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
+    if (timer_queue_peek(cpu) == timer) {
         /* we just modified the head of the timer queue */
         LTRACEF("setting new timer for %u msecs\n", delay);
         platform_set_oneshot_timer(timer_tick, NULL, delay);
@@ -119,7 +215,7 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
 #endif
 
 out:
-    spin_unlock_irqrestore(&timer_lock, state);
+    ticket_spin_unlock_irqrestore(&timer_lock, state);
 }
 
 /**
@@ -140,7 +236,27 @@ void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback,
 {
     if (delay == 0)
         delay = 1;
-    timer_set(timer, delay, 0, callback, arg);
+    timer_set(timer, delay, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, within a window
+ *
+ * Like timer_set_oneshot(), but the callback may run up to slack ms after
+ * delay has passed. Timers whose windows overlap are fired together.
+ *
+ * @param  timer The timer to use
+ * @param  delay The minimum delay, in ms, before the timer is executed
+ * @param  slack How much later, in ms, the timer may be executed
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_slack(timer_t *timer, lk_time_t delay, lk_time_t slack,
+                             timer_callback callback, void *arg)
+{
+    if (delay == 0)
+        delay = 1;
+    timer_set(timer, delay, slack, 0, callback, arg);
 }
 
 /**
@@ -161,7 +277,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, period, period, callback, arg);
+    timer_set(timer, period, 0, period, callback, arg);
 }
 
 /**
@@ -172,7 +288,7 @@ void timer_cancel(timer_t *timer)
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    ticket_spin_lock_irqsave(&timer_lock, state);
 
     uint cpu = arch_curr_cpu_num();
 
@@ -188,23 +304,23 @@ void timer_cancel(timer_t *timer)
         timer->periodic_time = 0;
 
         /* we're done, so return back to the callback */
-        spin_unlock_irqrestore(&timer_lock, state);
+        ticket_spin_unlock_irqrestore(&timer_lock, state);
         return;
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
+    if (timer_is_queued(timer)) {
 #if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *oldhead = timer_queue_peek(cpu);
 #endif
 
         /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *newhead = timer_queue_peek(cpu);
         if (newhead == NULL) {
             LTRACEF("clearing old hw timer, nothing in the queue\n");
             platform_stop_timer();
@@ -223,7 +339,7 @@ void timer_cancel(timer_t *timer)
 #endif
     }
 
-    spin_unlock_irqrestore(&timer_lock, state);
+    ticket_spin_unlock_irqrestore(&timer_lock, state);
 
     /* wait for the timer to become un-busy in case a callback is currently active on another cpu */
     while (timer->active_cpu >= 0) {
@@ -236,6 +352,22 @@ void timer_cancel(timer_t *timer)
     timer->periodic_time = 0;
 }
 
+lk_time_t timer_next_delay(void)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    lk_time_t delay = INFINITE_TIME;
+    lk_time_t now = current_time();
+
+    ticket_spin_lock(&timer_lock);
+    timer_t *timer = timer_queue_peek(arch_curr_cpu_num());
+    if (timer)
+        delay = TIME_GT(timer->scheduled_time, now) ? timer->scheduled_time - now : 0;
+    ticket_spin_unlock(&timer_lock);
+
+    return delay;
+}
+
 /* called at interrupt time to process any pending timers */
 static enum handler_return timer_tick(void *arg, lk_time_t now)
 {
@@ -250,28 +382,29 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     LTRACEF("cpu %u now %u, sp %p\n", cpu, now, __GET_FRAME());
 
-    spin_lock(&timer_lock);
+    ticket_spin_lock(&timer_lock);
 
     for (;;) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer = timer_queue_peek(cpu);
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %u now %u (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
-        if (likely(TIME_LT(now, timer->scheduled_time)))
+        /* fire anything whose window has opened, not just what is due */
+        if (likely(TIME_LT(now, timer->scheduled_time - timer->slack)))
             break;
 
         /* process it */
         LTRACEF("timer %p\n", timer);
         DEBUG_ASSERT(timer && timer->magic == TIMER_MAGIC);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
         /* spinlock below acts as a memory barrier */
 
         /* we pulled it off the list, release the list lock to handle it */
-        spin_unlock(&timer_lock);
+        ticket_spin_unlock(&timer_lock);
 
         LTRACEF("dequeued timer %p, scheduled %u periodic %u\n", timer, timer->scheduled_time, timer->periodic_time);
 
@@ -283,7 +416,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
         DEBUG_ASSERT(arch_ints_disabled());
         /* it may have been requeued or periodic, grab the lock so we can safely inspect it */
-        spin_lock(&timer_lock);
+        ticket_spin_lock(&timer_lock);
 
         /* record whether or not we've been cancelled in the meantime */
         bool cancelled = timer->cancel;
@@ -297,7 +430,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
             /* if it is a periodic timer and it hasn't been requeued
              * by the callback put it back in the list
              */
-            if (timer->periodic_time > 0 && !list_in_list(&timer->node)) {
+            if (timer->periodic_time > 0 && !timer_is_queued(timer)) {
                 LTRACEF("periodic timer, period %u\n", timer->periodic_time);
                 timer->scheduled_time = now + timer->periodic_time;
                 insert_timer_in_queue(cpu, timer);
@@ -307,7 +440,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer = timer_queue_peek(cpu);
     if (timer) {
         /* has to be the case or it would have fired already */
         DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
@@ -319,10 +452,10 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
     }
 
     /* we're done manipulating the timer queue */
-    spin_unlock(&timer_lock);
+    ticket_spin_unlock(&timer_lock);
 #else
     /* release the timer lock before calling the tick handler */
-    spin_unlock(&timer_lock);
+    ticket_spin_unlock(&timer_lock);
 
     /* let the scheduler have a shot to do quantum expiration, etc */
     /* in case of dynamic timer, the scheduler will set up a periodic timer */
@@ -336,20 +469,20 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 void timer_transition_off_cpu(uint old_cpu)
 {
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    ticket_spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
+    timer_t *old_head = timer_queue_peek(cpu);
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    timer_t *entry;
+    while ((entry = timer_queue_peek(old_cpu)) != NULL) {
+        remove_timer_from_queue(entry);
         insert_timer_in_queue(cpu, entry);
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *new_head = timer_queue_peek(cpu);
     if (new_head != NULL && new_head != old_head) {
         lk_time_t now = current_time();
         lk_time_t delay = 0;
@@ -363,7 +496,7 @@ void timer_transition_off_cpu(uint old_cpu)
     }
 #endif
 
-    spin_unlock_irqrestore(&timer_lock, state);
+    ticket_spin_unlock_irqrestore(&timer_lock, state);
 }
 
 /* This function is to be invoked after resume on each CPU that may have
@@ -372,11 +505,11 @@ void timer_thaw_percpu(void)
 {
 #if PLATFORM_HAS_DYNAMIC_TIMER
     DEBUG_ASSERT(arch_ints_disabled());
-    spin_lock(&timer_lock);
+    ticket_spin_lock(&timer_lock);
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *t = timer_queue_peek(cpu);
     if (t) {
         lk_time_t now = current_time();
         lk_time_t delay = 0;
@@ -387,15 +520,15 @@ void timer_thaw_percpu(void)
         platform_set_oneshot_timer(timer_tick, NULL, delay);
     }
 
-    spin_unlock(&timer_lock);
+    ticket_spin_unlock(&timer_lock);
 #endif
 }
 
 void timer_init(void)
 {
-    timer_lock = SPIN_LOCK_INITIAL_VALUE;
+    ticket_spin_lock_init(&timer_lock);
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].timer_queue = NULL;
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
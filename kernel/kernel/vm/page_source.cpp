@@ -0,0 +1,123 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/page_source.h>
+
+#include "vm_priv.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+PageRequest::PageRequest() {
+    event_init(&event_, false, EVENT_FLAG_AUTOUNSIGNAL);
+}
+
+PageRequest::~PageRequest() {
+    // a request that was never waited on is still queued
+    if (source_) {
+        AutoLock a(source_->lock_);
+        if (InContainer())
+            source_->requests_.erase(*this);
+    }
+    event_destroy(&event_);
+}
+
+status_t PageRequest::Wait() {
+    DEBUG_ASSERT(source_);
+
+    status_t status = event_wait_timeout(&event_, INFINITE_TIME, true);
+
+    mxtl::RefPtr<PageSource> source = mxtl::move(source_);
+    AutoLock a(source->lock_);
+    if (InContainer()) {
+        // gave up before the page came in
+        source->requests_.erase(*this);
+        return status;
+    }
+    return status_;
+}
+
+PageSource::~PageSource() {
+    // each request holds a reference
+    DEBUG_ASSERT(requests_.is_empty());
+}
+
+status_t PageSource::GetPage(uint64_t offset, uint64_t len, PageRequest* request) {
+    DEBUG_ASSERT(!request->InContainer());
+    DEBUG_ASSERT(len >= PAGE_SIZE);
+    LTRACEF("source %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    AutoLock a(lock_);
+
+    if (closed_)
+        return ERR_BAD_STATE;
+
+    // only the first thread to want a page asks for it
+    bool pending = false;
+    for (const auto& r : requests_) {
+        if (r.offset_ == offset) {
+            pending = true;
+            break;
+        }
+    }
+    if (!pending) {
+        status_t status = SendRequest(offset, len);
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    request->offset_ = offset;
+    request->status_ = NO_ERROR;
+    request->source_ = mxtl::RefPtr<PageSource>(this);
+    requests_.push_back(request);
+    return ERR_SHOULD_WAIT;
+}
+
+status_t PageSource::Prefetch(uint64_t offset, uint64_t len) {
+    LTRACEF("source %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    AutoLock a(lock_);
+
+    if (closed_)
+        return ERR_BAD_STATE;
+
+    return SendRequest(offset, len);
+}
+
+void PageSource::CompleteLocked(PageRequest* request, status_t status) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    requests_.erase(*request);
+    request->status_ = status;
+    event_signal(&request->event_, false);
+}
+
+void PageSource::OnPagesSupplied(uint64_t offset, uint64_t len) {
+    LTRACEF("source %p offset %#" PRIx64 " len %#" PRIx64 "\n", this, offset, len);
+
+    AutoLock a(lock_);
+
+    for (auto iter = requests_.begin(); iter != requests_.end();) {
+        PageRequest* r = &*iter;
+        ++iter;
+        if (r->offset_ >= offset && r->offset_ - offset < len)
+            CompleteLocked(r, NO_ERROR);
+    }
+}
+
+void PageSource::Close() {
+    LTRACEF("source %p\n", this);
+
+    AutoLock a(lock_);
+
+    closed_ = true;
+    while (!requests_.is_empty())
+        CompleteLocked(&requests_.front(), ERR_BAD_STATE);
+}
@@ -7,14 +7,21 @@
 
 #include "vm_priv.h"
 #include <assert.h>
+#include <arch/ops.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/event.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
+#include <kernel/vm/vm_object.h>
 #include <lib/console.h>
+#include <lib/heap.h>
 #include <list.h>
+#include <lk/init.h>
 #include <new.h>
 #include <pow2.h>
 #include <stdlib.h>
@@ -31,24 +38,577 @@
 static mxtl::DoublyLinkedList<PmmArena*> arena_list;
 static Mutex arena_lock;
 
-paddr_t vm_page_to_paddr(const vm_page_t* page) {
-    for (const auto& a : arena_list) {
-        // LTRACEF("testing page %p against arena %p\n", page, &a);
-        if (a.page_belongs_to_arena(page)) {
-            return a.page_address_from_arena(page);
+// The numa node of each cpu, and the number of nodes the arenas have been
+// tagged with. Everything is on node 0 until the platform says otherwise.
+static uint cpu_numa_node[SMP_MAX_CPUS];
+static uint numa_node_count = 1;
+
+// Each cpu keeps a small magazine of free pages so that single page
+// allocations and frees usually don't touch arena_lock. The magazine is
+// refilled from or drained to the arenas PMM_CACHE_BATCH pages at a time.
+// Only pages from KMAP arenas on the cpu's own numa node are cached, so the
+// magazine can satisfy any allocation for that node. Cached pages are in the
+// ALLOC state as far as the arenas are concerned; they are counted as free by
+// pmm_count_free_pages().
+#define PMM_CACHE_SIZE 64
+#define PMM_CACHE_BATCH (PMM_CACHE_SIZE / 2)
+
+struct pmm_cpu_cache {
+    spin_lock_t lock;
+    size_t count;
+    vm_page_t* pages[PMM_CACHE_SIZE];
+} __CPU_ALIGN;
+
+static pmm_cpu_cache pmm_cache[SMP_MAX_CPUS];
+
+// A pool of pages per numa node zeroed ahead of time by a low priority
+// thread, handed out to PMM_ALLOC_FLAG_ZEROED allocations. The thread tops each
+// one up to PMM_ZERO_POOL_TARGET pages whenever it drops below half of that.
+// Pooled pages are in the ALLOC state and are counted as free, like the cpu
+// caches.
+#define PMM_ZERO_POOL_TARGET 512
+
+struct pmm_zero_pool {
+    list_node pages;
+    size_t count;
+};
+
+static spin_lock_t zero_pool_lock = SPIN_LOCK_INITIAL_VALUE;
+static pmm_zero_pool zero_pools[PMM_MAX_NUMA_NODES];
+static event_t zero_pool_event = EVENT_INITIAL_VALUE(zero_pool_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// Memory pressure. Free pages are checked against the watermarks whenever
+// arena_lock is dropped after allocating or freeing, counting only the pages
+// in the arenas, so the cpu caches and zeroed pool count as used. The
+// watermarks are zero, and pressure is never reported, until the reclaim
+// thread starts.
+#define PMM_LOW_WATERMARK_DIVISOR 32
+#define PMM_HIGH_WATERMARK_DIVISOR 16
+
+// how often the reclaim thread tries again while still under pressure
+#define PMM_RECLAIM_RETRY_MSECS 1000
+
+static size_t pmm_low_watermark;
+static size_t pmm_high_watermark;
+static bool pmm_pressure;
+static pmm_pressure_callback_t pmm_pressure_callback;
+static event_t pmm_pressure_event =
+    EVENT_INITIAL_VALUE(pmm_pressure_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+static PmmArena* arena_for_page(const vm_page_t* page) {
+    for (auto& a : arena_list) {
+        if (a.page_belongs_to_arena(page))
+            return &a;
+    }
+    return nullptr;
+}
+
+// the numa node an allocation with these flags should come from
+static uint pmm_alloc_node(uint alloc_flags) {
+    uint node = (alloc_flags & PMM_ALLOC_FLAG_NODE_MASK) >> PMM_ALLOC_FLAG_NODE_SHIFT;
+    return node ? node - 1 : cpu_numa_node[arch_curr_cpu_num()];
+}
+
+// Call func on each arena an allocation with these flags may use, those on the
+// preferred node first, until it returns true. arena_lock must be held.
+template <typename Func>
+static bool pmm_for_each_alloc_arena(uint alloc_flags, uint node, Func func) {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    bool remote = false;
+    for (;;) {
+        for (auto& a : arena_list) {
+            /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+            if ((alloc_flags & PMM_ALLOC_FLAG_KMAP) && (a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                continue;
+            if ((a.numa_node() == node) == remote)
+                continue;
+            if (func(a))
+                return true;
         }
+
+        if (remote || (alloc_flags & PMM_ALLOC_FLAG_BIND) || numa_node_count == 1)
+            return false;
+        remote = true;
     }
-    return -1;
 }
 
-vm_page_t* paddr_to_vm_page(paddr_t addr) {
+static size_t pmm_arena_free_count_locked() {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    size_t free = 0;
+    for (const auto& a : arena_list)
+        free += a.free_count();
+    return free;
+}
+
+// compare the free pages to the watermarks and wake the reclaim thread if
+// we've crossed one, arena_lock must be held
+static void pmm_check_pressure_locked() {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    if (pmm_low_watermark == 0)
+        return;
+
+    size_t free = pmm_arena_free_count_locked();
+    if (!pmm_pressure && free < pmm_low_watermark) {
+        pmm_pressure = true;
+        event_signal(&pmm_pressure_event, false);
+    } else if (pmm_pressure && free > pmm_high_watermark) {
+        pmm_pressure = false;
+        event_signal(&pmm_pressure_event, false);
+    }
+}
+
+// return the pages on the list to their arenas, arena_lock must be held
+static size_t pmm_free_locked(struct list_node* list) {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    size_t count = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(list, vm_page_t, free.node)) != nullptr) {
+        /* see which arena this page belongs to and add it */
+        for (auto& a : arena_list) {
+            if (a.FreePage(page) >= 0) {
+                count++;
+                break;
+            }
+        }
+    }
+
+    pmm_check_pressure_locked();
+    return count;
+}
+
+// Move every cpu's cached pages back to the arenas so that allocations
+// that need particular pages, or the last few free pages, can see them.
+static void pmm_drain_caches_locked() {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        pmm_cpu_cache* cache = &pmm_cache[i];
+
+        AutoSpinLockIrqSave guard(cache->lock);
+        while (cache->count > 0)
+            list_add_tail(&list, &cache->pages[--cache->count]->free.node);
+    }
+
+    // the zeroed pools aren't refilled until zeroed allocations drain them again
+    {
+        AutoSpinLockIrqSave guard(zero_pool_lock);
+        for (auto& pool : zero_pools) {
+            vm_page_t* page;
+            while ((page = list_remove_head_type(&pool.pages, vm_page_t, free.node)) != nullptr)
+                list_add_tail(&list, &page->free.node);
+            pool.count = 0;
+        }
+    }
+
+    pmm_free_locked(&list);
+}
+
+// grab a page on the given node out of the current cpu's cache, refilling it
+// if empty, or return null if this cpu isn't on that node
+static vm_page_t* pmm_cache_alloc_page(uint node) {
+    for (;;) {
+        {
+            AutoSpinLockIrqSave guard(pmm_cache[arch_curr_cpu_num()].lock);
+            // interrupts are off now, so we can't migrate away from this cache
+            uint cpu = arch_curr_cpu_num();
+            if (cpu_numa_node[cpu] != node)
+                return nullptr;
+            pmm_cpu_cache* cache = &pmm_cache[cpu];
+            if (cache->count > 0)
+                return cache->pages[--cache->count];
+        }
+
+        // refill a batch from the node's KMAP arenas outside of the cache lock
+        list_node list = LIST_INITIAL_VALUE(list);
+        {
+            AutoLock al(arena_lock);
+            size_t allocated = 0;
+            pmm_for_each_alloc_arena(PMM_ALLOC_FLAG_KMAP | PMM_ALLOC_FLAG_BIND, node,
+                                     [&allocated, &list](PmmArena& a) {
+                allocated += a.AllocPages(PMM_CACHE_BATCH - allocated, &list);
+                return allocated == PMM_CACHE_BATCH;
+            });
+            pmm_check_pressure_locked();
+        }
+        if (list_is_empty(&list))
+            return nullptr;
+
+        // we may be on a different cpu than when we started, which is fine as
+        // long as it's on the same node
+        list_node extra = LIST_INITIAL_VALUE(extra);
+        vm_page_t* page;
+        {
+            AutoSpinLockIrqSave guard(pmm_cache[arch_curr_cpu_num()].lock);
+            uint cpu = arch_curr_cpu_num();
+            pmm_cpu_cache* cache = &pmm_cache[cpu];
+            size_t limit = (cpu_numa_node[cpu] == node) ? PMM_CACHE_SIZE : 0;
+            page = list_remove_head_type(&list, vm_page_t, free.node);
+            vm_page_t* p;
+            while ((p = list_remove_head_type(&list, vm_page_t, free.node)) != nullptr) {
+                if (cache->count < limit)
+                    cache->pages[cache->count++] = p;
+                else
+                    list_add_tail(&extra, &p->free.node);
+            }
+        }
+        if (!list_is_empty(&extra)) {
+            AutoLock al(arena_lock);
+            pmm_free_locked(&extra);
+        }
+        return page;
+    }
+}
+
+// stash a page in the current cpu's cache, draining half of it if full
+static bool pmm_cache_free_page(vm_page_t* page) {
+    PmmArena* arena = arena_for_page(page);
+    if (!arena)
+        return false;
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    {
+        AutoSpinLockIrqSave guard(pmm_cache[arch_curr_cpu_num()].lock);
+        uint cpu = arch_curr_cpu_num();
+        pmm_cpu_cache* cache = &pmm_cache[cpu];
+
+        if ((arena->flags() & PMM_ARENA_FLAG_KMAP) == 0 || arena->numa_node() != cpu_numa_node[cpu])
+            list_add_tail(&list, &page->free.node);
+        else if (cache->count < PMM_CACHE_SIZE) {
+            cache->pages[cache->count++] = page;
+            return true;
+        } else {
+            // full, push the older half back to the arenas along with this page
+            for (size_t i = 0; i < PMM_CACHE_BATCH; i++)
+                list_add_tail(&list, &cache->pages[i]->free.node);
+            memmove(&cache->pages[0], &cache->pages[PMM_CACHE_BATCH],
+                    (cache->count - PMM_CACHE_BATCH) * sizeof(cache->pages[0]));
+            cache->count -= PMM_CACHE_BATCH;
+            cache->pages[cache->count++] = page;
+        }
+    }
+
+    AutoLock al(arena_lock);
+    pmm_free_locked(&list);
+    return true;
+}
+
+static size_t pmm_cached_count() {
+    size_t count = 0;
+    for (const auto& pool : zero_pools)
+        count += pool.count;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++)
+        count += pmm_cache[i].count;
+    return count;
+}
+
+static void pmm_zero_page(vm_page_t* page) {
+    void* ptr = paddr_to_kvaddr(vm_page_to_paddr(page));
+    DEBUG_ASSERT(ptr);
+
+    arch_zero_page(ptr);
+}
+
+// move up to count pages out of a node's zeroed pool onto the tail of list
+static size_t pmm_zero_pool_take(uint node, size_t count, list_node* list) {
+    size_t taken = 0;
+    bool refill;
+    {
+        AutoSpinLockIrqSave guard(zero_pool_lock);
+        pmm_zero_pool* pool = &zero_pools[node];
+        vm_page_t* page;
+        while (taken < count && (page = list_remove_head_type(&pool->pages, vm_page_t, free.node))) {
+            list_add_tail(list, &page->free.node);
+            taken++;
+        }
+        pool->count -= taken;
+        refill = taken > 0 && pool->count < PMM_ZERO_POOL_TARGET / 2;
+    }
+
+    if (refill)
+        event_signal(&zero_pool_event, false);
+    return taken;
+}
+
+static int pmm_zero_thread(void*) {
+    for (;;) {
+        event_wait(&zero_pool_event);
+
+        for (uint node = 0; node < numa_node_count; node++) {
+            pmm_zero_pool* pool = &zero_pools[node];
+            while (pool->count < PMM_ZERO_POOL_TARGET) {
+                vm_page_t* page = pmm_alloc_page(
+                    PMM_ALLOC_FLAG_KMAP | PMM_ALLOC_FLAG_NODE(node) | PMM_ALLOC_FLAG_BIND, nullptr);
+                if (!page)
+                    break;
+
+                pmm_zero_page(page);
+
+                AutoSpinLockIrqSave guard(zero_pool_lock);
+                list_add_tail(&pool->pages, &page->free.node);
+                pool->count++;
+            }
+        }
+    }
+    return 0;
+}
+
+static void pmm_zero_init(uint level) {
+    thread_t* t = thread_create("pmm zero", &pmm_zero_thread, nullptr, LOWEST_PRIORITY + 1,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        panic("failed to create pmm zero thread\n");
+    thread_detach_and_resume(t);
+
+    // fill the pool up for the first time
+    event_signal(&zero_pool_event, false);
+}
+
+LK_INIT_HOOK(pmm_zero, &pmm_zero_init, LK_INIT_LEVEL_THREADING);
+
+static void pmm_init_early(uint level) {
+    for (auto& pool : zero_pools)
+        list_initialize(&pool.pages);
+}
+
+LK_INIT_HOOK(pmm_early, &pmm_init_early, LK_INIT_LEVEL_EARLIEST);
+
+static int pmm_reclaim_thread(void*) {
+    bool reported = false;
+    pmm_pressure_callback_t reported_to = nullptr;
+    for (;;) {
+        // keep trying every so often while under pressure, more objects may
+        // have been unlocked since the last pass
+        event_wait_timeout(&pmm_pressure_event,
+                           reported ? PMM_RECLAIM_RETRY_MSECS : INFINITE_TIME, false);
+
+        size_t free;
+        bool pressure;
+        {
+            AutoLock al(arena_lock);
+            free = pmm_arena_free_count_locked();
+            pressure = pmm_pressure;
+        }
+
+        if (pressure && free < pmm_high_watermark) {
+            size_t target = pmm_high_watermark - free;
+            size_t purged = VmObjectPaged::PurgeUnlockedObjects(target);
+            LTRACEF("purged %zu pages\n", purged);
+
+            // then whatever idle memory compresses
+            if (purged < target) {
+                __UNUSED size_t compressed = VmObjectPaged::CompressIdlePages(target - purged);
+                LTRACEF("compressed %zu pages\n", compressed);
+            }
+
+            // and any free pages the kernel heap is sitting on
+            heap_trim();
+        }
+
+        // freeing the pages may have taken us back out of pressure
+        pmm_pressure_callback_t callback;
+        {
+            AutoLock al(arena_lock);
+            pressure = pmm_pressure;
+            callback = pmm_pressure_callback;
+        }
+
+        if (pressure != reported || callback != reported_to) {
+            reported = pressure;
+            reported_to = callback;
+            if (callback)
+                callback(pressure);
+        }
+    }
+    return 0;
+}
+
+static void pmm_reclaim_init(uint level) {
+    size_t total = 0;
+    {
+        AutoLock al(arena_lock);
+        for (const auto& a : arena_list)
+            total += a.size() / PAGE_SIZE;
+
+        pmm_low_watermark = total / PMM_LOW_WATERMARK_DIVISOR;
+        pmm_high_watermark = total / PMM_HIGH_WATERMARK_DIVISOR;
+    }
+    LTRACEF("watermarks low %zu high %zu pages\n", pmm_low_watermark, pmm_high_watermark);
+
+    thread_t* t = thread_create("pmm reclaim", &pmm_reclaim_thread, nullptr, HIGH_PRIORITY,
+                                DEFAULT_STACK_SIZE);
+    if (!t)
+        panic("failed to create pmm reclaim thread\n");
+    thread_detach_and_resume(t);
+}
+
+LK_INIT_HOOK(pmm_reclaim, &pmm_reclaim_init, LK_INIT_LEVEL_THREADING);
+
+void pmm_set_pressure_callback(pmm_pressure_callback_t callback) {
+    AutoLock al(arena_lock);
+    pmm_pressure_callback = callback;
+
+    // have the reclaim thread report the current state to the new callback
+    event_signal(&pmm_pressure_event, false);
+}
+
+bool pmm_under_pressure() {
+    AutoLock al(arena_lock);
+    return pmm_pressure;
+}
+
+// Physical address space is split into sections of 1 << PMM_SECTION_SHIFT
+// bytes, each recording the arena that covers it so paddr_to_vm_page() doesn't
+// need to walk the arena list. A section that straddles two arenas is marked
+// shared and falls back to checking each arena. The table is grown out of the
+// boot allocator as arenas are added.
+#define PMM_SECTION_SHIFT 25 // 32MB
+
+static PmmArena** arena_sections;
+static size_t arena_section_count;
+static PmmArena* const kSharedSection = reinterpret_cast<PmmArena*>(1);
+
+static void pmm_add_arena_sections(PmmArena* arena) {
+    size_t first = arena->base() >> PMM_SECTION_SHIFT;
+    size_t last = (arena->base() + arena->size() - 1) >> PMM_SECTION_SHIFT;
+
+    if (last >= arena_section_count) {
+        // grow the table, the old one is leaked back to the boot allocator
+        size_t count = last + 1;
+        PmmArena** sections = static_cast<PmmArena**>(boot_alloc_mem(count * sizeof(PmmArena*)));
+        memset(sections, 0, count * sizeof(PmmArena*));
+        if (arena_sections)
+            memcpy(sections, arena_sections, arena_section_count * sizeof(PmmArena*));
+        arena_sections = sections;
+        arena_section_count = count;
+    }
+
+    for (size_t i = first; i <= last; i++)
+        arena_sections[i] = arena_sections[i] ? kSharedSection : arena;
+}
+
+// Point the sections covered by an arena that has just been split at whichever
+// half covers them. The section holding the split point is shared, unless the
+// tail starts exactly on it.
+static void pmm_split_arena_sections(PmmArena* head, PmmArena* tail) {
+    size_t split = tail->base() >> PMM_SECTION_SHIFT;
+    size_t last = (tail->base() + tail->size() - 1) >> PMM_SECTION_SHIFT;
+
+    for (size_t i = split; i <= last; i++) {
+        if (arena_sections[i] != head)
+            continue;
+        if (i == split && (tail->base() & ((1UL << PMM_SECTION_SHIFT) - 1)))
+            arena_sections[i] = kSharedSection;
+        else
+            arena_sections[i] = tail;
+    }
+}
+
+// split the arena containing pa, if any, so that an arena starts at pa
+static status_t pmm_split_arena_at_locked(paddr_t pa) {
+    DEBUG_ASSERT(arena_lock.IsHeld());
+
+    for (auto& a : arena_list) {
+        if (!a.address_in_arena(pa) || a.base() == pa)
+            continue;
+
+        AllocChecker ac;
+        PmmArena* tail = new (&ac) PmmArena(a.info());
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+
+        a.SplitInto(pa, tail);
+        arena_list.insert_after(arena_list.make_iterator(a), tail);
+        pmm_split_arena_sections(&a, tail);
+        return NO_ERROR;
+    }
+    return NO_ERROR;
+}
+
+status_t pmm_set_numa_node(paddr_t base, size_t size, uint node) {
+    LTRACEF("base %#" PRIxPTR " size %#zx node %u\n", base, size, node);
+
+    if (node >= PMM_MAX_NUMA_NODES || size == 0)
+        return ERR_INVALID_ARGS;
+    if (!IS_PAGE_ALIGNED(base) || !IS_PAGE_ALIGNED(size) || base + size - 1 < base)
+        return ERR_INVALID_ARGS;
+
+    AutoLock al(arena_lock);
+
+    // split the arenas straddling either end of the range, so that every arena
+    // is either entirely inside or entirely outside of it
+    status_t status = pmm_split_arena_at_locked(base);
+    if (status == NO_ERROR && base + size != 0)
+        status = pmm_split_arena_at_locked(base + size);
+    if (status != NO_ERROR)
+        return status;
+
+    bool found = false;
     for (auto& a : arena_list) {
-        if (a.address_in_arena(addr)) {
-            size_t index = (addr - a.base()) / PAGE_SIZE;
-            return a.get_page(index);
+        if (a.base() >= base && a.base() + a.size() - 1 <= base + size - 1) {
+            a.set_numa_node(node);
+            found = true;
         }
     }
-    return NULL;
+    if (!found)
+        return ERR_NOT_FOUND;
+
+    numa_node_count = MAX(numa_node_count, node + 1);
+    return NO_ERROR;
+}
+
+void pmm_set_cpu_numa_node(uint cpu_num, uint node) {
+    DEBUG_ASSERT(cpu_num < SMP_MAX_CPUS);
+    DEBUG_ASSERT(node < PMM_MAX_NUMA_NODES);
+
+    AutoLock al(arena_lock);
+
+    // the cpu's cache holds pages from its old node, send them back
+    list_node list = LIST_INITIAL_VALUE(list);
+    {
+        pmm_cpu_cache* cache = &pmm_cache[cpu_num];
+
+        AutoSpinLockIrqSave guard(cache->lock);
+        while (cache->count > 0)
+            list_add_tail(&list, &cache->pages[--cache->count]->free.node);
+        cpu_numa_node[cpu_num] = node;
+    }
+    pmm_free_locked(&list);
+}
+
+uint pmm_numa_node_count() {
+    return numa_node_count;
+}
+
+paddr_t vm_page_to_paddr(const vm_page_t* page) {
+    return page->paddr;
+}
+
+vm_page_t* paddr_to_vm_page(paddr_t addr) {
+    size_t section = addr >> PMM_SECTION_SHIFT;
+    if (section >= arena_section_count)
+        return NULL;
+
+    PmmArena* arena = arena_sections[section];
+    if (arena == kSharedSection) {
+        arena = nullptr;
+        for (auto& a : arena_list) {
+            if (a.address_in_arena(addr)) {
+                arena = &a;
+                break;
+            }
+        }
+    }
+
+    if (!arena || !arena->address_in_arena(addr))
+        return NULL;
+
+    size_t index = (addr - arena->base()) / PAGE_SIZE;
+    return arena->get_page(index);
 }
 
 status_t pmm_add_arena(const pmm_arena_info_t* info) {
@@ -76,28 +636,56 @@ done_add:
     // tell the arena to allocate a page array
     arena->BootAllocArray();
 
+    pmm_add_arena_sections(arena);
+
     return NO_ERROR;
 }
 
 vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(arena_lock);
-
-    /* walk the arenas in order until we find one with a free page */
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+    vm_page_t* page;
+    uint node = pmm_alloc_node(alloc_flags);
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        if (pmm_zero_pool_take(node, 1, &list) > 0) {
+            page = list_remove_head_type(&list, vm_page_t, free.node);
+        } else {
+            // pool is dry, zero one here
+            page = pmm_alloc_page(alloc_flags & ~PMM_ALLOC_FLAG_ZEROED, nullptr);
+            if (!page)
+                return nullptr;
+            pmm_zero_page(page);
         }
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
+    }
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
-            return page;
+    // fast path, out of this cpu's cache
+    page = pmm_cache_alloc_page(node);
+    if (page) {
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
     }
 
-    LTRACEF("failed to allocate page\n");
-    return nullptr;
+    AutoLock al(arena_lock);
+
+    /* the kmap arenas are dry, see if any cpu is sitting on free pages */
+    pmm_drain_caches_locked();
+
+    /* walk the arenas in order until we find one with a free page */
+    page = nullptr;
+    pmm_for_each_alloc_arena(alloc_flags, node, [&page, pa](PmmArena& a) {
+        // try to allocate the page out of the arena
+        page = a.AllocPage(pa);
+        return page != nullptr;
+    });
+
+    if (!page)
+        LTRACEF("failed to allocate page\n");
+    pmm_check_pressure_locked();
+    return page;
 }
 
 size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
@@ -109,26 +697,46 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
+    uint node = pmm_alloc_node(alloc_flags);
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        /* take what we can from the zeroed pool and zero the rest here */
+        size_t allocated = pmm_zero_pool_take(node, count, list);
+        if (allocated < count) {
+            list_node extra = LIST_INITIAL_VALUE(extra);
+            allocated += pmm_alloc_pages(count - allocated, alloc_flags & ~PMM_ALLOC_FLAG_ZEROED,
+                                         &extra);
+            vm_page_t* page;
+            while ((page = list_remove_head_type(&extra, vm_page_t, free.node)) != nullptr) {
+                pmm_zero_page(page);
+                list_add_tail(list, &page->free.node);
+            }
+        }
+        return allocated;
+    }
+
     AutoLock al(arena_lock);
 
     /* walk the arenas in order, allocating as many pages as we can from each */
     size_t allocated = 0;
-    for (auto& a : arena_list) {
+    bool drained = false;
+retry:
+    pmm_for_each_alloc_arena(alloc_flags, node, [count, list, &allocated](PmmArena& a) {
         DEBUG_ASSERT(count > allocated);
 
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
-
         // ask the arena to allocate some pages
         allocated += a.AllocPages(count - allocated, list);
         DEBUG_ASSERT(allocated <= count);
-        if (allocated == count)
-            break;
+        return allocated == count;
+    });
+
+    /* came up short, pull the per-cpu caches back in and try again */
+    if (allocated < count && !drained) {
+        pmm_drain_caches_locked();
+        drained = true;
+        goto retry;
     }
 
+    pmm_check_pressure_locked();
     return allocated;
 }
 
@@ -143,6 +751,9 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
 
     AutoLock al(arena_lock);
 
+    /* the pages we want may be sitting in a cpu's cache */
+    pmm_drain_caches_locked();
+
     /* walk through the arenas, looking to see if the physical page belongs to it */
     for (auto& a : arena_list) {
         while (allocated < count && a.address_in_arena(address)) {
@@ -161,6 +772,7 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
             break;
     }
 
+    pmm_check_pressure_locked();
     return allocated;
 }
 
@@ -170,23 +782,44 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
 
     if (count == 0)
         return 0;
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        /* the pool can't help with a run, just zero it after allocating */
+        paddr_t run_pa;
+        size_t allocated = pmm_alloc_contiguous(count, alloc_flags & ~PMM_ALLOC_FLAG_ZEROED,
+                                                alignment_log2, &run_pa, list);
+        for (size_t i = 0; i < allocated; i++)
+            pmm_zero_page(paddr_to_vm_page(run_pa + i * PAGE_SIZE));
+        if (allocated > 0 && pa)
+            *pa = run_pa;
+        return allocated;
+    }
     if (alignment_log2 < PAGE_SIZE_SHIFT)
         alignment_log2 = PAGE_SIZE_SHIFT;
 
     AutoLock al(arena_lock);
 
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
+    bool drained = false;
+    size_t allocated = 0;
 
-        size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
-        if (allocated > 0) {
-            DEBUG_ASSERT(allocated == count);
-            return allocated;
+    pmm_for_each_alloc_arena(alloc_flags, pmm_alloc_node(alloc_flags), [&](PmmArena& a) {
+        allocated = a.AllocContiguous(count, alignment_log2, pa, list);
+        if (allocated > 0)
+            return true;
+
+        /* cached pages may be breaking up the run we need, return them and retry once */
+        if (!drained) {
+            pmm_drain_caches_locked();
+            drained = true;
+            allocated = a.AllocContiguous(count, alignment_log2, pa, list);
         }
+        return allocated > 0;
+    });
+
+    if (allocated > 0) {
+        DEBUG_ASSERT(allocated == count);
+        pmm_check_pressure_locked();
+        return allocated;
     }
 
     LTRACEF("couldn't find run\n");
@@ -267,29 +900,29 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
-    AutoLock al(arena_lock);
-
-    uint count = 0;
-    while (!list_is_empty(list)) {
-        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
-
+#if LK_DEBUGLEVEL > 1
+    vm_page_t* page;
+    list_for_every_entry (list, page, vm_page_t, free.node) {
         DEBUG_ASSERT(!page_is_free(page));
-
-        /* see which arena this page belongs to and add it */
-        for (auto& a : arena_list) {
-            if (a.FreePage(page) >= 0) {
-                count++;
-                break;
-            }
-        }
     }
+#endif
+
+    AutoLock al(arena_lock);
 
-    LTRACEF("returning count %u\n", count);
+    size_t count = pmm_free_locked(list);
+
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
 
 size_t pmm_free_page(vm_page_t* page) {
+    DEBUG_ASSERT(!page_is_free(page));
+
+    // fast path, into this cpu's cache
+    if (pmm_cache_free_page(page))
+        return 1;
+
     struct list_node list;
     list_initialize(&list);
 
@@ -303,6 +936,7 @@ void pmm_dump_free() {
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
+    free += pmm_cached_count();
     auto megabytes_free = free / 256u;
     printf(" %zu free MBs\n", megabytes_free);
 }
@@ -313,6 +947,7 @@ size_t pmm_count_free_pages() {
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
+    free += pmm_cached_count();
     return free;
 }
 
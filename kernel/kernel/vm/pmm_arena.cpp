@@ -15,7 +15,7 @@
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 PmmArena::PmmArena(const pmm_arena_info_t* info)
-    : info_(info) {}
+    : info_(*info) {}
 
 PmmArena::~PmmArena() {}
 
@@ -25,7 +25,7 @@ void PmmArena::BootAllocArray() {
     size_t size = page_count * VM_PAGE_STRUCT_SIZE;
     void* raw_page_array = boot_alloc_mem(size);
 
-    LTRACEF("arena for base 0%#" PRIxPTR " size %#zx page array at %p size %zu\n", info_->base, info_->size,
+    LTRACEF("arena for base 0%#" PRIxPTR " size %#zx page array at %p size %zu\n", info_.base, info_.size,
             raw_page_array, size);
 
     memset(raw_page_array, 0, size);
@@ -36,12 +36,42 @@ void PmmArena::BootAllocArray() {
     for (size_t i = 0; i < page_count; i++) {
         auto& p = page_array_[i];
 
+        p.paddr = base() + i * PAGE_SIZE;
         list_add_tail(&free_list_, &p.free.node);
     }
 
     free_count_ += page_count;
 }
 
+void PmmArena::SplitInto(paddr_t pa, PmmArena* tail) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(pa));
+    DEBUG_ASSERT(pa > base() && address_in_arena(pa));
+    DEBUG_ASSERT(tail->page_array_ == nullptr && tail->free_count_ == 0);
+
+    size_t index = (pa - base()) / PAGE_SIZE;
+
+    tail->info_ = info_;
+    tail->info_.base = pa;
+    tail->info_.size = size() - index * PAGE_SIZE;
+    tail->numa_node_ = numa_node_;
+    tail->page_array_ = page_array_ + index;
+
+    info_.size = index * PAGE_SIZE;
+
+    // hand over the free pages that now belong to the tail, keeping their order
+    vm_page_t* page;
+    vm_page_t* temp;
+    list_for_every_entry_safe (&free_list_, page, temp, vm_page_t, free.node) {
+        if (page->paddr < pa)
+            continue;
+
+        list_delete(&page->free.node);
+        list_add_tail(&tail->free_list_, &page->free.node);
+        free_count_--;
+        tail->free_count_++;
+    }
+}
+
 vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
     vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
     if (!page)
@@ -183,6 +213,7 @@ status_t PmmArena::FreePage(vm_page_t* page) {
         return ERR_NOT_FOUND;
 
     page->state = VM_PAGE_STATE_FREE;
+    page->flags = 0;
 
     list_add_head(&free_list_, &page->free.node);
     free_count_++;
@@ -190,8 +221,8 @@ status_t PmmArena::FreePage(vm_page_t* page) {
 }
 
 void PmmArena::Dump(bool dump_pages) {
-    printf("arena %p: name '%s' base %#" PRIxPTR " size 0x%zx priority %u flags 0x%x\n", this, name(), base(),
-           size(), priority(), flags());
+    printf("arena %p: name '%s' base %#" PRIxPTR " size 0x%zx priority %u flags 0x%x node %u\n", this,
+           name(), base(), size(), priority(), flags(), numa_node_);
     printf("\tpage_array %p, free_count %zu\n", page_array_, free_count_);
 
     /* dump all of the pages */
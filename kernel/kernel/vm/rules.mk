@@ -10,18 +10,23 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_DEPS += \
+    lib/counters \
+    lib/lz4 \
     lib/mxtl \
     lib/user_copy
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/bootalloc.cpp \
     $(LOCAL_DIR)/page.cpp \
+    $(LOCAL_DIR)/page_source.cpp \
     $(LOCAL_DIR)/pmm.cpp \
     $(LOCAL_DIR)/pmm_arena.cpp \
     $(LOCAL_DIR)/vm.cpp \
     $(LOCAL_DIR)/vm_address_region.cpp \
     $(LOCAL_DIR)/vm_address_region_or_mapping.cpp \
     $(LOCAL_DIR)/vm_aspace.cpp \
+    $(LOCAL_DIR)/vm_commit_account.cpp \
+    $(LOCAL_DIR)/vm_compressed_page.cpp \
     $(LOCAL_DIR)/vm_mapping.cpp \
     $(LOCAL_DIR)/vm_object.cpp \
     $(LOCAL_DIR)/vm_object_paged.cpp \
@@ -10,13 +10,14 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 #include <mxtl/auto_call.h>
-#include <mxtl/auto_lock.h>
 #include <new.h>
 #include <safeint/safe_math.h>
+#include <string.h>
 #include <trace.h>
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
@@ -75,7 +76,7 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
                                                 mxtl::RefPtr<VmAddressRegionOrMapping>* out) {
     DEBUG_ASSERT(out);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -185,10 +186,20 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
     LTRACEF("%p %#zx %#zx %x\n", this, mapping_offset, size, vmar_flags);
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_CAN_RWX_FLAGS | VMAR_FLAG_MAP_HIGH)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_CAN_RWX_FLAGS | VMAR_FLAG_MAP_HIGH |
+                       VMAR_FLAG_FAULT_AROUND | VMAR_FLAG_LARGE_PAGES)) {
         return ERR_INVALID_ARGS;
     }
 
+    // line the mapping up with the largest page size it can use
+    if ((vmar_flags & VMAR_FLAG_LARGE_PAGES) && !(vmar_flags & VMAR_FLAG_SPECIFIC)) {
+        if (size >= (1UL << VM_HUGE_PAGE_SHIFT)) {
+            align_pow2 = MAX(align_pow2, VM_HUGE_PAGE_SHIFT);
+        } else if (size >= (1UL << VM_LARGE_PAGE_SHIFT)) {
+            align_pow2 = MAX(align_pow2, VM_LARGE_PAGE_SHIFT);
+        }
+    }
+
     // Validate that arch_mmu_flags does not contain any prohibited flags
     if (!is_valid_mapping_flags(arch_mmu_flags)) {
         return ERR_ACCESS_DENIED;
@@ -222,7 +233,7 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
 
 status_t VmAddressRegion::DestroyLocked() {
     DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
     LTRACEF("%p '%s'\n", this, name_);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -257,7 +268,7 @@ void VmAddressRegion::RemoveSubregion(VmAddressRegionOrMapping* region) {
 }
 
 mxtl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegion(vaddr_t addr) {
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return nullptr;
     }
@@ -277,19 +288,55 @@ mxtl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegionLocked(vaddr_t
     return mxtl::RefPtr<VmAddressRegionOrMapping>(&*itr);
 }
 
-size_t VmAddressRegion::AllocatedPages() const {
+size_t VmAddressRegion::AllocatedPagesLocked() const {
     DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
 
     size_t sum = 0;
     for (const auto& child : subregions_) {
-        sum += child.AllocatedPages();
+        sum += child.AllocatedPagesLocked();
     }
     return sum;
 }
 
-status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
+size_t VmAddressRegion::GetMappingInfo(VmMappingInfo* info, size_t max) {
+    DEBUG_ASSERT(magic_ == kMagic);
+
+    AutoReadLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return 0;
+    }
+
+    size_t count = 0;
+    GetMappingInfoLocked(info, max, &count);
+    return count;
+}
+
+void VmAddressRegion::GetMappingInfoLocked(VmMappingInfo* info, size_t max, size_t* count) {
     DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
+
+    for (auto& child : subregions_) {
+        if (!child.is_mapping()) {
+            child.as_vm_address_region()->GetMappingInfoLocked(info, max, count);
+            continue;
+        }
+
+        if (*count < max) {
+            VmMappingInfo* mi = &info[*count];
+            strlcpy(mi->name, child.name_, sizeof(mi->name));
+            mi->base = child.base_;
+            mi->size = child.size_;
+            mi->arch_mmu_flags = child.as_vm_mapping()->arch_mmu_flags();
+            mi->committed_pages = child.AllocatedPagesLocked();
+        }
+        (*count)++;
+    }
+}
+
+status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags, PageRequest* request) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
 
     mxtl::RefPtr<VmAddressRegion> vmar(this);
     while (1) {
@@ -299,7 +346,7 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
         }
 
         if (next->is_mapping()) {
-            return next->PageFault(va, pf_flags);
+            return next->PageFault(va, pf_flags, request);
         }
 
         vmar = next->as_vm_address_region();
@@ -307,7 +354,7 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
 }
 
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
     DEBUG_ASSERT(size > 0);
 
     // Find the first region with base > *base*.  Since subregions_ has no
@@ -339,7 +386,7 @@ bool VmAddressRegion::CheckGapLocked(const ChildList::iterator& prev,
                                      const ChildList::iterator& next,
                                      vaddr_t* pva, vaddr_t search_base, vaddr_t align,
                                      size_t region_size, size_t min_gap, uint arch_mmu_flags) {
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
 
     safeint::CheckedNumeric<vaddr_t> gap_beg; // first byte of a gap
     safeint::CheckedNumeric<vaddr_t> gap_end; // last byte of a gap
@@ -428,7 +475,7 @@ vaddr_t VmAddressRegion::AllocSpotLocked(vaddr_t base, size_t size, uint8_t alig
     DEBUG_ASSERT(size > 0 && IS_PAGE_ALIGNED(size));
     DEBUG_ASSERT(IS_PAGE_ALIGNED(min_alloc_gap));
     DEBUG_ASSERT(min_alloc_gap <= MAX_MIN_ALLOC_GAP);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
 
     LTRACEF_LEVEL(2, "aspace %p base %#" PRIxPTR " size 0x%zx align %hhu\n", this, base, size,
                   align_pow2);
@@ -440,23 +487,74 @@ vaddr_t VmAddressRegion::AllocSpotLocked(vaddr_t base, size_t size, uint8_t alig
     vaddr_t spot;
 
     // Find the first gap in the address space which can contain a region of the
-    // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
-
-    do {
-        if (CheckGapLocked(before_iter, after_iter, &spot, base, align, size, min_alloc_gap,
-                     arch_mmu_flags)) {
-            return spot;
-        }
+    // requested size: the one in front of the first child, then the ones between
+    // children (found via the subtree gap summaries), then the one after the last.
+    if (CheckGapLocked(subregions_.end(), subregions_.begin(), &spot, base, align, size,
+                       min_alloc_gap, arch_mmu_flags)) {
+        return spot;
+    }
+    if (subregions_.is_empty())
+        return -1;
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+    if (FindGapLocked(subregions_.root(), &spot, base, align, size, min_alloc_gap,
+                      arch_mmu_flags)) {
+        return spot;
+    }
+
+    auto last = subregions_.make_iterator(subregions_.back());
+    if (CheckGapLocked(last, subregions_.end(), &spot, base, align, size, min_alloc_gap,
+                       arch_mmu_flags)) {
+        return spot;
+    }
 
     // couldn't find anything
     return -1;
 }
 
+bool VmAddressRegion::FindGapLocked(VmAddressRegionOrMapping* node, vaddr_t* pva,
+                                    vaddr_t search_base, vaddr_t align, size_t region_size,
+                                    size_t min_gap, uint arch_mmu_flags) {
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
+
+    // skip subtrees with no gap large enough, or which end below the search base.
+    // The recursion is bounded by the height of the tree.
+    if (!node || node->subtree_max_gap_ < region_size + 2 * min_gap ||
+        node->subtree_last_byte_ < search_base) {
+        return false;
+    }
+
+    VmAddressRegionOrMapping* left = ChildList::left_child(node);
+    VmAddressRegionOrMapping* right = ChildList::right_child(node);
+
+    if (FindGapLocked(left, pva, search_base, align, region_size, min_gap, arch_mmu_flags))
+        return true;
+
+    // the gap between the last region in the left subtree and this one
+    if (left && node->base_ - left->subtree_last_byte_ - 1 >= region_size + 2 * min_gap) {
+        auto next = subregions_.make_iterator(*node);
+        auto prev = next;
+        --prev;
+        if (CheckGapLocked(prev, next, pva, search_base, align, region_size, min_gap,
+                           arch_mmu_flags)) {
+            return true;
+        }
+    }
+
+    // the gap between this region and the first one in the right subtree
+    if (right && right->subtree_first_byte_ - (node->base_ + node->size_) >=
+                     region_size + 2 * min_gap) {
+        auto prev = subregions_.make_iterator(*node);
+        auto next = prev;
+        ++next;
+        if (CheckGapLocked(prev, next, pva, search_base, align, region_size, min_gap,
+                           arch_mmu_flags)) {
+            return true;
+        }
+    }
+
+    return FindGapLocked(right, pva, search_base, align, region_size, min_gap, arch_mmu_flags);
+}
+
 void VmAddressRegion::Dump(uint depth) const {
     DEBUG_ASSERT(magic_ == kMagic);
     for (uint i = 0; i < depth; ++i) {
@@ -471,7 +569,7 @@ void VmAddressRegion::Dump(uint depth) const {
 
 void VmAddressRegion::Activate() {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
 
     state_ = LifeCycleState::ALIVE;
     parent_->subregions_.insert(mxtl::RefPtr<VmAddressRegionOrMapping>(this));
@@ -10,10 +10,10 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <mxtl/auto_call.h>
-#include <mxtl/auto_lock.h>
 #include <string.h>
 #include <trace.h>
 
@@ -31,7 +31,7 @@ VmAddressRegionOrMapping::VmAddressRegionOrMapping(uint32_t magic,
 }
 
 status_t VmAddressRegionOrMapping::Destroy() {
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -39,6 +39,14 @@ status_t VmAddressRegionOrMapping::Destroy() {
     return DestroyLocked();
 }
 
+size_t VmAddressRegionOrMapping::AllocatedPages() const {
+    AutoReadLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return 0;
+    }
+    return AllocatedPagesLocked();
+}
+
 VmAddressRegionOrMapping::~VmAddressRegionOrMapping() {
     LTRACEF("%p '%s'\n", this, name_);
 
@@ -78,3 +86,27 @@ bool VmAddressRegionOrMapping::is_valid_mapping_flags(uint arch_mmu_flags) {
     }
     return true;
 }
+
+void VmAddressRegionOrMapping::WAVLTreeAugmentTraits::Update(VmAddressRegionOrMapping* node,
+                                                             VmAddressRegionOrMapping* left,
+                                                             VmAddressRegionOrMapping* right) {
+    vaddr_t last_byte = node->base_ + node->size_ - 1;
+    size_t max_gap = 0;
+
+    if (left) {
+        max_gap = MAX(left->subtree_max_gap_, node->base_ - left->subtree_last_byte_ - 1);
+        node->subtree_first_byte_ = left->subtree_first_byte_;
+    } else {
+        node->subtree_first_byte_ = node->base_;
+    }
+
+    if (right) {
+        max_gap = MAX(max_gap, right->subtree_max_gap_);
+        max_gap = MAX(max_gap, right->subtree_first_byte_ - last_byte - 1);
+        node->subtree_last_byte_ = right->subtree_last_byte_;
+    } else {
+        node->subtree_last_byte_ = last_byte;
+    }
+
+    node->subtree_max_gap_ = max_gap;
+}
@@ -20,6 +20,7 @@
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/type_support.h>
 #include <new.h>
+#include <platform.h>
 #include <safeint/safe_math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -209,8 +210,25 @@ status_t VmAspace::Destroy() {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("%p '%s'\n", this, name_);
 
+    AutoWriteLock guard(lock_);
+
+    // nothing will run in a dead user address space again, so rather than
+    // have each mapping unmap itself, drop the whole page table tree at once
+    // and flush the tlb a single time
+    if (is_user() && !page_tables_released_) {
+        AutoLock ml(mmu_lock_);
+        status_t status = arch_mmu_unmap_all(&arch_aspace_);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        page_tables_released_ = true;
+    }
+
     // tear down and free all of the regions in our address space
-    status_t status = root_vmar_->Destroy();
+    status_t status = ERR_BAD_STATE;
+    if (root_vmar_->state_ == VmAddressRegion::LifeCycleState::ALIVE) {
+        status = root_vmar_->DestroyLocked();
+    }
     if (status != NO_ERROR && status != ERR_BAD_STATE) {
         return status;
     }
@@ -274,6 +292,14 @@ status_t VmAspace::MapObject(mxtl::RefPtr<VmObject> vmo, const char* name, uint6
         vmar_flags |= VMAR_FLAG_MAP_HIGH;
     }
 
+    if (vmm_flags & VMM_FLAG_FAULT_AROUND) {
+        vmar_flags |= VMAR_FLAG_FAULT_AROUND;
+    }
+
+    if (vmm_flags & VMM_FLAG_LARGE_PAGES) {
+        vmar_flags |= VMAR_FLAG_LARGE_PAGES;
+    }
+
     // Create the mappings with all of the CAN_* RWX flags, so that
     // Protect() can transition them arbitrarily.  This is not desirable for the
     // long-term, and will vanish when MapObject is removed from VmAspace.
@@ -291,6 +317,15 @@ status_t VmAspace::MapObject(mxtl::RefPtr<VmObject> vmo, const char* name, uint6
     // if we're committing it, map the region now
     if (vmm_flags & VMM_FLAG_COMMIT) {
         auto err = r->MapRange(0, size, true);
+        if (err < 0) {
+            // don't leave a half committed mapping behind
+            r->Destroy();
+            return err;
+        }
+    } else if (vmm_flags & VMM_FLAG_LARGE_PAGES) {
+        // map whatever is already resident now, while it can still go in as
+        // large pages; demand faults only ever map a single page
+        auto err = r->MapRange(0, size, false);
         if (err < 0)
             return err;
     }
@@ -480,12 +515,28 @@ status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     DEBUG_ASSERT(root_vmar_);
     LTRACEF("va %#" PRIxPTR ", flags %#x\n", va, flags);
 
-    // for now, hold the aspace lock across the page fault operation,
-    // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(lock_);
-
-    return root_vmar_->PageFault(va, flags);
+    lk_bigtime_t start = current_time_hires();
+
+    // hold the aspace lock shared across the page fault operation, which
+    // stops any other operations on the address space from moving the region
+    // out from underneath it while letting faults on other regions proceed.
+    // A page that has to come from a page source is waited for with no locks
+    // held, after which the fault starts over, since the region may be gone.
+    PageRequest request;
+    status_t status;
+    for (;;) {
+        {
+            AutoReadLock a(lock_);
+            status = root_vmar_->PageFault(va, flags, &request);
+        }
+        if (status != ERR_SHOULD_WAIT)
+            break;
+        status = request.Wait();
+        if (status != NO_ERROR)
+            break;
+    }
+    __atomic_fetch_add(&fault_stats_.fault_time, current_time_hires() - start, __ATOMIC_RELAXED);
+    return status;
 }
 
 void VmAspace::Dump() const {
@@ -494,7 +545,7 @@ void VmAspace::Dump() const {
            ref_count_debug(), name_, base_, base_ + size_ - 1, size_, flags_);
 
     printf("regions:\n");
-    AutoLock a(lock_);
+    AutoReadLock a(lock_);
 
     root_vmar_->Dump(1);
 }
@@ -509,6 +560,25 @@ void DumpAllAspaces() {
 size_t VmAspace::AllocatedPages() const {
     DEBUG_ASSERT(magic_ == MAGIC);
 
-    AutoLock a(lock_);
-    return root_vmar_->AllocatedPages();
+    AutoReadLock a(lock_);
+    if (root_vmar_->state_ != VmAddressRegion::LifeCycleState::ALIVE)
+        return 0;
+    return root_vmar_->AllocatedPagesLocked();
+}
+
+size_t VmAspace::PageTableBytes() const {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    AutoLock ml(mmu_lock_);
+    return arch_mmu_page_table_bytes(const_cast<arch_aspace_t*>(&arch_aspace_));
+}
+
+VmAspace::FaultStats VmAspace::GetFaultStats() const {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    FaultStats stats;
+    stats.minor_faults = __atomic_load_n(&fault_stats_.minor_faults, __ATOMIC_RELAXED);
+    stats.major_faults = __atomic_load_n(&fault_stats_.major_faults, __ATOMIC_RELAXED);
+    stats.fault_time = __atomic_load_n(&fault_stats_.fault_time, __ATOMIC_RELAXED);
+    return stats;
 }
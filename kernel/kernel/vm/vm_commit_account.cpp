@@ -0,0 +1,59 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/vm_commit_account.h>
+
+#include "vm_priv.h"
+
+#include <assert.h>
+#include <new.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+mxtl::RefPtr<VmCommitAccount> VmCommitAccount::Create(mxtl::RefPtr<VmCommitAccount> parent) {
+    AllocChecker ac;
+    auto account = mxtl::AdoptRef(new (&ac) VmCommitAccount(mxtl::move(parent)));
+    if (!ac.check())
+        return nullptr;
+    return account;
+}
+
+VmCommitAccount::VmCommitAccount(mxtl::RefPtr<VmCommitAccount> parent)
+    : parent_(mxtl::move(parent)) {
+    LTRACEF("%p parent %p\n", this, parent_.get());
+}
+
+VmCommitAccount::~VmCommitAccount() {
+    LTRACEF("%p\n", this);
+
+    // every VMO charging us holds a reference
+    DEBUG_ASSERT(committed_pages_ == 0);
+}
+
+bool VmCommitAccount::HasRoom(size_t count) const {
+    for (const VmCommitAccount* a = this; a; a = a->parent_.get()) {
+        size_t limit = a->limit_pages();
+        if (limit == 0)
+            continue;
+        size_t committed = a->committed_pages();
+        if (committed > limit || count > limit - committed)
+            return false;
+    }
+    return true;
+}
+
+void VmCommitAccount::Charge(size_t count) {
+    for (VmCommitAccount* a = this; a; a = a->parent_.get())
+        __atomic_fetch_add(&a->committed_pages_, count, __ATOMIC_RELAXED);
+}
+
+void VmCommitAccount::Uncharge(size_t count) {
+    for (VmCommitAccount* a = this; a; a = a->parent_.get()) {
+        __UNUSED size_t old = __atomic_fetch_sub(&a->committed_pages_, count, __ATOMIC_RELAXED);
+        DEBUG_ASSERT(old >= count);
+    }
+}
@@ -0,0 +1,97 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/vm/vm_compressed_page.h>
+
+#include "vm_priv.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
+#include <kernel/mutex.h>
+#include <kernel/vm.h>
+#include <kernel/cmdline.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <lz4/lz4.h>
+#include <new.h>
+#include <string.h>
+#include <trace.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// A page has to come out at most this big to be kept compressed; past it
+// the heap overhead and the cost of inflating it on the next touch aren't
+// worth what little is saved.
+#define MAX_COMPRESSED_SIZE (PAGE_SIZE * 3 / 4)
+
+// pages held compressed, and the heap bytes holding them
+KCOUNTER(compressed_pages_counter, "vm.compressed.pages");
+KCOUNTER(compressed_bytes_counter, "vm.compressed.bytes");
+
+// The compressor's state is too big for a kernel stack, so there's one,
+// used under this lock, with a buffer to compress into before the result's
+// size is known.
+static Mutex compress_lock;
+static LZ4_stream_t compress_state;
+static char compress_buf[MAX_COMPRESSED_SIZE];
+
+static bool compression_enabled;
+
+static void vm_compression_init(uint level) {
+    compression_enabled = cmdline_get_bool("vm.compress", false);
+}
+
+LK_INIT_HOOK(vm_compression, &vm_compression_init, LK_INIT_LEVEL_VM);
+
+bool VmCompressedPage::Enabled() {
+    return compression_enabled;
+}
+
+mxtl::unique_ptr<VmCompressedPage> VmCompressedPage::Compress(uint64_t offset, const void* src) {
+    AutoLock a(compress_lock);
+
+    int size = LZ4_compress_fast_extState(&compress_state, static_cast<const char*>(src),
+                                          compress_buf, PAGE_SIZE, MAX_COMPRESSED_SIZE, 1);
+    if (size <= 0)
+        return nullptr;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[size]);
+    if (!ac.check())
+        return nullptr;
+    memcpy(data.get(), compress_buf, size);
+
+    mxtl::unique_ptr<VmCompressedPage> page(
+        new (&ac) VmCompressedPage(offset, mxtl::move(data), size));
+    if (!ac.check())
+        return nullptr;
+
+    LTRACEF("offset %#" PRIx64 " compressed to %d bytes\n", offset, size);
+    return page;
+}
+
+VmCompressedPage::VmCompressedPage(uint64_t offset, mxtl::unique_ptr<uint8_t[]> data, size_t size)
+    : offset_(offset), data_(mxtl::move(data)), size_(size) {
+    kcounter_add(&compressed_pages_counter, 1);
+    kcounter_add(&compressed_bytes_counter, static_cast<int64_t>(size_));
+}
+
+VmCompressedPage::~VmCompressedPage() {
+    kcounter_add(&compressed_pages_counter, -1);
+    kcounter_add(&compressed_bytes_counter, -static_cast<int64_t>(size_));
+}
+
+status_t VmCompressedPage::Decompress(void* dst) const {
+    int size = LZ4_decompress_safe(reinterpret_cast<const char*>(data_.get()),
+                                   static_cast<char*>(dst), static_cast<int>(size_), PAGE_SIZE);
+    // we made it, so anything else means something scribbled on it
+    if (size != PAGE_SIZE) {
+        TRACEF("offset %#" PRIx64 " inflated to %d bytes\n", offset_, size);
+        return ERR_BAD_STATE;
+    }
+    return NO_ERROR;
+}
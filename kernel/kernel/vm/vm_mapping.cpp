@@ -10,17 +10,75 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 #include <mxtl/auto_call.h>
-#include <mxtl/auto_lock.h>
 #include <new.h>
 #include <safeint/safe_math.h>
 #include <trace.h>
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+namespace {
+
+// Collects runs of pages that are contiguous both virtually and physically
+// and have the same permissions, so each run can go to arch_mmu_map in one
+// call.  The arch layer uses large page entries where a run lines up.
+// |mmu_lock| is taken around each call.
+class MmuMapBatch {
+public:
+    MmuMapBatch(arch_aspace_t* aspace, mutex_t* mmu_lock, bool merge)
+        : aspace_(aspace), mmu_lock_(mmu_lock), merge_(merge) {}
+    ~MmuMapBatch() { Flush(); }
+
+    void Add(vaddr_t va, paddr_t pa, uint mmu_flags) {
+        if (count_ > 0 && (!merge_ || va_ + count_ * PAGE_SIZE != va ||
+                           pa_ + count_ * PAGE_SIZE != pa || mmu_flags_ != mmu_flags)) {
+            Flush();
+        }
+        if (count_ == 0) {
+            va_ = va;
+            pa_ = pa;
+            mmu_flags_ = mmu_flags;
+        }
+        count_++;
+    }
+
+    void Flush() {
+        if (count_ == 0)
+            return;
+
+        LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n",
+                      count_, pa_, va_);
+        AutoLock ml(mmu_lock_);
+        auto ret = arch_mmu_map(aspace_, va_, pa_, count_, mmu_flags_);
+        if (ret < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   ret, count_, va_, pa_);
+        }
+#if ARCH_ARM64
+        else if (mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+            arch_sync_cache_range(va_, count_ * PAGE_SIZE);
+        }
+#endif
+        count_ = 0;
+    }
+
+private:
+    arch_aspace_t* const aspace_;
+    mutex_t* const mmu_lock_;
+    const bool merge_;
+
+    vaddr_t va_ = 0;
+    paddr_t pa_ = 0;
+    size_t count_ = 0;
+    uint mmu_flags_ = 0;
+};
+
+} // namespace
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags,
                      const char* name)
@@ -34,14 +92,11 @@ VmMapping::~VmMapping() {
     DEBUG_ASSERT(magic_ == kMagic);
 }
 
-size_t VmMapping::AllocatedPages() const {
+size_t VmMapping::AllocatedPagesLocked() const {
     DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
 
-    AutoLock guard(aspace_->lock());
-    if (state_ != LifeCycleState::ALIVE) {
-        return ERR_BAD_STATE;
-    }
-    return object_->AllocatedPages();
+    return object_->AllocatedPagesInRange(object_offset_, size_);
 }
 
 void VmMapping::Dump(uint depth) const {
@@ -60,7 +115,7 @@ status_t VmMapping::Protect(uint arch_mmu_flags) {
     DEBUG_ASSERT(magic_ == kMagic);
     LTRACEF("%p %s %#" PRIxPTR " %#x %#x\n", this, name_, base_, flags_, arch_mmu_flags);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -81,10 +136,45 @@ status_t VmMapping::Protect(uint arch_mmu_flags) {
     // Persist our current caching mode
     arch_mmu_flags_ = arch_mmu_flags | (arch_mmu_flags_ & ARCH_MMU_FLAG_CACHE_MASK);
 
+    AutoLock ml(aspace_->mmu_lock());
     auto err = arch_mmu_protect(&aspace_->arch_aspace(), base_, size_ / PAGE_SIZE, arch_mmu_flags_);
     LTRACEF("arch_mmu_protect returns %d\n", err);
     // TODO: deal with error mapping here
 
+    // if we just made borrowed pages writable, copy-on-write ones or the zero
+    // page, unmap them again so the next write faults and gives the object its
+    // own copy.  The same goes for clean pages, whose first write has to be
+    // seen.  Runs of them go in one call, since most of a sparse mapping may
+    // be uncommitted.
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE) {
+        size_t run = 0;
+        for (size_t o = 0; o <= size_; o += PAGE_SIZE) {
+            if (o < size_ && (object_->IsPageSharedLocked(object_offset_ + o) ||
+                              object_->IsPageCleanLocked(object_offset_ + o))) {
+                run++;
+                continue;
+            }
+            if (run > 0) {
+                arch_mmu_unmap(&aspace_->arch_aspace(), base_ + o - run * PAGE_SIZE, run);
+                run = 0;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
+status_t VmMapping::Advise(Advice advice) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    LTRACEF("%p %s %#" PRIxPTR " advice %d\n", this, name_, base_, static_cast<int>(advice));
+
+    AutoWriteLock guard(aspace_->lock());
+    if (state_ != LifeCycleState::ALIVE) {
+        return ERR_BAD_STATE;
+    }
+
+    // only changes what later faults do
+    advice_ = advice;
     return NO_ERROR;
 }
 
@@ -94,7 +184,7 @@ status_t VmMapping::Unmap() {
 
 status_t VmMapping::UnmapLocked() {
     DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
 
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
@@ -102,11 +192,17 @@ status_t VmMapping::UnmapLocked() {
 
     LTRACEF("%p '%s'\n", this, name_);
 
+    // the whole aspace was unmapped at once as it died
+    if (aspace_->page_tables_released()) {
+        return NO_ERROR;
+    }
+
     // grab the lock for the vmo
     DEBUG_ASSERT(object_);
     AutoLock al(object_->lock());
 
     // unmap the section of address space we cover
+    AutoLock ml(aspace_->mmu_lock());
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), base_, size_ / PAGE_SIZE);
     if (status < 0) {
         return status;
@@ -117,7 +213,10 @@ status_t VmMapping::UnmapLocked() {
 status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
     DEBUG_ASSERT(magic_ == kMagic);
 
-    AutoLock guard(aspace_->lock());
+    // This runs with only the object's lock held, often from inside a fault
+    // in some address space, and does not take the aspace lock.  That is
+    // safe: our base, size and offset never change, and we are only on the
+    // object's region list, which our caller is walking, while alive.
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -148,12 +247,16 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
     // make sure the base + offset is within our address space
     // should be, according to the range stored in base_ + size_
     safeint::CheckedNumeric<vaddr_t> unmap_base = base_;
-    unmap_base += offset_new;
+    unmap_base += offset_new - object_offset_;
 
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 "\n", unmap_base.ValueOrDie(), len_new);
 
+    AutoLock ml(aspace_->mmu_lock());
+    if (aspace_->page_tables_released())
+        return NO_ERROR;
+
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
-                                     static_cast<size_t>(len_new));
+                                     static_cast<size_t>(len_new / PAGE_SIZE));
     if (status < 0)
         return status;
 
@@ -163,7 +266,9 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) {
 status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     DEBUG_ASSERT(magic_ == kMagic);
 
-    AutoLock guard(aspace_->lock());
+    // like a fault, this only fills in page tables, so the aspace lock
+    // shared is enough
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ERR_BAD_STATE;
     }
@@ -177,6 +282,11 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
+    // without large pages each page goes in on its own, so a later partial
+    // unmap or protect never has to split anything
+    MmuMapBatch batch(&aspace_->arch_aspace(), &aspace_->mmu_lock(),
+                      flags_ & VMAR_FLAG_LARGE_PAGES);
+
     // iterate through the range, grabbing a page from the underlying object and
     // mapping it in
     size_t o;
@@ -195,21 +305,22 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
             continue;
         }
 
-        vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
+        // pages borrowed from a parent object can't be written through, and
+        // neither can clean ones until a write fault says they're dirty
+        uint mmu_flags = arch_mmu_flags_;
+        if (object_->IsPageSharedLocked(vmo_offset) || object_->IsPageCleanLocked(vmo_offset))
+            mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
 
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
-        }
+        batch.Add(base_ + o, pa, mmu_flags);
     }
+    batch.Flush();
 
     return NO_ERROR;
 }
 
 status_t VmMapping::DestroyLocked() {
     DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
     LTRACEF("%p '%s'\n", this, name_);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -241,9 +352,9 @@ status_t VmMapping::DestroyLocked() {
     return NO_ERROR;
 }
 
-status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
+status_t VmMapping::PageFault(vaddr_t va, uint pf_flags, PageRequest* request) {
     DEBUG_ASSERT(magic_ == kMagic);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
 
     DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
 
@@ -281,56 +392,81 @@ status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
-    // fault in or grab an existing page
+    // it's a major fault if a write has to give the object a page of its
+    // own; reads of memory it doesn't have only map the zero page
     paddr_t new_pa;
+    bool major = (pf_flags & VMM_PF_FLAG_WRITE) && object_->IsPageSharedLocked(vmo_offset);
+
+    // fault in or grab an existing page
     auto status = object_->FaultPageLocked(vmo_offset, pf_flags, &new_pa);
     if (status < 0) {
+        // the page may have to come from the object's page source, which a
+        // sequential mapping asks for the pages after it as well
+        uint64_t len = PAGE_SIZE;
+        if (advice_ == Advice::SEQUENTIAL)
+            len = MIN(kReadAheadPages * PAGE_SIZE, base_ + size_ - va);
+        status_t req_status = object_->RequestPageLocked(vmo_offset, len, request);
+        if (req_status != ERR_NOT_SUPPORTED)
+            return req_status;
+
         TRACEF("ERROR: failed to fault in or grab existing page\n");
         TRACEF("%p '%s', vmo_offset %#" PRIx64 ", pf_flags %#x\n", this, name_, vmo_offset, pf_flags);
         return status;
     }
+    aspace_->CountFaultLocked(major);
+
+    // pages borrowed from a parent object can't be written through, nor can
+    // clean ones be written without the object seeing it; a write fault will
+    // have given the object its own copy, or dirtied it
+    uint mmu_flags = arch_mmu_flags_;
+    if (object_->IsPageSharedLocked(vmo_offset) || object_->IsPageCleanLocked(vmo_offset))
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
 
     // see if something is mapped here now
     // this may happen if we are one of multiple threads racing on a single
     // address
-    uint page_flags;
-    paddr_t pa;
-    status_t err = arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags);
-    if (err >= 0) {
-        LTRACEF("queried va, page at pa %#" PRIxPTR ", flags %#x is already there\n", pa,
-                page_flags);
-        if (pa == new_pa) {
-            // page was already mapped, are the permissions compatible?
-            if (page_flags == arch_mmu_flags_)
-                return NO_ERROR;
-
-            // same page, different permission
-            auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, arch_mmu_flags_);
+    {
+        AutoLock ml(aspace_->mmu_lock());
+        uint page_flags;
+        paddr_t pa;
+        status_t err = arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags);
+        if (err >= 0) {
+            LTRACEF("queried va, page at pa %#" PRIxPTR ", flags %#x is already there\n", pa,
+                    page_flags);
+            if (pa == new_pa) {
+                // page was already mapped, are the permissions compatible?
+                if (page_flags == mmu_flags)
+                    return NO_ERROR;
+
+                // same page, different permission
+                auto ret = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, mmu_flags);
+                if (ret < 0) {
+                    TRACEF("failed to modify permissions on existing mapping\n");
+                    return ERR_NO_MEMORY;
+                }
+            } else {
+                // some other page is mapped there already. copy-on-write unmaps the
+                // parent's page when the object gets its own, so this shouldn't happen
+                printf("KERN: thread %s faulted on va %#" PRIxPTR
+                       ", different page was present, unhandled\n",
+                       get_current_thread()->name, va);
+                return ERR_NOT_SUPPORTED;
+            }
+        } else {
+            // nothing was mapped there before, map it now
+            LTRACEF("mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", new_pa, va);
+            auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags);
             if (ret < 0) {
-                TRACEF("failed to modify permissions on existing mapping\n");
+                TRACEF("failed to map page\n");
                 return ERR_NO_MEMORY;
             }
-        } else {
-            // some other page is mapped there already
-            // currently this is an error situation, since there's no way for this to
-            // have
-            // happened, but in the future this will be a path for copy-on-write.
-            // TODO: implement
-            printf("KERN: thread %s faulted on va %#" PRIxPTR
-                   ", different page was present, unhandled\n",
-                   get_current_thread()->name, va);
-            return ERR_NOT_SUPPORTED;
-        }
-    } else {
-        // nothing was mapped there before, map it now
-        LTRACEF("mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", new_pa, va);
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, arch_mmu_flags_);
-        if (ret < 0) {
-            TRACEF("failed to map page\n");
-            return ERR_NO_MEMORY;
         }
     }
 
+    if (advice_ == Advice::SEQUENTIAL ||
+        (advice_ == Advice::NORMAL && (flags_ & VMAR_FLAG_FAULT_AROUND)))
+        FaultAroundLocked(va);
+
 // TODO: figure out what to do with this
 #if ARCH_ARM64
     if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
@@ -339,9 +475,49 @@ status_t VmMapping::PageFault(vaddr_t va, uint pf_flags) {
     return NO_ERROR;
 }
 
+void VmMapping::FaultAroundLocked(vaddr_t va) {
+    DEBUG_ASSERT(magic_ == kMagic);
+    DEBUG_ASSERT(is_rwlock_held(&aspace_->lock()));
+    DEBUG_ASSERT(object_->lock().IsHeld());
+
+    // look at the aligned window of pages around va, or the window starting
+    // at it if the access is sequential, clipped to the mapping
+    const vaddr_t window = kFaultAroundPages * PAGE_SIZE;
+    const vaddr_t window_base = (advice_ == Advice::SEQUENTIAL) ? va : ROUNDDOWN(va, window);
+    const vaddr_t start = MAX(window_base, base_);
+    const vaddr_t last = MIN(window_base + window - 1, base_ + size_ - 1);
+
+    MmuMapBatch batch(&aspace_->arch_aspace(), &aspace_->mmu_lock(), true);
+
+    for (vaddr_t addr = start; addr <= last && addr >= start; addr += PAGE_SIZE) {
+        uint64_t vmo_offset = addr - base_ + object_offset_;
+
+        // only pick up pages the object already has, never allocate here, and
+        // leave anything that is already mapped alone
+        paddr_t pa;
+        if (addr == va || object_->GetPageLocked(vmo_offset, &pa) < 0)
+            continue;
+        {
+            // nothing else can map this page while we hold the object's lock
+            paddr_t mapped_pa;
+            uint page_flags;
+            AutoLock ml(aspace_->mmu_lock());
+            if (arch_mmu_query(&aspace_->arch_aspace(), addr, &mapped_pa, &page_flags) >= 0)
+                continue;
+        }
+
+        uint mmu_flags = arch_mmu_flags_;
+        if (object_->IsPageSharedLocked(vmo_offset) || object_->IsPageCleanLocked(vmo_offset))
+            mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+
+        batch.Add(addr, pa, mmu_flags);
+    }
+    batch.Flush();
+}
+
 void VmMapping::ActivateLocked() {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(&aspace_->lock()));
+    DEBUG_ASSERT(is_rwlock_write_held(&aspace_->lock()));
     DEBUG_ASSERT(object_->lock().IsHeld());
     DEBUG_ASSERT(parent_);
 
@@ -23,7 +23,13 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-VmObject::VmObject() {
+VmObject::VmObject()
+    : lock_(local_lock_) {
+    LTRACEF("%p\n", this);
+}
+
+VmObject::VmObject(Mutex& shared_lock)
+    : lock_(shared_lock) {
     LTRACEF("%p\n", this);
 }
 
@@ -16,6 +16,7 @@
 #include <kernel/vm/vm_address_region.h>
 #include <lib/console.h>
 #include <lib/user_copy.h>
+#include <lk/init.h>
 #include <new.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,44 +24,116 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-namespace {
+// All purgeable objects, least recently unlocked first. The lock is taken
+// before any object's lock.
+static Mutex purgeable_lock;
+static mxtl::DoublyLinkedList<VmObjectPaged*, VmObjectPaged::PurgeableListTraits> purgeable_list;
 
-void ZeroPage(paddr_t pa) {
-    void* ptr = paddr_to_kvaddr(pa);
-    DEBUG_ASSERT(ptr);
+// All compressible objects, in the order CompressIdlePages() gets to them.
+// The lock is taken before any object's lock.
+static Mutex compressible_lock;
+static mxtl::DoublyLinkedList<VmObjectPaged*, VmObjectPaged::CompressibleListTraits>
+    compressible_list;
 
-    arch_zero_page(ptr);
+// What every uncommitted page of a paged object reads as.  Read faults map it
+// read only, and the first write gives the object a page of its own.
+static vm_page_t* zero_page;
+
+static void zero_page_init(uint level) {
+    paddr_t pa;
+    zero_page = pmm_alloc_page(PMM_ALLOC_FLAG_ANY, &pa);
+    ASSERT(zero_page);
+    zero_page->state = VM_PAGE_STATE_WIRED;
+    arch_zero_page(paddr_to_kvaddr(pa));
 }
 
-void ZeroPage(vm_page_t* p) {
-    paddr_t pa = vm_page_to_paddr(p);
-    ZeroPage(pa);
+LK_INIT_HOOK(vm_zero_page, &zero_page_init, LK_INIT_LEVEL_VM);
+
+// A copy in flight pins the page it is using while it has the object's lock
+// dropped.  If the object lets go of the page before then, the page list marks
+// it as no longer belonging to an object instead of freeing it, and the last
+// unpin frees it.  Both are called with the object's lock held.
+// The zero page is never freed, so it's left alone.
+static void pin_page(vm_page_t* p) {
+    if (p == zero_page)
+        return;
+    p->pin_count++;
 }
 
-} // namespace
+static void unpin_page(vm_page_t* p) {
+    if (p == zero_page)
+        return;
+    DEBUG_ASSERT(p->pin_count > 0);
+    if (--p->pin_count == 0 && p->state == VM_PAGE_STATE_ALLOC)
+        pmm_free_page(p);
+}
 
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags)
-    : pmm_alloc_flags_(pmm_alloc_flags) {
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, bool purgeable)
+    : pmm_alloc_flags_(pmm_alloc_flags), purgeable_(purgeable),
+      purgeable_lock_count_(purgeable ? 1 : 0) {
     LTRACEF("%p\n", this);
 }
 
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObjectPaged> parent,
+                             uint64_t parent_offset)
+    : VmObject(parent->lock()), pmm_alloc_flags_(pmm_alloc_flags), parent_(mxtl::move(parent)),
+      parent_offset_(parent_offset) {
+    LTRACEF("%p parent %p offset %#" PRIx64 "\n", this, parent_.get(), parent_offset_);
+}
+
 VmObjectPaged::~VmObjectPaged() {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("%p\n", this);
 
+    // our clones hold references to us
+    DEBUG_ASSERT(children_.is_empty());
+
+    if (parent_) {
+        AutoLock a(lock_);
+        parent_->children_.erase(*this);
+    }
+
+    if (purgeable_) {
+        AutoLock pl(purgeable_lock);
+        purgeable_list.erase(*this);
+    }
+
+    if (compressible_) {
+        AutoLock cl(compressible_lock);
+        compressible_list.erase(*this);
+    }
+
     // free all of the pages attached to us
     page_list_.FreeAllPages();
+    compressed_pages_.clear();
 }
 
-mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
+mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                             uint32_t options) {
     // there's a max size to keep indexes within range
     if (size > MAX_SIZE)
         return nullptr;
 
+    if (options & ~(kPurgeable | kNumaInterleave | kCompressible))
+        return nullptr;
+    bool purgeable = (options & kPurgeable) != 0;
+
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags));
+    auto paged = new (&ac) VmObjectPaged(pmm_alloc_flags, purgeable);
     if (!ac.check())
         return nullptr;
+    paged->numa_interleave_ = (options & kNumaInterleave) != 0;
+    auto vmo = mxtl::AdoptRef<VmObject>(paged);
+
+    if (purgeable) {
+        AutoLock pl(purgeable_lock);
+        purgeable_list.push_back(paged);
+    } else if ((options & kCompressible) && VmCompressedPage::Enabled()) {
+        // purging is cheaper than compressing, and purgeable objects have it
+        paged->compressible_ = true;
+        AutoLock cl(compressible_lock);
+        compressible_list.push_back(paged);
+    }
 
     auto err = vmo->Resize(size);
     if (err == ERR_NO_MEMORY)
@@ -73,6 +146,305 @@ mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t
     return vmo;
 }
 
+mxtl::RefPtr<VmObject> VmObjectPaged::CreateWithSource(uint32_t pmm_alloc_flags, uint64_t size,
+                                                       mxtl::RefPtr<PageSource> source) {
+    DEBUG_ASSERT(source);
+
+    // there's a max size to keep indexes within range
+    if (size > MAX_SIZE)
+        return nullptr;
+
+    AllocChecker ac;
+    auto paged = new (&ac) VmObjectPaged(pmm_alloc_flags);
+    if (!ac.check())
+        return nullptr;
+    auto vmo = mxtl::AdoptRef<VmObject>(paged);
+
+    // nobody else can see it yet; both are fixed from here on
+    paged->size_ = size;
+    paged->page_source_ = mxtl::move(source);
+
+    return vmo;
+}
+
+status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<VmObject>* clone_vmo) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("vmo %p offset %#" PRIx64 " size %#" PRIx64 "\n", this, offset, size);
+
+    if (!IS_PAGE_ALIGNED(offset))
+        return ERR_INVALID_ARGS;
+
+    // there's a max size to keep indexes within range
+    if (size > MAX_SIZE || offset > MAX_SIZE)
+        return ERR_OUT_OF_RANGE;
+
+    // a clone reading through to pages that can vanish would see them turn to
+    // zeros, and one of a paged-in object would have to wait for them
+    if (purgeable_ || page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    AllocChecker ac;
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(
+        new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::RefPtr<VmObjectPaged>(this), offset));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    AutoLock a(lock_);
+
+    // clones read through to our pages without faulting them in, so they
+    // all have to be there
+    if (!compressed_pages_.is_empty()) {
+        status_t status = DecompressRangeLocked(0, ROUNDUP_PAGE_SIZE(size_));
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    vmo->size_ = size;
+    vmo->numa_interleave_ = numa_interleave_;
+    // its copies count against the same limits as our pages until someone
+    // says otherwise
+    vmo->page_list_.SetAccount(mxtl::RefPtr<VmCommitAccount>(page_list_.account()));
+    children_.push_front(vmo.get());
+
+    *clone_vmo = mxtl::move(vmo);
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::LockPurgeable(bool* was_purged) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    if (!purgeable_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock a(lock_);
+
+    if (purgeable_lock_count_ == UINT32_MAX)
+        return ERR_BAD_STATE;
+    purgeable_lock_count_++;
+
+    *was_purged = purged_;
+    purged_ = false;
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::UnlockPurgeable() {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    if (!purgeable_)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock pl(purgeable_lock);
+    AutoLock a(lock_);
+
+    if (purgeable_lock_count_ == 0)
+        return ERR_BAD_STATE;
+
+    // the last unlock makes us the most recent purge candidate
+    if (--purgeable_lock_count_ == 0) {
+        purgeable_list.erase(*this);
+        purgeable_list.push_back(this);
+    }
+
+    return NO_ERROR;
+}
+
+void VmObjectPaged::SetCommitAccount(mxtl::RefPtr<VmCommitAccount> account) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+
+    AutoLock a(lock_);
+    page_list_.SetAccount(mxtl::move(account));
+}
+
+size_t VmObjectPaged::PurgeUnlockedObjects(size_t target_pages) {
+    LTRACEF("target %zu pages\n", target_pages);
+
+    size_t freed = 0;
+
+    // An object whose last reference is gone blocks in its destructor on
+    // purgeable_lock before freeing anything, so everything on the list is
+    // safe to touch while we hold it. Such an object has no mappings left.
+    AutoLock pl(purgeable_lock);
+    for (auto& vmo : purgeable_list) {
+        if (freed >= target_pages)
+            break;
+
+        AutoLock a(vmo.lock_);
+        if (vmo.purgeable_lock_count_ > 0)
+            continue;
+
+        for (auto& r : vmo.region_list_) {
+            r.UnmapVmoRangeLocked(0, ROUNDUP_PAGE_SIZE(vmo.size_));
+        }
+
+        size_t count = vmo.page_list_.FreeAllPages();
+        if (count > 0) {
+            LTRACEF("purged %zu pages from vmo %p\n", count, &vmo);
+            vmo.purged_ = true;
+            freed += count;
+        }
+    }
+
+    return freed;
+}
+
+size_t VmObjectPaged::CompressIdlePages(size_t target_pages) {
+    LTRACEF("target %zu pages\n", target_pages);
+
+    size_t freed = 0;
+
+    // Objects go to the back of the list as they're visited, so the next
+    // call picks up where this one stopped. An object whose last reference
+    // is gone blocks in its destructor on compressible_lock, so everything
+    // on the list is safe to touch while we hold it.
+    AutoLock cl(compressible_lock);
+    for (size_t count = compressible_list.size_slow(); count > 0 && freed < target_pages;
+         count--) {
+        VmObjectPaged& vmo = compressible_list.front();
+        compressible_list.erase(vmo);
+        compressible_list.push_back(&vmo);
+
+        AutoLock a(vmo.lock_);
+        freed += vmo.CompressIdlePagesLocked(target_pages - freed);
+    }
+
+    return freed;
+}
+
+size_t VmObjectPaged::CompressIdlePagesLocked(size_t target_pages) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // pages a clone may be reading through to, or whose physical address
+    // someone may be using, stay put
+    if (parent_ || !children_.is_empty() || pages_exposed_)
+        return 0;
+
+    // The pages compressed are left in the page list until the walk is done,
+    // with their compressed copies already in the tree meanwhile.
+    size_t count = 0;
+    page_list_.ForEveryPage([this, target_pages, &count](vm_page_t* p, uint64_t offset) {
+        // leave pages in use by a copy, and any wired into the object
+        if (count >= target_pages || p->pin_count > 0 || p->state != VM_PAGE_STATE_OBJECT)
+            return;
+
+        // Mappings may have picked it up without a fault since it was
+        // marked, or it's being marked now, but either way nothing may have
+        // it mapped once we're done.
+        for (auto& r : region_list_) {
+            r.UnmapVmoRangeLocked(offset, PAGE_SIZE);
+        }
+
+        if (!(p->flags & VM_PAGE_FLAG_IDLE)) {
+            p->flags |= VM_PAGE_FLAG_IDLE;
+            return;
+        }
+
+        auto compressed = VmCompressedPage::Compress(offset,
+                                                     paddr_to_kvaddr(vm_page_to_paddr(p)));
+        if (!compressed)
+            return;
+        compressed_pages_.insert(mxtl::move(compressed));
+        count++;
+    });
+
+    if (count == 0)
+        return 0;
+
+    size_t freed = 0;
+    for (const auto& compressed : compressed_pages_) {
+        vm_page_t* p = page_list_.GetPage(compressed.offset());
+        if (p) {
+            p->flags &= static_cast<uint8_t>(~VM_PAGE_FLAG_IDLE);
+            page_list_.FreePage(compressed.offset());
+            freed++;
+        }
+    }
+    DEBUG_ASSERT(freed == count);
+
+    LTRACEF("compressed %zu pages of vmo %p\n", freed, this);
+    return freed;
+}
+
+vm_page_t* VmObjectPaged::DecompressPageLocked(CompressedPageTree::iterator compressed) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(compressed.IsValid());
+
+    uint64_t offset = compressed->offset();
+
+    paddr_t pa;
+    vm_page_t* p = pmm_alloc_page(PageAllocFlags(offset), &pa);
+    if (!p)
+        return nullptr;
+
+    if (compressed->Decompress(paddr_to_kvaddr(pa)) != NO_ERROR)
+        panic("vmo %p: compressed page at offset %#" PRIx64 " is corrupt\n", this, offset);
+    compressed_pages_.erase(compressed);
+
+    p->state = VM_PAGE_STATE_OBJECT;
+
+    __UNUSED auto status = page_list_.AddPage(p, offset);
+    DEBUG_ASSERT(status == NO_ERROR);
+
+    LTRACEF("decompressed page %p at offset %#" PRIx64 "\n", p, offset);
+    return p;
+}
+
+status_t VmObjectPaged::DecompressRangeLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    for (auto iter = compressed_pages_.lower_bound(start);
+         iter.IsValid() && iter->offset() < end;) {
+        auto compressed = iter++;
+        if (!DecompressPageLocked(compressed))
+            return ERR_NO_MEMORY;
+    }
+    return NO_ERROR;
+}
+
+size_t VmObjectPaged::FreeCompressedRangeLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    size_t count = 0;
+    for (auto iter = compressed_pages_.lower_bound(start);
+         iter.IsValid() && iter->offset() < end;) {
+        auto compressed = iter++;
+        compressed_pages_.erase(compressed);
+        count++;
+    }
+    return count;
+}
+
+void VmObjectPaged::UnmapZeroPageRangeLocked(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!zero_page_used_)
+        return;
+
+    for (auto& r : region_list_) {
+        r.UnmapVmoRangeLocked(offset, len);
+    }
+}
+
+void VmObjectPaged::UnmapClonesRangeLocked(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    for (auto& c : children_) {
+        // intersect with the part of us the clone covers and translate to its offsets
+        uint64_t start = MAX(offset, c.parent_offset_);
+        uint64_t end = MIN(offset + len, c.parent_offset_ + ROUNDUP_PAGE_SIZE(c.size_));
+        if (start >= end)
+            continue;
+
+        uint64_t clone_offset = start - c.parent_offset_;
+        for (auto& r : c.region_list_) {
+            r.UnmapVmoRangeLocked(clone_offset, end - start);
+        }
+
+        // pages the clone doesn't have may have been read through to its own clones
+        c.UnmapClonesRangeLocked(clone_offset, end - start);
+    }
+}
+
 void VmObjectPaged::Dump(uint depth, bool page_dump) {
     if (magic_ != MAGIC) {
         printf("VmObjectPaged at %p has bad magic\n", this);
@@ -87,8 +459,14 @@ void VmObjectPaged::Dump(uint depth, bool page_dump) {
     for (uint i = 0; i < depth; ++i) {
         printf("  ");
     }
-    printf("object %p: ref %d size %#" PRIx64 ", %zu allocated pages\n", this, ref_count_debug(), size_,
-           count);
+    printf("object %p: ref %d size %#" PRIx64 ", %zu allocated pages, %zu compressed\n", this,
+           ref_count_debug(), size_, count, compressed_pages_.size());
+    if (parent_) {
+        for (uint i = 0; i < depth; ++i) {
+            printf("  ");
+        }
+        printf("  clone of %p at offset %#" PRIx64 "\n", parent_.get(), parent_offset_);
+    }
 
     if (page_dump) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -106,6 +484,22 @@ size_t VmObjectPaged::AllocatedPages() const {
     AutoLock a(lock_);
     size_t count = 0;
     page_list_.ForEveryPage([&count](const auto p, uint64_t) { count++; });
+    // compressed pages are still committed
+    return count + compressed_pages_.size();
+}
+
+size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    AutoLock a(lock_);
+    if (!TrimRange(offset, len, size_))
+        return 0;
+    size_t count = 0;
+    page_list_.ForEveryPageInRange([&count](vm_page_t*&, uint64_t) { count++; },
+                                   offset, offset + len);
+    for (auto iter = compressed_pages_.lower_bound(ROUNDDOWN(offset, PAGE_SIZE));
+         iter.IsValid() && iter->offset() < offset + len; ++iter) {
+        count++;
+    }
     return count;
 }
 
@@ -179,7 +573,37 @@ vm_page_t* VmObjectPaged::GetPageLocked(uint64_t offset) {
     if (offset >= size_)
         return nullptr;
 
-    return page_list_.GetPage(offset);
+    vm_page_t* p = page_list_.GetPage(offset);
+    if (p || !parent_)
+        return p;
+
+    // read through to the parent's page, if it has one
+    return parent_->GetPageLocked(offset + parent_offset_);
+}
+
+bool VmObjectPaged::IsPageSharedLocked(uint64_t offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // anything we don't have is either our parent's page or the zero page
+    return !page_list_.GetPage(offset);
+}
+
+bool VmObjectPaged::IsPageCleanLocked(uint64_t offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!page_source_)
+        return false;
+
+    vm_page_t* p = page_list_.GetPage(offset);
+    return p && !(p->flags & VM_PAGE_FLAG_DIRTY);
+}
+
+uint32_t VmObjectPaged::PageAllocFlags(uint64_t offset) const {
+    if (!numa_interleave_)
+        return pmm_alloc_flags_;
+
+    uint node = static_cast<uint>((offset / PAGE_SIZE) % pmm_numa_node_count());
+    return (pmm_alloc_flags_ & ~PMM_ALLOC_FLAG_NODE_MASK) | PMM_ALLOC_FLAG_NODE(node);
 }
 
 vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
@@ -192,28 +616,93 @@ vm_page_t* VmObjectPaged::FaultPageLocked(uint64_t offset, uint pf_flags) {
         return nullptr;
 
     vm_page_t* p = page_list_.GetPage(offset);
-    if (p)
+    if (p) {
+        // it's in use after all
+        p->flags &= static_cast<uint8_t>(~VM_PAGE_FLAG_IDLE);
+        if (pf_flags & VMM_PF_FLAG_WRITE)
+            p->flags |= VM_PAGE_FLAG_DIRTY;
         return p;
+    }
+
+    // a page that was compressed while idle comes back as it was
+    if (!compressed_pages_.is_empty()) {
+        auto compressed = compressed_pages_.find(offset);
+        if (compressed.IsValid())
+            return DecompressPageLocked(compressed);
+    }
+
+    // only the page source can fill it in; see RequestPageLocked()
+    if (page_source_)
+        return nullptr;
+
+    // a clone reads through to its parent's page until it's written to
+    vm_page_t* src = nullptr;
+    if (parent_) {
+        src = parent_->GetPageLocked(offset + parent_offset_);
+        if (src && !(pf_flags & VMM_PF_FLAG_WRITE))
+            return src;
+    }
+
+    // nothing has been written here yet, so it reads as zeros
+    if (!src && !(pf_flags & VMM_PF_FLAG_WRITE) && zero_page) {
+        zero_page_used_ = true;
+        return zero_page;
+    }
 
-    // allocate a page
+    // the page counts against the limits of whoever owns us
+    if (!page_list_.HasRoom(1))
+        return nullptr;
+
+    // allocate a page, only zeroed if we're not about to copy over it
     paddr_t pa;
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+    p = pmm_alloc_page(PageAllocFlags(offset) | (src ? 0 : PMM_ALLOC_FLAG_ZEROED), &pa);
     if (!p)
         return nullptr;
 
-    p->state = VM_PAGE_STATE_OBJECT;
+    if (src) {
+        memcpy(paddr_to_kvaddr(pa), paddr_to_kvaddr(vm_page_to_paddr(src)), PAGE_SIZE);
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
+        // our mappings and our clones' may still have the parent's page mapped here
+        for (auto& r : region_list_) {
+            r.UnmapVmoRangeLocked(offset, PAGE_SIZE);
+        }
+    } else {
+        UnmapZeroPageRangeLocked(offset, PAGE_SIZE);
+    }
+
+    p->state = VM_PAGE_STATE_OBJECT;
 
     __UNUSED auto status = page_list_.AddPage(p, offset);
     DEBUG_ASSERT(status == NO_ERROR);
 
+    if (!children_.is_empty())
+        UnmapClonesRangeLocked(offset, PAGE_SIZE);
+
     LTRACEF("faulted in page %p, pa %#" PRIxPTR "\n", p, pa);
 
     return p;
 }
 
+status_t VmObjectPaged::RequestPageLocked(uint64_t offset, uint64_t len,
+                                          PageRequest* request) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!page_source_)
+        return ERR_NOT_SUPPORTED;
+    if (offset >= size_)
+        return ERR_OUT_OF_RANGE;
+
+    // ask for the pages after it up to the first one we already have
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    uint64_t end = start + PAGE_SIZE;
+    uint64_t limit = ROUNDUP_PAGE_SIZE(offset + MIN(len, size_ - offset));
+    while (end < limit && !page_list_.GetPage(end))
+        end += PAGE_SIZE;
+
+    return page_source_->GetPage(start, end - start, request);
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     DEBUG_ASSERT(magic_ == MAGIC);
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -223,6 +712,10 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
     AutoLock a(lock_);
 
+    // our pages can only come from the page source
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     if (!TrimRange(offset, len, size_))
         return ERR_OUT_OF_RANGE;
@@ -235,20 +728,44 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
+    // compressed pages are committed, but they're wanted back now
+    if (!compressed_pages_.is_empty()) {
+        status_t status = DecompressRangeLocked(ROUNDDOWN(offset, PAGE_SIZE), end);
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    // a clone needs copies of its parent's pages, and interleaved pages each
+    // come from their own node, so fault them in one by one
+    if (parent_ || (numa_interleave_ && pmm_numa_node_count() > 1)) {
+        for (uint64_t o = ROUNDDOWN(offset, PAGE_SIZE); o < end; o += PAGE_SIZE) {
+            if (page_list_.GetPage(o))
+                continue;
+            if (!FaultPageLocked(o, VMM_PF_FLAG_WRITE))
+                return ERR_NO_MEMORY;
+            if (committed)
+                *committed += PAGE_SIZE;
+        }
+        return NO_ERROR;
     }
+
+    // count the pages already present to figure out how many we need to allocate
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    size_t present = 0;
+    page_list_.ForEveryPageInRange([&present](vm_page_t*&, uint64_t) { present++; }, start, end);
+
+    size_t count = (end - start) / PAGE_SIZE - present;
     if (count == 0)
         return NO_ERROR;
 
+    if (!page_list_.HasRoom(count))
+        return ERR_NO_MEMORY;
+
     // allocate count number of pages
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -266,9 +783,6 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         __UNUSED auto status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -278,6 +792,12 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
     DEBUG_ASSERT(list_is_empty(&page_list));
 
+    UnmapZeroPageRangeLocked(start, end - start);
+
+    // clones that read through to us get our new pages
+    if (!children_.is_empty())
+        UnmapClonesRangeLocked(start, end - start);
+
     // for now we only support committing as much as we were asked for
     DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
 
@@ -294,6 +814,11 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
     AutoLock a(lock_);
 
+    // a clone's pages can't be made contiguous with its parent's, nor can the
+    // ones a page source supplies
+    if (parent_ || page_source_)
+        return ERR_NOT_SUPPORTED;
+
     // trim the size
     if (!TrimRange(offset, len, size_))
         return ERR_OUT_OF_RANGE;
@@ -306,6 +831,15 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + len);
     DEBUG_ASSERT(end > offset);
 
+    // contiguous memory is for handing to hardware, which is going to
+    // expect it to stay where it is
+    pages_exposed_ = true;
+    if (!compressed_pages_.is_empty()) {
+        status_t status = DecompressRangeLocked(ROUNDDOWN(offset, PAGE_SIZE), end);
+        if (status != NO_ERROR)
+            return status;
+    }
+
     // make a pass through the list, making sure we have an empty run on the object
     size_t count = 0;
     for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
@@ -315,11 +849,14 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
     DEBUG_ASSERT(count == len / PAGE_SIZE);
 
+    if (!page_list_.HasRoom(count))
+        return ERR_NO_MEMORY;
+
     // allocate count number of pages
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_, alignment_log2, nullptr, &page_list);
+    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, alignment_log2, nullptr, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -335,9 +872,6 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         __UNUSED auto status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -345,6 +879,8 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
             *committed += PAGE_SIZE;
     }
 
+    UnmapZeroPageRangeLocked(ROUNDDOWN(offset, PAGE_SIZE), end - ROUNDDOWN(offset, PAGE_SIZE));
+
     // for now we only support committing as much as we were asked for
     DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
 
@@ -383,16 +919,194 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
         // unmap any pages the region may have mapped that intersect this range
         r.UnmapVmoRangeLocked(start, page_aligned_len);
     }
+    UnmapClonesRangeLocked(start, page_aligned_len);
+
+    // free the pages in the range
+    size_t freed = page_list_.FreePages(start, end);
+    freed += FreeCompressedRangeLocked(start, end);
+    if (decommitted)
+        *decommitted = freed * PAGE_SIZE;
 
-    // iterate through the pages, freeing them
-    while (start < end) {
-        auto status = page_list_.FreePage(start);
-        if (status == NO_ERROR && decommitted) {
-            *decommitted += PAGE_SIZE;
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::PrefetchRange(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    // anything else can have its pages now
+    if (!page_source_)
+        return CommitRange(offset, len, nullptr);
+
+    AutoLock a(lock_);
+
+    if (!TrimRange(offset, len, size_))
+        return ERR_OUT_OF_RANGE;
+
+    // ask for each run of pages we don't have, without waiting on any
+    uint64_t end = ROUNDUP_PAGE_SIZE(offset + len);
+    uint64_t run = 0;
+    for (uint64_t o = ROUNDDOWN(offset, PAGE_SIZE); o <= end; o += PAGE_SIZE) {
+        if (o < end && !page_list_.GetPage(o)) {
+            run += PAGE_SIZE;
+            continue;
+        }
+        if (run > 0) {
+            status_t status = page_source_->Prefetch(o - run, run);
+            if (status != NO_ERROR)
+                return status;
+            run = 0;
         }
-        start += PAGE_SIZE;
     }
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::DontNeedRange(uint64_t offset, uint64_t len) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    AutoLock a(lock_);
 
+    if (!TrimRange(offset, len, size_))
+        return ERR_OUT_OF_RANGE;
+
+    // only what CompressIdlePagesLocked() would take is worth marking
+    if (!page_source_ && (!compressible_ || parent_ || !children_.is_empty() || pages_exposed_))
+        return NO_ERROR;
+
+    // A page only partly in the range goes too: a clean page comes back as
+    // it was, and marking one idle only means it's compressed sooner.
+    uint64_t end = ROUNDUP_PAGE_SIZE(offset + len);
+    for (uint64_t o = ROUNDDOWN(offset, PAGE_SIZE); o < end; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(o);
+        if (!p || p->pin_count > 0)
+            continue;
+
+        if (page_source_) {
+            if (p->flags & VM_PAGE_FLAG_DIRTY)
+                continue;
+            for (auto& r : region_list_) {
+                r.UnmapVmoRangeLocked(o, PAGE_SIZE);
+            }
+            page_list_.FreePage(o);
+        } else if (!(p->flags & VM_PAGE_FLAG_IDLE)) {
+            // as if the first pass of the idle scan had already seen it
+            for (auto& r : region_list_) {
+                r.UnmapVmoRangeLocked(o, PAGE_SIZE);
+            }
+            p->flags |= VM_PAGE_FLAG_IDLE;
+        }
+    }
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+
+    AutoLock a(lock_);
+
+    if (offset > size_ || len > size_ - offset)
+        return ERR_OUT_OF_RANGE;
+
+    // pages shared with a parent or clones, that may be purged, or that would
+    // have to be paged in first, can't be handed over whole
+    if (parent_ || !children_.is_empty() || purgeable_ || page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    if (len == 0)
+        return NO_ERROR;
+
+    uint64_t end = offset + len;
+
+    // fill in any holes, so the caller gets a page for every offset
+    size_t pinned = 0;
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        vm_page_t* p = FaultPageLocked(o, VMM_PF_FLAG_WRITE);
+        if (!p)
+            return ERR_NO_MEMORY;
+        if (p->pin_count > 0)
+            pinned++;
+    }
+
+    // a page a copy is still using can't be handed over, so the caller gets a
+    // copy of it instead and the original is freed when the copy is done
+    list_node copies = LIST_INITIAL_VALUE(copies);
+    if (pinned > 0 && pmm_alloc_pages(pinned, pmm_alloc_flags_, &copies) < pinned) {
+        pmm_free(&copies);
+        return ERR_NO_MEMORY;
+    }
+
+    for (auto& r : region_list_) {
+        r.UnmapVmoRangeLocked(offset, len);
+    }
+
+    list_node taken = LIST_INITIAL_VALUE(taken);
+    __UNUSED size_t count = page_list_.TakePages(offset, end, &taken);
+    DEBUG_ASSERT(count == len / PAGE_SIZE);
+
+    vm_page_t* p;
+    while ((p = list_remove_head_type(&taken, vm_page_t, free.node)) != nullptr) {
+        p->state = VM_PAGE_STATE_ALLOC;
+        if (p->pin_count > 0) {
+            vm_page_t* copy = list_remove_head_type(&copies, vm_page_t, free.node);
+            DEBUG_ASSERT(copy);
+            memcpy(paddr_to_kvaddr(vm_page_to_paddr(copy)),
+                   paddr_to_kvaddr(vm_page_to_paddr(p)), PAGE_SIZE);
+            copy->state = VM_PAGE_STATE_ALLOC;
+            p = copy;
+        }
+        list_add_tail(pages, &p->free.node);
+    }
+    DEBUG_ASSERT(list_is_empty(&copies));
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+    DEBUG_ASSERT(magic_ == MAGIC);
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!page_source_)
+        return ERR_NOT_SUPPORTED;
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+
+    {
+        AutoLock a(lock_);
+
+        if (offset > size_ || len > size_ - offset)
+            return ERR_OUT_OF_RANGE;
+        if (list_length(pages) < len / PAGE_SIZE)
+            return ERR_INVALID_ARGS;
+
+        // nothing of ours is mapped at offsets we have no page for, so there's
+        // nothing to unmap
+        uint64_t end = offset + len;
+        for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+            vm_page_t* p = list_remove_head_type(pages, vm_page_t, free.node);
+            DEBUG_ASSERT(p);
+
+            if (page_list_.GetPage(o)) {
+                // supplied twice, or written by someone since it was asked for
+                pmm_free_page(p);
+                continue;
+            }
+
+            // whatever flags it had in the object it was taken from don't
+            // matter here; it's clean until written
+            p->flags = 0;
+            p->state = VM_PAGE_STATE_OBJECT;
+            __UNUSED auto status = page_list_.AddPage(p, o);
+            DEBUG_ASSERT(status == NO_ERROR);
+        }
+    }
+
+    page_source_->OnPagesSupplied(offset, len);
     return NO_ERROR;
 }
 
@@ -404,6 +1118,10 @@ status_t VmObjectPaged::Resize(uint64_t s) {
     if (s > MAX_SIZE)
         return ERR_OUT_OF_RANGE;
 
+    // the page source would be asked for pages it doesn't have
+    if (page_source_)
+        return ERR_NOT_SUPPORTED;
+
     AutoLock a(lock_);
 
     // see if we're shrinking the vmo
@@ -420,12 +1138,11 @@ status_t VmObjectPaged::Resize(uint64_t s) {
                 // unmap any pages the region may have mapped that intersect this range
                 r.UnmapVmoRangeLocked(start, page_aligned_len);
             }
+            UnmapClonesRangeLocked(start, page_aligned_len);
 
-            // iterate through the pages, freeing them
-            while (start < end) {
-                page_list_.FreePage(start);
-                start += PAGE_SIZE;
-            }
+            // free the pages in the range
+            page_list_.FreePages(start, end);
+            FreeCompressedRangeLocked(start, end);
         }
     }
 
@@ -444,35 +1161,70 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
     if (bytes_copied)
         *bytes_copied = 0;
 
-    AutoLock a(lock_);
-
     // trim the size
-    if (!TrimRange(offset, len, size_))
-        return ERR_OUT_OF_RANGE;
+    {
+        AutoLock a(lock_);
+        if (!TrimRange(offset, len, size_))
+            return ERR_OUT_OF_RANGE;
+    }
 
     // was in range, just zero length
     if (len == 0)
         return 0;
 
-    // walk the list of pages and do the write
+    // Look up, and fault in if need be, one page at a time with the lock held,
+    // but do the copy itself with it dropped so a large copy doesn't hold up
+    // faults and other copies on the object.  The page is pinned meanwhile, so
+    // it stays allocated even if it is decommitted or purged under us.  A page
+    // that has to come from the page source is waited for with it dropped too.
+    vm_page_t* p = nullptr;
+    PageRequest request;
+    status_t status = NO_ERROR;
     size_t dest_offset = 0;
     while (len > 0) {
         size_t page_offset = offset % PAGE_SIZE;
         size_t tocopy = MIN(PAGE_SIZE - page_offset, len);
 
-        // fault in the page
-        vm_page_t* p = FaultPageLocked(offset, write ? VMM_PF_FLAG_WRITE : 0);
-        if (!p)
-            return ERR_NO_MEMORY;
+        {
+            AutoLock a(lock_);
+            if (p) {
+                unpin_page(p);
+                p = nullptr;
+            }
+
+            // the object may have shrunk since the last page
+            if (offset >= size_)
+                break;
+
+            // fault in the page
+            p = FaultPageLocked(offset, write ? VMM_PF_FLAG_WRITE : 0);
+            if (p) {
+                pin_page(p);
+            } else {
+                if (!page_source_)
+                    return ERR_NO_MEMORY;
+                // ask for the rest of the copy's pages along with it
+                status = RequestPageLocked(offset, len, &request);
+                if (status != ERR_SHOULD_WAIT)
+                    return status;
+            }
+        }
+
+        if (!p) {
+            status = request.Wait();
+            if (status != NO_ERROR)
+                return status;
+            continue;
+        }
 
         // compute the kernel mapping of this page
         paddr_t pa = vm_page_to_paddr(p);
         uint8_t* page_ptr = reinterpret_cast<uint8_t*>(paddr_to_kvaddr(pa));
 
         // call the copy routine
-        auto err = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
-        if (err < 0)
-            return err;
+        status = copyfunc(page_ptr + page_offset, dest_offset, tocopy);
+        if (status < 0)
+            break;
 
         offset += tocopy;
         if (bytes_copied)
@@ -481,7 +1233,12 @@ status_t VmObjectPaged::ReadWriteInternal(uint64_t offset, size_t len, size_t* b
         len -= tocopy;
     }
 
-    return NO_ERROR;
+    if (p) {
+        AutoLock a(lock_);
+        unpin_page(p);
+    }
+
+    return status;
 }
 
 status_t VmObjectPaged::Read(void* _ptr, uint64_t offset, size_t len, size_t* bytes_read) {
@@ -574,6 +1331,15 @@ status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, user_ptr<paddr_t>
     if (unlikely(table_size > buffer_size))
         return ERR_BUFFER_TOO_SMALL;
 
+    // whoever asks is going to use the addresses, so the pages have to
+    // stay where they are from now on
+    pages_exposed_ = true;
+    if (!compressed_pages_.is_empty()) {
+        status_t status = DecompressRangeLocked(start_page_offset, end_page_offset);
+        if (status != NO_ERROR)
+            return status;
+    }
+
     size_t index = 0;
     for (uint64_t off = start_page_offset; off != end_page_offset; off += PAGE_SIZE, index++) {
         // grab a pointer to the page only if it's already present
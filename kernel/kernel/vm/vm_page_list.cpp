@@ -9,6 +9,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/vm.h>
+#include <lib/counters.h>
 #include <new.h>
 #include <trace.h>
 
@@ -16,9 +17,35 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(page_list_node_bytes, "vm.page_list_node.bytes");
+
+// Return pages the list no longer holds to the pmm.  A page that is pinned by
+// a copy in flight is instead marked as no longer belonging to an object, and
+// the copy frees it when it unpins it.
+static void free_page_list(list_node* list) {
+    list_node to_free = LIST_INITIAL_VALUE(to_free);
+    size_t count = 0;
+
+    vm_page_t* p;
+    while ((p = list_remove_head_type(list, vm_page_t, free.node)) != nullptr) {
+        if (p->pin_count > 0) {
+            p->state = VM_PAGE_STATE_ALLOC;
+            continue;
+        }
+        list_add_tail(&to_free, &p->free.node);
+        count++;
+    }
+
+    if (count > 0) {
+        __UNUSED auto freed = pmm_free(&to_free);
+        DEBUG_ASSERT(freed == count);
+    }
+}
+
 VmPageListNode::VmPageListNode(uint64_t offset)
     : obj_offset_(offset) {
     LTRACEF("%p offset %#" PRIx64 "\n", this, obj_offset_);
+    kcounter_add(&page_list_node_bytes, sizeof(VmPageListNode));
 }
 
 VmPageListNode::~VmPageListNode() {
@@ -29,6 +56,7 @@ VmPageListNode::~VmPageListNode() {
         DEBUG_ASSERT(p == nullptr);
     }
     magic_ = 0;
+    kcounter_add(&page_list_node_bytes, -static_cast<int64_t>(sizeof(VmPageListNode)));
 }
 
 vm_page* VmPageListNode::GetPage(size_t index) {
@@ -68,16 +96,37 @@ VmPageList::~VmPageList() {
     DEBUG_ASSERT(list_.is_empty());
 }
 
+VmPageListNode* VmPageList::FindNode(uint64_t node_offset) {
+    if (last_node_ && last_node_->offset() == node_offset)
+        return last_node_;
+
+    auto pln = list_.find(node_offset);
+    if (!pln.IsValid())
+        return nullptr;
+
+    last_node_ = &*pln;
+    return last_node_;
+}
+
+void VmPageList::EraseNode(VmPageListNode* node) {
+    DEBUG_ASSERT(node->IsEmpty());
+
+    LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
+    if (node == last_node_)
+        last_node_ = nullptr;
+    list_.erase(*node);
+}
+
 status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+    uint64_t node_offset = NodeOffset(offset);
+    size_t index = NodeIndex(offset);
 
     LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
                   node_offset, index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         AllocChecker ac;
         mxtl::unique_ptr<VmPageListNode> pl =
             mxtl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
@@ -88,24 +137,31 @@ status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
         __UNUSED auto status = pl->AddPage(p, index);
         DEBUG_ASSERT(status == NO_ERROR);
 
+        last_node_ = pl.get();
         list_.insert(mxtl::move(pl));
     } else {
-        pln->AddPage(p, index);
+        auto status = pln->AddPage(p, index);
+        if (status != NO_ERROR)
+            return status;
     }
 
+    count_++;
+    if (account_)
+        account_->Charge(1);
+
     return NO_ERROR;
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+    uint64_t node_offset = NodeOffset(offset);
+    size_t index = NodeIndex(offset);
 
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         return nullptr;
     }
 
@@ -113,15 +169,15 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
 }
 
 status_t VmPageList::FreePage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
-    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+    uint64_t node_offset = NodeOffset(offset);
+    size_t index = NodeIndex(offset);
 
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
     // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    auto pln = FindNode(node_offset);
+    if (!pln) {
         return ERR_NOT_FOUND;
     }
 
@@ -129,17 +185,66 @@ status_t VmPageList::FreePage(uint64_t offset) {
     auto page = pln->RemovePage(index);
     if (page) {
         // if it was the last page in the node, remove the node from the tree
-        if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
-        }
+        if (pln->IsEmpty())
+            EraseNode(pln);
 
-        pmm_free_page(page);
+        count_--;
+        if (account_)
+            account_->Uncharge(1);
+
+        if (page->pin_count > 0)
+            page->state = VM_PAGE_STATE_ALLOC;
+        else
+            pmm_free_page(page);
     }
 
     return NO_ERROR;
 }
 
+size_t VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start_offset, end_offset);
+
+    list_node list;
+    list_initialize(&list);
+
+    size_t count = TakePages(start_offset, end_offset, &list);
+
+    // return all the pages to the pmm at once
+    free_page_list(&list);
+
+    return count;
+}
+
+size_t VmPageList::TakePages(uint64_t start_offset, uint64_t end_offset, list_node* pages) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(start_offset) && IS_PAGE_ALIGNED(end_offset));
+
+    size_t count = 0;
+
+    auto per_page_func = [&](vm_page*& p, uint64_t offset) {
+        // add the page to the list and null out the inner node
+        list_add_tail(pages, &p->free.node);
+        p = nullptr;
+        count++;
+    };
+
+    // walk the nodes covering the range, dropping the ones that end up empty
+    auto pl = list_.lower_bound(NodeOffset(start_offset));
+    while (pl.IsValid() && pl->offset() < end_offset) {
+        VmPageListNode* node = &*pl;
+        ++pl;
+
+        node->ForEveryPageInRange(per_page_func, start_offset, end_offset);
+        if (node->IsEmpty())
+            EraseNode(node);
+    }
+
+    count_ -= count;
+    if (account_ && count > 0)
+        account_->Uncharge(count);
+
+    return count;
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
@@ -160,11 +265,26 @@ size_t VmPageList::FreeAllPages() {
     ForEveryPage(per_page_func);
 
     // return all the pages to the pmm at once
-    __UNUSED auto freed = pmm_free(&list);
-    DEBUG_ASSERT(freed == count);
+    free_page_list(&list);
 
     // empty the tree
+    last_node_ = nullptr;
     list_.clear();
 
+    DEBUG_ASSERT(count == count_);
+    count_ = 0;
+    if (account_ && count > 0)
+        account_->Uncharge(count);
+
     return count;
 }
+
+void VmPageList::SetAccount(mxtl::RefPtr<VmCommitAccount> account) {
+    LTRACEF("%p account %p, %zu pages\n", this, account.get(), count_);
+
+    if (account_ && count_ > 0)
+        account_->Uncharge(count_);
+    account_ = mxtl::move(account);
+    if (account_ && count_ > 0)
+        account_->Charge(count_);
+}
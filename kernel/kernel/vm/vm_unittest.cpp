@@ -9,10 +9,12 @@
 #include <err.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_compressed_page.h>
 #include <kernel/vm/vm_object.h>
 #include <kernel/vm/vm_address_region.h>
 #include <mxtl/array.h>
 #include <new.h>
+#include <string.h>
 #include <unittest.h>
 
 static bool pmm_tests(void* context) {
@@ -33,6 +35,83 @@ static bool pmm_tests(void* context) {
         EXPECT_EQ(1u, ret, "pmm_free_page on single page");
     }
 
+    // allocations bound to a numa node only succeed if it has memory
+    unittest_printf("allocating pages bound to numa nodes\n");
+    {
+        uint node_count = pmm_numa_node_count();
+        EXPECT_GE(node_count, 1u, "pmm_numa_node_count");
+
+        for (uint node = 0; node < node_count; node++) {
+            vm_page_t* page = pmm_alloc_page(PMM_ALLOC_FLAG_NODE(node) | PMM_ALLOC_FLAG_BIND,
+                                             nullptr);
+            EXPECT_NEQ(nullptr, page, "pmm_alloc_page bound to node");
+            if (page)
+                pmm_free_page(page);
+        }
+
+        if (node_count < PMM_MAX_NUMA_NODES) {
+            vm_page_t* page = pmm_alloc_page(PMM_ALLOC_FLAG_NODE(node_count) | PMM_ALLOC_FLAG_BIND,
+                                             nullptr);
+            EXPECT_EQ(nullptr, page, "pmm_alloc_page bound to missing node");
+        }
+    }
+
+    // allocate and free single pages through the per cpu cache, making sure
+    // the free count comes back to where it started
+    unittest_printf("allocating single pages, then freeing them one at a time\n");
+    {
+        static const size_t alloc_count = 256;
+        vm_page_t* pages[alloc_count];
+
+        size_t free_before = pmm_count_free_pages();
+        size_t i;
+        for (i = 0; i < alloc_count; i++) {
+            paddr_t pa;
+            pages[i] = pmm_alloc_page(0, &pa);
+            if (!pages[i])
+                break;
+            EXPECT_EQ(pages[i], paddr_to_vm_page(pa), "pmm_alloc_page paddr");
+            EXPECT_FALSE(page_is_free(pages[i]), "pmm_alloc_page page state");
+        }
+        EXPECT_EQ(alloc_count, i, "pmm_alloc_page count");
+        EXPECT_EQ(free_before - i, pmm_count_free_pages(), "free count after alloc");
+
+        while (i > 0) {
+            auto ret = pmm_free_page(pages[--i]);
+            EXPECT_EQ(1u, ret, "pmm_free_page on single page");
+        }
+        EXPECT_EQ(free_before, pmm_count_free_pages(), "free count after free");
+    }
+
+    // dirty a batch of pages, free them, then make sure zeroed allocations
+    // never hand back a dirty page
+    unittest_printf("allocating zeroed pages\n");
+    {
+        static const size_t alloc_count = 64;
+        list_node list = LIST_INITIAL_VALUE(list);
+
+        auto count = pmm_alloc_pages(alloc_count, PMM_ALLOC_FLAG_KMAP, &list);
+        EXPECT_EQ(alloc_count, count, "pmm_alloc_pages kmap pages");
+        vm_page_t* p;
+        list_for_every_entry (&list, p, vm_page_t, free.node) {
+            memset(paddr_to_kvaddr(vm_page_to_paddr(p)), 0xff, PAGE_SIZE);
+        }
+        pmm_free(&list);
+
+        count = pmm_alloc_pages(alloc_count, PMM_ALLOC_FLAG_ZEROED, &list);
+        EXPECT_EQ(alloc_count, count, "pmm_alloc_pages zeroed pages");
+        list_for_every_entry (&list, p, vm_page_t, free.node) {
+            const uint8_t* ptr = static_cast<const uint8_t*>(paddr_to_kvaddr(vm_page_to_paddr(p)));
+            size_t i;
+            for (i = 0; i < PAGE_SIZE; i++) {
+                if (ptr[i] != 0)
+                    break;
+            }
+            EXPECT_EQ(PAGE_SIZE, i, "zeroed page contents");
+        }
+        pmm_free(&list);
+    }
+
     // allocate a bunch of pages then free them
     unittest_printf("allocating a lot of pages, then freeing them\n");
     {
@@ -276,6 +355,45 @@ static bool vmm_tests(void* context) {
         EXPECT_EQ(0, err, "vmm_free_aspace");
     }
 
+    unittest_printf("allocating many regions, freeing every other one, then refilling the holes\n");
+    {
+        void* ptr[64];
+        void* fill;
+        vmm_aspace_t* aspace;
+        const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+
+        auto err = vmm_create_aspace(&aspace, "test aspace", 0);
+        EXPECT_EQ(0, err, "vmm_allocate_aspace error code");
+        EXPECT_NEQ(nullptr, aspace, "vmm_allocate_aspace pointer");
+
+        for (unsigned int i = 0; i < countof(ptr); ++i) {
+            err = vmm_alloc(aspace, "test", PAGE_SIZE, &ptr[i], 0, 0, 0, arch_rw_flags);
+            EXPECT_EQ(0, err, "vmm_allocate region of memory");
+        }
+
+        // punch one page holes throughout the address space
+        for (unsigned int i = 1; i < countof(ptr); i += 2) {
+            err = vmm_free_region(aspace, reinterpret_cast<vaddr_t>(ptr[i]));
+            EXPECT_EQ(0, err, "vmm_free_region");
+        }
+
+        // allocations which fit in a hole fill the lowest one first
+        for (unsigned int i = 1; i < countof(ptr); i += 2) {
+            err = vmm_alloc(aspace, "test", PAGE_SIZE, &fill, 0, 0, 0, arch_rw_flags);
+            EXPECT_EQ(0, err, "vmm_allocate region of memory");
+            EXPECT_EQ(ptr[i], fill, "first fit into a freed hole");
+        }
+
+        // a larger allocation skips all of the (now filled) holes
+        err = vmm_alloc(aspace, "test", 2 * PAGE_SIZE, &fill, 0, 0, 0, arch_rw_flags);
+        EXPECT_EQ(0, err, "vmm_allocate region of memory");
+        EXPECT_GT(reinterpret_cast<vaddr_t>(fill), reinterpret_cast<vaddr_t>(ptr[countof(ptr) - 1]),
+                  "large allocation placed after existing regions");
+
+        err = vmm_free_aspace(aspace);
+        EXPECT_EQ(0, err, "vmm_free_aspace");
+    }
+
     unittest_printf("test for some invalid arguments\n");
     {
         void* ptr;
@@ -325,6 +443,43 @@ static bool vmm_tests(void* context) {
         aspace.reset();
     }
 
+    unittest_printf("destroying an address space with committed mappings unmaps all of them\n");
+    {
+        auto aspace = VmAspace::Create(0, "test aspace3");
+        const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+
+        // spread out enough to need several page tables
+        void* ptr[4];
+        static const size_t alloc_size = 64 * PAGE_SIZE;
+        for (unsigned int i = 0; i < countof(ptr); ++i) {
+            auto err = aspace->Alloc("test", alloc_size, &ptr[i], 0, 4 * alloc_size,
+                                     VMM_FLAG_COMMIT, arch_rw_flags);
+            EXPECT_EQ(NO_ERROR, err, "allocating region\n");
+        }
+        for (void* p : ptr) {
+            paddr_t paddr;
+            for (size_t o = 0; o < alloc_size; o += PAGE_SIZE) {
+                auto err = arch_mmu_query(&aspace->arch_aspace(),
+                                          reinterpret_cast<vaddr_t>(p) + o, &paddr, nullptr);
+                EXPECT_EQ(NO_ERROR, err, "committed page mapped");
+            }
+        }
+
+        auto err = aspace->Destroy();
+        EXPECT_EQ(NO_ERROR, err, "destroying aspace");
+        for (void* p : ptr) {
+            paddr_t paddr;
+            for (size_t o = 0; o < alloc_size; o += PAGE_SIZE) {
+                err = arch_mmu_query(&aspace->arch_aspace(),
+                                     reinterpret_cast<vaddr_t>(p) + o, &paddr, nullptr);
+                EXPECT_EQ(ERR_NOT_FOUND, err, "page unmapped by destroy");
+            }
+        }
+        EXPECT_EQ(NO_ERROR, aspace->Destroy(), "destroying aspace twice");
+
+        aspace.reset();
+    }
+
     unittest_printf("verify there are no test aspaces left around\n");
     DumpAllAspaces();
 
@@ -364,6 +519,84 @@ static bool vmm_object_tests(void* context) {
         EXPECT_EQ(ROUNDUP_PAGE_SIZE(alloc_size), committed, "committing vm object\n");
     }
 
+    unittest_printf("creating vm object, committing and decommitting sparse ranges\n");
+    {
+        // big enough to span several page list nodes
+        static const size_t alloc_size = PAGE_SIZE * 256;
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+        EXPECT_TRUE(vmo, "vmobject creation\n");
+
+        uint64_t committed;
+        auto ret = vmo->CommitRange(PAGE_SIZE * 60, PAGE_SIZE * 8, &committed);
+        EXPECT_EQ(0, ret, "committing vm object\n");
+        EXPECT_EQ(PAGE_SIZE * 8, committed, "committing vm object\n");
+
+        // overlaps the range already committed
+        ret = vmo->CommitRange(PAGE_SIZE * 50, PAGE_SIZE * 100, &committed);
+        EXPECT_EQ(0, ret, "committing vm object\n");
+        EXPECT_EQ(PAGE_SIZE * 92, committed, "committing vm object\n");
+
+        uint64_t decommitted;
+        ret = vmo->DecommitRange(PAGE_SIZE * 40, PAGE_SIZE * 30, &decommitted);
+        EXPECT_EQ(0, ret, "decommitting vm object\n");
+        EXPECT_EQ(PAGE_SIZE * 20, decommitted, "decommitting vm object\n");
+
+        ret = vmo->CommitRange(0, alloc_size, &committed);
+        EXPECT_EQ(0, ret, "committing vm object\n");
+        EXPECT_EQ(alloc_size - PAGE_SIZE * 80, committed, "committing vm object\n");
+
+        ret = vmo->DecommitRange(0, alloc_size, &decommitted);
+        EXPECT_EQ(0, ret, "decommitting vm object\n");
+        EXPECT_EQ(alloc_size, decommitted, "decommitting vm object\n");
+    }
+
+    unittest_printf("creating vm object, taking pages out of it\n");
+    {
+        static const size_t alloc_size = PAGE_SIZE * 8;
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+        EXPECT_TRUE(vmo, "vmobject creation\n");
+
+        // only some of the range is committed up front
+        static const uint32_t pattern = 0x12345678;
+        size_t bytes_written;
+        auto ret = vmo->Write(&pattern, PAGE_SIZE * 2, sizeof(pattern), &bytes_written);
+        EXPECT_EQ(0, ret, "writing to object\n");
+
+        list_node pages = LIST_INITIAL_VALUE(pages);
+        ret = vmo->TakePages(PAGE_SIZE, PAGE_SIZE * 3 + 1, &pages);
+        EXPECT_EQ(ERR_INVALID_ARGS, ret, "taking unaligned range\n");
+        ret = vmo->TakePages(PAGE_SIZE * 4, PAGE_SIZE * 8, &pages);
+        EXPECT_EQ(ERR_OUT_OF_RANGE, ret, "taking range past the end\n");
+
+        ret = vmo->TakePages(PAGE_SIZE, PAGE_SIZE * 3, &pages);
+        EXPECT_EQ(0, ret, "taking pages\n");
+        EXPECT_EQ(3u, list_length(&pages), "taking pages\n");
+        EXPECT_EQ(0u, vmo->AllocatedPages(), "taking pages\n");
+
+        // they come out in order, and keep their contents
+        vm_page_t* p = list_next_type(&pages, list_peek_head(&pages), vm_page_t, free.node);
+        EXPECT_EQ(pattern, *reinterpret_cast<uint32_t*>(paddr_to_kvaddr(vm_page_to_paddr(p))),
+                  "taking pages\n");
+
+        // and the object reads back as zeros
+        uint32_t val = 1;
+        size_t bytes_read;
+        ret = vmo->Read(&val, PAGE_SIZE * 2, sizeof(val), &bytes_read);
+        EXPECT_EQ(0, ret, "reading from object\n");
+        EXPECT_EQ(0u, val, "reading from object\n");
+
+        pmm_free(&pages);
+
+        // a clone shares its parent's pages, so neither may give them away
+        mxtl::RefPtr<VmObject> clone;
+        ret = vmo->CloneCOW(0, alloc_size, &clone);
+        EXPECT_EQ(0, ret, "cloning object\n");
+        ret = vmo->TakePages(0, PAGE_SIZE, &pages);
+        EXPECT_EQ(ERR_NOT_SUPPORTED, ret, "taking pages from a parent\n");
+        ret = clone->TakePages(0, PAGE_SIZE, &pages);
+        EXPECT_EQ(ERR_NOT_SUPPORTED, ret, "taking pages from a clone\n");
+    }
+
     unittest_printf("creating vm object, committing contiguous memory\n");
     {
         static const size_t alloc_size = PAGE_SIZE * 16;
@@ -416,6 +649,56 @@ static bool vmm_object_tests(void* context) {
         EXPECT_EQ(NO_ERROR, err, "unmapping object");
     }
 
+    unittest_printf("creating contiguous vm object, mapping it with large pages\n");
+    {
+        const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+        static const size_t alloc_size = 2UL << VM_LARGE_PAGE_SHIFT;
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+        EXPECT_TRUE(vmo, "vmobject creation\n");
+
+        uint64_t committed;
+        auto ret = vmo->CommitRangeContiguous(0, alloc_size, &committed, VM_LARGE_PAGE_SHIFT);
+        EXPECT_EQ(NO_ERROR, ret, "committing vm object contig\n");
+
+        auto ka = VmAspace::kernel_aspace();
+        void* ptr;
+        ret = ka->MapObject(vmo, "test", 0, alloc_size, &ptr, 0, 0, VMM_FLAG_LARGE_PAGES,
+                            arch_rw_flags);
+        EXPECT_EQ(NO_ERROR, ret, "mapping object");
+        EXPECT_TRUE(IS_ALIGNED((vaddr_t)ptr, 1UL << VM_LARGE_PAGE_SHIFT), "mapping alignment");
+
+        // the whole range is mapped up front, in order
+        paddr_t base_pa = 0;
+        uint flags;
+        ret = arch_mmu_query(&ka->arch_aspace(), (vaddr_t)ptr, &base_pa, &flags);
+        EXPECT_EQ(NO_ERROR, ret, "querying mapping");
+        EXPECT_TRUE(IS_ALIGNED(base_pa, 1UL << VM_LARGE_PAGE_SHIFT), "physical alignment");
+        for (size_t o = 0; o < alloc_size; o += PAGE_SIZE) {
+            paddr_t pa = 0;
+            ret = arch_mmu_query(&ka->arch_aspace(), (vaddr_t)ptr + o, &pa, &flags);
+            EXPECT_EQ(NO_ERROR, ret, "querying mapping");
+            EXPECT_EQ(base_pa + o, pa, "querying mapping");
+        }
+
+        // fill with known pattern and test
+        if (!fill_and_test(ptr, alloc_size))
+            all_ok = false;
+
+        // taking a single page out of the middle leaves the rest mapped
+        uint64_t decommitted;
+        ret = vmo->DecommitRange(PAGE_SIZE, PAGE_SIZE, &decommitted);
+        EXPECT_EQ(NO_ERROR, ret, "decommitting page");
+        paddr_t pa;
+        ret = arch_mmu_query(&ka->arch_aspace(), (vaddr_t)ptr + PAGE_SIZE, &pa, &flags);
+        EXPECT_NEQ(NO_ERROR, ret, "decommitted page unmapped");
+        ret = arch_mmu_query(&ka->arch_aspace(), (vaddr_t)ptr + 2 * PAGE_SIZE, &pa, &flags);
+        EXPECT_EQ(NO_ERROR, ret, "neighbor still mapped");
+        EXPECT_EQ(base_pa + 2 * PAGE_SIZE, pa, "neighbor still mapped");
+
+        auto err = ka->FreeRegion((vaddr_t)ptr);
+        EXPECT_EQ(NO_ERROR, err, "unmapping object");
+    }
+
     unittest_printf("creating vm object, mapping it, dropping ref before unmapping\n");
     {
         const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
@@ -624,8 +907,35 @@ static bool vmm_object_tests(void* context) {
     END_TEST;
 }
 
+static bool vm_compressed_page_tests(void* context) {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    mxtl::Array<uint8_t> a(new (&ac) uint8_t[PAGE_SIZE], PAGE_SIZE);
+    REQUIRE_TRUE(ac.check(), "allocating page buffer");
+    mxtl::Array<uint8_t> b(new (&ac) uint8_t[PAGE_SIZE], PAGE_SIZE);
+    REQUIRE_TRUE(ac.check(), "allocating page buffer");
+
+    // a page with little in it comes back as it went in
+    memset(a.get(), 0, PAGE_SIZE);
+    memcpy(a.get() + 100, "compressed", 10);
+    auto cp = VmCompressedPage::Compress(PAGE_SIZE * 3, a.get());
+    REQUIRE_NONNULL(cp.get(), "compressing page");
+    EXPECT_EQ(PAGE_SIZE * 3u, cp->offset(), "compressed page offset");
+    memset(b.get(), 0xff, PAGE_SIZE);
+    EXPECT_EQ(NO_ERROR, cp->Decompress(b.get()), "decompressing page");
+    EXPECT_EQ(0, memcmp(a.get(), b.get(), PAGE_SIZE), "decompressed contents");
+
+    // one full of noise isn't kept
+    fill_region(99, a.get(), PAGE_SIZE);
+    EXPECT_NULL(VmCompressedPage::Compress(0, a.get()).get(), "compressing noise");
+
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(vm_tests)
 UNITTEST("pmm tests", pmm_tests)
 UNITTEST("vmm tests", vmm_tests)
 UNITTEST("vm object based test", vmm_object_tests)
+UNITTEST("vm compressed page tests", vm_compressed_page_tests)
 UNITTEST_END_TESTCASE(vm_tests, "vmtests", "Virtual memory tests", NULL, NULL);
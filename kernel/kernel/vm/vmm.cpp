@@ -14,6 +14,7 @@
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
 #include <string.h>
 #include <trace.h>
@@ -139,7 +140,11 @@ void vmm_context_switch(vmm_aspace_t* oldspace, vmm_aspace_t* newaspace) {
 
 void DumpProcessMemoryUsage(const char* prefix, size_t min_pages);
 
+KCOUNTER(vm_page_fault_count, "vm.page_fault");
+
 status_t vmm_page_fault_handler(vaddr_t addr, uint flags) {
+    kcounter_add(&vm_page_fault_count, 1);
+
 #if TRACE_PAGE_FAULT || LOCAL_TRACE
     thread_t* current_thread = get_current_thread();
     TRACEF("thread %s va 0x%lx, flags 0x%x\n", current_thread->name, addr, flags);
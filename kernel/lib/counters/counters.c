@@ -0,0 +1,84 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/counters.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+#endif
+
+extern const struct k_counter_desc __start_kcounters[] __WEAK;
+extern const struct k_counter_desc __stop_kcounters[] __WEAK;
+
+size_t kcounter_count(void)
+{
+    return __stop_kcounters - __start_kcounters;
+}
+
+const struct k_counter_desc* kcounter_get(size_t index)
+{
+    if (index >= kcounter_count())
+        return NULL;
+    return &__start_kcounters[index];
+}
+
+int64_t kcounter_get_cpu(const struct k_counter_desc* c, uint cpu)
+{
+    if (cpu >= SMP_MAX_CPUS)
+        return 0;
+    return __atomic_load_n(&c->slots[cpu].value, __ATOMIC_RELAXED);
+}
+
+int64_t kcounter_sum(const struct k_counter_desc* c)
+{
+    int64_t sum = 0;
+    for (uint i = 0; i < arch_max_num_cpus(); i++)
+        sum += kcounter_get_cpu(c, i);
+    return sum;
+}
+
+#if WITH_LIB_CONSOLE
+
+static int cmd_counters(int argc, const cmd_args *argv)
+{
+    bool percpu = false;
+    const char* prefix = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i].str, "-c")) {
+            percpu = true;
+        } else if (argv[i].str[0] == '-') {
+            printf("usage: %s [-c] [name prefix]\n", argv[0].str);
+            printf("  -c : also show each cpu's value\n");
+            return -1;
+        } else {
+            prefix = argv[i].str;
+        }
+    }
+
+    uint num_cpus = arch_max_num_cpus();
+    for (const struct k_counter_desc* c = __start_kcounters; c != __stop_kcounters; c++) {
+        if (prefix && strncmp(c->name, prefix, strlen(prefix)))
+            continue;
+        printf("%-32s %14" PRId64, c->name, kcounter_sum(c));
+        if (percpu) {
+            for (uint i = 0; i < num_cpus; i++)
+                printf(" %10" PRId64, kcounter_get_cpu(c, i));
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("counters", "show kernel event counters", &cmd_counters)
+STATIC_COMMAND_END(counters);
+
+#endif
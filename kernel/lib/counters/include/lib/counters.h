@@ -0,0 +1,68 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS
+
+/* Per-cpu event counters for kernel statistics.
+ *
+ * Each counter has a slot per cpu, each slot on its own cache line, so
+ * bumping a counter only touches a line that belongs to the current cpu.
+ * Readers sum the slots. Counters are defined anywhere in the kernel with
+ *
+ *   KCOUNTER(page_fault_counter, "vm.page_fault");
+ *   ...
+ *   kcounter_add(&page_fault_counter, 1);
+ *
+ * and are gathered through the kcounters section, so they show up in the
+ * "counters" console command and MX_INFO_KERNEL_COUNTERS without being
+ * registered anywhere else. */
+
+struct k_counter_slot {
+    int64_t value;
+} __CPU_ALIGN;
+
+struct k_counter_desc {
+    const char* name;
+    struct k_counter_slot* slots; /* SMP_MAX_CPUS of them */
+};
+
+#define KCOUNTER(var, counter_name)                                         \
+    static struct k_counter_slot var##_slots[SMP_MAX_CPUS];                 \
+    static const struct k_counter_desc var                                  \
+        __ALIGNED(sizeof(void*)) __SECTION("kcounters")                     \
+        __attribute__((used)) = {                                           \
+        .name = counter_name,                                               \
+        .slots = var##_slots,                                               \
+    }
+
+static inline void kcounter_add(const struct k_counter_desc* c, int64_t delta)
+{
+    /* The thread may move to another cpu between reading the cpu number and
+     * the add, so the add is atomic. It is almost never contended. */
+    __atomic_fetch_add(&c->slots[arch_curr_cpu_num()].value, delta, __ATOMIC_RELAXED);
+}
+
+/* number of counters defined in the kernel */
+size_t kcounter_count(void);
+
+/* the index'th counter, in no particular order, or NULL */
+const struct k_counter_desc* kcounter_get(size_t index);
+
+/* one cpu's value, and the value summed over all cpus */
+int64_t kcounter_get_cpu(const struct k_counter_desc* c, uint cpu);
+int64_t kcounter_sum(const struct k_counter_desc* c);
+
+__END_CDECLS
@@ -6,6 +6,7 @@
 
 #include <lib/crypto/global_prng.h>
 
+#include <arch/ops.h>
 #include <assert.h>
 #include <dev/hw_rng.h>
 #include <err.h>
@@ -14,6 +15,7 @@
 #include <lib/crypto/prng.h>
 #include <new.h>
 #include <lk/init.h>
+#include <string.h>
 
 namespace crypto {
 
@@ -21,21 +23,74 @@ namespace GlobalPRNG {
 
 PRNG* GetInstance() {
     static PRNG* global_prng = nullptr;
-    static mutex_t lock = MUTEX_INITIAL_VALUE(lock);
 
-    AllocChecker ac;
-
-    AutoLock guard(lock);
-    if (unlikely(!global_prng)) {
-        global_prng = new (&ac) PRNG(nullptr, 0);
+    PRNG* prng = __atomic_load_n(&global_prng, __ATOMIC_ACQUIRE);
+    if (unlikely(!prng)) {
+        AllocChecker ac;
+        PRNG* created = new (&ac) PRNG(nullptr, 0);
         ASSERT(ac.check());
+        if (__atomic_compare_exchange_n(&global_prng, &prng, created, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            prng = created;
+        } else {
+            delete created;
+        }
     }
-    return global_prng;
+    return prng;
 }
 
-static void EarlyBootSeed(uint level) {
-    PRNG* prng = GetInstance();
+namespace {
+
+struct PerCpuPRNG {
+    Mutex lock;
+    PRNG* prng = nullptr;
+    // the value of |generation| it was last seeded at
+    uint64_t generation = 0;
+    size_t drawn = 0;
+} __CPU_ALIGN;
+
+PerCpuPRNG per_cpu_prng[SMP_MAX_CPUS];
+
+// bumped whenever entropy is added to the global PRNG
+uint64_t generation;
+
+} // namespace
+
+void Draw(void* out, int size) {
+    DEBUG_ASSERT(size >= 0);
+
+    // Holding the lock rather than pinning the thread, it doesn't matter if
+    // we're migrated: the lock is only ever contended when that happens.
+    PerCpuPRNG& pc = per_cpu_prng[arch_curr_cpu_num()];
+    AutoLock guard(&pc.lock);
 
+    uint64_t gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    if (unlikely(!pc.prng || pc.generation != gen || pc.drawn >= kReseedBytes)) {
+        uint8_t seed[PRNG::kMinEntropy];
+        GetInstance()->Draw(seed, sizeof(seed));
+        if (!pc.prng) {
+            AllocChecker ac;
+            pc.prng = new (&ac) PRNG(seed, sizeof(seed));
+            ASSERT(ac.check());
+        } else {
+            pc.prng->AddEntropy(seed, sizeof(seed));
+        }
+        // Get rid of the stack copy of the seed
+        memset(seed, 0, sizeof(seed));
+        pc.generation = gen;
+        pc.drawn = 0;
+    }
+
+    pc.prng->Draw(out, size);
+    pc.drawn += size;
+}
+
+void AddEntropy(const void* data, int size) {
+    GetInstance()->AddEntropy(data, size);
+    __atomic_fetch_add(&generation, 1, __ATOMIC_RELEASE);
+}
+
+static void EarlyBootSeed(uint level) {
     uint8_t buf[32] = {0};
     // TODO(security): Have the PRNG reseed based on usage
     size_t fetched = 0;
@@ -53,11 +108,11 @@ static void EarlyBootSeed(uint level) {
         // hardware that we should remove and attempt to do better.  If this
         // fallback is used, it breaks all cryptography used on the system.
         // *CRITICAL*
-        prng->AddEntropy(buf, sizeof(buf));
+        AddEntropy(buf, sizeof(buf));
         return;
     }
     DEBUG_ASSERT(fetched == sizeof(buf));
-    prng->AddEntropy(buf, static_cast<int>(fetched));
+    AddEntropy(buf, static_cast<int>(fetched));
 }
 
 } //namespace GlobalPRNG
@@ -7,6 +7,7 @@
 #include <lib/crypto/global_prng.h>
 
 #include <stdint.h>
+#include <string.h>
 #include <unittest.h>
 
 namespace crypto {
@@ -24,10 +25,32 @@ bool identical(void*) {
     END_TEST;
 }
 
+// Consecutive draws from the calling cpu's PRNG, including ones that make it
+// reseed, don't repeat.
+bool per_cpu_draw(void*) {
+    BEGIN_TEST;
+
+    uint8_t first[32];
+    GlobalPRNG::Draw(first, sizeof(first));
+
+    uint8_t buf[256];
+    for (size_t drawn = 0; drawn <= GlobalPRNG::kReseedBytes; drawn += sizeof(buf)) {
+        GlobalPRNG::Draw(buf, sizeof(buf));
+        EXPECT_NEQ(0, memcmp(first, buf, sizeof(first)), "repeated output");
+    }
+
+    uint8_t last[32];
+    GlobalPRNG::Draw(last, sizeof(last));
+    EXPECT_NEQ(0, memcmp(first, last, sizeof(first)), "repeated output after a reseed");
+
+    END_TEST;
+}
+
 } // namespace
 
 UNITTEST_START_TESTCASE(global_prng_tests)
 UNITTEST("Identical", identical)
+UNITTEST("PerCpuDraw", per_cpu_draw)
 UNITTEST_END_TESTCASE(global_prng_tests, "global_prng",
                       "Validate global PRNG singleton",
                       NULL, NULL);
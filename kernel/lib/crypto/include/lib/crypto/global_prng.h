@@ -16,6 +16,19 @@ namespace GlobalPRNG {
 // guaranteed to be non-null.
 PRNG* GetInstance();
 
+// Fills |out| with |size| random bytes from the calling cpu's own PRNG, so
+// that callers on different cpus don't contend for the global one.  Each
+// cpu's PRNG is seeded from the global PRNG when first used, and reseeded
+// from it after every kReseedBytes of output and after any entropy is added
+// through AddEntropy().  Blocks until the global PRNG has been seeded.
+void Draw(void* out, int size);
+
+// Mixes |size| bytes of entropy into the global PRNG, and has every cpu's
+// PRNG reseed from it before its next draw.
+void AddEntropy(const void* data, int size);
+
+constexpr size_t kReseedBytes = 64 * 1024;
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
@@ -6,25 +6,36 @@
 
 #include <lib/debuglog.h>
 
+#include <assert.h>
 #include <err.h>
 #include <dev/udisplay.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <lib/user_copy.h>
 #include <lib/io.h>
 #include <lk/init.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "git-version.h"
 
 #define DLOG_SIZE (64 * 1024)
+#define DLOG_MASK (DLOG_SIZE - 1)
 
-static uint8_t DLOG_DATA[DLOG_SIZE];
+static_assert((DLOG_SIZE & DLOG_MASK) == 0, "DLOG_SIZE must be a power of two");
+// Records are written with interrupts off, so at most one per cpu is ever
+// reserved but unpublished, each taking up to two entries with the skip at
+// the end of the buffer. Keeping that well under the log's size means a
+// writer moving the tail only ever walks published records.
+static_assert(SMP_MAX_CPUS * 2 * DLOG_MAX_ENTRY <= DLOG_SIZE / 2, "DLOG_SIZE too small");
+
+static uint8_t DLOG_DATA[DLOG_SIZE] __ALIGNED(8);
 
 static dlog_t DLOG = {
-    .lock = MUTEX_INITIAL_VALUE(DLOG.lock),
     .size = DLOG_SIZE,
     .data = DLOG_DATA,
+    .lock = MUTEX_INITIAL_VALUE(DLOG.lock),
     .readers = LIST_INITIAL_VALUE(DLOG.readers),
 };
 
@@ -32,13 +43,37 @@ static dlog_t DLOG = {
 
 #define ALIGN8(n) (((n) + 7) & (~7))
 
-#define REC(ptr, off) ((dlog_record_t*)((ptr) + (off)))
+#define REC(ptr, off) ((dlog_record_t*)((ptr) + ((off) & DLOG_MASK)))
 
 // To avoid complexity with splitting record headers, this is
 // a mostly-circular buffer -- each record has a next index
 // that can be used to advance to the next record, allowing the
 // leftover space not large enough for a full record at the end
 // to be skipped easily.
+static uint64_t dlog_record_end(uint64_t dst, size_t sz) {
+    uint64_t end = dst + sz;
+    if ((end & DLOG_MASK) + DLOG_MAX_ENTRY > DLOG_SIZE) {
+        end = ROUNDUP(end, DLOG_SIZE);
+    }
+    return end;
+}
+
+// The offset of the record after the one at |off|, from a copy of its header.
+static uint64_t dlog_record_next(uint64_t off, const dlog_record_t* rec) {
+    return off + ((rec->next - off) & DLOG_MASK);
+}
+
+static void dlog_notify_readers(dlog_t* log) {
+    mutex_acquire(&log->lock);
+    // records published from here on need a wakeup of their own
+    __atomic_store_n(&log->notify_pending, false, __ATOMIC_RELEASE);
+    dlog_reader_t* rdr;
+    list_for_every_entry (&log->readers, rdr, dlog_reader_t, node) {
+        event_signal(&rdr->event, false);
+    }
+    mutex_release(&log->lock);
+}
+
 status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     dlog_t* log = &DLOG;
 
@@ -53,44 +88,35 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     // Keep record headers uint64 aligned
     size_t sz = ALIGN8(len + sizeof(dlog_record_t));
 
-    mutex_acquire(&log->lock);
-
-    // Determine location of new record and next record after it
-    uint32_t dst = log->head;
-    uint32_t end = log->head + sz;
-    uint32_t nxt = end;
-    if ((nxt + DLOG_MAX_ENTRY) > log->size) {
-        nxt = 0;
-    }
-
-    // Advance our tail if we write past it.
-    if (log->head != log->tail) {
-        while ((log->tail >= dst) && (log->tail < end)) {
-            log->tail = REC(log->data, log->tail)->next;
-        }
-    }
-
-    // Notify readers and advance their tails if necessary
-    dlog_reader_t* rdr;
-    list_for_every_entry (&log->readers, rdr, dlog_reader_t, node) {
-        if (rdr->tail == log->head) {
-            // Reader view was empty, point reader's tail
-            // at the message we're writing now
-            rdr->tail = dst;
-        } else {
-            // If we're about to overwrite the message at
-            // the reader's tail, advance that tail.
-            // This will never cause the reader view to be "empty".
-            while ((rdr->tail >= dst) && (rdr->tail < end)) {
-                rdr->tail = REC(log->data, rdr->tail)->next;
-            }
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // Claim the space for the new record
+    uint64_t dst = __atomic_load_n(&log->reserve, __ATOMIC_RELAXED);
+    uint64_t end;
+    do {
+        end = dlog_record_end(dst, sz);
+    } while (!__atomic_compare_exchange_n(&log->reserve, &dst, end, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    // Advance the tail past the records we're about to overwrite. Another
+    // writer may be doing the same, and may already be overwriting a record
+    // we're looking at, in which case our compare and swap fails.
+    uint64_t tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+    while (tail + log->size < end) {
+        uint64_t next = dlog_record_next(tail, REC(log->data, tail));
+        if (__atomic_compare_exchange_n(&log->tail, &tail, next, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            tail = next;
         }
-        event_signal(&rdr->event, false);
     }
+    // readers recheck the tail after copying a record, make sure the new
+    // one is visible before any of the record it guards is overwritten
+    __atomic_thread_fence(__ATOMIC_RELEASE);
 
     // Write the new record
     dlog_record_t* rec = REC(log->data, dst);
-    rec->next = nxt;
+    rec->next = (uint32_t)(end & DLOG_MASK);
     rec->datalen = len;
     rec->flags = flags;
     rec->timestamp = current_time_hires();
@@ -99,10 +125,19 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     rec->tid = t->user_tid;
     memcpy(rec->data, ptr, len);
 
-    // Advance the head pointer
-    log->head = nxt;
+    // Publish it once the records reserved before it are, so readers see
+    // them in order. Those writers have interrupts off too, so this is short.
+    while (__atomic_load_n(&log->head, __ATOMIC_ACQUIRE) != dst) {
+        arch_spinloop_pause();
+    }
+    __atomic_store_n(&log->head, end, __ATOMIC_RELEASE);
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    mutex_release(&log->lock);
+    // Only one writer of a burst wakes the readers
+    if (!__atomic_exchange_n(&log->notify_pending, true, __ATOMIC_ACQ_REL)) {
+        dlog_notify_readers(log);
+    }
     return NO_ERROR;
 }
 
@@ -110,32 +145,58 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
 // TODO: filter with flags
 status_t dlog_read_etc(dlog_reader_t* rdr, uint32_t flags, void* ptr, size_t len, bool user) {
     dlog_t* log = rdr->log;
-    status_t r = ERR_BAD_STATE;
+    uint64_t buf[DLOG_MAX_ENTRY / sizeof(uint64_t)];
+    dlog_record_t* copy = (dlog_record_t*)buf;
+    status_t r;
 
-    mutex_acquire(&log->lock);
-    if (rdr->tail != log->head) {
-        dlog_record_t* rec = REC(log->data, rdr->tail);
-        size_t copylen = rec->datalen + sizeof(dlog_record_t);
+    mutex_acquire(&rdr->lock);
+    for (;;) {
+        // Records the writers have moved the tail past are gone
+        uint64_t tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+        if (rdr->tail < tail) {
+            rdr->tail = tail;
+        }
+        if (rdr->tail == __atomic_load_n(&log->head, __ATOMIC_ACQUIRE)) {
+            // Nothing left to read, we're in the "empty" state now, unless
+            // a record was published since we looked and its wakeup came
+            // before this unsignal.
+            event_unsignal(&rdr->event);
+            if (rdr->tail == __atomic_load_n(&log->head, __ATOMIC_ACQUIRE)) {
+                r = ERR_BAD_STATE;
+                break;
+            }
+            event_signal(&rdr->event, false);
+            continue;
+        }
+
+        // Take a copy, and keep it only if the record wasn't overwritten
+        // while it was being made.
+        const dlog_record_t* rec = REC(log->data, rdr->tail);
+        size_t copylen = MIN(rec->datalen + sizeof(dlog_record_t), sizeof(buf));
+        memcpy(copy, rec, copylen);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&log->tail, __ATOMIC_RELAXED) > rdr->tail) {
+            continue;
+        }
+
+        copylen = copy->datalen + sizeof(dlog_record_t);
         if (copylen > len) {
             r = ERR_BUFFER_TOO_SMALL;
-        } else {
-            if (user) {
-                r = copy_to_user_unsafe(ptr, rec, copylen);
-                if (r == NO_ERROR) {
-                    r = copylen;
-                }
-            } else {
-                memcpy(ptr, rec, copylen);
+            break;
+        }
+        if (user) {
+            r = copy_to_user_unsafe(ptr, copy, copylen);
+            if (r == NO_ERROR) {
                 r = copylen;
             }
-            rdr->tail = rec->next;
-            if (rdr->tail == log->head) {
-                // Nothing left to read, we're in the "empty" state now.
-                event_unsignal(&rdr->event);
-            }
+        } else {
+            memcpy(ptr, copy, copylen);
+            r = copylen;
         }
+        rdr->tail = dlog_record_next(rdr->tail, copy);
+        break;
     }
-    mutex_release(&log->lock);
+    mutex_release(&rdr->lock);
     return r;
 }
 
@@ -144,11 +205,12 @@ void dlog_reader_init(dlog_reader_t* rdr) {
 
     rdr->log = log;
     event_init(&rdr->event, false, 0);
+    mutex_init(&rdr->lock);
 
     mutex_acquire(&log->lock);
     list_add_tail(&log->readers, &rdr->node);
-    rdr->tail = log->tail;
-    if (log->head != log->tail) {
+    rdr->tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&log->head, __ATOMIC_ACQUIRE) != rdr->tail) {
         event_signal(&rdr->event, false);
     }
     mutex_release(&log->lock);
@@ -159,8 +221,9 @@ void dlog_reader_destroy(dlog_reader_t* rdr) {
 
     mutex_acquire(&log->lock);
     list_delete(&rdr->node);
-    event_destroy(&rdr->event);
     mutex_release(&log->lock);
+    event_destroy(&rdr->event);
+    mutex_destroy(&rdr->lock);
 }
 
 void dlog_wait(dlog_reader_t* rdr) {
@@ -221,7 +284,7 @@ static status_t dlog_read_unsafe(dlog_reader_t* rdr, uint32_t flags, void* ptr,
         } else {
             memcpy(ptr, rec, copylen);
             r = copylen;
-            rdr->tail = rec->next;
+            rdr->tail = dlog_record_next(rdr->tail, rec);
         }
     }
     return r;
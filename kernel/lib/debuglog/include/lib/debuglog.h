@@ -37,15 +37,25 @@ typedef struct dlog dlog_t;
 typedef struct dlog_record dlog_record_t;
 typedef struct dlog_reader dlog_reader_t;
 
+// Writers never take a lock: each claims space by advancing |reserve|,
+// pushes |tail| past whatever that space overwrites, fills in its record and
+// then publishes it by advancing |head|, in the order the space was claimed.
+// The offsets count bytes written since boot, the data is at offset % size.
 struct dlog {
-    mutex_t lock;
-
     uint32_t size;
-    uint32_t head;
-    uint32_t tail;
     bool paused;
     void* data;
 
+    uint64_t reserve;
+    uint64_t head;
+    uint64_t tail;
+
+    // set while a writer is on its way to wake the readers, so the writers
+    // behind it don't all wake them again
+    bool notify_pending;
+
+    // protects readers
+    mutex_t lock;
     struct list_node readers;
 };
 
@@ -53,7 +63,9 @@ struct dlog_reader {
     struct list_node node;
     event_t event;
     dlog_t* log;
-    uint32_t tail;
+    // serializes readers sharing this view of the log
+    mutex_t lock;
+    uint64_t tail;
 };
 
 struct dlog_record {
@@ -8,29 +8,46 @@
 #include <assert.h>
 #include <err.h>
 #include <list.h>
+#include <stdio.h>
 #include <trace.h>
 
 #include <kernel/event.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <lk/init.h>
 
-static spin_lock_t dpc_lock = SPIN_LOCK_INITIAL_VALUE;
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event = EVENT_INITIAL_VALUE(dpc_event, false, 0);
+// Each cpu queues dpcs on its own list and runs them on its own worker
+// thread, pinned to that cpu, so deferred work stays local to the cpu that
+// took the interrupt.
+struct dpc_state {
+    spin_lock_t lock;
+    struct list_node list;
+    event_t event;
+    thread_t *thread;
+} __CPU_ALIGN;
+
+static struct dpc_state dpc_state[SMP_MAX_CPUS];
 
 status_t dpc_queue(dpc_t *dpc, bool reschedule)
 {
     DEBUG_ASSERT(dpc);
     DEBUG_ASSERT(dpc->func);
 
+    // disable interrupts before picking the queue so we can't migrate away from it
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    struct dpc_state *ds = &dpc_state[arch_curr_cpu_num()];
+
+    spin_lock(&ds->lock);
 
     // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&dpc_list, &dpc->node);
-    event_signal(&dpc_event, false);
+    list_add_tail(&ds->list, &dpc->node);
+    event_signal(&ds->event, false);
+
+    spin_unlock(&ds->lock);
 
-    spin_unlock_irqrestore(&dpc_lock, state);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     // reschedule here if asked to
     if (reschedule)
@@ -39,38 +56,103 @@ status_t dpc_queue(dpc_t *dpc, bool reschedule)
     return NO_ERROR;
 }
 
+// Move any dpcs left on a cpu that is going offline to the current cpu.
+// Its worker stays pinned there and resumes if the cpu comes back.
+void dpc_transition_off_cpu(uint old_cpu)
+{
+    DEBUG_ASSERT(old_cpu < SMP_MAX_CPUS);
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    uint cpu = arch_curr_cpu_num();
+    DEBUG_ASSERT(cpu != old_cpu);
+
+    struct dpc_state *src = &dpc_state[old_cpu];
+    struct dpc_state *dst = &dpc_state[cpu];
+
+    // always take the locks in cpu order
+    if (old_cpu < cpu) {
+        spin_lock(&src->lock);
+        spin_lock(&dst->lock);
+    } else {
+        spin_lock(&dst->lock);
+        spin_lock(&src->lock);
+    }
+
+    dpc_t *dpc;
+    bool moved = false;
+    while ((dpc = list_remove_head_type(&src->list, dpc_t, node)) != NULL) {
+        list_add_tail(&dst->list, &dpc->node);
+        moved = true;
+    }
+    event_unsignal(&src->event);
+    if (moved)
+        event_signal(&dst->event, false);
+
+    spin_unlock(&src->lock);
+    spin_unlock(&dst->lock);
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
 static int dpc_thread(void *arg)
 {
+    struct dpc_state *ds = arg;
+
     for (;;) {
         // wait for a dpc to fire
-        __UNUSED status_t err = event_wait(&dpc_event);
+        __UNUSED status_t err = event_wait(&ds->event);
         DEBUG_ASSERT(err == NO_ERROR);
 
         spin_lock_saved_state_t state;
-        spin_lock_irqsave(&dpc_lock, state);
+        spin_lock_irqsave(&ds->lock, state);
 
         // pop a dpc off the list
-        dpc_t *dpc = list_remove_head_type(&dpc_list, dpc_t, node);
+        dpc_t *dpc = list_remove_head_type(&ds->list, dpc_t, node);
 
         // if the list is now empty, unsignal the event so we block until it is
         if (!dpc)
-            event_unsignal(&dpc_event);
+            event_unsignal(&ds->event);
 
-        spin_unlock_irqrestore(&dpc_lock, state);
+        spin_unlock_irqrestore(&ds->lock, state);
 
         // call the dpc
         if (dpc && dpc->func)
             dpc->func(dpc);
     }
 
-
     return 0;
 }
 
-static void dpc_init(unsigned int level)
+static void dpc_init_early(unsigned int level)
 {
-    thread_t *t = thread_create("dpc", &dpc_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        spin_lock_init(&dpc_state[i].lock);
+        list_initialize(&dpc_state[i].list);
+        event_init(&dpc_state[i].event, false, 0);
+    }
+}
+
+static void dpc_init_percpu(unsigned int level)
+{
+    uint cpu = arch_curr_cpu_num();
+    struct dpc_state *ds = &dpc_state[cpu];
+
+    // a cpu that was unplugged and brought back keeps its old worker
+    if (ds->thread)
+        return;
+
+    char name[THREAD_NAME_LENGTH];
+    snprintf(name, sizeof(name), "dpc-%u", cpu);
+
+    thread_t *t = thread_create(name, &dpc_thread, ds, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t)
+        panic("failed to create dpc thread for cpu %u\n", cpu);
+    thread_set_pinned_cpu(t, cpu);
+    ds->thread = t;
     thread_detach_and_resume(t);
 }
 
-LK_INIT_HOOK(dpc, dpc_init, LK_INIT_LEVEL_THREADING);
+LK_INIT_HOOK(dpc_early, dpc_init_early, LK_INIT_LEVEL_EARLIEST);
+LK_INIT_HOOK_FLAGS(dpc, dpc_init_percpu, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
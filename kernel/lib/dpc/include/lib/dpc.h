@@ -21,7 +21,11 @@ typedef struct dpc {
     void *arg;
 } dpc_t;
 
+// Queue a dpc to run on the current cpu's dpc thread.
 status_t dpc_queue(dpc_t *dpc, bool reschedule);
 
+// Move the pending dpcs of a cpu that is going offline to the current cpu.
+void dpc_transition_off_cpu(uint old_cpu);
+
 __END_CDECLS
 
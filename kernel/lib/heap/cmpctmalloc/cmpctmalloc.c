@@ -24,7 +24,9 @@
 //
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
-// and the header size is two words with eager coalescing on free.
+// and the header size is two words with eager coalescing on free.  Small
+// allocations are usually served from per-cpu magazines in front of the
+// mutex, see below.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -74,6 +76,10 @@ typedef struct free_struct {
 struct heap {
     size_t size;
     size_t remaining;
+    // Statistics for cmpct_get_info().
+    size_t os_allocations;
+    size_t os_alloc_count;
+    size_t returned;
     mutex_t lock;
     free_t *free_lists[NUMBER_OF_BUCKETS];
     // We have some 32 bit words that tell us whether there is an entry in the
@@ -85,6 +91,33 @@ struct heap {
 // Heap static vars.
 static struct heap theheap;
 
+// Each cpu keeps a magazine of recently freed blocks for each of the buckets
+// up to CMPCT_MAGAZINE_MAX_SIZE bytes, so that most small allocations and
+// frees (kernel objects, message packets) don't take the heap mutex.  A
+// magazine is refilled from or drained to the free lists
+// CMPCT_MAGAZINE_BATCH blocks at a time under a single acquisition of the
+// mutex.  Cached blocks still have their allocation headers, so as far as the
+// free lists are concerned they are allocated; cmpct_trim() returns them
+// before trimming.
+#define CMPCT_MAGAZINE_MAX_SIZE 512
+#define CMPCT_MAGAZINE_BUCKETS 32  // Buckets 8 through 512.
+#define CMPCT_MAGAZINE_SIZE 8
+#define CMPCT_MAGAZINE_BATCH (CMPCT_MAGAZINE_SIZE / 2)
+
+struct cmpct_magazine {
+    size_t count;
+    void *blocks[CMPCT_MAGAZINE_SIZE];
+};
+
+struct cmpct_cpu_cache {
+    spin_lock_t lock;
+    struct cmpct_magazine magazines[CMPCT_MAGAZINE_BUCKETS];
+} __CPU_ALIGN;
+
+static struct cmpct_cpu_cache cpu_caches[SMP_MAX_CPUS];
+
+static void magazine_drain_all(void);
+
 static ssize_t heap_grow(size_t len, free_t **bucket);
 
 static void lock(void)
@@ -111,6 +144,24 @@ void cmpct_dump(void)
             (unsigned long)theheap.size,
             (unsigned long)theheap.remaining);
 
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        size_t cached = 0;
+        size_t bytes = 0;
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cpu_caches[cpu].lock, state);
+        for (int i = 0; i < CMPCT_MAGAZINE_BUCKETS; i++) {
+            struct cmpct_magazine *mag = &cpu_caches[cpu].magazines[i];
+            for (size_t j = 0; j < mag->count; j++) {
+                bytes += ((header_t *)mag->blocks[j] - 1)->size;
+            }
+            cached += mag->count;
+        }
+        spin_unlock_irqrestore(&cpu_caches[cpu].lock, state);
+        if (cached > 0) {
+            dprintf(INFO, "\tcpu %u magazines: %zu blocks, %zu bytes\n", cpu, cached, bytes);
+        }
+    }
+
     dprintf(INFO, "\tfree list:\n");
     for (int i = 0; i < NUMBER_OF_BUCKETS; i++) {
         bool header_printed = false;
@@ -184,6 +235,14 @@ static int size_to_index_freeing(size_t size)
     return size_to_index_helper(size, &dummy, 0, 0);
 }
 
+// The smallest size, not including the header, that is filed in the bucket.
+static size_t bucket_size(int index)
+{
+    if (index < 15) return (index + 1) * 8;
+    int row_column = index - 15 + 32;
+    return (size_t)(8 + (row_column & 7)) << (row_column >> 3);
+}
+
 static inline header_t *tag_as_free(void *left)
 {
     return (header_t *)((uintptr_t)left | 1);
@@ -263,6 +322,8 @@ static void free_to_os(header_t *header, size_t size)
     DEBUG_ASSERT(IS_PAGE_ALIGNED(size));
     page_free(header, size >> PAGE_SIZE_SHIFT);
     theheap.size -= size;
+    theheap.os_allocations--;
+    theheap.returned += size;
 }
 
 static void free_memory(void *address, void *left, size_t size)
@@ -538,6 +599,36 @@ static void cmpct_test_get_back_newly_freed(void)
     }
 }
 
+static void cmpct_test_magazines(void)
+{
+    // A freed small block is handed straight back from this cpu's magazine.
+    void *a = cmpct_alloc(64);
+    void *b = cmpct_alloc(64);
+    ASSERT(a != NULL && b != NULL && a != b);
+    cmpct_free(a);
+    void *c = cmpct_alloc(60);
+    ASSERT(c == a);
+
+    // Overflowing a magazine pushes blocks back to the free lists.
+    void *ptr[CMPCT_MAGAZINE_SIZE * 4];
+    for (size_t i = 0; i < countof(ptr); i++) {
+        ptr[i] = cmpct_alloc(200);
+        ASSERT(ptr[i] != NULL);
+        ASSERT(((header_t *)ptr[i] - 1)->size - sizeof(header_t) >= 200);
+    }
+    for (size_t i = 0; i < countof(ptr); i++) cmpct_free(ptr[i]);
+    cmpct_free(b);
+    cmpct_free(c);
+
+    // Trimming empties every magazine.
+    cmpct_trim();
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (int i = 0; i < CMPCT_MAGAZINE_BUCKETS; i++) {
+            ASSERT(cpu_caches[cpu].magazines[i].count == 0);
+        }
+    }
+}
+
 static void cmpct_test_return_to_os(void)
 {
     cmpct_trim();
@@ -558,10 +649,46 @@ static void cmpct_test_return_to_os(void)
     ASSERT(remaining == theheap.remaining);
 }
 
+static void cmpct_test_info(void)
+{
+    for (int i = 0; i < NUMBER_OF_BUCKETS; i++) {
+        ASSERT(size_to_index_freeing(bucket_size(i)) == i);
+    }
+
+    // A large allocation gets an OS allocation of its own, which goes back
+    // as soon as it is freed.
+    struct heap_info before, during, after;
+    cmpct_get_info(&before);
+    void *big = cmpct_alloc(1u << HEAP_ALLOC_VIRTUAL_BITS);
+    ASSERT(big != NULL);
+    cmpct_get_info(&during);
+    ASSERT(during.os_allocations == before.os_allocations + 1);
+    ASSERT(during.os_alloc_count == before.os_alloc_count + 1);
+    ASSERT(during.size > before.size + (1u << HEAP_ALLOC_VIRTUAL_BITS));
+    cmpct_free(big);
+    cmpct_get_info(&after);
+    ASSERT(after.os_allocations == before.os_allocations);
+    ASSERT(after.size == before.size);
+    ASSERT(after.returned_bytes == before.returned_bytes + (during.size - before.size));
+
+    // The buckets account for everything on the free lists.
+    static struct heap_bucket_info buckets[NUMBER_OF_BUCKETS];
+    ASSERT(cmpct_get_bucket_info(buckets, countof(buckets)) == NUMBER_OF_BUCKETS);
+    size_t free_bytes = 0;
+    for (int i = 0; i < NUMBER_OF_BUCKETS; i++) {
+        ASSERT(buckets[i].free_bytes >= buckets[i].free_count * (buckets[i].size + sizeof(header_t)));
+        free_bytes += buckets[i].free_bytes;
+    }
+    cmpct_get_info(&after);
+    ASSERT(free_bytes == after.free_bytes);
+}
+
 void cmpct_test(void)
 {
     cmpct_test_buckets();
+    cmpct_test_info();
     cmpct_test_get_back_newly_freed();
+    cmpct_test_magazines();
     cmpct_test_return_to_os();
     cmpct_test_trim();
     cmpct_dump();
@@ -650,7 +777,9 @@ void cmpct_trim(void)
 {
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
-    // them and free the page(s).
+    // them and free the page(s).  Anything sitting in the cpu magazines goes
+    // back to the free lists first so it can coalesce.
+    magazine_drain_all();
     lock();
     for (int bucket = size_to_index_freeing(PAGE_SIZE);
             bucket < NUMBER_OF_BUCKETS;
@@ -681,6 +810,7 @@ void cmpct_trim(void)
                 create_free_area(free_area, untag(free_area->header.left), new_free_size, NULL);
                 page_free(new_os_allocation_end, freed_up >> PAGE_SIZE_SHIFT);
                 theheap.size -= freed_up;
+                theheap.returned += freed_up;
             } else if (is_start_of_os_allocation(untag(free_area->header.left))) {
                 char *old_os_allocation_start =
                     (char *)ROUNDDOWN((uintptr_t)free_area, PAGE_SIZE);
@@ -712,33 +842,83 @@ void cmpct_trim(void)
                 }
                 page_free(old_os_allocation_start, freed_up >> PAGE_SIZE_SHIFT);
                 theheap.size -= freed_up;
+                theheap.returned += freed_up;
             }
         }
     }
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+void cmpct_get_info(struct heap_info *info)
 {
-    if (size == 0u) return NULL;
+    size_t cached = 0;
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cpu_caches[cpu].lock, state);
+        for (int i = 0; i < CMPCT_MAGAZINE_BUCKETS; i++) {
+            struct cmpct_magazine *mag = &cpu_caches[cpu].magazines[i];
+            for (size_t j = 0; j < mag->count; j++) {
+                cached += ((header_t *)mag->blocks[j] - 1)->size;
+            }
+        }
+        spin_unlock_irqrestore(&cpu_caches[cpu].lock, state);
+    }
 
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+    lock();
+    info->size = theheap.size;
+    info->free_bytes = theheap.remaining;
+    info->cached_bytes = cached;
+    info->os_allocations = theheap.os_allocations;
+    info->os_alloc_count = theheap.os_alloc_count;
+    info->returned_bytes = theheap.returned;
+    unlock();
+}
 
-    size_t rounded_up;
-    int start_bucket = size_to_index_allocating(size, &rounded_up);
+size_t cmpct_get_bucket_info(struct heap_bucket_info *buckets, size_t count)
+{
+    count = MIN(count, (size_t)NUMBER_OF_BUCKETS);
+    for (size_t i = 0; i < count; i++) {
+        buckets[i].size = bucket_size(i);
+        buckets[i].free_count = 0;
+        buckets[i].free_bytes = 0;
+        buckets[i].cached_count = 0;
+    }
 
-    rounded_up += sizeof(header_t);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cpu_caches[cpu].lock, state);
+        for (size_t i = 0; i < MIN(count, (size_t)CMPCT_MAGAZINE_BUCKETS); i++) {
+            buckets[i].cached_count += cpu_caches[cpu].magazines[i].count;
+        }
+        spin_unlock_irqrestore(&cpu_caches[cpu].lock, state);
+    }
 
     lock();
+    for (size_t i = 0; i < count; i++) {
+        for (free_t *free_area = theheap.free_lists[i];
+                free_area != NULL;
+                free_area = free_area->next) {
+            buckets[i].free_count++;
+            buckets[i].free_bytes += free_area->header.size;
+        }
+    }
+    unlock();
+    return NUMBER_OF_BUCKETS;
+}
+
+// Carve an allocation of rounded_up bytes (including the header) out of the
+// free lists, growing the heap if there is nothing big enough and grow is set.
+static void *alloc_locked(int start_bucket, size_t rounded_up, size_t size, bool grow)
+{
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
+        if (!grow) return NULL;
         // Grow heap by at least 12% if we can.
         size_t growby = MIN(1u << HEAP_ALLOC_VIRTUAL_BITS,
                             MAX(theheap.size >> 3,
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -762,13 +942,179 @@ void *cmpct_alloc(size_t size)
     } else {
         unlink_free(head, bucket);
     }
-    void *result =
-        create_allocation_header(head, 0, head->header.size, head->header.left);
+    return create_allocation_header(head, 0, head->header.size, head->header.left);
+}
+
+static void free_locked(header_t *header)
+{
+    size_t size = header->size;
+    header_t *left = header->left;
+    if (left != NULL && is_tagged_as_free(left)) {
+        // Coalesce with left free object.
+        unlink_free_unknown_bucket((free_t *)left);
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce both sides.
+            unlink_free_unknown_bucket((free_t *)right);
+            header_t *right_right = right_header(right);
+            FixLeftPointer(right_right, left);
+            free_memory(left, left->left, left->size + size + right->size);
+        } else {
+            // Coalesce only left.
+            FixLeftPointer(right, left);
+            free_memory(left, left->left, left->size + size);
+        }
+    } else {
+        header_t *right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce only right.
+            header_t *right_right = right_header(right);
+            unlink_free_unknown_bucket((free_t *)right);
+            FixLeftPointer(right_right, header);
+            free_memory(header, left, size + right->size);
+        } else {
+            free_memory(header, left, size);
+        }
+    }
+}
+
+// Pop a block for the given bucket off the current cpu's magazine, refilling
+// it from the free lists if it is empty.
+static void *magazine_alloc(int bucket, size_t rounded_up)
+{
+    spin_lock_saved_state_t state;
+    struct cmpct_magazine *mag;
+    void *result = NULL;
+
+    // disable interrupts before picking the cache so we can't migrate away from it
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cmpct_cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    mag = &cache->magazines[bucket];
+    if (mag->count > 0) result = mag->blocks[--mag->count];
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    if (result != NULL) return result;
+
+    // Refill a batch under one acquisition of the heap lock.  Only the first
+    // block may grow the heap; we don't grow it just to stock the magazine.
+    void *batch[CMPCT_MAGAZINE_BATCH];
+    size_t count = 0;
+    lock();
+    while (count < CMPCT_MAGAZINE_BATCH) {
+        void *block = alloc_locked(bucket, rounded_up, rounded_up - sizeof(header_t), count == 0);
+        if (block == NULL) break;
+        batch[count++] = block;
+    }
+    unlock();
+    if (count == 0) return NULL;
+    result = batch[--count];
+
+    // We may be on a different cpu by now, which is fine.
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    mag = &cache->magazines[bucket];
+    while (count > 0 && mag->count < CMPCT_MAGAZINE_SIZE) {
+        mag->blocks[mag->count++] = batch[--count];
+    }
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (count > 0) {
+        lock();
+        while (count > 0) free_locked((header_t *)batch[--count] - 1);
+        unlock();
+    }
+    return result;
+}
+
+// Stash a block in the current cpu's magazine for its bucket, pushing the
+// older half of the magazine back to the free lists if it is full.
+static void magazine_free(void *payload, int bucket)
+{
+    void *batch[CMPCT_MAGAZINE_BATCH];
+    size_t count = 0;
+    spin_lock_saved_state_t state;
+
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cmpct_cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    struct cmpct_magazine *mag = &cache->magazines[bucket];
 #ifdef CMPCT_DEBUG
-    memset(result, ALLOC_FILL, size);
-    memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
+    for (size_t i = 0; i < mag->count; i++) {
+        DEBUG_ASSERT(mag->blocks[i] != payload);  // Double free!
+    }
+#endif
+    if (mag->count == CMPCT_MAGAZINE_SIZE) {
+        count = CMPCT_MAGAZINE_BATCH;
+        memcpy(batch, mag->blocks, sizeof(batch));
+        memmove(&mag->blocks[0], &mag->blocks[CMPCT_MAGAZINE_BATCH],
+                (CMPCT_MAGAZINE_SIZE - CMPCT_MAGAZINE_BATCH) * sizeof(mag->blocks[0]));
+        mag->count -= CMPCT_MAGAZINE_BATCH;
+    }
+    mag->blocks[mag->count++] = payload;
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (count > 0) {
+        lock();
+        for (size_t i = 0; i < count; i++) free_locked((header_t *)batch[i] - 1);
+        unlock();
+    }
+}
+
+// Return every block cached in the cpu magazines to the free lists.
+static void magazine_drain_all(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct cmpct_cpu_cache *cache = &cpu_caches[cpu];
+        for (int bucket = 0; bucket < CMPCT_MAGAZINE_BUCKETS; bucket++) {
+            void *batch[CMPCT_MAGAZINE_SIZE];
+            size_t count;
+
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&cache->lock, state);
+            struct cmpct_magazine *mag = &cache->magazines[bucket];
+            count = mag->count;
+            memcpy(batch, mag->blocks, count * sizeof(batch[0]));
+            mag->count = 0;
+            spin_unlock_irqrestore(&cache->lock, state);
+
+            if (count == 0) continue;
+            lock();
+            for (size_t i = 0; i < count; i++) free_locked((header_t *)batch[i] - 1);
+            unlock();
+        }
+    }
+}
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    size_t rounded_up;
+    int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+    rounded_up += sizeof(header_t);
+
+    void *result;
+    if (start_bucket < CMPCT_MAGAZINE_BUCKETS) {
+        result = magazine_alloc(start_bucket, rounded_up);
+    } else {
+        lock();
+        result = alloc_locked(start_bucket, rounded_up, size, true);
+        unlock();
+    }
+#ifdef CMPCT_DEBUG
+    if (result != NULL) {
+        size_t usable = ((header_t *)result - 1)->size - sizeof(header_t);
+        memset(result, ALLOC_FILL, size);
+        memset(((char *)result) + size, PADDING_FILL, usable - size);
+    }
 #endif
-    unlock();
     return result;
 }
 
@@ -792,8 +1138,9 @@ void *cmpct_memalign(size_t size, size_t alignment)
         header_t *right = right_header(unaligned_header);
         unaligned_header->size = left_over;
         FixLeftPointer(right, header);
+        // The sliver in front is too small to be worth caching.
+        free_locked(unaligned_header);
         unlock();
-        cmpct_free(unaligned);
     } else {
         unlock();
     }
@@ -806,36 +1153,16 @@ void cmpct_free(void *payload)
     if (payload == NULL) return;
     header_t *header = (header_t *)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
-    size_t size = header->size;
-    lock();
-    header_t *left = header->left;
-    if (left != NULL && is_tagged_as_free(left)) {
-        // Coalesce with left free object.
-        unlink_free_unknown_bucket((free_t *)left);
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce both sides.
-            unlink_free_unknown_bucket((free_t *)right);
-            header_t *right_right = right_header(right);
-            FixLeftPointer(right_right, left);
-            free_memory(left, left->left, left->size + size + right->size);
-        } else {
-            // Coalesce only left.
-            FixLeftPointer(right, left);
-            free_memory(left, left->left, left->size + size);
-        }
-    } else {
-        header_t *right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce only right.
-            header_t *right_right = right_header(right);
-            unlink_free_unknown_bucket((free_t *)right);
-            FixLeftPointer(right_right, header);
-            free_memory(header, left, size + right->size);
-        } else {
-            free_memory(header, left, size);
-        }
+    size_t usable = header->size - sizeof(header_t);
+    if (usable >= sizeof(free_t) - sizeof(header_t) && usable <= CMPCT_MAGAZINE_MAX_SIZE) {
+#ifdef CMPCT_DEBUG
+        memset(payload, FREE_FILL, usable);
+#endif
+        magazine_free(payload, size_to_index_freeing(usable));
+        return;
     }
+    lock();
+    free_locked(header);
     unlock();
 }
 
@@ -878,6 +1205,8 @@ static ssize_t heap_grow(size_t size, free_t **bucket)
         return ERR_NO_MEMORY;
 
     theheap.size += size;
+    theheap.os_allocations++;
+    theheap.os_alloc_count++;
 
     LTRACEF("growing heap by 0x%zx bytes, new ptr %p\n", size, ptr);
     add_to_heap(ptr, size, bucket);
@@ -892,6 +1221,11 @@ void cmpct_init(void)
     // Create a mutex.
     mutex_init(&theheap.lock);
 
+    DEBUG_ASSERT(size_to_index_freeing(CMPCT_MAGAZINE_MAX_SIZE) == CMPCT_MAGAZINE_BUCKETS - 1);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        spin_lock_init(&cpu_caches[i].lock);
+    }
+
     // Initialize the free list.
     for (int i = 0; i < NUMBER_OF_BUCKETS; i++) {
         theheap.free_lists[i] = NULL;
@@ -903,6 +1237,9 @@ void cmpct_init(void)
     size_t initial_alloc = HEAP_GROW_SIZE - 2 * sizeof(header_t);
 
     theheap.remaining = 0;
+    theheap.os_allocations = 0;
+    theheap.os_alloc_count = 0;
+    theheap.returned = 0;
 
     heap_grow(initial_alloc, NULL);
 }
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <lib/heap.h>
 #include <magenta/compiler.h>
 
 __BEGIN_CDECLS;
@@ -20,5 +21,7 @@ void cmpct_init(void);
 void cmpct_dump(void);
 void cmpct_test(void);
 void cmpct_trim(void);
+void cmpct_get_info(struct heap_info *info);
+size_t cmpct_get_bucket_info(struct heap_bucket_info *buckets, size_t count);
 
 __END_CDECLS;
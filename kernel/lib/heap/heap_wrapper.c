@@ -16,8 +16,10 @@
 #include <list.h>
 #include <arch/ops.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <lib/console.h>
 #include <lib/page_alloc.h>
+#include <lk/init.h>
 
 #define LOCAL_TRACE 0
 
@@ -36,6 +38,11 @@ static bool heap_trace = false;
 #define heap_trace (false)
 #endif
 
+/* how often the background trim runs, and how much free memory the heap has
+ * to be holding for it to bother */
+#define HEAP_TRIM_INTERVAL_MSECS 10000
+#define HEAP_TRIM_THRESHOLD (1024 * 1024)
+
 /* delayed free list */
 struct list_node delayed_free_list = LIST_INITIAL_VALUE(delayed_free_list);
 spin_lock_t delayed_free_lock = SPIN_LOCK_INITIAL_VALUE;
@@ -66,6 +73,8 @@ static inline void HEAP_INIT(void)
 }
 #define HEAP_DUMP miniheap_dump
 #define HEAP_TRIM miniheap_trim
+static inline status_t HEAP_GET_INFO(struct heap_info *info) { return ERR_NOT_SUPPORTED; }
+static inline ssize_t HEAP_GET_BUCKET_INFO(struct heap_bucket_info *b, size_t n) { return ERR_NOT_SUPPORTED; }
 
 /* end miniheap implementation */
 #elif WITH_LIB_HEAP_CMPCTMALLOC
@@ -79,6 +88,12 @@ static inline void HEAP_INIT(void)
 #define HEAP_INIT cmpct_init
 #define HEAP_DUMP cmpct_dump
 #define HEAP_TRIM cmpct_trim
+static inline status_t HEAP_GET_INFO(struct heap_info *info)
+{
+    cmpct_get_info(info);
+    return NO_ERROR;
+}
+#define HEAP_GET_BUCKET_INFO cmpct_get_bucket_info
 static inline void *HEAP_CALLOC(size_t n, size_t s)
 {
     size_t realsize = n * s;
@@ -124,6 +139,8 @@ static inline void HEAP_DUMP(void)
 }
 
 static inline void HEAP_TRIM(void) { dlmalloc_trim(0); }
+static inline status_t HEAP_GET_INFO(struct heap_info *info) { return ERR_NOT_SUPPORTED; }
+static inline ssize_t HEAP_GET_BUCKET_INFO(struct heap_bucket_info *b, size_t n) { return ERR_NOT_SUPPORTED; }
 
 /* end dlmalloc implementation */
 #else
@@ -166,6 +183,45 @@ void heap_trim(void)
     HEAP_TRIM();
 }
 
+status_t heap_get_info(struct heap_info *info)
+{
+    return HEAP_GET_INFO(info);
+}
+
+ssize_t heap_get_bucket_info(struct heap_bucket_info *buckets, size_t count)
+{
+    return HEAP_GET_BUCKET_INFO(buckets, count);
+}
+
+/* background trimming, so that pages freed by a burst of allocations go back
+ * to the system without anyone asking */
+static int heap_trim_thread(void *arg)
+{
+    for (;;) {
+        thread_sleep(HEAP_TRIM_INTERVAL_MSECS);
+
+        /* not worth disturbing the heap for less than this */
+        struct heap_info info;
+        if (heap_get_info(&info) == NO_ERROR &&
+                info.free_bytes + info.cached_bytes < HEAP_TRIM_THRESHOLD)
+            continue;
+
+        heap_trim();
+    }
+    return 0;
+}
+
+static void heap_trim_init(uint level)
+{
+    thread_t *t = thread_create("heap trim", &heap_trim_thread, NULL,
+                                LOW_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t)
+        panic("failed to create heap trim thread\n");
+    thread_detach_and_resume(t);
+}
+
+LK_INIT_HOOK(heap_trim, heap_trim_init, LK_INIT_LEVEL_THREADING);
+
 void *malloc(size_t size)
 {
     DEBUG_ASSERT(!arch_in_int_handler());
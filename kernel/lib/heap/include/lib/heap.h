@@ -28,4 +28,29 @@ void heap_delayed_free(void *);
 /* tell the heap to return any free pages it can find */
 void heap_trim(void);
 
+/* heap statistics */
+struct heap_info {
+    size_t size;            /* bytes currently taken from the page allocator */
+    size_t free_bytes;      /* bytes sitting on the free lists */
+    size_t cached_bytes;    /* freed bytes held back in per-cpu caches */
+    size_t os_allocations;  /* separate chunks currently taken from the page allocator */
+    size_t os_alloc_count;  /* chunks ever taken from the page allocator */
+    size_t returned_bytes;  /* bytes ever given back to the page allocator */
+};
+
+/* free block occupancy of one heap bucket */
+struct heap_bucket_info {
+    size_t size;            /* smallest block, not counting headers, that goes in the bucket */
+    size_t free_count;
+    size_t free_bytes;
+    size_t cached_count;
+};
+
+/* returns ERR_NOT_SUPPORTED if the heap implementation keeps no statistics */
+status_t heap_get_info(struct heap_info *info);
+
+/* fills in up to count buckets and returns the total number of buckets, or
+ * a negative error */
+ssize_t heap_get_bucket_info(struct heap_bucket_info *buckets, size_t count);
+
 __END_CDECLS;
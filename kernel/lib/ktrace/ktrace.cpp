@@ -11,23 +11,31 @@
 #include <arch/ops.h>
 #include <arch/user_copy.h>
 #include <kernel/cmdline.h>
+#include <kernel/irqsoff.h>
+#include <kernel/lockstat.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 #include <lib/ktrace.h>
+#include <lib/syscall_stats.h>
 #include <lk/init.h>
 #include <magenta/user_thread.h>
+#include <platform.h>
 
 #if __x86_64__
 extern "C" uint64_t get_tsc_ticks_per_ms(void);
 #define ktrace_timestamp() rdtsc();
 #define ktrace_ticks_per_ms() get_tsc_ticks_per_ms()
 #else
-#include <platform.h>
 #define ktrace_timestamp() current_time_hires()
 #define ktrace_ticks_per_ms() (1000000)
 #endif
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always);
 
+// the part of the trace buffer set aside for names
+#define KTRACE_META_FRACTION 64
+
 #define MAGENTA_SYSCALL_DEF(s64,s32,num,ret,name,attr,args...) \
     ktrace_name_etc(TAG_SYSCALL_NAME, num, 0, #name, true);
 #define MAGENTA_VDSOCALL_DEF(ret, name, args...) // Nothing to do here.
@@ -72,86 +80,538 @@ static void ktrace_report_probes(void) {
     mutex_release(&probe_list_lock);
 }
 
+// The boot timeline is kept here until the trace buffer exists, and after,
+// so it can be written out again when the buffer is rewound.
+typedef struct ktrace_boot_stage {
+    uint64_t ts;
+    uint32_t num;
+    uint32_t arg;
+    uint32_t tid;
+} ktrace_boot_stage_t;
+
+static ktrace_boot_stage_t boot_stages[KTRACE_BOOT_STAGES];
+static uint32_t boot_stage_count;
+static char boot_stage_names[KTRACE_BOOT_STAGE_NAMES][MX_MAX_NAME_LEN];
+static uint32_t boot_stage_name_count;
+static spin_lock_t boot_stage_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// Each cpu writes its records into its own buffer, so tracing doesn't bounce
+// a shared cache line between cpus. Positions in a cpu buffer only ever
+// grow; the record at position p is at buf[p % bufsize]. Records never
+// straddle the end of a buffer: a zero tag where the next record would be
+// means the rest of the buffer is unused. The head (where the next record
+// goes) and tail (the oldest record still in the buffer) are kept in the
+// trace VMO's header, so that readers mapping it can follow along.
+typedef struct ktrace_cpu {
+    ktrace_cpu_index_t* index;
+    uint8_t* buf;
+} ktrace_cpu_t;
+
+// The version and ticks records and all the name records live in a separate
+// buffer shared by all cpus, which is never overwritten, so that a circular
+// trace can always be decoded.
 typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
-
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // overwrite the oldest records rather than stop when a cpu buffer fills
+    bool circular;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // set by KTRACE_ACTION_REWIND, the buffers get emptied by the next start
+    bool rewind;
 
-    // raw trace buffer
-    uint8_t* buffer;
+    // the start of the trace VMO, see ktrace_buffer_header_t
+    ktrace_buffer_header_t* header;
+
+    // name records go at |meta| + header->meta_len
+    uint32_t meta_size;
+    uint8_t* meta;
+
+    // size of each cpu's buffer
+    uint32_t bufsize;
+    uint32_t num_cpus;
+    ktrace_cpu_t cpu[SMP_MAX_CPUS];
+
+    mxtl::RefPtr<VmObject> vmo;
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
-int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
+// serializes writers of name records
+static spin_lock_t meta_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// the largest record a tag can describe
+#define KTRACE_MAX_RECSIZE (0xF << 3)
+
+// A registered user trace buffer, see ktrace_user_header_t. It is only ever
+// read through the VMO and never mapped, since the thread writing it can
+// decommit its pages at any time. Everything in it is untrusted.
+typedef struct ktrace_user_buffer {
+    mxtl::RefPtr<VmObject> vmo;
+
+    // taken when the buffer was registered, not from its header
+    uint32_t size;
+    uint32_t tid;
+
+    // records before this position were there before the last rewind
+    uint64_t start;
+} ktrace_user_buffer_t;
+
+// registered user buffers, guarded by reader_lock
+static ktrace_user_buffer_t user_buffers[KTRACE_USER_BUFFERS];
+static uint32_t user_buffer_count;
+
+// Where the reader is in a user buffer. The record at pos is copied out of
+// the VMO into rec, so merging looks at it as often as it likes for the
+// price of one copy.
+typedef struct ktrace_user_reader {
+    uint64_t pos;
+    uint64_t end;
+
+    // the position of the record in rec, UINT64_MAX if none
+    uint64_t rec_pos;
+    uint64_t rec[KTRACE_MAX_RECSIZE / sizeof(uint64_t)];
+} ktrace_user_reader_t;
+
+// Reading merges the cpu buffers by timestamp into a single stream that
+// starts with the name records. A read carries on from where the last one
+// stopped, so reading the stream in order only walks it once.
+typedef struct ktrace_reader {
+    // the records in each cpu buffer when the stream was last sized
+    uint64_t pos[SMP_MAX_CPUS];
+    uint64_t end[SMP_MAX_CPUS];
+    ktrace_user_reader_t user[KTRACE_USER_BUFFERS];
+
+    // offset in the stream of the next record to merge
+    uint32_t off;
+
+    uint32_t meta_len;
+    uint32_t len;
+} ktrace_reader_t;
+
+static ktrace_reader_t KTRACE_READER;
+static mutex_t reader_lock = MUTEX_INITIAL_VALUE(reader_lock);
+
+// Returns the next record at or after |*pos| in |kc|'s buffer, or NULL and
+// sets |*pos| to |end| if there is none. Skips records that were overwritten
+// since the stream was sized, which only happens if a circular trace is read
+// without stopping it.
+static ktrace_header_t* ktrace_next_record(const ktrace_cpu_t* kc, uint64_t* pos, uint64_t end) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    uint64_t p = *pos;
+    if (p < kc->index->tail)
+        p = kc->index->tail;
+    while (p < end) {
+        uint32_t off = static_cast<uint32_t>(p % ks->bufsize);
+        ktrace_header_t* hdr = (ktrace_header_t*) (kc->buf + off);
+        uint32_t len = KTRACE_LEN(hdr->tag);
+        if (hdr->tag == 0) {
+            p += ks->bufsize - off;
+            continue;
+        }
+        if (len < KTRACE_HDRSIZE || len > ks->bufsize - off)
+            break;
+        *pos = p;
+        return hdr;
+    }
+    *pos = end;
+    return NULL;
+}
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+static bool ktrace_user_read(const ktrace_user_buffer_t* ub, uint64_t off, void* ptr, size_t len) {
+    size_t actual;
+    return (ub->vmo->Read(ptr, off, len, &actual) == NO_ERROR) && (actual == len);
+}
+
+static void ktrace_user_index(const ktrace_user_buffer_t* ub, uint64_t* head, uint64_t* tail) {
+    ktrace_user_header_t uh;
+    if (!ktrace_user_read(ub, 0, &uh, sizeof(uh))) {
+        uh.head = 0;
+        uh.tail = 0;
+    }
+    *head = uh.head;
+    *tail = uh.tail;
+}
+
+// User records are stamped with mx_ticks_get(). When it doesn't count at
+// the same rate as ktrace_timestamp(), which is only on x86 with a tsc that
+// isn't invariant or on other machines, it is converted.
+static uint64_t ktrace_user_timestamp(uint64_t ticks) {
+    uint64_t user_tps = platform_user_ticks_per_second();
+    if (user_tps == 0) {
+        // mx_ticks_get() falls back to nanoseconds
+        user_tps = 1000000000u;
+    }
+    uint64_t tps = ktrace_ticks_per_ms() * 1000;
+    if (user_tps == tps)
+        return ticks;
+    return (ticks / user_tps) * tps + (ticks % user_tps) * tps / user_tps;
+}
+
+// Like ktrace_next_record(), for user buffer |n|. Returns a copy of the next
+// record to merge at or after its reader's pos, with this trace's tid and
+// timestamp, or NULL and sets pos to end if there is none.
+static ktrace_header_t* ktrace_user_next_record(ktrace_reader_t* kr, uint32_t n) {
+    const ktrace_user_buffer_t* ub = &user_buffers[n];
+    ktrace_user_reader_t* ur = &kr->user[n];
+    ktrace_header_t* hdr = (ktrace_header_t*) ur->rec;
+    if (ur->rec_pos == ur->pos)
+        return hdr;
+
+    uint64_t head, tail;
+    ktrace_user_index(ub, &head, &tail);
+    uint64_t p = MAX(MAX(ur->pos, ub->start), tail);
+
+    // only the last |size| bytes can still be there, however confused the
+    // writer is about its own indices
+    if (ur->end > p && ur->end - p > ub->size)
+        p = ur->end - ub->size;
+
+    while (p < ur->end) {
+        uint32_t off = static_cast<uint32_t>(p % ub->size);
+        if (!ktrace_user_read(ub, KTRACE_USER_HDRSIZE + off, &hdr->tag, sizeof(hdr->tag)))
+            break;
+        if (hdr->tag == 0) {
+            p += ub->size - off;
+            continue;
+        }
+        uint32_t len = KTRACE_LEN(hdr->tag);
+        if (len < KTRACE_HDRSIZE || len > ub->size - off ||
+            !ktrace_user_read(ub, KTRACE_USER_HDRSIZE + off, hdr, len) ||
+            KTRACE_LEN(hdr->tag) != len)
+            break;
+        if (KTRACE_GROUP(hdr->tag) != KTRACE_GRP_PROBE) {
+            p += len;
+            continue;
         }
+        hdr->tid = ub->tid;
+        hdr->ts = ktrace_user_timestamp(hdr->ts);
+        ur->pos = p;
+        ur->rec_pos = p;
+        return hdr;
     }
+    ur->pos = ur->end;
+    ur->rec_pos = UINT64_MAX;
+    return NULL;
+}
+
+// Goes back to the first record since the last rewind in user buffer |n|.
+static void ktrace_user_reader_rewind(ktrace_reader_t* kr, uint32_t n) {
+    kr->user[n].pos = user_buffers[n].start;
+    kr->user[n].rec_pos = UINT64_MAX;
+}
 
-    // null read is a query for trace buffer size
-    if (ptr == NULL) {
-        return max;
+// Sizes the stream from what the buffers have in them now and goes back to
+// its start.
+static void ktrace_reader_reset(ktrace_reader_t* kr) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    kr->meta_len = __atomic_load_n(&ks->header->meta_len, __ATOMIC_ACQUIRE);
+    kr->len = kr->meta_len;
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        const ktrace_cpu_t* kc = &ks->cpu[cpu];
+        kr->end[cpu] = __atomic_load_n(&kc->index->head, __ATOMIC_ACQUIRE);
+        kr->pos[cpu] = kc->index->tail;
+        uint64_t p = kr->pos[cpu];
+        ktrace_header_t* hdr;
+        while ((hdr = ktrace_next_record(kc, &p, kr->end[cpu])) != NULL) {
+            kr->len += KTRACE_LEN(hdr->tag);
+            p += KTRACE_LEN(hdr->tag);
+        }
+    }
+    for (uint32_t n = 0; n < user_buffer_count; n++) {
+        ktrace_user_reader_t* ur = &kr->user[n];
+        uint64_t tail;
+        ktrace_user_index(&user_buffers[n], &ur->end, &tail);
+        ktrace_user_reader_rewind(kr, n);
+        ktrace_header_t* hdr;
+        while ((hdr = ktrace_user_next_record(kr, n)) != NULL) {
+            kr->len += KTRACE_LEN(hdr->tag);
+            ur->pos += KTRACE_LEN(hdr->tag);
+        }
+        ktrace_user_reader_rewind(kr, n);
+    }
+    kr->off = kr->meta_len;
+}
+
+// Finds the oldest record not yet merged, and where it came from: a cpu, or
+// num_cpus plus the number of a user buffer.
+static ktrace_header_t* ktrace_reader_next(ktrace_reader_t* kr, uint32_t* src_out) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    ktrace_header_t* next = NULL;
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        ktrace_header_t* hdr = ktrace_next_record(&ks->cpu[cpu], &kr->pos[cpu], kr->end[cpu]);
+        if (hdr && (!next || hdr->ts < next->ts)) {
+            next = hdr;
+            *src_out = cpu;
+        }
+    }
+    for (uint32_t n = 0; n < user_buffer_count; n++) {
+        ktrace_header_t* hdr = ktrace_user_next_record(kr, n);
+        if (hdr && (!next || hdr->ts < next->ts)) {
+            next = hdr;
+            *src_out = ks->num_cpus + n;
+        }
+    }
+    return next;
+}
+
+// Writes the BOOT_STAGE record for |bs| with the name records. Must be
+// called with boot_stage_lock held.
+static void ktrace_boot_stage_write(const ktrace_boot_stage_t* bs) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->meta == NULL)
+        return;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&meta_lock, state);
+    uint32_t off = ks->header->meta_len;
+    if (off + KTRACE_RECSIZE <= ks->meta_size) {
+        ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) (ks->meta + off);
+        rec->tag = TAG_BOOT_STAGE;
+        rec->tid = bs->tid;
+        rec->ts = bs->ts;
+        rec->a = bs->num;
+        rec->b = bs->arg;
+        rec->c = 0;
+        rec->d = 0;
+        __atomic_store_n(&ks->header->meta_len, off + KTRACE_RECSIZE, __ATOMIC_RELEASE);
+    }
+    spin_unlock_irqrestore(&meta_lock, state);
+}
+
+static void ktrace_boot_stage_insert(const char* name, uint32_t arg, uint64_t ts, bool first) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&boot_stage_lock, state);
+    uint32_t num;
+    for (num = 0; num < boot_stage_name_count; num++) {
+        if (!strncmp(boot_stage_names[num], name, MX_MAX_NAME_LEN - 1))
+            break;
+    }
+    if ((boot_stage_count == KTRACE_BOOT_STAGES) ||
+        ((num == boot_stage_name_count) && (num == KTRACE_BOOT_STAGE_NAMES))) {
+        spin_unlock_irqrestore(&boot_stage_lock, state);
+        return;
+    }
+    if (num == boot_stage_name_count) {
+        strlcpy(boot_stage_names[num], name, MX_MAX_NAME_LEN);
+        boot_stage_name_count++;
+        if (!first)
+            ktrace_name_etc(TAG_BOOT_STAGE_NAME, num, 0, boot_stage_names[num], true);
+    }
+
+    // only the bootloader's stages go in ahead of the others, before the
+    // timeline is first written out
+    uint32_t i = first ? 0 : boot_stage_count;
+    memmove(&boot_stages[i + 1], &boot_stages[i], (boot_stage_count - i) * sizeof(boot_stages[0]));
+    ktrace_boot_stage_t* bs = &boot_stages[i];
+    bs->ts = ts;
+    bs->num = num;
+    bs->arg = arg;
+    thread_t* t = get_current_thread();
+    bs->tid = t ? (uint32_t)t->user_tid : 0;
+    boot_stage_count++;
+    if (!first)
+        ktrace_boot_stage_write(bs);
+    spin_unlock_irqrestore(&boot_stage_lock, state);
+}
+
+void ktrace_boot_stage(const char* name, uint32_t arg, uint64_t ts) {
+    if (ts == 0)
+        ts = ktrace_timestamp();
+    ktrace_boot_stage_insert(name, arg, ts, false);
+}
+
+static void ktrace_report_boot_stages(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&boot_stage_lock, state);
+    for (uint32_t num = 0; num < boot_stage_name_count; num++) {
+        ktrace_name_etc(TAG_BOOT_STAGE_NAME, num, 0, boot_stage_names[num], true);
+    }
+    for (uint32_t i = 0; i < boot_stage_count; i++) {
+        ktrace_boot_stage_write(&boot_stages[i]);
+    }
+    spin_unlock_irqrestore(&boot_stage_lock, state);
+}
+
+// The bootloader passes the times of its stages as
+// bootloader.timeline=<name>:<ticks in hex>,...
+static void ktrace_boot_stages_from_cmdline(void) {
+    const char* p = cmdline_get("bootloader.timeline");
+    if (p == NULL)
+        return;
+
+    // added last to first, each in front of the ones after it
+    char names[8][16];
+    uint64_t ts[8];
+    uint32_t n = 0;
+    while ((*p != 0) && (*p != ' ') && (n < countof(ts))) {
+        const char* colon = strchr(p, ':');
+        if ((colon == NULL) || (colon - p >= (ptrdiff_t)sizeof(names[0])))
+            break;
+        memcpy(names[n], p, colon - p);
+        names[n][colon - p] = 0;
+        char* end;
+        ts[n++] = strtoul(colon + 1, &end, 16);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    while (n-- > 0) {
+        char name[MX_MAX_NAME_LEN];
+        snprintf(name, sizeof(name), "bootloader:%s", names[n]);
+        ktrace_boot_stage_insert(name, 0, ts[n], true);
+    }
+}
+
+int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    ktrace_reader_t* kr = &KTRACE_READER;
+
+    if (ks->meta == NULL)
+        return (ptr == NULL) ? 0 : ERR_INVALID_ARGS;
+
+    mutex_acquire(&reader_lock);
+
+    // null read is a query for trace buffer size; reading from the start
+    // takes a fresh look at the buffers too
+    if (ptr == NULL || off == 0) {
+        ktrace_reader_reset(kr);
+        if (ptr == NULL) {
+            mutex_release(&reader_lock);
+            return kr->len;
+        }
+    } else if (off < kr->off) {
+        // going backwards means merging again from the start
+        for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++)
+            kr->pos[cpu] = ks->cpu[cpu].index->tail;
+        for (uint32_t n = 0; n < user_buffer_count; n++)
+            ktrace_user_reader_rewind(kr, n);
+        kr->off = kr->meta_len;
     }
 
     // constrain read to available buffer
-    if (off >= max) {
+    if (off >= kr->len) {
+        mutex_release(&reader_lock);
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+    if (len > (kr->len - off)) {
+        len = kr->len - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != NO_ERROR) {
-        return ERR_INVALID_ARGS;
+    uint8_t* out = (uint8_t*) ptr;
+    uint32_t copied = 0;
+    if (off < kr->meta_len) {
+        copied = MIN(len, kr->meta_len - off);
+        if (arch_copy_to_user(out, ks->meta + off, copied) != NO_ERROR) {
+            mutex_release(&reader_lock);
+            return ERR_INVALID_ARGS;
+        }
+    }
+
+    while (copied < len) {
+        uint32_t src;
+        ktrace_header_t* hdr = ktrace_reader_next(kr, &src);
+        if (hdr == NULL)
+            break;
+        uint32_t rec_len = KTRACE_LEN(hdr->tag);
+        uint32_t cur = off + copied;
+        if (kr->off + rec_len > cur) {
+            // start partway into the record if the last read stopped there
+            uint32_t skip = cur - kr->off;
+            uint32_t n = MIN(rec_len - skip, len - copied);
+            if (arch_copy_to_user(out + copied, (uint8_t*) hdr + skip, n) != NO_ERROR) {
+                mutex_release(&reader_lock);
+                return ERR_INVALID_ARGS;
+            }
+            copied += n;
+            if (skip + n < rec_len)
+                break;
+        }
+        kr->off += rec_len;
+        if (src < ks->num_cpus) {
+            kr->pos[src] += rec_len;
+        } else {
+            kr->user[src - ks->num_cpus].pos += rec_len;
+        }
     }
-    return len;
+
+    mutex_release(&reader_lock);
+    return copied;
+}
+
+// Empties the buffers and writes the syscall and probe names again.
+static void ktrace_rewind(void) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+
+    // roll back to just after the metadata
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&meta_lock, state);
+    __atomic_store_n(&ks->header->meta_len, KTRACE_RECSIZE * 2, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&meta_lock, state);
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        __atomic_store_n(&ks->cpu[cpu].index->head, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&ks->cpu[cpu].index->tail, 0, __ATOMIC_RELEASE);
+    }
+    for (uint32_t n = 0; n < user_buffer_count; n++) {
+        uint64_t tail;
+        ktrace_user_index(&user_buffers[n], &user_buffers[n].start, &tail);
+    }
+    ks->header->flags = ks->circular ? KTRACE_BUFFER_CIRCULAR : 0;
+    ks->rewind = false;
+    ktrace_report_syscalls();
+    ktrace_report_probes();
+    ktrace_report_boot_stages();
+}
+
+static void ktrace_start(uint32_t options, bool circular) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    options = KTRACE_GRP_TO_MASK(options);
+    mutex_acquire(&reader_lock);
+    if (ks->rewind || ks->circular != circular) {
+        ks->circular = circular;
+        ktrace_rewind();
+    }
+    mutex_release(&reader_lock);
+    atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
+    ktrace_report_live_threads();
 }
 
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
     switch (action) {
     case KTRACE_ACTION_START:
-        options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
-        atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
-        ktrace_report_live_threads();
+    case KTRACE_ACTION_START_CIRCULAR:
+        if (ks->meta == NULL)
+            return ERR_BAD_STATE;
+        ktrace_start(options, action == KTRACE_ACTION_START_CIRCULAR);
         break;
-    case KTRACE_ACTION_STOP: {
+    case KTRACE_ACTION_STOP:
+        // leave the syscall and lock counts in the trace, if they are being kept
+        syscall_stats_ktrace();
+        lockstat_ktrace();
+        irqsoff_ktrace();
+        ktrace_sample_control(0);
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
-        }
         break;
-    }
+    case KTRACE_ACTION_SAMPLE:
+        if (ks->meta == NULL)
+            return ERR_BAD_STATE;
+        return ktrace_sample_control(options);
     case KTRACE_ACTION_REWIND:
-        // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls();
-        ktrace_report_probes();
+        // what was traced stays readable until tracing starts again
+        if (atomic_load(&ks->grpmask)) {
+            mutex_acquire(&reader_lock);
+            ktrace_rewind();
+            mutex_release(&reader_lock);
+        } else {
+            ks->rewind = true;
+        }
         break;
+    case KTRACE_ACTION_GET_VMO:
+        // handed out by the syscall layer, see ktrace_get_vmo()
+        return ERR_INVALID_ARGS;
+    case KTRACE_ACTION_ADD_USER_BUFFER:
+    case KTRACE_ACTION_REMOVE_USER_BUFFER:
+        // looked up by the syscall layer, see ktrace_add_user_buffer()
+        return ERR_INVALID_ARGS;
     case KTRACE_ACTION_NEW_PROBE: {
         ktrace_probe_info_t* probe;
         mutex_acquire(&probe_list_lock);
@@ -170,6 +630,9 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
         mutex_release(&probe_list_lock);
         return probe->num;
     }
+    case KTRACE_ACTION_BOOT_STAGE:
+        ktrace_boot_stage((const char*) ptr, options, 0);
+        break;
     default:
         return ERR_INVALID_ARGS;
     }
@@ -191,19 +654,46 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    // The buffer is a VMO so that readers can map it. Its pages are all
+    // committed up front, since records are written with interrupts off.
     status_t status;
-    VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, 0, VMM_FLAG_COMMIT,
-                                ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
-        dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
+    uint8_t* buffer;
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, mb);
+    if (!vmo || (status = vmo->CommitRange(0, mb, nullptr)) < 0 ||
+        (status = VmAspace::kernel_aspace()->MapObject(
+             vmo, "ktrace", 0, mb, (void**)&buffer, 0, 0, VMM_FLAG_COMMIT,
+             ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
+        dprintf(INFO, "ktrace: cannot alloc buffer\n");
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    // the header and cpu indices, then a small slice for the names, and the
+    // rest split evenly between the cpus
+    ks->num_cpus = arch_max_num_cpus();
+    uint32_t header_size = ROUNDUP(static_cast<uint32_t>(
+        sizeof(ktrace_buffer_header_t) + ks->num_cpus * sizeof(ktrace_cpu_index_t)), PAGE_SIZE);
+    ks->header = (ktrace_buffer_header_t*) buffer;
+    ks->meta = buffer + header_size;
+    ks->meta_size = ROUNDUP(mb / KTRACE_META_FRACTION, 8);
+    ks->bufsize = ROUNDDOWN((mb - header_size - ks->meta_size) / ks->num_cpus, 8);
+    ktrace_cpu_index_t* index = (ktrace_cpu_index_t*) (ks->header + 1);
+    for (uint32_t cpu = 0; cpu < ks->num_cpus; cpu++) {
+        ks->cpu[cpu].index = &index[cpu];
+        ks->cpu[cpu].buf = ks->meta + ks->meta_size + cpu * ks->bufsize;
+    }
+    ks->circular = cmdline_get_bool("ktrace.circular", false);
+
+    ks->header->version = KTRACE_VERSION;
+    ks->header->flags = ks->circular ? KTRACE_BUFFER_CIRCULAR : 0;
+    ks->header->num_cpus = ks->num_cpus;
+    ks->header->meta_offset = header_size;
+    ks->header->meta_size = ks->meta_size;
+    ks->header->cpu_offset = header_size + ks->meta_size;
+    ks->header->cpu_size = ks->bufsize;
+    ks->vmo = mxtl::move(vmo);
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu%s)\n", buffer, mb, ks->bufsize,
+            ks->circular ? ", circular" : "");
 
     // register all static probes
     ktrace_probe_info_t *probe;
@@ -215,7 +705,7 @@ void ktrace_init(unsigned level) {
 
     // write metadata to the first two event slots
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->meta;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
@@ -223,74 +713,113 @@ void ktrace_init(unsigned level) {
     rec[1].b = (uint32_t)(n >> 32);
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+    __atomic_store_n(&ks->header->meta_len, KTRACE_RECSIZE * 2, __ATOMIC_RELEASE);
     ktrace_report_syscalls();
     ktrace_report_probes();
+    ktrace_boot_stages_from_cmdline();
+    ktrace_report_boot_stages();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
 
     // report names of existing threads
     ktrace_report_live_threads();
 }
 
+// Makes room for a |len| byte record in the current cpu's buffer and fills
+// in its header. Must be called with interrupts disabled. Returns NULL if a
+// linear trace has filled up, in which case tracing stops.
+static ktrace_header_t* ktrace_reserve(ktrace_state_t* ks, uint32_t tag, uint32_t tid) {
+    ktrace_cpu_t* kc = &ks->cpu[arch_curr_cpu_num()];
+    uint64_t head = kc->index->head;
+    uint32_t len = KTRACE_LEN(tag);
+    uint32_t off = static_cast<uint32_t>(head % ks->bufsize);
+    uint32_t room = ks->bufsize - off;
+
+    if (!ks->circular) {
+        if (head + len > ks->bufsize) {
+            // if we arrive at the end, stop
+            atomic_store(&ks->grpmask, 0);
+            return NULL;
+        }
+    } else {
+        // drop the oldest records until this one fits, including the
+        // skipped end of the buffer if it has to go at the start
+        uint64_t end = head + len + ((room < len) ? room : 0);
+        uint64_t tail = kc->index->tail;
+        if (end - tail > ks->bufsize) {
+            do {
+                uint32_t tail_off = static_cast<uint32_t>(tail % ks->bufsize);
+                uint32_t tail_tag = *(uint32_t*) (kc->buf + tail_off);
+                tail += tail_tag ? KTRACE_LEN(tail_tag) : ks->bufsize - tail_off;
+            } while (end - tail > ks->bufsize);
+
+            // readers must see the new tail before the records change
+            __atomic_store_n(&kc->index->tail, tail, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+        }
+        if (room < len) {
+            *(uint32_t*) (kc->buf + off) = 0;
+            head += room;
+            off = 0;
+        }
+    }
+
+    ktrace_header_t* hdr = (ktrace_header_t*) (kc->buf + off);
+    hdr->ts = ktrace_timestamp();
+    hdr->tag = tag;
+    hdr->tid = tid;
+    __atomic_store_n(&kc->index->head, head + len, __ATOMIC_RELEASE);
+    return hdr;
+}
+
 void ktrace_tiny(uint32_t tag, uint32_t arg) {
-    uint64_t ts = ktrace_timestamp();
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ts;
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        ktrace_reserve(ks, tag, arg);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
     }
 }
 
 void* ktrace_open(uint32_t tag) {
-    uint64_t ts = ktrace_timestamp();
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
         return NULL;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return NULL;
-    }
-
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ts;
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    ktrace_header_t* hdr = ktrace_reserve(ks, tag, (uint32_t)get_current_thread()->user_tid);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return hdr ? hdr + 1 : NULL;
 }
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if ((tag & atomic_load(&ks->grpmask)) || always) {
+        if (ks->meta == NULL)
+            return;
+
         uint32_t len = static_cast<uint32_t>(strnlen(name, 31));
 
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+        // names that don't fit are dropped, but tracing carries on
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&meta_lock, state);
+        uint32_t off = ks->header->meta_len;
+        if (off + KTRACE_LEN(tag) <= ks->meta_size) {
+            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->meta + off);
             rec->tag = tag;
             rec->id = id;
             rec->arg = arg;
             memcpy(rec->name, name, len);
             rec->name[len] = 0;
+            __atomic_store_n(&ks->header->meta_len, off + KTRACE_LEN(tag), __ATOMIC_RELEASE);
         }
+        spin_unlock_irqrestore(&meta_lock, state);
     }
 }
 
@@ -298,4 +827,85 @@ void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {
     ktrace_name_etc(tag, id, arg, name, false);
 }
 
+status_t ktrace_get_vmo(mxtl::RefPtr<VmObject>* vmo) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (!ks->vmo)
+        return ERR_NOT_SUPPORTED;
+    *vmo = ks->vmo;
+    return NO_ERROR;
+}
+
+// Drops user buffer |n|, moving the last one into its place. The stream being
+// read comes up short by whatever was left of it. Must be called with
+// reader_lock held.
+static void ktrace_user_buffer_drop(uint32_t n) {
+    uint32_t last = --user_buffer_count;
+    if (n != last) {
+        user_buffers[n] = mxtl::move(user_buffers[last]);
+        KTRACE_READER.user[n] = KTRACE_READER.user[last];
+    }
+    user_buffers[last].vmo.reset();
+}
+
+status_t ktrace_add_user_buffer(mxtl::RefPtr<VmObject> vmo) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->meta == NULL)
+        return ERR_BAD_STATE;
+
+    ktrace_user_header_t uh;
+    size_t actual;
+    if ((vmo->Read(&uh, 0, sizeof(uh), &actual) != NO_ERROR) || (actual != sizeof(uh)) ||
+        (uh.magic != KTRACE_USER_MAGIC) || (uh.size < KTRACE_MAX_RECSIZE) || (uh.size & 7) ||
+        (KTRACE_USER_HDRSIZE + (uint64_t)uh.size > vmo->size()))
+        return ERR_INVALID_ARGS;
+
+    mutex_acquire(&reader_lock);
+    for (uint32_t n = 0; n < user_buffer_count; n++) {
+        if (user_buffers[n].vmo == vmo) {
+            mutex_release(&reader_lock);
+            return ERR_ALREADY_EXISTS;
+        }
+    }
+    if (user_buffer_count == KTRACE_USER_BUFFERS) {
+        // the records of threads that are gone stay in the trace until
+        // room is needed
+        for (uint32_t n = 0; n < user_buffer_count; n++) {
+            if (user_buffers[n].vmo->only_reference()) {
+                ktrace_user_buffer_drop(n);
+                break;
+            }
+        }
+    }
+    if (user_buffer_count == KTRACE_USER_BUFFERS) {
+        mutex_release(&reader_lock);
+        return ERR_NO_RESOURCES;
+    }
+
+    // it joins the stream the next time it is sized
+    uint32_t n = user_buffer_count++;
+    ktrace_user_buffer_t* ub = &user_buffers[n];
+    ub->vmo = mxtl::move(vmo);
+    ub->size = uh.size;
+    ub->tid = (uint32_t)get_current_thread()->user_tid;
+    ub->start = 0;
+    KTRACE_READER.user[n].pos = 0;
+    KTRACE_READER.user[n].end = 0;
+    KTRACE_READER.user[n].rec_pos = UINT64_MAX;
+    mutex_release(&reader_lock);
+    return NO_ERROR;
+}
+
+status_t ktrace_remove_user_buffer(const mxtl::RefPtr<VmObject>& vmo) {
+    mutex_acquire(&reader_lock);
+    for (uint32_t n = 0; n < user_buffer_count; n++) {
+        if (user_buffers[n].vmo != vmo)
+            continue;
+        ktrace_user_buffer_drop(n);
+        mutex_release(&reader_lock);
+        return NO_ERROR;
+    }
+    mutex_release(&reader_lock);
+    return ERR_NOT_FOUND;
+}
+
 LK_INIT_HOOK(ktrace, ktrace_init, LK_INIT_LEVEL_APPS - 1);
@@ -0,0 +1,93 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+// The sampler keeps a periodic timer on each cpu so that its timer interrupt
+// fires at least at the sampling rate. The arch interrupt code hands the
+// interrupted context to ktrace_sample_irq(), which leaves a TAG_SAMPLE
+// record once the cpu's next sample is due, so other timers that happen to
+// fire in between don't skew the samples towards their callers.
+
+#define KTRACE_SAMPLE_MAX_RATE 1000 // per second, the timers run in ms
+
+typedef struct sampler_cpu {
+    timer_t timer;
+    lk_bigtime_t last;
+} __CPU_ALIGN sampler_cpu_t;
+
+bool ktrace_sampling;
+
+static sampler_cpu_t sampler_cpus[SMP_MAX_CPUS];
+static lk_time_t sampler_period;
+static mutex_t sampler_lock = MUTEX_INITIAL_VALUE(sampler_lock);
+
+static enum handler_return sampler_tick(timer_t* timer, lk_time_t now, void* arg) {
+    // the interrupt is all we want
+    return INT_NO_RESCHEDULE;
+}
+
+static void sampler_start_cpu(void* arg) {
+    sampler_cpu_t* sc = &sampler_cpus[arch_curr_cpu_num()];
+    timer_cancel(&sc->timer);
+    sc->last = 0;
+    timer_set_periodic(&sc->timer, sampler_period, sampler_tick, nullptr);
+}
+
+static void sampler_stop_cpu(void* arg) {
+    timer_cancel(&sampler_cpus[arch_curr_cpu_num()].timer);
+}
+
+status_t ktrace_sample_control(uint32_t rate) {
+    if (rate > KTRACE_SAMPLE_MAX_RATE)
+        return ERR_INVALID_ARGS;
+
+    mutex_acquire(&sampler_lock);
+    if (rate == 0) {
+        if (ktrace_sampling) {
+            __atomic_store_n(&ktrace_sampling, false, __ATOMIC_RELAXED);
+            mp_sync_exec(MP_CPU_ALL, sampler_stop_cpu, nullptr);
+        }
+    } else {
+        sampler_period = 1000 / rate;
+        mp_sync_exec(MP_CPU_ALL, sampler_start_cpu, nullptr);
+        __atomic_store_n(&ktrace_sampling, true, __ATOMIC_RELAXED);
+    }
+    mutex_release(&sampler_lock);
+    return NO_ERROR;
+}
+
+void ktrace_sample_irq(uintptr_t pc, uintptr_t fp, bool user) {
+    // take at most one sample a period, allowing for the timer firing early
+    // or late by up to half of one
+    sampler_cpu_t* sc = &sampler_cpus[arch_curr_cpu_num()];
+    lk_bigtime_t now = current_time_hires();
+    if (now - sc->last < sampler_period * 500000ull)
+        return;
+    sc->last = now;
+
+    uint64_t* rec = static_cast<uint64_t*>(ktrace_open(TAG_SAMPLE));
+    if (rec == nullptr)
+        return;
+
+    uintptr_t frames[KTRACE_SAMPLE_FRAMES];
+    size_t n = 0;
+    if (!user)
+        n = thread_get_backtrace(get_current_thread(), reinterpret_cast<void*>(fp),
+                                 frames, KTRACE_SAMPLE_FRAMES);
+    rec[0] = pc;
+    for (size_t i = 0; i < KTRACE_SAMPLE_FRAMES; i++)
+        rec[1 + i] = (i < n) ? frames[i] : 0;
+}
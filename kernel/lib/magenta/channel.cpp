@@ -112,6 +112,60 @@ status_t Channel::Write(size_t side, mxtl::unique_ptr<MessagePacket> msg) {
     return NO_ERROR;
 }
 
+status_t Channel::ReadMany(size_t side, size_t count, MessageSize* sizes, MessageList* msgs) {
+    DEBUG_ASSERT(count > 0u);
+    auto other = other_side(side);
+
+    AutoLock lock(&lock_);
+
+    if (messages_[side].is_empty())
+        return dispatcher_alive_[other] ? ERR_SHOULD_WAIT : ERR_REMOTE_CLOSED;
+
+    for (size_t i = 0; i < count && !messages_[side].is_empty(); i++) {
+        const MessagePacket& next = messages_[side].front();
+        if (next.data_size() > sizes[i].bytes || next.num_handles() > sizes[i].handles) {
+            if (i > 0)
+                break;
+            sizes[0].bytes = next.data_size();
+            sizes[0].handles = next.num_handles();
+            return ERR_BUFFER_TOO_SMALL;
+        }
+        sizes[i].bytes = next.data_size();
+        sizes[i].handles = next.num_handles();
+        msgs->push_back(messages_[side].pop_front());
+    }
+
+    if (messages_[side].is_empty()) {
+        state_tracker_[side].UpdateState(MX_CHANNEL_READABLE, 0u);
+    }
+
+    return NO_ERROR;
+}
+
+status_t Channel::WriteMany(size_t side, MessageList* msgs) {
+    auto other = other_side(side);
+
+    AutoLock lock(&lock_);
+    if (!dispatcher_alive_[other]) {
+        // As in Write(), leave the handles to the caller to put back.
+        for (auto& msg : *msgs)
+            msg.set_owns_handles(false);
+        msgs->clear();
+        return ERR_BAD_STATE;
+    }
+
+    while (!msgs->is_empty()) {
+        auto msg = msgs->pop_front();
+        auto size = msg->data_size();
+        messages_[other].push_back(mxtl::move(msg));
+        if (iopc_[other])
+            iopc_[other]->Signal(MX_CHANNEL_READABLE, size, &lock_);
+    }
+
+    state_tracker_[other].UpdateState(0u, MX_CHANNEL_READABLE);
+    return NO_ERROR;
+}
+
 StateTracker* Channel::GetStateTracker(size_t side) {
     return &state_tracker_[side];
 }
@@ -133,3 +187,11 @@ status_t Channel::SetIOPort(size_t side, mxtl::unique_ptr<PortClient> client) {
 
     return NO_ERROR;
 }
+
+void Channel::GetQueued(size_t side, uint64_t* count, uint64_t* bytes) {
+    AutoLock lock(&lock_);
+    for (const auto& msg : messages_[side]) {
+        *count += 1;
+        *bytes += msg.allocated_size();
+    }
+}
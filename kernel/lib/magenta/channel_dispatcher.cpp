@@ -79,6 +79,21 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     return channel_->Write(side_, mxtl::move(msg));
 }
 
+status_t ChannelDispatcher::ReadMany(size_t count, Channel::MessageSize* sizes,
+                                     Channel::MessageList* msgs) {
+    LTRACE_ENTRY;
+    return channel_->ReadMany(side_, count, sizes, msgs);
+}
+
+status_t ChannelDispatcher::WriteMany(Channel::MessageList* msgs) {
+    LTRACE_ENTRY;
+    return channel_->WriteMany(side_, msgs);
+}
+
+void ChannelDispatcher::GetQueued(uint64_t* count, uint64_t* bytes) {
+    channel_->GetQueued(side_, count, bytes);
+}
+
 status_t ChannelDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client) {
     LTRACE_ENTRY;
     return channel_->SetIOPort(side_, mxtl::move(client));
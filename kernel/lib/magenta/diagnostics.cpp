@@ -46,7 +46,7 @@ static char StateChar(const ProcessDispatcher& pd) {
 }
 
 static const char* ObjectTypeToString(mx_obj_type_t type) {
-    static_assert(MX_OBJ_TYPE_LAST == 19, "need to update switch below");
+    static_assert(MX_OBJ_TYPE_LAST == 21, "need to update switch below");
 
     switch (type) {
         case MX_OBJ_TYPE_PROCESS: return "process";
@@ -65,6 +65,8 @@ static const char* ObjectTypeToString(mx_obj_type_t type) {
         case MX_OBJ_TYPE_EVENT_PAIR: return "event-pair";
         case MX_OBJ_TYPE_JOB: return "job";
         case MX_OBJ_TYPE_VMAR: return "vmar";
+        case MX_OBJ_TYPE_FIFO: return "fifo";
+        case MX_OBJ_TYPE_PAGER: return "pager";
         default: return "???";
     }
 }
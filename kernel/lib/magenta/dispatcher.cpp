@@ -8,11 +8,15 @@
 #include <magenta/state_tracker.h>
 
 #include <arch/ops.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
 
 // The first 1K koids are reserved.
 static mx_koid_t global_koid = 1024ULL;
 
+KCOUNTER(dispatcher_create_count, "magenta.dispatcher.create");
+KCOUNTER(dispatcher_destroy_count, "magenta.dispatcher.destroy");
+
 mx_koid_t Dispatcher::GenerateKernelObjectId() {
     return atomic_add_u64(&global_koid, 1ULL);
 }
@@ -20,9 +24,11 @@ mx_koid_t Dispatcher::GenerateKernelObjectId() {
 Dispatcher::Dispatcher()
     : koid_(GenerateKernelObjectId()),
       handle_count_(0u) {
+    kcounter_add(&dispatcher_create_count, 1);
 }
 
 Dispatcher::~Dispatcher() {
+    kcounter_add(&dispatcher_destroy_count, 1);
 #if WITH_LIB_KTRACE
     ktrace(TAG_OBJECT_DELETE, (uint32_t)koid_, 0, 0, 0);
 #endif
@@ -0,0 +1,177 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/fifo_dispatcher.h>
+
+#include <assert.h>
+#include <err.h>
+#include <new.h>
+
+#include <kernel/auto_lock.h>
+#include <kernel/mutex.h>
+
+constexpr mx_rights_t kDefaultFifoRights =
+    MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
+
+// The state shared by the two endpoints.
+class FifoDispatcher::Ring : public mxtl::RefCounted<Ring> {
+public:
+    explicit Ring(uint64_t elem_count) : elem_count(elem_count) {}
+
+    // Recomputes the signals of both endpoints from the counters.
+    void UpdateSignalsLocked();
+
+    const uint64_t elem_count;
+
+    Mutex lock;
+    uint64_t head = 0u;
+    uint64_t tail = 0u;
+
+    // Cleared by each endpoint as it goes away.
+    FifoDispatcher* producer = nullptr;
+    FifoDispatcher* consumer = nullptr;
+};
+
+void FifoDispatcher::Ring::UpdateSignalsLocked() {
+    DEBUG_ASSERT(lock.IsHeld());
+
+    if (producer) {
+        if (head - tail < elem_count)
+            producer->state_tracker_.UpdateState(0u, MX_FIFO_WRITABLE);
+        else
+            producer->state_tracker_.UpdateState(MX_FIFO_WRITABLE, 0u);
+    }
+    if (consumer) {
+        if (head != tail)
+            consumer->state_tracker_.UpdateState(0u, MX_FIFO_READABLE);
+        else
+            consumer->state_tracker_.UpdateState(MX_FIFO_READABLE, 0u);
+    }
+}
+
+status_t FifoDispatcher::Create(uint64_t elem_count,
+                                mxtl::RefPtr<Dispatcher>* producer,
+                                mxtl::RefPtr<Dispatcher>* consumer,
+                                mx_rights_t* rights) {
+    AllocChecker ac;
+    mxtl::RefPtr<Ring> ring = mxtl::AdoptRef(new (&ac) Ring(elem_count));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto disp0 = new (&ac) FifoDispatcher(true, ring);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto disp1 = new (&ac) FifoDispatcher(false, ring);
+    if (!ac.check()) {
+        delete disp0;
+        return ERR_NO_MEMORY;
+    }
+
+    disp0->Init(disp1->get_koid());
+    disp1->Init(disp0->get_koid());
+
+    {
+        AutoLock lock(&ring->lock);
+        ring->producer = disp0;
+        ring->consumer = disp1;
+        ring->UpdateSignalsLocked();
+    }
+
+    *rights = kDefaultFifoRights;
+    *producer = mxtl::AdoptRef<Dispatcher>(disp0);
+    *consumer = mxtl::AdoptRef<Dispatcher>(disp1);
+    return NO_ERROR;
+}
+
+FifoDispatcher::FifoDispatcher(bool is_producer, mxtl::RefPtr<Ring> ring)
+    : is_producer_(is_producer), ring_(mxtl::move(ring)) {
+}
+
+FifoDispatcher::~FifoDispatcher() {
+    // An endpoint that never got a handle is destroyed without
+    // on_zero_handles().
+    Detach();
+}
+
+void FifoDispatcher::Init(mx_koid_t peer_koid) {
+    peer_koid_ = peer_koid;
+}
+
+void FifoDispatcher::Detach() {
+    AutoLock lock(&ring_->lock);
+    FifoDispatcher*& self = is_producer_ ? ring_->producer : ring_->consumer;
+    if (self != this)
+        return;
+    self = nullptr;
+
+    FifoDispatcher* peer = is_producer_ ? ring_->consumer : ring_->producer;
+    if (peer)
+        peer->state_tracker_.UpdateState(0u, MX_FIFO_PEER_CLOSED);
+}
+
+void FifoDispatcher::on_zero_handles() {
+    Detach();
+}
+
+status_t FifoDispatcher::user_signal(uint32_t clear_mask, uint32_t set_mask, bool peer) {
+    if ((set_mask & ~MX_USER_SIGNAL_ALL) || (clear_mask & ~MX_USER_SIGNAL_ALL))
+        return ERR_INVALID_ARGS;
+
+    if (!peer) {
+        state_tracker_.UpdateState(clear_mask, set_mask);
+        return NO_ERROR;
+    }
+
+    AutoLock lock(&ring_->lock);
+    FifoDispatcher* other = is_producer_ ? ring_->consumer : ring_->producer;
+    if (!other)
+        return ERR_REMOTE_CLOSED;
+    other->state_tracker_.UpdateState(clear_mask, set_mask);
+    return NO_ERROR;
+}
+
+mx_status_t FifoDispatcher::Op(uint32_t op, uint64_t count, mx_fifo_state_t* out) {
+    AutoLock lock(&ring_->lock);
+
+    switch (op) {
+    case MX_FIFO_OP_READ_STATE:
+        if (count != 0u)
+            return ERR_INVALID_ARGS;
+        break;
+
+    case MX_FIFO_OP_ADVANCE_HEAD:
+        if (!is_producer_)
+            return ERR_NOT_SUPPORTED;
+        if (!ring_->consumer)
+            return ERR_REMOTE_CLOSED;
+        if (count > ring_->elem_count - (ring_->head - ring_->tail))
+            return ERR_OUT_OF_RANGE;
+        if (count) {
+            ring_->head += count;
+            ring_->UpdateSignalsLocked();
+        }
+        break;
+
+    case MX_FIFO_OP_ADVANCE_TAIL:
+        if (is_producer_)
+            return ERR_NOT_SUPPORTED;
+        if (count > ring_->head - ring_->tail)
+            return ERR_OUT_OF_RANGE;
+        if (count) {
+            ring_->tail += count;
+            ring_->UpdateSignalsLocked();
+        }
+        break;
+
+    default:
+        return ERR_INVALID_ARGS;
+    }
+
+    out->head = ring_->head;
+    out->tail = ring_->tail;
+    return NO_ERROR;
+}
@@ -26,7 +26,24 @@ FutexContext::~FutexContext() {
 status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t timeout) {
     LTRACE_ENTRY;
 
+    return WaitInternal(value_ptr, current_value, timeout, nullptr);
+}
+
+status_t FutexContext::FutexWaitPi(user_ptr<int> value_ptr, int current_value,
+                                   mxtl::RefPtr<UserThread> owner, mx_time_t timeout) {
+    LTRACE_ENTRY;
+
+    UserThread* t = UserThread::GetCurrent();
+    if (!owner || owner.get() == t || owner->process() != t->process())
+        return ERR_INVALID_ARGS;
+
+    return WaitInternal(value_ptr, current_value, timeout, mxtl::move(owner));
+}
+
+status_t FutexContext::WaitInternal(user_ptr<int> value_ptr, int current_value, mx_time_t timeout,
+                                    mxtl::RefPtr<UserThread> pi_owner) {
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
+    Bucket* bucket = GetBucket(futex_key);
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -35,22 +52,22 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    bucket->lock.Acquire();
 
     UserThread* t = UserThread::GetCurrent();
     if (t->state() == UserThread::State::DYING || t->state() == UserThread::State::DEAD) {
-        lock_.Release();
+        bucket->lock.Release();
         return ERR_BAD_STATE;
     }
 
     int value;
     status_t result = value_ptr.copy_from_user(&value);
     if (result != NO_ERROR) {
-        lock_.Release();
+        bucket->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        bucket->lock.Release();
         return ERR_BAD_STATE;
     }
 
@@ -58,19 +75,44 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    const bool pi = (pi_owner != nullptr);
+    if (pi)
+        node->set_pi_owner(mxtl::move(pi_owner), get_current_thread()->priority);
+
+    QueueNodesLocked(bucket, node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, timeout);
-    if (result == NO_ERROR) {
+    // Lend our priority to the owner now that it can see us waiting.
+    if (pi) {
+        AutoLock pi_lock(pi_lock_);
+        pi_waiters_.push_back(node);
+        UpdatePiOwnerLocked(node->get_pi_owner());
+    }
+
+    // Block current thread.  This releases the bucket lock and does not reacquire it.
+    result = node->BlockThread(&bucket->lock, timeout);
+    if (result == NO_ERROR && !pi) {
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
 
-    AutoLock lock(lock_);
+    // Declared before the lock so that our reference to the owner is
+    // dropped after the bucket lock is released.
+    mxtl::RefPtr<UserThread> owner;
+    bucket = LockNodeBucket(node);
     // If we got a timeout, we need to remove the thread's node from the
     // wait queue, since FutexWake() didn't do that.
-    if (UnqueueNodeLocked(node)) {
+    bool timed_out = (result != NO_ERROR) && UnqueueNodeLocked(bucket, node);
+
+    // Stop lending our priority, whether we were woken or gave up.
+    if (pi) {
+        AutoLock pi_lock(pi_lock_);
+        DEBUG_ASSERT(!node->InPiList());
+        owner = node->take_pi_owner();
+        UpdatePiOwnerLocked(owner.get());
+    }
+    bucket->lock.Release();
+
+    if (timed_out) {
         return ERR_TIMED_OUT;
     }
     // The current thread was not found on the wait queue.  This means
@@ -98,52 +140,66 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
 void FutexContext::WakeAll() {
     LTRACE_ENTRY;
 
-    AutoLock lock(lock_);
-    for(auto &entry : futex_table_) {
-        FutexNode::WakeThreads(&entry);
+    for (auto& bucket : buckets_) {
+        AutoLock lock(bucket.lock);
+        for (auto& entry : bucket.table) {
+            RemovePiWaiters(&entry);
+            FutexNode::WakeThreads(&entry);
+        }
+        bucket.table.clear();
     }
-    futex_table_.clear();
 }
 
 void FutexContext::WakeKilledThread(FutexNode* node) {
     LTRACE_ENTRY;
 
-    AutoLock lock(lock_);
-    if (UnqueueNodeLocked(node))
+    Bucket* bucket = LockNodeBucket(node);
+    if (UnqueueNodeLocked(bucket, node))
         node->WakeKilledThread();
+    bucket->lock.Release();
 }
 
-status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count) {
+status_t FutexContext::FutexWake(user_ptr<int> value_ptr, uint32_t count, bool lifo) {
     LTRACE_ENTRY;
 
     if (count == 0) return NO_ERROR;
 
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
+    Bucket* bucket = GetBucket(futex_key);
 
     {
-        AutoLock lock(lock_);
+        AutoLock lock(bucket->lock);
 
-        FutexNode* node = futex_table_.erase(futex_key);
+        FutexNode* node = bucket->table.erase(futex_key);
         if (!node) {
             // nothing blocked on this futex if we can't find it
             return NO_ERROR;
         }
         DEBUG_ASSERT(node->GetKey() == futex_key);
 
-        FutexNode* wake_head = node;
-        node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+        FutexNode* wake_head;
+        if (lifo) {
+            node = FutexNode::RemoveFromTail(node, count, futex_key, &wake_head);
+        } else {
+            wake_head = node;
+            node = FutexNode::RemoveFromHead(node, count, futex_key, 0u);
+        }
         // node is now the new blocked thread list head
 
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
-            futex_table_.insert(node);
+            bucket->table.insert(node);
         }
 
         // Traversing this list of threads must be done while holding the
         // lock, because any of these threads might wake up from a timeout
         // and call FutexWait(), which would clobber the "next" pointer in
         // the thread's FutexNode.
+        RemovePiWaiters(wake_head);
         FutexNode::WakeThreads(wake_head);
+
+        // Waking a PI futex releases it, so drop what the woken waiters lent us.
+        UpdateCurrentPiOwner();
     }
 
     return NO_ERROR;
@@ -156,7 +212,37 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ERR_INVALID_ARGS;
 
-    AutoLock lock(lock_);
+    uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+    if (wake_key == requeue_key) return ERR_INVALID_ARGS;
+
+    // Lock the two buckets involved, in address order so that two requeues
+    // going opposite ways can't deadlock.
+    Bucket* wake_bucket = GetBucket(wake_key);
+    Bucket* requeue_bucket = GetBucket(requeue_key);
+    Bucket* first = (wake_bucket < requeue_bucket) ? wake_bucket : requeue_bucket;
+    Bucket* second = (wake_bucket < requeue_bucket) ? requeue_bucket : wake_bucket;
+
+    first->lock.Acquire();
+    if (second != first)
+        second->lock.Acquire();
+
+    status_t result = RequeueLocked(wake_bucket, wake_ptr, wake_count, current_value,
+                                    requeue_bucket, requeue_ptr, requeue_count);
+
+    if (second != first)
+        second->lock.Release();
+    first->lock.Release();
+
+    return result;
+}
+
+status_t FutexContext::RequeueLocked(Bucket* wake_bucket, user_ptr<int> wake_ptr,
+                                     uint32_t wake_count, int current_value,
+                                     Bucket* requeue_bucket, user_ptr<int> requeue_ptr,
+                                     uint32_t requeue_count) {
+    DEBUG_ASSERT(wake_bucket->lock.IsHeld());
+    DEBUG_ASSERT(requeue_bucket->lock.IsHeld());
 
     int value;
     status_t result = wake_ptr.copy_from_user(&value);
@@ -165,12 +251,11 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
     uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
-    if (wake_key == requeue_key) return ERR_INVALID_ARGS;
 
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on the tables look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_bucket->table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return NO_ERROR;
@@ -194,22 +279,48 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_bucket, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_bucket->table.insert(node);
+    }
+
+    if (wake_head) {
+        RemovePiWaiters(wake_head);
+        FutexNode::WakeThreads(wake_head);
     }
 
-    FutexNode::WakeThreads(wake_head);
+    UpdateCurrentPiOwner();
+
     return NO_ERROR;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+FutexContext::Bucket* FutexContext::GetBucket(uintptr_t futex_key) {
+    // Futexes are often packed together (e.g. in an array of mutexes), so
+    // mix the address up rather than using its low bits.
+    uint64_t hash = (static_cast<uint64_t>(futex_key) >> 2) * 0x9e3779b97f4a7c15ull;
+    return &buckets_[(hash >> 32) % kNumBuckets];
+}
+
+FutexContext::Bucket* FutexContext::LockNodeBucket(FutexNode* node) {
+    // The key of a node only changes with the locks of both its old and its
+    // new bucket held, so once we hold the lock of the bucket that matches
+    // the key, it stays that way.
+    for (;;) {
+        Bucket* bucket = GetBucket(node->GetKey());
+        bucket->lock.Acquire();
+        if (GetBucket(node->GetKey()) == bucket)
+            return bucket;
+        bucket->lock.Release();
+    }
+}
+
+void FutexContext::QueueNodesLocked(Bucket* bucket, FutexNode* head) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -217,15 +328,52 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!bucket->table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
+void FutexContext::RemovePiWaiters(FutexNode* head) {
+    // The nodes' PI owners can't change while they are queued, so check
+    // them before taking |pi_lock_|; most futexes aren't priority inheriting.
+    bool any_pi = false;
+    FutexNode::ForEachInList(head, [&any_pi](FutexNode* node) {
+        if (node->get_pi_owner())
+            any_pi = true;
+    });
+    if (!any_pi)
+        return;
+
+    AutoLock lock(pi_lock_);
+    FutexNode::ForEachInList(head, [this](FutexNode* node) {
+        if (node->InPiList())
+            pi_waiters_.erase(*node);
+    });
+}
+
+void FutexContext::UpdatePiOwnerLocked(UserThread* owner) {
+    DEBUG_ASSERT(pi_lock_.IsHeld());
+
+    int priority = -1;
+    for (auto& node : pi_waiters_) {
+        if (node.get_pi_owner() == owner && node.pi_priority() > priority)
+            priority = node.pi_priority();
+    }
+    owner->set_inherited_priority(priority);
+}
+
+void FutexContext::UpdateCurrentPiOwner() {
+    UserThread* t = UserThread::GetCurrent();
+    if (t->inherited_priority() >= 0) {
+        AutoLock lock(pi_lock_);
+        UpdatePiOwnerLocked(t);
+    }
+}
+
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
+bool FutexContext::UnqueueNodeLocked(Bucket* bucket, FutexNode* node) {
+    DEBUG_ASSERT(bucket->lock.IsHeld());
 
     if (!node->IsInQueue())
         return false;
@@ -235,11 +383,18 @@ bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
     // However, that could be out of date if the thread was requeued by
     // FutexRequeue(), so we need to re-get the hash table key here.
     uintptr_t futex_key = node->GetKey();
+    DEBUG_ASSERT(GetBucket(futex_key) == bucket);
 
-    FutexNode* old_head = futex_table_.erase(futex_key);
+    FutexNode* old_head = bucket->table.erase(futex_key);
     DEBUG_ASSERT(old_head);
     FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
     if (new_head)
-        futex_table_.insert(new_head);
+        bucket->table.insert(new_head);
+
+    if (node->get_pi_owner()) {
+        AutoLock lock(pi_lock_);
+        if (node->InPiList())
+            pi_waiters_.erase(*node);
+    }
     return true;
 }
@@ -8,6 +8,7 @@
 #include <err.h>
 #include <magenta/futex_node.h>
 #include <magenta/magenta.h>
+#include <magenta/user_thread.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -99,6 +100,69 @@ FutexNode* FutexNode::RemoveFromHead(FutexNode* list_head, uint32_t count,
     return node;
 }
 
+// This removes up to |count| nodes from the tail of |list_head|, the threads
+// which blocked most recently, and puts them in a list in |*removed|. The
+// first one taken is the last of them which last ran on this cpu if there
+// is one among the last WAIT_QUEUE_LIFO_SCAN, as wait_queue_wake_one_lifo()
+// does. It returns the list of remaining nodes, which may be null (empty).
+// The removed nodes get a hash key of 0.
+FutexNode* FutexNode::RemoveFromTail(FutexNode* list_head, uint32_t count,
+                                     uintptr_t old_hash_key,
+                                     FutexNode** removed) {
+    ASSERT(list_head);
+    ASSERT(count != 0);
+
+    // The waiting threads are blocked in their nodes' wait queues: the
+    // bucket lock held by the caller is only dropped once they are.
+    FutexNode* node = list_head->queue_prev_;
+    {
+        THREAD_LOCK(state);
+        int cpu = arch_curr_cpu_num();
+        FutexNode* candidate = node;
+        for (int i = 0; i < WAIT_QUEUE_LIFO_SCAN; i++) {
+            thread_t* t = list_peek_head_type(&candidate->wait_queue_.list, thread_t, queue_node);
+            if (t && thread_last_cpu(t) == cpu) {
+                node = candidate;
+                break;
+            }
+            if (candidate == list_head)
+                break;
+            candidate = candidate->queue_prev_;
+        }
+        THREAD_UNLOCK(state);
+    }
+
+    FutexNode* removed_head = nullptr;
+    for (;;) {
+        DEBUG_ASSERT(node->GetKey() == old_hash_key);
+        list_head = RemoveNodeFromList(list_head, node);
+        node->set_hash_key(0u);
+        node->SetAsSingletonList();
+        if (removed_head)
+            removed_head->AppendList(node);
+        else
+            removed_head = node;
+
+        if (--count == 0 || list_head == nullptr)
+            break;
+        node = list_head->queue_prev_;
+    }
+
+    *removed = removed_head;
+    return list_head;
+}
+
+void FutexNode::set_pi_owner(mxtl::RefPtr<UserThread> owner, int priority) {
+    DEBUG_ASSERT(!pi_owner_);
+    pi_owner_ = mxtl::move(owner);
+    pi_priority_ = priority;
+}
+
+mxtl::RefPtr<UserThread> FutexNode::take_pi_owner() {
+    pi_priority_ = -1;
+    return mxtl::move(pi_owner_);
+}
+
 // This blocks the current thread.  This releases the given mutex (which
 // must be held when BlockThread() is called).  To reduce contention, it
 // does not reclaim the mutex on return.
@@ -1,12 +1,19 @@
 // Copyright 2016 The Fuchsia Authors. All rights reserved.
 // This is a GENERATED file. The license governing this file can be found in the LICENSE file.
 
-mx_time_t sys_time_get(
+mx_time_t sys_clock_get(
     uint32_t clock_id);
 
 mx_status_t sys_nanosleep(
     mx_time_t nanoseconds);
 
+mx_time_t sys_time_get(
+    uint32_t clock_id);
+
+uint64_t sys_ticks_get();
+
+uint64_t sys_ticks_per_second();
+
 uint32_t sys_num_cpus();
 
 mx_status_t sys_version_get(
@@ -26,6 +33,16 @@ mx_status_t sys_handle_replace(
     mx_rights_t rights,
     mx_handle_t out[1]);
 
+mx_status_t sys_handle_close_many(
+    const mx_handle_t handles[],
+    uint32_t num_handles);
+
+mx_status_t sys_handle_duplicate_many(
+    mx_handle_t handle,
+    mx_rights_t rights,
+    mx_handle_t out[],
+    uint32_t num_handles);
+
 mx_status_t sys_handle_wait_one(
     mx_handle_t handle,
     mx_signals_t waitfor,
@@ -102,6 +119,28 @@ mx_status_t sys_channel_write(
     const mx_handle_t handles[],
     uint32_t num_handles);
 
+mx_status_t sys_channel_call(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_time_t timeout,
+    const mx_channel_call_args_t args[1],
+    uint32_t actual_bytes[1],
+    uint32_t actual_handles[1],
+    mx_status_t read_status[1]);
+
+mx_status_t sys_channel_read_many(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_channel_msg_t msgs[],
+    uint32_t count,
+    uint32_t actual[1]);
+
+mx_status_t sys_channel_write_many(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_channel_msg_t msgs[],
+    uint32_t count);
+
 mx_status_t sys_socket_create(
     uint32_t options,
     mx_handle_t out0[1],
@@ -121,6 +160,36 @@ mx_status_t sys_socket_read(
     size_t size,
     size_t actual[1]);
 
+mx_status_t sys_socket_write_vmo(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_handle_t vmo,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]);
+
+mx_status_t sys_socket_splice(
+    mx_handle_t src,
+    mx_handle_t dst,
+    uint32_t options,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]);
+
+mx_status_t sys_fifo_create(
+    uint32_t elem_count,
+    uint32_t elem_size,
+    uint32_t options,
+    mx_handle_t producer[1],
+    mx_handle_t consumer[1],
+    mx_handle_t vmo[1]);
+
+mx_status_t sys_fifo_op(
+    mx_handle_t handle,
+    uint32_t op,
+    uint64_t count,
+    mx_fifo_state_t state[1]);
+
 void sys_thread_exit();
 
 mx_status_t sys_thread_create(
@@ -137,6 +206,16 @@ mx_status_t sys_thread_start(
     uintptr_t arg1,
     uintptr_t arg2);
 
+mx_status_t sys_thread_create_start(
+    mx_handle_t process,
+    const char name[],
+    uint32_t name_len,
+    uintptr_t thread_entry,
+    uintptr_t stack,
+    uintptr_t arg1,
+    uintptr_t arg2,
+    mx_handle_t out[1]);
+
 mx_status_t sys_thread_read_state(
     mx_handle_t handle,
     uint32_t kind,
@@ -168,6 +247,13 @@ mx_status_t sys_process_start(
     mx_handle_t arg_handle,
     uintptr_t arg2);
 
+mx_status_t sys_process_start_etc(
+    mx_handle_t process_handle,
+    mx_handle_t thread_handle,
+    const mx_process_start_t args[1],
+    mx_process_map_t maps[],
+    uint32_t num_maps);
+
 mx_status_t sys_process_map_vm(
     mx_handle_t proc_handle,
     mx_handle_t vmo_handle,
@@ -187,6 +273,12 @@ mx_status_t sys_process_protect_vm(
     size_t len,
     uint32_t prot);
 
+mx_status_t sys_process_advise_vm(
+    mx_handle_t proc_handle,
+    uintptr_t address,
+    size_t len,
+    uint32_t advice);
+
 mx_status_t sys_process_read_memory(
     mx_handle_t proc,
     uintptr_t vaddr,
@@ -194,6 +286,17 @@ mx_status_t sys_process_read_memory(
     size_t len,
     size_t actual[1]);
 
+mx_status_t sys_process_read_memory_many(
+    mx_handle_t proc,
+    mx_process_read_t reads[],
+    uint32_t count);
+
+mx_status_t sys_process_map_view(
+    mx_handle_t proc,
+    uintptr_t vaddr,
+    size_t len,
+    uintptr_t ptr[1]);
+
 mx_status_t sys_process_write_memory(
     mx_handle_t proc,
     uintptr_t vaddr,
@@ -238,6 +341,17 @@ mx_status_t sys_futex_requeue(
     mx_futex_t requeue_ptr[1],
     uint32_t requeue_count);
 
+mx_status_t sys_futex_wait_pi(
+    mx_futex_t value_ptr[1],
+    int current_value,
+    mx_handle_t owner,
+    mx_time_t timeout);
+
+mx_status_t sys_futex_wake_etc(
+    mx_futex_t value_ptr[1],
+    uint32_t count,
+    uint32_t options);
+
 mx_status_t sys_waitset_create(
     uint32_t options,
     mx_handle_t out[1]);
@@ -273,12 +387,27 @@ mx_status_t sys_port_wait(
     void* packet,
     size_t size);
 
+mx_status_t sys_port_wait_many(
+    mx_handle_t handle,
+    mx_time_t timeout,
+    void* packets,
+    size_t size,
+    uint32_t count,
+    uint32_t actual[1]);
+
 mx_status_t sys_port_bind(
     mx_handle_t handle,
     uint64_t key,
     mx_handle_t source,
     mx_signals_t signals);
 
+mx_status_t sys_object_wait_async(
+    mx_handle_t handle,
+    mx_handle_t port,
+    uint64_t key,
+    mx_signals_t signals,
+    uint32_t options);
+
 mx_status_t sys_vmo_create(
     uint64_t size,
     uint32_t options,
@@ -314,6 +443,16 @@ mx_status_t sys_vmo_op_range(
     void* buffer,
     size_t buffer_size);
 
+mx_status_t sys_vmo_clone(
+    mx_handle_t handle,
+    uint32_t options,
+    uint64_t offset,
+    uint64_t size,
+    mx_handle_t out[1]);
+
+mx_status_t sys_memory_pressure_event(
+    mx_handle_t out[1]);
+
 mx_status_t sys_cprng_draw(
     void* buffer,
     size_t len,
@@ -323,6 +462,25 @@ mx_status_t sys_cprng_add_entropy(
     const void* buffer,
     size_t len);
 
+mx_status_t sys_pager_create(
+    uint32_t options,
+    mx_handle_t out[1]);
+
+mx_status_t sys_pager_create_vmo(
+    mx_handle_t pager,
+    mx_handle_t port,
+    uint64_t key,
+    uint64_t size,
+    uint32_t options,
+    mx_handle_t out[1]);
+
+mx_status_t sys_pager_supply_pages(
+    mx_handle_t pager,
+    mx_handle_t pager_vmo,
+    uint64_t offset,
+    uint64_t length,
+    mx_handle_t aux_vmo);
+
 mx_handle_t sys_log_create(
     uint32_t options);
 
@@ -391,6 +549,11 @@ mx_status_t sys_interrupt_complete(
 mx_status_t sys_interrupt_wait(
     mx_handle_t handle);
 
+mx_status_t sys_interrupt_set_affinity(
+    mx_handle_t handle,
+    uint32_t cpu,
+    uint32_t options);
+
 mx_status_t sys_mmap_device_io(
     mx_handle_t handle,
     uint32_t io_addr,
@@ -502,6 +665,11 @@ uint32_t sys_acpi_uefi_rsdp(
 mx_status_t sys_acpi_cache_flush(
     mx_handle_t handle);
 
+mx_status_t sys_acpi_set_cstates(
+    mx_handle_t handle,
+    const mx_acpi_cstate_t states[],
+    uint32_t count);
+
 mx_status_t sys_resource_create(
     mx_handle_t parent_handle,
     const mx_rrec_t records[],
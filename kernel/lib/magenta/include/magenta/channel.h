@@ -21,6 +21,14 @@ class MessagePacket;
 
 class Channel : public mxtl::RefCounted<Channel> {
 public:
+    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
+
+    // Space for one message, for ReadMany().
+    struct MessageSize {
+        uint32_t bytes;
+        uint32_t handles;
+    };
+
     Channel();
     ~Channel();
 
@@ -37,12 +45,23 @@ public:
                   bool may_discard);
     status_t Write(size_t side, mxtl::unique_ptr<MessagePacket> msg);
 
+    // Batched versions of Read() and Write(), which take the lock once.
+    // ReadMany() dequeues up to |count| messages into |msgs|, stopping at the
+    // first one that doesn't fit the matching entry of |sizes|; on return the
+    // entries hold the actual sizes. If not even the first message fits it
+    // returns ERR_BUFFER_TOO_SMALL with that message's size in |sizes[0]|.
+    // WriteMany() queues all of |msgs| together, or none of them.
+    status_t ReadMany(size_t side, size_t count, MessageSize* sizes, MessageList* msgs);
+    status_t WriteMany(size_t side, MessageList* msgs);
+
+    // Adds the number of messages waiting to be read by |side| and the
+    // kernel memory they hold to |*count| and |*bytes|.
+    void GetQueued(size_t side, uint64_t* count, uint64_t* bytes);
+
     StateTracker* GetStateTracker(size_t side);
     status_t SetIOPort(size_t side, mxtl::unique_ptr<PortClient> client);
 
 private:
-    using MessageList = mxtl::DoublyLinkedList<mxtl::unique_ptr<MessagePacket>>;
-
     Mutex lock_;
     bool dispatcher_alive_[2];
     MessageList messages_[2];
@@ -13,12 +13,14 @@
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
+#include <mxtl/object_cache.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/unique_ptr.h>
 
 class PortClient;
 
-class ChannelDispatcher final : public Dispatcher {
+class ChannelDispatcher final : public Dispatcher,
+                                public mxtl::ObjectCacheAllocated<ChannelDispatcher> {
 public:
     static status_t Create(uint32_t flags, mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
@@ -40,6 +42,11 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+    // See Channel::ReadMany() and Channel::WriteMany() for details.
+    status_t ReadMany(size_t count, Channel::MessageSize* sizes, Channel::MessageList* msgs);
+    status_t WriteMany(Channel::MessageList* msgs);
+    // See Channel::GetQueued() for details.
+    void GetQueued(uint64_t* count, uint64_t* bytes);
 
 private:
     ChannelDispatcher(uint32_t flags, size_t side, mxtl::RefPtr<Channel> channel);
@@ -43,6 +43,8 @@ DECLARE_DISPTAG(ResourceDispatcher, MX_OBJ_TYPE_RESOURCE)
 DECLARE_DISPTAG(EventPairDispatcher, MX_OBJ_TYPE_EVENT_PAIR)
 DECLARE_DISPTAG(JobDispatcher, MX_OBJ_TYPE_JOB)
 DECLARE_DISPTAG(VmAddressRegionDispatcher, MX_OBJ_TYPE_VMAR)
+DECLARE_DISPTAG(FifoDispatcher, MX_OBJ_TYPE_FIFO)
+DECLARE_DISPTAG(PagerDispatcher, MX_OBJ_TYPE_PAGER)
 
 #undef DECLARE_DISPTAG
 
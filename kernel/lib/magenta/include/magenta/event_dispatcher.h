@@ -8,10 +8,12 @@
 
 #include <magenta/dispatcher.h>
 #include <magenta/state_tracker.h>
+#include <mxtl/object_cache.h>
 
 #include <sys/types.h>
 
-class EventDispatcher final : public Dispatcher {
+class EventDispatcher final : public Dispatcher,
+                              public mxtl::ObjectCacheAllocated<EventDispatcher> {
 public:
     static status_t Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
                            mx_rights_t* rights);
@@ -9,10 +9,12 @@
 #include <kernel/mutex.h>
 #include <magenta/dispatcher.h>
 #include <magenta/state_tracker.h>
+#include <mxtl/object_cache.h>
 #include <mxtl/ref_ptr.h>
 #include <sys/types.h>
 
-class EventPairDispatcher final : public Dispatcher {
+class EventPairDispatcher final : public Dispatcher,
+                                  public mxtl::ObjectCacheAllocated<EventPairDispatcher> {
 public:
     static status_t Create(mxtl::RefPtr<Dispatcher>* dispatcher0,
                            mxtl::RefPtr<Dispatcher>* dispatcher1,
@@ -0,0 +1,60 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <magenta/dispatcher.h>
+#include <magenta/state_tracker.h>
+#include <magenta/types.h>
+
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+
+// A fifo is a ring of fixed size elements that lives in a VMO mapped by both
+// of its endpoints, a producer and a consumer. The kernel never touches the
+// elements; it only keeps the head (elements produced) and tail (elements
+// consumed) counters, so it can tell the producer when there is room and the
+// consumer when there is data via MX_FIFO_WRITABLE and MX_FIFO_READABLE.
+class FifoDispatcher final : public Dispatcher {
+public:
+    static status_t Create(uint64_t elem_count,
+                           mxtl::RefPtr<Dispatcher>* producer,
+                           mxtl::RefPtr<Dispatcher>* consumer,
+                           mx_rights_t* rights);
+
+    ~FifoDispatcher() final;
+
+    // Dispatcher implementation.
+    mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_FIFO; }
+    StateTracker* get_state_tracker() final { return &state_tracker_; }
+    void on_zero_handles() final;
+    status_t user_signal(uint32_t clear_mask, uint32_t set_mask, bool peer) final;
+    mx_koid_t get_inner_koid() const final { return peer_koid_; }
+
+    // Fifo methods.
+
+    // Does one of the MX_FIFO_OP_* operations and returns the resulting
+    // state. Only the producer can advance the head, only the consumer can
+    // advance the tail, and neither can move past the other.
+    mx_status_t Op(uint32_t op, uint64_t count, mx_fifo_state_t* out);
+
+private:
+    class Ring;
+
+    FifoDispatcher(bool is_producer, mxtl::RefPtr<Ring> ring);
+    void Init(mx_koid_t peer_koid);
+    void Detach();
+
+    const bool is_producer_;
+    const mxtl::RefPtr<Ring> ring_;
+
+    // Set in Init(); never changes otherwise.
+    mx_koid_t peer_koid_ = 0u;
+
+    StateTracker state_tracker_;
+};
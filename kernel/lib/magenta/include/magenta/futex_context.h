@@ -10,6 +10,9 @@
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/futex_node.h>
 #include <magenta/types.h>
+#include <mxtl/ref_ptr.h>
+
+class UserThread;
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
@@ -23,6 +26,11 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+//
+// The table is split into buckets, each with its own lock, so that operations on futexes in
+// different buckets don't contend. Threads waiting on priority inheriting futexes are also kept
+// on |pi_waiters_|, so that the priority an owner inherits can be worked out without looking at
+// every bucket.
 class FutexContext {
 public:
     FutexContext();
@@ -35,8 +43,17 @@ public:
     // on the same |value_ptr| futex.
     status_t FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t timeout);
 
+    // FutexWaitPi is FutexWait for a priority inheriting lock held by |owner|,
+    // a thread in the same process.  While the current thread is blocked on the
+    // futex, |owner| runs at no lower a priority than it.  The boost is dropped
+    // when |owner| wakes the futex or the waiters give up.
+    status_t FutexWaitPi(user_ptr<int> value_ptr, int current_value,
+                         mxtl::RefPtr<UserThread> owner, mx_time_t timeout);
+
     // FutexWake will wake up to |count| number of threads blocked on the |value_ptr| futex.
-    status_t FutexWake(user_ptr<int> value_ptr, uint32_t count);
+    // They are the ones that have waited the longest, unless |lifo| is set, in which case
+    // they are the ones that started waiting last; see FutexNode::RemoveFromTail().
+    status_t FutexWake(user_ptr<int> value_ptr, uint32_t count, bool lifo);
 
     // FutexWait first verifies that the integer pointed to by |wake_ptr|
     // still equals |current_value|. If the test fails, FutexWait returns FAILED_PRECONDITION.
@@ -56,14 +73,49 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head);
+    status_t WaitInternal(user_ptr<int> value_ptr, int current_value, mx_time_t timeout,
+                          mxtl::RefPtr<UserThread> pi_owner);
+
+    static constexpr size_t kNumBuckets = 16u;
+
+    struct Bucket {
+        // protects table
+        Mutex lock;
+
+        // Key is futex address, value is the FutexNode for the head of futex's blocked thread
+        // list.
+        FutexNode::HashTable table;
+    };
+
+    Bucket* GetBucket(uintptr_t futex_key);
+
+    // Locks the bucket that |node| is currently queued in (or would have been, if it has
+    // already been woken). The bucket can change until its lock is held because of requeues.
+    Bucket* LockNodeBucket(FutexNode* node);
+
+    status_t RequeueLocked(Bucket* wake_bucket, user_ptr<int> wake_ptr, uint32_t wake_count,
+                           int current_value, Bucket* requeue_bucket, user_ptr<int> requeue_ptr,
+                           uint32_t requeue_count);
+
+    static void QueueNodesLocked(Bucket* bucket, FutexNode* head);
+
+    // Takes the nodes in the list starting at |head|, which are about to be woken, off
+    // |pi_waiters_|.
+    void RemovePiWaiters(FutexNode* head);
+
+    // Recomputes the priority |owner| inherits from PI waiters in this context.
+    void UpdatePiOwnerLocked(UserThread* owner);
+
+    // Drops what the current thread inherited from waiters that were just woken.
+    void UpdateCurrentPiOwner();
+
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node);
 
-    bool UnqueueNodeLocked(FutexNode* node);
+    Bucket buckets_[kNumBuckets];
 
-    // protects futex_table_
-    Mutex lock_;
+    // Protects |pi_waiters_|. Only ever acquired with at most a bucket lock held.
+    Mutex pi_lock_;
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_;
+    // The waiters on priority inheriting futexes that are in a blocked thread list.
+    FutexNode::PiList pi_waiters_;
 };
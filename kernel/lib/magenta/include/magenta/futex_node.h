@@ -11,13 +11,27 @@
 #include <kernel/wait.h>
 #include <list.h>
 #include <magenta/types.h>
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_hash_table.h>
+#include <mxtl/ref_ptr.h>
+
+class UserThread;
 
 // Node for linked list of threads blocked on a futex
 // Intended to be embedded within a UserThread Instance
 class FutexNode : public mxtl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*>;
+    // FutexContext spreads futexes over many of these, so each one is small.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*,
+                                      mxtl::SinglyLinkedList<FutexNode*>, size_t, 7>;
+
+    // For the list of priority inheriting waiters in a FutexContext.
+    struct PiListTraits {
+        static mxtl::DoublyLinkedListNodeState<FutexNode*>& node_state(FutexNode& node) {
+            return node.pi_list_node_state_;
+        }
+    };
+    using PiList = mxtl::DoublyLinkedList<FutexNode*, PiListTraits>;
 
     FutexNode();
     ~FutexNode();
@@ -38,6 +52,11 @@ public:
                                      uintptr_t old_hash_key,
                                      uintptr_t new_hash_key);
 
+    static FutexNode* RemoveFromTail(FutexNode* list_head,
+                                     uint32_t count,
+                                     uintptr_t old_hash_key,
+                                     FutexNode** removed);
+
     status_t BlockThread(Mutex* mutex, mx_time_t timeout);
 
     void WakeKilledThread();
@@ -49,6 +68,26 @@ public:
         hash_key_ = key;
     }
 
+    // For a thread waiting on a priority inheriting futex, the thread it
+    // named as the owner and its own priority when it blocked.
+    void set_pi_owner(mxtl::RefPtr<UserThread> owner, int priority);
+    mxtl::RefPtr<UserThread> take_pi_owner();
+    UserThread* get_pi_owner() const { return pi_owner_.get(); }
+
+    int pi_priority() const { return pi_priority_; }
+    bool InPiList() const { return pi_list_node_state_.InContainer(); }
+
+    // Calls |func| on each node of the list starting at |head|.
+    template <typename Func>
+    static void ForEachInList(FutexNode* head, Func func) {
+        FutexNode* node = head;
+        do {
+            FutexNode* next = node->queue_next_;
+            func(node);
+            node = next;
+        } while (node != head);
+    }
+
     // Trait implementation for mxtl::HashTable
     uintptr_t GetKey() const { return hash_key_; }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
@@ -77,4 +116,9 @@ private:
     //  * When the thread is not waiting on a futex, queue_next_ is null.
     FutexNode* queue_prev_ = nullptr;
     FutexNode* queue_next_ = nullptr;
+
+    // Set while the thread waits on a priority inheriting futex.
+    mxtl::RefPtr<UserThread> pi_owner_;
+    int pi_priority_ = -1;
+    mxtl::DoublyLinkedListNodeState<FutexNode*> pi_list_node_state_;
 };
@@ -27,12 +27,14 @@ public:
 
     mxtl::RefPtr<Dispatcher> dispatcher() const { return dispatcher_; }
 
+    // The owning process reads this without its handle table lock to
+    // validate lookups, so it is published and read atomically.
     mx_koid_t process_id() const {
-        return process_id_;
+        return __atomic_load_n(&process_id_, __ATOMIC_ACQUIRE);
     }
 
     void set_process_id(mx_koid_t pid) {
-        process_id_ = pid;
+        __atomic_store_n(&process_id_, pid, __ATOMIC_RELEASE);
     }
 
     uint32_t rights() const {
@@ -8,7 +8,11 @@
 
 #include <kernel/event.h>
 
+#include <err.h>
+#include <kernel/spinlock.h>
 #include <magenta/dispatcher.h>
+#include <magenta/port_dispatcher.h>
+#include <mxtl/ref_ptr.h>
 #include <sys/types.h>
 
 // TODO:
@@ -24,15 +28,30 @@ class InterruptDispatcher : public Dispatcher {
 public:
     InterruptDispatcher& operator=(const InterruptDispatcher &) = delete;
 
+    ~InterruptDispatcher() override;
     mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_INTERRUPT; }
 
     // Notify the system that the caller has finished processing the interrupt.
-    // Required before the handle can be waited upon again.
+    // Required before the handle can be waited upon again, or before the
+    // interrupt can be queued to its port again.
     virtual status_t InterruptComplete() = 0;
 
-    status_t WaitForInterrupt() {
-        return event_wait(&event_);
-    }
+    // Waits for the interrupt, first binding the calling thread to the cpu
+    // and priority asked for with SetAffinity().  Returns ERR_BAD_STATE once
+    // the interrupt is bound to a port.
+    status_t WaitForInterrupt();
+
+    // From mx_port_bind() for MX_SIGNAL_SIGNALED: from now on each interrupt
+    // queues one packet to the port instead of waking WaitForInterrupt().
+    // An interrupt can only be bound once.
+    status_t set_port_client(mxtl::unique_ptr<PortClient> client) final;
+
+    // Steer the interrupt to |cpu|, or leave it where it is if |cpu| is
+    // MX_INTERRUPT_CPU_ANY, and have threads that wait for it run there.
+    // |options| can also ask for those threads to run at high or real-time
+    // priority.  The threads keep whatever they were given when they stop
+    // waiting.
+    status_t SetAffinity(uint32_t cpu, uint32_t options);
 
     virtual void on_zero_handles() final {
         // Ensure any waiters stop waiting
@@ -43,13 +62,27 @@ protected:
     InterruptDispatcher() {
         event_init(&event_, false, 0);
     }
-    int signal() {
-        return event_signal(&event_, false);
-    }
+    // Moves delivery of the interrupt to |cpu|, or back to the platform's
+    // default if |cpu| is -1.
+    virtual status_t SetTargetCpu(int cpu) { return ERR_NOT_SUPPORTED; }
+    // Called from the interrupt handler, with the interrupt masked.  Returns
+    // the number of threads woken.
+    int signal();
     void unsignal() {
         event_unsignal(&event_);
     }
 
 private:
+    void BindCurrentThread();
+
     event_t event_;
+
+    // Set once by set_port_client(), read by the interrupt handler.
+    SpinLock port_lock_;
+    mxtl::RefPtr<PortDispatcher> port_;
+    IOP_Interrupt port_packet_;
+
+    // From SetAffinity(), read without a lock by waiters.
+    int cpu_ = -1;
+    int options_ = 0;
 };
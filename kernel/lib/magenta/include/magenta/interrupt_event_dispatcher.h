@@ -27,6 +27,9 @@ public:
     // requred to exist in our collection of allocated vectors.
     uint32_t GetKey() const { return vector_; }
 
+protected:
+    status_t SetTargetCpu(int cpu) final;
+
 private:
     using VectorCollection = mxtl::WAVLTree<uint32_t, InterruptEventDispatcher*>;
     friend mxtl::DefaultWAVLTreeTraits<InterruptEventDispatcher*>;
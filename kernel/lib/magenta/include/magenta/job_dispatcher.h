@@ -9,6 +9,8 @@
 #include <stdint.h>
 
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/vm/vm_commit_account.h>
 
 #include <magenta/dispatcher.h>
 #include <magenta/process_dispatcher.h>
@@ -59,22 +61,56 @@ public:
     void AddChildProcess(ProcessDispatcher* process);
     void RemoveChildProcess(ProcessDispatcher* process);
     bool EnumerateChildren(JobEnumerator* je);
+    // Sums the runtime of every process in the job and its child jobs,
+    // including those that have gone away.
+    status_t GetRuntimeInfo(mx_info_task_runtime_t* info);
     void Kill();
 
+    // Limits on what the job and its child jobs use, and what they've used
+    // of them. The cpu quota and affinity apply to |thread| once it's set up
+    // with SetUpThread(), the memory limit to VMOs that charge the commit
+    // account.
+    status_t SetCpuQuota(const mx_job_cpu_quota_t& quota);
+    mx_job_cpu_quota_t GetCpuQuota();
+    status_t SetCpuAffinity(uint32_t mask);
+    uint32_t GetCpuAffinity();
+    status_t SetMemoryLimit(uint64_t bytes);
+    uint64_t GetMemoryLimit() const;
+    status_t GetResourceInfo(mx_info_job_resources_t* info);
+
+    mxtl::RefPtr<VmCommitAccount> commit_account() const { return commit_account_; }
+
+    // Subjects a new thread of one of our processes to our cpu limits.
+    void SetUpThread(thread_t* thread);
+
 private:
-    JobDispatcher(uint32_t flags, mxtl::RefPtr<JobDispatcher> parent);
+    JobDispatcher(uint32_t flags, mxtl::RefPtr<JobDispatcher> parent,
+                  mxtl::RefPtr<VmCommitAccount> commit_account);
     void AddChildJob(JobDispatcher* job);
     void RemoveChildJob(JobDispatcher* job);
 
+    // our mask combined with those of every job above us
+    uint32_t GetEffectiveCpuAffinity();
+
     StateTracker state_tracker_;
     const mxtl::RefPtr<JobDispatcher> parent_;
 
+    // what the VMOs created in the job and its child jobs have committed
+    const mxtl::RefPtr<VmCommitAccount> commit_account_;
+
+    // Shared by the threads of the job's processes, nested in the parent's.
+    // Protected by the thread lock.
+    thread_quota_t cpu_quota_;
+
     mxtl::DoublyLinkedListNodeState<JobDispatcher*> dll_job_;
 
     // The |lock_| protects all members below.
     Mutex lock_;
     uint32_t process_count_;
     uint32_t job_count_;
+    // runtime of the processes and jobs that have been destroyed
+    mx_info_task_runtime_t exited_runtime_ = {};
+    uint32_t cpu_affinity_ = UINT32_MAX;
 
     mxtl::DoublyLinkedList<JobDispatcher*, ListTraits> jobs_;
     mxtl::DoublyLinkedList<ProcessDispatcher*, ProcessDispatcher::JobListTraits> procs_;
@@ -43,6 +43,9 @@ mxtl::RefPtr<ExceptionPort> GetSystemExceptionPort();
 
 mxtl::RefPtr<JobDispatcher> GetRootJobDispatcher();
 
+// The event signaled while the system is low on memory.
+mxtl::RefPtr<Dispatcher> GetMemoryPressureEvent();
+
 bool magenta_rights_check(mx_rights_t actual, mx_rights_t desired);
 
 struct handle_delete {
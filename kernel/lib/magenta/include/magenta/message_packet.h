@@ -14,23 +14,32 @@
 
 class Handle;
 
-class MessagePacket : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
+// A message packet is a single allocation holding the packet header, then
+// the handle array, then the data. Small packets come from size-classed
+// object caches and larger ones from the heap.
+class MessagePacket final : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<MessagePacket>> {
 public:
     // Creates a message packet.
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    static void operator delete(void* ptr);
+
     ~MessagePacket();
 
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
+    // The kernel memory behind the packet, including any slack in its
+    // cache block.
+    size_t allocated_size() const;
+
     void set_owns_handles(bool own_handles) { owns_handles_ = own_handles; }
 
-    const void* data() const { return data_.get(); }
-    void* mutable_data() { return data_.get(); }
-    Handle* const* handles() const { return handles_.get(); }
-    Handle** mutable_handles() { return handles_.get(); }
+    const void* data() const { return handles() + num_handles_; }
+    void* mutable_data() { return mutable_handles() + num_handles_; }
+    Handle* const* handles() const { return reinterpret_cast<Handle* const*>(this + 1); }
+    Handle** mutable_handles() { return reinterpret_cast<Handle**>(this + 1); }
 
 private:
     MessagePacket(uint32_t data_size, uint32_t num_handles);
@@ -38,8 +47,4 @@ private:
     bool owns_handles_;
     uint32_t data_size_;
     uint32_t num_handles_;
-
-    // TODO(vtl): Allocate these inline instead.
-    mxtl::unique_ptr<uint8_t[]> data_;
-    mxtl::unique_ptr<Handle*[]> handles_;
 };
@@ -0,0 +1,61 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/mutex.h>
+
+#include <magenta/dispatcher.h>
+#include <magenta/types.h>
+
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+
+class PortDispatcher;
+class VmObject;
+
+// A pager lets a userspace process fill in the pages of VMOs on demand.
+// Each of its VMOs starts out with no pages; touching one that isn't there
+// sends an mx_pager_packet_t to the port the VMO was created with and
+// blocks until the pager supplies the page with SupplyPages(). Once the
+// pager's last handle goes, faults on pages that were never supplied fail.
+class PagerDispatcher final : public Dispatcher {
+public:
+    static status_t Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
+                           mx_rights_t* rights);
+
+    ~PagerDispatcher() final;
+
+    // Dispatcher implementation.
+    mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_PAGER; }
+    void on_zero_handles() final;
+
+    // Pager methods.
+
+    // Makes a VMO of |size| bytes whose page requests are queued on |port|
+    // with |key|.
+    status_t CreateVmo(mxtl::RefPtr<PortDispatcher> port, uint64_t key, uint64_t size,
+                       mxtl::RefPtr<VmObject>* vmo);
+
+    // Moves the pages of the first |len| bytes of |aux_vmo| into one of our
+    // VMOs at |offset|, waking anything waiting on them.
+    status_t SupplyPages(mxtl::RefPtr<VmObject> vmo, uint64_t offset, uint64_t len,
+                         mxtl::RefPtr<VmObject> aux_vmo);
+
+private:
+    class Source;
+
+    PagerDispatcher();
+    void RemoveSource(Source* source);
+
+    Mutex lock_;
+    bool closed_ = false;
+    // the sources of our live VMOs; each removes itself as it goes away
+    mxtl::DoublyLinkedList<Source*> sources_;
+};
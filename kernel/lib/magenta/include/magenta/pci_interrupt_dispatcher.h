@@ -25,6 +25,9 @@ public:
     ~PciInterruptDispatcher() final;
     status_t InterruptComplete() final;
 
+protected:
+    status_t SetTargetCpu(int cpu) final;
+
 private:
     static pcie_irq_handler_retval_t IrqThunk(const PcieDevice& dev,
                                               uint irq_id,
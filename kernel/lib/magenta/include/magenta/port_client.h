@@ -21,6 +21,8 @@ public:
     ~PortClient();
 
     mx_signals_t get_trigger_signals() const { return signals_; }
+    uint64_t get_key() const { return key_; }
+    const mxtl::RefPtr<PortDispatcher>& get_port() const { return port_; }
     bool Signal(mx_signals_t signals, const Mutex* mutex);
     bool Signal(mx_signals_t signals, size_t byte_count, const Mutex* mutex);
 
@@ -9,12 +9,14 @@
 #include <new.h>
 #include <kernel/mutex.h>
 #include <kernel/event.h>
+#include <kernel/spinlock.h>
 
 #include <magenta/dispatcher.h>
 #include <magenta/syscalls/port.h>
 #include <magenta/types.h>
 
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/object_cache.h>
 
 #include <sys/types.h>
 
@@ -27,15 +29,32 @@ struct IOP_Packet : public mxtl::DoublyLinkedListable<IOP_Packet*> {
     static IOP_Packet* MakeFromUser(const void* data, size_t size);
     static void Delete(IOP_Packet* packet);
 
+    // Where the packet's memory came from, which decides how Delete() frees it.
+    enum class Kind : uint8_t {
+        kHeap,      // a heap block sized for the payload
+        kCached,    // a fixed size block from the packet cache
+        kSignal,    // an IOP_Signal, owned by the port
+        kObserver,  // an IOP_Observer, owned by its PortObserver
+        kInterrupt, // an IOP_Interrupt, owned by its InterruptDispatcher
+    };
+
     IOP_Packet(size_t data_size)
-        : is_signal(false), data_size(data_size) {}
+        : kind(Kind::kHeap), data_size(data_size) {}
 
-    IOP_Packet(size_t data_size, bool is_signal)
-        : is_signal(is_signal), data_size(data_size) {}
+    IOP_Packet(size_t data_size, Kind kind)
+        : kind(kind), data_size(data_size) {}
 
     bool CopyToUser(void* data, size_t* size);
 
-    bool is_signal;
+    // The kernel memory the packet was allocated with, or 0 for the kinds
+    // embedded in another object.
+    size_t allocated_size() const;
+
+    bool is_signal() const { return kind == Kind::kSignal; }
+    bool is_observer() const { return kind == Kind::kObserver; }
+    bool is_interrupt() const { return kind == Kind::kInterrupt; }
+
+    Kind kind;
     size_t data_size;
 };
 
@@ -46,6 +65,44 @@ struct IOP_Signal : public IOP_Packet {
     IOP_Signal(uint64_t key, mx_signals_t signal);
 };
 
+class PortObserver;
+
+// The packet of an mx_object_wait_async() observer. It is embedded in its
+// PortObserver, so queueing it never allocates. The payload is guarded by the
+// port's lock and is copied out by Wait() rather than handed to the caller.
+// |removed| is set, also under the port's lock, once the observer has left
+// its StateTracker; whoever then holds the last use of it deletes it.
+struct IOP_Observer : public IOP_Packet {
+    mx_io_packet_t payload;
+    PortObserver* const observer;
+    bool removed;
+
+    IOP_Observer(PortObserver* observer, uint64_t key);
+};
+
+// The packet of an interrupt bound to a port with mx_port_bind(). It is
+// embedded in its InterruptDispatcher and queued from the interrupt handler,
+// at most once at a time, so the payload is written only while it is not
+// queued. Wait() copies the payload out like an observer's. Whether it is
+// queued, and on which list, only changes under the port's |irq_lock_|.
+struct IOP_Interrupt : public IOP_Packet {
+    mx_io_packet_t payload;
+    bool pending;   // on |irq_packets_| rather than |packets_|
+
+    IOP_Interrupt();
+};
+
+// One packet dequeued by PortDispatcher::Wait(): either |packet|, which the
+// caller must Delete(), or, for packets posted by a PortObserver, nullptr and
+// a copy of the payload in |observed|.
+struct IOP_Result {
+    IOP_Packet* packet;
+    mx_io_packet_t observed;
+
+    // An observer done with its packet, freed by Wait() once unlocked.
+    PortObserver* done;
+};
+
 // Port job is to deliver packets to threads waiting in Wait(). There
 // are two types of packets:
 //
@@ -68,8 +125,23 @@ struct IOP_Signal : public IOP_Packet {
 //                           |          |           |
 //                           +------>at_zero_ <-----+
 //
+// 3- Posted by PortObservers armed by mx_object_wait_async(). These are
+//    IOP_Observer packets embedded in the observer, queued at most once
+//    at a time; a repeating observer that fires again while its packet
+//    is queued just adds its signals to it. Wait() copies the payload out
+//    and the packet goes back to the observer.
+//
+// 4- Posted by interrupt handlers for InterruptDispatchers bound to the
+//    port. A Mutex can't be taken there, so these IOP_Interrupt packets go
+//    on |irq_packets_| under a spinlock and Wait() moves them to the tail
+//    of |packets_|. Like observer packets, they are queued at most once at
+//    a time, and the interrupt stays masked until mx_interrupt_complete().
+//
+// Packets of the first kind that fit in MX_PORT_MAX_PKT_SIZE come from an
+// ObjectCache rather than the general heap.
 
-class PortDispatcher final : public Dispatcher {
+class PortDispatcher final : public Dispatcher,
+                             public mxtl::ObjectCacheAllocated<PortDispatcher> {
 public:
     static status_t Create(uint32_t options,
                            mxtl::RefPtr<Dispatcher>* dispatcher,
@@ -82,15 +154,43 @@ public:
     mx_status_t Queue(IOP_Packet* packet);
     void* Signal(void* cookie, uint64_t key, mx_signals_t signal);
 
-    mx_status_t Wait(mx_time_t timeout, IOP_Packet** packet);
+    // Dequeues, in order, up to |count| packets whose data fits in
+    // |max_size|, waiting up to |timeout| for the first one. Stops early at
+    // a packet that does not fit, which stays queued; if that is the first
+    // one, returns ERR_BUFFER_TOO_SMALL.
+    mx_status_t Wait(mx_time_t timeout, size_t max_size,
+                     IOP_Result* results, size_t count, size_t* actual);
+
+    // Adds the number of packets waiting to be read and the kernel memory
+    // they were allocated with to |*count| and |*bytes|.
+    void GetQueued(uint64_t* count, uint64_t* bytes);
+
+    // Called by PortObserver, under the lock of the StateTracker it is
+    // in. QueueObserver() returns ERR_UNAVAILABLE if nobody can ever read
+    // the port and otherwise sets |*awoke_threads|. ObserverRemoved()
+    // returns true if the observer should delete itself now; otherwise
+    // its packet is still queued and Wait() or the port deletes it.
+    mx_status_t QueueObserver(IOP_Observer* packet, mx_signals_t signals, bool* awoke_threads);
+    bool ObserverRemoved(IOP_Observer* packet);
+
+    // Called by InterruptDispatcher. QueueInterrupt() runs in the interrupt
+    // handler and returns true if it woke a thread. RemoveInterrupt() is
+    // called once the handler can no longer run, and unqueues the packet.
+    bool QueueInterrupt(IOP_Interrupt* packet);
+    void RemoveInterrupt(IOP_Interrupt* packet);
 
 private:
     PortDispatcher(uint32_t options);
     void FreePackets_NoLock();
+    void TakeInterrupts_Locked();
 
     Mutex lock_;
     bool no_clients_;
     mxtl::DoublyLinkedList<IOP_Packet*> packets_;
     mxtl::DoublyLinkedList<IOP_Packet*> at_zero_;
     event_t event_;
+
+    // Taken inside |lock_|. |no_clients_| is only set with both held.
+    SpinLock irq_lock_;
+    mxtl::DoublyLinkedList<IOP_Packet*> irq_packets_;
 };
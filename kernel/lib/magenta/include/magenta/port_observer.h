@@ -0,0 +1,61 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <magenta/port_dispatcher.h>
+#include <magenta/state_observer.h>
+#include <magenta/types.h>
+
+#include <mxtl/object_cache.h>
+#include <mxtl/ref_ptr.h>
+
+class Handle;
+
+// PortObserver is the StateObserver armed by mx_object_wait_async(). It
+// watches |signals| on the object behind |handle| and delivers an
+// MX_PORT_PKT_TYPE_IOSN packet with |key| to |port| when they assert.
+//
+// A one-shot observer fires once, as soon as any of the signals is
+// asserted, and then removes itself. A repeating observer fires each time
+// one of the signals goes from deasserted to asserted and stays until the
+// handle is closed or transferred.
+//
+// The observer owns its packet, so nothing is allocated per event. It
+// deletes itself once it is out of the StateTracker and its packet is not
+// queued on the port.
+class PortObserver final : public StateObserver,
+                           public mxtl::ObjectCacheAllocated<PortObserver> {
+public:
+    PortObserver(bool repeating, Handle* handle, mxtl::RefPtr<PortDispatcher> port,
+                 uint64_t key, mx_signals_t signals);
+    ~PortObserver();
+
+private:
+    PortObserver() = delete;
+    PortObserver(const PortObserver&) = delete;
+    PortObserver& operator=(const PortObserver&) = delete;
+
+    // StateObserver implementation:
+    bool OnInitialize(mx_signals_t initial_state, bool* should_remove) final;
+    bool OnStateChange(mx_signals_t new_state, bool* should_remove) final;
+    bool OnCancel(Handle* handle, bool* should_remove) final;
+    void OnRemoved() final;
+
+    bool Fire(mx_signals_t signals, bool* should_remove);
+
+    const bool repeating_;
+    Handle* const handle_;
+    const mx_signals_t watched_signals_;
+    mxtl::RefPtr<PortDispatcher> port_;
+
+    // Guarded by the StateTracker's lock.
+    mx_signals_t last_state_ = 0u;
+
+    IOP_Observer packet_;
+};
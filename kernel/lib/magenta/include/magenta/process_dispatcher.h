@@ -27,6 +27,15 @@
 
 class JobDispatcher;
 
+// Accumulates |add| into |sum|, for processes and jobs totalling their tasks.
+inline void AddTaskRuntime(mx_info_task_runtime_t* sum, const mx_info_task_runtime_t& add) {
+    sum->cpu_time += add.cpu_time;
+    sum->queue_time += add.queue_time;
+    sum->voluntary_switches += add.voluntary_switches;
+    sum->involuntary_switches += add.involuntary_switches;
+    sum->migrations += add.migrations;
+}
+
 class ProcessDispatcher : public Dispatcher {
 public:
     static mx_status_t Create(mxtl::RefPtr<JobDispatcher> job,
@@ -94,10 +103,19 @@ public:
     HandleUniquePtr RemoveHandle(mx_handle_t handle_value);
     HandleUniquePtr RemoveHandle_NoLock(mx_handle_t handle_value);
 
+    // Removes the Handles corresponding to the |count| values in
+    // |handle_values|, all or none, and stores them in |handles| if it is
+    // not null. Like RemoveHandle_NoLock() but waits out lookups only once.
+    // Returns the index of the first value with no handle in this process,
+    // which may be a repeated one, or |count| on success.
+    size_t RemoveHandles_NoLock(const mx_handle_t* handle_values, size_t count,
+                                Handle** handles);
+
     // Puts back the |handle_value| which has not yet been given to another process
     // back into this process.
     void UndoRemoveHandle_NoLock(mx_handle_t handle_value);
 
+    // Looks up |handle_value| without taking the handle table lock.
     bool GetDispatcher(mx_handle_t handle_value, mxtl::RefPtr<Dispatcher>* dispatcher,
                        uint32_t* rights);
 
@@ -147,6 +165,12 @@ public:
     void Kill();
 
     status_t GetInfo(mx_info_process_t* info);
+    status_t GetMemoryInfo(mx_info_process_memory_t* info);
+    // Walks the handle table, so a channel or port the process holds
+    // several handles to is counted once for each of them.
+    status_t GetKernelMemoryInfo(mx_info_process_kernel_memory_t* info);
+    // Sums the runtime of the live threads and of those that have exited.
+    status_t GetRuntimeInfo(mx_info_task_runtime_t* info);
 
     status_t CreateUserThread(mxtl::StringPiece name, uint32_t flags, mxtl::RefPtr<UserThread>* user_thread);
 
@@ -224,6 +248,9 @@ private:
     // list of threads in this process
     mxtl::DoublyLinkedList<UserThread*> thread_list_;
 
+    // runtime of the threads that have left thread_list_
+    mx_info_task_runtime_t exited_runtime_ = {};
+
     // our address space
     mxtl::RefPtr<VmAspace> aspace_;
 
@@ -231,7 +258,9 @@ private:
     const mxtl::RefPtr<JobDispatcher> job_;
 
     // our list of handles
-    mutable Mutex handle_table_lock_; // protects |handles_|.
+    // Protects |handles_| and the process id of the Handles in it. Lookups
+    // through GetDispatcher() don't take it; see process_dispatcher.cpp.
+    mutable Mutex handle_table_lock_;
     mxtl::DoublyLinkedList<Handle*> handles_;
 
     StateTracker state_tracker_;
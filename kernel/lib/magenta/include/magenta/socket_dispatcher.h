@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <pow2.h>
 #include <stdint.h>
 
 #include <kernel/mutex.h>
@@ -14,7 +15,9 @@
 #include <magenta/state_tracker.h>
 #include <magenta/types.h>
 
+#include <mxtl/intrusive_double_list.h>
 #include <mxtl/ref_counted.h>
+#include <mxtl/unique_ptr.h>
 
 class VmObject;
 class PortClient;
@@ -37,23 +40,59 @@ public:
     mx_status_t Write(const void* src, size_t len, bool from_user,
                       size_t* written);
 
+    // Moves the pages backing [offset, offset + len) of |vmo| into the
+    // socket rather than copying their contents. Both must be page aligned.
+    // The range of |vmo| reads back as zeros afterwards.
+    mx_status_t WritePages(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                           size_t* written);
+
+    // Copies up to |len| bytes of |vmo| starting at |offset| into the
+    // socket, stopping early at the end of |vmo|.
+    mx_status_t WriteFromVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                             size_t* written);
+
     status_t HalfClose();
 
     mx_status_t Read(void* dest, size_t len, bool from_user,
                      size_t* nread);
 
+    // Reads up to |len| bytes into |vmo| starting at |offset|, stopping
+    // early at the end of |vmo|.
+    mx_status_t ReadToVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                          size_t* nread);
+
+    // Reads up to |len| bytes and writes them to |dest| in one go, never
+    // taking more than |dest| has room for.
+    mx_status_t Splice(mxtl::RefPtr<SocketDispatcher> dest, size_t len, size_t* moved);
+
+    // Capacity of the buffer that data written by the peer lands in.
+    uint32_t GetBufferSize();
+    // Replaces that buffer with one of |size| bytes, rounded up to a power
+    // of two. Only allowed while there is no unread data.
+    status_t SetBufferSize(uint32_t size);
+
     void OnPeerZeroHandles();
 
 private:
     class CBuf {
     public:
         ~CBuf();
+        // May be called again while empty to resize the buffer.
         bool Init(uint32_t len);
         size_t Write(const void* src, size_t len, bool from_user);
+        // A null |dest| discards |len| bytes.
         size_t Read(void* dest, size_t len, bool from_user);
+        // Write() and Read() in place: |fill| and |drain| are called on each
+        // contiguous span of up to |len| bytes in the buffer and return how
+        // much of it they used, stopping the copy when that falls short.
+        template <typename F> size_t Fill(size_t len, F fill);
+        template <typename F> size_t Drain(size_t len, F drain);
+        // Copies out the next |len| bytes without consuming them.
+        size_t Peek(void* dest, size_t len);
         size_t CouldRead() const;
         size_t free() const;
         bool empty() const;
+        uint32_t size() const { return valpow2(len_pow2_); }
 
     private:
         size_t head_ = 0u;
@@ -63,18 +102,61 @@ private:
         mxtl::RefPtr<VmObject> vmo_;
     };
 
+    // Pages handed over by WritePages(), queued in between the bytes in
+    // the cbuf that were written before and after them.
+    struct PageSegment final : public mxtl::DoublyLinkedListable<mxtl::unique_ptr<PageSegment>> {
+        PageSegment() { list_initialize(&pages); }
+        ~PageSegment();
+
+        // how many bytes had been written to the cbuf when it was queued
+        uint64_t stream_pos = 0u;
+        size_t len = 0u;
+        // bytes already read; fully read pages are freed as we go
+        size_t consumed = 0u;
+        list_node pages;
+    };
+
     SocketDispatcher(uint32_t flags);
     mx_status_t Init(mxtl::RefPtr<SocketDispatcher> other);
     mx_status_t WriteSelf(const void* src, size_t len, bool from_user,
                           size_t* nwritten);
+    mx_status_t WriteDatagramLocked(const void* src, size_t len, bool from_user,
+                                    size_t* nwritten);
+    size_t ReadDatagramLocked(void* dest, size_t len, bool from_user);
+    mx_status_t WritePagesSelf(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                               size_t* written);
+    mx_status_t WriteFromVmoSelf(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                                 size_t* written);
+    size_t ReadStreamLocked(void* dest, size_t len, bool from_user);
+    size_t ReadSegmentLocked(PageSegment* segment, void* dest, size_t len, bool from_user);
+    // Like CBuf::Drain(), on the pages of |segment|.
+    template <typename F> size_t DrainSegmentLocked(PageSegment* segment, size_t len, F drain);
+    // Consumes up to |len| bytes of the stream in order, taking them from the
+    // cbuf with |read_cbuf| and from segments with |read_segment|, each of
+    // which returns how many bytes it took.
+    template <typename C, typename S>
+    size_t ReadStreamWithLocked(size_t len, C read_cbuf, S read_segment);
+    // Signals the effects of a stream read; |was_full| is FullLocked() from
+    // before it.
+    void DidReadStreamLocked(bool was_full, size_t nread);
+    void DidWriteStreamLocked(bool was_empty, size_t nwritten);
+    bool EmptyLocked() const;
+    bool FullLocked() const;
     status_t  UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     status_t HalfCloseOther();
 
+    const uint32_t flags_;
     StateTracker state_tracker_;
 
     // The |lock_| protects all members below.
     Mutex lock_;
     CBuf cbuf_;
+    // stream positions of the cbuf, to order it against segments_
+    uint64_t cbuf_written_ = 0u;
+    uint64_t cbuf_read_ = 0u;
+    mxtl::DoublyLinkedList<mxtl::unique_ptr<PageSegment>> segments_;
+    // unread bytes in segments_, bounded by the size of the cbuf
+    size_t segment_bytes_ = 0u;
     mxtl::RefPtr<SocketDispatcher> other_;
     mxtl::unique_ptr<PortClient> iopc_;
     // half_closed_[0] is this end and [1] is the other end.
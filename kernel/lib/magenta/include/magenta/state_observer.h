@@ -18,14 +18,15 @@ public:
     explicit StateObserver() { }
 
     // Called when this object is added to a StateTracker, to give it the initial state. Returns
-    // true if a thread was awoken.
+    // true if a thread was awoken. Like OnCancel(), the callee may set |*should_remove| to be
+    // removed right away.
     // WARNING: This is called under StateTracker's mutex.
-    virtual bool OnInitialize(mx_signals_t initial_state) = 0;
+    virtual bool OnInitialize(mx_signals_t initial_state, bool* should_remove) = 0;
 
     // Called whenever the state changes, to give it the new state. Returns true if a thread was
-    // awoken.
+    // awoken. Like OnCancel(), the callee may set |*should_remove| to be removed.
     // WARNING: This is called under StateTracker's mutex
-    virtual bool OnStateChange(mx_signals_t new_state) = 0;
+    virtual bool OnStateChange(mx_signals_t new_state, bool* should_remove) = 0;
 
     // Called when |handle| (which refers to a handle to the object that owns the StateTracker) is
     // being destroyed/"closed"/transferred. (The object itself, and thus the StateTracker too, may
@@ -36,6 +37,12 @@ public:
     // WARNING: This is called under StateTracker's mutex.
     virtual bool OnCancel(Handle* handle, bool* should_remove) = 0;
 
+    // Called once the StateTracker has removed the observer because it set |*should_remove| in
+    // one of the calls above. The StateTracker no longer refers to it, so the callee may free
+    // itself.
+    // WARNING: This is called under StateTracker's mutex.
+    virtual void OnRemoved() { }
+
 protected:
     ~StateObserver() {}
 
@@ -18,7 +18,7 @@ class Handle;
 
 class StateTracker {
 public:
-    StateTracker(mx_signals_t signals = 0u) : signals_(signals) { }
+    StateTracker(mx_signals_t signals = 0u) : state_(signals) { }
 
     StateTracker(const StateTracker& o) = delete;
     StateTracker& operator=(const StateTracker& o) = delete;
@@ -26,7 +26,7 @@ public:
     // Set the initial signals state. This is an alternative to provide the initial signals state to
     // the constructor. This does no locking and does not notify anything.
     void set_initial_signals_state(mx_signals_t signals) {
-        signals_ = signals;
+        __atomic_store_n(&state_, static_cast<uint64_t>(signals), __ATOMIC_RELAXED);
     }
 
     // Add an observer.
@@ -42,12 +42,31 @@ public:
 
     // Notify others of a change in state (possibly waking them). (Clearing satisfied signals or
     // setting satisfiable signals should not wake anyone.)
+    //
+    // When there are no observers this does not take the lock.
     void UpdateState(mx_signals_t clear_mask, mx_signals_t set_mask);
 
-    mx_signals_t GetSignalsState() { return signals_; }
+    mx_signals_t GetSignalsState() {
+        return static_cast<mx_signals_t>(__atomic_load_n(&state_, __ATOMIC_ACQUIRE));
+    }
 
 private:
-    mx_signals_t signals_;
+    // Set in |state_| while |observers_| is non-empty.
+    static constexpr uint64_t kHasObservers = 1ull << 32;
+
+    // Applies the masks to |state_| and returns true if the signals changed.
+    // If |observers_ok| is false, gives up and returns false without changing
+    // anything when there are observers; |*done| tells the two apart.
+    bool ApplyMasks(mx_signals_t clear_mask, mx_signals_t set_mask, bool observers_ok,
+                    mx_signals_t* new_signals, bool* done);
+
+    // Keeps kHasObservers in sync with |observers_|.
+    void UpdateHasObserversLocked();
+
+    // The signals in the low 32 bits plus kHasObservers. Only changed with
+    // atomic operations; kHasObservers is only changed with |lock_| held, and
+    // while it is set the signals are too.
+    uint64_t state_;
     Mutex lock_;
 
     // Active observers are elements in |observers_|.
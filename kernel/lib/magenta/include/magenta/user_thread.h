@@ -17,6 +17,7 @@
 #include <magenta/excp_port.h>
 #include <magenta/futex_node.h>
 #include <magenta/state_tracker.h>
+#include <magenta/syscalls/object.h>
 
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/ref_counted.h>
@@ -69,6 +70,36 @@ public:
 
     State state() const { return state_; }
 
+    // Fair share scheduling weight, see thread_set_fair_weight().
+    status_t set_fair_weight(uint32_t weight) { return thread_set_fair_weight(&thread_, weight); }
+    uint32_t fair_weight() const { return thread_.fair_weight; }
+
+    // Deadline scheduling parameters, see thread_set_deadline().
+    status_t set_deadline(const thread_deadline_params_t& params) {
+        return thread_set_deadline(&thread_, &params);
+    }
+    thread_deadline_params_t deadline() const { return thread_.deadline; }
+
+    // How late sleep and wait timeouts may fire, see thread_set_timer_slack().
+    status_t set_timer_slack(lk_time_t slack) { return thread_set_timer_slack(&thread_, slack); }
+    lk_time_t timer_slack() const { return thread_.timer_slack; }
+
+    // The only cpu this thread may run on, or -1, see thread_pin_cpu().
+    status_t set_pinned_cpu(int cpu) { return thread_pin_cpu(&thread_, cpu); }
+    int pinned_cpu() const { return thread_pinned_cpu(&thread_); }
+
+    // Priority lent to this thread by waiters on PI futexes it owns, or -1.
+    void set_inherited_priority(int priority) {
+        thread_set_user_inherited_priority(&thread_, priority);
+    }
+    int inherited_priority() const { return thread_.user_inherited_priority; }
+
+    // the kernel stack the thread runs on in the kernel, once it has one
+    size_t kernel_stack_size() const { return thread_.stack ? thread_.stack_size : 0u; }
+
+    // cpu and run queue time and context switches so far.
+    void GetRuntimeInfo(mx_info_task_runtime_t* info);
+
     status_t SetExceptionPort(ThreadDispatcher* td, mxtl::RefPtr<ExceptionPort> eport);
     void ResetExceptionPort();
     mxtl::RefPtr<ExceptionPort> exception_port();
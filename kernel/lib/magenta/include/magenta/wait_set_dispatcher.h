@@ -87,8 +87,8 @@ public:
         Entry(const Entry&) = delete;
         Entry& operator=(const Entry&) = delete;
 
-        bool OnInitialize(mx_signals_t initial_state) final;
-        bool OnStateChange(mx_signals_t new_state) final;
+        bool OnInitialize(mx_signals_t initial_state, bool* should_remove) final;
+        bool OnStateChange(mx_signals_t new_state, bool* should_remove) final;
         bool OnCancel(Handle* handle, bool* should_remove) final;
 
         // Triggers (including adding to the triggered list). It must not already be triggered
@@ -145,8 +145,8 @@ private:
     WaitSetDispatcher& operator=(const WaitSetDispatcher&) = delete;
 
     // StateObserver implementation:
-    bool OnInitialize(mx_signals_t initial_state) final;
-    bool OnStateChange(mx_signals_t new_state) final;
+    bool OnInitialize(mx_signals_t initial_state, bool* should_remove) final;
+    bool OnStateChange(mx_signals_t new_state, bool* should_remove) final;
     bool OnCancel(Handle* handle, bool* should_remove) final;
 
     // We are *not* waitable, but we need to observe handle "cancellation".
@@ -35,8 +35,8 @@ private:
     WaitStateObserver& operator=(const WaitStateObserver&) = delete;
 
     // StateObserver implementation:
-    bool OnInitialize(mx_signals_t initial_state) final;
-    bool OnStateChange(mx_signals_t new_state) final;
+    bool OnInitialize(mx_signals_t initial_state, bool* should_remove) final;
+    bool OnStateChange(mx_signals_t new_state, bool* should_remove) final;
     bool OnCancel(Handle* handle, bool* should_remove) final;
 
     bool MaybeSignal(mx_signals_t signals);
@@ -0,0 +1,95 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/interrupt_dispatcher.h>
+
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+
+#include <magenta/port_client.h>
+#include <magenta/types.h>
+
+constexpr uint32_t kAffinityOptions = MX_INTERRUPT_PRIORITY_HIGH | MX_INTERRUPT_REAL_TIME;
+
+InterruptDispatcher::~InterruptDispatcher() {
+    // The subclass has unregistered the handler by now, so the packet can
+    // not be queued again.
+    if (port_)
+        port_->RemoveInterrupt(&port_packet_);
+}
+
+status_t InterruptDispatcher::WaitForInterrupt() {
+    {
+        AutoSpinLockIrqSave lock(port_lock_);
+        if (port_)
+            return ERR_BAD_STATE;
+    }
+    BindCurrentThread();
+    return event_wait(&event_);
+}
+
+status_t InterruptDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client) {
+    if (!(client->get_trigger_signals() & MX_SIGNAL_SIGNALED))
+        return ERR_INVALID_ARGS;
+
+    AutoSpinLockIrqSave lock(port_lock_);
+    if (port_)
+        return ERR_BAD_STATE;
+    port_packet_.payload.hdr.key = client->get_key();
+    port_ = client->get_port();
+    return NO_ERROR;
+}
+
+int InterruptDispatcher::signal() {
+    {
+        AutoSpinLock lock(port_lock_);
+        if (port_)
+            return port_->QueueInterrupt(&port_packet_) ? 1 : 0;
+    }
+    return event_signal(&event_, false);
+}
+
+status_t InterruptDispatcher::SetAffinity(uint32_t cpu, uint32_t options) {
+    if (options & ~kAffinityOptions)
+        return ERR_INVALID_ARGS;
+
+    int target = -1;
+    if (cpu != MX_INTERRUPT_CPU_ANY) {
+        if ((cpu >= arch_max_num_cpus()) || !mp_is_cpu_active(cpu))
+            return ERR_INVALID_ARGS;
+        target = static_cast<int>(cpu);
+    }
+
+    // Delivering the interrupt on the waiter's cpu saves the wakeup an IPI,
+    // but the waiter is still bound if the interrupt controller can't do it.
+    status_t status = SetTargetCpu(target);
+    if ((status != NO_ERROR) && (status != ERR_NOT_SUPPORTED))
+        return status;
+
+    __atomic_store_n(&cpu_, target, __ATOMIC_RELAXED);
+    __atomic_store_n(&options_, static_cast<int>(options), __ATOMIC_RELAXED);
+
+    // Drivers usually ask from the thread that is about to wait.
+    BindCurrentThread();
+    return NO_ERROR;
+}
+
+void InterruptDispatcher::BindCurrentThread() {
+    int cpu = __atomic_load_n(&cpu_, __ATOMIC_RELAXED);
+    int options = __atomic_load_n(&options_, __ATOMIC_RELAXED);
+    if ((cpu < 0) && (options == 0))
+        return;
+
+    thread_t* t = get_current_thread();
+    if ((cpu >= 0) && (thread_pinned_cpu(t) != cpu))
+        thread_pin_cpu(t, cpu);
+    if ((options & MX_INTERRUPT_PRIORITY_HIGH) && (t->base_priority < HIGH_PRIORITY))
+        thread_set_priority(HIGH_PRIORITY);
+    if ((options & MX_INTERRUPT_REAL_TIME) && !(t->flags & THREAD_FLAG_REAL_TIME))
+        thread_set_real_time(t);
+}
@@ -82,6 +82,10 @@ status_t InterruptEventDispatcher::InterruptComplete() {
     return NO_ERROR;
 }
 
+status_t InterruptEventDispatcher::SetTargetCpu(int cpu) {
+    return set_interrupt_target_cpu(vector_, cpu);
+}
+
 enum handler_return InterruptEventDispatcher::IrqHandler(void* ctx) {
     InterruptEventDispatcher* thiz = reinterpret_cast<InterruptEventDispatcher*>(ctx);
 
@@ -10,16 +10,21 @@
 #include <new.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/mp.h>
 
 #include <magenta/process_dispatcher.h>
 
 constexpr mx_rights_t kDefaultJobRights =
     MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE |
-    MX_RIGHT_ENUMERATE;
+    MX_RIGHT_ENUMERATE | MX_RIGHT_GET_PROPERTY | MX_RIGHT_SET_PROPERTY;
 
 mxtl::RefPtr<JobDispatcher> JobDispatcher::CreateRootJob() {
+    auto account = VmCommitAccount::Create(nullptr);
+    if (!account)
+        return nullptr;
+
     AllocChecker ac;
-    auto job = mxtl::AdoptRef(new (&ac) JobDispatcher(0u, nullptr));
+    auto job = mxtl::AdoptRef(new (&ac) JobDispatcher(0u, nullptr, mxtl::move(account)));
     return ac.check() ? job  : nullptr;
 }
 
@@ -27,8 +32,12 @@ status_t JobDispatcher::Create(uint32_t flags,
                                mxtl::RefPtr<JobDispatcher> parent,
                                mxtl::RefPtr<Dispatcher>* dispatcher,
                                mx_rights_t* rights) {
+    auto account = VmCommitAccount::Create(parent->commit_account_);
+    if (!account)
+        return ERR_NO_MEMORY;
+
     AllocChecker ac;
-    auto job = new (&ac) JobDispatcher(flags, parent);
+    auto job = new (&ac) JobDispatcher(flags, parent, mxtl::move(account));
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -40,13 +49,20 @@ status_t JobDispatcher::Create(uint32_t flags,
 }
 
 JobDispatcher::JobDispatcher(uint32_t /*flags*/,
-                             mxtl::RefPtr<JobDispatcher> parent)
+                             mxtl::RefPtr<JobDispatcher> parent,
+                             mxtl::RefPtr<VmCommitAccount> commit_account)
     : parent_(mxtl::move(parent)),
+      commit_account_(mxtl::move(commit_account)),
       process_count_(0u), job_count_(0u) {
     state_tracker_.set_initial_signals_state(0u);
+    thread_quota_init(&cpu_quota_, parent_ ? &parent_->cpu_quota_ : nullptr);
 }
 
 JobDispatcher::~JobDispatcher() {
+    // our child jobs and the threads of our processes are all gone, each
+    // held a reference
+    thread_quota_destroy(&cpu_quota_);
+
     if (parent_)
         parent_->RemoveChildJob(this);
 }
@@ -65,7 +81,12 @@ void JobDispatcher::AddChildProcess(ProcessDispatcher* process) {
 }
 
 void JobDispatcher::RemoveChildProcess(ProcessDispatcher* process) {
+    // the process is being destroyed, its threads are all gone
+    mx_info_task_runtime_t rt;
+    process->GetRuntimeInfo(&rt);
+
     AutoLock lock(&lock_);
+    AddTaskRuntime(&exited_runtime_, rt);
     if (!ProcessDispatcher::ProcessListTraits::node_state(*process).InContainer())
         return;
     procs_.erase(*process);
@@ -79,7 +100,11 @@ void JobDispatcher::AddChildJob(JobDispatcher* job) {
 }
 
 void JobDispatcher::RemoveChildJob(JobDispatcher* job) {
+    mx_info_task_runtime_t rt;
+    job->GetRuntimeInfo(&rt);
+
     AutoLock lock(&lock_);
+    AddTaskRuntime(&exited_runtime_, rt);
     if (!JobDispatcher::ListTraits::node_state(*job).InContainer())
         return;
     jobs_.erase(*job);
@@ -111,6 +136,24 @@ void JobDispatcher::Kill() {
     }
 }
 
+status_t JobDispatcher::GetRuntimeInfo(mx_info_task_runtime_t* info) {
+    AutoLock lock(&lock_);
+
+    *info = exited_runtime_;
+    for (auto& proc : procs_) {
+        mx_info_task_runtime_t rt;
+        proc.GetRuntimeInfo(&rt);
+        AddTaskRuntime(info, rt);
+    }
+    for (auto& job : jobs_) {
+        mx_info_task_runtime_t rt;
+        job.GetRuntimeInfo(&rt);
+        AddTaskRuntime(info, rt);
+    }
+
+    return NO_ERROR;
+}
+
 bool JobDispatcher::EnumerateChildren(JobEnumerator* je) {
     AutoLock lock(&lock_);
 
@@ -131,3 +174,75 @@ bool JobDispatcher::EnumerateChildren(JobEnumerator* je) {
     }
     return true;
 }
+
+status_t JobDispatcher::SetCpuQuota(const mx_job_cpu_quota_t& quota) {
+    if (quota.period != 0 && (quota.period < MX_JOB_CPU_PERIOD_MIN ||
+                              quota.period > MX_JOB_CPU_PERIOD_MAX))
+        return ERR_INVALID_ARGS;
+    return thread_quota_set(&cpu_quota_, quota.period, quota.quota);
+}
+
+mx_job_cpu_quota_t JobDispatcher::GetCpuQuota() {
+    thread_quota_info_t qi;
+    thread_quota_get_info(&cpu_quota_, &qi);
+    return mx_job_cpu_quota_t{qi.period_ns, qi.quota_ns};
+}
+
+status_t JobDispatcher::SetCpuAffinity(uint32_t mask) {
+    uint32_t above = parent_ ? parent_->GetEffectiveCpuAffinity() : UINT32_MAX;
+    if ((mask & above & mp_get_active_mask()) == 0)
+        return ERR_INVALID_ARGS;
+
+    AutoLock lock(&lock_);
+    cpu_affinity_ = mask;
+    return NO_ERROR;
+}
+
+uint32_t JobDispatcher::GetCpuAffinity() {
+    AutoLock lock(&lock_);
+    return cpu_affinity_;
+}
+
+uint32_t JobDispatcher::GetEffectiveCpuAffinity() {
+    uint32_t mask = GetCpuAffinity();
+    for (JobDispatcher* job = parent_.get(); job; job = job->parent_.get())
+        mask &= job->GetCpuAffinity();
+    return mask;
+}
+
+status_t JobDispatcher::SetMemoryLimit(uint64_t bytes) {
+    uint64_t pages = ROUNDUP(bytes, PAGE_SIZE) / PAGE_SIZE;
+    if (pages < bytes / PAGE_SIZE || pages > SIZE_MAX)
+        return ERR_OUT_OF_RANGE;
+    commit_account_->set_limit_pages(static_cast<size_t>(pages));
+    return NO_ERROR;
+}
+
+uint64_t JobDispatcher::GetMemoryLimit() const {
+    return static_cast<uint64_t>(commit_account_->limit_pages()) * PAGE_SIZE;
+}
+
+status_t JobDispatcher::GetResourceInfo(mx_info_job_resources_t* info) {
+    thread_quota_info_t qi;
+    thread_quota_get_info(&cpu_quota_, &qi);
+
+    *info = {};
+    info->committed_bytes = static_cast<uint64_t>(commit_account_->committed_pages()) * PAGE_SIZE;
+    info->memory_limit = GetMemoryLimit();
+    info->cpu_period = qi.period_ns;
+    info->cpu_quota = qi.quota_ns;
+    info->cpu_throttled_count = qi.throttled_count;
+    info->cpu_throttled_time = qi.throttled_ns;
+    info->cpu_affinity = GetEffectiveCpuAffinity();
+    return NO_ERROR;
+}
+
+void JobDispatcher::SetUpThread(thread_t* thread) {
+    thread_set_quota(thread, &cpu_quota_);
+
+    // the mask was checked against the online cpus when it was set, if
+    // they've all gone since, run where we can
+    uint32_t mask = GetEffectiveCpuAffinity();
+    if (mask != UINT32_MAX)
+        thread_set_cpu_affinity(thread, mask);
+}
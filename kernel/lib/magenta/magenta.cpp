@@ -6,16 +6,20 @@
 
 #include <magenta/magenta.h>
 
+#include <inttypes.h>
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
 #include <kernel/mutex.h>
+#include <kernel/vm.h>
 
 #include <lk/init.h>
 
 #include <lib/console.h>
+#include <lib/counters.h>
 
 #include <magenta/dispatcher.h>
+#include <magenta/event_dispatcher.h>
 #include <magenta/excp_port.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/handle.h>
@@ -41,10 +45,12 @@ constexpr size_t kMaxHandleCount = 16 * 1024u;
 
 constexpr size_t kHighHandleCount = (kMaxHandleCount * 8) / 7;
 
-// The handle arena and its mutex.
-mutex_t handle_mutex = MUTEX_INITIAL_VALUE(handle_mutex);
-mxtl::TypedArena<Handle> handle_arena;
-size_t outstanding_handles = 0u;
+// The handle arena. Freed handles are cached per cpu, so making and deleting
+// handles usually doesn't take the arena's lock.
+mxtl::CpuCachedTypedArena<Handle> handle_arena;
+int64_t outstanding_handles = 0;
+
+KCOUNTER(handle_bytes, "magenta.handle.bytes");
 
 // The system exception port.
 static mxtl::RefPtr<ExceptionPort> system_exception_port;
@@ -53,27 +59,56 @@ static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mut
 // All jobs and processes are rooted at the |root_job|.
 static mxtl::RefPtr<JobDispatcher> root_job;
 
+// Signaled while the pmm is under memory pressure.
+static mxtl::RefPtr<Dispatcher> memory_pressure_event;
+
+static void memory_pressure_changed(bool under_pressure) {
+    if (under_pressure)
+        memory_pressure_event->get_state_tracker()->UpdateState(0u, MX_EVENT_SIGNALED);
+    else
+        memory_pressure_event->get_state_tracker()->UpdateState(MX_EVENT_SIGNALED, 0u);
+}
+
 void magenta_init(uint level) {
     handle_arena.Init("handles", kMaxHandleCount);
     root_job = JobDispatcher::CreateRootJob();
+
+    mx_rights_t rights;
+    if (EventDispatcher::Create(0u, &memory_pressure_event, &rights) != NO_ERROR)
+        panic("failed to create the memory pressure event\n");
+    pmm_set_pressure_callback(&memory_pressure_changed);
+}
+
+static void high_handle_count(int64_t count) {
+    printf("warning!! high handle count: %" PRId64 " handles\n", count);
 }
 
-static void high_handle_count(size_t count) {
-    printf("warning!! high handle count: %zu handles\n", outstanding_handles);
+static void count_new_handle() {
+    int64_t count = atomic_add_64(&outstanding_handles, 1) + 1;
+    if (count > static_cast<int64_t>(kHighHandleCount))
+        high_handle_count(count);
 }
 
 Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    return handle_arena.New(mxtl::move(dispatcher), rights);
+    count_new_handle();
+    auto handle = handle_arena.New(mxtl::move(dispatcher), rights);
+    if (!handle) {
+        atomic_add_64(&outstanding_handles, -1);
+        return nullptr;
+    }
+    kcounter_add(&handle_bytes, sizeof(Handle));
+    return handle;
 }
 
 Handle* DupHandle(Handle* source, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
-    return handle_arena.New(source, rights);
+    count_new_handle();
+    auto handle = handle_arena.New(source, rights);
+    if (!handle) {
+        atomic_add_64(&outstanding_handles, -1);
+        return nullptr;
+    }
+    kcounter_add(&handle_bytes, sizeof(Handle));
+    return handle;
 }
 
 void DeleteHandle(Handle* handle) {
@@ -103,13 +138,12 @@ void DeleteHandle(Handle* handle) {
     // table lookup.
     memset(handle, 0, sizeof(Handle));
 
-    AutoLock lock(&handle_mutex);
-    --outstanding_handles;
+    atomic_add_64(&outstanding_handles, -1);
+    kcounter_add(&handle_bytes, -static_cast<int64_t>(sizeof(Handle)));
     handle_arena.RawFree(handle);
 }
 
 bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
     return handle_arena.in_range(addr);
 }
 
@@ -147,6 +181,10 @@ mxtl::RefPtr<JobDispatcher> GetRootJobDispatcher() {
     return root_job;
 }
 
+mxtl::RefPtr<Dispatcher> GetMemoryPressureEvent() {
+    return memory_pressure_event;
+}
+
 bool magenta_rights_check(mx_rights_t actual, mx_rights_t desired) {
     if ((actual & desired) == desired)
         return true;
@@ -8,37 +8,96 @@
 
 #include <err.h>
 #include <new.h>
+#include <stdlib.h>
 
+#include <lib/counters.h>
 #include <magenta/magenta.h>
+#include <mxtl/object_cache.h>
+
+namespace {
+
+// Every packet allocation starts with a word saying where it came from, which
+// operator delete reads back. The packet itself follows.
+constexpr size_t kPrefixSize = sizeof(uint64_t);
+static_assert(alignof(MessagePacket) <= kPrefixSize, "");
+static_assert(sizeof(MessagePacket) % alignof(Handle*) == 0, "");
+
+// Index in the prefix of packets that came from the heap.
+constexpr uint64_t kHeapAllocated = ~0ull;
+
+const char* SmallName() { return "message packets (128)"; }
+const char* MediumName() { return "message packets (256)"; }
+const char* LargeName() { return "message packets (512)"; }
+
+// Most messages are small control messages, which fit the first class.
+mxtl::ObjectCache caches[] = {
+    {&SmallName, 128u, alignof(MessagePacket)},
+    {&MediumName, 256u, alignof(MessagePacket)},
+    {&LargeName, mxtl::ObjectCache::kMaxObjectSize, alignof(MessagePacket)},
+};
+
+// Memory held by packets that exist, whether queued or in flight.
+KCOUNTER(packet_bytes_counter, "magenta.channel.packet_bytes");
+
+size_t PacketSize(uint32_t data_size, uint32_t num_handles) {
+    return kPrefixSize + sizeof(MessagePacket) + num_handles * sizeof(Handle*) + data_size;
+}
+
+}  // namespace
 
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
                                   mxtl::unique_ptr<MessagePacket>* msg) {
-    AllocChecker ac;
+    size_t size = PacketSize(data_size, num_handles);
 
-    msg->reset(new (&ac) MessagePacket(data_size, num_handles));
-    if (!ac.check())
-        return ERR_NO_MEMORY;
-
-    if (data_size > 0u) {
-        (*msg)->data_.reset(new (&ac) uint8_t[data_size]);
-        if (!ac.check())
-            return ERR_NO_MEMORY;
+    uint64_t index;
+    void* buffer = nullptr;
+    for (index = 0; index < countof(caches); index++) {
+        if (size <= caches[index].object_size()) {
+            buffer = caches[index].Alloc();
+            break;
+        }
     }
-
-    if (num_handles > 0u) {
-        (*msg)->handles_.reset(new (&ac) Handle*[num_handles]);
-        if (!ac.check())
-            return ERR_NO_MEMORY;
+    if (index == countof(caches)) {
+        index = kHeapAllocated;
+        buffer = malloc(size);
     }
+    if (!buffer)
+        return ERR_NO_MEMORY;
 
+    *static_cast<uint64_t*>(buffer) = index;
+    msg->reset(new (static_cast<char*>(buffer) + kPrefixSize) MessagePacket(data_size, num_handles));
+    kcounter_add(&packet_bytes_counter, (*msg)->allocated_size());
     return NO_ERROR;
 }
 
+size_t MessagePacket::allocated_size() const {
+    uint64_t index = *reinterpret_cast<const uint64_t*>(
+        reinterpret_cast<const char*>(this) - kPrefixSize);
+    if (index == kHeapAllocated)
+        return PacketSize(data_size_, num_handles_);
+    return caches[index].object_size();
+}
+
+// static
+void MessagePacket::operator delete(void* ptr) {
+    if (!ptr)
+        return;
+    void* buffer = static_cast<char*>(ptr) - kPrefixSize;
+    uint64_t index = *static_cast<uint64_t*>(buffer);
+    if (index == kHeapAllocated) {
+        free(buffer);
+    } else {
+        DEBUG_ASSERT(index < countof(caches));
+        caches[index].Free(buffer);
+    }
+}
+
 MessagePacket::~MessagePacket() {
+    kcounter_add(&packet_bytes_counter, -static_cast<int64_t>(allocated_size()));
     if (owns_handles_) {
         for (uint32_t i = 0; i < num_handles_; i++)
-            DeleteHandle(handles_[i]);
+            DeleteHandle(mutable_handles()[i]);
     }
 }
 
@@ -0,0 +1,166 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/pager_dispatcher.h>
+
+#include <assert.h>
+#include <err.h>
+#include <new.h>
+
+#include <kernel/auto_lock.h>
+#include <kernel/vm.h>
+#include <kernel/vm/page_source.h>
+#include <kernel/vm/vm_object.h>
+
+#include <magenta/port_dispatcher.h>
+
+constexpr mx_rights_t kDefaultPagerRights =
+    MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
+
+// Backs one VMO, asking for its pages on the pager's behalf.
+class PagerDispatcher::Source final : public PageSource,
+                                      public mxtl::DoublyLinkedListable<Source*> {
+public:
+    Source(mxtl::RefPtr<PagerDispatcher> pager, mxtl::RefPtr<PortDispatcher> port, uint64_t key)
+        : pager_(mxtl::move(pager)), port_(mxtl::move(port)), key_(key) {}
+
+    ~Source() final { pager_->RemoveSource(this); }
+
+    // The VMO we back. Only compared against, never followed; it holds the
+    // last reference to us, so it can't be replaced by another at the same
+    // address while we're on the pager's list.
+    VmObject* vmo = nullptr;
+
+private:
+    status_t SendRequest(uint64_t offset, uint64_t len) final;
+
+    const mxtl::RefPtr<PagerDispatcher> pager_;
+    const mxtl::RefPtr<PortDispatcher> port_;
+    const uint64_t key_;
+};
+
+status_t PagerDispatcher::Source::SendRequest(uint64_t offset, uint64_t len) {
+    mx_pager_packet_t packet = {};
+    packet.hdr.key = key_;
+    packet.hdr.type = MX_PORT_PKT_TYPE_PAGER;
+    packet.command = MX_PAGER_VMO_READ;
+    packet.offset = offset;
+    packet.length = len;
+
+    IOP_Packet* iopk = IOP_Packet::Make(&packet, sizeof(packet));
+    if (!iopk)
+        return ERR_NO_MEMORY;
+
+    return port_->Queue(iopk);
+}
+
+status_t PagerDispatcher::Create(uint32_t options, mxtl::RefPtr<Dispatcher>* dispatcher,
+                                 mx_rights_t* rights) {
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    auto disp = new (&ac) PagerDispatcher();
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    *rights = kDefaultPagerRights;
+    *dispatcher = mxtl::AdoptRef<Dispatcher>(disp);
+    return NO_ERROR;
+}
+
+PagerDispatcher::PagerDispatcher() {}
+
+PagerDispatcher::~PagerDispatcher() {
+    // each source holds a reference to us
+    DEBUG_ASSERT(sources_.is_empty());
+}
+
+void PagerDispatcher::on_zero_handles() {
+    AutoLock lock(&lock_);
+
+    // Nobody is left to supply pages. A source may be on its way out,
+    // blocked on our lock in its destructor, but it's intact until then.
+    closed_ = true;
+    for (auto& source : sources_)
+        source.Close();
+}
+
+void PagerDispatcher::RemoveSource(Source* source) {
+    AutoLock lock(&lock_);
+    // CreateVmo() may have given up on it before adding it
+    if (source->InContainer())
+        sources_.erase(*source);
+}
+
+status_t PagerDispatcher::CreateVmo(mxtl::RefPtr<PortDispatcher> port, uint64_t key,
+                                    uint64_t size, mxtl::RefPtr<VmObject>* vmo) {
+    uint64_t rounded_size = ROUNDUP(size, PAGE_SIZE);
+    if (rounded_size < size)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    auto source = mxtl::AdoptRef(new (&ac) Source(mxtl::RefPtr<PagerDispatcher>(this),
+                                                  mxtl::move(port), key));
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    {
+        AutoLock lock(&lock_);
+        if (closed_)
+            return ERR_BAD_STATE;
+        sources_.push_back(source.get());
+    }
+
+    Source* raw_source = source.get();
+    mxtl::RefPtr<VmObject> new_vmo =
+        VmObjectPaged::CreateWithSource(PMM_ALLOC_FLAG_ANY, rounded_size, mxtl::move(source));
+    if (!new_vmo)
+        return ERR_NO_MEMORY;
+
+    {
+        AutoLock lock(&lock_);
+        raw_source->vmo = new_vmo.get();
+    }
+
+    *vmo = mxtl::move(new_vmo);
+    return NO_ERROR;
+}
+
+status_t PagerDispatcher::SupplyPages(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                      uint64_t len, mxtl::RefPtr<VmObject> aux_vmo) {
+    {
+        AutoLock lock(&lock_);
+        bool found = false;
+        for (const auto& source : sources_) {
+            if (source.vmo == vmo.get()) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return ERR_INVALID_ARGS;
+    }
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+
+    // our VMOs never change size, so check before taking anything out of
+    // |aux_vmo|
+    if (offset > vmo->size() || len > vmo->size() - offset)
+        return ERR_OUT_OF_RANGE;
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    status_t status = aux_vmo->TakePages(0, len, &pages);
+    if (status != NO_ERROR)
+        return status;
+
+    status = vmo->SupplyPages(offset, len, &pages);
+
+    // whatever wasn't needed
+    pmm_free(&pages);
+    return status;
+}
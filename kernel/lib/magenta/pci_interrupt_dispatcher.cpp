@@ -93,4 +93,9 @@ status_t PciInterruptDispatcher::InterruptComplete() {
     return NO_ERROR;
 }
 
+status_t PciInterruptDispatcher::SetTargetCpu(int cpu) {
+    DEBUG_ASSERT(device_ != nullptr);
+    return device_->device()->SetIrqTargetCpu(irq_id_, cpu);
+}
+
 #endif  // if WITH_DEV_PCIE
@@ -9,25 +9,49 @@
 #include <assert.h>
 #include <err.h>
 #include <new.h>
+#include <platform.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
 
 #include <kernel/auto_lock.h>
+#include <lib/counters.h>
 #include <lib/user_copy.h>
 
+#include <magenta/port_observer.h>
 #include <magenta/state_tracker.h>
 #include <magenta/user_copy.h>
 
 constexpr mx_rights_t kDefaultIOPortRights =
     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+static const char* PacketCacheName() { return "port packets"; }
+
+// Every packet a user can queue fits in one of these; only exception
+// reports are bigger and go to the heap.
+static mxtl::ObjectCache packet_cache(&PacketCacheName,
+                                      sizeof(IOP_Packet) + MX_PORT_MAX_PKT_SIZE,
+                                      alignof(IOP_Packet));
+
+// Memory held by allocated packets; the embedded kinds belong to other objects.
+KCOUNTER(port_packet_bytes, "magenta.port.packet_bytes");
+
 IOP_Packet* IOP_Packet::Alloc(size_t size) {
-    AllocChecker ac;
-    auto mem = new (&ac) char [sizeof(IOP_Packet) + size];
-    if (!ac.check())
-        return nullptr;
-    return new (mem) IOP_Packet(size);
+    IOP_Packet* packet;
+    if (size <= MX_PORT_MAX_PKT_SIZE) {
+        void* mem = packet_cache.Alloc();
+        if (!mem)
+            return nullptr;
+        packet = new (mem) IOP_Packet(size, Kind::kCached);
+    } else {
+        AllocChecker ac;
+        auto mem = new (&ac) char [sizeof(IOP_Packet) + size];
+        if (!ac.check())
+            return nullptr;
+        packet = new (mem) IOP_Packet(size);
+    }
+    kcounter_add(&port_packet_bytes, packet->allocated_size());
+    return packet;
 }
 
 IOP_Packet* IOP_Packet::Make(const void* data, size_t size) {
@@ -47,35 +71,79 @@ IOP_Packet* IOP_Packet::MakeFromUser(const void* data, size_t size) {
         reinterpret_cast<char*>(pk) + sizeof(IOP_Packet));
 
     auto status = magenta_copy_from_user(data, header, size);
+    if (status != NO_ERROR) {
+        Delete(pk);
+        return nullptr;
+    }
     header->type = MX_PORT_PKT_TYPE_USER;
-
-    return (status == NO_ERROR) ? pk : nullptr;
+    return pk;
 }
 
 void IOP_Packet::Delete(IOP_Packet* packet) {
-    if (!packet || packet->is_signal)
+    if (!packet)
         return;
-    packet->~IOP_Packet();
-    delete [] reinterpret_cast<char*>(packet);
+    kcounter_add(&port_packet_bytes, -static_cast<int64_t>(packet->allocated_size()));
+    switch (packet->kind) {
+    case Kind::kHeap:
+        packet->~IOP_Packet();
+        delete [] reinterpret_cast<char*>(packet);
+        break;
+    case Kind::kCached:
+        packet->~IOP_Packet();
+        packet_cache.Free(packet);
+        break;
+    case Kind::kSignal:
+    case Kind::kObserver:
+    case Kind::kInterrupt:
+        // owned by the port, the observer or the interrupt
+        break;
+    }
+}
+
+size_t IOP_Packet::allocated_size() const {
+    switch (kind) {
+    case Kind::kHeap:
+        return sizeof(IOP_Packet) + data_size;
+    case Kind::kCached:
+        return packet_cache.object_size();
+    default:
+        return 0u;
+    }
 }
 
 bool IOP_Packet::CopyToUser(void* data, size_t* size) {
     if (*size < data_size)
-        return ERR_BUFFER_TOO_SMALL;
+        return false;
     *size = data_size;
     return copy_to_user_unsafe(
         data, reinterpret_cast<char*>(this) + sizeof(IOP_Packet), data_size) == NO_ERROR;
 }
 
 IOP_Signal::IOP_Signal(uint64_t key, mx_signals_t signal)
-    : IOP_Packet(sizeof(payload), true),
+    : IOP_Packet(sizeof(payload), Kind::kSignal),
       payload {{key, MX_PORT_PKT_TYPE_IOSN, 0u}, 0u, 0u, signal, 0u},
       count(1u) {
 }
 
+IOP_Observer::IOP_Observer(PortObserver* observer, uint64_t key)
+    : IOP_Packet(sizeof(payload), Kind::kObserver),
+      payload {{key, MX_PORT_PKT_TYPE_IOSN, 0u}, 0u, 0u, 0u, 0u},
+      observer(observer),
+      removed(false) {
+}
+
+IOP_Interrupt::IOP_Interrupt()
+    : IOP_Packet(sizeof(payload), Kind::kInterrupt),
+      payload {{0u, MX_PORT_PKT_TYPE_IOSN, 0u}, 0u, 0u, MX_SIGNAL_SIGNALED, 0u},
+      pending(false) {
+}
+
 mx_status_t PortDispatcher::Create(uint32_t options,
                                    mxtl::RefPtr<Dispatcher>* dispatcher,
                                    mx_rights_t* rights) {
+    if (options & ~MX_PORT_OPT_LIFO)
+        return ERR_INVALID_ARGS;
+
     AllocChecker ac;
     auto disp = new (&ac) PortDispatcher(options);
     if (!ac.check())
@@ -86,9 +154,14 @@ mx_status_t PortDispatcher::Create(uint32_t options,
     return NO_ERROR;
 }
 
-PortDispatcher::PortDispatcher(uint32_t /*options*/)
+PortDispatcher::PortDispatcher(uint32_t options)
     : no_clients_(false) {
-    event_init(&event_, false, EVENT_FLAG_AUTOUNSIGNAL);
+    // With MX_PORT_OPT_LIFO each packet goes to the thread which started
+    // waiting last, so a pool of workers keeps its hot ones busy.
+    uint flags = EVENT_FLAG_AUTOUNSIGNAL;
+    if (options & MX_PORT_OPT_LIFO)
+        flags |= EVENT_FLAG_WAKE_LIFO;
+    event_init(&event_, false, flags);
 }
 
 PortDispatcher::~PortDispatcher() {
@@ -99,20 +172,36 @@ PortDispatcher::~PortDispatcher() {
 
 void PortDispatcher::FreePackets_NoLock() {
     while (!packets_.is_empty()) {
-        IOP_Packet::Delete(packets_.pop_front());
+        auto pk = packets_.pop_front();
+        if (pk->is_signal()) {
+            delete static_cast<IOP_Signal*>(pk);
+        } else if (pk->is_observer()) {
+            // The observer's reference keeps us alive while one is queued,
+            // so this only runs from on_zero_handles().
+            auto op = static_cast<IOP_Observer*>(pk);
+            if (op->removed)
+                delete op->observer;
+        } else if (pk->is_interrupt()) {
+            // owned by the interrupt, which holds a reference to us
+        } else {
+            IOP_Packet::Delete(pk);
+        }
     }
     while (!at_zero_.is_empty()) {
-        auto signal = at_zero_.pop_front();
-        if (signal) {
-            signal->is_signal = false;
-            IOP_Packet::Delete(signal);
-        }
+        delete static_cast<IOP_Signal*>(at_zero_.pop_front());
     }
 }
 
 void PortDispatcher::on_zero_handles() {
     AutoLock al(&lock_);
-    no_clients_ = true;
+    {
+        AutoSpinLockIrqSave irq_lock(irq_lock_);
+        no_clients_ = true;
+        while (!irq_packets_.is_empty()) {
+            static_cast<IOP_Interrupt*>(&irq_packets_.front())->pending = false;
+            irq_packets_.pop_front();
+        }
+    }
     FreePackets_NoLock();
 }
 
@@ -176,30 +265,125 @@ void* PortDispatcher::Signal(void* cookie, uint64_t key, mx_signals_t signal) {
     return node;
 }
 
-mx_status_t PortDispatcher::Wait(mx_time_t timeout, IOP_Packet** packet) {
+mx_status_t PortDispatcher::QueueObserver(IOP_Observer* packet, mx_signals_t signals,
+                                          bool* awoke_threads) {
+    AutoLock al(&lock_);
+    if (no_clients_)
+        return ERR_UNAVAILABLE;
+
+    packet->payload.signals |= signals;
+    if (!packet->InContainer()) {
+        packet->payload.timestamp = current_time_hires();
+        packets_.push_back(packet);
+        *awoke_threads = event_signal_etc(&event_, false, NO_ERROR) > 0;
+    }
+    return NO_ERROR;
+}
+
+bool PortDispatcher::ObserverRemoved(IOP_Observer* packet) {
+    AutoLock al(&lock_);
+    packet->removed = true;
+    return !packet->InContainer();
+}
+
+bool PortDispatcher::QueueInterrupt(IOP_Interrupt* packet) {
+    AutoSpinLockIrqSave irq_lock(irq_lock_);
+    if (no_clients_ || packet->InContainer())
+        return false;
+
+    packet->payload.timestamp = current_time_hires();
+    packet->pending = true;
+    irq_packets_.push_back(packet);
+    return event_signal_etc(&event_, false, NO_ERROR) > 0;
+}
+
+void PortDispatcher::RemoveInterrupt(IOP_Interrupt* packet) {
+    AutoLock al(&lock_);
+    AutoSpinLockIrqSave irq_lock(irq_lock_);
+    if (!packet->InContainer())
+        return;
+    if (packet->pending) {
+        irq_packets_.erase(*packet);
+    } else {
+        packets_.erase(*packet);
+    }
+    packet->pending = false;
+}
+
+void PortDispatcher::TakeInterrupts_Locked() {
+    DEBUG_ASSERT(lock_.IsHeld());
+    AutoSpinLockIrqSave irq_lock(irq_lock_);
+    while (!irq_packets_.is_empty()) {
+        auto pk = static_cast<IOP_Interrupt*>(&irq_packets_.front());
+        irq_packets_.pop_front();
+        pk->pending = false;
+        packets_.push_back(pk);
+    }
+}
+
+mx_status_t PortDispatcher::Wait(mx_time_t timeout, size_t max_size,
+                                 IOP_Result* results, size_t count, size_t* actual) {
+    DEBUG_ASSERT(count > 0);
+
     while (true) {
+        size_t n = 0;
+        bool too_small = false;
         {
             AutoLock al(&lock_);
-            if (!packets_.is_empty()) {
-                auto pk = packets_.pop_front();
-                ASSERT(pk);
-
-                if (!pk->is_signal) {
-                    *packet = pk;
+            TakeInterrupts_Locked();
+            while (n < count && !packets_.is_empty()) {
+                auto pk = &packets_.front();
+                if (pk->data_size > max_size) {
+                    too_small = (n == 0);
+                    break;
+                }
+                IOP_Result* result = &results[n++];
+                result->packet = nullptr;
+                result->done = nullptr;
+
+                if (pk->is_interrupt()) {
+                    // Its handler may queue it again as soon as it is off.
+                    AutoSpinLockIrqSave irq_lock(irq_lock_);
+                    packets_.pop_front();
+                    result->observed = static_cast<IOP_Interrupt*>(pk)->payload;
+                    continue;
+                }
+                packets_.pop_front();
+
+                if (pk->is_observer()) {
+                    auto op = static_cast<IOP_Observer*>(pk);
+                    result->observed = op->payload;
+                    op->payload.signals = 0u;
+                    if (op->removed)
+                        result->done = op->observer;
+                } else if (!pk->is_signal()) {
+                    result->packet = pk;
                 } else {
+                    // Signal packets go back to the tail while they have
+                    // counts left, so they may show up again in this batch.
                     auto signal = static_cast<IOP_Signal*>(pk);
                     auto prev = atomic_add(&signal->count, -1);
                     if (prev == 1)
                         at_zero_.push_back(signal);
                     else
                         packets_.push_back(signal);
-                    *packet = signal;
+                    result->packet = signal;
                 }
-                return NO_ERROR;
             }
+        }
 
+        if (n > 0) {
+            for (size_t ix = 0; ix != n; ++ix) {
+                delete results[ix].done;
+                results[ix].done = nullptr;
+            }
+            *actual = n;
+            return NO_ERROR;
         }
 
+        if (too_small)
+            return ERR_BUFFER_TOO_SMALL;
+
         if (timeout == 0ull)
             return ERR_TIMED_OUT;
 
@@ -209,3 +393,11 @@ mx_status_t PortDispatcher::Wait(mx_time_t timeout, IOP_Packet** packet) {
             return st;
     }
 }
+
+void PortDispatcher::GetQueued(uint64_t* count, uint64_t* bytes) {
+    AutoLock al(&lock_);
+    for (const auto& packet : packets_) {
+        *count += 1;
+        *bytes += packet.allocated_size();
+    }
+}
@@ -0,0 +1,61 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <magenta/port_observer.h>
+
+#include <assert.h>
+#include <err.h>
+
+#include <mxtl/type_support.h>
+
+PortObserver::PortObserver(bool repeating, Handle* handle, mxtl::RefPtr<PortDispatcher> port,
+                           uint64_t key, mx_signals_t signals)
+    : repeating_(repeating),
+      handle_(handle),
+      watched_signals_(signals),
+      port_(mxtl::move(port)),
+      packet_(this, key) {
+}
+
+PortObserver::~PortObserver() {
+    DEBUG_ASSERT(!packet_.InContainer());
+}
+
+bool PortObserver::OnInitialize(mx_signals_t initial_state, bool* should_remove) {
+    last_state_ = initial_state;
+    if (!(initial_state & watched_signals_))
+        return false;
+    return Fire(initial_state & watched_signals_, should_remove);
+}
+
+bool PortObserver::OnStateChange(mx_signals_t new_state, bool* should_remove) {
+    // One-shot observers go on the level, repeating ones on the edge.
+    mx_signals_t fired = new_state & watched_signals_;
+    if (repeating_)
+        fired &= ~last_state_;
+    last_state_ = new_state;
+    if (!fired)
+        return false;
+    return Fire(fired, should_remove);
+}
+
+bool PortObserver::OnCancel(Handle* handle, bool* should_remove) {
+    if (handle == handle_)
+        *should_remove = true;
+    return false;
+}
+
+void PortObserver::OnRemoved() {
+    if (port_->ObserverRemoved(&packet_))
+        delete this;
+}
+
+bool PortObserver::Fire(mx_signals_t signals, bool* should_remove) {
+    bool awoke_threads = false;
+    if (port_->QueueObserver(&packet_, signals, &awoke_threads) != NO_ERROR || !repeating_)
+        *should_remove = true;
+    return awoke_threads;
+}
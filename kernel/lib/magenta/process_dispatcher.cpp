@@ -15,6 +15,7 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
@@ -22,9 +23,11 @@
 
 #include <lib/crypto/global_prng.h>
 
+#include <magenta/channel_dispatcher.h>
 #include <magenta/futex_context.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/port_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -44,6 +47,31 @@ mutex_t ProcessDispatcher::global_process_list_mutex_ =
 mxtl::DoublyLinkedList<ProcessDispatcher*, ProcessDispatcher::ProcessListTraits>
     ProcessDispatcher::global_process_list_;
 
+// GetDispatcher() looks handles up without taking |handle_table_lock_|, so
+// that threads of a process making syscalls at the same time don't
+// serialize on it. A lookup runs with interrupts disabled and holds its cpu's
+// sequence odd while it looks at the Handle. Whoever takes a Handle out of a
+// table clears its process id and then calls WaitForHandleReaders(), which
+// waits out every lookup that may still have seen the old id, so a Handle is
+// never destroyed or reused under a reader. Lookups only ever wait on
+// themselves; the removal side pays for the wait.
+struct HandleReader {
+    uint32_t seq;
+} __CPU_ALIGN;
+
+static HandleReader handle_readers[SMP_MAX_CPUS];
+
+static void WaitForHandleReaders() {
+    smp_mb();
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        uint32_t seq = __atomic_load_n(&handle_readers[cpu].seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1u))
+            continue;
+        while (__atomic_load_n(&handle_readers[cpu].seq, __ATOMIC_ACQUIRE) == seq)
+            arch_spinloop_pause();
+    }
+}
+
 mx_handle_t map_handle_to_value(const Handle* handle, mx_handle_t mixer) {
     // Ensure that the last bit of the result is not zero and that
     // we don't lose upper bits.
@@ -91,8 +119,7 @@ ProcessDispatcher::ProcessDispatcher(mxtl::RefPtr<JobDispatcher> job,
 
     // Generate handle XOR mask with top bit and bottom two bits cleared
     uint32_t secret;
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    prng->Draw(&secret, sizeof(secret));
+    crypto::GlobalPRNG::Draw(&secret, sizeof(secret));
 
     // Handle values cannot be negative values, so we mask the high bit.
     handle_rand_ = (secret << 2) & INT_MAX;
@@ -258,6 +285,10 @@ void ProcessDispatcher::RemoveThread(UserThread* t) {
     DEBUG_ASSERT(t != nullptr);
     thread_list_.erase(*t);
 
+    mx_info_task_runtime_t rt;
+    t->GetRuntimeInfo(&rt);
+    AddTaskRuntime(&exited_runtime_, rt);
+
     // if this was the last thread, transition directly to DEAD state
     if (thread_list_.is_empty()) {
         LTRACEF("last thread left the process %p, entering DEAD state\n", this);
@@ -314,6 +345,10 @@ void ProcessDispatcher::SetState(State s) {
         LTRACEF_LEVEL(2, "cleaning up handle table on proc %p\n", this);
         {
             AutoLock lock(&handle_table_lock_);
+            for (auto& handle : handles_)
+                handle.set_process_id(0u);
+            WaitForHandleReaders();
+
             Handle* handle;
             while ((handle = handles_.pop_front()) != nullptr) {
                 DeleteHandle(handle);
@@ -371,10 +406,32 @@ HandleUniquePtr ProcessDispatcher::RemoveHandle_NoLock(mx_handle_t handle_value)
         return nullptr;
     handles_.erase(*handle);
     handle->set_process_id(0u);
+    WaitForHandleReaders();
 
     return HandleUniquePtr(handle);
 }
 
+size_t ProcessDispatcher::RemoveHandles_NoLock(const mx_handle_t* handle_values, size_t count,
+                                               Handle** handles) {
+    for (size_t ix = 0; ix != count; ++ix) {
+        auto handle = GetHandle_NoLock(handle_values[ix]);
+        if (!handle) {
+            // Put back the handles already removed. Nothing waited for their
+            // readers, who can still use them.
+            for (size_t idx = 0; idx != ix; ++idx)
+                UndoRemoveHandle_NoLock(handle_values[idx]);
+            return ix;
+        }
+        handles_.erase(*handle);
+        handle->set_process_id(0u);
+        if (handles)
+            handles[ix] = handle;
+    }
+    WaitForHandleReaders();
+
+    return count;
+}
+
 void ProcessDispatcher::UndoRemoveHandle_NoLock(mx_handle_t handle_value) {
     auto handle = map_value_to_handle(handle_value, handle_rand_);
     AddHandle_NoLock(HandleUniquePtr(handle));
@@ -383,13 +440,32 @@ void ProcessDispatcher::UndoRemoveHandle_NoLock(mx_handle_t handle_value) {
 bool ProcessDispatcher::GetDispatcher(mx_handle_t handle_value,
                                       mxtl::RefPtr<Dispatcher>* dispatcher,
                                       uint32_t* rights) {
-    AutoLock lock(&handle_table_lock_);
+    mxtl::RefPtr<Dispatcher> found;
+    uint32_t found_rights = 0u;
+
+    // disable interrupts so we stay on this cpu and the section stays short
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    HandleReader* reader = &handle_readers[arch_curr_cpu_num()];
+    __atomic_store_n(&reader->seq, reader->seq + 1u, __ATOMIC_RELAXED);
+    smp_mb();
+
     Handle* handle = GetHandle_NoLock(handle_value);
-    if (!handle)
+    if (handle) {
+        // The handle holds its reference until WaitForHandleReaders() lets
+        // whoever removes it go on, so taking another one here is safe.
+        found_rights = handle->rights();
+        found = handle->dispatcher();
+    }
+
+    __atomic_store_n(&reader->seq, reader->seq + 1u, __ATOMIC_RELEASE);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (!found)
         return false;
 
-    *rights = handle->rights();
-    *dispatcher = handle->dispatcher();
+    *rights = found_rights;
+    *dispatcher = mxtl::move(found);
     return true;
 }
 
@@ -399,6 +475,60 @@ status_t ProcessDispatcher::GetInfo(mx_info_process_t* info) {
     return NO_ERROR;
 }
 
+status_t ProcessDispatcher::GetMemoryInfo(mx_info_process_memory_t* info) {
+    VmAspace::FaultStats stats = aspace_->GetFaultStats();
+
+    info->committed_bytes = aspace_->AllocatedPages() * PAGE_SIZE;
+    info->minor_faults = stats.minor_faults;
+    info->major_faults = stats.major_faults;
+    info->fault_time = stats.fault_time;
+
+    return NO_ERROR;
+}
+
+status_t ProcessDispatcher::GetKernelMemoryInfo(mx_info_process_kernel_memory_t* info) {
+    *info = {};
+
+    {
+        AutoLock lock(&handle_table_lock_);
+        for (const auto& handle : handles_) {
+            info->handle_count++;
+            auto dispatcher = handle.dispatcher();
+            if (auto channel = dispatcher->get_specific<ChannelDispatcher>()) {
+                channel->GetQueued(&info->channel_msg_count, &info->channel_msg_bytes);
+            } else if (auto port = dispatcher->get_specific<PortDispatcher>()) {
+                port->GetQueued(&info->port_packet_count, &info->port_packet_bytes);
+            }
+        }
+    }
+    info->handle_bytes = info->handle_count * sizeof(Handle);
+
+    {
+        AutoLock lock(&thread_list_lock_);
+        for (const auto& thread : thread_list_) {
+            info->thread_count++;
+            info->thread_stack_bytes += thread.kernel_stack_size();
+        }
+    }
+
+    info->page_table_bytes = aspace_->PageTableBytes();
+
+    return NO_ERROR;
+}
+
+status_t ProcessDispatcher::GetRuntimeInfo(mx_info_task_runtime_t* info) {
+    AutoLock lock(&thread_list_lock_);
+
+    *info = exited_runtime_;
+    for (auto& thread : thread_list_) {
+        mx_info_task_runtime_t rt;
+        thread.GetRuntimeInfo(&rt);
+        AddTaskRuntime(info, rt);
+    }
+
+    return NO_ERROR;
+}
+
 status_t ProcessDispatcher::CreateUserThread(mxtl::StringPiece name, uint32_t flags, mxtl::RefPtr<UserThread>* user_thread) {
     AllocChecker ac;
     auto ut = mxtl::AdoptRef(new (&ac) UserThread(mxtl::WrapRefPtr(this),
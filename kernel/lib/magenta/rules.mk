@@ -18,20 +18,24 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/event_pair_dispatcher.cpp \
     $(LOCAL_DIR)/exception.cpp \
     $(LOCAL_DIR)/excp_port.cpp \
+    $(LOCAL_DIR)/fifo_dispatcher.cpp \
     $(LOCAL_DIR)/futex_context.cpp \
     $(LOCAL_DIR)/futex_node.cpp \
     $(LOCAL_DIR)/handle.cpp \
+    $(LOCAL_DIR)/interrupt_dispatcher.cpp \
     $(LOCAL_DIR)/interrupt_event_dispatcher.cpp \
     $(LOCAL_DIR)/io_mapping_dispatcher.cpp \
     $(LOCAL_DIR)/job_dispatcher.cpp \
     $(LOCAL_DIR)/log_dispatcher.cpp \
     $(LOCAL_DIR)/magenta.cpp \
     $(LOCAL_DIR)/message_packet.cpp \
+    $(LOCAL_DIR)/pager_dispatcher.cpp \
     $(LOCAL_DIR)/pci_device_dispatcher.cpp \
     $(LOCAL_DIR)/pci_interrupt_dispatcher.cpp \
     $(LOCAL_DIR)/pci_io_mapping_dispatcher.cpp \
     $(LOCAL_DIR)/port_client.cpp \
     $(LOCAL_DIR)/port_dispatcher.cpp \
+    $(LOCAL_DIR)/port_observer.cpp \
     $(LOCAL_DIR)/process_dispatcher.cpp \
     $(LOCAL_DIR)/resource_dispatcher.cpp \
     $(LOCAL_DIR)/socket_dispatcher.cpp \
@@ -45,6 +49,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/wait_state_observer.cpp \
 
 MODULE_DEPS := \
+    lib/counters \
     lib/dpc \
     lib/mxtl \
     dev/interrupt \
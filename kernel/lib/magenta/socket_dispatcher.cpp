@@ -17,6 +17,7 @@
 #include <lib/user_copy/user_ptr.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
 
@@ -26,9 +27,16 @@
 #define LOCAL_TRACE 0
 
 constexpr mx_rights_t kDefaultSocketRights =
-    MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE;
+    MX_RIGHT_TRANSFER | MX_RIGHT_DUPLICATE | MX_RIGHT_READ | MX_RIGHT_WRITE |
+    MX_RIGHT_GET_PROPERTY | MX_RIGHT_SET_PROPERTY;
 
-constexpr size_t kDeFaultSocketBufferSize = 256 * 1024u;
+constexpr uint32_t kDeFaultSocketBufferSize = 256 * 1024u;
+
+constexpr uint32_t kMinSocketBufferSize = PAGE_SIZE;
+constexpr uint32_t kMaxSocketBufferSize = 16 * 1024 * 1024u;
+
+// In datagram mode each message is stored behind a header holding its length.
+typedef uint32_t datagram_header_t;
 
 constexpr mx_signals_t kValidSignalMask =
     MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED | MX_USER_SIGNAL_ALL;
@@ -41,27 +49,32 @@ template <typename T> T vmodpow2(T val, uint modp2) { return val & ((1U << modp2
 #define INC_POINTER(len_pow2, ptr, inc) vmodpow2(((ptr) + (inc)), len_pow2)
 
 SocketDispatcher::CBuf::~CBuf() {
-    VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
+    if (buf_)
+        VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
 }
 
 bool SocketDispatcher::CBuf::Init(uint32_t len) {
-    vmo_ = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
-    if (!vmo_)
+    DEBUG_ASSERT(empty());
+
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, len);
+    if (!vmo)
         return false;
 
     void* start = nullptr;
     auto st = VmAspace::kernel_aspace()->MapObject(
-        vmo_, "socket", 0u, len, &start, PAGE_SIZE_SHIFT, 0,
+        vmo, "socket", 0u, len, &start, PAGE_SIZE_SHIFT, 0,
         0, ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
 
-    if (st < 0)
+    if (st < 0 || !start)
         return false;
 
-    buf_ = reinterpret_cast<char*>(start);
+    if (buf_)
+        VmAspace::kernel_aspace()->FreeRegion(reinterpret_cast<vaddr_t>(buf_));
 
-    if (!buf_)
-        return false;
+    vmo_ = mxtl::move(vmo);
+    buf_ = reinterpret_cast<char*>(start);
     len_pow2_ = log2_uint_floor(len);
+    head_ = tail_ = 0u;
     return true;
 }
 
@@ -74,7 +87,8 @@ bool SocketDispatcher::CBuf::empty() const {
     return tail_ == head_;
 }
 
-size_t SocketDispatcher::CBuf::Write(const void* src, size_t len, bool from_user) {
+template <typename F>
+size_t SocketDispatcher::CBuf::Fill(size_t len, F fill) {
 
     size_t write_len;
     size_t pos = 0;
@@ -100,54 +114,79 @@ size_t SocketDispatcher::CBuf::Write(const void* src, size_t len, bool from_user
             break;
         }
 
-        const char *ptr = (const char*)src;
-        ptr += pos;
+        size_t filled = fill(buf_ + head_, write_len);
+
+        head_ = INC_POINTER(len_pow2_, head_, filled);
+        pos += filled;
+        if (filled < write_len)
+            break;
+    }
+    return pos;
+}
+
+size_t SocketDispatcher::CBuf::Write(const void* src, size_t len, bool from_user) {
+    const char* ptr = reinterpret_cast<const char*>(src);
+    return Fill(len, [this, &ptr, from_user](char* dest, size_t n) {
         if (from_user) {
             // TODO: find a safer way to do this
             user_ptr<const void> uptr(ptr);
-            vmo_->WriteUser(uptr, head_, write_len, nullptr);
+            vmo_->WriteUser(uptr, dest - buf_, n, nullptr);
+        } else {
+            memcpy(dest, ptr, n);
+        }
+        ptr += n;
+        return n;
+    });
+}
+
+template <typename F>
+size_t SocketDispatcher::CBuf::Drain(size_t len, F drain) {
+    size_t pos = 0;
+    // loop until we've read everything we need
+    // at most this will make two passes to deal with wraparound
+    while (pos < len && tail_ != head_) {
+        size_t read_len;
+        if (head_ > tail_) {
+            // simple case where there is no wraparound
+            read_len = MIN(head_ - tail_, len - pos);
         } else {
-            memcpy(buf_ + head_, ptr, write_len);
+            // read to the end of buffer in this pass
+            read_len = MIN(valpow2(len_pow2_) - tail_, len - pos);
         }
 
-        head_ = INC_POINTER(len_pow2_, head_, write_len);
-        pos += write_len;
+        size_t drained = drain(buf_ + tail_, read_len);
+
+        tail_ = INC_POINTER(len_pow2_, tail_, drained);
+        pos += drained;
+        if (drained < read_len)
+            break;
     }
     return pos;
 }
 
 size_t SocketDispatcher::CBuf::Read(void* dest, size_t len, bool from_user) {
-    size_t ret = 0;
-
-    if (tail_ != head_) {
-        size_t pos = 0;
-        // loop until we've read everything we need
-        // at most this will make two passes to deal with wraparound
-        while (pos < len && tail_ != head_) {
-            size_t read_len;
-            if (head_ > tail_) {
-                // simple case where there is no wraparound
-                read_len = MIN(head_ - tail_, len - pos);
-            } else {
-                // read to the end of buffer in this pass
-                read_len = MIN(valpow2(len_pow2_) - tail_, len - pos);
-            }
-
-            char *ptr = (char*)dest;
-            ptr += pos;
-            if (from_user) {
-                // TODO: find a safer way to do this
-                user_ptr<void> uptr(ptr);
-                vmo_->ReadUser(uptr, tail_, read_len, nullptr);
-            } else {
-                memcpy(ptr, buf_ + tail_, read_len);
-            }
-
-            tail_ = INC_POINTER(len_pow2_, tail_, read_len);
-            pos += read_len;
+    char* ptr = reinterpret_cast<char*>(dest);
+    return Drain(len, [this, &ptr, from_user](const char* src, size_t n) {
+        if (!ptr) {
+            // discard the data
+            return n;
         }
-        ret = pos;
-    }
+        if (from_user) {
+            // TODO: find a safer way to do this
+            user_ptr<void> uptr(ptr);
+            vmo_->ReadUser(uptr, src - buf_, n, nullptr);
+        } else {
+            memcpy(ptr, src, n);
+        }
+        ptr += n;
+        return n;
+    });
+}
+
+size_t SocketDispatcher::CBuf::Peek(void* dest, size_t len) {
+    size_t tail = tail_;
+    size_t ret = Read(dest, len, false);
+    tail_ = tail;
     return ret;
 }
 
@@ -162,6 +201,9 @@ status_t SocketDispatcher::Create(uint32_t flags,
                                   mx_rights_t* rights) {
     LTRACE_ENTRY;
 
+    if (flags & ~MX_SOCKET_DATAGRAM)
+        return ERR_INVALID_ARGS;
+
     AllocChecker ac;
     auto socket0 = mxtl::AdoptRef(new (&ac) SocketDispatcher(flags));
     if (!ac.check())
@@ -183,8 +225,8 @@ status_t SocketDispatcher::Create(uint32_t flags,
     return NO_ERROR;
 }
 
-SocketDispatcher::SocketDispatcher(uint32_t /*flags*/)
-    : half_closed_{false, false} {
+SocketDispatcher::SocketDispatcher(uint32_t flags)
+    : flags_(flags), half_closed_{false, false} {
 
     state_tracker_.set_initial_signals_state(MX_SOCKET_WRITABLE);
 }
@@ -192,11 +234,42 @@ SocketDispatcher::SocketDispatcher(uint32_t /*flags*/)
 SocketDispatcher::~SocketDispatcher() {
 }
 
+SocketDispatcher::PageSegment::~PageSegment() {
+    if (!list_is_empty(&pages))
+        pmm_free(&pages);
+}
+
+bool SocketDispatcher::EmptyLocked() const {
+    return cbuf_.empty() && segments_.is_empty();
+}
+
+bool SocketDispatcher::FullLocked() const {
+    return cbuf_.free() == 0u || segment_bytes_ + PAGE_SIZE > cbuf_.size();
+}
+
 mx_status_t SocketDispatcher::Init(mxtl::RefPtr<SocketDispatcher> other) {
     other_ = mxtl::move(other);
     return cbuf_.Init(kDeFaultSocketBufferSize) ? NO_ERROR : ERR_NO_MEMORY;
 }
 
+uint32_t SocketDispatcher::GetBufferSize() {
+    AutoLock lock(&lock_);
+    return cbuf_.size();
+}
+
+status_t SocketDispatcher::SetBufferSize(uint32_t size) {
+    if (size < kMinSocketBufferSize || size > kMaxSocketBufferSize)
+        return ERR_OUT_OF_RANGE;
+    size = round_up_pow2_u32(size);
+
+    AutoLock lock(&lock_);
+    if (!EmptyLocked())
+        return ERR_BAD_STATE;
+    if (size == cbuf_.size())
+        return NO_ERROR;
+    return cbuf_.Init(size) ? NO_ERROR : ERR_NO_MEMORY;
+}
+
 void SocketDispatcher::on_zero_handles() {
     mxtl::RefPtr<SocketDispatcher> socket;
     {
@@ -262,7 +335,7 @@ status_t SocketDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client)
         AutoLock lock(&lock_);
         iopc_ = mxtl::move(client);
 
-        if (!cbuf_.empty())
+        if (!EmptyLocked())
             iopc_->Signal(MX_SOCKET_READABLE, 0u, &lock_);
     }
 
@@ -310,53 +383,419 @@ mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
                                         bool from_user, size_t* written) {
     AutoLock lock(&lock_);
 
+    if (flags_ & MX_SOCKET_DATAGRAM)
+        return WriteDatagramLocked(src, len, from_user, written);
+
     if (!cbuf_.free())
         return ERR_SHOULD_WAIT;
 
-    bool was_empty = cbuf_.empty();
+    bool was_empty = EmptyLocked();
 
     auto st = cbuf_.Write(src, len, from_user);
+    cbuf_written_ += st;
+    DidWriteStreamLocked(was_empty, st);
+
+    *written = st;
+    return NO_ERROR;
+}
 
-    if (st > 0) {
+void SocketDispatcher::DidWriteStreamLocked(bool was_empty, size_t nwritten) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (nwritten > 0) {
         if (was_empty)
             state_tracker_.UpdateState(0u, MX_SOCKET_READABLE);
         if (iopc_)
-            iopc_->Signal(MX_SOCKET_READABLE, st, &lock_);
+            iopc_->Signal(MX_SOCKET_READABLE, nwritten, &lock_);
     }
 
-    if (!cbuf_.free())
+    if (FullLocked())
         other_->state_tracker_.UpdateState(MX_SOCKET_WRITABLE, 0u);
+}
+
+mx_status_t SocketDispatcher::WriteFromVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                           size_t len, size_t* written) {
+    if (flags_ & MX_SOCKET_DATAGRAM)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_REMOTE_CLOSED;
+        if (half_closed_[0])
+            return ERR_BAD_STATE;
+        other = other_;
+    }
+
+    return other->WriteFromVmoSelf(mxtl::move(vmo), offset, len, written);
+}
+
+mx_status_t SocketDispatcher::WriteFromVmoSelf(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                               size_t len, size_t* written) {
+    AutoLock lock(&lock_);
+
+    if (!cbuf_.free())
+        return ERR_SHOULD_WAIT;
+
+    bool was_empty = EmptyLocked();
+
+    // the vmo copies its pages straight into the cbuf
+    uint64_t pos = offset;
+    mx_status_t status = NO_ERROR;
+    size_t st = cbuf_.Fill(len, [&vmo, &pos, &status](char* dest, size_t n) {
+        size_t copied = 0;
+        status = vmo->Read(dest, pos, n, &copied);
+        pos += copied;
+        return copied;
+    });
+    if (st == 0 && status != NO_ERROR)
+        return status;
+
+    cbuf_written_ += st;
+    DidWriteStreamLocked(was_empty, st);
 
     *written = st;
     return NO_ERROR;
 }
 
+mx_status_t SocketDispatcher::WritePages(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                         size_t len, size_t* written) {
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ERR_INVALID_ARGS;
+    if (flags_ & MX_SOCKET_DATAGRAM)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_REMOTE_CLOSED;
+        if (half_closed_[0])
+            return ERR_BAD_STATE;
+        other = other_;
+    }
+
+    return other->WritePagesSelf(mxtl::move(vmo), offset, len, written);
+}
+
+mx_status_t SocketDispatcher::WritePagesSelf(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                             size_t len, size_t* written) {
+    AutoLock lock(&lock_);
+
+    if (len == 0) {
+        *written = 0;
+        return NO_ERROR;
+    }
+
+    // donated pages may hold at most as much as the cbuf does
+    size_t room = ROUNDDOWN(cbuf_.size() - segment_bytes_, PAGE_SIZE);
+    len = MIN(len, room);
+    if (len == 0)
+        return ERR_SHOULD_WAIT;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<PageSegment> segment(new (&ac) PageSegment());
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    mx_status_t status = vmo->TakePages(offset, len, &segment->pages);
+    if (status != NO_ERROR)
+        return status;
+
+    bool was_empty = EmptyLocked();
+
+    segment->stream_pos = cbuf_written_;
+    segment->len = len;
+    segments_.push_back(mxtl::move(segment));
+    segment_bytes_ += len;
+    DidWriteStreamLocked(was_empty, len);
+
+    *written = len;
+    return NO_ERROR;
+}
+
+mx_status_t SocketDispatcher::WriteDatagramLocked(const void* src, size_t len,
+                                                  bool from_user, size_t* written) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // one byte of the buffer always stays empty
+    size_t needed = sizeof(datagram_header_t) + len;
+    if (needed > cbuf_.size() - 1u)
+        return ERR_OUT_OF_RANGE;
+
+    if (cbuf_.free() < needed) {
+        // the message won't fit until the reader makes room, so don't leave
+        // the writer spinning on WRITABLE in the meantime
+        other_->state_tracker_.UpdateState(MX_SOCKET_WRITABLE, 0u);
+        return ERR_SHOULD_WAIT;
+    }
+
+    bool was_empty = cbuf_.empty();
+
+    datagram_header_t header = static_cast<datagram_header_t>(len);
+    cbuf_.Write(&header, sizeof(header), false);
+    __UNUSED size_t st = cbuf_.Write(src, len, from_user);
+    DEBUG_ASSERT(st == len);
+
+    if (was_empty)
+        state_tracker_.UpdateState(0u, MX_SOCKET_READABLE);
+    if (iopc_)
+        iopc_->Signal(MX_SOCKET_READABLE, needed, &lock_);
+
+    if (cbuf_.free() <= sizeof(datagram_header_t))
+        other_->state_tracker_.UpdateState(MX_SOCKET_WRITABLE, 0u);
+
+    *written = len;
+    return NO_ERROR;
+}
+
+size_t SocketDispatcher::ReadDatagramLocked(void* dest, size_t len, bool from_user) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    datagram_header_t header;
+    __UNUSED size_t st = cbuf_.Read(&header, sizeof(header), false);
+    DEBUG_ASSERT(st == sizeof(header));
+
+    // whatever does not fit in the caller's buffer is dropped
+    size_t nread = MIN(len, static_cast<size_t>(header));
+    cbuf_.Read(dest, nread, from_user);
+    cbuf_.Read(nullptr, header - nread, false);
+    return nread;
+}
+
+template <typename F>
+size_t SocketDispatcher::DrainSegmentLocked(PageSegment* segment, size_t len, F drain) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    size_t pos = 0;
+    while (pos < len && segment->consumed < segment->len) {
+        vm_page_t* page = list_peek_head_type(&segment->pages, vm_page_t, free.node);
+        DEBUG_ASSERT(page);
+
+        size_t page_offset = segment->consumed % PAGE_SIZE;
+        size_t read_len = MIN(PAGE_SIZE - page_offset, len - pos);
+        const char* src = reinterpret_cast<const char*>(
+            paddr_to_kvaddr(vm_page_to_paddr(page))) + page_offset;
+
+        size_t drained = drain(src, read_len);
+
+        segment->consumed += drained;
+        pos += drained;
+
+        // give back each page as soon as it has been read
+        if (drained > 0 && IS_PAGE_ALIGNED(segment->consumed)) {
+            list_delete(&page->free.node);
+            pmm_free_page(page);
+        }
+        if (drained < read_len)
+            break;
+    }
+    return pos;
+}
+
+size_t SocketDispatcher::ReadSegmentLocked(PageSegment* segment, void* dest, size_t len,
+                                           bool from_user) {
+    char* ptr = reinterpret_cast<char*>(dest);
+    return DrainSegmentLocked(segment, len, [&ptr, from_user](const char* src, size_t n) {
+        if (from_user) {
+            // TODO: find a safer way to do this
+            user_ptr<void> uptr(ptr);
+            uptr.copy_array_to_user(src, n);
+        } else {
+            memcpy(ptr, src, n);
+        }
+        ptr += n;
+        return n;
+    });
+}
+
+template <typename C, typename S>
+size_t SocketDispatcher::ReadStreamWithLocked(size_t len, C read_cbuf, S read_segment) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    size_t pos = 0;
+    while (pos < len) {
+        PageSegment* segment = segments_.is_empty() ? nullptr : &segments_.front();
+
+        size_t st;
+        if (segment && segment->stream_pos == cbuf_read_) {
+            // the cbuf is drained up to where the segment was written
+            st = read_segment(segment, len - pos);
+            segment_bytes_ -= st;
+            if (segment->consumed == segment->len)
+                segments_.pop_front();
+        } else {
+            size_t avail = len - pos;
+            if (segment)
+                avail = MIN(avail, static_cast<size_t>(segment->stream_pos - cbuf_read_));
+            st = read_cbuf(avail);
+            cbuf_read_ += st;
+        }
+
+        if (st == 0)
+            break;
+        pos += st;
+    }
+    return pos;
+}
+
+size_t SocketDispatcher::ReadStreamLocked(void* dest, size_t len, bool from_user) {
+    char* ptr = reinterpret_cast<char*>(dest);
+    return ReadStreamWithLocked(len,
+        [this, &ptr, from_user](size_t n) {
+            size_t st = cbuf_.Read(ptr, n, from_user);
+            ptr += st;
+            return st;
+        },
+        [this, &ptr, from_user](PageSegment* segment, size_t n) {
+            size_t st = ReadSegmentLocked(segment, ptr, n, from_user);
+            ptr += st;
+            return st;
+        });
+}
+
+void SocketDispatcher::DidReadStreamLocked(bool was_full, size_t nread) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (EmptyLocked())
+        state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
+
+    bool closed = half_closed_[1] || !other_;
+    if (!closed && was_full && !FullLocked() && nread > 0)
+        other_->state_tracker_.UpdateState(0u, MX_SOCKET_WRITABLE);
+}
+
 mx_status_t SocketDispatcher::Read(void* dest, size_t len,
                                    bool from_user, size_t* nread) {
     AutoLock lock(&lock_);
 
-    // Just query for bytes outstanding.
+    bool datagram = (flags_ & MX_SOCKET_DATAGRAM) != 0;
+
+    // Just query for bytes outstanding, or the size of the next datagram.
     if (!dest && len == 0) {
-        *nread = cbuf_.CouldRead();
+        if (datagram) {
+            datagram_header_t header = 0;
+            if (!cbuf_.empty())
+                cbuf_.Peek(&header, sizeof(header));
+            *nread = header;
+        } else {
+            *nread = cbuf_.CouldRead() + segment_bytes_;
+        }
         return NO_ERROR;
     }
 
     bool closed = half_closed_[1] || !other_;
 
-    if (cbuf_.empty())
+    if (EmptyLocked())
         return closed ? ERR_REMOTE_CLOSED: ERR_SHOULD_WAIT;
 
-    bool was_full = cbuf_.free() == 0u;
+    bool was_full = FullLocked();
 
-    auto st = cbuf_.Read(dest, len, from_user);
+    size_t st;
+    if (datagram) {
+        // the writer may be waiting for room for a message of any size
+        was_full = true;
+        st = ReadDatagramLocked(dest, len, from_user);
+    } else {
+        st = ReadStreamLocked(dest, len, from_user);
+    }
 
-    if (cbuf_.empty()) {
+    if (EmptyLocked()) {
         state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
     }
 
-    if (!closed && was_full && (st > 0))
+    if (!closed && was_full && !FullLocked() && (datagram || (st > 0)))
         other_->state_tracker_.UpdateState(0u, MX_SOCKET_WRITABLE);
 
     *nread = static_cast<size_t>(st);
     return NO_ERROR;
 }
+
+mx_status_t SocketDispatcher::ReadToVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                                        size_t* nread) {
+    if (flags_ & MX_SOCKET_DATAGRAM)
+        return ERR_NOT_SUPPORTED;
+
+    AutoLock lock(&lock_);
+
+    if (EmptyLocked())
+        return (half_closed_[1] || !other_) ? ERR_REMOTE_CLOSED : ERR_SHOULD_WAIT;
+
+    bool was_full = FullLocked();
+
+    // the bytes are only consumed once the vmo has taken them, so running
+    // into its end loses nothing
+    uint64_t pos = offset;
+    mx_status_t status = NO_ERROR;
+    auto drain = [&vmo, &pos, &status](const char* src, size_t n) {
+        size_t copied = 0;
+        status = vmo->Write(src, pos, n, &copied);
+        pos += copied;
+        return copied;
+    };
+    size_t st = ReadStreamWithLocked(len,
+        [this, &drain](size_t n) { return cbuf_.Drain(n, drain); },
+        [this, &drain](PageSegment* segment, size_t n) {
+            return DrainSegmentLocked(segment, n, drain);
+        });
+    if (st == 0 && status != NO_ERROR)
+        return status;
+
+    DidReadStreamLocked(was_full, st);
+
+    *nread = st;
+    return NO_ERROR;
+}
+
+mx_status_t SocketDispatcher::Splice(mxtl::RefPtr<SocketDispatcher> dest, size_t len,
+                                     size_t* moved) {
+    if ((flags_ | dest->flags_) & MX_SOCKET_DATAGRAM)
+        return ERR_NOT_SUPPORTED;
+
+    // the bytes land in the cbuf of |dest|'s peer
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&dest->lock_);
+        if (!dest->other_)
+            return ERR_REMOTE_CLOSED;
+        if (dest->half_closed_[0])
+            return ERR_BAD_STATE;
+        other = dest->other_;
+    }
+    if (other.get() == this)
+        return ERR_INVALID_ARGS;
+
+    // Both locks are held so that no more is read than |other| can take.
+    // They are always taken in address order, so splices going opposite
+    // ways between the same sockets can't deadlock.
+    bool this_first = reinterpret_cast<uintptr_t>(this) <
+                      reinterpret_cast<uintptr_t>(other.get());
+    AutoLock lock0(this_first ? &lock_ : &other->lock_);
+    AutoLock lock1(this_first ? &other->lock_ : &lock_);
+
+    if (EmptyLocked())
+        return (half_closed_[1] || !other_) ? ERR_REMOTE_CLOSED : ERR_SHOULD_WAIT;
+    if (!other->cbuf_.free())
+        return ERR_SHOULD_WAIT;
+
+    bool was_full = FullLocked();
+    bool was_empty = other->EmptyLocked();
+
+    // copied once, from this socket's buffer or pages into the other cbuf
+    auto drain = [&other](const char* src, size_t n) {
+        return other->cbuf_.Write(src, n, false);
+    };
+    size_t st = ReadStreamWithLocked(len,
+        [this, &drain](size_t n) { return cbuf_.Drain(n, drain); },
+        [this, &drain](PageSegment* segment, size_t n) {
+            return DrainSegmentLocked(segment, n, drain);
+        });
+    other->cbuf_written_ += st;
+
+    DidReadStreamLocked(was_full, st);
+    other->DidWriteStreamLocked(was_empty, st);
+
+    *moved = st;
+    return NO_ERROR;
+}
@@ -17,7 +17,17 @@ void StateTracker::AddObserver(StateObserver* observer) {
         AutoLock lock(&lock_);
 
         observers_.push_front(observer);
-        awoke_threads = observer->OnInitialize(signals_);
+        // Setting the bit makes concurrent fast path updates fail their
+        // compare-exchange and retry under the lock, so the observer cannot
+        // miss a change made after it reads the initial state.
+        uint64_t state = __atomic_or_fetch(&state_, kHasObservers, __ATOMIC_SEQ_CST);
+        bool should_remove = false;
+        awoke_threads = observer->OnInitialize(static_cast<mx_signals_t>(state), &should_remove);
+        if (should_remove) {
+            observers_.erase(*observer);
+            observer->OnRemoved();
+            UpdateHasObserversLocked();
+        }
     }
     if (awoke_threads)
         thread_preempt(false);
@@ -27,6 +37,7 @@ void StateTracker::RemoveObserver(StateObserver* observer) {
     AutoLock lock(&lock_);
     DEBUG_ASSERT(observer != nullptr);
     observers_.erase(*observer);
+    UpdateHasObserversLocked();
 }
 
 void StateTracker::Cancel(Handle* handle) {
@@ -40,34 +51,80 @@ void StateTracker::Cancel(Handle* handle) {
             if (should_remove) {
                 auto to_remove = it;
                 ++it;
-                observers_.erase(to_remove);
+                observers_.erase(to_remove)->OnRemoved();
             } else {
                 ++it;
             }
         }
+        UpdateHasObserversLocked();
     }
 
     if (awoke_threads)
         thread_preempt(false);
 }
 
+bool StateTracker::ApplyMasks(mx_signals_t clear_mask, mx_signals_t set_mask, bool observers_ok,
+                              mx_signals_t* new_signals, bool* done) {
+    uint64_t state = __atomic_load_n(&state_, __ATOMIC_ACQUIRE);
+    for (;;) {
+        auto previous_signals = static_cast<mx_signals_t>(state);
+        auto signals = static_cast<mx_signals_t>((previous_signals & ~clear_mask) | set_mask);
+        if (signals == previous_signals) {
+            *done = true;
+            return false;
+        }
+        if (!observers_ok && (state & kHasObservers)) {
+            *done = false;
+            return false;
+        }
+
+        uint64_t new_state = (state & kHasObservers) | signals;
+        if (__atomic_compare_exchange_n(&state_, &state, new_state, true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+            *new_signals = signals;
+            *done = true;
+            return true;
+        }
+    }
+}
+
+void StateTracker::UpdateHasObserversLocked() {
+    DEBUG_ASSERT(lock_.IsHeld());
+    if (observers_.is_empty())
+        __atomic_and_fetch(&state_, ~kHasObservers, __ATOMIC_SEQ_CST);
+}
+
 void StateTracker::UpdateState(mx_signals_t clear_mask,
                                mx_signals_t set_mask) {
+    // Without observers there is nobody to notify, so don't take the lock.
+    mx_signals_t signals;
+    bool done;
+    ApplyMasks(clear_mask, set_mask, false, &signals, &done);
+    if (done)
+        return;
+
     bool awoke_threads = false;
 
     {
         AutoLock lock(&lock_);
 
-        auto previous_signals = signals_;
-        signals_ &= ~clear_mask;
-        signals_ |= set_mask;
-
-        if (previous_signals == signals_)
+        // The last observer may have gone away meanwhile, in which case
+        // others can be racing with us on the fast path.
+        if (!ApplyMasks(clear_mask, set_mask, true, &signals, &done))
             return;
 
-        for (auto& observer : observers_) {
-            awoke_threads = observer.OnStateChange(signals_) || awoke_threads;
+        for (auto it = observers_.begin(); it != observers_.end();) {
+            bool should_remove = false;
+            awoke_threads = it->OnStateChange(signals, &should_remove) || awoke_threads;
+            if (should_remove) {
+                auto to_remove = it;
+                ++it;
+                observers_.erase(to_remove)->OnRemoved();
+            } else {
+                ++it;
+            }
         }
+        UpdateHasObserversLocked();
     }
 
     if (awoke_threads) {
@@ -26,6 +26,7 @@
 #include <magenta/c_user_thread.h>
 #include <magenta/exception.h>
 #include <magenta/excp_port.h>
+#include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/debug.h>
@@ -118,6 +119,9 @@ status_t UserThread::Initialize(const char* name, size_t len) {
     // associate the proc's address space with this thread
     process_->aspace()->AttachToThread(lkthread);
 
+    // and hold it to its job's cpu limits
+    process_->job()->SetUpThread(lkthread);
+
     // we've entered the initialized state
     SetState(State::INITIALIZED);
 
@@ -139,6 +143,16 @@ void UserThread::get_name(char out_name[MX_MAX_NAME_LEN]) {
     memcpy(out_name, thread_.name, MX_MAX_NAME_LEN);
 }
 
+void UserThread::GetRuntimeInfo(mx_info_task_runtime_t* info) {
+    thread_runtime_t rt;
+    thread_get_runtime(&thread_, &rt);
+    info->cpu_time = rt.cpu_time;
+    info->queue_time = rt.queue_time;
+    info->voluntary_switches = rt.voluntary_switches;
+    info->involuntary_switches = rt.involuntary_switches;
+    info->migrations = rt.migrations;
+}
+
 // start a thread
 status_t UserThread::Start(uintptr_t entry, uintptr_t sp,
                            uintptr_t arg1, uintptr_t arg2,
@@ -63,6 +63,17 @@ mx_status_t VmObjectDispatcher::GetSize(uint64_t* size) {
     return NO_ERROR;
 }
 
+mx_status_t VmObjectDispatcher::Clone(uint32_t options, uint64_t offset, uint64_t size,
+                                      mxtl::RefPtr<VmObject>* clone_vmo) {
+    LTRACEF("options %#x offset %#" PRIx64 " size %#" PRIx64 "\n", options, offset, size);
+
+    // copy-on-write is the only kind of clone there is for now
+    if (options != MX_VMO_CLONE_COPY_ON_WRITE)
+        return ERR_INVALID_ARGS;
+
+    return vmo_->CloneCOW(offset, size, clone_vmo);
+}
+
 mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t size,
                                         user_ptr<void> buffer, size_t buffer_size, mx_rights_t rights) {
     LTRACEF("op %u offset %#" PRIx64 " size %#" PRIx64
@@ -78,14 +89,41 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             return status;
         }
         case MX_VMO_OP_DECOMMIT: {
+            // throwing pages away changes the contents
+            if ((rights & MX_RIGHT_WRITE) == 0)
+                return ERR_ACCESS_DENIED;
             // TODO: handle partial decommits
             auto status = vmo_->DecommitRange(offset, size, nullptr);
             return status;
         }
-        case MX_VMO_OP_LOCK:
+        case MX_VMO_OP_LOCK: {
+            // purgeable objects are locked and unlocked as a whole
+            if (offset != 0 || size < vmo_->size())
+                return ERR_INVALID_ARGS;
+
+            // optionally report whether the contents were purged
+            if (buffer && buffer_size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+
+            bool was_purged;
+            auto status = vmo_->LockPurgeable(&was_purged);
+            if (status != NO_ERROR)
+                return status;
+
+            if (buffer) {
+                uint32_t state = was_purged ? MX_VMO_LOCK_PURGED : MX_VMO_LOCK_RETAINED;
+                if (buffer.reinterpret<uint32_t>().copy_to_user(state) != NO_ERROR) {
+                    vmo_->UnlockPurgeable();
+                    return ERR_INVALID_ARGS;
+                }
+            }
+            return NO_ERROR;
+        }
         case MX_VMO_OP_UNLOCK:
-            // TODO: handle
-            return ERR_NOT_SUPPORTED;
+            if (offset != 0 || size < vmo_->size())
+                return ERR_INVALID_ARGS;
+
+            return vmo_->UnlockPurgeable();
         case MX_VMO_OP_LOOKUP:
             // we will be using the user pointer
             if (!buffer)
@@ -98,6 +136,13 @@ mx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
         case MX_VMO_OP_CACHE_SYNC:
             // TODO: handle
             return ERR_NOT_SUPPORTED;
+        case MX_VMO_OP_WILLNEED:
+            return vmo_->PrefetchRange(offset, size);
+        case MX_VMO_OP_DONTNEED:
+            // pages given up only come back if their pager is still around
+            if ((rights & MX_RIGHT_WRITE) == 0)
+                return ERR_ACCESS_DENIED;
+            return vmo_->DontNeedRange(offset, size);
         default:
             return ERR_INVALID_ARGS;
     }
@@ -122,6 +167,15 @@ mx_status_t VmObjectDispatcher::Map(mxtl::RefPtr<VmAspace> aspace, uint32_t vmo_
         // TODO: test against right
         vmm_flags |= VMM_FLAG_VALLOC_BASE;
     }
+    if (flags & MX_VM_FLAG_FAULT_AROUND) {
+        vmm_flags |= VMM_FLAG_FAULT_AROUND;
+    }
+    if (flags & MX_VM_FLAG_LARGE_PAGES) {
+        vmm_flags |= VMM_FLAG_LARGE_PAGES;
+    }
+    if (flags & MX_VM_FLAG_COMMIT) {
+        vmm_flags |= VMM_FLAG_COMMIT;
+    }
 
     // convert MX level mapping flags to internal VM flags
     uint arch_mmu_flags = ARCH_MMU_FLAG_PERM_USER;
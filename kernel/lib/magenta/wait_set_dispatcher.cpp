@@ -90,7 +90,7 @@ mx_signals_t WaitSetDispatcher::Entry::GetSignalsState_NoLock() const {
 WaitSetDispatcher::Entry::Entry(mx_signals_t watched_signals, uint64_t cookie)
     : StateObserver(), watched_signals_(watched_signals), cookie_(cookie) {}
 
-bool WaitSetDispatcher::Entry::OnInitialize(mx_signals_t initial_state) {
+bool WaitSetDispatcher::Entry::OnInitialize(mx_signals_t initial_state, bool* should_remove) {
     AutoLock lock(&wait_set_->mutex_);
 
     DEBUG_ASSERT(state_ == State::ADD_PENDING);
@@ -104,7 +104,7 @@ bool WaitSetDispatcher::Entry::OnInitialize(mx_signals_t initial_state) {
     return false;
 }
 
-bool WaitSetDispatcher::Entry::OnStateChange(mx_signals_t new_state) {
+bool WaitSetDispatcher::Entry::OnStateChange(mx_signals_t new_state, bool* should_remove) {
     AutoLock lock(&wait_set_->mutex_);
 
     if (state_ == State::REMOVED)
@@ -351,9 +351,9 @@ WaitSetDispatcher::WaitSetDispatcher()
     state_tracker_.AddObserver(this);
 }
 
-bool WaitSetDispatcher::OnInitialize(mx_signals_t initial_state) { return false; }
+bool WaitSetDispatcher::OnInitialize(mx_signals_t initial_state, bool* should_remove) { return false; }
 
-bool WaitSetDispatcher::OnStateChange(mx_signals_t new_state) { return false; }
+bool WaitSetDispatcher::OnStateChange(mx_signals_t new_state, bool* should_remove) { return false; }
 
 bool WaitSetDispatcher::OnCancel(Handle* handle, bool* should_remove) {
     AutoLock lock(&mutex_);
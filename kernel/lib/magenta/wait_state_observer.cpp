@@ -54,7 +54,7 @@ mx_signals_t WaitStateObserver::End() {
     return wakeup_reasons_;
 }
 
-bool WaitStateObserver::OnInitialize(mx_signals_t initial_state) {
+bool WaitStateObserver::OnInitialize(mx_signals_t initial_state, bool* should_remove) {
     // Record the initial state of the state tracker as our wakeup reason.  If
     // we are going to become immediately signaled, the reason is contained
     // somewhere in this initial state.
@@ -62,7 +62,7 @@ bool WaitStateObserver::OnInitialize(mx_signals_t initial_state) {
     return MaybeSignal(initial_state);
 }
 
-bool WaitStateObserver::OnStateChange(mx_signals_t new_state) {
+bool WaitStateObserver::OnStateChange(mx_signals_t new_state, bool* should_remove) {
     // If we are still on our StateTracker's list of observers, and the
     // StateTracker's state has changed, accumulate the reasons that we may have
     // woken up.  In particular any satisfied bits which have become set
@@ -65,6 +65,44 @@ static bool arena_test(void* context)
     END_TEST;
 }
 
+static bool cpu_cached_arena_test(void* context)
+{
+    arena_dtor_count = 0;
+    BEGIN_TEST;
+    // Fewer slots than the cpu magazines can hold between them, so running
+    // out forces the cached slots back into the arena.
+    const int count = 40;
+    mxtl::CpuCachedTypedArena<ArenaFoo, 8> arena;
+    arena.Init("cached_arena_tests", count);
+
+    for (int times = 0; times != 5; ++times) {
+        ArenaFoo* afp[count] = {0};
+
+        for (int ix = 0; ix != count; ++ix) {
+            afp[ix] = arena.New(17, 5, ix + 100);
+            EXPECT_TRUE(afp[ix] != nullptr, "");
+            EXPECT_TRUE(arena.in_range(afp[ix]), "");
+        }
+
+        // The arena is full.
+        EXPECT_TRUE(arena.New(1, 2, 3) == nullptr, "");
+
+        for (int ix = 0; ix != count; ++ix) {
+            if (!afp[ix]) continue;
+
+            EXPECT_EQ(17, afp[ix]->xx, "");
+            EXPECT_EQ(5, afp[ix]->yy, "");
+            EXPECT_EQ(ix + 100, afp[ix]->zz, "");
+
+            arena.Delete(afp[ix]);
+        }
+
+        EXPECT_EQ(count * (times + 1), arena_dtor_count, "");
+    }
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(arena_tests)
 UNITTEST("Arena allocator test", arena_test)
+UNITTEST("Cpu cached arena test", cpu_cached_arena_test)
 UNITTEST_END_TESTCASE(arena_tests, "arenatests", "Arena allocator test", NULL, NULL);
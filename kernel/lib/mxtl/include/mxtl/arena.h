@@ -6,12 +6,17 @@
 
 #pragma once
 
+#include <arch/ops.h>
 #include <new.h>
 #include <stddef.h>
+#include <string.h>
 
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_object.h>
 
+#include <mxtl/auto_lock.h>
 #include <mxtl/intrusive_single_list.h>
+#include <mxtl/mutex.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/type_support.h>
 
@@ -34,9 +39,12 @@ public:
     status_t Init(const char* name, size_t ob_size, size_t max_count);
     void* Alloc();
     void Free(void* addr);
+    // Safe to call without whatever lock serializes Alloc(); |d_top_| only
+    // ever grows.
     bool in_range(void* addr) const {
+        char* top = __atomic_load_n(&d_top_, __ATOMIC_ACQUIRE);
         return ((addr >= static_cast<void*>(d_start_)) &&
-                (addr < static_cast<void*>(d_top_)));
+                (addr < static_cast<void*>(top)));
     }
 
     void* start() const { return d_start_; }
@@ -98,4 +106,142 @@ public:
 private:
     Arena arena_;
 };
+
+// CpuCachedTypedArena is a TypedArena which is safe to use from many threads
+// at once. Freed slots go into a small magazine on the current cpu and are
+// handed back out from there, so New() and Delete() only take the arena lock
+// to refill an empty magazine or drain a full one, kMagazineSize / 2 slots at
+// a time. Slots keep their position in the arena, so offsets from start()
+// remain stable identifiers.
+//
+// Slots sitting in the magazines still count against max_count; when the
+// arena runs out they are pulled back before giving up.
+template <typename T, size_t kMagazineSize = 32>
+class CpuCachedTypedArena {
+public:
+    status_t Init(const char* name, size_t max_count) {
+        AutoLock al(lock_);
+        return arena_.Init(name, sizeof(T), max_count);
+    }
+
+    template <typename... Args>
+    T* New(Args&&... args) {
+        void* addr = Alloc();
+        return addr ? new (addr) T(mxtl::forward<Args>(args)...) : nullptr;
+    };
+
+    void Delete(T* obj) {
+        obj->~T();
+        RawFree(obj);
+    }
+
+    void RawFree(void* mem) {
+        if (!mem) return;
+
+        void* batch[kBatch];
+        size_t count = 0;
+
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        Magazine* mag = &magazines_[arch_curr_cpu_num()];
+        spin_lock(&mag->lock);
+        if (mag->count == kMagazineSize) {
+            // full, push the older half back to the arena
+            count = kBatch;
+            memcpy(batch, mag->slots, sizeof(batch));
+            memmove(&mag->slots[0], &mag->slots[kBatch],
+                    (kMagazineSize - kBatch) * sizeof(mag->slots[0]));
+            mag->count -= kBatch;
+        }
+        mag->slots[mag->count++] = mem;
+        spin_unlock(&mag->lock);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (count > 0) {
+            AutoLock al(lock_);
+            for (size_t i = 0; i < count; i++)
+                arena_.Free(batch[i]);
+        }
+    }
+
+    // Doesn't take the arena lock, so it may be used for lockless lookups.
+    bool in_range(void* obj) const { return arena_.in_range(obj); }
+
+    void* start() const { return arena_.start(); }
+    void* end() const { return arena_.end(); }
+
+private:
+    static_assert(kMagazineSize >= 2, "");
+    static constexpr size_t kBatch = kMagazineSize / 2;
+
+    struct Magazine {
+        spin_lock_t lock;
+        size_t count;
+        void* slots[kMagazineSize];
+    } __CPU_ALIGN;
+
+    void* Alloc() {
+        spin_lock_saved_state_t state;
+        void* slot = nullptr;
+
+        // disable interrupts before picking the magazine so we can't migrate away from it
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        Magazine* mag = &magazines_[arch_curr_cpu_num()];
+        spin_lock(&mag->lock);
+        if (mag->count > 0)
+            slot = mag->slots[--mag->count];
+        spin_unlock(&mag->lock);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        if (slot)
+            return slot;
+
+        void* batch[kBatch];
+        size_t count = 0;
+        {
+            AutoLock al(lock_);
+            while (count < kBatch && (batch[count] = arena_.Alloc()) != nullptr)
+                count++;
+            if (count == 0) {
+                // out of slots; take back whatever the other cpus are holding
+                DrainLocked();
+                if ((batch[0] = arena_.Alloc()) == nullptr)
+                    return nullptr;
+                count = 1;
+            }
+        }
+        slot = batch[--count];
+
+        // we may be on a different cpu by now, which is fine
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        mag = &magazines_[arch_curr_cpu_num()];
+        spin_lock(&mag->lock);
+        while (count > 0 && mag->count < kMagazineSize)
+            mag->slots[mag->count++] = batch[--count];
+        spin_unlock(&mag->lock);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (count > 0) {
+            AutoLock al(lock_);
+            while (count > 0)
+                arena_.Free(batch[--count]);
+        }
+        return slot;
+    }
+
+    void DrainLocked() {
+        DEBUG_ASSERT(lock_.IsHeld());
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            Magazine* mag = &magazines_[cpu];
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&mag->lock, state);
+            while (mag->count > 0)
+                arena_.Free(mag->slots[--mag->count]);
+            spin_unlock_irqrestore(&mag->lock, state);
+        }
+    }
+
+    mxtl::Mutex lock_;
+    Arena arena_;
+    Magazine magazines_[SMP_MAX_CPUS] = {};
+};
 }
@@ -0,0 +1,124 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <assert.h>
+#include <kernel/spinlock.h>
+#include <new.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <mxtl/mutex.h>
+
+namespace mxtl {
+
+// ObjectCache is an allocator for objects of a single type, backed by
+// page-sized slabs. Objects are padded out to a multiple of the cache line so
+// that neighbours never share one.
+//
+// Each cpu keeps a magazine of recently freed objects which Alloc() and Free()
+// go to first, so creating and destroying short lived objects usually only
+// touches cpu local state. Magazines are refilled from or drained to the
+// shared free list kBatch objects at a time under the cache's mutex.
+//
+// Slabs are never returned to the system; the cache only grows to the high
+// water mark of the type. The constructor is constexpr so that caches can be
+// constant initialized globals, usable before global constructors run.
+class ObjectCache {
+public:
+    // Largest object a cache will hold; a slab always fits at least eight.
+    static constexpr size_t kMaxObjectSize = PAGE_SIZE / 8;
+
+    constexpr ObjectCache(const char* (*name)(), size_t ob_size, size_t alignment)
+        : name_(name),
+          ob_size_(RoundObjectSize(ob_size, alignment)) {}
+
+    ObjectCache(const ObjectCache&) = delete;
+    ObjectCache& operator=(const ObjectCache&) = delete;
+
+    void* Alloc();
+    void Free(void* obj);
+
+    // Moves every object cached on the cpus back to the shared free list.
+    void Drain();
+
+    const char* name() const { return name_(); }
+    size_t object_size() const { return ob_size_; }
+
+    // Prints the state of every cache that has allocated a slab.
+    static void DumpAll();
+
+private:
+    static constexpr size_t kMagazineSize = 16;
+    static constexpr size_t kBatch = kMagazineSize / 2;
+
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    struct Magazine {
+        spin_lock_t lock;
+        size_t count;
+        void* objects[kMagazineSize];
+    } __CPU_ALIGN;
+
+    static constexpr size_t RoundObjectSize(size_t size, size_t alignment) {
+        return ROUNDUP(size < sizeof(FreeObject) ? sizeof(FreeObject) : size,
+                       alignment > CACHE_LINE ? alignment : CACHE_LINE);
+    }
+
+    // Fills |objects| with up to |count| objects from the shared free list,
+    // growing the cache by a slab if needed. Returns how many it got.
+    size_t AllocBatch(void** objects, size_t count);
+    void FreeBatch(void* const* objects, size_t count);
+    status_t GrowLocked();
+
+    const char* (*const name_)();
+    const size_t ob_size_;
+
+    mxtl::Mutex lock_;
+    FreeObject* free_list_ = nullptr;
+    size_t slab_count_ = 0;
+    size_t free_count_ = 0;
+    ObjectCache* next_cache_ = nullptr;
+
+    Magazine magazines_[SMP_MAX_CPUS] = {};
+};
+
+// Deriving from ObjectCacheAllocated<T> makes new (&ac) T(...) and delete
+// of a T go through an ObjectCache of its own rather than the general heap.
+// Only the exact type T may be allocated this way, so it should be final.
+template <typename T>
+class ObjectCacheAllocated {
+public:
+    static void* operator new(size_t size, AllocChecker* ac) noexcept {
+        static_assert(sizeof(T) <= ObjectCache::kMaxObjectSize, "type too big for an ObjectCache");
+        DEBUG_ASSERT(size == sizeof(T));
+        void* obj = cache_.Alloc();
+        ac->arm(size, obj != nullptr);
+        return obj;
+    }
+
+    static void operator delete(void* obj) {
+        cache_.Free(obj);
+    }
+
+    static ObjectCache& object_cache() { return cache_; }
+
+private:
+    static const char* CacheName() { return __PRETTY_FUNCTION__; }
+
+    static ObjectCache cache_;
+};
+
+template <typename T>
+ObjectCache ObjectCacheAllocated<T>::cache_(&ObjectCacheAllocated<T>::CacheName,
+                                            sizeof(T), alignof(T));
+
+} // namespace mxtl
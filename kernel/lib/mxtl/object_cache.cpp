@@ -0,0 +1,190 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <mxtl/object_cache.h>
+
+#include <err.h>
+#include <kernel/vm.h>
+#include <lib/console.h>
+#include <lib/page_alloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <trace.h>
+
+#include <mxtl/auto_lock.h>
+
+#define LOCAL_TRACE 0
+
+namespace mxtl {
+
+// Every cache that has allocated a slab, for DumpAll().
+static mxtl::Mutex cache_list_lock;
+static ObjectCache* cache_list;
+
+void* ObjectCache::Alloc() {
+    spin_lock_saved_state_t state;
+    void* obj = nullptr;
+
+    // disable interrupts before picking the magazine so we can't migrate away from it
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    Magazine* mag = &magazines_[arch_curr_cpu_num()];
+    spin_lock(&mag->lock);
+    if (mag->count > 0)
+        obj = mag->objects[--mag->count];
+    spin_unlock(&mag->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    if (obj)
+        return obj;
+
+    void* batch[kBatch];
+    size_t count = AllocBatch(batch, kBatch);
+    if (count == 0)
+        return nullptr;
+    obj = batch[--count];
+
+    // we may be on a different cpu by now, which is fine
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    mag = &magazines_[arch_curr_cpu_num()];
+    spin_lock(&mag->lock);
+    while (count > 0 && mag->count < kMagazineSize)
+        mag->objects[mag->count++] = batch[--count];
+    spin_unlock(&mag->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    FreeBatch(batch, count);
+    return obj;
+}
+
+void ObjectCache::Free(void* obj) {
+    if (!obj)
+        return;
+    DEBUG_ASSERT(IS_ALIGNED(obj, CACHE_LINE));
+
+    void* batch[kBatch];
+    size_t count = 0;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    Magazine* mag = &magazines_[arch_curr_cpu_num()];
+    spin_lock(&mag->lock);
+    if (mag->count == kMagazineSize) {
+        // full, push the older half back to the shared free list
+        count = kBatch;
+        memcpy(batch, mag->objects, sizeof(batch));
+        memmove(&mag->objects[0], &mag->objects[kBatch],
+                (kMagazineSize - kBatch) * sizeof(mag->objects[0]));
+        mag->count -= kBatch;
+    }
+    mag->objects[mag->count++] = obj;
+    spin_unlock(&mag->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    FreeBatch(batch, count);
+}
+
+void ObjectCache::Drain() {
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        void* batch[kMagazineSize];
+        size_t count;
+
+        Magazine* mag = &magazines_[cpu];
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&mag->lock, state);
+        count = mag->count;
+        memcpy(batch, mag->objects, count * sizeof(batch[0]));
+        mag->count = 0;
+        spin_unlock_irqrestore(&mag->lock, state);
+
+        FreeBatch(batch, count);
+    }
+}
+
+size_t ObjectCache::AllocBatch(void** objects, size_t count) {
+    bool first_slab;
+    size_t allocated = 0;
+    {
+        AutoLock al(lock_);
+        first_slab = (slab_count_ == 0);
+        // only grow for the first object; we don't add slabs just to stock a magazine
+        if (!free_list_ && GrowLocked() != NO_ERROR)
+            return 0;
+        while (allocated < count && free_list_) {
+            FreeObject* obj = free_list_;
+            free_list_ = obj->next;
+            objects[allocated++] = obj;
+        }
+        free_count_ -= allocated;
+        first_slab = first_slab && (slab_count_ > 0);
+    }
+
+    if (first_slab) {
+        AutoLock al(cache_list_lock);
+        next_cache_ = cache_list;
+        cache_list = this;
+    }
+    return allocated;
+}
+
+void ObjectCache::FreeBatch(void* const* objects, size_t count) {
+    if (count == 0)
+        return;
+
+    AutoLock al(lock_);
+    for (size_t i = 0; i < count; i++) {
+        FreeObject* obj = static_cast<FreeObject*>(objects[i]);
+        obj->next = free_list_;
+        free_list_ = obj;
+    }
+    free_count_ += count;
+}
+
+status_t ObjectCache::GrowLocked() {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    char* slab = static_cast<char*>(page_alloc(1));
+    if (!slab)
+        return ERR_NO_MEMORY;
+
+    LTRACEF("cache %s: new slab %p, object size %zu\n", name(), slab, ob_size_);
+
+    size_t per_slab = PAGE_SIZE / ob_size_;
+    for (size_t i = per_slab; i > 0; i--) {
+        FreeObject* obj = reinterpret_cast<FreeObject*>(slab + (i - 1) * ob_size_);
+        obj->next = free_list_;
+        free_list_ = obj;
+    }
+    free_count_ += per_slab;
+    slab_count_++;
+    return NO_ERROR;
+}
+
+void ObjectCache::DumpAll() {
+    AutoLock al(cache_list_lock);
+    for (ObjectCache* cache = cache_list; cache; cache = cache->next_cache_) {
+        size_t cached = 0;
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+            cached += cache->magazines_[cpu].count;
+
+        AutoLock cache_al(cache->lock_);
+        size_t total = cache->slab_count_ * (PAGE_SIZE / cache->ob_size_);
+        printf("%s\n\tobject size %zu, slabs %zu, in use %zu, free %zu, in magazines %zu\n",
+               cache->name(), cache->ob_size_, cache->slab_count_,
+               total - cache->free_count_ - cached, cache->free_count_, cached);
+    }
+}
+
+} // namespace mxtl
+
+static int cmd_object_cache(int argc, const cmd_args* argv) {
+    mxtl::ObjectCache::DumpAll();
+    return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+#if LK_DEBUGLEVEL > 0
+STATIC_COMMAND("object_cache", "dump kernel object caches", &cmd_object_cache)
+#endif
+STATIC_COMMAND_END(object_cache);
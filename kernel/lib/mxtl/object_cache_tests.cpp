@@ -0,0 +1,64 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <app/tests.h>
+#include <unittest.h>
+
+#include <mxtl/object_cache.h>
+
+static int cached_dtor_count;
+
+struct CachedFoo final : public mxtl::ObjectCacheAllocated<CachedFoo> {
+    char ff;
+    int xx, yy, zz;
+
+    CachedFoo(int x, int y, int z) : ff(0), xx(x), yy(y), zz(z) {}
+    ~CachedFoo() { ++cached_dtor_count; }
+};
+
+static bool object_cache_test(void* context)
+{
+    BEGIN_TEST;
+    cached_dtor_count = 0;
+
+    auto& cache = CachedFoo::object_cache();
+    EXPECT_EQ(0u, cache.object_size() % CACHE_LINE, "object size not cache line padded");
+    EXPECT_LE(sizeof(CachedFoo), cache.object_size(), "object size too small");
+
+    // Enough objects to overflow a magazine and need more than one slab.
+    const int count = PAGE_SIZE / CACHE_LINE + 50;
+    CachedFoo* objs[count] = {};
+
+    for (int times = 0; times != 3; ++times) {
+        for (int ix = 0; ix != count; ++ix) {
+            AllocChecker ac;
+            objs[ix] = new (&ac) CachedFoo(17, 5, ix + 100);
+            EXPECT_TRUE(ac.check(), "");
+            EXPECT_TRUE(IS_ALIGNED(objs[ix], CACHE_LINE), "object not cache line aligned");
+        }
+
+        for (int ix = 0; ix != count; ++ix) {
+            EXPECT_EQ(17, objs[ix]->xx, "");
+            EXPECT_EQ(5, objs[ix]->yy, "");
+            EXPECT_EQ(ix + 100, objs[ix]->zz, "");
+            for (int jx = ix + 1; jx != count; ++jx)
+                EXPECT_NEQ(objs[ix], objs[jx], "object handed out twice");
+        }
+
+        for (int ix = 0; ix != count; ++ix)
+            delete objs[ix];
+
+        EXPECT_EQ(count * (times + 1), cached_dtor_count, "");
+    }
+
+    cache.Drain();
+
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(object_cache_tests)
+UNITTEST("Object cache test", object_cache_test)
+UNITTEST_END_TESTCASE(object_cache_tests, "objcachetests", "Object cache tests", NULL, NULL);
@@ -0,0 +1,59 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <magenta/compiler.h>
+#include <platform.h>
+
+__BEGIN_CDECLS
+
+/* Per-syscall call counts and latency histograms. Collection is off unless
+ * turned on with kernel.syscall-stats=true or the "syscalls" console
+ * command. Each cpu keeps its own counters, so a call only costs a couple of
+ * timestamps and a few stores; while collection is off it costs one load. */
+
+/* latency[i] counts calls that took [2^(i+7), 2^(i+8)) ns, except that the
+ * first and last buckets are open ended */
+#define SYSCALL_STATS_BUCKETS 16
+
+struct syscall_stats {
+    const char* name;
+    uint32_t num;
+    uint64_t count;
+    lk_bigtime_t total_time;
+    uint64_t latency[SYSCALL_STATS_BUCKETS];
+};
+
+/* turning collection on for the first time allocates the counters */
+status_t syscall_stats_enable(bool enable);
+void syscall_stats_reset(void);
+
+/* fills in up to count syscalls, summed over all cpus, and returns the total
+ * number of syscalls, or ERR_NOT_SUPPORTED if collection was never on */
+ssize_t syscall_stats_get(struct syscall_stats* stats, size_t count);
+
+/* writes a TAG_SYSCALL_STATS ktrace record for each syscall that was called */
+void syscall_stats_ktrace(void);
+
+/* Called by the syscall dispatcher around each call. begin() returns 0 when
+ * collection is off, and end() ignores such calls. */
+extern bool syscall_stats_on;
+
+static inline lk_bigtime_t syscall_stats_begin(void) {
+    if (likely(!__atomic_load_n(&syscall_stats_on, __ATOMIC_RELAXED)))
+        return 0;
+    return current_time_hires();
+}
+
+void syscall_stats_end(uint32_t index, lk_bigtime_t start);
+
+__END_CDECLS
@@ -11,6 +11,7 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_DEPS := \
     lib/console \
+    lib/counters \
     lib/crypto \
     lib/magenta \
     lib/user_copy \
@@ -28,6 +29,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/syscalls_object.cpp \
     $(LOCAL_DIR)/syscalls_port.cpp \
     $(LOCAL_DIR)/syscalls_resource.cpp \
+    $(LOCAL_DIR)/syscalls_stats.cpp \
     $(LOCAL_DIR)/syscalls_task.cpp \
     $(LOCAL_DIR)/syscalls_test.cpp \
     $(LOCAL_DIR)/syscalls_vmo.cpp \
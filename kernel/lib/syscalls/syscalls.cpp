@@ -7,6 +7,7 @@
 #include <err.h>
 
 #include <lib/ktrace.h>
+#include <lib/syscall_stats.h>
 #include <lib/user_copy.h>
 
 #include <magenta/magenta.h>
@@ -61,20 +62,27 @@ extern "C" void arm_syscall_handler(struct arm_fault_frame* frame) {
      * uses them or not, which is safe for simple arg passing.
      */
     syscall_func sfunc;
+    uint32_t stats_index;
 
     switch (syscall_num) {
 #define MAGENTA_SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...)                               \
     case n:                                                                                        \
         sfunc = reinterpret_cast<syscall_func>(sys_##name);                                        \
+        stats_index = kSyscallIndex_##name;                                                        \
         break;
 #include <magenta/syscalls.inc>
         default:
             sfunc = reinterpret_cast<syscall_func>(sys_invalid_syscall);
+            stats_index = kSyscallCount;
     }
 
     /* call the routine */
-    ret = sfunc(frame->r[0], frame->r[1], frame->r[2], frame->r[3], frame->r[4],
-                         frame->r[5], frame->r[6], frame->r[7]);
+    {
+        lk_bigtime_t stats_start = syscall_stats_begin();
+        ret = sfunc(frame->r[0], frame->r[1], frame->r[2], frame->r[3], frame->r[4],
+                    frame->r[5], frame->r[6], frame->r[7]);
+        syscall_stats_end(stats_index, stats_start);
+    }
 
     LTRACEF_LEVEL(2, "ret 0x%llx\n", ret);
 
@@ -117,20 +125,25 @@ extern "C" void arm64_syscall(struct arm64_iframe_long* frame, bool is_64bit, ui
      * uses them or not, which is safe for simple arg passing.
      */
     syscall_func sfunc;
+    uint32_t stats_index;
 
     switch (syscall_num) {
 #define MAGENTA_SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...)                               \
     case n:                                                                                        \
         sfunc = reinterpret_cast<syscall_func>(sys_##name);                                        \
+        stats_index = kSyscallIndex_##name;                                                        \
         break;
 #include <magenta/syscalls.inc>
         default:
             sfunc = reinterpret_cast<syscall_func>(sys_invalid_syscall);
+            stats_index = kSyscallCount;
     }
 
     /* call the routine */
+    lk_bigtime_t stats_start = syscall_stats_begin();
     uint64_t ret = sfunc(frame->r[0], frame->r[1], frame->r[2], frame->r[3], frame->r[4],
                          frame->r[5], frame->r[6], frame->r[7]);
+    syscall_stats_end(stats_index, stats_start);
 
     LTRACEF_LEVEL(2, "ret %#" PRIx64 "\n", ret);
 
@@ -179,19 +192,24 @@ uint64_t x86_64_syscall(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t ar
      * uses them or not, which is safe for simple arg passing.
      */
     syscall_func sfunc;
+    uint32_t stats_index;
 
     switch (syscall_num) {
 #define MAGENTA_SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...)                               \
     case n:                                                                                        \
         sfunc = reinterpret_cast<syscall_func>(sys_##name);                                        \
+        stats_index = kSyscallIndex_##name;                                                        \
         break;
 #include <magenta/syscalls.inc>
         default:
             sfunc = reinterpret_cast<syscall_func>(sys_invalid_syscall);
+            stats_index = kSyscallCount;
     }
 
     /* call the routine */
+    lk_bigtime_t stats_start = syscall_stats_begin();
     uint64_t ret = sfunc(arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8);
+    syscall_stats_end(stats_index, stats_start);
 
     /* check to see if there are any pending signals */
     thread_process_pending_signals();
@@ -9,15 +9,19 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/thread.h>
 
 #include <lib/ktrace.h>
 #include <lib/user_copy.h>
 
+#include <magenta/channel.h>
 #include <magenta/channel_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
+#include <magenta/wait_event.h>
+#include <magenta/wait_state_observer.h>
 
 #include <magenta/syscalls/channel.h>
 
@@ -32,8 +36,11 @@
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
 
+constexpr uint32_t kMaxMessageBatch = 64u;
+
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
+constexpr size_t kChannelBatchInlineCount = 8u;
 
 mx_status_t sys_channel_create(uint32_t flags, user_ptr<mx_handle_t> out0, user_ptr<mx_handle_t> out1) {
     LTRACEF("entry out_handles %p,%p\n", out0.get(), out1.get());
@@ -71,42 +78,12 @@ mx_status_t sys_channel_create(uint32_t flags, user_ptr<mx_handle_t> out0, user_
     return NO_ERROR;
 }
 
-mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
-                             user_ptr<void> _bytes,
-                             uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
-                             user_ptr<mx_handle_t> _handles,
-                             uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
-    LTRACEF("handle %d bytes %p num_bytes %p handles %p num_handles %p",
-            handle_value, _bytes.get(), _num_bytes.get(), _handles.get(), _num_handles.get());
-
-    auto up = ProcessDispatcher::GetCurrent();
-
-    mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ);
-    if (result != NO_ERROR)
-        return result;
-
-    if (flags & ~MX_CHANNEL_READ_MASK)
-        return ERR_NOT_SUPPORTED;
-
-    mxtl::unique_ptr<MessagePacket> msg;
-    result = channel->Read(&num_bytes, &num_handles, &msg,
-                           flags & MX_CHANNEL_READ_MAY_DISCARD);
-    if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
-        return result;
-
-    // On ERR_BUFFER_TOO_SMALL, Read() gives us the size of the next message (which remains
-    // unconsumed, unless |flags| has MX_CHANNEL_READ_MAY_DISCARD set).
-    if (_num_bytes) {
-        if (_num_bytes.copy_to_user(num_bytes) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-    if (_num_handles) {
-        if (_num_handles.copy_to_user(num_handles) != NO_ERROR)
-            return ERR_INVALID_ARGS;
-    }
-    if (result == ERR_BUFFER_TOO_SMALL)
-        return result;
+// Copies |msg| out to the caller's buffers and moves its handles into the
+// caller's handle table.
+static mx_status_t copy_message_to_user(ProcessDispatcher* up, MessagePacket* msg,
+                                        user_ptr<void> _bytes, user_ptr<mx_handle_t> _handles) {
+    uint32_t num_bytes = msg->data_size();
+    uint32_t num_handles = msg->num_handles();
 
     if (num_bytes > 0u) {
         if (_bytes.copy_array_to_user(msg->data(), num_bytes) != NO_ERROR)
@@ -137,23 +114,111 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
         }
     }
 
+    return NO_ERROR;
+}
+
+// Reads the next message on |channel| into the caller's buffers.
+static mx_status_t channel_read(ProcessDispatcher* up, ChannelDispatcher* channel, uint32_t flags,
+                                user_ptr<void> _bytes,
+                                uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
+                                user_ptr<mx_handle_t> _handles,
+                                uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = channel->Read(&num_bytes, &num_handles, &msg,
+                                       flags & MX_CHANNEL_READ_MAY_DISCARD);
+    if (result != NO_ERROR && result != ERR_BUFFER_TOO_SMALL)
+        return result;
+
+    // On ERR_BUFFER_TOO_SMALL, Read() gives us the size of the next message (which remains
+    // unconsumed, unless |flags| has MX_CHANNEL_READ_MAY_DISCARD set).
+    if (_num_bytes) {
+        if (_num_bytes.copy_to_user(num_bytes) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+    if (_num_handles) {
+        if (_num_handles.copy_to_user(num_handles) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+    if (result == ERR_BUFFER_TOO_SMALL)
+        return result;
+
+    result = copy_message_to_user(up, msg.get(), _bytes, _handles);
+    if (result != NO_ERROR)
+        return result;
+
     ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
     return result;
 }
 
-mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
-                              user_ptr<const void> _bytes, uint32_t num_bytes,
-                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
-    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u flags 0x%x\n",
-            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, flags);
+mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t flags,
+                             user_ptr<void> _bytes,
+                             uint32_t num_bytes, user_ptr<uint32_t> _num_bytes,
+                             user_ptr<mx_handle_t> _handles,
+                             uint32_t num_handles, user_ptr<uint32_t> _num_handles) {
+    LTRACEF("handle %d bytes %p num_bytes %p handles %p num_handles %p",
+            handle_value, _bytes.get(), _num_bytes.get(), _handles.get(), _num_handles.get());
 
     auto up = ProcessDispatcher::GetCurrent();
 
     mxtl::RefPtr<ChannelDispatcher> channel;
-    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_WRITE);
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ);
     if (result != NO_ERROR)
         return result;
 
+    if (flags & ~MX_CHANNEL_READ_MASK)
+        return ERR_NOT_SUPPORTED;
+
+    return channel_read(up, channel.get(), flags, _bytes, num_bytes, _num_bytes,
+                        _handles, num_handles, _num_handles);
+}
+
+// Looks up the |count| handles in |values| for transfer over |channel|,
+// storing them in |out|. The index of |channel|'s own handle, if present,
+// is returned in |self_index|; the caller decides whether that's allowed.
+static mx_status_t validate_handles_NoLock(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                           const mx_handle_t* values, size_t count,
+                                           Handle** out, size_t* self_index) {
+    *self_index = -1;
+    for (size_t ix = 0; ix != count; ++ix) {
+        auto handle = up->GetHandle_NoLock(values[ix]);
+        if (!handle)
+            return up->BadHandle(values[ix], ERR_BAD_HANDLE);
+
+        if (handle->dispatcher().get() == static_cast<Dispatcher*>(channel)) {
+            // Found itself, which is only allowed for
+            // MX_FLAG_REPLY_CHANNEL (aka Reply) channels.
+            if (!channel->is_reply_channel())
+                return ERR_NOT_SUPPORTED;
+            *self_index = ix;
+        }
+
+        if (!magenta_rights_check(handle->rights(), MX_RIGHT_TRANSFER))
+            return up->BadHandle(values[ix], ERR_ACCESS_DENIED);
+
+        out[ix] = handle;
+    }
+    return NO_ERROR;
+}
+
+// Removes the |count| handles in |values| from the handle table, all or none.
+static mx_status_t remove_handles_NoLock(ProcessDispatcher* up,
+                                         const mx_handle_t* values, size_t count) {
+    // Passing duplicate handles is not allowed: the second one is not
+    // found once the first is removed.
+    // TODO: more specific error?
+    if (up->RemoveHandles_NoLock(values, count, nullptr) != count)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
+// Builds a message from the caller's buffers and writes it to |channel|,
+// moving the handles out of the caller's handle table. A reader blocked on
+// the other end is woken onto this cpu to take it over; if |yield| is not
+// set, the caller must block right after. See thread_handoff_begin().
+static mx_status_t channel_write(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                 user_ptr<const void> _bytes, uint32_t num_bytes,
+                                 user_ptr<const mx_handle_t> _handles, uint32_t num_handles,
+                                 bool yield) {
     bool is_reply_channel = channel->is_reply_channel();
 
     if (num_bytes > 0u && !_bytes)
@@ -167,7 +232,7 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
         return ERR_OUT_OF_RANGE;
 
     mxtl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(num_bytes, num_handles, &msg);
+    mx_status_t result = MessagePacket::Create(num_bytes, num_handles, &msg);
     if (result != NO_ERROR)
         return result;
 
@@ -185,32 +250,15 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
             return ERR_INVALID_ARGS;
 
         {
-            // Loop twice, first we collect and validate handles, the second pass
-            // we remove them from this process.
+            // First collect and validate the handles, then remove them from
+            // this process.
             AutoLock lock(up->handle_table_lock());
 
-            size_t reply_channel_found = -1;
-
-            for (size_t ix = 0; ix != num_handles; ++ix) {
-                auto handle = up->GetHandle_NoLock(handles[ix]);
-                if (!handle)
-                    return up->BadHandle(handles[ix], ERR_BAD_HANDLE);
-
-                if (handle->dispatcher().get() == static_cast<Dispatcher*>(channel.get())) {
-                    // Found itself, which is only allowed for
-                    // MX_FLAG_REPLY_CHANNEL (aka Reply) channels.
-                    if (!is_reply_channel) {
-                        return ERR_NOT_SUPPORTED;
-                    } else {
-                        reply_channel_found = ix;
-                    }
-                }
-
-                if (!magenta_rights_check(handle->rights(), MX_RIGHT_TRANSFER))
-                    return up->BadHandle(handles[ix], ERR_ACCESS_DENIED);
-
-                msg->mutable_handles()[ix] = handle;
-            }
+            size_t reply_channel_found;
+            result = validate_handles_NoLock(up, channel, handles.get(), num_handles,
+                                             msg->mutable_handles(), &reply_channel_found);
+            if (result != NO_ERROR)
+                return result;
 
             if (is_reply_channel) {
                 // For reply channels, itself must be in the handle
@@ -219,19 +267,9 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
                     return ERR_BAD_STATE;
             }
 
-            for (size_t ix = 0; ix != num_handles; ++ix) {
-                auto handle = up->RemoveHandle_NoLock(handles[ix]).release();
-                // Passing duplicate handles is not allowed.
-                // If we've already seen this handle flag an error.
-                if (!handle) {
-                    // Put back the handles we've already removed.
-                    for (size_t idx = 0; idx < ix; ++idx) {
-                        up->UndoRemoveHandle_NoLock(handles[idx]);
-                    }
-                    // TODO: more specific error?
-                    return ERR_INVALID_ARGS;
-                }
-            }
+            result = remove_handles_NoLock(up, handles.get(), num_handles);
+            if (result != NO_ERROR)
+                return result;
         }
 
         // On success, the MessagePacket owns the handles.
@@ -243,6 +281,7 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
             return ERR_BAD_STATE;
     }
 
+    thread_handoff_begin();
     result = channel->Write(mxtl::move(msg));
     if (result != NO_ERROR) {
         // Write failed, put back the handles into this process.
@@ -253,5 +292,284 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
     }
 
     ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), num_bytes, num_handles, 0);
+    thread_handoff_end(yield);
+    return result;
+}
+
+mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t flags,
+                              user_ptr<const void> _bytes, uint32_t num_bytes,
+                              user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("handle %d bytes %p num_bytes %u handles %p num_handles %u flags 0x%x\n",
+            handle_value, _bytes.get(), num_bytes, _handles.get(), num_handles, flags);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_WRITE);
+    if (result != NO_ERROR)
+        return result;
+
+    return channel_write(up, channel.get(), _bytes, num_bytes, _handles, num_handles, true);
+}
+
+mx_status_t sys_channel_read_many(mx_handle_t handle_value, uint32_t options,
+                                  user_ptr<mx_channel_msg_t> _msgs, uint32_t count,
+                                  user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d msgs %p count %u\n", handle_value, _msgs.get(), count);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    if (count > kMaxMessageBatch)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kChannelBatchInlineCount> msgs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    mxtl::InlineArray<Channel::MessageSize, kChannelBatchInlineCount> sizes(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_msgs.copy_array_from_user(msgs.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    for (uint32_t i = 0; i < count; i++) {
+        sizes[i].bytes = msgs[i].num_bytes;
+        sizes[i].handles = msgs[i].num_handles;
+    }
+
+    Channel::MessageList list;
+    result = channel->ReadMany(count, sizes.get(), &list);
+    if (result == ERR_BUFFER_TOO_SMALL) {
+        // Give back the size of the message that didn't fit.
+        msgs[0].num_bytes = sizes[0].bytes;
+        msgs[0].num_handles = sizes[0].handles;
+        if (_msgs.copy_array_to_user(msgs.get(), 1) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        if (_actual && _actual.copy_to_user(0u) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return result;
+    }
+    if (result != NO_ERROR)
+        return result;
+
+    // The messages have left the channel; copy out what we can.
+    uint32_t actual = 0;
+    while (!list.is_empty()) {
+        auto msg = list.pop_front();
+        result = copy_message_to_user(up, msg.get(),
+                                      user_ptr<void>(msgs[actual].bytes),
+                                      user_ptr<mx_handle_t>(msgs[actual].handles));
+        if (result != NO_ERROR)
+            return result;
+        msgs[actual].num_bytes = sizes[actual].bytes;
+        msgs[actual].num_handles = sizes[actual].handles;
+        ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(),
+               msgs[actual].num_bytes, msgs[actual].num_handles, 0);
+        actual++;
+    }
+
+    if (_msgs.copy_array_to_user(msgs.get(), actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual && _actual.copy_to_user(actual) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
+mx_status_t sys_channel_write_many(mx_handle_t handle_value, uint32_t options,
+                                   user_ptr<const mx_channel_msg_t> _msgs, uint32_t count) {
+    LTRACEF("handle %d msgs %p count %u\n", handle_value, _msgs.get(), count);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    if (count > kMaxMessageBatch)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_WRITE);
+    if (result != NO_ERROR)
+        return result;
+
+    // A reply channel must be the last handle of each message it carries,
+    // which doesn't compose with batching.
+    if (channel->is_reply_channel())
+        return ERR_NOT_SUPPORTED;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kChannelBatchInlineCount> msgs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_msgs.copy_array_from_user(msgs.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    uint32_t total_bytes = 0;
+    size_t total_handles = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (msgs[i].num_bytes > 0u && !msgs[i].bytes)
+            return ERR_INVALID_ARGS;
+        if (msgs[i].num_handles > 0u && !msgs[i].handles)
+            return ERR_INVALID_ARGS;
+        if (msgs[i].num_bytes > kMaxMessageSize)
+            return ERR_OUT_OF_RANGE;
+        total_bytes += msgs[i].num_bytes;
+        total_handles += msgs[i].num_handles;
+    }
+    if (total_handles > kMaxMessageHandles)
+        return ERR_OUT_OF_RANGE;
+
+    // Build all the packets first, gathering every handle value into one
+    // array so they can be taken from the handle table all or none.
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, total_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    Channel::MessageList list;
+    size_t handle_offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        mxtl::unique_ptr<MessagePacket> msg;
+        result = MessagePacket::Create(msgs[i].num_bytes, msgs[i].num_handles, &msg);
+        if (result != NO_ERROR)
+            return result;
+
+        if (msgs[i].num_bytes > 0u) {
+            if (user_ptr<const void>(msgs[i].bytes).copy_array_from_user(
+                    msg->mutable_data(), msgs[i].num_bytes) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+        }
+        if (msgs[i].num_handles > 0u) {
+            if (user_ptr<const mx_handle_t>(msgs[i].handles).copy_array_from_user(
+                    &handles[handle_offset], msgs[i].num_handles) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            handle_offset += msgs[i].num_handles;
+        }
+        list.push_back(mxtl::move(msg));
+    }
+
+    if (total_handles > 0u) {
+        AutoLock lock(up->handle_table_lock());
+
+        handle_offset = 0;
+        for (auto& msg : list) {
+            size_t self_index;
+            result = validate_handles_NoLock(up, channel.get(), &handles[handle_offset],
+                                             msg.num_handles(), msg.mutable_handles(),
+                                             &self_index);
+            if (result != NO_ERROR)
+                return result;
+            handle_offset += msg.num_handles();
+        }
+
+        result = remove_handles_NoLock(up, handles.get(), total_handles);
+        if (result != NO_ERROR)
+            return result;
+
+        // On success, the MessagePackets own the handles.
+        for (auto& msg : list)
+            msg.set_owns_handles(true);
+    }
+
+    // as in channel_write()
+    thread_handoff_begin();
+    result = channel->WriteMany(&list);
+    if (result != NO_ERROR) {
+        // Write failed, put back the handles into this process.
+        AutoLock lock(up->handle_table_lock());
+        for (size_t ix = 0; ix != total_handles; ++ix) {
+            up->UndoRemoveHandle_NoLock(handles[ix]);
+        }
+    }
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), total_bytes, (uint32_t)total_handles, 0);
+    thread_handoff_end(true);
     return result;
 }
+
+mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options, mx_time_t timeout,
+                             user_ptr<const mx_channel_call_args_t> _args,
+                             user_ptr<uint32_t> _actual_bytes, user_ptr<uint32_t> _actual_handles,
+                             user_ptr<mx_status_t> _read_status) {
+    LTRACEF("handle %d options 0x%x timeout %" PRIu64 "\n", handle_value, options, timeout);
+
+    if (options != 0u)
+        return ERR_INVALID_ARGS;
+
+    mx_channel_call_args_t args;
+    if (_args.copy_from_user(&args) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcher(handle_value, &channel, MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (result != NO_ERROR)
+        return result;
+
+    // If the write fails the request never went out and the caller still
+    // owns its handles, so that is reported directly.
+    result = channel_write(up, channel.get(),
+                           user_ptr<const void>(args.wr_bytes), args.wr_num_bytes,
+                           user_ptr<const mx_handle_t>(args.wr_handles), args.wr_num_handles,
+                           false);
+    if (result != NO_ERROR)
+        return result;
+
+    // From here on failures are reported through |read_status|, so the
+    // caller can tell that the request was sent.
+    WaitEvent event;
+    WaitStateObserver wait_state_observer;
+    {
+        AutoLock lock(up->handle_table_lock());
+
+        Handle* handle = up->GetHandle_NoLock(handle_value);
+        if (!handle) {
+            result = ERR_BAD_HANDLE;
+        } else {
+            result = wait_state_observer.Begin(&event, handle,
+                                               MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED);
+        }
+    }
+
+    if (result == NO_ERROR) {
+        // The server is usually blocked reading the channel, so the write
+        // above queued it on this cpu and blocking here hands it over.
+        if (timeout > 0ull) {
+            lk_time_t t = mx_time_to_lk(timeout);
+            if (t == 0)
+                t = 1u;
+            result = event.Wait(t);
+        } else {
+            result = ERR_TIMED_OUT;
+        }
+
+        // Regardless of wait outcome, we must call End().
+        auto signals_state = wait_state_observer.End();
+        if (signals_state & MX_SIGNAL_HANDLE_CLOSED) {
+            result = ERR_HANDLE_CLOSED;
+        } else if ((result == NO_ERROR || result == ERR_TIMED_OUT) &&
+                   (signals_state & (MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED))) {
+            // a reply, or none coming; the read tells us which
+            result = channel_read(up, channel.get(), 0u,
+                                  user_ptr<void>(args.rd_bytes), args.rd_num_bytes,
+                                  _actual_bytes,
+                                  user_ptr<mx_handle_t>(args.rd_handles), args.rd_num_handles,
+                                  _actual_handles);
+        }
+    }
+
+    if (result == NO_ERROR)
+        return NO_ERROR;
+    if (_read_status && _read_status.copy_to_user(result) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return ERR_CALL_FAILED;
+}
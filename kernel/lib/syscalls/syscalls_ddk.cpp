@@ -24,6 +24,7 @@
 #include <magenta/io_mapping_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
+#include <magenta/syscalls/acpi.h>
 #include <magenta/syscalls/pci.h>
 #include <magenta/user_copy.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -97,6 +98,18 @@ mx_status_t sys_interrupt_wait(mx_handle_t handle_value) {
     return interrupt->WaitForInterrupt();
 }
 
+mx_status_t sys_interrupt_set_affinity(mx_handle_t handle_value, uint32_t cpu, uint32_t options) {
+    LTRACEF("handle %d cpu %u options 0x%x\n", handle_value, cpu, options);
+
+    auto up = ProcessDispatcher::GetCurrent();
+    mxtl::RefPtr<InterruptDispatcher> interrupt;
+    mx_status_t status = up->GetDispatcher(handle_value, &interrupt, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    return interrupt->SetAffinity(cpu, options);
+}
+
 
 mx_status_t sys_mmap_device_memory(mx_handle_t hrsrc, uintptr_t paddr, uint32_t len,
                                    mx_cache_policy_t cache_policy,
@@ -170,8 +183,13 @@ mx_status_t sys_vmo_create_contiguous(mx_handle_t hrsrc, size_t size,
         return ERR_NO_MEMORY;
 
     // always immediately commit memory to the object
+    // prefer a large page aligned run so mappings of it can use large pages
     uint64_t committed;
-    status = vmo->CommitRangeContiguous(0, size, &committed, PAGE_SIZE_SHIFT);
+    status = ERR_NO_MEMORY;
+    if (size >= (1UL << VM_LARGE_PAGE_SHIFT))
+        status = vmo->CommitRangeContiguous(0, size, &committed, VM_LARGE_PAGE_SHIFT);
+    if (status < 0)
+        status = vmo->CommitRangeContiguous(0, size, &committed, PAGE_SIZE_SHIFT);
     if (status < 0 || (size_t)committed < size) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", size / PAGE_SIZE,
                 (size_t)committed / PAGE_SIZE);
@@ -283,6 +301,7 @@ mx_status_t sys_io_mapping_get_info(mx_handle_t handle,
 
 #if ARCH_X86
 #include <arch/x86/descriptor.h>
+#include <arch/x86/idle.h>
 #include <arch/x86/ioport.h>
 
 mx_status_t sys_mmap_device_io(mx_handle_t hrsrc, uint32_t io_addr, uint32_t len) {
@@ -333,3 +352,30 @@ mx_status_t sys_acpi_cache_flush(mx_handle_t hrsrc) {
     return ERR_NOT_SUPPORTED;
 #endif
 }
+
+mx_status_t sys_acpi_set_cstates(mx_handle_t hrsrc, user_ptr<const mx_acpi_cstate_t> states,
+                                 uint32_t count) {
+    // TODO: finer grained validation
+    mx_status_t status;
+    if ((status = validate_resource_handle(hrsrc)) < 0) {
+        return status;
+    }
+    if (count > MX_ACPI_MAX_CSTATES)
+        return ERR_INVALID_ARGS;
+
+#if ARCH_X86
+    mx_acpi_cstate_t cstates[MX_ACPI_MAX_CSTATES];
+    if (states.copy_array_from_user(cstates, count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    x86_idle_state idle_states[MX_ACPI_MAX_CSTATES];
+    for (uint32_t i = 0; i < count; i++) {
+        idle_states[i].type = cstates[i].type;
+        idle_states[i].mwait_hint = cstates[i].mwait_hint;
+        idle_states[i].latency_us = cstates[i].latency_us;
+    }
+    return x86_idle_set_states(idle_states, count);
+#else
+    return ERR_NOT_SUPPORTED;
+#endif
+}
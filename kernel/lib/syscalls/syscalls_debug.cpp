@@ -29,8 +29,10 @@
 #include <magenta/syscalls/debug.h>
 #include <magenta/thread_dispatcher.h>
 #include <magenta/user_copy.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/array.h>
+#include <mxtl/inline_array.h>
 
 #include "syscalls_priv.h"
 
@@ -39,6 +41,8 @@
 constexpr uint32_t kMaxDebugWriteSize = 256u;
 constexpr size_t kMaxDebugReadBlock = 64 * 1024u * 1024u;
 constexpr size_t kMaxDebugWriteBlock = 64 * 1024u * 1024u;
+constexpr uint32_t kMaxDebugReadCount = 1024u;
+constexpr uint32_t kDebugReadInlineCount = 16u;
 
 constexpr uint32_t kMaxThreadStateSize = MX_MAX_THREAD_STATE_SIZE;
 
@@ -178,6 +182,117 @@ mx_status_t sys_process_read_memory(mx_handle_t proc, uintptr_t vaddr,
     return st;
 }
 
+mx_status_t sys_process_read_memory_many(mx_handle_t proc, user_ptr<mx_process_read_t> _reads,
+                                         uint32_t count) {
+    if (!_reads || count == 0 || count > kMaxDebugReadCount)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ProcessDispatcher> process;
+    mx_status_t status = up->GetDispatcher(proc, &process,
+                                           MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    auto aspace = process->aspace();
+    if (!aspace)
+        return ERR_BAD_STATE;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_process_read_t, kDebugReadInlineCount> reads(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_reads.copy_array_from_user(reads.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    // Each read stops at the end of the mapping it starts in.  One that
+    // can't be done reads nothing, rather than failing the others.
+    for (uint32_t i = 0; i < count; ++i) {
+        mx_process_read_t* r = &reads[i];
+        size_t len = r->len;
+        r->actual = 0;
+        if (len == 0 || len > kMaxDebugReadBlock)
+            continue;
+
+        auto region = aspace->FindRegion(r->vaddr);
+        if (!region)
+            continue;
+        auto vm_mapping = region->as_vm_mapping();
+        if (!vm_mapping || r->vaddr < vm_mapping->base())
+            continue;
+        auto vmo = vm_mapping->vmo();
+        if (!vmo)
+            continue;
+
+        size_t in_mapping = vm_mapping->base() + vm_mapping->size() - r->vaddr;
+        if (len > in_mapping)
+            len = in_mapping;
+        uint64_t offset = r->vaddr - vm_mapping->base() + vm_mapping->object_offset();
+        size_t read = 0;
+        if (vmo->ReadUser(user_ptr<void>(r->buffer), offset, len, &read) == NO_ERROR)
+            r->actual = read;
+    }
+
+    if (_reads.copy_array_to_user(reads.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
+mx_status_t sys_process_map_view(mx_handle_t proc, uintptr_t vaddr, size_t len,
+                                 user_ptr<uintptr_t> _ptr) {
+    if (!_ptr || len == 0 || len > kMaxDebugReadBlock)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ProcessDispatcher> process;
+    mx_status_t status = up->GetDispatcher(proc, &process,
+                                           MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    auto aspace = process->aspace();
+    if (!aspace)
+        return ERR_BAD_STATE;
+
+    auto region = aspace->FindRegion(vaddr);
+    if (!region)
+        return ERR_NO_MEMORY;
+    auto vm_mapping = region->as_vm_mapping();
+    if (!vm_mapping || vaddr < vm_mapping->base())
+        return ERR_NO_MEMORY;
+    auto vmo = vm_mapping->vmo();
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    // the view is of whole pages, all from the one mapping
+    uintptr_t start = ROUNDDOWN(vaddr, PAGE_SIZE);
+    if (vaddr + len < vaddr)
+        return ERR_INVALID_ARGS;
+    uintptr_t end = ROUNDUP(vaddr + len, PAGE_SIZE);
+    if (end > vm_mapping->base() + vm_mapping->size())
+        return ERR_OUT_OF_RANGE;
+
+    // It shares the target's pages, and their cache policy, but the caller
+    // can only read them.
+    uint64_t offset = start - vm_mapping->base() + vm_mapping->object_offset();
+    uint arch_mmu_flags = ARCH_MMU_FLAG_PERM_USER | ARCH_MMU_FLAG_PERM_READ |
+                          (vm_mapping->arch_mmu_flags() & ARCH_MMU_FLAG_CACHE_MASK);
+    void* ptr = nullptr;
+    status = up->aspace()->MapObject(mxtl::move(vmo), "debug view", offset, end - start,
+                                     &ptr, 0, 0, 0, arch_mmu_flags);
+    if (status != NO_ERROR)
+        return status;
+
+    uintptr_t view = reinterpret_cast<uintptr_t>(ptr) + (vaddr - start);
+    if (_ptr.copy_to_user(view) != NO_ERROR) {
+        up->aspace()->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+        return ERR_INVALID_ARGS;
+    }
+    return NO_ERROR;
+}
+
 mx_status_t sys_process_write_memory(mx_handle_t proc, uintptr_t vaddr,
                                      user_ptr<const void> buffer,
                                      size_t len, user_ptr<size_t> actual) {
@@ -245,13 +360,53 @@ mx_status_t sys_ktrace_control(mx_handle_t handle, uint32_t action, uint32_t opt
     }
 
     switch (action) {
-    case KTRACE_ACTION_NEW_PROBE: {
+    case KTRACE_ACTION_NEW_PROBE:
+    case KTRACE_ACTION_BOOT_STAGE: {
         char name[MX_MAX_NAME_LEN];
         if (ptr.copy_array_from_user(name, sizeof(name) - 1) != NO_ERROR)
             return ERR_INVALID_ARGS;
         name[sizeof(name) - 1] = 0;
         return ktrace_control(action, options, name);
     }
+    case KTRACE_ACTION_GET_VMO: {
+        mxtl::RefPtr<VmObject> vmo;
+        if ((status = ktrace_get_vmo(&vmo)) < 0)
+            return status;
+
+        mxtl::RefPtr<Dispatcher> dispatcher;
+        mx_rights_t rights;
+        if ((status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights)) < 0)
+            return status;
+
+        // readers only get to look, the kernel owns the buffer
+        rights &= ~(MX_RIGHT_WRITE | MX_RIGHT_EXECUTE);
+        HandleUniquePtr handle(MakeHandle(mxtl::move(dispatcher), rights));
+        if (!handle)
+            return ERR_NO_MEMORY;
+
+        auto up = ProcessDispatcher::GetCurrent();
+        if (ptr.reinterpret<mx_handle_t>().copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+
+        up->AddHandle(mxtl::move(handle));
+        return NO_ERROR;
+    }
+    case KTRACE_ACTION_ADD_USER_BUFFER:
+    case KTRACE_ACTION_REMOVE_USER_BUFFER: {
+        mx_handle_t vmo_handle;
+        if (ptr.reinterpret<mx_handle_t>().copy_from_user(&vmo_handle) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+
+        // the kernel only ever reads it
+        mxtl::RefPtr<VmObjectDispatcher> vmo;
+        status = ProcessDispatcher::GetCurrent()->GetDispatcher(vmo_handle, &vmo, MX_RIGHT_READ);
+        if (status != NO_ERROR)
+            return status;
+
+        if (action == KTRACE_ACTION_ADD_USER_BUFFER)
+            return ktrace_add_user_buffer(vmo->vmo());
+        return ktrace_remove_user_buffer(vmo->vmo());
+    }
     default:
         return ktrace_control(action, options, nullptr);
     }
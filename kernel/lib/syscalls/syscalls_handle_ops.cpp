@@ -10,15 +10,23 @@
 
 #include <kernel/auto_lock.h>
 
+#include <lib/user_copy/user_ptr.h>
+
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
 #define LOCAL_TRACE 0
 
+constexpr uint32_t kMaxHandleManyCount = 1024u;
+
+// Covers the common small batches without going to the heap.
+constexpr size_t kHandleManyInlineCount = 8u;
+
 mx_status_t sys_handle_close(mx_handle_t handle_value) {
     LTRACEF("handle %d\n", handle_value);
     auto up = ProcessDispatcher::GetCurrent();
@@ -62,6 +70,96 @@ mx_status_t sys_handle_duplicate(mx_handle_t handle_value, mx_rights_t rights,
     return NO_ERROR;
 }
 
+mx_status_t sys_handle_close_many(user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
+    LTRACEF("count %u\n", num_handles);
+
+    if (num_handles > kMaxHandleManyCount)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kHandleManyInlineCount> values(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    mxtl::InlineArray<Handle*, kHandleManyInlineCount> handles(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_handles.copy_array_from_user(values.get(), num_handles) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+    {
+        AutoLock lock(up->handle_table_lock());
+        size_t bad = up->RemoveHandles_NoLock(values.get(), num_handles, handles.get());
+        if (bad != num_handles)
+            return up->BadHandle(values[bad], ERR_BAD_HANDLE);
+    }
+
+    // As in sys_handle_close(), the handles go away outside the lock.
+    for (size_t ix = 0; ix != num_handles; ++ix)
+        DeleteHandle(handles[ix]);
+    return NO_ERROR;
+}
+
+mx_status_t sys_handle_duplicate_many(mx_handle_t handle_value, mx_rights_t rights,
+                                      user_ptr<mx_handle_t> _out, uint32_t num_handles) {
+    LTRACEF("handle %d count %u\n", handle_value, num_handles);
+
+    if (num_handles > kMaxHandleManyCount)
+        return ERR_OUT_OF_RANGE;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_handle_t, kHandleManyInlineCount> values(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    mxtl::InlineArray<Handle*, kHandleManyInlineCount> dests(&ac, num_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    {
+        AutoLock lock(up->handle_table_lock());
+        Handle* source = up->GetHandle_NoLock(handle_value);
+        if (!source)
+            return up->BadHandle(handle_value, ERR_BAD_HANDLE);
+
+        if (!magenta_rights_check(source->rights(), MX_RIGHT_DUPLICATE))
+            return up->BadHandle(handle_value, ERR_ACCESS_DENIED);
+
+        if (rights == MX_RIGHT_SAME_RIGHTS) {
+            rights = source->rights();
+        } else if ((source->rights() & rights) != rights) {
+            return ERR_INVALID_ARGS;
+        }
+
+        mx_status_t status = NO_ERROR;
+        size_t made = 0;
+        for (; made != num_handles; ++made) {
+            dests[made] = DupHandle(source, rights);
+            if (!dests[made]) {
+                status = ERR_NO_MEMORY;
+                break;
+            }
+            values[made] = up->MapHandleToValue(dests[made]);
+        }
+
+        if (status == NO_ERROR &&
+            _out.copy_array_to_user(values.get(), num_handles) != NO_ERROR)
+            status = ERR_INVALID_ARGS;
+
+        if (status != NO_ERROR) {
+            for (size_t ix = 0; ix != made; ++ix)
+                DeleteHandle(dests[ix]);
+            return status;
+        }
+
+        for (size_t ix = 0; ix != num_handles; ++ix)
+            up->AddHandle_NoLock(HandleUniquePtr(dests[ix]));
+    }
+
+    return NO_ERROR;
+}
+
 mx_status_t sys_handle_replace(mx_handle_t handle_value, mx_rights_t rights,
                                user_ptr<mx_handle_t> out) {
     LTRACEF("handle %d\n", handle_value);
@@ -118,6 +118,37 @@ mx_status_t sys_handle_wait_many(user_ptr<mx_wait_item_t> _items, uint32_t count
     if (_items.copy_array_from_user(items.get(), count) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // Reading the signals doesn't lock the StateTrackers, so first check
+    // whether we can return without registering (and later unregistering)
+    // an observer with every one of them: either something is already
+    // satisfied or we aren't going to block anyway.
+    bool satisfied = false;
+    {
+        AutoLock lock(up->handle_table_lock());
+
+        for (size_t ix = 0; ix != count; ++ix) {
+            Handle* handle = up->GetHandle_NoLock(items[ix].handle);
+            if (!handle)
+                return up->BadHandle(items[ix].handle, ERR_BAD_HANDLE);
+            if (!magenta_rights_check(handle->rights(), MX_RIGHT_READ))
+                return ERR_ACCESS_DENIED;
+            auto state_tracker = handle->dispatcher()->get_state_tracker();
+            if (!state_tracker)
+                return ERR_NOT_SUPPORTED;
+
+            items[ix].pending = state_tracker->GetSignalsState();
+            if (items[ix].pending & items[ix].waitfor)
+                satisfied = true;
+        }
+    }
+    if (satisfied || timeout == 0ull) {
+        if (_items.copy_array_to_user(items.get(), count) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return timeout > 0ull ? NO_ERROR : ERR_TIMED_OUT;
+    }
+
     mxtl::InlineArray<WaitStateObserver, kWaitManyInlineCount> wait_state_observers(&ac, count);
     if (!ac.check())
         return ERR_NO_MEMORY;
@@ -128,7 +159,6 @@ mx_status_t sys_handle_wait_many(user_ptr<mx_wait_item_t> _items, uint32_t count
     status_t result = NO_ERROR;
     size_t num_added = 0;
     {
-        auto up = ProcessDispatcher::GetCurrent();
         AutoLock lock(up->handle_table_lock());
 
         for (; num_added != count; ++num_added) {
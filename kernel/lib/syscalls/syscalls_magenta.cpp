@@ -8,6 +8,7 @@
 #include <inttypes.h>
 #include <new.h>
 #include <platform.h>
+#include <pow2.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +20,7 @@
 #include <kernel/auto_lock.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
+#include <kernel/vm/vm_object.h>
 
 #include <lib/crypto/global_prng.h>
 #include <lib/ktrace.h>
@@ -27,13 +29,16 @@
 
 #include <magenta/event_dispatcher.h>
 #include <magenta/event_pair_dispatcher.h>
+#include <magenta/fifo_dispatcher.h>
 #include <magenta/log_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/socket_dispatcher.h>
 #include <magenta/state_tracker.h>
+#include <magenta/thread_dispatcher.h>
 #include <magenta/syscalls/log.h>
 #include <magenta/user_copy.h>
+#include <magenta/vm_object_dispatcher.h>
 #include <magenta/wait_set_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
@@ -47,6 +52,9 @@ constexpr size_t kMaxCPRNGSeed = MX_CPRNG_ADD_ENTROPY_MAX_LEN;
 
 constexpr uint32_t kMaxWaitSetWaitResults = 1024u;
 
+// Largest ring mx_fifo_create() will make, in bytes.
+constexpr uint64_t kMaxFifoSize = 16u * 1024u * 1024u;
+
 mx_status_t sys_nanosleep(mx_time_t nanoseconds) {
     LTRACEF("nseconds %" PRIu64 "\n", nanoseconds);
 
@@ -60,7 +68,7 @@ mx_status_t sys_nanosleep(mx_time_t nanoseconds) {
 
 static int64_t utc_offset;
 
-uint64_t sys_time_get(uint32_t clock_id) {
+uint64_t sys_clock_get(uint32_t clock_id) {
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return current_time_hires();
@@ -155,7 +163,14 @@ mx_status_t sys_futex_wait(user_ptr<mx_futex_t> value_ptr, int current_value, mx
 }
 
 mx_status_t sys_futex_wake(user_ptr<mx_futex_t> value_ptr, uint32_t count) {
-    return ProcessDispatcher::GetCurrent()->futex_context()->FutexWake(value_ptr, count);
+    return ProcessDispatcher::GetCurrent()->futex_context()->FutexWake(value_ptr, count, false);
+}
+
+mx_status_t sys_futex_wake_etc(user_ptr<mx_futex_t> value_ptr, uint32_t count, uint32_t options) {
+    if (options & ~MX_FUTEX_WAKE_LIFO)
+        return ERR_INVALID_ARGS;
+    return ProcessDispatcher::GetCurrent()->futex_context()->FutexWake(
+        value_ptr, count, (options & MX_FUTEX_WAKE_LIFO) != 0);
 }
 
 mx_status_t sys_futex_requeue(user_ptr<mx_futex_t> wake_ptr, uint32_t wake_count, int current_value,
@@ -164,6 +179,19 @@ mx_status_t sys_futex_requeue(user_ptr<mx_futex_t> wake_ptr, uint32_t wake_count
         wake_ptr, wake_count, current_value, requeue_ptr, requeue_count);
 }
 
+mx_status_t sys_futex_wait_pi(user_ptr<mx_futex_t> value_ptr, int current_value,
+                              mx_handle_t owner_handle, mx_time_t timeout) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ThreadDispatcher> owner;
+    mx_status_t status = up->GetDispatcher(owner_handle, &owner);
+    if (status != NO_ERROR)
+        return status;
+
+    return up->futex_context()->FutexWaitPi(
+        value_ptr, current_value, mxtl::WrapRefPtr(owner->thread()), timeout);
+}
+
 int sys_log_create(uint32_t flags) {
     LTRACEF("flags 0x%x\n", flags);
 
@@ -235,8 +263,7 @@ mx_status_t sys_cprng_draw(user_ptr<void> buffer, size_t len, user_ptr<size_t> a
 
     uint8_t kernel_buf[kMaxCPRNGDraw];
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    prng->Draw(kernel_buf, static_cast<int>(len));
+    crypto::GlobalPRNG::Draw(kernel_buf, static_cast<int>(len));
 
     if (buffer.copy_array_to_user(kernel_buf, len) != NO_ERROR)
         return ERR_INVALID_ARGS;
@@ -257,8 +284,7 @@ mx_status_t sys_cprng_add_entropy(user_ptr<const void> buffer, size_t len) {
     if (buffer.copy_array_from_user(kernel_buf, len) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    prng->AddEntropy(kernel_buf, static_cast<int>(len));
+    crypto::GlobalPRNG::AddEntropy(kernel_buf, static_cast<int>(len));
 
     // Get rid of the stack copy of the random data
     memset(kernel_buf, 0, sizeof(kernel_buf));
@@ -387,7 +413,7 @@ mx_status_t sys_waitset_wait(mx_handle_t ws_handle,
 mx_status_t sys_socket_create(uint32_t flags, user_ptr<mx_handle_t> out0, user_ptr<mx_handle_t> out1) {
     LTRACEF("entry out_handles %p, %p\n", out0.get(), out1.get());
 
-    if (flags != 0u)
+    if (flags & ~MX_SOCKET_DATAGRAM)
         return ERR_INVALID_ARGS;
 
     mxtl::RefPtr<Dispatcher> socket0, socket1;
@@ -482,3 +508,177 @@ mx_status_t sys_socket_read(mx_handle_t handle, uint32_t flags,
 
     return status;
 }
+
+mx_status_t sys_socket_write_vmo(mx_handle_t handle, uint32_t flags,
+                                 mx_handle_t vmo_handle, uint64_t offset, size_t size,
+                                 user_ptr<size_t> actual) {
+    LTRACEF("handle %d vmo %d\n", handle, vmo_handle);
+
+    if (flags)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcher(handle, &socket, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    // the pages leave the vmo, which is as good as writing to it
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    status = up->GetDispatcher(vmo_handle, &vmo, MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    size_t nwritten;
+    status = socket->WritePages(vmo->vmo(), offset, size, &nwritten);
+    if (status != NO_ERROR)
+        return status;
+
+    // Caller may ignore results if desired.
+    if (actual)
+        status = actual.copy_to_user(nwritten);
+
+    return status;
+}
+
+mx_status_t sys_socket_splice(mx_handle_t src_handle, mx_handle_t dst_handle, uint32_t options,
+                              uint64_t offset, size_t size, user_ptr<size_t> actual) {
+    LTRACEF("src %d dst %d\n", src_handle, dst_handle);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // either end may be a socket or a vmo, but not both vmos
+    mxtl::RefPtr<Dispatcher> src, dst;
+    mx_rights_t src_rights, dst_rights;
+    if (!up->GetDispatcher(src_handle, &src, &src_rights))
+        return up->BadHandle(src_handle, ERR_BAD_HANDLE);
+    if (!up->GetDispatcher(dst_handle, &dst, &dst_rights))
+        return up->BadHandle(dst_handle, ERR_BAD_HANDLE);
+
+    auto src_socket = src->get_specific<SocketDispatcher>();
+    auto dst_socket = dst->get_specific<SocketDispatcher>();
+    auto src_vmo = src->get_specific<VmObjectDispatcher>();
+    auto dst_vmo = dst->get_specific<VmObjectDispatcher>();
+    if (!src_socket && !(src_vmo && dst_socket))
+        return up->BadHandle(src_handle, ERR_WRONG_TYPE);
+    if (!dst_socket && !(dst_vmo && src_socket))
+        return up->BadHandle(dst_handle, ERR_WRONG_TYPE);
+
+    if (!magenta_rights_check(src_rights, MX_RIGHT_READ))
+        return up->BadHandle(src_handle, ERR_ACCESS_DENIED);
+    if (!magenta_rights_check(dst_rights, MX_RIGHT_WRITE))
+        return up->BadHandle(dst_handle, ERR_ACCESS_DENIED);
+
+    mx_status_t status;
+    size_t nmoved;
+    if (src_vmo || dst_vmo) {
+        auto vmo = (src_vmo ? src_vmo : dst_vmo)->vmo();
+        if (size > 0 && offset >= vmo->size())
+            return ERR_OUT_OF_RANGE;
+        if (src_vmo)
+            status = dst_socket->WriteFromVmo(mxtl::move(vmo), offset, size, &nmoved);
+        else
+            status = src_socket->ReadToVmo(mxtl::move(vmo), offset, size, &nmoved);
+    } else {
+        if (offset)
+            return ERR_INVALID_ARGS;
+        status = src_socket->Splice(DownCastDispatcher<SocketDispatcher>(mxtl::move(dst)),
+                                    size, &nmoved);
+    }
+    if (status != NO_ERROR)
+        return status;
+
+    // Caller may ignore results if desired.
+    if (actual)
+        status = actual.copy_to_user(nmoved);
+
+    return status;
+}
+
+mx_status_t sys_fifo_create(uint32_t elem_count, uint32_t elem_size, uint32_t options,
+                            user_ptr<mx_handle_t> out_producer,
+                            user_ptr<mx_handle_t> out_consumer,
+                            user_ptr<mx_handle_t> out_vmo) {
+    LTRACEF("elem_count %u elem_size %u\n", elem_count, elem_size);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+    if (!elem_count || !ispow2(elem_count) || !elem_size)
+        return ERR_INVALID_ARGS;
+    uint64_t size = static_cast<uint64_t>(elem_count) * elem_size;
+    if (size > kMaxFifoSize)
+        return ERR_OUT_OF_RANGE;
+
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0u, ROUNDUP(size, PAGE_SIZE));
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    mxtl::RefPtr<Dispatcher> vmo_dispatcher;
+    mx_rights_t vmo_rights;
+    status_t result = VmObjectDispatcher::Create(mxtl::move(vmo), &vmo_dispatcher, &vmo_rights);
+    if (result != NO_ERROR)
+        return result;
+
+    mxtl::RefPtr<Dispatcher> producer, consumer;
+    mx_rights_t rights;
+    result = FifoDispatcher::Create(elem_count, &producer, &consumer, &rights);
+    if (result != NO_ERROR)
+        return result;
+
+    HandleUniquePtr h0(MakeHandle(mxtl::move(producer), rights));
+    if (!h0)
+        return ERR_NO_MEMORY;
+
+    HandleUniquePtr h1(MakeHandle(mxtl::move(consumer), rights));
+    if (!h1)
+        return ERR_NO_MEMORY;
+
+    HandleUniquePtr h2(MakeHandle(mxtl::move(vmo_dispatcher), vmo_rights));
+    if (!h2)
+        return ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    if (out_producer.copy_to_user(up->MapHandleToValue(h0.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    if (out_consumer.copy_to_user(up->MapHandleToValue(h1.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    if (out_vmo.copy_to_user(up->MapHandleToValue(h2.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(h0));
+    up->AddHandle(mxtl::move(h1));
+    up->AddHandle(mxtl::move(h2));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_fifo_op(mx_handle_t handle, uint32_t op, uint64_t count,
+                        user_ptr<mx_fifo_state_t> out) {
+    LTRACEF("handle %d op %u count %" PRIu64 "\n", handle, op, count);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mx_rights_t needed = (op == MX_FIFO_OP_READ_STATE) ? MX_RIGHT_READ : MX_RIGHT_WRITE;
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcher(handle, &fifo, needed);
+    if (status != NO_ERROR)
+        return status;
+
+    mx_fifo_state_t state;
+    status = fifo->Op(op, count, &state);
+    if (status != NO_ERROR)
+        return status;
+
+    // Caller may ignore results if desired.
+    if (out)
+        status = out.copy_to_user(state);
+
+    return status;
+}
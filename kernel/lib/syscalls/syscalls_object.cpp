@@ -9,12 +9,20 @@
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm/vm_address_region.h>
+#include <lib/counters.h>
+#include <lib/heap.h>
+#include <lib/syscall_stats.h>
 
+#include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/resource_dispatcher.h>
+#include <magenta/socket_dispatcher.h>
 #include <magenta/thread_dispatcher.h>
+#include <magenta/vm_address_region_dispatcher.h>
 
+#include <mxtl/array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -159,6 +167,342 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
                 return ERR_INVALID_ARGS;
             return status;
         }
+        case MX_INFO_KERNEL_HEAP: {
+            size_t actual = (buffer_size < sizeof(mx_info_kernel_heap_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            if (actual > 0) {
+                struct heap_info hi;
+                status = heap_get_info(&hi);
+                if (status != NO_ERROR)
+                    return status;
+
+                mx_info_kernel_heap_t info = {
+                    .size = hi.size,
+                    .free_bytes = hi.free_bytes,
+                    .cached_bytes = hi.cached_bytes,
+                    .os_allocations = hi.os_allocations,
+                    .os_alloc_count = hi.os_alloc_count,
+                    .returned_bytes = hi.returned_bytes,
+                };
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_KERNEL_HEAP_BUCKETS: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            ssize_t num_buckets = heap_get_bucket_info(nullptr, 0);
+            if (num_buckets < 0)
+                return static_cast<mx_status_t>(num_buckets);
+
+            // the heap lock is held while the buckets are walked, so gather
+            // them into a kernel buffer first and copy out afterwards
+            size_t num_to_copy = MIN(static_cast<size_t>(num_buckets),
+                                     buffer_size / sizeof(mx_info_kernel_heap_bucket_t));
+            if (num_to_copy > 0) {
+                AllocChecker ac;
+                heap_bucket_info* tmp = new (&ac) heap_bucket_info[num_to_copy];
+                if (!ac.check())
+                    return ERR_NO_MEMORY;
+                mxtl::Array<heap_bucket_info> buckets(tmp, num_to_copy);
+                heap_get_bucket_info(buckets.get(), num_to_copy);
+
+                auto records = _buffer.reinterpret<mx_info_kernel_heap_bucket_t>();
+                for (size_t i = 0; i < num_to_copy; i++) {
+                    mx_info_kernel_heap_bucket_t info = {
+                        .size = buckets[i].size,
+                        .free_count = buckets[i].free_count,
+                        .free_bytes = buckets[i].free_bytes,
+                        .cached_count = buckets[i].cached_count,
+                    };
+                    if (records.element_offset(i).copy_to_user(info) != NO_ERROR)
+                        return ERR_INVALID_ARGS;
+                }
+            }
+            if (_actual && (_actual.copy_to_user(num_to_copy) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(static_cast<size_t>(num_buckets)) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_PROCESS_MEMORY: {
+            size_t actual = (buffer_size < sizeof(mx_info_process_memory_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            mxtl::RefPtr<ProcessDispatcher> process;
+            auto error = up->GetDispatcher<ProcessDispatcher>(handle, &process, MX_RIGHT_READ);
+            if (error < 0)
+                return error;
+
+            if (actual > 0) {
+                mx_info_process_memory_t info = { };
+
+                auto err = process->GetMemoryInfo(&info);
+                if (err != NO_ERROR)
+                    return err;
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_TASK_RUNTIME: {
+            size_t actual = (buffer_size < sizeof(mx_info_task_runtime_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            // a thread, or everything a process or job has run
+            mxtl::RefPtr<Dispatcher> dispatcher;
+            uint32_t rights;
+            if (!up->GetDispatcher(handle, &dispatcher, &rights))
+                return up->BadHandle(handle, ERR_BAD_HANDLE);
+            if (!magenta_rights_check(rights, MX_RIGHT_READ))
+                return ERR_ACCESS_DENIED;
+
+            mx_info_task_runtime_t info = { };
+            if (auto thread = dispatcher->get_specific<ThreadDispatcher>()) {
+                thread->thread()->GetRuntimeInfo(&info);
+            } else if (auto process = dispatcher->get_specific<ProcessDispatcher>()) {
+                auto err = process->GetRuntimeInfo(&info);
+                if (err != NO_ERROR)
+                    return err;
+            } else if (auto job = dispatcher->get_specific<JobDispatcher>()) {
+                auto err = job->GetRuntimeInfo(&info);
+                if (err != NO_ERROR)
+                    return err;
+            } else {
+                return ERR_WRONG_TYPE;
+            }
+
+            if (actual > 0 && _buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_JOB_RESOURCES: {
+            size_t actual = (buffer_size < sizeof(mx_info_job_resources_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            mxtl::RefPtr<JobDispatcher> job;
+            auto err = up->GetDispatcher(handle, &job, MX_RIGHT_READ);
+            if (err != NO_ERROR)
+                return err;
+
+            mx_info_job_resources_t info = { };
+            err = job->GetResourceInfo(&info);
+            if (err != NO_ERROR)
+                return err;
+
+            if (actual > 0 && _buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_PROCESS_KERNEL_MEMORY: {
+            size_t actual = (buffer_size < sizeof(mx_info_process_kernel_memory_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            mxtl::RefPtr<ProcessDispatcher> process;
+            auto err = up->GetDispatcher(handle, &process, MX_RIGHT_READ);
+            if (err != NO_ERROR)
+                return err;
+
+            if (actual > 0) {
+                mx_info_process_kernel_memory_t info;
+                err = process->GetKernelMemoryInfo(&info);
+                if (err != NO_ERROR)
+                    return err;
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_PROCESS_MAPS: {
+            // either a whole process or one of its vmars
+            mxtl::RefPtr<Dispatcher> dispatcher;
+            uint32_t rights;
+            if (!up->GetDispatcher(handle, &dispatcher, &rights))
+                return up->BadHandle(handle, ERR_BAD_HANDLE);
+            if (!magenta_rights_check(rights, MX_RIGHT_READ))
+                return ERR_ACCESS_DENIED;
+
+            mxtl::RefPtr<VmAddressRegion> vmar;
+            if (auto process = dispatcher->get_specific<ProcessDispatcher>()) {
+                vmar = process->aspace()->root_vmar();
+            } else if (auto vmar_disp = dispatcher->get_specific<VmAddressRegionDispatcher>()) {
+                vmar = vmar_disp->vmar();
+            } else {
+                return ERR_WRONG_TYPE;
+            }
+
+            // the aspace lock is held while the mappings are walked, so
+            // gather them into a kernel buffer first and copy out afterwards
+            size_t num_maps = vmar->GetMappingInfo(nullptr, 0);
+            size_t num_to_copy = MIN(num_maps, buffer_size / sizeof(mx_info_maps_t));
+            if (num_to_copy > 0) {
+                AllocChecker ac;
+                VmMappingInfo* tmp = new (&ac) VmMappingInfo[num_to_copy];
+                if (!ac.check())
+                    return ERR_NO_MEMORY;
+                mxtl::Array<VmMappingInfo> maps(tmp, num_to_copy);
+
+                // mappings may have come or gone since we counted them
+                num_maps = vmar->GetMappingInfo(maps.get(), num_to_copy);
+                num_to_copy = MIN(num_maps, num_to_copy);
+
+                auto records = _buffer.reinterpret<mx_info_maps_t>();
+                for (size_t i = 0; i < num_to_copy; i++) {
+                    mx_info_maps_t info = { };
+                    strlcpy(info.name, maps[i].name, sizeof(info.name));
+                    info.base = maps[i].base;
+                    info.size = maps[i].size;
+                    info.committed_bytes = maps[i].committed_pages * PAGE_SIZE;
+                    if (maps[i].arch_mmu_flags & ARCH_MMU_FLAG_PERM_READ)
+                        info.flags |= MX_VM_FLAG_PERM_READ;
+                    if (maps[i].arch_mmu_flags & ARCH_MMU_FLAG_PERM_WRITE)
+                        info.flags |= MX_VM_FLAG_PERM_WRITE;
+                    if (maps[i].arch_mmu_flags & ARCH_MMU_FLAG_PERM_EXECUTE)
+                        info.flags |= MX_VM_FLAG_PERM_EXECUTE;
+                    if (records.element_offset(i).copy_to_user(info) != NO_ERROR)
+                        return ERR_INVALID_ARGS;
+                }
+            }
+            if (_actual && (_actual.copy_to_user(num_to_copy) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(num_maps) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_KERNEL_SYSCALLS: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            ssize_t num_syscalls = syscall_stats_get(nullptr, 0);
+            if (num_syscalls < 0)
+                return static_cast<mx_status_t>(num_syscalls);
+
+            size_t num_to_copy = MIN(static_cast<size_t>(num_syscalls),
+                                     buffer_size / sizeof(mx_info_kernel_syscall_t));
+            if (num_to_copy > 0) {
+                AllocChecker ac;
+                syscall_stats* tmp = new (&ac) syscall_stats[num_to_copy];
+                if (!ac.check())
+                    return ERR_NO_MEMORY;
+                mxtl::Array<syscall_stats> stats(tmp, num_to_copy);
+                syscall_stats_get(stats.get(), num_to_copy);
+
+                static_assert(MX_SYSCALL_LATENCY_BUCKETS == SYSCALL_STATS_BUCKETS, "");
+                auto records = _buffer.reinterpret<mx_info_kernel_syscall_t>();
+                for (size_t i = 0; i < num_to_copy; i++) {
+                    mx_info_kernel_syscall_t info = { };
+                    strlcpy(info.name, stats[i].name, sizeof(info.name));
+                    info.num = stats[i].num;
+                    info.count = stats[i].count;
+                    info.total_time = stats[i].total_time;
+                    memcpy(info.latency, stats[i].latency, sizeof(info.latency));
+                    if (records.element_offset(i).copy_to_user(info) != NO_ERROR)
+                        return ERR_INVALID_ARGS;
+                }
+            }
+            if (_actual && (_actual.copy_to_user(num_to_copy) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(static_cast<size_t>(num_syscalls)) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_KERNEL_SCHED_LATENCY: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            size_t num_cpus = arch_max_num_cpus();
+            size_t num_to_copy = MIN(num_cpus,
+                                     buffer_size / sizeof(mx_info_kernel_sched_latency_t));
+
+            static_assert(MX_SCHED_LATENCY_BUCKETS == SCHED_LATENCY_BUCKETS, "");
+            auto records = _buffer.reinterpret<mx_info_kernel_sched_latency_t>();
+            for (size_t i = 0; i < num_to_copy; i++) {
+                sched_latency lat;
+                sched_latency_get(static_cast<uint>(i), &lat);
+                mx_info_kernel_sched_latency_t info = { };
+                memcpy(info.wakeup_latency, lat.wakeup, sizeof(info.wakeup_latency));
+                memcpy(info.slice_length, lat.slice, sizeof(info.slice_length));
+                if (records.element_offset(i).copy_to_user(info) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(num_to_copy) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(num_cpus) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_INFO_KERNEL_COUNTERS: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            size_t num_counters = kcounter_count();
+            size_t num_to_copy = MIN(num_counters,
+                                     buffer_size / sizeof(mx_info_kernel_counter_t));
+
+            auto records = _buffer.reinterpret<mx_info_kernel_counter_t>();
+            for (size_t i = 0; i < num_to_copy; i++) {
+                const k_counter_desc* c = kcounter_get(i);
+                mx_info_kernel_counter_t info = { };
+                strlcpy(info.name, c->name, sizeof(info.name));
+                info.value = kcounter_sum(c);
+                if (records.element_offset(i).copy_to_user(info) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(num_to_copy) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(num_counters) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_NOT_SUPPORTED;
     }
@@ -202,6 +546,95 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_PROP_SCHED_FAIR_WEIGHT: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return ERR_WRONG_TYPE;
+            uint32_t value = thread->thread()->fair_weight();
+            if (_value.reinterpret<uint32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_TIMER_SLACK: {
+            if (size < sizeof(mx_time_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return ERR_WRONG_TYPE;
+            mx_time_t value = thread->thread()->timer_slack() * 1000000ull;
+            if (_value.reinterpret<mx_time_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_SCHED_CPU: {
+            if (size < sizeof(int32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return ERR_WRONG_TYPE;
+            int32_t value = thread->thread()->pinned_cpu();
+            if (_value.reinterpret<int32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_SCHED_DEADLINE: {
+            if (size < sizeof(mx_sched_deadline_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return ERR_WRONG_TYPE;
+            thread_deadline_params_t params = thread->thread()->deadline();
+            mx_sched_deadline_t value = {params.runtime_ns, params.deadline_ns, params.period_ns};
+            if (_value.reinterpret<mx_sched_deadline_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_JOB_CPU_QUOTA: {
+            if (size < sizeof(mx_job_cpu_quota_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return ERR_WRONG_TYPE;
+            mx_job_cpu_quota_t value = job->GetCpuQuota();
+            if (_value.reinterpret<mx_job_cpu_quota_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_JOB_CPU_AFFINITY: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return ERR_WRONG_TYPE;
+            uint32_t value = job->GetCpuAffinity();
+            if (_value.reinterpret<uint32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_JOB_MEMORY_LIMIT: {
+            if (size < sizeof(uint64_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return ERR_WRONG_TYPE;
+            uint64_t value = job->GetMemoryLimit();
+            if (_value.reinterpret<uint64_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
+        case MX_PROP_SOCKET_BUFFER_SIZE: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto socket = dispatcher->get_specific<SocketDispatcher>();
+            if (!socket)
+                return ERR_WRONG_TYPE;
+            uint32_t value = socket->GetBufferSize();
+            if (_value.reinterpret<uint32_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         case MX_PROP_NAME: {
             if (size < MX_MAX_NAME_LEN)
                 return ERR_BUFFER_TOO_SMALL;
@@ -248,6 +681,105 @@ mx_status_t sys_object_set_property(mx_handle_t handle_value, uint32_t property,
             status = process->set_bad_handle_policy(value);
             break;
         }
+        case MX_PROP_SCHED_FAIR_WEIGHT: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            uint32_t value = 0;
+            if (_value.reinterpret<const uint32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = thread->thread()->set_fair_weight(value);
+            break;
+        }
+        case MX_PROP_TIMER_SLACK: {
+            if (size < sizeof(mx_time_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            mx_time_t value = 0;
+            if (_value.reinterpret<const mx_time_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            if (value > MX_TIMER_SLACK_MAX)
+                return ERR_INVALID_ARGS;
+            status = thread->thread()->set_timer_slack(static_cast<lk_time_t>(value / 1000000u));
+            break;
+        }
+        case MX_PROP_SCHED_CPU: {
+            if (size < sizeof(int32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            int32_t value = 0;
+            if (_value.reinterpret<const int32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = thread->thread()->set_pinned_cpu(value);
+            break;
+        }
+        case MX_PROP_SCHED_DEADLINE: {
+            if (size < sizeof(mx_sched_deadline_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = dispatcher->get_specific<ThreadDispatcher>();
+            if (!thread)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            mx_sched_deadline_t value = {};
+            if (_value.reinterpret<const mx_sched_deadline_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            thread_deadline_params_t params = {value.runtime, value.deadline, value.period};
+            status = thread->thread()->set_deadline(params);
+            break;
+        }
+        case MX_PROP_JOB_CPU_QUOTA: {
+            if (size < sizeof(mx_job_cpu_quota_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            mx_job_cpu_quota_t value = {};
+            if (_value.reinterpret<const mx_job_cpu_quota_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = job->SetCpuQuota(value);
+            break;
+        }
+        case MX_PROP_JOB_CPU_AFFINITY: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            uint32_t value = 0;
+            if (_value.reinterpret<const uint32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = job->SetCpuAffinity(value);
+            break;
+        }
+        case MX_PROP_JOB_MEMORY_LIMIT: {
+            if (size < sizeof(uint64_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto job = dispatcher->get_specific<JobDispatcher>();
+            if (!job)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            uint64_t value = 0;
+            if (_value.reinterpret<const uint64_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = job->SetMemoryLimit(value);
+            break;
+        }
+        case MX_PROP_SOCKET_BUFFER_SIZE: {
+            if (size < sizeof(uint32_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto socket = dispatcher->get_specific<SocketDispatcher>();
+            if (!socket)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            uint32_t value = 0;
+            if (_value.reinterpret<const uint32_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            status = socket->SetBufferSize(value);
+            break;
+        }
         case MX_PROP_NAME: {
             if (size >= MX_MAX_NAME_LEN)
                 size = MX_MAX_NAME_LEN - 1;
@@ -13,15 +13,23 @@
 #include <lib/ktrace.h>
 
 #include <magenta/port_dispatcher.h>
+#include <magenta/port_observer.h>
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
+#include <magenta/state_tracker.h>
 
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
 #define LOCAL_TRACE 0
 
+constexpr uint32_t kMaxPortWaitManyCount = 1024u;
+
+// Covers the common small batches without going to the heap.
+constexpr size_t kPortWaitManyInlineCount = 8u;
+
 mx_status_t sys_port_create(uint32_t options, user_ptr<mx_handle_t> out) {
     LTRACEF("options %u\n", options);
 
@@ -74,6 +82,19 @@ mx_status_t sys_port_queue(mx_handle_t handle, user_ptr<const void> packet, size
     return port->Queue(iopk);
 }
 
+// Copies |result| out to |packet| and releases it. Returns false if the
+// copy faulted.
+static bool CopyResultToUser(IOP_Result* result, user_ptr<void> packet, size_t size) {
+    if (!result->packet) {
+        // from an mx_object_wait_async() observer
+        return packet.reinterpret<mx_io_packet_t>().copy_to_user(result->observed) == NO_ERROR;
+    }
+    bool copied = result->packet->CopyToUser(packet.get(), &size);
+    IOP_Packet::Delete(result->packet);
+    result->packet = nullptr;
+    return copied;
+}
+
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t timeout,
                           user_ptr<void> packet, size_t size) {
     LTRACEF("handle %d\n", handle);
@@ -90,17 +111,62 @@ mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t timeout,
 
     ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
 
-    IOP_Packet* iopk = nullptr;
-    status = port->Wait(timeout, &iopk);
+    IOP_Result result;
+    size_t count;
+    status = port->Wait(timeout, size, &result, 1u, &count);
+
+    ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), status, 0, 0);
+    if (status < 0)
+        return status;
+
+    return CopyResultToUser(&result, packet, size) ? NO_ERROR : ERR_INVALID_ARGS;
+}
+
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t timeout,
+                               user_ptr<void> packets, size_t size, uint32_t count,
+                               user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (!packets || !count || count > kMaxPortWaitManyCount)
+        return ERR_INVALID_ARGS;
+    if (size > SIZE_MAX / count)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcher> port;
+    mx_status_t status = up->GetDispatcher(handle, &port, MX_RIGHT_READ);
+    if (status != NO_ERROR)
+        return status;
+
+    AllocChecker ac;
+    mxtl::InlineArray<IOP_Result, kPortWaitManyInlineCount> results(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), count, 0, 0);
+
+    size_t actual;
+    status = port->Wait(timeout, size, results.get(), count, &actual);
 
     ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), status, 0, 0);
     if (status < 0)
         return status;
 
-    if (!iopk->CopyToUser(packet.get(), &size))
+    // Every packet has to be released, even once a copy has faulted.
+    bool copied = true;
+    for (size_t ix = 0; ix != actual; ++ix) {
+        if (copied) {
+            copied = CopyResultToUser(&results[ix], packets.byte_offset(ix * size), size);
+        } else {
+            IOP_Packet::Delete(results[ix].packet);
+        }
+    }
+    if (!copied)
         return ERR_INVALID_ARGS;
 
-    IOP_Packet::Delete(iopk);
+    if (_actual.copy_to_user(static_cast<uint32_t>(actual)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
     return NO_ERROR;
 }
 
@@ -134,3 +200,44 @@ mx_status_t sys_port_bind(mx_handle_t handle, uint64_t key,
 
     return source_disp->set_port_client(mxtl::move(client));
 }
+
+mx_status_t sys_object_wait_async(mx_handle_t handle_value, mx_handle_t port_handle,
+                                  uint64_t key, mx_signals_t signals, uint32_t options) {
+    LTRACEF("handle %d port %d\n", handle_value, port_handle);
+
+    if (!signals)
+        return ERR_INVALID_ARGS;
+    if (options != MX_WAIT_ASYNC_ONCE && options != MX_WAIT_ASYNC_REPEATING)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcher> port;
+    mx_status_t status = up->GetDispatcher(port_handle, &port, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    // The handle must stay in the table until the observer is added, or
+    // we could miss the cancel that comes with closing it.
+    AutoLock lock(up->handle_table_lock());
+
+    Handle* handle = up->GetHandle_NoLock(handle_value);
+    if (!handle)
+        return up->BadHandle(handle_value, ERR_BAD_HANDLE);
+    if (!magenta_rights_check(handle->rights(), MX_RIGHT_READ))
+        return up->BadHandle(handle_value, ERR_ACCESS_DENIED);
+
+    auto state_tracker = handle->dispatcher()->get_state_tracker();
+    if (!state_tracker)
+        return ERR_NOT_SUPPORTED;
+
+    AllocChecker ac;
+    auto observer = new (&ac) PortObserver(options == MX_WAIT_ASYNC_REPEATING, handle,
+                                           mxtl::move(port), key, signals);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    // From here on the observer owns itself.
+    state_tracker->AddObserver(observer);
+    return NO_ERROR;
+}
@@ -20,3 +20,12 @@
 #define MAGENTA_VDSOCALL_DEF(ret, name, args...) // Nothing to do here.
 
 #include <magenta/syscalls.inc>
+
+// Syscall numbers are sparse, so per-syscall tables are indexed by the
+// order of the syscalls in syscalls.inc instead.
+enum : uint32_t {
+#define MAGENTA_SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) kSyscallIndex_##name,
+#define MAGENTA_VDSOCALL_DEF(ret, name, args...) // Nothing to do here.
+#include <magenta/syscalls.inc>
+    kSyscallCount,
+};
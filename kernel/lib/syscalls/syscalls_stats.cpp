@@ -0,0 +1,203 @@
+// Copyright 2016 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/syscall_stats.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <new.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <kernel/cmdline.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <lib/console.h>
+#include <lib/ktrace.h>
+#include <lk/init.h>
+
+#include "syscalls_priv.h"
+
+bool syscall_stats_on;
+
+namespace {
+
+struct SyscallInfo {
+    const char* name;
+    uint32_t num;
+};
+
+const SyscallInfo kSyscalls[] = {
+#define MAGENTA_SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) { #name, n },
+#define MAGENTA_VDSOCALL_DEF(ret, name, args...) // Nothing to do here.
+#include <magenta/syscalls.inc>
+};
+static_assert(countof(kSyscalls) == kSyscallCount, "");
+
+struct Counters {
+    uint64_t count;
+    lk_bigtime_t total_time;
+    uint64_t latency[SYSCALL_STATS_BUCKETS];
+};
+
+// kSyscallCount Counters for each cpu, allocated the first time collection
+// is turned on and never freed, so a call that saw collection on can always
+// record itself. Only the cpu a call finishes on writes its counters, with
+// interrupts off; readers and reset race with that, which is fine for
+// statistics.
+Counters* counters;
+
+mutex_t enable_lock = MUTEX_INITIAL_VALUE(enable_lock);
+
+uint latency_bucket(lk_bigtime_t ns) {
+    if (ns < (1u << 8))
+        return 0;
+    uint bucket = (63 - __builtin_clzll(ns)) - 7;
+    return MIN(bucket, SYSCALL_STATS_BUCKETS - 1u);
+}
+
+size_t num_counters() {
+    return arch_max_num_cpus() * static_cast<size_t>(kSyscallCount);
+}
+
+// Sums syscall |i|'s counters over all cpus.
+void sum_counters(const Counters* c, size_t i, syscall_stats* s) {
+    memset(s, 0, sizeof(*s));
+    s->name = kSyscalls[i].name;
+    s->num = kSyscalls[i].num;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        const Counters& cc = c[cpu * kSyscallCount + i];
+        s->count += cc.count;
+        s->total_time += cc.total_time;
+        for (uint b = 0; b < SYSCALL_STATS_BUCKETS; b++)
+            s->latency[b] += cc.latency[b];
+    }
+}
+
+} // namespace
+
+status_t syscall_stats_enable(bool enable) {
+    mutex_acquire(&enable_lock);
+    if (enable && !counters) {
+        AllocChecker ac;
+        Counters* c = new (&ac) Counters[num_counters()]();
+        if (!ac.check()) {
+            mutex_release(&enable_lock);
+            return ERR_NO_MEMORY;
+        }
+        __atomic_store_n(&counters, c, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&syscall_stats_on, enable, __ATOMIC_RELEASE);
+    mutex_release(&enable_lock);
+    return NO_ERROR;
+}
+
+void syscall_stats_reset(void) {
+    Counters* c = __atomic_load_n(&counters, __ATOMIC_ACQUIRE);
+    if (c)
+        memset(c, 0, num_counters() * sizeof(*c));
+}
+
+ssize_t syscall_stats_get(struct syscall_stats* stats, size_t count) {
+    const Counters* c = __atomic_load_n(&counters, __ATOMIC_ACQUIRE);
+    if (!c)
+        return ERR_NOT_SUPPORTED;
+
+    count = MIN(count, static_cast<size_t>(kSyscallCount));
+    for (size_t i = 0; i < count; i++)
+        sum_counters(c, i, &stats[i]);
+    return kSyscallCount;
+}
+
+void syscall_stats_ktrace(void) {
+    const Counters* c = __atomic_load_n(&counters, __ATOMIC_ACQUIRE);
+    if (!c)
+        return;
+
+    for (size_t i = 0; i < kSyscallCount; i++) {
+        syscall_stats s;
+        sum_counters(c, i, &s);
+        if (s.count == 0)
+            continue;
+        uint64_t time = s.total_time;
+        ktrace(TAG_SYSCALL_STATS, s.num, static_cast<uint32_t>(MIN(s.count, UINT32_MAX)),
+               static_cast<uint32_t>(time), static_cast<uint32_t>(time >> 32));
+    }
+}
+
+void syscall_stats_end(uint32_t index, lk_bigtime_t start) {
+    if (start == 0 || index >= kSyscallCount)
+        return;
+    lk_bigtime_t ns = current_time_hires() - start;
+
+    Counters* c = __atomic_load_n(&counters, __ATOMIC_ACQUIRE);
+    if (!c)
+        return;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    Counters* cc = &c[arch_curr_cpu_num() * kSyscallCount + index];
+    cc->count++;
+    cc->total_time += ns;
+    cc->latency[latency_bucket(ns)]++;
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+static void syscall_stats_init(uint level) {
+    if (cmdline_get_bool("kernel.syscall-stats", false))
+        syscall_stats_enable(true);
+}
+
+LK_INIT_HOOK(syscall_stats, syscall_stats_init, LK_INIT_LEVEL_APPS - 1);
+
+static void dump_syscall_stats(void) {
+    const Counters* c = __atomic_load_n(&counters, __ATOMIC_ACQUIRE);
+    if (!c) {
+        printf("syscall stats were never turned on\n");
+        return;
+    }
+
+    printf("%-24s %12s %14s %10s\n", "syscall", "calls", "total ns", "avg ns");
+    for (size_t i = 0; i < kSyscallCount; i++) {
+        syscall_stats s;
+        sum_counters(c, i, &s);
+        if (s.count == 0)
+            continue;
+        printf("%-24s %12" PRIu64 " %14" PRIu64 " %10" PRIu64 "\n",
+               s.name, s.count, s.total_time, s.total_time / s.count);
+    }
+}
+
+static int cmd_syscalls(int argc, const cmd_args* argv) {
+    if (argc < 2) {
+    usage:
+        printf("usage:\n");
+        printf("%s on    : start counting syscalls\n", argv[0].str);
+        printf("%s off   : stop counting syscalls\n", argv[0].str);
+        printf("%s reset : zero the counts\n", argv[0].str);
+        printf("%s dump  : show the counts\n", argv[0].str);
+        return -1;
+    }
+
+    if (!strcmp(argv[1].str, "on")) {
+        return syscall_stats_enable(true);
+    } else if (!strcmp(argv[1].str, "off")) {
+        return syscall_stats_enable(false);
+    } else if (!strcmp(argv[1].str, "reset")) {
+        syscall_stats_reset();
+    } else if (!strcmp(argv[1].str, "dump")) {
+        dump_syscall_stats();
+    } else {
+        printf("unrecognized subcommand\n");
+        goto usage;
+    }
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("syscalls", "per-syscall counts and latency", &cmd_syscalls)
+STATIC_COMMAND_END(syscalls);
@@ -29,7 +29,10 @@
 #include <magenta/thread_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <magenta/vm_object_dispatcher.h>
 
+#include <mxtl/algorithm.h>
+#include <mxtl/inline_array.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/string_piece.h>
 
@@ -37,15 +40,25 @@
 
 #define LOCAL_TRACE 0
 
+constexpr uint32_t kMaxProcessStartMaps = 64u;
+
+// Enough for a stack and a few more, without going to the heap.
+constexpr size_t kProcessStartMapsInlineCount = 4u;
+
+// How many handle values are copied in at a time when closing the handles
+// of a bootstrap message that couldn't be sent.
+constexpr size_t kCloseHandlesChunkCount = 16u;
+
 extern "C" {
 uint64_t get_tsc_ticks_per_ms(void);
 };
 
-mx_status_t sys_thread_create(mx_handle_t process_handle,
-                              user_ptr<const char> name, uint32_t name_len,
-                              uint32_t flags, user_ptr<mx_handle_t> out) {
-    LTRACEF("process handle %d, flags %#x\n", process_handle, flags);
-
+// Creates a thread in |process_handle|'s process and a handle to it, which
+// is not added to the caller's handle table yet.
+static mx_status_t create_thread(ProcessDispatcher* up, mx_handle_t process_handle,
+                                 user_ptr<const char> name, uint32_t name_len,
+                                 uint32_t flags, mxtl::RefPtr<ThreadDispatcher>* out_thread,
+                                 HandleUniquePtr* out_handle) {
     // copy the name to a local buffer
     char buf[MX_MAX_NAME_LEN];
     mxtl::StringPiece sp;
@@ -58,8 +71,6 @@ mx_status_t sys_thread_create(mx_handle_t process_handle,
         return ERR_INVALID_ARGS;
 
     // convert process handle to process dispatcher
-    auto up = ProcessDispatcher::GetCurrent();
-
     mxtl::RefPtr<ProcessDispatcher> process;
     result = get_process(up, process_handle, &process);
     if (result != NO_ERROR)
@@ -83,10 +94,28 @@ mx_status_t sys_thread_create(mx_handle_t process_handle,
     ktrace(TAG_THREAD_CREATE, tid, pid, 0, 0);
     ktrace_name(TAG_THREAD_NAME, tid, pid, buf);
 
-    HandleUniquePtr handle(MakeHandle(mxtl::move(thread_dispatcher), thread_rights));
-    if (!handle)
+    *out_thread = DownCastDispatcher<ThreadDispatcher>(mxtl::RefPtr<Dispatcher>(thread_dispatcher));
+    out_handle->reset(MakeHandle(mxtl::move(thread_dispatcher), thread_rights));
+    if (!*out_handle)
         return ERR_NO_MEMORY;
 
+    return NO_ERROR;
+}
+
+mx_status_t sys_thread_create(mx_handle_t process_handle,
+                              user_ptr<const char> name, uint32_t name_len,
+                              uint32_t flags, user_ptr<mx_handle_t> out) {
+    LTRACEF("process handle %d, flags %#x\n", process_handle, flags);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    HandleUniquePtr handle;
+    mx_status_t status = create_thread(up, process_handle, name, name_len, flags,
+                                       &thread, &handle);
+    if (status != NO_ERROR)
+        return status;
+
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
     up->AddHandle(mxtl::move(handle));
@@ -112,6 +141,38 @@ mx_status_t sys_thread_start(mx_handle_t thread_handle, uintptr_t entry,
     return thread->Start(entry, stack, arg1, arg2, /* initial_thread= */ false);
 }
 
+mx_status_t sys_thread_create_start(mx_handle_t process_handle,
+                                    user_ptr<const char> name, uint32_t name_len,
+                                    uintptr_t entry, uintptr_t stack,
+                                    uintptr_t arg1, uintptr_t arg2,
+                                    user_ptr<mx_handle_t> out) {
+    LTRACEF("process handle %d, entry %#" PRIxPTR ", sp %#" PRIxPTR
+            ", arg1 %#" PRIxPTR ", arg2 %#" PRIxPTR "\n",
+            process_handle, entry, stack, arg1, arg2);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    HandleUniquePtr handle;
+    mx_status_t status = create_thread(up, process_handle, name, name_len, 0u,
+                                       &thread, &handle);
+    if (status != NO_ERROR)
+        return status;
+
+    // The new thread may use its handle as soon as it runs, so it has to be
+    // in place first.
+    mx_handle_t handle_value = up->MapHandleToValue(handle.get());
+    if (out.copy_to_user(handle_value) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    up->AddHandle(mxtl::move(handle));
+
+    ktrace(TAG_THREAD_START, (uint32_t)thread->get_koid(), 0, 0, 0);
+    status = thread->Start(entry, stack, arg1, arg2, /* initial_thread= */ false);
+    if (status != NO_ERROR)
+        up->RemoveHandle(handle_value);
+    return status;
+}
+
 void sys_thread_exit() {
     LTRACE_ENTRY;
     UserThread::GetCurrent()->Exit();
@@ -241,31 +302,33 @@ mx_status_t sys_process_create(mx_handle_t job_handle,
 // - maintains the state machine invariant that 'started' processes have one
 //   thread running
 
-mx_status_t sys_process_start(mx_handle_t process_handle, mx_handle_t thread_handle,
-                              uintptr_t pc, uintptr_t sp,
-                              mx_handle_t arg_handle_value, uintptr_t arg2) {
-    LTRACEF("phandle %d, thandle %d, pc %#" PRIxPTR ", sp %#" PRIxPTR
-            ", arg_handle %d, arg2 %#" PRIxPTR "\n",
-            process_handle, thread_handle, pc, sp, arg_handle_value, arg2);
-
-    auto up = ProcessDispatcher::GetCurrent();
-
+// Looks up the process and its initial thread for sys_process_start and
+// sys_process_start_etc.
+static mx_status_t get_process_and_thread(ProcessDispatcher* up,
+                                          mx_handle_t process_handle,
+                                          mx_handle_t thread_handle,
+                                          mxtl::RefPtr<ProcessDispatcher>* process,
+                                          mxtl::RefPtr<ThreadDispatcher>* thread) {
     // get process dispatcher
-    mxtl::RefPtr<ProcessDispatcher> process;
-    mx_status_t status = get_process(up, process_handle, &process);
+    mx_status_t status = get_process(up, process_handle, process);
     if (status != NO_ERROR)
         return status;
 
     // get thread_dispatcher
-    mxtl::RefPtr<ThreadDispatcher> thread;
-    status = up->GetDispatcher(thread_handle, &thread, MX_RIGHT_WRITE);
+    status = up->GetDispatcher(thread_handle, thread, MX_RIGHT_WRITE);
     if (status != NO_ERROR)
         return status;
 
     // test that the thread belongs to the starting process
-    if (thread->thread()->process() != process.get())
+    if ((*thread)->thread()->process() != process->get())
         return ERR_ACCESS_DENIED;
 
+    return NO_ERROR;
+}
+
+static mx_status_t start_process(ProcessDispatcher* up, ProcessDispatcher* process,
+                                 ThreadDispatcher* thread, uintptr_t pc, uintptr_t sp,
+                                 mx_handle_t arg_handle_value, uintptr_t arg2) {
     // XXX test that handle has TRANSFER rights before we remove it from the source process
 
     HandleUniquePtr arg_handle = up->RemoveHandle(arg_handle_value);
@@ -283,6 +346,131 @@ mx_status_t sys_process_start(mx_handle_t process_handle, mx_handle_t thread_han
     return thread->Start(pc, sp, arg_nhv, arg2, /* initial_thread= */ true);
 }
 
+mx_status_t sys_process_start(mx_handle_t process_handle, mx_handle_t thread_handle,
+                              uintptr_t pc, uintptr_t sp,
+                              mx_handle_t arg_handle_value, uintptr_t arg2) {
+    LTRACEF("phandle %d, thandle %d, pc %#" PRIxPTR ", sp %#" PRIxPTR
+            ", arg_handle %d, arg2 %#" PRIxPTR "\n",
+            process_handle, thread_handle, pc, sp, arg_handle_value, arg2);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ProcessDispatcher> process;
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    mx_status_t status = get_process_and_thread(up, process_handle, thread_handle,
+                                                &process, &thread);
+    if (status != NO_ERROR)
+        return status;
+
+    return start_process(up, process.get(), thread.get(), pc, sp, arg_handle_value, arg2);
+}
+
+// Makes the mappings for sys_process_start_etc, giving back where they went.
+static mx_status_t map_for_start(ProcessDispatcher* up, ProcessDispatcher* process,
+                                 user_ptr<mx_process_map_t> _maps, uint32_t num_maps,
+                                 uint32_t stack_map, uintptr_t* stack_addr) {
+    if (num_maps > kMaxProcessStartMaps)
+        return ERR_OUT_OF_RANGE;
+    if (num_maps == 0u)
+        return NO_ERROR;
+    if (!_maps)
+        return ERR_INVALID_ARGS;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_process_map_t, kProcessStartMapsInlineCount> maps(&ac, num_maps);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    if (_maps.copy_array_from_user(maps.get(), num_maps) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    for (uint32_t i = 0; i < num_maps; ++i) {
+        mx_process_map_t* m = &maps[i];
+        mxtl::RefPtr<VmObjectDispatcher> vmo;
+        uint32_t vmo_rights;
+        mx_status_t status = up->GetDispatcher(m->vmo, &vmo, &vmo_rights);
+        if (status != NO_ERROR)
+            return status;
+        status = process->Map(mxtl::move(vmo), vmo_rights, m->offset, m->len,
+                              &m->addr, m->flags);
+        if (status != NO_ERROR)
+            return status;
+    }
+
+    if (_maps.copy_array_to_user(maps.get(), num_maps) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (stack_map != MX_PROCESS_START_NO_MAP)
+        *stack_addr = maps[stack_map].addr;
+    return NO_ERROR;
+}
+
+// Closes as many of the handles in |_handles| as are valid. Unlike
+// sys_handle_close_many(), a bad or repeated value doesn't stop the rest
+// from being closed.
+static void close_handles_best_effort(ProcessDispatcher* up,
+                                      user_ptr<const mx_handle_t> _handles,
+                                      uint32_t num_handles) {
+    mx_handle_t values[kCloseHandlesChunkCount];
+    size_t num_closed = 0;
+    while (num_closed < num_handles) {
+        size_t this_chunk_size = mxtl::min(num_handles - num_closed, kCloseHandlesChunkCount);
+        if (_handles.element_offset(num_closed).copy_array_from_user(
+                values, this_chunk_size) != NO_ERROR)
+            return;
+        for (size_t i = 0; i < this_chunk_size; i++)
+            HandleUniquePtr handle(up->RemoveHandle(values[i]));
+        num_closed += this_chunk_size;
+    }
+}
+
+// This does what a launcher would otherwise do with a mx_process_map_vm()
+// per mapping, a mx_channel_write() of the bootstrap message and a
+// mx_process_start(), in that order. If it fails, mappings already made
+// stay made and the process is not started, but the message's handles are
+// gone either way so the caller need not work out which step failed.
+mx_status_t sys_process_start_etc(mx_handle_t process_handle, mx_handle_t thread_handle,
+                                  user_ptr<const mx_process_start_t> _args,
+                                  user_ptr<mx_process_map_t> _maps, uint32_t num_maps) {
+    LTRACEF("phandle %d, thandle %d, num_maps %u\n", process_handle, thread_handle, num_maps);
+
+    mx_process_start_t args;
+    if (_args.copy_from_user(&args) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ProcessDispatcher> process;
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    uintptr_t stack_addr = 0u;
+    mx_status_t status = ERR_INVALID_ARGS;
+    if (args.stack_map == MX_PROCESS_START_NO_MAP || args.stack_map < num_maps) {
+        status = get_process_and_thread(up, process_handle, thread_handle,
+                                        &process, &thread);
+    }
+    if (status == NO_ERROR)
+        status = map_for_start(up, process.get(), _maps, num_maps, args.stack_map, &stack_addr);
+
+    if (args.bootstrap != MX_HANDLE_INVALID) {
+        if (status == NO_ERROR) {
+            status = sys_channel_write(args.bootstrap, 0u,
+                                       user_ptr<const void>(args.msg.bytes), args.msg.num_bytes,
+                                       user_ptr<const mx_handle_t>(args.msg.handles),
+                                       args.msg.num_handles);
+        }
+        if (status != NO_ERROR) {
+            if (args.msg.num_handles > 0u) {
+                close_handles_best_effort(up, user_ptr<const mx_handle_t>(args.msg.handles),
+                                          args.msg.num_handles);
+            }
+            return status;
+        }
+    }
+    if (status != NO_ERROR)
+        return status;
+
+    return start_process(up, process.get(), thread.get(), args.entry, args.stack + stack_addr,
+                         args.arg_handle, args.arg2);
+}
+
 void sys_process_exit(int retcode) {
     LTRACEF("retcode %d\n", retcode);
     ProcessDispatcher::GetCurrent()->Exit(retcode);
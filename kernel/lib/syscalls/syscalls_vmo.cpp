@@ -14,7 +14,10 @@
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
 
+#include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/pager_dispatcher.h>
+#include <magenta/port_dispatcher.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
 #include <magenta/vm_object_dispatcher.h>
@@ -28,14 +31,38 @@
 mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t> out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
-    if (options)
+    if (options & ~(MX_VMO_PURGEABLE | MX_VMO_NUMA_INTERLEAVE | MX_VMO_NUMA_BIND |
+                    MX_VMO_NUMA_NODE_MASK))
         return ERR_INVALID_ARGS;
 
+    // memory userspace asked for may be compressed while it sits idle
+    uint32_t vmo_options = VmObjectPaged::kCompressible;
+    if (options & MX_VMO_PURGEABLE)
+        vmo_options |= VmObjectPaged::kPurgeable;
+    if (options & MX_VMO_NUMA_INTERLEAVE)
+        vmo_options |= VmObjectPaged::kNumaInterleave;
+
+    // a node may only be named to bind to, and an object can't be both bound
+    // and interleaved
+    uint32_t pmm_alloc_flags = 0;
+    uint node = (options & MX_VMO_NUMA_NODE_MASK) >> MX_VMO_NUMA_NODE_SHIFT;
+    if (options & MX_VMO_NUMA_BIND) {
+        if ((options & MX_VMO_NUMA_INTERLEAVE) || node >= pmm_numa_node_count())
+            return ERR_INVALID_ARGS;
+        pmm_alloc_flags = PMM_ALLOC_FLAG_NODE(node) | PMM_ALLOC_FLAG_BIND;
+    } else if (node != 0) {
+        return ERR_INVALID_ARGS;
+    }
+
     // create a vm object
-    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0, size);
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(pmm_alloc_flags, size, vmo_options);
     if (!vmo)
         return ERR_NO_MEMORY;
 
+    // its pages count against the limits of the creator's job
+    auto up = ProcessDispatcher::GetCurrent();
+    vmo->SetCommitAccount(up->job()->commit_account());
+
     // create a Vm Object dispatcher
     mxtl::RefPtr<Dispatcher> dispatcher;
     mx_rights_t rights;
@@ -48,8 +75,6 @@ mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t
     if (!handle)
         return ERR_NO_MEMORY;
 
-    auto up = ProcessDispatcher::GetCurrent();
-
     if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
@@ -159,6 +184,159 @@ mx_status_t sys_vmo_op_range(mx_handle_t handle, uint32_t op, uint64_t offset, u
     return vmo->RangeOp(op, offset, size, buffer, buffer_size, vmo_rights);
 }
 
+mx_status_t sys_vmo_clone(mx_handle_t handle, uint32_t options, uint64_t offset, uint64_t size,
+                          user_ptr<mx_handle_t> _out_handle) {
+    LTRACEF("handle %d options %#x offset %#" PRIx64 " size %#" PRIx64 "\n",
+            handle, options, offset, size);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // lookup the dispatcher from handle, the clone can read everything the source can
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    mx_status_t status = up->GetDispatcher(handle, &vmo, MX_RIGHT_READ);
+    if (status != NO_ERROR)
+        return status;
+
+    // create the clone
+    mxtl::RefPtr<VmObject> clone_vmo;
+    status = vmo->Clone(options, offset, size, &clone_vmo);
+    if (status != NO_ERROR)
+        return status;
+    clone_vmo->SetCommitAccount(up->job()->commit_account());
+
+    // create a Vm Object dispatcher
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = VmObjectDispatcher::Create(mxtl::move(clone_vmo), &dispatcher, &rights);
+    if (status != NO_ERROR)
+        return status;
+
+    // create a handle and attach the dispatcher to it
+    HandleUniquePtr clone_handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!clone_handle)
+        return ERR_NO_MEMORY;
+
+    if (_out_handle.copy_to_user(up->MapHandleToValue(clone_handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(clone_handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_memory_pressure_event(user_ptr<mx_handle_t> _out_handle) {
+    LTRACE_ENTRY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // only the kernel gets to signal it
+    HandleUniquePtr handle(MakeHandle(GetMemoryPressureEvent(),
+                                      MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    if (_out_handle.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_pager_create(uint32_t options, user_ptr<mx_handle_t> out) {
+    LTRACEF("options %#x\n", options);
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    mx_status_t result = PagerDispatcher::Create(options, &dispatcher, &rights);
+    if (result != NO_ERROR)
+        return result;
+
+    HandleUniquePtr handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_pager_create_vmo(mx_handle_t pager_handle, mx_handle_t port_handle, uint64_t key,
+                                 uint64_t size, uint32_t options, user_ptr<mx_handle_t> out) {
+    LTRACEF("pager %d port %d key %#" PRIx64 " size %#" PRIx64 "\n",
+            pager_handle, port_handle, key, size);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PagerDispatcher> pager;
+    mx_status_t status = up->GetDispatcher(pager_handle, &pager, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<PortDispatcher> port;
+    status = up->GetDispatcher(port_handle, &port, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> vmo;
+    status = pager->CreateVmo(mxtl::move(port), key, size, &vmo);
+    if (status != NO_ERROR)
+        return status;
+    vmo->SetCommitAccount(up->job()->commit_account());
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+    if (status != NO_ERROR)
+        return status;
+
+    HandleUniquePtr handle(MakeHandle(mxtl::move(dispatcher), rights));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    if (out.copy_to_user(up->MapHandleToValue(handle.get())) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
+}
+
+mx_status_t sys_pager_supply_pages(mx_handle_t pager_handle, mx_handle_t pager_vmo_handle,
+                                   uint64_t offset, uint64_t length, mx_handle_t aux_vmo_handle) {
+    LTRACEF("pager %d vmo %d offset %#" PRIx64 " length %#" PRIx64 " aux %d\n",
+            pager_handle, pager_vmo_handle, offset, length, aux_vmo_handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PagerDispatcher> pager;
+    mx_status_t status = up->GetDispatcher(pager_handle, &pager, MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    // the pager is what lets us fill in its VMOs, so any handle to one will do
+    mxtl::RefPtr<VmObjectDispatcher> pager_vmo;
+    status = up->GetDispatcher(pager_vmo_handle, &pager_vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    // the pages are taken out of it, as by a read and a decommit
+    mxtl::RefPtr<VmObjectDispatcher> aux_vmo;
+    status = up->GetDispatcher(aux_vmo_handle, &aux_vmo, MX_RIGHT_READ | MX_RIGHT_WRITE);
+    if (status != NO_ERROR)
+        return status;
+
+    return pager->SupplyPages(pager_vmo->vmo(), offset, length, aux_vmo->vmo());
+}
+
 mx_status_t sys_process_map_vm(mx_handle_t proc_handle, mx_handle_t vmo_handle,
                                uint64_t offset, size_t len, user_ptr<uintptr_t> user_ptr,
                                uint32_t flags) {
@@ -266,3 +444,50 @@ mx_status_t sys_process_protect_vm(mx_handle_t proc_handle, uintptr_t address, s
 
     return vm_mapping->Protect(arch_mmu_flags);
 }
+
+mx_status_t sys_process_advise_vm(mx_handle_t proc_handle, uintptr_t address, size_t len,
+                                  uint32_t advice) {
+    LTRACEF("proc handle %d, address %#" PRIxPTR ", len %#zx, advice %u\n",
+            proc_handle, address, len, advice);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ProcessDispatcher> process;
+    mx_status_t status = get_process(up, proc_handle, &process);
+    if (status != NO_ERROR)
+        return status;
+
+    // get a reffed pointer to the address space in the target process
+    mxtl::RefPtr<VmAspace> aspace = process->aspace();
+    if (!aspace)
+        return ERR_INVALID_ARGS;
+
+    // like protect, only the mapping at a given address for now, signaled with len = 0
+    if (len != 0)
+        return ERR_INVALID_ARGS;
+
+    VmMapping::Advice vm_advice;
+    switch (advice) {
+    case MX_VM_ADVICE_NORMAL:
+        vm_advice = VmMapping::Advice::NORMAL;
+        break;
+    case MX_VM_ADVICE_SEQUENTIAL:
+        vm_advice = VmMapping::Advice::SEQUENTIAL;
+        break;
+    case MX_VM_ADVICE_RANDOM:
+        vm_advice = VmMapping::Advice::RANDOM;
+        break;
+    default:
+        return ERR_INVALID_ARGS;
+    }
+
+    auto r = aspace->FindRegion(address);
+    if (!r)
+        return ERR_INVALID_ARGS;
+
+    auto vm_mapping = r->as_vm_mapping();
+    if (!vm_mapping)
+        return ERR_INVALID_ARGS;
+
+    return vm_mapping->Advise(vm_advice);
+}
@@ -24,4 +24,18 @@ struct vdso_constants {
     // of the booted system.
     uint32_t max_num_cpus;
 
+    // Nonzero if MX_CLOCK_MONOTONIC is the tick counter scaled by
+    // |ns_per_tick|, so that the vDSO can compute it without a syscall.
+    uint32_t ticks_to_time_valid;
+
+    // Frequency of the tick counter the vDSO reads, or 0 if user mode
+    // can't read one and mx_ticks_get() has to fall back to the kernel.
+    uint64_t ticks_per_second;
+
+    // Nanoseconds per tick as a 32.64 fixed point number, with the same
+    // layout as struct fp_32_64 in <lib/fixed_point.h>.
+    uint32_t ns_per_tick_l0;
+    uint32_t ns_per_tick_l32;
+    uint32_t ns_per_tick_l64;
+
 };
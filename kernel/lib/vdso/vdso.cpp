@@ -9,6 +9,8 @@
 
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/fixed_point.h>
+#include <platform.h>
 
 #include "vdso-code.h"
 
@@ -64,7 +66,14 @@ VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {
     // Rather than assigning each member individually, do this with
     // struct assignment and a compound literal so that the compiler
     // can warn if the initializer list omits any member.
+    fp_32_64 ns_per_tick = {};
+    bool ticks_to_time_valid = platform_user_ticks_to_ns(&ns_per_tick);
     *constants_window.data() = (vdso_constants) {
         arch_max_num_cpus(),
+        ticks_to_time_valid,
+        platform_user_ticks_per_second(),
+        ns_per_tick.l0,
+        ns_per_tick.l32,
+        ns_per_tick.l64,
     };
 }
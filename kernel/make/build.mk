@@ -115,10 +115,12 @@ USER_MANIFEST_DEPS := $(foreach x,$(USER_MANIFEST_LINES),$(lastword $(subst =,$(
 
 $(info MKBOOTFS $(MKBOOTFS))
 
+# Compress each file on its own, so that only the ones that are used get
+# decompressed at boot.
 $(USER_BOOTFS): $(MKBOOTFS) $(USER_MANIFEST) $(USER_MANIFEST_DEPS)
 	@echo generating $@
 	@$(MKDIR)
-	$(NOECHO)$(MKBOOTFS) -c -o $(USER_BOOTFS) $(USER_MANIFEST)
+	$(NOECHO)$(MKBOOTFS) -z -o $(USER_BOOTFS) $(USER_MANIFEST)
 
 GENERATED += $(USER_BOOTFS)
 
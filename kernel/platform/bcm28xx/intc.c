@@ -113,6 +113,10 @@ unsigned int remap_interrupt(unsigned int vector) {
     return vector;
 }
 
+status_t set_interrupt_target_cpu(unsigned int vector, int cpu) {
+    return ERR_NOT_SUPPORTED;
+}
+
 /*
  *  TODO(hollande) - Implement!
  */
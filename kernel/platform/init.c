@@ -39,3 +39,13 @@ __WEAK void *platform_get_ramdisk(size_t *size)
     *size = 0;
     return NULL;
 }
+
+__WEAK uint64_t platform_user_ticks_per_second(void)
+{
+    return 0;
+}
+
+__WEAK bool platform_user_ticks_to_ns(struct fp_32_64* ns_per_tick)
+{
+    return false;
+}
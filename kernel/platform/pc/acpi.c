@@ -8,11 +8,15 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
 #include <trace.h>
 
 #include <lk/init.h>
 
+#include <arch/mp.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
+#include <kernel/vm.h>
 #include <platform/pc/acpi.h>
 
 #define LOCAL_TRACE 0
@@ -305,3 +309,165 @@ status_t platform_find_hpet(struct acpi_hpet_descriptor *hpet)
 
     return NO_ERROR;
 }
+
+static status_t acpi_get_srat_record_limits(uintptr_t *start, uintptr_t *end)
+{
+    ACPI_TABLE_HEADER *table = NULL;
+    ACPI_STATUS status = AcpiGetTable((char *)ACPI_SIG_SRAT, 1, &table);
+    if (status != AE_OK) {
+        LTRACEF("could not find SRAT\n");
+        return ERR_NOT_FOUND;
+    }
+    ACPI_TABLE_SRAT *srat = (ACPI_TABLE_SRAT *)table;
+    uintptr_t records_start = ((uintptr_t)srat) + sizeof(*srat);
+    uintptr_t records_end = ((uintptr_t)srat) + srat->Header.Length;
+    if (records_start > records_end) {
+        TRACEF("SRAT wraps around address space\n");
+        return ERR_INTERNAL;
+    }
+    *start = records_start;
+    *end = records_end;
+    return NO_ERROR;
+}
+
+/* The proximity domains named in the SRAT, in the order they were first seen.
+ * A domain's index here is its numa node. Domains past PMM_MAX_NUMA_NODES are
+ * folded into node 0.
+ */
+static uint32_t numa_domains[PMM_MAX_NUMA_NODES];
+static uint numa_domain_count;
+
+static uint acpi_numa_node(uint32_t domain, bool add)
+{
+    for (uint i = 0; i < numa_domain_count; i++) {
+        if (numa_domains[i] == domain)
+            return i;
+    }
+    if (!add || numa_domain_count == PMM_MAX_NUMA_NODES)
+        return 0;
+
+    numa_domains[numa_domain_count] = domain;
+    return numa_domain_count++;
+}
+
+/* @brief Walk the SRAT, calling one of the callbacks for each enabled entry
+ *
+ * @param mem Called with the range and proximity domain of each memory entry.
+ * @param cpu Called with the APIC id and proximity domain of each cpu entry,
+ *        returns true to stop the walk.
+ * @param ctx Passed to the callbacks.
+ */
+static status_t acpi_walk_srat(void (*mem)(uint64_t base, uint64_t len, uint32_t domain),
+                               bool (*cpu)(uint32_t apic_id, uint32_t domain, void *ctx),
+                               void *ctx)
+{
+    uintptr_t records_start, records_end;
+    status_t status = acpi_get_srat_record_limits(&records_start, &records_end);
+    if (status != NO_ERROR)
+        return status;
+
+    uintptr_t addr;
+    for (addr = records_start; addr < records_end;) {
+        ACPI_SUBTABLE_HEADER *record_hdr = (ACPI_SUBTABLE_HEADER *)addr;
+        if (record_hdr->Length == 0)
+            break;
+
+        switch (record_hdr->Type) {
+            case ACPI_SRAT_TYPE_CPU_AFFINITY: {
+                ACPI_SRAT_CPU_AFFINITY *a = (ACPI_SRAT_CPU_AFFINITY *)record_hdr;
+                uint32_t domain = a->ProximityDomainLo |
+                                  ((uint32_t)a->ProximityDomainHi[0] << 8) |
+                                  ((uint32_t)a->ProximityDomainHi[1] << 16) |
+                                  ((uint32_t)a->ProximityDomainHi[2] << 24);
+                if ((a->Flags & ACPI_SRAT_CPU_ENABLED) && cpu && cpu(a->ApicId, domain, ctx))
+                    return NO_ERROR;
+                break;
+            }
+            case ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY: {
+                ACPI_SRAT_X2APIC_CPU_AFFINITY *a = (ACPI_SRAT_X2APIC_CPU_AFFINITY *)record_hdr;
+                if ((a->Flags & ACPI_SRAT_CPU_ENABLED) && cpu && cpu(a->ApicId, a->ProximityDomain, ctx))
+                    return NO_ERROR;
+                break;
+            }
+            case ACPI_SRAT_TYPE_MEMORY_AFFINITY: {
+                ACPI_SRAT_MEM_AFFINITY *a = (ACPI_SRAT_MEM_AFFINITY *)record_hdr;
+                if ((a->Flags & ACPI_SRAT_MEM_ENABLED) && mem)
+                    mem(a->BaseAddress, a->Length, a->ProximityDomain);
+                break;
+            }
+        }
+
+        addr += record_hdr->Length;
+    }
+    if (addr != records_end) {
+        TRACEF("malformed SRAT\n");
+        return ERR_INTERNAL;
+    }
+    return NO_ERROR;
+}
+
+static void acpi_numa_add_memory(uint64_t base, uint64_t len, uint32_t domain)
+{
+    uint node = acpi_numa_node(domain, true);
+
+    /* only whole pages can be tagged */
+    uint64_t end = ROUNDDOWN(base + len, PAGE_SIZE);
+    base = ROUNDUP(base, PAGE_SIZE);
+    if (end <= base)
+        return;
+
+    LTRACEF("memory %#" PRIx64 " - %#" PRIx64 " domain %u node %u\n", base, end, domain, node);
+
+    /* ranges with no memory behind them aren't an error */
+    status_t status = pmm_set_numa_node((paddr_t)base, (size_t)(end - base), node);
+    if (status != NO_ERROR && status != ERR_NOT_FOUND)
+        TRACEF("failed to set numa node of %#" PRIx64 " - %#" PRIx64 ": %d\n", base, end, status);
+}
+
+static bool acpi_numa_add_cpu(uint32_t apic_id, uint32_t domain, void *ctx)
+{
+    acpi_numa_node(domain, true);
+    return false;
+}
+
+/* tag the memory arenas with their nodes, before the secondary cpus start */
+static void platform_init_numa(uint level)
+{
+    if (!acpi_initialized)
+        return;
+
+    acpi_walk_srat(acpi_numa_add_memory, acpi_numa_add_cpu, NULL);
+}
+
+LK_INIT_HOOK(acpi_numa, &platform_init_numa, LK_INIT_LEVEL_VM + 2);
+
+struct acpi_numa_cpu {
+    uint32_t apic_id;
+    uint node;
+};
+
+static bool acpi_numa_find_cpu(uint32_t apic_id, uint32_t domain, void *ctx)
+{
+    struct acpi_numa_cpu *cpu = ctx;
+    if (apic_id != cpu->apic_id)
+        return false;
+
+    cpu->node = acpi_numa_node(domain, false);
+    return true;
+}
+
+/* as each cpu comes up, look up its node by its APIC id */
+static void platform_init_numa_percpu(uint level)
+{
+    if (!acpi_initialized || numa_domain_count <= 1)
+        return;
+
+    struct acpi_numa_cpu cpu = { .apic_id = x86_get_percpu()->apic_id, .node = 0 };
+    acpi_walk_srat(NULL, acpi_numa_find_cpu, &cpu);
+
+    LTRACEF("cpu %u apic id %u node %u\n", arch_curr_cpu_num(), cpu.apic_id, cpu.node);
+    pmm_set_cpu_numa_node(arch_curr_cpu_num(), cpu.node);
+}
+
+LK_INIT_HOOK_FLAGS(acpi_numa_percpu, &platform_init_numa_percpu, LK_INIT_LEVEL_THREADING,
+                   LK_INIT_FLAG_ALL_CPUS);
@@ -16,6 +16,7 @@
 #include <arch/x86.h>
 #include <arch/x86/interrupts.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/mp.h>
 #include <lk/init.h>
 #include <kernel/spinlock.h>
 #include "platform_p.h"
@@ -29,7 +30,7 @@
 
 #ifdef WITH_DEV_PCIE
 #include <dev/pcie_platform.h>
-#define MAX_IRQ_BLOCK_SIZE PCIE_MAX_MSI_IRQS
+#define MAX_IRQ_BLOCK_SIZE X86_MAX_MSIX_BLOCK_SIZE
 #else
 #define MAX_IRQ_BLOCK_SIZE (1u)
 #endif
@@ -277,7 +278,32 @@ unsigned int remap_interrupt(unsigned int vector) {
     return apic_io_isa_to_global(vector);
 }
 
+status_t set_interrupt_target_cpu(unsigned int vector, int cpu)
+{
+    if (!is_valid_interrupt(vector, 0))
+        return ERR_INVALID_ARGS;
+
+    // With no particular cpu asked for, the interrupt goes back to the
+    // bootstrap processor, where it was first configured to go.
+    uint32_t apic_id = x86_cpu_num_to_apic_id((cpu < 0) ? 0 : (uint)cpu);
+    if (apic_id == INVALID_APIC_ID || apic_id > 0xff)
+        return ERR_INVALID_ARGS;
+
+    apic_io_configure_irq_dst(vector, DST_MODE_PHYSICAL, (uint8_t)apic_id);
+    return NO_ERROR;
+}
+
 #ifdef WITH_DEV_PCIE
+static uint32_t x86_msi_apic_tgt_addr(uint32_t apic_id) {
+    // See section 10.11.1 of the Intel 64 and IA-32 Architectures Software
+    // Developer's Manual Volume 3A.
+    uint32_t tgt_addr = 0xFEE00000;                 // base addr
+    tgt_addr |= (apic_id & 0xFF) << 12;             // Dest ID
+    tgt_addr |= 0x08;                               // Redir hint == 1
+    tgt_addr &= ~0x04;                              // Dest Mode == Physical
+    return tgt_addr;
+}
+
 status_t x86_alloc_msi_block(uint requested_irqs,
                              bool can_target_64bit,
                              bool is_msix,
@@ -288,7 +314,10 @@ status_t x86_alloc_msi_block(uint requested_irqs,
     if (out_block->allocated)
         return ERR_BAD_STATE;
 
-    if (!requested_irqs || (requested_irqs > PCIE_MAX_MSI_IRQS))
+    // MSI-X vectors each have their own address and data, but a block is
+    // still handed out as one naturally aligned range of vectors.
+    uint max_irqs = is_msix ? X86_MAX_MSIX_BLOCK_SIZE : PCIE_MAX_MSI_IRQS;
+    if (!requested_irqs || (requested_irqs > max_irqs))
         return ERR_INVALID_ARGS;
 
     status_t res;
@@ -297,19 +326,13 @@ status_t x86_alloc_msi_block(uint requested_irqs,
 
     res = p2ra_allocate_range(&x86_irq_vector_allocator, alloc_size, &alloc_start);
     if (res == NO_ERROR) {
-        // Compute the target address.
-        // See section 10.11.1 of the Intel 64 and IA-32 Architectures Software
-        // Developer's Manual Volume 3A.
+        // Compute the target address.  The block starts out bound to the
+        // Local APIC of the processor which is active when calling
+        // alloc_msi_block; x86_retarget_msi_block moves it elsewhere.
         //
-        // TODO(johngro) : don't just bind this block to the Local APIC of the
-        // processor which is active when calling alloc_msi_block.  Instead,
-        // there should either be a system policy (like, always send to any
-        // processor, or just processor 0, or something), or the decision of
-        // which CPUs to bind to should be left to the caller.
-        uint32_t tgt_addr = 0xFEE00000;                 // base addr
-        tgt_addr |= ((uint32_t)apic_local_id()) << 12;  // Dest ID == our local APIC ID
-        tgt_addr |= 0x08;                               // Redir hint == 1
-        tgt_addr &= ~0x04;                              // Dest Mode == Physical
+        // TODO(johngro) : there should be a system policy for the initial
+        // target (like, always send to any processor, or just processor 0).
+        uint32_t tgt_addr = x86_msi_apic_tgt_addr(apic_local_id());
 
         // Compute the target data.
         // See section 10.11.2 of the Intel 64 and IA-32 Architectures Software
@@ -341,6 +364,20 @@ void x86_free_msi_block(pcie_msi_block_t* block) {
     memset(block, 0, sizeof(*block));
 }
 
+status_t x86_msi_target_addr(int cpu, uint64_t* out_tgt_addr) {
+    uint32_t apic_id = x86_cpu_num_to_apic_id((cpu < 0) ? 0 : (uint)cpu);
+    if (apic_id == INVALID_APIC_ID || apic_id > 0xff)
+        return ERR_INVALID_ARGS;
+
+    *out_tgt_addr = x86_msi_apic_tgt_addr(apic_id);
+    return NO_ERROR;
+}
+
+status_t x86_retarget_msi_block(pcie_msi_block_t* block, int cpu) {
+    DEBUG_ASSERT(block && block->allocated);
+    return x86_msi_target_addr(cpu, &block->tgt_addr);
+}
+
 void x86_register_msi_handler(const pcie_msi_block_t* block,
                               uint                    msi_id,
                               int_handler             handler,
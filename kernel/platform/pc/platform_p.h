@@ -20,6 +20,11 @@ __BEGIN_CDECLS
  * architectural devices often occupy this area */
 #define HIGH_ADDRESS_LIMIT 0xfec00000
 
+/* The largest block of vectors handed to one device for MSI-X.  Every cpu
+ * shares the one vector space, and the largest aligned block which fits in
+ * it holds 64. */
+#define X86_MAX_MSIX_BLOCK_SIZE 64u
+
 extern paddr_t pcie_mem_lo_base;
 extern size_t pcie_mem_lo_size;
 
@@ -34,6 +39,8 @@ void platform_mem_init(void);
 status_t x86_alloc_msi_block(uint requested_irqs, bool can_target_64bit,
                              bool is_msix, pcie_msi_block_t* out_block);
 void x86_free_msi_block(pcie_msi_block_t* block);
+status_t x86_retarget_msi_block(pcie_msi_block_t* block, int cpu);
+status_t x86_msi_target_addr(int cpu, uint64_t* out_tgt_addr);
 void x86_register_msi_handler(const pcie_msi_block_t* block,
                               uint msi_id,
                               int_handler handler,
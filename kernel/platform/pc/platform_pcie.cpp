@@ -67,6 +67,18 @@ public:
         x86_free_msi_block(block);
     }
 
+    status_t RetargetMsiBlock(pcie_msi_block_t* block, int cpu) override {
+        return x86_retarget_msi_block(block, cpu);
+    }
+
+    status_t GetMsiTargetAddr(const pcie_msi_block_t* block,
+                              int cpu,
+                              uint64_t* out_tgt_addr) override {
+        return x86_msi_target_addr(cpu, out_tgt_addr);
+    }
+
+    uint max_msix_block_size() const override { return X86_MAX_MSIX_BLOCK_SIZE; }
+
     void RegisterMsiHandler(const pcie_msi_block_t* block,
                             uint                    msi_id,
                             int_handler             handler,
@@ -167,6 +167,20 @@ lk_bigtime_t current_time_hires(void)
     return time;
 }
 
+uint64_t platform_user_ticks_per_second(void)
+{
+    // The TSC is only calibrated if it runs at a constant rate.
+    return tsc_ticks_per_ms * 1000;
+}
+
+bool platform_user_ticks_to_ns(struct fp_32_64* ns_per_tick)
+{
+    if (wall_clock != CLOCK_TSC)
+        return false;
+    *ns_per_tick = ns_per_tsc;
+    return true;
+}
+
 // The PIT timer will keep track of wall time if we aren't using the TSC
 static enum handler_return pit_timer_tick(void *arg)
 {
@@ -12,4 +12,6 @@
 #define GICBASE(n)  (CPUPRIV_BASE_VIRT)
 #define GICD_OFFSET (0x00000)
 #define GICC_OFFSET (0x10000)
+/* GICv3 has no memory mapped cpu interface, but a redistributor per cpu */
+#define GICR_OFFSET (0xa0000)
 
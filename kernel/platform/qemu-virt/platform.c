@@ -11,7 +11,11 @@
 #include <trace.h>
 #include <dev/display.h>
 #include <dev/hw_rng.h>
+#if WITH_DEV_INTERRUPT_ARM_GICV3
+#include <dev/interrupt/arm_gicv3.h>
+#else
 #include <dev/interrupt/arm_gicv2m.h>
+#endif
 #include <dev/timer/arm_generic.h>
 #include <dev/uart.h>
 #include <lk/init.h>
@@ -29,7 +33,9 @@
 
 #define DEFAULT_MEMORY_SIZE (MEMSIZE) /* try to fetch from the emulator via the fdt */
 
+#if !WITH_DEV_INTERRUPT_ARM_GICV3
 static const paddr_t GICV2M_REG_FRAMES[] = { GICV2M_FRAME_PHYS };
+#endif
 
 /* initial memory mappings. parsed by start.S */
 struct mmu_initial_mapping mmu_initial_mappings[] = {
@@ -106,7 +112,11 @@ void* platform_get_ramdisk(size_t *size) {
 void platform_early_init(void)
 {
     /* initialize the interrupt controller */
+#if WITH_DEV_INTERRUPT_ARM_GICV3
+    arm_gicv3_init();
+#else
     arm_gicv2m_init(GICV2M_REG_FRAMES, countof(GICV2M_REG_FRAMES));
+#endif
 
     arm_generic_timer_init(ARM_GENERIC_TIMER_PHYSICAL_INT, 0);
 
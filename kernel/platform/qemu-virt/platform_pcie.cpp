@@ -8,7 +8,9 @@
 #if WITH_DEV_PCIE
 #include <dev/pcie_bus_driver.h>
 #include <dev/pcie_platform.h>
+#if !WITH_DEV_INTERRUPT_ARM_GICV3
 #include <dev/interrupt/arm_gicv2m_msi.h>
+#endif
 #include <inttypes.h>
 #include <lk/init.h>
 #include <new.h>
@@ -33,6 +35,7 @@ public:
         return NO_ERROR;
     }
 
+#if !WITH_DEV_INTERRUPT_ARM_GICV3
     status_t AllocMsiBlock(uint requested_irqs,
                            bool can_target_64bit,
                            bool is_msix,
@@ -56,11 +59,17 @@ public:
                        bool                    mask) override {
         arm_gicv2m_mask_unmask_msi(block, msi_id, mask);
     }
+#endif
 };
 
 static void arm_qemu_pcie_init_hook(uint level) {
-    /* Initialize the MSI allocator */
+    /* Initialize the MSI allocator.  With GICv3, MSIs would go through an ITS,
+     * which isn't supported yet. */
+#if WITH_DEV_INTERRUPT_ARM_GICV3
+    status_t res = ERR_NOT_SUPPORTED;
+#else
     status_t res = arm_gicv2m_msi_init();
+#endif
     if (res != NO_ERROR)
         TRACEF("Failed to initialize MSI allocator (res = %d).  PCI will be "
                "restricted to legacy IRQ mode.\n", res);
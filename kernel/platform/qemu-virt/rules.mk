@@ -20,6 +20,9 @@ ARM_CPU ?= cortex-a15
 endif
 WITH_SMP ?= 1
 
+# which interrupt controller qemu is started with (-machine virt,gic-version=3)
+QEMU_GIC_VERSION ?= 2
+
 LK_HEAP_IMPLEMENTATION ?= cmpctmalloc
 
 MODULE_SRCS += \
@@ -37,8 +40,16 @@ MODULE_DEPS += \
     lib/cbuf \
     lib/fdt \
     dev/pcie \
-    dev/timer/arm_generic \
-    dev/interrupt/arm_gicv2m
+    dev/timer/arm_generic
+
+ifeq ($(QEMU_GIC_VERSION),3)
+ifneq ($(ARCH),arm64)
+$(error GICv3 is only supported on arm64)
+endif
+MODULE_DEPS += dev/interrupt/arm_gicv3
+else
+MODULE_DEPS += dev/interrupt/arm_gicv2m
+endif
 
 KERNEL_DEFINES += \
     MEMBASE=$(MEMBASE) \
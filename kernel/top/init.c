@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <magenta/compiler.h>
 #include <debug.h>
+#include <lib/ktrace.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -83,6 +84,10 @@ void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop
                    arch_curr_cpu_num(), found->hook, found->name, found->level, found->flags);
         }
 #endif
+        /* start of each level on the boot cpu, for the boot timeline */
+        if ((required_flag & LK_INIT_FLAG_PRIMARY_CPU) && found->level != last_called_level)
+            ktrace_boot_stage("kernel:init", found->level, 0);
+
         found->hook(found->level);
         last_called_level = found->level;
         last = found;
@@ -0,0 +1,160 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "cstate.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <acpica/acpi.h>
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/acpi.h>
+
+// Capabilities we claim in _PDC, as Intel's "Processor Vendor-Specific ACPI"
+// document lays them out: C1 and deeper states entered through mwait, and
+// C states coordinated by the OS across cpus.
+#define PDC_C_C1_HALT 0x0002u
+#define PDC_SMP_C1PT 0x0008u
+#define PDC_SMP_C2C3 0x0010u
+#define PDC_C_C1_FFH 0x0100u
+#define PDC_C_C2C3_FFH 0x0200u
+#define PDC_CAPABILITIES (PDC_C_C1_HALT | PDC_SMP_C1PT | PDC_SMP_C2C3 | \
+                          PDC_C_C1_FFH | PDC_C_C2C3_FFH)
+
+// The register of a _CST entry, a Generic Register Descriptor (ACPI v6.1
+// section 6.4.3.7)
+typedef struct {
+    uint8_t tag;
+    uint16_t length;
+    uint8_t space_id;
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __PACKED cst_register_t;
+
+// An mwait state is a functional fixed hardware register of the native C
+// state class, whose address is the mwait hint.
+#define CST_FFH_CLASS_MWAIT 2u
+
+typedef struct {
+    mx_acpi_cstate_t states[MX_ACPI_MAX_CSTATES];
+    uint32_t count;
+    bool found;
+} cstate_ctx_t;
+
+static void set_pdc(ACPI_HANDLE cpu) {
+    uint32_t pdc[3] = { 1, 1, PDC_CAPABILITIES };
+    ACPI_OBJECT arg = {
+        .Buffer.Type = ACPI_TYPE_BUFFER,
+        .Buffer.Length = sizeof(pdc),
+        .Buffer.Pointer = (uint8_t*)pdc,
+    };
+    ACPI_OBJECT_LIST args = {
+        .Count = 1,
+        .Pointer = &arg,
+    };
+    // without it the firmware may describe only states entered by port reads
+    AcpiEvaluateObject(cpu, (char*)"_PDC", &args, NULL);
+}
+
+// Takes the mwait states out of a _CST package (ACPI v6.1 section 8.4.2.1),
+// sorted by latency. The others are entered by reading a port, which we
+// don't do.
+static void parse_cst(ACPI_OBJECT* cst, cstate_ctx_t* ctx) {
+    if (cst->Type != ACPI_TYPE_PACKAGE || cst->Package.Count < 1) {
+        return;
+    }
+    for (uint32_t i = 1; i < cst->Package.Count; i++) {
+        ACPI_OBJECT* entry = &cst->Package.Elements[i];
+        if (entry->Type != ACPI_TYPE_PACKAGE || entry->Package.Count != 4) {
+            continue;
+        }
+        ACPI_OBJECT* fields = entry->Package.Elements;
+        if (fields[0].Type != ACPI_TYPE_BUFFER ||
+            fields[0].Buffer.Length < sizeof(cst_register_t) ||
+            fields[1].Type != ACPI_TYPE_INTEGER ||
+            fields[2].Type != ACPI_TYPE_INTEGER ||
+            fields[3].Type != ACPI_TYPE_INTEGER) {
+            continue;
+        }
+        const cst_register_t* reg = (const cst_register_t*)fields[0].Buffer.Pointer;
+        if (reg->space_id != ACPI_ADR_SPACE_FIXED_HARDWARE ||
+            reg->bit_offset != CST_FFH_CLASS_MWAIT) {
+            continue;
+        }
+        if (ctx->count == MX_ACPI_MAX_CSTATES) {
+            break;
+        }
+
+        mx_acpi_cstate_t state = {
+            .type = (uint32_t)fields[1].Integer.Value,
+            .mwait_hint = (uint32_t)reg->address,
+            .latency_us = (uint32_t)fields[2].Integer.Value,
+            .power_mw = (uint32_t)fields[3].Integer.Value,
+        };
+        uint32_t n = ctx->count++;
+        while (n > 0 && ctx->states[n - 1].latency_us > state.latency_us) {
+            ctx->states[n] = ctx->states[n - 1];
+            n--;
+        }
+        ctx->states[n] = state;
+    }
+}
+
+static ACPI_STATUS cstate_cpu_cb(ACPI_HANDLE cpu, uint32_t nesting_level,
+                                 void* _ctx, void** ret) {
+    cstate_ctx_t* ctx = _ctx;
+
+    // every cpu has to be told, but the states of the first one that has
+    // any stand for all of them
+    set_pdc(cpu);
+    if (ctx->found) {
+        return AE_OK;
+    }
+
+    ACPI_BUFFER buffer = {
+        .Length = ACPI_ALLOCATE_BUFFER,
+        .Pointer = NULL,
+    };
+    ACPI_STATUS status = AcpiEvaluateObject(cpu, (char*)"_CST", NULL, &buffer);
+    if (status != AE_OK) {
+        return AE_OK;
+    }
+    parse_cst(buffer.Pointer, ctx);
+    ctx->found = true;
+    ACPI_FREE(buffer.Pointer);
+    return AE_OK;
+}
+
+/* @brief Tell the kernel about the processor idle states ACPI describes
+ *
+ * Walks the processor objects, both the Processor() kind and processor
+ * devices, and hands the mwait states of the first _CST found to the kernel
+ * idle loop.
+ *
+ * @param root_resource_handle The handle to pass to the kernel.
+ *
+ * @return NO_ERROR on success, including when there are no states to give
+ */
+mx_status_t cstate_report(mx_handle_t root_resource_handle) {
+    cstate_ctx_t ctx = {};
+
+    ACPI_STATUS status = AcpiWalkNamespace(ACPI_TYPE_PROCESSOR, ACPI_ROOT_OBJECT,
+                                           ACPI_UINT32_MAX, cstate_cpu_cb, NULL,
+                                           &ctx, NULL);
+    if (status != AE_OK) {
+        return ERR_INTERNAL;
+    }
+    status = AcpiGetDevices((char*)"ACPI0007", cstate_cpu_cb, &ctx, NULL);
+    if (status != AE_OK) {
+        return ERR_INTERNAL;
+    }
+
+    if (ctx.count == 0) {
+        return NO_ERROR;
+    }
+    return mx_acpi_set_cstates(root_resource_handle, ctx.states, ctx.count);
+}
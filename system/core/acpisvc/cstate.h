@@ -0,0 +1,9 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+
+mx_status_t cstate_report(mx_handle_t root_resource_handle);
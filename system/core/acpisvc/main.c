@@ -9,6 +9,7 @@
 #include <magenta/syscalls.h>
 #include <mxio/util.h>
 
+#include "cstate.h"
 #include "ec.h"
 #include "pci.h"
 #include "powerbtn.h"
@@ -54,6 +55,11 @@ int main(int argc, char** argv) {
         printf("WARNING: ACPI failed to report all current resources!\n");
     }
 
+    mx_status = cstate_report(root_resource_handle);
+    if (mx_status != NO_ERROR && mx_status != ERR_NOT_SUPPORTED) {
+        printf("WARNING: ACPI failed to report processor idle states: %d\n", mx_status);
+    }
+
     return begin_processing(acpi_root);
 }
 
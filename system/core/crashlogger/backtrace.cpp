@@ -22,13 +22,16 @@
 #include <magenta/syscalls/object.h>
 
 #include <mxtl/array.h>
+#include <mxtl/unique_ptr.h>
 
 #include "backtrace.h"
 #include "dso-list.h"
 #include "utils.h"
 
 // Keep open debug info for this many files.
-constexpr size_t kDebugInfoCacheNumWays = 2;
+// The cache outlives each crash, so this wants to cover the handful of
+// DSOs a crash loop keeps going through.
+constexpr size_t kDebugInfoCacheNumWays = 8;
 
 // Error callback for libbacktrace.
 
@@ -51,39 +54,43 @@ bt_so_iterator (void* iter_state, backtrace_so_callback* callback, void* data) {
     return 1;
 }
 
-// A cache of data stored for each shared lib.
-// This lets us lazily obtain debug info, and only keep
-// a subset of it in memory.
+// A cache of debug info, by build id, kept from one crash to the next.
+// This lets us lazily obtain debug info, only keep a subset of it in
+// memory, and not parse it again each time the same binary crashes.
+// The libbacktrace state is for the DSO loaded at 0, so it is looked up
+// by the pc relative to where the DSO is in the crashing process.
 class DebugInfoCache {
  public:
-    DebugInfoCache(dsoinfo_t* dso_list, size_t nr_ways);
+    explicit DebugInfoCache(size_t nr_ways);
     ~DebugInfoCache();
 
-    dsoinfo_t* dso_list() { return dso_list_; }
+    // Whether a backtrace is using the cache. If crashlogger crashes
+    // while one is, the backtrace of itself doesn't use it.
+    bool in_use() const { return in_use_; }
+    void set_in_use(bool in_use) { in_use_ = in_use; }
 
-    mx_status_t GetDebugInfo(uintptr_t pc, dsoinfo_t** out_dso, backtrace_state** out_bt_state);
-    
- private:
-    dsoinfo_t* dso_list_;
+    mx_status_t GetDebugInfo(dsoinfo_t* dso_list, uintptr_t pc,
+                             dsoinfo_t** out_dso, backtrace_state** out_bt_state);
 
-    size_t last_used_ = 0;
+ private:
+    uint64_t use_count_ = 0;
 
     bool cache_avail_ = false;
+    bool in_use_ = false;
 
     struct way {
-        // Not owned by us. This is the "tag".
-        dsoinfo_t* dso = nullptr;
-        // Owned by us.
+        // The "tag". Empty if the way is unused.
+        char buildid[MAX_BUILDID_SIZE * 2 + 1] = {};
+        // Owned by us. nullptr if there is no debug info for |buildid|,
+        // which is worth remembering too.
         backtrace_state* bt_state = nullptr;
+        uint64_t last_used = 0;
     };
 
     mxtl::Array<way> ways_;
 };
 
-// Note: We take ownership of |dso_list|.
-
-DebugInfoCache::DebugInfoCache(dsoinfo_t* dso_list, size_t nr_ways)
-    : dso_list_(dso_list) {
+DebugInfoCache::DebugInfoCache(size_t nr_ways) {
     AllocChecker ac;
     auto ways = new (&ac) way[nr_ways];
     if (!ac.check()) {
@@ -100,8 +107,6 @@ DebugInfoCache::~DebugInfoCache() {
             backtrace_destroy_state(ways_[i].bt_state, bt_error_callback, nullptr);
         }
     }
-
-    dso_free_list(dso_list_);
 }
 
 // Find the DSO and debug info (backtrace_state) for PC.
@@ -112,38 +117,36 @@ DebugInfoCache::~DebugInfoCache() {
 // If the result is NO_ERROR then |*out_bt_state| is set to the
 // accompanying libbacktrace state if available or nullptr if not.
 
-mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
+mx_status_t DebugInfoCache::GetDebugInfo(dsoinfo_t* dso_list, uintptr_t pc,
                                          dsoinfo_t** out_dso,
                                          backtrace_state** out_bt_state) {
-    dsoinfo_t* dso = dso_lookup(dso_list_, pc);
+    dsoinfo_t* dso = dso_lookup(dso_list, pc);
     if (dso == nullptr) {
         debugf(1, "No DSO found for pc %p\n", (void*) pc);
         return ERR_NOT_FOUND;
     }
 
-#if 1 // Skip using libbacktrace until leaks are fixed.
     *out_dso = dso;
     *out_bt_state = nullptr;
-    return NO_ERROR;
-#endif
 
     // If we failed to initialize the cache (OOM) we can still report the
-    // DSO we found.
-    if (!cache_avail_) {
-        *out_dso = dso;
-        *out_bt_state = nullptr;
+    // DSO we found. Without a build id there's nothing to look it up by,
+    // or to find debug info with.
+    if (!cache_avail_ || dso->buildid[0] == 'x')
         return NO_ERROR;
-    }
 
     const size_t nr_ways = ways_.size();
 
+    size_t way = 0;
     for (size_t i = 0; i < nr_ways; ++i) {
-        if (ways_[i].dso == dso) {
+        if (!strcmp(ways_[i].buildid, dso->buildid)) {
             debugf(1, "using cached debug info entry for pc %p\n", (void*) pc);
-            *out_dso = dso;
+            ways_[i].last_used = ++use_count_;
             *out_bt_state = ways_[i].bt_state;
             return NO_ERROR;
         }
+        if (ways_[i].last_used < ways_[way].last_used)
+            way = i;
     }
 
     // PC is in a DSO, but not found in the cache.
@@ -152,42 +155,29 @@ mx_status_t DebugInfoCache::GetDebugInfo(uintptr_t pc,
     // no point in having error messages pollute the backtrace, at least by
     // default).
 
-    *out_dso = dso;
-    *out_bt_state = nullptr;
-
+    backtrace_state* bt_state = nullptr;
     const char* debug_file = nullptr;
     auto status = dso_find_debug_file(dso, &debug_file);
-    if (status != NO_ERROR) {
-        // There's no additional debug file available, but we did find the DSO.
-        return NO_ERROR;
-    }
-
-    struct backtrace_state* bt_state =
-        backtrace_create_state(debug_file, 0 /*!threaded*/,
-                               bt_error_callback, nullptr);
-    if (bt_state == nullptr) {
-        debugf(1, "backtrace_create_state failed (OOM)\n");
+    if (status == NO_ERROR) {
+        bt_state = backtrace_create_state(debug_file, 0 /*!threaded*/,
+                                          bt_error_callback, nullptr);
+        if (bt_state == nullptr) {
+            // Don't remember this, it may work next time.
+            debugf(1, "backtrace_create_state failed (OOM)\n");
+            return NO_ERROR;
+        }
+        backtrace_set_so_iterator(bt_state, bt_so_iterator, nullptr);
+        backtrace_set_base_address(bt_state, 0);
+    } else if (status != ERR_NOT_FOUND) {
         return NO_ERROR;
     }
 
-    // last_used_+1: KISS until there's data warranting something better
-    size_t way = (last_used_ + 1) % nr_ways;
-    if (ways_[way].dso != nullptr) {
-        // Free the entry.
-        backtrace_destroy_state(ways_[way].bt_state, bt_error_callback, nullptr);
-        ways_[way].dso = nullptr;
-        ways_[way].bt_state = nullptr;
-    }
-
-    // The iterator doesn't do anything, but we pass |list| anyway
-    // in case some day we need it to.
-    backtrace_set_so_iterator(bt_state, bt_so_iterator, dso_list_);
-    backtrace_set_base_address(bt_state, dso->base);
-
-    ways_[way].dso = dso;
+    // Replace the least recently used entry.
+    backtrace_destroy_state(ways_[way].bt_state, bt_error_callback, nullptr);
+    strlcpy(ways_[way].buildid, dso->buildid, sizeof(ways_[way].buildid));
     ways_[way].bt_state = bt_state;
+    ways_[way].last_used = ++use_count_;
     *out_bt_state = bt_state;
-    last_used_ = way;
     return NO_ERROR;
 }
 
@@ -216,10 +206,17 @@ btprint_callback(void* vdata, uintptr_t pc, const char* filename, int lineno,
     return 0;
 }
 
-static void btprint(DebugInfoCache* di_cache, int n, uintptr_t pc, uintptr_t sp) {
+static void btprint(DebugInfoCache* di_cache, dsoinfo_t* dso_list,
+                    int n, uintptr_t pc, uintptr_t sp) {
     dsoinfo_t* dso;
-    backtrace_state* bt_state;
-    auto status = di_cache->GetDebugInfo(pc, &dso, &bt_state);
+    backtrace_state* bt_state = nullptr;
+    mx_status_t status;
+    if (di_cache != nullptr) {
+        status = di_cache->GetDebugInfo(dso_list, pc, &dso, &bt_state);
+    } else {
+        dso = dso_lookup(dso_list, pc);
+        status = dso != nullptr ? NO_ERROR : ERR_NOT_FOUND;
+    }
 
     if (status != NO_ERROR) {
         // The pc is not in any DSO.
@@ -234,7 +231,7 @@ static void btprint(DebugInfoCache* di_cache, int n, uintptr_t pc, uintptr_t sp)
     memset(&pcinfo_data, 0, sizeof(pcinfo_data));
 
     if (bt_state != nullptr) {
-        auto ret = backtrace_pcinfo(bt_state, pc, btprint_callback,
+        auto ret = backtrace_pcinfo(bt_state, pc - dso->base, btprint_callback,
                                     bt_error_callback, &pcinfo_data);
         if (ret == 0) {
             // FIXME: How to interpret the result is seriously confusing.
@@ -336,15 +333,34 @@ void backtrace(mx_handle_t process, mx_handle_t thread,
     // on using heuristics. Ideally this would be handled on a per-DSO basis.
 
     // Keep a cache of loaded debug info to maintain some performance
-    // without loading debug info for all shared libs.
-    // This won't get used if initializing libunwind failed, but we can still
-    // use |dso_list|.
-    DebugInfoCache di_cache(dso_list, kDebugInfoCacheNumWays);
+    // without loading debug info for all shared libs, or loading it
+    // again for each crash.
+    // If we crashed while using the cache then make do with one just for
+    // this backtrace, the shared one could be in any state.
+    // The shared one is never freed, not even at exit, since the thread
+    // using it when we crashed never gets to finish.
+    static DebugInfoCache* shared_di_cache = nullptr;
+    AllocChecker ac;
+    if (shared_di_cache == nullptr) {
+        shared_di_cache = new (&ac) DebugInfoCache(kDebugInfoCacheNumWays);
+        if (!ac.check())
+            print_error("unable to allocate debug info cache (OOM)");
+    }
+    DebugInfoCache* di_cache = shared_di_cache;
+    mxtl::unique_ptr<DebugInfoCache> self_di_cache;
+    if (di_cache != nullptr && di_cache->in_use()) {
+        self_di_cache.reset(new (&ac) DebugInfoCache(kDebugInfoCacheNumWays));
+        if (!ac.check())
+            print_error("unable to allocate debug info cache (OOM)");
+        di_cache = self_di_cache.get();
+    }
+    if (di_cache != nullptr)
+        di_cache->set_in_use(true);
 
     // On with the show.
 
     int n = 1;
-    btprint(&di_cache, n++, pc, sp);
+    btprint(di_cache, dso_list, n++, pc, sp);
     while ((sp >= 0x1000000) && (n < 50)) {
         if (libunwind_ok) {
             int ret = unw_step(&cursor);
@@ -369,10 +385,13 @@ void backtrace(mx_handle_t process, mx_handle_t thread,
                 break;
             }
         }
-        btprint(&di_cache, n++, pc, sp);
+        btprint(di_cache, dso_list, n++, pc, sp);
     }
     printf("bt#%02d: end\n", n);
 
+    if (di_cache != nullptr)
+        di_cache->set_in_use(false);
     unw_destroy_addr_space(remote_as);
     unw_destroy_fuchsia(fuchsia);
+    dso_free_list(dso_list);
 }
@@ -132,6 +132,41 @@ next_instruction:
     return false;
 }
 
+int devhost_binding_protocols(const mx_bind_inst_t* binding, uint32_t binding_size,
+                              uint32_t* protos, int max) {
+    const mx_bind_inst_t* ip = binding;
+    const mx_bind_inst_t* end = ip + (binding_size / sizeof(mx_bind_inst_t));
+    if ((ip == end) || (max < 1)) {
+        return -1;
+    }
+
+    // BI_ABORT_IF(NE, BIND_PROTOCOL, ...) to start
+    if ((BINDINST_CC(ip->op) == COND_NE) && (BINDINST_OP(ip->op) == OP_ABORT) &&
+        (BINDINST_PB(ip->op) == BIND_PROTOCOL)) {
+        protos[0] = ip->arg;
+        return 1;
+    }
+
+    // nothing but BI_MATCH_IF(EQ, BIND_PROTOCOL, ...)
+    int count = 0;
+    for (; ip < end; ip++) {
+        if ((BINDINST_CC(ip->op) != COND_EQ) || (BINDINST_OP(ip->op) != OP_MATCH) ||
+            (BINDINST_PB(ip->op) != BIND_PROTOCOL) || (count == max)) {
+            return -1;
+        }
+        protos[count++] = ip->arg;
+    }
+    return count;
+}
+
+uint32_t devhost_device_protocol(mx_device_t* dev) {
+    bpctx_t ctx;
+    ctx.props = dev->props;
+    ctx.end = dev->props + dev->prop_count;
+    ctx.protocol_id = dev->protocol_id;
+    return dev_get_prop(&ctx, BIND_PROTOCOL);
+}
+
 bool devhost_is_bindable_drv(mx_driver_t* drv, mx_device_t* dev) {
     bpctx_t ctx;
     ctx.props = dev->props;
@@ -0,0 +1,250 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "devhost.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <sys/param.h>
+
+#include <ddk/device.h>
+#include <ddk/io-buffer.h>
+#include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+
+#include <mxio/debug.h>
+
+#define MXDEBUG 0
+
+// Serves the queued block protocol in magenta/device/block.h for any block
+// device, on top of its iotxn_queue().  Each session has a thread that
+// waits for the client to ring, and turns new requests into iotxns that
+// are windows into the session's buffer, so the driver moves the data
+// straight between the device and memory the client has mapped.
+//
+// The buffer is physically contiguous, like every iotxn's, which is why
+// the device allocates it rather than the client.
+
+typedef struct block_session {
+    mx_device_t* dev;
+    mx_handle_t fifo;       // consumer end
+    io_buffer_t buffer;     // the ring, then the data area
+    block_fifo_request_t* ring;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t blksize;
+    uint32_t count;
+
+    mtx_t lock;
+    // requests taken from the ring, and those handed back, which is
+    // always a run, so slots done out of order wait in done[]
+    uint64_t issued;
+    uint64_t tail;
+    uint32_t inflight;
+    bool closing;
+    uint8_t done[0];
+} block_session_t;
+
+static void block_session_free(block_session_t* bs) {
+    xprintf("block: session %p on %s closed\n", bs, bs->dev->name);
+    mx_handle_close(bs->fifo);
+    io_buffer_release(&bs->buffer);
+    free(bs);
+}
+
+// Marks request n done, and hands back to the client every request up to
+// the first that isn't.
+static void block_session_done(block_session_t* bs, uint64_t n, mx_status_t status,
+                               uint32_t actual) {
+    mtx_lock(&bs->lock);
+    uint32_t slot = n & (bs->count - 1);
+    bs->ring[slot].status = status;
+    bs->ring[slot].actual = actual;
+    bs->done[slot] = 1;
+    bs->inflight--;
+
+    uint64_t advance = 0;
+    while ((bs->tail < bs->issued) && bs->done[bs->tail & (bs->count - 1)]) {
+        bs->done[bs->tail & (bs->count - 1)] = 0;
+        bs->tail++;
+        advance++;
+    }
+    if (advance > 0) {
+        mx_fifo_op(bs->fifo, MX_FIFO_OP_ADVANCE_TAIL, advance, NULL);
+        mx_object_signal_peer(bs->fifo, 0, BLOCK_FIFO_SIGNAL);
+    }
+    bool release = bs->closing && (bs->inflight == 0);
+    mtx_unlock(&bs->lock);
+
+    if (release) {
+        block_session_free(bs);
+    }
+}
+
+static void block_txn_complete(iotxn_t* txn, void* cookie) {
+    block_session_t* bs = cookie;
+    uint64_t n = *iotxn_to(txn, uint64_t);
+    mx_status_t status = txn->status;
+    uint32_t actual = (status == NO_ERROR) ? (uint32_t)txn->actual : 0;
+    txn->ops->release(txn);
+    block_session_done(bs, n, status, actual);
+}
+
+static void block_session_issue(block_session_t* bs, uint64_t n) {
+    // the client may scribble on the slot, so work from a copy of it
+    block_fifo_request_t req = bs->ring[n & (bs->count - 1)];
+
+    mtx_lock(&bs->lock);
+    bs->issued++;
+    bs->inflight++;
+    mtx_unlock(&bs->lock);
+
+    uint32_t opcode;
+    switch (req.opcode) {
+    case BLOCK_OP_READ:
+        opcode = IOTXN_OP_READ;
+        break;
+    case BLOCK_OP_WRITE:
+        opcode = IOTXN_OP_WRITE;
+        break;
+    default:
+        block_session_done(bs, n, ERR_NOT_SUPPORTED, 0);
+        return;
+    }
+    if ((req.length == 0) || (req.length % bs->blksize) || (req.dev_offset % bs->blksize) ||
+        (req.data_offset > bs->data_size) || (req.length > bs->data_size - req.data_offset)) {
+        block_session_done(bs, n, ERR_INVALID_ARGS, 0);
+        return;
+    }
+
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc_window(&txn, &bs->buffer, bs->data_offset + req.data_offset,
+                                            req.length, sizeof(uint64_t));
+    if (status != NO_ERROR) {
+        block_session_done(bs, n, status, 0);
+        return;
+    }
+    txn->opcode = opcode;
+    txn->offset = req.dev_offset;
+    txn->length = req.length;
+    txn->complete_cb = block_txn_complete;
+    txn->cookie = bs;
+    *iotxn_to(txn, uint64_t) = n;
+    iotxn_queue(bs->dev, txn);
+}
+
+static int block_session_thread(void* arg) {
+    block_session_t* bs = arg;
+    for (;;) {
+        mx_signals_t observed;
+        mx_status_t status = mx_handle_wait_one(bs->fifo, BLOCK_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED,
+                                                MX_TIME_INFINITE, &observed);
+        if ((status != NO_ERROR) || (observed & MX_FIFO_PEER_CLOSED)) {
+            break;
+        }
+        // clear the doorbell before looking, so a ring after this is seen
+        mx_object_signal(bs->fifo, BLOCK_FIFO_SIGNAL, 0);
+        mx_fifo_state_t state;
+        if (mx_fifo_op(bs->fifo, MX_FIFO_OP_READ_STATE, 0, &state) != NO_ERROR) {
+            break;
+        }
+        for (uint64_t n = bs->issued; n < state.head; n++) {
+            block_session_issue(bs, n);
+        }
+    }
+
+    // requests still on the ring are dropped with the client
+    mtx_lock(&bs->lock);
+    bs->closing = true;
+    bool release = (bs->inflight == 0);
+    mtx_unlock(&bs->lock);
+    if (release) {
+        block_session_free(bs);
+    }
+    return 0;
+}
+
+mx_status_t devhost_block_fifo_create(mx_device_t* dev, const void* in_buf, size_t in_len,
+                                      void* out_buf, size_t out_len) {
+    if (dev->protocol_id != MX_PROTOCOL_BLOCK) {
+        return ERR_NOT_SUPPORTED;
+    }
+    const block_fifo_config_t* config = in_buf;
+    if ((in_len < sizeof(*config)) || (out_len < sizeof(block_fifo_info_t))) {
+        return ERR_INVALID_ARGS;
+    }
+    uint32_t count = config->count;
+    if ((count == 0) || (count & (count - 1)) || (count > BLOCK_FIFO_MAX_COUNT) ||
+        (config->data_size == 0) || (config->data_size > BLOCK_FIFO_MAX_DATA)) {
+        return ERR_INVALID_ARGS;
+    }
+
+    uint64_t blksize;
+    ssize_t r = dev->ops->ioctl(dev, IOCTL_BLOCK_GET_BLOCKSIZE, NULL, 0, &blksize, sizeof(blksize));
+    if (r != sizeof(blksize) || blksize == 0) {
+        return (r < 0) ? r : ERR_NOT_SUPPORTED;
+    }
+
+    block_session_t* bs;
+    if ((bs = calloc(1, sizeof(block_session_t) + count)) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    bs->dev = dev;
+    bs->count = count;
+    bs->blksize = blksize;
+    bs->data_offset = roundup(count * sizeof(block_fifo_request_t), PAGE_SIZE);
+    bs->data_size = config->data_size;
+    mtx_init(&bs->lock, mtx_plain);
+
+    mx_status_t status;
+    if ((status = io_buffer_init(&bs->buffer, bs->data_offset + roundup(bs->data_size, PAGE_SIZE),
+                                 IO_BUFFER_RW)) != NO_ERROR) {
+        free(bs);
+        return status;
+    }
+    bs->ring = io_buffer_virt(&bs->buffer);
+    memset(bs->ring, 0, bs->data_offset);
+
+    // the ring is kept in the buffer, so the fifo's own vmo isn't needed
+    mx_handle_t producer, vmo;
+    if ((status = mx_fifo_create(count, sizeof(block_fifo_request_t), 0,
+                                 &producer, &bs->fifo, &vmo)) != NO_ERROR) {
+        io_buffer_release(&bs->buffer);
+        free(bs);
+        return status;
+    }
+    mx_handle_close(vmo);
+
+    block_fifo_info_t* info = out_buf;
+    if ((status = mx_handle_duplicate(bs->buffer.vmo_handle, MX_RIGHT_SAME_RIGHTS,
+                                      &info->vmo)) != NO_ERROR) {
+        goto fail;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, block_session_thread, bs, "block-session") != thrd_success) {
+        mx_handle_close(info->vmo);
+        status = ERR_NO_RESOURCES;
+        goto fail;
+    }
+    thrd_detach(t);
+
+    xprintf("block: session %p on %s, %u slots, %" PRIu64 " bytes\n",
+            bs, dev->name, count, bs->data_size);
+    info->fifo = producer;
+    info->data_offset = bs->data_offset;
+    return sizeof(block_fifo_info_t);
+
+fail:
+    mx_handle_close(producer);
+    block_session_free(bs);
+    return status;
+}
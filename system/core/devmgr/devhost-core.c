@@ -18,6 +18,8 @@
 #include <ddk/device.h>
 #include <ddk/driver.h>
 
+#include <magenta/compiler.h>
+#include <magenta/ktrace.h>
 #include <magenta/listnode.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
@@ -120,6 +122,33 @@ static mx_status_t default_resume(mx_device_t* dev) {
 static struct list_node unmatched_device_list = LIST_INITIAL_VALUE(unmatched_device_list);
 static struct list_node driver_list = LIST_INITIAL_VALUE(driver_list);
 
+// Drivers are also indexed by the protocols their binding programs can
+// match, so probing a device only runs the programs of drivers that might
+// take it.  Drivers are tried in the order they were added, which seq
+// keeps across the index's lists.
+typedef struct driver_ref {
+    struct list_node node;
+    mx_driver_t* drv;
+    uint32_t protocol_id;
+    uint32_t seq;
+} driver_ref_t;
+
+#define DRIVER_INDEX_BUCKETS 16
+#define DRIVER_INDEX_MAX_PROTOCOLS 8
+
+static struct list_node driver_index[DRIVER_INDEX_BUCKETS];
+static struct list_node driver_index_any = LIST_INITIAL_VALUE(driver_index_any);
+static uint32_t driver_seq;
+
+// Devices added are probed by a pool of threads, so slow binds of
+// independent devices overlap rather than run one after another.  Queued
+// devices wait on bind_queue through their unode, which removal unlinks.
+#define BIND_THREADS 4
+
+static struct list_node bind_queue = LIST_INITIAL_VALUE(bind_queue);
+static cnd_t bind_cnd;
+static int bind_threads;
+
 #define device_is_bound(dev) (!!dev->owner)
 
 void dev_ref_release(mx_device_t* dev) {
@@ -170,7 +199,15 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv) {
     }
 
     DM_UNLOCK();
+    mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
     status = drv->ops.bind(drv, dev);
+    if (status == NO_ERROR) {
+        // in the boot timeline, with how long the bind took in us
+        char name[MX_MAX_NAME_LEN];
+        snprintf(name, sizeof(name), "bind:%s", drv->name ? drv->name : "?");
+        t = mx_time_get(MX_CLOCK_MONOTONIC) - t;
+        mx_ktrace_control(get_root_resource(), KTRACE_ACTION_BOOT_STAGE, (uint32_t)(t / 1000), name);
+    }
     DM_LOCK();
     if (status < 0) {
         return status;
@@ -185,27 +222,133 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv) {
     return NO_ERROR;
 }
 
+static unsigned driver_index_hash(uint32_t protocol_id) {
+    return (protocol_id ^ (protocol_id >> 8) ^ (protocol_id >> 16) ^ (protocol_id >> 24)) %
+           DRIVER_INDEX_BUCKETS;
+}
+
+static mx_status_t driver_index_add(mx_driver_t* drv) {
+    if (driver_seq == 0) {
+        for (unsigned i = 0; i < DRIVER_INDEX_BUCKETS; i++) {
+            list_initialize(&driver_index[i]);
+        }
+    }
+
+    uint32_t protos[DRIVER_INDEX_MAX_PROTOCOLS];
+    int count = devhost_binding_protocols(drv->binding, drv->binding_size,
+                                          protos, countof(protos));
+    driver_ref_t* refs = calloc((count < 0) ? 1 : count, sizeof(driver_ref_t));
+    if (refs == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    uint32_t seq = ++driver_seq;
+    if (count < 0) {
+        refs[0].drv = drv;
+        refs[0].seq = seq;
+        list_add_tail(&driver_index_any, &refs[0].node);
+        return NO_ERROR;
+    }
+    for (int i = 0; i < count; i++) {
+        refs[i].drv = drv;
+        refs[i].protocol_id = protos[i];
+        refs[i].seq = seq;
+        list_add_tail(&driver_index[driver_index_hash(protos[i])], &refs[i].node);
+    }
+    return NO_ERROR;
+}
+
+// the first ref in list after ref, or from the start if ref is NULL, for
+// protocol_id, or for any protocol in driver_index_any
+static driver_ref_t* driver_index_next(struct list_node* list, driver_ref_t* ref,
+                                       uint32_t protocol_id) {
+    if (ref == NULL) {
+        ref = list_peek_head_type(list, driver_ref_t, node);
+    } else {
+        ref = list_next_type(list, &ref->node, driver_ref_t, node);
+    }
+    if (list != &driver_index_any) {
+        while ((ref != NULL) && (ref->protocol_id != protocol_id)) {
+            ref = list_next_type(list, &ref->node, driver_ref_t, node);
+        }
+    }
+    return ref;
+}
+
 static void devhost_device_probe_all(mx_device_t* dev, bool autobind) {
     if ((dev->flags & DEV_FLAG_UNBINDABLE) == 0) {
-        if (!device_is_bound(dev)) {
-            mx_driver_t* drv = NULL;
-            list_for_every_entry (&driver_list, drv, mx_driver_t, node) {
-                if (autobind && drv->flags & DRV_FLAG_NO_AUTOBIND) {
-                    continue;
-                }
-                if (devhost_device_probe(dev, drv) == NO_ERROR) {
-                    break;
-                }
+        uint32_t protocol_id = devhost_device_protocol(dev);
+        struct list_node* bucket = &driver_index[driver_index_hash(protocol_id)];
+
+        // the next ref from each list is found after probing, as drivers
+        // may be added while a bind runs unlocked
+        driver_ref_t* a = (driver_seq == 0) ? NULL : driver_index_next(bucket, NULL, protocol_id);
+        driver_ref_t* b = driver_index_next(&driver_index_any, NULL, 0);
+        while (!device_is_bound(dev) && ((a != NULL) || (b != NULL))) {
+            driver_ref_t* ref;
+            if ((b == NULL) || ((a != NULL) && (a->seq < b->seq))) {
+                ref = a;
+            } else {
+                ref = b;
+            }
+            if (!(autobind && (ref->drv->flags & DRV_FLAG_NO_AUTOBIND))) {
+                devhost_device_probe(dev, ref->drv);
+            }
+            if (ref == a) {
+                a = driver_index_next(bucket, a, protocol_id);
+            } else {
+                b = driver_index_next(&driver_index_any, b, 0);
             }
         }
 
-        // if no driver is bound, add the device to the unmatched list
-        if (!device_is_bound(dev)) {
+        // if no driver is bound, add the device to the unmatched list,
+        // unless it is still waiting to be probed
+        if (!device_is_bound(dev) && !list_in_list(&dev->unode)) {
             list_add_tail(&unmatched_device_list, &dev->unode);
         }
     }
 }
 
+static int devhost_bind_thread(void* arg) {
+    DM_LOCK();
+    for (;;) {
+        mx_device_t* dev;
+        while ((dev = list_remove_head_type(&bind_queue, mx_device_t, unode)) == NULL) {
+            cnd_wait(&bind_cnd, &__devhost_api_lock);
+        }
+        dev->flags |= DEV_FLAG_BUSY;
+        devhost_device_probe_all(dev, true);
+        dev->flags &= ~DEV_FLAG_BUSY;
+    }
+    return 0;
+}
+
+static void devhost_device_queue_probe(mx_device_t* dev) {
+    if (dev->flags & DEV_FLAG_UNBINDABLE) {
+        return;
+    }
+    if (bind_threads == 0) {
+        cnd_init(&bind_cnd);
+        for (int i = 0; i < BIND_THREADS; i++) {
+            thrd_t t;
+            if (thrd_create_with_name(&t, devhost_bind_thread, NULL, "devhost-bind") != thrd_success) {
+                break;
+            }
+            thrd_detach(t);
+            bind_threads++;
+        }
+        if (bind_threads == 0) {
+            // no pool, so probe here as before
+            bind_threads = -1;
+        }
+    }
+    if (bind_threads < 0) {
+        devhost_device_probe_all(dev, true);
+        return;
+    }
+    list_add_tail(&bind_queue, &dev->unode);
+    cnd_signal(&bind_cnd);
+}
+
 void devhost_device_init(mx_device_t* dev, mx_driver_t* driver,
                         const char* name, mx_protocol_device_t* ops) {
     xprintf("devhost: init '%s' drv=%p, ops=%p\n",
@@ -364,8 +507,8 @@ mx_status_t devhost_device_add(mx_device_t* dev, mx_device_t* parent) {
         }
     }
 
-    // probe the device
-    devhost_device_probe_all(dev, true);
+    // queue the device to be probed
+    devhost_device_queue_probe(dev);
 
     dev->flags &= (~DEV_FLAG_BUSY);
     return NO_ERROR;
@@ -550,7 +693,11 @@ mx_status_t devhost_driver_add(mx_driver_t* drv) {
             return r;
     }
 
-    // add the driver to the driver list
+    // add the driver to the driver list and index
+    mx_status_t status = driver_index_add(drv);
+    if (status < 0) {
+        return status;
+    }
     list_add_tail(&driver_list, &drv->node);
 
     // probe unmatched devices with the driver and initialize if the probe is successful
@@ -0,0 +1,239 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "devhost.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <sys/param.h>
+
+#include <ddk/device.h>
+#include <ddk/protocol/ethernet.h>
+
+#include <magenta/device/ethernet.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+
+#include <mxio/debug.h>
+
+#define MXDEBUG 0
+
+// Serves the batched frames of magenta/device/ethernet.h for any ethernet
+// device, on top of its ethernet_protocol_t.  Each session has a thread
+// that moves frames between the session's buffer and the driver with
+// send() and recv() for as long as there are entries to work on, so a
+// busy client pays for one wakeup per run of frames rather than a
+// syscall and an extra copy for each one.  On devices with several
+// receive queues, a session for each spreads receiving over as many
+// threads.
+
+typedef struct eth_session {
+    mx_device_t* dev;
+    ethernet_protocol_t* eth;
+    mx_handle_t fifo;       // consumer end
+    mx_handle_t vmo;
+    uintptr_t addr;
+    size_t size;
+    eth_fifo_entry_t* ring;
+    uint8_t* data;
+    uint64_t data_size;
+    uint32_t count;
+    uint32_t dir;
+    uint32_t queue;
+    mx_handle_t readable;   // asserts DEV_STATE_READABLE while the queue has frames
+    size_t mtu;
+    uint64_t tail;
+} eth_session_t;
+
+static void eth_session_free(eth_session_t* es) {
+    xprintf("eth: session %p on %s closed\n", es, es->dev->name);
+    mx_handle_close(es->fifo);
+    mx_process_unmap_vm(mx_process_self(), es->addr, es->size);
+    mx_handle_close(es->vmo);
+    free(es);
+}
+
+static bool eth_entry_valid(eth_session_t* es, const eth_fifo_entry_t* e) {
+    return (e->length > 0) && (e->offset < es->data_size) &&
+           (e->length <= es->data_size - e->offset);
+}
+
+// Sends the frames up to head, returning how many entries are done.
+static uint64_t eth_session_tx(eth_session_t* es, uint64_t head) {
+    uint64_t n;
+    for (n = es->tail; n < head; n++) {
+        eth_fifo_entry_t* slot = &es->ring[n & (es->count - 1)];
+        // the client may scribble on the slot, so work from a copy of it
+        eth_fifo_entry_t e = *slot;
+        e.flags = 0;
+        if (eth_entry_valid(es, &e) &&
+            (es->eth->send(es->dev, es->data + e.offset, e.length) >= 0)) {
+            e.flags = ETH_FIFO_OK;
+        }
+        *slot = e;
+    }
+    return n - es->tail;
+}
+
+// Fills the buffers up to head with whatever frames the driver has,
+// returning how many entries are done.
+static uint64_t eth_session_rx(eth_session_t* es, uint64_t head) {
+    uint64_t n;
+    for (n = es->tail; n < head; n++) {
+        eth_fifo_entry_t* slot = &es->ring[n & (es->count - 1)];
+        eth_fifo_entry_t e = *slot;
+        if (!eth_entry_valid(es, &e) || (e.length < es->mtu)) {
+            // hand back what can't be used straight away
+            e.length = 0;
+            e.flags = 0;
+            *slot = e;
+            continue;
+        }
+        uint8_t* buf = es->data + e.offset;
+        uint32_t hash = 0;
+        mx_status_t r = (es->eth->recv_queue != NULL)
+                            ? es->eth->recv_queue(es->dev, es->queue, buf, e.length, &hash)
+                            : es->eth->recv(es->dev, buf, e.length);
+        if (r <= 0) {
+            break;
+        }
+        e.length = r;
+        e.flags = ETH_FIFO_OK;
+        if (es->eth->recv_queue != NULL) {
+            e.flags |= ETH_FIFO_HASH;
+            e.hash = hash;
+        }
+        *slot = e;
+    }
+    return n - es->tail;
+}
+
+static int eth_session_thread(void* arg) {
+    eth_session_t* es = arg;
+    for (;;) {
+        // clear the doorbell before looking, so a ring after this is seen
+        mx_object_signal(es->fifo, ETH_FIFO_SIGNAL, 0);
+        mx_fifo_state_t state;
+        if (mx_fifo_op(es->fifo, MX_FIFO_OP_READ_STATE, 0, &state) != NO_ERROR) {
+            break;
+        }
+        uint64_t done = (es->dir == ETH_FIFO_TX) ? eth_session_tx(es, state.head)
+                                                 : eth_session_rx(es, state.head);
+        if (done > 0) {
+            if (mx_fifo_op(es->fifo, MX_FIFO_OP_ADVANCE_TAIL, done, NULL) != NO_ERROR) {
+                break;
+            }
+            es->tail += done;
+            mx_object_signal_peer(es->fifo, 0, ETH_FIFO_SIGNAL);
+            continue;
+        }
+
+        // caught up: wait for more entries, or with buffers posted, for
+        // the driver to have a frame
+        mx_wait_item_t items[2] = {
+            { .handle = es->fifo, .waitfor = ETH_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED },
+            { .handle = es->readable, .waitfor = DEV_STATE_READABLE },
+        };
+        uint32_t nitems = ((es->dir == ETH_FIFO_RX) && (es->tail < state.head)) ? 2 : 1;
+        mx_status_t status = mx_handle_wait_many(items, nitems, MX_TIME_INFINITE);
+        if ((status != NO_ERROR) || (items[0].pending & MX_FIFO_PEER_CLOSED)) {
+            break;
+        }
+    }
+
+    // entries still on the ring are dropped with the client
+    eth_session_free(es);
+    return 0;
+}
+
+mx_status_t devhost_ethernet_fifo_create(mx_device_t* dev, const void* in_buf, size_t in_len,
+                                         void* out_buf, size_t out_len) {
+    ethernet_protocol_t* eth;
+    if ((dev->protocol_id != MX_PROTOCOL_ETHERNET) ||
+        (device_get_protocol(dev, MX_PROTOCOL_ETHERNET, (void**)&eth) != NO_ERROR)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    const eth_fifo_config_t* config = in_buf;
+    if ((in_len < sizeof(*config)) || (out_len < sizeof(eth_fifo_info_t))) {
+        return ERR_INVALID_ARGS;
+    }
+    uint32_t count = config->count;
+    uint32_t rx_queues = (eth->get_rx_queues != NULL) ? eth->get_rx_queues(dev) : 1;
+    if ((count == 0) || (count & (count - 1)) || (count > ETH_FIFO_MAX_COUNT) ||
+        ((config->dir != ETH_FIFO_TX) && (config->dir != ETH_FIFO_RX)) ||
+        (config->data_size == 0) || (config->data_size > ETH_FIFO_MAX_DATA) ||
+        (config->queue >= ((config->dir == ETH_FIFO_RX) ? rx_queues : 1))) {
+        return ERR_INVALID_ARGS;
+    }
+
+    eth_session_t* es;
+    if ((es = calloc(1, sizeof(eth_session_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    es->dev = dev;
+    es->eth = eth;
+    es->count = count;
+    es->dir = config->dir;
+    es->queue = config->queue;
+    es->readable = (es->queue == 0) ? dev->event : eth->get_rx_queue_event(dev, es->queue);
+    es->mtu = eth->get_mtu(dev);
+    es->data_size = config->data_size;
+    uint64_t data_offset = roundup(count * sizeof(eth_fifo_entry_t), PAGE_SIZE);
+    es->size = data_offset + roundup(es->data_size, PAGE_SIZE);
+
+    mx_status_t status;
+    if ((status = mx_vmo_create(es->size, 0, &es->vmo)) != NO_ERROR) {
+        free(es);
+        return status;
+    }
+    if ((status = mx_process_map_vm(mx_process_self(), es->vmo, 0, es->size, &es->addr,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE)) != NO_ERROR) {
+        mx_handle_close(es->vmo);
+        free(es);
+        return status;
+    }
+    es->ring = (eth_fifo_entry_t*)es->addr;
+    es->data = (uint8_t*)es->addr + data_offset;
+
+    // the ring is kept in the buffer, so the fifo's own vmo isn't needed
+    mx_handle_t producer, vmo;
+    if ((status = mx_fifo_create(count, sizeof(eth_fifo_entry_t), 0,
+                                 &producer, &es->fifo, &vmo)) != NO_ERROR) {
+        mx_process_unmap_vm(mx_process_self(), es->addr, es->size);
+        mx_handle_close(es->vmo);
+        free(es);
+        return status;
+    }
+    mx_handle_close(vmo);
+
+    eth_fifo_info_t* info = out_buf;
+    if ((status = mx_handle_duplicate(es->vmo, MX_RIGHT_SAME_RIGHTS, &info->vmo)) != NO_ERROR) {
+        goto fail;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, eth_session_thread, es, "eth-session") != thrd_success) {
+        mx_handle_close(info->vmo);
+        status = ERR_NO_RESOURCES;
+        goto fail;
+    }
+    thrd_detach(t);
+
+    xprintf("eth: %s session %p on %s queue %u, %u slots, %" PRIu64 " bytes\n",
+            (es->dir == ETH_FIFO_TX) ? "tx" : "rx", es, dev->name, es->queue, count,
+            es->data_size);
+    info->fifo = producer;
+    info->data_offset = data_offset;
+    info->rx_queues = rx_queues;
+    return sizeof(eth_fifo_info_t);
+
+fail:
+    mx_handle_close(producer);
+    eth_session_free(es);
+    return status;
+}
@@ -45,13 +45,18 @@ extern mx_handle_t _dmctl_handle;
 // FIXME(yky,teisenbe): remove when real acpi bus driver goes in
 extern mx_driver_t _driver_acpi_root;
 
+// whether some devices are kept in the root devhost, see devhost_is_colocated()
+static bool colocating;
+
 static void init_driver(mx_driver_t* drv, bool for_root) {
         if ((drv->binding_size == 0) && (!for_root)) {
             // only load root-level drivers in the root devhost
             return;
         }
 #if !ONLY_ONE_DEVHOST
-        if ((drv->binding_size > 0) && (for_root)) {
+        // unless it is hosting devices that would otherwise get a devhost
+        // of their own, along with everything stacked on them
+        if ((drv->binding_size > 0) && (for_root) && (!colocating)) {
             return;
         }
 #endif
@@ -65,6 +70,13 @@ static bool is_driver_disabled(magenta_driver_info_t* di) {
     return getenv(opt) != NULL;
 }
 
+// driver.<driver_name>.colocate
+static bool is_driver_colocated(magenta_driver_info_t* di) {
+    char opt[16 + DRIVER_NAME_LEN_MAX];
+    snprintf(opt, 16 + DRIVER_NAME_LEN_MAX, "driver.%s.colocate", di->note->name);
+    return getenv(opt) != NULL;
+}
+
 static void init_from_driver_info(magenta_driver_info_t* di, bool for_root) {
     mx_driver_t* drv = di->driver;
     drv->name = di->note->name;
@@ -132,6 +144,81 @@ static void init_builtin_drivers(bool for_root) {
     }
 }
 
+// devhost.colocate=all, or a list of <vid>:<did> in hex
+static bool is_pci_id_colocated(uint32_t vid, uint32_t did) {
+    const char* ids = getenv("devhost.colocate");
+    if (ids == NULL) {
+        return false;
+    }
+    if (!strcmp(ids, "all")) {
+        return true;
+    }
+    while (*ids) {
+        char* end;
+        if ((strtoul(ids, &end, 16) == vid) && (*end == ':') &&
+            (strtoul(end + 1, &end, 16) == did) && ((*end == ',') || (*end == 0))) {
+            return true;
+        }
+        if ((ids = strchr(ids, ',')) == NULL) {
+            break;
+        }
+        ids++;
+    }
+    return false;
+}
+
+static bool any_driver_colocated(void) {
+    magenta_driver_info_t* di;
+    for (di = __start_magenta_drivers; di < __stop_magenta_drivers; di++) {
+        if (!is_driver_disabled(di) && is_driver_colocated(di)) {
+            return true;
+        }
+    }
+    list_for_every_entry(&driver_list, di, magenta_driver_info_t, node) {
+        if (is_driver_colocated(di)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a bus driver in the root devhost should publish the device with
+// these properties right there instead of launching a devhost for it. That
+// is the case for the pci devices listed in devhost.colocate, and for those
+// a driver marked with driver.<name>.colocate would bind to. The drivers
+// that end up stacked on a colocated device run in the root devhost too.
+bool devhost_is_colocated(uint32_t protocol_id, mx_device_prop_t* props, uint32_t prop_count) {
+    if (!colocating) {
+        return false;
+    }
+
+    uint32_t vid = 0, did = 0;
+    for (uint32_t i = 0; i < prop_count; i++) {
+        if (props[i].id == BIND_PCI_VID) {
+            vid = props[i].value;
+        } else if (props[i].id == BIND_PCI_DID) {
+            did = props[i].value;
+        }
+    }
+    if ((protocol_id == MX_PROTOCOL_PCI) && is_pci_id_colocated(vid, did)) {
+        return true;
+    }
+
+    magenta_driver_info_t* di;
+    for (di = __start_magenta_drivers; di < __stop_magenta_drivers; di++) {
+        if (!is_driver_disabled(di) && is_driver_colocated(di) &&
+            devhost_is_bindable(di, protocol_id, props, prop_count)) {
+            return true;
+        }
+    }
+    list_for_every_entry(&driver_list, di, magenta_driver_info_t, node) {
+        if (is_driver_colocated(di) && devhost_is_bindable(di, protocol_id, props, prop_count)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static mx_handle_t app_launcher;
 static mx_handle_t sysinfo_job_root;
 
@@ -176,14 +263,17 @@ int main(int argc, char** argv) {
     if ((r = devhost_cmdline(argc, argv)) < 0) {
         return r;
     }
+    // the bus drivers among the builtin drivers need every driver loaded to
+    // tell which of their devices are colocated
+    load_loadable_drivers("/system/lib/driver");
+    load_loadable_drivers("/boot/lib/driver");
     if (as_root) {
+        colocating = (getenv("devhost.colocate") != NULL) || any_driver_colocated();
         driver_add(&_driver_dmctl);
         // FIXME(yky,teisenbe): remove when real acpi bus driver goes in
         driver_add(&_driver_acpi_root);
     }
     init_builtin_drivers(as_root);
-    load_loadable_drivers("/system/lib/driver");
-    load_loadable_drivers("/boot/lib/driver");
     init_loaded_drivers(as_root);
     return devhost_start();
 }
@@ -222,6 +312,7 @@ mx_status_t devmgr_control(const char* cmd) {
                "kerneldebug - send a command to the kernel\n"
                "ktraceoff   - stop kernel tracing\n"
                "ktraceon    - start kernel tracing\n"
+               "ktracering  - start kernel tracing, keeping only the latest records\n"
                "acpi-ps0    - invoke the _PS0 method on an acpi object\n"
                );
         return NO_ERROR;
@@ -249,6 +340,10 @@ mx_status_t devmgr_control(const char* cmd) {
         mx_ktrace_control(get_root_resource(), KTRACE_ACTION_START, KTRACE_GRP_ALL, NULL);
         return NO_ERROR;
     }
+    if (!strcmp(cmd, "ktracering")) {
+        mx_ktrace_control(get_root_resource(), KTRACE_ACTION_START_CIRCULAR, KTRACE_GRP_ALL, NULL);
+        return NO_ERROR;
+    }
     if (!strcmp(cmd, "ktraceoff")) {
         mx_ktrace_control(get_root_resource(), KTRACE_ACTION_STOP, 0, NULL);
         mx_ktrace_control(get_root_resource(), KTRACE_ACTION_REWIND, 0, NULL);
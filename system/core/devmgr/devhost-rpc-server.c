@@ -18,8 +18,10 @@
 #include <ddk/driver.h>
 #include <ddk/ioctl.h>
 #include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
 #include <ddk/protocol/device.h>
 
+#include <magenta/device/ethernet.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
@@ -106,9 +108,28 @@ static void sync_io_complete(iotxn_t* txn, void* cookie) {
     completion_signal((completion_t*)cookie);
 }
 
+// read and write rpcs, for every device in the devhost, take their iotxns
+// from here rather than allocating a contiguous buffer each time
+#define SYNC_IO_POOL_COUNT 4
+
+static iotxn_pool_t* sync_io_pool;
+static once_flag sync_io_pool_once = ONCE_FLAG_INIT;
+
+static void sync_io_pool_init(void) {
+    if (iotxn_pool_create(&sync_io_pool, SYNC_IO_POOL_COUNT, MXIO_CHUNK_SIZE, 0) != NO_ERROR) {
+        sync_io_pool = NULL;
+    }
+}
+
 static ssize_t do_sync_io(mx_device_t* dev, uint32_t opcode, void* buf, size_t count, mx_off_t off) {
     iotxn_t* txn;
-    mx_status_t status = iotxn_alloc(&txn, 0, MXIO_CHUNK_SIZE, 0);
+    mx_status_t status;
+    call_once(&sync_io_pool_once, sync_io_pool_init);
+    if (sync_io_pool != NULL) {
+        status = iotxn_pool_alloc(sync_io_pool, &txn, MXIO_CHUNK_SIZE);
+    } else {
+        status = iotxn_alloc(&txn, 0, MXIO_CHUNK_SIZE, 0);
+    }
     if (status != NO_ERROR) {
         return status;
     }
@@ -203,6 +224,14 @@ static ssize_t do_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_
         r = dev->ops->resume(dev);
         break;
     }
+    case IOCTL_BLOCK_FIFO_CREATE: {
+        r = devhost_block_fifo_create(dev, in_buf, in_len, out_buf, out_len);
+        break;
+    }
+    case IOCTL_ETHERNET_FIFO_CREATE: {
+        r = devhost_ethernet_fifo_create(dev, in_buf, in_len, out_buf, out_len);
+        break;
+    }
     default:
         r = dev->ops->ioctl(dev, op, in_buf, in_len, out_buf, out_len);
     }
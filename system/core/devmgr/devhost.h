@@ -51,6 +51,16 @@ mx_status_t devhost_device_openat(mx_device_t* dev, mx_device_t** out,
 mx_status_t devhost_device_close(mx_device_t* dev, uint32_t flags);
 
 bool devhost_is_bindable_drv(mx_driver_t* drv, mx_device_t* dev);
+
+// the protocols a binding program can match, for indexing drivers: the one
+// it aborts on any other of to start, or the ones it does nothing but match.
+// returns how many went in protos, or -1 if a device of any protocol might
+// match
+int devhost_binding_protocols(const mx_bind_inst_t* binding, uint32_t binding_size,
+                              uint32_t* protos, int max);
+
+// the protocol a binding program sees for dev
+uint32_t devhost_device_protocol(mx_device_t* dev);
 bool devhost_is_bindable_di(magenta_driver_info_t* di, mx_device_t* dev);
 bool devhost_is_bindable(magenta_driver_info_t* di, uint32_t protocol_id,
                          mx_device_prop_t* props, uint32_t prop_count);
@@ -69,6 +79,14 @@ typedef struct devhost_iostate {
 devhost_iostate_t* create_devhost_iostate(mx_device_t* dev);
 mx_status_t devhost_rio_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie);
 
+// serves IOCTL_BLOCK_FIFO_CREATE for block devices, in devhost-block.c
+mx_status_t devhost_block_fifo_create(mx_device_t* dev, const void* in_buf, size_t in_len,
+                                      void* out_buf, size_t out_len);
+
+// serves IOCTL_ETHERNET_FIFO_CREATE for ethernet devices, in devhost-ethernet.c
+mx_status_t devhost_ethernet_fifo_create(mx_device_t* dev, const void* in_buf, size_t in_len,
+                                         void* out_buf, size_t out_len);
+
 // routines devhost uses to talk to devmgr
 mx_status_t devhost_add(mx_device_t* dev, mx_device_t* child);
 mx_status_t devhost_remove(mx_device_t* dev);
@@ -34,13 +34,14 @@ struct bootfile {
 struct callback_data {
     mx_handle_t vmo;
     unsigned int file_count;
-    mx_status_t (*add_file)(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+    mx_status_t (*add_file)(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            uint32_t flags);
 };
 
-static void callback(void* arg, const char* path, size_t off, size_t len) {
+static void callback(void* arg, const char* path, size_t off, size_t len, uint32_t flags) {
     struct callback_data* cd = arg;
     //printf("bootfs: %s @%zd (%zd bytes)\n", path, off, len);
-    cd->add_file(path, cd->vmo, off, len);
+    cd->add_file(path, cd->vmo, off, len, flags);
     ++cd->file_count;
 }
 
@@ -9,6 +9,7 @@
 #include <magenta/device/block.h>
 #include <magenta/device/console.h>
 #include <magenta/device/devmgr.h>
+#include <magenta/ktrace.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <mxio/debug.h>
@@ -154,6 +155,21 @@ static mx_status_t block_device_added(int dirfd, const char* name, void* cookie)
         return NO_ERROR;
     }
 
+    // A whole disk gets an I/O scheduler stacked on it, and it's the
+    // scheduler's device that's looked at for what's on the disk.
+    // Partitions know their GUID, and schedulers their counters.
+    if (getenv("blksched.disable") == NULL) {
+        uint8_t guid[16];
+        block_sched_stats_t stats;
+        if ((ioctl_block_get_partition_guid(fd, guid, sizeof(guid)) < 0) &&
+            (ioctl_block_get_sched_stats(fd, &stats) < 0)) {
+            printf("devmgr: /dev/class/block/%s: disk, adding scheduler\n", name);
+            ioctl_device_bind(fd, "blksched", 8);
+            close(fd);
+            return NO_ERROR;
+        }
+    }
+
     if (read(fd, data, sizeof(data)) != sizeof(data)) {
         close(fd);
         printf("devmgr: cannot read: /dev/class/block/%s\n", name);
@@ -279,6 +295,9 @@ int main(int argc, char** argv) {
 
     printf("devmgr: main()\n");
 
+    char stage[MX_MAX_NAME_LEN] = "devmgr";
+    mx_ktrace_control(root_resource_handle, KTRACE_ACTION_BOOT_STAGE, 0, stage);
+
     char** e = environ;
     while (*e) {
         printf("cmdline: %s\n", *e++);
@@ -25,6 +25,69 @@ mx_status_t dn_create(dnode_t** out, const char* name, size_t len, vnode_t* vn)
     return NO_ERROR;
 }
 
+#define DN_HASH_MIN 16
+
+static uint32_t dn_hash_name(const char* name, size_t len) {
+    // fnv1a
+    uint32_t hash = 2166136261u;
+    while (len-- > 0) {
+        hash = (hash ^ (uint8_t) *name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Names recently looked up and not found, so that walks which probe for
+// files that aren't there (search paths and the like) don't scan the
+// directory each time.  Only short names are kept.  Adding a child
+// drops the entry its name would be in, deleting a directory drops
+// all of its entries.  Like the tree itself, it's under vfs_lock.
+#define DN_NEG_SLOTS 64
+#define DN_NEG_NAME_MAX 31
+
+typedef struct {
+    const dnode_t* parent;
+    uint32_t hash;
+    uint32_t len;
+    char name[DN_NEG_NAME_MAX];
+} dn_neg_t;
+
+static dn_neg_t dn_neg_cache[DN_NEG_SLOTS];
+
+static dn_neg_t* dn_neg_slot(const dnode_t* parent, uint32_t hash) {
+    uintptr_t p = (uintptr_t) parent;
+    return &dn_neg_cache[(hash ^ (uint32_t) (p >> 4)) % DN_NEG_SLOTS];
+}
+
+static void dn_neg_purge(const dnode_t* parent) {
+    for (unsigned n = 0; n < DN_NEG_SLOTS; n++) {
+        if (dn_neg_cache[n].parent == parent) {
+            dn_neg_cache[n].parent = NULL;
+        }
+    }
+}
+
+static void dn_hash_insert(dnode_t* parent, dnode_t* child) {
+    dnode_t** chain = &parent->hash[child->name_hash & parent->hash_mask];
+    child->hash_next = *chain;
+    *chain = child;
+}
+
+// Start hashing the children, or rehash them into a bigger table.
+// If there's no memory for it, lookups just keep scanning the list.
+static void dn_hash_resize(dnode_t* parent, uint32_t size) {
+    dnode_t** hash;
+    if ((hash = calloc(size, sizeof(dnode_t*))) == NULL) {
+        return;
+    }
+    free(parent->hash);
+    parent->hash = hash;
+    parent->hash_mask = size - 1;
+    dnode_t* dn;
+    list_for_every_entry(&parent->children, dn, dnode_t, dn_entry) {
+        dn_hash_insert(parent, dn);
+    }
+}
+
 mx_status_t dn_allocate(dnode_t** out, const char* name, size_t len) {
     if ((len > DN_NAME_MAX) || (len < 1)) {
         return ERR_INVALID_ARGS;
@@ -37,6 +100,7 @@ mx_status_t dn_allocate(dnode_t** out, const char* name, size_t len) {
     dn->flags = len;
     memcpy(dn->name, name, len);
     dn->name[len] = '\0';
+    dn->name_hash = dn_hash_name(name, len);
     list_initialize(&dn->children);
     *out = dn;
     return NO_ERROR;
@@ -54,10 +118,25 @@ void dn_attach(dnode_t* dn, vnode_t* vn) {
 
 void dn_delete(dnode_t* dn) {
     // detach from parent
-    if (dn->parent) {
+    dnode_t* parent = dn->parent;
+    if (parent) {
         list_delete(&dn->dn_entry);
+        parent->child_count--;
+        if (parent->hash) {
+            dnode_t** chain = &parent->hash[dn->name_hash & parent->hash_mask];
+            while ((*chain != NULL) && (*chain != dn)) {
+                chain = &(*chain)->hash_next;
+            }
+            if (*chain != NULL) {
+                *chain = dn->hash_next;
+            }
+        }
         dn->parent = NULL;
     }
+    if (dn->hash) {
+        free(dn->hash);
+    }
+    dn_neg_purge(dn);
 
     // detach from vnode
     if (dn->vnode) {
@@ -86,6 +165,22 @@ void dn_add_child(dnode_t* parent, dnode_t* child) {
 
     child->parent = parent;
     list_add_tail(&parent->children, &child->dn_entry);
+    parent->child_count++;
+
+    if (parent->hash) {
+        if (parent->child_count > parent->hash_mask + 1) {
+            dn_hash_resize(parent, 2 * (parent->hash_mask + 1));
+        } else {
+            dn_hash_insert(parent, child);
+        }
+    } else if (parent->child_count > DN_HASH_MIN) {
+        dn_hash_resize(parent, 2 * DN_HASH_MIN);
+    }
+
+    dn_neg_t* neg = dn_neg_slot(parent, child->name_hash);
+    if (neg->parent == parent) {
+        neg->parent = NULL;
+    }
 }
 
 mx_status_t dn_lookup(dnode_t* parent, dnode_t** out, const char* name, size_t len) {
@@ -98,15 +193,37 @@ mx_status_t dn_lookup(dnode_t* parent, dnode_t** out, const char* name, size_t l
         *out = parent->parent;
         return NO_ERROR;
     }
-    list_for_every_entry(&parent->children, dn, dnode_t, dn_entry) {
-        if (DN_NAME_LEN(dn->flags) != len) {
-            continue;
+    uint32_t hash = dn_hash_name(name, len);
+    dn_neg_t* neg = dn_neg_slot(parent, hash);
+    if ((neg->parent == parent) && (neg->hash == hash) && (neg->len == len) &&
+        (memcmp(neg->name, name, len) == 0)) {
+        return ERR_NOT_FOUND;
+    }
+    if (parent->hash) {
+        for (dn = parent->hash[hash & parent->hash_mask]; dn != NULL; dn = dn->hash_next) {
+            if ((dn->name_hash == hash) && (DN_NAME_LEN(dn->flags) == len) &&
+                (memcmp(dn->name, name, len) == 0)) {
+                *out = dn;
+                return NO_ERROR;
+            }
         }
-        if (memcmp(dn->name, name, len) != 0) {
-            continue;
+    } else {
+        list_for_every_entry(&parent->children, dn, dnode_t, dn_entry) {
+            if (DN_NAME_LEN(dn->flags) != len) {
+                continue;
+            }
+            if (memcmp(dn->name, name, len) != 0) {
+                continue;
+            }
+            *out = dn;
+            return NO_ERROR;
         }
-        *out = dn;
-        return NO_ERROR;
+    }
+    if (len <= DN_NEG_NAME_MAX) {
+        neg->parent = parent;
+        neg->hash = hash;
+        neg->len = len;
+        memcpy(neg->name, name, len);
     }
     return ERR_NOT_FOUND;
 }
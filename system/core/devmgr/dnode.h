@@ -25,6 +25,15 @@ struct dnode {
     list_node_t children;
     list_node_t dn_entry; // entry in parent's list
     list_node_t vn_entry; // entry in vnode's list
+
+    // once a directory has more than DN_HASH_MIN children, they're also
+    // in hash chains by name, hash_mask + 1 of them
+    dnode_t** hash;
+    dnode_t* hash_next;   // next in parent's chain
+    uint32_t hash_mask;
+    uint32_t name_hash;
+    uint32_t child_count;
+
     uint32_t flags;
     char name[];
 };
@@ -19,6 +19,7 @@ typedef struct dnode dnode_t;
 #define MEMFS_TYPE_DEVICE 3
 #define MEMFS_TYPE_MASK 0x3
 #define MEMFS_FLAG_VMO_REUSE 4
+#define MEMFS_FLAG_VMO_COMPRESSED 8 // vmo holds an LZ4 frame, not the data
 
 struct vnode {
     VNODE_BASE_FIELDS
@@ -34,6 +35,10 @@ struct vnode {
     // all directory watchers
     list_node_t watch_list;
 
+    // data files: guards data, so that the file can be read and written
+    // from several connections at once without vfs_lock
+    mtx_t lock;
+
     union {
         struct {
             mx_handle_t h;
@@ -41,8 +46,9 @@ struct vnode {
             mx_off_t length; // extent of data
         } vmo;
         struct {
-            mx_off_t length;
-            uint8_t* block[];
+            mx_handle_t h;   // created on the first write
+            mx_off_t length; // extent of data
+            mx_off_t size;   // of the vmo, which may run past length
         } data;
     };
 };
@@ -56,6 +62,7 @@ ssize_t vfs_do_ioctl(vnode_t* vn, uint32_t op, const void* in_buf,
                      size_t in_len, void* out_buf, size_t out_len);
 
 mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len);
+mx_status_t vmofile_inflate(vnode_t* vn);
 
 
 void vfs_notify_add(vnode_t* vndir, const char* name, size_t namelen);
@@ -77,11 +84,13 @@ mx_status_t devfs_remove(vnode_t* vn);
 
 // boot fs
 vnode_t* bootfs_get_root(void);
-mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            uint32_t flags);
 
 // system fs
 vnode_t* systemfs_get_root(void);
-mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len);
+mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                              uint32_t flags);
 
 // memory fs
 vnode_t* memfs_get_root(void);
@@ -91,6 +100,8 @@ mx_status_t mem_create_none(vnode_t* vndir, vnode_t** out, const char* name, siz
 ssize_t mem_write_none(vnode_t* vn, const void* data, size_t len, size_t off);
 ssize_t memfs_read_none(vnode_t* vn, void* data, size_t len, size_t off);
 mx_status_t mem_readdir_none(vnode_t* parent, void* cookie, void* data, size_t len);
+// a handle to the vmo holding a data file, for mapping it
+mx_handle_t mem_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len);
 
 // TODO(orr) normally static; temporary exposure, to be undone in subsequent patch
 mx_status_t _mem_create(vnode_t* parent, vnode_t** out,
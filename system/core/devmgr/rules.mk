@@ -36,7 +36,8 @@ MODULE_STATIC_LIBS := \
     ulib/launchpad \
     ulib/elfload \
     ulib/mxio \
-    ulib/fs
+    ulib/fs \
+    ulib/lz4
 
 MODULE_LIBS := ulib/magenta ulib/musl
 
@@ -74,7 +75,9 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/devhost.c \
     $(LOCAL_DIR)/devhost-api.c \
     $(LOCAL_DIR)/devhost-binding.c \
+    $(LOCAL_DIR)/devhost-block.c \
     $(LOCAL_DIR)/devhost-core.c \
+    $(LOCAL_DIR)/devhost-ethernet.c \
     $(LOCAL_DIR)/devhost-rpc-server.c \
     $(DRIVER_SRCS) \
 
@@ -7,23 +7,132 @@
 
 #include <fs/vfs.h>
 
+#include <magenta/bootdata.h>
 #include <magenta/listnode.h>
+#include <magenta/syscalls.h>
 
 #include <ddk/device.h>
 
 #include <mxio/debug.h>
 #include <mxio/vfs.h>
 
+#include <lz4/lz4frame.h>
+
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #define MXDEBUG 0
 
+// Files that mkbootfs compressed stay LZ4 frames in the bootfs VMO until
+// something first reads, maps or runs them.  Then each is decompressed into a
+// VMO of its own, which serves it from then on, so the files that are never
+// used never cost the time or memory to decompress.
+static mtx_t inflate_lock = MTX_INIT;
+
+#define INFLATE_CHUNK (64 * 1024)
+
+// Decompresses the LZ4 frame at |off| in |src| into exactly |len| bytes at |dst|.
+static mx_status_t lz4_inflate(mx_handle_t src, mx_off_t off, uint8_t* dst, size_t len) {
+    LZ4F_decompressionContext_t dctx;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+        return ERR_NO_MEMORY;
+    }
+    uint8_t* buf = malloc(INFLATE_CHUNK);
+    if (buf == NULL) {
+        LZ4F_freeDecompressionContext(dctx);
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t status;
+    size_t out = 0;
+    for (;;) {
+        size_t n;
+        if ((status = mx_vmo_read(src, buf, off, INFLATE_CHUNK, &n)) < 0) {
+            break;
+        }
+        if (n == 0) {
+            // the VMO ended before the frame did
+            status = ERR_IO;
+            break;
+        }
+        const uint8_t* p = buf;
+        while (n > 0) {
+            size_t dst_size = len - out;
+            size_t src_size = n;
+            size_t hint = LZ4F_decompress(dctx, dst + out, &dst_size, p, &src_size, NULL);
+            if (LZ4F_isError(hint) || (dst_size == 0 && src_size == 0)) {
+                // corrupt, or decompresses to more than the entry says
+                status = ERR_IO;
+                goto done;
+            }
+            out += dst_size;
+            p += src_size;
+            n -= src_size;
+            off += src_size;
+            if (hint == 0) {
+                // end of the frame
+                status = (out == len) ? NO_ERROR : ERR_IO;
+                goto done;
+            }
+        }
+    }
+done:
+    free(buf);
+    LZ4F_freeDecompressionContext(dctx);
+    return status;
+}
+
+mx_status_t vmofile_inflate(vnode_t* vn) {
+    if (!(vn->memfs_flags & MEMFS_FLAG_VMO_COMPRESSED)) {
+        return NO_ERROR;
+    }
+    mtx_lock(&inflate_lock);
+    mx_status_t status = NO_ERROR;
+    if (!(vn->memfs_flags & MEMFS_FLAG_VMO_COMPRESSED)) {
+        // someone else got here first
+        goto done;
+    }
+
+    mx_handle_t vmo;
+    if ((status = mx_vmo_create(vn->vmo.length, 0, &vmo)) < 0) {
+        goto done;
+    }
+    uintptr_t addr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, vn->vmo.length, &addr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    if (status < 0) {
+        mx_handle_close(vmo);
+        goto done;
+    }
+    status = lz4_inflate(vn->vmo.h, vn->vmo.offset, (uint8_t*)addr, vn->vmo.length);
+    mx_process_unmap_vm(mx_process_self(), addr, 0);
+    if (status < 0) {
+        printf("bootfs: vn %p does not decompress (%d)\n", vn, status);
+        mx_handle_close(vmo);
+        goto done;
+    }
+    xprintf("vmofile: vn %p decompressed %" PRIu64 " bytes\n", vn, vn->vmo.length);
+
+    // the bootfs VMO is shared by all of its files; this one is ours
+    vn->vmo.h = vmo;
+    vn->vmo.offset = 0;
+    vn->memfs_flags &= ~MEMFS_FLAG_VMO_COMPRESSED;
+done:
+    mtx_unlock(&inflate_lock);
+    return status;
+}
+
 
 mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    mx_status_t status = vmofile_inflate(vn);
+    if (status < 0)
+        return status;
     mx_handle_t vmo;
-    mx_status_t status = mx_handle_duplicate(vn->vmo.h, MX_RIGHT_READ | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, &vmo);
+    // MAP and EXECUTE so that clients can mmap() the file, and run it in place
+    status = mx_handle_duplicate(vn->vmo.h, MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP |
+                                             MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER, &vmo);
     if (status < 0)
         return status;
     xprintf("vmofile: %x (%x) off=%" PRIu64 " len=%" PRIu64 "\n", vmo, vn->vmo.h, vn->vmo.offset, vn->vmo.length);
@@ -35,13 +144,18 @@ mx_handle_t vfs_get_vmofile(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
 
 static mx_status_t _vnb_create(vnode_t* parent, vnode_t** out,
                                const char* name, size_t namelen,
-                               mx_handle_t h, mx_off_t off, size_t datalen) {
+                               mx_handle_t h, mx_off_t off, size_t datalen,
+                               uint32_t flags) {
     if (parent->dnode == NULL) {
         return ERR_NOT_DIR;
     }
 
+    uint32_t memfs_flags = MEMFS_TYPE_VMO | MEMFS_FLAG_VMO_REUSE;
+    if (flags & BOOTFS_FILE_COMPRESSED) {
+        memfs_flags |= MEMFS_FLAG_VMO_COMPRESSED;
+    }
     vnode_t* vnb;
-    mx_status_t r = _mem_create(parent, &vnb, name, namelen, MEMFS_TYPE_VMO|MEMFS_FLAG_VMO_REUSE);
+    mx_status_t r = _mem_create(parent, &vnb, name, namelen, memfs_flags);
     if (r < 0) {
         if (mx_handle_close(h) < 0) {
             printf("memfs_create_from_vmo: unexpected error closing handle\n");
@@ -89,7 +203,7 @@ static mx_status_t _vnb_mkdir(vnode_t* parent, vnode_t** out, const char* name,
 }
 
 static mx_status_t _add_file(vnode_t* vnb, const char* path, mx_handle_t vmo,
-                             mx_off_t off, size_t len) {
+                             mx_off_t off, size_t len, uint32_t flags) {
     mx_status_t r;
     if ((path[0] == '/') || (path[0] == 0))
         return ERR_INVALID_ARGS;
@@ -99,7 +213,7 @@ static mx_status_t _add_file(vnode_t* vnb, const char* path, mx_handle_t vmo,
             if (path[0] == 0) {
                 return ERR_INVALID_ARGS;
             }
-            return _vnb_create(vnb, &vnb, path, strlen(path), vmo, off, len);
+            return _vnb_create(vnb, &vnb, path, strlen(path), vmo, off, len, flags);
         } else {
             if (nextpath == path)
                 return ERR_INVALID_ARGS;
@@ -112,11 +226,13 @@ static mx_status_t _add_file(vnode_t* vnb, const char* path, mx_handle_t vmo,
     }
 }
 
-mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len) {
-    return _add_file(bootfs_get_root(), path, vmo, off, len);
+mx_status_t bootfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                            uint32_t flags) {
+    return _add_file(bootfs_get_root(), path, vmo, off, len, flags);
 }
 
-mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len) {
-    return _add_file(systemfs_get_root(), path, vmo, off, len);
+mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, size_t len,
+                              uint32_t flags) {
+    return _add_file(systemfs_get_root(), path, vmo, off, len, flags);
 }
 
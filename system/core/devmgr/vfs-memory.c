@@ -16,25 +16,21 @@
 #include <mxio/vfs.h>
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
 #define MXDEBUG 0
 
-#define MAXBLOCKS 8192
-#define BLOCKSIZE 8192
-
 mx_status_t mem_get_node(vnode_t** out, mx_device_t* dev);
 mx_status_t mem_can_unlink(dnode_t* dn);
 
 static void mem_release(vnode_t* vn) {
     xprintf("memfs: vn %p destroyed\n", vn);
 
-    for (int i = 0; i < MAXBLOCKS; i++) {
-        if (vn->data.block[i]) {
-            free(vn->data.block[i]);
-        }
+    if (vn->data.h != MX_HANDLE_INVALID) {
+        mx_handle_close(vn->data.h);
     }
     free(vn);
 }
@@ -53,108 +49,146 @@ mx_status_t memfs_close(vnode_t* vn) {
     return NO_ERROR;
 }
 
-static ssize_t mem_read(vnode_t* vn, void* _data, size_t len, size_t off) {
-    uint8_t* data = _data;
-    ssize_t count = 0;
+// Make the vmo holding a data file's contents, creating it if it doesn't
+// exist yet, at least len bytes long.
+static mx_status_t mem_vmo_grow(vnode_t* vn, uint64_t len) {
+    if (len <= vn->data.size) {
+        return NO_ERROR;
+    }
+    // doubling keeps resizes rare for files written a little at a time;
+    // only the pages written to take up memory
+    uint64_t size = (len > 2 * vn->data.size) ? len : 2 * vn->data.size;
+    size = (size + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+    mx_status_t r;
+    if (vn->data.h == MX_HANDLE_INVALID) {
+        r = mx_vmo_create(size, 0, &vn->data.h);
+    } else {
+        r = mx_vmo_set_size(vn->data.h, size);
+    }
+    if (r < 0) {
+        return r;
+    }
+    vn->data.size = size;
+    return NO_ERROR;
+}
+
+static ssize_t _mem_read(vnode_t* vn, void* data, size_t len, size_t off) {
     if (off >= vn->data.length)
         return 0;
     if (len > (vn->data.length - off))
         len = vn->data.length - off;
 
-    size_t bno = off / BLOCKSIZE;
-    off = off % BLOCKSIZE;
-    while (len > 0) {
-        size_t xfer = (BLOCKSIZE - off);
-        if (len < xfer)
-            xfer = len;
-        if (vn->data.block[bno] == NULL) {
-            xprintf("mem_read: hole at %zu\n", bno);
-            memset(data, 0, xfer);
-        } else {
-            memcpy(data, vn->data.block[bno] + off, xfer);
-        }
-        data += xfer;
-        len -= xfer;
-        count += xfer;
-        bno++;
-        off = 0;
-    }
-    return count;
-}
-
-static ssize_t mem_write(vnode_t* vn, const void* _data, size_t len, size_t off) {
-    const uint8_t* data = _data;
-    ssize_t count = 0;
-    size_t bno = off / BLOCKSIZE;
-    off = off % BLOCKSIZE;
-    while (len > 0) {
-        size_t xfer = (BLOCKSIZE - off);
+    // past the end of the vmo is a hole
+    size_t xfer = 0;
+    if (off < vn->data.size) {
+        xfer = vn->data.size - off;
         if (len < xfer)
             xfer = len;
-        if (bno >= MAXBLOCKS) {
-            return count ? count : ERR_NO_MEMORY;
+        size_t actual;
+        mx_status_t r = mx_vmo_read(vn->data.h, data, off, xfer, &actual);
+        if (r < 0) {
+            return r;
         }
-        if (vn->data.block[bno] == NULL) {
-            xprintf("mem_write: alloc at %zu\n", bno);
-            if ((vn->data.block[bno] = calloc(1, BLOCKSIZE)) == NULL) {
-                return count ? count : ERR_NO_MEMORY;
-            }
+        if (actual != xfer) {
+            return ERR_IO;
         }
-        memcpy(vn->data.block[bno] + off, data, xfer);
-
-        size_t pos = bno * BLOCKSIZE + off + xfer;
-        if (pos > vn->data.length)
-            vn->data.length = pos;
+    }
+    memset((uint8_t*)data + xfer, 0, len - xfer);
+    return len;
+}
 
-        data += xfer;
-        len -= xfer;
-        count += xfer;
-        bno++;
-        off = 0;
+static ssize_t _mem_write(vnode_t* vn, const void* data, size_t len, size_t off) {
+    if (len == 0) {
+        return 0;
+    }
+    if (off + len < off) {
+        return ERR_INVALID_ARGS;
+    }
+    mx_status_t r;
+    if ((r = mem_vmo_grow(vn, off + len)) < 0) {
+        return r;
     }
-    return count;
+    size_t actual;
+    if ((r = mx_vmo_write(vn->data.h, data, off, len, &actual)) < 0) {
+        return r;
+    }
+    if ((off + actual) > vn->data.length)
+        vn->data.length = off + actual;
+    return actual;
 }
 
-mx_status_t memfs_truncate(vnode_t* vn, size_t len) {
-    mx_status_t r = 0;
+static ssize_t mem_read(vnode_t* vn, void* data, size_t len, size_t off) {
+    mtx_lock(&vn->lock);
+    ssize_t r = _mem_read(vn, data, len, off);
+    mtx_unlock(&vn->lock);
+    return r;
+}
 
-    while (len < vn->data.length) {
-        // Truncate should make the file shorter
+static ssize_t mem_write(vnode_t* vn, const void* data, size_t len, size_t off) {
+    mtx_lock(&vn->lock);
+    ssize_t r = _mem_write(vn, data, len, off);
+    mtx_unlock(&vn->lock);
+    return r;
+}
 
-        // Observe the final blocks of the file first
-        size_t bno = vn->data.length / BLOCKSIZE;
-        size_t b_start = bno * BLOCKSIZE;
+static mx_handle_t _mem_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    // the mapping covers the file's last page, if partial, as well
+    mx_status_t r = mem_vmo_grow(vn, vn->data.length ? vn->data.length : 1);
+    if (r < 0) {
+        return r;
+    }
+    mx_handle_t vmo;
+    r = mx_handle_duplicate(vn->data.h, MX_RIGHT_READ | MX_RIGHT_WRITE | MX_RIGHT_EXECUTE |
+                                        MX_RIGHT_MAP | MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER,
+                            &vmo);
+    if (r < 0) {
+        return r;
+    }
+    *off = 0;
+    *len = vn->data.length;
+    return vmo;
+}
 
-        if (b_start == vn->data.length) {
-            // If the last block is empty, move to the one before
-            bno--;
-            b_start -= BLOCKSIZE;
-        }
-        // "b_start" is now guaranteed to be less than "mem->datalen"
+mx_handle_t mem_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    mtx_lock(&vn->lock);
+    mx_handle_t r = _mem_get_vmo(vn, off, len);
+    mtx_unlock(&vn->lock);
+    return r;
+}
 
-        if (len <= b_start) {
-            // Wipe out this entire block
-            if (vn->data.block[bno] != NULL) {
-                free(vn->data.block[bno]);
-                vn->data.block[bno] = NULL;
+static mx_status_t _memfs_truncate(vnode_t* vn, size_t len) {
+    if ((len < vn->data.length) && (vn->data.h != MX_HANDLE_INVALID)) {
+        // Truncate should make the file shorter: the pages past the new end
+        // go back, and the rest of the last one must read as zeroes if the
+        // file grows again
+        uint64_t size = (len + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+        if (size < vn->data.size) {
+            mx_status_t r;
+            if ((r = mx_vmo_set_size(vn->data.h, size)) < 0) {
+                return r;
             }
-            vn->data.length = b_start;
-        } else {
-            // Wipe out a portion of a block
-            size_t sub_block_off = len - b_start;
-            memset(vn->data.block[bno] + sub_block_off, 0, BLOCKSIZE - sub_block_off);
-            vn->data.length = len;
+            vn->data.size = size;
         }
-    }
-    if (len > vn->data.length) {
-        // Truncate should make the file longer
-        if (len > MAXBLOCKS * BLOCKSIZE) {
-            return ERR_INVALID_ARGS;
+        static const uint8_t zeroes[PAGE_SIZE];
+        uint64_t end = (vn->data.length < vn->data.size) ? vn->data.length : vn->data.size;
+        if (len < end) {
+            size_t actual;
+            mx_status_t r;
+            if ((r = mx_vmo_write(vn->data.h, zeroes, len, end - len, &actual)) < 0) {
+                return r;
+            }
         }
-        // Memfs supports sparse files, so we can simply extend the data length,
-        // and trust the rest of the filesystem to deal with this appropriately
-        vn->data.length = len;
     }
+    // Memfs supports sparse files, so growing the file only moves its end;
+    // nothing past the vmo is ever read
+    vn->data.length = len;
+    return NO_ERROR;
+}
+
+mx_status_t memfs_truncate(vnode_t* vn, size_t len) {
+    mtx_lock(&vn->lock);
+    mx_status_t r = _memfs_truncate(vn, len);
+    mtx_unlock(&vn->lock);
     return r;
 }
 
@@ -288,7 +322,9 @@ mx_status_t mem_lookup_none(vnode_t* parent, vnode_t** out, const char* name, si
 static mx_status_t mem_getattr(vnode_t* vn, vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
     if (vn->dnode == NULL) {
+        mtx_lock(&vn->lock);
         attr->size = vn->data.length;
+        mtx_unlock(&vn->lock);
         attr->mode = V_TYPE_FILE | V_IRUSR;
     } else {
         attr->mode = V_TYPE_DIR | V_IRUSR;
@@ -396,10 +432,13 @@ void vmo_release(vnode_t* vn) {
 ssize_t vmo_read(vnode_t* vn, void* data, size_t len, size_t off) {
     if (off > vn->vmo.length)
         return 0;
+    mx_status_t r = vmofile_inflate(vn);
+    if (r < 0)
+        return r;
     size_t rlen = vn->vmo.length - off;
     if (len > rlen)
         len = rlen;
-    mx_status_t r = mx_vmo_read(vn->vmo.h, data, vn->vmo.offset+off, len, &len);
+    r = mx_vmo_read(vn->vmo.h, data, vn->vmo.offset+off, len, &len);
     if (r < 0) {
         return r;
     }
@@ -419,7 +458,10 @@ static ssize_t vmo_write(vnode_t* vn, const void* data, size_t len, size_t off)
         // TODO(orr): grow vmo to support extending length
         return ERR_NOT_SUPPORTED;
     }
-    mx_status_t r = mx_vmo_write(vn->vmo.h, data, vn->vmo.offset+off, len, &rlen);
+    mx_status_t r = vmofile_inflate(vn);
+    if (r < 0)
+        return r;
+    r = mx_vmo_write(vn->vmo.h, data, vn->vmo.offset+off, len, &rlen);
     if (r < 0) {
         return r;
     }
@@ -527,7 +569,7 @@ mx_status_t _mem_create(vnode_t* parent, vnode_t** out,
     vnode_t* vn;
     switch (type) {
     case MEMFS_TYPE_DATA:
-        if ((vn = calloc(1, sizeof(vnode_t)+MAXBLOCKS*sizeof(uint8_t*))) == NULL) {
+        if ((vn = calloc(1, sizeof(vnode_t))) == NULL) {
             return ERR_NO_MEMORY;
         }
         vn->ops = &vn_mem_ops;
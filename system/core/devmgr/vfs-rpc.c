@@ -28,6 +28,13 @@
 
 #define MXDEBUG 0
 
+// Connections are spread over the dispatcher's threads, each served by
+// one of them.  What's under a directory is guarded by vfs_lock, which
+// is held for walks and for changes to the tree, and memfs data files
+// have a lock of their own, so reads and writes don't wait on lookups
+// or on each other.
+#define VFS_THREADS 4
+
 static mxio_dispatcher_t* vfs_dispatcher;
 
 static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie);
@@ -252,12 +259,21 @@ static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
     }
     case MXRIO_WRITE: {
         if (ios->io_flags & O_APPEND) {
+            // under vfs_lock, so that appenders on other connections
+            // can't find the same end of file
             vnattr_t attr;
-            mx_status_t r;
-            if ((r = vn->ops->getattr(vn, &attr)) < 0) {
-                return r;
+            ssize_t r;
+            mtx_lock(&vfs_lock);
+            if ((r = vn->ops->getattr(vn, &attr)) >= 0) {
+                ios->io_off = attr.size;
+                r = vn->ops->write(vn, msg->data, len, ios->io_off);
+            }
+            mtx_unlock(&vfs_lock);
+            if (r >= 0) {
+                ios->io_off += r;
+                msg->arg2.off = ios->io_off;
             }
-            ios->io_off = attr.size;
+            return r;
         }
         ssize_t r = vn->ops->write(vn, msg->data, len, ios->io_off);
         if (r >= 0) {
@@ -394,13 +410,44 @@ static mx_status_t _vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie)
         if (data_end <= newpath) {
             return ERR_INVALID_ARGS;
         }
-        return vfs_rename(vn, oldpath, newpath, rh);
+        mtx_lock(&vfs_lock);
+        mx_status_t r = vfs_rename(vn, oldpath, newpath, rh);
+        mtx_unlock(&vfs_lock);
+        return r;
     }
     case MXRIO_SYNC: {
         return vn->ops->sync(vn);
     }
-    case MXRIO_UNLINK:
-        return vn->ops->unlink(vn, (const char*)msg->data, len);
+    case MXRIO_MMAP: {
+        // every file lives in a VMO, which is handed out as is
+        mx_off_t off, size;
+        mx_handle_t vmo;
+        switch (vn->memfs_flags & MEMFS_TYPE_MASK) {
+        case MEMFS_TYPE_DATA:
+            vmo = mem_get_vmo(vn, &off, &size);
+            break;
+        case MEMFS_TYPE_VMO:
+            vmo = vfs_get_vmofile(vn, &off, &size);
+            break;
+        default:
+            return ERR_NOT_SUPPORTED;
+        }
+        if (vmo < 0) {
+            return vmo;
+        }
+        msg->handle[0] = vmo;
+        msg->hcount = 1;
+        msg->arg2.off = off;
+        memcpy(msg->data, &size, sizeof(size));
+        msg->datalen = sizeof(size);
+        return NO_ERROR;
+    }
+    case MXRIO_UNLINK: {
+        mtx_lock(&vfs_lock);
+        mx_status_t r = vn->ops->unlink(vn, (const char*)msg->data, len);
+        mtx_unlock(&vfs_lock);
+        return r;
+    }
     default:
         return ERR_NOT_SUPPORTED;
     }
@@ -429,7 +476,7 @@ static vnode_t* global_vfs_root;
 void vfs_global_init(vnode_t* root) {
     global_vfs_root = root;
     if (mxio_dispatcher_create(&vfs_dispatcher, mxrio_handler) == NO_ERROR) {
-        mxio_dispatcher_start(vfs_dispatcher, "vfs-rio-dispatcher");
+        mxio_dispatcher_start_threads(vfs_dispatcher, "vfs-rio-dispatcher", VFS_THREADS);
     }
 }
 
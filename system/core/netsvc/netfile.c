@@ -63,7 +63,8 @@ void netfile_open(const char *filename, uint32_t cookie, uint32_t arg,
         netfile.fd = -1;
     }
     netfile.blocknum = 0;
-    netfile.cookie = cookie;
+    netfile.datasize = 0;
+    nb_window_init(&netfile.window, 0);
 
     struct stat st;
 again: // label here to catch filename=/path/to/new/directory/
@@ -115,18 +116,17 @@ void netfile_read(uint32_t cookie, uint32_t arg,
         udp6_send(&m.hdr, sizeof(m.hdr), saddr, sport, dport);
         return;
     }
-    if (arg == (netfile.blocknum - 1)) {
-        // repeat of last block read, probably due to dropped packet
-        // unless cookie doesn't match, in which case it's an error
-        if (cookie != netfile.cookie) {
-            m.hdr.arg = -EIO;
+    // Reads are asked for ahead, so when one goes missing those after it
+    // are asked for again: go back to any block, but don't read the last
+    // one again.
+    if ((netfile.blocknum == 0) || (arg != (netfile.blocknum - 1))) {
+        if ((arg != netfile.blocknum) &&
+            (lseek(netfile.fd, (off_t)arg * sizeof(netfile.data), SEEK_SET) < 0)) {
+            printf("netsvc: error seeking '%s': %d\n", netfile.filename, errno);
+            m.hdr.arg = -errno;
             udp6_send(&m.hdr, sizeof(m.hdr), saddr, sport, dport);
             return;
         }
-    } else if (arg != netfile.blocknum) {
-        // ignore bogus read requests -- host will timeout if they're confused
-        return;
-    } else {
         ssize_t n = read(netfile.fd, netfile.data, sizeof(netfile.data));
         if (n < 0) {
             n = 0;
@@ -138,8 +138,7 @@ void netfile_read(uint32_t cookie, uint32_t arg,
             return;
         }
         netfile.datasize = n;
-        netfile.blocknum++;
-        netfile.cookie = cookie;
+        netfile.blocknum = arg + 1;
     }
 
     m.hdr.arg = arg;
@@ -162,18 +161,13 @@ void netfile_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
         return;
     }
 
-    if (arg == (netfile.blocknum - 1)) {
-        // repeat of last block write, probably due to dropped packet
-        // unless cookie doesn't match, in which case it's an error
-        if (cookie != netfile.cookie) {
-            m.arg = -EIO;
-            udp6_send(&m, sizeof(m), saddr, sport, dport);
-            return;
-        }
-    } else if (arg != netfile.blocknum) {
-        // ignore bogus write requests -- host will timeout if they're confused
+    // Writes are sent ahead of their acks, which are for the block wanted
+    // next.  Acking each one costs little here, and means the host needn't
+    // wait out a timeout for the last few.
+    switch (nb_window_check(&netfile.window, arg)) {
+    case NB_WINDOW_DROP:
         return;
-    } else {
+    case NB_WINDOW_TAKE: {
         ssize_t n = write(netfile.fd, data, len);
         if (n != (ssize_t)len) {
             printf("netsvc: error writing %s: %d\n", netfile.filename, errno);
@@ -186,10 +180,12 @@ void netfile_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
             udp6_send(&m, sizeof(m), saddr, sport, dport);
             return;
         }
-        netfile.blocknum++;
-        netfile.cookie = cookie;
+        nb_window_advance(&netfile.window, arg + 1, true);
+        break;
+    }
     }
 
+    m.arg = netfile.window.expected;
     udp6_send(&m, sizeof(m), saddr, sport, dport);
 }
 
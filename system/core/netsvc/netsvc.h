@@ -13,10 +13,10 @@
 typedef struct netfile_state_t {
     int      fd;
     char     filename[1024]; // for debugging
-    uint32_t blocknum;
-    uint32_t cookie;
-    uint8_t  data[1024];
+    uint32_t blocknum;       // the block the next read() gets
+    uint8_t  data[1024];     // the block before it
     size_t   datasize;
+    nbwindow window;         // of blocks written
 } netfile_state;
 
 extern netfile_state netfile;
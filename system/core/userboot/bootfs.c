@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include "bootfs.h"
+#include "decompress.h"
 #include "util.h"
 
 #pragma GCC visibility push(hidden)
@@ -20,6 +21,7 @@ void bootfs_mount(mx_handle_t proc_self, mx_handle_t log, mx_handle_t vmo, struc
     uintptr_t addr = 0;
     status = mx_process_map_vm(proc_self, vmo, 0, size, &addr, MX_VM_FLAG_PERM_READ);
     check(log, status, "mx_process_map_vm failed on bootfs vmo\n");
+    fs->proc_self = proc_self;
     fs->contents =  (const void*)addr;
     fs->len = size;
 }
@@ -94,8 +96,15 @@ mx_handle_t bootfs_open(mx_handle_t log,
     struct bootfs_file file = bootfs_search(log, fs, filename);
     if (file.offset == 0 && file.size == 0)
         fail(log, ERR_INVALID_ARGS, "file not found\n");
+
+    uint32_t flags = file.offset & BOOTFS_FILE_FLAGS_MASK;
+    file.offset &= ~BOOTFS_FILE_FLAGS_MASK;
     if (file.offset > fs->len)
         fail(log, ERR_INVALID_ARGS, "bogus offset in bootfs header!\n");
+    // the size is what a compressed file decompresses to
+    if (flags & BOOTFS_FILE_COMPRESSED)
+        return decompress_bootfs_file(log, fs->proc_self,
+                                      &fs->contents[file.offset], file.size);
     if (fs->len - file.offset < file.size)
         fail(log, ERR_INVALID_ARGS, "bogus size in bootfs header!\n");
 
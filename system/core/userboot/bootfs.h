@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 struct bootfs {
+    mx_handle_t proc_self;
     const uint8_t* contents;
     size_t len;
 };
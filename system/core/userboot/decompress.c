@@ -5,10 +5,14 @@
 #include "decompress.h"
 #include "util.h"
 
+#include <stdbool.h>
+#include <stdnoreturn.h>
 #include <string.h>
+#include <sys/param.h>
 
 #include <magenta/bootdata.h>
 #include <magenta/compiler.h>
+#include <magenta/stack.h>
 #include <magenta/syscalls.h>
 
 #include <lz4.h>
@@ -22,6 +26,12 @@
 //  - Final content size must be included in frame header
 //  - Max block size is 64kB
 //
+// Independent blocks can be decompressed in any order, so the blocks of a
+// large frame are shared out among threads on all the CPUs. For that, every
+// block but the last must hold exactly 64kB, which is how the LZ4 Frame
+// library lays them out unless it is told to flush early. Frames laid out
+// some other way are still decompressed, just on one thread.
+//
 //  See https://github.com/lz4/lz4/blob/dev/lz4_Frame_format.md for details.
 #define MX_LZ4_MAGIC 0x184D2204
 #define MX_LZ4_VERSION (1 << 6)
@@ -46,6 +56,13 @@ typedef struct {
 #define MX_LZ4_BLOCK_1MB          (6 << 4)
 #define MX_LZ4_BLOCK_4MB          (7 << 4)
 
+#define MX_LZ4_BLOCK_SIZE         (64 << 10)
+
+// Decompression is spread over at most this many threads, including the one
+// which called it. The others each get a stack of this size.
+#define LZ4_MAX_THREADS           8
+#define LZ4_THREAD_STACK_SIZE     (4 * PAGE_SIZE)
+
 static void check_lz4_frame(mx_handle_t log, const lz4_frame_desc* fd, size_t expected) {
     if ((fd->flag & MX_LZ4_FLAG_VERSION) != MX_LZ4_VERSION) {
         fail(log, ERR_INVALID_ARGS, "bad lz4 version for bootfs\n");
@@ -77,47 +94,153 @@ static void check_lz4_frame(mx_handle_t log, const lz4_frame_desc* fd, size_t ex
     // TODO: header checksum
 }
 
-static mx_handle_t decompress_bootfs_vmo(mx_handle_t log, mx_handle_t proc_self, const uint8_t* data) {
-    const bootdata_t* hdr = (bootdata_t*)data;
+// One thread's part of a frame: every |stride|th block, starting with block
+// |first|.
+typedef struct {
+    const uint8_t* blocks;
+    uint8_t* dst;
+    size_t size;
+    uint32_t first;
+    uint32_t stride;
+    bool ok;
+} lz4_share;
 
-    // Skip past the bootdata header
-    data += sizeof(bootdata_t);
+// Decompresses the blocks of |share| to their places in its |dst|. Returns
+// false if a block does not decompress or the frame does not have full-size
+// blocks covering exactly |size| bytes.
+static bool decompress_lz4_share(const lz4_share* share) {
+    const uint8_t* data = share->blocks;
+    size_t offset = 0;
+    for (uint32_t i = 0;; i++, offset += MX_LZ4_BLOCK_SIZE) {
+        uint32_t blocksize = *(const uint32_t*)data;
+        data += sizeof(uint32_t);
+        if (blocksize == 0) {
+            return offset >= share->size;
+        }
+        if (offset >= share->size) {
+            return false;
+        }
 
-    if (*(const uint32_t*)data != MX_LZ4_MAGIC) {
-        fail(log, ERR_INVALID_ARGS, "bad magic number for compressed bootfs\n");
+        // If the data is uncompressed, the high bit is 1.
+        uint32_t actual = blocksize & 0x7fffffff;
+        if (i % share->stride == share->first) {
+            size_t want = MIN(share->size - offset, (size_t)MX_LZ4_BLOCK_SIZE);
+            uint8_t* dst = share->dst + offset;
+            if (blocksize >> 31) {
+                if (actual != want) {
+                    return false;
+                }
+                memcpy(dst, data, actual);
+            } else if (LZ4_decompress_safe((const char*)data, (char*)dst,
+                                           actual, want) != (int)want) {
+                return false;
+            }
+        }
+        data += actual;
     }
-    data += sizeof(uint32_t);
+}
 
-    size_t newsize = hdr->outsize;
-    check_lz4_frame(log, (const lz4_frame_desc*)data, newsize - sizeof(bootdata_t));
-    data += sizeof(lz4_frame_desc);
+static noreturn void lz4_thread_entry(uintptr_t arg1, uintptr_t arg2) {
+    lz4_share* share = (lz4_share*)arg1;
+    share->ok = decompress_lz4_share(share);
+    mx_thread_exit();
+    __builtin_trap();
+}
 
-    newsize = (newsize + 4095) & ~4095;
-    if (newsize < hdr->outsize) {
-        // newsize wrapped, which means the outsize was too large
-        fail(log, ERR_NO_MEMORY, "lz4 output size too large\n");
+// Decompresses the |size| bytes held by the LZ4 blocks starting at |blocks|
+// into |dst| using up to one thread per CPU. Returns false, leaving |dst|
+// partly written, if that wasn't worth doing or the frame's blocks aren't
+// laid out in a way that lets it be done.
+static bool decompress_lz4_parallel(mx_handle_t log, mx_handle_t proc_self,
+                                    const uint8_t* blocks, size_t size,
+                                    uint8_t* dst, size_t remaining) {
+    size_t nblocks = (size + MX_LZ4_BLOCK_SIZE - 1) / MX_LZ4_BLOCK_SIZE;
+    uint32_t nthreads = MIN(mx_num_cpus(), LZ4_MAX_THREADS);
+    if (nthreads > nblocks) {
+        nthreads = (uint32_t)nblocks;
     }
-    mx_handle_t dst_vmo;
-    mx_status_t status = mx_vmo_create((uint64_t)newsize, 0, &dst_vmo);
-    if (status < 0) {
-        check(log, status, "mx_vmo_create failed for decompressing bootfs\n");
+    if (nthreads < 2 || size > remaining) {
+        return false;
     }
 
-    uintptr_t dst_addr = 0;
-    status = mx_process_map_vm(proc_self, dst_vmo, 0, newsize, &dst_addr,
+    size_t stacks_size = (nthreads - 1) * LZ4_THREAD_STACK_SIZE;
+    mx_handle_t stacks_vmo;
+    mx_status_t status = mx_vmo_create(stacks_size, 0, &stacks_vmo);
+    check(log, status, "mx_vmo_create failed for decompression thread stacks\n");
+    uintptr_t stacks_base = 0;
+    status = mx_process_map_vm(proc_self, stacks_vmo, 0, stacks_size, &stacks_base,
             MX_VM_FLAG_PERM_READ|MX_VM_FLAG_PERM_WRITE);
-    check(log, status, "mx_process_map_vm failed on bootfs vmo during decompression\n");
+    check(log, status, "mx_process_map_vm failed for decompression thread stacks\n");
+    mx_handle_close(stacks_vmo);
 
-    size_t remaining = newsize;
-    uint8_t* dst = (uint8_t*)dst_addr;
+    lz4_share shares[LZ4_MAX_THREADS];
+    mx_handle_t threads[LZ4_MAX_THREADS];
+    for (uint32_t i = 0; i < nthreads; i++) {
+        shares[i] = (lz4_share){
+            .blocks = blocks,
+            .dst = dst,
+            .size = size,
+            .first = i,
+            .stride = nthreads,
+            .ok = false,
+        };
+    }
 
-    bootdata_t* boothdr = (bootdata_t*)dst;
-    // Copy the bootdata header but mark it as not compressed
-    *boothdr = *hdr;
-    boothdr->insize = hdr->outsize;
-    boothdr->flags &= ~BOOTDATA_BOOTFS_FLAG_COMPRESSED;
-    dst += sizeof(bootdata_t);
-    remaining -= sizeof(bootdata_t);
+    // Share 0 is done on this thread.
+    static const char name[] = "userboot-lz4";
+    for (uint32_t i = 1; i < nthreads; i++) {
+        status = mx_thread_create(proc_self, name, sizeof(name) - 1, 0, &threads[i]);
+        if (status != NO_ERROR) {
+            threads[i] = MX_HANDLE_INVALID;
+            continue;
+        }
+        uintptr_t sp = compute_initial_stack_pointer(
+            stacks_base + (i - 1) * LZ4_THREAD_STACK_SIZE, LZ4_THREAD_STACK_SIZE);
+        status = mx_thread_start(threads[i], (uintptr_t)&lz4_thread_entry, sp,
+                                 (uintptr_t)&shares[i], 0);
+        if (status != NO_ERROR) {
+            mx_handle_close(threads[i]);
+            threads[i] = MX_HANDLE_INVALID;
+        }
+    }
+
+    bool ok = decompress_lz4_share(&shares[0]);
+    for (uint32_t i = 1; i < nthreads; i++) {
+        if (threads[i] == MX_HANDLE_INVALID) {
+            // No thread could be started for this share, so do it here.
+            shares[i].ok = decompress_lz4_share(&shares[i]);
+        } else {
+            status = mx_handle_wait_one(threads[i], MX_TASK_TERMINATED,
+                                        MX_TIME_INFINITE, NULL);
+            check(log, status, "mx_handle_wait_one failed on decompression thread\n");
+            mx_handle_close(threads[i]);
+        }
+        ok = ok && shares[i].ok;
+    }
+
+    status = mx_process_unmap_vm(proc_self, stacks_base, 0);
+    check(log, status, "mx_process_unmap_vm failed for decompression thread stacks\n");
+    return ok;
+}
+
+// Decompresses the LZ4 frame at |data|, which must say it holds |expected|
+// bytes, into |dst|, and returns how many bytes it wrote there.
+static size_t decompress_lz4_frame(mx_handle_t log, mx_handle_t proc_self,
+                                   const uint8_t* data, size_t expected,
+                                   uint8_t* dst, size_t remaining) {
+    if (*(const uint32_t*)data != MX_LZ4_MAGIC) {
+        fail(log, ERR_INVALID_ARGS, "bad magic number for compressed bootfs\n");
+    }
+    data += sizeof(uint32_t);
+
+    check_lz4_frame(log, (const lz4_frame_desc*)data, expected);
+    data += sizeof(lz4_frame_desc);
+
+    if (decompress_lz4_parallel(log, proc_self, data, expected, dst, remaining)) {
+        return expected;
+    }
+
+    const uint8_t* dst_start = dst;
 
     // Read each LZ4 block and decompress it. Block sizes are 32 bits.
     uint32_t blocksize = *(const uint32_t*)data;
@@ -126,13 +249,13 @@ static mx_handle_t decompress_bootfs_vmo(mx_handle_t log, mx_handle_t proc_self,
         // If the data is uncompressed, the high bit is 1.
         if (blocksize >> 31) {
             uint32_t actual = blocksize & 0x7fffffff;
-            memcpy(dst, data, actual);
-            dst += actual;
-            data += actual;
             if (remaining - actual > remaining) {
                 // Remaining wrapped around (would be negative if signed)
                 fail(log, ERR_INVALID_ARGS, "bootdata outsize too small for lz4 decompression\n");
             }
+            memcpy(dst, data, actual);
+            dst += actual;
+            data += actual;
             remaining -= actual;
         } else {
             int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
@@ -152,6 +275,45 @@ static mx_handle_t decompress_bootfs_vmo(mx_handle_t log, mx_handle_t proc_self,
         data += sizeof(uint32_t);
     }
 
+    return dst - dst_start;
+}
+
+static mx_handle_t decompress_bootfs_vmo(mx_handle_t log, mx_handle_t proc_self, const uint8_t* data) {
+    const bootdata_t* hdr = (bootdata_t*)data;
+
+    // Skip past the bootdata header
+    data += sizeof(bootdata_t);
+
+    size_t newsize = (hdr->outsize + 4095) & ~4095;
+    if (newsize < hdr->outsize) {
+        // newsize wrapped, which means the outsize was too large
+        fail(log, ERR_NO_MEMORY, "lz4 output size too large\n");
+    }
+    mx_handle_t dst_vmo;
+    mx_status_t status = mx_vmo_create((uint64_t)newsize, 0, &dst_vmo);
+    if (status < 0) {
+        check(log, status, "mx_vmo_create failed for decompressing bootfs\n");
+    }
+
+    uintptr_t dst_addr = 0;
+    status = mx_process_map_vm(proc_self, dst_vmo, 0, newsize, &dst_addr,
+            MX_VM_FLAG_PERM_READ|MX_VM_FLAG_PERM_WRITE);
+    check(log, status, "mx_process_map_vm failed on bootfs vmo during decompression\n");
+
+    size_t remaining = newsize;
+    uint8_t* dst = (uint8_t*)dst_addr;
+
+    bootdata_t* boothdr = (bootdata_t*)dst;
+    // Copy the bootdata header but mark it as not compressed
+    *boothdr = *hdr;
+    boothdr->insize = hdr->outsize;
+    boothdr->flags &= ~BOOTDATA_BOOTFS_FLAG_COMPRESSED;
+    dst += sizeof(bootdata_t);
+    remaining -= sizeof(bootdata_t);
+
+    remaining -= decompress_lz4_frame(log, proc_self, data,
+                                      hdr->outsize - sizeof(bootdata_t), dst, remaining);
+
     // Sanity check: verify that we didn't have more than one page leftover.
     // The bootdata header should have specified the exact outsize needed, which
     // we rounded up to the next full page.
@@ -165,6 +327,29 @@ static mx_handle_t decompress_bootfs_vmo(mx_handle_t log, mx_handle_t proc_self,
     return dst_vmo;
 }
 
+mx_handle_t decompress_bootfs_file(mx_handle_t log, mx_handle_t proc_self,
+                                   const uint8_t* data, size_t size) {
+    mx_handle_t vmo;
+    mx_status_t status = mx_vmo_create((uint64_t)size, 0, &vmo);
+    check(log, status, "mx_vmo_create failed for decompressing bootfs file\n");
+    if (size == 0)
+        return vmo;
+
+    uintptr_t addr = 0;
+    status = mx_process_map_vm(proc_self, vmo, 0, size, &addr,
+            MX_VM_FLAG_PERM_READ|MX_VM_FLAG_PERM_WRITE);
+    check(log, status, "mx_process_map_vm failed on bootfs file vmo during decompression\n");
+
+    if (decompress_lz4_frame(log, proc_self, data, size, (uint8_t*)addr, size) != size) {
+        fail(log, ERR_INVALID_ARGS,
+                "bootfs file size does not match its decompressed size\n");
+    }
+
+    status = mx_process_unmap_vm(proc_self, addr, 0);
+    check(log, status, "mx_process_unmap_vm after decompress failed\n");
+    return vmo;
+}
+
 mx_handle_t decompress_vmo(mx_handle_t log, mx_handle_t proc_self, mx_handle_t vmo) {
     uint64_t size;
     mx_status_t status = mx_vmo_get_size(vmo, &size);
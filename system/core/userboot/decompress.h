@@ -8,10 +8,17 @@
 #pragma GCC visibility push(hidden)
 
 #include <magenta/types.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // If the VMO holds a compressed bootdata, returns a handle to a new VMO with
 // the decompressed data and consumes the original VMO handle. Otherwise returns
 // the original handle.
 mx_handle_t decompress_vmo(mx_handle_t log, mx_handle_t proc_self, mx_handle_t vmo);
 
+// Returns a new VMO of |size| bytes holding the decompressed contents of the
+// bootfs file whose LZ4 frame starts at |data|.
+mx_handle_t decompress_bootfs_file(mx_handle_t log, mx_handle_t proc_self,
+                                   const uint8_t* data, size_t size);
+
 #pragma GCC visibility pop
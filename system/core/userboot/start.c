@@ -10,6 +10,7 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <magenta/ktrace.h>
 #include <magenta/stack.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/log.h>
@@ -24,6 +25,13 @@
 
 #define SHUTDOWN_COMMAND "poweroff"
 
+// the kernel reads a whole name's worth, whatever its length
+static void boot_stage(mx_handle_t rroot, const char* name) {
+    char buf[MX_MAX_NAME_LEN] = { 0 };
+    memcpy(buf, name, MIN(strlen(name), sizeof(buf) - 1));
+    mx_ktrace_control(rroot, KTRACE_ACTION_BOOT_STAGE, 0, buf);
+}
+
 static noreturn void do_shutdown(mx_handle_t log, mx_handle_t rroot) {
     print(log, "Process exited.  Executing \"", SHUTDOWN_COMMAND, "\".\n",
           NULL);
@@ -135,6 +143,8 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     if (job == MX_HANDLE_INVALID)
         fail(log, ERR_INVALID_ARGS, "no job handlke in bootstrap message\n");
 
+    boot_stage(resource_root, "userboot");
+
     // Hang on to our own process handle.  If we closed it, our process
     // would be killed.  Exiting will clean it up.
     const mx_handle_t proc_self = *proc_handle_loc;
@@ -226,6 +236,7 @@ static noreturn void bootstrap(mx_handle_t log, mx_handle_t bootstrap_pipe) {
     status = mx_process_start(proc, thread, entry, sp,
                               child_start_handle, vdso_base);
     check(log, status, "mx_process_start failed\n");
+    boot_stage(root_resource_handle, "userboot:start");
     status = mx_handle_close(thread);
     check(log, status, "mx_handle_close failed on thread handle\n");
 
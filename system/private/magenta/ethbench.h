@@ -0,0 +1,59 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+// The protocol between ethbench on the device (system/uapp/ethbench) and
+// ethbench on the host (system/tools/ethbench.c), over UDP6 to and from
+// ETHBENCH_PORT on the device's link local address.
+//
+// The host finds the device by sending ETHBENCH_HELLO to ff02::1, which
+// the device answers.  Then, for each test:
+//
+//   rx    the host sends count ETHBENCH_DATA, numbered by seq from 0, and
+//         then ETHBENCH_END until the device answers with ETHBENCH_STATS
+//         for the data it received.
+//   tx    the host sends ETHBENCH_SEND, which the device answers by
+//         sending an ethbench_send_t's worth of ETHBENCH_DATA, and then
+//         a few ETHBENCH_END with its ethbench_stats_t.
+//   ping  the host sends ETHBENCH_PING, which the device sends straight
+//         back as ETHBENCH_PONG, leaving the rest as it was.
+//
+// Values are in the byte order of the host and device, as in netboot.
+
+#define ETHBENCH_PORT 33340
+
+#define ETHBENCH_MAGIC 0xeb0b3e4c
+
+#define ETHBENCH_HELLO 1
+#define ETHBENCH_DATA  2
+#define ETHBENCH_END   3
+#define ETHBENCH_STATS 4
+#define ETHBENCH_SEND  5
+#define ETHBENCH_PING  6
+#define ETHBENCH_PONG  7
+
+typedef struct ethbench_hdr {
+    uint32_t magic;
+    uint32_t cmd;
+    uint32_t seq;
+    uint32_t arg;
+    uint64_t stamp;         // the sender's clock, in ns, for ping
+} ethbench_hdr_t;
+
+// follows ETHBENCH_SEND
+typedef struct ethbench_send {
+    uint32_t count;         // frames to send
+    uint32_t size;          // UDP payload bytes in each, from the header on
+} ethbench_send_t;
+
+// follows ETHBENCH_STATS, and the ETHBENCH_END that ends a tx test
+typedef struct ethbench_stats {
+    uint64_t frames;        // ETHBENCH_DATA received, or sent
+    uint64_t bytes;         // of UDP payload in them
+    uint64_t elapsed;       // ns from the first to the last of them
+    uint64_t errors;        // sends that failed, or frames that were not ours
+} ethbench_stats_t;
@@ -17,6 +17,14 @@ __BEGIN_CDECLS;
 // Flag indicating that the bootfs is compressed.
 #define BOOTDATA_BOOTFS_FLAG_COMPRESSED  (1 << 0)
 
+// Bootfs file offsets are page aligned, so the low bits of the offset in a
+// directory entry are free for flags.  This one marks a file that is stored
+// as an LZ4 frame, with the same restrictions as a compressed bootfs image,
+// which decompresses to the size given in the entry.  Such files can be
+// decompressed one at a time, when they are first used.
+#define BOOTFS_FILE_COMPRESSED  (1 << 0)
+#define BOOTFS_FILE_FLAGS_MASK  0xfff
+
 // Boot data header, describing the type and size of data used to initialize the
 // system. All fields are little-endian. Any changes to this struct must change
 // the magic number as well.
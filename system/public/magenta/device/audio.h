@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
 
 __BEGIN_CDECLS
 
@@ -48,6 +49,58 @@ enum {
 // called with no arguments
 #define IOCTL_AUDIO_STOP                    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_AUDIO, 7)
 
+// switches the device to streaming through a ring buffer shared with the
+// client, in place of read() and write(), and returns a handle to its vmo
+// call with in_len = sizeof(audio_ring_config_t) and out_len = sizeof(mx_handle_t)
+// only allowed while stopped.  The ring is dropped when the device is closed.
+#define IOCTL_AUDIO_SET_RING_BUFFER         IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_AUDIO, 8)
+
+// returns how far the device has got through the ring buffer
+// call with out_len = sizeof(audio_ring_position_t)
+#define IOCTL_AUDIO_GET_RING_POSITION       IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_AUDIO, 9)
+
+// splits the ring into periods of the given size in bytes, and returns an
+// event the device signals (MX_EVENT_SIGNALED) each time it finishes one.
+// The client clears the signal before it waits again.
+// call with in_len = sizeof(uint32_t) and out_len = sizeof(mx_handle_t)
+// only allowed while stopped, after IOCTL_AUDIO_SET_RING_BUFFER, and until
+// the ring is set again.  Not all devices can do this.
+#define IOCTL_AUDIO_GET_RING_EVENT          IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_AUDIO, 10)
+
+// returns a read only vmo the device keeps its offset in the ring in, so the
+// client can follow it while running without a call to the driver.  The
+// offset is a uint32_t, at audio_ring_position_vmo_t.offset in the vmo.
+// call with out_len = sizeof(audio_ring_position_vmo_t)
+// Not all devices can do this.
+#define IOCTL_AUDIO_GET_RING_POSITION_VMO   IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_AUDIO, 11)
+
+typedef struct {
+    // size of the ring in bytes, a multiple of the audio frame size
+    // (4 bytes, for 16 bit stereo)
+    uint32_t size;
+    // USB frames (1ms each) of audio to keep queued to the hardware, which
+    // is how far ahead of playback a sink reads the ring.  0 for the default.
+    // Devices that aren't on USB ignore this
+    uint32_t depth;
+} audio_ring_config_t;
+
+typedef struct {
+    // bytes the device has taken from the ring (sink) or put in it (source)
+    // since it was started.  The ring offset is position % size.
+    // A sink client must have written the ring ahead of this, and may
+    // overwrite anything behind it.  A source client may read up to it.
+    uint64_t position;
+    // the USB frame at the time, to relate position to the clock.
+    // 0 for devices that aren't on USB
+    uint64_t usb_frame;
+} audio_ring_position_t;
+
+typedef struct {
+    mx_handle_t vmo;
+    // where in the vmo the position is
+    uint32_t offset;
+} audio_ring_position_vmo_t;
+
 IOCTL_WRAPPER_OUT(ioctl_audio_get_device_type, IOCTL_AUDIO_GET_DEVICE_TYPE, int);
 IOCTL_WRAPPER_OUT(ioctl_audio_get_sample_rate_count, IOCTL_AUDIO_GET_SAMPLE_RATE_COUNT, int);
 IOCTL_WRAPPER_VAROUT(ioctl_audio_get_sample_rates, IOCTL_AUDIO_GET_SAMPLE_RATES, uint32_t);
@@ -55,5 +108,9 @@ IOCTL_WRAPPER_OUT(ioctl_audio_get_sample_rate, IOCTL_AUDIO_GET_SAMPLE_RATE, uint
 IOCTL_WRAPPER_IN(ioctl_audio_set_sample_rate, IOCTL_AUDIO_SET_SAMPLE_RATE, uint32_t);
 IOCTL_WRAPPER(ioctl_audio_start, IOCTL_AUDIO_START);
 IOCTL_WRAPPER(ioctl_audio_stop, IOCTL_AUDIO_STOP);
+IOCTL_WRAPPER_INOUT(ioctl_audio_set_ring_buffer, IOCTL_AUDIO_SET_RING_BUFFER, audio_ring_config_t, mx_handle_t);
+IOCTL_WRAPPER_OUT(ioctl_audio_get_ring_position, IOCTL_AUDIO_GET_RING_POSITION, audio_ring_position_t);
+IOCTL_WRAPPER_INOUT(ioctl_audio_get_ring_event, IOCTL_AUDIO_GET_RING_EVENT, uint32_t, mx_handle_t);
+IOCTL_WRAPPER_OUT(ioctl_audio_get_ring_position_vmo, IOCTL_AUDIO_GET_RING_POSITION_VMO, audio_ring_position_vmo_t);
 
 __END_CDECLS
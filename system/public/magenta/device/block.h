@@ -6,6 +6,7 @@
 
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
 
 #define IOCTL_BLOCK_GET_SIZE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 1)
@@ -37,3 +38,75 @@ IOCTL_WRAPPER_VAROUT(ioctl_block_get_name, IOCTL_BLOCK_GET_NAME, char);
 
 // ssize_t ioctl_block_rr_part(int fd);
 IOCTL_WRAPPER(ioctl_block_rr_part, IOCTL_BLOCK_RR_PART);
+
+// IOCTL_BLOCK_GET_SCHED_STATS returns the counters of the I/O scheduler
+// stacked on a disk, and fails on a device without one.
+#define IOCTL_BLOCK_GET_SCHED_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 8)
+
+typedef struct block_sched_stats {
+    uint64_t requests;      // taken from clients
+    uint64_t dispatched;    // sent to the disk, after merging
+    uint64_t merged;        // requests sent as part of another
+    uint64_t barriers;      // requests that waited for all before them
+    uint32_t max_queued;    // most requests waiting at once
+    uint32_t max_clients;   // most clients with requests waiting at once
+} block_sched_stats_t;
+
+// ssize_t ioctl_block_get_sched_stats(int fd, block_sched_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_block_get_sched_stats, IOCTL_BLOCK_GET_SCHED_STATS, block_sched_stats_t);
+
+// Queued, asynchronous I/O
+//
+// IOCTL_BLOCK_FIFO_CREATE sets up a session with the device: a fifo of
+// block_fifo_request_t for the client to produce, and a VMO the device
+// allocated, laid out as the fifo's ring followed by a data area of the
+// size the client asked for.  Requests name the part of the data area
+// to transfer to or from, which the device does DMA into or out of
+// directly.
+//
+// To submit, fill in the next slots of the ring, advance the fifo's
+// head, and raise BLOCK_FIFO_SIGNAL on the device's end with
+// mx_object_signal_peer().  The device works on up to a whole ring of
+// requests at once and may finish them in any order, but it fills in
+// status and actual and advances the tail in submission order, raising
+// BLOCK_FIFO_SIGNAL on the client's end each time it does.  A slot is
+// the client's again once the tail is past it.
+//
+// Closing the fifo ends the session, once what's in flight is done.
+#define IOCTL_BLOCK_FIFO_CREATE \
+    IOCTL(IOCTL_KIND_GET_TWO_HANDLES, IOCTL_FAMILY_BLOCK, 7)
+
+#define BLOCK_FIFO_SIGNAL MX_USER_SIGNAL_0
+
+#define BLOCK_FIFO_MAX_COUNT 256
+#define BLOCK_FIFO_MAX_DATA (16 * 1024 * 1024)
+
+#define BLOCK_OP_READ  1
+#define BLOCK_OP_WRITE 2
+
+typedef struct block_fifo_config {
+    uint32_t count;         // ring slots, a power of two
+    uint32_t reserved;
+    uint64_t data_size;     // bytes in the data area
+} block_fifo_config_t;
+
+typedef struct block_fifo_info {
+    mx_handle_t fifo;       // producer end
+    mx_handle_t vmo;
+    uint64_t data_offset;   // of the data area in the VMO
+} block_fifo_info_t;
+
+typedef struct block_fifo_request {
+    uint32_t opcode;        // BLOCK_OP_*
+    mx_status_t status;     // filled in by the device
+    uint32_t length;        // bytes, a multiple of the block size
+    uint32_t actual;        // filled in by the device
+    uint64_t dev_offset;    // bytes, a multiple of the block size
+    uint64_t data_offset;   // into the data area
+} block_fifo_request_t;
+
+// ssize_t ioctl_block_fifo_create(int fd, const block_fifo_config_t* in,
+//                                 block_fifo_info_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_block_fifo_create, IOCTL_BLOCK_FIFO_CREATE,
+                    block_fifo_config_t, block_fifo_info_t);
@@ -32,8 +32,8 @@ typedef struct mx_display_info {
 #define IOCTL_DISPLAY_FLUSH_FB \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 2)
 
-// Flush a region in the framebuffer
-//   in: ioctl_display_region_t
+// Flush regions in the framebuffer
+//   in: ioctl_display_region_t[]
 //   out: none
 #define IOCTL_DISPLAY_FLUSH_FB_REGION \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DISPLAY, 3)
@@ -65,5 +65,8 @@ IOCTL_WRAPPER(ioctl_display_flush_fb, IOCTL_DISPLAY_FLUSH_FB);
 // ssize_t ioctl_display_flush_fb_region(int fd, const ioctl_display_region_t* in);
 IOCTL_WRAPPER_IN(ioctl_display_flush_fb_region, IOCTL_DISPLAY_FLUSH_FB_REGION, ioctl_display_region_t);
 
+// ssize_t ioctl_display_flush_fb_regions(int fd, const ioctl_display_region_t* in, size_t in_len);
+IOCTL_WRAPPER_VARIN(ioctl_display_flush_fb_regions, IOCTL_DISPLAY_FLUSH_FB_REGION, ioctl_display_region_t);
+
 // ssize_t ioctl_display_set_fullscreen(int fd, uint32_t in);
 IOCTL_WRAPPER_IN(ioctl_display_set_fullscreen, IOCTL_DISPLAY_SET_FULLSCREEN, uint32_t);
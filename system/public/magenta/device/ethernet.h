@@ -0,0 +1,82 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/device/ioctl.h>
+#include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
+
+// Batched frames
+//
+// IOCTL_ETHERNET_FIFO_CREATE sets up a session for sending or for
+// receiving: a fifo of eth_fifo_entry_t for the client to produce, and
+// a VMO laid out as the fifo's ring followed by a data area of the size
+// the client asked for, which holds the frames.  Entries name a part of
+// the data area.  To receive, post entries for empty buffers of at
+// least the device's MTU; the device fills in length and flags as
+// frames arrive.  To send, post entries for frames; the device sets
+// flags once each is sent.  Either way the device advances the tail in
+// order, and a slot and its buffer are the client's again once the
+// tail is past it.  A client wanting both directions opens a session
+// for each.
+//
+// Neither side raises ETH_FIFO_SIGNAL per frame.  The device works
+// until the tail catches up with the head before it waits, so the
+// client need only raise it on the device's end, with
+// mx_object_signal_peer(), when the tail had caught up with the head
+// it is advancing from.  The device raises it on the client's end once
+// for each run of entries it hands back.
+//
+// A device may spread the frames it receives over several queues, by a
+// hash of their flow, so that each can be served on its own thread.
+// eth_fifo_info_t.rx_queues says how many there are; a receive session
+// takes frames from the one named in its config.  On such devices the
+// frames carry ETH_FIFO_HASH, and in hash the hash that chose their
+// queue, or 0 for those the device couldn't parse, which go to queue 0.
+//
+// Closing the fifo ends the session.
+#define IOCTL_ETHERNET_FIFO_CREATE \
+    IOCTL(IOCTL_KIND_GET_TWO_HANDLES, IOCTL_FAMILY_ETH, 1)
+
+#define ETH_FIFO_SIGNAL MX_USER_SIGNAL_0
+
+#define ETH_FIFO_MAX_COUNT 256
+#define ETH_FIFO_MAX_DATA (1024 * 1024)
+
+#define ETH_FIFO_TX 1
+#define ETH_FIFO_RX 2
+
+// in eth_fifo_entry_t.flags, set by the device
+#define ETH_FIFO_OK 1           // the frame was sent, or one was received
+#define ETH_FIFO_HASH 2         // hash holds the received frame's flow hash
+
+typedef struct eth_fifo_config {
+    uint32_t count;         // ring slots, a power of two
+    uint32_t dir;           // ETH_FIFO_TX or ETH_FIFO_RX
+    uint64_t data_size;     // bytes in the data area
+    uint32_t queue;         // receive queue, from 0 to rx_queues - 1
+    uint32_t reserved;
+} eth_fifo_config_t;
+
+typedef struct eth_fifo_info {
+    mx_handle_t fifo;       // producer end
+    mx_handle_t vmo;
+    uint64_t data_offset;   // of the data area in the VMO
+    uint32_t rx_queues;     // receive queues the device has
+    uint32_t reserved;
+} eth_fifo_info_t;
+
+typedef struct eth_fifo_entry {
+    uint32_t offset;        // into the data area
+    uint16_t length;        // of the frame, or of the buffer until one's received
+    uint16_t flags;         // ETH_FIFO_*
+    uint32_t hash;          // with ETH_FIFO_HASH
+    uint32_t reserved;
+} eth_fifo_entry_t;
+
+// ssize_t ioctl_ethernet_fifo_create(int fd, const eth_fifo_config_t* in,
+//                                    eth_fifo_info_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_fifo_create, IOCTL_ETHERNET_FIFO_CREATE,
+                    eth_fifo_config_t, eth_fifo_info_t);
@@ -26,6 +26,8 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 7)
 #define IOCTL_INPUT_SET_REPORT \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 8)
+#define IOCTL_INPUT_ENABLE_TIMESTAMPS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 9)
 
 enum {
     INPUT_PROTO_NONE = 0,
@@ -59,6 +61,16 @@ typedef struct input_set_report {
     uint8_t data[];
 } input_set_report_t;
 
+// Once IOCTL_INPUT_ENABLE_TIMESTAMPS has been issued on an open device, each
+// report read from it follows one of these, and a read returns as many whole
+// reports as fit in the buffer.
+typedef struct input_report_header {
+    // mx_ticks_get() when the driver received the report
+    uint64_t timestamp;
+    // the number of bytes of report following the header
+    input_report_size_t len;
+} __attribute__((packed)) input_report_header_t;
+
 typedef struct boot_kbd_report {
     uint8_t modifier;
     uint8_t reserved;
@@ -103,3 +115,6 @@ IOCTL_WRAPPER_IN_VAROUT(ioctl_input_get_report, IOCTL_INPUT_GET_REPORT,
 
 // ssize_t ioctl_input_set_report(int fd, const input_set_report_t* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_input_set_report, IOCTL_INPUT_SET_REPORT, input_set_report_t);
+
+// ssize_t ioctl_input_enable_timestamps(int fd);
+IOCTL_WRAPPER(ioctl_input_enable_timestamps, IOCTL_INPUT_ENABLE_TIMESTAMPS);
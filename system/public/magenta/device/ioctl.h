@@ -44,6 +44,7 @@
 #define IOCTL_FAMILY_SYSINFO        0x1D
 #define IOCTL_FAMILY_GPU            0x1E
 #define IOCTL_FAMILY_RTC            0x1F  // ioctls for RTC
+#define IOCTL_FAMILY_ETH            0x20
 
 // IOCTL constructor
 // --K-FFNN
@@ -22,9 +22,24 @@
 #define IOCTL_KTRACE_ADD_PROBE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 2)
 
+// return a read-only handle to the VMO holding the trace buffer,
+// laid out as described by ktrace_buffer_header_t
+#define IOCTL_KTRACE_GET_VMO \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_KTRACE, 3)
+
+// record that boot reached a stage, in the boot timeline
+// input: ascii stage name, < MX_MAX_NAME_LEN
+#define IOCTL_KTRACE_BOOT_STAGE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 4)
+
 IOCTL_WRAPPER_OUT(ioctl_ktrace_get_handle, IOCTL_KTRACE_GET_HANDLE, mx_handle_t);
+IOCTL_WRAPPER_OUT(ioctl_ktrace_get_vmo, IOCTL_KTRACE_GET_VMO, mx_handle_t);
 
 static inline mx_status_t ioctl_ktrace_add_probe(int fd, const char* name, uint32_t* probe_id) {
     return mxio_ioctl(fd, IOCTL_KTRACE_ADD_PROBE,
                       name, strlen(name), probe_id, sizeof(uint32_t));
 }
+
+static inline mx_status_t ioctl_ktrace_boot_stage(int fd, const char* name) {
+    return mxio_ioctl(fd, IOCTL_KTRACE_BOOT_STAGE, name, strlen(name), NULL, 0);
+}
@@ -94,6 +94,10 @@
 // and has a closed remote end will return ERR_REMOTE_CLOSED.
 #define ERR_SHOULD_WAIT (-27)
 
+// ERR_CALL_FAILED: mx_channel_call() wrote its request but did not
+// receive a reply; the reason is returned separately.
+#define ERR_CALL_FAILED (-28)
+
 // ======= Permission check errors =======
 // ERR_ACCESS_DENIED: The caller did not have permission to perform
 // the specified operation.
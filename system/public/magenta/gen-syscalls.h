@@ -1,12 +1,19 @@
 // Copyright 2016 The Fuchsia Authors. All rights reserved.
 // This is a GENERATED file. The license governing this file can be found in the LICENSE file.
 
-extern mx_time_t mx_time_get(
+extern mx_time_t mx_clock_get(
     uint32_t clock_id);
 
 extern mx_status_t mx_nanosleep(
     mx_time_t nanoseconds);
 
+extern mx_time_t mx_time_get(
+    uint32_t clock_id) __attribute__((leaf, const));
+
+extern uint64_t mx_ticks_get(void) __attribute__((leaf, const));
+
+extern uint64_t mx_ticks_per_second(void) __attribute__((leaf, const));
+
 extern uint32_t mx_num_cpus(void) __attribute__((leaf, const));
 
 extern mx_status_t mx_version_get(
@@ -26,6 +33,16 @@ extern mx_status_t mx_handle_replace(
     mx_rights_t rights,
     mx_handle_t out[1]);
 
+extern mx_status_t mx_handle_close_many(
+    const mx_handle_t handles[],
+    uint32_t num_handles);
+
+extern mx_status_t mx_handle_duplicate_many(
+    mx_handle_t handle,
+    mx_rights_t rights,
+    mx_handle_t out[],
+    uint32_t num_handles);
+
 extern mx_status_t mx_handle_wait_one(
     mx_handle_t handle,
     mx_signals_t waitfor,
@@ -102,6 +119,28 @@ extern mx_status_t mx_channel_write(
     const mx_handle_t handles[],
     uint32_t num_handles);
 
+extern mx_status_t mx_channel_call(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_time_t timeout,
+    const mx_channel_call_args_t args[1],
+    uint32_t actual_bytes[1],
+    uint32_t actual_handles[1],
+    mx_status_t read_status[1]);
+
+extern mx_status_t mx_channel_read_many(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_channel_msg_t msgs[],
+    uint32_t count,
+    uint32_t actual[1]);
+
+extern mx_status_t mx_channel_write_many(
+    mx_handle_t handle,
+    uint32_t options,
+    const mx_channel_msg_t msgs[],
+    uint32_t count);
+
 extern mx_status_t mx_socket_create(
     uint32_t options,
     mx_handle_t out0[1],
@@ -121,6 +160,36 @@ extern mx_status_t mx_socket_read(
     size_t size,
     size_t actual[1]);
 
+extern mx_status_t mx_socket_write_vmo(
+    mx_handle_t handle,
+    uint32_t options,
+    mx_handle_t vmo,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]);
+
+extern mx_status_t mx_socket_splice(
+    mx_handle_t src,
+    mx_handle_t dst,
+    uint32_t options,
+    uint64_t offset,
+    size_t size,
+    size_t actual[1]);
+
+extern mx_status_t mx_fifo_create(
+    uint32_t elem_count,
+    uint32_t elem_size,
+    uint32_t options,
+    mx_handle_t producer[1],
+    mx_handle_t consumer[1],
+    mx_handle_t vmo[1]);
+
+extern mx_status_t mx_fifo_op(
+    mx_handle_t handle,
+    uint32_t op,
+    uint64_t count,
+    mx_fifo_state_t state[1]);
+
 extern void mx_thread_exit(void) __attribute__((noreturn));
 
 extern mx_status_t mx_thread_create(
@@ -137,6 +206,16 @@ extern mx_status_t mx_thread_start(
     uintptr_t arg1,
     uintptr_t arg2);
 
+extern mx_status_t mx_thread_create_start(
+    mx_handle_t process,
+    const char name[],
+    uint32_t name_len,
+    uintptr_t thread_entry,
+    uintptr_t stack,
+    uintptr_t arg1,
+    uintptr_t arg2,
+    mx_handle_t out[1]);
+
 extern mx_status_t mx_thread_read_state(
     mx_handle_t handle,
     uint32_t kind,
@@ -168,6 +247,13 @@ extern mx_status_t mx_process_start(
     mx_handle_t arg_handle,
     uintptr_t arg2);
 
+extern mx_status_t mx_process_start_etc(
+    mx_handle_t process_handle,
+    mx_handle_t thread_handle,
+    const mx_process_start_t args[1],
+    mx_process_map_t maps[],
+    uint32_t num_maps);
+
 extern mx_status_t mx_process_map_vm(
     mx_handle_t proc_handle,
     mx_handle_t vmo_handle,
@@ -187,6 +273,12 @@ extern mx_status_t mx_process_protect_vm(
     size_t len,
     uint32_t prot);
 
+extern mx_status_t mx_process_advise_vm(
+    mx_handle_t proc_handle,
+    uintptr_t address,
+    size_t len,
+    uint32_t advice);
+
 extern mx_status_t mx_process_read_memory(
     mx_handle_t proc,
     uintptr_t vaddr,
@@ -194,6 +286,17 @@ extern mx_status_t mx_process_read_memory(
     size_t len,
     size_t actual[1]);
 
+extern mx_status_t mx_process_read_memory_many(
+    mx_handle_t proc,
+    mx_process_read_t reads[],
+    uint32_t count);
+
+extern mx_status_t mx_process_map_view(
+    mx_handle_t proc,
+    uintptr_t vaddr,
+    size_t len,
+    uintptr_t ptr[1]);
+
 extern mx_status_t mx_process_write_memory(
     mx_handle_t proc,
     uintptr_t vaddr,
@@ -238,6 +341,17 @@ extern mx_status_t mx_futex_requeue(
     mx_futex_t requeue_ptr[1],
     uint32_t requeue_count);
 
+extern mx_status_t mx_futex_wait_pi(
+    mx_futex_t value_ptr[1],
+    int current_value,
+    mx_handle_t owner,
+    mx_time_t timeout);
+
+extern mx_status_t mx_futex_wake_etc(
+    mx_futex_t value_ptr[1],
+    uint32_t count,
+    uint32_t options);
+
 extern mx_status_t mx_waitset_create(
     uint32_t options,
     mx_handle_t out[1]);
@@ -273,12 +387,27 @@ extern mx_status_t mx_port_wait(
     void* packet,
     size_t size);
 
+extern mx_status_t mx_port_wait_many(
+    mx_handle_t handle,
+    mx_time_t timeout,
+    void* packets,
+    size_t size,
+    uint32_t count,
+    uint32_t actual[1]);
+
 extern mx_status_t mx_port_bind(
     mx_handle_t handle,
     uint64_t key,
     mx_handle_t source,
     mx_signals_t signals);
 
+extern mx_status_t mx_object_wait_async(
+    mx_handle_t handle,
+    mx_handle_t port,
+    uint64_t key,
+    mx_signals_t signals,
+    uint32_t options);
+
 extern mx_status_t mx_vmo_create(
     uint64_t size,
     uint32_t options,
@@ -314,6 +443,16 @@ extern mx_status_t mx_vmo_op_range(
     void* buffer,
     size_t buffer_size);
 
+extern mx_status_t mx_vmo_clone(
+    mx_handle_t handle,
+    uint32_t options,
+    uint64_t offset,
+    uint64_t size,
+    mx_handle_t out[1]);
+
+extern mx_status_t mx_memory_pressure_event(
+    mx_handle_t out[1]);
+
 extern mx_status_t mx_cprng_draw(
     void* buffer,
     size_t len,
@@ -323,6 +462,25 @@ extern mx_status_t mx_cprng_add_entropy(
     const void* buffer,
     size_t len);
 
+extern mx_status_t mx_pager_create(
+    uint32_t options,
+    mx_handle_t out[1]);
+
+extern mx_status_t mx_pager_create_vmo(
+    mx_handle_t pager,
+    mx_handle_t port,
+    uint64_t key,
+    uint64_t size,
+    uint32_t options,
+    mx_handle_t out[1]);
+
+extern mx_status_t mx_pager_supply_pages(
+    mx_handle_t pager,
+    mx_handle_t pager_vmo,
+    uint64_t offset,
+    uint64_t length,
+    mx_handle_t aux_vmo);
+
 extern mx_handle_t mx_log_create(
     uint32_t options);
 
@@ -391,6 +549,11 @@ extern mx_status_t mx_interrupt_complete(
 extern mx_status_t mx_interrupt_wait(
     mx_handle_t handle);
 
+extern mx_status_t mx_interrupt_set_affinity(
+    mx_handle_t handle,
+    uint32_t cpu,
+    uint32_t options);
+
 extern mx_status_t mx_mmap_device_io(
     mx_handle_t handle,
     uint32_t io_addr,
@@ -502,6 +665,11 @@ extern uint32_t mx_acpi_uefi_rsdp(
 extern mx_status_t mx_acpi_cache_flush(
     mx_handle_t handle);
 
+extern mx_status_t mx_acpi_set_cstates(
+    mx_handle_t handle,
+    const mx_acpi_cstate_t states[],
+    uint32_t count);
+
 extern mx_status_t mx_resource_create(
     mx_handle_t parent_handle,
     const mx_rrec_t records[],
@@ -17,6 +17,7 @@ KTRACE_DEF(0x022,NAME,PROC_NAME,META) // pid, 0, name[]
 KTRACE_DEF(0x023,NAME,SYSCALL_NAME,META) // num, 0, name[]
 KTRACE_DEF(0x024,NAME,IRQ_NAME,META) // num, 0, name[]
 KTRACE_DEF(0x025,NAME,PROBE_NAME,META) // num, 0, name[]
+KTRACE_DEF(0x026,NAME,BOOT_STAGE_NAME,META) // num, 0, name[]
 
 KTRACE_DEF(0x030,16B,IRQ_ENTER,IRQ) // (irqn << 8) | cpu
 KTRACE_DEF(0x031,16B,IRQ_EXIT,IRQ) // (irqn << 8) | cpu
@@ -24,8 +25,17 @@ KTRACE_DEF(0x032,16B,SYSCALL_ENTER,IRQ) // (n << 8) | cpu
 KTRACE_DEF(0x033,16B,SYSCALL_EXIT,IRQ) // (n << 8) | cpu
 
 KTRACE_DEF(0x034,32B,PAGE_FAULT,IRQ) // virtual_address_hi, virtual_address_lo, flags, cpu
+KTRACE_DEF(0x035,32B,SYSCALL_STATS,META) // num, calls, total_ns_lo, total_ns_hi
+KTRACE_DEF(0x036,32B,LOCK_STATS,META) // site_lo, contended, wait_us, hold_us
+KTRACE_DEF(0x037,64B,SAMPLE,SAMPLE) // pc, frames[], see ktrace_rec_sample_t
+KTRACE_DEF(0x038,32B,BOOT_STAGE,META) // num, arg
+KTRACE_DEF(0x039,32B,IRQSOFF,META) // start_site_lo, end_site_lo, duration_us, (kind << 8) | cpu
 
 KTRACE_DEF(0x040,32B,CONTEXT_SWITCH,SCHEDULER) // to-tid, (state<<16|cpu), from-kt, to-kt
+KTRACE_DEF(0x041,32B,MUTEX_SPIN,SCHEDULER) // mutex, spin-ns, acquired
+KTRACE_DEF(0x042,32B,RUNQ_ENQUEUE,SCHEDULER) // tid, (head<<16|cpu), kt, priority
+KTRACE_DEF(0x043,32B,RUNQ_DEQUEUE,SCHEDULER) // tid, cpu, kt, priority
+KTRACE_DEF(0x044,32B,RUNQ_MIGRATE,SCHEDULER) // tid, from-cpu, to-cpu, kt
 
 // events from 0x100 on all share the tag/tid/ts common header
 
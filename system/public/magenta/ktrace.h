@@ -24,6 +24,7 @@ __BEGIN_CDECLS
 #define KTRACE_TAG_16B(e,g)       KTRACE_TAG(e,g,16)
 #define KTRACE_TAG_32B(e,g)       KTRACE_TAG(e,g,32)
 #define KTRACE_TAG_NAME(e,g)      KTRACE_TAG(e,g,48)
+#define KTRACE_TAG_64B(e,g)       KTRACE_TAG(e,g,64)
 
 #define KTRACE_LEN(tag)           (((tag)&0xF)<<3)
 #define KTRACE_GROUP(tag)         (((tag)>>20)&0xFFF)
@@ -45,6 +46,7 @@ __BEGIN_CDECLS
 #define KTRACE_GRP_IPC            0x010
 #define KTRACE_GRP_IRQ            0x020
 #define KTRACE_GRP_PROBE          0x040
+#define KTRACE_GRP_SAMPLE         0x080
 
 #define KTRACE_GRP_TO_MASK(grp)   ((grp) << 20)
 
@@ -67,6 +69,19 @@ typedef struct ktrace_rec_32b {
     uint32_t d;
 } ktrace_rec_32b_t;
 
+// Where a cpu was when the sampler interrupted it. For kernel code the
+// return addresses of up to KTRACE_SAMPLE_FRAMES callers follow, found by
+// walking the frame pointers; the rest, and all of them for user code, are 0.
+#define KTRACE_SAMPLE_FRAMES 5
+
+typedef struct ktrace_rec_sample {
+    uint32_t tag;
+    uint32_t tid;
+    uint64_t ts;
+    uint64_t pc;
+    uint64_t frames[KTRACE_SAMPLE_FRAMES];
+} ktrace_rec_sample_t;
+
 typedef struct ktrace_rec_name {
     uint32_t tag;
     uint32_t id;
@@ -87,5 +102,87 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_START_CIRCULAR 5 // options = grpmask, 0 = all
+#define KTRACE_ACTION_GET_VMO   6 // options ignored, ptr = mx_handle_t* out
+#define KTRACE_ACTION_SAMPLE    7 // options = samples per second per cpu, 0 = stop
+#define KTRACE_ACTION_BOOT_STAGE 8 // options = arg, ptr = name
+#define KTRACE_ACTION_ADD_USER_BUFFER 9 // options ignored, ptr = mx_handle_t* vmo
+#define KTRACE_ACTION_REMOVE_USER_BUFFER 10 // options ignored, ptr = mx_handle_t* vmo
+
+// The boot timeline is a BOOT_STAGE record for each stage boot got through,
+// from the bootloader's on, named by the BOOT_STAGE_NAME record with its
+// num. They are kept with the name records, so they survive rewinds and
+// are always at the start of what's read. Up to KTRACE_BOOT_STAGES are
+// kept, from KTRACE_BOOT_STAGE_NAMES different names.
+#define KTRACE_BOOT_STAGES      256
+#define KTRACE_BOOT_STAGE_NAMES 128
+
+// The trace buffer VMO from KTRACE_ACTION_GET_VMO starts with a
+// ktrace_buffer_header_t, followed by a ktrace_cpu_index_t for each cpu.
+//
+// The name records (and the version and ticks records before them) are at
+// meta_offset, and meta_len bytes of them have been written so far. Each
+// cpu writes its other records into its own cpu_size bytes at cpu_offset +
+// cpu * cpu_size. A position p in a cpu buffer is at offset p % cpu_size;
+// positions only ever grow. Records never straddle the end of a cpu buffer:
+// a zero tag means skip to the end. Records are ordered by time within a cpu
+// buffer, but not across cpus.
+//
+// The kernel moves a cpu's head (the producer index) past each record once
+// it has made room for it. A reader keeps its own position (the consumer
+// index) and reads the records between it and head. A circular trace moves
+// tail past the oldest records before overwriting them, so a reader must
+// check tail after copying records out; any records it copied from below
+// tail were being overwritten.
+#define KTRACE_BUFFER_CIRCULAR      1u
+
+typedef struct ktrace_buffer_header {
+    uint32_t version;       // KTRACE_VERSION
+    uint32_t flags;         // KTRACE_BUFFER_CIRCULAR
+    uint32_t num_cpus;
+    uint32_t meta_len;
+    uint32_t meta_offset;
+    uint32_t meta_size;
+    uint32_t cpu_offset;
+    uint32_t cpu_size;
+    uint64_t reserved[4];
+} ktrace_buffer_header_t;
+
+typedef struct ktrace_cpu_index {
+    uint64_t head;
+    uint64_t tail;
+    uint64_t reserved[6];   // keeps each cpu's indices in their own cache line
+} ktrace_cpu_index_t;
+
+// A user trace buffer is a VMO that one thread writes its own probe records
+// into, without a syscall for each, and registers with
+// KTRACE_ACTION_ADD_USER_BUFFER. Its records are merged by time into what
+// mx_ktrace_read() returns, between the kernel's. Up to
+// KTRACE_USER_BUFFERS can be registered at once.
+//
+// The VMO starts with a ktrace_user_header_t, and size bytes of records
+// follow it at KTRACE_USER_HDRSIZE, laid out like a cpu buffer's. The
+// writer moves head and tail just as the kernel does for a circular trace.
+// Records are stamped with mx_ticks_get(). Only records in the PROBE group
+// are merged, and each gets the tid of the thread which registered the
+// buffer. Rewinding the trace skips the records written before it. A buffer
+// stays registered until it is removed, or until room is needed for another
+// and nothing else holds its VMO any more.
+#define KTRACE_USER_MAGIC           0x55545243u // "UTRC"
+#define KTRACE_USER_HDRSIZE         (64)
+#define KTRACE_USER_BUFFERS         128
+
+typedef struct ktrace_user_header {
+    uint32_t magic;         // KTRACE_USER_MAGIC
+    uint32_t size;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t reserved[5];
+} ktrace_user_header_t;
+
+static_assert(sizeof(ktrace_rec_sample_t) == 64, "");
+static_assert(sizeof(ktrace_buffer_header_t) == 64, "");
+static_assert(sizeof(ktrace_cpu_index_t) == 64, "");
+static_assert(sizeof(ktrace_user_header_t) == KTRACE_USER_HDRSIZE, "");
 
 __END_CDECLS
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -39,7 +40,24 @@
 
 #define NB_VERSION_1_0  0x0001000
 #define NB_VERSION_1_1  0x0001010
-#define NB_VERSION_CURRENT NB_VERSION_1_1
+#define NB_VERSION_1_2  0x0001020
+#define NB_VERSION_CURRENT NB_VERSION_1_2
+
+// Windowed transfers (1.2)
+//
+// NB_DATA and NB_LAST_DATA, whose arg is a byte offset, and NB_WRITE and
+// NB_READ, whose arg is a block number, are sent up to NB_WINDOW ahead of
+// what has been acked.  Their receiver acks cumulatively, with an NB_ACK
+// (or for NB_LAST_DATA, NB_FILE_RECEIVED) whose arg is what it expects
+// next, at least every NB_ACK_INTERVAL messages and for the last one.
+// For NB_READ the data sent back is the ack.
+//
+// The receiver only takes the one it expects.  The first that arrives
+// other than that, since that last moved, is answered with an ack for
+// it; the rest are dropped.  A sender goes back to what an ack that
+// moved nothing asks for, once for each place, and to what was last
+// acked after NB_RETRANSMIT_MS without any progress, giving up after
+// NB_RETRANSMIT_MAX of those in a row.
 
 typedef struct nbmsg_t {
     uint32_t magic;
@@ -49,6 +67,52 @@ typedef struct nbmsg_t {
     uint8_t  data[0];
 } nbmsg;
 
+#define NB_WINDOW             32
+#define NB_ACK_INTERVAL        8
+#define NB_RETRANSMIT_MS     250
+#define NB_RETRANSMIT_MAX     20
+
+// the receiving end of a windowed transfer
+typedef struct nbwindow_t {
+    uint32_t expected;  // offset or block wanted next
+    uint32_t unacked;   // messages taken since the last ack
+    bool answered;      // something other than expected has been acked
+} nbwindow;
+
+#define NB_WINDOW_TAKE 0    // the one expected: take it, then nb_window_advance()
+#define NB_WINDOW_ACK  1    // drop it, and ack expected
+#define NB_WINDOW_DROP 2    // drop it
+
+static inline void nb_window_init(nbwindow* w, uint32_t start) {
+    w->expected = start;
+    w->unacked = 0;
+    w->answered = false;
+}
+
+// what to do with a message for pos
+static inline int nb_window_check(nbwindow* w, uint32_t pos) {
+    if (pos == w->expected) {
+        return NB_WINDOW_TAKE;
+    }
+    if (w->answered) {
+        return NB_WINDOW_DROP;
+    }
+    w->answered = true;
+    return NB_WINDOW_ACK;
+}
+
+// Moves on to next once the expected message is taken, returning whether
+// it's time to ack.
+static inline bool nb_window_advance(nbwindow* w, uint32_t next, bool last) {
+    w->expected = next;
+    w->answered = false;
+    if (last || (++w->unacked >= NB_ACK_INTERVAL)) {
+        w->unacked = 0;
+        return true;
+    }
+    return false;
+}
+
 typedef struct nbfile_t {
     uint8_t* data;
     size_t size; // max size of buffer
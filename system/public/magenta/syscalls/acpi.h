@@ -0,0 +1,27 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/syscalls/types.h>
+
+__BEGIN_CDECLS
+
+// A processor idle state, as found in the _CST object of a processor, for
+// mx_acpi_set_cstates(). Only states entered with mwait can be handed over.
+typedef struct mx_acpi_cstate {
+    // the ACPI C state type: 1, 2 or 3
+    uint32_t type;
+    // the value given to mwait in eax to enter it
+    uint32_t mwait_hint;
+    // worst case time to come back out of it, in microseconds
+    uint32_t latency_us;
+    // average power draw while in it, in milliwatts
+    uint32_t power_mw;
+} mx_acpi_cstate_t;
+
+// The most states mx_acpi_set_cstates() takes.
+#define MX_ACPI_MAX_CSTATES 8u
+
+__END_CDECLS
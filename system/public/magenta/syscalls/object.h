@@ -19,6 +19,16 @@ typedef enum {
     MX_INFO_PROCESS_THREADS,        // mx_koid_t[n]
     MX_INFO_RESOURCE_CHILDREN,      // mx_rrec_t[n]
     MX_INFO_RESOURCE_RECORDS,       // mx_rrec_t[n]
+    MX_INFO_KERNEL_HEAP,            // mx_info_kernel_heap_t[1]
+    MX_INFO_KERNEL_HEAP_BUCKETS,    // mx_info_kernel_heap_bucket_t[n]
+    MX_INFO_PROCESS_MEMORY,         // mx_info_process_memory_t[1]
+    MX_INFO_PROCESS_MAPS,           // mx_info_maps_t[n]
+    MX_INFO_KERNEL_SYSCALLS,        // mx_info_kernel_syscall_t[n]
+    MX_INFO_TASK_RUNTIME,           // mx_info_task_runtime_t[1]
+    MX_INFO_KERNEL_SCHED_LATENCY,   // mx_info_kernel_sched_latency_t[n]
+    MX_INFO_KERNEL_COUNTERS,        // mx_info_kernel_counter_t[n]
+    MX_INFO_JOB_RESOURCES,          // mx_info_job_resources_t[1]
+    MX_INFO_PROCESS_KERNEL_MEMORY,  // mx_info_process_kernel_memory_t[1]
 } mx_object_info_topic_t;
 
 typedef enum {
@@ -39,6 +49,8 @@ typedef enum {
     MX_OBJ_TYPE_EVENT_PAIR          = 16,
     MX_OBJ_TYPE_JOB                 = 17,
     MX_OBJ_TYPE_VMAR                = 18,
+    MX_OBJ_TYPE_FIFO                = 19,
+    MX_OBJ_TYPE_PAGER               = 20,
     MX_OBJ_TYPE_LAST
 } mx_obj_type_t;
 
@@ -58,6 +70,104 @@ typedef struct mx_info_process {
     int return_code;
 } mx_info_process_t;
 
+typedef struct mx_info_kernel_heap {
+    uint64_t size;                // bytes the heap holds from the pmm
+    uint64_t free_bytes;          // bytes on the heap's free lists
+    uint64_t cached_bytes;        // freed bytes held in per-cpu caches
+    uint64_t os_allocations;      // chunks currently held from the pmm
+    uint64_t os_alloc_count;      // chunks ever taken from the pmm
+    uint64_t returned_bytes;      // bytes ever given back to the pmm
+} mx_info_kernel_heap_t;
+
+typedef struct mx_info_kernel_heap_bucket {
+    uint64_t size;                // smallest free block filed in the bucket
+    uint64_t free_count;          // blocks on the bucket's free list
+    uint64_t free_bytes;          // bytes in those blocks, including headers
+    uint64_t cached_count;        // blocks of this size held in per-cpu caches
+} mx_info_kernel_heap_bucket_t;
+
+typedef struct mx_info_process_memory {
+    uint64_t committed_bytes;     // bytes of mapped objects backed by pages
+    uint64_t minor_faults;        // faults that only mapped an existing page
+    uint64_t major_faults;        // faults that allocated or copied a page
+    mx_time_t fault_time;         // time spent handling faults
+} mx_info_process_memory_t;
+
+typedef struct mx_info_maps {
+    char name[MX_MAX_NAME_LEN];
+    uint64_t base;
+    uint64_t size;
+    uint64_t committed_bytes;     // bytes of the mapping backed by pages
+    uint32_t flags;               // MX_VM_FLAG_PERM_...
+    uint32_t reserved;
+} mx_info_maps_t;
+
+#define MX_SYSCALL_LATENCY_BUCKETS 16
+
+typedef struct mx_info_kernel_syscall {
+    char name[MX_MAX_NAME_LEN];
+    uint32_t num;                 // the syscall number
+    uint32_t reserved;
+    uint64_t count;               // calls made while counting was on
+    mx_time_t total_time;         // time those calls took, blocking included
+    // latency[i] counts calls that took [2^(i+7), 2^(i+8)) ns, except that
+    // the first and last buckets are open ended
+    uint64_t latency[MX_SYSCALL_LATENCY_BUCKETS];
+} mx_info_kernel_syscall_t;
+
+// For a thread, or the sum over all the threads a process or job (including
+// its child jobs) has ever had.
+typedef struct mx_info_task_runtime {
+    mx_time_t cpu_time;           // time spent running
+    mx_time_t queue_time;         // time spent ready to run, waiting for a cpu
+    uint64_t voluntary_switches;  // times a thread blocked, slept or exited
+    uint64_t involuntary_switches; // times a thread was preempted or yielded
+    uint64_t migrations;          // times a thread ran on a different cpu than
+                                  // the one it last ran on
+} mx_info_task_runtime_t;
+
+#define MX_SCHED_LATENCY_BUCKETS 24
+
+// One for each cpu. Bucket i counts intervals of [2^(i+9), 2^(i+10)) ns,
+// except that the first and last buckets are open ended.
+typedef struct mx_info_kernel_sched_latency {
+    uint64_t wakeup_latency[MX_SCHED_LATENCY_BUCKETS]; // made ready until running
+    uint64_t slice_length[MX_SCHED_LATENCY_BUCKETS];   // running until switched out
+} mx_info_kernel_sched_latency_t;
+
+// One for each kernel event counter, summed over all cpus.
+typedef struct mx_info_kernel_counter {
+    char name[MX_MAX_NAME_LEN];
+    int64_t value;
+} mx_info_kernel_counter_t;
+
+// What a job and its child jobs use of the limits set on it.
+typedef struct mx_info_job_resources {
+    uint64_t committed_bytes;      // committed to the VMOs created in them
+    uint64_t memory_limit;         // MX_PROP_JOB_MEMORY_LIMIT, or 0
+    mx_time_t cpu_period;          // MX_PROP_JOB_CPU_QUOTA, or 0
+    mx_time_t cpu_quota;
+    uint64_t cpu_throttled_count;  // periods in which the quota ran out
+    mx_time_t cpu_throttled_time;  // time spent held off the cpu for it
+    uint32_t cpu_affinity;         // MX_PROP_JOB_CPU_AFFINITY, with the
+                                   // masks of the jobs above it applied
+    uint32_t reserved;
+} mx_info_job_resources_t;
+
+// Kernel memory held on behalf of a process. Messages and packets count
+// against the process holding the channel endpoint or port they wait on.
+typedef struct mx_info_process_kernel_memory {
+    uint64_t handle_count;         // handles in the process's handle table
+    uint64_t handle_bytes;
+    uint64_t channel_msg_count;    // messages queued to be read on its channels
+    uint64_t channel_msg_bytes;
+    uint64_t port_packet_count;    // packets queued on its ports
+    uint64_t port_packet_bytes;
+    uint64_t thread_count;         // threads that haven't been destroyed
+    uint64_t thread_stack_bytes;   // their kernel stacks
+    uint64_t page_table_bytes;     // page tables of the address space
+} mx_info_process_kernel_memory_t;
+
 
 // Object properties.
 
@@ -67,6 +177,68 @@ typedef struct mx_info_process {
 #define MX_PROP_NUM_STATE_KINDS             2u
 // Argument is a char[MX_MAX_NAME_LEN]
 #define MX_PROP_NAME                        3u
+// Argument is a uint32_t fair share weight (threads only). Nonzero moves
+// the thread into the fair share scheduling class, 0 returns it to fixed
+// priority scheduling.
+#define MX_PROP_SCHED_FAIR_WEIGHT           4u
+// Argument is an mx_time_t, in nanoseconds, by which the thread's sleep and
+// wait deadlines may be late so the kernel can coalesce them (threads only).
+// It is rounded down to a millisecond and capped at MX_TIMER_SLACK_MAX.
+#define MX_PROP_TIMER_SLACK                 5u
+// Argument is a uint32_t, the size in bytes of the buffer that data written
+// by the peer lands in (sockets only). Rounded up to a power of two, and can
+// only be set while the buffer holds no unread data.
+#define MX_PROP_SOCKET_BUFFER_SIZE          6u
+// Argument is an int32_t, the only cpu the thread may run on, or -1 to let
+// it run on any (threads only). The cpu must be online.
+#define MX_PROP_SCHED_CPU                   7u
+// Argument is an mx_job_cpu_quota_t (jobs only). The threads of the job and
+// its child jobs may run for |quota| in total every |period|, after which
+// none of them runs until the next period. A zero period lifts the limit.
+#define MX_PROP_JOB_CPU_QUOTA               8u
+// Argument is a uint32_t mask of the cpus the threads of the job and its
+// child jobs may run on (jobs only), which applies to threads started after
+// it is set. It is combined with the masks of the jobs above, and must leave
+// at least one online cpu.
+#define MX_PROP_JOB_CPU_AFFINITY            9u
+// Argument is a uint64_t, the number of bytes that may be committed to the
+// VMOs created in the job and its child jobs, or 0 for no limit (jobs only).
+// Rounded up to a page. Commits and page faults that would go past it fail
+// with ERR_NO_MEMORY.
+#define MX_PROP_JOB_MEMORY_LIMIT            10u
+// Argument is an mx_sched_deadline_t (threads only). A nonzero period moves
+// the thread into the deadline scheduling class, where it runs for |runtime|
+// within |deadline| of the start of every |period|, ahead of threads of any
+// priority below the kernel's own. Fails with ERR_NO_RESOURCES if no cpu the
+// thread may run on has room left for runtime / deadline of its time. A zero
+// period returns the thread to the class it was in before.
+#define MX_PROP_SCHED_DEADLINE              11u
+
+// Argument for MX_PROP_JOB_CPU_QUOTA:
+typedef struct mx_job_cpu_quota {
+    mx_time_t period;  // MX_JOB_CPU_PERIOD_MIN to MX_JOB_CPU_PERIOD_MAX
+    mx_time_t quota;   // up to |period| times the number of cpus
+} mx_job_cpu_quota_t;
+
+#define MX_JOB_CPU_PERIOD_MIN               MX_MSEC(1)
+#define MX_JOB_CPU_PERIOD_MAX               MX_SEC(10)
+
+// Argument for MX_PROP_SCHED_DEADLINE:
+typedef struct mx_sched_deadline {
+    mx_time_t runtime;   // nonzero, up to |deadline|
+    mx_time_t deadline;  // up to |period|
+    mx_time_t period;    // MX_SCHED_DEADLINE_PERIOD_MIN to MX_SCHED_DEADLINE_PERIOD_MAX
+} mx_sched_deadline_t;
+
+#define MX_SCHED_DEADLINE_PERIOD_MIN        MX_MSEC(1)
+#define MX_SCHED_DEADLINE_PERIOD_MAX        MX_SEC(10)
+
+// Weights for MX_PROP_SCHED_FAIR_WEIGHT:
+#define MX_SCHED_FAIR_WEIGHT_DEFAULT        1024u
+#define MX_SCHED_FAIR_WEIGHT_MAX            (MX_SCHED_FAIR_WEIGHT_DEFAULT * 64u)
+
+// Upper bound for MX_PROP_TIMER_SLACK:
+#define MX_TIMER_SLACK_MAX                  1000000000ull
 
 // Policies for MX_PROP_BAD_HANDLE_POLICY:
 #define MX_POLICY_BAD_HANDLE_IGNORE         0u
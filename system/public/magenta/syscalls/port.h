@@ -17,6 +17,14 @@ __BEGIN_CDECLS
 #define MX_PORT_PKT_TYPE_IOSN      1u
 #define MX_PORT_PKT_TYPE_USER      2u
 #define MX_PORT_PKT_TYPE_EXCEPTION 3u
+#define MX_PORT_PKT_TYPE_PAGER     4u
+
+// Options for mx_port_create()
+#define MX_PORT_OPT_LIFO        1u
+
+// Options for mx_object_wait_async()
+#define MX_WAIT_ASYNC_ONCE      0u
+#define MX_WAIT_ASYNC_REPEATING 1u
 
 typedef struct mx_packet_header {
     uint64_t key;
@@ -37,4 +45,17 @@ typedef struct mx_exception_packet {
     mx_exception_report_t report;
 } mx_exception_packet_t;
 
+// Commands in an mx_pager_packet_t
+#define MX_PAGER_VMO_READ 0u
+
+// Sent by a pager to ask for pages of one of its VMOs; hdr.key is the key
+// given to mx_pager_create_vmo().
+typedef struct mx_pager_packet {
+    mx_packet_header_t hdr;
+    uint32_t command;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t length;
+} mx_pager_packet_t;
+
 __END_CDECLS
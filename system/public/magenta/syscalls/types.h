@@ -23,6 +23,24 @@ typedef uint64_t mx_koid_t;
 #define MX_VMO_OP_UNLOCK                4u
 #define MX_VMO_OP_LOOKUP                5u
 #define MX_VMO_OP_CACHE_SYNC            6u
+#define MX_VMO_OP_WILLNEED              7u
+#define MX_VMO_OP_DONTNEED              8u
+
+// VM Object creation options
+#define MX_VMO_PURGEABLE                1u
+#define MX_VMO_NUMA_INTERLEAVE          2u
+#define MX_VMO_NUMA_BIND                4u
+#define MX_VMO_NUMA_NODE_SHIFT          8
+#define MX_VMO_NUMA_NODE_MASK           (0xffu << MX_VMO_NUMA_NODE_SHIFT)
+#define MX_VMO_NUMA_NODE(n)             (((uint32_t)(n) << MX_VMO_NUMA_NODE_SHIFT) & \
+                                         MX_VMO_NUMA_NODE_MASK)
+
+// VM Object lock states, reported by MX_VMO_OP_LOCK
+#define MX_VMO_LOCK_RETAINED            0u
+#define MX_VMO_LOCK_PURGED              1u
+
+// VM Object clone flags
+#define MX_VMO_CLONE_COPY_ON_WRITE      1u
 
 // Buffer size limits on the cprng syscalls
 #define MX_CPRNG_DRAW_MAX_LEN        256
@@ -31,6 +49,10 @@ typedef uint64_t mx_koid_t;
 // Socket flags and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
 
+// Socket create options.
+#define MX_SOCKET_STREAM                    0u
+#define MX_SOCKET_DATAGRAM                  1u
+
 // Structure for mx_waitset_*():
 typedef struct mx_waitset_result {
     uint64_t cookie;
@@ -41,6 +63,7 @@ typedef struct mx_waitset_result {
 // forward declarations needed by syscalls.h
 typedef struct mx_pcie_get_nth_info mx_pcie_get_nth_info_t;
 typedef struct mx_pci_init_arg mx_pci_init_arg_t;
+typedef struct mx_acpi_cstate mx_acpi_cstate_t;
 typedef union mx_rrec mx_rrec_t;
 
 __END_CDECLS
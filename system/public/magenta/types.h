@@ -6,6 +6,7 @@
 
 #include <magenta/compiler.h>
 #include <magenta/errors.h>
+#include <stddef.h>
 #include <stdint.h>
 #ifndef __cplusplus
 #ifndef _KERNEL
@@ -103,6 +104,11 @@ typedef uint32_t mx_signals_t;
 #define MX_SOCKET_WRITABLE          MX_OBJECT_SIGNAL_1
 #define MX_SOCKET_PEER_CLOSED       MX_OBJECT_SIGNAL_2
 
+// Fifo
+#define MX_FIFO_READABLE            MX_OBJECT_SIGNAL_0
+#define MX_FIFO_WRITABLE            MX_OBJECT_SIGNAL_1
+#define MX_FIFO_PEER_CLOSED         MX_OBJECT_SIGNAL_2
+
 // Resource
 #define MX_RESOURCE_READABLE        MX_OBJECT_SIGNAL_0
 #define MX_RESOURCE_WRITABLE        MX_OBJECT_SIGNAL_1
@@ -120,6 +126,64 @@ typedef struct {
     mx_signals_t pending;
 } mx_wait_item_t;
 
+// Arguments to mx_channel_call(): the request to write and the buffers
+// for the reply.
+typedef struct {
+    const void* wr_bytes;
+    const mx_handle_t* wr_handles;
+    void* rd_bytes;
+    mx_handle_t* rd_handles;
+    uint32_t wr_num_bytes;
+    uint32_t wr_num_handles;
+    uint32_t rd_num_bytes;
+    uint32_t rd_num_handles;
+} mx_channel_call_args_t;
+
+// One message for mx_channel_write_many() or mx_channel_read_many().
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+} mx_channel_msg_t;
+
+// One read for mx_process_read_memory_many(): up to len bytes at vaddr in
+// the target process go to buffer, and actual is set to how many did.
+typedef struct {
+    uintptr_t vaddr;
+    void* buffer;
+    size_t len;
+    size_t actual;
+} mx_process_read_t;
+
+// One mapping for mx_process_start_etc(), made as mx_process_map_vm() would
+// with these arguments.  addr is where it goes with MX_VM_FLAG_FIXED, and is
+// set to where it went.
+typedef struct {
+    mx_handle_t vmo;
+    uint32_t flags;
+    uint64_t offset;
+    size_t len;
+    uintptr_t addr;
+} mx_process_map_t;
+
+// How mx_process_start_etc() starts a process once its mappings are made.
+// The initial stack pointer is stack, offset by where maps[stack_map] went
+// unless stack_map is MX_PROCESS_START_NO_MAP.  Unless bootstrap is
+// MX_HANDLE_INVALID, msg is written to that channel first, as by
+// mx_channel_write().  arg_handle and arg2 are as for mx_process_start().
+typedef struct {
+    uintptr_t entry;
+    uintptr_t stack;
+    uint32_t stack_map;
+    mx_handle_t arg_handle;
+    uintptr_t arg2;
+    mx_handle_t bootstrap;
+    mx_channel_msg_t msg;
+} mx_process_start_t;
+
+#define MX_PROCESS_START_NO_MAP   ((uint32_t)-1)
+
 typedef uint32_t mx_rights_t;
 #define MX_RIGHT_NONE             ((mx_rights_t)0u)
 #define MX_RIGHT_DUPLICATE        ((mx_rights_t)1u << 0)
@@ -140,11 +204,31 @@ typedef uint32_t mx_rights_t;
 #define MX_VM_FLAG_PERM_EXECUTE   (1u << 3)
 #define MX_VM_FLAG_ALLOC_BASE     (1u << 4)
 #define MX_VM_FLAG_DMA            (1u << 5)
+#define MX_VM_FLAG_FAULT_AROUND   (1u << 6)
+#define MX_VM_FLAG_LARGE_PAGES    (1u << 7)
+#define MX_VM_FLAG_COMMIT         (1u << 8)
+
+// advice to mx_process_advise_vm()
+#define MX_VM_ADVICE_NORMAL       (0u)
+#define MX_VM_ADVICE_SEQUENTIAL   (1u)
+#define MX_VM_ADVICE_RANDOM       (2u)
 
 // flags to channel routines
 #define MX_FLAG_REPLY_CHANNEL            (1u << 0)
 #define MX_CHANNEL_CREATE_REPLY_CHANNEL  (1u << 0)
 
+// operations for mx_fifo_op()
+#define MX_FIFO_OP_READ_STATE     (0u)
+#define MX_FIFO_OP_ADVANCE_HEAD   (1u)
+#define MX_FIFO_OP_ADVANCE_TAIL   (2u)
+
+// The position of a fifo's producer (head) and consumer (tail). Both only
+// ever grow; element n of the stream lives in slot n % elem_count.
+typedef struct mx_fifo_state {
+    uint64_t head;
+    uint64_t tail;
+} mx_fifo_state_t;
+
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
 #define MX_CLOCK_UTC              (1u)
@@ -165,6 +249,11 @@ typedef int64_t mx_rel_off_t;
 // interrupt flags
 #define MX_FLAG_REMAP_IRQ  0x1
 
+// mx_interrupt_set_affinity() cpu and options
+#define MX_INTERRUPT_CPU_ANY        ((uint32_t)-1)
+#define MX_INTERRUPT_PRIORITY_HIGH  0x1
+#define MX_INTERRUPT_REAL_TIME      0x2
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
     MX_CACHE_POLICY_CACHED          = 0,
@@ -190,4 +279,7 @@ typedef atomic_int mx_futex_t;
 #endif
 #endif
 
+// Options for mx_futex_wake_etc()
+#define MX_FUTEX_WAKE_LIFO        ((uint32_t)1u)
+
 __END_CDECLS
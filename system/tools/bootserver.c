@@ -24,6 +24,8 @@
 
 #include <magenta/netboot.h>
 
+#include "netprotocol.h"
+
 static uint32_t cookie = 1;
 static char* appname;
 static struct in6_addr allowed_addr;
@@ -31,6 +33,28 @@ static const char spinner[] = {'|', '/', '-', '\\'};
 static const int MAX_READ_RETRIES = 10;
 static const int MAX_SEND_RETRIES = 10000;
 
+static void io_error(nbmsg* ack) {
+    switch (ack->cmd) {
+    case NB_ERROR:
+        fprintf(stderr, "\n%s: error: Generic error\n", appname);
+        break;
+    case NB_ERROR_BAD_CMD:
+        fprintf(stderr, "\n%s: error: Bad command\n", appname);
+        break;
+    case NB_ERROR_BAD_PARAM:
+        fprintf(stderr, "\n%s: error: Bad parameter\n", appname);
+        break;
+    case NB_ERROR_TOO_LARGE:
+        fprintf(stderr, "\n%s: error: File too large\n", appname);
+        break;
+    case NB_ERROR_BAD_FILE:
+        fprintf(stderr, "\n%s: error: Bad file\n", appname);
+        break;
+    default:
+        fprintf(stderr, "\n%s: error: Unknown command 0x%08X\n", appname, ack->cmd);
+    }
+}
+
 static int io_rcv(int s, nbmsg* msg, nbmsg* ack) {
     for (int i = 0; i < MAX_READ_RETRIES; i++) {
         bool retry_allowed = i + 1 < MAX_READ_RETRIES;
@@ -61,6 +85,10 @@ static int io_rcv(int s, nbmsg* msg, nbmsg* ack) {
                 fprintf(stderr, "\n%s: error: Bad cookie\n", appname);
                 return 0;
             }
+            if (ack->cookie < msg->cookie) {
+                // a late ack for data sent ahead
+                continue;
+            }
         }
 
         if (ack->cmd == NB_ACK || ack->cmd == NB_FILE_RECEIVED) {
@@ -71,25 +99,7 @@ static int io_rcv(int s, nbmsg* msg, nbmsg* ack) {
             return 0;
         }
 
-        switch (ack->cmd) {
-        case NB_ERROR:
-            fprintf(stderr, "\n%s: error: Generic error\n", appname);
-            break;
-        case NB_ERROR_BAD_CMD:
-            fprintf(stderr, "\n%s: error: Bad command\n", appname);
-            break;
-        case NB_ERROR_BAD_PARAM:
-            fprintf(stderr, "\n%s: error: Bad parameter\n", appname);
-            break;
-        case NB_ERROR_TOO_LARGE:
-            fprintf(stderr, "\n%s: error: File too large\n", appname);
-            break;
-        case NB_ERROR_BAD_FILE:
-            fprintf(stderr, "\n%s: error: Bad file\n", appname);
-            break;
-        default:
-            fprintf(stderr, "\n%s: error: Unknown command 0x%08X\n", appname, ack->cmd);
-        }
+        io_error(ack);
         return -1;
     }
     fprintf(stderr, "\n%s: error: Unexpected code path\n", appname);
@@ -187,24 +197,31 @@ static int io(int s, nbmsg* msg, size_t len, nbmsg* ack, bool wait_reply) {
 
 typedef struct {
     FILE* fp;
+    size_t pos;         // of fp
     const char* data;
     size_t datalen;
 } xferdata;
 
-static ssize_t xread(xferdata* xd, void* data, size_t len) {
+// reads up to len bytes from offset
+static ssize_t xread(xferdata* xd, size_t offset, void* data, size_t len) {
     if (xd->fp == NULL) {
-        if (len > xd->datalen) {
-            len = xd->datalen;
+        if (offset >= xd->datalen) {
+            return 0;
         }
-        memcpy(data, xd->data, len);
-        xd->datalen -= len;
-        xd->data += len;
+        if (len > xd->datalen - offset) {
+            len = xd->datalen - offset;
+        }
+        memcpy(data, xd->data + offset, len);
         return len;
     } else {
+        if ((offset != xd->pos) && fseek(xd->fp, offset, SEEK_SET)) {
+            return -1;
+        }
         ssize_t r = fread(data, 1, len, xd->fp);
         if (r == 0) {
             return ferror(xd->fp) ? -1 : 0;
         }
+        xd->pos = offset + r;
         return r;
     }
 }
@@ -233,18 +250,20 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
 
     // This only works on POSIX systems
     bool is_redirected = !isatty(fileno(stdout));
+    long sz = 0;
 
     if (!strcmp(fn, "(cmdline)")) {
         xd.fp = NULL;
         xd.data = name;
         xd.datalen = strlen(name) + 1;
         name = "cmdline";
+        sz = xd.datalen;
     } else if ((xd.fp = fopen(fn, "rb")) == NULL) {
         fprintf(stderr, "%s: error: Could not open file %s\n", appname, fn);
         return -1;
     }
 
-    long sz = 0;
+    xd.pos = 0;
     if (xd.fp) {
         if (fseek(xd.fp, 0L, SEEK_END)) {
             fprintf(stderr, "%s: error: Could not determine size of %s\n", appname, fn);
@@ -281,27 +300,73 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
         goto done;
     }
 
-    msg->cmd = NB_DATA;
-    msg->arg = 0;
-
+    // Data goes out ahead of the acks, which say where the device is up
+    // to, and from there again when it misses something.
+    nbsender w;
+    netboot_sender_init(&w, 0, PAYLOAD_SIZE);
     bool completed = false;
-    do {
-        struct timeval packet_start_time;
-        gettimeofday(&packet_start_time, NULL);
+    while (!completed) {
+        bool more = (w.next < (size_t)sz) && netboot_sender_ready(&w);
+        if (more) {
+            struct timeval packet_start_time;
+            gettimeofday(&packet_start_time, NULL);
+
+            r = xread(&xd, w.next, msg->data, PAYLOAD_SIZE);
+            if (r <= 0) {
+                fprintf(stderr, "\n%s: error: Reading '%s'\n", appname, fn);
+                goto done;
+            }
+            msg->cmd = (w.next + r >= sz) ? NB_LAST_DATA : NB_DATA;
+            msg->arg = w.next;
+            msg->magic = NB_MAGIC;
+            msg->cookie = cookie++;
+            if (io_send(s, msg, sizeof(nbmsg) + r)) {
+                goto done;
+            }
+            w.next += r;
+
+            // Some UEFI netstacks can lose back-to-back packets at max speed
+            // so throttle output.
+            // At 1280 bytes per packet, we should at least have 10 microseconds
+            // between packets, to be safe using 20 microseconds here.
+            // 1280 bytes * (1,000,000/10) seconds = 128,000,000 bytes/seconds = 122MB/s = 976Mb/s
+            // We wait as a busy wait as the context switching a sleep can cause
+            // will often degrade performance significantly.
+            int64_t us_since_last_packet;
+            do {
+                struct timeval now;
+                gettimeofday(&now, NULL);
+                us_since_last_packet = (int64_t)(now.tv_sec - packet_start_time.tv_sec) * 1000000 + ((int64_t)now.tv_usec - (int64_t)packet_start_time.tv_usec);
+            } while (us_since_last_packet < 20);
+        }
 
-        r = xread(&xd, msg->data, PAYLOAD_SIZE);
+        r = netboot_sender_recv(&w, s, ack, 2048, !more);
         if (r < 0) {
-            fprintf(stderr, "\n%s: error: Reading '%s'\n", appname, fn);
+            fprintf(stderr, "\n%s: error: %s at %u\n", appname,
+                    (errno == ETIMEDOUT) ? "Timed out" : "Socket read error", w.acked);
             goto done;
         }
+        if ((r >= (int)sizeof(nbmsg)) && (ack->magic == NB_MAGIC)) {
+            if (ack->cmd == NB_FILE_RECEIVED) {
+                completed = true;
+            } else if (ack->cmd == NB_ACK) {
+                netboot_sender_ack(&w, ack->arg);
+                // the device has it all, even if what it said last was lost
+                completed = (w.acked >= sz);
+            } else {
+                io_error(ack);
+                goto done;
+            }
+        }
+        current_pos = w.acked;
 
         if (is_redirected) {
             if (count++ > 8 * 1024) {
-                fprintf(stderr, "%.01f%%\n", 100.0 * (float)msg->arg / (float)sz);
+                fprintf(stderr, "%.01f%%\n", 100.0 * (float)current_pos / (float)sz);
                 count = 0;
             }
         } else {
-            if (count++ > 1024 || r == 0) {
+            if (count++ > 1024 || completed) {
                 count = 0;
                 float bw = 0;
 
@@ -323,55 +388,7 @@ static int xfer(struct sockaddr_in6* addr, const char* fn, const char* name, boo
                 }
             }
         }
-
-        if (r == 0) {
-            fprintf(stderr, "\n%s: Reached end of file, waiting for confirmation.\n", appname);
-            // Do not send anything, but keep waiting on incoming messages
-            if (io(s, NULL, 0, ack, true)) {
-                goto done;
-            }
-        } else {
-            if (current_pos + r >= sz) {
-                msg->cmd = NB_LAST_DATA;
-            } else {
-                msg->cmd = NB_DATA;
-            }
-
-            if (io(s, msg, sizeof(nbmsg) + r, ack, false)) {
-                goto done;
-            }
-
-            // Some UEFI netstacks can lose back-to-back packets at max speed
-            // so throttle output.
-            // At 1280 bytes per packet, we should at least have 10 microseconds
-            // between packets, to be safe using 20 microseconds here.
-            // 1280 bytes * (1,000,000/10) seconds = 128,000,000 bytes/seconds = 122MB/s = 976Mb/s
-            // We wait as a busy wait as the context switching a sleep can cause
-            // will often degrade performance significantly.
-            int64_t us_since_last_packet;
-            do {
-                struct timeval now;
-                gettimeofday(&now, NULL);
-                us_since_last_packet = (int64_t)(now.tv_sec - packet_start_time.tv_sec) * 1000000 + ((int64_t)now.tv_usec - (int64_t)packet_start_time.tv_usec);
-            } while (us_since_last_packet < 20);
-        }
-
-        // ACKs really are NACKs
-        if (ack->cookie > 0 && ack->cmd == NB_ACK && ack->arg != current_pos) {
-            fprintf(stderr, "\n%s: need to rewind to %d from %zu\n", appname, ack->arg, current_pos);
-            current_pos = ack->arg;
-            if (fseek(xd.fp, current_pos, SEEK_SET)) {
-                fprintf(stderr, "\n%s: error: Failed to rewind '%s' to %zu\n", appname, fn, current_pos);
-                goto done;
-            }
-        } else if (ack->cmd == NB_FILE_RECEIVED) {
-            completed = true;
-        } else {
-            current_pos += r;
-        }
-
-        msg->arg = current_pos;
-    } while (!completed);
+    }
 
     status = 0;
 
@@ -8,12 +8,13 @@ BOOTSERVER := $(BUILDDIR)/tools/bootserver
 LOGLISTENER := $(BUILDDIR)/tools/loglistener
 NETRUNCMD := $(BUILDDIR)/tools/netruncmd
 NETCP := $(BUILDDIR)/tools/netcp
+ETHBENCH := $(BUILDDIR)/tools/ethbench
 SYSGEN := $(BUILDDIR)/tools/sysgen
 
 TOOLS_CFLAGS := -g -std=c11 -Wall -Isystem/public -Isystem/private
 TOOLS_CXXFLAGS := -std=c++11 -Wall
 
-ALL_TOOLS := $(BOOTSERVER) $(LOGLISTENER) $(NETRUNCMD) $(NETCP) $(SYSGEN)
+ALL_TOOLS := $(BOOTSERVER) $(LOGLISTENER) $(NETRUNCMD) $(NETCP) $(ETHBENCH) $(SYSGEN)
 
 # LZ4 host lib
 # TODO: set up third_party build rules for system/tools
@@ -57,6 +58,11 @@ $(BUILDDIR)/tools/%: system/tools/%.cpp
 	@$(MKDIR)
 	$(NOECHO)c++ $(TOOLS_CXXFLAGS) -o $@ $<
 
+$(BUILDDIR)/tools/bootserver: system/tools/bootserver.c system/tools/netprotocol.c
+	@echo compiling $@
+	@$(MKDIR)
+	$(NOECHO)cc $(TOOLS_CFLAGS) -o $@ $^
+
 $(BUILDDIR)/tools/netruncmd: system/tools/netruncmd.c system/tools/netprotocol.c
 	@echo compiling $@
 	@$(MKDIR)
@@ -0,0 +1,416 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <magenta/ethbench.h>
+
+// The host end of ethbench (see magenta/ethbench.h), which measures an
+// ethernet driver from outside with ethbench running on the device:
+//
+//   ethbench [-i <interface>] [-s <size>] [-n <count>] rx|tx|ping
+//
+//   rx    sends -n frames of -s bytes of UDP payload to the device as
+//         fast as it can, and reports what the device received of them
+//   tx    has the device send -n such frames, and reports what arrived
+//   ping  times -n round trips of -s bytes, one at a time
+//
+// Rates in Mbit/s count each whole frame from the ethernet header on.
+
+#define FRAME_HDR_LEN (14 + 40 + 8)
+#define PAYLOAD_MAX (1514 - FRAME_HDR_LEN)
+
+#define DEFAULT_SIZE 1024
+#define DEFAULT_COUNT 100000
+#define DEFAULT_PINGS 1000
+
+static const char* appname;
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec;
+}
+
+static void put_hdr(void* buf, uint32_t cmd, uint32_t seq, uint32_t arg) {
+    ethbench_hdr_t hdr = {
+        .magic = ETHBENCH_MAGIC,
+        .cmd = cmd,
+        .seq = seq,
+        .arg = arg,
+        .stamp = now(),
+    };
+    memcpy(buf, &hdr, sizeof(hdr));
+}
+
+// waits up to ms for a message of at least len bytes, returning its
+// length, 0 on timeout, or -1
+static ssize_t recv_msg(int s, void* buf, size_t size, size_t len, int ms) {
+    uint64_t deadline = now() + (uint64_t)ms * (uint64_t)1000000;
+    for (;;) {
+        uint64_t t = now();
+        if (t >= deadline) {
+            return 0;
+        }
+        struct pollfd fds = { .fd = s, .events = POLLIN };
+        int r = poll(&fds, 1, (int)((deadline - t + 999999) / 1000000));
+        if (r < 0) {
+            return (errno == EINTR) ? 0 : -1;
+        } else if (r == 0) {
+            return 0;
+        }
+        ssize_t n = recv(s, buf, size, 0);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                continue;
+            }
+            return -1;
+        }
+        ethbench_hdr_t hdr;
+        if ((size_t)n >= len) {
+            memcpy(&hdr, buf, sizeof(hdr));
+            if (hdr.magic == ETHBENCH_MAGIC) {
+                return n;
+            }
+        }
+    }
+}
+
+// finds the device by asking all the links, or just the one named, and
+// connects s to it
+static int bench_open(const char* ifname) {
+    int s = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (s < 0) {
+        fprintf(stderr, "%s: cannot create socket: %s\n", appname, strerror(errno));
+        return -1;
+    }
+    // room for the bursts of a tx test
+    int bufsize = 4 * 1024 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(s, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(ETHBENCH_PORT);
+    inet_pton(AF_INET6, "ff02::1", &addr.sin6_addr);
+
+    unsigned scope = 0;
+    if ((ifname != NULL) && ((scope = if_nametoindex(ifname)) == 0)) {
+        fprintf(stderr, "%s: no interface %s\n", appname, ifname);
+        close(s);
+        return -1;
+    }
+
+    struct ifaddrs* ifaddrs;
+    if (getifaddrs(&ifaddrs) < 0) {
+        fprintf(stderr, "%s: cannot enumerate network interfaces\n", appname);
+        close(s);
+        return -1;
+    }
+
+    uint8_t buf[PAYLOAD_MAX];
+    for (int i = 0; i < 10; i++) {
+        put_hdr(buf, ETHBENCH_HELLO, i, 0);
+        for (struct ifaddrs* ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+            if ((ifa->ifa_addr == NULL) || (ifa->ifa_addr->sa_family != AF_INET6)) {
+                continue;
+            }
+            struct sockaddr_in6* in6 = (void*)ifa->ifa_addr;
+            if ((in6->sin6_scope_id == 0) || (scope && (in6->sin6_scope_id != scope))) {
+                continue;
+            }
+            addr.sin6_scope_id = in6->sin6_scope_id;
+            sendto(s, buf, sizeof(ethbench_hdr_t), 0, (struct sockaddr*)&addr, sizeof(addr));
+        }
+
+        struct sockaddr_in6 ra;
+        socklen_t rlen = sizeof(ra);
+        struct pollfd fds = { .fd = s, .events = POLLIN };
+        if (poll(&fds, 1, 250) <= 0) {
+            continue;
+        }
+        ssize_t n = recvfrom(s, buf, sizeof(buf), 0, (void*)&ra, &rlen);
+        ethbench_hdr_t hdr;
+        if (n < (ssize_t)sizeof(hdr)) {
+            continue;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+        if ((hdr.magic != ETHBENCH_MAGIC) || (hdr.cmd != ETHBENCH_HELLO)) {
+            continue;
+        }
+        char tmp[INET6_ADDRSTRLEN];
+        if (inet_ntop(AF_INET6, &ra.sin6_addr, tmp, sizeof(tmp)) == NULL) {
+            strcpy(tmp, "???");
+        }
+        printf("found ethbench at %s/%d, on the %s path\n", tmp, ra.sin6_scope_id,
+               hdr.arg ? "fifo" : "fd");
+        freeifaddrs(ifaddrs);
+        if (connect(s, (void*)&ra, rlen) < 0) {
+            fprintf(stderr, "%s: cannot connect UDP port\n", appname);
+            close(s);
+            return -1;
+        }
+        return s;
+    }
+
+    freeifaddrs(ifaddrs);
+    fprintf(stderr, "%s: no ethbench answered\n", appname);
+    close(s);
+    return -1;
+}
+
+static void print_rate(const char* what, uint64_t frames, uint64_t bytes, uint64_t ns) {
+    if (ns == 0) {
+        ns = 1;
+    }
+    printf("%-9s %10" PRIu64 " frames %10" PRIu64 " frames/s %8" PRIu64 " Mbit/s\n",
+           what, frames, frames * (uint64_t)1000000000 / ns,
+           (bytes + frames * FRAME_HDR_LEN) * 8 * 1000 / ns);
+}
+
+static int bench_rx(int s, uint32_t size, uint32_t count) {
+    uint8_t buf[PAYLOAD_MAX];
+    uint32_t id = (uint32_t)now() | 1;
+    memset(buf, 0x5a, sizeof(buf));
+
+    uint64_t errors = 0;
+    uint64_t start = now();
+    for (uint32_t i = 0; i < count; i++) {
+        put_hdr(buf, ETHBENCH_DATA, i, id);
+        while (send(s, buf, size, 0) < 0) {
+            // the socket's buffers are full: the link is the limit
+            if ((errno != ENOBUFS) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                errors++;
+                break;
+            }
+        }
+    }
+    uint64_t elapsed = now() - start;
+    print_rate("sent", count, (uint64_t)count * size, elapsed);
+
+    for (int i = 0; i < 20; i++) {
+        put_hdr(buf, ETHBENCH_END, count, id);
+        send(s, buf, sizeof(ethbench_hdr_t), 0);
+        ssize_t n = recv_msg(s, buf, sizeof(buf),
+                             sizeof(ethbench_hdr_t) + sizeof(ethbench_stats_t), 100);
+        if (n < 0) {
+            break;
+        }
+        ethbench_hdr_t hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if ((n == 0) || (hdr.cmd != ETHBENCH_STATS) || (hdr.arg != id)) {
+            continue;
+        }
+        ethbench_stats_t st;
+        memcpy(&st, buf + sizeof(hdr), sizeof(st));
+        print_rate("received", st.frames, st.bytes, st.elapsed);
+        uint64_t dropped = (st.frames < count) ? count - st.frames : 0;
+        printf("dropped   %10" PRIu64 " frames (%" PRIu64 ".%02" PRIu64 "%%), "
+               "%" PRIu64 " send errors, %" PRIu64 " bad frames\n",
+               dropped, dropped * 100 / count, (dropped * 10000 / count) % 100,
+               errors, st.errors);
+        return 0;
+    }
+    fprintf(stderr, "%s: the device did not report\n", appname);
+    return -1;
+}
+
+static int bench_tx(int s, uint32_t size, uint32_t count) {
+    uint8_t buf[2048];
+    uint32_t id = (uint32_t)now() | 1;
+    put_hdr(buf, ETHBENCH_SEND, 0, id);
+    ethbench_send_t req = { .count = count, .size = size };
+    memcpy(buf + sizeof(ethbench_hdr_t), &req, sizeof(req));
+    if (send(s, buf, sizeof(ethbench_hdr_t) + sizeof(req), 0) < 0) {
+        fprintf(stderr, "%s: cannot send: %s\n", appname, strerror(errno));
+        return -1;
+    }
+
+    uint64_t frames = 0, bytes = 0, reordered = 0;
+    uint64_t first = 0, last = 0;
+    uint32_t next = 0;
+    bool ended = false;
+    ethbench_stats_t st;
+    memset(&st, 0, sizeof(st));
+    for (;;) {
+        // the first frame may take a while, if the device was idle
+        ssize_t n = recv_msg(s, buf, sizeof(buf), sizeof(ethbench_hdr_t),
+                             (frames > 0) ? 500 : 2000);
+        if (n <= 0) {
+            break;
+        }
+        ethbench_hdr_t hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.arg != id) {
+            continue;
+        }
+        if (hdr.cmd == ETHBENCH_END) {
+            if ((size_t)n >= sizeof(hdr) + sizeof(st)) {
+                memcpy(&st, buf + sizeof(hdr), sizeof(st));
+            }
+            ended = true;
+            break;
+        }
+        if (hdr.cmd != ETHBENCH_DATA) {
+            continue;
+        }
+        last = now();
+        if (frames++ == 0) {
+            first = last;
+        }
+        bytes += n;
+        if (hdr.seq < next) {
+            reordered++;
+        }
+        next = hdr.seq + 1;
+    }
+    if (!ended && (frames == 0)) {
+        fprintf(stderr, "%s: nothing came from the device\n", appname);
+        return -1;
+    }
+    if (ended) {
+        print_rate("sent", st.frames, st.bytes, st.elapsed);
+    }
+    print_rate("received", frames, bytes, last - first);
+    uint64_t sent = ended ? st.frames : count;
+    uint64_t dropped = (frames < sent) ? sent - frames : 0;
+    printf("dropped   %10" PRIu64 " frames, %" PRIu64 " out of order, %" PRIu64
+           " device errors%s\n", dropped, reordered, st.errors,
+           ended ? "" : " (the device's report was lost)");
+    return 0;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_ping(int s, uint32_t size, uint32_t count) {
+    uint8_t buf[2048];
+    uint64_t* rtt = malloc(count * sizeof(uint64_t));
+    if (rtt == NULL) {
+        fprintf(stderr, "%s: out of memory\n", appname);
+        return -1;
+    }
+    memset(buf, 0x5a, sizeof(buf));
+    uint32_t got = 0, lost = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        put_hdr(buf, ETHBENCH_PING, i, 0);
+        uint64_t t = now();
+        if (send(s, buf, size, 0) < 0) {
+            lost++;
+            continue;
+        }
+        for (;;) {
+            ssize_t n = recv_msg(s, buf, sizeof(buf), sizeof(ethbench_hdr_t), 1000);
+            if (n <= 0) {
+                lost++;
+                break;
+            }
+            ethbench_hdr_t hdr;
+            memcpy(&hdr, buf, sizeof(hdr));
+            // late answers to earlier pings are passed over
+            if ((hdr.cmd == ETHBENCH_PONG) && (hdr.seq == i)) {
+                rtt[got++] = now() - t;
+                break;
+            }
+        }
+    }
+    if (got == 0) {
+        fprintf(stderr, "%s: no pings answered\n", appname);
+        free(rtt);
+        return -1;
+    }
+    qsort(rtt, got, sizeof(uint64_t), cmp_u64);
+    printf("%u of %u answered, rtt in us: min %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+           " p99 %" PRIu64 " max %" PRIu64 "\n",
+           got, count, rtt[0] / 1000, rtt[(got - 1) * 50 / 100] / 1000,
+           rtt[(got - 1) * 90 / 100] / 1000, rtt[(got - 1) * 99 / 100] / 1000,
+           rtt[got - 1] / 1000);
+    free(rtt);
+    return (lost == 0) ? 0 : -1;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: %s [-i <interface>] [-s <size>] [-n <count>] rx|tx|ping\n", appname);
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    appname = argv[0];
+    const char* ifname = NULL;
+    const char* test = NULL;
+    uint32_t size = DEFAULT_SIZE;
+    uint32_t count = 0;
+    for (int i = 1; i < argc; i++) {
+        if ((argv[i][0] == '-') && (i + 1 < argc)) {
+            if (!strcmp(argv[i], "-i")) {
+                ifname = argv[++i];
+            } else if (!strcmp(argv[i], "-s")) {
+                size = strtoul(argv[++i], NULL, 0);
+            } else if (!strcmp(argv[i], "-n")) {
+                count = strtoul(argv[++i], NULL, 0);
+            } else {
+                return usage();
+            }
+        } else if (test == NULL) {
+            test = argv[i];
+        } else {
+            return usage();
+        }
+    }
+    if (test == NULL) {
+        return usage();
+    }
+    if (size < sizeof(ethbench_hdr_t) + sizeof(ethbench_stats_t)) {
+        size = sizeof(ethbench_hdr_t) + sizeof(ethbench_stats_t);
+    }
+    if (size > PAYLOAD_MAX) {
+        size = PAYLOAD_MAX;
+    }
+
+    int (*bench)(int s, uint32_t size, uint32_t count);
+    if (!strcmp(test, "rx")) {
+        bench = bench_rx;
+    } else if (!strcmp(test, "tx")) {
+        bench = bench_tx;
+    } else if (!strcmp(test, "ping")) {
+        bench = bench_ping;
+    } else {
+        return usage();
+    }
+    if (count == 0) {
+        count = (bench == bench_ping) ? DEFAULT_PINGS : DEFAULT_COUNT;
+    }
+
+    int s = bench_open(ifname);
+    if (s < 0) {
+        return -1;
+    }
+    printf("%s: %u frames of %u bytes of payload, %u byte frames\n", test, count, size,
+           size + FRAME_HDR_LEN);
+    int r = bench(s, size, count);
+    close(s);
+    return r;
+}
@@ -36,6 +36,8 @@ char FSMAGIC[16] = "[BOOTFS]\0\0\0\0\0\0\0\0";
 //   namedata   (namelength bytes, includes \0)
 //
 // - fileoffsets must be page aligned (multiple of 4096)
+// - with -z, files that shrink by at least a page are stored as LZ4 frames
+//   and have BOOTFS_FILE_COMPRESSED set in their fileoffset
 
 #define FSENTRYSZ 12
 
@@ -49,6 +51,10 @@ struct fsentry {
     uint32_t length;
 
     char *srcpath;
+
+    // the LZ4 frame stored in place of the file, if it's compressed
+    void *zdata;
+    uint32_t zlength;
 };
 typedef struct fs {
     fsentry *first;
@@ -277,6 +283,9 @@ static const copy_ops copy_passthrough = {
     .copy_file = copyfile,
 };
 
+// userboot decompresses the blocks of a frame on all the CPUs at once, which
+// needs them to be independent and, since nothing here ever flushes, every
+// block but the last to be full.
 static LZ4F_preferences_t lz4_prefs = {
     .frameInfo = {
         .blockSizeID = LZ4F_max64KB,
@@ -356,6 +365,9 @@ ssize_t compress_finish(void* dst, void* cookie) {
     return wrote;
 }
 
+#define PAGEALIGN(n) (((n) + 4095) & (~4095))
+#define PAGEFILL(n) (PAGEALIGN(n) - (n))
+
 static const copy_ops copy_compress = {
     .copy_setup = compress_setup,
     .copy_data = compress_data,
@@ -363,8 +375,48 @@ static const copy_ops copy_compress = {
     .copy_finish = compress_finish,
 };
 
-#define PAGEALIGN(n) (((n) + 4095) & (~4095))
-#define PAGEFILL(n) (PAGEALIGN(n) - (n))
+// Compresses one file into its own LZ4 frame, and keeps it if that saves at
+// least a page, since the stored data is padded out to pages either way.
+int compress_entry(fsentry *e) {
+    if (e->length == 0) {
+        return 0;
+    }
+    lz4_prefs.frameInfo.contentSize = e->length;
+    // header, the data, and the final block plus footer
+    size_t max = 16 + LZ4F_compressBound(e->length, &lz4_prefs) +
+                 LZ4F_compressBound(65536, &lz4_prefs) + 8;
+    uint8_t *buf = malloc(max);
+    if (buf == NULL) {
+        fprintf(stderr, "error: out of memory compressing '%s'\n", e->srcpath);
+        return -1;
+    }
+    uint8_t *dst = buf;
+    void *cookie = NULL;
+    ssize_t wrote;
+    if ((wrote = compress_setup(dst, &cookie)) < 0) goto fail;
+    dst += wrote;
+    if ((wrote = compress_file(dst, e->srcpath, e->length, cookie)) < 0) goto fail;
+    dst += wrote;
+    if ((wrote = compress_finish(dst, cookie)) < 0) goto fail;
+    dst += wrote;
+
+    size_t zlength = dst - buf;
+    if (zlength > max) {
+        fprintf(stderr, "INTERNAL ERROR!! wrote %zu bytes > %zu bytes!\n", zlength, max);
+        goto fail;
+    }
+    if (PAGEALIGN(zlength) < PAGEALIGN(e->length)) {
+        e->zdata = buf;
+        e->zlength = zlength;
+    } else {
+        free(buf);
+    }
+    return 0;
+fail:
+    fprintf(stderr, "error: failed compressing '%s'\n", e->srcpath);
+    free(buf);
+    return -1;
+}
 
 char fill[4096];
 
@@ -416,7 +468,7 @@ int export_userfs(const char *fn, fs *fs, unsigned hsz, uint64_t outsize, bool c
         uint32_t hdr[3];
         hdr[0] = e->namelen;
         hdr[1] = e->length;
-        hdr[2] = e->offset;
+        hdr[2] = e->offset | (e->zdata ? BOOTFS_FILE_COMPRESSED : 0);
         CHECK_WRITE(wrote = op->copy_data(dst, hdr, sizeof(hdr), cookie));
         dst += wrote;
         CHECK_WRITE(wrote = op->copy_data(dst, e->name, e->namelen, cookie));
@@ -438,11 +490,18 @@ int export_userfs(const char *fn, fs *fs, unsigned hsz, uint64_t outsize, bool c
 
     for (e = fs->first; e != NULL; e = e->next) {
         if (verbose) {
-            fprintf(stderr, "%08x %08x %s\n", e->offset, e->length, e->name);
+            fprintf(stderr, "%08x %08x %s%s\n", e->offset, e->length, e->name,
+                    e->zdata ? " (compressed)" : "");
+        }
+        if (e->zdata) {
+            CHECK_WRITE(wrote = op->copy_data(dst, e->zdata, e->zlength, cookie));
+            dst += wrote;
+            n = PAGEFILL(e->zlength);
+        } else {
+            CHECK_WRITE(wrote = op->copy_file(dst, e->srcpath, e->length, cookie));
+            dst += wrote;
+            n = PAGEFILL(e->length);
         }
-        CHECK_WRITE(wrote = op->copy_file(dst, e->srcpath, e->length, cookie));
-        dst += wrote;
-        n = PAGEFILL(e->length);
         if (n) {
             CHECK_WRITE(wrote = op->copy_data(dst, fill, n, cookie));
             dst += wrote;
@@ -510,6 +569,7 @@ int main(int argc, char **argv) {
     unsigned hsz = 0;
     uint64_t off;
     bool compressed = false;
+    bool compress_files = false;
 
     argc--;
     argv++;
@@ -528,10 +588,12 @@ int main(int argc, char **argv) {
             argc--;
             argv++;
         } else if (!strcmp(cmd,"-h")) {
-            fprintf(stderr, "usage: mkbootfs [-v] [-o <fsimage>] <manifests>...\n");
+            fprintf(stderr, "usage: mkbootfs [-v] [-c] [-z] [-o <fsimage>] <manifests>...\n");
             return 0;
         } else if (!strcmp(cmd,"-c")) {
             compressed = true;
+        } else if (!strcmp(cmd,"-z")) {
+            compress_files = true;
         } else {
             fprintf(stderr, "unknown option: %s\n", cmd);
             return -1;
@@ -569,11 +631,19 @@ int main(int argc, char **argv) {
     // account for the end-of-records record
     hsz += 12;
 
+    if (compress_files) {
+        for (e = fs.first; e != NULL; e = e->next) {
+            if (compress_entry(e) < 0) {
+                return -1;
+            }
+        }
+    }
+
     off = PAGEALIGN(hsz);
     fsentry* last_entry = NULL;
     for (e = fs.first; e != NULL; e = e->next) {
         e->offset = off;
-        off += PAGEALIGN(e->length);
+        off += PAGEALIGN(e->zdata ? e->zlength : e->length);
         if (off > INT32_MAX) {
             fprintf(stderr, "error: userfs too large\n");
             return -1;
@@ -59,22 +59,54 @@ static int pull_file(int s, const char* dst, const char* src) {
         return -1;
     }
 
+    // blocks are asked for ahead, and taken in order; the answer for the
+    // next wanted is its ack
+    nbsender w;
+    netboot_sender_init(&w, 0, 1);
+    bool eof = false;
     int n = 0;
-    int blocknum = 0;
-    for (;;) {
-        memset(&out, 0, sizeof(out));
-        out.hdr.cmd = NB_READ;
-        out.hdr.arg = blocknum;
-        r = netboot_txn(s, &in, &out, sizeof(out.hdr) + 1);
+    while (!eof) {
+        bool more = netboot_sender_ready(&w);
+        if (more) {
+            memset(&out, 0, sizeof(out));
+            out.hdr.cmd = NB_READ;
+            out.hdr.arg = w.next;
+            if (netboot_send(s, &out, sizeof(out.hdr) + 1) < 0) {
+                fprintf(stderr, "%s: error asking for block %u (%d)\n",
+                        appname, w.next, errno);
+                close(fd);
+                return -1;
+            }
+            w.next++;
+        }
+        r = netboot_sender_recv(&w, s, &in, sizeof(in), !more);
         if (r < 0) {
-            fprintf(stderr, "%s: error reading block %d (%d)\n",
-                    appname, blocknum, errno);
+            fprintf(stderr, "%s: error reading block %u (%d)\n",
+                    appname, w.acked, errno);
             close(fd);
             return r;
         }
+        if ((r < (int)sizeof(in.hdr)) || (in.hdr.magic != NB_MAGIC) || (in.hdr.cmd != NB_ACK)) {
+            continue;
+        }
+        if ((int32_t)in.hdr.arg < 0) {
+            errno = -(int32_t)in.hdr.arg;
+            fprintf(stderr, "%s: error reading block %u (%d)\n",
+                    appname, w.acked, errno);
+            close(fd);
+            return -1;
+        }
+        if (in.hdr.arg != w.acked) {
+            if (in.hdr.arg > w.acked) {
+                // the one wanted went missing
+                netboot_sender_ack(&w, w.acked);
+            }
+            continue;
+        }
         r -= sizeof(in.hdr);
         if (r == 0) {
-            break; // EOF
+            eof = true;
+            continue;
         }
         if (write(fd, in.data, r) < r) {
             fprintf(stderr, "%s: pull short local write: %s\n",
@@ -82,7 +114,7 @@ static int pull_file(int s, const char* dst, const char* src) {
             close(fd);
             return -1;
         }
-        blocknum++;
+        netboot_sender_ack(&w, w.acked + 1);
         n += r;
     }
 
@@ -150,35 +182,70 @@ again:
         return -1;
     }
 
+    // blocks are sent ahead of their acks, which say which block is
+    // wanted next, until the block after the last is
+    nbsender w;
+    netboot_sender_init(&w, 0, 1);
+    uint32_t end = UINT32_MAX;
+    uint32_t pos = 0;   // block at the file's offset
+    uint32_t sent = 0;  // blocks sent at least once
     int n = 0;
-    int len = 0;
-    int blocknum = 0;
-    for (;;) {
-        memset(&out, 0, sizeof(out));
-        out.hdr.cmd = NB_WRITE;
-        out.hdr.arg = blocknum;
-
-        len = read(fd, out.data, sizeof(out.data));
-        if (len < 0) {
-            fprintf(stderr, "%s: error reading block %d (%d)\n",
-                    appname, blocknum, errno);
+    while (w.acked < end) {
+        bool more = (w.next < end) && netboot_sender_ready(&w);
+        if (more) {
+            if ((w.next != pos) &&
+                (lseek(fd, (off_t)w.next * sizeof(out.data), SEEK_SET) < 0)) {
+                fprintf(stderr, "%s: error seeking to block %u (%d)\n",
+                        appname, w.next, errno);
+                close(fd);
+                return -1;
+            }
+            memset(&out, 0, sizeof(out));
+            out.hdr.cmd = NB_WRITE;
+            out.hdr.arg = w.next;
+
+            int len = read(fd, out.data, sizeof(out.data));
+            if (len < 0) {
+                fprintf(stderr, "%s: error reading block %u (%d)\n",
+                        appname, w.next, errno);
+                close(fd);
+                return -1;
+            }
+            pos = w.next + 1;
+            if (len == 0) {
+                end = w.next;
+                continue;
+            }
+            if (netboot_send(s, &out, sizeof(out.hdr) + len + 1) < 0) {
+                fprintf(stderr, "%s: error writing block %u (%d)\n",
+                        appname, w.next, errno);
+                close(fd);
+                return -1;
+            }
+            if (w.next == sent) {
+                sent++;
+                n += len;
+            }
+            w.next++;
+        }
+        r = netboot_sender_recv(&w, s, &in, sizeof(in), !more);
+        if (r < 0) {
+            fprintf(stderr, "%s: error writing block %u (%d)\n",
+                    appname, w.acked, errno);
             close(fd);
             return r;
         }
-        if (len == 0) {
-            break; // EOF
+        if ((r < (int)sizeof(in.hdr)) || (in.hdr.magic != NB_MAGIC) || (in.hdr.cmd != NB_ACK)) {
+            continue;
         }
-
-        r = netboot_txn(s, &in, &out, sizeof(out.hdr) + len + 1);
-        if (r < 0) {
-            fprintf(stderr, "%s: error writing block %d (%d)\n",
-                    appname, blocknum, errno);
+        if ((int32_t)in.hdr.arg < 0) {
+            errno = -(int32_t)in.hdr.arg;
+            fprintf(stderr, "%s: error writing block %u (%d)\n",
+                    appname, w.acked, errno);
             close(fd);
-            return r;
+            return -1;
         }
-
-        blocknum++;
-        n += len;
+        netboot_sender_ack(&w, in.hdr.arg);
     }
 
     memset(&out, 0, sizeof(out));
@@ -15,6 +15,7 @@
 #include <ifaddrs.h>
 
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -147,9 +148,11 @@ resend:
             fprintf(stderr, "netboot: response too short\n");
             continue;
         }
-        if ((in->hdr.magic != NB_MAGIC) ||
-            (in->hdr.cookie != out->hdr.cookie) ||
-            (in->hdr.cmd != NB_ACK)) {
+        if ((in->hdr.magic == NB_MAGIC) && (in->hdr.cookie != out->hdr.cookie)) {
+            // a late answer to something sent ahead, before this
+            continue;
+        }
+        if ((in->hdr.magic != NB_MAGIC) || (in->hdr.cmd != NB_ACK)) {
             fprintf(stderr, "netboot: bad ack header"
                     " (magic=0x%x, cookie=%x/%x, cmd=%d)\n",
                     in->hdr.magic, in->hdr.cookie, cookie, in->hdr.cmd);
@@ -163,3 +166,82 @@ resend:
         return r;
     }
 }
+
+int netboot_send(int s, msg* out, int outlen) {
+    out->hdr.magic = NB_MAGIC;
+    out->hdr.cookie = ++cookie;
+    return (write(s, out, outlen) == outlen) ? 0 : -1;
+}
+
+static int64_t now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void netboot_sender_init(nbsender* w, uint32_t start, uint32_t step) {
+    w->acked = start;
+    w->next = start;
+    w->step = step;
+    w->timeouts = 0;
+    w->went_back = false;
+    w->deadline = now_ms() + NB_RETRANSMIT_MS;
+}
+
+bool netboot_sender_ready(const nbsender* w) {
+    return (w->next - w->acked) < NB_WINDOW * w->step;
+}
+
+void netboot_sender_ack(nbsender* w, uint32_t pos) {
+    if (pos > w->acked) {
+        w->acked = pos;
+        if (w->next < pos) {
+            w->next = pos;
+        }
+        w->timeouts = 0;
+        w->went_back = false;
+        w->deadline = now_ms() + NB_RETRANSMIT_MS;
+    } else if ((pos == w->acked) && (pos < w->next) && !w->went_back) {
+        // the receiver missed what it asks for, so everything since
+        w->next = pos;
+        w->went_back = true;
+    }
+}
+
+int netboot_sender_recv(nbsender* w, int s, void* buf, size_t len, bool wait) {
+    for (;;) {
+        int64_t left = w->deadline - now_ms();
+        if (left <= 0) {
+            if (++w->timeouts > NB_RETRANSMIT_MAX) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            w->next = w->acked;
+            w->went_back = false;
+            w->deadline = now_ms() + NB_RETRANSMIT_MS;
+            return 0;
+        }
+        struct pollfd pfd = { .fd = s, .events = POLLIN };
+        int r = poll(&pfd, 1, wait ? (int)left : 0);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            if (!wait) {
+                return 0;
+            }
+            continue;
+        }
+        ssize_t n = recv(s, buf, len, 0);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                continue;
+            }
+            return -1;
+        }
+        return n;
+    }
+}
@@ -6,6 +6,9 @@
 
 #include <magenta/netboot.h>
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define MAXSIZE 1024
 
 typedef struct {
@@ -18,3 +21,32 @@ struct sockaddr_in6;
 int netboot_open(const char* hostname, unsigned port, struct sockaddr_in6* addr_out);
 
 int netboot_txn(int s, msg* in, msg* out, int outlen);
+
+// sets the magic and a fresh cookie, and sends
+int netboot_send(int s, msg* out, int outlen);
+
+// The sending end of a windowed transfer (see magenta/netboot.h).
+// Positions are byte offsets or block numbers, and step is what a full
+// message moves one by.
+typedef struct {
+    uint32_t acked;     // the receiver has everything before this
+    uint32_t next;      // what to send next
+    uint32_t step;
+    uint32_t timeouts;  // in a row, without progress
+    bool went_back;     // for an ack that moved nothing, since acked last moved
+    int64_t deadline;   // in ms, for progress before going back to acked
+} nbsender;
+
+void netboot_sender_init(nbsender* w, uint32_t start, uint32_t step);
+
+// whether the window has room for another message
+bool netboot_sender_ready(const nbsender* w);
+
+// the receiver asked for pos
+void netboot_sender_ack(nbsender* w, uint32_t pos);
+
+// Returns the length of a message received on s, 0 if none arrives
+// before the deadline, or straight away unless wait is set, or -1 on
+// error.  When the deadline passes next goes back to acked; after too
+// many of those in a row it fails with ETIMEDOUT.
+int netboot_sender_recv(nbsender* w, int s, void* buf, size_t len, bool wait);
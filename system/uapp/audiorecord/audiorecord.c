@@ -6,6 +6,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,10 @@
 
 #define DEV_AUDIO   "/dev/class/audio"
 
+// for streaming through the device's ring buffer
+#define RING_SIZE 65536
+#define RING_POLL_MS 5
+
 static int open_source(void) {
     struct dirent* de;
     DIR* dir = opendir(DEV_AUDIO);
@@ -65,9 +70,34 @@ next:
     return -1;
 }
 
+// reads what the device has put in the ring since the last time,
+// once every RING_POLL_MS, count times
+static int read_ring(int fd, const uint8_t* ring, int count) {
+    uint64_t read_position = 0;
+    for (int i = 0; i < count; i++) {
+        mx_nanosleep(MX_MSEC(RING_POLL_MS));
+
+        audio_ring_position_t pos;
+        if (ioctl_audio_get_ring_position(fd, &pos) != sizeof(pos)) {
+            printf("ioctl_audio_get_ring_position failed\n");
+            return -1;
+        }
+        if (pos.position - read_position > RING_SIZE) {
+            printf("overrun, lost %" PRIu64 " bytes\n", pos.position - read_position - RING_SIZE);
+            read_position = pos.position - RING_SIZE;
+        }
+        // the data is at ring + read_position % RING_SIZE, wrapping
+        printf("read %" PRIu64 " at frame %" PRIu64 "\n",
+               pos.position - read_position, pos.usb_frame);
+        read_position = pos.position;
+    }
+    return 0;
+}
+
 static void usage(char* me) {
     fprintf(stderr, "usage: %s [-s <number of times to start/stop>] "
-                    "[-r <number of buffers to read per start/stop>]\n", me);
+                    "[-r <number of buffers to read per start/stop>] "
+                    "[-d <USB frames to queue, streaming through a ring buffer>]\n", me);
 }
 
 int main(int argc, char **argv) {
@@ -75,6 +105,8 @@ int main(int argc, char **argv) {
     int start_stop_count = 1;
     // number of times to read per start/stop
     int read_count = INT_MAX;
+    // stream through a ring buffer, with this many USB frames queued
+    int ring_depth = 0;
 
     for (int i = 1; i < argc; i++) {
         char* arg = argv[i];
@@ -88,6 +120,16 @@ int main(int argc, char **argv) {
             }
             usage(argv[0]);
             return -1;
+        } else if (strcmp(arg, "-d") == 0) {
+            if (++i < argc) {
+                int depth = atoi(argv[i]);
+                if (depth > 0) {
+                    ring_depth = depth;
+                    continue;
+                }
+            }
+            usage(argv[0]);
+            return -1;
         } else if (strcmp(arg, "-r") == 0) {
             if (++i < argc) {
                 int count = atoi(argv[i]);
@@ -111,9 +153,39 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    uint8_t* ring = NULL;
+    if (ring_depth > 0) {
+        audio_ring_config_t config = {
+            .size = RING_SIZE,
+            .depth = ring_depth,
+        };
+        mx_handle_t vmo;
+        uintptr_t ptr;
+        if (ioctl_audio_set_ring_buffer(fd, &config, &vmo) != sizeof(vmo)) {
+            printf("ioctl_audio_set_ring_buffer failed\n");
+            close(fd);
+            return -1;
+        }
+        mx_status_t status = mx_process_map_vm(mx_process_self(), vmo, 0, RING_SIZE, &ptr,
+                                               MX_VM_FLAG_PERM_READ);
+        mx_handle_close(vmo);
+        if (status < 0) {
+            printf("failed to map the ring buffer: %d\n", status);
+            close(fd);
+            return -1;
+        }
+        ring = (uint8_t*)ptr;
+    }
+
     for (int i = 0; i < start_stop_count; i++) {
         ioctl_audio_start(fd);
 
+        if (ring) {
+            int ret = read_ring(fd, ring, read_count);
+            ioctl_audio_stop(fd);
+            if (ret < 0) break;
+            continue;
+        }
         for (int j = 0; j < read_count; j++) {
             uint16_t buffer[500];
             int length = read(fd, buffer, sizeof(buffer));
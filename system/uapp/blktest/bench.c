@@ -0,0 +1,483 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <magenta/device/block.h>
+
+#include <mxio/io.h>
+
+#include "blktest.h"
+
+// Runs a mix of reads and writes against a block device for a while and
+// reports how many got done and how long they took:
+//
+//   magenta> blktest bench <dev> [-b <bytes>] [-q <depth>] [-j <threads>]
+//                                [-r <random %>] [-w <write %>] [-t <seconds>]
+//                                [-o <offset>] [-s <bytes>] [-f]
+//
+// Each thread has its own fd, or with -f its own session of the queued
+// block protocol, keeping -q requests in flight.  Through an fd there is
+// only ever one.  Sequential requests follow on from the last the thread
+// sent, each thread starting in a different part of the range.
+//
+// Latency is from a request being handed over to it being seen to be
+// done, so through the fifo it includes the wait for the ring.  Writes
+// wreck whatever is on the device.
+
+#define BENCH_MAX_THREADS 16
+#define BENCH_MAX_DEPTH BLOCK_FIFO_MAX_COUNT
+
+// latencies in ns, in buckets a sixteenth of a power of two wide
+#define LAT_SUB_SHIFT 4
+#define LAT_SUB (1u << LAT_SUB_SHIFT)
+#define LAT_BUCKETS (LAT_SUB * (64 - LAT_SUB_SHIFT + 1))
+
+enum { OP_READ, OP_WRITE, OP_COUNT };
+static const char* const op_names[OP_COUNT] = { "read", "write" };
+
+typedef struct {
+    uint64_t ios;
+    uint64_t bytes;
+    uint64_t lat_sum;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t hist[LAT_BUCKETS];
+} bench_stats_t;
+
+typedef struct {
+    const char* dev;
+    uint64_t blksize;
+    uint64_t bs;
+    uint32_t depth;
+    uint32_t threads;
+    uint32_t random_pct;
+    uint32_t write_pct;
+    mx_time_t duration;
+    uint64_t offset;
+    uint64_t range;
+    bool fifo;
+} bench_config_t;
+
+typedef struct {
+    const bench_config_t* cfg;
+    uint32_t index;
+    uint64_t rng;
+    uint64_t next;          // where the next sequential request goes
+    mx_status_t status;
+    bench_stats_t stats[OP_COUNT];
+    thrd_t thread;
+} bench_thread_t;
+
+static uint32_t lat_bucket(uint64_t ns) {
+    if (ns < LAT_SUB) {
+        return ns;
+    }
+    uint32_t shift = 63 - __builtin_clzll(ns) - LAT_SUB_SHIFT;
+    return LAT_SUB * (shift + 1) + ((ns >> shift) & (LAT_SUB - 1));
+}
+
+// the smallest latency that lands in bucket b
+static uint64_t lat_bucket_min(uint32_t b) {
+    if (b < LAT_SUB) {
+        return b;
+    }
+    uint32_t shift = b / LAT_SUB - 1;
+    return (uint64_t)(LAT_SUB + b % LAT_SUB) << shift;
+}
+
+static void stats_add(bench_stats_t* s, uint64_t bytes, mx_time_t lat) {
+    if ((s->ios == 0) || (lat < s->lat_min)) {
+        s->lat_min = lat;
+    }
+    s->lat_max = MAX(s->lat_max, lat);
+    s->ios++;
+    s->bytes += bytes;
+    s->lat_sum += lat;
+    s->hist[lat_bucket(lat)]++;
+}
+
+static void stats_merge(bench_stats_t* to, const bench_stats_t* from) {
+    if (from->ios == 0) {
+        return;
+    }
+    if ((to->ios == 0) || (from->lat_min < to->lat_min)) {
+        to->lat_min = from->lat_min;
+    }
+    to->lat_max = MAX(to->lat_max, from->lat_max);
+    to->ios += from->ios;
+    to->bytes += from->bytes;
+    to->lat_sum += from->lat_sum;
+    for (uint32_t i = 0; i < LAT_BUCKETS; i++) {
+        to->hist[i] += from->hist[i];
+    }
+}
+
+static uint64_t stats_percentile(const bench_stats_t* s, uint32_t per_mille) {
+    uint64_t want = (s->ios * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LAT_BUCKETS; i++) {
+        if ((seen += s->hist[i]) >= want) {
+            return MIN(MAX(lat_bucket_min(i), s->lat_min), s->lat_max);
+        }
+    }
+    return s->lat_max;
+}
+
+static void stats_print(const char* name, const bench_stats_t* s, mx_time_t elapsed) {
+    if (s->ios == 0) {
+        return;
+    }
+    // rates in hundredths, to print without floating point
+    uint64_t iops = s->ios * MX_SEC(1) * 100 / elapsed;
+    uint64_t mbps = s->bytes * MX_SEC(1) / elapsed * 100 / (1024 * 1024);
+    printf("%-6s %10" PRIu64 " ios %8" PRIu64 ".%02" PRIu64 " iops %6" PRIu64 ".%02" PRIu64 " MB/s\n",
+           name, s->ios, iops / 100, iops % 100, mbps / 100, mbps % 100);
+    printf("       latency us: min %" PRIu64 " avg %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+           " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+           s->lat_min / 1000, s->lat_sum / s->ios / 1000, stats_percentile(s, 500) / 1000,
+           stats_percentile(s, 900) / 1000, stats_percentile(s, 990) / 1000,
+           stats_percentile(s, 999) / 1000, s->lat_max / 1000);
+}
+
+static uint64_t rng_next(bench_thread_t* t) {
+    // xorshift64*
+    t->rng ^= t->rng >> 12;
+    t->rng ^= t->rng << 25;
+    t->rng ^= t->rng >> 27;
+    return t->rng * 0x2545f4914f6cdd1dull;
+}
+
+// picks what the next request does and where
+static uint32_t bench_next(bench_thread_t* t, uint64_t* offset) {
+    const bench_config_t* cfg = t->cfg;
+    uint64_t slots = cfg->range / cfg->bs;
+    uint32_t op = (rng_next(t) % 100 < cfg->write_pct) ? OP_WRITE : OP_READ;
+    if ((cfg->random_pct > 0) && (rng_next(t) % 100 < cfg->random_pct)) {
+        *offset = cfg->offset + (rng_next(t) % slots) * cfg->bs;
+    } else {
+        if (t->next + cfg->bs > cfg->offset + cfg->range) {
+            t->next = cfg->offset;
+        }
+        *offset = t->next;
+    }
+    t->next = *offset + cfg->bs;
+    return op;
+}
+
+static mx_status_t bench_fd(bench_thread_t* t) {
+    const bench_config_t* cfg = t->cfg;
+    int fd = open(cfg->dev, O_RDWR);
+    if (fd < 0) {
+        return fd;
+    }
+    uint8_t* buf = malloc(cfg->bs);
+    if (!buf) {
+        close(fd);
+        return ERR_NO_MEMORY;
+    }
+    memset(buf, 0xa5, cfg->bs);
+
+    mx_status_t status = NO_ERROR;
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + cfg->duration;
+    for (;;) {
+        mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+        if (start >= deadline) {
+            break;
+        }
+        uint64_t offset;
+        uint32_t op = bench_next(t, &offset);
+        ssize_t r = (op == OP_WRITE) ? pwrite(fd, buf, cfg->bs, offset)
+                                     : pread(fd, buf, cfg->bs, offset);
+        if (r != (ssize_t)cfg->bs) {
+            printf("blktest: %s of %" PRIu64 " at %" PRIu64 " returned %zd\n",
+                   op_names[op], cfg->bs, offset, r);
+            status = (r < 0) ? r : ERR_IO;
+            break;
+        }
+        stats_add(&t->stats[op], cfg->bs, mx_time_get(MX_CLOCK_MONOTONIC) - start);
+    }
+    free(buf);
+    close(fd);
+    return status;
+}
+
+static mx_status_t bench_fifo(bench_thread_t* t) {
+    const bench_config_t* cfg = t->cfg;
+    uint32_t count = 1;
+    while (count < cfg->depth) {
+        count *= 2;
+    }
+    int fd = open(cfg->dev, O_RDWR);
+    if (fd < 0) {
+        return fd;
+    }
+    block_fifo_config_t config = {
+        .count = count,
+        .data_size = count * cfg->bs,
+    };
+    block_fifo_info_t info;
+    ssize_t rc = ioctl_block_fifo_create(fd, &config, &info);
+    close(fd);
+    if (rc < 0) {
+        printf("blktest: %s has no fifo: %zd\n", cfg->dev, rc);
+        return rc;
+    }
+
+    mx_status_t status;
+    uintptr_t addr;
+    size_t size = info.data_offset + config.data_size;
+    if ((status = mx_process_map_vm(mx_process_self(), info.vmo, 0, size, &addr,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE)) < 0) {
+        goto done;
+    }
+    block_fifo_request_t* ring = (block_fifo_request_t*)addr;
+    uint8_t* data = (uint8_t*)addr + info.data_offset;
+    memset(data, 0xa5, config.data_size);
+    mx_time_t* sent = calloc(count, sizeof(mx_time_t));
+    if (!sent) {
+        status = ERR_NO_MEMORY;
+        goto unmap;
+    }
+
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + cfg->duration;
+    bool stopping = false;
+    while (!stopping || (tail < head)) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        stopping = stopping || (now >= deadline);
+        uint64_t n = 0;
+        while (!stopping && (head - tail < cfg->depth)) {
+            uint32_t slot = head % count;
+            block_fifo_request_t* req = &ring[slot];
+            uint64_t offset;
+            uint32_t op = bench_next(t, &offset);
+            req->opcode = (op == OP_WRITE) ? BLOCK_OP_WRITE : BLOCK_OP_READ;
+            req->status = 0;
+            req->length = cfg->bs;
+            req->actual = 0;
+            req->dev_offset = offset;
+            req->data_offset = slot * cfg->bs;
+            sent[slot] = now;
+            head++;
+            n++;
+        }
+        if (n > 0) {
+            if ((status = mx_fifo_op(info.fifo, MX_FIFO_OP_ADVANCE_HEAD, n, NULL)) < 0) {
+                break;
+            }
+            mx_object_signal_peer(info.fifo, 0, BLOCK_FIFO_SIGNAL);
+        }
+
+        mx_time_t timeout = stopping ? MX_TIME_INFINITE : deadline - now;
+        status = mx_handle_wait_one(info.fifo, BLOCK_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED,
+                                    timeout, NULL);
+        if ((status < 0) && (status != ERR_TIMED_OUT)) {
+            break;
+        }
+        mx_object_signal(info.fifo, BLOCK_FIFO_SIGNAL, 0);
+        mx_fifo_state_t state;
+        if ((status = mx_fifo_op(info.fifo, MX_FIFO_OP_READ_STATE, 0, &state)) < 0) {
+            break;
+        }
+        now = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (; tail < state.tail; tail++) {
+            uint32_t slot = tail % count;
+            block_fifo_request_t* req = &ring[slot];
+            uint32_t op = (req->opcode == BLOCK_OP_WRITE) ? OP_WRITE : OP_READ;
+            if ((req->status != NO_ERROR) || (req->actual != req->length)) {
+                printf("blktest: %s at %" PRIu64 " failed: %d, %u of %u bytes\n",
+                       op_names[op], req->dev_offset, req->status, req->actual, req->length);
+                status = (req->status != NO_ERROR) ? req->status : ERR_IO;
+                goto out;
+            }
+            stats_add(&t->stats[op], req->length, now - sent[slot]);
+        }
+    }
+out:
+    free(sent);
+unmap:
+    mx_process_unmap_vm(mx_process_self(), addr, size);
+done:
+    mx_handle_close(info.fifo);
+    mx_handle_close(info.vmo);
+    return status;
+}
+
+static int bench_thread(void* arg) {
+    bench_thread_t* t = arg;
+    t->status = t->cfg->fifo ? bench_fifo(t) : bench_fd(t);
+    return 0;
+}
+
+static int bench_usage(void) {
+    printf("Usage: blktest bench <dev> [-b <bytes>] [-q <depth>] [-j <threads>]\n"
+           "                           [-r <random %%>] [-w <write %%>] [-t <seconds>]\n"
+           "                           [-o <offset>] [-s <bytes>] [-f]\n"
+           "  -b  request size, a multiple of the block size (default 4096)\n"
+           "  -q  requests in flight per thread, with -f (default 1)\n"
+           "  -j  threads (default 1)\n"
+           "  -r  percentage of requests at random offsets (default 0)\n"
+           "  -w  percentage of requests that write (default 0)\n"
+           "  -t  how long to run (default 10)\n"
+           "  -o  -s  the part of the device to use (default all of it)\n"
+           "  -f  use the queued block protocol rather than read() and write()\n");
+    return -1;
+}
+
+int do_bench(int argc, const char** argv) {
+    if (argc < 1) {
+        return bench_usage();
+    }
+    bench_config_t cfg = {
+        .dev = argv[0],
+        .bs = 4096,
+        .depth = 1,
+        .threads = 1,
+        .duration = MX_SEC(10),
+    };
+    uint64_t range = 0;
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (!strcmp(opt, "-f")) {
+            cfg.fifo = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return bench_usage();
+        }
+        uint64_t val = arg_to_u64(argv[++i]);
+        if (!strcmp(opt, "-b")) {
+            cfg.bs = val;
+        } else if (!strcmp(opt, "-q")) {
+            cfg.depth = val;
+        } else if (!strcmp(opt, "-j")) {
+            cfg.threads = val;
+        } else if (!strcmp(opt, "-r")) {
+            cfg.random_pct = val;
+        } else if (!strcmp(opt, "-w")) {
+            cfg.write_pct = val;
+        } else if (!strcmp(opt, "-t")) {
+            cfg.duration = MX_SEC(val);
+        } else if (!strcmp(opt, "-o")) {
+            cfg.offset = val;
+        } else if (!strcmp(opt, "-s")) {
+            range = val;
+        } else {
+            return bench_usage();
+        }
+    }
+    if ((cfg.depth == 0) || (cfg.depth > BENCH_MAX_DEPTH) || (cfg.threads == 0) ||
+        (cfg.threads > BENCH_MAX_THREADS) || (cfg.random_pct > 100) || (cfg.write_pct > 100) ||
+        (cfg.duration == 0)) {
+        return bench_usage();
+    }
+    if (!cfg.fifo && (cfg.depth > 1)) {
+        printf("blktest: read() and write() take one request at a time, ignoring -q\n");
+        cfg.depth = 1;
+    }
+
+    int fd = open(cfg.dev, O_RDONLY);
+    if (fd < 0) {
+        printf("blktest: cannot open %s\n", cfg.dev);
+        return fd;
+    }
+    uint64_t size;
+    ssize_t rc;
+    if ((rc = ioctl_block_get_size(fd, &size)) != sizeof(size) ||
+        (rc = ioctl_block_get_blocksize(fd, &cfg.blksize)) != sizeof(cfg.blksize)) {
+        printf("blktest: error getting sizes for %s\n", cfg.dev);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if ((cfg.blksize == 0) || (cfg.bs == 0) || (cfg.bs % cfg.blksize) ||
+        (cfg.offset % cfg.blksize) || (cfg.offset >= size)) {
+        printf("blktest: sizes and offsets must be multiples of the block size, %" PRIu64 "\n",
+               cfg.blksize);
+        return -1;
+    }
+    if (cfg.fifo && (cfg.bs > UINT32_MAX || cfg.bs * cfg.depth > BLOCK_FIFO_MAX_DATA)) {
+        printf("blktest: at most %u bytes can be in flight through the fifo\n",
+               BLOCK_FIFO_MAX_DATA);
+        return -1;
+    }
+    cfg.range = size - cfg.offset;
+    if (range != 0) {
+        cfg.range = MIN(cfg.range, range);
+    }
+    cfg.range -= cfg.range % cfg.bs;
+    if (cfg.range == 0) {
+        printf("blktest: no room for a %" PRIu64 " byte request\n", cfg.bs);
+        return -1;
+    }
+
+    printf("%s: %" PRIu64 " byte requests, %u%% random, %u%% writes, over %" PRIu64
+           " bytes at %" PRIu64 "\n", cfg.dev, cfg.bs, cfg.random_pct, cfg.write_pct,
+           cfg.range, cfg.offset);
+    printf("%u thread%s, %u in flight each, through %s, for %" PRIu64 "s\n",
+           cfg.threads, (cfg.threads == 1) ? "" : "s", cfg.depth,
+           cfg.fifo ? "the fifo" : "read() and write()", cfg.duration / MX_SEC(1));
+
+    bench_thread_t* threads = calloc(cfg.threads, sizeof(bench_thread_t));
+    if (!threads) {
+        printf("blktest: out of memory\n");
+        return -1;
+    }
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint32_t started = 0;
+    for (; started < cfg.threads; started++) {
+        bench_thread_t* t = &threads[started];
+        t->cfg = &cfg;
+        t->index = started;
+        t->rng = (start ^ ((uint64_t)started << 32)) | 1;
+        uint64_t slots = cfg.range / cfg.bs;
+        t->next = cfg.offset + (slots * started / cfg.threads) * cfg.bs;
+        if (thrd_create_with_name(&t->thread, bench_thread, t, "blktest-bench") != thrd_success) {
+            printf("blktest: cannot start thread %u\n", started);
+            break;
+        }
+    }
+
+    bench_stats_t* total = calloc(OP_COUNT + 1, sizeof(bench_stats_t));
+    if (!total) {
+        printf("blktest: out of memory\n");
+    }
+    int ret = 0;
+    for (uint32_t i = 0; i < started; i++) {
+        thrd_join(threads[i].thread, NULL);
+        if (threads[i].status != NO_ERROR) {
+            printf("blktest: thread %u failed: %d\n", i, threads[i].status);
+            ret = -1;
+        }
+        for (uint32_t op = 0; total && (op < OP_COUNT); op++) {
+            stats_merge(&total[op], &threads[i].stats[op]);
+            stats_merge(&total[OP_COUNT], &threads[i].stats[op]);
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    if (total) {
+        for (uint32_t op = 0; op < OP_COUNT; op++) {
+            stats_print(op_names[op], &total[op], elapsed);
+        }
+        if ((total[OP_READ].ios > 0) && (total[OP_WRITE].ios > 0)) {
+            stats_print("total", &total[OP_COUNT], elapsed);
+        }
+        free(total);
+    }
+    free(threads);
+    return ret;
+}
@@ -0,0 +1,12 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+uint64_t arg_to_u64(const char* arg);
+
+// blktest bench <dev> [options], with argv starting at <dev>
+int do_bench(int argc, const char** argv);
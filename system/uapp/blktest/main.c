@@ -11,11 +11,14 @@
 #include <limits.h>
 #include <sys/param.h>
 
+#include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <magenta/device/block.h>
 
 #include <mxio/io.h>
 
+#include "blktest.h"
+
 static int do_test(const char* dev, mx_off_t offset, mx_off_t count, uint8_t pattern) {
     int fd = open(dev, O_RDWR);
     if (fd < 0) {
@@ -106,7 +109,159 @@ fail:
     return rc;
 }
 
-static uint64_t arg_to_u64(const char* arg) {
+#define FIFO_SLOTS 16
+#define FIFO_CHUNK (64 * 1024)
+
+typedef struct fifo_session {
+    mx_handle_t fifo;
+    mx_handle_t vmo;
+    uintptr_t addr;
+    size_t size;
+    block_fifo_request_t* ring;
+    uint8_t* data;
+    uint64_t head;
+    uint64_t tail;
+} fifo_session_t;
+
+// Moves [offset, offset + count) in chunks, keeping the whole ring in
+// flight, and checks that reads come back as the pattern.
+static ssize_t fifo_run(fifo_session_t* fs, uint32_t opcode, mx_off_t offset, mx_off_t count,
+                        uint8_t pattern) {
+    mx_off_t end = offset + count;
+    uint64_t first = fs->head;
+    uint64_t total = (count + FIFO_CHUNK - 1) / FIFO_CHUNK;
+    while (fs->tail < first + total) {
+        uint64_t n = 0;
+        while ((fs->head < fs->tail + FIFO_SLOTS) && (offset < end)) {
+            uint32_t slot = fs->head % FIFO_SLOTS;
+            block_fifo_request_t* req = &fs->ring[slot];
+            req->opcode = opcode;
+            req->status = 0;
+            req->length = MIN(FIFO_CHUNK, end - offset);
+            req->actual = 0;
+            req->dev_offset = offset;
+            req->data_offset = slot * FIFO_CHUNK;
+            if (opcode == BLOCK_OP_WRITE) {
+                memset(fs->data + req->data_offset, pattern, req->length);
+            }
+            offset += req->length;
+            fs->head++;
+            n++;
+        }
+        mx_status_t status;
+        if (n > 0) {
+            if ((status = mx_fifo_op(fs->fifo, MX_FIFO_OP_ADVANCE_HEAD, n, NULL)) < 0) {
+                return status;
+            }
+            mx_object_signal_peer(fs->fifo, 0, BLOCK_FIFO_SIGNAL);
+        }
+
+        if ((status = mx_handle_wait_one(fs->fifo, BLOCK_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED,
+                                         MX_TIME_INFINITE, NULL)) < 0) {
+            return status;
+        }
+        mx_object_signal(fs->fifo, BLOCK_FIFO_SIGNAL, 0);
+        mx_fifo_state_t state;
+        if ((status = mx_fifo_op(fs->fifo, MX_FIFO_OP_READ_STATE, 0, &state)) < 0) {
+            return status;
+        }
+        if (state.tail == fs->tail) {
+            continue;
+        }
+        for (; fs->tail < state.tail; fs->tail++) {
+            block_fifo_request_t* req = &fs->ring[fs->tail % FIFO_SLOTS];
+            if (req->status != NO_ERROR) {
+                printf("request at %" PRIu64 " failed: %d\n", req->dev_offset, req->status);
+                return req->status;
+            }
+            if (req->actual != req->length) {
+                printf("request at %" PRIu64 " moved %u of %u bytes\n",
+                       req->dev_offset, req->actual, req->length);
+                return ERR_IO;
+            }
+            if (opcode == BLOCK_OP_READ) {
+                uint8_t* data = fs->data + req->data_offset;
+                for (uint32_t i = 0; i < req->length; i++) {
+                    if (data[i] != pattern) {
+                        printf("mismatch at %" PRIu64 "\n", req->dev_offset + i);
+                        return ERR_IO;
+                    }
+                }
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
+// The same test over the queued protocol.
+static int do_fifo_test(const char* dev, mx_off_t offset, mx_off_t count, uint8_t pattern) {
+    int fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        printf("Cannot open %s!\n", dev);
+        return fd;
+    }
+
+    ssize_t rc;
+    uint64_t size, blksize;
+    if ((rc = ioctl_block_get_size(fd, &size)) != sizeof(size) ||
+        (rc = ioctl_block_get_blocksize(fd, &blksize)) != sizeof(blksize)) {
+        printf("Error getting sizes for %s\n", dev);
+        close(fd);
+        return -1;
+    }
+    if (count == UINT64_MAX) {
+        count = size;
+    }
+    count = MIN(count, size - offset);
+    count -= count % blksize;
+
+    block_fifo_config_t config = {
+        .count = FIFO_SLOTS,
+        .data_size = FIFO_SLOTS * FIFO_CHUNK,
+    };
+    block_fifo_info_t info;
+    rc = ioctl_block_fifo_create(fd, &config, &info);
+    close(fd);
+    if (rc < 0) {
+        printf("%s has no fifo: %zd\n", dev, rc);
+        return rc;
+    }
+
+    fifo_session_t fs = {
+        .fifo = info.fifo,
+        .vmo = info.vmo,
+        .size = info.data_offset + config.data_size,
+    };
+    if ((rc = mx_process_map_vm(mx_process_self(), fs.vmo, 0, fs.size, &fs.addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE)) < 0) {
+        printf("Cannot map the fifo buffer: %zd\n", rc);
+        goto done;
+    }
+    fs.ring = (block_fifo_request_t*)fs.addr;
+    fs.data = (uint8_t*)fs.addr + info.data_offset;
+
+    printf("Writing 0x%02x from offset %" PRIu64 " to %" PRIu64 " (%" PRIu64 " bytes) through the fifo...",
+           pattern, offset, offset + count, count);
+    if ((rc = fifo_run(&fs, BLOCK_OP_WRITE, offset, count, pattern)) < 0) {
+        printf("Fail\n");
+        goto unmap;
+    }
+    printf("OK\n");
+    printf("Reading back...");
+    if ((rc = fifo_run(&fs, BLOCK_OP_READ, offset, count, pattern)) < 0) {
+        printf("Fail\n");
+    } else {
+        printf("OK\n");
+    }
+unmap:
+    mx_process_unmap_vm(mx_process_self(), fs.addr, fs.size);
+done:
+    mx_handle_close(fs.fifo);
+    mx_handle_close(fs.vmo);
+    return rc;
+}
+
+uint64_t arg_to_u64(const char* arg) {
     int base = 10;
     if ((arg[0] == '0') && ((arg[1] == 'x') || arg[1] == 'X')) {
         base = 16;
@@ -120,6 +275,9 @@ int main(int argc, const char** argv) {
         printf("not enough arguments!\n");
         goto usage;
     }
+    if (!strcmp(argv[1], "bench")) {
+        return do_bench(argc - 2, argv + 2);
+    }
     const char* dev = argv[1];
     mx_off_t offset = argc >= 3 ? arg_to_u64(argv[2]) : 0;
     mx_off_t count = argc >= 4 ? arg_to_u64(argv[3]) : UINT64_MAX;
@@ -129,9 +287,13 @@ int main(int argc, const char** argv) {
     do_test(dev, offset, count, 0xff);
     do_test(dev, offset, count, 0x00);
 
+    do_fifo_test(dev, offset, count, 0x5a);
+    do_fifo_test(dev, offset, count, 0xa5);
+
     return 0;
 usage:
     printf("Usage:\n");
     printf("%s <dev> [<offset>] [<count>]\n", argv[0]);
+    printf("%s bench <dev> [<options>]\n", argv[0]);
     return 0;
 }
@@ -9,6 +9,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userapp
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/bench.c \
     $(LOCAL_DIR)/main.c
 
 MODULE_LIBS := ulib/magenta ulib/mxio ulib/musl
@@ -9,9 +9,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <magenta/compiler.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/threads.h>
 #include <mxtl/unique_ptr.h>
 
 namespace {
@@ -21,12 +25,33 @@ void argument_error(const char* argv0, const char* message) {
     exit(EXIT_FAILURE);
 }
 
-void duplicate_handles(uint32_t n, mx_handle_t src, mx_handle_t* dest) {
-    for (uint32_t i = 0; i < n; i++) {
-        assert(mx_handle_duplicate(src, MX_RIGHT_SAME_RIGHTS, &dest[i]) == 0);
+bool json_output = false;  // -j
+
+struct Metric {
+    const char* name;
+    double value;
+};
+
+// Prints one test's results, as "name: metric value, ..." or, with -j, as a
+// line of JSON for regression tracking to pick up.
+void report(const char* test, const Metric* metrics, size_t count) {
+    if (json_output) {
+        printf("{\"test\":\"%s\"", test);
+        for (size_t i = 0; i < count; i++)
+            printf(",\"%s\":%.0f", metrics[i].name, metrics[i].value);
+        printf("}\n");
+    } else {
+        printf("%s:", test);
+        for (size_t i = 0; i < count; i++)
+            printf("%s %s %.0f", i ? "," : "", metrics[i].name, metrics[i].value);
+        printf("\n");
     }
 }
 
+void duplicate_handles(uint32_t n, mx_handle_t src, mx_handle_t* dest) {
+    assert(mx_handle_duplicate_many(src, MX_RIGHT_SAME_RIGHTS, dest, n) == 0);
+}
+
 struct TestArgs {
     uint32_t size;
     uint32_t handles;
@@ -106,9 +131,573 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
 
     double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
-               "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+    char name[128];
+    snprintf(name, sizeof(name), "channel_write_read/size=%" PRIu32 "/handles=%" PRIu32
+             "/queue=%" PRIu32, test_args.size, test_args.handles, test_args.queue);
+    Metric metrics[] = {{"iterations_per_second", its_per_second}};
+    report(name, metrics, countof(metrics));
+}
+
+enum class WaitMethod {
+    WAIT_MANY,
+    WAITSET,
+    PORT,
+};
+
+const char* wait_method_name(WaitMethod method) {
+    switch (method) {
+        case WaitMethod::WAIT_MANY:
+            return "handle_wait_many";
+        case WaitMethod::WAITSET:
+            return "waitset_wait";
+        case WaitMethod::PORT:
+            return "port_wait";
+    }
+    return "?";
+}
+
+// Measures how long it takes to find out that one of |num_handles| events is signaled, the way an
+// event loop would: signal the last event, wait on all of them, then clear it again. The waitset
+// and the port are set up once, outside the timed loop.
+void do_wait_test(uint32_t duration, uint32_t num_handles, WaitMethod method) {
+    __UNUSED mx_status_t status;
+
+    uint64_t duration_ns = duration * 1000000000ull;
+
+    mxtl::unique_ptr<mx_wait_item_t[]> items(new mx_wait_item_t[num_handles]);
+    for (uint32_t i = 0; i < num_handles; i++) {
+        status = mx_event_create(0u, &items[i].handle);
+        assert(status == NO_ERROR);
+        items[i].waitfor = MX_EVENT_SIGNALED;
+        items[i].pending = 0u;
+    }
+    mx_handle_t signaled = items[num_handles - 1].handle;
+
+    mx_handle_t waiter = MX_HANDLE_INVALID;
+    if (method == WaitMethod::WAITSET) {
+        status = mx_waitset_create(0u, &waiter);
+        assert(status == NO_ERROR);
+        for (uint32_t i = 0; i < num_handles; i++) {
+            status = mx_waitset_add(waiter, i, items[i].handle, MX_EVENT_SIGNALED);
+            assert(status == NO_ERROR);
+        }
+    } else if (method == WaitMethod::PORT) {
+        status = mx_port_create(0u, &waiter);
+        assert(status == NO_ERROR);
+        for (uint32_t i = 0; i < num_handles; i++) {
+            status = mx_object_wait_async(items[i].handle, waiter, i, MX_EVENT_SIGNALED,
+                                          MX_WAIT_ASYNC_REPEATING);
+            assert(status == NO_ERROR);
+        }
+    }
+
+    static constexpr uint32_t big_it_size = 1000;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            status = mx_object_signal(signaled, 0u, MX_EVENT_SIGNALED);
+            assert(status == NO_ERROR);
+
+            switch (method) {
+                case WaitMethod::WAIT_MANY:
+                    status = mx_handle_wait_many(items.get(), num_handles, MX_TIME_INFINITE);
+                    assert(status == NO_ERROR);
+                    assert(items[num_handles - 1].pending & MX_EVENT_SIGNALED);
+                    break;
+                case WaitMethod::WAITSET: {
+                    mx_waitset_result_t result;
+                    uint32_t num_results = 1u;
+                    status = mx_waitset_wait(waiter, MX_TIME_INFINITE, &result, &num_results);
+                    assert(status == NO_ERROR);
+                    assert(num_results == 1u && result.cookie == num_handles - 1);
+                    break;
+                }
+                case WaitMethod::PORT: {
+                    mx_io_packet_t packet;
+                    status = mx_port_wait(waiter, MX_TIME_INFINITE, &packet, sizeof(packet));
+                    assert(status == NO_ERROR);
+                    assert(packet.hdr.key == num_handles - 1);
+                    break;
+                }
+            }
+
+            status = mx_object_signal(signaled, MX_EVENT_SIGNALED, 0u);
+            assert(status == NO_ERROR);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    if (waiter != MX_HANDLE_INVALID) {
+        status = mx_handle_close(waiter);
+        assert(status == NO_ERROR);
+    }
+    for (uint32_t i = 0; i < num_handles; i++) {
+        status = mx_handle_close(items[i].handle);
+        assert(status == NO_ERROR);
+    }
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    double ns_per_wait = real_duration * 1000000000.0 / (static_cast<double>(big_its) * big_it_size);
+    char name[128];
+    snprintf(name, sizeof(name), "%s/handles=%" PRIu32, wait_method_name(method), num_handles);
+    Metric metrics[] = {{"ns_per_wait", ns_per_wait}};
+    report(name, metrics, countof(metrics));
+}
+
+void do_wait_suite(uint32_t duration) {
+    static constexpr uint32_t handle_counts[] = {1, 10, 100, 1000};
+    static constexpr WaitMethod methods[] = {
+        WaitMethod::WAIT_MANY,
+        WaitMethod::WAITSET,
+        WaitMethod::PORT,
+    };
+    for (size_t i = 0; i < countof(methods); i++) {
+        for (size_t j = 0; j < countof(handle_counts); j++)
+            do_wait_test(duration, handle_counts[j], methods[i]);
+    }
+}
+
+// Where the threads of a multi-threaded test run.
+enum class Affinity {
+    NONE,       // wherever the scheduler puts them
+    SAME_CPU,   // all on cpu 0
+    CROSS_CPU,  // spread over the cpus, round robin
+};
+
+constexpr Affinity kAffinities[] = {Affinity::NONE, Affinity::SAME_CPU, Affinity::CROSS_CPU};
+
+const char* affinity_name(Affinity affinity) {
+    switch (affinity) {
+        case Affinity::NONE:
+            return "none";
+        case Affinity::SAME_CPU:
+            return "same_cpu";
+        case Affinity::CROSS_CPU:
+            return "cross_cpu";
+    }
+    return "?";
+}
+
+// The cpu the |index|th thread of a test should be pinned to, or -1.
+int32_t affinity_cpu(Affinity affinity, uint32_t index) {
+    switch (affinity) {
+        case Affinity::NONE:
+            return -1;
+        case Affinity::SAME_CPU:
+            return 0;
+        case Affinity::CROSS_CPU:
+            return static_cast<int32_t>(index % mx_num_cpus());
+    }
+    return -1;
+}
+
+void pin_current_thread(int32_t cpu) {
+    __UNUSED mx_status_t status;
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+    status = mx_object_set_property(self, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu));
+    assert(status == NO_ERROR);
+}
+
+// One way for two threads to pass a message back and forth. Side 0 is the
+// thread doing the timing, side 1 the one answering it.
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual const char* name() const = 0;
+    // Sends a message to the other side.
+    virtual void Send(int side) = 0;
+    // Blocks until a message from the other side arrives, and consumes it.
+    virtual void Receive(int side) = 0;
+};
+
+class ChannelTransport final : public Transport {
+public:
+    explicit ChannelTransport(uint32_t size) : size_(size), data_(new uint8_t[size + 1]) {
+        __UNUSED mx_status_t status = mx_channel_create(0u, &h_[0], &h_[1]);
+        assert(status == NO_ERROR);
+    }
+    ~ChannelTransport() final {
+        mx_handle_close(h_[0]);
+        mx_handle_close(h_[1]);
+    }
+    const char* name() const final { return "channel"; }
+    void Send(int side) final {
+        __UNUSED mx_status_t status = mx_channel_write(h_[side], 0u, data_.get(), size_,
+                                                       nullptr, 0u);
+        assert(status == NO_ERROR);
+    }
+    void Receive(int side) final {
+        __UNUSED mx_status_t status;
+        status = mx_handle_wait_one(h_[side], MX_CHANNEL_READABLE, MX_TIME_INFINITE, nullptr);
+        assert(status == NO_ERROR);
+        uint32_t r_size = 0u, r_handles = 0u;
+        status = mx_channel_read(h_[side], 0u, data_.get(), size_, &r_size, nullptr, 0u,
+                                 &r_handles);
+        assert(status == NO_ERROR && r_size == size_);
+    }
+
+private:
+    const uint32_t size_;
+    mxtl::unique_ptr<uint8_t[]> data_;
+    mx_handle_t h_[2];
+};
+
+class SocketTransport final : public Transport {
+public:
+    explicit SocketTransport(uint32_t size) : size_(size), data_(new uint8_t[size + 1]) {
+        __UNUSED mx_status_t status = mx_socket_create(0u, &h_[0], &h_[1]);
+        assert(status == NO_ERROR);
+    }
+    ~SocketTransport() final {
+        mx_handle_close(h_[0]);
+        mx_handle_close(h_[1]);
+    }
+    const char* name() const final { return "socket"; }
+    void Send(int side) final {
+        __UNUSED mx_status_t status;
+        size_t actual = 0u;
+        status = mx_socket_write(h_[side], 0u, data_.get(), size_, &actual);
+        assert(status == NO_ERROR && actual == size_);
+    }
+    void Receive(int side) final {
+        // a stream, the message may arrive in pieces
+        for (size_t got = 0u; got < size_;) {
+            __UNUSED mx_status_t status;
+            status = mx_handle_wait_one(h_[side], MX_SOCKET_READABLE, MX_TIME_INFINITE, nullptr);
+            assert(status == NO_ERROR);
+            size_t actual = 0u;
+            status = mx_socket_read(h_[side], 0u, data_.get() + got, size_ - got, &actual);
+            assert(status == NO_ERROR);
+            got += actual;
+        }
+    }
+
+private:
+    const uint32_t size_;
+    mxtl::unique_ptr<uint8_t[]> data_;
+    mx_handle_t h_[2];
+};
+
+class EventPairTransport final : public Transport {
+public:
+    EventPairTransport() {
+        __UNUSED mx_status_t status = mx_eventpair_create(0u, &h_[0], &h_[1]);
+        assert(status == NO_ERROR);
+    }
+    ~EventPairTransport() final {
+        mx_handle_close(h_[0]);
+        mx_handle_close(h_[1]);
+    }
+    const char* name() const final { return "eventpair"; }
+    void Send(int side) final {
+        __UNUSED mx_status_t status = mx_object_signal_peer(h_[side], 0u, MX_USER_SIGNAL_0);
+        assert(status == NO_ERROR);
+    }
+    void Receive(int side) final {
+        __UNUSED mx_status_t status;
+        status = mx_handle_wait_one(h_[side], MX_USER_SIGNAL_0, MX_TIME_INFINITE, nullptr);
+        assert(status == NO_ERROR);
+        // the other side won't signal again until we answer
+        status = mx_object_signal(h_[side], MX_USER_SIGNAL_0, 0u);
+        assert(status == NO_ERROR);
+    }
+
+private:
+    mx_handle_t h_[2];
+};
+
+class PortTransport final : public Transport {
+public:
+    PortTransport() {
+        for (int i = 0; i < 2; i++) {
+            __UNUSED mx_status_t status = mx_port_create(0u, &port_[i]);
+            assert(status == NO_ERROR);
+        }
+    }
+    ~PortTransport() final {
+        mx_handle_close(port_[0]);
+        mx_handle_close(port_[1]);
+    }
+    const char* name() const final { return "port"; }
+    void Send(int side) final {
+        Packet packet = {{static_cast<uint64_t>(side), 0u, 0u}, 0u};
+        __UNUSED mx_status_t status = mx_port_queue(port_[1 - side], &packet, sizeof(packet));
+        assert(status == NO_ERROR);
+    }
+    void Receive(int side) final {
+        Packet packet;
+        __UNUSED mx_status_t status = mx_port_wait(port_[side], MX_TIME_INFINITE, &packet,
+                                                   sizeof(packet));
+        assert(status == NO_ERROR && packet.hdr.key == static_cast<uint64_t>(1 - side));
+    }
+
+private:
+    struct Packet {
+        mx_packet_header_t hdr;
+        uint64_t payload;
+    };
+    mx_handle_t port_[2];
+};
+
+class WaitSetTransport final : public Transport {
+public:
+    WaitSetTransport() {
+        for (int i = 0; i < 2; i++) {
+            __UNUSED mx_status_t status;
+            status = mx_event_create(0u, &event_[i]);
+            assert(status == NO_ERROR);
+            status = mx_waitset_create(0u, &waitset_[i]);
+            assert(status == NO_ERROR);
+            status = mx_waitset_add(waitset_[i], i, event_[i], MX_EVENT_SIGNALED);
+            assert(status == NO_ERROR);
+        }
+    }
+    ~WaitSetTransport() final {
+        for (int i = 0; i < 2; i++) {
+            mx_handle_close(waitset_[i]);
+            mx_handle_close(event_[i]);
+        }
+    }
+    const char* name() const final { return "waitset"; }
+    void Send(int side) final {
+        __UNUSED mx_status_t status = mx_object_signal(event_[1 - side], 0u, MX_EVENT_SIGNALED);
+        assert(status == NO_ERROR);
+    }
+    void Receive(int side) final {
+        __UNUSED mx_status_t status;
+        mx_waitset_result_t result;
+        uint32_t num_results = 1u;
+        status = mx_waitset_wait(waitset_[side], MX_TIME_INFINITE, &result, &num_results);
+        assert(status == NO_ERROR && num_results == 1u);
+        status = mx_object_signal(event_[side], MX_EVENT_SIGNALED, 0u);
+        assert(status == NO_ERROR);
+    }
+
+private:
+    mx_handle_t event_[2];
+    mx_handle_t waitset_[2];
+};
+
+struct PingPong {
+    Transport* transport;
+    int32_t cpu;
+    bool done;
+};
+
+int pong_thread(void* arg) {
+    PingPong* pp = static_cast<PingPong*>(arg);
+    if (pp->cpu >= 0)
+        pin_current_thread(pp->cpu);
+    for (;;) {
+        pp->transport->Receive(1);
+        if (__atomic_load_n(&pp->done, __ATOMIC_ACQUIRE))
+            break;
+        pp->transport->Send(1);
+    }
+    return 0;
+}
+
+int compare_u64(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x > y) - (x < y);
+}
+
+// Measures round trips between two threads: one sends a message and waits
+// for the answer the other sends as soon as the message arrives, recording
+// how long each round trip took.
+void do_latency_test(uint32_t duration, Transport* transport, Affinity affinity) {
+    if (affinity == Affinity::CROSS_CPU && mx_num_cpus() < 2u)
+        return;
+
+    static constexpr size_t kMaxSamples = 1u << 19;
+    uint64_t duration_ns = duration * 1000000000ull;
+    mxtl::unique_ptr<uint64_t[]> samples(new uint64_t[kMaxSamples]);
+
+    PingPong pp = {transport, affinity_cpu(affinity, 1u), false};
+    thrd_t thread;
+    __UNUSED int ret = thrd_create(&thread, pong_thread, &pp);
+    assert(ret == thrd_success);
+    int32_t cpu = affinity_cpu(affinity, 0u);
+    if (cpu >= 0)
+        pin_current_thread(cpu);
+
+    size_t num_samples = 0u;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    while (num_samples < kMaxSamples) {
+        uint64_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
+        transport->Send(0);
+        transport->Receive(0);
+        uint64_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
+        samples[num_samples++] = t1 - t0;
+        if (t1 - start_ns >= duration_ns)
+            break;
+    }
+
+    __atomic_store_n(&pp.done, true, __ATOMIC_RELEASE);
+    transport->Send(0);
+    thrd_join(thread, nullptr);
+    if (cpu >= 0)
+        pin_current_thread(-1);
+
+    qsort(samples.get(), num_samples, sizeof(samples[0]), compare_u64);
+    uint64_t total = 0u;
+    for (size_t i = 0; i < num_samples; i++)
+        total += samples[i];
+
+    char name[128];
+    snprintf(name, sizeof(name), "pingpong/%s/affinity=%s", transport->name(),
+             affinity_name(affinity));
+    Metric metrics[] = {
+        {"round_trips", static_cast<double>(num_samples)},
+        {"mean_ns", static_cast<double>(total) / static_cast<double>(num_samples)},
+        {"p50_ns", static_cast<double>(samples[num_samples * 50 / 100])},
+        {"p99_ns", static_cast<double>(samples[num_samples * 99 / 100])},
+        {"p999_ns", static_cast<double>(samples[num_samples * 999 / 1000])},
+        {"max_ns", static_cast<double>(samples[num_samples - 1])},
+    };
+    report(name, metrics, countof(metrics));
+}
+
+void do_latency_suite(uint32_t duration, uint32_t size) {
+    mxtl::unique_ptr<Transport> transports[] = {
+        mxtl::unique_ptr<Transport>(new ChannelTransport(size)),
+        mxtl::unique_ptr<Transport>(new SocketTransport(size)),
+        mxtl::unique_ptr<Transport>(new EventPairTransport()),
+        mxtl::unique_ptr<Transport>(new PortTransport()),
+        mxtl::unique_ptr<Transport>(new WaitSetTransport()),
+    };
+    for (size_t i = 0; i < countof(transports); i++) {
+        for (size_t j = 0; j < countof(kAffinities); j++)
+            do_latency_test(duration, transports[i].get(), kAffinities[j]);
+    }
+}
+
+// Shared by the threads of a producer/consumer test on one channel.
+struct ProducerConsumer {
+    mx_handle_t write;
+    mx_handle_t read;
+    uint32_t size;
+    uint64_t deadline_ns;
+    // messages written but not yet read, which producers keep under
+    // kMaxInFlight so the channel doesn't grow without bound
+    uint32_t in_flight;
+    uint64_t received;
+};
+
+struct WorkerArgs {
+    ProducerConsumer* pc;
+    int32_t cpu;
+};
+
+constexpr uint32_t kMaxInFlight = 1024u;
+
+int producer_thread(void* arg) {
+    WorkerArgs* args = static_cast<WorkerArgs*>(arg);
+    ProducerConsumer* pc = args->pc;
+    if (args->cpu >= 0)
+        pin_current_thread(args->cpu);
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[pc->size]());
+    while (mx_time_get(MX_CLOCK_MONOTONIC) < pc->deadline_ns) {
+        if (__atomic_fetch_add(&pc->in_flight, 1u, __ATOMIC_RELAXED) >= kMaxInFlight) {
+            __atomic_fetch_sub(&pc->in_flight, 1u, __ATOMIC_RELAXED);
+            thrd_yield();
+            continue;
+        }
+        __UNUSED mx_status_t status = mx_channel_write(pc->write, 0u, data.get(), pc->size,
+                                                       nullptr, 0u);
+        assert(status == NO_ERROR);
+    }
+    return 0;
+}
+
+int consumer_thread(void* arg) {
+    WorkerArgs* args = static_cast<WorkerArgs*>(arg);
+    ProducerConsumer* pc = args->pc;
+    if (args->cpu >= 0)
+        pin_current_thread(args->cpu);
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[pc->size]);
+    uint64_t received = 0u;
+    for (;;) {
+        uint32_t r_size = 0u, r_handles = 0u;
+        mx_status_t status = mx_channel_read(pc->read, 0u, data.get(), pc->size, &r_size,
+                                             nullptr, 0u, &r_handles);
+        if (status == ERR_SHOULD_WAIT) {
+            // another consumer may have beaten us to it
+            status = mx_handle_wait_one(pc->read, MX_CHANNEL_READABLE, MX_TIME_INFINITE, nullptr);
+            assert(status == NO_ERROR);
+            continue;
+        }
+        assert(status == NO_ERROR);
+        // a message with its first byte set says the producers are done
+        if (data[0])
+            break;
+        __atomic_fetch_sub(&pc->in_flight, 1u, __ATOMIC_RELAXED);
+        received++;
+    }
+    __atomic_fetch_add(&pc->received, received, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Measures the message rate through one channel written by |producers|
+// threads and read by |consumers| threads.
+void do_producer_consumer_test(uint32_t duration, uint32_t size, uint32_t producers,
+                               uint32_t consumers, Affinity affinity) {
+    if (affinity == Affinity::CROSS_CPU && mx_num_cpus() < 2u)
+        return;
+
+    __UNUSED mx_status_t status;
+    ProducerConsumer pc = {};
+    status = mx_channel_create(0u, &pc.write, &pc.read);
+    assert(status == NO_ERROR);
+    pc.size = size;
+
+    uint32_t num_threads = producers + consumers;
+    mxtl::unique_ptr<thrd_t[]> threads(new thrd_t[num_threads]);
+    mxtl::unique_ptr<WorkerArgs[]> args(new WorkerArgs[num_threads]);
+
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    pc.deadline_ns = start_ns + duration * 1000000000ull;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        args[i] = {&pc, affinity_cpu(affinity, i)};
+        __UNUSED int ret = thrd_create(&threads[i], i < producers ? producer_thread : consumer_thread,
+                                       &args[i]);
+        assert(ret == thrd_success);
+    }
+    for (uint32_t i = 0; i < producers; i++)
+        thrd_join(threads[i], nullptr);
+
+    // everything written before this is read before the consumers stop
+    mxtl::unique_ptr<uint8_t[]> stop(new uint8_t[size]());
+    stop[0] = 1u;
+    for (uint32_t i = 0; i < consumers; i++) {
+        status = mx_channel_write(pc.write, 0u, stop.get(), size, nullptr, 0u);
+        assert(status == NO_ERROR);
+    }
+    for (uint32_t i = producers; i < num_threads; i++)
+        thrd_join(threads[i], nullptr);
+    uint64_t end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    mx_handle_close(pc.write);
+    mx_handle_close(pc.read);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    char name[128];
+    snprintf(name, sizeof(name), "producer_consumer/channel/size=%" PRIu32
+             "/producers=%" PRIu32 "/consumers=%" PRIu32 "/affinity=%s",
+             size, producers, consumers, affinity_name(affinity));
+    Metric metrics[] = {
+        {"messages_per_second", static_cast<double>(pc.received) / real_duration},
+    };
+    report(name, metrics, countof(metrics));
 }
 
 }  // namespace
@@ -121,13 +710,25 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -w    run wait suite: cost per wait vs. handle count (ignores -S/-H/-Q)\n"
+        "  -l    run latency suite: round trips between two threads over each\n"
+        "        transport, unpinned, on one cpu and across cpus (uses -S)\n"
+        "  -m    run producer/consumer test on one channel (uses -S/-P/-C)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -P N  set producer thread count to N (default: 1)\n"
+        "  -C N  set consumer thread count to N (default: 1)\n"
+        "  -j    print results as JSON, one object per line\n";
 
-    bool run_suite = false;  // -o/-s
+    bool run_suite = false;       // -o/-s
+    bool run_wait_suite = false;  // -o/-w
+    bool run_latency_suite = false;  // -o/-l
+    bool run_producer_consumer = false;  // -o/-m
+    uint32_t producers = 1;  // -P
+    uint32_t consumers = 1;  // -C
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
@@ -138,14 +739,14 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hoswlmjn:d:S:H:Q:P:C:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
             errno = 0;
             char* endptr = nullptr;
             unsigned long long v = strtoull(optarg, &endptr, 10);
-            if (errno != 0 || *endptr != '\0' || value > UINT32_MAX)
+            if (errno != 0 || *endptr != '\0' || v > UINT32_MAX)
                 argument_error(argv[0], "invalid numeric optional value");
             value = static_cast<uint32_t>(v);
         }
@@ -156,10 +757,25 @@ int main(int argc, char** argv) {
                 return EXIT_SUCCESS;
             case 'o':
                 run_suite = false;
+                run_wait_suite = false;
+                run_latency_suite = false;
+                run_producer_consumer = false;
                 break;
             case 's':
                 run_suite = true;
                 break;
+            case 'w':
+                run_wait_suite = true;
+                break;
+            case 'l':
+                run_latency_suite = true;
+                break;
+            case 'm':
+                run_producer_consumer = true;
+                break;
+            case 'j':
+                json_output = true;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -180,6 +796,14 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'P':
+                assert(optarg);
+                producers = value;
+                break;
+            case 'C':
+                assert(optarg);
+                consumers = value;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -187,16 +811,28 @@ int main(int argc, char** argv) {
     }
     if (optind < argc)
         argument_error(argv[0], "unexpected positional argument");
+    if (producers == 0u || consumers == 0u)
+        argument_error(argv[0], "need at least one producer and one consumer");
+    if (run_producer_consumer && test_args.size == 0u)
+        argument_error(argv[0], "producer/consumer messages need at least one byte");
 
     for (uint32_t i = 0; i < repeats; i++) {
-        if (repeats > 1u) {
+        if (repeats > 1u && !json_output) {
             if (i > 0u)
                 printf("\n");
             printf("Test iteration #%" PRIu32 " (of %" PRIu32 "):\n", i + 1,
                    repeats);
         }
 
-        if (run_suite) {
+        if (run_latency_suite) {
+            do_latency_suite(duration, test_args.size);
+        } else if (run_producer_consumer) {
+            for (size_t j = 0; j < countof(kAffinities); j++)
+                do_producer_consumer_test(duration, test_args.size, producers, consumers,
+                                          kAffinities[j]);
+        } else if (run_wait_suite) {
+            do_wait_suite(duration);
+        } else if (run_suite) {
             static constexpr TestArgs suite[] = {
                 {10, 0, 0},
                 {100, 0, 0},
@@ -0,0 +1,690 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <inet6/inet6.h>
+#include <magenta/device/ethernet.h>
+#include <magenta/ethbench.h>
+#include <magenta/syscalls.h>
+#include <mxio/io.h>
+
+// The device end of ethbench (see magenta/ethbench.h): answers the host
+// tool's tests over one ethernet device, written as raw frames so that
+// what's measured is the driver and the path to it, not a stack:
+//
+//   magenta> ethbench [-p fd|fifo] [<device>]
+//
+// With -p fd, which is the default, each frame is a read() or write() of
+// the device.  With -p fifo, frames go through the batched sessions of
+// magenta/device/ethernet.h, one receive session for each of the
+// device's receive queues.  Either way ethbench takes the frames it gets
+// from netsvc, so netbooting and the debug log pause while it runs; it
+// answers neighbor solicitations for the device's link local address
+// itself.
+
+#define FRAME_MAX 2048
+#define FRAME_HDR_LEN (ETH_HDR_LEN + IP6_HDR_LEN + UDP_HDR_LEN)
+#define PAYLOAD_MAX (ETH_MTU - FRAME_HDR_LEN)
+
+#define SLOTS 64            // in each session's ring
+#define RX_QUEUES 4
+#define BATCH 16            // entries posted to the device at once
+
+typedef struct {
+    mx_handle_t fifo;
+    mx_handle_t vmo;
+    uintptr_t addr;
+    size_t size;
+    eth_fifo_entry_t* ring;
+    uint8_t* data;
+    uint64_t head;          // posted to the device
+    uint64_t tail;          // taken back from it
+    uint64_t avail;         // the device's tail, when last looked at
+    uint64_t pending;       // ready to post, from head on
+} session_t;
+
+typedef struct bench bench_t;
+
+typedef struct {
+    const char* name;
+    // returns the next frame received, good until the next call, or
+    // NULL if there's none by deadline
+    uint8_t* (*recv)(bench_t* b, size_t* len, mx_time_t deadline);
+    // returns a buffer for a frame to send, or NULL
+    uint8_t* (*get_tx)(bench_t* b);
+    // sends the frame in the buffer get_tx() last returned
+    mx_status_t (*send)(bench_t* b, uint8_t* frame, size_t len);
+    // makes sure the frames sent so far are on their way
+    void (*flush)(bench_t* b);
+} bench_path_t;
+
+struct bench {
+    int fd;
+    const bench_path_t* path;
+    mac_addr_t mac;
+    ip6_addr_t addr;
+
+    // -p fd
+    uint8_t rxbuf[FRAME_MAX];
+    uint8_t txbuf[FRAME_MAX];
+
+    // -p fifo
+    session_t tx;
+    session_t rx[RX_QUEUES];
+    uint32_t rx_queues;
+    uint32_t rx_next;       // queue to look at first
+    eth_fifo_entry_t* rx_last;
+    session_t* rx_last_session;
+    uint64_t tx_errors;
+
+    // the rx test in progress
+    uint32_t rx_id;
+    ethbench_stats_t rx_stats;
+    mx_time_t rx_first;
+    bool rx_reported;
+};
+
+static const ip6_addr_t ll_all_nodes = {
+    .u8 = { 0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 },
+};
+
+static mx_time_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+// read() and write() of the device fd
+
+static uint8_t* fd_recv(bench_t* b, size_t* len, mx_time_t deadline) {
+    for (;;) {
+        ssize_t r = read(b->fd, b->rxbuf, sizeof(b->rxbuf));
+        if (r > 0) {
+            *len = r;
+            return b->rxbuf;
+        }
+        mx_time_t t = now();
+        if (t >= deadline) {
+            return NULL;
+        }
+        mxio_wait_fd(b->fd, MXIO_EVT_READABLE, NULL,
+                     (deadline == MX_TIME_INFINITE) ? MX_TIME_INFINITE : deadline - t);
+    }
+}
+
+static uint8_t* fd_get_tx(bench_t* b) {
+    return b->txbuf;
+}
+
+static mx_status_t fd_send(bench_t* b, uint8_t* frame, size_t len) {
+    // a full transmit ring is the driver keeping up, so give it a moment
+    for (int i = 0; i < 1000; i++) {
+        if (write(b->fd, frame, len) == (ssize_t)len) {
+            return NO_ERROR;
+        }
+        mx_nanosleep(MX_USEC(10));
+    }
+    return ERR_TIMED_OUT;
+}
+
+static void fd_flush(bench_t* b) {
+}
+
+static const bench_path_t fd_path = {
+    .name = "fd",
+    .recv = fd_recv,
+    .get_tx = fd_get_tx,
+    .send = fd_send,
+    .flush = fd_flush,
+};
+
+// batched sessions
+
+static mx_status_t session_open(bench_t* b, session_t* s, uint32_t dir, uint32_t queue,
+                                uint32_t* queues) {
+    memset(s, 0, sizeof(*s));
+    eth_fifo_config_t config = {
+        .count = SLOTS,
+        .dir = dir,
+        .data_size = SLOTS * FRAME_MAX,
+        .queue = queue,
+    };
+    eth_fifo_info_t info;
+    ssize_t r = ioctl_ethernet_fifo_create(b->fd, &config, &info);
+    if (r < 0) {
+        return r;
+    }
+    s->fifo = info.fifo;
+    s->vmo = info.vmo;
+    s->size = info.data_offset + config.data_size;
+    mx_status_t status = mx_process_map_vm(mx_process_self(), s->vmo, 0, s->size, &s->addr,
+                                           MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    if (status < 0) {
+        mx_handle_close(s->fifo);
+        mx_handle_close(s->vmo);
+        memset(s, 0, sizeof(*s));
+        return status;
+    }
+    s->ring = (eth_fifo_entry_t*)s->addr;
+    s->data = (uint8_t*)s->addr + info.data_offset;
+    if (queues != NULL) {
+        *queues = (info.rx_queues > 0) ? info.rx_queues : 1;
+    }
+    return NO_ERROR;
+}
+
+static void session_close(session_t* s) {
+    if (s->addr) {
+        mx_process_unmap_vm(mx_process_self(), s->addr, s->size);
+    }
+    mx_handle_close(s->fifo);
+    mx_handle_close(s->vmo);
+    memset(s, 0, sizeof(*s));
+}
+
+// posts the pending entries, waking the device only if it had caught up
+static void session_post(session_t* s) {
+    if (s->pending == 0) {
+        return;
+    }
+    uint64_t head = s->head;
+    if (mx_fifo_op(s->fifo, MX_FIFO_OP_ADVANCE_HEAD, s->pending, NULL) < 0) {
+        return;
+    }
+    s->head += s->pending;
+    s->pending = 0;
+    mx_fifo_state_t state;
+    if ((mx_fifo_op(s->fifo, MX_FIFO_OP_READ_STATE, 0, &state) < 0) || (state.tail == head)) {
+        mx_object_signal_peer(s->fifo, 0, ETH_FIFO_SIGNAL);
+    }
+}
+
+static void session_refresh(session_t* s) {
+    // clear the signal before looking, so entries after this raise it
+    mx_object_signal(s->fifo, ETH_FIFO_SIGNAL, 0);
+    mx_fifo_state_t state;
+    if (mx_fifo_op(s->fifo, MX_FIFO_OP_READ_STATE, 0, &state) == NO_ERROR) {
+        s->avail = state.tail;
+    }
+}
+
+static mx_status_t fifo_open(bench_t* b) {
+    uint32_t queues;
+    mx_status_t r;
+    if ((r = session_open(b, &b->tx, ETH_FIFO_TX, 0, &queues)) < 0) {
+        return r;
+    }
+    b->rx_queues = (queues < RX_QUEUES) ? queues : RX_QUEUES;
+    for (uint32_t q = 0; q < b->rx_queues; q++) {
+        session_t* s = &b->rx[q];
+        if ((r = session_open(b, s, ETH_FIFO_RX, q, NULL)) < 0) {
+            return r;
+        }
+        for (uint32_t i = 0; i < SLOTS; i++) {
+            s->ring[i].offset = i * FRAME_MAX;
+            s->ring[i].length = FRAME_MAX;
+            s->ring[i].flags = 0;
+        }
+        s->pending = SLOTS;
+        session_post(s);
+    }
+    return NO_ERROR;
+}
+
+static void fifo_close(bench_t* b) {
+    session_close(&b->tx);
+    for (uint32_t q = 0; q < RX_QUEUES; q++) {
+        session_close(&b->rx[q]);
+    }
+}
+
+// the buffer of the frame last returned goes back to its slot, to be
+// posted with the next batch
+static void fifo_release(bench_t* b) {
+    if (b->rx_last == NULL) {
+        return;
+    }
+    session_t* s = b->rx_last_session;
+    b->rx_last->length = FRAME_MAX;
+    b->rx_last->flags = 0;
+    b->rx_last = NULL;
+    if (++s->pending >= BATCH) {
+        session_post(s);
+    }
+}
+
+static uint8_t* fifo_recv(bench_t* b, size_t* len, mx_time_t deadline) {
+    fifo_release(b);
+    for (;;) {
+        for (uint32_t i = 0; i < b->rx_queues; i++) {
+            // take turns, so a busy queue doesn't keep the others waiting
+            session_t* s = &b->rx[(b->rx_next + i) % b->rx_queues];
+            while (s->tail < s->avail) {
+                eth_fifo_entry_t* e = &s->ring[s->tail++ & (SLOTS - 1)];
+                if (!(e->flags & ETH_FIFO_OK)) {
+                    e->length = FRAME_MAX;
+                    s->pending++;
+                    continue;
+                }
+                b->rx_next = (b->rx_next + i + 1) % b->rx_queues;
+                b->rx_last = e;
+                b->rx_last_session = s;
+                *len = e->length;
+                return s->data + e->offset;
+            }
+        }
+
+        // out of frames already handed back: give the device what's
+        // been read and see what else it has
+        bool found = false;
+        for (uint32_t q = 0; q < b->rx_queues; q++) {
+            session_post(&b->rx[q]);
+            session_refresh(&b->rx[q]);
+            found |= (b->rx[q].tail < b->rx[q].avail);
+        }
+        if (found) {
+            continue;
+        }
+        mx_time_t t = now();
+        if (t >= deadline) {
+            return NULL;
+        }
+        mx_wait_item_t items[RX_QUEUES];
+        for (uint32_t q = 0; q < b->rx_queues; q++) {
+            items[q].handle = b->rx[q].fifo;
+            items[q].waitfor = ETH_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED;
+            items[q].pending = 0;
+        }
+        mx_status_t status = mx_handle_wait_many(items, b->rx_queues,
+                                                 (deadline == MX_TIME_INFINITE)
+                                                     ? MX_TIME_INFINITE : deadline - t);
+        if ((status < 0) && (status != ERR_TIMED_OUT)) {
+            return NULL;
+        }
+    }
+}
+
+// takes back the slots of the frames the device is done sending
+static void fifo_reclaim(bench_t* b) {
+    session_t* s = &b->tx;
+    session_refresh(s);
+    for (; s->tail < s->avail; s->tail++) {
+        if (!(s->ring[s->tail & (SLOTS - 1)].flags & ETH_FIFO_OK)) {
+            b->tx_errors++;
+        }
+    }
+}
+
+static uint8_t* fifo_get_tx(bench_t* b) {
+    session_t* s = &b->tx;
+    while (s->head + s->pending - s->tail >= SLOTS) {
+        session_post(s);
+        fifo_reclaim(b);
+        if (s->head + s->pending - s->tail < SLOTS) {
+            break;
+        }
+        mx_signals_t observed;
+        mx_status_t r = mx_handle_wait_one(s->fifo, ETH_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED,
+                                           MX_SEC(1), &observed);
+        if ((r != NO_ERROR) || (observed & MX_FIFO_PEER_CLOSED)) {
+            return NULL;
+        }
+    }
+    return s->data + ((s->head + s->pending) & (SLOTS - 1)) * FRAME_MAX;
+}
+
+static mx_status_t fifo_send(bench_t* b, uint8_t* frame, size_t len) {
+    session_t* s = &b->tx;
+    eth_fifo_entry_t* e = &s->ring[(s->head + s->pending) & (SLOTS - 1)];
+    e->offset = frame - s->data;
+    e->length = len;
+    e->flags = 0;
+    if (++s->pending >= BATCH) {
+        session_post(s);
+    }
+    return NO_ERROR;
+}
+
+static void fifo_flush(bench_t* b) {
+    session_post(&b->tx);
+}
+
+static const bench_path_t fifo_path = {
+    .name = "fifo",
+    .recv = fifo_recv,
+    .get_tx = fifo_get_tx,
+    .send = fifo_send,
+    .flush = fifo_flush,
+};
+
+// frames
+
+static uint16_t ip6_payload_sum(const ip6_hdr_t* ip, uint8_t type, size_t len) {
+    uint16_t sum = ip6_sum(&ip->length, 2, htons(type));
+    return ip6_sum(&ip->src, 32 + len, sum);
+}
+
+// fills in the ethernet and ip6 headers of a frame in reply to rx, which
+// is where its source addresses come from, returning the ip6 header
+static ip6_hdr_t* frame_setup(bench_t* b, uint8_t* frame, const uint8_t* rx, uint8_t type,
+                              size_t len) {
+    const ip6_hdr_t* rxip = (const void*)(rx + ETH_HDR_LEN);
+    memcpy(frame, rx + ETH_ADDR_LEN, ETH_ADDR_LEN);
+    memcpy(frame + ETH_ADDR_LEN, &b->mac, ETH_ADDR_LEN);
+    frame[12] = ETH_IP6 >> 8;
+    frame[13] = ETH_IP6 & 0xFF;
+    ip6_hdr_t* ip = (void*)(frame + ETH_HDR_LEN);
+    ip->ver_tc_flow = 0x60;
+    ip->length = htons(len);
+    ip->next_header = type;
+    ip->hop_limit = 255;
+    ip->src = b->addr;
+    ip->dst = rxip->src;
+    return ip;
+}
+
+// sends a UDP reply to rx with the payload in place in frame, which came
+// from get_tx()
+static mx_status_t udp_reply(bench_t* b, uint8_t* frame, const uint8_t* rx, size_t len) {
+    const udp_hdr_t* rxudp = (const void*)(rx + ETH_HDR_LEN + IP6_HDR_LEN);
+    ip6_hdr_t* ip = frame_setup(b, frame, rx, HDR_UDP, UDP_HDR_LEN + len);
+    udp_hdr_t* udp = (void*)(frame + ETH_HDR_LEN + IP6_HDR_LEN);
+    udp->src_port = htons(ETHBENCH_PORT);
+    udp->dst_port = rxudp->src_port;
+    udp->length = htons(UDP_HDR_LEN + len);
+    udp->checksum = 0;
+    uint16_t sum = ~ip6_payload_sum(ip, HDR_UDP, UDP_HDR_LEN + len);
+    udp->checksum = (sum != 0) ? sum : 0xFFFF;
+    return b->path->send(b, frame, FRAME_HDR_LEN + len);
+}
+
+static void ndp_reply(bench_t* b, const uint8_t* rx, size_t len) {
+    const ndp_n_hdr_t* ns = (const void*)(rx + ETH_HDR_LEN + IP6_HDR_LEN);
+    if ((len < ETH_HDR_LEN + IP6_HDR_LEN + sizeof(ndp_n_hdr_t)) ||
+        (ns->type != ICMP6_NDP_N_SOLICIT) ||
+        memcmp(ns->target, &b->addr, IP6_ADDR_LEN)) {
+        return;
+    }
+    uint8_t* frame = b->path->get_tx(b);
+    if (frame == NULL) {
+        return;
+    }
+    size_t nlen = sizeof(ndp_n_hdr_t) + 8;
+    ip6_hdr_t* ip = frame_setup(b, frame, rx, HDR_ICMP6, nlen);
+    ndp_n_hdr_t* na = (void*)(frame + ETH_HDR_LEN + IP6_HDR_LEN);
+    na->type = ICMP6_NDP_N_ADVERTISE;
+    na->code = 0;
+    na->checksum = 0;
+    na->flags = 0x60; // (S)olicited and (O)verride
+    memcpy(na->target, &b->addr, IP6_ADDR_LEN);
+    na->options[0] = NDP_N_TGT_LL_ADDR;
+    na->options[1] = 1;
+    memcpy(na->options + 2, &b->mac, ETH_ADDR_LEN);
+    na->checksum = ~ip6_payload_sum(ip, HDR_ICMP6, nlen);
+    b->path->send(b, frame, ETH_HDR_LEN + IP6_HDR_LEN + nlen);
+    b->path->flush(b);
+}
+
+static void print_rate(const char* what, const ethbench_stats_t* st) {
+    uint64_t elapsed = (st->elapsed > 0) ? st->elapsed : 1;
+    printf("ethbench: %s %" PRIu64 " frames, %" PRIu64 " bytes in %" PRIu64 " us: "
+           "%" PRIu64 " frames/s, %" PRIu64 " Mbit/s, %" PRIu64 " errors\n",
+           what, st->frames, st->bytes, st->elapsed / 1000,
+           st->frames * MX_SEC(1) / elapsed,
+           (st->bytes + st->frames * FRAME_HDR_LEN) * 8 * 1000 / elapsed,
+           st->errors);
+}
+
+static void run_send(bench_t* b, const uint8_t* rx, const ethbench_hdr_t* req,
+                     const ethbench_send_t* send) {
+    uint32_t size = send->size;
+    if (size < sizeof(ethbench_hdr_t) + sizeof(ethbench_stats_t)) {
+        size = sizeof(ethbench_hdr_t) + sizeof(ethbench_stats_t);
+    }
+    if (size > PAYLOAD_MAX) {
+        size = PAYLOAD_MAX;
+    }
+    // nothing is received until this is done, so rx stays put for the
+    // replies to take their addresses from
+    ethbench_stats_t st;
+    memset(&st, 0, sizeof(st));
+    b->tx_errors = 0;
+    mx_time_t start = now();
+    for (uint32_t i = 0; i < send->count; i++) {
+        uint8_t* frame = b->path->get_tx(b);
+        if (frame == NULL) {
+            st.errors++;
+            break;
+        }
+        ethbench_hdr_t* hdr = (void*)(frame + FRAME_HDR_LEN);
+        hdr->magic = ETHBENCH_MAGIC;
+        hdr->cmd = ETHBENCH_DATA;
+        hdr->seq = i;
+        hdr->arg = req->arg;
+        hdr->stamp = now();
+        if (udp_reply(b, frame, rx, size) < 0) {
+            st.errors++;
+        } else {
+            st.frames++;
+            st.bytes += size;
+        }
+    }
+    b->path->flush(b);
+    st.elapsed = now() - start;
+    st.errors += b->tx_errors;
+    print_rate("sent", &st);
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t* frame = b->path->get_tx(b);
+        if (frame == NULL) {
+            break;
+        }
+        ethbench_hdr_t* hdr = (void*)(frame + FRAME_HDR_LEN);
+        hdr->magic = ETHBENCH_MAGIC;
+        hdr->cmd = ETHBENCH_END;
+        hdr->seq = send->count;
+        hdr->arg = req->arg;
+        hdr->stamp = now();
+        memcpy(hdr + 1, &st, sizeof(st));
+        udp_reply(b, frame, rx, sizeof(*hdr) + sizeof(st));
+    }
+    b->path->flush(b);
+}
+
+static void handle_udp(bench_t* b, uint8_t* rx, size_t len) {
+    ethbench_hdr_t* hdr = (void*)(rx + FRAME_HDR_LEN);
+    if ((len < sizeof(*hdr)) || (len > PAYLOAD_MAX) || (hdr->magic != ETHBENCH_MAGIC)) {
+        b->rx_stats.errors++;
+        return;
+    }
+
+    uint8_t* frame;
+    switch (hdr->cmd) {
+    case ETHBENCH_DATA:
+        if ((hdr->arg != b->rx_id) || (b->rx_stats.frames == 0)) {
+            // a new test
+            b->rx_id = hdr->arg;
+            memset(&b->rx_stats, 0, sizeof(b->rx_stats));
+            b->rx_first = now();
+            b->rx_reported = false;
+        }
+        b->rx_stats.frames++;
+        b->rx_stats.bytes += len;
+        b->rx_stats.elapsed = now() - b->rx_first;
+        break;
+    case ETHBENCH_END:
+        if (hdr->arg != b->rx_id) {
+            // nothing got here
+            b->rx_id = hdr->arg;
+            memset(&b->rx_stats, 0, sizeof(b->rx_stats));
+            b->rx_reported = false;
+        }
+        if ((frame = b->path->get_tx(b)) != NULL) {
+            ethbench_hdr_t* reply = (void*)(frame + FRAME_HDR_LEN);
+            *reply = *hdr;
+            reply->cmd = ETHBENCH_STATS;
+            memcpy(reply + 1, &b->rx_stats, sizeof(b->rx_stats));
+            udp_reply(b, frame, rx, sizeof(*reply) + sizeof(b->rx_stats));
+            b->path->flush(b);
+        }
+        if (!b->rx_reported) {
+            // said once for each test, however many times it's asked
+            print_rate("received", &b->rx_stats);
+            b->rx_reported = true;
+        }
+        break;
+    case ETHBENCH_SEND:
+        if (len >= sizeof(*hdr) + sizeof(ethbench_send_t)) {
+            ethbench_send_t send;
+            memcpy(&send, hdr + 1, sizeof(send));
+            run_send(b, rx, hdr, &send);
+        }
+        break;
+    case ETHBENCH_HELLO:
+    case ETHBENCH_PING:
+        if ((frame = b->path->get_tx(b)) != NULL) {
+            memcpy(frame + FRAME_HDR_LEN, hdr, len);
+            ethbench_hdr_t* reply = (void*)(frame + FRAME_HDR_LEN);
+            if (hdr->cmd == ETHBENCH_PING) {
+                reply->cmd = ETHBENCH_PONG;
+            } else {
+                // which path is being measured, for the host to say
+                reply->arg = (b->path == &fifo_path);
+            }
+            udp_reply(b, frame, rx, len);
+            b->path->flush(b);
+        }
+        break;
+    default:
+        b->rx_stats.errors++;
+        break;
+    }
+}
+
+static void handle_frame(bench_t* b, uint8_t* rx, size_t len) {
+    if ((len < ETH_HDR_LEN + IP6_HDR_LEN) ||
+        (rx[12] != (ETH_IP6 >> 8)) || (rx[13] != (ETH_IP6 & 0xFF))) {
+        return;
+    }
+    ip6_hdr_t* ip = (void*)(rx + ETH_HDR_LEN);
+    size_t plen = ntohs(ip->length);
+    if (((ip->ver_tc_flow & 0xF0) != 0x60) || (plen > len - ETH_HDR_LEN - IP6_HDR_LEN)) {
+        return;
+    }
+    if (ip->next_header == HDR_ICMP6) {
+        ndp_reply(b, rx, ETH_HDR_LEN + IP6_HDR_LEN + plen);
+        return;
+    }
+    if ((ip->next_header != HDR_UDP) || (plen < UDP_HDR_LEN) ||
+        (!ip6_addr_eq(&ip->dst, &b->addr) && !ip6_addr_eq(&ip->dst, &ll_all_nodes))) {
+        return;
+    }
+    udp_hdr_t* udp = (void*)(rx + ETH_HDR_LEN + IP6_HDR_LEN);
+    size_t ulen = ntohs(udp->length);
+    if ((ntohs(udp->dst_port) != ETHBENCH_PORT) || (ulen < UDP_HDR_LEN) || (ulen > plen)) {
+        return;
+    }
+    // the checksum isn't checked: a bad frame shows up in the counts
+    handle_udp(b, rx, ulen - UDP_HDR_LEN);
+}
+
+static int open_first(const char* dir) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return -1;
+    }
+    int fd = -1;
+    struct dirent* de;
+    while ((fd < 0) && ((de = readdir(d)) != NULL)) {
+        if (de->d_name[0] != '.') {
+            fd = openat(dirfd(d), de->d_name, O_RDWR);
+        }
+    }
+    closedir(d);
+    return fd;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: ethbench [-p fd|fifo] [<device>]\n");
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    static bench_t bench;
+    bench_t* b = &bench;
+    b->path = &fd_path;
+    const char* dev = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && (i + 1 < argc)) {
+            i++;
+            if (!strcmp(argv[i], "fd")) {
+                b->path = &fd_path;
+            } else if (!strcmp(argv[i], "fifo")) {
+                b->path = &fifo_path;
+            } else {
+                return usage();
+            }
+        } else if ((argv[i][0] != '-') && (dev == NULL)) {
+            dev = argv[i];
+        } else {
+            return usage();
+        }
+    }
+
+    b->fd = (dev != NULL) ? open(dev, O_RDWR) : open_first("/dev/class/ethernet");
+    if (b->fd < 0) {
+        fprintf(stderr, "ethbench: cannot open %s\n", dev ? dev : "an ethernet device");
+        return -1;
+    }
+    if (read(b->fd, &b->mac, ETH_ADDR_LEN) != ETH_ADDR_LEN) {
+        fprintf(stderr, "ethbench: cannot read mac address\n");
+        close(b->fd);
+        return -1;
+    }
+    if ((b->path == &fifo_path) && (fifo_open(b) < 0)) {
+        fprintf(stderr, "ethbench: cannot set up batched sessions\n");
+        fifo_close(b);
+        close(b->fd);
+        return -1;
+    }
+
+    // the link local address, from the mac by modified EUI-64
+    memset(&b->addr, 0, sizeof(b->addr));
+    b->addr.u8[0] = 0xFE;
+    b->addr.u8[1] = 0x80;
+    b->addr.u8[8] = b->mac.x[0] ^ 2;
+    b->addr.u8[9] = b->mac.x[1];
+    b->addr.u8[10] = b->mac.x[2];
+    b->addr.u8[11] = 0xFF;
+    b->addr.u8[12] = 0xFE;
+    b->addr.u8[13] = b->mac.x[3];
+    b->addr.u8[14] = b->mac.x[4];
+    b->addr.u8[15] = b->mac.x[5];
+
+    printf("ethbench: %02x:%02x:%02x:%02x:%02x:%02x, %s path, %u receive queue(s), port %u\n",
+           b->mac.x[0], b->mac.x[1], b->mac.x[2], b->mac.x[3], b->mac.x[4], b->mac.x[5],
+           b->path->name, (b->path == &fifo_path) ? b->rx_queues : 1, ETHBENCH_PORT);
+
+    for (;;) {
+        size_t len;
+        uint8_t* frame = b->path->recv(b, &len, MX_TIME_INFINITE);
+        if (frame == NULL) {
+            fprintf(stderr, "ethbench: device went away\n");
+            break;
+        }
+        handle_frame(b, frame, len);
+    }
+
+    if (b->path == &fifo_path) {
+        fifo_close(b);
+    }
+    close(b->fd);
+    return -1;
+}
@@ -0,0 +1,353 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <magenta/syscalls.h>
+
+// Times metadata and data operations in a scratch directory made under
+// any path, so the same runs can be compared across filesystems and
+// across changes to one:
+//
+//   magenta> fs-bench <path> [-n <files>] [-s <file size>] [-i <iterations>]
+//
+//   create     creating and closing -n empty files in one directory
+//   stat       stat() of each of them
+//   readdir    listing the directory of them, -i times
+//   unlink     unlinking each of them
+//   write Nk   writing a -s byte file from start to end, N bytes at a time
+//   read Nk    reading it back the same way
+//   rread 4k   reading 4k at random offsets, as many times as write 4k did
+//   rwrite 4k  the same, writing
+//   fsync      writing 4k at the start of the file and fsync()ing, -i times
+//
+// Each line gives the operations per second and, in us, percentiles of
+// how long one took.  For readdir that's one whole listing.
+
+#define DEFAULT_FILES 1000
+#define DEFAULT_SIZE (16 * 1024 * 1024)
+#define DEFAULT_ITERS 100
+
+static const size_t io_sizes[] = { 4096, 65536, 1024 * 1024 };
+
+typedef struct {
+    uint64_t* samples;
+    size_t count;
+    size_t max;
+    uint64_t bytes;
+    mx_time_t elapsed;
+} result_t;
+
+static mx_time_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+static int result_init(result_t* r, size_t max) {
+    memset(r, 0, sizeof(*r));
+    if ((r->samples = malloc(max * sizeof(uint64_t))) == NULL) {
+        fprintf(stderr, "fs-bench: out of memory\n");
+        return -1;
+    }
+    r->max = max;
+    return 0;
+}
+
+static void result_add(result_t* r, mx_time_t start, uint64_t bytes) {
+    mx_time_t t = now() - start;
+    if (r->count < r->max) {
+        r->samples[r->count++] = t;
+    }
+    r->elapsed += t;
+    r->bytes += bytes;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const result_t* r, uint32_t per_mille) {
+    size_t i = (r->count * per_mille + 999) / 1000;
+    return r->samples[(i > 0) ? i - 1 : 0];
+}
+
+static void result_print(const char* name, result_t* r) {
+    if ((r->count == 0) || (r->elapsed == 0)) {
+        printf("%-10s no samples\n", name);
+    } else {
+        qsort(r->samples, r->count, sizeof(uint64_t), cmp_u64);
+        uint64_t ops = r->count * MX_SEC(1) / r->elapsed;
+        printf("%-10s %8zu %8" PRIu64, name, r->count, ops);
+        if (r->bytes > 0) {
+            printf(" %8" PRIu64, r->bytes * MX_SEC(1) / r->elapsed / (1024 * 1024));
+        } else {
+            printf(" %8s", "-");
+        }
+        printf(" %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n",
+               percentile(r, 500) / 1000, percentile(r, 900) / 1000,
+               percentile(r, 990) / 1000, r->samples[r->count - 1] / 1000);
+    }
+    free(r->samples);
+    r->samples = NULL;
+}
+
+// files are named relative to the scratch directory, so each operation
+// looks up one name
+static void file_name(char* out, size_t len, uint32_t i) {
+    snprintf(out, len, "f%06u", i);
+}
+
+static int bench_metadata(const char* dir, int dfd, uint32_t files, uint32_t iters) {
+    char path[16];
+    result_t r;
+
+    if (result_init(&r, files) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < files; i++) {
+        file_name(path, sizeof(path), i);
+        mx_time_t t = now();
+        int fd = openat(dfd, path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "fs-bench: cannot create %s\n", path);
+            free(r.samples);
+            return -1;
+        }
+        close(fd);
+        result_add(&r, t, 0);
+    }
+    result_print("create", &r);
+
+    if (result_init(&r, files) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < files; i++) {
+        struct stat st;
+        file_name(path, sizeof(path), i);
+        mx_time_t t = now();
+        if (fstatat(dfd, path, &st, 0) < 0) {
+            fprintf(stderr, "fs-bench: cannot stat %s\n", path);
+            free(r.samples);
+            return -1;
+        }
+        result_add(&r, t, 0);
+    }
+    result_print("stat", &r);
+
+    if (result_init(&r, iters) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < iters; i++) {
+        mx_time_t t = now();
+        DIR* d = opendir(dir);
+        if (d == NULL) {
+            fprintf(stderr, "fs-bench: cannot open %s\n", dir);
+            free(r.samples);
+            return -1;
+        }
+        uint32_t seen = 0;
+        while (readdir(d) != NULL) {
+            seen++;
+        }
+        closedir(d);
+        result_add(&r, t, 0);
+        if (seen < files) {
+            fprintf(stderr, "fs-bench: listed %u of %u files\n", seen, files);
+            free(r.samples);
+            return -1;
+        }
+    }
+    result_print("readdir", &r);
+
+    if (result_init(&r, files) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < files; i++) {
+        file_name(path, sizeof(path), i);
+        mx_time_t t = now();
+        if (unlinkat(dfd, path, 0) < 0) {
+            fprintf(stderr, "fs-bench: cannot unlink %s\n", path);
+            free(r.samples);
+            return -1;
+        }
+        result_add(&r, t, 0);
+    }
+    result_print("unlink", &r);
+    return 0;
+}
+
+// moves the whole file n bytes at a time, or count requests of n bytes at
+// random offsets if random is set
+static int bench_io(int fd, const char* name, uint8_t* buf, size_t n, uint64_t size,
+                    bool writing, bool random, uint64_t count) {
+    result_t r;
+    if (!random) {
+        count = size / n;
+    }
+    if (result_init(&r, count) < 0) {
+        return -1;
+    }
+    uint64_t seed = now() | 1;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t offset = i * n;
+        if (random) {
+            seed ^= seed >> 12;
+            seed ^= seed << 25;
+            seed ^= seed >> 27;
+            offset = ((seed * 0x2545f4914f6cdd1dull) % (size / n)) * n;
+        }
+        mx_time_t t = now();
+        ssize_t actual = writing ? pwrite(fd, buf, n, offset) : pread(fd, buf, n, offset);
+        if (actual != (ssize_t)n) {
+            fprintf(stderr, "fs-bench: %s at %" PRIu64 " returned %zd\n", name, offset, actual);
+            free(r.samples);
+            return -1;
+        }
+        result_add(&r, t, n);
+    }
+    result_print(name, &r);
+    return 0;
+}
+
+static int bench_data(int dfd, uint64_t size, uint32_t iters) {
+    const char* path = "data";
+    int fd = openat(dfd, path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "fs-bench: cannot create %s\n", path);
+        return -1;
+    }
+    size_t max = io_sizes[countof(io_sizes) - 1];
+    uint8_t* buf = malloc(max);
+    if (buf == NULL) {
+        fprintf(stderr, "fs-bench: out of memory\n");
+        close(fd);
+        return -1;
+    }
+    memset(buf, 0x5a, max);
+
+    int r = 0;
+    char name[32];
+    for (size_t i = 0; (r == 0) && (i < countof(io_sizes)); i++) {
+        size_t n = io_sizes[i];
+        if (n > size) {
+            break;
+        }
+        snprintf(name, sizeof(name), "write %zuk", n / 1024);
+        r = bench_io(fd, name, buf, n, size, true, false, 0);
+        if (r == 0) {
+            snprintf(name, sizeof(name), "read %zuk", n / 1024);
+            r = bench_io(fd, name, buf, n, size, false, false, 0);
+        }
+    }
+    uint64_t count = size / io_sizes[0];
+    if (r == 0) {
+        r = bench_io(fd, "rread 4k", buf, io_sizes[0], size, false, true, count);
+    }
+    if (r == 0) {
+        r = bench_io(fd, "rwrite 4k", buf, io_sizes[0], size, true, true, count);
+    }
+
+    result_t res;
+    if ((r == 0) && (result_init(&res, iters) == 0)) {
+        for (uint32_t i = 0; i < iters; i++) {
+            if (pwrite(fd, buf, io_sizes[0], 0) != (ssize_t)io_sizes[0]) {
+                fprintf(stderr, "fs-bench: write before fsync failed\n");
+                r = -1;
+                break;
+            }
+            mx_time_t t = now();
+            if (fsync(fd) < 0) {
+                fprintf(stderr, "fs-bench: fsync failed\n");
+                r = -1;
+                break;
+            }
+            result_add(&res, t, 0);
+        }
+        if (r == 0) {
+            result_print("fsync", &res);
+        } else {
+            free(res.samples);
+        }
+    }
+
+    free(buf);
+    close(fd);
+    unlinkat(dfd, path, 0);
+    return r;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: fs-bench <path> [-n <files>] [-s <file size>] [-i <iterations>]\n");
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        return usage();
+    }
+    uint32_t files = DEFAULT_FILES;
+    uint64_t size = DEFAULT_SIZE;
+    uint32_t iters = DEFAULT_ITERS;
+    for (int i = 2; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (!strcmp(argv[i], "-n")) {
+            files = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s")) {
+            size = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-i")) {
+            iters = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else {
+            return usage();
+        }
+    }
+    if ((files == 0) || (iters == 0) || (size < io_sizes[0])) {
+        return usage();
+    }
+    size -= size % io_sizes[0];
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/fs-bench-%" PRIx64, argv[1], now());
+    if (mkdir(dir, 0755) < 0) {
+        fprintf(stderr, "fs-bench: cannot make %s\n", dir);
+        return -1;
+    }
+    printf("fs-bench in %s: %u files, %" PRIu64 " byte file, %u iterations\n",
+           dir, files, size, iters);
+    printf("%-10s %8s %8s %8s %8s %8s %8s %8s\n",
+           "test", "ops", "ops/s", "MB/s", "p50 us", "p90 us", "p99 us", "max us");
+
+    int dfd = open(dir, O_RDONLY);
+    if (dfd < 0) {
+        fprintf(stderr, "fs-bench: cannot open %s\n", dir);
+        unlink(dir);
+        return -1;
+    }
+    int r = bench_metadata(dir, dfd, files, iters);
+    if (r == 0) {
+        r = bench_data(dfd, size, iters);
+    }
+    if (r < 0) {
+        // leave nothing behind, whatever was got through
+        for (uint32_t i = 0; i < files; i++) {
+            char path[16];
+            file_name(path, sizeof(path), i);
+            unlinkat(dfd, path, 0);
+        }
+    }
+    close(dfd);
+    unlink(dir);
+    return r;
+}
@@ -52,7 +52,16 @@ int main(int argc, char* argv[]) {
     while (i--) {
         mx_nanosleep(MX_SEC(1));
         gfx_fillrect(gfx, (gfx->width - d) / 2, (gfx->height - d) / 2, d, d, i % 2 ? 0xff55ff55 : 0xffaa00aa);
-        ioctl_display_flush_fb(vfd);
+
+        // only push what was drawn
+        ioctl_display_region_t r = {
+            .x = gfx->dirty.x,
+            .y = gfx->dirty.y,
+            .width = gfx->dirty.width,
+            .height = gfx->dirty.height,
+        };
+        ioctl_display_flush_fb_region(vfd, &r);
+        gfx_flush(gfx);
     }
 
     gfx_surface_destroy(gfx);
@@ -0,0 +1,150 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <magenta/device/ktrace.h>
+#include <magenta/ktrace.h>
+#include <magenta/syscalls.h>
+
+// Samples every cpu at the given rate for a while, then prints the samples
+// as folded stacks, one line per distinct stack with the outermost frame
+// first, followed by how many samples had it:
+//
+//   magenta> kprofile -r 500 10 > /tmp/kernel.folded
+//   host> netcp :/tmp/kernel.folded kernel.folded
+//   host> flamegraph.pl kernel.folded > kernel.svg
+//
+// The addresses are left for the host to symbolize.
+
+#define STACK_DEPTH (1 + KTRACE_SAMPLE_FRAMES)
+
+typedef struct sample_stack {
+    uint64_t pc[STACK_DEPTH];
+    uint32_t count;
+} sample_stack_t;
+
+static int stack_cmp(const void* a, const void* b) {
+    return memcmp(((const sample_stack_t*)a)->pc, ((const sample_stack_t*)b)->pc,
+                  sizeof(((const sample_stack_t*)a)->pc));
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: kprofile [-r samples-per-second] [seconds]\n");
+}
+
+int main(int argc, char** argv) {
+    uint32_t rate = 100;
+    uint32_t seconds = 5;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            rate = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-') {
+            seconds = (uint32_t)strtoul(argv[i], NULL, 0);
+        } else {
+            usage();
+            return -1;
+        }
+    }
+
+    int fd;
+    if ((fd = open("/dev/class/misc/ktrace", O_RDWR)) < 0) {
+        fprintf(stderr, "cannot open trace device\n");
+        return -1;
+    }
+    mx_handle_t kth;
+    if (ioctl_ktrace_get_handle(fd, &kth) < 0) {
+        fprintf(stderr, "cannot get ktrace handle\n");
+        return -1;
+    }
+
+    // trace nothing but the samples, from an empty buffer
+    mx_ktrace_control(kth, KTRACE_ACTION_STOP, 0, NULL);
+    mx_ktrace_control(kth, KTRACE_ACTION_REWIND, 0, NULL);
+    mx_ktrace_control(kth, KTRACE_ACTION_START, KTRACE_GRP_SAMPLE, NULL);
+    mx_status_t status = mx_ktrace_control(kth, KTRACE_ACTION_SAMPLE, rate, NULL);
+    if (status < 0) {
+        fprintf(stderr, "cannot start sampling: %d\n", status);
+        mx_ktrace_control(kth, KTRACE_ACTION_STOP, 0, NULL);
+        return -1;
+    }
+    mx_nanosleep(MX_SEC(seconds));
+    mx_ktrace_control(kth, KTRACE_ACTION_STOP, 0, NULL);
+
+    // pull the samples out of the trace
+    size_t max = 1024, num = 0;
+    sample_stack_t* stacks = malloc(max * sizeof(*stacks));
+    if (stacks == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    static uint8_t buf[64 * 1024];
+    size_t have = 0;
+    ssize_t r;
+    while ((r = read(fd, buf + have, sizeof(buf) - have)) > 0) {
+        have += r;
+        size_t off = 0;
+        while (have - off >= KTRACE_HDRSIZE) {
+            const ktrace_header_t* hdr = (const ktrace_header_t*)(buf + off);
+            uint32_t len = KTRACE_LEN(hdr->tag);
+            if (len == 0) {
+                fprintf(stderr, "bad record in trace\n");
+                goto done;
+            }
+            if (have - off < len)
+                break;
+            if (KTRACE_EVENT(hdr->tag) == KTRACE_EVENT(TAG_SAMPLE) &&
+                KTRACE_GROUP(hdr->tag) == KTRACE_GRP_SAMPLE) {
+                if (num == max) {
+                    sample_stack_t* more = realloc(stacks, 2 * max * sizeof(*stacks));
+                    if (more == NULL) {
+                        fprintf(stderr, "out of memory, dropping the rest of the samples\n");
+                        goto done;
+                    }
+                    stacks = more;
+                    max *= 2;
+                }
+                const ktrace_rec_sample_t* rec = (const ktrace_rec_sample_t*)hdr;
+                stacks[num].pc[0] = rec->pc;
+                memcpy(&stacks[num].pc[1], rec->frames, sizeof(rec->frames));
+                stacks[num].count = 1;
+                num++;
+            }
+            off += len;
+        }
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+done:
+    close(fd);
+
+    // count each distinct stack once
+    qsort(stacks, num, sizeof(*stacks), stack_cmp);
+    size_t unique = 0;
+    for (size_t i = 0; i < num; i++) {
+        if (unique > 0 && stack_cmp(&stacks[unique - 1], &stacks[i]) == 0) {
+            stacks[unique - 1].count++;
+        } else {
+            stacks[unique++] = stacks[i];
+        }
+    }
+
+    for (size_t i = 0; i < unique; i++) {
+        int depth = STACK_DEPTH;
+        while (depth > 1 && stacks[i].pc[depth - 1] == 0)
+            depth--;
+        for (int d = depth - 1; d >= 0; d--)
+            printf("%#" PRIx64 "%s", stacks[i].pc[d], d ? ";" : "");
+        printf(" %u\n", stacks[i].count);
+    }
+    fprintf(stderr, "kprofile: %zu samples, %zu stacks\n", num, unique);
+
+    free(stacks);
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <launchpad/launchpad.h>
+#include <launchpad/vmo.h>
+#include <magenta/processargs.h>
+#include <magenta/syscalls.h>
+#include <mxio/util.h>
+
+// Times each phase of launching a process, by launching this program
+// over and over with "--child", which just reports when its main()
+// started and exits:
+//
+//   file       reading the executable into a VM object
+//   create     mx_process_create and setting up the launchpad
+//   elf        mapping the executable, or the dynamic linker and
+//              looking it up through the loader service
+//   vdso       mapping the vDSO
+//   start      stack, initial thread and bootstrap messages
+//   main       from mx_process_start to the child's main(), which is
+//              mostly dynamic linking and libc startup
+//   exit       from the child's main() to it being seen to terminate
+//
+// With -t, the executable is loaded from a launchpad template made once
+// up front, so "file" is skipped and "elf" is just the mapping.
+
+enum {
+    PHASE_FILE,
+    PHASE_CREATE,
+    PHASE_ELF,
+    PHASE_VDSO,
+    PHASE_START,
+    PHASE_MAIN,
+    PHASE_EXIT,
+    PHASE_COUNT
+};
+
+static const char* const phase_names[PHASE_COUNT] = {
+    "file", "create", "elf", "vdso", "start", "main", "exit",
+};
+
+static int child_main(void) {
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_handle_t h = mxio_get_startup_handle(MX_HND_INFO(MX_HND_TYPE_USER0, 0));
+    if (h <= 0)
+        return -1;
+    mx_channel_write(h, 0, &now, sizeof(now), NULL, 0);
+    mx_handle_close(h);
+    return 0;
+}
+
+// Launches one child and fills in how long each phase took, in ns.
+static mx_status_t launch_once(const char* path, const launchpad_template_t* tmpl,
+                               mx_handle_t job, uint64_t times[PHASE_COUNT]) {
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    if (status != NO_ERROR)
+        return status;
+
+    mx_time_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    if (tmpl == NULL) {
+        vmo = launchpad_vmo_from_file(path);
+        if (vmo < 0) {
+            mx_handle_close(channel[0]);
+            mx_handle_close(channel[1]);
+            return vmo;
+        }
+    }
+    mx_time_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    launchpad_t* lp;
+    mx_handle_t child_job;
+    status = mx_handle_duplicate(job, MX_RIGHT_SAME_RIGHTS, &child_job);
+    if (status == NO_ERROR)
+        status = launchpad_create(child_job, "launch-perf child", &lp);
+    if (status != NO_ERROR) {
+        if (vmo != MX_HANDLE_INVALID)
+            mx_handle_close(vmo);
+        mx_handle_close(channel[0]);
+        mx_handle_close(channel[1]);
+        return status;
+    }
+    const char* argv[] = {path, "--child"};
+    status = launchpad_arguments(lp, 2, argv);
+    if (status == NO_ERROR)
+        status = launchpad_add_handle(lp, channel[1], MX_HND_INFO(MX_HND_TYPE_USER0, 0));
+    if (status != NO_ERROR)
+        mx_handle_close(channel[1]);
+    mx_time_t t2 = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    if (status == NO_ERROR) {
+        if (tmpl == NULL) {
+            status = launchpad_elf_load(lp, vmo);
+            if (status != NO_ERROR)
+                mx_handle_close(vmo);
+        } else {
+            status = launchpad_elf_load_template(lp, tmpl);
+        }
+    } else if (vmo != MX_HANDLE_INVALID) {
+        mx_handle_close(vmo);
+    }
+    mx_time_t t3 = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    if (status == NO_ERROR)
+        status = launchpad_load_vdso(lp, MX_HANDLE_INVALID);
+    mx_time_t t4 = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    mx_handle_t proc = status;
+    if (status == NO_ERROR)
+        proc = launchpad_start(lp);
+    mx_time_t t5 = mx_time_get(MX_CLOCK_MONOTONIC);
+    launchpad_destroy(lp);
+    if (proc < 0) {
+        mx_handle_close(channel[0]);
+        return proc;
+    }
+
+    mx_time_t main_time = 0;
+    status = mx_handle_wait_one(channel[0], MX_CHANNEL_READABLE, MX_TIME_INFINITE, NULL);
+    if (status == NO_ERROR) {
+        uint32_t actual;
+        status = mx_channel_read(channel[0], 0, &main_time, sizeof(main_time), &actual,
+                                 NULL, 0, NULL);
+        if (status == NO_ERROR && actual != sizeof(main_time))
+            status = ERR_BAD_STATE;
+    }
+    mx_handle_close(channel[0]);
+    if (status == NO_ERROR)
+        status = mx_handle_wait_one(proc, MX_TASK_TERMINATED, MX_TIME_INFINITE, NULL);
+    mx_time_t t6 = mx_time_get(MX_CLOCK_MONOTONIC);
+    mx_handle_close(proc);
+    if (status != NO_ERROR)
+        return status;
+
+    times[PHASE_FILE] = t1 - t0;
+    times[PHASE_CREATE] = t2 - t1;
+    times[PHASE_ELF] = t3 - t2;
+    times[PHASE_VDSO] = t4 - t3;
+    times[PHASE_START] = t5 - t4;
+    times[PHASE_MAIN] = main_time - t5;
+    times[PHASE_EXIT] = t6 - main_time;
+    return NO_ERROR;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: launch-perf [-t] [-n launches]\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && !strcmp(argv[1], "--child"))
+        return child_main();
+
+    bool use_template = false;
+    uint32_t launches = 100;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t")) {
+            use_template = true;
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            launches = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else {
+            usage();
+            return -1;
+        }
+    }
+    if (launches == 0) {
+        usage();
+        return -1;
+    }
+
+    mx_handle_t job = mxio_get_startup_handle(MX_HND_INFO(MX_HND_TYPE_JOB, 0));
+    if (job <= 0) {
+        fprintf(stderr, "launch-perf: no job to launch in\n");
+        return -1;
+    }
+
+    launchpad_template_t* tmpl = NULL;
+    if (use_template) {
+        mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+        mx_status_t status = launchpad_template_create(launchpad_vmo_from_file(argv[0]), &tmpl);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "launch-perf: cannot make a template of %s: %d\n", argv[0], status);
+            return -1;
+        }
+        printf("template created in %" PRIu64 " ns\n", mx_time_get(MX_CLOCK_MONOTONIC) - start);
+    }
+
+    uint64_t* samples = malloc(sizeof(uint64_t) * PHASE_COUNT * launches);
+    if (samples == NULL) {
+        fprintf(stderr, "launch-perf: out of memory\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < launches; i++) {
+        uint64_t times[PHASE_COUNT];
+        mx_status_t status = launch_once(argv[0], tmpl, job, times);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "launch-perf: launch %u failed: %d\n", i, status);
+            return -1;
+        }
+        for (int p = 0; p < PHASE_COUNT; p++)
+            samples[p * launches + i] = times[p];
+    }
+
+    printf("%u launches%s, ns:\n", launches, use_template ? " from a template" : "");
+    printf("%-8s %10s %10s %10s %10s\n", "phase", "min", "median", "p90", "max");
+    uint64_t total = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        uint64_t* s = &samples[p * launches];
+        qsort(s, launches, sizeof(*s), compare_u64);
+        printf("%-8s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               phase_names[p], s[0], s[launches / 2], s[launches * 9 / 10], s[launches - 1]);
+        total += s[launches / 2];
+    }
+    printf("%-8s %10s %10" PRIu64 "\n", "total", "", total);
+
+    free(samples);
+    if (tmpl != NULL)
+        launchpad_template_destroy(tmpl);
+    return 0;
+}
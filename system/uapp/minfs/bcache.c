@@ -2,9 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <fs/trace.h>
@@ -17,34 +22,43 @@
 
 #define BLOCK_FLAGS 0xF
 
-static int readblk(int fd, uint32_t bno, void* data) {
-    off_t off = bno * MINFS_BLOCK_SIZE;
-    trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return -1;
-    }
-    if (read(fd, data, MINFS_BLOCK_SIZE) != MINFS_BLOCK_SIZE) {
-        error("minfs: cannot read block %u\n", bno);
+// A miss reads ahead up to this many blocks, as long as the ones after it on
+// disk aren't cached already.  Files are mostly allocated in runs, so this
+// makes a sequential read one pread() per run rather than one per block.
+#define BCACHE_CLUSTER 8
+
+static int readblks(int fd, uint32_t bno, uint32_t count, void* data) {
+    off_t off = (off_t)bno * MINFS_BLOCK_SIZE;
+    ssize_t len = (ssize_t)count * MINFS_BLOCK_SIZE;
+    trace(IO, "readblks() bno=%u count=%u off=%#llx\n", bno, count, (unsigned long long)off);
+    if (pread(fd, data, len, off) != len) {
+        error("minfs: cannot read blocks %u-%u\n", bno, bno + count - 1);
         return -1;
     }
     return 0;
 }
 
-static int writeblk(int fd, uint32_t bno, void* data) {
-    off_t off = bno * MINFS_BLOCK_SIZE;
-    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
-    if (lseek(fd, off, SEEK_SET) < 0) {
-        error("minfs: cannot seek to block %u\n", bno);
-        return -1;
-    }
-    if (write(fd, data, MINFS_BLOCK_SIZE) != MINFS_BLOCK_SIZE) {
-        error("minfs: cannot write block %u\n", bno);
+static int writeblks(int fd, uint32_t bno, uint32_t count, void* data) {
+    off_t off = (off_t)bno * MINFS_BLOCK_SIZE;
+    ssize_t len = (ssize_t)count * MINFS_BLOCK_SIZE;
+    trace(IO, "writeblks() bno=%u count=%u off=%#llx\n", bno, count, (unsigned long long)off);
+    if (pwrite(fd, data, len, off) != len) {
+        error("minfs: cannot write blocks %u-%u\n", bno, bno + count - 1);
         return -1;
     }
     return 0;
 }
 
+// Dirty blocks are written back later, in block order, by bcache_flush().
+// That happens once half of the cache is dirty, on bcache_sync(), when no
+// clean block is left to reuse and, on Magenta, every BCACHE_FLUSH_SECONDS
+// from a worker thread of its own, so writers don't wait for the disk.
+#define BCACHE_FLUSH_SECONDS 1
+
+// bcache_prefetch() queues up to this many blocks for the worker to read in.
+// Without the worker, on the host, they're read in right away.
+#define BCACHE_PREFETCH_MAX 32
+
 struct block {
     list_node_t hashnode;
     list_node_t listnode;
@@ -54,7 +68,7 @@ struct block {
 };
 
 struct bcache {
-    list_node_t list_busy;  // between bcache_get() and bcache_put()
+    list_node_t list_busy;  // between bcache_get() and bcache_put(), or loading
     list_node_t list_dirty; // waiting for write
     list_node_t list_lru;   // available for re-use
     list_node_t list_free;  // never been used
@@ -62,6 +76,24 @@ struct bcache {
     int fd;
     uint32_t blocksize;
     uint32_t blockmax;
+    void* cluster;          // BCACHE_CLUSTER blocks, for reading ahead
+
+    uint32_t nblocks;
+    uint32_t dirty_count;
+    uint32_t watermark;     // dirty blocks that start a flush
+    block_t** sorted;       // the dirty list, in block order, for flushing
+    void* flushbuf;         // BCACHE_CLUSTER blocks being written back
+
+    uint32_t prefetch[BCACHE_PREFETCH_MAX];
+    uint32_t prefetch_count;
+    void* fetchbuf;         // BCACHE_CLUSTER blocks being prefetched
+
+    // the lock protects all of the above against the worker, and
+    // flush_lock makes flushes take turns
+    mtx_t lock;
+    mtx_t flush_lock;
+    cnd_t wake;             // for the worker
+    cnd_t loaded;           // a prefetch has been read in
 };
 
 #define bno_hash(bno) fnv1a_tiny(bno, MINFS_HASH_BITS)
@@ -87,6 +119,8 @@ static const char* modestr(uint32_t mode) {
 }
 
 #define BLOCK_BUSY 0x10
+#define BLOCK_WRITEBACK 0x20 // copied out, being written, on the dirty list
+#define BLOCK_LOADING 0x40   // being prefetched, on the busy list
 
 
 void bcache_invalidate(bcache_t* bc) {
@@ -104,58 +138,309 @@ void bcache_invalidate(bcache_t* bc) {
     trace(BCACHE, "[ %d blocks dropped ]\n", n);
 }
 
-static block_t* _bcache_get(bcache_t* bc, uint32_t bno, void** data, uint32_t mode) {
-    trace(BCACHE,"bcache_get() bno=%u %s\n",bno,modestr(mode));
-    if (bno >= bc->blockmax) {
+static block_t* bcache_lookup(bcache_t* bc, uint32_t bno) {
+    block_t* blk;
+    list_for_every_entry(bc->hash + bno_hash(bno), blk, block_t, hashnode) {
+        if (blk->bno == bno) {
+            return blk;
+        }
+    }
+    return NULL;
+}
+
+// Takes a never used block, or the least recently used one, for |bno|.
+static block_t* bcache_alloc(bcache_t* bc, uint32_t bno) {
+    block_t* blk;
+    if ((blk = list_remove_head_type(&bc->list_free, block_t, listnode)) != NULL) {
+        // nothing extra to do
+    } else if ((blk = list_remove_head_type(&bc->list_lru, block_t, listnode)) != NULL) {
+        if (blk->flags & BLOCK_BUSY) {
+            panic("blk %p bno %u is busy on lru\n", blk, blk->bno);
+        }
+        // remove from hash, bno to be reassigned
+        list_delete(&blk->hashnode);
+    } else {
         return NULL;
     }
+    blk->bno = bno;
+    list_add_tail(bc->hash + bno_hash(bno), &blk->hashnode);
+    return blk;
+}
+
+static int bno_cmp(const void* a, const void* b) {
+    uint32_t x = (*(block_t* const*)a)->bno;
+    uint32_t y = (*(block_t* const*)b)->bno;
+    return (x > y) - (x < y);
+}
+
+static void mark_dirty(bcache_t* bc, block_t* blk) {
+    if (!(blk->flags & BLOCK_DIRTY)) {
+        blk->flags |= BLOCK_DIRTY;
+        bc->dirty_count++;
+    }
+}
+
+// Writes back the dirty blocks in block order, each run of consecutive ones
+// with a single pwrite().  The data is copied out under the lock, so the
+// blocks can be used again while it's written.  They stay on the dirty list
+// until it has been, so that they can't be reused for other blocks and then
+// read back from the disk before it's there.
+static mx_status_t bcache_flush(bcache_t* bc) {
+    mx_status_t status = NO_ERROR;
+    mtx_lock(&bc->flush_lock);
+    mtx_lock(&bc->lock);
+    if (bc->fd < 0) {
+        goto done;
+    }
+    uint32_t count = 0;
     block_t* blk;
-    uint32_t bucket = bno_hash(bno);
-    list_for_every_entry(bc->hash + bucket, blk, block_t, hashnode) {
-        if (blk->bno == bno) {
-            if (blk->flags & BLOCK_BUSY) {
-                panic("blk %p bno %u is busy\n", blk, bno);
+    list_for_every_entry(&bc->list_dirty, blk, block_t, listnode) {
+        bc->sorted[count++] = blk;
+    }
+    qsort(bc->sorted, count, sizeof(block_t*), bno_cmp);
+    trace(BCACHE, "bcache_flush() %u blocks\n", count);
+
+    for (uint32_t n = 0; n < count;) {
+        uint32_t first = n;
+        blk = bc->sorted[n++];
+        if ((blk->flags & BLOCK_BUSY) || !(blk->flags & BLOCK_DIRTY)) {
+            // taken while the lock was dropped, it's back when it's put
+            continue;
+        }
+        uint32_t bno = blk->bno;
+        uint32_t run = 0;
+        for (;;) {
+            memcpy(bc->flushbuf + run * bc->blocksize, blk->data, bc->blocksize);
+            blk->flags = (blk->flags & ~BLOCK_DIRTY) | BLOCK_WRITEBACK;
+            bc->dirty_count--;
+            run++;
+            if ((run == BCACHE_CLUSTER) || (n == count)) {
+                break;
             }
-            if (mode == MODE_ZERO) {
-                blk->flags |= BLOCK_DIRTY;
-                memset(blk->data, 0, bc->blocksize);
+            blk = bc->sorted[n];
+            if ((blk->bno != bno + run) || (blk->flags & BLOCK_BUSY) ||
+                !(blk->flags & BLOCK_DIRTY)) {
+                break;
             }
-            // remove from dirty or lru
+            n++;
+        }
+
+        mtx_unlock(&bc->lock);
+        if (writeblks(bc->fd, bno, run, bc->flushbuf) < 0) {
+            status = ERR_IO;
+        }
+        mtx_lock(&bc->lock);
+
+        for (uint32_t i = first; i < first + run; i++) {
+            blk = bc->sorted[i];
+            blk->flags &= ~BLOCK_WRITEBACK;
+            if (!(blk->flags & (BLOCK_BUSY | BLOCK_DIRTY))) {
+                list_delete(&blk->listnode);
+                list_add_tail(&bc->list_lru, &blk->listnode);
+            }
+        }
+    }
+done:
+    mtx_unlock(&bc->lock);
+    mtx_unlock(&bc->flush_lock);
+    return status;
+}
+
+static int u32_cmp(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Reads in the queued prefetches, each run of consecutive blocks with one
+// pread().  While they're read, the blocks are in the hash and marked
+// BLOCK_LOADING, so bcache_get() waits for them rather than reading them
+// again.  Prefetches that find no clean block to go in are dropped.
+static void bcache_fetch(bcache_t* bc) {
+    uint32_t bnos[BCACHE_PREFETCH_MAX];
+    mtx_lock(&bc->lock);
+    uint32_t count = bc->prefetch_count;
+    memcpy(bnos, bc->prefetch, count * sizeof(uint32_t));
+    bc->prefetch_count = 0;
+    qsort(bnos, count, sizeof(uint32_t), u32_cmp);
+    trace(BCACHE, "bcache_fetch() %u blocks\n", count);
+
+    for (uint32_t n = 0; n < count;) {
+        uint32_t bno = bnos[n++];
+        if ((bc->fd < 0) || (bcache_lookup(bc, bno) != NULL)) {
+            continue;
+        }
+        block_t* run[BCACHE_CLUSTER];
+        uint32_t len = 0;
+        for (;;) {
+            block_t* blk;
+            if ((blk = bcache_alloc(bc, bno + len)) == NULL) {
+                break;
+            }
+            blk->flags |= BLOCK_LOADING;
+            list_add_tail(&bc->list_busy, &blk->listnode);
+            run[len++] = blk;
+            while ((n < count) && (bnos[n] < bno + len)) {
+                n++; // duplicates
+            }
+            if ((len == BCACHE_CLUSTER) || (n == count) || (bnos[n] != bno + len) ||
+                (bcache_lookup(bc, bnos[n]) != NULL)) {
+                break;
+            }
+            n++;
+        }
+        if (len == 0) {
+            break;
+        }
+
+        mtx_unlock(&bc->lock);
+        int r = readblks(bc->fd, bno, len, bc->fetchbuf);
+        mtx_lock(&bc->lock);
+
+        for (uint32_t i = 0; i < len; i++) {
+            block_t* blk = run[i];
+            blk->flags &= ~BLOCK_LOADING;
             list_delete(&blk->listnode);
-            goto done;
+            if (r == 0) {
+                memcpy(blk->data, bc->fetchbuf + i * bc->blocksize, bc->blocksize);
+                list_add_tail(&bc->list_lru, &blk->listnode);
+            } else {
+                list_delete(&blk->hashnode);
+                list_add_tail(&bc->list_free, &blk->listnode);
+            }
         }
+        cnd_broadcast(&bc->loaded);
     }
-    if (mode == MODE_FIND) {
-        blk = NULL;
-    } else {
-        if ((blk = list_remove_head_type(&bc->list_free, block_t, listnode)) != NULL) {
-            // nothing extra to do
-        } else if ((blk = list_remove_head_type(&bc->list_lru, block_t, listnode)) != NULL) {
-            if (blk->flags & BLOCK_BUSY) {
-                panic("blk %p bno %u is busy on lru\n", blk, blk->bno);
+    mtx_unlock(&bc->lock);
+}
+
+void bcache_prefetch(bcache_t* bc, const uint32_t* bnos, uint32_t count) {
+    mtx_lock(&bc->lock);
+    for (uint32_t n = 0; n < count; n++) {
+        if (bc->prefetch_count == BCACHE_PREFETCH_MAX) {
+            break;
+        }
+        if ((bnos[n] < bc->blockmax) && (bcache_lookup(bc, bnos[n]) == NULL)) {
+            bc->prefetch[bc->prefetch_count++] = bnos[n];
+        }
+    }
+    bool queued = (bc->prefetch_count > 0);
+    mtx_unlock(&bc->lock);
+
+    if (queued) {
+#ifdef __Fuchsia__
+        cnd_signal(&bc->wake);
+#else
+        bcache_fetch(bc);
+#endif
+    }
+}
+
+#ifdef __Fuchsia__
+static int bcache_worker(void* arg) {
+    bcache_t* bc = arg;
+    struct timespec next_flush;
+    timespec_get(&next_flush, TIME_UTC);
+    next_flush.tv_sec += BCACHE_FLUSH_SECONDS;
+
+    mtx_lock(&bc->lock);
+    while (bc->fd >= 0) {
+        bool flush_due = false;
+        if ((bc->prefetch_count == 0) && (bc->dirty_count < bc->watermark)) {
+            flush_due = (cnd_timedwait(&bc->wake, &bc->lock, &next_flush) == thrd_timedout);
+        }
+        if (bc->prefetch_count > 0) {
+            mtx_unlock(&bc->lock);
+            bcache_fetch(bc);
+            mtx_lock(&bc->lock);
+        }
+        if (flush_due || (bc->dirty_count >= bc->watermark)) {
+            if (bc->dirty_count > 0) {
+                mtx_unlock(&bc->lock);
+                if (bcache_flush(bc) < 0) {
+                    error("minfs: write back failed\n");
+                }
+                mtx_lock(&bc->lock);
             }
-            // remove from hash, bno to be reassigned
-            list_delete(&blk->hashnode);
-        } else {
-            panic("bcache: out of blocks\n");
+            timespec_get(&next_flush, TIME_UTC);
+            next_flush.tv_sec += BCACHE_FLUSH_SECONDS;
+        }
+    }
+    mtx_unlock(&bc->lock);
+    return 0;
+}
+#endif
+
+// Reads in |blk|, and the uncached blocks that follow it, which are left on
+// the lru list in case they're wanted next.
+static void bcache_load(bcache_t* bc, block_t* blk) {
+    uint32_t bno = blk->bno;
+    uint32_t count = 1;
+    while ((count < BCACHE_CLUSTER) && (bno + count < bc->blockmax) &&
+           (bcache_lookup(bc, bno + count) == NULL)) {
+        count++;
+    }
+    if ((count > 1) && (readblks(bc->fd, bno, count, bc->cluster) == 0)) {
+        memcpy(blk->data, bc->cluster, bc->blocksize);
+        for (uint32_t n = 1; n < count; n++) {
+            block_t* ra;
+            if ((ra = bcache_alloc(bc, bno + n)) == NULL) {
+                break;
+            }
+            memcpy(ra->data, bc->cluster + n * bc->blocksize, bc->blocksize);
+            list_add_tail(&bc->list_lru, &ra->listnode);
+        }
+        return;
+    }
+    if (readblks(bc->fd, bno, 1, blk->data) < 0) {
+        panic("bcache: bno %u read error!\n", bno);
+    }
+}
+
+static block_t* _bcache_get(bcache_t* bc, uint32_t bno, void** data, uint32_t mode) {
+    trace(BCACHE,"bcache_get() bno=%u %s\n",bno,modestr(mode));
+    if (bno >= bc->blockmax) {
+        return NULL;
+    }
+    mtx_lock(&bc->lock);
+    block_t* blk;
+    while (((blk = bcache_lookup(bc, bno)) != NULL) && (blk->flags & BLOCK_LOADING)) {
+        cnd_wait(&bc->loaded, &bc->lock);
+    }
+    if (blk != NULL) {
+        if (blk->flags & BLOCK_BUSY) {
+            panic("blk %p bno %u is busy\n", blk, bno);
         }
-        blk->bno = bno;
-        list_add_tail(bc->hash + bucket, &blk->hashnode);
         if (mode == MODE_ZERO) {
-            blk->flags |= BLOCK_DIRTY;
+            mark_dirty(bc, blk);
             memset(blk->data, 0, bc->blocksize);
-        } else {
-            if (readblk(bc->fd, bno, blk->data) < 0) {
-                panic("bcache: bno %u read error!\n", bno);
+        }
+        // remove from dirty or lru
+        list_delete(&blk->listnode);
+    } else if (mode != MODE_FIND) {
+        if ((blk = bcache_alloc(bc, bno)) == NULL) {
+            // everything is dirty or busy, so make some room
+            mtx_unlock(&bc->lock);
+            bcache_flush(bc);
+            mtx_lock(&bc->lock);
+            if ((blk = bcache_alloc(bc, bno)) == NULL) {
+                panic("bcache: out of blocks\n");
             }
         }
+        if (mode == MODE_ZERO) {
+            mark_dirty(bc, blk);
+            memset(blk->data, 0, bc->blocksize);
+        } else {
+            bcache_load(bc, blk);
+        }
     }
-done:
+
     if (blk) {
         blk->flags |= BLOCK_BUSY;
         list_add_tail(&bc->list_busy, &blk->listnode);
         *data = blk->data;
     }
+    mtx_unlock(&bc->lock);
     trace(BCACHE, "bcache_get bno=%u %p\n", bno, blk);
     return blk;
 }
@@ -168,22 +453,39 @@ block_t* bcache_get_zero(bcache_t* bc, uint32_t bno, void** bdata) {
     return _bcache_get(bc, bno, bdata, MODE_ZERO);
 }
 
+block_t* bcache_get_cached(bcache_t* bc, uint32_t bno, void** bdata) {
+    return _bcache_get(bc, bno, bdata, MODE_FIND);
+}
+
 void bcache_put(bcache_t* bc, block_t* blk, uint32_t flags) {
     trace(BCACHE, "bcache_put() bno=%u%s\n", blk->bno, (flags & BLOCK_DIRTY) ? " DIRTY" : "");
     if (!(blk->flags & BLOCK_BUSY)) {
         panic("bcache_put() bno=%u NOT BUSY!\n", blk->bno);
     }
+    mtx_lock(&bc->lock);
     // remove from busy list
     list_delete(&blk->listnode);
-    if ((flags | blk->flags) & BLOCK_DIRTY) {
-        if (writeblk(bc->fd, blk->bno, blk->data) < 0) {
+    if (flags & BLOCK_DIRTY) {
+        mark_dirty(bc, blk);
+    }
+    blk->flags &= (~BLOCK_BUSY);
+    if (blk->flags & (BLOCK_DIRTY | BLOCK_WRITEBACK)) {
+        list_add_tail(&bc->list_dirty, &blk->listnode);
+    } else {
+        list_add_tail(&bc->list_lru, &blk->listnode);
+    }
+    bool flush = (bc->dirty_count >= bc->watermark);
+    mtx_unlock(&bc->lock);
+
+    if (flush) {
+#ifdef __Fuchsia__
+        cnd_signal(&bc->wake);
+#else
+        if (bcache_flush(bc) < 0) {
             error("block write error!\n");
         }
-        blk->flags &= (~(BLOCK_DIRTY|BLOCK_BUSY));
-    } else {
-        blk->flags &= (~BLOCK_BUSY);
+#endif
     }
-    list_add_tail(&bc->list_lru, &blk->listnode);
 }
 
 mx_status_t bcache_read(bcache_t* bc, uint32_t bno, void* data, uint32_t off, uint32_t len) {
@@ -202,8 +504,36 @@ mx_status_t bcache_read(bcache_t* bc, uint32_t bno, void* data, uint32_t off, ui
     }
 }
 
+// Cached blocks are never older than the disk, so they're copied over
+// whatever was read for them.  Ones still being loaded are just what was read.
+mx_status_t bcache_read_blocks(bcache_t* bc, uint32_t bno, uint32_t count, void* data) {
+    trace(BCACHE, "bcache_read_blocks() bno=%u count=%u\n", bno, count);
+    if ((bno > bc->blockmax) || ((bc->blockmax - bno) < count)) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    if (readblks(bc->fd, bno, count, data) < 0) {
+        return ERR_IO;
+    }
+    mtx_lock(&bc->lock);
+    for (uint32_t n = 0; n < count; n++) {
+        block_t* blk;
+        if (((blk = bcache_lookup(bc, bno + n)) != NULL) && !(blk->flags & BLOCK_LOADING)) {
+            memcpy(data + n * bc->blocksize, blk->data, bc->blocksize);
+        }
+    }
+    mtx_unlock(&bc->lock);
+    return NO_ERROR;
+}
+
 mx_status_t bcache_sync(bcache_t* bc) {
-    return fsync(bc->fd);
+    mx_status_t status = bcache_flush(bc);
+    if (fsync(bc->fd) < 0) {
+        status = ERR_IO;
+    }
+    return status;
 }
 
 int bcache_create(bcache_t** out, int fd, uint32_t blockmax, uint32_t blocksize, uint32_t num) {
@@ -214,6 +544,20 @@ int bcache_create(bcache_t** out, int fd, uint32_t blockmax, uint32_t blocksize,
     bc->fd = fd;
     bc->blockmax = blockmax;
     bc->blocksize = blocksize;
+    if (((bc->cluster = malloc(BCACHE_CLUSTER * blocksize)) == NULL) ||
+        ((bc->flushbuf = malloc(BCACHE_CLUSTER * blocksize)) == NULL) ||
+        ((bc->fetchbuf = malloc(BCACHE_CLUSTER * blocksize)) == NULL) ||
+        ((bc->sorted = malloc(num * sizeof(block_t*))) == NULL)) {
+        free(bc->cluster);
+        free(bc->flushbuf);
+        free(bc->fetchbuf);
+        free(bc);
+        return -1;
+    }
+    mtx_init(&bc->lock, mtx_plain);
+    mtx_init(&bc->flush_lock, mtx_plain);
+    cnd_init(&bc->wake);
+    cnd_init(&bc->loaded);
     list_initialize(&bc->list_busy);
     list_initialize(&bc->list_dirty);
     list_initialize(&bc->list_lru);
@@ -231,14 +575,34 @@ int bcache_create(bcache_t** out, int fd, uint32_t blockmax, uint32_t blocksize,
             break;
         }
         list_add_tail(&bc->list_free, &blk->listnode);
+        bc->nblocks++;
         num--;
     }
+    bc->watermark = bc->nblocks / 2;
+#ifdef __Fuchsia__
+    thrd_t t;
+    if (thrd_create_with_name(&t, bcache_worker, bc, "minfs-bcache") == thrd_success) {
+        thrd_detach(t);
+    } else {
+        error("minfs: no bcache worker, flushing only when full\n");
+    }
+#endif
     *out = bc;
     return 0;
 }
 
 int bcache_close(bcache_t* bc) {
-    return close(bc->fd);
+    if (bcache_flush(bc) < 0) {
+        error("minfs: cannot write back the cache before closing\n");
+    }
+    mtx_lock(&bc->flush_lock);
+    mtx_lock(&bc->lock);
+    int r = close(bc->fd);
+    bc->fd = -1;
+    mtx_unlock(&bc->lock);
+    mtx_unlock(&bc->flush_lock);
+    cnd_signal(&bc->wake);
+    return r;
 }
 
 #ifndef __Fuchsia__
@@ -19,6 +19,7 @@ mx_status_t bitmap_init(bitmap_t* bm, uint32_t max) {
     // ensure there's space for all the bits
     bm->bitcount = max;
     bm->mapcount = (max + 63) / 64;
+    bm->setcount = 0;
 
     // round the allocated buffer size to a fs block size to ensure
     // that we don't partially write a block out
@@ -28,7 +29,25 @@ mx_status_t bitmap_init(bitmap_t* bm, uint32_t max) {
     if ((bm->map = calloc(1, size)) == NULL) {
         return ERR_NO_MEMORY;
     }
-    bm->end = bm->map + bm->mapcount;
+
+    // a level of summary for every 64-fold, up to a single word
+    uint32_t words = bm->mapcount;
+    size_t total = 0;
+    bm->levels = 0;
+    do {
+        words = (words + 63) / 64;
+        bm->fullcount[bm->levels++] = words;
+        total += words;
+    } while ((words > 1) && (bm->levels < BITMAP_LEVELS));
+    uint64_t* full;
+    if ((full = calloc(total, sizeof(uint64_t))) == NULL) {
+        free(bm->map);
+        return ERR_NO_MEMORY;
+    }
+    for (uint32_t l = 0; l < bm->levels; l++) {
+        bm->full[l] = full;
+        full += bm->fullcount[l];
+    }
     return NO_ERROR;
 }
 
@@ -42,34 +61,110 @@ mx_status_t bitmap_resize(bitmap_t* bm, uint32_t max) {
 
 void bitmap_destroy(bitmap_t* bm) {
     free(bm->map);
+    free(bm->full[0]);
+}
+
+void bitmap_word_full(bitmap_t* bm, uint32_t word) {
+    for (uint32_t l = 0; l < bm->levels; l++) {
+        uint64_t* sw = &bm->full[l][word >> 6];
+        *sw |= 1ULL << (word & 63);
+        if (*sw != ~0ULL) {
+            break;
+        }
+        word >>= 6;
+    }
+}
+
+void bitmap_word_freed(bitmap_t* bm, uint32_t word) {
+    for (uint32_t l = 0; l < bm->levels; l++) {
+        uint64_t* sw = &bm->full[l][word >> 6];
+        uint64_t bit = 1ULL << (word & 63);
+        if ((*sw & bit) == 0) {
+            // so the levels above weren't full either
+            break;
+        }
+        *sw &= ~bit;
+        word >>= 6;
+    }
+}
+
+void bitmap_summarize(bitmap_t* bm) {
+    for (uint32_t l = 0; l < bm->levels; l++) {
+        memset(bm->full[l], 0, bm->fullcount[l] * sizeof(uint64_t));
+    }
+    bm->setcount = 0;
+    for (uint32_t n = 0; n < bm->mapcount; n++) {
+        bm->setcount += __builtin_popcountll(bm->map[n]);
+        if (bm->map[n] == ~0ULL) {
+            bitmap_word_full(bm, n);
+        }
+    }
 }
 
 static void bitmap_zero(bitmap_t* bm) {
-    memset(bm->map, 0, bm->bitcount / 8);
+    memset(bm->map, 0, bm->mapcount * sizeof(uint64_t));
+    bitmap_summarize(bm);
+}
+
+// Find the first clear bit at or after n at level l, where level 0 is
+// the map itself and level l + 1 is full[l].  Runs of full words are
+// skipped by asking the level above for the next one that isn't.
+static uint32_t find_clear(bitmap_t* bm, uint32_t l, uint32_t n) {
+    uint64_t* bits = (l == 0) ? bm->map : bm->full[l - 1];
+    uint32_t words = (l == 0) ? bm->mapcount : bm->fullcount[l - 1];
+    while ((n >> 6) < words) {
+        uint32_t w = n >> 6;
+        uint64_t v = bits[w] | ((1ULL << (n & 63)) - 1);
+        if (v != ~0ULL) {
+            return (w << 6) + __builtin_ctzll(~v);
+        }
+        if (l == bm->levels) {
+            n = (w + 1) << 6;
+            continue;
+        }
+        uint32_t next;
+        if ((next = find_clear(bm, l + 1, w + 1)) == BITMAP_FAIL) {
+            break;
+        }
+        n = next << 6;
+    }
+    return BITMAP_FAIL;
 }
 
 // minbit specifies a bit number which is the minimum to allocate at
 // to avoid making all allocations suffer, we round to the nearest
 // multiple of the sub-bitmap storage unit (a uint64_t).
 uint32_t bitmap_alloc(bitmap_t* bm, uint32_t minbit) {
-    uint64_t* bits = bm->map + ((minbit + 63) >> 6);
-    uint64_t* end = bm->end;
-    while (bits < end) {
-        uint64_t v = *bits;
-        uint32_t n;
-        if ((n = __builtin_ffsll(~v)) != 0) {
-            n--;
-            uint32_t ret = ((bits - bm->map) << 6) + n;
-            // If this is end-1, and the map is full
-            // we might attempt to use a bit past the
-            // end.  Ensure that we do not.
-            if (ret >= bm->bitcount) {
+    uint32_t word = (minbit >> 6) + ((minbit & 63) != 0);
+    if (word >= bm->mapcount) {
+        return BITMAP_FAIL;
+    }
+    uint32_t n = find_clear(bm, 0, word << 6);
+    // If the map is full we might find a bit past the
+    // end of it.  Ensure that we do not use it.
+    if ((n == BITMAP_FAIL) || (n >= bm->bitcount)) {
+        return BITMAP_FAIL;
+    }
+    bitmap_set(bm, n);
+    return n;
+}
+
+uint32_t bitmap_find_run(bitmap_t* bm, uint32_t minbit, uint32_t count) {
+    uint32_t n = minbit;
+    while ((n = find_clear(bm, 0, n)) != BITMAP_FAIL) {
+        if ((count > bm->bitcount) || (n > bm->bitcount - count)) {
+            break;
+        }
+        uint32_t i;
+        for (i = 1; i < count; i++) {
+            if (bitmap_get(bm, n + i)) {
                 break;
             }
-            *bits = v | (1ULL << n);
-            return ret;
         }
-        bits++;
+        if (i == count) {
+            return n;
+        }
+        n += i + 1;
     }
     return BITMAP_FAIL;
 }
@@ -117,10 +212,47 @@ int do_bitmap_test(void) {
     for (n = 0; n < 10; n++) {
         bm.map[n] = -1;
     }
+    bitmap_summarize(&bm);
     FAIL_IF(bitmap_alloc(&bm, 0) != 640);
+    FAIL_IF(bm.setcount != 641);
+
+    bitmap_clr(&bm, 700);
+    bitmap_set(&bm, 650);
+    FAIL_IF(bitmap_find_run(&bm, 0, 8) != 641);
+    FAIL_IF(bitmap_find_run(&bm, 641, 10) != 651);
+    FAIL_IF(bitmap_find_run(&bm, 1000, 24) != 1000);
+    FAIL_IF(bitmap_find_run(&bm, 1000, 25) != BITMAP_FAIL);
+    FAIL_IF(bm.setcount != 642);
 
     memset(bm.map, 0xFF, bm.bitcount / 8);
+    bitmap_summarize(&bm);
+    FAIL_IF(bitmap_alloc(&bm, 0) != BITMAP_FAIL);
+    bitmap_destroy(&bm);
+
+    // large enough for three levels of summary, with the only
+    // free bits far apart
+    const uint32_t big = 64 * 64 * 64 * 3 + 100;
+    if (bitmap_init(&bm, big)) {
+        error("init failed\n");
+        return -1;
+    }
+    FAIL_IF(bm.levels != 3);
+    for (n = 0; n < big; n++) {
+        FAIL_IF(bitmap_alloc(&bm, 0) != n);
+    }
     FAIL_IF(bitmap_alloc(&bm, 0) != BITMAP_FAIL);
+    bitmap_clr(&bm, big - 1);
+    bitmap_clr(&bm, 64 * 64 * 64 + 7);
+    bitmap_clr(&bm, 5);
+    FAIL_IF(bitmap_alloc(&bm, 0) != 5);
+    FAIL_IF(bitmap_alloc(&bm, 6) != 64 * 64 * 64 + 7);
+    FAIL_IF(bitmap_alloc(&bm, 0) != big - 1);
+    FAIL_IF(bitmap_alloc(&bm, 0) != BITMAP_FAIL);
+    bitmap_clr(&bm, 64 * 64 + 1);
+    FAIL_IF(bitmap_alloc(&bm, 64 * 64 + 2) != BITMAP_FAIL);
+    FAIL_IF(bitmap_alloc(&bm, 64 * 64) != 64 * 64 + 1);
+
+    bitmap_destroy(&bm);
 
     warn("bitmap: ok\n");
     return 0;
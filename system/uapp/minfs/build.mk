@@ -18,7 +18,7 @@ LFLAGS += -Wl,-wrap,lseek -Wl,-wrap,rename
 
 SRCS += main.c wrap.c test.c
 SRCS += bitmap.c bcache.c
-SRCS += minfs.c minfs-ops.c minfs-check.c
+SRCS += minfs.c minfs-ops.c minfs-extent.c minfs-check.c
 LIBFS_SRCS += vfs.c
 
 OBJS := $(patsubst %.c,$(BUILDDIR)/host/system/uapp/minfs/%.o,$(SRCS))
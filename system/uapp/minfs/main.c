@@ -22,6 +22,9 @@ int do_minfs_mount(bcache_t* bc, int argc, char** argv) {
     if (minfs_mount(&vn, bc) < 0) {
         return -1;
     }
+    if (vcache_init(0) < 0) {
+        warn("minfs: page cache won't give way under memory pressure\n");
+    }
     vfs_rpc_server(vn);
     return 0;
 }
@@ -233,7 +236,16 @@ found:
 
     for (unsigned i = 0; i < sizeof(CMDS) / sizeof(CMDS[0]); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
-            return CMDS[i].func(bc, argc - 3, argv + 3);
+            int r = CMDS[i].func(bc, argc - 3, argv + 3);
+#ifndef __Fuchsia__
+            // and the inodes it left dirty, if it mounted the filesystem
+            if (fake_root != NULL) {
+                minfs_write_inodes(fake_root->fs);
+            }
+#endif
+            // write back whatever the command left in the cache
+            bcache_sync(bc);
+            return r;
         }
     }
     return -1;
@@ -5,32 +5,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include "minfs-private.h"
 
 #define VERBOSE 1
 
+// The blocks of in-use inodes are checked by this many threads at once,
+// each handed an inode block's worth of inodes at a time in turn.
+#define CHECK_THREADS 4
+#define CHECK_CHUNK MINFS_INODES_PER_BLOCK
+
 typedef struct check {
     bitmap_t checked_inodes;
     bitmap_t checked_blocks;
+    // the whole inode table, read in up front
+    minfs_inode_t* inodes;
 } check_t;
 
 static mx_status_t check_inode(check_t* chk, minfs_t* fs, uint32_t ino, uint32_t parent);
 
-static mx_status_t get_inode(minfs_t* fs, minfs_inode_t* inode, uint32_t ino) {
+static bool inode_magic_ok(const minfs_inode_t* inode) {
+    return (inode->magic == MINFS_MAGIC_FILE) || (inode->magic == MINFS_MAGIC_DIR);
+}
+
+static mx_status_t get_inode(check_t* chk, minfs_t* fs, minfs_inode_t* inode, uint32_t ino) {
     if (ino >= fs->info.inode_count) {
         error("check: ino %u out of range (>=%u)\n",
               ino, fs->info.inode_count);
         return ERR_OUT_OF_RANGE;
     }
-    mx_status_t status;
-    uint32_t bno_of_ino = fs->info.ino_block + ino / MINFS_INODES_PER_BLOCK;
-    uint32_t off_of_ino = (ino % MINFS_INODES_PER_BLOCK) * MINFS_INODE_SIZE;
-    if ((status = bcache_read(fs->bc, bno_of_ino, inode, off_of_ino, MINFS_INODE_SIZE)) < 0) {
-        return status;
-    }
-    if ((inode->magic != MINFS_MAGIC_FILE) && (inode->magic != MINFS_MAGIC_DIR)) {
+    memcpy(inode, chk->inodes + ino, sizeof(minfs_inode_t));
+    if (!inode_magic_ok(inode)) {
         error("check: ino %u has bad magic %#x\n", ino, inode->magic);
         return ERR_IO_DATA_INTEGRITY;
     }
@@ -41,6 +48,10 @@ static mx_status_t get_inode(minfs_t* fs, minfs_inode_t* inode, uint32_t ino) {
 #define CD_RECURSE 2
 
 static mx_status_t get_inode_nth_bno(minfs_t* fs, minfs_inode_t* inode, uint32_t n, uint32_t* bno_out) {
+    if (minfs_extents(fs)) {
+        uint32_t run;
+        return minfs_extent_map(fs, inode, n, bno_out, &run);
+    }
     if (n < MINFS_DIRECT) {
         *bno_out = inode->dnum[n];
         return NO_ERROR;
@@ -69,13 +80,54 @@ static mx_status_t get_inode_nth_bno(minfs_t* fs, minfs_inode_t* inode, uint32_t
     return NO_ERROR;
 }
 
+// every dirent has a slot in the index, pointing at a dirent block
+static mx_status_t check_index(minfs_t* fs, minfs_inode_t* inode, uint32_t ino) {
+    uint32_t live = 0;
+    uint32_t used = 0;
+    for (uint32_t n = 0; n < inode->dix_blocks; n++) {
+        uint32_t bno;
+        mx_status_t status;
+        if (((status = get_inode_nth_bno(fs, inode, MINFS_DIX_START + n, &bno)) < 0) ||
+            (bno == 0)) {
+            error("check: ino#%u: index block %u missing\n", ino, n);
+            return (status < 0) ? status : ERR_IO_DATA_INTEGRITY;
+        }
+        minfs_dix_slot_t slots[MINFS_DIX_SLOTS];
+        if ((status = bcache_read(fs->bc, bno, slots, 0, MINFS_BLOCK_SIZE)) < 0) {
+            error("check: ino#%u: failed to read index block %u (bno=%u)\n", ino, n, bno);
+            return status;
+        }
+        for (uint32_t i = 0; i < MINFS_DIX_SLOTS; i++) {
+            if (slots[i].block == 0) {
+                continue;
+            }
+            used++;
+            if (slots[i].block == MINFS_DIX_DELETED) {
+                continue;
+            }
+            live++;
+            if (slots[i].block > inode->size / MINFS_BLOCK_SIZE) {
+                warn("check: ino#%u: index slot %u points past the dirents\n",
+                     ino, n * (uint32_t) MINFS_DIX_SLOTS + i);
+            }
+        }
+    }
+    if (live != inode->dirent_count) {
+        warn("check: ino#%u: index has %u dirents, not %u\n", ino, live, inode->dirent_count);
+    }
+    if (used != inode->dix_used) {
+        warn("check: ino#%u: index has %u slots used, not %u\n", ino, used, inode->dix_used);
+    }
+    return NO_ERROR;
+}
+
 static mx_status_t check_directory(check_t* chk, minfs_t* fs, minfs_inode_t* inode,
                                    uint32_t ino, uint32_t parent, uint32_t flags) {
     unsigned eno = 0;
     bool dot = false;
     bool dotdot = false;
     uint32_t dirent_count = 0;
-    for (unsigned n = 0; n < inode->block_count; n++) {
+    for (unsigned n = 0; n < inode->size / MINFS_BLOCK_SIZE; n++) {
         uint32_t bno;
         mx_status_t status;
         if ((status = get_inode_nth_bno(fs, inode, n, &bno)) < 0) {
@@ -142,6 +194,12 @@ static mx_status_t check_directory(check_t* chk, minfs_t* fs, minfs_inode_t* ino
             error("check: ino#%u: blk=%u bno=%u dir block not full\n", ino, n, bno);
         }
     }
+    if (inode->dix_blocks) {
+        mx_status_t status;
+        if ((status = check_index(fs, inode, ino)) < 0) {
+            return status;
+        }
+    }
     if (dirent_count != inode->dirent_count) {
         error("check: ino#%u: dirent_count of %u != %u (actual)\n",
               ino, inode->dirent_count, dirent_count);
@@ -172,8 +230,50 @@ const char* check_data_block(check_t* chk, minfs_t* fs, uint32_t bno) {
     return NULL;
 }
 
-mx_status_t check_file(check_t* chk, minfs_t* fs,
-                       minfs_inode_t* inode, uint32_t ino) {
+// count and sanity-check the blocks of an extent inode,
+// returning the file block past the last one mapped in *max
+static mx_status_t check_extents(check_t* chk, minfs_t* fs, minfs_inode_t* inode,
+                                 uint32_t ino, uint32_t* blocks, uint32_t* max) {
+    const char* msg;
+    if (inode->ext_block) {
+        if ((msg = check_data_block(chk, fs, inode->ext_block)) != NULL) {
+            warn("check: ino#%u: extent block @%u: %s\n", ino, inode->ext_block, msg);
+        }
+        (*blocks)++;
+    }
+    *max = 0;
+    for (uint32_t n = 0;;) {
+        mx_status_t status;
+        uint32_t bno, run;
+        if ((status = minfs_extent_map(fs, inode, n, &bno, &run)) < 0) {
+            error("check: ino#%u: bad extents\n", ino);
+            return status;
+        }
+        if (run == 0) {
+            break;
+        }
+        if (bno) {
+            for (uint32_t i = 0; i < run; i++) {
+                if ((msg = check_data_block(chk, fs, bno + i)) != NULL) {
+                    warn("check: ino#%u: block %u(@%u): %s\n", ino, n + i, bno + i, msg);
+                }
+            }
+            *blocks += run;
+            if ((inode->magic != MINFS_MAGIC_DIR) || (n < MINFS_DIX_START)) {
+                *max = n + run;
+            } else if (n + run > MINFS_DIX_START + inode->dix_blocks) {
+                warn("check: ino#%u: blocks past the directory index\n", ino);
+            }
+        }
+        n += run;
+    }
+    return NO_ERROR;
+}
+
+// count and sanity-check the blocks of a direct/indirect inode,
+// returning the file block past the last one mapped in *max
+static mx_status_t check_blocks(check_t* chk, minfs_t* fs, minfs_inode_t* inode,
+                                uint32_t ino, uint32_t* blocks, uint32_t* max) {
 #if VERBOSE
     for (unsigned n = 0; n < MINFS_DIRECT; n++) {
         info("%d, ", inode->dnum[n]);
@@ -181,8 +281,6 @@ mx_status_t check_file(check_t* chk, minfs_t* fs,
     info("...\n");
 #endif
 
-    uint32_t blocks = 0;
-
     // count and sanity-check indirect blocks
     for (unsigned n = 0; n < MINFS_INDIRECT; n++) {
         if (inode->inum[n]) {
@@ -191,13 +289,11 @@ mx_status_t check_file(check_t* chk, minfs_t* fs,
                 warn("check: ino#%u: indirect block %u(@%u): %s\n",
                      ino, n, inode->inum[n], msg);
             }
-            blocks++;
+            (*blocks)++;
         }
     }
 
     // count and sanity-check data blocks
-
-    unsigned max = 0;
     for (unsigned n = 0;;n++) {
         mx_status_t status;
         uint32_t bno;
@@ -209,14 +305,31 @@ mx_status_t check_file(check_t* chk, minfs_t* fs,
             }
         }
         if (bno) {
-            blocks++;
+            (*blocks)++;
             const char* msg;
             if ((msg = check_data_block(chk, fs, bno)) != NULL) {
                 warn("check: ino#%u: block %u(@%u): %s\n", ino, n, bno, msg);
             }
-            max = n + 1;
+            *max = n + 1;
         }
     }
+    return NO_ERROR;
+}
+
+mx_status_t check_file(check_t* chk, minfs_t* fs,
+                       minfs_inode_t* inode, uint32_t ino) {
+    uint32_t blocks = 0;
+    uint32_t max = 0;
+    mx_status_t status;
+    if (minfs_extents(fs)) {
+        status = check_extents(chk, fs, inode, ino, &blocks, &max);
+    } else {
+        status = check_blocks(chk, fs, inode, ino, &blocks, &max);
+    }
+    if (status < 0) {
+        return status;
+    }
+
     if (max) {
         unsigned sizeblocks = inode->size / MINFS_BLOCK_SIZE;
         if (sizeblocks > max) {
@@ -236,25 +349,28 @@ mx_status_t check_file(check_t* chk, minfs_t* fs,
     return NO_ERROR;
 }
 
+// The blocks of in-use inodes have all been checked by the time the tree is
+// walked, so only the ones a directory refers to that aren't in use are here.
 mx_status_t check_inode(check_t* chk, minfs_t* fs, uint32_t ino, uint32_t parent) {
     if (bitmap_get(&chk->checked_inodes, ino)) {
         // we've been here before
         return NO_ERROR;
     }
     bitmap_set(&chk->checked_inodes, ino);
-    if (!bitmap_get(&fs->inode_map, ino)) {
+    bool inuse = bitmap_get(&fs->inode_map, ino);
+    if (!inuse) {
         warn("check: ino#%u: not marked in-use\n", ino);
     }
     mx_status_t status;
     minfs_inode_t inode;
-    if ((status = get_inode(fs, &inode, ino)) < 0) {
+    if ((status = get_inode(chk, fs, &inode, ino)) < 0) {
         error("check: ino#%u: not readable\n", ino);
         return status;
     }
     if (inode.magic == MINFS_MAGIC_DIR) {
         info("ino#%u: DIR blks=%u links=%u\n",
              ino, inode.block_count, inode.link_count);
-        if ((status = check_file(chk, fs, &inode, ino)) < 0) {
+        if (!inuse && ((status = check_file(chk, fs, &inode, ino)) < 0)) {
             return status;
         }
 #if VERBOSE
@@ -268,13 +384,91 @@ mx_status_t check_inode(check_t* chk, minfs_t* fs, uint32_t ino, uint32_t parent
     } else {
         info("ino#%u: FILE blks=%u links=%u size=%u\n",
              ino, inode.block_count, inode.link_count, inode.size);
-        if ((status = check_file(chk, fs, &inode, ino)) < 0) {
+        if (!inuse && ((status = check_file(chk, fs, &inode, ino)) < 0)) {
             return status;
         }
     }
     return NO_ERROR;
 }
 
+typedef struct check_thread {
+    // sharing the inode table, but with blocks of its own
+    check_t chk;
+    minfs_t* fs;
+    uint32_t first;
+    mx_status_t status;
+    thrd_t t;
+    bool running;
+} check_thread_t;
+
+// Check the blocks of the in-use inodes in every CHECK_THREADS'th chunk,
+// starting from the first'th.  Ones with bad magic are left to the tree walk
+// to complain about, if anything refers to them.
+static int check_blocks_thread(void* arg) {
+    check_thread_t* ct = arg;
+    minfs_t* fs = ct->fs;
+    uint32_t count = fs->info.inode_count;
+    for (uint32_t base = ct->first * CHECK_CHUNK; base < count;
+         base += CHECK_THREADS * CHECK_CHUNK) {
+        for (uint32_t ino = base; (ino < base + CHECK_CHUNK) && (ino < count); ino++) {
+            minfs_inode_t* inode = ct->chk.inodes + ino;
+            if ((ino == 0) || !bitmap_get(&fs->inode_map, ino) || !inode_magic_ok(inode)) {
+                continue;
+            }
+            if ((ct->status = check_file(&ct->chk, fs, inode, ino)) < 0) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+// Fold a thread's blocks into chk's.  Any it shares with another thread are
+// in use by two inodes.
+static void check_merge_blocks(check_t* chk, check_t* other) {
+    uint64_t* map = chk->checked_blocks.map;
+    const uint64_t* omap = other->checked_blocks.map;
+    for (uint32_t w = 0; w < chk->checked_blocks.mapcount; w++) {
+        for (uint64_t dup = map[w] & omap[w]; dup != 0; dup &= dup - 1) {
+            warn("check: block @%u: double-allocated\n",
+                 w * 64 + (uint32_t) __builtin_ctzll(dup));
+        }
+        map[w] |= omap[w];
+    }
+}
+
+static mx_status_t check_all_blocks(check_t* chk, minfs_t* fs) {
+    check_thread_t ct[CHECK_THREADS];
+    uint32_t n;
+    mx_status_t status = NO_ERROR;
+    for (n = 0; n < CHECK_THREADS; n++) {
+        ct[n].chk.inodes = chk->inodes;
+        ct[n].fs = fs;
+        ct[n].first = n;
+        ct[n].status = NO_ERROR;
+        if ((status = bitmap_init(&ct[n].chk.checked_blocks, fs->info.block_count)) < 0) {
+            break;
+        }
+        ct[n].running = (thrd_create(&ct[n].t, check_blocks_thread, &ct[n]) == thrd_success);
+        if (!ct[n].running) {
+            // do this share here instead
+            check_blocks_thread(&ct[n]);
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (ct[i].running) {
+            thrd_join(ct[i].t, NULL);
+        }
+        if ((status == NO_ERROR) && (ct[i].status < 0)) {
+            status = ct[i].status;
+        }
+        check_merge_blocks(chk, &ct[i].chk);
+        bitmap_destroy(&ct[i].chk.checked_blocks);
+    }
+    bitmap_summarize(&chk->checked_blocks);
+    return status;
+}
+
 mx_status_t minfs_check(bcache_t* bc) {
     mx_status_t status;
 
@@ -303,8 +497,26 @@ mx_status_t minfs_check(bcache_t* bc) {
         return -1;
     }
 
+    // every inode gets looked at, so read them all in one go
+    uint32_t inoblks = (info.inode_count + MINFS_INODES_PER_BLOCK - 1) / MINFS_INODES_PER_BLOCK;
+    if ((chk.inodes = malloc((size_t) inoblks * MINFS_BLOCK_SIZE)) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    if ((status = bcache_read_blocks(bc, info.ino_block, inoblks, chk.inodes)) < 0) {
+        error("check: failed reading inode table\n");
+        free(chk.inodes);
+        return status;
+    }
+
+    if ((status = check_all_blocks(&chk, fs)) < 0) {
+        free(chk.inodes);
+        return status;
+    }
+
     //TODO: check root not a directory
-    if ((status = check_inode(&chk, fs, 1, 1)) < 0) {
+    status = check_inode(&chk, fs, 1, 1);
+    free(chk.inodes);
+    if (status < 0) {
         return status;
     }
 
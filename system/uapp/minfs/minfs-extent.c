@@ -0,0 +1,197 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "minfs-private.h"
+
+// Get the table the inode's extents are in, and how many it can hold.
+// If that's the extent block, *blk is set and must be bcache_put().
+static minfs_extent_t* ext_table(minfs_t* fs, minfs_inode_t* inode,
+                                 block_t** blk, uint32_t* max) {
+    minfs_extent_t* ext;
+    if (inode->ext_block == 0) {
+        *blk = NULL;
+        *max = MINFS_INODE_EXTENTS;
+        ext = inode->ext;
+    } else {
+        if ((*blk = bcache_get(fs->bc, inode->ext_block, (void**) &ext)) == NULL) {
+            error("minfs: cannot read extent block @%u\n", inode->ext_block);
+            return NULL;
+        }
+        *max = MINFS_BLOCK_EXTENTS;
+    }
+    if (inode->ext_count > *max) {
+        error("minfs: %u extents, room for %u\n", inode->ext_count, *max);
+        if (*blk != NULL) {
+            bcache_put(fs->bc, *blk, 0);
+        }
+        return NULL;
+    }
+    return ext;
+}
+
+static void ext_table_put(minfs_t* fs, block_t* blk, uint32_t flags) {
+    if (blk != NULL) {
+        bcache_put(fs->bc, blk, flags);
+    }
+}
+
+// index of the first extent that ends past file block n,
+// which is the one holding n, if any does
+static uint32_t ext_find(const minfs_extent_t* ext, uint32_t count, uint32_t n) {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ext[mid].fbn + ext[mid].count <= n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+mx_status_t minfs_extent_map(minfs_t* fs, minfs_inode_t* inode, uint32_t n,
+                             uint32_t* bno, uint32_t* run) {
+    block_t* blk;
+    uint32_t max;
+    minfs_extent_t* ext;
+    if ((ext = ext_table(fs, inode, &blk, &max)) == NULL) {
+        return ERR_IO;
+    }
+    uint32_t i = ext_find(ext, inode->ext_count, n);
+    if (i == inode->ext_count) {
+        *bno = 0;
+        *run = 0;
+    } else if (ext[i].fbn <= n) {
+        *bno = ext[i].bno + (n - ext[i].fbn);
+        *run = ext[i].fbn + ext[i].count - n;
+    } else {
+        *bno = 0;
+        *run = ext[i].fbn - n;
+    }
+    ext_table_put(fs, blk, 0);
+    return NO_ERROR;
+}
+
+uint32_t minfs_extent_hint(minfs_t* fs, minfs_inode_t* inode, uint32_t n) {
+    block_t* blk;
+    uint32_t max;
+    minfs_extent_t* ext;
+    if ((ext = ext_table(fs, inode, &blk, &max)) == NULL) {
+        return 0;
+    }
+    uint32_t hint = 0;
+    uint32_t i = ext_find(ext, inode->ext_count, n);
+    if (i > 0) {
+        // leave room for any hole in between to be filled in later
+        hint = ext[i - 1].bno + (n - ext[i - 1].fbn);
+    }
+    ext_table_put(fs, blk, 0);
+    return hint;
+}
+
+mx_status_t minfs_extent_add(minfs_t* fs, minfs_inode_t* inode, uint32_t n, uint32_t bno) {
+    block_t* blk;
+    uint32_t max;
+    minfs_extent_t* ext;
+    if ((ext = ext_table(fs, inode, &blk, &max)) == NULL) {
+        return ERR_IO;
+    }
+    uint32_t count = inode->ext_count;
+    uint32_t i = ext_find(ext, count, n);
+    if ((i < count) && (ext[i].fbn <= n)) {
+        ext_table_put(fs, blk, 0);
+        return ERR_ALREADY_EXISTS;
+    }
+
+    // grow the extents on either side where bno continues them
+    bool after = (i > 0) && (ext[i - 1].fbn + ext[i - 1].count == n) &&
+                 (ext[i - 1].bno + ext[i - 1].count == bno);
+    bool before = (i < count) && (ext[i].fbn == n + 1) && (ext[i].bno == bno + 1);
+    if (after && before) {
+        ext[i - 1].count += 1 + ext[i].count;
+        memmove(&ext[i], &ext[i + 1], (count - i - 1) * sizeof(minfs_extent_t));
+        memset(&ext[count - 1], 0, sizeof(minfs_extent_t));
+        inode->ext_count--;
+    } else if (after) {
+        ext[i - 1].count++;
+    } else if (before) {
+        ext[i].fbn--;
+        ext[i].bno--;
+        ext[i].count++;
+    } else {
+        if (count == max) {
+            if (blk != NULL) {
+                ext_table_put(fs, blk, 0);
+                return ERR_NO_RESOURCES;
+            }
+            // the inode is full, move the extents to a block of their own
+            uint32_t ebno;
+            minfs_extent_t* eext;
+            if ((blk = minfs_new_block(fs, 0, &ebno, (void**) &eext)) == NULL) {
+                return ERR_NO_RESOURCES;
+            }
+            memcpy(eext, inode->ext, sizeof(inode->ext));
+            memset(inode->ext, 0, sizeof(inode->ext));
+            inode->ext_block = ebno;
+            inode->block_count++;
+            ext = eext;
+        }
+        memmove(&ext[i + 1], &ext[i], (count - i) * sizeof(minfs_extent_t));
+        ext[i].fbn = n;
+        ext[i].bno = bno;
+        ext[i].count = 1;
+        inode->ext_count++;
+    }
+    ext_table_put(fs, blk, BLOCK_DIRTY);
+    return NO_ERROR;
+}
+
+mx_status_t minfs_extent_truncate(minfs_t* fs, minfs_inode_t* inode, uint32_t start,
+                                  minfs_release_t release, void* cookie) {
+    block_t* blk;
+    uint32_t max;
+    minfs_extent_t* ext;
+    if ((ext = ext_table(fs, inode, &blk, &max)) == NULL) {
+        return ERR_IO;
+    }
+    mx_status_t status = NO_ERROR;
+    uint32_t count = inode->ext_count;
+    uint32_t i = ext_find(ext, count, start);
+    // last to first, so that if a release fails, the extents up to the
+    // one that failed are still mapped
+    for (uint32_t j = count; j-- > i;) {
+        // the extent holding start, if any, keeps the blocks before it
+        uint32_t skip = (ext[j].fbn < start) ? (start - ext[j].fbn) : 0;
+        if ((status = release(cookie, ext[j].bno + skip, ext[j].count - skip)) < 0) {
+            break;
+        }
+        inode->block_count -= ext[j].count - skip;
+        if (skip > 0) {
+            ext[j].count = skip;
+        } else {
+            memset(&ext[j], 0, sizeof(minfs_extent_t));
+            inode->ext_count = j;
+        }
+    }
+    uint32_t keep = inode->ext_count;
+
+    if ((status == NO_ERROR) && (blk != NULL) && (keep <= MINFS_INODE_EXTENTS)) {
+        // what's left fits back in the inode
+        memcpy(inode->ext, ext, sizeof(inode->ext));
+        if ((status = release(cookie, inode->ext_block, 1)) == NO_ERROR) {
+            inode->ext_block = 0;
+            inode->block_count--;
+        } else {
+            memset(inode->ext, 0, sizeof(inode->ext));
+        }
+    }
+    ext_table_put(fs, blk, BLOCK_DIRTY);
+    return status;
+}
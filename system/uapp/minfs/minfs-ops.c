@@ -18,10 +18,22 @@
 
 // Allocate a new data block from the block bitmap.
 // Return the underlying block (obtained via bcache_get()).
-// If hint is nonzero it indicates which block number
-// to start the search for free blocks from.
+// If hint is nonzero it's the block number wanted, usually the one
+// after the previous block of the file, so files stay contiguous;
+// if that's taken the search for free blocks starts from there.
 block_t* minfs_new_block(minfs_t* fs, uint32_t hint, uint32_t* out_bno, void** bdata) {
-    uint32_t bno = bitmap_alloc(&fs->block_map, hint);
+    uint32_t bno;
+    if (minfs_free_blocks(fs) == 0) {
+        // what's left is spoken for by delayed writes
+        return NULL;
+    }
+    if ((hint >= fs->info.dat_block) && (hint < fs->info.block_count) &&
+        !bitmap_get(&fs->block_map, hint)) {
+        bitmap_set(&fs->block_map, hint);
+        bno = hint;
+    } else {
+        bno = bitmap_alloc(&fs->block_map, hint);
+    }
     if ((bno == BITMAP_FAIL) && (hint != 0)) {
         bno = bitmap_alloc(&fs->block_map, 0);
     }
@@ -91,6 +103,33 @@ static void put_bitmap_block(minfs_t* fs, gbb_ctxt_t* gbb) {
     }
 }
 
+typedef struct {
+    minfs_t* fs;
+    gbb_ctxt_t gbb;
+} release_ctxt_t;
+
+// minfs_release_t for freeing the blocks of truncated extents
+static mx_status_t release_blocks(void* cookie, uint32_t bno, uint32_t count) {
+    release_ctxt_t* rc = cookie;
+    mx_status_t status;
+    for (uint32_t n = bno; n < bno + count; n++) {
+        if ((status = get_bitmap_block(rc->fs, &rc->gbb, n)) < 0) {
+            return status;
+        }
+        bitmap_clr(&rc->fs->block_map, n);
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t vn_extents_shrink(vnode_t* vn, minfs_inode_t* inode, uint32_t start) {
+    release_ctxt_t rc;
+    memset(&rc, 0, sizeof(rc));
+    rc.fs = vn->fs;
+    mx_status_t status = minfs_extent_truncate(vn->fs, inode, start, release_blocks, &rc);
+    put_bitmap_block(vn->fs, &rc.gbb);
+    return status;
+}
+
 static mx_status_t minfs_inode_destroy(vnode_t* vn) {
     mx_status_t status;
     minfs_inode_t inode;
@@ -105,6 +144,10 @@ static mx_status_t minfs_inode_destroy(vnode_t* vn) {
     minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
     minfs_ino_free(vn->fs, vn->ino);
 
+    if (minfs_extents(vn->fs)) {
+        return vn_extents_shrink(vn, &inode, 0);
+    }
+
     // release all direct blocks
     for (unsigned n = 0; n < MINFS_DIRECT; n++) {
         if (inode.dnum[n] == 0) {
@@ -157,6 +200,12 @@ static mx_status_t vn_blocks_shrink(vnode_t* vn, uint32_t start) {
     gbb_ctxt_t gbb;
     memset(&gbb, 0, sizeof(gbb));
 
+    if (minfs_extents(vn->fs)) {
+        status = vn_extents_shrink(vn, &vn->inode, start);
+        minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+        return status;
+    }
+
     // release direct blocks
     for (unsigned bno = start; bno < MINFS_DIRECT; bno++) {
         if (vn->inode.dnum[bno] == 0) {
@@ -237,19 +286,52 @@ static mx_status_t vn_blocks_shrink(vnode_t* vn, uint32_t start) {
     return NO_ERROR;
 }
 
+static block_t* vn_get_extent_block(vnode_t* vn, uint32_t n, void** bdata, bool alloc) {
+    uint32_t bno, run;
+    if (minfs_extent_map(vn->fs, &vn->inode, n, &bno, &run) < 0) {
+        return NULL;
+    }
+    if (bno != 0) {
+        return bcache_get(vn->fs->bc, bno, bdata);
+    }
+    if (!alloc) {
+        return NULL;
+    }
+    uint32_t hint = minfs_extent_hint(vn->fs, &vn->inode, n);
+    block_t* blk;
+    if ((blk = minfs_new_block(vn->fs, hint, &bno, bdata)) == NULL) {
+        return NULL;
+    }
+    mx_status_t status;
+    if ((status = minfs_extent_add(vn->fs, &vn->inode, n, bno)) < 0) {
+        error("minfs: cannot map block %u of ino#%u: %d\n", n, vn->ino, status);
+        bcache_put(vn->fs->bc, blk, 0);
+        release_ctxt_t rc;
+        memset(&rc, 0, sizeof(rc));
+        rc.fs = vn->fs;
+        release_blocks(&rc, bno, 1);
+        put_bitmap_block(vn->fs, &rc.gbb);
+        return NULL;
+    }
+    vn->inode.block_count++;
+    minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+    return blk;
+}
+
 // Obtain the nth block of a vnode.
 // If alloc is true, allocate that block if it doesn't already exist.
 static block_t* vn_get_block(vnode_t* vn, uint32_t n, void** bdata, bool alloc) {
-#if 0
-    uint32_t hint = ((vn->fs->info.block_count - vn->fs->info.dat_block) / 256) * (vn->ino % 256);
-#else
-    uint32_t hint = 0;
-#endif
+    if (minfs_extents(vn->fs)) {
+        return vn_get_extent_block(vn, n, bdata, alloc);
+    }
+
     // direct blocks are simple... is there an entry in dnum[]?
     if (n < MINFS_DIRECT) {
         uint32_t bno;
         if ((bno = vn->inode.dnum[n]) == 0) {
             if (alloc) {
+                // try to follow on from the block before
+                uint32_t hint = (n > 0 && vn->inode.dnum[n - 1]) ? vn->inode.dnum[n - 1] + 1 : 0;
                 block_t* blk = minfs_new_block(vn->fs, hint, &bno, bdata);
                 if (blk != NULL) {
                     vn->inode.dnum[n] = bno;
@@ -305,7 +387,9 @@ static block_t* vn_get_block(vnode_t* vn, uint32_t n, void** bdata, bool alloc)
     block_t* blk = NULL;
     if ((bno = ientry[j]) == 0) {
         if (alloc) {
-            // allocate a new block
+            // allocate a new block, following on from the one before
+            // where that's in the same indirect block
+            uint32_t hint = (j > 0 && ientry[j - 1]) ? ientry[j - 1] + 1 : 0;
             blk = minfs_new_block(vn->fs, hint, &bno, bdata);
             if (blk != NULL) {
                 vn->inode.block_count++;
@@ -335,6 +419,151 @@ static inline void vn_put_block_dirty(vnode_t* vn, block_t* blk) {
     bcache_put(vn->fs->bc, blk, BLOCK_DIRTY);
 }
 
+// Writes into holes in regular files on extent volumes are buffered in
+// the vnode, up to this many consecutive file blocks, and only given
+// device blocks when the run is flushed, so that they can be allocated
+// together and the bitmap and extents updated once for all of them.
+#define MINFS_DELALLOC_MAX 32
+
+static void* vn_delalloc_find(vnode_t* vn, uint32_t n) {
+    if ((n >= vn->da_start) && (n < vn->da_start + vn->da_count)) {
+        return vn->da_data + (n - vn->da_start) * MINFS_BLOCK_SIZE;
+    }
+    return NULL;
+}
+
+// write out the bitmap blocks covering [bno, bno + count)
+static mx_status_t commit_bitmap(minfs_t* fs, uint32_t bno, uint32_t count) {
+    gbb_ctxt_t gbb;
+    memset(&gbb, 0, sizeof(gbb));
+    mx_status_t status = NO_ERROR;
+    for (uint32_t n = bno; n < bno + count; n++) {
+        if ((status = get_bitmap_block(fs, &gbb, n)) < 0) {
+            break;
+        }
+    }
+    put_bitmap_block(fs, &gbb);
+    return status;
+}
+
+// Allocate device blocks for the delayed run, in as few runs of them as
+// the free space allows, and move its data into the cache.
+static mx_status_t vn_delalloc_flush(vnode_t* vn) {
+    if (vn->da_count == 0) {
+        return NO_ERROR;
+    }
+    minfs_t* fs = vn->fs;
+    fs->reserved -= vn->da_count;
+
+    mx_status_t status = NO_ERROR;
+    uint32_t done = 0;
+    while (done < vn->da_count) {
+        uint32_t n = vn->da_start + done;
+        uint32_t want = vn->da_count - done;
+        uint32_t hint = minfs_extent_hint(fs, &vn->inode, n);
+        if (hint < fs->info.dat_block) {
+            hint = fs->info.dat_block;
+        }
+        // continuing the file's last extent if possible, else the first
+        // gap big enough, settling for shorter runs when there's none
+        uint32_t bno;
+        while (((bno = bitmap_find_run(&fs->block_map, hint, want)) == BITMAP_FAIL) &&
+               ((bno = bitmap_find_run(&fs->block_map, fs->info.dat_block, want)) == BITMAP_FAIL) &&
+               (want > 1)) {
+            want /= 2;
+        }
+        if (bno == BITMAP_FAIL) {
+            status = ERR_NO_RESOURCES;
+            break;
+        }
+        for (uint32_t i = 0; i < want; i++) {
+            bitmap_set(&fs->block_map, bno + i);
+        }
+        if ((status = commit_bitmap(fs, bno, want)) < 0) {
+            break;
+        }
+
+        uint32_t i;
+        for (i = 0; i < want; i++) {
+            block_t* blk;
+            void* bdata;
+            if ((blk = bcache_get_zero(fs->bc, bno + i, &bdata)) == NULL) {
+                status = ERR_IO;
+                break;
+            }
+            memcpy(bdata, vn->da_data + (done + i) * MINFS_BLOCK_SIZE, MINFS_BLOCK_SIZE);
+            if ((status = minfs_extent_add(fs, &vn->inode, n + i, bno + i)) < 0) {
+                bcache_put(fs->bc, blk, 0);
+                break;
+            }
+            bcache_put(fs->bc, blk, BLOCK_DIRTY);
+            vn->inode.block_count++;
+        }
+        done += i;
+        if (i < want) {
+            // give back what didn't get mapped
+            for (uint32_t j = i; j < want; j++) {
+                bitmap_clr(&fs->block_map, bno + j);
+            }
+            commit_bitmap(fs, bno + i, want - i);
+            break;
+        }
+    }
+    if (done < vn->da_count) {
+        error("minfs: ino#%u: lost %u delayed blocks: %d\n", vn->ino, vn->da_count - done, status);
+    }
+    vn->da_count = 0;
+    minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+    return status;
+}
+
+// drop the delayed run without writing it, for a file being destroyed
+static void vn_delalloc_discard(vnode_t* vn) {
+    vn->fs->reserved -= vn->da_count;
+    vn->da_count = 0;
+    free(vn->da_data);
+    vn->da_data = NULL;
+}
+
+// The buffer for file block n, if it's in the delayed run or is a hole
+// that can be added to it, else NULL for vn_get_block() to deal with.
+static void* vn_delalloc_block(vnode_t* vn, uint32_t n) {
+    void* bdata;
+    if ((bdata = vn_delalloc_find(vn, n)) != NULL) {
+        return bdata;
+    }
+    if (!minfs_extents(vn->fs) || (vn->inode.magic != MINFS_MAGIC_FILE)) {
+        return NULL;
+    }
+    uint32_t bno, run;
+    if ((minfs_extent_map(vn->fs, &vn->inode, n, &bno, &run) < 0) || (bno != 0)) {
+        return NULL;
+    }
+    if ((vn->da_count > 0) &&
+        ((n != vn->da_start + vn->da_count) || (vn->da_count == MINFS_DELALLOC_MAX))) {
+        // not an append to the run, start a new one
+        if (vn_delalloc_flush(vn) < 0) {
+            return NULL;
+        }
+    }
+    // leave a block over for the extent block the flush may need
+    if (minfs_free_blocks(vn->fs) <= 1) {
+        return NULL;
+    }
+    if ((vn->da_data == NULL) &&
+        ((vn->da_data = malloc(MINFS_DELALLOC_MAX * MINFS_BLOCK_SIZE)) == NULL)) {
+        return NULL;
+    }
+    if (vn->da_count == 0) {
+        vn->da_start = n;
+    }
+    bdata = vn->da_data + vn->da_count * MINFS_BLOCK_SIZE;
+    memset(bdata, 0, MINFS_BLOCK_SIZE);
+    vn->da_count++;
+    vn->fs->reserved++;
+    return bdata;
+}
+
 #define DIR_CB_DONE 0
 #define DIR_CB_NEXT 1
 #define DIR_CB_SAVE 2
@@ -346,6 +575,10 @@ typedef struct dir_args {
     uint32_t ino;
     uint32_t type;
     uint32_t reclen;
+    uint32_t block;     // set to the dirent block the callback finished in
+    minfs_dix_slot_t* dix;  // for indexing the dirents
+    uint32_t dix_count;
+    uint32_t dix_max;
 } dir_args_t;
 
 static mx_status_t cb_dir_find(vnode_t* vndir, minfs_dirent_t* de, dir_args_t* args) {
@@ -492,62 +725,376 @@ static mx_status_t cb_dir_append(vnode_t* vndir, minfs_dirent_t* de, dir_args_t*
     return DIR_CB_SAVE_SYNC;
 }
 
-static mx_status_t vn_dir_for_each(vnode_t* vn, dir_args_t* args,
-                                   mx_status_t (*func)(vnode_t*, minfs_dirent_t*, dir_args_t*)) {
-    for (unsigned n = 0; n < vn->inode.block_count; n++) {
-        block_t* blk;
-        void* data;
-        if ((blk = vn_get_block(vn, n, &data, false)) == NULL) {
-            error("vn_dir: vn=%p missing block %u\n", vn, n);
-            return ERR_NOT_FOUND;
-        }
-        uint32_t size = MINFS_BLOCK_SIZE;
-        minfs_dirent_t* de = data;
-        while (size > MINFS_DIRENT_SIZE) {
-            //fprintf(stderr,"DE ino=%u rlen=%u nlen=%u\n", de->ino, de->reclen, de->namelen);
-            uint32_t rlen = de->reclen;
-            if ((rlen > size) || (rlen & 3)) {
-                error("vn_dir: vn=%p bad reclen %u > %u\n", vn, rlen, size);
+typedef mx_status_t (*dir_cb_t)(vnode_t*, minfs_dirent_t*, dir_args_t*);
+
+// Run func over the dirents of block n of a directory.
+static mx_status_t vn_dir_block(vnode_t* vn, uint32_t n, dir_args_t* args, dir_cb_t func) {
+    block_t* blk;
+    void* data;
+    if ((blk = vn_get_block(vn, n, &data, false)) == NULL) {
+        error("vn_dir: vn=%p missing block %u\n", vn, n);
+        return ERR_NOT_FOUND;
+    }
+    uint32_t size = MINFS_BLOCK_SIZE;
+    minfs_dirent_t* de = data;
+    while (size > MINFS_DIRENT_SIZE) {
+        //fprintf(stderr,"DE ino=%u rlen=%u nlen=%u\n", de->ino, de->reclen, de->namelen);
+        uint32_t rlen = de->reclen;
+        if ((rlen > size) || (rlen & 3)) {
+            error("vn_dir: vn=%p bad reclen %u > %u\n", vn, rlen, size);
+            break;
+        }
+        if (de->ino != 0) {
+            if ((de->namelen == 0) || (de->namelen > (rlen - MINFS_DIRENT_SIZE))) {
+                error("vn_dir: vn=%p bad namelen %u / %u\n", vn, de->namelen, rlen);
                 break;
             }
-            if (de->ino != 0) {
-                if ((de->namelen == 0) || (de->namelen > (rlen - MINFS_DIRENT_SIZE))) {
-                    error("vn_dir: vn=%p bad namelen %u / %u\n", vn, de->namelen, rlen);
-                    break;
+        }
+        mx_status_t status;
+        switch ((status = func(vn, de, args))) {
+        case DIR_CB_NEXT:
+            break;
+        case DIR_CB_SAVE:
+            args->block = n;
+            vn_put_block_dirty(vn, blk);
+            return NO_ERROR;
+        case DIR_CB_SAVE_SYNC:
+            args->block = n;
+            vn->inode.seq_num++;
+            vn_put_block_dirty(vn, blk);
+            minfs_sync_vnode(vn, MX_FS_SYNC_MTIME);
+            return NO_ERROR;
+        case DIR_CB_DONE:
+        default:
+            args->block = n;
+            vn_put_block(vn, blk);
+            return status;
+        }
+        de = ((void*) de) + rlen;
+        size -= rlen;
+    }
+    vn_put_block(vn, blk);
+    return ERR_NOT_FOUND;
+}
+
+// Directory index slots are read and written through a cursor that
+// holds on to the index block of the last slot.
+typedef struct {
+    block_t* blk;
+    uint32_t n;
+    uint32_t flags;
+    minfs_dix_slot_t* slots;
+} dix_cursor_t;
+
+static void dix_put(vnode_t* vn, dix_cursor_t* c) {
+    if (c->blk != NULL) {
+        bcache_put(vn->fs->bc, c->blk, c->flags);
+        c->blk = NULL;
+        c->flags = 0;
+    }
+}
+
+static minfs_dix_slot_t* dix_get(vnode_t* vn, dix_cursor_t* c, uint32_t slot) {
+    uint32_t n = slot / MINFS_DIX_SLOTS;
+    if ((c->blk == NULL) || (c->n != n)) {
+        dix_put(vn, c);
+        if ((c->blk = vn_get_block(vn, MINFS_DIX_START + n, (void**) &c->slots, false)) == NULL) {
+            error("minfs: ino#%u: missing index block %u\n", vn->ino, n);
+            return NULL;
+        }
+        c->n = n;
+    }
+    return &c->slots[slot % MINFS_DIX_SLOTS];
+}
+
+// Put (hash, block) in the first free or deleted slot of its chain.
+static mx_status_t dix_store(vnode_t* vn, dix_cursor_t* c, uint32_t hash, uint32_t block) {
+    uint32_t mask = vn->inode.dix_blocks * MINFS_DIX_SLOTS - 1;
+    for (uint32_t i = 0; i <= mask; i++) {
+        minfs_dix_slot_t* slot;
+        if ((slot = dix_get(vn, c, (hash + i) & mask)) == NULL) {
+            return ERR_IO;
+        }
+        if ((slot->block == 0) || (slot->block == MINFS_DIX_DELETED)) {
+            if (slot->block == 0) {
+                vn->inode.dix_used++;
+            }
+            slot->hash = hash;
+            slot->block = block + 1;
+            c->flags = BLOCK_DIRTY;
+            return NO_ERROR;
+        }
+    }
+    return ERR_NO_RESOURCES;
+}
+
+static mx_status_t cb_dix_collect(vnode_t* vndir, minfs_dirent_t* de, dir_args_t* args) {
+    if (de->ino != 0) {
+        if (args->dix_count == args->dix_max) {
+            error("minfs: ino#%u: more dirents than dirent_count\n", vndir->ino);
+            return ERR_BAD_STATE;
+        }
+        args->dix[args->dix_count].hash = fnv1a32(de->name, de->namelen);
+        args->dix[args->dix_count].block = args->block;
+        args->dix_count++;
+    }
+    return DIR_CB_NEXT;
+}
+
+// (Re)build the index of a directory with nblocks of slots, no fewer than
+// it has, from the old index if there is one, or else from the dirents.
+static mx_status_t dix_rebuild(vnode_t* vn, uint32_t nblocks) {
+    uint32_t max = vn->inode.dirent_count;
+    minfs_dix_slot_t* live;
+    if ((live = malloc((max + 1) * sizeof(minfs_dix_slot_t))) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status = NO_ERROR;
+    uint32_t count = 0;
+    dix_cursor_t c;
+    memset(&c, 0, sizeof(c));
+    if (vn->inode.dix_blocks == 0) {
+        dir_args_t args = {
+            .dix = live,
+            .dix_max = max,
+        };
+        for (uint32_t n = 0; n < vn->inode.size / MINFS_BLOCK_SIZE; n++) {
+            args.block = n;
+            if ((status = vn_dir_block(vn, n, &args, cb_dix_collect)) != ERR_NOT_FOUND) {
+                goto done;
+            }
+        }
+        status = NO_ERROR;
+        count = args.dix_count;
+    } else {
+        for (uint32_t i = 0; i < vn->inode.dix_blocks * MINFS_DIX_SLOTS; i++) {
+            minfs_dix_slot_t* slot;
+            if ((slot = dix_get(vn, &c, i)) == NULL) {
+                status = ERR_IO;
+                goto done;
+            }
+            if ((slot->block != 0) && (slot->block != MINFS_DIX_DELETED)) {
+                if (count == max) {
+                    status = ERR_BAD_STATE;
+                    goto done;
                 }
+                live[count].hash = slot->hash;
+                live[count++].block = slot->block - 1;
             }
+        }
+        dix_put(vn, &c);
+    }
+
+    // clear the new table, reusing the blocks of the old one
+    for (uint32_t n = 0; n < nblocks; n++) {
+        block_t* blk;
+        void* bdata;
+        if ((blk = vn_get_block(vn, MINFS_DIX_START + n, &bdata, true)) == NULL) {
+            status = ERR_NO_RESOURCES;
+            goto done;
+        }
+        memset(bdata, 0, MINFS_BLOCK_SIZE);
+        vn_put_block_dirty(vn, blk);
+    }
+    vn->inode.dix_blocks = nblocks;
+    vn->inode.dix_used = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((status = dix_store(vn, &c, live[i].hash, live[i].block)) < 0) {
+            break;
+        }
+    }
+done:
+    dix_put(vn, &c);
+    free(live);
+    minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+    return status;
+}
+
+// index blocks for a directory of count dirents, half full at most
+static uint32_t dix_size(uint32_t count) {
+    uint32_t nblocks = 1;
+    while (nblocks * MINFS_DIX_SLOTS < 2 * count) {
+        nblocks *= 2;
+    }
+    return nblocks;
+}
+
+// index the dirent for args->name, just added in args->block
+static mx_status_t dix_insert(vnode_t* vn, dir_args_t* args) {
+    mx_status_t status;
+    uint32_t slots = vn->inode.dix_blocks * MINFS_DIX_SLOTS;
+    if ((vn->inode.dix_used + 1) * 4 > slots * 3) {
+        // too full, or too many deleted slots lengthening the chains
+        uint32_t nblocks = dix_size(vn->inode.dirent_count);
+        if (nblocks < vn->inode.dix_blocks) {
+            nblocks = vn->inode.dix_blocks;
+        }
+        if ((status = dix_rebuild(vn, nblocks)) < 0) {
+            return status;
+        }
+    }
+    dix_cursor_t c;
+    memset(&c, 0, sizeof(c));
+    status = dix_store(vn, &c, fnv1a32(args->name, args->len), args->block);
+    dix_put(vn, &c);
+    minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+    return status;
+}
+
+// drop the index slot of the dirent for args->name, just removed from args->block
+static mx_status_t dix_remove(vnode_t* vn, dir_args_t* args) {
+    uint32_t hash = fnv1a32(args->name, args->len);
+    uint32_t mask = vn->inode.dix_blocks * MINFS_DIX_SLOTS - 1;
+    dix_cursor_t c;
+    memset(&c, 0, sizeof(c));
+    mx_status_t status = ERR_NOT_FOUND;
+    for (uint32_t i = 0; i <= mask; i++) {
+        minfs_dix_slot_t* slot;
+        if ((slot = dix_get(vn, &c, (hash + i) & mask)) == NULL) {
+            status = ERR_IO;
+            break;
+        }
+        if (slot->block == 0) {
+            break;
+        }
+        if ((slot->hash == hash) && (slot->block == args->block + 1)) {
+            slot->block = MINFS_DIX_DELETED;
+            c.flags = BLOCK_DIRTY;
+            status = NO_ERROR;
+            break;
+        }
+    }
+    dix_put(vn, &c);
+    return status;
+}
+
+// Run func over the dirents of the blocks the index has args->name in.
+static mx_status_t vn_dir_lookup(vnode_t* vn, dir_args_t* args, dir_cb_t func) {
+    uint32_t hash = fnv1a32(args->name, args->len);
+    uint32_t mask = vn->inode.dix_blocks * MINFS_DIX_SLOTS - 1;
+    dix_cursor_t c;
+    memset(&c, 0, sizeof(c));
+    for (uint32_t i = 0; i <= mask; i++) {
+        minfs_dix_slot_t* slot;
+        if ((slot = dix_get(vn, &c, (hash + i) & mask)) == NULL) {
+            return ERR_IO;
+        }
+        if (slot->block == 0) {
+            break;
+        }
+        if ((slot->block != MINFS_DIX_DELETED) && (slot->hash == hash)) {
+            uint32_t block = slot->block - 1;
+            // the callback may change the directory, index included
+            dix_put(vn, &c);
             mx_status_t status;
-            switch ((status = func(vn, de, args))) {
-            case DIR_CB_NEXT:
-                break;
-            case DIR_CB_SAVE:
-                vn_put_block_dirty(vn, blk);
-                return NO_ERROR;
-            case DIR_CB_SAVE_SYNC:
-                vn->inode.seq_num++;
-                vn_put_block_dirty(vn, blk);
-                minfs_sync_vnode(vn, MX_FS_SYNC_MTIME);
-                return NO_ERROR;
-            case DIR_CB_DONE:
-            default:
-                vn_put_block(vn, blk);
+            if ((status = vn_dir_block(vn, block, args, func)) != ERR_NOT_FOUND) {
                 return status;
             }
-            de = ((void*) de) + rlen;
-            size -= rlen;
         }
-        vn_put_block(vn, blk);
     }
+    dix_put(vn, &c);
     return ERR_NOT_FOUND;
 }
 
+// Run func over the dirents of a directory until it's done with one,
+// or only over those that may have args->name, if there's an index.
+static mx_status_t vn_dir_for_each(vnode_t* vn, dir_args_t* args, dir_cb_t func) {
+    if (vn->inode.dix_blocks != 0) {
+        return vn_dir_lookup(vn, args, func);
+    }
+    for (unsigned n = 0; n < vn->inode.size / MINFS_BLOCK_SIZE; n++) {
+        mx_status_t status;
+        if ((status = vn_dir_block(vn, n, args, func)) != ERR_NOT_FOUND) {
+            return status;
+        }
+    }
+    return ERR_NOT_FOUND;
+}
+
+// Add an empty dirent block to the end of a directory, and an index if
+// it's the second block on a volume with extents.
+static mx_status_t vn_dir_grow(vnode_t* vn) {
+    uint32_t n = vn->inode.size / MINFS_BLOCK_SIZE;
+    block_t* blk;
+    void* bdata;
+    if ((n >= MINFS_DIX_START) ||
+        ((blk = vn_get_block(vn, n, &bdata, true)) == NULL)) {
+        return ERR_NO_RESOURCES;
+    }
+    minfs_dirent_t* de = bdata;
+    de->ino = 0;
+    de->reclen = MINFS_BLOCK_SIZE;
+    de->namelen = 0;
+    de->type = 0;
+    vn_put_block_dirty(vn, blk);
+    vn->inode.size += MINFS_BLOCK_SIZE;
+    minfs_sync_vnode(vn, MX_FS_SYNC_DEFAULT);
+
+    if (minfs_extents(vn->fs) && (vn->inode.dix_blocks == 0)) {
+        return dix_rebuild(vn, dix_size(vn->inode.dirent_count + 1));
+    }
+    return NO_ERROR;
+}
+
+// Add the dirent described by args to a directory.  Indexed directories
+// aren't searched for room: the dirent goes where one was last removed,
+// or at the end.
+static mx_status_t vn_dir_append(vnode_t* vn, dir_args_t* args) {
+    mx_status_t status = ERR_NOT_FOUND;
+    uint32_t last = vn->inode.size / MINFS_BLOCK_SIZE - 1;
+    if (vn->inode.dix_blocks == 0) {
+        status = vn_dir_for_each(vn, args, cb_dir_append);
+    } else {
+        if (vn->dir_hint < last) {
+            status = vn_dir_block(vn, vn->dir_hint, args, cb_dir_append);
+        }
+        if (status == ERR_NOT_FOUND) {
+            status = vn_dir_block(vn, last, args, cb_dir_append);
+        }
+    }
+    if (status == ERR_NOT_FOUND) {
+        if ((status = vn_dir_grow(vn)) < 0) {
+            return status;
+        }
+        status = vn_dir_block(vn, last + 1, args, cb_dir_append);
+    }
+    if (status < 0) {
+        return status;
+    }
+    vn->dir_hint = args->block;
+    if (vn->inode.dix_blocks != 0) {
+        return dix_insert(vn, args);
+    }
+    return NO_ERROR;
+}
+
+// Account for the dirent for args->name having been removed.
+static void vn_dir_removed(vnode_t* vn, dir_args_t* args) {
+    vn->dir_hint = args->block;
+    if ((vn->inode.dix_blocks != 0) && (dix_remove(vn, args) < 0)) {
+        error("minfs: ino#%u: '%.*s' missing from the index\n",
+              vn->ino, (int) args->len, args->name);
+    }
+}
+
 static void fs_release(vnode_t* vn) {
     trace(MINFS, "minfs_release() vn=%p(#%u)%s\n", vn, vn->ino,
           vn->inode.link_count ? "" : " link-count is zero");
     if (vn->inode.link_count == 0) {
+#ifdef __Fuchsia__
+        vcache_release(vn->cache);
+#endif
+        vn_delalloc_discard(vn);
         minfs_inode_destroy(vn);
+        // the zeroed inode can't wait for a vnode that's going away
+        minfs_write_inodes(vn->fs);
         list_delete(&vn->hashnode);
         free(vn);
+    } else {
+        // the last reference is gone, so is the reason to hold off
+        vn_delalloc_flush(vn);
+        free(vn->da_data);
+        vn->da_data = NULL;
     }
 }
 
@@ -568,25 +1115,114 @@ static mx_status_t fs_close(vnode_t* vn) {
 // due to the limitations of the inode and indirect blocks
 #define MAX_FILE_BLOCK (MINFS_DIRECT + MINFS_INDIRECT * (MINFS_BLOCK_SIZE / sizeof(uint32_t)))
 
-static ssize_t fs_read(vnode_t* vn, void* data, size_t len, size_t off) {
-    trace(MINFS, "minfs_read() vn=%p(#%u) len=%zd off=%zd\n", vn, vn->ino, len, off);
-    if (vn->inode.magic == MINFS_MAGIC_DIR) {
-        return ERR_NOT_FILE;
+// with extents, only the 32 bit file size limits it
+#define MAX_EXTENT_FILE_BLOCK (UINT32_MAX / MINFS_BLOCK_SIZE)
+
+static inline uint32_t vn_max_block(vnode_t* vn) {
+    return minfs_extents(vn->fs) ? MAX_EXTENT_FILE_BLOCK : MAX_FILE_BLOCK;
+}
+
+// file blocks to keep read in ahead of a sequential reader
+#define MINFS_READAHEAD 16
+
+// Finds the device blocks holding file blocks [n, n + count), 0 for holes,
+// without reading anything in: an indirect block that isn't cached yet is
+// prefetched itself and the mapping stops short of it.  Returns how many
+// blocks were mapped.
+static uint32_t vn_map_blocks(vnode_t* vn, uint32_t n, uint32_t count, uint32_t* bnos) {
+    const uint32_t direct_per_indirect = MINFS_BLOCK_SIZE / sizeof(uint32_t);
+    uint32_t done = 0;
+    if (minfs_extents(vn->fs)) {
+        while (done < count) {
+            uint32_t bno, run;
+            if (minfs_extent_map(vn->fs, &vn->inode, n, &bno, &run) < 0) {
+                break;
+            }
+            if ((run == 0) || (run > count - done)) {
+                run = count - done;
+            }
+            for (uint32_t i = 0; i < run; i++) {
+                bnos[done++] = (bno != 0) ? bno + i : 0;
+            }
+            n += run;
+        }
+        return done;
+    }
+    while ((done < count) && (n < MINFS_DIRECT)) {
+        bnos[done++] = vn->inode.dnum[n++];
+    }
+    while ((done < count) && (n < MAX_FILE_BLOCK)) {
+        uint32_t i = (n - MINFS_DIRECT) / direct_per_indirect;
+        uint32_t j = (n - MINFS_DIRECT) % direct_per_indirect;
+        uint32_t ibno = vn->inode.inum[i];
+        if (ibno == 0) {
+            for (; (done < count) && (j < direct_per_indirect); j++, n++) {
+                bnos[done++] = 0;
+            }
+            continue;
+        }
+        block_t* iblk;
+        uint32_t* ientry;
+        if ((iblk = bcache_get_cached(vn->fs->bc, ibno, (void**) &ientry)) == NULL) {
+            bcache_prefetch(vn->fs->bc, &ibno, 1);
+            break;
+        }
+        for (; (done < count) && (j < direct_per_indirect); j++, n++) {
+            bnos[done++] = ientry[j];
+        }
+        bcache_put(vn->fs->bc, iblk, 0);
     }
+    return done;
+}
 
-    // clip to EOF
-    if (off >= vn->inode.size) {
-        return 0;
+// Keeps the MINFS_READAHEAD file blocks past [n, last] on their way into
+// the cache when a read starts where the previous one ended.
+static void vn_readahead(vnode_t* vn, uint32_t n, uint32_t last) {
+    if (n != vn->ra_next) {
+        // a seek, start over
+        vn->ra_end = 0;
+        return;
     }
-    if (len > (vn->inode.size - off)) {
-        len = vn->inode.size - off;
+    if (vn->ra_end >= last + 1 + MINFS_READAHEAD / 2) {
+        return;
     }
+    uint32_t start = (vn->ra_end > last + 1) ? vn->ra_end : last + 1;
+    uint32_t end = last + 1 + MINFS_READAHEAD;
+    uint32_t eof = (vn->inode.size + MINFS_BLOCK_SIZE - 1) / MINFS_BLOCK_SIZE;
+    if (end > eof) {
+        end = eof;
+    }
+    if (end > vn_max_block(vn)) {
+        end = vn_max_block(vn);
+    }
+    if (start >= end) {
+        return;
+    }
+
+    uint32_t bnos[MINFS_READAHEAD];
+    uint32_t mapped = vn_map_blocks(vn, start, end - start, bnos);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mapped; i++) {
+        if (bnos[i] != 0) {
+            bnos[count++] = bnos[i];
+        }
+    }
+    if (count > 0) {
+        bcache_prefetch(vn->fs->bc, bnos, count);
+    }
+    vn->ra_end = start + mapped;
+}
 
+// Reads [off, off + len), within the file, from its blocks.
+static ssize_t vn_read(vnode_t* vn, void* data, size_t len, size_t off) {
     void* start = data;
     uint32_t n = off / MINFS_BLOCK_SIZE;
     size_t adjust = off % MINFS_BLOCK_SIZE;
 
-    while ((len > 0) && (n < MAX_FILE_BLOCK)) {
+    vn_readahead(vn, n, (off + len - 1) / MINFS_BLOCK_SIZE);
+    vn->ra_next = (off + len) / MINFS_BLOCK_SIZE;
+
+    while ((len > 0) && (n < vn_max_block(vn))) {
         size_t xfer;
         if (len > (MINFS_BLOCK_SIZE - adjust)) {
             xfer = MINFS_BLOCK_SIZE - adjust;
@@ -596,11 +1232,14 @@ static ssize_t fs_read(vnode_t* vn, void* data, size_t len, size_t off) {
 
         block_t* blk;
         void* bdata;
-        if ((blk = vn_get_block(vn, n, &bdata, true)) == NULL) {
+        if ((bdata = vn_delalloc_find(vn, n)) != NULL) {
+            memcpy(data, bdata + adjust, xfer);
+        } else if ((blk = vn_get_block(vn, n, &bdata, true)) != NULL) {
+            memcpy(data, bdata + adjust, xfer);
+            vn_put_block(vn, blk);
+        } else {
             break;
         }
-        memcpy(data, bdata + adjust, xfer);
-        vn_put_block(vn, blk);
 
         adjust = 0;
         len -= xfer;
@@ -610,6 +1249,55 @@ static ssize_t fs_read(vnode_t* vn, void* data, size_t len, size_t off) {
     return data - start;
 }
 
+#ifdef __Fuchsia__
+static ssize_t vn_cache_fill(void* cookie, void* data, size_t len, size_t off) {
+    return vn_read(cookie, data, len, off);
+}
+#endif
+
+static ssize_t fs_read(vnode_t* vn, void* data, size_t len, size_t off) {
+    trace(MINFS, "minfs_read() vn=%p(#%u) len=%zd off=%zd\n", vn, vn->ino, len, off);
+    if (vn->inode.magic == MINFS_MAGIC_DIR) {
+        return ERR_NOT_FILE;
+    }
+
+    // clip to EOF
+    if (off >= vn->inode.size) {
+        return 0;
+    }
+    if (len > (vn->inode.size - off)) {
+        len = vn->inode.size - off;
+    }
+
+#ifdef __Fuchsia__
+    return vcache_read(&vn->cache, vn->inode.size, data, len, off, vn_cache_fill, vn);
+#else
+    return vn_read(vn, data, len, off);
+#endif
+}
+
+#ifdef __Fuchsia__
+// called by the rpc server once it's done with a request on vn, so the
+// inodes a request changes make one trip through the cache
+void minfs_request_done(vnode_t* vn) {
+    minfs_write_inodes(vn->fs);
+}
+
+mx_handle_t minfs_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len) {
+    trace(MINFS, "minfs_get_vmo() vn=%p(#%u)\n", vn, vn->ino);
+    if (vn->inode.magic == MINFS_MAGIC_DIR) {
+        return ERR_NOT_FILE;
+    }
+    mx_handle_t vmo = vcache_get_vmo(&vn->cache, vn->inode.size, vn_cache_fill, vn);
+    if (vmo < 0) {
+        return vmo;
+    }
+    *off = 0;
+    *len = vn->inode.size;
+    return vmo;
+}
+#endif
+
 static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
     trace(MINFS, "minfs_write() vn=%p(#%u) len=%zd off=%zd\n", vn, vn->ino, len, off);
     if (vn->inode.magic == MINFS_MAGIC_DIR) {
@@ -623,7 +1311,7 @@ static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
     uint32_t n = off / MINFS_BLOCK_SIZE;
     size_t adjust = off % MINFS_BLOCK_SIZE;
 
-    while ((len > 0) && (n < MAX_FILE_BLOCK)) {
+    while ((len > 0) && (n < vn_max_block(vn))) {
         size_t xfer;
         if (len > (MINFS_BLOCK_SIZE - adjust)) {
             xfer = MINFS_BLOCK_SIZE - adjust;
@@ -633,11 +1321,14 @@ static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
 
         block_t* blk;
         void* bdata;
-        if ((blk = vn_get_block(vn, n, &bdata, true)) == NULL) {
+        if ((bdata = vn_delalloc_block(vn, n)) != NULL) {
+            memcpy(bdata + adjust, data, xfer);
+        } else if ((blk = vn_get_block(vn, n, &bdata, true)) != NULL) {
+            memcpy(bdata + adjust, data, xfer);
+            vn_put_block_dirty(vn, blk);
+        } else {
             break;
         }
-        memcpy(bdata + adjust, data, xfer);
-        vn_put_block_dirty(vn, blk);
 
         adjust = 0;
         len -= xfer;
@@ -651,6 +1342,9 @@ static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
         // return an error explicitly (rather than zero).
         return ERR_NO_RESOURCES;
     }
+#ifdef __Fuchsia__
+    vcache_write(vn->cache, vn->inode.size, start, len, off);
+#endif
     if ((off + len) > vn->inode.size) {
         vn->inode.size = off + len;
     }
@@ -827,8 +1521,7 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
     args.ino = vn->ino;
     args.type = type;
     args.reclen = SIZEOF_MINFS_DIRENT(len);
-    if ((status = vn_dir_for_each(vndir, &args, cb_dir_append)) < 0) {
-        //TODO: handle "block full" by creating a new directory block
+    if ((status = vn_dir_append(vndir, &args)) < 0) {
         error("minfs_create() dir append failed %d\n", status);
         return status;
     }
@@ -836,9 +1529,15 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
     if (type == MINFS_TYPE_DIR) {
         void* bdata;
         block_t* blk;
-        if ((blk = minfs_new_block(vndir->fs, 0, vn->inode.dnum + 0, &bdata)) == NULL) {
+        uint32_t bno;
+        if ((blk = minfs_new_block(vndir->fs, 0, &bno, &bdata)) == NULL) {
             panic("failed to create directory");
         }
+        if (minfs_extents(vndir->fs)) {
+            minfs_extent_add(vndir->fs, &vn->inode, 0, bno);
+        } else {
+            vn->inode.dnum[0] = bno;
+        }
         minfs_dir_init(bdata, vn->ino, vndir->ino);
         bcache_put(vndir->fs->bc, blk, BLOCK_DIRTY);
         vn->inode.block_count = 1;
@@ -881,7 +1580,11 @@ static mx_status_t fs_unlink(vnode_t* vn, const char* name, size_t len) {
         .name = name,
         .len = len,
     };
-    return vn_dir_for_each(vn, &args, cb_dir_unlink);
+    mx_status_t status;
+    if ((status = vn_dir_for_each(vn, &args, cb_dir_unlink)) == NO_ERROR) {
+        vn_dir_removed(vn, &args);
+    }
+    return status;
 }
 
 static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
@@ -889,7 +1592,11 @@ static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
         return ERR_NOT_FILE;
     }
 
-    mx_status_t r = 0;
+    // the delayed blocks get allocated first, for the rest to see them
+    mx_status_t r;
+    if ((r = vn_delalloc_flush(vn)) < 0) {
+        return r;
+    }
     if (len < vn->inode.size) {
         // Truncate should make the file shorter
         size_t bno = vn->inode.size / MINFS_BLOCK_SIZE;
@@ -918,10 +1625,13 @@ static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
             }
         }
         vn->inode.size = len;
+#ifdef __Fuchsia__
+        vcache_truncate(vn->cache, len);
+#endif
         minfs_sync_vnode(vn, MX_FS_SYNC_MTIME);
     } else if (len > vn->inode.size) {
         // Truncate should make the file longer, filled with zeroes.
-        if (MAX_FILE_BLOCK * MINFS_BLOCK_SIZE < len) {
+        if ((uint64_t) vn_max_block(vn) * MINFS_BLOCK_SIZE < len) {
             return ERR_INVALID_ARGS;
         }
         char zero = 0;
@@ -1002,7 +1712,7 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     if (status == ERR_NOT_FOUND) {
         // if 'newname' does not exist, create it
         args.reclen = SIZEOF_MINFS_DIRENT(newlen);
-        if ((status = vn_dir_for_each(newdir, &args, cb_dir_append)) < 0) {
+        if ((status = vn_dir_append(newdir, &args)) < 0) {
             goto done;
         }
         status = 0;
@@ -1039,14 +1749,32 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     // finally, remove oldname from its original position
     args.name = oldname;
     args.len = oldlen;
-    status = vn_dir_for_each(olddir, &args, cb_dir_force_unlink);
+    if ((status = vn_dir_for_each(olddir, &args, cb_dir_force_unlink)) == NO_ERROR) {
+        vn_dir_removed(olddir, &args);
+    }
 done:
     vn_release(oldvn);
     return status;
 }
 
 static mx_status_t fs_sync(vnode_t* vn) {
-    return bcache_sync(vn->fs->bc);
+    minfs_t* fs = vn->fs;
+    mx_status_t status = NO_ERROR;
+    for (unsigned n = 0; n < MINFS_BUCKETS; n++) {
+        vnode_t* v;
+        list_for_every_entry(fs->vnode_hash + n, v, vnode_t, hashnode) {
+            mx_status_t r;
+            if ((r = vn_delalloc_flush(v)) < 0) {
+                status = r;
+            }
+        }
+    }
+    minfs_write_inodes(fs);
+    mx_status_t r;
+    if ((r = bcache_sync(fs->bc)) < 0) {
+        status = r;
+    }
+    return status;
 }
 
 vnode_ops_t minfs_ops = {
@@ -19,6 +19,11 @@
 #define MX_FS_SYNC_MTIME (1<<0)
 #define MX_FS_SYNC_CTIME (1<<1)
 
+// minfs_sync_vnode() only puts the vnode on minfs_t.dirty_inodes, and
+// minfs_write_inodes() copies them into the inode table a block at a time.
+// Past this many, that happens right away.
+#define MINFS_DIRTY_INODES_MAX 64
+
 typedef struct minfs minfs_t;
 
 struct minfs {
@@ -28,7 +33,12 @@ struct minfs {
     uint32_t abmblks;
     uint32_t ibmblks;
     minfs_info_t info;
+    // blocks promised to writes that haven't been allocated yet
+    uint32_t reserved;
     list_node_t vnode_hash[MINFS_BUCKETS];
+    // vnodes whose inode has changed since it was last written
+    list_node_t dirty_inodes;
+    uint32_t dirty_inodes_count;
 };
 
 struct vnode {
@@ -40,7 +50,27 @@ struct vnode {
     uint32_t ino;
     uint32_t reserved;
 
+    // sequential read detection: where the next read would start if it
+    // followed the last one, and the file block read-ahead has reached
+    uint32_t ra_next;
+    uint32_t ra_end;
+
+    // directories: a block that had room for a dirent lately
+    uint32_t dir_hint;
+
+    // delayed allocation: file blocks [da_start, da_start + da_count)
+    // have been written but have no device blocks yet, their data is
+    // in da_data
+    uint32_t da_start;
+    uint32_t da_count;
+    void* da_data;
+
+    // files: the pages read through the VFS page cache, NULL until then
+    vcache_t* cache;
+
     list_node_t hashnode;
+    // on minfs_t.dirty_inodes, if it's there
+    list_node_t dirtynode;
 
     minfs_inode_t inode;
 };
@@ -62,9 +92,43 @@ block_t* minfs_new_block(minfs_t* fs, uint32_t hint, uint32_t* out_bno, void** b
 // free ino in inode bitmap
 mx_status_t minfs_ino_free(minfs_t* fs, uint32_t ino);
 
-// write the inode data of this vnode to disk (default does not update time values)
+// mark the inode data of this vnode for writing (default does not update time values)
 void minfs_sync_vnode(vnode_t* vn, uint32_t flags);
 
+// copy every dirty inode into its block of the inode table
+void minfs_write_inodes(minfs_t* fs);
+
+static inline bool minfs_extents(minfs_t* fs) {
+    return (fs->info.flags & MINFS_FLAG_EXTENTS) != 0;
+}
+
+// blocks neither allocated nor reserved
+static inline uint32_t minfs_free_blocks(minfs_t* fs) {
+    uint32_t used = fs->block_map.setcount + fs->reserved;
+    return (used < fs->info.block_count) ? (fs->info.block_count - used) : 0;
+}
+
+// Extents (minfs-extent.c), for file systems with MINFS_FLAG_EXTENTS.
+// None of these write the inode back; that's up to the caller.
+
+// find the device block of file block n, 0 for a hole, and in *run how
+// many file blocks from n on are mapped, or unmapped, the same way
+// (*run is 0 for the hole past the last extent)
+mx_status_t minfs_extent_map(minfs_t* fs, minfs_inode_t* inode, uint32_t n,
+                             uint32_t* bno, uint32_t* run);
+
+// where to allocate file block n so it continues the extent before it
+uint32_t minfs_extent_hint(minfs_t* fs, minfs_inode_t* inode, uint32_t n);
+
+// map the hole at file block n to bno
+mx_status_t minfs_extent_add(minfs_t* fs, minfs_inode_t* inode, uint32_t n, uint32_t bno);
+
+// unmap file blocks from start on, handing each run of device blocks
+// that's no longer used, the extent block included, to release()
+typedef mx_status_t (*minfs_release_t)(void* cookie, uint32_t bno, uint32_t count);
+mx_status_t minfs_extent_truncate(minfs_t* fs, minfs_inode_t* inode, uint32_t start,
+                                  minfs_release_t release, void* cookie);
+
 mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max);
 void minfs_dump_info(minfs_info_t* info);
 
@@ -80,6 +144,11 @@ mx_status_t minfs_mount(vnode_t** root_out, bcache_t* bc);
 
 mx_status_t minfs_unmount(minfs_t* fs);
 
+#ifdef __Fuchsia__
+// a read-only VMO holding the whole file, for MXRIO_MMAP
+mx_handle_t minfs_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len);
+#endif
+
 mx_status_t minfs_get_vnode(minfs_t* fs, vnode_t** out, uint32_t ino);
 
 void minfs_dir_init(void* bdata, uint32_t ino_self, uint32_t ino_parent);
@@ -18,6 +18,8 @@ void minfs_dump_info(minfs_info_t* info) {
     printf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     printf("minfs: inode table  @ %10u\n", info->ino_block);
     printf("minfs: data blocks  @ %10u\n", info->dat_block);
+    printf("minfs: block map:     %s\n",
+           (info->flags & MINFS_FLAG_EXTENTS) ? "extents" : "direct/indirect");
 }
 
 mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
@@ -30,6 +32,10 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: bad version %08x\n", info->version);
         return ERR_INVALID_ARGS;
     }
+    if (info->flags & ~(MINFS_FLAG_CLEAN | MINFS_FLAG_EXTENTS)) {
+        error("minfs: unknown flags %08x\n", info->flags);
+        return ERR_INVALID_ARGS;
+    }
     if ((info->block_size != MINFS_BLOCK_SIZE) ||
         (info->inode_size != MINFS_INODE_SIZE)) {
         error("minfs: bsz/isz %u/%u unsupported\n", info->block_size, info->inode_size);
@@ -52,10 +58,6 @@ static uint64_t minfs_current_utc_time(void) {
 }
 
 void minfs_sync_vnode(vnode_t* vn, uint32_t flags) {
-    // sync the data portion of the current vnode
-    block_t* blk;
-    void* bdata;
-
     // by default, c/mtimes are not updated to current time
     if (flags != MX_FS_SYNC_DEFAULT) {
         mx_time_t cur_time = minfs_current_utc_time();
@@ -69,15 +71,49 @@ void minfs_sync_vnode(vnode_t* vn, uint32_t flags) {
         // TODO(orr): no current support for atime
     }
 
-    uint32_t bno_of_ino = vn->fs->info.ino_block + (vn->ino / MINFS_INODES_PER_BLOCK);
-    uint32_t off_of_ino = (vn->ino % MINFS_INODES_PER_BLOCK) * MINFS_INODE_SIZE;
-
-    if ((blk = bcache_get(vn->fs->bc, bno_of_ino, &bdata)) == NULL) {
-        panic("failed sync vnode %p(#%u)", vn, vn->ino);
+    // the inode is copied out later, along with the others in its block
+    minfs_t* fs = vn->fs;
+    if (!list_in_list(&vn->dirtynode)) {
+        list_add_tail(&fs->dirty_inodes, &vn->dirtynode);
+        if (++fs->dirty_inodes_count >= MINFS_DIRTY_INODES_MAX) {
+            minfs_write_inodes(fs);
+        }
     }
+}
 
-    memcpy(bdata + off_of_ino, &vn->inode, MINFS_INODE_SIZE);
-    bcache_put(vn->fs->bc, blk, BLOCK_DIRTY);
+static int vnode_ino_cmp(const void* a, const void* b) {
+    uint32_t ino_a = (*(vnode_t* const*)a)->ino;
+    uint32_t ino_b = (*(vnode_t* const*)b)->ino;
+    return (ino_a > ino_b) - (ino_a < ino_b);
+}
+
+void minfs_write_inodes(minfs_t* fs) {
+    vnode_t* dirty[MINFS_DIRTY_INODES_MAX];
+    uint32_t count = 0;
+    vnode_t* vn;
+    while ((vn = list_remove_head_type(&fs->dirty_inodes, vnode_t, dirtynode)) != NULL) {
+        dirty[count++] = vn;
+    }
+    fs->dirty_inodes_count = 0;
+
+    // in inode order, so the inodes sharing a block are next to each other
+    qsort(dirty, count, sizeof(dirty[0]), vnode_ino_cmp);
+    uint32_t n = 0;
+    while (n < count) {
+        uint32_t bno_of_ino = fs->info.ino_block + (dirty[n]->ino / MINFS_INODES_PER_BLOCK);
+        block_t* blk;
+        void* bdata;
+        if ((blk = bcache_get(fs->bc, bno_of_ino, &bdata)) == NULL) {
+            panic("failed sync vnode %p(#%u)", dirty[n], dirty[n]->ino);
+        }
+        do {
+            uint32_t off_of_ino = (dirty[n]->ino % MINFS_INODES_PER_BLOCK) * MINFS_INODE_SIZE;
+            memcpy(bdata + off_of_ino, &dirty[n]->inode, MINFS_INODE_SIZE);
+            n++;
+        } while ((n < count) &&
+                 (fs->info.ino_block + (dirty[n]->ino / MINFS_INODES_PER_BLOCK) == bno_of_ino));
+        bcache_put(fs->bc, blk, BLOCK_DIRTY);
+    }
 }
 
 mx_status_t minfs_ino_free(minfs_t* fs, uint32_t ino) {
@@ -251,6 +287,7 @@ mx_status_t minfs_create(minfs_t** out, bcache_t* bc, minfs_info_t* info) {
     for (int n = 0; n < MINFS_BUCKETS; n++) {
         list_initialize(fs->vnode_hash + n);
     }
+    list_initialize(&fs->dirty_inodes);
     memcpy(&fs->info, info, sizeof(minfs_info_t));
     fs->bc = bc;
 
@@ -282,18 +319,17 @@ void minfs_destroy(minfs_t* fs) {
 }
 
 mx_status_t minfs_load_bitmaps(minfs_t* fs) {
-    for (uint32_t n = 0; n < fs->abmblks; n++) {
-        void* bmdata = minfs_bitmap_nth_block(&fs->block_map, n);
-        if (bcache_read(fs->bc, fs->info.abm_block + n, bmdata, 0, MINFS_BLOCK_SIZE)) {
-            error("minfs: failed reading alloc bitmap\n");
-        }
+    // the bitmaps' blocks are contiguous both on disk and in memory
+    if (bcache_read_blocks(fs->bc, fs->info.abm_block, fs->abmblks,
+                           minfs_bitmap_nth_block(&fs->block_map, 0)) < 0) {
+        error("minfs: failed reading alloc bitmap\n");
     }
-    for (uint32_t n = 0; n < fs->ibmblks; n++) {
-        void* bmdata = minfs_bitmap_nth_block(&fs->inode_map, n);
-        if (bcache_read(fs->bc, fs->info.ibm_block + n, bmdata, 0, MINFS_BLOCK_SIZE)) {
-            error("minfs: failed reading inode bitmap\n");
-        }
+    if (bcache_read_blocks(fs->bc, fs->info.ibm_block, fs->ibmblks,
+                           minfs_bitmap_nth_block(&fs->inode_map, 0)) < 0) {
+        error("minfs: failed reading inode bitmap\n");
     }
+    bitmap_summarize(&fs->block_map);
+    bitmap_summarize(&fs->inode_map);
     return NO_ERROR;
 }
 
@@ -328,6 +364,7 @@ mx_status_t minfs_mount(vnode_t** out, bcache_t* bc) {
 }
 
 mx_status_t minfs_unmount(minfs_t* fs) {
+    minfs_write_inodes(fs);
     return bcache_close(fs->bc);
 }
 
@@ -346,7 +383,7 @@ int minfs_mkfs(bcache_t* bc) {
     info.magic0 = MINFS_MAGIC0;
     info.magic1 = MINFS_MAGIC1;
     info.version = MINFS_VERSION;
-    info.flags = MINFS_FLAG_CLEAN;
+    info.flags = MINFS_FLAG_CLEAN | MINFS_FLAG_EXTENTS;
     info.block_size = MINFS_BLOCK_SIZE;
     info.inode_size = MINFS_INODE_SIZE;
     info.block_count = blocks;
@@ -417,7 +454,10 @@ int minfs_mkfs(bcache_t* bc) {
     ino[MINFS_ROOT_INO].block_count = 1;
     ino[MINFS_ROOT_INO].link_count = 1;
     ino[MINFS_ROOT_INO].dirent_count = 2;
-    ino[MINFS_ROOT_INO].dnum[0] = info.dat_block;
+    ino[MINFS_ROOT_INO].ext_count = 1;
+    ino[MINFS_ROOT_INO].ext[0].fbn = 0;
+    ino[MINFS_ROOT_INO].ext[0].bno = info.dat_block;
+    ino[MINFS_ROOT_INO].ext[0].count = 1;
     bcache_put(bc, blk, BLOCK_DIRTY);
 
     blk = bcache_get_zero(bc, 0, &bdata);
@@ -18,6 +18,7 @@
 
 #define MINFS_ROOT_INO       1
 #define MINFS_FLAG_CLEAN     1
+#define MINFS_FLAG_EXTENTS   2   // inodes map their data with extents
 #define MINFS_BLOCK_SIZE     8192
 #define MINFS_BLOCK_BITS     (MINFS_BLOCK_SIZE * 8)
 #define MINFS_INODE_SIZE     256
@@ -25,6 +26,7 @@
 
 #define MINFS_DIRECT         16
 #define MINFS_INDIRECT       32
+#define MINFS_INODE_EXTENTS  16
 
 #define MINFS_TYPE_FILE      8
 #define MINFS_TYPE_DIR       4
@@ -62,6 +64,16 @@ typedef struct {
 //     ino_block + ino / MINFS_INODES_PER_BLOCK
 //   at offset: ino % MINFS_INODES_PER_BLOCK
 // - inode 0 is never used, should be marked allocated but ignored
+// - with MINFS_FLAG_EXTENTS, inodes hold extents in place of the
+//   direct and indirect block tables
+
+typedef struct {
+    uint32_t fbn;                   // first file block
+    uint32_t bno;                   // first device block
+    uint32_t count;                 // blocks in the run
+} minfs_extent_t;
+
+#define MINFS_BLOCK_EXTENTS  (MINFS_BLOCK_SIZE / sizeof(minfs_extent_t))
 
 typedef struct {
     uint32_t magic;
@@ -73,9 +85,19 @@ typedef struct {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;           // for directories
-    uint32_t rsvd[5];
-    uint32_t dnum[MINFS_DIRECT];    // direct blocks
-    uint32_t inum[MINFS_INDIRECT];  // indirect blocks
+    uint32_t ext_count;             // extents in use
+    uint32_t ext_block;             // block holding the extents, once
+                                    // they no longer fit in the inode
+    uint32_t dix_blocks;            // directories: blocks of name index
+    uint32_t dix_used;              // directories: index slots not free
+    uint32_t rsvd[1];
+    union {
+        struct {
+            uint32_t dnum[MINFS_DIRECT];    // direct blocks
+            uint32_t inum[MINFS_INDIRECT];  // indirect blocks
+        };
+        minfs_extent_t ext[MINFS_INODE_EXTENTS];
+    };
 } minfs_inode_t;
 
 static_assert(sizeof(minfs_inode_t) == MINFS_INODE_SIZE,
@@ -91,6 +113,17 @@ typedef struct {
 
 #define MINFS_DIRENT_SIZE sizeof(minfs_dirent_t)
 
+// directory name index, on MINFS_FLAG_EXTENTS volumes
+#define MINFS_DIX_START      0x40000     // file block where it starts
+#define MINFS_DIX_DELETED    0xFFFFFFFF
+
+typedef struct {
+    uint32_t hash;                  // fnv1a32 of the name
+    uint32_t block;                 // dirent block holding it, plus one
+} minfs_dix_slot_t;
+
+#define MINFS_DIX_SLOTS      (MINFS_BLOCK_SIZE / sizeof(minfs_dix_slot_t))
+
 #define SIZEOF_MINFS_DIRENT(namelen) (MINFS_DIRENT_SIZE + ((namelen + 3) & (~3)))
 
 // Notes:
@@ -100,12 +133,26 @@ typedef struct {
 // - dirents with ino of 0 are freespace, and
 //   skipped over on lookup
 // - reclen must be a multiple of 4
+// - once a directory on a volume with extents grows past its first
+//   block, it gets an index: a hash table with linear probing of
+//   dix_blocks (a power of two) blocks from file block MINFS_DIX_START
+//   on, with a slot for each dirent; block 0 marks an empty slot and
+//   MINFS_DIX_DELETED a deleted one
+// - the dirent blocks stay as they are, so a directory can always be
+//   read linearly
 
 
 // blocksize   8K    16K    32K
 // 16 dir =  128K   256K   512K
 // 32 ind =  512M  1024M  2048M
 
+// Notes on extents:
+// - extents are kept sorted by fbn and don't overlap, file blocks
+//   outside of all of them are holes
+// - up to MINFS_INODE_EXTENTS live in the inode itself; past that
+//   they all move to ext_block, which holds MINFS_BLOCK_EXTENTS
+// - ext_block counts towards the inode's block_count
+
 //  1GB ->  128K blocks ->  16K bitmap (2K qword)
 //  4GB ->  512K blocks ->  64K bitmap (8K qword)
 // 32GB -> 4096K blocks -> 512K bitmap (64K qwords)
@@ -114,12 +161,21 @@ typedef struct {
 
 // Allocation Bitmap (bitmap.c)
 
+// Over the map there are levels of summary bits, so allocation
+// doesn't have to scan every word: bit n of full[0] is set when
+// map[n] has no bits free, and bit n of full[l] is set when
+// full[l - 1][n] is all ones.  The last level is a single word.
+#define BITMAP_LEVELS 6
+
 typedef struct bitmap bitmap_t;
 struct bitmap {
     uint32_t bitcount;
     uint32_t mapcount;
+    uint32_t setcount;
     uint64_t *map;
-    uint64_t *end;
+    uint32_t levels;
+    uint32_t fullcount[BITMAP_LEVELS];
+    uint64_t *full[BITMAP_LEVELS];
 };
 
 
@@ -146,15 +202,39 @@ void bitmap_destroy(bitmap_t* bm);
 // to a maximum allowed bit smaller than the storage)
 mx_status_t bitmap_resize(bitmap_t* bm, uint32_t maxbits);
 
+// recompute the summary and setcount after changing the map
+// directly, such as by reading it in from disk
+void bitmap_summarize(bitmap_t* bm);
+
+// keep the summary up to date when map[word] fills up or stops being full
+void bitmap_word_full(bitmap_t* bm, uint32_t word);
+void bitmap_word_freed(bitmap_t* bm, uint32_t word);
+
 static inline void bitmap_set(bitmap_t* bm, uint32_t n) {
     if (n < bm->bitcount) {
-        bm->map[n >> 6] |= (1ULL << (n & 63));
+        uint64_t* word = &bm->map[n >> 6];
+        uint64_t bit = 1ULL << (n & 63);
+        if ((*word & bit) == 0) {
+            *word |= bit;
+            bm->setcount++;
+            if (*word == ~0ULL) {
+                bitmap_word_full(bm, n >> 6);
+            }
+        }
     }
 }
 
 static inline void bitmap_clr(bitmap_t* bm, uint32_t n) {
     if (n < bm->bitcount) {
-        bm->map[n >> 6] &= ~((1ULL << (n & 63)));
+        uint64_t* word = &bm->map[n >> 6];
+        uint64_t bit = 1ULL << (n & 63);
+        if (*word & bit) {
+            if (*word == ~0ULL) {
+                bitmap_word_freed(bm, n >> 6);
+            }
+            *word &= ~bit;
+            bm->setcount--;
+        }
     }
 }
 
@@ -176,6 +256,11 @@ static inline void* bitmap_data(bitmap_t* bm) {
 // returns BITMAP_FAIL if no bit is found
 uint32_t bitmap_alloc(bitmap_t* bm, uint32_t minbit);
 
+// find the first run of count clear bits at or after minbit,
+// without setting them
+// returns BITMAP_FAIL if there's no run that long
+uint32_t bitmap_find_run(bitmap_t* bm, uint32_t minbit, uint32_t count);
+
 
 // Block Cache (bcache.c)
 
@@ -195,12 +280,25 @@ block_t* bcache_get(bcache_t* bc, uint32_t bno, void** bdata);
 // and clearing to all 0s
 block_t* bcache_get_zero(bcache_t* bc, uint32_t bno, void** block);
 
+// acquire a block only if it's already in the cache
+block_t* bcache_get_cached(bcache_t* bc, uint32_t bno, void** bdata);
+
+// start reading blocks into the cache, in the background where possible;
+// blocks already cached, or that there's no room for, are skipped
+void bcache_prefetch(bcache_t* bc, const uint32_t* bnos, uint32_t count);
+
 // release a block back to the cache
-// flags *must* contain BLOCK_DIRTY if it was modified
+// flags *must* contain BLOCK_DIRTY if it was modified,
+// it's written back later, by bcache_sync() at the latest
 void bcache_put(bcache_t* bc, block_t* blk, uint32_t flags);
 
 mx_status_t bcache_read(bcache_t* bc, uint32_t bno, void* data, uint32_t off, uint32_t len);
 
+// read count whole blocks starting at bno into data, in one large read
+// from disk rather than through the cache, but seeing any cached changes
+mx_status_t bcache_read_blocks(bcache_t* bc, uint32_t bno, uint32_t count, void* data);
+
+// write back all dirty blocks and wait for the device to have them
 mx_status_t bcache_sync(bcache_t* bc);
 
 uint32_t bcache_max_block(bcache_t* bc);
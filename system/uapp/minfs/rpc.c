@@ -25,6 +25,10 @@ struct vnode {
     VNODE_BASE_FIELDS
 };
 
+// minfs-ops.c
+mx_handle_t minfs_get_vmo(vnode_t* vn, mx_off_t* off, mx_off_t* len);
+void minfs_request_done(vnode_t* vn);
+
 typedef struct iostate {
     vnode_t* vn;
     vdircookie_t dircookie;
@@ -92,8 +96,7 @@ mx_handle_t vfs_rpc_server(vnode_t* vn) {
     return NO_ERROR;
 }
 
-static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
-    iostate_t* ios = cookie;
+static mx_status_t vfs_handle_request(mxrio_msg_t* msg, mx_handle_t rh, iostate_t* ios) {
     vnode_t* vn = ios->vn;
     uint32_t len = msg->datalen;
     int32_t arg = msg->arg;
@@ -308,9 +311,34 @@ static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
     case MXRIO_SYNC: {
         return vn->ops->sync(vn);
     }
+    case MXRIO_MMAP: {
+        // every client maps the file's page cache
+        mx_off_t off, size;
+        mx_handle_t vmo;
+        if ((vmo = minfs_get_vmo(vn, &off, &size)) < 0) {
+            return vmo;
+        }
+        msg->handle[0] = vmo;
+        msg->hcount = 1;
+        msg->arg2.off = off;
+        memcpy(msg->data, &size, sizeof(size));
+        msg->datalen = sizeof(size);
+        return NO_ERROR;
+    }
     case MXRIO_UNLINK:
         return vn->ops->unlink(vn, (const char*)msg->data, len);
     default:
         return ERR_NOT_SUPPORTED;
     }
 }
+
+static mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
+    iostate_t* ios = cookie;
+    // a close drops the dispatcher's ref, and ios with it
+    vnode_t* vn = ios->vn;
+    vn_acquire(vn);
+    mx_status_t r = vfs_handle_request(msg, rh, ios);
+    minfs_request_done(vn);
+    vn_release(vn);
+    return r;
+}
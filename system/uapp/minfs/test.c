@@ -16,6 +16,7 @@
 #include "misc.h"
 
 void drop_cache(void);
+int do_bitmap_test(void);
 
 #define TRY(func) ({\
     int ret = (func); \
@@ -305,6 +306,35 @@ int test_rename(void) {
     return 0;
 }
 
+// enough entries to spread a directory over many blocks and
+// exercise its index, with removals leaving holes to be reused
+int test_dir(void) {
+    const unsigned count = 3000;
+    char name[64];
+    TRY(mkdir("::many", 0755));
+    for (unsigned n = 0; n < count; n++) {
+        snprintf(name, sizeof(name), "::many/entry-with-a-long-name-%05u", n);
+        close(TRY(open(name, O_RDWR|O_CREAT|O_EXCL, 0644)));
+    }
+    for (unsigned n = 0; n < count; n += 2) {
+        snprintf(name, sizeof(name), "::many/entry-with-a-long-name-%05u", n);
+        TRY(unlink(name));
+    }
+    for (unsigned n = 0; n < count; n++) {
+        snprintf(name, sizeof(name), "::many/entry-with-a-long-name-%05u", n);
+        if (n & 1) {
+            close(TRY(open(name, O_RDWR, 0644)));
+        } else {
+            EXPECT_FAIL(open(name, O_RDWR, 0644));
+        }
+    }
+    for (unsigned n = 0; n < count; n += 4) {
+        snprintf(name, sizeof(name), "::many/again-%05u", n);
+        close(TRY(open(name, O_RDWR|O_CREAT|O_EXCL, 0644)));
+    }
+    return 0;
+}
+
 int run_fs_tests(int argc, char** argv) {
     fprintf(stderr, "--- fs tests ---\n");
     if (argc > 0) {
@@ -320,6 +350,12 @@ int run_fs_tests(int argc, char** argv) {
         if (!strcmp(argv[0], "rename")) {
             return test_rename();
         }
+        if (!strcmp(argv[0], "dir")) {
+            return test_dir();
+        }
+        if (!strcmp(argv[0], "bitmap")) {
+            return do_bitmap_test();
+        }
         fprintf(stderr, "unknown test: %s\n", argv[0]);
         return -1;
     }
@@ -19,6 +19,7 @@
 #include <launchpad/launchpad.h>
 #include <launchpad/vmo.h>
 
+#include <magenta/device/ktrace.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
@@ -785,6 +786,13 @@ void greet(void) {
 void console(void) {
     editstate es;
 
+    // the first prompt is the end of the boot timeline
+    int fd = open("/dev/misc/ktrace", O_RDWR);
+    if (fd >= 0) {
+        ioctl_ktrace_boot_stage(fd, "mxsh:prompt");
+        close(fd);
+    }
+
     while (readline(&es) == 0) {
         execline(es.line);
     }
@@ -5,14 +5,20 @@
 #include <dirent.h>
 #include <inttypes.h>
 #include <launchpad/launchpad.h>
+#include <launchpad/vmo.h>
 #include <limits.h>
 #include <magenta/listnode.h>
+#include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
+#include <mxio/util.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
 
 typedef struct failure {
     list_node_t node;
@@ -115,21 +121,330 @@ static void run_tests(const char* dirn) {
     closedir(dir);
 }
 
+// With -j, the tests are run that many at a time, each in a job of its
+// own so that whatever one leaves running can be killed with it. A
+// test's output is collected and printed in one piece when it is done,
+// and a table of how long each took is printed at the end.
+
+typedef struct test {
+    char* path;
+    const char* name;
+    mx_time_t duration;
+} test_t;
+
+static test_t* tests = NULL;
+static size_t test_count = 0;
+static size_t next_test = 0;
+
+static mx_handle_t tests_job = MX_HANDLE_INVALID;
+
+// Guards next_test, and keeps the output of one test, and the failures
+// list and counts, together.
+static mtx_t tests_lock = MTX_INIT;
+
+static void find_tests(const char* dirn) {
+    DIR* dir = opendir(dirn);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent* de;
+    struct stat stat_buf;
+    while ((de = readdir(dir)) != NULL) {
+        char name[64 + NAME_MAX];
+        snprintf(name, sizeof(name), "%s/%s", dirn, de->d_name);
+        if (stat(name, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode)) {
+            continue;
+        }
+        test_t* more = realloc(tests, (test_count + 1) * sizeof(test_t));
+        char* path = strdup(name);
+        if (more == NULL || path == NULL) {
+            printf("FAILURE: Out of memory listing %s\n", name);
+            free(path);
+            if (more != NULL) {
+                tests = more;
+            }
+            break;
+        }
+        tests = more;
+        tests[test_count].path = path;
+        tests[test_count].name = path + strlen(dirn) + 1;
+        tests[test_count].duration = 0;
+        test_count++;
+    }
+
+    closedir(dir);
+}
+
+// Start the test in a job of its own with its stdout and stderr going to
+// *out_fd, returning the process or an error.
+static mx_handle_t launch_test(test_t* test, mx_handle_t job, int* out_fd) {
+    char verbose_opt[] = {'v','=', verbosity + '0', 0};
+    const char* argv[] = {test->path, verbose_opt};
+    int argc = verbosity >= 0 ? 2 : 1;
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return ERR_NO_RESOURCES;
+    }
+    mx_handle_t lp_job;
+    mx_status_t status = mx_handle_duplicate(job, MX_RIGHT_SAME_RIGHTS, &lp_job);
+    if (status != NO_ERROR) {
+        close(fds[0]);
+        close(fds[1]);
+        return status;
+    }
+    launchpad_t* lp;
+    status = launchpad_create(lp_job, test->name, &lp);
+    if (status == NO_ERROR) {
+        status = launchpad_elf_load(lp, launchpad_vmo_from_file(test->path));
+        if (status == NO_ERROR)
+            status = launchpad_load_vdso(lp, MX_HANDLE_INVALID);
+        if (status == NO_ERROR)
+            status = launchpad_add_vdso_vmo(lp);
+        if (status == NO_ERROR)
+            status = launchpad_arguments(lp, argc, argv);
+        if (status == NO_ERROR)
+            status = launchpad_environ(lp, (const char* const*)environ);
+        if (status == NO_ERROR)
+            status = launchpad_clone_mxio_root(lp);
+        if (status == NO_ERROR)
+            status = launchpad_clone_mxio_cwd(lp);
+        if (status == NO_ERROR)
+            status = launchpad_clone_fd(lp, fds[1], STDOUT_FILENO);
+        if (status == NO_ERROR)
+            status = launchpad_clone_fd(lp, fds[1], STDERR_FILENO);
+        mx_handle_t proc = (status == NO_ERROR) ? launchpad_start(lp) : status;
+        launchpad_destroy(lp);
+        status = proc;
+    }
+    // Only the test holds the other end now, so reading sees the
+    // end of its output once it has exited.
+    close(fds[1]);
+    if (status < 0) {
+        close(fds[0]);
+        return status;
+    }
+    *out_fd = fds[0];
+    return status;
+}
+
+// Read what the test writes until it has exited and there's no more.
+// Waiting for the end of the pipe isn't enough, anything the test
+// started could be holding it open.
+static char* read_output(int fd, mx_handle_t proc, size_t* out_len) {
+    size_t len = 0;
+    size_t max = 4096;
+    char* buf = malloc(max);
+    while (buf != NULL) {
+        if (len == max) {
+            char* more = realloc(buf, max * 2);
+            if (more == NULL) {
+                break;
+            }
+            buf = more;
+            max *= 2;
+        }
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int n = poll(&pfd, 1, 10);
+        if (n < 0) {
+            break;
+        }
+        if (n > 0) {
+            ssize_t r = read(fd, buf + len, max - len);
+            if (r <= 0) {
+                break;
+            }
+            len += r;
+        } else if (mx_handle_wait_one(proc, MX_SIGNAL_SIGNALED, 0u, NULL) == NO_ERROR) {
+            break;
+        }
+    }
+    *out_len = len;
+    return buf;
+}
+
+static void run_buffered(test_t* test) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    int cause = -1;
+    int rc = 0;
+    mx_status_t status;
+    char* output = NULL;
+    size_t output_len = 0;
+
+    mx_handle_t job = MX_HANDLE_INVALID;
+    mx_handle_t proc = mx_job_create(tests_job, 0u, &job);
+    if (proc == NO_ERROR) {
+        int fd = -1;
+        proc = launch_test(test, job, &fd);
+        if (proc > 0) {
+            // The output has to be read as it comes, or the test could
+            // block on a full pipe.
+            output = read_output(fd, proc, &output_len);
+            close(fd);
+        }
+    }
+    if (proc < 0) {
+        status = proc;
+        cause = FAILED_TO_LAUNCH;
+    } else {
+        mx_info_process_t proc_info;
+        status = mx_handle_wait_one(proc, MX_SIGNAL_SIGNALED, MX_TIME_INFINITE, NULL);
+        if (status != NO_ERROR) {
+            cause = FAILED_TO_WAIT;
+        } else {
+            status = mx_object_get_info(proc, MX_INFO_PROCESS, &proc_info,
+                                        sizeof(proc_info), NULL, NULL);
+            if (status < 0) {
+                cause = FAILED_TO_RETURN_CODE;
+            } else if ((rc = proc_info.return_code) != 0) {
+                cause = FAILED_NONZERO_RETURN_CODE;
+            }
+        }
+        mx_handle_close(proc);
+    }
+    if (job != MX_HANDLE_INVALID) {
+        mx_task_kill(job);
+        mx_handle_close(job);
+    }
+    test->duration = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    mtx_lock(&tests_lock);
+    total_count++;
+    if (verbosity) {
+        printf(
+            "\n------------------------------------------------\n"
+            "RUNNING TEST: %s\n\n",
+            test->name);
+    }
+    if (output != NULL) {
+        fwrite(output, 1, output_len, stdout);
+    }
+    switch (cause) {
+    case -1:
+        printf("PASSED: %s passed\n", test->name);
+        break;
+    case FAILED_TO_LAUNCH:
+        printf("FAILURE: Failed to launch %s: %d\n", test->name, status);
+        break;
+    case FAILED_TO_WAIT:
+        printf("FAILURE: Failed to wait for process exiting %s: %d\n", test->name, status);
+        break;
+    case FAILED_TO_RETURN_CODE:
+        printf("FAILURE: Failed to get process return code %s: %d\n", test->name, status);
+        break;
+    case FAILED_NONZERO_RETURN_CODE:
+        printf("FAILED: %s exited with nonzero status: %d\n", test->name, rc);
+        break;
+    }
+    if (cause != -1) {
+        fail_test(&failures, test->name, cause, rc);
+        failed_count++;
+    }
+    fflush(stdout);
+    mtx_unlock(&tests_lock);
+    free(output);
+}
+
+static int run_worker(void* arg) {
+    for (;;) {
+        mtx_lock(&tests_lock);
+        size_t i = next_test++;
+        mtx_unlock(&tests_lock);
+        if (i >= test_count) {
+            return 0;
+        }
+        run_buffered(&tests[i]);
+    }
+}
+
+static int cmp_duration(const void* a, const void* b) {
+    mx_time_t x = (*(const test_t* const*)a)->duration;
+    mx_time_t y = (*(const test_t* const*)b)->duration;
+    return (x < y) - (x > y);
+}
+
+static void print_timings(void) {
+    const test_t** sorted = malloc(test_count * sizeof(test_t*));
+    if (sorted == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < test_count; i++) {
+        sorted[i] = &tests[i];
+    }
+    qsort(sorted, test_count, sizeof(test_t*), cmp_duration);
+    printf("\nTIMINGS: slowest first, in ms\n");
+    for (size_t i = 0; i < test_count; i++) {
+        printf("%8" PRIu64 " %s\n", sorted[i]->duration / MX_MSEC(1), sorted[i]->name);
+    }
+    free(sorted);
+}
+
+static void run_tests_parallel(int jobs) {
+    find_tests("/boot/test");
+    find_tests("/system/test");
+
+    thrd_t threads[jobs];
+    int started = 0;
+    for (; started < jobs; started++) {
+        if (thrd_create_with_name(&threads[started], run_worker, NULL, "runtests") != thrd_success) {
+            break;
+        }
+    }
+    // If no threads could be made, this one does the work.
+    if (started == 0) {
+        run_worker(NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    mx_time_t elapsed = 0;
+    for (size_t i = 0; i < test_count; i++) {
+        elapsed += tests[i].duration;
+    }
+    print_timings();
+    printf("total %" PRIu64 " ms of tests, %d at a time\n", elapsed / MX_MSEC(1), jobs);
+    for (size_t i = 0; i < test_count; i++) {
+        free(tests[i].path);
+    }
+    free(tests);
+}
+
+static int usage(const char* name) {
+    printf("unknown option. usage: %s [-q|-v] [-j <tests at a time>]\n", name);
+    return -1;
+}
+
 int main(int argc, char** argv) {
-    if (argc > 1) {
-        if (strcmp(argv[1], "-q") == 0) {
+    int jobs = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
             verbosity = 0;
-        } else if (strcmp(argv[1], "-v") == 0) {
+        } else if (strcmp(argv[i], "-v") == 0) {
             printf("verbose output. enjoy.\n");
             verbosity = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs <= 0 || jobs > 64) {
+                return usage(argv[0]);
+            }
         } else {
-            printf("unknown option. usage: %s [-q|-v]\n", argv[0]);
-            return -1;
+            return usage(argv[0]);
         }
     }
 
-    run_tests("/boot/test");
-    run_tests("/system/test");
+    if (jobs > 0) {
+        tests_job = mxio_get_startup_handle(MX_HND_INFO(MX_HND_TYPE_JOB, 0));
+        if (tests_job <= 0) {
+            printf("FAILURE: No job to run tests in\n");
+            return -1;
+        }
+        run_tests_parallel(jobs);
+    } else {
+        run_tests("/boot/test");
+        run_tests("/system/test");
+    }
 
     printf("\nSUMMARY: Ran %d tests: %d failed\n", total_count, failed_count);
 
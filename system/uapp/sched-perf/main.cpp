@@ -0,0 +1,719 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <magenta/syscalls/port.h>
+#include <magenta/threads.h>
+#include <mxtl/unique_ptr.h>
+
+namespace {
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+bool json_output = false;  // -j
+
+struct Metric {
+    const char* name;
+    double value;
+};
+
+// Prints one test's results, as "name: metric value, ..." or, with -j, as a
+// line of JSON for regression tracking to pick up.
+void report(const char* test, const Metric* metrics, size_t count) {
+    if (json_output) {
+        printf("{\"test\":\"%s\"", test);
+        for (size_t i = 0; i < count; i++)
+            printf(",\"%s\":%.3f", metrics[i].name, metrics[i].value);
+        printf("}\n");
+    } else {
+        printf("%s:", test);
+        for (size_t i = 0; i < count; i++)
+            printf("%s %s %.3f", i ? "," : "", metrics[i].name, metrics[i].value);
+        printf("\n");
+    }
+}
+
+uint64_t now_ns() {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+// Busy-waits until |ns| have passed. A thread that is preempted part way
+// through finishes late rather than running for |ns| once it is back.
+void spin_ns(uint64_t ns) {
+    uint64_t deadline = now_ns() + ns;
+    while (now_ns() < deadline)
+        ;
+}
+
+mx_handle_t thread_handle(thrd_t thread) {
+    return thrd_get_mx_handle(thread);
+}
+
+void pin_thread(mx_handle_t thread, int32_t cpu) {
+    __UNUSED mx_status_t status;
+    status = mx_object_set_property(thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu));
+    assert(status == NO_ERROR);
+}
+
+// 0 puts the thread back in the fixed priority class.
+void set_fair_weight(mx_handle_t thread, uint32_t weight) {
+    __UNUSED mx_status_t status;
+    status = mx_object_set_property(thread, MX_PROP_SCHED_FAIR_WEIGHT, &weight, sizeof(weight));
+    assert(status == NO_ERROR);
+}
+
+mx_info_task_runtime_t task_runtime(mx_handle_t task) {
+    mx_info_task_runtime_t info = {};
+    __UNUSED mx_status_t status;
+    status = mx_object_get_info(task, MX_INFO_TASK_RUNTIME, &info, sizeof(info), nullptr, nullptr);
+    assert(status == NO_ERROR);
+    return info;
+}
+
+int compare_u64(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x > y) - (x < y);
+}
+
+// Latency samples, reported as a distribution.
+class Samples {
+public:
+    static constexpr size_t kMax = 1u << 16;
+
+    Samples() : samples_(new uint64_t[kMax]) {}
+
+    bool full() const { return count_ == kMax; }
+    void Add(uint64_t ns) {
+        if (count_ < kMax)
+            samples_[count_++] = ns;
+    }
+
+    // Fills in the six metrics starting at |metrics| with the sample count
+    // and the distribution's mean, median, tail and maximum.
+    void Summarize(Metric* metrics) {
+        qsort(samples_.get(), count_, sizeof(samples_[0]), compare_u64);
+        uint64_t total = 0u;
+        for (size_t i = 0; i < count_; i++)
+            total += samples_[i];
+        size_t n = count_ ? count_ : 1u;
+        metrics[0] = {"samples", static_cast<double>(count_)};
+        metrics[1] = {"mean_ns", static_cast<double>(total) / static_cast<double>(n)};
+        metrics[2] = {"p50_ns", count_ ? static_cast<double>(samples_[count_ * 50 / 100]) : 0.0};
+        metrics[3] = {"p99_ns", count_ ? static_cast<double>(samples_[count_ * 99 / 100]) : 0.0};
+        metrics[4] = {"p999_ns", count_ ? static_cast<double>(samples_[count_ * 999 / 1000]) : 0.0};
+        metrics[5] = {"max_ns", count_ ? static_cast<double>(samples_[count_ - 1]) : 0.0};
+    }
+
+private:
+    mxtl::unique_ptr<uint64_t[]> samples_;
+    size_t count_ = 0u;
+};
+
+constexpr size_t kSummaryMetrics = 6u;
+
+// Threads that do nothing but burn cpu until they are stopped.
+class Hogs {
+public:
+    // |cpu| of -1 leaves them unpinned; |weight| of 0 leaves them in the
+    // fixed priority class.
+    Hogs(uint32_t count, int32_t cpu, uint32_t weight)
+        : count_(count), threads_(new thrd_t[count]), args_(new Arg[count]) {
+        for (uint32_t i = 0; i < count_; i++) {
+            args_[i] = {this, cpu, weight};
+            __UNUSED int ret = thrd_create(&threads_[i], &Hogs::Run, &args_[i]);
+            assert(ret == thrd_success);
+        }
+    }
+    ~Hogs() { Stop(); }
+
+    uint32_t count() const { return count_; }
+    mx_handle_t handle(uint32_t i) const { return thread_handle(threads_[i]); }
+
+    void Stop() {
+        if (stopped_)
+            return;
+        __atomic_store_n(&stop_, true, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < count_; i++)
+            thrd_join(threads_[i], nullptr);
+        stopped_ = true;
+    }
+
+private:
+    struct Arg {
+        Hogs* hogs;
+        int32_t cpu;
+        uint32_t weight;
+    };
+
+    static int Run(void* raw) {
+        Arg* arg = static_cast<Arg*>(raw);
+        mx_handle_t self = thread_handle(thrd_current());
+        if (arg->cpu >= 0)
+            pin_thread(self, arg->cpu);
+        if (arg->weight)
+            set_fair_weight(self, arg->weight);
+        while (!__atomic_load_n(&arg->hogs->stop_, __ATOMIC_RELAXED)) {
+            for (volatile uint32_t i = 0; i < 1000u; i++)
+                ;
+        }
+        return 0;
+    }
+
+    const uint32_t count_;
+    mxtl::unique_ptr<thrd_t[]> threads_;
+    mxtl::unique_ptr<Arg[]> args_;
+    bool stop_ = false;
+    bool stopped_ = false;
+};
+
+// How a wakeup latency test wakes its thread.
+enum class WakeSource {
+    TIMER,  // a sleep running out
+    EVENT,  // another thread signaling it
+};
+
+const char* wake_source_name(WakeSource source) {
+    return source == WakeSource::TIMER ? "timer" : "event";
+}
+
+constexpr uint64_t kWakePeriodNs = 1000000u;  // 1ms
+
+struct EventWaker {
+    mx_handle_t h[2];  // eventpair: 0 is the waker's end, 1 the sleeper's
+    uint64_t stamp;    // when the waker signaled
+    uint64_t deadline_ns;
+};
+
+// Signals the sleeper once a period, and waits for it to answer before the
+// next one so a slow wakeup isn't counted from the wrong signal.
+int event_waker_thread(void* raw) {
+    EventWaker* w = static_cast<EventWaker*>(raw);
+    __UNUSED mx_status_t status;
+    for (;;) {
+        mx_nanosleep(kWakePeriodNs);
+        bool done = now_ns() >= w->deadline_ns;
+        __atomic_store_n(&w->stamp, done ? 0u : now_ns(), __ATOMIC_RELEASE);
+        status = mx_object_signal_peer(w->h[0], 0u, MX_USER_SIGNAL_0);
+        assert(status == NO_ERROR);
+        if (done)
+            break;
+        status = mx_handle_wait_one(w->h[0], MX_USER_SIGNAL_0, MX_TIME_INFINITE, nullptr);
+        assert(status == NO_ERROR);
+        status = mx_object_signal(w->h[0], MX_USER_SIGNAL_0, 0u);
+        assert(status == NO_ERROR);
+    }
+    return 0;
+}
+
+// Measures how late a thread starts running after being woken, with
+// |load| cpu hogs per cpu competing with it.
+void do_wakeup_test(uint32_t duration, uint32_t load, WakeSource source) {
+    __UNUSED mx_status_t status;
+    Hogs hogs(load * mx_num_cpus(), -1, 0u);
+    Samples samples;
+    uint64_t deadline_ns = now_ns() + duration * 1000000000ull;
+
+    if (source == WakeSource::TIMER) {
+        while (!samples.full() && now_ns() < deadline_ns) {
+            uint64_t t0 = now_ns();
+            mx_nanosleep(kWakePeriodNs);
+            uint64_t late = now_ns() - t0;
+            samples.Add(late > kWakePeriodNs ? late - kWakePeriodNs : 0u);
+        }
+    } else {
+        EventWaker w = {};
+        status = mx_eventpair_create(0u, &w.h[0], &w.h[1]);
+        assert(status == NO_ERROR);
+        w.deadline_ns = deadline_ns;
+        thrd_t waker;
+        __UNUSED int ret = thrd_create(&waker, event_waker_thread, &w);
+        assert(ret == thrd_success);
+        for (;;) {
+            status = mx_handle_wait_one(w.h[1], MX_USER_SIGNAL_0, MX_TIME_INFINITE, nullptr);
+            assert(status == NO_ERROR);
+            uint64_t woke = now_ns();
+            uint64_t stamp = __atomic_load_n(&w.stamp, __ATOMIC_ACQUIRE);
+            if (stamp == 0u)
+                break;
+            samples.Add(woke - stamp);
+            status = mx_object_signal(w.h[1], MX_USER_SIGNAL_0, 0u);
+            assert(status == NO_ERROR);
+            status = mx_object_signal_peer(w.h[1], 0u, MX_USER_SIGNAL_0);
+            assert(status == NO_ERROR);
+        }
+        thrd_join(waker, nullptr);
+        mx_handle_close(w.h[0]);
+        mx_handle_close(w.h[1]);
+    }
+    hogs.Stop();
+
+    char name[128];
+    snprintf(name, sizeof(name), "wakeup/%s/load=%" PRIu32, wake_source_name(source), load);
+    Metric metrics[kSummaryMetrics];
+    samples.Summarize(metrics);
+    report(name, metrics, countof(metrics));
+}
+
+void do_wakeup_suite(uint32_t duration) {
+    static constexpr uint32_t loads[] = {0, 1, 2, 4};
+    for (size_t i = 0; i < countof(loads); i++) {
+        do_wakeup_test(duration, loads[i], WakeSource::TIMER);
+        do_wakeup_test(duration, loads[i], WakeSource::EVENT);
+    }
+}
+
+// Measures how evenly |per_cpu| cpu hogs per cpu with the same priority, or
+// the same fair share weight, split the machine between them.
+void do_fairness_test(uint32_t duration, uint32_t per_cpu, bool fair) {
+    uint32_t count = per_cpu * mx_num_cpus();
+    mxtl::unique_ptr<mx_info_task_runtime_t[]> start(new mx_info_task_runtime_t[count]);
+
+    Hogs hogs(count, -1, fair ? MX_SCHED_FAIR_WEIGHT_DEFAULT : 0u);
+    // let them all get going before taking the first reading
+    mx_nanosleep(MX_MSEC(100));
+    for (uint32_t i = 0; i < count; i++)
+        start[i] = task_runtime(hogs.handle(i));
+    uint64_t start_ns = now_ns();
+    mx_nanosleep(duration * 1000000000ull);
+
+    double total = 0.0, total_sq = 0.0, min = INFINITY, max = 0.0;
+    uint64_t migrations = 0u, preemptions = 0u;
+    for (uint32_t i = 0; i < count; i++) {
+        mx_info_task_runtime_t end = task_runtime(hogs.handle(i));
+        double cpu = static_cast<double>(end.cpu_time - start[i].cpu_time);
+        total += cpu;
+        total_sq += cpu * cpu;
+        min = cpu < min ? cpu : min;
+        max = cpu > max ? cpu : max;
+        migrations += end.migrations - start[i].migrations;
+        preemptions += end.involuntary_switches - start[i].involuntary_switches;
+    }
+    double real_duration = static_cast<double>(now_ns() - start_ns) / 1000000000.0;
+    hogs.Stop();
+
+    char name[128];
+    snprintf(name, sizeof(name), "fairness/%s/threads_per_cpu=%" PRIu32,
+             fair ? "fair" : "fixed", per_cpu);
+    Metric metrics[] = {
+        {"threads", static_cast<double>(count)},
+        // Jain's index: 1 when every thread got the same time, 1/n when one
+        // thread got all of it
+        {"fairness_index", total_sq > 0.0 ? total * total / (count * total_sq) : 0.0},
+        {"min_to_max", max > 0.0 ? min / max : 0.0},
+        {"mean_cpu_ns", total / count},
+        {"migrations_per_second", static_cast<double>(migrations) / real_duration},
+        {"preemptions_per_second", static_cast<double>(preemptions) / real_duration},
+    };
+    report(name, metrics, countof(metrics));
+}
+
+void do_fairness_suite(uint32_t duration) {
+    static constexpr uint32_t per_cpu[] = {1, 2, 4};
+    for (size_t i = 0; i < countof(per_cpu); i++) {
+        do_fairness_test(duration, per_cpu[i], false);
+        do_fairness_test(duration, per_cpu[i], true);
+    }
+}
+
+// A thread that runs in short bursts and sleeps in between, which is what
+// makes the scheduler pick a cpu for it over and over.
+struct Bursty {
+    uint64_t burst_ns;
+    uint64_t deadline_ns;
+};
+
+int bursty_thread(void* raw) {
+    Bursty* b = static_cast<Bursty*>(raw);
+    while (now_ns() < b->deadline_ns) {
+        spin_ns(b->burst_ns);
+        mx_nanosleep(b->burst_ns);
+    }
+    return 0;
+}
+
+// Measures how often unpinned threads that keep sleeping and waking move
+// between cpus, with |per_cpu| of them per cpu.
+void do_migration_test(uint32_t duration, uint32_t per_cpu) {
+    uint32_t count = per_cpu * mx_num_cpus();
+    mxtl::unique_ptr<thrd_t[]> threads(new thrd_t[count]);
+    uint64_t start_ns = now_ns();
+    Bursty b = {MX_USEC(200), start_ns + duration * 1000000000ull};
+    for (uint32_t i = 0; i < count; i++) {
+        __UNUSED int ret = thrd_create(&threads[i], bursty_thread, &b);
+        assert(ret == thrd_success);
+    }
+
+    mx_info_task_runtime_t total = {};
+    for (uint32_t i = 0; i < count; i++) {
+        mx_handle_t handle = thread_handle(threads[i]);
+        __UNUSED mx_status_t status;
+        status = mx_handle_wait_one(handle, MX_TASK_TERMINATED, MX_TIME_INFINITE, nullptr);
+        assert(status == NO_ERROR);
+        mx_info_task_runtime_t rt = task_runtime(handle);
+        total.cpu_time += rt.cpu_time;
+        total.voluntary_switches += rt.voluntary_switches;
+        total.migrations += rt.migrations;
+        thrd_join(threads[i], nullptr);
+    }
+    double real_duration = static_cast<double>(now_ns() - start_ns) / 1000000000.0;
+
+    char name[128];
+    snprintf(name, sizeof(name), "migration/threads_per_cpu=%" PRIu32, per_cpu);
+    Metric metrics[] = {
+        {"threads", static_cast<double>(count)},
+        {"migrations_per_second", static_cast<double>(total.migrations) / real_duration},
+        // the share of the times a thread went back on a cpu that moved it
+        {"migrations_per_wakeup", total.voluntary_switches
+             ? static_cast<double>(total.migrations) / static_cast<double>(total.voluntary_switches)
+             : 0.0},
+        {"cpu_utilization", static_cast<double>(total.cpu_time) /
+                            (real_duration * 1000000000.0 * mx_num_cpus())},
+    };
+    report(name, metrics, countof(metrics));
+}
+
+void do_migration_suite(uint32_t duration) {
+    if (mx_num_cpus() < 2u)
+        return;
+    static constexpr uint32_t per_cpu[] = {1, 2, 4};
+    for (size_t i = 0; i < countof(per_cpu); i++)
+        do_migration_test(duration, per_cpu[i]);
+}
+
+constexpr uint64_t kHoldNs = MX_USEC(100);
+
+// A lock held by a low weight thread that a high weight thread needs, with
+// cpu hogs of ordinary weight in between, all on one cpu.
+struct Inversion {
+    mx_futex_t lock;       // 0 free, 1 held
+    mx_futex_t held;       // bumped each time the holder takes the lock
+    bool done;
+    mx_handle_t holder;
+    uint64_t deadline_ns;
+};
+
+void inversion_lock(Inversion* inv, bool pi) {
+    for (;;) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&inv->lock, &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        if (pi) {
+            mx_futex_wait_pi(&inv->lock, 1, inv->holder, MX_TIME_INFINITE);
+        } else {
+            mx_futex_wait(&inv->lock, 1, MX_TIME_INFINITE);
+        }
+    }
+}
+
+void inversion_unlock(Inversion* inv) {
+    __atomic_store_n(&inv->lock, 0, __ATOMIC_RELEASE);
+    mx_futex_wake(&inv->lock, UINT32_MAX);
+}
+
+int inversion_holder_thread(void* raw) {
+    Inversion* inv = static_cast<Inversion*>(raw);
+    while (now_ns() < inv->deadline_ns) {
+        inversion_lock(inv, false);
+        __atomic_fetch_add(&inv->held, 1, __ATOMIC_RELEASE);
+        mx_futex_wake(&inv->held, UINT32_MAX);
+        spin_ns(kHoldNs);
+        inversion_unlock(inv);
+        mx_nanosleep(MX_MSEC(1));
+    }
+    __atomic_store_n(&inv->done, true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&inv->held, 1, __ATOMIC_RELEASE);
+    mx_futex_wake(&inv->held, UINT32_MAX);
+    return 0;
+}
+
+// Measures how long the high weight thread waits for a lock that is only
+// held for kHoldNs of work, with |hogs| hogs preempting the holder, with
+// and without lending the waiter's priority to the holder.
+void do_inversion_test(uint32_t duration, uint32_t num_hogs, bool pi) {
+    Hogs hogs(num_hogs, 0, MX_SCHED_FAIR_WEIGHT_DEFAULT);
+    mx_handle_t self = thread_handle(thrd_current());
+    pin_thread(self, 0);
+    set_fair_weight(self, MX_SCHED_FAIR_WEIGHT_MAX);
+
+    Inversion inv = {};
+    inv.deadline_ns = now_ns() + duration * 1000000000ull;
+    thrd_t holder;
+    __UNUSED int ret = thrd_create(&holder, inversion_holder_thread, &inv);
+    assert(ret == thrd_success);
+    inv.holder = thread_handle(holder);
+    pin_thread(inv.holder, 0);
+    set_fair_weight(inv.holder, MX_SCHED_FAIR_WEIGHT_DEFAULT / 16u);
+
+    Samples samples;
+    int seen = 0;
+    for (;;) {
+        int held = __atomic_load_n(&inv.held, __ATOMIC_ACQUIRE);
+        if (held == seen) {
+            mx_futex_wait(&inv.held, seen, MX_TIME_INFINITE);
+            continue;
+        }
+        seen = held;
+        if (__atomic_load_n(&inv.done, __ATOMIC_ACQUIRE))
+            break;
+        uint64_t t0 = now_ns();
+        inversion_lock(&inv, pi);
+        samples.Add(now_ns() - t0);
+        inversion_unlock(&inv);
+    }
+    thrd_join(holder, nullptr);
+    hogs.Stop();
+    set_fair_weight(self, 0u);
+    pin_thread(self, -1);
+
+    char name[128];
+    snprintf(name, sizeof(name), "inversion/%s/hogs=%" PRIu32, pi ? "pi_futex" : "futex",
+             num_hogs);
+    Metric metrics[kSummaryMetrics + 1];
+    samples.Summarize(metrics);
+    metrics[kSummaryMetrics] = {"hold_ns", static_cast<double>(kHoldNs)};
+    report(name, metrics, countof(metrics));
+}
+
+void do_inversion_suite(uint32_t duration) {
+    static constexpr uint32_t hogs[] = {1, 2, 4};
+    for (size_t i = 0; i < countof(hogs); i++) {
+        do_inversion_test(duration, hogs[i], false);
+        do_inversion_test(duration, hogs[i], true);
+    }
+}
+
+constexpr uint64_t kItemNs = MX_USEC(20);
+
+// A pool of worker threads taking items off a port.
+struct Pool {
+    mx_handle_t port;
+    uint32_t in_flight;
+    uint64_t done;
+    uint64_t queue_ns;      // total time items waited to be picked up
+    uint64_t max_queue_ns;
+};
+
+struct Item {
+    mx_packet_header_t hdr;  // key 1 tells a worker to stop
+    uint64_t queued_ns;
+};
+
+int pool_worker_thread(void* raw) {
+    Pool* pool = static_cast<Pool*>(raw);
+    uint64_t done = 0u, queue_ns = 0u, max_queue_ns = 0u;
+    for (;;) {
+        Item item;
+        __UNUSED mx_status_t status;
+        status = mx_port_wait(pool->port, MX_TIME_INFINITE, &item, sizeof(item));
+        assert(status == NO_ERROR);
+        if (item.hdr.key == 1u)
+            break;
+        uint64_t waited = now_ns() - item.queued_ns;
+        queue_ns += waited;
+        max_queue_ns = waited > max_queue_ns ? waited : max_queue_ns;
+        spin_ns(kItemNs);
+        __atomic_fetch_sub(&pool->in_flight, 1u, __ATOMIC_RELAXED);
+        done++;
+    }
+    __atomic_fetch_add(&pool->done, done, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool->queue_ns, queue_ns, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&pool->max_queue_ns, __ATOMIC_RELAXED);
+    while (max_queue_ns > max &&
+           !__atomic_compare_exchange_n(&pool->max_queue_ns, &max, max_queue_ns, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return 0;
+}
+
+// Measures the rate at which |workers| threads get through kItemNs items
+// fed to them by this thread, which keeps a few items queued per worker.
+void do_pool_test(uint32_t duration, uint32_t workers) {
+    __UNUSED mx_status_t status;
+    Pool pool = {};
+    status = mx_port_create(0u, &pool.port);
+    assert(status == NO_ERROR);
+
+    mxtl::unique_ptr<thrd_t[]> threads(new thrd_t[workers]);
+    for (uint32_t i = 0; i < workers; i++) {
+        __UNUSED int ret = thrd_create(&threads[i], pool_worker_thread, &pool);
+        assert(ret == thrd_success);
+    }
+
+    uint32_t max_in_flight = workers * 4u;
+    uint64_t start_ns = now_ns();
+    uint64_t deadline_ns = start_ns + duration * 1000000000ull;
+    while (now_ns() < deadline_ns) {
+        if (__atomic_load_n(&pool.in_flight, __ATOMIC_RELAXED) >= max_in_flight) {
+            thrd_yield();
+            continue;
+        }
+        __atomic_fetch_add(&pool.in_flight, 1u, __ATOMIC_RELAXED);
+        Item item = {{0u, 0u, 0u}, now_ns()};
+        status = mx_port_queue(pool.port, &item, sizeof(item));
+        assert(status == NO_ERROR);
+    }
+    for (uint32_t i = 0; i < workers; i++) {
+        Item stop = {{1u, 0u, 0u}, 0u};
+        status = mx_port_queue(pool.port, &stop, sizeof(stop));
+        assert(status == NO_ERROR);
+    }
+    for (uint32_t i = 0; i < workers; i++)
+        thrd_join(threads[i], nullptr);
+    double real_duration = static_cast<double>(now_ns() - start_ns) / 1000000000.0;
+    mx_handle_close(pool.port);
+
+    // the most the machine could get through, as if the items cost nothing
+    // but their work
+    double ideal = real_duration * 1000000000.0 * mx_num_cpus() / static_cast<double>(kItemNs);
+    char name[128];
+    snprintf(name, sizeof(name), "pool/workers=%" PRIu32 "/cpus=%" PRIu32, workers,
+             mx_num_cpus());
+    Metric metrics[] = {
+        {"items_per_second", static_cast<double>(pool.done) / real_duration},
+        {"efficiency", static_cast<double>(pool.done) / ideal},
+        {"mean_queue_ns", pool.done ? static_cast<double>(pool.queue_ns) /
+                                      static_cast<double>(pool.done) : 0.0},
+        {"max_queue_ns", static_cast<double>(pool.max_queue_ns)},
+    };
+    report(name, metrics, countof(metrics));
+}
+
+void do_pool_suite(uint32_t duration) {
+    uint32_t cpus = mx_num_cpus();
+    // from half the cpus busy to 8 threads per cpu
+    uint32_t workers[] = {cpus > 1u ? cpus / 2u : 1u, cpus, cpus * 2u, cpus * 4u, cpus * 8u};
+    for (size_t i = 0; i < countof(workers); i++) {
+        if (i > 0 && workers[i] == workers[i - 1])
+            continue;
+        do_pool_test(duration, workers[i]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Runs every suite unless some are picked.\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -w    run wakeup suite: how late timer and event wakeups are\n"
+        "        with 0 to 4 cpu hogs per cpu\n"
+        "  -f    run fairness suite: how evenly equal cpu hogs share the cpus,\n"
+        "        in the fixed priority and fair share classes\n"
+        "  -m    run migration suite: how often threads that keep sleeping\n"
+        "        and waking change cpus\n"
+        "  -i    run inversion suite: how long a high weight thread waits for\n"
+        "        a lock held by a low weight thread among hogs, with and\n"
+        "        without priority inheriting futexes\n"
+        "  -p    run pool suite: throughput of a thread pool as the number\n"
+        "        of workers goes from half the cpus to 8 per cpu\n"
+        "  -n N  set test repetition count to N (default: 1)\n"
+        "  -d N  set test duration to N seconds (default: 2)\n"
+        "  -j    print results as JSON, one object per line\n";
+
+    bool run_wakeup = false;     // -w
+    bool run_fairness = false;   // -f
+    bool run_migration = false;  // -m
+    bool run_inversion = false;  // -i
+    bool run_pool = false;       // -p
+    uint32_t duration = 2;       // -d
+    uint32_t repeats = 1;        // -n
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+hwfmipjn:d:")) != -1) {
+        // Our option values are always unsigned numbers.
+        uint32_t value = 0;
+        if (optarg) {
+            errno = 0;
+            char* endptr = nullptr;
+            unsigned long long v = strtoull(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || v > UINT32_MAX)
+                argument_error(argv[0], "invalid numeric optional value");
+            value = static_cast<uint32_t>(v);
+        }
+
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0]);
+                return EXIT_SUCCESS;
+            case 'w':
+                run_wakeup = true;
+                break;
+            case 'f':
+                run_fairness = true;
+                break;
+            case 'm':
+                run_migration = true;
+                break;
+            case 'i':
+                run_inversion = true;
+                break;
+            case 'p':
+                run_pool = true;
+                break;
+            case 'j':
+                json_output = true;
+                break;
+            case 'n':
+                assert(optarg);
+                repeats = value;
+                break;
+            case 'd':
+                assert(optarg);
+                duration = value;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+    if (duration == 0u)
+        argument_error(argv[0], "tests need to run for at least a second");
+    if (!run_wakeup && !run_fairness && !run_migration && !run_inversion && !run_pool)
+        run_wakeup = run_fairness = run_migration = run_inversion = run_pool = true;
+
+    for (uint32_t i = 0; i < repeats; i++) {
+        if (repeats > 1u && !json_output) {
+            if (i > 0u)
+                printf("\n");
+            printf("Test iteration #%" PRIu32 " (of %" PRIu32 "):\n", i + 1,
+                   repeats);
+        }
+
+        if (run_wakeup)
+            do_wakeup_suite(duration);
+        if (run_fairness)
+            do_fairness_suite(duration);
+        if (run_migration)
+            do_migration_suite(duration);
+        if (run_inversion)
+            do_inversion_suite(duration);
+        if (run_pool)
+            do_pool_suite(duration);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lib/crypto/cryptolib.h>
+
+#include <magenta/syscalls.h>
+
+// Times cryptolib's SHA256, with whatever SHA instructions the cpu has,
+// against its portable C code, over a range of buffer sizes:
+//
+//   magenta> sha256-bench [megabytes]
+//
+// The two have to agree on every digest, too.
+
+static const size_t sizes[] = {64, 1024, 16384, 1024 * 1024};
+
+typedef void (*init_fn)(clSHA256_CTX* ctx);
+
+// Hashes total bytes, size at a time, and returns how long it took.
+static mx_time_t time_hash(init_fn init, const uint8_t* buf, size_t size, size_t total,
+                           uint8_t* digest) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t done = 0; done < total; done += size) {
+        clSHA256_CTX ctx;
+        init(&ctx);
+        clHASH_update(&ctx, buf, (int)size);
+        memcpy(digest, clHASH_final(&ctx), clSHA256_DIGEST_SIZE);
+    }
+    return mx_time_get(MX_CLOCK_MONOTONIC) - start;
+}
+
+// in MB/s
+static uint64_t rate(size_t bytes, mx_time_t ns) {
+    return ns ? (uint64_t)bytes * 1000 / ns : 0;
+}
+
+int main(int argc, char** argv) {
+    size_t megabytes = (argc > 1) ? strtoul(argv[1], NULL, 0) : 64;
+    if (megabytes == 0) {
+        fprintf(stderr, "usage: sha256-bench [megabytes]\n");
+        return -1;
+    }
+    size_t total = megabytes * 1024 * 1024;
+
+    size_t max = sizes[countof(sizes) - 1];
+    uint8_t* buf = malloc(max);
+    if (buf == NULL) {
+        fprintf(stderr, "sha256-bench: out of memory\n");
+        return -1;
+    }
+    for (size_t i = 0; i < max; i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    printf("sha256: %s\n", clSHA256_impl());
+    printf("%10s %12s %12s\n", "size", "fast MB/s", "C MB/s");
+    int status = 0;
+    for (size_t i = 0; i < countof(sizes); i++) {
+        uint8_t fast[clSHA256_DIGEST_SIZE];
+        uint8_t portable[clSHA256_DIGEST_SIZE];
+        mx_time_t fast_ns = time_hash(clSHA256_init, buf, sizes[i], total, fast);
+        mx_time_t portable_ns = time_hash(clSHA256_init_portable, buf, sizes[i], total, portable);
+        printf("%10zu %12" PRIu64 " %12" PRIu64 "\n", sizes[i],
+               rate(total, fast_ns), rate(total, portable_ns));
+        if (memcmp(fast, portable, sizeof(fast)) != 0) {
+            fprintf(stderr, "sha256-bench: digests of %zu bytes differ!\n", sizes[i]);
+            status = -1;
+        }
+    }
+
+    free(buf);
+    return status;
+}
@@ -40,6 +40,8 @@ int main(int argc, char** argv) {
             fprintf(stderr, "error: cannot open %s for read\n", argv[i]);
             return 1;
         }
+        // read ahead, where the file is remote
+        mxio_set_buffered(fd, true);
 
         clSHA256_CTX ctx;
         clSHA256_init(&ctx);
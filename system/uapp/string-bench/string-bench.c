@@ -0,0 +1,131 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/syscalls.h>
+
+// Times libc's strlen, strchr, memchr and memcmp against the portable C
+// versions from musl, which are what every architecture used before x86-64
+// got its own, over a range of lengths:
+//
+//   magenta> string-bench [iterations]
+
+#define ONES ((size_t)-1 / UCHAR_MAX)
+#define HIGHS (ONES * (UCHAR_MAX / 2 + 1))
+#define HASZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+#define ALIGN (sizeof(size_t))
+
+static size_t c_strlen(const char* s) {
+    const char* a = s;
+    const size_t* w;
+    for (; (uintptr_t)s % ALIGN; s++)
+        if (!*s)
+            return s - a;
+    for (w = (const void*)s; !HASZERO(*w); w++)
+        ;
+    for (s = (const void*)w; *s; s++)
+        ;
+    return s - a;
+}
+
+static char* c_strchr(const char* s, int c) {
+    const size_t* w;
+    size_t k;
+    c = (unsigned char)c;
+    if (!c)
+        return (char*)s + c_strlen(s);
+    for (; (uintptr_t)s % ALIGN; s++)
+        if (!*s || *(unsigned char*)s == c)
+            goto done;
+    k = ONES * c;
+    for (w = (const void*)s; !HASZERO(*w) && !HASZERO(*w ^ k); w++)
+        ;
+    for (s = (const void*)w; *s && *(unsigned char*)s != c; s++)
+        ;
+done:
+    return *(unsigned char*)s == c ? (char*)s : NULL;
+}
+
+static void* c_memchr(const void* src, int c, size_t n) {
+    const unsigned char* s = src;
+    c = (unsigned char)c;
+    for (; ((uintptr_t)s % ALIGN) && n && *s != c; s++, n--)
+        ;
+    if (n && *s != c) {
+        const size_t* w;
+        size_t k = ONES * c;
+        for (w = (const void*)s; n >= ALIGN && !HASZERO(*w ^ k); w++, n -= ALIGN)
+            ;
+        for (s = (const void*)w; n && *s != c; s++, n--)
+            ;
+    }
+    return n ? (void*)s : NULL;
+}
+
+static int c_memcmp(const void* vl, const void* vr, size_t n) {
+    const unsigned char *l = vl, *r = vr;
+    for (; n && *l == *r; n--, l++, r++)
+        ;
+    return n ? *l - *r : 0;
+}
+
+// keeps the compiler from deciding the results are unused
+static volatile uintptr_t sink;
+
+#define TIME(iters, expr) ({                                   \
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);         \
+    for (uint32_t i = 0; i < (iters); i++)                     \
+        sink = (uintptr_t)(expr);                              \
+    (mx_time_get(MX_CLOCK_MONOTONIC) - start) / (iters);       \
+})
+
+static const size_t lengths[] = {8, 32, 128, 1024, 16384};
+
+int main(int argc, char** argv) {
+    uint32_t iters = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 10000;
+    if (iters == 0) {
+        fprintf(stderr, "usage: string-bench [iterations]\n");
+        return -1;
+    }
+
+    size_t max = lengths[countof(lengths) - 1];
+    // one byte off alignment, as strings out of a parser usually are
+    char* a = malloc(max + 2);
+    char* b = malloc(max + 2);
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "string-bench: out of memory\n");
+        return -1;
+    }
+    char* s = a + 1;
+    memset(s, 'x', max);
+    memcpy(b + 1, s, max);
+
+    printf("%-8s %8s %10s %10s\n", "routine", "length", "libc ns", "C ns");
+    for (size_t i = 0; i < countof(lengths); i++) {
+        size_t len = lengths[i];
+        s[len] = 0;
+        b[1 + len] = 0;
+        printf("%-8s %8zu %10" PRIu64 " %10" PRIu64 "\n", "strlen", len,
+               TIME(iters, strlen(s)), TIME(iters, c_strlen(s)));
+        printf("%-8s %8zu %10" PRIu64 " %10" PRIu64 "\n", "strchr", len,
+               TIME(iters, strchr(s, 'y')), TIME(iters, c_strchr(s, 'y')));
+        printf("%-8s %8zu %10" PRIu64 " %10" PRIu64 "\n", "memchr", len,
+               TIME(iters, memchr(s, 'y', len)), TIME(iters, c_memchr(s, 'y', len)));
+        printf("%-8s %8zu %10" PRIu64 " %10" PRIu64 "\n", "memcmp", len,
+               TIME(iters, memcmp(s, b + 1, len)), TIME(iters, c_memcmp(s, b + 1, len)));
+        s[len] = 'x';
+        b[1 + len] = 'x';
+    }
+
+    free(a);
+    free(b);
+    return 0;
+}
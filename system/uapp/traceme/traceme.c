@@ -7,12 +7,54 @@
 #include <unistd.h>
 
 #include <magenta/device/ktrace.h>
+#include <magenta/ktrace.h>
+#include <magenta/syscalls.h>
+#include <utrace/utrace.h>
 
 // 1. Run:            magenta> traceme
 // 2. Stop tracing:   magenta> dm ktraceoff
 // 3. Grab trace:     host> netcp :/dev/class/misc/ktrace test.trace
 // 4. Examine trace:  host> tracevic test.trace
 
+// Counts the records with |tag| still in the trace buffer by reading the
+// mapped trace VMO directly, without copying it out through the device.
+static int count_records(mx_handle_t vmo, uint32_t tag) {
+    uint64_t size;
+    uintptr_t addr;
+    if (mx_vmo_get_size(vmo, &size) < 0 ||
+        mx_process_map_vm(mx_process_self(), vmo, 0, size, &addr, MX_VM_FLAG_PERM_READ) < 0) {
+        return -1;
+    }
+
+    const uint8_t* base = (const uint8_t*) addr;
+    const ktrace_buffer_header_t* hdr = (const ktrace_buffer_header_t*) base;
+    const ktrace_cpu_index_t* index = (const ktrace_cpu_index_t*) (hdr + 1);
+    int count = 0;
+    for (uint32_t cpu = 0; cpu < hdr->num_cpus; cpu++) {
+        const uint8_t* buf = base + hdr->cpu_offset + cpu * hdr->cpu_size;
+        uint64_t head = __atomic_load_n(&index[cpu].head, __ATOMIC_ACQUIRE);
+        uint64_t pos = __atomic_load_n(&index[cpu].tail, __ATOMIC_ACQUIRE);
+        while (pos < head) {
+            uint32_t off = (uint32_t)(pos % hdr->cpu_size);
+            uint32_t rec_tag = *(const uint32_t*) (buf + off);
+            if (rec_tag == 0) {
+                pos += hdr->cpu_size - off;
+                continue;
+            }
+            if (KTRACE_LEN(rec_tag) == 0) {
+                // overwritten under us by a circular trace
+                break;
+            }
+            if (rec_tag == tag)
+                count++;
+            pos += KTRACE_LEN(rec_tag);
+        }
+    }
+
+    mx_process_unmap_vm(mx_process_self(), addr, 0);
+    return count;
+}
+
 int main(int argc, char** argv) {
     int fd;
     if ((fd = open("/dev/class/misc/ktrace", O_RDWR)) < 0) {
@@ -34,6 +76,12 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // a read-only view of the trace buffer, to look at our own probes
+    mx_handle_t vmo;
+    if (ioctl_ktrace_get_vmo(fd, &vmo) < 0) {
+        vmo = MX_HANDLE_INVALID;
+    }
+
     // once all probes are registered, you can close the device
     close(fd);
 
@@ -42,6 +90,21 @@ int main(int argc, char** argv) {
     printf("hello, ktrace! id = %u\n", id);
     mx_ktrace_write(kth, id, 2, 0);
 
+    // or, without a syscall for each, into a buffer of this thread's own
+    // that is merged into the trace stream
+    if (utrace_thread_init(kth, 16384) == NO_ERROR) {
+        for (uint32_t n = 3; n < 6; n++)
+            utrace_probe2(id, n, 0);
+    } else {
+        fprintf(stderr, "cannot set up user trace buffer\n");
+    }
+
+    if (vmo != MX_HANDLE_INVALID) {
+        printf("%d trace-me records in the buffer\n", count_records(vmo, TAG_PROBE_24(id)));
+        mx_handle_close(vmo);
+    }
+
+    // not released, so its records stay in the trace after we exit
     return 0;
 }
 
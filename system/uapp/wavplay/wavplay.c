@@ -24,6 +24,12 @@
 #define BUFFER_COUNT 2
 #define BUFFER_SIZE 16384
 
+// streaming through the device's ring buffer: about a third of a second
+// at 48kHz, which bounds how long a file read may stall us
+#define RING_SIZE (BUFFER_SIZE * 4)
+// how often we top the ring up
+#define RING_POLL_MS 5
+
 #define BUFFER_EMPTY 0
 #define BUFFER_BUSY 1
 #define BUFFER_FULL 2
@@ -39,6 +45,9 @@ static int empty_index = 0;
 static int full_index = -1;
 static volatile bool file_done;
 
+// USB frames (1ms each) the device keeps queued from the ring
+static uint32_t ring_depth = 8;
+
 static int get_empty(void) {
     int index, other;
 
@@ -133,6 +142,91 @@ static int file_read_thread(void* arg) {
 
     return 0;
 }
+// fills the ring from the file up to end, and with silence once the file is done
+static void ring_fill(uint8_t* ring, int src_fd, uint64_t* filled, uint64_t* written,
+                      uint64_t end) {
+    while (*filled < end) {
+        size_t offset = *filled % RING_SIZE;
+        size_t count = RING_SIZE - offset;
+        if (count > end - *filled) {
+            count = end - *filled;
+        }
+        if (!file_done) {
+            ssize_t actual = read(src_fd, ring + offset, count);
+            if (actual > 0) {
+                *filled += actual;
+                *written = *filled;
+                continue;
+            }
+            file_done = true;
+        }
+        memset(ring + offset, 0, count);
+        *filled += count;
+    }
+}
+
+// plays the file through the device's ring buffer, staying a ring ahead of
+// where the device has read to.  Returns ERR_NOT_SUPPORTED if it has none.
+static int do_play_ring(int src_fd, int dest_fd) {
+    audio_ring_config_t config = {
+        .size = RING_SIZE,
+        .depth = ring_depth,
+    };
+    mx_handle_t vmo;
+    if (ioctl_audio_set_ring_buffer(dest_fd, &config, &vmo) != sizeof(vmo)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    uintptr_t ptr;
+    mx_status_t status = mx_process_map_vm(mx_process_self(), vmo, 0, RING_SIZE, &ptr,
+                                           MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    mx_handle_close(vmo);
+    if (status < 0) {
+        printf("failed to map the ring buffer: %d\n", status);
+        return status;
+    }
+    uint8_t* ring = (uint8_t*)ptr;
+
+    // bytes of the file, and of the file and the silence after it, in the ring
+    uint64_t written = 0;
+    uint64_t filled = 0;
+    uint32_t underruns = 0;
+    ring_fill(ring, src_fd, &filled, &written, RING_SIZE);
+
+    int ret = ioctl_audio_start(dest_fd);
+    while (ret == NO_ERROR) {
+        audio_ring_position_t pos;
+        if (ioctl_audio_get_ring_position(dest_fd, &pos) != sizeof(pos)) {
+            ret = -1;
+            break;
+        }
+        if (pos.position >= written && file_done) {
+            break;
+        }
+        if (pos.position > filled) {
+            // the device got ahead of us, and played what was left in the ring
+            underruns++;
+            filled = pos.position;
+            if (!file_done) {
+                lseek(src_fd, pos.position - written, SEEK_CUR);
+                written = filled;
+            }
+        }
+        ring_fill(ring, src_fd, &filled, &written, pos.position + RING_SIZE);
+        mx_nanosleep(MX_MSEC(RING_POLL_MS));
+    }
+    if (ret == NO_ERROR) {
+        // let what is queued play out
+        mx_nanosleep(MX_MSEC(ring_depth));
+    }
+    ioctl_audio_stop(dest_fd);
+    mx_process_unmap_vm(mx_process_self(), ptr, 0);
+
+    if (underruns > 0) {
+        printf("%u underruns\n", underruns);
+    }
+    return ret;
+}
+
 static int do_play(int src_fd, int dest_fd, uint32_t sample_rate)
 {
     int ret = ioctl_audio_set_sample_rate(dest_fd, &sample_rate);
@@ -140,6 +234,12 @@ static int do_play(int src_fd, int dest_fd, uint32_t sample_rate)
         printf("sample rate %d not supported\n", sample_rate);
         return ret;
     }
+
+    ret = do_play_ring(src_fd, dest_fd);
+    if (ret != ERR_NOT_SUPPORTED) {
+        return ret;
+    }
+    ret = 0;
     ioctl_audio_start(dest_fd);
 
     thrd_t thread;
@@ -282,6 +382,12 @@ static int play_files(const char* directory, int dest_fd) {
 }
 
 int main(int argc, char **argv) {
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-d") == 0) {
+        ring_depth = atoi(argv[2]);
+        first = 3;
+    }
+
     int dest_fd = open_sink();
     if (dest_fd < 0) {
         printf("couldn't find a usable audio sink\n");
@@ -289,10 +395,10 @@ int main(int argc, char **argv) {
     }
 
     int ret = 0;
-    if (argc == 1) {
+    if (first == argc) {
         ret = play_files("/data", dest_fd);
     } else {
-        for (int i = 1; i < argc && ret == 0; i++) {
+        for (int i = first; i < argc && ret == 0; i++) {
             ret = play_file(argv[i], dest_fd);
         }
     }
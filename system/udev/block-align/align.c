@@ -24,9 +24,18 @@
 // block device, giving the underlying block device the appearance of a regular
 // file.
 
+// bounce txns for requests up to this size, which covers the partial
+// blocks of any request and an 8K rpc bounced whole, come from a pool
+#define ALIGN_POOL_COUNT 4
+#define ALIGN_POOL_SIZE (16 * 1024)
+
+// the least alignment of a buffer any controller below us can DMA to
+#define ALIGN_DMA_ALIGN 4
+
 typedef struct align_device {
     mx_device_t device;
     uint64_t blksize;
+    iotxn_pool_t* pool;
 } align_device_t;
 
 #define get_aligned_device(dev) containerof(dev, align_device_t, device)
@@ -39,6 +48,9 @@ static ssize_t align_ioctl(mx_device_t* dev, uint32_t op, const void* cmd,
     return parent->ops->ioctl(parent, op, cmd, cmdlen, reply, max);
 }
 
+// The parent may rewrite a txn's offset and length on the way down, as
+// gpt does, so what was asked of it is kept here rather than read back.
+
 static void aligned_write_complete(iotxn_t* txn_aligned, void* cookie) {
     iotxn_t* txn = cookie;
     mx_status_t status = txn_aligned->status;
@@ -49,6 +61,7 @@ static void aligned_write_complete(iotxn_t* txn_aligned, void* cookie) {
 static void aligned_read_complete(iotxn_t* txn_aligned, void* cookie) {
     iotxn_t* txn = cookie;
     mx_status_t status = txn_aligned->status;
+    mx_off_t offset_aligned = *iotxn_to(txn_aligned, mx_off_t);
     mx_off_t actual = 0;
     if (status != NO_ERROR) {
         goto done;
@@ -56,7 +69,7 @@ static void aligned_read_complete(iotxn_t* txn_aligned, void* cookie) {
         // Copy the result from the aligned read into the original txn
         void* buffer;
         txn_aligned->ops->mmap(txn_aligned, &buffer);
-        txn->ops->copyto(txn, buffer + (txn->offset - txn_aligned->offset),
+        txn->ops->copyto(txn, buffer + (txn->offset - offset_aligned),
                          txn->length, 0);
         actual = txn->length;
         goto done;
@@ -65,8 +78,9 @@ static void aligned_read_complete(iotxn_t* txn_aligned, void* cookie) {
         void* buffer;
         txn->ops->mmap(txn, &buffer);
         txn_aligned->ops->copyto(txn_aligned, buffer, txn->length,
-                                 txn->offset - txn_aligned->offset);
+                                 txn->offset - offset_aligned);
         txn_aligned->opcode = IOTXN_OP_WRITE;
+        txn_aligned->offset = offset_aligned;
         txn_aligned->complete_cb = aligned_write_complete;
         iotxn_queue(txn->context, txn_aligned);
         return;
@@ -76,8 +90,165 @@ done:
     txn->ops->complete(txn, status, actual);
 }
 
+// Reads the blocks covering txn into a txn of their own, and copies
+// between the two.
+static void align_bounce(align_device_t* device, iotxn_t* txn, mx_off_t offset_aligned,
+                         mx_off_t length_aligned) {
+    mx_device_t* parent = device->device.parent;
+
+    // Allocates a larger iotxn, capable of containing the aligned length.
+    iotxn_t* txn_aligned;
+    mx_status_t status = iotxn_pool_alloc(device->pool, &txn_aligned, length_aligned);
+    if (status != NO_ERROR) {
+        txn->ops->complete(txn, status, 0);
+        return;
+    }
+    txn_aligned->opcode = IOTXN_OP_READ;
+    txn_aligned->offset = offset_aligned;
+    txn_aligned->length = length_aligned;
+    txn_aligned->complete_cb = aligned_read_complete;
+    txn_aligned->cookie = txn;
+    *iotxn_to(txn_aligned, mx_off_t) = offset_aligned;
+    txn->context = parent;
+    iotxn_queue(parent, txn_aligned);
+}
+
+// A request split into the whole blocks in its middle, which are passed
+// on as a window onto the request's own buffer, and the partial blocks
+// at either end, which go through a block-sized buffer each.
+typedef struct align_split {
+    iotxn_t* txn;
+    mx_device_t* parent;
+    uint64_t blksize;
+    iotxn_t* head;
+    iotxn_t* tail;
+    mtx_t lock;
+    uint32_t pending;
+    mx_status_t status;
+} align_split_t;
+
+// copies what the original request has of the partial block part between
+// the two, into part if in is set
+static void align_split_copy(align_split_t* split, iotxn_t* part, bool in) {
+    iotxn_t* txn = split->txn;
+    mx_off_t block = *iotxn_to(part, mx_off_t);
+    mx_off_t start = MAX(block, txn->offset);
+    mx_off_t end = MIN(block + split->blksize, txn->offset + txn->length);
+    void* buffer;
+    txn->ops->mmap(txn, &buffer);
+    buffer += start - txn->offset;
+    if (in) {
+        part->ops->copyto(part, buffer, end - start, start - block);
+    } else {
+        part->ops->copyfrom(part, buffer, end - start, start - block);
+    }
+}
+
+static void align_split_complete(iotxn_t* part, void* cookie) {
+    align_split_t* split = cookie;
+    iotxn_t* txn = split->txn;
+    mx_status_t status = part->status;
+    if ((status == NO_ERROR) && ((part == split->head) || (part == split->tail))) {
+        if (txn->opcode == IOTXN_OP_READ) {
+            align_split_copy(split, part, false);
+        } else if (part->opcode == IOTXN_OP_READ) {
+            // read the block, now merge the new data in and write it back
+            align_split_copy(split, part, true);
+            part->opcode = IOTXN_OP_WRITE;
+            part->offset = *iotxn_to(part, mx_off_t);
+            part->length = split->blksize;
+            iotxn_queue(split->parent, part);
+            return;
+        }
+    }
+    part->ops->release(part);
+
+    mtx_lock(&split->lock);
+    if ((status != NO_ERROR) && (split->status == NO_ERROR)) {
+        split->status = status;
+    }
+    bool last = (--split->pending == 0);
+    mtx_unlock(&split->lock);
+    if (last) {
+        status = split->status;
+        free(split);
+        txn->ops->complete(txn, status, (status == NO_ERROR) ? txn->length : 0);
+    }
+}
+
+// a txn for the partial block at offset block, read first either way
+static mx_status_t align_split_part(align_split_t* split, iotxn_pool_t* pool, mx_off_t block,
+                                    iotxn_t** out) {
+    iotxn_t* part;
+    mx_status_t status = iotxn_pool_alloc(pool, &part, split->blksize);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    part->opcode = IOTXN_OP_READ;
+    part->offset = block;
+    part->length = split->blksize;
+    part->complete_cb = align_split_complete;
+    part->cookie = split;
+    *iotxn_to(part, mx_off_t) = block;
+    *out = part;
+    return NO_ERROR;
+}
+
+static void align_split(align_device_t* device, iotxn_t* txn, mx_off_t start, mx_off_t end) {
+    uint64_t blksize = device->blksize;
+    align_split_t* split = calloc(1, sizeof(align_split_t));
+    if (!split) {
+        txn->ops->complete(txn, ERR_NO_MEMORY, 0);
+        return;
+    }
+    split->txn = txn;
+    split->parent = device->device.parent;
+    split->blksize = blksize;
+    mtx_init(&split->lock, mtx_plain);
+
+    iotxn_t* middle;
+    mx_status_t status = iotxn_clone_window(txn, &middle, start - txn->offset, end - start, 0);
+    if (status != NO_ERROR) {
+        goto fail;
+    }
+    middle->offset = start;
+    middle->complete_cb = align_split_complete;
+    middle->cookie = split;
+    if ((txn->offset < start) &&
+        ((status = align_split_part(split, device->pool, start - blksize, &split->head)) != NO_ERROR)) {
+        goto fail_middle;
+    }
+    if ((txn->offset + txn->length > end) &&
+        ((status = align_split_part(split, device->pool, end, &split->tail)) != NO_ERROR)) {
+        goto fail_head;
+    }
+
+    split->pending = 1 + (split->head != NULL) + (split->tail != NULL);
+    iotxn_t* head = split->head;
+    iotxn_t* tail = split->tail;
+    iotxn_queue(split->parent, middle);
+    if (head) {
+        iotxn_queue(split->parent, head);
+    }
+    if (tail) {
+        iotxn_queue(split->parent, tail);
+    }
+    return;
+
+fail_head:
+    if (split->head) {
+        split->head->ops->release(split->head);
+    }
+fail_middle:
+    middle->ops->release(middle);
+fail:
+    free(split);
+    txn->ops->complete(txn, status, 0);
+}
+
 static void align_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
-    uint64_t blksize = get_aligned_device(dev)->blksize;
+    align_device_t* device = get_aligned_device(dev);
+    uint64_t blksize = device->blksize;
     mx_device_t* parent = dev->parent;
 
     // In the case that the request is:
@@ -104,26 +275,16 @@ static void align_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
         return;
     }
 
-    // TODO(smklein): For large iotxns, allocating an iotxn of size
-    // 'length_aligned' can cause a large, unnecessary allocation. Rather than
-    // re-allocating a larger iotxn, use an iotxn of length 'blksize' for the
-    // misaligned / start end, and issue the original 'iotxn' for the aligned
-    // middle portion of the request.
-
-    // Allocates a larger iotxn, capable of containing the aligned length.
-    iotxn_t* txn_aligned;
-    mx_status_t status = iotxn_alloc(&txn_aligned, 0, length_aligned, 0);
-    if (status != NO_ERROR) {
-        txn->ops->complete(txn, status, 0);
-        return;
+    // The whole blocks in the middle, if there are any, are moved straight
+    // to or from the request's buffer, as long as where they start in it
+    // is aligned well enough for the controller's DMA.
+    mx_off_t start = offset_aligned + ((offset_aligned < txn->offset) ? blksize : 0);
+    mx_off_t end = (txn->offset + txn->length) - ((txn->offset + txn->length) % blksize);
+    if ((start < end) && ((start - txn->offset) % ALIGN_DMA_ALIGN == 0)) {
+        align_split(device, txn, start, end);
+    } else {
+        align_bounce(device, txn, offset_aligned, length_aligned);
     }
-    txn_aligned->opcode = IOTXN_OP_READ;
-    txn_aligned->offset = offset_aligned;
-    txn_aligned->length = length_aligned;
-    txn_aligned->complete_cb = aligned_read_complete;
-    txn_aligned->cookie = txn;
-    txn->context = parent;
-    iotxn_queue(parent, txn_aligned);
 }
 
 static mx_off_t align_getsize(mx_device_t* dev) {
@@ -137,6 +298,7 @@ static void align_unbind(mx_device_t* dev) {
 
 static mx_status_t align_release(mx_device_t* dev) {
     align_device_t* device = get_aligned_device(dev);
+    iotxn_pool_destroy(device->pool);
     free(device);
     return NO_ERROR;
 }
@@ -163,9 +325,15 @@ static mx_status_t align_bind(mx_driver_t* drv, mx_device_t* dev) {
         free(device);
         return rc;
     }
-    device->device.protocol_id = MX_PROTOCOL_BLOCK;
     mx_status_t status;
+    if ((status = iotxn_pool_create(&device->pool, ALIGN_POOL_COUNT, ALIGN_POOL_SIZE,
+                                    sizeof(mx_off_t))) != NO_ERROR) {
+        free(device);
+        return status;
+    }
+    device->device.protocol_id = MX_PROTOCOL_BLOCK;
     if ((status = device_add(&device->device, dev)) != NO_ERROR) {
+        iotxn_pool_destroy(device->pool);
         free(device);
         return status;
     }
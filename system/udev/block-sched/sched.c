@@ -0,0 +1,549 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/completion.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
+#include <ddk/protocol/device.h>
+
+#include <magenta/listnode.h>
+#include <magenta/types.h>
+#include <sys/param.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define TRACE 0
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
+
+// This block device sits on a disk, ahead of the partitions, and decides
+// the order its requests are sent down in.
+//
+// Requests are queued per client, a client being whoever completes them
+// (the complete_cb and cookie), and the clients take turns, so a writer
+// with a deep queue gets one turn in line like someone doing a single
+// read.  From its client's queue, a turn takes the request nearest ahead
+// of the last one sent, among the oldest few, and every queued request
+// of the same kind that continues it, which go down together as one.
+//
+// Requests with IOTXN_SYNC_* flags, or ones that aren't reads or writes,
+// are barriers: they're sent once everything before them is done, on
+// their own, and nothing after them is sent until they are done.
+//
+// Only a few requests are sent down at a time, so that there's a queue
+// to choose from when the disk is busy.
+
+#define SCHED_MAX_INFLIGHT 8
+#define SCHED_WINDOW 8
+#define SCHED_MERGE_MAX (64 * 1024)
+#define SCHED_MERGE_POOL 4
+#define SCHED_IDLE_CLIENTS 16
+
+typedef struct sched_client {
+    list_node_t node;           // in the device's clients or idle_clients
+    list_node_t queue;          // its requests, oldest first
+    void (*complete_cb)(iotxn_t* txn, void* cookie);
+    void* cookie;
+} sched_client_t;
+
+typedef struct sched_device {
+    mx_device_t device;
+    iotxn_pool_t* pool;         // for merged requests
+
+    mtx_t lock;
+    list_node_t clients;        // with requests queued, in turn order
+    list_node_t idle_clients;
+    uint32_t idle_count;
+    uint32_t client_count;
+    uint32_t queued;
+    uint32_t inflight;
+    mx_off_t next_offset;       // just past the last request sent
+
+    // the barrier everything after waits in held for, and whether it's
+    // been sent down yet
+    iotxn_t* barrier;
+    bool barrier_sent;
+    list_node_t held;
+
+    bool dispatching;
+    bool redispatch;
+    bool dead;
+
+    block_sched_stats_t stats;
+} sched_device_t;
+
+// in the extra space of a merged request
+typedef struct sched_merge {
+    sched_device_t* dev;
+    mx_off_t offset;
+    list_node_t members;
+} sched_merge_t;
+
+#define get_sched_device(dev) containerof(dev, sched_device_t, device)
+
+static void sched_dispatch(sched_device_t* dev);
+
+static bool sched_is_barrier(iotxn_t* txn) {
+    return (txn->opcode != IOTXN_OP_READ && txn->opcode != IOTXN_OP_WRITE) ||
+           (txn->flags & (IOTXN_SYNC_BEFORE | IOTXN_SYNC_AFTER));
+}
+
+static void sched_sync_complete(iotxn_t* txn, void* cookie) {
+    completion_signal((completion_t*)cookie);
+}
+
+static sched_client_t* sched_client_get(sched_device_t* dev, iotxn_t* txn) {
+    sched_client_t* client;
+    list_for_every_entry (&dev->clients, client, sched_client_t, node) {
+        if (client->complete_cb == txn->complete_cb && client->cookie == txn->cookie) {
+            return client;
+        }
+    }
+    if ((client = list_remove_head_type(&dev->idle_clients, sched_client_t, node)) != NULL) {
+        dev->idle_count--;
+    } else if ((client = malloc(sizeof(sched_client_t))) == NULL) {
+        return NULL;
+    }
+    list_initialize(&client->queue);
+    client->complete_cb = txn->complete_cb;
+    client->cookie = txn->cookie;
+    list_add_tail(&dev->clients, &client->node);
+    if (++dev->client_count > dev->stats.max_clients) {
+        dev->stats.max_clients = dev->client_count;
+    }
+    return client;
+}
+
+static void sched_client_put(sched_device_t* dev, sched_client_t* client) {
+    dev->client_count--;
+    if (dev->idle_count < SCHED_IDLE_CLIENTS) {
+        list_add_head(&dev->idle_clients, &client->node);
+        dev->idle_count++;
+    } else {
+        free(client);
+    }
+}
+
+// Queues a request, with the lock held.  Returns false if there was no
+// memory to queue it with.
+static bool sched_add(sched_device_t* dev, iotxn_t* txn) {
+    if (dev->barrier != NULL) {
+        list_add_tail(&dev->held, &txn->node);
+    } else if (sched_is_barrier(txn)) {
+        dev->barrier = txn;
+        dev->stats.barriers++;
+    } else {
+        sched_client_t* client = sched_client_get(dev, txn);
+        if (client == NULL) {
+            return false;
+        }
+        list_add_tail(&client->queue, &txn->node);
+        if (++dev->queued > dev->stats.max_queued) {
+            dev->stats.max_queued = dev->queued;
+        }
+    }
+    return true;
+}
+
+// Takes the next requests to send down off the queues, with the lock
+// held, and returns how many.  Several are to be merged into one.
+static uint32_t sched_next(sched_device_t* dev, list_node_t* out) {
+    if (dev->inflight >= SCHED_MAX_INFLIGHT) {
+        return 0;
+    }
+    sched_client_t* client = list_remove_head_type(&dev->clients, sched_client_t, node);
+    if (client == NULL) {
+        if ((dev->barrier != NULL) && !dev->barrier_sent && (dev->inflight == 0)) {
+            dev->barrier_sent = true;
+            dev->inflight++;
+            dev->stats.dispatched++;
+            list_add_tail(out, &dev->barrier->node);
+            return 1;
+        }
+        return 0;
+    }
+
+    // the nearest request at or past the head, or failing that the
+    // nearest to the start, among the oldest few
+    iotxn_t* txn;
+    iotxn_t* pick = NULL;
+    iotxn_t* lowest = NULL;
+    uint32_t n = 0;
+    list_for_every_entry (&client->queue, txn, iotxn_t, node) {
+        if (n++ == SCHED_WINDOW) {
+            break;
+        }
+        if ((lowest == NULL) || (txn->offset < lowest->offset)) {
+            lowest = txn;
+        }
+        if ((txn->offset >= dev->next_offset) && ((pick == NULL) || (txn->offset < pick->offset))) {
+            pick = txn;
+        }
+    }
+    if (pick == NULL) {
+        pick = lowest;
+    }
+    list_delete(&pick->node);
+    list_add_tail(out, &pick->node);
+    uint32_t count = 1;
+
+    // and whatever continues it
+    mx_off_t end = pick->offset + pick->length;
+    bool merged;
+    do {
+        merged = false;
+        list_for_every_entry (&client->queue, txn, iotxn_t, node) {
+            if ((txn->offset == end) && (txn->opcode == pick->opcode) &&
+                (end - pick->offset + txn->length <= SCHED_MERGE_MAX)) {
+                list_delete(&txn->node);
+                list_add_tail(out, &txn->node);
+                end += txn->length;
+                count++;
+                merged = true;
+                break;
+            }
+        }
+    } while (merged);
+
+    dev->next_offset = end;
+    dev->queued -= count;
+    dev->inflight++;
+    dev->stats.dispatched++;
+    if (count > 1) {
+        dev->stats.merged += count;
+    }
+    if (list_is_empty(&client->queue)) {
+        sched_client_put(dev, client);
+    } else {
+        list_add_tail(&dev->clients, &client->node);
+    }
+    return count;
+}
+
+// Takes one sent request off the books, releasing what was held behind
+// it if it was the barrier.  Requests that couldn't be queued again are
+// put on failed, to be completed without the lock.
+static void sched_retire(sched_device_t* dev, iotxn_t* txn, list_node_t* failed) {
+    mtx_lock(&dev->lock);
+    dev->inflight--;
+    if ((txn != NULL) && (txn == dev->barrier)) {
+        dev->barrier = NULL;
+        dev->barrier_sent = false;
+        iotxn_t* held;
+        while ((dev->barrier == NULL) &&
+               (held = list_remove_head_type(&dev->held, iotxn_t, node)) != NULL) {
+            if (!sched_add(dev, held)) {
+                list_add_tail(failed, &held->node);
+            }
+        }
+    }
+    mtx_unlock(&dev->lock);
+}
+
+static void sched_fail(list_node_t* list, mx_status_t status) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(list, iotxn_t, node)) != NULL) {
+        txn->ops->complete(txn, status, 0);
+    }
+}
+
+static void sched_one_complete(iotxn_t* clone, void* cookie) {
+    sched_device_t* dev = cookie;
+    iotxn_t* txn = *iotxn_to(clone, iotxn_t*);
+    mx_status_t status = clone->status;
+    mx_off_t actual = clone->actual;
+    clone->ops->release(clone);
+
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+    sched_retire(dev, txn, &failed);
+    txn->ops->complete(txn, status, actual);
+    sched_fail(&failed, ERR_NO_MEMORY);
+    sched_dispatch(dev);
+}
+
+static void sched_merge_complete(iotxn_t* merged, void* cookie) {
+    sched_merge_t* m = cookie;
+    sched_device_t* dev = m->dev;
+    mx_status_t status = merged->status;
+    mx_off_t actual = (status == NO_ERROR) ? merged->actual : 0;
+    void* data;
+    merged->ops->mmap(merged, &data);
+
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+    sched_retire(dev, NULL, &failed);
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&m->members, iotxn_t, node)) != NULL) {
+        mx_off_t skip = txn->offset - m->offset;
+        mx_off_t got = (actual > skip) ? MIN(actual - skip, txn->length) : 0;
+        if ((status == NO_ERROR) && (txn->opcode == IOTXN_OP_READ)) {
+            txn->ops->copyto(txn, data + skip, got, 0);
+        }
+        txn->ops->complete(txn, status, got);
+    }
+    merged->ops->release(merged);
+    sched_dispatch(dev);
+}
+
+// Sends one request down
+static void sched_issue_one(sched_device_t* dev, iotxn_t* txn) {
+    mx_status_t status = NO_ERROR;
+    iotxn_t* clone = NULL;
+    if (txn->complete_cb == sched_sync_complete) {
+        // the marker for a sync, which only had to wait its turn
+    } else if ((status = txn->ops->clone(txn, &clone, sizeof(iotxn_t*))) == NO_ERROR) {
+        clone->complete_cb = sched_one_complete;
+        clone->cookie = dev;
+        *iotxn_to(clone, iotxn_t*) = txn;
+        iotxn_queue(dev->device.parent, clone);
+        return;
+    }
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+    sched_retire(dev, txn, &failed);
+    txn->ops->complete(txn, status, 0);
+    sched_fail(&failed, ERR_NO_MEMORY);
+}
+
+// Sends requests that follow each other down as one, copying them into a
+// txn of its own.  Returns an error, and leaves them be, if it can't.
+static mx_status_t sched_issue_merged(sched_device_t* dev, list_node_t* members) {
+    iotxn_t* first = list_peek_head_type(members, iotxn_t, node);
+    iotxn_t* last = list_peek_tail_type(members, iotxn_t, node);
+    mx_off_t length = last->offset + last->length - first->offset;
+
+    iotxn_t* merged;
+    mx_status_t status = iotxn_pool_alloc(dev->pool, &merged, length);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    sched_merge_t* m = iotxn_to(merged, sched_merge_t);
+    m->dev = dev;
+    m->offset = first->offset;
+    list_initialize(&m->members);
+    merged->opcode = first->opcode;
+    merged->offset = first->offset;
+    merged->length = length;
+    merged->complete_cb = sched_merge_complete;
+    merged->cookie = m;
+
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(members, iotxn_t, node)) != NULL) {
+        if (txn->opcode == IOTXN_OP_WRITE) {
+            void* data;
+            txn->ops->mmap(txn, &data);
+            merged->ops->copyto(merged, data, txn->length, txn->offset - m->offset);
+        }
+        list_add_tail(&m->members, &txn->node);
+    }
+    xprintf("%s: merged at 0x%" PRIx64 ", 0x%" PRIx64 " bytes\n", dev->device.name,
+            merged->offset, length);
+    iotxn_queue(dev->device.parent, merged);
+    return NO_ERROR;
+}
+
+// Sends down what's next, until there's nothing more to send or as much
+// in flight as is allowed.  Only one thread does at a time; another that
+// comes along has it go round again.
+static void sched_dispatch(sched_device_t* dev) {
+    mtx_lock(&dev->lock);
+    if (dev->dispatching) {
+        dev->redispatch = true;
+        mtx_unlock(&dev->lock);
+        return;
+    }
+    dev->dispatching = true;
+    for (;;) {
+        list_node_t members = LIST_INITIAL_VALUE(members);
+        uint32_t count = sched_next(dev, &members);
+        if (count == 0) {
+            if (!dev->redispatch) {
+                break;
+            }
+            dev->redispatch = false;
+            continue;
+        }
+        mtx_unlock(&dev->lock);
+
+        if ((count == 1) || (sched_issue_merged(dev, &members) != NO_ERROR)) {
+            if (count > 1) {
+                // no memory to merge them, so they go down one at a time
+                mtx_lock(&dev->lock);
+                dev->inflight += count - 1;
+                mtx_unlock(&dev->lock);
+            }
+            iotxn_t* txn;
+            while ((txn = list_remove_head_type(&members, iotxn_t, node)) != NULL) {
+                sched_issue_one(dev, txn);
+            }
+        }
+        mtx_lock(&dev->lock);
+    }
+    dev->dispatching = false;
+    mtx_unlock(&dev->lock);
+}
+
+static void sched_iotxn_queue(mx_device_t* device, iotxn_t* txn) {
+    sched_device_t* dev = get_sched_device(device);
+    mtx_lock(&dev->lock);
+    if (dev->dead) {
+        mtx_unlock(&dev->lock);
+        txn->ops->complete(txn, ERR_REMOTE_CLOSED, 0);
+        return;
+    }
+    dev->stats.requests++;
+    bool queued = sched_add(dev, txn);
+    mtx_unlock(&dev->lock);
+    if (!queued) {
+        txn->ops->complete(txn, ERR_NO_MEMORY, 0);
+        return;
+    }
+    sched_dispatch(dev);
+}
+
+// Waits for everything queued before it to be done, then has the disk
+// flush its cache.
+static mx_status_t sched_sync(sched_device_t* dev) {
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc(&txn, 0, 0, 0);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    completion_t completion = COMPLETION_INIT;
+    txn->opcode = IOTXN_OP_READ;
+    txn->flags = IOTXN_SYNC_BEFORE;
+    txn->complete_cb = sched_sync_complete;
+    txn->cookie = &completion;
+    sched_iotxn_queue(&dev->device, txn);
+    completion_wait(&completion, MX_TIME_INFINITE);
+    status = txn->status;
+    txn->ops->release(txn);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    mx_device_t* parent = dev->device.parent;
+    return parent->ops->ioctl(parent, IOCTL_DEVICE_SYNC, NULL, 0, NULL, 0);
+}
+
+static ssize_t sched_ioctl(mx_device_t* device, uint32_t op, const void* cmd, size_t cmdlen,
+                           void* reply, size_t max) {
+    sched_device_t* dev = get_sched_device(device);
+    switch (op) {
+    case IOCTL_BLOCK_GET_SCHED_STATS: {
+        block_sched_stats_t* stats = reply;
+        if (max < sizeof(*stats)) return ERR_BUFFER_TOO_SMALL;
+        mtx_lock(&dev->lock);
+        *stats = dev->stats;
+        mtx_unlock(&dev->lock);
+        return sizeof(*stats);
+    }
+    case IOCTL_DEVICE_SYNC:
+        return sched_sync(dev);
+    default: {
+        mx_device_t* parent = device->parent;
+        return parent->ops->ioctl(parent, op, cmd, cmdlen, reply, max);
+    }
+    }
+}
+
+static mx_off_t sched_getsize(mx_device_t* device) {
+    mx_device_t* parent = device->parent;
+    return parent->ops->get_size(parent);
+}
+
+static void sched_unbind(mx_device_t* device) {
+    sched_device_t* dev = get_sched_device(device);
+    list_node_t dropped = LIST_INITIAL_VALUE(dropped);
+    mtx_lock(&dev->lock);
+    dev->dead = true;
+    sched_client_t* client;
+    while ((client = list_remove_head_type(&dev->clients, sched_client_t, node)) != NULL) {
+        iotxn_t* txn;
+        while ((txn = list_remove_head_type(&client->queue, iotxn_t, node)) != NULL) {
+            list_add_tail(&dropped, &txn->node);
+        }
+        sched_client_put(dev, client);
+    }
+    dev->queued = 0;
+    if ((dev->barrier != NULL) && !dev->barrier_sent) {
+        list_add_tail(&dropped, &dev->barrier->node);
+        dev->barrier = NULL;
+    }
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&dev->held, iotxn_t, node)) != NULL) {
+        list_add_tail(&dropped, &txn->node);
+    }
+    mtx_unlock(&dev->lock);
+    sched_fail(&dropped, ERR_REMOTE_CLOSED);
+    device_remove(device);
+}
+
+static mx_status_t sched_release(mx_device_t* device) {
+    sched_device_t* dev = get_sched_device(device);
+    sched_client_t* client;
+    while ((client = list_remove_head_type(&dev->idle_clients, sched_client_t, node)) != NULL) {
+        free(client);
+    }
+    iotxn_pool_destroy(dev->pool);
+    free(dev);
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t sched_proto = {
+    .ioctl = sched_ioctl,
+    .iotxn_queue = sched_iotxn_queue,
+    .get_size = sched_getsize,
+    .unbind = sched_unbind,
+    .release = sched_release,
+};
+
+static mx_status_t sched_bind(mx_driver_t* drv, mx_device_t* parent) {
+    sched_device_t* dev = calloc(1, sizeof(sched_device_t));
+    if (!dev) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status;
+    if ((status = iotxn_pool_create(&dev->pool, SCHED_MERGE_POOL, SCHED_MERGE_MAX,
+                                    sizeof(sched_merge_t))) != NO_ERROR) {
+        free(dev);
+        return status;
+    }
+    mtx_init(&dev->lock, mtx_plain);
+    list_initialize(&dev->clients);
+    list_initialize(&dev->idle_clients);
+    list_initialize(&dev->held);
+
+    char name[MX_DEVICE_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%s-sched", parent->name);
+    device_init(&dev->device, drv, name, &sched_proto);
+    dev->device.protocol_id = MX_PROTOCOL_BLOCK;
+    if ((status = device_add(&dev->device, parent)) != NO_ERROR) {
+        iotxn_pool_destroy(dev->pool);
+        free(dev);
+        return status;
+    }
+    return NO_ERROR;
+}
+
+mx_driver_t _driver_block_sched = {
+    .ops = {
+        .bind = sched_bind,
+    },
+    .flags = DRV_FLAG_NO_AUTOBIND,
+};
+
+MAGENTA_DRIVER_BEGIN(_driver_block_sched, "blksched", "magenta", "0.1", 1)
+    BI_MATCH_IF(EQ, BIND_PROTOCOL, MX_PROTOCOL_BLOCK),
+MAGENTA_DRIVER_END(_driver_block_sched)
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +62,13 @@ typedef struct bochs_vbe_device {
 #define BOCHS_VBE_DISPI_Y_OFFSET 0x9
 #define BOCHS_VBE_DISPI_VIDEO_MEMORY_64K 0xa
 
+// the vga registers at 0x3c0 - 0x3df are mirrored at 0x400 in the mmio bar
+#define BOCHS_VBE_VGA_INPUT_STATUS_1 0x41a // 0x3da
+#define BOCHS_VBE_VGA_VERTICAL_RETRACE 0x08
+
+// how long to look for a retrace before flipping anyway
+#define BOCHS_VBE_VSYNC_TIMEOUT MX_MSEC(50)
+
 static int mx_display_format_to_bpp(unsigned format) {
     unsigned bpp;
     switch (format) {
@@ -93,6 +101,31 @@ static int mx_display_format_to_bpp(unsigned format) {
     return bpp;
 }
 
+// bytes in one frame of the current mode
+static size_t bochs_vbe_page_size(bochs_vbe_device_t* dev) {
+    int bpp = mx_display_format_to_bpp(dev->info.format);
+    return (size_t)dev->info.stride * dev->info.height * ((bpp + 7) / 8);
+}
+
+static uint32_t bochs_vbe_page_count(bochs_vbe_device_t* dev) {
+    return dev->framebuffer_size / bochs_vbe_page_size(dev);
+}
+
+// wait for the start of a vertical retrace, so a new scanout offset takes
+// effect between frames
+static void bochs_vbe_wait_vsync(bochs_vbe_device_t* dev) {
+    const volatile uint8_t* status = (uint8_t*)dev->regs + BOCHS_VBE_VGA_INPUT_STATUS_1;
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + BOCHS_VBE_VSYNC_TIMEOUT;
+    while (pcie_read8(status) & BOCHS_VBE_VGA_VERTICAL_RETRACE) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline)
+            return;
+    }
+    while (!(pcie_read8(status) & BOCHS_VBE_VGA_VERTICAL_RETRACE)) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline)
+            return;
+    }
+}
+
 static void set_hw_mode(bochs_vbe_device_t* dev) {
     xprintf("id: 0x%x\n", bochs_vbe_dispi_read(dev->regs, BOCHS_VBE_DISPI_ID));
 
@@ -154,10 +187,41 @@ static mx_status_t bochs_vbe_get_framebuffer(mx_device_t* dev, void** framebuffe
     return NO_ERROR;
 }
 
+static void bochs_vbe_flush_region(mx_device_t* dev, const ioctl_display_region_t* regions,
+                                   uint32_t count) {
+    // the framebuffer is write combining, so all a flush needs is to drain
+    // the cpu's buffers, whatever the region
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static mx_status_t bochs_vbe_get_page(mx_device_t* dev, uint32_t page, void** framebuffer) {
+    assert(framebuffer);
+    bochs_vbe_device_t* vdev = get_bochs_vbe_device(dev);
+    if (page >= bochs_vbe_page_count(vdev))
+        return ERR_OUT_OF_RANGE;
+    (*framebuffer) = (uint8_t*)vdev->framebuffer + page * bochs_vbe_page_size(vdev);
+    return NO_ERROR;
+}
+
+static mx_status_t bochs_vbe_flip(mx_device_t* dev, uint32_t page) {
+    bochs_vbe_device_t* vdev = get_bochs_vbe_device(dev);
+    if (page >= bochs_vbe_page_count(vdev))
+        return ERR_OUT_OF_RANGE;
+
+    // pages are stacked in the virtual screen, so flipping is panning down
+    atomic_thread_fence(memory_order_seq_cst);
+    bochs_vbe_wait_vsync(vdev);
+    bochs_vbe_dispi_write(vdev->regs, BOCHS_VBE_DISPI_Y_OFFSET, page * vdev->info.height);
+    return NO_ERROR;
+}
+
 static mx_display_protocol_t bochs_vbe_display_proto = {
     .set_mode = bochs_vbe_set_mode,
     .get_mode = bochs_vbe_get_mode,
     .get_framebuffer = bochs_vbe_get_framebuffer,
+    .flush_region = bochs_vbe_flush_region,
+    .get_page = bochs_vbe_get_page,
+    .flip = bochs_vbe_flip,
 };
 
 // implement device protocol
@@ -37,11 +37,70 @@
 
 #define VC_DEVNAME "vc"
 
+// console output is pushed to the display at most this often
+#define VC_FLUSH_INTERVAL MX_MSEC(16)
+
 #define LOW_REPEAT_KEY_FREQUENCY_MICRO 250000000
 #define HIGH_REPEAT_KEY_FREQUENCY_MICRO 50000000
 
 // framebuffer
 static gfx_surface hw_gfx;
+static mx_device_t* hw_dev;
+static mx_display_protocol_t* hw_disp;
+
+// where the display can flip, whole frames are drawn to the page that is
+// not being scanned out, which hw_back covers, and then flipped to
+static gfx_surface hw_back;
+static void* hw_page[2];
+static uint32_t hw_front;
+static bool hw_can_flip;
+
+static void vc_hw_flush(unsigned starty, unsigned endy) {
+    ioctl_display_region_t region = {
+        .x = 0,
+        .y = starty,
+        .width = hw_gfx.width,
+        .height = endy - starty + 1,
+    };
+    hw_disp->flush_region(hw_dev, &region, 1);
+}
+
+gfx_surface* vc_hw_begin_frame(void) {
+    return hw_can_flip ? &hw_back : &hw_gfx;
+}
+
+void vc_hw_end_frame(gfx_surface* frame) {
+    gfx_flush(frame);
+    if (frame != &hw_back) {
+        return;
+    }
+    if (hw_disp->flip(hw_dev, !hw_front) < 0) {
+        // show it the slow way
+        gfx_copylines(&hw_gfx, &hw_back, 0, 0, hw_gfx.height);
+        gfx_flush(&hw_gfx);
+        return;
+    }
+    hw_front = !hw_front;
+    hw_gfx.ptr = hw_page[hw_front];
+    hw_back.ptr = hw_page[!hw_front];
+}
+
+static void vc_hw_init_pages(gfx_surface* hw, mx_display_info_t* info) {
+    if (!hw_disp->get_page || !hw_disp->flip) {
+        return;
+    }
+    if ((hw_disp->get_page(hw_dev, 0, &hw_page[0]) < 0) ||
+        (hw_disp->get_page(hw_dev, 1, &hw_page[1]) < 0)) {
+        return;
+    }
+    if (gfx_init_surface(&hw_back, hw_page[1], info->width, info->height, info->stride,
+                         info->format, 0) < 0) {
+        return;
+    }
+    hw_back.flush = hw->flush;
+    hw_front = 0;
+    hw_can_flip = true;
+}
 
 static thrd_t input_poll_thread;
 
@@ -55,6 +114,11 @@ static unsigned active_vc_index;
 static vc_battery_info_t battery_info;
 static mtx_t vc_lock = MTX_INIT;
 
+// the flush thread waits on this for output to push
+static mtx_t vc_flush_lock = MTX_INIT;
+static cnd_t vc_flush_cnd;
+static bool vc_flush_pending;
+
 static void vc_process_kb_report(uint8_t* report_buf, hid_keys_t* key_state,
                                  int* cur_idx, int* prev_idx,
                                  hid_keys_t* key_pressed,
@@ -639,17 +703,58 @@ static ssize_t vc_device_read(mx_device_t* dev, void* buf, size_t count, mx_off_
     return r ? r : (ssize_t)ERR_SHOULD_WAIT;
 }
 
+static void vc_schedule_flush(void) {
+    mtx_lock(&vc_flush_lock);
+    vc_flush_pending = true;
+    cnd_signal(&vc_flush_cnd);
+    mtx_unlock(&vc_flush_lock);
+}
+
+// pushes the active vc's output to the display, a frame at a time, so a
+// flood of output costs a copy per frame rather than one per write
+static int vc_flush_thread(void* arg) {
+    mx_time_t last = 0;
+    for (;;) {
+        mtx_lock(&vc_flush_lock);
+        while (!vc_flush_pending) {
+            cnd_wait(&vc_flush_cnd, &vc_flush_lock);
+        }
+        vc_flush_pending = false;
+        mtx_unlock(&vc_flush_lock);
+
+        // let the rest of this frame's output collect
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        if (now - last < VC_FLUSH_INTERVAL) {
+            mx_nanosleep(VC_FLUSH_INTERVAL - (now - last));
+        }
+
+        // vc_lock keeps the vc from being released, and is taken inside
+        // vc->lock elsewhere, so the vc can only be tried here
+        mtx_lock(&vc_lock);
+        vc_device_t* vc = active_vc;
+        if (vc != NULL) {
+            if (mtx_trylock(&vc->lock) == thrd_success) {
+                vc_device_flush(vc);
+                mtx_unlock(&vc->lock);
+            } else {
+                vc_schedule_flush();
+            }
+        }
+        mtx_unlock(&vc_lock);
+        last = mx_time_get(MX_CLOCK_MONOTONIC);
+    }
+    return 0;
+}
+
 static ssize_t vc_device_write(mx_device_t* dev, const void* buf, size_t count, mx_off_t off) {
     vc_device_t* vc = get_vc_device(dev);
     mtx_lock(&vc->lock);
-    vc->invy0 = vc_device_rows(vc) + 1;
-    vc->invy1 = -1;
     const uint8_t* str = (const uint8_t*)buf;
     for (size_t i = 0; i < count; i++) {
         vc->textcon.putc(&vc->textcon, str[i]);
     }
-    if (vc->invy1 >= 0) {
-        vc_gfx_invalidate(vc, 0, vc->invy0, vc->columns, vc->invy1 - vc->invy0);
+    if (vc->active && ((vc->invy1 >= 0) || (vc->flags & VC_FLAG_STATUSDIRTY))) {
+        vc_schedule_flush();
     }
     if (!vc->active && !(vc->flags & VC_FLAG_HASINPUT)) {
         vc->flags |= VC_FLAG_HASINPUT;
@@ -698,10 +803,12 @@ static ssize_t vc_device_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, s
         return NO_ERROR;
     case IOCTL_DISPLAY_FLUSH_FB_REGION: {
         const ioctl_display_region_t* rect = cmd;
-        if (cmdlen < sizeof(*rect)) {
+        if ((cmdlen < sizeof(*rect)) || (cmdlen % sizeof(*rect))) {
             return ERR_INVALID_ARGS;
         }
-        vc_gfx_invalidate_region(vc, rect->x, rect->y, rect->width, rect->height);
+        for (size_t i = 0; i < cmdlen / sizeof(*rect); i++) {
+            vc_gfx_invalidate_region(vc, rect[i].x, rect[i].y, rect[i].width, rect[i].height);
+        }
         return NO_ERROR;
     }
     case IOCTL_DISPLAY_SET_FULLSCREEN: {
@@ -885,6 +992,12 @@ static mx_status_t vc_root_bind(mx_driver_t* drv, mx_device_t* dev) {
     if ((status = gfx_init_surface(&hw_gfx, framebuffer, info.width, info.height, info.stride, info.format, 0)) < 0) {
         return status;
     }
+    hw_dev = dev;
+    hw_disp = disp;
+    if (disp->flush_region) {
+        hw_gfx.flush = vc_hw_flush;
+    }
+    vc_hw_init_pages(&hw_gfx, &info);
 
     // publish the root vc device. opening this device will create a new vc
     mx_device_t* device;
@@ -909,6 +1022,10 @@ static mx_status_t vc_root_bind(mx_driver_t* drv, mx_device_t* dev) {
     xprintf("initialized vc on display %s, width=%u height=%u stride=%u format=%u\n",
             dev->name, info.width, info.height, info.stride, info.format);
 
+    thrd_t f;
+    cnd_init(&vc_flush_cnd);
+    thrd_create_with_name(&f, vc_flush_thread, NULL, "vc-flush");
+
     if (vc_root_open(NULL, &dev, 0) == NO_ERROR) {
         thrd_t t;
         thrd_create_with_name(&t, vc_log_reader_thread, dev, "vc-log-reader");
@@ -4,6 +4,7 @@
 
 #include <assert.h>
 #include <ddk/protocol/console.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
@@ -62,6 +63,27 @@ static mx_status_t vc_device_setup(vc_device_t* dev) {
         return ERR_NO_MEMORY;
     }
 
+    // expand the font into an atlas, so drawing needs no bit twiddling
+    const gfx_font* font = dev->font;
+    dev->glyphs = malloc(128 * font->height * font->width);
+    if (!dev->glyphs) {
+        free(dev->scrollback_buf);
+        free(dev->text_buf);
+        return ERR_NO_MEMORY;
+    }
+    uint8_t* glyph = dev->glyphs;
+    for (unsigned i = 0; i < 128 * font->height; i++) {
+        uint16_t bits = font->data[i];
+        for (unsigned j = 0; j < font->width; j++) {
+            *glyph++ = bits & 1;
+            bits >>= 1;
+        }
+    }
+
+    // nothing drawn but not yet shown
+    dev->invy0 = INT_MAX;
+    dev->invy1 = -1;
+
     // set up the default palette
     memcpy(&dev->palette, default_palette, sizeof(default_palette));
     dev->front_color = DEFAULT_FRONT_COLOR;
@@ -79,12 +101,10 @@ static void vc_device_invalidate(void* cookie, int x0, int y0, int w, int h) {
             if (sc < 0)
                 sc += dev->scrollback_rows;
         }
-        for (int x = x0; x < x0 + w; x++) {
-            if (y < 0) {
-                vc_gfx_draw_char(dev, dev->scrollback_buf[x + sc * dev->columns], x, y - dev->vpy);
-            } else {
-                vc_gfx_draw_char(dev, dev->text_buf[x + y * dev->columns], x, y - dev->vpy);
-            }
+        if (y < 0) {
+            vc_gfx_draw_run(dev, &dev->scrollback_buf[x0 + sc * dev->columns], w, x0, y - dev->vpy);
+        } else {
+            vc_gfx_draw_run(dev, &dev->text_buf[x0 + y * dev->columns], w, x0, y - dev->vpy);
         }
     }
 }
@@ -149,19 +169,20 @@ static void vc_tc_scroll(void* cookie, int y0, int y1, int dir) {
         return;
     // invalidate the cursor before copying
     vc_device_invalidate(cookie, dev->x, dev->y, 1, 1);
+    // move whole lines, and draw only the ones scrolled in
     int delta = ABS(dir);
     if (dir > 0) {
-        gfx_copyrect(dev->gfx, 0, (y0 + delta) * dev->charh,
-                     dev->gfx->width, (y1 - y0 - delta) * dev->charh, 0, y0);
+        gfx_copylines(dev->gfx, dev->gfx, (y0 + delta) * dev->charh, y0 * dev->charh,
+                      (y1 - y0 - delta) * dev->charh);
         vc_device_invalidate(cookie, 0, y1 - delta, dev->columns, delta);
     } else {
-        gfx_copyrect(dev->gfx, 0, y0, dev->gfx->width, (y1 - y0 - delta) * dev->charh,
-                     0, (y0 + delta) * dev->charh);
+        gfx_copylines(dev->gfx, dev->gfx, y0 * dev->charh, (y0 + delta) * dev->charh,
+                      (y1 - y0 - delta) * dev->charh);
         vc_device_invalidate(cookie, 0, y0, dev->columns, delta);
     }
     vc_device_write_status(dev);
-    vc_gfx_invalidate_status(dev);
-    vc_invalidate_lines(dev, 0, vc_device_rows(dev));
+    dev->flags |= VC_FLAG_STATUSDIRTY;
+    vc_invalidate_lines(dev, y0, y1 - y0);
 }
 
 static void vc_tc_setparam(void* cookie, int param, uint8_t* arg, size_t arglen) {
@@ -304,6 +325,21 @@ void vc_device_render(vc_device_t* dev) {
     vc_gfx_invalidate_all(dev);
 }
 
+void vc_device_flush(vc_device_t* dev) {
+    if (dev->invy1 >= 0) {
+        int y0 = MAX(dev->invy0, 0);
+        if (dev->invy1 > y0) {
+            vc_gfx_invalidate(dev, 0, y0, dev->columns, dev->invy1 - y0);
+        }
+        dev->invy0 = INT_MAX;
+        dev->invy1 = -1;
+    }
+    if (dev->flags & VC_FLAG_STATUSDIRTY) {
+        dev->flags &= ~VC_FLAG_STATUSDIRTY;
+        vc_gfx_invalidate_status(dev);
+    }
+}
+
 int vc_device_get_scrollback_lines(vc_device_t* dev) {
     return dev->sc_t >= dev->sc_h ? dev->sc_t - dev->sc_h : dev->scrollback_rows - 1;
 }
@@ -316,12 +352,10 @@ void vc_device_scroll_viewport(vc_device_t* dev, int dir) {
     dev->vpy = vpy;
     unsigned rows = vc_device_rows(dev);
     if (dir > 0) {
-        gfx_copyrect(dev->gfx, 0, delta * dev->charh,
-                     dev->gfx->width, (rows - delta) * dev->charh, 0, 0);
+        gfx_copylines(dev->gfx, dev->gfx, delta * dev->charh, 0, (rows - delta) * dev->charh);
         vc_device_invalidate(dev, 0, vpy + rows - delta, dev->columns, delta);
     } else {
-        gfx_copyrect(dev->gfx, 0, 0, dev->gfx->width,
-                     (rows - delta) * dev->charh, 0, delta * dev->charh);
+        gfx_copylines(dev->gfx, dev->gfx, 0, delta * dev->charh, (rows - delta) * dev->charh);
         vc_device_invalidate(dev, 0, vpy, dev->columns, delta);
     }
     gfx_flush(dev->gfx);
@@ -400,7 +434,8 @@ mx_status_t vc_device_alloc(gfx_surface* hw_gfx, vc_device_t** out_dev) {
         goto fail;
     device->hw_gfx = hw_gfx;
 
-    vc_device_setup(device);
+    if (vc_device_setup(device) < 0)
+        goto fail;
     vc_device_reset(device);
 
     *out_dev = device;
@@ -411,6 +446,7 @@ fail:
 }
 
 void vc_device_free(vc_device_t* device) {
+    free(device->glyphs);
     if (device->st_gfx)
         gfx_surface_destroy(device->st_gfx);
     if (device->gfx_vmo)
@@ -9,21 +9,78 @@
 #include "vc.h"
 #include "vcdebug.h"
 
-void vc_gfx_draw_char(vc_device_t* dev, vc_char_t ch, unsigned x, unsigned y) {
-    gfx_putchar(dev->gfx, dev->font, TOCHAR(ch), x * dev->charw, y * dev->charh,
-                palette_to_color(dev, TOFG(ch)), palette_to_color(dev, TOBG(ch)));
+// the run is drawn a whole row of pixels at a time, from the font atlas,
+// with colors translated once for the palette rather than per char
+#define MKDRAWRUN(FUNC, TYPE) \
+static void FUNC(vc_device_t* dev, const uint32_t* colors, const vc_char_t* chars, \
+                 unsigned count, unsigned px, unsigned py) { \
+    gfx_surface* gfx = dev->gfx; \
+    unsigned cw = dev->charw; \
+    for (unsigned row = 0; row < dev->charh; row++) { \
+        TYPE* dest = (TYPE*)gfx->ptr + px + (py + row) * gfx->stride; \
+        for (unsigned i = 0; i < count; i++) { \
+            vc_char_t ch = chars[i]; \
+            unsigned c = TOCHAR(ch) > 127 ? ' ' : TOCHAR(ch); \
+            const uint8_t* glyph = dev->glyphs + (c * dev->charh + row) * cw; \
+            TYPE fg = (TYPE)colors[TOFG(ch)]; \
+            TYPE bg = (TYPE)colors[TOBG(ch)]; \
+            for (unsigned j = 0; j < cw; j++) { \
+                TYPE mask = (TYPE)-glyph[j]; \
+                *dest++ = (fg & mask) | (bg & ~mask); \
+            } \
+        } \
+    } \
+}
+
+MKDRAWRUN(draw_run8, uint8_t)
+MKDRAWRUN(draw_run16, uint16_t)
+MKDRAWRUN(draw_run32, uint32_t)
+
+void vc_gfx_draw_run(vc_device_t* dev, const vc_char_t* chars, unsigned count, unsigned x, unsigned y) {
+    gfx_surface* gfx = dev->gfx;
+    if ((x >= dev->columns) || ((y + 1) * dev->charh > gfx->height))
+        return;
+    if (count > dev->columns - x)
+        count = dev->columns - x;
+    if (count == 0)
+        return;
+
+    uint32_t colors[countof(dev->palette)];
+    for (unsigned i = 0; i < countof(colors); i++) {
+        colors[i] = palette_to_color(dev, i);
+        if (gfx->translate_color)
+            colors[i] = gfx->translate_color(colors[i]);
+    }
+
+    unsigned px = x * dev->charw;
+    unsigned py = y * dev->charh;
+    switch (gfx->pixelsize) {
+    case 4:
+        draw_run32(dev, colors, chars, count, px, py);
+        break;
+    case 2:
+        draw_run16(dev, colors, chars, count, px, py);
+        break;
+    case 1:
+        draw_run8(dev, colors, chars, count, px, py);
+        break;
+    default:
+        return;
+    }
+    gfx_mark_dirty(gfx, px, py, count * dev->charw, dev->charh);
 }
 
 void vc_gfx_invalidate_all(vc_device_t* dev) {
     if (!dev->active)
         return;
+    gfx_surface* frame = vc_hw_begin_frame();
     if (dev->flags & VC_FLAG_FULLSCREEN) {
-        gfx_copylines(dev->hw_gfx, dev->gfx, 0, 0, dev->gfx->height);
+        gfx_copylines(frame, dev->gfx, 0, 0, dev->gfx->height);
     } else {
-        gfx_copylines(dev->hw_gfx, dev->st_gfx, 0, 0, dev->st_gfx->height);
-        gfx_copylines(dev->hw_gfx, dev->gfx, 0, dev->st_gfx->height, dev->gfx->height - dev->st_gfx->height);
+        gfx_copylines(frame, dev->st_gfx, 0, 0, dev->st_gfx->height);
+        gfx_copylines(frame, dev->gfx, 0, dev->st_gfx->height, dev->gfx->height - dev->st_gfx->height);
     }
-    gfx_flush(dev->hw_gfx);
+    vc_hw_end_frame(frame);
 }
 
 void vc_gfx_invalidate_status(vc_device_t* dev) {
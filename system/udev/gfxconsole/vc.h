@@ -44,6 +44,9 @@ typedef struct vc_device {
     gfx_surface* hw_gfx;
     // backing store
     const gfx_font* font;
+    uint8_t* glyphs;
+    // font atlas: for each char, charh rows of charw bytes, 1 where the
+    // glyph is set
 
     vc_char_t* text_buf;
     // text buffer
@@ -58,7 +61,8 @@ typedef struct vc_device {
     // number of rows in scrollback
 
     int invy0, invy1;
-    // offscreen invalid lines, tracked during textcon drawing
+    // offscreen invalid lines, tracked during textcon drawing and pushed
+    // to the display by vc_device_flush
 
     unsigned x, y;
     // cursor
@@ -96,6 +100,7 @@ typedef struct vc_device {
 #define VC_FLAG_HASINPUT    (1 << 0)
 #define VC_FLAG_RESETSCROLL (1 << 1)
 #define VC_FLAG_FULLSCREEN  (1 << 2)
+#define VC_FLAG_STATUSDIRTY (1 << 3)
 
 mx_status_t vc_device_alloc(gfx_surface* hw_gfx, vc_device_t** out_dev);
 void vc_device_free(vc_device_t* dev);
@@ -116,6 +121,8 @@ void vc_device_render(vc_device_t* dev);
 int vc_device_get_scrollback_lines(vc_device_t* dev);
 void vc_device_scroll_viewport(vc_device_t* dev, int dir);
 void vc_device_set_fullscreen(vc_device_t* dev, bool fullscreen);
+// pushes what textcon has drawn since the last flush; call with dev->lock held
+void vc_device_flush(vc_device_t* dev);
 
 static inline int vc_device_rows(vc_device_t* dev) {
     return dev->flags & VC_FLAG_FULLSCREEN ? dev->rows : dev->rows - 1;
@@ -129,7 +136,13 @@ void vc_gfx_invalidate_status(vc_device_t* dev);
 void vc_gfx_invalidate(vc_device_t* dev, unsigned x, unsigned y, unsigned w, unsigned h);
 // invalidates a region in pixels
 void vc_gfx_invalidate_region(vc_device_t* dev, unsigned x, unsigned y, unsigned w, unsigned h);
-void vc_gfx_draw_char(vc_device_t* dev, vc_char_t ch, unsigned x, unsigned y);
+// draws count chars along a row, starting at x, y in characters
+void vc_gfx_draw_run(vc_device_t* dev, const vc_char_t* chars, unsigned count, unsigned x, unsigned y);
+
+// whole frames are drawn to the surface vc_hw_begin_frame returns, which is
+// off screen if the display can flip, and shown by vc_hw_end_frame
+gfx_surface* vc_hw_begin_frame(void);
+void vc_hw_end_frame(gfx_surface* frame);
 
 static inline uint32_t palette_to_color(vc_device_t* dev, uint8_t color) {
     assert(color <= MAX_COLOR);
@@ -494,6 +494,9 @@ static int i8042_irq_thread(void* arg) {
     if (status)
         return 0;
 
+    // input latency is what the user feels, so don't queue behind anyone
+    mx_interrupt_set_affinity(device->irq, MX_INTERRUPT_CPU_ANY, MX_INTERRUPT_PRIORITY_HIGH);
+
     for (;;) {
         status = mx_interrupt_wait(device->irq);
         if (status == NO_ERROR) {
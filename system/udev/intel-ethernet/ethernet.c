@@ -29,6 +29,10 @@ typedef struct ethernet_device ethernet_device_t;
 struct ethernet_device {
     ethdev_t eth;
     mtx_t lock;
+    // each receive queue has its own lock, and event for DEV_STATE_READABLE,
+    // which for queue 0 is the device's
+    mtx_t rx_lock[ETH_RXQ_MAX];
+    mx_handle_t rx_event[ETH_RXQ_MAX];
     mx_device_t dev;
     pci_protocol_t* pci;
     mx_device_t* pcidev;
@@ -43,6 +47,8 @@ struct ethernet_device {
 
 static int irq_thread(void* arg) {
     ethernet_device_t* edev = arg;
+    // the irq is delivered to cpu 0, so wake up there
+    mx_interrupt_set_affinity(edev->irqh, 0, MX_INTERRUPT_PRIORITY_HIGH);
     for (;;) {
         mx_status_t r;
         if ((r = mx_interrupt_wait(edev->irqh)) < 0) {
@@ -54,11 +60,18 @@ static int irq_thread(void* arg) {
         if (edev->edge_triggered_irq)
             mx_interrupt_complete(edev->irqh);
 
-        mtx_lock(&edev->lock);
-        if (eth_handle_irq(&edev->eth) & ETH_IRQ_RX) {
-            device_state_set(&edev->dev, DEV_STATE_READABLE);
+        // there's one irq for all the queues, so wake those it was for
+        bool rx = eth_handle_irq(&edev->eth) & ETH_IRQ_RX;
+        for (uint32_t q = 0; q < edev->eth.rx_queues; q++) {
+            mtx_lock(&edev->rx_lock[q]);
+            if (rx && eth_rx_pending(&edev->eth, q)) {
+                mx_object_signal(edev->rx_event[q], 0, DEV_STATE_READABLE);
+            }
+        }
+        eth_update_itr(&edev->eth);
+        for (uint32_t q = 0; q < edev->eth.rx_queues; q++) {
+            mtx_unlock(&edev->rx_lock[q]);
         }
-        mtx_unlock(&edev->lock);
 
         if (!edev->edge_triggered_irq)
             mx_interrupt_complete(edev->irqh);
@@ -66,18 +79,35 @@ static int irq_thread(void* arg) {
     return 0;
 }
 
-static mx_status_t eth_recv(mx_device_t* dev, void* data, size_t len) {
+static mx_status_t eth_recv_queue(mx_device_t* dev, uint32_t queue, void* data, size_t len,
+                                  uint32_t* hash) {
     ethernet_device_t* edev = get_eth_device(dev);
+    if (queue >= edev->eth.rx_queues) {
+        return ERR_INVALID_ARGS;
+    }
     mx_status_t r = ERR_BAD_STATE;
-    mtx_lock(&edev->lock);
-    r = eth_rx(&edev->eth, data);
+    mtx_lock(&edev->rx_lock[queue]);
+    r = eth_rx(&edev->eth, queue, data, hash);
     if (r <= 0) {
-        device_state_clr(dev, DEV_STATE_READABLE);
+        mx_object_signal(edev->rx_event[queue], DEV_STATE_READABLE, 0);
     }
-    mtx_unlock(&edev->lock);
+    mtx_unlock(&edev->rx_lock[queue]);
     return r;
 }
 
+static mx_status_t eth_recv(mx_device_t* dev, void* data, size_t len) {
+    return eth_recv_queue(dev, 0, data, len, NULL);
+}
+
+static uint32_t eth_get_rx_queues(mx_device_t* dev) {
+    return get_eth_device(dev)->eth.rx_queues;
+}
+
+static mx_handle_t eth_get_rx_queue_event(mx_device_t* dev, uint32_t queue) {
+    ethernet_device_t* edev = get_eth_device(dev);
+    return (queue < edev->eth.rx_queues) ? edev->rx_event[queue] : ERR_INVALID_ARGS;
+}
+
 static mx_status_t eth_send(mx_device_t* dev, const void* data, size_t len) {
     ethernet_device_t* edev = get_eth_device(dev);
     if (len > ETH_TXBUF_DSIZE) {
@@ -104,12 +134,22 @@ static size_t eth_get_mtu(mx_device_t* dev) {
     return ETH_RXBUF_SIZE;
 }
 
+// The hardware can also insert checksums and segment TCP on the way out,
+// but send() has no way to ask for either yet.
+static uint32_t eth_get_features(mx_device_t* dev) {
+    return ETH_FEATURE_RX_CSUM;
+}
+
 static ethernet_protocol_t ethernet_ops = {
     .send = eth_send,
     .recv = eth_recv,
     .get_mac_addr = eth_get_mac_addr,
     .is_online = eth_is_online,
     .get_mtu = eth_get_mtu,
+    .get_features = eth_get_features,
+    .get_rx_queues = eth_get_rx_queues,
+    .recv_queue = eth_recv_queue,
+    .get_rx_queue_event = eth_get_rx_queue_event,
 };
 
 // simplified read/write interface
@@ -136,6 +176,9 @@ static mx_status_t eth_release(mx_device_t* dev) {
     edev->pci->enable_bus_master(edev->pcidev, true);
     mx_handle_close(edev->irqh);
     mx_handle_close(edev->ioh);
+    for (uint32_t q = 1; q < edev->eth.rx_queues; q++) {
+        mx_handle_close(edev->rx_event[q]);
+    }
     free(dev);
     return ERR_NOT_SUPPORTED;
 }
@@ -146,12 +189,57 @@ static mx_protocol_device_t device_ops = {
     .write = eth_write,
 };
 
+// ring depths come from the commandline, rounded down to a power of two
+static uint32_t eth_ring_count(const char* opt, uint32_t count) {
+    const char* v = getenv(opt);
+    if (v != NULL) {
+        uint32_t n = strtoul(v, NULL, 0);
+        if ((n < ETH_RING_MIN) || (n > ETH_RING_MAX)) {
+            printf("eth: %s must be from %u to %u\n", opt, ETH_RING_MIN, ETH_RING_MAX);
+        } else {
+            for (count = ETH_RING_MIN; count * 2 <= n; count *= 2)
+                ;
+        }
+    }
+    return count;
+}
+
+// Only the PCH parts have more than one receive queue; those use both
+// unless told otherwise.
+static void eth_config(ethdev_t* eth, uint32_t rx_queues) {
+    eth->rx_queues = rx_queues;
+    const char* v = getenv("intel-ethernet.rxqueues");
+    if (v != NULL) {
+        uint32_t n = strtoul(v, NULL, 0);
+        if ((n < 1) || (n > rx_queues)) {
+            printf("eth: intel-ethernet.rxqueues must be from 1 to %u here\n", rx_queues);
+        } else {
+            eth->rx_queues = n;
+        }
+    }
+
+    eth->rx_count = eth_ring_count("intel-ethernet.rxring", ETH_RXBUF_COUNT);
+    eth->tx_count = eth_ring_count("intel-ethernet.txring", ETH_TXBUF_COUNT);
+
+    // a fixed rate limit, 0 for none, or by default one that adapts
+    v = getenv("intel-ethernet.itr");
+    if (v != NULL) {
+        eth->itr = strtoul(v, NULL, 0);
+        eth->itr_adaptive = false;
+    } else {
+        eth->itr_adaptive = true;
+    }
+}
+
 static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev) {
     ethernet_device_t* edev;
     if ((edev = calloc(1, sizeof(ethernet_device_t))) == NULL) {
         return ERR_NO_MEMORY;
     }
     mtx_init(&edev->lock, mtx_plain);
+    for (uint32_t q = 0; q < ETH_RXQ_MAX; q++) {
+        mtx_init(&edev->rx_lock[q], mtx_plain);
+    }
 
     pci_protocol_t* pci;
     if (device_get_protocol(dev, MX_PROTOCOL_PCI, (void**)&pci)) {
@@ -203,7 +291,24 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev) {
         goto fail;
     }
 
-    r = io_buffer_init(&edev->buffer, ETH_ALLOC, IO_BUFFER_RW);
+    const pci_config_t* pci_config;
+    mx_handle_t cfgh = pci->get_config(dev, &pci_config);
+    if (cfgh < 0) {
+        printf("eth: cannot get pci config %d\n", cfgh);
+        goto fail;
+    }
+    eth_config(&edev->eth, (pci_config->device_id == 0x100E) ? 1 : ETH_RXQ_MAX);
+    mx_handle_close(cfgh);
+
+    for (uint32_t q = 1; q < edev->eth.rx_queues; q++) {
+        if ((r = mx_event_create(0, &edev->rx_event[q])) < 0) {
+            printf("eth: cannot create rx queue event %d\n", r);
+            edev->eth.rx_queues = q;
+            break;
+        }
+    }
+
+    r = io_buffer_init(&edev->buffer, eth_alloc_size(&edev->eth), IO_BUFFER_RW);
     if (r < 0) {
         printf("eth: cannot alloc io-buffer %d\n", r);
         goto fail;
@@ -218,6 +323,7 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev) {
     if (device_add(&edev->dev, dev)) {
         goto fail;
     }
+    edev->rx_event[0] = edev->dev.event;
 
     thrd_create_with_name(&edev->thread, irq_thread, edev, "eth-irq-thread");
     thrd_detach(edev->thread);
@@ -226,6 +332,9 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev) {
 
 fail:
     io_buffer_release(&edev->buffer);
+    for (uint32_t q = 1; q < edev->eth.rx_queues; q++) {
+        mx_handle_close(edev->rx_event[q]);
+    }
     if (edev->ioh) {
         edev->pci->enable_bus_master(edev->pcidev, true);
         mx_handle_close(edev->irqh);
@@ -18,6 +18,7 @@
 #define IE_ICS       0x00C8 // Interrupt Cause Set
 #define IE_IMS       0x00D0 // Interrupt Mask Set / Read
 #define IE_IMC       0x00D8 // Interrupt Mask Clear
+#define IE_ITR       0x00C4 // Interrupt Throttling
 
 #define IE_RCTL      0x0100 // Receive Control
 #define IE_RDBAL     0x2800 // RX Descriptor Base Low
@@ -26,6 +27,7 @@
 #define IE_RDH       0x2810 // RX Descriptor Head
 #define IE_RDT       0x2818 // RX Descriptor Tail
 #define IE_RDTR      0x3820 // RX Delay Timer
+#define IE_RXQ(reg, n) ((reg) + (n) * 0x100) // RDBAL..RXDCTL for RX queue n
 
 #define IE_TCTL      0x0400 // Transmit Control
 #define IE_TIPG      0x0410 // TX IPG
@@ -41,6 +43,10 @@
 #define IE_RXDCTL    0x2828 // RX Descriptor Control
 
 #define IE_RXCSUM    0x5000 // RX Checksum Control
+#define IE_RFCTL     0x5008 // RX Filter Control
+#define IE_MRQC      0x5818 // Multiple RX Queues Command
+#define IE_RETA(n)   (0x5C00 + ((n) * 4)) // Redirection Table [0:31], 4 entries each
+#define IE_RSSRK(n)  (0x5C80 + ((n) * 4)) // RSS Random Key [0:9]
 #define IE_MTA(n)    (0x5200 + ((n) * 4)) // RX Multicast Table Array [0:127]
 #define IE_RAL(n)    (0x5400 + ((n) * 8)) // RX Address Low
 #define IE_RAH(n)    (0x5404 + ((n) * 8)) // RX Address High
@@ -79,6 +85,22 @@
 #define IE_INT_MDAC       (1 << 9) // MDIO Access Complete
 #define IE_INT_PHYINT     (1 << 12 // PHY Interrupt
 
+#define IE_ITR_INTERVAL(rate) (3906250 / (rate)) // 256ns units between irqs, for irqs/s
+
+#define IE_RXCSUM_IPOFL   (1 << 8) // IP Checksum Offload Enable
+#define IE_RXCSUM_TUOFL   (1 << 9) // TCP/UDP Checksum Offload Enable
+#define IE_RXCSUM_PCSD    (1 << 13) // Packet Checksum Disable (RSS hash in its place)
+
+#define IE_RFCTL_EXSTEN   (1 << 15) // Extended Status Enable (extended rx descriptors)
+
+#define IE_MRQC_RSS       (1 << 0) // Multiple RX Queues by RSS
+#define IE_MRQC_TCPIPV4   (1 << 16) // which headers are hashed
+#define IE_MRQC_IPV4      (1 << 17)
+#define IE_MRQC_TCPIPV6   (1 << 18)
+#define IE_MRQC_IPV6      (1 << 20)
+
+#define IE_RETA_QUEUE(q)  ((q) << 7) // per 8 bit entry
+
 #define IE_RCTL_RST       (1 << 0) // RX Reset*
 #define IE_RCTL_EN        (1 << 1) // RX Enable
 #define IE_RCTL_SBP       (1 << 2) // Store Bad Packates
@@ -136,6 +158,14 @@ typedef struct ie_rxd {
 #define IE_RXD_CHK(n)  (((n) >> 16) & 0xFFFF)
 #define IE_RXD_LEN(n)  ((n) & 0xFFFF)
 
+// Extended rx descriptors are given to the hardware as an address and 0,
+// and written back as the RSS hash in the high half of the first word,
+// and in the second, the same status and error bits as legacy ones but
+// moved: status in 7:0, errors in 31:24, and length in 47:32.
+#define IE_RXDX_HASH(a)  ((uint32_t)((a) >> 32))
+#define IE_RXDX_INFO(n)  (IE_RXD_LEN((n) >> 32) | (((n) & 0xFFULL) << 32) | \
+                          ((((n) >> 24) & 0xFFULL) << 40)) // in the legacy layout
+
 
 typedef struct ie_txd {
     uint64_t addr;
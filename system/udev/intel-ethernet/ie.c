@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <magenta/listnode.h>
 
@@ -44,30 +45,90 @@ unsigned eth_handle_irq(ethdev_t* eth) {
     return readl(IE_ICR);
 }
 
-status_t eth_rx(ethdev_t* eth, void* data) {
-    uint32_t n = eth->rx_rd_ptr;
-    uint64_t info = eth->rxd[n].info;
-
-    if (!(info & IE_RXD_DONE)) {
-        return ERR_BAD_STATE;
+void eth_update_itr(ethdev_t* eth) {
+    uint32_t packets = 0;
+    uint32_t bytes = 0;
+    for (uint32_t q = 0; q < eth->rx_queues; q++) {
+        packets += eth->rxq[q].itr_packets;
+        bytes += eth->rxq[q].itr_bytes;
+        eth->rxq[q].itr_packets = 0;
+        eth->rxq[q].itr_bytes = 0;
+    }
+    if (!eth->itr_adaptive || (packets == 0)) {
+        return;
     }
 
-    // copy out packet
-    mx_status_t r = IE_RXD_LEN(info);
-    if (r > ETH_RXBUF_SIZE) {
-        // should not be possible, but...
-        r = ERR_BAD_STATE;
+    // a trickle of small frames is delivered as soon as it arrives, and
+    // a stream of full ones gathered into fewer, larger batches
+    uint32_t target;
+    if ((bytes > 25000) || (packets > 35)) {
+        target = ETH_ITR_BULK;
+    } else if ((bytes / packets > 1200) || (packets > 10)) {
+        target = ETH_ITR_LOW_LATENCY;
     } else {
-        memcpy(data, eth->rxb + ETH_RXBUF_SIZE * n, r);
+        target = ETH_ITR_LOWEST_LATENCY;
     }
+    // give up latency slowly, so one burst doesn't swing the rate
+    uint32_t itr = (target > eth->itr) ? target : (eth->itr * 3 + target) / 4;
+    if (itr != eth->itr) {
+        eth->itr = itr;
+        writel(IE_ITR_INTERVAL(itr), IE_ITR);
+    }
+}
 
-    // make buffer available to hw
-    eth->rxd[n].info = 0;
-    writel(n, IE_RDT);
-    n = (n + 1) & (ETH_RXBUF_COUNT - 1);
-    eth->rx_rd_ptr = n;
+// the next descriptor's status, errors and length, in the legacy layout
+// whichever kind the ring holds
+static uint64_t eth_rxd_info(ethdev_t* eth, ie_rxd_t* rxd) {
+    return (eth->rx_queues > 1) ? IE_RXDX_INFO(rxd->info) : rxd->info;
+}
+
+bool eth_rx_pending(ethdev_t* eth, uint32_t queue) {
+    ie_rxq_t* rxq = &eth->rxq[queue];
+    return eth_rxd_info(eth, &rxq->rxd[rxq->rd_ptr]) & IE_RXD_DONE;
+}
 
-    return r;
+status_t eth_rx(ethdev_t* eth, uint32_t queue, void* data, uint32_t* hash) {
+    ie_rxq_t* rxq = &eth->rxq[queue];
+    for (;;) {
+        uint32_t n = rxq->rd_ptr;
+        ie_rxd_t* rxd = &rxq->rxd[n];
+        uint64_t info = eth_rxd_info(eth, rxd);
+
+        if (!(info & IE_RXD_DONE)) {
+            return ERR_BAD_STATE;
+        }
+
+        // copy out packet, unless the hardware checked its checksums and
+        // one was wrong
+        mx_status_t r = IE_RXD_LEN(info);
+        bool bad_csum = !(info & IE_RXD_IXSM) && (info & (IE_RXD_IPE | IE_RXD_TCPE));
+        if (r > ETH_RXBUF_SIZE) {
+            // should not be possible, but...
+            r = ERR_BAD_STATE;
+        } else if (!bad_csum) {
+            memcpy(data, rxq->rxb + ETH_RXBUF_SIZE * n, r);
+            rxq->itr_packets++;
+            rxq->itr_bytes += r;
+            if (hash != NULL) {
+                *hash = (eth->rx_queues > 1) ? IE_RXDX_HASH(rxd->addr) : 0;
+            }
+        }
+
+        // make buffer available to hw; extended descriptors were written
+        // over, so they need their address again
+        if (eth->rx_queues > 1) {
+            rxd->addr = rxq->rxb_phys + ETH_RXBUF_SIZE * n;
+        }
+        rxd->info = 0;
+        writel(n, IE_RXQ(IE_RDT, queue));
+        n = (n + 1) & (eth->rx_count - 1);
+        rxq->rd_ptr = n;
+
+        if (!bad_csum) {
+            return r;
+        }
+        rxq->csum_errors++;
+    }
 }
 
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
@@ -89,7 +150,7 @@ status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
         // TODO: verify that this is the matching buffer to txd[n] addr?
         list_add_tail(&eth->free_frames, &frame->node);
         eth->txd[n].info = 0;
-        n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+        n = (n + 1) & (eth->tx_count - 1);
     }
     eth->tx_rd_ptr = n;
 
@@ -106,7 +167,7 @@ status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
     list_add_tail(&eth->busy_frames, &frame->node);
 
     // inform hw of buffer availability
-    n = (n + 1) & (ETH_TXBUF_COUNT - 1);
+    n = (n + 1) & (eth->tx_count - 1);
     eth->tx_wr_ptr = n;
     writel(n, IE_TDT);
 
@@ -137,19 +198,55 @@ status_t eth_reset_hw(ethdev_t* eth) {
     return NO_ERROR;
 }
 
+// Frames are spread over the queues by the hash of their addresses and,
+// for TCP, ports, which keeps each flow on one queue.  Anything else goes
+// to queue 0.
+static void eth_init_rss(ethdev_t* eth) {
+    // the key from Microsoft's RSS verification suite, which spreads well
+    static const uint32_t key[10] = {
+        0xda565a6d, 0xc20e5b25, 0x3d256741, 0xb08fa343, 0xcb2bcad0,
+        0xb4307bae, 0xa32dcb77, 0x0cf23080, 0x3bb7426a, 0xfa01acbe,
+    };
+    for (uint32_t i = 0; i < countof(key); i++) {
+        writel(key[i], IE_RSSRK(i));
+    }
+    // 128 one byte entries, indexed by the low bits of the hash
+    for (uint32_t i = 0; i < 32; i++) {
+        uint32_t reta = 0;
+        for (uint32_t j = 0; j < 4; j++) {
+            reta |= IE_RETA_QUEUE((i * 4 + j) % eth->rx_queues) << (j * 8);
+        }
+        writel(reta, IE_RETA(i));
+    }
+    writel(IE_MRQC_RSS | IE_MRQC_TCPIPV4 | IE_MRQC_IPV4 | IE_MRQC_TCPIPV6 | IE_MRQC_IPV6,
+           IE_MRQC);
+}
+
 void eth_init_hw(ethdev_t* eth) {
     //TODO: tune RXDCTL and TXDCTL settings
     //TODO: TCTL COLD should be based on link state
     //TODO: use address filtering for multicast
 
-    // setup rx ring
-    eth->rx_rd_ptr = 0;
-    writel(0, IE_RXCSUM);
-    writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXDCTL);
-    writel(eth->rxd_phys, IE_RDBAL);
-    writel(eth->rxd_phys >> 32, IE_RDBAH);
-    writel(ETH_RXBUF_COUNT * 16, IE_RDLEN);
-    writel(ETH_RXBUF_COUNT - 1, IE_RDT);
+    // setup rx rings
+    uint32_t rxcsum = IE_RXCSUM_IPOFL | IE_RXCSUM_TUOFL;
+    if (eth->rx_queues > 1) {
+        // the hash takes the place of the packet checksum, which isn't used
+        rxcsum |= IE_RXCSUM_PCSD;
+        writel(IE_RFCTL_EXSTEN, IE_RFCTL);
+    }
+    writel(rxcsum, IE_RXCSUM);
+    for (uint32_t q = 0; q < eth->rx_queues; q++) {
+        ie_rxq_t* rxq = &eth->rxq[q];
+        rxq->rd_ptr = 0;
+        writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXQ(IE_RXDCTL, q));
+        writel(rxq->rxd_phys, IE_RXQ(IE_RDBAL, q));
+        writel(rxq->rxd_phys >> 32, IE_RXQ(IE_RDBAH, q));
+        writel(eth->rx_count * sizeof(ie_rxd_t), IE_RXQ(IE_RDLEN, q));
+        writel(eth->rx_count - 1, IE_RXQ(IE_RDT, q));
+    }
+    if (eth->rx_queues > 1) {
+        eth_init_rss(eth);
+    }
     writel(IE_RCTL_BSIZE2048 | IE_RCTL_DPF | IE_RCTL_SECRC | IE_RCTL_BAM | IE_RCTL_MPE | IE_RCTL_EN, IE_RCTL);
 
     // setup tx ring
@@ -158,42 +255,65 @@ void eth_init_hw(ethdev_t* eth) {
     writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_TXDCTL);
     writel(eth->txd_phys, IE_TDBAL);
     writel(eth->txd_phys >> 32, IE_TDBAH);
-    writel(ETH_TXBUF_COUNT * 16, IE_TDLEN);
+    writel(eth->tx_count * sizeof(ie_txd_t), IE_TDLEN);
     writel(IE_TCTL_CT(15) | IE_TCTL_COLD_FD | IE_TCTL_EN, IE_TCTL);
 
+    // start adaptive moderation from the lowest latency
+    if (eth->itr_adaptive) {
+        eth->itr = ETH_ITR_LOWEST_LATENCY;
+    }
+    writel(eth->itr ? IE_ITR_INTERVAL(eth->itr) : 0, IE_ITR);
+
     // disable all irqs (write to "clear" mask)
     writel(0xFFFF, IE_IMC);
     // enable rx irq (write to "set" mask)
     writel(IE_INT_RXT0, IE_IMS);
 }
 
+size_t eth_alloc_size(const ethdev_t* eth) {
+    return (ETH_RXBUF_SIZE + sizeof(ie_rxd_t)) * eth->rx_count * eth->rx_queues +
+           (ETH_TXBUF_SIZE + sizeof(ie_txd_t)) * eth->tx_count;
+}
+
 void eth_setup_buffers(ethdev_t* eth, void* iomem, mx_paddr_t iophys) {
-    printf("eth: iomem @%p (phys %" PRIxPTR ")\n", iomem, iophys);
+    printf("eth: iomem @%p (phys %" PRIxPTR "), %u rx queue%s of %u and %u tx descriptors\n",
+           iomem, iophys, eth->rx_queues, (eth->rx_queues > 1) ? "s" : "", eth->rx_count,
+           eth->tx_count);
 
     list_initialize(&eth->free_frames);
     list_initialize(&eth->busy_frames);
 
-    eth->rxd = iomem;
-    eth->rxd_phys = iophys;
-    iomem += ETH_DRING_SIZE;
-    iophys += ETH_DRING_SIZE;
-    memset(eth->rxd, 0, ETH_DRING_SIZE);
+    // the rings come first, so they stay aligned for the hardware
+    size_t rxd_size = sizeof(ie_rxd_t) * eth->rx_count;
+    size_t txd_size = sizeof(ie_txd_t) * eth->tx_count;
+
+    for (uint32_t q = 0; q < eth->rx_queues; q++) {
+        ie_rxq_t* rxq = &eth->rxq[q];
+        rxq->rxd = iomem;
+        rxq->rxd_phys = iophys;
+        iomem += rxd_size;
+        iophys += rxd_size;
+        memset(rxq->rxd, 0, rxd_size);
+    }
 
     eth->txd = iomem;
     eth->txd_phys = iophys;
-    iomem += ETH_DRING_SIZE;
-    iophys += ETH_DRING_SIZE;
-    memset(eth->txd, 0, ETH_DRING_SIZE);
-
-    eth->rxb = iomem;
-    eth->rxb_phys = iophys;
-    iomem += ETH_RXBUF_SIZE * ETH_RXBUF_COUNT;
-    iophys += ETH_RXBUF_SIZE * ETH_RXBUF_COUNT;
-
-    for (int n = 0; n < ETH_RXBUF_COUNT; n++) {
-        eth->rxd[n].addr = eth->rxb_phys + ETH_RXBUF_SIZE * n;
+    iomem += txd_size;
+    iophys += txd_size;
+    memset(eth->txd, 0, txd_size);
+
+    for (uint32_t q = 0; q < eth->rx_queues; q++) {
+        ie_rxq_t* rxq = &eth->rxq[q];
+        rxq->rxb = iomem;
+        rxq->rxb_phys = iophys;
+        iomem += ETH_RXBUF_SIZE * eth->rx_count;
+        iophys += ETH_RXBUF_SIZE * eth->rx_count;
+
+        for (uint32_t n = 0; n < eth->rx_count; n++) {
+            rxq->rxd[n].addr = rxq->rxb_phys + ETH_RXBUF_SIZE * n;
+        }
     }
-    for (int n = 0; n < ETH_TXBUF_COUNT - 1; n++) {
+    for (uint32_t n = 0; n < eth->tx_count - 1; n++) {
         framebuf_t *txb = iomem;
         txb->phys = iophys + ETH_TXBUF_HSIZE;
         txb->size = ETH_TXBUF_SIZE - ETH_TXBUF_HSIZE;
@@ -16,53 +16,95 @@ struct framebuf {
     size_t size;
 };
 
+// the most receive queues any of the parts has
+#define ETH_RXQ_MAX 2
+
+// One receive ring and its buffers.  Each queue may be worked on at the
+// same time as the others, and as transmit.
+typedef struct ie_rxq {
+    ie_rxd_t* rxd;
+    void* rxb;
+    // store as 64bit integer to match hw register size
+    uint64_t rxd_phys;
+    uint64_t rxb_phys;
+    uint32_t rd_ptr;
+
+    // what's arrived since the last irq, for interrupt moderation
+    uint32_t itr_packets;
+    uint32_t itr_bytes;
+
+    // frames the hardware found to have bad IP, TCP or UDP checksums
+    uint64_t csum_errors;
+} ie_rxq_t;
+
 struct ethdev {
     uintptr_t iobase;
 
-    // tx/rx descriptor rings
+    // tx descriptor ring
     ie_txd_t* txd;
-    ie_rxd_t* rxd;
+
+    // descriptors in each ring, powers of two
+    uint32_t rx_count;
+    uint32_t tx_count;
 
     uint32_t tx_wr_ptr;
     uint32_t tx_rd_ptr;
-    uint32_t rx_rd_ptr;
+
+    // With more than one queue, received frames are steered by a hash of
+    // their flow, and the rings hold extended descriptors, which carry it.
+    uint32_t rx_queues;
+    ie_rxq_t rxq[ETH_RXQ_MAX];
+
+    // interrupt moderation: the most irqs/s allowed (0 for no limit), and
+    // whether it follows the traffic
+    uint32_t itr;
+    bool itr_adaptive;
 
     list_node_t free_frames;
     list_node_t busy_frames;
 
-    // base physical addresses for
-    // tx/rx rings and rx buffers
-    // store as 64bit integer to match hw register size
     uint64_t txd_phys;
-    uint64_t rxd_phys;
-    uint64_t rxb_phys;
-    void* rxb;
 
     uint8_t mac[6];
 };
 
 #define ETH_RXBUF_SIZE  2048
-#define ETH_RXBUF_COUNT 32
+#define ETH_RXBUF_COUNT 256     // default ring depths
 
 #define ETH_TXBUF_SIZE  2048
-#define ETH_TXBUF_COUNT 8
+#define ETH_TXBUF_COUNT 256
 #define ETH_TXBUF_HSIZE 128
 #define ETH_TXBUF_DSIZE (ETH_TXBUF_SIZE - ETH_TXBUF_HSIZE)
 
-#define ETH_DRING_SIZE 2048
+// The rings' lengths must be multiples of 128 bytes.  The hardware takes
+// far longer rings than the most here, but each descriptor has its own
+// buffer in the one physically contiguous allocation.
+#define ETH_RING_MIN 8
+#define ETH_RING_MAX 4096
+
+// interrupt rates, in irqs/s, adaptive moderation moves between
+#define ETH_ITR_LOWEST_LATENCY 70000
+#define ETH_ITR_LOW_LATENCY    20000
+#define ETH_ITR_BULK           4000
 
-#define ETH_ALLOC ((ETH_RXBUF_SIZE * ETH_RXBUF_COUNT) + \
-                   (ETH_TXBUF_SIZE * ETH_TXBUF_COUNT) + \
-                   (ETH_DRING_SIZE * 2))
+// bytes of iomem needed for the rings, of the queues and depths in eth
+size_t eth_alloc_size(const ethdev_t* eth);
 
 status_t eth_reset_hw(ethdev_t* eth);
+// uses the queues and ring depths in eth, which must already be set
 void eth_setup_buffers(ethdev_t* eth, void* iomem, uintptr_t iophys);
 void eth_init_hw(ethdev_t* eth);
 
 void eth_dump_regs(ethdev_t* eth);
 
-status_t eth_rx(ethdev_t* eth, void* data);
+// takes a frame from the queue, and its flow hash if hash isn't NULL
+status_t eth_rx(ethdev_t* eth, uint32_t queue, void* data, uint32_t* hash);
+// whether the queue has a frame waiting
+bool eth_rx_pending(ethdev_t* eth, uint32_t queue);
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
 
 #define ETH_IRQ_RX IE_INT_RXT0
 unsigned eth_handle_irq(ethdev_t* eth);
+// picks the next interrupt rate, if it's adaptive, from what all the
+// queues received since the last irq, which it resets; call once per irq
+void eth_update_itr(ethdev_t* eth);
@@ -0,0 +1,197 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+// Intel High Definition Audio 1.0a controller registers, and the codec verbs
+// we use.  Section and table numbers are from the specification.
+
+#define HDA_REG_GCAP     0x00   // 16 bits
+#define HDA_REG_GCTL     0x08
+#define HDA_REG_WAKEEN   0x0c   // 16 bits
+#define HDA_REG_STATESTS 0x0e   // 16 bits
+#define HDA_REG_INTCTL   0x20
+#define HDA_REG_INTSTS   0x24
+#define HDA_REG_CORBLBASE 0x40
+#define HDA_REG_CORBUBASE 0x44
+#define HDA_REG_CORBWP   0x48   // 16 bits
+#define HDA_REG_CORBRP   0x4a   // 16 bits
+#define HDA_REG_CORBCTL  0x4c   // 8 bits
+#define HDA_REG_CORBSIZE 0x4e   // 8 bits
+#define HDA_REG_RIRBLBASE 0x50
+#define HDA_REG_RIRBUBASE 0x54
+#define HDA_REG_RIRBWP   0x58   // 16 bits
+#define HDA_REG_RINTCNT  0x5a   // 16 bits
+#define HDA_REG_RIRBCTL  0x5c   // 8 bits
+#define HDA_REG_RIRBSTS  0x5d   // 8 bits
+#define HDA_REG_RIRBSIZE 0x5e   // 8 bits
+#define HDA_REG_DPLBASE  0x70
+#define HDA_REG_DPUBASE  0x74
+
+#define HDA_GCAP_64OK        (1 << 0)
+#define HDA_GCAP_ISS(gcap)   (((gcap) >> 8) & 0xf)
+#define HDA_GCAP_OSS(gcap)   (((gcap) >> 12) & 0xf)
+
+#define HDA_GCTL_CRST        (1 << 0)
+
+#define HDA_INTCTL_GIE       (1u << 31)
+#define HDA_INTCTL_SIE(n)    (1u << (n))
+#define HDA_INTSTS_SIS_MASK  0x3fffffff
+
+#define HDA_CORBRP_RST       (1 << 15)
+#define HDA_CORBCTL_RUN      (1 << 1)
+#define HDA_RIRBWP_RST       (1 << 15)
+#define HDA_RIRBCTL_DMAEN    (1 << 1)
+#define HDA_RIRBSTS_MASK     0x05
+
+// CORBSIZE and RIRBSIZE
+#define HDA_RING_SIZE_CAP_256 (1 << 6)
+#define HDA_RING_SIZE_CAP_16  (1 << 5)
+#define HDA_RING_SIZE_256     0x2
+#define HDA_RING_SIZE_16      0x1
+#define HDA_RING_SIZE_2       0x0
+
+#define HDA_DPLBASE_ENABLE   (1 << 0)
+
+// stream descriptors start at 0x80, inputs first and then outputs
+#define HDA_MAX_STREAMS      30
+#define HDA_REG_SD(n)        (0x80 + 0x20 * (n))
+#define HDA_SD_CTL           0x00   // 24 bits, and STS in the top byte
+#define HDA_SD_STS           0x03   // 8 bits
+#define HDA_SD_LPIB          0x04
+#define HDA_SD_CBL           0x08
+#define HDA_SD_LVI           0x0c   // 16 bits
+#define HDA_SD_FMT           0x12   // 16 bits
+#define HDA_SD_BDPL          0x18
+#define HDA_SD_BDPU          0x1c
+
+#define HDA_SD_CTL_SRST      (1 << 0)
+#define HDA_SD_CTL_RUN       (1 << 1)
+#define HDA_SD_CTL_IOCE      (1 << 2)
+#define HDA_SD_CTL_FEIE      (1 << 3)
+#define HDA_SD_CTL_DEIE      (1 << 4)
+#define HDA_SD_CTL_STRM(tag) ((uint32_t)(tag) << 20)
+
+#define HDA_SD_STS_BCIS      (1 << 2)
+#define HDA_SD_STS_FIFOE     (1 << 3)
+#define HDA_SD_STS_DESE      (1 << 4)
+#define HDA_SD_STS_MASK      (HDA_SD_STS_BCIS | HDA_SD_STS_FIFOE | HDA_SD_STS_DESE)
+
+// stream format, for SDnFMT and the converters on the codec (section 3.7.1)
+#define HDA_FMT_BASE_44K1    (1 << 14)
+#define HDA_FMT_MULT(n)      (((n) - 1) << 11)
+#define HDA_FMT_DIV(n)       (((n) - 1) << 8)
+#define HDA_FMT_BITS_16      (1 << 4)
+#define HDA_FMT_CHAN(n)      ((n) - 1)
+
+// a buffer descriptor list holds 2 to 256 entries, 128 byte aligned (section 3.6.2)
+#define HDA_BDL_MAX_ENTRIES  256
+#define HDA_BDL_ALIGN        128
+#define HDA_BDL_IOC          (1 << 0)
+
+typedef struct {
+    uint64_t address;
+    uint32_t length;
+    uint32_t flags;
+} __PACKED hda_bdl_entry_t;
+
+// the controller writes each stream's LPIB here, by descriptor number (section 3.6.1)
+typedef struct {
+    uint32_t position;
+    uint32_t reserved;
+} __PACKED hda_dma_position_t;
+
+typedef struct {
+    uint32_t response;
+    uint32_t response_ex;
+} __PACKED hda_rirb_entry_t;
+
+#define HDA_RIRB_EX_CODEC(ex)  ((ex) & 0xf)
+#define HDA_RIRB_EX_UNSOL      (1 << 4)
+
+#define HDA_MAX_CODECS       15
+
+// codec verbs: a 12 bit verb with an 8 bit payload, or a 4 bit one with 16 (section 7.3)
+#define HDA_VERB(codec, nid, verb) \
+    (((uint32_t)(codec) << 28) | ((uint32_t)(nid) << 20) | (verb))
+#define HDA_SP_VERB(id, payload) (((uint32_t)(id) << 8) | (uint8_t)(payload))
+#define HDA_LP_VERB(id, payload) (((uint32_t)(id) << 16) | (uint16_t)(payload))
+
+#define HDA_GET_PARAM(param)             HDA_SP_VERB(0xf00, param)
+#define HDA_GET_CONN_LIST(offset)        HDA_SP_VERB(0xf02, offset)
+#define HDA_SET_CONN_SELECT(index)       HDA_SP_VERB(0x701, index)
+#define HDA_SET_POWER_STATE(state)       HDA_SP_VERB(0x705, state)
+#define HDA_SET_STREAM_CHAN(tag, chan)   HDA_SP_VERB(0x706, ((tag) << 4) | (chan))
+#define HDA_SET_PIN_CTRL(val)            HDA_SP_VERB(0x707, val)
+#define HDA_SET_EAPD(val)                HDA_SP_VERB(0x70c, val)
+#define HDA_GET_CONFIG_DEFAULT           HDA_SP_VERB(0xf1c, 0)
+#define HDA_SET_FORMAT(fmt)              HDA_LP_VERB(0x2, fmt)
+#define HDA_SET_AMP(val)                 HDA_LP_VERB(0x3, val)
+
+// parameters (section 7.3.4)
+#define HDA_PARAM_NODE_COUNT     0x04
+#define HDA_PARAM_FN_GROUP_TYPE  0x05
+#define HDA_PARAM_AW_CAPS        0x09
+#define HDA_PARAM_PCM            0x0a
+#define HDA_PARAM_PIN_CAPS       0x0c
+#define HDA_PARAM_IN_AMP_CAPS    0x0d
+#define HDA_PARAM_CONN_LIST_LEN  0x0e
+#define HDA_PARAM_OUT_AMP_CAPS   0x12
+
+#define HDA_NODE_START(val)      (((val) >> 16) & 0xff)
+#define HDA_NODE_COUNT(val)      ((val) & 0xff)
+#define HDA_FN_GROUP_AUDIO       0x01
+
+#define HDA_AW_TYPE(caps)        (((caps) >> 20) & 0xf)
+#define HDA_AW_TYPE_OUTPUT       0x0
+#define HDA_AW_TYPE_INPUT        0x1
+#define HDA_AW_TYPE_MIXER        0x2
+#define HDA_AW_TYPE_SELECTOR     0x3
+#define HDA_AW_TYPE_PIN          0x4
+#define HDA_AW_STEREO            (1 << 0)
+#define HDA_AW_IN_AMP            (1 << 1)
+#define HDA_AW_OUT_AMP           (1 << 2)
+#define HDA_AW_FORMAT_OVERRIDE   (1 << 4)
+#define HDA_AW_CONN_LIST         (1 << 8)
+#define HDA_AW_DIGITAL           (1 << 9)
+#define HDA_AW_POWER_CTL         (1 << 10)
+
+#define HDA_PCM_16BITS           (1 << 17)
+#define HDA_PCM_RATE_MASK        0x7ff
+
+#define HDA_PIN_CAPS_HP          (1 << 3)
+#define HDA_PIN_CAPS_OUTPUT      (1 << 4)
+#define HDA_PIN_CAPS_INPUT       (1 << 5)
+#define HDA_PIN_CAPS_EAPD        (1 << 16)
+
+#define HDA_AMP_CAPS_OFFSET(caps) ((caps) & 0x7f)
+
+#define HDA_CONN_LIST_LONG       (1 << 7)
+#define HDA_CONN_LIST_LEN(val)   ((val) & 0x7f)
+
+// configuration default (section 7.3.3.31)
+#define HDA_CONFIG_PORT(cfg)     (((cfg) >> 30) & 0x3)
+#define HDA_CONFIG_PORT_NONE     1
+#define HDA_CONFIG_DEVICE(cfg)   (((cfg) >> 20) & 0xf)
+#define HDA_CONFIG_LINE_OUT      0x0
+#define HDA_CONFIG_SPEAKER       0x1
+#define HDA_CONFIG_HP_OUT        0x2
+#define HDA_CONFIG_LINE_IN       0x8
+#define HDA_CONFIG_MIC_IN        0xa
+
+#define HDA_PIN_CTRL_IN          (1 << 5)
+#define HDA_PIN_CTRL_OUT         (1 << 6)
+#define HDA_PIN_CTRL_HP          (1 << 7)
+#define HDA_EAPD_ENABLE          (1 << 1)
+
+#define HDA_AMP_OUTPUT           (1 << 15)
+#define HDA_AMP_INPUT            (1 << 14)
+#define HDA_AMP_LEFT             (1 << 13)
+#define HDA_AMP_RIGHT            (1 << 12)
+#define HDA_AMP_INDEX(n)         ((n) << 8)
+
+#define HDA_POWER_D0             0x0
@@ -0,0 +1,515 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/device.h>
+#include <ddk/io-buffer.h>
+#include <magenta/device/audio.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include "intel-hda.h"
+
+// A stream's buffer descriptor list points the DMA at the ring buffer the
+// client maps, a period to each entry, so samples go between the client
+// and the codec with no copying on our side.  The client follows the DMA
+// by the position the controller writes to memory it can map, or polls
+// IOCTL_AUDIO_GET_RING_POSITION, and can wait on an event we signal as
+// each period completes rather than poll at all.
+//
+// Without a period from the client, the ring is split in two, and only
+// the end of the ring interrupts us, which is enough to count the times
+// the DMA has been round it.
+
+#define HDA_RING_MAX (1024 * 1024)
+#define HDA_STREAM_TIMEOUT MX_MSEC(10)
+
+// the rates we can set, all as 16 bit stereo for now
+static const struct {
+    uint32_t rate;
+    uint32_t pcm;       // its bit in HDA_PARAM_PCM
+    uint16_t fmt;
+} hda_rates[] = {
+    { 8000,   1 << 0,  HDA_FMT_DIV(6) },
+    { 11025,  1 << 1,  HDA_FMT_BASE_44K1 | HDA_FMT_DIV(4) },
+    { 16000,  1 << 2,  HDA_FMT_DIV(3) },
+    { 22050,  1 << 3,  HDA_FMT_BASE_44K1 | HDA_FMT_DIV(2) },
+    { 32000,  1 << 4,  HDA_FMT_MULT(2) | HDA_FMT_DIV(3) },
+    { 44100,  1 << 5,  HDA_FMT_BASE_44K1 },
+    { 48000,  1 << 6,  0 },
+    { 88200,  1 << 7,  HDA_FMT_BASE_44K1 | HDA_FMT_MULT(2) },
+    { 96000,  1 << 8,  HDA_FMT_MULT(2) },
+    { 176400, 1 << 9,  HDA_FMT_BASE_44K1 | HDA_FMT_MULT(4) },
+    { 192000, 1 << 10, HDA_FMT_MULT(4) },
+};
+#define HDA_RATE_COUNT (sizeof(hda_rates) / sizeof(hda_rates[0]))
+
+struct intel_hda_stream {
+    mx_device_t device;
+    intel_hda_t* hda;
+    int type;
+    uint32_t sd;
+    uint32_t reg;
+    uint8_t tag;
+    intel_hda_converter_t conv;
+
+    uint32_t sample_rates[HDA_RATE_COUNT];
+    uint16_t formats[HDA_RATE_COUNT];
+    int sample_rate_count;
+    // current sample rate, and its stream format
+    uint32_t sample_rate;
+    uint16_t format;
+
+    // guards everything below, against the ioctls and the irq thread
+    mtx_t lock;
+    bool open;
+    bool started;
+
+    io_buffer_t bdl;
+    // ring buffer shared with the client, and the bytes between interrupts
+    io_buffer_t ring;
+    uint32_t ring_size;
+    uint32_t period;
+    // signaled each period, once the client has asked for it
+    mx_handle_t period_event;
+
+    // times the DMA has been round the ring, and the offset we last saw it at
+    uint64_t laps;
+    uint32_t last_offset;
+};
+#define get_intel_hda_stream(dev) containerof(dev, intel_hda_stream_t, device)
+
+static uint32_t stream_read32(intel_hda_stream_t* stream, uint32_t reg) {
+    return hda_read32(stream->hda, stream->reg + reg);
+}
+
+static void stream_write32(intel_hda_stream_t* stream, uint32_t reg, uint32_t val) {
+    hda_write32(stream->hda, stream->reg + reg, val);
+}
+
+// the control register shares its dword with the status one, whose bits
+// are write one to clear, so leave those alone
+static void stream_set_ctl(intel_hda_stream_t* stream, uint32_t ctl) {
+    stream_write32(stream, HDA_SD_CTL, ctl & 0xffffff);
+}
+
+static mx_status_t stream_wait_ctl(intel_hda_stream_t* stream, uint32_t mask, uint32_t val) {
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + HDA_STREAM_TIMEOUT;
+    while ((stream_read32(stream, HDA_SD_CTL) & mask) != val) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            return ERR_TIMED_OUT;
+        }
+        mx_nanosleep(MX_USEC(10));
+    }
+    return NO_ERROR;
+}
+
+static mx_status_t stream_reset(intel_hda_stream_t* stream) {
+    stream_set_ctl(stream, HDA_SD_CTL_SRST);
+    mx_status_t status = stream_wait_ctl(stream, HDA_SD_CTL_SRST, HDA_SD_CTL_SRST);
+    if (status == NO_ERROR) {
+        stream_set_ctl(stream, 0);
+        status = stream_wait_ctl(stream, HDA_SD_CTL_SRST, 0);
+    }
+    hda_write8(stream->hda, stream->reg + HDA_SD_STS, HDA_SD_STS_MASK);
+    return status;
+}
+
+// Returns the bytes the DMA has been through since we started it.  This
+// has to be called at least once a lap to see each wrap, which the
+// interrupt at the end of the ring does.  Call with stream->lock held.
+static uint64_t stream_position(intel_hda_stream_t* stream) {
+    uint32_t offset = stream_read32(stream, HDA_SD_LPIB) % stream->ring_size;
+    if (offset < stream->last_offset) {
+        stream->laps++;
+    }
+    stream->last_offset = offset;
+    return stream->laps * stream->ring_size + offset;
+}
+
+void intel_hda_stream_irq(intel_hda_stream_t* stream) {
+    uint8_t sts = hda_read8(stream->hda, stream->reg + HDA_SD_STS);
+    hda_write8(stream->hda, stream->reg + HDA_SD_STS, sts & HDA_SD_STS_MASK);
+    if (sts & (HDA_SD_STS_FIFOE | HDA_SD_STS_DESE)) {
+        xprintf("intel-hda: stream %u error, status 0x%02x\n", stream->sd, sts);
+    }
+    if (!(sts & HDA_SD_STS_BCIS)) {
+        return;
+    }
+    mtx_lock(&stream->lock);
+    if (stream->started) {
+        stream_position(stream);
+        if (stream->period_event != MX_HANDLE_INVALID) {
+            mx_object_signal(stream->period_event, 0, MX_EVENT_SIGNALED);
+        }
+    }
+    mtx_unlock(&stream->lock);
+}
+
+// points a descriptor at each period of the ring.  Call with stream->lock held
+static void stream_fill_bdl(intel_hda_stream_t* stream) {
+    hda_bdl_entry_t* bdl = io_buffer_virt(&stream->bdl);
+    uint32_t count = stream->ring_size / stream->period;
+    for (uint32_t i = 0; i < count; i++) {
+        bdl[i].address = io_buffer_phys(&stream->ring) + i * stream->period;
+        bdl[i].length = stream->period;
+        bool ioc = (stream->period_event != MX_HANDLE_INVALID) || (i + 1 == count);
+        bdl[i].flags = ioc ? HDA_BDL_IOC : 0;
+    }
+}
+
+static mx_status_t intel_hda_stream_start(intel_hda_stream_t* stream) {
+    intel_hda_t* hda = stream->hda;
+    mx_status_t status = NO_ERROR;
+
+    mtx_lock(&stream->lock);
+    if (stream->started) {
+        goto out;
+    }
+    // there's no read() or write(); everything goes through the ring
+    if (!io_buffer_is_valid(&stream->ring)) {
+        status = ERR_BAD_STATE;
+        goto out;
+    }
+
+    intel_hda_converter_t* conv = &stream->conv;
+    if ((status = hda_codec_cmd(hda, conv->codec, conv->nid, HDA_SET_FORMAT(stream->format),
+                                NULL)) != NO_ERROR ||
+        (status = hda_codec_cmd(hda, conv->codec, conv->nid,
+                                HDA_SET_STREAM_CHAN(stream->tag, 0), NULL)) != NO_ERROR) {
+        goto out;
+    }
+    if ((status = stream_reset(stream)) != NO_ERROR) {
+        goto out;
+    }
+
+    stream_fill_bdl(stream);
+    mx_paddr_t bdl = io_buffer_phys(&stream->bdl);
+    stream_write32(stream, HDA_SD_BDPL, (uint32_t)bdl);
+    stream_write32(stream, HDA_SD_BDPU, (uint32_t)(bdl >> 32));
+    stream_write32(stream, HDA_SD_CBL, stream->ring_size);
+    hda_write16(hda, stream->reg + HDA_SD_LVI, stream->ring_size / stream->period - 1);
+    hda_write16(hda, stream->reg + HDA_SD_FMT, stream->format);
+
+    stream->laps = 0;
+    stream->last_offset = 0;
+    uint32_t ctl = HDA_SD_CTL_STRM(stream->tag) | HDA_SD_CTL_IOCE | HDA_SD_CTL_FEIE |
+                   HDA_SD_CTL_DEIE;
+    stream_set_ctl(stream, ctl);
+    stream_set_ctl(stream, ctl | HDA_SD_CTL_RUN);
+    stream->started = true;
+
+out:
+    mtx_unlock(&stream->lock);
+    return status;
+}
+
+// call with stream->lock held
+static mx_status_t intel_hda_stream_stop_locked(intel_hda_stream_t* stream) {
+    if (!stream->started) {
+        return NO_ERROR;
+    }
+    stream->started = false;
+    stream_set_ctl(stream, stream_read32(stream, HDA_SD_CTL) & ~HDA_SD_CTL_RUN);
+    mx_status_t status = stream_wait_ctl(stream, HDA_SD_CTL_RUN, 0);
+    hda_write8(stream->hda, stream->reg + HDA_SD_STS, HDA_SD_STS_MASK);
+
+    // stream 0 is reserved, and tells the converter to stop
+    intel_hda_converter_t* conv = &stream->conv;
+    hda_codec_cmd(stream->hda, conv->codec, conv->nid, HDA_SET_STREAM_CHAN(0, 0), NULL);
+    return status;
+}
+
+static mx_status_t intel_hda_stream_stop(intel_hda_stream_t* stream) {
+    mtx_lock(&stream->lock);
+    mx_status_t status = intel_hda_stream_stop_locked(stream);
+    mtx_unlock(&stream->lock);
+    return status;
+}
+
+// call with stream->lock held, and the stream stopped
+static void intel_hda_stream_free_ring(intel_hda_stream_t* stream) {
+    if (io_buffer_is_valid(&stream->ring)) {
+        mx_process_unmap_vm(mx_process_self(), (uintptr_t)stream->ring.virt, 0);
+        io_buffer_release(&stream->ring);
+    }
+    if (stream->period_event != MX_HANDLE_INVALID) {
+        mx_handle_close(stream->period_event);
+        stream->period_event = MX_HANDLE_INVALID;
+    }
+    stream->ring_size = 0;
+    stream->period = 0;
+}
+
+static ssize_t intel_hda_stream_set_ring_buffer(intel_hda_stream_t* stream,
+                                                const audio_ring_config_t* config,
+                                                mx_handle_t* out_vmo) {
+    // two halves, each where a descriptor may start
+    if (config->size == 0 || config->size > HDA_RING_MAX ||
+        (config->size % (2 * HDA_BDL_ALIGN)) != 0) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status;
+    mtx_lock(&stream->lock);
+    if (stream->started) {
+        status = ERR_BAD_STATE;
+        goto out;
+    }
+    intel_hda_stream_free_ring(stream);
+    if ((status = io_buffer_init(&stream->ring, config->size, IO_BUFFER_RW)) != NO_ERROR) {
+        goto out;
+    }
+    // what a source hasn't recorded yet reads as silence
+    memset(io_buffer_virt(&stream->ring), 0, config->size);
+    if ((status = mx_handle_duplicate(stream->ring.vmo_handle, MX_RIGHT_SAME_RIGHTS,
+                                      out_vmo)) != NO_ERROR) {
+        intel_hda_stream_free_ring(stream);
+        goto out;
+    }
+    stream->ring_size = config->size;
+    stream->period = config->size / 2;
+
+out:
+    mtx_unlock(&stream->lock);
+    return (status == NO_ERROR) ? (ssize_t)sizeof(*out_vmo) : status;
+}
+
+static ssize_t intel_hda_stream_get_ring_event(intel_hda_stream_t* stream, uint32_t period,
+                                               mx_handle_t* out_event) {
+    mx_status_t status;
+    mtx_lock(&stream->lock);
+    if (stream->started || !io_buffer_is_valid(&stream->ring)) {
+        status = ERR_BAD_STATE;
+        goto out;
+    }
+    if (period == 0 || (period % HDA_BDL_ALIGN) != 0 || (stream->ring_size % period) != 0 ||
+        stream->ring_size / period < 2 || stream->ring_size / period > HDA_BDL_MAX_ENTRIES) {
+        status = ERR_INVALID_ARGS;
+        goto out;
+    }
+    if (stream->period_event == MX_HANDLE_INVALID &&
+        (status = mx_event_create(0, &stream->period_event)) != NO_ERROR) {
+        goto out;
+    }
+    if ((status = mx_handle_duplicate(stream->period_event, MX_RIGHT_SAME_RIGHTS,
+                                      out_event)) != NO_ERROR) {
+        goto out;
+    }
+    stream->period = period;
+
+out:
+    mtx_unlock(&stream->lock);
+    return (status == NO_ERROR) ? (ssize_t)sizeof(*out_event) : status;
+}
+
+static ssize_t intel_hda_stream_get_position_vmo(intel_hda_stream_t* stream,
+                                                 audio_ring_position_vmo_t* reply) {
+    mx_status_t status = mx_handle_duplicate(stream->hda->positions.vmo_handle,
+                                             MX_RIGHT_READ | MX_RIGHT_MAP | MX_RIGHT_TRANSFER |
+                                             MX_RIGHT_DUPLICATE, &reply->vmo);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    reply->offset = stream->sd * sizeof(hda_dma_position_t);
+    return sizeof(*reply);
+}
+
+static mx_status_t intel_hda_stream_open(mx_device_t* dev, mx_device_t** dev_out,
+                                         uint32_t flags) {
+    intel_hda_stream_t* stream = get_intel_hda_stream(dev);
+    mx_status_t result;
+
+    mtx_lock(&stream->lock);
+    if (stream->open) {
+        result = ERR_ALREADY_BOUND;
+    } else {
+        stream->open = true;
+        result = NO_ERROR;
+    }
+    mtx_unlock(&stream->lock);
+
+    return result;
+}
+
+static mx_status_t intel_hda_stream_close(mx_device_t* dev, uint32_t flags) {
+    intel_hda_stream_t* stream = get_intel_hda_stream(dev);
+
+    mtx_lock(&stream->lock);
+    intel_hda_stream_stop_locked(stream);
+    intel_hda_stream_free_ring(stream);
+    stream->open = false;
+    mtx_unlock(&stream->lock);
+
+    return NO_ERROR;
+}
+
+static ssize_t intel_hda_stream_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf,
+                                      size_t in_len, void* out_buf, size_t out_len) {
+    intel_hda_stream_t* stream = get_intel_hda_stream(dev);
+
+    switch (op) {
+    case IOCTL_AUDIO_GET_DEVICE_TYPE: {
+        int* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        *reply = stream->type;
+        return sizeof(*reply);
+    }
+    case IOCTL_AUDIO_GET_SAMPLE_RATE_COUNT: {
+        int* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        *reply = stream->sample_rate_count;
+        return sizeof(*reply);
+    }
+    case IOCTL_AUDIO_GET_SAMPLE_RATES: {
+        size_t reply_size = stream->sample_rate_count * sizeof(uint32_t);
+        if (out_len < reply_size) return ERR_BUFFER_TOO_SMALL;
+        memcpy(out_buf, stream->sample_rates, reply_size);
+        return reply_size;
+    }
+    case IOCTL_AUDIO_GET_SAMPLE_RATE: {
+        uint32_t* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        *reply = stream->sample_rate;
+        return sizeof(*reply);
+    }
+    case IOCTL_AUDIO_SET_SAMPLE_RATE: {
+        if (in_len < sizeof(uint32_t)) return ERR_BUFFER_TOO_SMALL;
+        uint32_t sample_rate = *((uint32_t *)in_buf);
+        int i;
+        for (i = 0; i < stream->sample_rate_count; i++) {
+            if (sample_rate == stream->sample_rates[i]) {
+                break;
+            }
+        }
+        if (i == stream->sample_rate_count) {
+            return ERR_INVALID_ARGS;
+        }
+        mx_status_t status = NO_ERROR;
+        mtx_lock(&stream->lock);
+        if (sample_rate == stream->sample_rate) {
+            // nothing to do
+        } else if (stream->started) {
+            status = ERR_BAD_STATE;
+        } else {
+            stream->sample_rate = sample_rate;
+            stream->format = stream->formats[i];
+        }
+        mtx_unlock(&stream->lock);
+        return status;
+    }
+    case IOCTL_AUDIO_START:
+        return intel_hda_stream_start(stream);
+    case IOCTL_AUDIO_STOP:
+        return intel_hda_stream_stop(stream);
+    case IOCTL_AUDIO_SET_RING_BUFFER: {
+        if (in_len < sizeof(audio_ring_config_t)) return ERR_INVALID_ARGS;
+        if (out_len < sizeof(mx_handle_t)) return ERR_BUFFER_TOO_SMALL;
+        return intel_hda_stream_set_ring_buffer(stream, in_buf, out_buf);
+    }
+    case IOCTL_AUDIO_GET_RING_POSITION: {
+        audio_ring_position_t* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        mx_status_t status = sizeof(*reply);
+        mtx_lock(&stream->lock);
+        if (!io_buffer_is_valid(&stream->ring)) {
+            status = ERR_BAD_STATE;
+        } else {
+            reply->position = stream->started ? stream_position(stream)
+                                              : stream->laps * stream->ring_size +
+                                                stream->last_offset;
+            reply->usb_frame = 0;
+        }
+        mtx_unlock(&stream->lock);
+        return status;
+    }
+    case IOCTL_AUDIO_GET_RING_EVENT: {
+        if (in_len < sizeof(uint32_t)) return ERR_INVALID_ARGS;
+        if (out_len < sizeof(mx_handle_t)) return ERR_BUFFER_TOO_SMALL;
+        return intel_hda_stream_get_ring_event(stream, *((uint32_t *)in_buf), out_buf);
+    }
+    case IOCTL_AUDIO_GET_RING_POSITION_VMO: {
+        if (out_len < sizeof(audio_ring_position_vmo_t)) return ERR_BUFFER_TOO_SMALL;
+        return intel_hda_stream_get_position_vmo(stream, out_buf);
+    }
+    }
+
+    return ERR_NOT_SUPPORTED;
+}
+
+static mx_protocol_device_t intel_hda_stream_device_proto = {
+    .open = intel_hda_stream_open,
+    .close = intel_hda_stream_close,
+    .ioctl = intel_hda_stream_ioctl,
+};
+
+mx_status_t intel_hda_stream_create(intel_hda_t* hda, int type, uint32_t sd,
+                                    const intel_hda_converter_t* conv) {
+    intel_hda_stream_t* stream = calloc(1, sizeof(intel_hda_stream_t));
+    if (!stream) {
+        xprintf("intel-hda: out of memory\n");
+        return ERR_NO_MEMORY;
+    }
+    stream->hda = hda;
+    stream->type = type;
+    stream->sd = sd;
+    stream->reg = HDA_REG_SD(sd);
+    stream->conv = *conv;
+    mtx_init(&stream->lock, mtx_plain);
+
+    // inputs and outputs number their streams apart, from 1
+    uint32_t index = (type == AUDIO_TYPE_SINK) ? sd - hda->input_streams : sd;
+    stream->tag = index + 1;
+
+    for (uint32_t i = 0; i < HDA_RATE_COUNT; i++) {
+        if (conv->pcm & hda_rates[i].pcm) {
+            stream->sample_rates[stream->sample_rate_count] = hda_rates[i].rate;
+            stream->formats[stream->sample_rate_count] = hda_rates[i].fmt | HDA_FMT_BITS_16 |
+                                                         HDA_FMT_CHAN(2);
+            stream->sample_rate_count++;
+            if (stream->sample_rate == 0 || hda_rates[i].rate == 48000) {
+                stream->sample_rate = hda_rates[i].rate;
+                stream->format = stream->formats[stream->sample_rate_count - 1];
+            }
+        }
+    }
+    if (stream->sample_rate_count == 0) {
+        free(stream);
+        return ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status;
+    if ((status = io_buffer_init(&stream->bdl, PAGE_SIZE, IO_BUFFER_RW)) != NO_ERROR) {
+        free(stream);
+        return status;
+    }
+    if ((status = stream_reset(stream)) != NO_ERROR) {
+        xprintf("intel-hda: error %d resetting stream %u\n", status, sd);
+        goto fail;
+    }
+    hda->streams[sd] = stream;
+    hda_write32(hda, HDA_REG_INTCTL, hda_read32(hda, HDA_REG_INTCTL) | HDA_INTCTL_SIE(sd));
+
+    char name[MX_DEVICE_NAME_MAX];
+    snprintf(name, sizeof(name), "intel-hda-%s-%u",
+             (type == AUDIO_TYPE_SINK) ? "sink" : "source", index);
+    device_init(&stream->device, hda->device.driver, name, &intel_hda_stream_device_proto);
+    stream->device.protocol_id = MX_PROTOCOL_AUDIO;
+    xprintf("intel-hda: %s on codec %u node %u, stream %u\n", name, conv->codec, conv->nid, sd);
+    if ((status = device_add(&stream->device, &hda->device)) != NO_ERROR) {
+        goto fail;
+    }
+    return NO_ERROR;
+
+fail:
+    hda_write32(hda, HDA_REG_INTCTL, hda_read32(hda, HDA_REG_INTCTL) & ~HDA_INTCTL_SIE(sd));
+    hda->streams[sd] = NULL;
+    io_buffer_release(&stream->bdl);
+    free(stream);
+    return status;
+}
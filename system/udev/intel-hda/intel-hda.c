@@ -0,0 +1,641 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/io-buffer.h>
+#include <ddk/protocol/pci.h>
+#include <magenta/device/audio.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <sys/param.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include "intel-hda.h"
+
+// The controller's codecs are set up once, when it's bound.  We take the
+// analog converters on each audio function group, and route every output
+// pin that's wired to something to a DAC, and an input pin to each ADC, by
+// the first path through the mixers and selectors we find.  Each DAC and
+// ADC with a path is published as an audio sink or source, on a stream
+// descriptor of its own.
+//
+// What's played or recorded goes through a ring buffer shared with the
+// client, which the stream's DMA runs around; see intel-hda-stream.c.
+
+#define HDA_CMD_TIMEOUT MX_MSEC(100)
+#define HDA_RESET_TIMEOUT MX_MSEC(100)
+#define HDA_MAX_PATH 5
+#define HDA_MAX_CONN 32
+
+uint32_t hda_read32(intel_hda_t* hda, uint32_t reg) {
+    return pcie_read32(hda->regs + reg);
+}
+
+void hda_write32(intel_hda_t* hda, uint32_t reg, uint32_t val) {
+    pcie_write32(hda->regs + reg, val);
+}
+
+uint16_t hda_read16(intel_hda_t* hda, uint32_t reg) {
+    return pcie_read16(hda->regs + reg);
+}
+
+void hda_write16(intel_hda_t* hda, uint32_t reg, uint16_t val) {
+    pcie_write16(hda->regs + reg, val);
+}
+
+uint8_t hda_read8(intel_hda_t* hda, uint32_t reg) {
+    return pcie_read8(hda->regs + reg);
+}
+
+void hda_write8(intel_hda_t* hda, uint32_t reg, uint8_t val) {
+    pcie_write8(hda->regs + reg, val);
+}
+
+// waits for the bits of a 16 bit register in mask to read as val
+static mx_status_t hda_wait16(intel_hda_t* hda, uint32_t reg, uint16_t mask, uint16_t val) {
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + HDA_RESET_TIMEOUT;
+    while ((hda_read16(hda, reg) & mask) != val) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            return ERR_TIMED_OUT;
+        }
+        mx_nanosleep(MX_USEC(10));
+    }
+    return NO_ERROR;
+}
+
+mx_status_t hda_codec_cmd(intel_hda_t* hda, uint8_t codec, uint16_t nid, uint32_t verb,
+                          uint32_t* response) {
+    mtx_lock(&hda->cmd_lock);
+    hda->corb_wp = (hda->corb_wp + 1) % hda->corb_entries;
+    hda->corb[hda->corb_wp] = HDA_VERB(codec, nid, verb);
+    hda_write16(hda, HDA_REG_CORBWP, hda->corb_wp);
+
+    mx_status_t status = NO_ERROR;
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + HDA_CMD_TIMEOUT;
+    for (;;) {
+        uint16_t wp = hda_read16(hda, HDA_REG_RIRBWP) & 0xff;
+        if (wp != hda->rirb_rp) {
+            hda->rirb_rp = (hda->rirb_rp + 1) % hda->rirb_entries;
+            volatile hda_rirb_entry_t* entry = &hda->rirb[hda->rirb_rp];
+            // we don't ask for unsolicited responses, but skip any that come
+            if (entry->response_ex & HDA_RIRB_EX_UNSOL) {
+                continue;
+            }
+            if (response) {
+                *response = entry->response;
+            }
+            break;
+        }
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            xprintf("intel-hda: codec %u node %u verb 0x%05x timed out\n", codec, nid, verb);
+            status = ERR_TIMED_OUT;
+            break;
+        }
+        mx_nanosleep(MX_USEC(10));
+    }
+    mtx_unlock(&hda->cmd_lock);
+    return status;
+}
+
+static uint32_t hda_get_param(intel_hda_t* hda, uint8_t codec, uint16_t nid, uint8_t param) {
+    uint32_t val;
+    if (hda_codec_cmd(hda, codec, nid, HDA_GET_PARAM(param), &val) != NO_ERROR) {
+        return 0;
+    }
+    return val;
+}
+
+typedef struct {
+    uint16_t nid;
+    uint32_t caps;
+    uint32_t pin_caps;
+    uint32_t config;
+    uint32_t pcm;
+    uint16_t conn[HDA_MAX_CONN];
+    uint32_t conn_count;
+    // a converter we've published a stream for
+    bool streaming;
+} hda_widget_t;
+
+typedef struct {
+    intel_hda_t* hda;
+    uint8_t codec;
+    uint16_t nid;
+    // the defaults for widgets that don't override them
+    uint32_t pcm;
+    uint32_t in_amp;
+    uint32_t out_amp;
+    hda_widget_t* widgets;
+    uint32_t start;
+    uint32_t count;
+} hda_afg_t;
+
+// widgets from one end of a path to the other, and the connection each
+// takes to the next
+typedef struct {
+    hda_widget_t* widget[HDA_MAX_PATH];
+    uint32_t index[HDA_MAX_PATH];
+    uint32_t length;
+} hda_path_t;
+
+static hda_widget_t* hda_afg_widget(hda_afg_t* afg, uint32_t nid) {
+    if (nid < afg->start || nid >= afg->start + afg->count) {
+        return NULL;
+    }
+    return &afg->widgets[nid - afg->start];
+}
+
+static void hda_read_conn_list(hda_afg_t* afg, hda_widget_t* w) {
+    uint32_t len = hda_get_param(afg->hda, afg->codec, w->nid, HDA_PARAM_CONN_LIST_LEN);
+    bool long_form = len & HDA_CONN_LIST_LONG;
+    uint32_t count = HDA_CONN_LIST_LEN(len);
+    uint32_t per_response = long_form ? 2 : 4;
+    uint32_t bits = long_form ? 16 : 8;
+    uint32_t range = 1u << (bits - 1);
+
+    uint32_t prev = 0;
+    for (uint32_t offset = 0; offset < count; offset += per_response) {
+        uint32_t val;
+        if (hda_codec_cmd(afg->hda, afg->codec, w->nid, HDA_GET_CONN_LIST(offset), &val)) {
+            return;
+        }
+        for (uint32_t i = 0; i < per_response && offset + i < count; i++) {
+            uint32_t entry = (val >> (i * bits)) & ((1u << bits) - 1);
+            uint32_t nid = entry & (range - 1);
+            // a range entry stands for the nodes after the one before it, up to its own
+            uint32_t first = ((entry & range) && prev != 0) ? prev + 1 : nid;
+            for (uint32_t n = first; n <= nid && w->conn_count < HDA_MAX_CONN; n++) {
+                w->conn[w->conn_count++] = n;
+            }
+            prev = nid;
+        }
+    }
+}
+
+static bool hda_pin_usable(hda_widget_t* w, uint32_t pin_cap) {
+    if ((HDA_AW_TYPE(w->caps) != HDA_AW_TYPE_PIN) || (w->caps & HDA_AW_DIGITAL) ||
+        !(w->pin_caps & pin_cap) || (HDA_CONFIG_PORT(w->config) == HDA_CONFIG_PORT_NONE)) {
+        return false;
+    }
+    switch (HDA_CONFIG_DEVICE(w->config)) {
+    case HDA_CONFIG_LINE_OUT:
+    case HDA_CONFIG_SPEAKER:
+    case HDA_CONFIG_HP_OUT:
+        return pin_cap == HDA_PIN_CAPS_OUTPUT;
+    case HDA_CONFIG_LINE_IN:
+    case HDA_CONFIG_MIC_IN:
+        return pin_cap == HDA_PIN_CAPS_INPUT;
+    }
+    return false;
+}
+
+// whether w can end a path looking for type: an analog stereo converter
+// that does 16 bit samples, or a pin that takes input
+static bool hda_path_end(hda_widget_t* w, uint32_t type) {
+    if (HDA_AW_TYPE(w->caps) != type) {
+        return false;
+    }
+    if (type == HDA_AW_TYPE_PIN) {
+        return hda_pin_usable(w, HDA_PIN_CAPS_INPUT);
+    }
+    return !(w->caps & HDA_AW_DIGITAL) && (w->caps & HDA_AW_STEREO) &&
+           (w->pcm & HDA_PCM_16BITS) && (w->pcm & HDA_PCM_RATE_MASK);
+}
+
+// Finds a path from w to a widget of the given type, depth first through
+// mixers and selectors, and returns whether it did.
+static bool hda_find_path(hda_afg_t* afg, hda_widget_t* w, uint32_t type, hda_path_t* path) {
+    uint32_t depth = path->length;
+    path->widget[depth] = w;
+    path->length = depth + 1;
+    if (depth > 0 && hda_path_end(w, type)) {
+        return true;
+    }
+    uint32_t w_type = HDA_AW_TYPE(w->caps);
+    if ((depth > 0 && w_type != HDA_AW_TYPE_MIXER && w_type != HDA_AW_TYPE_SELECTOR) ||
+        path->length == HDA_MAX_PATH) {
+        path->length = depth;
+        return false;
+    }
+    for (uint32_t i = 0; i < w->conn_count; i++) {
+        hda_widget_t* next = hda_afg_widget(afg, w->conn[i]);
+        if (next == NULL) {
+            continue;
+        }
+        bool loop = false;
+        for (uint32_t j = 0; j < path->length; j++) {
+            loop |= (path->widget[j] == next);
+        }
+        if (!loop) {
+            path->index[depth] = i;
+            if (hda_find_path(afg, next, type, path)) {
+                return true;
+            }
+        }
+    }
+    path->length = depth;
+    return false;
+}
+
+static void hda_unmute(hda_afg_t* afg, hda_widget_t* w, uint32_t dir, uint32_t index) {
+    uint32_t caps = hda_get_param(afg->hda, afg->codec, w->nid,
+                                  (dir == HDA_AMP_INPUT) ? HDA_PARAM_IN_AMP_CAPS
+                                                         : HDA_PARAM_OUT_AMP_CAPS);
+    if (caps == 0) {
+        caps = (dir == HDA_AMP_INPUT) ? afg->in_amp : afg->out_amp;
+    }
+    // no mute, and the gain that's 0dB
+    uint32_t val = dir | HDA_AMP_LEFT | HDA_AMP_RIGHT | HDA_AMP_INDEX(index) |
+                   HDA_AMP_CAPS_OFFSET(caps);
+    hda_codec_cmd(afg->hda, afg->codec, w->nid, HDA_SET_AMP(val), NULL);
+}
+
+// selects each connection along the path, and opens up its amplifiers
+static void hda_setup_path(hda_afg_t* afg, hda_path_t* path) {
+    for (uint32_t i = 0; i < path->length; i++) {
+        hda_widget_t* w = path->widget[i];
+        bool last = (i + 1 == path->length);
+        uint32_t index = last ? 0 : path->index[i];
+        if (!last && w->conn_count > 1 && HDA_AW_TYPE(w->caps) != HDA_AW_TYPE_MIXER) {
+            hda_codec_cmd(afg->hda, afg->codec, w->nid, HDA_SET_CONN_SELECT(index), NULL);
+        }
+        if (w->caps & HDA_AW_IN_AMP) {
+            hda_unmute(afg, w, HDA_AMP_INPUT, index);
+        }
+        if (w->caps & HDA_AW_OUT_AMP) {
+            hda_unmute(afg, w, HDA_AMP_OUTPUT, 0);
+        }
+    }
+}
+
+static void hda_add_stream(hda_afg_t* afg, hda_widget_t* conv, int type) {
+    intel_hda_t* hda = afg->hda;
+    uint32_t sd;
+    if (type == AUDIO_TYPE_SINK) {
+        if (hda->outputs_used == hda->output_streams) {
+            return;
+        }
+        sd = hda->input_streams + hda->outputs_used++;
+    } else {
+        if (hda->inputs_used == hda->input_streams) {
+            return;
+        }
+        sd = hda->inputs_used++;
+    }
+    intel_hda_converter_t c = {
+        .codec = afg->codec,
+        .nid = conv->nid,
+        .pcm = conv->pcm,
+    };
+    if (intel_hda_stream_create(hda, type, sd, &c) == NO_ERROR) {
+        conv->streaming = true;
+    }
+}
+
+static void hda_setup_outputs(hda_afg_t* afg) {
+    for (uint32_t i = 0; i < afg->count; i++) {
+        hda_widget_t* pin = &afg->widgets[i];
+        if (!hda_pin_usable(pin, HDA_PIN_CAPS_OUTPUT)) {
+            continue;
+        }
+        hda_path_t path = { .length = 0 };
+        if (!hda_find_path(afg, pin, HDA_AW_TYPE_OUTPUT, &path)) {
+            continue;
+        }
+        uint32_t ctrl = HDA_PIN_CTRL_OUT;
+        if ((HDA_CONFIG_DEVICE(pin->config) == HDA_CONFIG_HP_OUT) &&
+            (pin->pin_caps & HDA_PIN_CAPS_HP)) {
+            ctrl |= HDA_PIN_CTRL_HP;
+        }
+        hda_codec_cmd(afg->hda, afg->codec, pin->nid, HDA_SET_PIN_CTRL(ctrl), NULL);
+        if (pin->pin_caps & HDA_PIN_CAPS_EAPD) {
+            hda_codec_cmd(afg->hda, afg->codec, pin->nid, HDA_SET_EAPD(HDA_EAPD_ENABLE), NULL);
+        }
+        hda_setup_path(afg, &path);
+
+        // pins that share a DAC all play what's sent to it
+        hda_widget_t* dac = path.widget[path.length - 1];
+        if (!dac->streaming) {
+            hda_add_stream(afg, dac, AUDIO_TYPE_SINK);
+        }
+    }
+}
+
+static void hda_setup_inputs(hda_afg_t* afg) {
+    for (uint32_t i = 0; i < afg->count; i++) {
+        hda_widget_t* adc = &afg->widgets[i];
+        if (!hda_path_end(adc, HDA_AW_TYPE_INPUT)) {
+            continue;
+        }
+        hda_path_t path = { .length = 0 };
+        if (!hda_find_path(afg, adc, HDA_AW_TYPE_PIN, &path)) {
+            continue;
+        }
+        hda_widget_t* pin = path.widget[path.length - 1];
+        hda_codec_cmd(afg->hda, afg->codec, pin->nid, HDA_SET_PIN_CTRL(HDA_PIN_CTRL_IN), NULL);
+        hda_setup_path(afg, &path);
+        hda_add_stream(afg, adc, AUDIO_TYPE_SOURCE);
+    }
+}
+
+static void hda_probe_afg(intel_hda_t* hda, uint8_t codec, uint16_t nid) {
+    hda_afg_t afg = {
+        .hda = hda,
+        .codec = codec,
+        .nid = nid,
+    };
+    hda_codec_cmd(hda, codec, nid, HDA_SET_POWER_STATE(HDA_POWER_D0), NULL);
+    afg.pcm = hda_get_param(hda, codec, nid, HDA_PARAM_PCM);
+    afg.in_amp = hda_get_param(hda, codec, nid, HDA_PARAM_IN_AMP_CAPS);
+    afg.out_amp = hda_get_param(hda, codec, nid, HDA_PARAM_OUT_AMP_CAPS);
+
+    uint32_t nodes = hda_get_param(hda, codec, nid, HDA_PARAM_NODE_COUNT);
+    afg.start = HDA_NODE_START(nodes);
+    afg.count = HDA_NODE_COUNT(nodes);
+    if (afg.count == 0 || (afg.widgets = calloc(afg.count, sizeof(hda_widget_t))) == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < afg.count; i++) {
+        hda_widget_t* w = &afg.widgets[i];
+        w->nid = afg.start + i;
+        w->caps = hda_get_param(hda, codec, w->nid, HDA_PARAM_AW_CAPS);
+        if (w->caps & HDA_AW_POWER_CTL) {
+            hda_codec_cmd(hda, codec, w->nid, HDA_SET_POWER_STATE(HDA_POWER_D0), NULL);
+        }
+        if (w->caps & HDA_AW_CONN_LIST) {
+            hda_read_conn_list(&afg, w);
+        }
+        switch (HDA_AW_TYPE(w->caps)) {
+        case HDA_AW_TYPE_OUTPUT:
+        case HDA_AW_TYPE_INPUT:
+            w->pcm = (w->caps & HDA_AW_FORMAT_OVERRIDE)
+                         ? hda_get_param(hda, codec, w->nid, HDA_PARAM_PCM) : afg.pcm;
+            break;
+        case HDA_AW_TYPE_PIN:
+            w->pin_caps = hda_get_param(hda, codec, w->nid, HDA_PARAM_PIN_CAPS);
+            hda_codec_cmd(hda, codec, w->nid, HDA_GET_CONFIG_DEFAULT, &w->config);
+            break;
+        }
+    }
+
+    hda_setup_outputs(&afg);
+    hda_setup_inputs(&afg);
+    free(afg.widgets);
+}
+
+static void hda_probe_codec(intel_hda_t* hda, uint8_t codec) {
+    uint32_t nodes = hda_get_param(hda, codec, 0, HDA_PARAM_NODE_COUNT);
+    for (uint32_t i = 0; i < HDA_NODE_COUNT(nodes); i++) {
+        uint16_t nid = HDA_NODE_START(nodes) + i;
+        uint32_t type = hda_get_param(hda, codec, nid, HDA_PARAM_FN_GROUP_TYPE);
+        if ((type & 0xff) == HDA_FN_GROUP_AUDIO) {
+            hda_probe_afg(hda, codec, nid);
+        }
+    }
+}
+
+static int hda_irq_thread(void* arg) {
+    intel_hda_t* hda = arg;
+    // a low latency client waits on the period signals sent from here
+    mx_interrupt_set_affinity(hda->irq_handle, MX_INTERRUPT_CPU_ANY, MX_INTERRUPT_PRIORITY_HIGH);
+    for (;;) {
+        mx_status_t status = mx_interrupt_wait(hda->irq_handle);
+        if (status < 0) {
+            xprintf("intel-hda: error %d waiting for interrupt\n", status);
+            mx_interrupt_complete(hda->irq_handle);
+            break;
+        }
+        if (hda->edge_triggered_irq) {
+            mx_interrupt_complete(hda->irq_handle);
+        }
+
+        uint32_t sts = hda_read32(hda, HDA_REG_INTSTS) & HDA_INTSTS_SIS_MASK;
+        for (uint32_t sd = 0; sts != 0; sd++, sts >>= 1) {
+            if (!(sts & 1)) {
+                continue;
+            }
+            if (hda->streams[sd]) {
+                intel_hda_stream_irq(hda->streams[sd]);
+            } else {
+                hda_write8(hda, HDA_REG_SD(sd) + HDA_SD_STS, HDA_SD_STS_MASK);
+            }
+        }
+
+        if (!hda->edge_triggered_irq) {
+            mx_interrupt_complete(hda->irq_handle);
+        }
+    }
+    return 0;
+}
+
+// picks the biggest ring the CORBSIZE or RIRBSIZE register offers
+static uint16_t hda_ring_size(intel_hda_t* hda, uint32_t reg) {
+    uint8_t caps = hda_read8(hda, reg);
+    if (caps & HDA_RING_SIZE_CAP_256) {
+        hda_write8(hda, reg, HDA_RING_SIZE_256);
+        return 256;
+    }
+    if (caps & HDA_RING_SIZE_CAP_16) {
+        hda_write8(hda, reg, HDA_RING_SIZE_16);
+        return 16;
+    }
+    hda_write8(hda, reg, HDA_RING_SIZE_2);
+    return 2;
+}
+
+// Brings the controller and its codecs out of reset, and sets up the
+// command rings.  Returns the codecs that are present.
+static mx_status_t hda_reset(intel_hda_t* hda, uint16_t* codecs) {
+    hda_write8(hda, HDA_REG_CORBCTL, 0);
+    hda_write8(hda, HDA_REG_RIRBCTL, 0);
+    hda_write32(hda, HDA_REG_INTCTL, 0);
+
+    // hold the link in reset for at least 100us, then give the codecs
+    // 521us to ask for an address (section 5.5.1)
+    hda_write32(hda, HDA_REG_GCTL, hda_read32(hda, HDA_REG_GCTL) & ~HDA_GCTL_CRST);
+    mx_status_t status;
+    if ((status = hda_wait16(hda, HDA_REG_GCTL, HDA_GCTL_CRST, 0)) != NO_ERROR) {
+        return status;
+    }
+    mx_nanosleep(MX_USEC(100));
+    hda_write32(hda, HDA_REG_GCTL, hda_read32(hda, HDA_REG_GCTL) | HDA_GCTL_CRST);
+    if ((status = hda_wait16(hda, HDA_REG_GCTL, HDA_GCTL_CRST, HDA_GCTL_CRST)) != NO_ERROR) {
+        return status;
+    }
+    mx_nanosleep(MX_USEC(1000));
+    *codecs = hda_read16(hda, HDA_REG_STATESTS) & ((1u << HDA_MAX_CODECS) - 1);
+    hda_write16(hda, HDA_REG_STATESTS, *codecs);
+
+    uint16_t gcap = hda_read16(hda, HDA_REG_GCAP);
+    hda->input_streams = HDA_GCAP_ISS(gcap);
+    hda->output_streams = HDA_GCAP_OSS(gcap);
+    if (!(gcap & HDA_GCAP_64OK) && ((io_buffer_phys(&hda->cmd_buffer) >> 32) ||
+                                    (io_buffer_phys(&hda->positions) >> 32))) {
+        xprintf("intel-hda: controller can't reach our buffers\n");
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // the CORB takes the first 1K of the page, and the RIRB the next 2K
+    mx_paddr_t phys = io_buffer_phys(&hda->cmd_buffer);
+    hda->corb = io_buffer_virt(&hda->cmd_buffer);
+    hda->rirb = io_buffer_virt(&hda->cmd_buffer) + 1024;
+    hda->corb_entries = hda_ring_size(hda, HDA_REG_CORBSIZE);
+    hda->rirb_entries = hda_ring_size(hda, HDA_REG_RIRBSIZE);
+
+    hda_write32(hda, HDA_REG_CORBLBASE, (uint32_t)phys);
+    hda_write32(hda, HDA_REG_CORBUBASE, (uint32_t)(phys >> 32));
+    hda_write16(hda, HDA_REG_CORBRP, HDA_CORBRP_RST);
+    if ((status = hda_wait16(hda, HDA_REG_CORBRP, HDA_CORBRP_RST, HDA_CORBRP_RST)) != NO_ERROR) {
+        return status;
+    }
+    hda_write16(hda, HDA_REG_CORBRP, 0);
+    if ((status = hda_wait16(hda, HDA_REG_CORBRP, HDA_CORBRP_RST, 0)) != NO_ERROR) {
+        return status;
+    }
+    hda_write16(hda, HDA_REG_CORBWP, 0);
+    hda->corb_wp = 0;
+
+    hda_write32(hda, HDA_REG_RIRBLBASE, (uint32_t)(phys + 1024));
+    hda_write32(hda, HDA_REG_RIRBUBASE, (uint32_t)((phys + 1024) >> 32));
+    hda_write16(hda, HDA_REG_RIRBWP, HDA_RIRBWP_RST);
+    hda_write16(hda, HDA_REG_RINTCNT, 1);
+    hda->rirb_rp = 0;
+
+    hda_write8(hda, HDA_REG_RIRBCTL, HDA_RIRBCTL_DMAEN);
+    hda_write8(hda, HDA_REG_CORBCTL, HDA_CORBCTL_RUN);
+
+    mx_paddr_t pos = io_buffer_phys(&hda->positions);
+    hda_write32(hda, HDA_REG_DPUBASE, (uint32_t)(pos >> 32));
+    hda_write32(hda, HDA_REG_DPLBASE, (uint32_t)pos | HDA_DPLBASE_ENABLE);
+
+    // each stream's interrupt is enabled as it's set up
+    hda_write32(hda, HDA_REG_INTCTL, HDA_INTCTL_GIE);
+    return NO_ERROR;
+}
+
+static mx_status_t hda_init(intel_hda_t* hda) {
+    mx_status_t status;
+    if ((status = io_buffer_init(&hda->cmd_buffer, PAGE_SIZE, IO_BUFFER_RW)) != NO_ERROR) {
+        return status;
+    }
+    if ((status = io_buffer_init(&hda->positions, PAGE_SIZE, IO_BUFFER_RW)) != NO_ERROR) {
+        return status;
+    }
+    memset(io_buffer_virt(&hda->cmd_buffer), 0, PAGE_SIZE);
+    memset(io_buffer_virt(&hda->positions), 0, PAGE_SIZE);
+
+    uint16_t codecs;
+    if ((status = hda_reset(hda, &codecs)) != NO_ERROR) {
+        return status;
+    }
+    xprintf("intel-hda: %u input and %u output streams, codecs 0x%x\n",
+            hda->input_streams, hda->output_streams, codecs);
+
+    pci_protocol_t* pci = hda->pci;
+    if (pci->set_irq_mode(hda->pcidev, MX_PCIE_IRQ_MODE_MSI, 1) == NO_ERROR) {
+        hda->edge_triggered_irq = true;
+    } else if ((status = pci->set_irq_mode(hda->pcidev, MX_PCIE_IRQ_MODE_LEGACY, 1)) < 0) {
+        xprintf("intel-hda: error %d setting irq mode\n", status);
+        return status;
+    }
+    if ((hda->irq_handle = pci->map_interrupt(hda->pcidev, 0)) < 0) {
+        xprintf("intel-hda: error %d getting irq handle\n", hda->irq_handle);
+        return hda->irq_handle;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, hda_irq_thread, hda, "intel-hda-irq") != thrd_success) {
+        return ERR_NO_RESOURCES;
+    }
+    thrd_detach(t);
+
+    for (uint8_t codec = 0; codec < HDA_MAX_CODECS; codec++) {
+        if (codecs & (1u << codec)) {
+            hda_probe_codec(hda, codec);
+        }
+    }
+    return NO_ERROR;
+}
+
+static int hda_init_thread(void* arg) {
+    intel_hda_t* hda = arg;
+    mx_status_t status = hda_init(hda);
+    if (status != NO_ERROR) {
+        xprintf("intel-hda: error %d initializing controller\n", status);
+    }
+    return 0;
+}
+
+static mx_protocol_device_t intel_hda_device_proto = {
+};
+
+static mx_status_t intel_hda_bind(mx_driver_t* drv, mx_device_t* pcidev) {
+    pci_protocol_t* pci;
+    if (device_get_protocol(pcidev, MX_PROTOCOL_PCI, (void**)&pci)) return ERR_NOT_SUPPORTED;
+
+    mx_status_t status = pci->claim_device(pcidev);
+    if (status < 0) {
+        xprintf("intel-hda: error %d claiming pci device\n", status);
+        return status;
+    }
+
+    intel_hda_t* hda = calloc(1, sizeof(intel_hda_t));
+    if (!hda) {
+        xprintf("intel-hda: out of memory\n");
+        return ERR_NO_MEMORY;
+    }
+    device_init(&hda->device, drv, "intel-hda", &intel_hda_device_proto);
+    hda->pcidev = pcidev;
+    hda->pci = pci;
+    mtx_init(&hda->cmd_lock, mtx_plain);
+
+    hda->regs_handle = pci->map_mmio(pcidev, 0, MX_CACHE_POLICY_UNCACHED_DEVICE,
+                                     &hda->regs, &hda->regs_size);
+    if (hda->regs_handle < 0) {
+        status = hda->regs_handle;
+        xprintf("intel-hda: error %d mapping registers\n", status);
+        goto fail;
+    }
+    if ((status = pci->enable_bus_master(pcidev, true)) < 0) {
+        xprintf("intel-hda: error %d in enable bus master\n", status);
+        goto fail;
+    }
+
+    // the sinks and sources are added under the controller, once the
+    // codecs are set up
+    if ((status = device_add(&hda->device, pcidev)) != NO_ERROR) {
+        goto fail;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, hda_init_thread, hda, "intel-hda-init") != thrd_success) {
+        xprintf("intel-hda: cannot create init thread\n");
+        return NO_ERROR;
+    }
+    thrd_detach(t);
+    return NO_ERROR;
+
+fail:
+    if (hda->regs_handle > 0) {
+        mx_handle_close(hda->regs_handle);
+    }
+    free(hda);
+    return status;
+}
+
+mx_driver_t _driver_intel_hda = {
+    .ops = {
+        .bind = intel_hda_bind,
+    },
+};
+
+MAGENTA_DRIVER_BEGIN(_driver_intel_hda, "intel-hda", "magenta", "0.1", 3)
+    BI_ABORT_IF(NE, BIND_PROTOCOL, MX_PROTOCOL_PCI),
+    BI_ABORT_IF(NE, BIND_PCI_CLASS, 0x04),      // multimedia
+    BI_MATCH_IF(EQ, BIND_PCI_SUBCLASS, 0x03),   // high definition audio
+MAGENTA_DRIVER_END(_driver_intel_hda)
@@ -0,0 +1,91 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <ddk/device.h>
+#include <ddk/io-buffer.h>
+#include <ddk/protocol/pci.h>
+#include <hw/pci.h>
+#include <magenta/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include "intel-hda-hw.h"
+
+#define TRACE 1
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
+
+typedef struct intel_hda intel_hda_t;
+typedef struct intel_hda_stream intel_hda_stream_t;
+
+struct intel_hda {
+    mx_device_t device;
+    mx_device_t* pcidev;
+    pci_protocol_t* pci;
+
+    void* regs;
+    uint64_t regs_size;
+    mx_handle_t regs_handle;
+    mx_handle_t irq_handle;
+    bool edge_triggered_irq;
+
+    // the CORB and RIRB share a page; commands are sent one at a time,
+    // and their responses polled for
+    mtx_t cmd_lock;
+    io_buffer_t cmd_buffer;
+    volatile uint32_t* corb;
+    volatile hda_rirb_entry_t* rirb;
+    uint16_t corb_entries;
+    uint16_t rirb_entries;
+    uint16_t corb_wp;
+    uint16_t rirb_rp;
+
+    // the DMA position buffer has a page of its own, since it's shared
+    // read only with the clients of the streams
+    io_buffer_t positions;
+
+    uint32_t input_streams;
+    uint32_t output_streams;
+    uint32_t inputs_used;
+    uint32_t outputs_used;
+    // by descriptor number; set before the stream's interrupt is enabled
+    intel_hda_stream_t* streams[HDA_MAX_STREAMS];
+};
+
+uint32_t hda_read32(intel_hda_t* hda, uint32_t reg);
+void hda_write32(intel_hda_t* hda, uint32_t reg, uint32_t val);
+uint16_t hda_read16(intel_hda_t* hda, uint32_t reg);
+void hda_write16(intel_hda_t* hda, uint32_t reg, uint16_t val);
+uint8_t hda_read8(intel_hda_t* hda, uint32_t reg);
+void hda_write8(intel_hda_t* hda, uint32_t reg, uint8_t val);
+
+// sends a verb to a codec and waits for its response
+mx_status_t hda_codec_cmd(intel_hda_t* hda, uint8_t codec, uint16_t nid, uint32_t verb,
+                          uint32_t* response);
+
+// the converter (DAC or ADC) a stream is routed through on its codec
+typedef struct {
+    uint8_t codec;
+    uint16_t nid;
+    // supported sizes and rates, as in HDA_PARAM_PCM
+    uint32_t pcm;
+} intel_hda_converter_t;
+
+// publishes a sink or source (AUDIO_TYPE_*) on stream descriptor sd,
+// playing or recording through conv
+mx_status_t intel_hda_stream_create(intel_hda_t* hda, int type, uint32_t sd,
+                                    const intel_hda_converter_t* conv);
+
+// handles an interrupt for the stream, from the irq thread
+void intel_hda_stream_irq(intel_hda_stream_t* stream);
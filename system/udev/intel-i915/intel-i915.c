@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -87,10 +88,18 @@ static mx_status_t intel_i915_get_framebuffer(mx_device_t* dev, void** framebuff
     return NO_ERROR;
 }
 
+static void intel_i915_flush_region(mx_device_t* dev, const ioctl_display_region_t* regions,
+                                    uint32_t count) {
+    // the framebuffer is write combining and scanned out as it is, so all
+    // a flush needs is to drain the cpu's buffers, whatever the region
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
 static mx_display_protocol_t intel_i915_display_proto = {
     .set_mode = intel_i915_set_mode,
     .get_mode = intel_i915_get_mode,
     .get_framebuffer = intel_i915_get_framebuffer,
+    .flush_region = intel_i915_flush_region,
 };
 
 // implement device protocol
@@ -8,12 +8,15 @@
 #include <ddk/binding.h>
 #include <magenta/types.h>
 
+// the bind properties published for each pci device
+#define KPCI_PROP_COUNT 8
+
 typedef struct kpci_device {
     mx_device_t device;
     mx_handle_t handle;
     uint32_t index;
     mx_pcie_get_nth_info_t info;
-    mx_device_prop_t props[8];
+    mx_device_prop_t props[KPCI_PROP_COUNT];
 } kpci_device_t;
 
 #define get_kpci_device(dev) containerof(dev, kpci_device_t, device)
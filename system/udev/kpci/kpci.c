@@ -33,6 +33,26 @@ static mx_protocol_device_t kpci_device_proto = {
     .release = kpci_release,
 };
 
+static void kpci_init_props(mx_device_prop_t* props, const mx_pcie_get_nth_info_t* info) {
+    mx_device_prop_t device_props[] = {
+        (mx_device_prop_t){ BIND_PROTOCOL, 0, MX_PROTOCOL_PCI },
+        (mx_device_prop_t){ BIND_PCI_VID, 0, info->vendor_id },
+        (mx_device_prop_t){ BIND_PCI_DID, 0, info->device_id },
+        (mx_device_prop_t){ BIND_PCI_CLASS, 0, info->base_class },
+        (mx_device_prop_t){ BIND_PCI_SUBCLASS, 0, info->sub_class },
+        (mx_device_prop_t){ BIND_PCI_INTERFACE, 0, info->program_interface },
+        (mx_device_prop_t){ BIND_PCI_REVISION, 0, info->revision_id },
+        (mx_device_prop_t){ BIND_PCI_BDF_ADDR, 0, BIND_PCI_BDF_PACK(info->bus_id,
+                                                                    info->dev_id,
+                                                                    info->func_id) },
+    };
+
+    static_assert(sizeof(device_props) == KPCI_PROP_COUNT * sizeof(mx_device_prop_t),
+                 "Invalid number of PCI properties in kpci_device_t!");
+
+    memcpy(props, device_props, sizeof(device_props));
+}
+
 static mx_status_t kpci_init_child(mx_driver_t* drv, mx_device_t** out, uint32_t index) {
     mx_pcie_get_nth_info_t info;
 
@@ -57,23 +77,7 @@ static mx_status_t kpci_init_child(mx_driver_t* drv, mx_device_t** out, uint32_t
     device->index = index;
     *out = &device->device;
 
-    mx_device_prop_t device_props[] = {
-        (mx_device_prop_t){ BIND_PROTOCOL, 0, MX_PROTOCOL_PCI },
-        (mx_device_prop_t){ BIND_PCI_VID, 0, info.vendor_id },
-        (mx_device_prop_t){ BIND_PCI_DID, 0, info.device_id },
-        (mx_device_prop_t){ BIND_PCI_CLASS, 0, info.base_class },
-        (mx_device_prop_t){ BIND_PCI_SUBCLASS, 0, info.sub_class },
-        (mx_device_prop_t){ BIND_PCI_INTERFACE, 0, info.program_interface },
-        (mx_device_prop_t){ BIND_PCI_REVISION, 0, info.revision_id },
-        (mx_device_prop_t){ BIND_PCI_BDF_ADDR, 0, BIND_PCI_BDF_PACK(info.bus_id,
-                                                                    info.dev_id,
-                                                                    info.func_id) },
-    };
-
-    static_assert(sizeof(device_props) == sizeof(device->props),
-                 "Invalid number of PCI properties in kpci_device_t!");
-
-    memcpy(device->props, device_props, sizeof(device->props));
+    kpci_init_props(device->props, &info);
     device->device.props = device->props;
     device->device.prop_count = countof(device->props);
 
@@ -94,6 +98,7 @@ static mx_device_t* kpci_root_dev;
 
 void devhost_launch_devhost(mx_device_t* parent, const char* name, uint32_t protocol_id,
                             const char* procname, int argc, char** argv);
+bool devhost_is_colocated(uint32_t protocol_id, mx_device_prop_t* props, uint32_t prop_count);
 
 static mx_status_t kpci_init_children(mx_driver_t* drv, mx_device_t* parent) {
     for (uint32_t index = 0;; index++) {
@@ -111,6 +116,18 @@ static mx_status_t kpci_init_children(mx_driver_t* drv, mx_device_t* parent) {
         }
         mx_handle_close(h);
 
+        // publish it here if the device and its driver stack are to share
+        // the root devhost, rather than launching a devhost for it
+        mx_device_prop_t props[KPCI_PROP_COUNT];
+        kpci_init_props(props, &info);
+        if (devhost_is_colocated(MX_PROTOCOL_PCI, props, countof(props))) {
+            mx_device_t* device;
+            if (kpci_init_child(drv, &device, index) == NO_ERROR) {
+                device_add(device, parent);
+            }
+            continue;
+        }
+
         char name[32];
         snprintf(name, sizeof(name), "%02x:%02x:%02x",
                  info.bus_id, info.dev_id, info.func_id);
@@ -47,6 +47,18 @@ static ssize_t ktrace_ioctl(mx_device_t* dev, uint32_t op,
         *((mx_handle_t*) reply) = h;
         return sizeof(mx_handle_t);
     }
+    case IOCTL_KTRACE_GET_VMO: {
+        if (max < sizeof(mx_handle_t)) {
+            return ERR_BUFFER_TOO_SMALL;
+        }
+        mx_handle_t h;
+        mx_status_t status = mx_ktrace_control(get_root_resource(), KTRACE_ACTION_GET_VMO, 0, &h);
+        if (status < 0) {
+            return status;
+        }
+        *((mx_handle_t*) reply) = h;
+        return sizeof(mx_handle_t);
+    }
     case IOCTL_KTRACE_ADD_PROBE: {
         char name[MX_MAX_NAME_LEN];
         if ((cmdlen >= MX_MAX_NAME_LEN) || (cmdlen < 1) || (max != sizeof(uint32_t))) {
@@ -61,6 +73,15 @@ static ssize_t ktrace_ioctl(mx_device_t* dev, uint32_t op,
         *((uint32_t*) reply) = status;
         return sizeof(uint32_t);
     }
+    case IOCTL_KTRACE_BOOT_STAGE: {
+        char name[MX_MAX_NAME_LEN];
+        if ((cmdlen >= MX_MAX_NAME_LEN) || (cmdlen < 1)) {
+            return ERR_INVALID_ARGS;
+        }
+        memcpy(name, cmd, cmdlen);
+        name[cmdlen] = 0;
+        return mx_ktrace_control(get_root_resource(), KTRACE_ACTION_BOOT_STAGE, 0, name);
+    }
     default:
         return ERR_INVALID_ARGS;
     }
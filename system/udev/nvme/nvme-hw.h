@@ -0,0 +1,104 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+// NVM Express 1.2 controller registers, commands and data structures
+
+#define NVME_REG_CAP   0x00   // 64 bits
+#define NVME_REG_VS    0x08
+#define NVME_REG_INTMS 0x0c
+#define NVME_REG_INTMC 0x10
+#define NVME_REG_CC    0x14
+#define NVME_REG_CSTS  0x1c
+#define NVME_REG_AQA   0x24
+#define NVME_REG_ASQ   0x28   // 64 bits
+#define NVME_REG_ACQ   0x30   // 64 bits
+#define NVME_REG_DOORBELL_BASE 0x1000
+
+#define NVME_CAP_MQES(cap)   ((uint32_t)((cap) & 0xffff))
+#define NVME_CAP_TO(cap)     ((uint32_t)(((cap) >> 24) & 0xff))   // in 500ms units
+#define NVME_CAP_DSTRD(cap)  ((uint32_t)(((cap) >> 32) & 0xf))
+#define NVME_CAP_CSS_NVM(cap) (((cap) >> 37) & 1)
+#define NVME_CAP_MPSMIN(cap) ((uint32_t)(((cap) >> 48) & 0xf))
+
+#define NVME_CC_EN          (1 << 0)
+#define NVME_CC_CSS_NVM     (0 << 4)
+#define NVME_CC_MPS(shift)  (((shift) - 12) << 7)
+#define NVME_CC_AMS_RR      (0 << 11)
+#define NVME_CC_SHN_NORMAL  (1 << 14)
+#define NVME_CC_SHN_MASK    (3 << 14)
+#define NVME_CC_IOSQES(n)   ((n) << 16)
+#define NVME_CC_IOCQES(n)   ((n) << 20)
+
+#define NVME_CSTS_RDY        (1 << 0)
+#define NVME_CSTS_CFS        (1 << 1)
+#define NVME_CSTS_SHST_MASK  (3 << 2)
+#define NVME_CSTS_SHST_DONE  (2 << 2)
+
+// admin commands
+#define NVME_ADMIN_OP_DELETE_SQ    0x00
+#define NVME_ADMIN_OP_CREATE_SQ    0x01
+#define NVME_ADMIN_OP_DELETE_CQ    0x04
+#define NVME_ADMIN_OP_CREATE_CQ    0x05
+#define NVME_ADMIN_OP_IDENTIFY     0x06
+#define NVME_ADMIN_OP_SET_FEATURES 0x09
+
+#define NVME_IDENTIFY_NS   0
+#define NVME_IDENTIFY_CTRL 1
+
+#define NVME_FEATURE_NUM_QUEUES 0x07
+
+#define NVME_QUEUE_PHYS_CONTIG (1 << 0)
+#define NVME_CQ_IRQ_ENABLED    (1 << 1)
+
+// nvm commands
+#define NVME_OP_FLUSH 0x00
+#define NVME_OP_WRITE 0x01
+#define NVME_OP_READ  0x02
+
+typedef struct {
+    uint32_t cdw0;      // opcode in 7:0, command id in 31:16
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} __PACKED nvme_cmd_t;
+
+#define NVME_CMD_CDW0(op, cid) ((uint32_t)(op) | ((uint32_t)(cid) << 16))
+
+#define NVME_SQE_SHIFT 6    // 64 byte submission queue entries
+#define NVME_CQE_SHIFT 4    // 16 byte completion queue entries
+
+typedef struct {
+    uint32_t result;    // command specific
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;    // phase in bit 0, status field in 15:1
+} __PACKED nvme_cpl_t;
+
+#define NVME_CPL_PHASE(cpl)  ((cpl)->status & 1)
+#define NVME_CPL_STATUS(cpl) ((cpl)->status >> 1)
+
+// the parts of the identify data that are used
+#define NVME_ID_CTRL_SN     4       // 20 bytes
+#define NVME_ID_CTRL_MN     24      // 40 bytes
+#define NVME_ID_CTRL_MDTS   77
+#define NVME_ID_CTRL_NN     516     // 4 bytes
+
+#define NVME_ID_NS_NSZE     0       // 8 bytes
+#define NVME_ID_NS_FLBAS    26
+#define NVME_ID_NS_LBAF     128     // 4 bytes each, lba data size shift in 23:16
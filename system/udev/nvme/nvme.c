@@ -0,0 +1,817 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/completion.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/io-buffer.h>
+#include <ddk/iotxn.h>
+#include <ddk/protocol/block.h>
+#include <ddk/protocol/device.h>
+#include <ddk/protocol/pci.h>
+
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <magenta/listnode.h>
+#include <sys/param.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include "nvme-hw.h"
+
+#define TRACE 1
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
+
+// The controller gets an I/O queue pair for each cpu, as far as it and
+// the interrupts go, and every pair a vector of its own if there are
+// enough.  A thread submits on the same queue each time; which one is
+// picked from its id, since a thread can't tell which cpu it's on.
+//
+// Each queue has a command slot for all but one of its entries, so a full
+// set of slots can never overrun it, and a txn holds a slot until it's
+// done, being sent down a transfer at a time if it's bigger than the
+// controller takes in one.  Each slot has a page list of its own.
+//
+// Ordering between txns is left to the scheduler stacked on the disk; a
+// txn with no data is a cache flush.
+
+#define NVME_MAX_IO_QUEUES 16
+#define NVME_MAX_NAMESPACES 16
+#define NVME_ADMIN_DEPTH 16
+#define NVME_IO_DEPTH 32            // at most 65, for the 64-bit slot mask
+#define NVME_MAX_XFER (128 * 1024)
+#define NVME_MAX_SG 64
+
+// a slot's page list, enough for NVME_MAX_XFER starting part way into a
+// page, and not crossing one itself
+#define NVME_PRP_LIST_SIZE 512
+#define NVME_PRP_LIST_ENTRIES (NVME_PRP_LIST_SIZE / sizeof(uint64_t))
+
+#define NVME_ADMIN_TIMEOUT MX_SEC(5)
+
+typedef struct nvme_device nvme_device_t;
+typedef struct nvme_ns nvme_ns_t;
+
+typedef struct nvme_slot {
+    iotxn_t* txn;
+    nvme_ns_t* ns;
+    mx_off_t done;              // bytes of the txn transferred
+    uint64_t chunk;             // bytes in the command in flight
+    uint32_t sg_count;
+    iotxn_sg_t sg[NVME_MAX_SG];
+} nvme_slot_t;
+
+typedef struct nvme_queue {
+    mtx_t lock;
+    nvme_device_t* dev;
+    uint16_t id;
+    uint16_t depth;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t cq_phase;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+    nvme_cmd_t* sq;
+    nvme_cpl_t* cq;
+    uint64_t* prp_virt;
+    mx_paddr_t prp_phys;
+    io_buffer_t buffer;
+
+    uint64_t free_slots;
+    nvme_slot_t* slots;
+    list_node_t pending;        // txns waiting for a slot
+} nvme_queue_t;
+
+typedef struct nvme_irq {
+    nvme_device_t* dev;
+    uint32_t index;
+    mx_handle_t handle;
+    thrd_t thread;
+} nvme_irq_t;
+
+struct nvme_device {
+    mx_device_t device;
+    mx_device_t* pcidev;
+    pci_protocol_t* pci;
+
+    void* regs;
+    uint64_t regs_size;
+    mx_handle_t regs_handle;
+    uint64_t cap;
+    uint32_t db_stride;
+    uint64_t max_xfer;
+
+    mtx_t admin_lock;
+    nvme_queue_t admin;
+    io_buffer_t identify;
+
+    nvme_queue_t queues[NVME_MAX_IO_QUEUES];
+    uint32_t queue_count;
+    nvme_irq_t irqs[NVME_MAX_IO_QUEUES];
+    uint32_t irq_count;
+};
+
+struct nvme_ns {
+    mx_device_t device;
+    nvme_device_t* ctrl;
+    uint32_t nsid;
+    uint32_t block_size;
+    uint64_t block_count;
+};
+
+#define get_nvme_ns(dev) containerof(dev, nvme_ns_t, device)
+
+static uint32_t nvme_read32(nvme_device_t* dev, uint32_t reg) {
+    return pcie_read32(dev->regs + reg);
+}
+
+static void nvme_write32(nvme_device_t* dev, uint32_t reg, uint32_t val) {
+    pcie_write32(dev->regs + reg, val);
+}
+
+static uint64_t nvme_read64(nvme_device_t* dev, uint32_t reg) {
+    return nvme_read32(dev, reg) | ((uint64_t)nvme_read32(dev, reg + 4) << 32);
+}
+
+static void nvme_write64(nvme_device_t* dev, uint32_t reg, uint64_t val) {
+    nvme_write32(dev, reg, (uint32_t)val);
+    nvme_write32(dev, reg + 4, (uint32_t)(val >> 32));
+}
+
+static void nvme_ring(volatile uint32_t* doorbell, uint32_t val) {
+    // the queue entries must be in memory before the controller looks
+    atomic_thread_fence(memory_order_seq_cst);
+    pcie_write32(doorbell, val);
+}
+
+static mx_status_t nvme_wait_ready(nvme_device_t* dev, bool ready) {
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) +
+                         MX_MSEC(500) * MAX(NVME_CAP_TO(dev->cap), 1u);
+    for (;;) {
+        uint32_t csts = nvme_read32(dev, NVME_REG_CSTS);
+        if (!!(csts & NVME_CSTS_RDY) == ready) {
+            return NO_ERROR;
+        }
+        if (ready && (csts & NVME_CSTS_CFS)) {
+            return ERR_IO;
+        }
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            return ERR_TIMED_OUT;
+        }
+        mx_nanosleep(MX_MSEC(1));
+    }
+}
+
+static mx_status_t nvme_queue_init(nvme_device_t* dev, nvme_queue_t* q, uint16_t id,
+                                   uint16_t depth) {
+    size_t sq_size = roundup((size_t)depth << NVME_SQE_SHIFT, PAGE_SIZE);
+    size_t cq_size = roundup((size_t)depth << NVME_CQE_SHIFT, PAGE_SIZE);
+    uint32_t slots = (id == 0) ? 0 : depth - 1u;
+    size_t prp_size = roundup(slots * NVME_PRP_LIST_SIZE, PAGE_SIZE);
+
+    mx_status_t status = io_buffer_init(&q->buffer, sq_size + cq_size + prp_size, IO_BUFFER_RW);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    uint8_t* virt = io_buffer_virt(&q->buffer);
+    memset(virt, 0, sq_size + cq_size + prp_size);
+    q->sq = (nvme_cmd_t*)virt;
+    q->cq = (nvme_cpl_t*)(virt + sq_size);
+    q->prp_virt = (uint64_t*)(virt + sq_size + cq_size);
+    q->prp_phys = io_buffer_phys(&q->buffer) + sq_size + cq_size;
+
+    if (slots > 0) {
+        if ((q->slots = calloc(slots, sizeof(nvme_slot_t))) == NULL) {
+            io_buffer_release(&q->buffer);
+            return ERR_NO_MEMORY;
+        }
+        q->free_slots = (slots == 64) ? ~0ull : ((1ull << slots) - 1);
+    }
+    mtx_init(&q->lock, mtx_plain);
+    list_initialize(&q->pending);
+    q->dev = dev;
+    q->id = id;
+    q->depth = depth;
+    q->cq_phase = 1;
+    q->sq_doorbell = dev->regs + NVME_REG_DOORBELL_BASE + (2 * id) * dev->db_stride;
+    q->cq_doorbell = dev->regs + NVME_REG_DOORBELL_BASE + (2 * id + 1) * dev->db_stride;
+    return NO_ERROR;
+}
+
+// Runs an admin command and waits for it, polling, since they're only
+// used while setting up.
+static mx_status_t nvme_admin(nvme_device_t* dev, nvme_cmd_t* cmd, uint32_t* result) {
+    mtx_lock(&dev->admin_lock);
+    nvme_queue_t* q = &dev->admin;
+    cmd->cdw0 |= NVME_CMD_CDW0(0, q->sq_tail);
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = (q->sq_tail + 1) % q->depth;
+    nvme_ring(q->sq_doorbell, q->sq_tail);
+
+    mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + NVME_ADMIN_TIMEOUT;
+    volatile nvme_cpl_t* cpl = &q->cq[q->cq_head];
+    while ((cpl->status & 1) != q->cq_phase) {
+        if (mx_time_get(MX_CLOCK_MONOTONIC) > deadline) {
+            mtx_unlock(&dev->admin_lock);
+            xprintf("nvme: admin command 0x%02x timed out\n", cmd->cdw0 & 0xff);
+            return ERR_TIMED_OUT;
+        }
+        mx_nanosleep(MX_USEC(10));
+    }
+    uint16_t sf = cpl->status >> 1;
+    if (result) {
+        *result = cpl->result;
+    }
+    if (++q->cq_head == q->depth) {
+        q->cq_head = 0;
+        q->cq_phase ^= 1;
+    }
+    nvme_ring(q->cq_doorbell, q->cq_head);
+    mtx_unlock(&dev->admin_lock);
+
+    if (sf != 0) {
+        xprintf("nvme: admin command 0x%02x failed, status 0x%x\n", cmd->cdw0 & 0xff, sf);
+        return ERR_IO;
+    }
+    return NO_ERROR;
+}
+
+// Fills in the PRPs for length bytes of the slot's txn, starting offset
+// bytes in.  Every piece after the first must start on a page, and every
+// piece before the last must end on one.
+static mx_status_t nvme_slot_prps(nvme_queue_t* q, uint32_t slot, mx_off_t offset,
+                                  uint64_t length, nvme_cmd_t* cmd) {
+    nvme_slot_t* s = &q->slots[slot];
+    uint64_t* list = q->prp_virt + slot * NVME_PRP_LIST_ENTRIES;
+    mx_off_t end = offset + length;
+    uint32_t count = 0;
+    mx_paddr_t prev_end = 0;
+    mx_off_t pos = 0;
+    for (uint32_t i = 0; i < s->sg_count && pos < end; pos += s->sg[i].length, i++) {
+        mx_off_t start = MAX(pos, offset);
+        mx_off_t stop = MIN(pos + s->sg[i].length, end);
+        if (start >= stop) {
+            continue;
+        }
+        mx_paddr_t addr = s->sg[i].paddr + (start - pos);
+        mx_paddr_t addr_end = addr + (stop - start);
+        if ((count > 0) && ((addr & (PAGE_SIZE - 1)) || (prev_end & (PAGE_SIZE - 1)))) {
+            return ERR_INVALID_ARGS;
+        }
+        while (addr < addr_end) {
+            if (count == 0) {
+                if (addr & 3) {
+                    return ERR_INVALID_ARGS;
+                }
+                cmd->prp1 = addr;
+            } else if (count - 1 < NVME_PRP_LIST_ENTRIES) {
+                list[count - 1] = addr;
+            } else {
+                return ERR_INVALID_ARGS;
+            }
+            count++;
+            addr = (addr & ~((mx_paddr_t)PAGE_SIZE - 1)) + PAGE_SIZE;
+        }
+        prev_end = addr_end;
+    }
+    if (count == 2) {
+        cmd->prp2 = list[0];
+    } else if (count > 2) {
+        cmd->prp2 = q->prp_phys + slot * NVME_PRP_LIST_SIZE;
+    }
+    return NO_ERROR;
+}
+
+// Puts the command for the next part of the slot's txn on the queue,
+// without ringing the doorbell.
+static mx_status_t nvme_slot_issue(nvme_queue_t* q, uint32_t slot) {
+    nvme_slot_t* s = &q->slots[slot];
+    iotxn_t* txn = s->txn;
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.nsid = s->ns->nsid;
+    if (txn->length == 0) {
+        cmd.cdw0 = NVME_CMD_CDW0(NVME_OP_FLUSH, slot);
+        s->chunk = 0;
+    } else {
+        uint64_t length = MIN(txn->length - s->done, q->dev->max_xfer);
+        mx_status_t status = nvme_slot_prps(q, slot, s->done, length, &cmd);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        uint64_t lba = (txn->offset + s->done) / s->ns->block_size;
+        uint8_t op = (txn->opcode == IOTXN_OP_READ) ? NVME_OP_READ : NVME_OP_WRITE;
+        cmd.cdw0 = NVME_CMD_CDW0(op, slot);
+        cmd.cdw10 = (uint32_t)lba;
+        cmd.cdw11 = (uint32_t)(lba >> 32);
+        cmd.cdw12 = (uint32_t)(length / s->ns->block_size - 1);
+        s->chunk = length;
+    }
+    q->sq[q->sq_tail] = cmd;
+    q->sq_tail = (q->sq_tail + 1) % q->depth;
+    return NO_ERROR;
+}
+
+// Starts as many pending txns as there are free slots, with the lock
+// held.  Those that can't be started are put on done.
+static void nvme_queue_submit(nvme_queue_t* q, list_node_t* done) {
+    bool issued = false;
+    iotxn_t* txn;
+    while ((q->free_slots != 0) &&
+           (txn = list_remove_head_type(&q->pending, iotxn_t, node)) != NULL) {
+        uint32_t slot = __builtin_ctzll(q->free_slots);
+        nvme_slot_t* s = &q->slots[slot];
+        s->txn = txn;
+        s->ns = txn->context;
+        s->done = 0;
+        s->sg_count = 0;
+        if ((txn->length > 0) &&
+            (txn->ops->physmap_sg(txn, s->sg, NVME_MAX_SG, &s->sg_count) != NO_ERROR)) {
+            // too scattered to describe, so have it made contiguous
+            txn->ops->physmap(txn, &s->sg[0].paddr);
+            s->sg[0].length = txn->length;
+            s->sg_count = (s->sg[0].paddr != 0) ? 1 : 0;
+        }
+        mx_status_t status = nvme_slot_issue(q, slot);
+        if (status != NO_ERROR) {
+            txn->status = status;
+            txn->actual = 0;
+            list_add_tail(done, &txn->node);
+            s->txn = NULL;
+            continue;
+        }
+        q->free_slots &= ~(1ull << slot);
+        issued = true;
+    }
+    if (issued) {
+        nvme_ring(q->sq_doorbell, q->sq_tail);
+    }
+}
+
+static void nvme_complete_list(list_node_t* done) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(done, iotxn_t, node)) != NULL) {
+        txn->ops->complete(txn, txn->status, txn->actual);
+    }
+}
+
+static void nvme_queue_irq(nvme_queue_t* q) {
+    list_node_t done = LIST_INITIAL_VALUE(done);
+    bool consumed = false;
+    bool issued = false;
+
+    mtx_lock(&q->lock);
+    for (;;) {
+        volatile nvme_cpl_t* cpl = &q->cq[q->cq_head];
+        if ((cpl->status & 1) != q->cq_phase) {
+            break;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        uint16_t slot = cpl->cid;
+        uint16_t sf = cpl->status >> 1;
+        if (++q->cq_head == q->depth) {
+            q->cq_head = 0;
+            q->cq_phase ^= 1;
+        }
+        consumed = true;
+
+        nvme_slot_t* s = (slot < q->depth - 1u) ? &q->slots[slot] : NULL;
+        if ((s == NULL) || (s->txn == NULL)) {
+            xprintf("nvme: queue %u: completion for idle slot %u\n", q->id, slot);
+            continue;
+        }
+        iotxn_t* txn = s->txn;
+        mx_status_t status = NO_ERROR;
+        if (sf != 0) {
+            xprintf("nvme: queue %u: command failed, status 0x%x\n", q->id, sf);
+            status = ERR_IO;
+        } else {
+            s->done += s->chunk;
+            if (s->done < txn->length) {
+                if ((status = nvme_slot_issue(q, slot)) == NO_ERROR) {
+                    issued = true;
+                    continue;
+                }
+            }
+        }
+        txn->status = status;
+        txn->actual = (status == NO_ERROR) ? s->done : 0;
+        list_add_tail(&done, &txn->node);
+        s->txn = NULL;
+        q->free_slots |= 1ull << slot;
+    }
+    if (consumed) {
+        nvme_ring(q->cq_doorbell, q->cq_head);
+    }
+    if (issued) {
+        nvme_ring(q->sq_doorbell, q->sq_tail);
+    }
+    nvme_queue_submit(q, &done);
+    mtx_unlock(&q->lock);
+
+    nvme_complete_list(&done);
+}
+
+static int nvme_irq_thread(void* arg) {
+    nvme_irq_t* irq = arg;
+    nvme_device_t* dev = irq->dev;
+    for (;;) {
+        mx_status_t status = mx_interrupt_wait(irq->handle);
+        if (status < 0) {
+            xprintf("nvme: error %d waiting for interrupt %u\n", status, irq->index);
+            break;
+        }
+        mx_interrupt_complete(irq->handle);
+        for (uint32_t i = irq->index; i < dev->queue_count; i += dev->irq_count) {
+            nvme_queue_irq(&dev->queues[i]);
+        }
+    }
+    return 0;
+}
+
+static nvme_queue_t* nvme_pick_queue(nvme_device_t* dev) {
+    uint64_t h = (uintptr_t)thrd_current() * 0x9e3779b97f4a7c15ull;
+    return &dev->queues[(h >> 32) % dev->queue_count];
+}
+
+// implement block device protocol:
+
+static void nvme_iotxn_queue(mx_device_t* device, iotxn_t* txn) {
+    nvme_ns_t* ns = get_nvme_ns(device);
+    if ((txn->opcode != IOTXN_OP_READ) && (txn->opcode != IOTXN_OP_WRITE)) {
+        txn->ops->complete(txn, ERR_NOT_SUPPORTED, 0);
+        return;
+    }
+    if ((txn->offset % ns->block_size) || (txn->length % ns->block_size)) {
+        txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
+        return;
+    }
+    uint64_t capacity = ns->block_count * ns->block_size;
+    if ((txn->length > 0) && (txn->offset >= capacity)) {
+        txn->ops->complete(txn, ERR_OUT_OF_RANGE, 0);
+        return;
+    }
+    // constrain to device capacity
+    txn->length = MIN(txn->length, capacity - MIN(txn->offset, capacity));
+    txn->context = ns;
+
+    list_node_t done = LIST_INITIAL_VALUE(done);
+    nvme_queue_t* q = nvme_pick_queue(ns->ctrl);
+    mtx_lock(&q->lock);
+    list_add_tail(&q->pending, &txn->node);
+    nvme_queue_submit(q, &done);
+    mtx_unlock(&q->lock);
+    nvme_complete_list(&done);
+}
+
+static void nvme_sync_complete(iotxn_t* txn, void* cookie) {
+    completion_signal((completion_t*)cookie);
+}
+
+static ssize_t nvme_ioctl(mx_device_t* device, uint32_t op, const void* cmd, size_t cmdlen,
+                          void* reply, size_t max) {
+    nvme_ns_t* ns = get_nvme_ns(device);
+    switch (op) {
+    case IOCTL_BLOCK_GET_SIZE: {
+        uint64_t* size = reply;
+        if (max < sizeof(*size)) return ERR_BUFFER_TOO_SMALL;
+        *size = ns->block_count * ns->block_size;
+        return sizeof(*size);
+    }
+    case IOCTL_BLOCK_GET_BLOCKSIZE: {
+        uint64_t* blksize = reply;
+        if (max < sizeof(*blksize)) return ERR_BUFFER_TOO_SMALL;
+        *blksize = ns->block_size;
+        return sizeof(*blksize);
+    }
+    case IOCTL_DEVICE_SYNC: {
+        iotxn_t* txn;
+        mx_status_t status = iotxn_alloc(&txn, 0, 0, 0);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        completion_t completion = COMPLETION_INIT;
+        txn->opcode = IOTXN_OP_WRITE;
+        txn->flags = IOTXN_SYNC_BEFORE;
+        txn->complete_cb = nvme_sync_complete;
+        txn->cookie = &completion;
+        nvme_iotxn_queue(device, txn);
+        completion_wait(&completion, MX_TIME_INFINITE);
+        status = txn->status;
+        txn->ops->release(txn);
+        return status;
+    }
+    default:
+        return ERR_NOT_SUPPORTED;
+    }
+}
+
+static mx_off_t nvme_getsize(mx_device_t* device) {
+    nvme_ns_t* ns = get_nvme_ns(device);
+    return ns->block_count * ns->block_size;
+}
+
+static mx_status_t nvme_ns_release(mx_device_t* device) {
+    free(get_nvme_ns(device));
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t nvme_ns_proto = {
+    .ioctl = nvme_ioctl,
+    .iotxn_queue = nvme_iotxn_queue,
+    .get_size = nvme_getsize,
+    .release = nvme_ns_release,
+};
+
+static mx_protocol_device_t nvme_device_proto = {
+};
+
+// set up:
+
+static mx_status_t nvme_identify(nvme_device_t* dev, uint32_t cns, uint32_t nsid) {
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_OP_IDENTIFY;
+    cmd.nsid = nsid;
+    cmd.prp1 = io_buffer_phys(&dev->identify);
+    cmd.cdw10 = cns;
+    return nvme_admin(dev, &cmd, NULL);
+}
+
+static mx_status_t nvme_create_io_queue(nvme_device_t* dev, nvme_queue_t* q, uint16_t vector) {
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_OP_CREATE_CQ;
+    cmd.prp1 = io_buffer_phys(&q->buffer) + ((uint8_t*)q->cq - (uint8_t*)q->sq);
+    cmd.cdw10 = ((uint32_t)(q->depth - 1) << 16) | q->id;
+    cmd.cdw11 = ((uint32_t)vector << 16) | NVME_CQ_IRQ_ENABLED | NVME_QUEUE_PHYS_CONTIG;
+    mx_status_t status = nvme_admin(dev, &cmd, NULL);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_OP_CREATE_SQ;
+    cmd.prp1 = io_buffer_phys(&q->buffer);
+    cmd.cdw10 = ((uint32_t)(q->depth - 1) << 16) | q->id;
+    cmd.cdw11 = ((uint32_t)q->id << 16) | NVME_QUEUE_PHYS_CONTIG;
+    return nvme_admin(dev, &cmd, NULL);
+}
+
+// Picks the interrupt mode, asking for a vector per queue
+static mx_status_t nvme_setup_irqs(nvme_device_t* dev, uint32_t wanted) {
+    static const mx_pci_irq_mode_t modes[] = { MX_PCIE_IRQ_MODE_MSI_X, MX_PCIE_IRQ_MODE_MSI };
+    for (size_t i = 0; i < countof(modes); i++) {
+        uint32_t max;
+        if (dev->pci->query_irq_mode_caps(dev->pcidev, modes[i], &max) != NO_ERROR || max == 0) {
+            continue;
+        }
+        uint32_t count = MIN(wanted, max);
+        if (dev->pci->set_irq_mode(dev->pcidev, modes[i], count) == NO_ERROR) {
+            dev->irq_count = count;
+            return NO_ERROR;
+        }
+    }
+    mx_status_t status = dev->pci->set_irq_mode(dev->pcidev, MX_PCIE_IRQ_MODE_LEGACY, 1);
+    if (status == NO_ERROR) {
+        xprintf("nvme: using legacy irq mode\n");
+        dev->irq_count = 1;
+    }
+    return status;
+}
+
+static void nvme_add_namespace(nvme_device_t* dev, uint32_t nsid) {
+    if (nvme_identify(dev, NVME_IDENTIFY_NS, nsid) != NO_ERROR) {
+        return;
+    }
+    uint8_t* id = io_buffer_virt(&dev->identify);
+    uint64_t nsze;
+    memcpy(&nsze, id + NVME_ID_NS_NSZE, sizeof(nsze));
+    uint32_t lbaf;
+    memcpy(&lbaf, id + NVME_ID_NS_LBAF + 4 * (id[NVME_ID_NS_FLBAS] & 0xf), sizeof(lbaf));
+    uint32_t lbads = (lbaf >> 16) & 0xff;
+    if ((nsze == 0) || (lbads < 9) || ((1ull << lbads) > dev->max_xfer)) {
+        return;
+    }
+
+    nvme_ns_t* ns = calloc(1, sizeof(nvme_ns_t));
+    if (!ns) {
+        return;
+    }
+    ns->ctrl = dev;
+    ns->nsid = nsid;
+    ns->block_size = 1u << lbads;
+    ns->block_count = nsze;
+
+    char name[MX_DEVICE_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "nvme-ns%u", nsid);
+    device_init(&ns->device, dev->device.driver, name, &nvme_ns_proto);
+    ns->device.protocol_id = MX_PROTOCOL_BLOCK;
+    xprintf("nvme: namespace %u, %" PRIu64 " blocks of %u bytes\n", nsid, nsze, ns->block_size);
+    if (device_add(&ns->device, &dev->device) != NO_ERROR) {
+        free(ns);
+    }
+}
+
+static mx_status_t nvme_init(nvme_device_t* dev) {
+    dev->cap = nvme_read64(dev, NVME_REG_CAP);
+    dev->db_stride = 4u << NVME_CAP_DSTRD(dev->cap);
+    if (!NVME_CAP_CSS_NVM(dev->cap) || (NVME_CAP_MPSMIN(dev->cap) != 0)) {
+        xprintf("nvme: controller doesn't do the nvm command set with 4K pages\n");
+        return ERR_NOT_SUPPORTED;
+    }
+    uint32_t vs = nvme_read32(dev, NVME_REG_VS);
+    xprintf("nvme: version %u.%u, %u queue entries most\n", vs >> 16, (vs >> 8) & 0xff,
+            NVME_CAP_MQES(dev->cap) + 1);
+
+    // start from a disabled controller
+    mx_status_t status;
+    if (nvme_read32(dev, NVME_REG_CC) & NVME_CC_EN) {
+        nvme_write32(dev, NVME_REG_CC, nvme_read32(dev, NVME_REG_CC) & ~NVME_CC_EN);
+    }
+    if ((status = nvme_wait_ready(dev, false)) != NO_ERROR) {
+        xprintf("nvme: error %d disabling controller\n", status);
+        return status;
+    }
+
+    uint16_t admin_depth = MIN(NVME_ADMIN_DEPTH, NVME_CAP_MQES(dev->cap) + 1);
+    if ((status = nvme_queue_init(dev, &dev->admin, 0, admin_depth)) != NO_ERROR) {
+        return status;
+    }
+    nvme_write32(dev, NVME_REG_AQA, ((uint32_t)(admin_depth - 1) << 16) | (admin_depth - 1));
+    nvme_write64(dev, NVME_REG_ASQ, io_buffer_phys(&dev->admin.buffer));
+    nvme_write64(dev, NVME_REG_ACQ, io_buffer_phys(&dev->admin.buffer) +
+                                    ((uint8_t*)dev->admin.cq - (uint8_t*)dev->admin.sq));
+    nvme_write32(dev, NVME_REG_CC, NVME_CC_IOCQES(NVME_CQE_SHIFT) | NVME_CC_IOSQES(NVME_SQE_SHIFT) |
+                                   NVME_CC_AMS_RR | NVME_CC_MPS(12) | NVME_CC_CSS_NVM |
+                                   NVME_CC_EN);
+    if ((status = nvme_wait_ready(dev, true)) != NO_ERROR) {
+        xprintf("nvme: error %d enabling controller\n", status);
+        return status;
+    }
+
+    if ((status = io_buffer_init(&dev->identify, PAGE_SIZE, IO_BUFFER_RW)) != NO_ERROR) {
+        return status;
+    }
+    if ((status = nvme_identify(dev, NVME_IDENTIFY_CTRL, 0)) != NO_ERROR) {
+        return status;
+    }
+    uint8_t* id = io_buffer_virt(&dev->identify);
+    char model[41];
+    memcpy(model, id + NVME_ID_CTRL_MN, 40);
+    model[40] = '\0';
+    uint32_t nn;
+    memcpy(&nn, id + NVME_ID_CTRL_NN, sizeof(nn));
+    dev->max_xfer = NVME_MAX_XFER;
+    if (id[NVME_ID_CTRL_MDTS] != 0) {
+        dev->max_xfer = MIN(dev->max_xfer, (uint64_t)PAGE_SIZE << id[NVME_ID_CTRL_MDTS]);
+    }
+    xprintf("nvme: %s, %u namespaces, %" PRIu64 " bytes per transfer\n", model, nn, dev->max_xfer);
+
+    // a queue pair per cpu, as many as the controller and interrupts let us
+    uint32_t wanted = MIN(mx_num_cpus(), NVME_MAX_IO_QUEUES);
+    if ((status = nvme_setup_irqs(dev, wanted)) != NO_ERROR) {
+        xprintf("nvme: error %d setting irq mode\n", status);
+        return status;
+    }
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cdw0 = NVME_ADMIN_OP_SET_FEATURES;
+    cmd.cdw10 = NVME_FEATURE_NUM_QUEUES;
+    cmd.cdw11 = ((wanted - 1) << 16) | (wanted - 1);
+    uint32_t result;
+    if ((status = nvme_admin(dev, &cmd, &result)) != NO_ERROR) {
+        return status;
+    }
+    uint32_t count = MIN(wanted, MIN((result & 0xffff) + 1, (result >> 16) + 1));
+
+    uint16_t io_depth = MIN(NVME_IO_DEPTH, NVME_CAP_MQES(dev->cap) + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        nvme_queue_t* q = &dev->queues[i];
+        if ((status = nvme_queue_init(dev, q, i + 1, io_depth)) != NO_ERROR) {
+            break;
+        }
+        if ((status = nvme_create_io_queue(dev, q, i % dev->irq_count)) != NO_ERROR) {
+            free(q->slots);
+            io_buffer_release(&q->buffer);
+            break;
+        }
+        dev->queue_count++;
+    }
+    if (dev->queue_count == 0) {
+        xprintf("nvme: error %d creating i/o queues\n", status);
+        return status;
+    }
+    // with fewer queues than vectors, the extra vectors go unused
+    dev->irq_count = MIN(dev->irq_count, dev->queue_count);
+    xprintf("nvme: %u i/o queues, %u interrupts\n", dev->queue_count, dev->irq_count);
+
+    for (uint32_t i = 0; i < dev->irq_count; i++) {
+        nvme_irq_t* irq = &dev->irqs[i];
+        irq->dev = dev;
+        irq->index = i;
+        if ((irq->handle = dev->pci->map_interrupt(dev->pcidev, i)) < 0) {
+            xprintf("nvme: error %d getting irq handle %u\n", irq->handle, i);
+            return irq->handle;
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "nvme-irq%u", i);
+        if (thrd_create_with_name(&irq->thread, nvme_irq_thread, irq, name) != thrd_success) {
+            return ERR_NO_RESOURCES;
+        }
+    }
+
+    for (uint32_t nsid = 1; nsid <= MIN(nn, NVME_MAX_NAMESPACES); nsid++) {
+        nvme_add_namespace(dev, nsid);
+    }
+    return NO_ERROR;
+}
+
+static int nvme_init_thread(void* arg) {
+    nvme_device_t* dev = arg;
+    mx_status_t status = nvme_init(dev);
+    if (status != NO_ERROR) {
+        xprintf("nvme: error %d initializing controller\n", status);
+    }
+    return 0;
+}
+
+// implement driver object:
+
+static mx_status_t nvme_bind(mx_driver_t* drv, mx_device_t* pcidev) {
+    pci_protocol_t* pci;
+    if (device_get_protocol(pcidev, MX_PROTOCOL_PCI, (void**)&pci)) return ERR_NOT_SUPPORTED;
+
+    mx_status_t status = pci->claim_device(pcidev);
+    if (status < 0) {
+        xprintf("nvme: error %d claiming pci device\n", status);
+        return status;
+    }
+
+    nvme_device_t* dev = calloc(1, sizeof(nvme_device_t));
+    if (!dev) {
+        xprintf("nvme: out of memory\n");
+        return ERR_NO_MEMORY;
+    }
+    device_init(&dev->device, drv, "nvme", &nvme_device_proto);
+    dev->pcidev = pcidev;
+    dev->pci = pci;
+    mtx_init(&dev->admin_lock, mtx_plain);
+
+    dev->regs_handle = pci->map_mmio(pcidev, 0, MX_CACHE_POLICY_UNCACHED_DEVICE,
+                                     &dev->regs, &dev->regs_size);
+    if (dev->regs_handle < 0) {
+        status = dev->regs_handle;
+        xprintf("nvme: error %d mapping register window\n", status);
+        goto fail;
+    }
+    if ((status = pci->enable_bus_master(pcidev, true)) < 0) {
+        xprintf("nvme: error %d in enable bus master\n", status);
+        goto fail;
+    }
+
+    // the namespaces are added under the controller, once it's set up
+    if ((status = device_add(&dev->device, pcidev)) != NO_ERROR) {
+        goto fail;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, nvme_init_thread, dev, "nvme-init") != thrd_success) {
+        xprintf("nvme: cannot create init thread\n");
+        return NO_ERROR;
+    }
+    thrd_detach(t);
+    return NO_ERROR;
+
+fail:
+    if (dev->regs_handle > 0) {
+        mx_handle_close(dev->regs_handle);
+    }
+    free(dev);
+    return status;
+}
+
+mx_driver_t _driver_nvme = {
+    .ops = {
+        .bind = nvme_bind,
+    },
+};
+
+MAGENTA_DRIVER_BEGIN(_driver_nvme, "nvme", "magenta", "0.1", 4)
+    BI_ABORT_IF(NE, BIND_PROTOCOL, MX_PROTOCOL_PCI),
+    BI_ABORT_IF(NE, BIND_PCI_CLASS, 0x01),      // mass storage
+    BI_ABORT_IF(NE, BIND_PCI_SUBCLASS, 0x08),   // non-volatile memory
+    BI_MATCH_IF(EQ, BIND_PCI_INTERFACE, 0x02),  // nvm express
+MAGENTA_DRIVER_END(_driver_nvme)
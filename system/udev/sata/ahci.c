@@ -70,6 +70,7 @@ typedef struct ahci_port {
     mtx_t lock;
 
     uint32_t running; // bitmask of running commands
+    uint32_t slots; // bitmask of command slots the device takes, set on the first txn
     iotxn_t* commands[AHCI_MAX_COMMANDS]; // commands in flight
 
     list_node_t txn_list;
@@ -88,9 +89,6 @@ typedef struct ahci_device {
     mx_handle_t irq_handle;
     thrd_t irq_thread;
 
-    thrd_t worker_thread;
-    completion_t worker_completion;
-
     thrd_t watchdog_thread;
     completion_t watchdog_completion;
 
@@ -185,10 +183,6 @@ static void ahci_port_reset(ahci_port_t* port) {
     ahci_write(&port->regs->serr, ahci_read(&port->regs->serr));
 }
 
-static bool ahci_port_cmd_busy(ahci_port_t* port, int slot) {
-    return ((ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci)) & (1 << slot)) || (port->commands[slot] != NULL) || (port->running & (1 << slot));
-}
-
 static bool cmd_is_read(uint8_t cmd) {
     if (cmd == SATA_CMD_READ_DMA ||
         cmd == SATA_CMD_READ_DMA_EXT ||
@@ -213,52 +207,61 @@ static bool cmd_is_queued(uint8_t cmd) {
     return (cmd == SATA_CMD_READ_FPDMA_QUEUED) || (cmd == SATA_CMD_WRITE_FPDMA_QUEUED);
 }
 
-static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
-    iotxn_t* txn;
-    uint32_t sact = ahci_read(&port->regs->sact);
-    for (int i = 0; i < AHCI_MAX_COMMANDS; i++) {
-        txn = port->commands[i];
-        if (txn == NULL) {
-            continue;
-        }
-        if (!(sact & (1 << i))) {
-            mtx_lock(&port->lock);
-            // clear state before calling the complete() hook
-            port->running &= ~(1 << i);
-            port->commands[i] = NULL;
-
-            // resume the port if paused for sync and no outstanding transactions
-            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+// Fills in the slot's PRDT with the physical pieces of txn's data, each
+// entry at most AHCI_PRD_MAX_SIZE, and returns how many it took. Where the
+// data is in more pieces than the table holds, it goes through the
+// contiguous copy physmap() makes instead.
+static uint16_t ahci_port_prdt(ahci_port_t* port, int slot, iotxn_t* txn) {
+    ahci_prd_t* prds = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
+    iotxn_sg_t sg[AHCI_MAX_PRDS];
+    uint32_t count;
+    if (txn->ops->physmap_sg(txn, sg, AHCI_MAX_PRDS, &count) != NO_ERROR) {
+        count = 0;
+    }
+
+    uint16_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        mx_paddr_t phys = sg[i].paddr;
+        uint64_t remaining = sg[i].length;
+        while (remaining > 0) {
+            if (n == AHCI_MAX_PRDS) {
+                goto contiguous;
             }
-            mtx_unlock(&port->lock);
-
-            txn->ops->complete(txn, status, txn->length);
+            size_t length = MIN(remaining, AHCI_PRD_MAX_SIZE);
+            prds[n].dba = LO32(phys);
+            prds[n].dbau = HI32(phys);
+            prds[n].dbc = ((length - 1) & 0x3fffff); // 0-based byte count
+            n++;
+            phys += length;
+            remaining -= length;
         }
     }
-    // hit the worker thread to do the next txn
-    completion_signal(&dev->worker_completion);
+    if (count > 0) {
+        return n;
+    }
+
+contiguous:;
+    mx_paddr_t phys;
+    txn->ops->physmap(txn, &phys);
+    mx_off_t remaining = txn->length;
+    for (n = 0; remaining > 0 && n < AHCI_MAX_PRDS; n++) {
+        size_t length = MIN(remaining, AHCI_PRD_MAX_SIZE);
+        prds[n].dba = LO32(phys);
+        prds[n].dbau = HI32(phys);
+        prds[n].dbc = ((length - 1) & 0x3fffff); // 0-based byte count
+        phys += length;
+        remaining -= length;
+    }
+    return n;
 }
 
-static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
+// Builds the command for txn in slot and issues it. Called with the port
+// lock held.
+static void ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
     assert(slot < AHCI_MAX_COMMANDS);
-    assert(!ahci_port_cmd_busy(port, slot));
+    assert(!(port->running & (1u << slot)));
 
     sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-    if ((cmd_is_read(pdata->cmd) || cmd_is_write(pdata->cmd)) && pdata->count == 0) {
-        // Empty reads and writes complete immediately, and are not actually
-        // transmitted to the underlying device.
-        // resume the port if paused for sync and no outstanding transactions
-        if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-            port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-        }
-        txn->ops->complete(txn, NO_ERROR, txn->length);
-        completion_signal(&dev->worker_completion);
-        return NO_ERROR;
-    }
-
-    mx_paddr_t phys;
-    txn->ops->physmap(txn, &phys);
 
     if (dev->cap & AHCI_CAP_NCQ) {
         if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
@@ -268,7 +271,7 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         }
     }
 
-    //xprintf("ahci.%d: do_txn slot=%d cmd=0x%x device=0x%x lba=0x%lx count=%u phys=0x%lx data_sz=0x%lx offset=0x%lx\n", port->nr, slot, pdata->cmd, pdata->device, pdata->lba, pdata->count, phys, txn->length, txn->offset);
+    //xprintf("ahci.%d: do_txn slot=%d cmd=0x%x device=0x%x lba=0x%lx count=%u data_sz=0x%lx offset=0x%lx\n", port->nr, slot, pdata->cmd, pdata->device, pdata->lba, pdata->count, txn->length, txn->offset);
 
     // build the command
     ahci_cl_t* cl = port->cl + slot;
@@ -276,7 +279,6 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     cl->prdtl_flags_cfl = 0;
     cl->cfl = 5; // 20 bytes
     cl->w = cmd_is_write(pdata->cmd) ? 1 : 0;
-    cl->prdtl = txn->length / AHCI_PRD_MAX_SIZE + 1;
     cl->prdbc = 0;
     memset(port->ct[slot], 0, sizeof(ahci_ct_t));
 
@@ -310,30 +312,114 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         cfis[13] = 0; // normal priority
     }
 
-    ahci_prd_t* prd = NULL;
-    for (int i = 0; i < cl->prdtl; i++) {
-        prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t)) + i;
-        prd->dba = LO32(phys);
-        prd->dbau = HI32(phys);
-        prd->dbc = ((txn->length - 1) & 0x3fffff); // 0-based byte count
-
-        phys += AHCI_PRD_MAX_SIZE;
-    }
+    cl->prdtl = ahci_port_prdt(port, slot, txn);
 
-    port->running |= (1 << slot);
+    port->running |= (1u << slot);
     port->commands[slot] = txn;
 
-    // start command
-    if (cmd_is_queued(pdata->cmd)) {
-        ahci_write(&port->regs->sact, ahci_read(&port->regs->sact) | (1 << slot));
-    }
-    ahci_write(&port->regs->ci, ahci_read(&port->regs->ci) | (1 << slot));
-
     // set the watchdog
     // TODO: general timeout mechanism
     pdata->timeout = mx_time_get(MX_CLOCK_MONOTONIC) + MX_SEC(1);
-    completion_signal(&dev->watchdog_completion);
-    return NO_ERROR;
+
+    // start command; zeroes written to sact and ci leave their bits alone,
+    // so there's no need to read them first
+    if (cmd_is_queued(pdata->cmd)) {
+        ahci_write(&port->regs->sact, 1u << slot);
+    }
+    ahci_write(&port->regs->ci, 1u << slot);
+}
+
+// Issues txns from the head of txn_list into every free command slot, so
+// the device has as many queued as it can take. Called with the port lock
+// held; empty reads and writes, which aren't sent to the device, are moved
+// to done for the caller to complete once it drops the lock.
+static bool ahci_port_submit(ahci_device_t* dev, ahci_port_t* port, list_node_t* done) {
+    bool issued = false;
+    iotxn_t* txn;
+    while (!(port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) &&
+           (txn = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL) {
+        sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+        if ((cmd_is_read(pdata->cmd) || cmd_is_write(pdata->cmd)) && pdata->count == 0) {
+            list_delete(&txn->node);
+            list_add_tail(done, &txn->node);
+            continue;
+        }
+
+        // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+        if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+            break;
+        }
+
+        // find a free command tag
+        if (port->slots == 0) {
+            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+            // without ncq, commands can't be queued to the device at all
+            if (!(dev->cap & AHCI_CAP_NCQ)) {
+                max = 0;
+            }
+            port->slots = (max >= 31) ? 0xffffffffu : ((1u << (max + 1)) - 1);
+        }
+        uint32_t free = port->slots & ~port->running;
+        if (free == 0) {
+            break;
+        }
+        int slot = __builtin_ctz(free);
+
+        list_delete(&txn->node);
+        // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+        if (txn->flags & IOTXN_SYNC_AFTER) {
+            port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+        }
+        ahci_do_txn(dev, port, slot, txn);
+        issued = true;
+    }
+    return issued;
+}
+
+// Fills the port's free slots and completes the txns that didn't need any.
+static void ahci_port_kick(ahci_device_t* dev, ahci_port_t* port) {
+    list_node_t done = LIST_INITIAL_VALUE(done);
+    mtx_lock(&port->lock);
+    bool issued = ahci_port_submit(dev, port, &done);
+    mtx_unlock(&port->lock);
+    if (issued) {
+        completion_signal(&dev->watchdog_completion);
+    }
+
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&done, iotxn_t, node)) != NULL) {
+        txn->ops->complete(txn, NO_ERROR, txn->length);
+    }
+}
+
+// Completes every running command the device is done with, then refills
+// the slots they free right away, from the interrupt thread.
+static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
+    iotxn_t* finished[AHCI_MAX_COMMANDS];
+    int count = 0;
+
+    mtx_lock(&port->lock);
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
+    uint32_t complete = port->running & ~active;
+    while (complete) {
+        int slot = __builtin_ctz(complete);
+        complete &= complete - 1;
+        // clear state before calling the complete() hook
+        finished[count++] = port->commands[slot];
+        port->commands[slot] = NULL;
+        port->running &= ~(1u << slot);
+    }
+    // resume the port if paused for sync and no outstanding transactions
+    if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+        port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+    }
+    mtx_unlock(&port->lock);
+
+    for (int i = 0; i < count; i++) {
+        finished[i]->ops->complete(finished[i], status, finished[i]->length);
+    }
+    ahci_port_kick(dev, port);
 }
 
 static mx_status_t ahci_port_initialize(ahci_port_t* port) {
@@ -441,70 +527,12 @@ void ahci_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     assert(pdata->port < AHCI_MAX_PORTS);
     assert(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT));
 
-    // put the cmd on the queue
+    // put the cmd on the queue, and start it now if there's a free slot
     mtx_lock(&port->lock);
     list_add_tail(&port->txn_list, &txn->node);
     mtx_unlock(&port->lock);
 
-    // hit the worker thread
-    completion_signal(&device->worker_completion);
-}
-
-// worker thread (for iotxn queue):
-
-static int ahci_worker_thread(void* arg) {
-    ahci_device_t* dev = (ahci_device_t*)arg;
-    ahci_port_t* port;
-    iotxn_t* txn;
-    for (;;) {
-        // iterate all the ports and run commands
-        for (int i = 0; i < AHCI_MAX_PORTS; i++) {
-            port = &dev->ports[i];
-            mtx_lock(&port->lock);
-            if (!(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT))) {
-                goto next;
-            }
-            if (port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) {
-                goto next;
-            }
-
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
-
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
-
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
-            }
-
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-            }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
-next:
-            mtx_unlock(&port->lock);
-        }
-        // wait here until more commands are queued, or a port becomes idle
-        completion_wait(&dev->worker_completion, MX_TIME_INFINITE);
-        completion_reset(&dev->worker_completion);
-    }
-    return 0;
+    ahci_port_kick(device, port);
 }
 
 static int ahci_watchdog_thread(void* arg) {
@@ -529,9 +557,9 @@ static int ahci_watchdog_thread(void* arg) {
                     if (pdata->timeout < now) {
                         // time out
                         printf("ahci: txn time out on port %d\n", port->nr);
-                        iotxn_t* txn = port->commands[i];
-                        port->running &= ~(1 << i);
-                        port->commands[i] = NULL;
+                        iotxn_t* txn = port->commands[j];
+                        port->running &= ~(1u << j);
+                        port->commands[j] = NULL;
                         mtx_unlock(&port->lock);
                         txn->ops->complete(txn, ERR_TIMED_OUT, 0);
                         mtx_lock(&port->lock);
@@ -556,15 +584,6 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     uint32_t is = ahci_read(&port->regs->is);
     ahci_write(&port->regs->is, is);
 
-    if (is & AHCI_PORT_INT_DHR) { // RFIS received
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_PS) { // PSFIS rcv
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
-    if (is & AHCI_PORT_INT_SDB) { // SDBFIS
-        ahci_port_complete_txn(dev, port, NO_ERROR);
-    }
     if (is & AHCI_PORT_INT_PRC) { // PhyRdy change
         uint32_t serr = ahci_read(&port->regs->serr);
         ahci_write(&port->regs->serr, serr & ~0x1);
@@ -572,12 +591,18 @@ static void ahci_port_irq(ahci_device_t* dev, int nr) {
     if (is & AHCI_PORT_INT_TFE) { // taskfile error
         xprintf("tfe error\n");
         ahci_port_complete_txn(dev, port, ERR_INTERNAL);
+    } else if (is & (AHCI_PORT_INT_DHR | AHCI_PORT_INT_PS | AHCI_PORT_INT_SDB)) {
+        // RFIS, PSFIS or SDBFIS received: one pass picks up every command
+        // the device finished, however many interrupts it coalesced
+        ahci_port_complete_txn(dev, port, NO_ERROR);
     }
 }
 
 static int ahci_irq_thread(void* arg) {
     ahci_device_t* dev = (ahci_device_t*)arg;
     mx_status_t status;
+    // the irq is delivered to cpu 0, so wake up there
+    mx_interrupt_set_affinity(dev->irq_handle, 0, MX_INTERRUPT_PRIORITY_HIGH);
     for (;;) {
         status = mx_interrupt_wait(dev->irq_handle);
         if (status) {
@@ -736,11 +761,15 @@ static mx_status_t ahci_bind(mx_driver_t* drv, mx_device_t* dev) {
         goto fail;
     }
 
-    // set msi irq mode
+    // use msi if the controller has it, else the legacy interrupt
     status = pci->set_irq_mode(dev, MX_PCIE_IRQ_MODE_MSI, 1);
     if (status < 0) {
-        xprintf("ahci: error %d setting irq mode\n", status);
-        goto fail;
+        status = pci->set_irq_mode(dev, MX_PCIE_IRQ_MODE_LEGACY, 1);
+        if (status < 0) {
+            xprintf("ahci: error %d setting irq mode\n", status);
+            goto fail;
+        }
+        xprintf("ahci: using legacy irq mode\n");
     }
 
     // get irq handle
@@ -762,14 +791,6 @@ static mx_status_t ahci_bind(mx_driver_t* drv, mx_device_t* dev) {
     device->watchdog_completion = COMPLETION_INIT;
     thrd_create_with_name(&device->watchdog_thread, ahci_watchdog_thread, device, "ahci-watchdog");
 
-    // start worker thread (for iotxn queue)
-    device->worker_completion = COMPLETION_INIT;
-    ret = thrd_create_with_name(&device->worker_thread, ahci_worker_thread, device, "ahci-worker");
-    if (ret != thrd_success) {
-        xprintf("ahci: error %d in worker thread create\n", ret);
-        goto fail;
-    }
-
     // add the device for the controller
     device_add(&device->device, dev);
 
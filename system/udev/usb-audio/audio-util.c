@@ -3,8 +3,10 @@
 // found in the LICENSE file.
 
 #include <ddk/common/usb.h>
+#include <magenta/syscalls.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "usb-audio.h"
 
@@ -72,3 +74,71 @@ mx_status_t usb_audio_set_volume(mx_device_t* device, uint8_t interface_number,
                 USB_AUDIO_SET_CUR, USB_AUDIO_VOLUME_CONTROL << 8 | interface_number,
                 fu_id << 8, &volume16, sizeof(volume16));
 }
+
+mx_status_t usb_audio_ring_init(usb_audio_ring_t* ring, uint32_t size, mx_handle_t* out_vmo) {
+    usb_audio_ring_free(ring);
+
+    mx_status_t status = mx_vmo_create(size, 0, &ring->vmo);
+    if (status < 0) {
+        return status;
+    }
+    uintptr_t ptr;
+    status = mx_process_map_vm(mx_process_self(), ring->vmo, 0, size, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    if (status < 0) {
+        goto fail;
+    }
+    ring->data = (uint8_t*)ptr;
+    ring->size = size;
+    ring->position = 0;
+
+    status = mx_handle_duplicate(ring->vmo, MX_RIGHT_SAME_RIGHTS, out_vmo);
+    if (status < 0) {
+        goto fail;
+    }
+    return NO_ERROR;
+
+fail:
+    usb_audio_ring_free(ring);
+    return status;
+}
+
+void usb_audio_ring_free(usb_audio_ring_t* ring) {
+    if (ring->data) {
+        mx_process_unmap_vm(mx_process_self(), (uintptr_t)ring->data, 0);
+    }
+    if (ring->vmo != MX_HANDLE_INVALID) {
+        mx_handle_close(ring->vmo);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+void usb_audio_ring_to_txn(usb_audio_ring_t* ring, iotxn_t* txn, size_t length) {
+    mx_off_t txn_offset = 0;
+    while (length > 0) {
+        uint32_t offset = ring->position % ring->size;
+        size_t count = ring->size - offset;
+        if (count > length) {
+            count = length;
+        }
+        txn->ops->copyto(txn, ring->data + offset, count, txn_offset);
+        txn_offset += count;
+        ring->position += count;
+        length -= count;
+    }
+}
+
+void usb_audio_ring_put(usb_audio_ring_t* ring, const void* data, size_t length) {
+    const uint8_t* src = data;
+    while (length > 0) {
+        uint32_t offset = ring->position % ring->size;
+        size_t count = ring->size - offset;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(ring->data + offset, src, count);
+        src += count;
+        ring->position += count;
+        length -= count;
+    }
+}
@@ -21,6 +21,10 @@
 // if no writes occur for 100ms
 #define WRITE_TIMEOUT_MS 100
 
+// USB frames queued ahead when streaming from a ring buffer,
+// unless the client asks for other
+#define RING_DEFAULT_DEPTH 8
+
 typedef struct {
     mx_device_t device;
     mx_device_t* usb_device;
@@ -49,10 +53,19 @@ typedef struct {
     int num_channels;
     int audio_frame_size; // size of an audio frame
 
+    int packet_size;
+
     // partially filled iotxn with data left over from last write() call
     // cur_txn->length marks size of left over data
     iotxn_t* cur_txn;
 
+    // ring buffer we stream from in place of write(), if the client set one
+    usb_audio_ring_t ring;
+    // number of iotxns kept queued from the ring
+    uint32_t ring_depth;
+    // failed iotxns in a row, to stop requeueing them if the endpoint is broken
+    uint32_t ring_errors;
+
     // USB frame we started playing at
     uint64_t start_usb_frame;
     // last USB frame we scheduled a packet for
@@ -79,6 +92,23 @@ static void update_signals(usb_audio_sink_t* sink) {
     }
 }
 
+static uint64_t get_usb_current_frame(usb_audio_sink_t* sink);
+
+// fills txn with the audio for the USB frame after the last one scheduled,
+// from the ring buffer.  call with sink->mutex held
+static void usb_audio_sink_ring_fill(usb_audio_sink_t* sink, iotxn_t* txn) {
+    uint64_t usb_frame = sink->last_usb_frame + 1;
+    uint64_t total_audio_frames = ((usb_frame - sink->start_usb_frame) *
+                                   sink->sample_rate) / 1000;
+    size_t length = (total_audio_frames - sink->audio_frame_count) * sink->audio_frame_size;
+
+    usb_audio_ring_to_txn(&sink->ring, txn, length);
+    txn->length = length;
+    usb_iotxn_set_frame(txn, usb_frame);
+    sink->last_usb_frame = usb_frame;
+    sink->audio_frame_count = total_audio_frames;
+}
+
 static void usb_audio_sink_write_complete(iotxn_t* txn, void* cookie) {
     if (txn->status == ERR_REMOTE_CLOSED) {
         txn->ops->release(txn);
@@ -86,8 +116,32 @@ static void usb_audio_sink_write_complete(iotxn_t* txn, void* cookie) {
     }
 
     usb_audio_sink_t* sink = (usb_audio_sink_t*)cookie;
-    // FIXME what to do with error here?
     mtx_lock(&sink->mutex);
+    if (sink->started && sink->ring.data) {
+        bool requeue = true;
+        if (txn->status == NO_ERROR) {
+            sink->ring_errors = 0;
+        } else if (++sink->ring_errors > WRITE_REQ_COUNT) {
+            requeue = false;
+        } else {
+            // we most likely missed our frame, so the ones after it are late too.
+            // move the schedule past the current frame, leaving a gap in the
+            // sound rather than a jump in the ring position
+            uint64_t current_frame = get_usb_current_frame(sink);
+            if (current_frame >= sink->last_usb_frame) {
+                uint64_t skip = current_frame + 1 - sink->last_usb_frame;
+                sink->start_usb_frame += skip;
+                sink->last_usb_frame += skip;
+            }
+        }
+        if (requeue) {
+            usb_audio_sink_ring_fill(sink, txn);
+            mtx_unlock(&sink->mutex);
+            iotxn_queue(sink->usb_device, txn);
+            return;
+        }
+    }
+    // FIXME what to do with error here?
     list_add_tail(&sink->free_write_reqs, &txn->node);
     completion_signal(&sink->free_write_completion);
     update_signals(sink);
@@ -109,6 +163,7 @@ static mx_status_t usb_audio_sink_release(mx_device_t* device) {
     while ((txn = list_remove_head_type(&sink->free_write_reqs, iotxn_t, node)) != NULL) {
         txn->ops->release(txn);
     }
+    usb_audio_ring_free(&sink->ring);
     free(sink->sample_rates);
     free(sink);
     return NO_ERROR;
@@ -144,6 +199,36 @@ static mx_status_t usb_audio_sink_start(usb_audio_sink_t* sink) {
     sink->start_usb_frame = 0;
     sink->cur_txn = NULL;
 
+    list_node_t queue = LIST_INITIAL_VALUE(queue);
+    mtx_lock(&sink->mutex);
+    sink->started = true;
+    if (sink->ring.data) {
+        // schedule from the frame after next, and keep ring_depth frames queued from then on
+        sink->start_usb_frame = get_usb_current_frame(sink) + 1;
+        sink->last_usb_frame = sink->start_usb_frame;
+        sink->audio_frame_count = 0;
+        sink->ring.position = 0;
+        sink->ring_errors = 0;
+        iotxn_t* txn;
+        for (uint32_t i = 0; i < sink->ring_depth; i++) {
+            if ((txn = list_remove_head_type(&sink->free_write_reqs, iotxn_t, node)) == NULL) {
+                break;
+            }
+            usb_audio_sink_ring_fill(sink, txn);
+            list_add_tail(&queue, &txn->node);
+        }
+        if (list_is_empty(&sink->free_write_reqs)) {
+            completion_reset(&sink->free_write_completion);
+        }
+        update_signals(sink);
+    }
+    mtx_unlock(&sink->mutex);
+
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&queue, iotxn_t, node)) != NULL) {
+        iotxn_queue(sink->usb_device, txn);
+    }
+
 out:
     mtx_unlock(&sink->start_stop_mutex);
     return status;
@@ -161,6 +246,11 @@ static mx_status_t usb_audio_sink_stop(usb_audio_sink_t* sink) {
         goto out;
     }
 
+    // iotxns still queued from the ring go back to the free list as they complete
+    mtx_lock(&sink->mutex);
+    sink->started = false;
+    mtx_unlock(&sink->mutex);
+
     // switch back to primary interface
     if (sink->alternate_setting != 0) {
         usb_set_interface(sink->usb_device, sink->interface_number, 0);
@@ -190,10 +280,11 @@ static mx_status_t usb_audio_sink_open(mx_device_t* dev, mx_device_t** dev_out,
 static mx_status_t usb_audio_sink_close(mx_device_t* dev, uint32_t flags) {
     usb_audio_sink_t* sink = get_usb_audio_sink(dev);
 
+    usb_audio_sink_stop(sink);
     mtx_lock(&sink->mutex);
     sink->open = false;
+    usb_audio_ring_free(&sink->ring);
     mtx_unlock(&sink->mutex);
-    usb_audio_sink_stop(sink);
 
     return NO_ERROR;
 }
@@ -204,6 +295,9 @@ static ssize_t usb_audio_sink_write(mx_device_t* dev, const void* data, size_t l
     if (sink->dead) {
         return ERR_REMOTE_CLOSED;
     }
+    if (sink->ring.data) {
+        return ERR_BAD_STATE;
+    }
 
     mx_status_t status = length;
 
@@ -278,6 +372,33 @@ out:
     return status;
 }
 
+static ssize_t usb_audio_sink_set_ring_buffer(usb_audio_sink_t* sink,
+                                              const audio_ring_config_t* config,
+                                              mx_handle_t* out_vmo) {
+    uint32_t depth = config->depth ? config->depth : RING_DEFAULT_DEPTH;
+    if (depth > WRITE_REQ_COUNT) {
+        depth = WRITE_REQ_COUNT;
+    }
+    // the ring must hold more than what is queued from it at once
+    if ((config->size % sink->audio_frame_size) != 0 ||
+        config->size <= depth * sink->packet_size) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status;
+    mtx_lock(&sink->start_stop_mutex);
+    if (sink->started) {
+        status = ERR_BAD_STATE;
+    } else {
+        mtx_lock(&sink->mutex);
+        status = usb_audio_ring_init(&sink->ring, config->size, out_vmo);
+        sink->ring_depth = depth;
+        mtx_unlock(&sink->mutex);
+    }
+    mtx_unlock(&sink->start_stop_mutex);
+    return (status == NO_ERROR) ? (ssize_t)sizeof(*out_vmo) : status;
+}
+
 static ssize_t usb_audio_sink_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf,
                                     size_t in_len, void* out_buf, size_t out_len) {
     usb_audio_sink_t* sink = get_usb_audio_sink(dev);
@@ -331,6 +452,22 @@ static ssize_t usb_audio_sink_ioctl(mx_device_t* dev, uint32_t op, const void* i
         return usb_audio_sink_start(sink);
     case IOCTL_AUDIO_STOP:
         return usb_audio_sink_stop(sink);
+    case IOCTL_AUDIO_SET_RING_BUFFER: {
+        if (in_len < sizeof(audio_ring_config_t)) return ERR_INVALID_ARGS;
+        if (out_len < sizeof(mx_handle_t)) return ERR_BUFFER_TOO_SMALL;
+        return usb_audio_sink_set_ring_buffer(sink, in_buf, out_buf);
+    }
+    case IOCTL_AUDIO_GET_RING_POSITION: {
+        audio_ring_position_t* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        mtx_lock(&sink->mutex);
+        bool streaming = (sink->ring.data != NULL);
+        reply->position = sink->ring.position;
+        mtx_unlock(&sink->mutex);
+        if (!streaming) return ERR_BAD_STATE;
+        reply->usb_frame = get_usb_current_frame(sink);
+        return sizeof(*reply);
+    }
     }
 
     return ERR_NOT_SUPPORTED;
@@ -377,6 +514,7 @@ mx_status_t usb_audio_sink_create(mx_driver_t* driver, mx_device_t* device, int
     sink->interface_number = intf->bInterfaceNumber;
     sink->alternate_setting = intf->bAlternateSetting;
     int packet_size = usb_ep_max_packet(ep);
+    sink->packet_size = packet_size;
 
     for (int i = 0; i < WRITE_REQ_COUNT; i++) {
         iotxn_t* txn = usb_alloc_iotxn(sink->ep_addr, packet_size, 0);
@@ -5,6 +5,7 @@
 #include <ddk/device.h>
 #include <ddk/common/usb.h>
 #include <magenta/device/audio.h>
+#include <magenta/device/usb.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -14,6 +15,10 @@
 
 #define READ_REQ_COUNT 20
 
+// reads kept queued when streaming into a ring buffer,
+// unless the client asks for other
+#define RING_DEFAULT_DEPTH 8
+
 typedef struct {
     mx_device_t device;
     mx_device_t* usb_device;
@@ -41,6 +46,16 @@ typedef struct {
     // current sample rate
     uint32_t sample_rate;
     int channels;
+    int packet_size;
+
+    // ring buffer we stream into in place of read(), if the client set one
+    usb_audio_ring_t ring;
+    // number of reads kept queued into the ring
+    uint32_t ring_depth;
+    // failed reads in a row, to stop requeueing them if the endpoint is broken
+    uint32_t ring_errors;
+    // a packet, expanded to stereo on its way to the ring
+    void* ring_packet;
 
     // the last signals we reported
     mx_signals_t signals;
@@ -60,6 +75,19 @@ static void update_signals(usb_audio_source_t* source) {
     }
 }
 
+// expands length bytes of mono samples in data to twice that in stereo
+static void expand_mono(void* data, size_t length) {
+    // work backwards through the buffer
+    uint16_t* start = (uint16_t *)data;
+    uint16_t* src = (uint16_t *)(data + length - sizeof(uint16_t));
+    uint16_t* dest = (uint16_t *)(data + 2 * length - sizeof(uint16_t));
+    while (src >= start) {
+        uint16_t sample = *src--;
+        *dest-- = sample;
+        *dest-- = sample;
+    }
+}
+
 static void usb_audio_source_read_complete(iotxn_t* txn, void* cookie) {
     usb_audio_source_t* source = (usb_audio_source_t*)cookie;
 
@@ -69,7 +97,30 @@ static void usb_audio_source_read_complete(iotxn_t* txn, void* cookie) {
     }
 
     mtx_lock(&source->mutex);
-    if (!source->open) {
+    if (source->ring.data) {
+        if (source->started) {
+            if (txn->status == NO_ERROR) {
+                source->ring_errors = 0;
+                if (txn->actual > 0) {
+                    txn->ops->copyfrom(txn, source->ring_packet, txn->actual, 0);
+                    size_t length = txn->actual;
+                    if (source->channels == 1) {
+                        expand_mono(source->ring_packet, length);
+                        length *= 2;
+                    }
+                    usb_audio_ring_put(&source->ring, source->ring_packet, length);
+                }
+            } else {
+                source->ring_errors++;
+            }
+            if (source->ring_errors <= READ_REQ_COUNT) {
+                mtx_unlock(&source->mutex);
+                iotxn_queue(source->usb_device, txn);
+                return;
+            }
+        }
+        list_add_tail(&source->free_read_reqs, &txn->node);
+    } else if (!source->open) {
         list_add_tail(&source->free_read_reqs, &txn->node);
     } else if (txn->status == NO_ERROR && txn->actual > 0) {
         list_add_tail(&source->completed_reads, &txn->node);
@@ -106,6 +157,8 @@ static mx_status_t usb_audio_source_release(mx_device_t* device) {
     while ((txn = list_remove_head_type(&source->completed_reads, iotxn_t, node)) != NULL) {
         txn->ops->release(txn);
     }
+    usb_audio_ring_free(&source->ring);
+    free(source->ring_packet);
     free(source->sample_rates);
     free(source);
     return NO_ERROR;
@@ -128,6 +181,28 @@ static mx_status_t usb_audio_source_start(usb_audio_source_t* source) {
         usb_set_interface(source->usb_device, source->interface_number, source->alternate_setting);
     }
 
+    if (source->ring.data) {
+        // queue ring_depth reads, which are requeued as they complete until we stop
+        list_node_t queue = LIST_INITIAL_VALUE(queue);
+        mtx_lock(&source->mutex);
+        source->started = true;
+        source->ring.position = 0;
+        source->ring_errors = 0;
+        iotxn_t* txn;
+        for (uint32_t i = 0; i < source->ring_depth; i++) {
+            if ((txn = list_remove_head_type(&source->free_read_reqs, iotxn_t, node)) == NULL) {
+                break;
+            }
+            list_add_tail(&queue, &txn->node);
+        }
+        mtx_unlock(&source->mutex);
+        while ((txn = list_remove_head_type(&queue, iotxn_t, node)) != NULL) {
+            iotxn_queue(source->usb_device, txn);
+        }
+        goto out;
+    }
+    source->started = true;
+
     // queue up reads, including stale completed reads
     iotxn_t* txn;
     while ((txn = list_remove_head_type(&source->completed_reads, iotxn_t, node)) != NULL) {
@@ -155,6 +230,11 @@ static mx_status_t usb_audio_source_stop(usb_audio_source_t* source) {
         goto out;
     }
 
+    // reads still queued into the ring go back to the free list as they complete
+    mtx_lock(&source->mutex);
+    source->started = false;
+    mtx_unlock(&source->mutex);
+
     // switch back to primary interface
     if (source->alternate_setting != 0) {
         usb_set_interface(source->usb_device, source->interface_number, 0);
@@ -184,10 +264,11 @@ static mx_status_t usb_audio_source_open(mx_device_t* dev, mx_device_t** dev_out
 static mx_status_t usb_audio_source_close(mx_device_t* dev, uint32_t flags) {
     usb_audio_source_t* source = get_usb_audio_source(dev);
 
+    usb_audio_source_stop(source);
     mtx_lock(&source->mutex);
     source->open = false;
+    usb_audio_ring_free(&source->ring);
     mtx_unlock(&source->mutex);
-    usb_audio_source_stop(source);
 
     return NO_ERROR;
 }
@@ -198,6 +279,9 @@ static ssize_t usb_audio_source_read(mx_device_t* dev, void* data, size_t length
     if (source->dead) {
         return ERR_REMOTE_CLOSED;
     }
+    if (source->ring.data) {
+        return ERR_BAD_STATE;
+    }
 
     mx_status_t status = 0;
 
@@ -220,15 +304,7 @@ static ssize_t usb_audio_source_read(mx_device_t* dev, void* data, size_t length
 
     txn->ops->copyfrom(txn, data, txn->actual, 0);
     if (source->channels == 1) {
-        // expand mono to stereo working backwards through the buffer
-        uint16_t* start = (uint16_t *)data;
-        uint16_t* src = (uint16_t *)(data + txn->actual - sizeof(uint16_t));
-        uint16_t* dest = (uint16_t *)(data + 2 * txn->actual - sizeof(uint16_t));
-        while (src >= start) {
-            uint16_t sample = *src--;
-            *dest-- = sample;
-            *dest-- = sample;
-        }
+        expand_mono(data, txn->actual);
         status = 2 * txn->actual;
     } else {
         status = txn->actual;
@@ -247,6 +323,44 @@ out:
     return status;
 }
 
+static ssize_t usb_audio_source_set_ring_buffer(usb_audio_source_t* source,
+                                                const audio_ring_config_t* config,
+                                                mx_handle_t* out_vmo) {
+    uint32_t depth = config->depth ? config->depth : RING_DEFAULT_DEPTH;
+    if (depth > READ_REQ_COUNT) {
+        depth = READ_REQ_COUNT;
+    }
+    // the ring must hold more than the reads queued into it can bring at once,
+    // in stereo 16 bit frames
+    if ((config->size % (2 * sizeof(uint16_t))) != 0 ||
+        config->size <= depth * 2 * source->packet_size) {
+        return ERR_INVALID_ARGS;
+    }
+
+    mx_status_t status = NO_ERROR;
+    mtx_lock(&source->start_stop_mutex);
+    if (source->started) {
+        status = ERR_BAD_STATE;
+    } else if (!source->ring_packet &&
+               (source->ring_packet = malloc(2 * source->packet_size)) == NULL) {
+        status = ERR_NO_MEMORY;
+    } else {
+        mtx_lock(&source->mutex);
+        status = usb_audio_ring_init(&source->ring, config->size, out_vmo);
+        source->ring_depth = depth;
+        // reads completed before we were streaming are stale
+        iotxn_t* txn;
+        while ((txn = list_remove_head_type(&source->completed_reads, iotxn_t, node)) != NULL) {
+            list_add_tail(&source->free_read_reqs, &txn->node);
+        }
+        source->completed_read_count = 0;
+        update_signals(source);
+        mtx_unlock(&source->mutex);
+    }
+    mtx_unlock(&source->start_stop_mutex);
+    return (status == NO_ERROR) ? (ssize_t)sizeof(*out_vmo) : status;
+}
+
 static ssize_t usb_audio_source_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf,
                                     size_t in_len, void* out_buf, size_t out_len) {
     usb_audio_source_t* source = get_usb_audio_source(dev);
@@ -301,6 +415,26 @@ static ssize_t usb_audio_source_ioctl(mx_device_t* dev, uint32_t op, const void*
         return usb_audio_source_start(source);
     case IOCTL_AUDIO_STOP:
         return usb_audio_source_stop(source);
+    case IOCTL_AUDIO_SET_RING_BUFFER: {
+        if (in_len < sizeof(audio_ring_config_t)) return ERR_INVALID_ARGS;
+        if (out_len < sizeof(mx_handle_t)) return ERR_BUFFER_TOO_SMALL;
+        return usb_audio_source_set_ring_buffer(source, in_buf, out_buf);
+    }
+    case IOCTL_AUDIO_GET_RING_POSITION: {
+        audio_ring_position_t* reply = out_buf;
+        if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
+        mtx_lock(&source->mutex);
+        bool streaming = (source->ring.data != NULL);
+        reply->position = source->ring.position;
+        mtx_unlock(&source->mutex);
+        if (!streaming) return ERR_BAD_STATE;
+        uint64_t usb_frame;
+        ssize_t rc = source->usb_device->ops->ioctl(source->usb_device,
+                                                    IOCTL_USB_GET_CURRENT_FRAME, NULL, 0,
+                                                    &usb_frame, sizeof(usb_frame));
+        reply->usb_frame = (rc == sizeof(usb_frame)) ? usb_frame : 0;
+        return sizeof(*reply);
+    }
     }
 
     return ERR_NOT_SUPPORTED;
@@ -350,6 +484,7 @@ mx_status_t usb_audio_source_create(mx_driver_t* driver, mx_device_t* device, in
     source->alternate_setting = intf->bAlternateSetting;
 
     int packet_size = usb_ep_max_packet(ep);
+    source->packet_size = packet_size;
 
     for (int i = 0; i < READ_REQ_COUNT; i++) {
         iotxn_t* txn = usb_alloc_iotxn(source->ep_addr, packet_size, 0);
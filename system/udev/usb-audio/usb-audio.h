@@ -5,6 +5,7 @@
 #pragma once
 
 #include <ddk/device.h>
+#include <ddk/iotxn.h>
 #include <magenta/hw/usb.h>
 #include <magenta/hw/usb-audio.h>
 
@@ -34,3 +35,22 @@ mx_status_t usb_audio_set_sample_rate(mx_device_t* usb_device, uint8_t ep_addr,
 
 // volume is in 0 - 100 range
 mx_status_t usb_audio_set_volume(mx_device_t* device, uint8_t interface_number, int fu_id, int volume);
+
+// a ring buffer shared with the client through a vmo, for streaming
+typedef struct {
+    mx_handle_t vmo;
+    uint8_t* data;
+    uint32_t size;
+    // bytes taken from or put in the ring since the stream started
+    uint64_t position;
+} usb_audio_ring_t;
+
+// creates and maps the ring, replacing any ring it had,
+// and returns a duplicate of its vmo handle for the client
+mx_status_t usb_audio_ring_init(usb_audio_ring_t* ring, uint32_t size, mx_handle_t* out_vmo);
+void usb_audio_ring_free(usb_audio_ring_t* ring);
+
+// copies length bytes at the ring position into txn, and advances it
+void usb_audio_ring_to_txn(usb_audio_ring_t* ring, iotxn_t* txn, size_t length);
+// copies length bytes into the ring at its position, and advances it
+void usb_audio_ring_put(usb_audio_ring_t* ring, const void* data, size_t length);
@@ -19,6 +19,7 @@
 #include <unistd.h>
 
 #include "asix-88179.h"
+#include "usb-eth.h"
 
 #define AX88179_DEBUG 0
 #define AX88179_DEBUG_VERBOSE 0
@@ -33,8 +34,10 @@
 #define ALIGN(a, b) ROUNDUP(a, b)
 
 #define READ_REQ_COUNT 8
-#define WRITE_REQ_COUNT 4
+#define WRITE_REQ_COUNT 8
+#define WRITE_MAX_FRAMES 16
 #define USB_BUF_SIZE 24576
+#define MAX_FRAME_SIZE 1514
 #define INTR_REQ_SIZE 8
 #define RX_HEADER_SIZE 4
 
@@ -52,9 +55,10 @@ typedef struct {
     iotxn_t* interrupt_req;
     completion_t completion;
 
-    // pool of free USB bulk requests
+    // pool of free USB bulk requests, and the bulk OUT requests, which
+    // gather frames
     list_node_t free_read_reqs;
-    list_node_t free_write_reqs;
+    usb_eth_tx_t tx;
 
     // list of received packets not yet read by upper layer
     list_node_t completed_reads;
@@ -77,10 +81,14 @@ typedef struct {
 
 typedef struct {
     uint16_t tx_len;
-    uint16_t unused[3];
+    uint16_t unused;
+    uint32_t tx_hdr2;
     // TODO: support additional tx header fields
 } ax88179_tx_hdr_t;
 
+// in tx_hdr2, for a transfer that ends on a packet boundary
+#define AX88179_TX_PADDING 0x80008000
+
 static void update_signals_locked(ax88179_t* eth) {
     mx_signals_t new_signals = 0;
 
@@ -88,7 +96,7 @@ static void update_signals_locked(ax88179_t* eth) {
         new_signals |= (DEV_STATE_READABLE | DEV_STATE_ERROR);
     if (!list_is_empty(&eth->completed_reads))
         new_signals |= DEV_STATE_READABLE;
-    if (!list_is_empty(&eth->free_write_reqs) && eth->online)
+    if (usb_eth_tx_writable(&eth->tx) && eth->online)
         new_signals |= DEV_STATE_WRITABLE;
     if (new_signals != eth->signals) {
         device_state_set_clr(eth->device, new_signals & ~eth->signals, eth->signals & ~new_signals);
@@ -257,11 +265,24 @@ static void ax88179_write_complete(iotxn_t* request, void* cookie) {
     }
 
     mtx_lock(&eth->mutex);
-    list_add_tail(&eth->free_write_reqs, &request->node);
+    usb_eth_tx_complete(&eth->tx, request);
     update_signals_locked(eth);
     mtx_unlock(&eth->mutex);
 }
 
+// a transfer that's a whole number of packets has padding turned on in
+// its last frame's header
+static size_t ax88179_tx_finish(iotxn_t* request, size_t last, void* cookie) {
+    size_t max_packet = (size_t)(uintptr_t)cookie;
+    if ((request->length % max_packet) == 0) {
+        ax88179_tx_hdr_t txhdr;
+        request->ops->copyfrom(request, &txhdr, sizeof(txhdr), last);
+        txhdr.tx_hdr2 |= htole32(AX88179_TX_PADDING);
+        request->ops->copyto(request, &txhdr, sizeof(txhdr), last);
+    }
+    return request->length;
+}
+
 static void ax88179_interrupt_complete(iotxn_t* request, void* cookie) {
     if (request->status == ERR_REMOTE_CLOSED) {
         // request will be released in ax88179_release()
@@ -319,27 +340,25 @@ mx_status_t ax88179_send(mx_device_t* device, const void* buffer, size_t length)
 
     mx_status_t status = NO_ERROR;
 
+    if (length > MAX_FRAME_SIZE) {
+        return ERR_INVALID_ARGS;
+    }
+
     mtx_lock(&eth->mutex);
 
-    list_node_t* node = list_remove_head(&eth->free_write_reqs);
-    if (!node) {
+    size_t offset;
+    iotxn_t* request = usb_eth_tx_reserve(&eth->tx, sizeof(ax88179_tx_hdr_t) + length, &offset);
+    if (!request) {
         status = ERR_BUFFER_TOO_SMALL;
         goto out;
     }
-    iotxn_t* request = containerof(node, iotxn_t, node);
-
-    if (length + sizeof(ax88179_tx_hdr_t) > 1500) {
-        status = ERR_INVALID_ARGS;
-        goto out;
-    }
 
     ax88179_tx_hdr_t txhdr;
     memset(&txhdr, 0, sizeof(txhdr));
     txhdr.tx_len = htole16(length);
-    request->ops->copyto(request, &txhdr, sizeof(txhdr), 0);
-    request->ops->copyto(request, buffer, length, sizeof(txhdr));
-    request->length = length + sizeof(txhdr);
-    iotxn_queue(eth->usb_device, request);
+    request->ops->copyto(request, &txhdr, sizeof(txhdr), offset);
+    request->ops->copyto(request, buffer, length, offset + sizeof(txhdr));
+    usb_eth_tx_commit(&eth->tx, offset, sizeof(txhdr) + length);
 
 out:
     update_signals_locked(eth);
@@ -459,14 +478,11 @@ static void ax88179_unbind(mx_device_t* device) {
 }
 
 static void ax88179_free(ax88179_t* eth) {
-    iotxn_t* txn;
-    while ((txn = list_remove_head_type(&eth->free_read_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&eth->free_write_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
+    usb_eth_free_reqs(&eth->free_read_reqs);
+    usb_eth_tx_release(&eth->tx);
+    if (eth->interrupt_req) {
+        eth->interrupt_req->ops->release(eth->interrupt_req);
     }
-    eth->interrupt_req->ops->release(eth->interrupt_req);
 
     free(eth->device);
     free(eth);
@@ -697,12 +713,14 @@ static mx_status_t ax88179_bind(mx_driver_t* driver, mx_device_t* device) {
     uint8_t bulk_in_addr = 0;
     uint8_t bulk_out_addr = 0;
     uint8_t intr_addr = 0;
+    size_t bulk_out_max_packet = 0;
 
    usb_endpoint_descriptor_t* endp = usb_desc_iter_next_endpoint(&iter);
     while (endp) {
         if (usb_ep_direction(endp) == USB_ENDPOINT_OUT) {
             if (usb_ep_type(endp) == USB_ENDPOINT_BULK) {
                 bulk_out_addr = endp->bEndpointAddress;
+                bulk_out_max_packet = usb_ep_max_packet(endp);
             }
         } else {
             if (usb_ep_type(endp) == USB_ENDPOINT_BULK) {
@@ -715,7 +733,7 @@ static mx_status_t ax88179_bind(mx_driver_t* driver, mx_device_t* device) {
     }
     usb_desc_iter_release(&iter);
 
-    if (!bulk_in_addr || !bulk_out_addr || !intr_addr) {
+    if (!bulk_in_addr || !bulk_out_addr || !intr_addr || !bulk_out_max_packet) {
         printf("ax88179_bind could not find endpoints\n");
         return ERR_NOT_SUPPORTED;
     }
@@ -727,34 +745,32 @@ static mx_status_t ax88179_bind(mx_driver_t* driver, mx_device_t* device) {
     }
 
     list_initialize(&eth->free_read_reqs);
-    list_initialize(&eth->free_write_reqs);
     list_initialize(&eth->completed_reads);
 
     eth->usb_device = device;
     eth->driver = driver;
 
-    mx_status_t status = NO_ERROR;
-    for (int i = 0; i < READ_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_in_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = ax88179_read_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_read_reqs, &req->node);
-    }
-    for (int i = 0; i < WRITE_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_out_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = ax88179_write_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_write_reqs, &req->node);
+    usb_eth_config_t config = {
+        .rx_reqs = READ_REQ_COUNT,
+        .tx_reqs = WRITE_REQ_COUNT,
+        .tx_frames = WRITE_MAX_FRAMES,
+    };
+    usb_eth_get_config(&config);
+
+    eth->tx.req_size = USB_BUF_SIZE;
+    eth->tx.max_frames = config.tx_frames;
+    eth->tx.finish = ax88179_tx_finish;
+    eth->tx.cookie = (void*)(uintptr_t)bulk_out_max_packet;
+    usb_eth_tx_init(&eth->tx, device);
+
+    mx_status_t status = usb_eth_alloc_reqs(&eth->free_read_reqs, config.rx_reqs, bulk_in_addr,
+                                            USB_BUF_SIZE, ax88179_read_complete, eth);
+    if (status == NO_ERROR) {
+        status = usb_eth_alloc_reqs(&eth->tx.free_reqs, config.tx_reqs, bulk_out_addr,
+                                    USB_BUF_SIZE, ax88179_write_complete, eth);
+    }
+    if (status != NO_ERROR) {
+        goto fail;
     }
     iotxn_t* int_req = usb_alloc_iotxn(intr_addr, INTR_REQ_SIZE, 0);
     if (!int_req) {
@@ -17,11 +17,14 @@
 #include <unistd.h>
 
 #include "asix-88772b.h"
+#include "usb-eth.h"
 
 #define READ_REQ_COUNT 8
-#define WRITE_REQ_COUNT 4
+#define WRITE_REQ_COUNT 8
+#define WRITE_MAX_FRAMES 16
 #define INTR_REQ_COUNT 4
 #define USB_BUF_SIZE 2048
+#define WRITE_BUF_SIZE 16384
 #define INTR_REQ_SIZE 8
 #define ETH_HEADER_SIZE 4
 
@@ -36,10 +39,11 @@ typedef struct {
     bool online;
     bool dead;
 
-    // pool of free USB requests
+    // pool of free USB requests, and the bulk OUT requests, which gather
+    // frames
     list_node_t free_read_reqs;
-    list_node_t free_write_reqs;
     list_node_t free_intr_reqs;
+    usb_eth_tx_t tx;
 
     // list of received packets not yet read by upper layer
     list_node_t completed_reads;
@@ -60,7 +64,7 @@ static void update_signals_locked(ax88772b_t* eth) {
         new_signals |= (DEV_STATE_READABLE | DEV_STATE_ERROR);
     if (!list_is_empty(&eth->completed_reads))
         new_signals |= DEV_STATE_READABLE;
-    if (!list_is_empty(&eth->free_write_reqs) && eth->online)
+    if (usb_eth_tx_writable(&eth->tx) && eth->online)
         new_signals |= DEV_STATE_WRITABLE;
     if (new_signals != eth->signals) {
         device_state_set_clr(eth->device, new_signals & ~eth->signals, eth->signals & ~new_signals);
@@ -178,11 +182,24 @@ static void ax88772b_write_complete(iotxn_t* request, void* cookie) {
     }
 
     mtx_lock(&eth->mutex);
-    list_add_tail(&eth->free_write_reqs, &request->node);
+    usb_eth_tx_complete(&eth->tx, request);
     update_signals_locked(eth);
     mtx_unlock(&eth->mutex);
 }
 
+// a transfer that's a whole number of packets gets a header for an empty
+// frame on the end, so the device doesn't wait for more
+static size_t ax88772b_tx_finish(iotxn_t* request, size_t last, void* cookie) {
+    size_t max_packet = (size_t)(uintptr_t)cookie;
+    size_t length = request->length;
+    if ((length % max_packet) == 0) {
+        static const uint8_t pad[ETH_HEADER_SIZE] = { 0x00, 0x00, 0xff, 0xff };
+        request->ops->copyto(request, pad, sizeof(pad), length);
+        length += sizeof(pad);
+    }
+    return length;
+}
+
 static void ax88772b_interrupt_complete(iotxn_t* request, void* cookie) {
     ax88772b_t* eth = (ax88772b_t*)cookie;
 
@@ -235,19 +252,18 @@ mx_status_t ax88772b_send(mx_device_t* device, const void* buffer, size_t length
 
     mx_status_t status = NO_ERROR;
 
+    if (length + ETH_HEADER_SIZE > USB_BUF_SIZE) {
+        return ERR_INVALID_ARGS;
+    }
+
     mtx_lock(&eth->mutex);
 
-    list_node_t* node = list_remove_head(&eth->free_write_reqs);
-    if (!node) {
+    size_t offset;
+    iotxn_t* request = usb_eth_tx_reserve(&eth->tx, ETH_HEADER_SIZE + length, &offset);
+    if (!request) {
         status = ERR_BUFFER_TOO_SMALL;
         goto out;
     }
-    iotxn_t* request = containerof(node, iotxn_t, node);
-
-    if (length + ETH_HEADER_SIZE > USB_BUF_SIZE) {
-        status = ERR_INVALID_ARGS;
-        goto out;
-    }
 
     // write 4 byte packet header
     uint8_t header[ETH_HEADER_SIZE];
@@ -258,10 +274,9 @@ mx_status_t ax88772b_send(mx_device_t* device, const void* buffer, size_t length
     header[2] = lo ^ 0xFF;
     header[3] = hi ^ 0xFF;
 
-    request->ops->copyto(request, header, ETH_HEADER_SIZE, 0);
-    request->ops->copyto(request, buffer, length, ETH_HEADER_SIZE);
-    request->length = length + ETH_HEADER_SIZE;
-    iotxn_queue(eth->usb_device, request);
+    request->ops->copyto(request, header, ETH_HEADER_SIZE, offset);
+    request->ops->copyto(request, buffer, length, offset + ETH_HEADER_SIZE);
+    usb_eth_tx_commit(&eth->tx, offset, ETH_HEADER_SIZE + length);
 
 out:
     update_signals_locked(eth);
@@ -291,17 +306,18 @@ mx_status_t ax88772b_recv(mx_device_t* device, void* buffer, size_t length) {
     if (remaining < 4) {
         printf("ax88772b_recv short packet\n");
         status = ERR_INTERNAL;
+        offset = 0;
         list_remove_head(&eth->completed_reads);
         requeue_read_request_locked(eth, request);
         goto out;
     }
 
     uint8_t header[ETH_HEADER_SIZE];
-    request->ops->copyfrom(request, header, ETH_HEADER_SIZE, 0);
+    request->ops->copyfrom(request, header, ETH_HEADER_SIZE, offset);
     uint16_t length1 = (header[0] | (uint16_t)header[1] << 8) & 0x7FF;
     uint16_t length2 = (~(header[2] | (uint16_t)header[3] << 8)) & 0x7FF;
 
-    if (length1 != length2) {
+    if ((length1 != length2) || (length1 > remaining - ETH_HEADER_SIZE)) {
         printf("invalid header: length1: %d length2: %d offset %zu\n", length1, length2, offset);
         status = ERR_INTERNAL;
         offset = 0;
@@ -313,7 +329,7 @@ mx_status_t ax88772b_recv(mx_device_t* device, void* buffer, size_t length) {
         status = ERR_BUFFER_TOO_SMALL;
         goto out;
     }
-    request->ops->copyfrom(request, buffer, length1, ETH_HEADER_SIZE);
+    request->ops->copyfrom(request, buffer, length1, offset + ETH_HEADER_SIZE);
     status = length1;
     offset += (length1 + 4);
     if (offset & 1)
@@ -368,16 +384,9 @@ static void ax88772b_unbind(mx_device_t* device) {
 }
 
 static void ax88772b_free(ax88772b_t* eth) {
-    iotxn_t* txn;
-    while ((txn = list_remove_head_type(&eth->free_read_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&eth->free_write_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&eth->free_intr_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
+    usb_eth_free_reqs(&eth->free_read_reqs);
+    usb_eth_tx_release(&eth->tx);
+    usb_eth_free_reqs(&eth->free_intr_reqs);
 
     free(eth->device);
     free(eth);
@@ -536,12 +545,14 @@ static mx_status_t ax88772b_bind(mx_driver_t* driver, mx_device_t* device) {
     uint8_t bulk_in_addr = 0;
     uint8_t bulk_out_addr = 0;
     uint8_t intr_addr = 0;
+    size_t bulk_out_max_packet = 0;
 
    usb_endpoint_descriptor_t* endp = usb_desc_iter_next_endpoint(&iter);
     while (endp) {
         if (usb_ep_direction(endp) == USB_ENDPOINT_OUT) {
             if (usb_ep_type(endp) == USB_ENDPOINT_BULK) {
                 bulk_out_addr = endp->bEndpointAddress;
+                bulk_out_max_packet = usb_ep_max_packet(endp);
             }
         } else {
             if (usb_ep_type(endp) == USB_ENDPOINT_BULK) {
@@ -554,7 +565,7 @@ static mx_status_t ax88772b_bind(mx_driver_t* driver, mx_device_t* device) {
     }
     usb_desc_iter_release(&iter);
 
-    if (!bulk_in_addr || !bulk_out_addr || !intr_addr) {
+    if (!bulk_in_addr || !bulk_out_addr || !intr_addr || !bulk_out_max_packet) {
         printf("ax88772b_bind could not find endpoints\n");
         return ERR_NOT_SUPPORTED;
     }
@@ -566,35 +577,34 @@ static mx_status_t ax88772b_bind(mx_driver_t* driver, mx_device_t* device) {
     }
 
     list_initialize(&eth->free_read_reqs);
-    list_initialize(&eth->free_write_reqs);
     list_initialize(&eth->free_intr_reqs);
     list_initialize(&eth->completed_reads);
 
     eth->usb_device = device;
     eth->driver = driver;
 
-    mx_status_t status = NO_ERROR;
-    for (int i = 0; i < READ_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_in_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = ax88772b_read_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_read_reqs, &req->node);
-    }
-    for (int i = 0; i < WRITE_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_out_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = ax88772b_write_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_write_reqs, &req->node);
+    usb_eth_config_t config = {
+        .rx_reqs = READ_REQ_COUNT,
+        .tx_reqs = WRITE_REQ_COUNT,
+        .tx_frames = WRITE_MAX_FRAMES,
+    };
+    usb_eth_get_config(&config);
+
+    eth->tx.req_size = WRITE_BUF_SIZE;
+    eth->tx.max_frames = config.tx_frames;
+    eth->tx.tail_room = ETH_HEADER_SIZE;
+    eth->tx.finish = ax88772b_tx_finish;
+    eth->tx.cookie = (void*)(uintptr_t)bulk_out_max_packet;
+    usb_eth_tx_init(&eth->tx, device);
+
+    mx_status_t status = usb_eth_alloc_reqs(&eth->free_read_reqs, config.rx_reqs, bulk_in_addr,
+                                            USB_BUF_SIZE, ax88772b_read_complete, eth);
+    if (status == NO_ERROR) {
+        status = usb_eth_alloc_reqs(&eth->tx.free_reqs, config.tx_reqs, bulk_out_addr,
+                                    WRITE_BUF_SIZE, ax88772b_write_complete, eth);
+    }
+    if (status != NO_ERROR) {
+        goto fail;
     }
     for (int i = 0; i < INTR_REQ_COUNT; i++) {
         iotxn_t* req = usb_alloc_iotxn(intr_addr, INTR_REQ_SIZE, 0);
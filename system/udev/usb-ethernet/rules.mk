@@ -12,7 +12,9 @@ MODULE_LIBS := ulib/driver ulib/magenta ulib/musl
 
 MODULE := usb-ethernet-ax88772b
 
-MODULE_SRCS := $(LOCAL_DIR)/asix-88772b.c
+MODULE_SRCS := \
+    $(LOCAL_DIR)/asix-88772b.c \
+    $(LOCAL_DIR)/usb-eth.c \
 
 include make/module.mk
 
@@ -25,7 +27,9 @@ MODULE_LIBS := ulib/driver ulib/magenta ulib/musl
 
 MODULE := usb-ethernet-ax88179
 
-MODULE_SRCS := $(LOCAL_DIR)/asix-88179.c
+MODULE_SRCS := \
+    $(LOCAL_DIR)/asix-88179.c \
+    $(LOCAL_DIR)/usb-eth.c \
 
 include make/module.mk
 
@@ -37,6 +41,8 @@ MODULE_LIBS := ulib/driver ulib/magenta ulib/musl
 
 MODULE := usb-ethernet-lan9514
 
-MODULE_SRCS := $(LOCAL_DIR)/smsc-lan9514.c
+MODULE_SRCS := \
+    $(LOCAL_DIR)/smsc-lan9514.c \
+    $(LOCAL_DIR)/usb-eth.c \
 
 include make/module.mk
\ No newline at end of file
@@ -18,14 +18,22 @@
 #include <unistd.h>
 
 #include "smsc-lan9514.h"
+#include "usb-eth.h"
 
 #define ETH_HEADER_SIZE 4
 #define ETH_RX_HEADER_SIZE 4
 
 #define READ_REQ_COUNT 8
-#define WRITE_REQ_COUNT 4
+#define WRITE_REQ_COUNT 8
+#define WRITE_MAX_FRAMES 16
 #define INTR_REQ_COUNT 4
 #define USB_BUF_SIZE 2048
+#define WRITE_BUF_SIZE 16384
+
+// The device gathers received frames into bulk IN transfers of up to
+// BURST_CAP packets, each frame after a status word and padded to 4 bytes.
+#define READ_BUF_SIZE_HS (16 * 1024 + 5 * 512)
+#define READ_BUF_SIZE_FS (6 * 1024 + 33 * 64)
 #define INTR_REQ_SIZE 4
 //#define ETH_HEADER_SIZE 4
 
@@ -40,10 +48,11 @@ typedef struct {
     bool online;
     bool dead;
 
-    // pool of free USB requests
+    // pool of free USB requests, and the bulk OUT requests, which gather
+    // frames
     list_node_t free_read_reqs;
-    list_node_t free_write_reqs;
     list_node_t free_intr_reqs;
+    usb_eth_tx_t tx;
 
     // list of received packets not yet read by upper layer
     list_node_t completed_reads;
@@ -249,7 +258,7 @@ static void update_signals_locked(lan9514_t* eth) {
         new_signals |= (DEV_STATE_READABLE | DEV_STATE_ERROR);
     if (!list_is_empty(&eth->completed_reads))
         new_signals |= DEV_STATE_READABLE;
-    if (!list_is_empty(&eth->free_write_reqs) && eth->online)
+    if (usb_eth_tx_writable(&eth->tx) && eth->online)
         new_signals |= DEV_STATE_WRITABLE;
     if (new_signals != eth->signals) {
         device_state_set_clr(eth->device, new_signals & ~eth->signals, eth->signals & ~new_signals);
@@ -298,7 +307,7 @@ static void lan9514_write_complete(iotxn_t* request, void* cookie) {
     }
 
     mtx_lock(&eth->mutex);
-    list_add_tail(&eth->free_write_reqs, &request->node);
+    usb_eth_tx_complete(&eth->tx, request);
     update_signals_locked(eth);
     mtx_unlock(&eth->mutex);
 }
@@ -334,6 +343,7 @@ mx_status_t lan9514_recv(mx_device_t* device, void* buffer, size_t length) {
     mx_status_t status = NO_ERROR;
 
     mtx_lock(&eth->mutex);
+    size_t offset = eth->read_offset;
 
     list_node_t* node = list_peek_head(&eth->completed_reads);
     if (!node) {
@@ -343,14 +353,22 @@ mx_status_t lan9514_recv(mx_device_t* device, void* buffer, size_t length) {
     iotxn_t* request = containerof(node, iotxn_t, node);
 
     uint32_t rx_status;
-
-    request->ops->copyfrom(request, &rx_status, sizeof(rx_status), 0);
+    if (request->actual < offset + sizeof(rx_status)) {
+        status = ERR_INTERNAL;
+        offset = 0;
+        list_remove_head(&eth->completed_reads);
+        requeue_read_request_locked(eth, request);
+        goto out;
+    }
+    request->ops->copyfrom(request, &rx_status, sizeof(rx_status), offset);
 
     uint32_t frame_len = (rx_status & LAN9514_RXSTATUS_FRAME_LEN) >> 16;
 
-    if (rx_status & LAN9514_RXSTATUS_ERROR_MASK) {
+    if ((rx_status & LAN9514_RXSTATUS_ERROR_MASK) ||
+        (frame_len > request->actual - offset - sizeof(rx_status))) {
         printf("invalid header: 0x%08x\n", rx_status);
         status = ERR_INTERNAL;
+        offset = 0;
         list_remove_head(&eth->completed_reads);
         requeue_read_request_locked(eth, request);
         goto out;
@@ -361,12 +379,17 @@ mx_status_t lan9514_recv(mx_device_t* device, void* buffer, size_t length) {
         goto out;
     }
 
-    request->ops->copyfrom(request, buffer, frame_len, sizeof(rx_status));
+    request->ops->copyfrom(request, buffer, frame_len, offset + sizeof(rx_status));
     status = frame_len;
 
-    list_remove_head(&eth->completed_reads);
+    offset = (offset + sizeof(rx_status) + frame_len + 3) & ~3;
+    if (offset + sizeof(rx_status) > request->actual) {
+        offset = 0;
+        list_remove_head(&eth->completed_reads);
+        requeue_read_request_locked(eth, request);
+    }
 out:
-    eth->read_offset = 0;
+    eth->read_offset = offset;
     update_signals_locked(eth);
     mtx_unlock(&eth->mutex);
     return status;
@@ -381,19 +404,19 @@ mx_status_t lan9514_send(mx_device_t* device, const void* buffer, size_t length)
 
     mx_status_t status = NO_ERROR;
 
+    if (length + ETH_HEADER_SIZE > USB_BUF_SIZE) {
+        return ERR_INVALID_ARGS;
+    }
+
     mtx_lock(&eth->mutex);
 
-    list_node_t* node = list_remove_head(&eth->free_write_reqs);
-    if (!node) {
+    // each frame's commands start on a 4 byte boundary
+    size_t offset;
+    iotxn_t* request = usb_eth_tx_reserve(&eth->tx, 8 + length, &offset);
+    if (!request) {
         status = ERR_BUFFER_TOO_SMALL;
         goto out;
     }
-    iotxn_t* request = containerof(node, iotxn_t, node);
-
-    if (length + ETH_HEADER_SIZE > USB_BUF_SIZE) {
-        status = ERR_INVALID_ARGS;
-        goto out;
-    }
 
     uint8_t header[8];
     uint32_t command_a = (1 << 13) | (1 << 12) | (length);
@@ -408,10 +431,9 @@ mx_status_t lan9514_send(mx_device_t* device, const void* buffer, size_t length)
     header[6] = (command_b >> 16) & 0xff;
     header[7] = (command_b >> 24) & 0xff;
 
-    request->ops->copyto(request, header, 8, 0);
-    request->ops->copyto(request, buffer, length, 8);
-    request->length = length + 8;
-    iotxn_queue(eth->usb_device, request);
+    request->ops->copyto(request, header, 8, offset);
+    request->ops->copyto(request, buffer, length, offset + 8);
+    usb_eth_tx_commit(&eth->tx, offset, 8 + length);
 
 out:
     update_signals_locked(eth);
@@ -496,18 +518,10 @@ size_t lan9514_get_mtu(mx_device_t* device) {
 }
 
 static void lan9514_free(lan9514_t* eth) {
-    iotxn_t* txn;
-
     mtx_lock(&eth->mutex);
-    while ((txn = list_remove_head_type(&eth->free_read_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&eth->free_write_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&eth->free_intr_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
+    usb_eth_free_reqs(&eth->free_read_reqs);
+    usb_eth_tx_release(&eth->tx);
+    usb_eth_free_reqs(&eth->free_intr_reqs);
     mtx_unlock(&eth->mutex);
 
     free(eth->device);
@@ -597,6 +611,11 @@ static mx_status_t lan9514_reset(lan9514_t* eth) {
         goto fail;
     printf("updated LAN9514 HW_CFG register = 0x%08x\n", retval);
 
+    bool high_speed = (usb_get_speed(eth->usb_device) == USB_SPEED_HIGH);
+    retval = high_speed ? (READ_BUF_SIZE_HS / 512) : (READ_BUF_SIZE_FS / 64);
+    if (lan9514_write_register(eth, LAN9514_BURST_CAP_REG, retval) < 0)
+        goto fail;
+
     if (lan9514_write_register(eth, LAN9514_BULK_IN_DLY_REG, LAN9514_BULK_IN_DLY_DEFAULT) < 0)
         goto fail;
     if (lan9514_read_register(eth, LAN9514_BULK_IN_DLY_REG, &retval) < 0)
@@ -606,6 +625,8 @@ static mx_status_t lan9514_reset(lan9514_t* eth) {
     if (lan9514_read_register(eth, LAN9514_HW_CFG_REG, &retval) < 0)
         goto fail;
     retval &= ~LAN9514_HW_CFG_RXDOFF;
+    // several frames to a bulk IN transfer, up to BURST_CAP
+    retval |= LAN9514_HW_CFG_MEF | LAN9514_HW_CFG_BCE;
     if (lan9514_write_register(eth, LAN9514_HW_CFG_REG, retval) < 0)
         goto fail;
     if (lan9514_read_register(eth, LAN9514_HW_CFG_REG, &retval) < 0)
@@ -813,35 +834,34 @@ static mx_status_t lan9514_bind(mx_driver_t* driver, mx_device_t* device) {
     }
 
     list_initialize(&eth->free_read_reqs);
-    list_initialize(&eth->free_write_reqs);
     list_initialize(&eth->free_intr_reqs);
     list_initialize(&eth->completed_reads);
 
     eth->usb_device = device;
     eth->driver = driver;
 
-    mx_status_t status = NO_ERROR;
-    for (int i = 0; i < READ_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_in_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = lan9514_read_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_read_reqs, &req->node);
-    }
-    for (int i = 0; i < WRITE_REQ_COUNT; i++) {
-        iotxn_t* req = usb_alloc_iotxn(bulk_out_addr, USB_BUF_SIZE, 0);
-        if (!req) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        req->length = USB_BUF_SIZE;
-        req->complete_cb = lan9514_write_complete;
-        req->cookie = eth;
-        list_add_head(&eth->free_write_reqs, &req->node);
+    usb_eth_config_t config = {
+        .rx_reqs = READ_REQ_COUNT,
+        .tx_reqs = WRITE_REQ_COUNT,
+        .tx_frames = WRITE_MAX_FRAMES,
+    };
+    usb_eth_get_config(&config);
+
+    eth->tx.req_size = WRITE_BUF_SIZE;
+    eth->tx.max_frames = config.tx_frames;
+    eth->tx.align = 4;
+    usb_eth_tx_init(&eth->tx, device);
+
+    size_t read_size = (usb_get_speed(device) == USB_SPEED_HIGH) ? READ_BUF_SIZE_HS
+                                                                 : READ_BUF_SIZE_FS;
+    mx_status_t status = usb_eth_alloc_reqs(&eth->free_read_reqs, config.rx_reqs, bulk_in_addr,
+                                            read_size, lan9514_read_complete, eth);
+    if (status == NO_ERROR) {
+        status = usb_eth_alloc_reqs(&eth->tx.free_reqs, config.tx_reqs, bulk_out_addr,
+                                    WRITE_BUF_SIZE, lan9514_write_complete, eth);
+    }
+    if (status != NO_ERROR) {
+        goto fail;
     }
 
     for (int i = 0; i < INTR_REQ_COUNT; i++) {
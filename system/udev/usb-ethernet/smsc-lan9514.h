@@ -51,6 +51,8 @@
 #define LAN9514_HW_CFG_LRST             (0x00000008)
 #define LAN9514_HW_CFG_BIR              (0x00001000)
 #define LAN9514_HW_CFG_RXDOFF           (0x00000600)
+#define LAN9514_HW_CFG_MEF              (0x00000020)
+#define LAN9514_HW_CFG_BCE              (0x00000002)
 
 #define LAN9514_PM_CTRL_REG             (0x20)
 #define LAN9514_PM_CTRL_PHY_RST         (0x00000010)
@@ -83,6 +85,8 @@
 
 
 
+#define LAN9514_BURST_CAP_REG           (0x38)
+
 #define LAN9514_BULK_IN_DLY_REG         (0x6c)
 #define LAN9514_BULK_IN_DLY_DEFAULT     (0x00002000)
 
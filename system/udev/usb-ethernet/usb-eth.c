@@ -0,0 +1,131 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/common/usb.h>
+#include <ddk/device.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+#include "usb-eth.h"
+
+static void usb_eth_option(const char* name, uint32_t* value, uint32_t max) {
+    const char* v = getenv(name);
+    if (v == NULL) {
+        return;
+    }
+    uint32_t n = strtoul(v, NULL, 0);
+    if ((n == 0) || (n > max)) {
+        printf("usb-ethernet: %s must be from 1 to %u\n", name, max);
+        return;
+    }
+    *value = n;
+}
+
+void usb_eth_get_config(usb_eth_config_t* config) {
+    usb_eth_option("usb-ethernet.rx-reqs", &config->rx_reqs, USB_ETH_MAX_REQS);
+    usb_eth_option("usb-ethernet.tx-reqs", &config->tx_reqs, USB_ETH_MAX_REQS);
+    usb_eth_option("usb-ethernet.tx-frames", &config->tx_frames, 64);
+}
+
+mx_status_t usb_eth_alloc_reqs(list_node_t* list, uint32_t count, uint8_t ep, size_t size,
+                               void (*complete_cb)(iotxn_t* txn, void* cookie), void* cookie) {
+    for (uint32_t i = 0; i < count; i++) {
+        iotxn_t* req = usb_alloc_iotxn(ep, size, 0);
+        if (!req) {
+            return ERR_NO_MEMORY;
+        }
+        req->length = size;
+        req->complete_cb = complete_cb;
+        req->cookie = cookie;
+        list_add_head(list, &req->node);
+    }
+    return NO_ERROR;
+}
+
+void usb_eth_free_reqs(list_node_t* list) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(list, iotxn_t, node)) != NULL) {
+        txn->ops->release(txn);
+    }
+}
+
+void usb_eth_tx_init(usb_eth_tx_t* tx, mx_device_t* usb_device) {
+    tx->usb_device = usb_device;
+    list_initialize(&tx->free_reqs);
+    tx->pending = NULL;
+    tx->pending_frames = 0;
+    tx->inflight = 0;
+    if (tx->max_frames == 0) {
+        tx->max_frames = 1;
+    }
+    if (tx->align == 0) {
+        tx->align = 1;
+    }
+}
+
+static void usb_eth_tx_flush(usb_eth_tx_t* tx) {
+    iotxn_t* req = tx->pending;
+    tx->pending = NULL;
+    if (tx->finish) {
+        req->length = tx->finish(req, tx->pending_last, tx->cookie);
+    }
+    tx->inflight++;
+    iotxn_queue(tx->usb_device, req);
+}
+
+iotxn_t* usb_eth_tx_reserve(usb_eth_tx_t* tx, size_t len, size_t* offset) {
+    size_t room = tx->req_size - tx->tail_room;
+    if (len > room) {
+        return NULL;
+    }
+    if (tx->pending) {
+        size_t at = (tx->pending->length + tx->align - 1) / tx->align * tx->align;
+        if ((tx->pending_frames < tx->max_frames) && (len <= room - MIN(at, room))) {
+            *offset = at;
+            return tx->pending;
+        }
+        usb_eth_tx_flush(tx);
+    }
+
+    iotxn_t* req = list_remove_head_type(&tx->free_reqs, iotxn_t, node);
+    if (req == NULL) {
+        return NULL;
+    }
+    req->length = 0;
+    tx->pending = req;
+    tx->pending_frames = 0;
+    *offset = 0;
+    return req;
+}
+
+void usb_eth_tx_commit(usb_eth_tx_t* tx, size_t offset, size_t len) {
+    tx->pending->length = offset + len;
+    tx->pending_last = offset;
+    tx->pending_frames++;
+    if ((tx->inflight < USB_ETH_TX_AHEAD) || (tx->pending_frames == tx->max_frames)) {
+        usb_eth_tx_flush(tx);
+    }
+}
+
+void usb_eth_tx_complete(usb_eth_tx_t* tx, iotxn_t* req) {
+    tx->inflight--;
+    list_add_tail(&tx->free_reqs, &req->node);
+    if (tx->pending) {
+        usb_eth_tx_flush(tx);
+    }
+}
+
+bool usb_eth_tx_writable(usb_eth_tx_t* tx) {
+    return (tx->pending != NULL) || !list_is_empty(&tx->free_reqs);
+}
+
+void usb_eth_tx_release(usb_eth_tx_t* tx) {
+    if (tx->pending) {
+        tx->pending->ops->release(tx->pending);
+        tx->pending = NULL;
+    }
+    usb_eth_free_reqs(&tx->free_reqs);
+}
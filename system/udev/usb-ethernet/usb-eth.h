@@ -0,0 +1,77 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <ddk/iotxn.h>
+#include <magenta/listnode.h>
+#include <magenta/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Request pools and transmit batching shared by the usb ethernet drivers.
+
+typedef struct usb_eth_config {
+    uint32_t rx_reqs;       // bulk IN requests kept queued
+    uint32_t tx_reqs;       // bulk OUT requests
+    uint32_t tx_frames;     // most frames gathered into one bulk OUT request
+} usb_eth_config_t;
+
+#define USB_ETH_MAX_REQS 64
+
+// Overrides what the driver put in config with any usb-ethernet.rx-reqs,
+// usb-ethernet.tx-reqs or usb-ethernet.tx-frames commandline options.
+void usb_eth_get_config(usb_eth_config_t* config);
+
+// Allocates count requests of size bytes for ep onto list.
+mx_status_t usb_eth_alloc_reqs(list_node_t* list, uint32_t count, uint8_t ep, size_t size,
+                               void (*complete_cb)(iotxn_t* txn, void* cookie), void* cookie);
+void usb_eth_free_reqs(list_node_t* list);
+
+// Gathers frames into bulk OUT requests.  Frames go straight out while
+// fewer than USB_ETH_TX_AHEAD requests are in flight, which is enough to
+// keep the pipe busy; past that they pile into one request, which goes
+// out once it's full or a request ahead of it completes.  So a slow
+// trickle of frames isn't held back, and a stream of them costs a
+// fraction of the transfers.
+//
+// All of it is called with the driver's lock held.
+typedef struct usb_eth_tx {
+    mx_device_t* usb_device;
+    list_node_t free_reqs;
+    iotxn_t* pending;       // gathering frames, not queued yet
+    size_t pending_last;    // offset of the last frame in it
+    uint32_t pending_frames;
+    uint32_t inflight;
+
+    // set up by the driver
+    size_t req_size;
+    uint32_t max_frames;
+    size_t align;           // each frame starts on a multiple of this
+    size_t tail_room;       // kept free at the end of each request for finish()
+    // called on each request before it's queued, with the offset of its
+    // last frame, returning the length to send
+    size_t (*finish)(iotxn_t* req, size_t last, void* cookie);
+    void* cookie;
+} usb_eth_tx_t;
+
+#define USB_ETH_TX_AHEAD 2
+
+void usb_eth_tx_init(usb_eth_tx_t* tx, mx_device_t* usb_device);
+
+// Finds room for a frame of len bytes, its header included, returning
+// the request and the offset to write it at, or NULL if every request
+// is in flight.  Follow with usb_eth_tx_commit() once it's written.
+iotxn_t* usb_eth_tx_reserve(usb_eth_tx_t* tx, size_t len, size_t* offset);
+void usb_eth_tx_commit(usb_eth_tx_t* tx, size_t offset, size_t len);
+
+// Takes back a request from its completion, sending what's gathered.
+void usb_eth_tx_complete(usb_eth_tx_t* tx, iotxn_t* req);
+
+// Whether a frame can be taken now.
+bool usb_eth_tx_writable(usb_eth_tx_t* tx);
+
+// Releases the requests not in flight.
+void usb_eth_tx_release(usb_eth_tx_t* tx);
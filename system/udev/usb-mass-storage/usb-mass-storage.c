@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -25,6 +26,15 @@
 #define WRITE_REQ_COUNT 3
 #define USB_BUF_SIZE 0x8000
 
+// Block txns are sent as commands which are queued on the endpoints
+// whole, CBW, data and CSW, as soon as there is one free, so that the
+// device can go on to the next as soon as it is done with one.  A command
+// has one data transfer of up to USB_BUF_SIZE.  That's a window into the
+// txn when it's for the one txn, or part of one, and otherwise a buffer
+// that a run of small adjacent txns is copied through.
+#define UMS_MAX_INFLIGHT 2
+#define UMS_MAX_MERGE 16
+
 // comment the next line if you don't want debug messages
 #define DEBUG 0
 #ifdef DEBUG
@@ -35,21 +45,47 @@
 
 // used to implement IOCTL_DEVICE_SYNC
 typedef struct {
-    // iotxn we are waiting to complete
-    iotxn_t* iotxn;
+    // number of txns that must be done
+    uint64_t seq;
     // completion for IOCTL_DEVICE_SYNC to wait on
     completion_t completion;
     // node for ums_t.sync_nodes list
     list_node_t node;
 } ums_sync_node_t;
 
+typedef struct ums ums_t;
+
 typedef struct {
+    list_node_t node;
+    ums_t* msd;
+    uint32_t tag;
+    uint32_t opcode;
+    uint32_t length;
+
+    iotxn_t* cbw;
+    iotxn_t* csw;
+    // a window into txns[0], or a buffer from the free read or write reqs
+    iotxn_t* data;
+    bool bounce;
+
+    // the txns the data is for, and where in the first it starts; all
+    // but the last are done with the command, and the last is if final
+    iotxn_t* txns[UMS_MAX_MERGE];
+    uint32_t txn_count;
+    mx_off_t txn_offset;
+    bool final;
+
+    // usb requests not yet completed, and the first error of any of them
+    uint32_t pending;
+    mx_status_t status;
+} ums_cmd_t;
+
+struct ums {
     mx_device_t device;
     mx_device_t* udev;
     mx_driver_t* driver;
 
     uint32_t tag_send;      // next tag to send in CBW
-    uint32_t tag_receive;   // next tag we expect to receive in CSW
 
     uint8_t lun;
     uint64_t total_blocks;
@@ -65,22 +101,33 @@ typedef struct {
     list_node_t free_read_reqs;
     list_node_t free_write_reqs;
 
-    // list of queued io transactions
+    // list of queued io transactions, and how much of the first has
+    // been sent in commands
     list_node_t queued_iotxns;
+    uint64_t head_issued;
+
+    // commands sent, oldest first, and those free
+    list_node_t active_cmds;
+    list_node_t free_cmds;
+    ums_cmd_t cmds[UMS_MAX_INFLIGHT];
+    bool dispatching;
+    bool redispatch;
+
+    // txns taken and handed back, which is always in order
+    uint64_t txns_queued;
+    uint64_t txns_done;
 
     // list of active ums_sync_node_t
     list_node_t sync_nodes;
 
     // list of received packets not yet read by upper layer
     list_node_t completed_reads;
-    list_node_t completed_csws;
 
     mtx_t mutex;
-} ums_t;
+};
 #define get_ums(dev) containerof(dev, ums_t, device)
 
-static void ums_csw_complete(iotxn_t* csw_request, void* cookie);
-static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request);
+static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request, uint32_t tag);
 
 static inline uint16_t read16be(uint8_t* ptr) {
     return betoh16(*((uint16_t*)ptr));
@@ -140,19 +187,17 @@ static void ums_queue_request(ums_t* msd, iotxn_t* txn) {
     iotxn_queue(msd->udev, txn);
 }
 
-static mx_status_t ums_send_cbw(ums_t* msd, uint32_t transfer_length, uint8_t flags,
-                                uint8_t command_len, void* command) {
-    iotxn_t* txn = get_free_write(msd);
-    if (!txn) {
-        return ERR_BUFFER_TOO_SMALL;
-    }
+// fills in a CBW for the command, returning its tag
+static uint32_t ums_fill_cbw(ums_t* msd, iotxn_t* txn, uint32_t transfer_length, uint8_t flags,
+                             uint8_t command_len, void* command) {
+    uint32_t tag = msd->tag_send++;
     // CBWs always have 31 bytes
     txn->length = 31;
 
     // first three blocks are 4 byte
     uint32_t buf_32[3];
     buf_32[0] = htole32(CBW_SIGNATURE);
-    buf_32[1] = htole32(msd->tag_send++);
+    buf_32[1] = htole32(tag);
     buf_32[2] = htole32(transfer_length);
     txn->ops->copyto(txn, buf_32, sizeof(buf_32), 0);
 
@@ -165,20 +210,17 @@ static mx_status_t ums_send_cbw(ums_t* msd, uint32_t transfer_length, uint8_t fl
 
     // copy command_len bytes from the command passed in into the command_len
     txn->ops->copyto(txn, command, command_len, sizeof(buf_32) + sizeof(buf_8));
-    ums_queue_request(msd, txn);
-    return NO_ERROR;
+    return tag;
 }
 
-static mx_status_t ums_queue_csw(ums_t* msd) {
-    list_node_t* csw_node = list_remove_head(&msd->free_csw_reqs);
-    if (!csw_node) {
-        DEBUG_PRINT(("UMS:error, no CSW reqs left\n"));
+static mx_status_t ums_send_cbw(ums_t* msd, uint32_t transfer_length, uint8_t flags,
+                                uint8_t command_len, void* command) {
+    iotxn_t* txn = get_free_write(msd);
+    if (!txn) {
         return ERR_BUFFER_TOO_SMALL;
     }
-    iotxn_t* csw_request = containerof(csw_node, iotxn_t, node);
-    csw_request->complete_cb = ums_csw_complete;
-    csw_request->cookie = msd;
-    ums_queue_request(msd, csw_request);
+    ums_fill_cbw(msd, txn, transfer_length, flags, command_len, command);
+    ums_queue_request(msd, txn);
     return NO_ERROR;
 }
 
@@ -200,7 +242,8 @@ static mx_status_t ums_read_csw(ums_t* msd) {
     ums_queue_request(msd, csw_request);
     completion_wait(&completion, MX_TIME_INFINITE);
 
-    csw_status_t csw_error = ums_verify_csw(msd, csw_request);
+    // the CSW is for the CBW just sent
+    csw_status_t csw_error = ums_verify_csw(msd, csw_request, msd->tag_send - 1);
     list_add_tail(&msd->free_csw_reqs, &csw_request->node);
 
     if (csw_error == CSW_SUCCESS) {
@@ -229,22 +272,7 @@ static mx_status_t ums_queue_read(ums_t* msd, uint16_t transfer_length) {
     return NO_ERROR;
 }
 
-static mx_status_t ums_queue_write(ums_t* msd, uint16_t transfer_length, iotxn_t* txn) {
-    list_node_t* write_node = list_remove_head(&msd->free_write_reqs);
-    if (!write_node) {
-        DEBUG_PRINT(("UMS:error, no write reqs left\n"));
-        return ERR_BUFFER_TOO_SMALL;
-    }
-    iotxn_t* write_request = containerof(write_node, iotxn_t, node);
-    write_request->length = transfer_length;
-    void* buffer;
-    write_request->ops->mmap(write_request, &buffer);
-    txn->ops->copyfrom(txn, buffer, (size_t)transfer_length, 0);
-    ums_queue_request(msd, write_request);
-    return NO_ERROR;
-}
-
-static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request) {
+static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request, uint32_t tag) {
     uint8_t buffer[UMS_COMMAND_STATUS_WRAPPER_SIZE];
     csw_request->ops->copyfrom(csw_request, buffer, sizeof(buffer), 0);
 
@@ -255,8 +283,8 @@ static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request) {
         return CSW_INVALID;
     }
     // check if tag matches the tag of last CBW
-    if (letoh32(ptr_32[1]) != msd->tag_receive++) {
-        DEBUG_PRINT(("UMS:csw tag mismatch, expected:%08x got in csw:%08x \n", msd->tag_receive - 1, letoh32(ptr_32[1])));
+    if (letoh32(ptr_32[1]) != tag) {
+        DEBUG_PRINT(("UMS:csw tag mismatch, expected:%08x got in csw:%08x \n", tag, letoh32(ptr_32[1])));
         return CSW_TAG_MISMATCH;
     }
     // check if success is true or not?
@@ -283,57 +311,6 @@ static iotxn_t* pop_completed_read(ums_t* msd) {
     return containerof(node, iotxn_t, node);
 }
 
-static void ums_csw_complete(iotxn_t* csw_request, void* cookie) {
-    ums_t* msd = (ums_t*)cookie;
-
-    // TODO: handle error case for CSW by setting iotxn to error and returning
-    iotxn_t* curr_txn = list_remove_head_type(&msd->queued_iotxns, iotxn_t, node);
-
-    // unblock calls to IOCTL_DEVICE_SYNC that are waiting for curr_txn to complete
-    mtx_lock(&msd->mutex);
-    ums_sync_node_t* sync_node;
-    list_for_every_entry(&msd->sync_nodes, sync_node, ums_sync_node_t, node) {
-        if (sync_node->iotxn == curr_txn) {
-            list_delete(&sync_node->node);
-            completion_signal(&sync_node->completion);
-        }
-    }
-    mtx_unlock(&msd->mutex);
-
-    csw_status_t csw_error = ums_verify_csw(msd, csw_request);
-    if (csw_error) {
-        // print error and then reset device due to it
-        DEBUG_PRINT(("UMS: CSW verify returned error. Check ums-hw.h csw_status_t for enum = %d\n", csw_error));
-        if (csw_error != CSW_FAILED) {
-            ums_reset(msd);
-        }
-        list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-        curr_txn->ops->complete(curr_txn, ERR_BAD_STATE, 0);
-        return;
-    }
-    // if head of iotxn list is a read iotxn and CSW reports success, then set its buffer to that
-    // of the latest read request, with limited length based on data residue field in CSW
-    if (curr_txn->opcode == IOTXN_OP_READ) {
-        iotxn_t* read_request = pop_completed_read(msd);
-        if (!read_request) {
-            list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-            return;
-        }
-        // data residue field is the 3rd uint32_t in csw buffer
-        uint32_t temp;
-        csw_request->ops->copyfrom(csw_request, &temp, sizeof(temp), 2 * sizeof(temp));
-        uint32_t residue = letoh32(temp);
-        uint32_t length = read_request->actual - residue;
-        void* buffer;
-        curr_txn->ops->mmap(curr_txn, &buffer);
-        read_request->ops->copyfrom(read_request, buffer, length, 0);
-        list_add_tail(&msd->free_read_reqs, &read_request->node);
-    }
-
-    list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-    curr_txn->ops->complete(curr_txn, NO_ERROR, curr_txn->length);
-}
-
 static void ums_write_complete(iotxn_t* txn, void* cookie) {
     ums_t* msd = (ums_t*)cookie;
     // FIXME what to do with error here?
@@ -515,137 +492,268 @@ static mx_status_t ums_read_capacity16(ums_t* msd, uint8_t* out_data) {
     return status;
 }
 
-static mx_status_t ums_read(mx_device_t* device, iotxn_t* txn) {
-    if (txn->length > UINT32_MAX) return ERR_INVALID_ARGS;
-    ums_t* msd = get_ums(device);
-    mx_status_t status = NO_ERROR;
-
-    uint64_t lba = txn->offset/msd->block_size;
-    uint32_t num_blocks = txn->length/msd->block_size;
-    uint32_t transfer_length = txn->length;
-
-    // CBW Configuration
-
+// builds the READ or WRITE command for num_blocks blocks at lba, and
+// returns its length
+static uint8_t ums_build_rw(ums_t* msd, uint32_t opcode, uint64_t lba, uint32_t num_blocks,
+                            uint8_t* command) {
+    bool read = (opcode == IOTXN_OP_READ);
     if (msd->use_read_write_16) {
-        uint8_t command[UMS_READ16_COMMAND_LENGTH];
         memset(command, 0, UMS_READ16_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ16;
-        // set lba
+        command[0] = read ? UMS_READ16 : UMS_WRITE16;
         write64be(command + 2, lba);
-        // set transfer length in blocks
         write32be(command + 10, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN,
-                                UMS_READ16_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
+        return UMS_READ16_COMMAND_LENGTH;
     } else if (num_blocks <= UINT16_MAX) {
-        uint8_t command[UMS_READ10_COMMAND_LENGTH];
         memset(command, 0, UMS_READ10_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ10;
-        // set lba
+        command[0] = read ? UMS_READ10 : UMS_WRITE10;
         write32be(command + 2, lba);
-        // set transfer length in blocks
         write16be(command + 7, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN, UMS_READ10_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
+        return UMS_READ10_COMMAND_LENGTH;
     } else {
-        uint8_t command[UMS_READ12_COMMAND_LENGTH];
         memset(command, 0, UMS_READ12_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ12;
-        // set lba
+        command[0] = read ? UMS_READ12 : UMS_WRITE12;
         write32be(command + 2, lba);
-        // set transfer length in blocks
         write32be(command + 6, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN,
-            UMS_READ12_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
+        return UMS_READ12_COMMAND_LENGTH;
+    }
+}
+
+static void ums_dispatch(ums_t* msd);
+
+// unblocks calls to IOCTL_DEVICE_SYNC that were waiting for the txns
+// handed back, called with the mutex held
+static void ums_signal_syncs(ums_t* msd) {
+    ums_sync_node_t* sync_node;
+    ums_sync_node_t* temp;
+    list_for_every_entry_safe(&msd->sync_nodes, sync_node, temp, ums_sync_node_t, node) {
+        if (sync_node->seq <= msd->txns_done) {
+            list_delete(&sync_node->node);
+            completion_signal(&sync_node->completion);
         }
     }
+}
 
-    // read request sense response
-    status = ums_queue_read(msd, transfer_length);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+// hands back the txns a command finished, and those after it that were
+// waiting for it, in the order they were queued
+static void ums_retire(ums_t* msd) {
+    list_node_t done = LIST_INITIAL_VALUE(done);
+
+    mtx_lock(&msd->mutex);
+    ums_cmd_t* cmd;
+    while ((cmd = list_peek_head_type(&msd->active_cmds, ums_cmd_t, node)) != NULL &&
+           cmd->pending == 0) {
+        list_delete(&cmd->node);
+
+        mx_status_t status = cmd->status;
+        if (status == NO_ERROR) {
+            csw_status_t csw_error = ums_verify_csw(msd, cmd->csw, cmd->tag);
+            uint32_t residue;
+            cmd->csw->ops->copyfrom(cmd->csw, &residue, sizeof(residue), 2 * sizeof(residue));
+            if (csw_error != CSW_SUCCESS) {
+                DEBUG_PRINT(("UMS: CSW verify returned error. Check ums-hw.h csw_status_t for enum = %d\n", csw_error));
+                if (csw_error != CSW_FAILED) {
+                    ums_reset(msd);
+                }
+                status = ERR_BAD_STATE;
+            } else if (letoh32(residue) != 0) {
+                status = ERR_IO;
+            }
+        }
+
+        void* buffer = NULL;
+        if (cmd->bounce) {
+            cmd->data->ops->mmap(cmd->data, &buffer);
+        }
+        mx_off_t offset = 0;
+        for (uint32_t i = 0; i < cmd->txn_count; i++) {
+            iotxn_t* txn = cmd->txns[i];
+            if (cmd->bounce && (status == NO_ERROR) && (cmd->opcode == IOTXN_OP_READ)) {
+                txn->ops->copyto(txn, buffer + offset, txn->length, 0);
+            }
+            offset += txn->length;
+            // a txn sent in parts fails if any of them does
+            if (txn->status == NO_ERROR) {
+                txn->status = status;
+            }
+            if ((i + 1 < cmd->txn_count) || cmd->final) {
+                list_add_tail(&done, &txn->node);
+                msd->txns_done++;
+            }
+        }
+        if (!cmd->bounce) {
+            cmd->data->ops->release(cmd->data);
+        } else if (cmd->opcode == IOTXN_OP_READ) {
+            cmd->data->complete_cb = ums_read_complete;
+            cmd->data->cookie = msd;
+            list_add_tail(&msd->free_read_reqs, &cmd->data->node);
+        } else {
+            cmd->data->complete_cb = ums_write_complete;
+            cmd->data->cookie = msd;
+            list_add_tail(&msd->free_write_reqs, &cmd->data->node);
+        }
+        cmd->data = NULL;
+        list_add_tail(&msd->free_cmds, &cmd->node);
     }
+    mtx_unlock(&msd->mutex);
 
-    // receive CSW
-    return ums_queue_csw(msd);
-}
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&done, iotxn_t, node)) != NULL) {
+        txn->ops->complete(txn, txn->status, (txn->status == NO_ERROR) ? txn->length : 0);
+    }
 
-static mx_status_t ums_write(mx_device_t* device, iotxn_t* txn) {
-    if (txn->length > UINT32_MAX) return ERR_INVALID_ARGS;
-    ums_t* msd = get_ums(device);
-    mx_status_t status = NO_ERROR;
+    mtx_lock(&msd->mutex);
+    ums_signal_syncs(msd);
+    mtx_unlock(&msd->mutex);
 
-    uint64_t lba = txn->offset/msd->block_size;
-    uint32_t num_blocks = txn->length/msd->block_size;
-    uint32_t transfer_length = txn->length;
+    ums_dispatch(msd);
+}
 
-    if (msd->use_read_write_16) {
-        uint8_t command[UMS_WRITE16_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE16_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE16;
-        // set lba
-        uint64_t* lba_ptr = (uint64_t*)&(command[2]);
-        *lba_ptr = htobe64(lba);
-        // set transfer length
-        uint32_t* transfer_len_ptr = (uint32_t*)&(command[10]);
-        *transfer_len_ptr = htobe32(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE16_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
+static void ums_cmd_part_complete(iotxn_t* txn, void* cookie) {
+    ums_cmd_t* cmd = cookie;
+    ums_t* msd = cmd->msd;
+    mtx_lock(&msd->mutex);
+    if ((txn->status != NO_ERROR) && (cmd->status == NO_ERROR)) {
+        cmd->status = txn->status;
+    }
+    bool retire = (--cmd->pending == 0);
+    mtx_unlock(&msd->mutex);
+    if (retire) {
+        ums_retire(msd);
+    }
+}
+
+// Makes a command of the first of the queued txns and any that follow on
+// from it, putting the usb requests to send on out.  Called with the
+// mutex held.
+static mx_status_t ums_start_cmd(ums_t* msd, ums_cmd_t* cmd, list_node_t* out) {
+    iotxn_t* head = list_peek_head_type(&msd->queued_iotxns, iotxn_t, node);
+    cmd->opcode = head->opcode;
+    cmd->status = NO_ERROR;
+    cmd->txn_count = 0;
+    cmd->txn_offset = msd->head_issued;
+    cmd->final = true;
+    uint64_t offset = head->offset + msd->head_issued;
+    uint8_t ep_address = (cmd->opcode == IOTXN_OP_READ) ? msd->bulk_in_addr : msd->bulk_out_addr;
+    list_node_t* free_reqs = (cmd->opcode == IOTXN_OP_READ) ? &msd->free_read_reqs
+                                                            : &msd->free_write_reqs;
+
+    // see how many small txns it can take, while there's a buffer for them
+    uint32_t count = 1;
+    uint64_t length = head->length;
+    if ((msd->head_issued == 0) && (length <= USB_BUF_SIZE) && !list_is_empty(free_reqs)) {
+        iotxn_t* next = head;
+        while (count < UMS_MAX_MERGE &&
+               (next = list_next_type(&msd->queued_iotxns, &next->node, iotxn_t, node)) != NULL &&
+               (next->opcode == cmd->opcode) && (next->offset == head->offset + length) &&
+               (length + next->length <= USB_BUF_SIZE)) {
+            length += next->length;
+            count++;
         }
-    } else if (num_blocks <= UINT16_MAX) {
-        uint8_t command[UMS_WRITE10_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE10_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE10;
-        // set lba
-        uint32_t* lba_ptr = (uint32_t*)&(command[2]);
-        *lba_ptr = htobe32(lba);
-        // set transfer length in blocks
-        uint16_t* transfer_len_ptr = (uint16_t*)&(command[7]);
-        *transfer_len_ptr = htobe16(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE10_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
+    }
+
+    if (count > 1) {
+        cmd->bounce = true;
+        cmd->data = list_remove_head_type(free_reqs, iotxn_t, node);
+        void* buffer;
+        cmd->data->ops->mmap(cmd->data, &buffer);
+        for (uint32_t i = 0; i < count; i++) {
+            iotxn_t* txn = list_remove_head_type(&msd->queued_iotxns, iotxn_t, node);
+            if (cmd->opcode == IOTXN_OP_WRITE) {
+                txn->ops->copyfrom(txn, buffer + (txn->offset - head->offset), txn->length, 0);
+            }
+            cmd->txns[cmd->txn_count++] = txn;
         }
     } else {
-        uint8_t command[UMS_WRITE12_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE12_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE12;
-        // set lba
-        uint32_t* lba_ptr = (uint32_t*)&(command[2]);
-        *lba_ptr = htobe32(lba);
-        // set transfer length
-        uint32_t* transfer_len_ptr = (uint32_t*)&(command[6]);
-        *transfer_len_ptr = htobe32(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE12_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
+        // the data goes straight in or out of the txn
+        length = MIN(head->length - msd->head_issued, USB_BUF_SIZE);
+        mx_status_t status = iotxn_clone_window(head, &cmd->data, msd->head_issued, length, 0);
+        if (status != NO_ERROR) {
             return status;
         }
+        cmd->bounce = false;
+        cmd->data->protocol = MX_PROTOCOL_USB;
+        usb_protocol_data_t* pdata = iotxn_pdata(cmd->data, usb_protocol_data_t);
+        memset(pdata, 0, sizeof(*pdata));
+        pdata->ep_address = ep_address;
+        cmd->txns[cmd->txn_count++] = head;
+        msd->head_issued += length;
+        if (msd->head_issued == head->length) {
+            list_remove_head(&msd->queued_iotxns);
+            msd->head_issued = 0;
+        } else {
+            cmd->final = false;
+        }
     }
+    cmd->length = length;
+    cmd->data->length = length;
+    cmd->data->complete_cb = ums_cmd_part_complete;
+    cmd->data->cookie = cmd;
+
+    uint8_t command[UMS_READ16_COMMAND_LENGTH];
+    uint8_t command_len = ums_build_rw(msd, cmd->opcode, offset / msd->block_size,
+                                       length / msd->block_size, command);
+    cmd->tag = ums_fill_cbw(msd, cmd->cbw, length,
+                            (cmd->opcode == IOTXN_OP_READ) ? USB_DIR_IN : USB_DIR_OUT,
+                            command_len, command);
+    cmd->pending = 3;
+    list_add_tail(out, &cmd->cbw->node);
+    list_add_tail(out, &cmd->data->node);
+    list_add_tail(out, &cmd->csw->node);
+    return NO_ERROR;
+}
 
-    //write response
-    status = ums_queue_write(msd, transfer_length, txn);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+// Sends as many commands as there are free.  Only one thread does at a
+// time, so that each command's requests go down together, in order.
+static void ums_dispatch(ums_t* msd) {
+    list_node_t failed = LIST_INITIAL_VALUE(failed);
+
+    mtx_lock(&msd->mutex);
+    if (msd->dispatching) {
+        msd->redispatch = true;
+        mtx_unlock(&msd->mutex);
+        return;
     }
+    msd->dispatching = true;
+    do {
+        msd->redispatch = false;
+        list_node_t out = LIST_INITIAL_VALUE(out);
+        ums_cmd_t* cmd;
+        while (!list_is_empty(&msd->queued_iotxns) &&
+               (cmd = list_peek_head_type(&msd->free_cmds, ums_cmd_t, node)) != NULL) {
+            mx_status_t status = ums_start_cmd(msd, cmd, &out);
+            if (status == NO_ERROR) {
+                list_delete(&cmd->node);
+                list_add_tail(&msd->active_cmds, &cmd->node);
+            } else if (msd->head_issued == 0) {
+                iotxn_t* txn = list_remove_head_type(&msd->queued_iotxns, iotxn_t, node);
+                txn->status = status;
+                list_add_tail(&failed, &txn->node);
+                msd->txns_done++;
+            } else {
+                // part of it is on the way, so try the rest again later
+                break;
+            }
+        }
+        mtx_unlock(&msd->mutex);
 
-    // receive CSW
-    return ums_queue_csw(msd);
+        iotxn_t* txn;
+        while ((txn = list_remove_head_type(&out, iotxn_t, node)) != NULL) {
+            ums_queue_request(msd, txn);
+        }
+        mtx_lock(&msd->mutex);
+    } while (msd->redispatch);
+    msd->dispatching = false;
+    mtx_unlock(&msd->mutex);
+
+    if (!list_is_empty(&failed)) {
+        iotxn_t* txn;
+        while ((txn = list_remove_head_type(&failed, iotxn_t, node)) != NULL) {
+            txn->ops->complete(txn, txn->status, 0);
+        }
+        mtx_lock(&msd->mutex);
+        ums_signal_syncs(msd);
+        mtx_unlock(&msd->mutex);
+    }
 }
 
 static mx_status_t ums_toggle_removable(mx_device_t* device, bool removable) {
@@ -684,6 +792,14 @@ static mx_status_t ums_release(mx_device_t* device) {
     while ((txn = list_remove_head_type(&msd->free_write_reqs, iotxn_t, node)) != NULL) {
         txn->ops->release(txn);
     }
+    for (int i = 0; i < UMS_MAX_INFLIGHT; i++) {
+        if (msd->cmds[i].cbw) {
+            msd->cmds[i].cbw->ops->release(msd->cmds[i].cbw);
+        }
+        if (msd->cmds[i].csw) {
+            msd->cmds[i].csw->ops->release(msd->cmds[i].csw);
+        }
+    }
 
     free(msd);
     return NO_ERROR;
@@ -691,38 +807,37 @@ static mx_status_t ums_release(mx_device_t* device) {
 
 static void ums_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     ums_t* msd = get_ums(dev);
-    mtx_lock(&msd->mutex);
 
     uint32_t block_size = msd->block_size;
     // offset must be aligned to block size
     if (txn->offset % block_size) {
         DEBUG_PRINT(("UMS:offset on iotxn (%" PRIu64 ") not aligned to block size(%d)\n", txn->offset, block_size));
         txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
-        goto out;
+        return;
     }
 
     if (txn->length % block_size) {
         DEBUG_PRINT(("UMS:length on iotxn (%" PRIu64 ") not aligned to block size(%d)\n", txn->length, block_size));
         txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
-        goto out;
+        return;
     }
 
-    mx_status_t status;
-    if (txn->opcode == IOTXN_OP_READ) {
-        status = ums_read(dev, txn);
-    }else if (txn->opcode == IOTXN_OP_WRITE) {
-        status = ums_write(dev, txn);
-    } else {
-        status = ERR_INVALID_ARGS;
+    if ((txn->opcode != IOTXN_OP_READ) && (txn->opcode != IOTXN_OP_WRITE)) {
+        txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
+        return;
     }
-    if (status == NO_ERROR) {
-        list_add_tail(&msd->queued_iotxns, &txn->node);
-    } else {
-        txn->ops->complete(txn, status, 0);
+    if (txn->length == 0) {
+        txn->ops->complete(txn, NO_ERROR, 0);
+        return;
     }
 
-out:
+    txn->status = NO_ERROR;
+    mtx_lock(&msd->mutex);
+    list_add_tail(&msd->queued_iotxns, &txn->node);
+    msd->txns_queued++;
     mtx_unlock(&msd->mutex);
+
+    ums_dispatch(msd);
 }
 
 static ssize_t ums_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t cmdlen, void* reply, size_t max) {
@@ -745,12 +860,12 @@ static ssize_t ums_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t
         ums_sync_node_t node;
 
         mtx_lock(&msd->mutex);
-        if (list_is_empty(&msd->queued_iotxns)) {
+        if (msd->txns_done == msd->txns_queued) {
             mtx_unlock(&msd->mutex);
             return NO_ERROR;
         }
         // queue a stack allocated sync node on ums_t.sync_nodes
-        node.iotxn = list_peek_tail_type(&msd->queued_iotxns, iotxn_t, node);
+        node.seq = msd->txns_queued;
         completion_reset(&node.completion);
         list_add_head(&msd->sync_nodes, &node.node);
         mtx_unlock(&msd->mutex);
@@ -903,8 +1018,10 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device) {
     list_initialize(&msd->free_write_reqs);
     list_initialize(&msd->queued_iotxns);
     list_initialize(&msd->completed_reads);
-    list_initialize(&msd->completed_csws);
+    list_initialize(&msd->active_cmds);
+    list_initialize(&msd->free_cmds);
     list_initialize(&msd->sync_nodes);
+    mtx_init(&msd->mutex, mtx_plain);
 
     msd->udev = device;
     msd->driver = driver;
@@ -942,11 +1059,27 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device) {
         txn->cookie = msd;
         list_add_head(&msd->free_write_reqs, &txn->node);
     }
+    for (int i = 0; i < UMS_MAX_INFLIGHT; i++) {
+        ums_cmd_t* cmd = &msd->cmds[i];
+        cmd->msd = msd;
+        cmd->cbw = usb_alloc_iotxn(bulk_out_addr, UMS_COMMAND_BLOCK_WRAPPER_SIZE, 0);
+        cmd->csw = usb_alloc_iotxn(bulk_in_addr, UMS_COMMAND_STATUS_WRAPPER_SIZE, 0);
+        if (!cmd->cbw || !cmd->csw) {
+            status = ERR_NO_MEMORY;
+            goto fail;
+        }
+        cmd->cbw->complete_cb = ums_cmd_part_complete;
+        cmd->cbw->cookie = cmd;
+        cmd->csw->length = UMS_COMMAND_STATUS_WRAPPER_SIZE;
+        cmd->csw->complete_cb = ums_cmd_part_complete;
+        cmd->csw->cookie = cmd;
+        list_add_tail(&msd->free_cmds, &cmd->node);
+    }
 
     uint8_t lun = 0;
     ums_get_max_lun(msd, (void*)&lun);
     DEBUG_PRINT(("UMS:Max lun is: %02x\n", (unsigned char)lun));
-    msd->tag_send = msd->tag_receive = 8;
+    msd->tag_send = 8;
     // TODO: get this lun from some sort of valid way. not sure how multilun support works
     msd->lun = 0;
     thrd_t thread;
@@ -28,7 +28,16 @@
 
 #define MAX_SLOTS 255
 
-typedef struct usb_xhci {
+typedef struct usb_xhci usb_xhci_t;
+
+// an interrupt vector, and the interrupter whose events it brings
+typedef struct {
+    usb_xhci_t* uxhci;
+    mx_handle_t handle;
+    uint32_t interrupter;
+} xhci_irq_t;
+
+struct usb_xhci {
     xhci_t xhci;
     // the device we implement
     mx_device_t device;
@@ -39,14 +48,14 @@ typedef struct usb_xhci {
     io_alloc_t* io_alloc;
     pci_protocol_t* pci_proto;
     bool legacy_irq_mode;
-    mx_handle_t irq_handle;
+    xhci_irq_t irqs[XHCI_INTERRUPTERS_MAX];
+    uint32_t irq_count;
     mx_handle_t mmio_handle;
     mx_handle_t cfg_handle;
-    thrd_t irq_thread;
 
     // used by the start thread
     mx_device_t* parent;
-} usb_xhci_t;
+};
 #define xhci_to_usb_xhci(dev) containerof(dev, usb_xhci_t, xhci)
 #define dev_to_usb_xhci(dev) containerof(dev, usb_xhci_t, device)
 
@@ -109,31 +118,56 @@ mx_vaddr_t xhci_phys_to_virt(xhci_t* xhci, mx_paddr_t addr) {
 }
 
 static int xhci_irq_thread(void* arg) {
-    usb_xhci_t* uxhci = (usb_xhci_t*)arg;
-    xprintf("xhci_irq_thread start\n");
+    xhci_irq_t* irq = (xhci_irq_t*)arg;
+    usb_xhci_t* uxhci = irq->uxhci;
+    xprintf("xhci_irq_thread %u start\n", irq->interrupter);
+
+    if (irq->interrupter == 0) {
+        // xhci_start will block, so do this part here instead of in usb_xhci_bind
+        xhci_start(&uxhci->xhci);
+
+        // the other interrupters are set up now, so they can be waited on
+        for (uint32_t i = 1; i < uxhci->xhci.num_interrupters; i++) {
+            thrd_t thread;
+            thrd_create_with_name(&thread, xhci_irq_thread, &uxhci->irqs[i], "xhci_irq_thread");
+            thrd_detach(thread);
+        }
 
-    // xhci_start will block, so do this part here instead of in usb_xhci_bind
-    xhci_start(&uxhci->xhci);
+        device_add(&uxhci->device, uxhci->parent);
+        uxhci->parent = NULL;
+    }
 
-    device_add(&uxhci->device, uxhci->parent);
-    uxhci->parent = NULL;
+    // isochronous completions are on a deadline, so interrupter 1 gets a cpu
+    // of its own where there is one, and is not preempted there.  All our
+    // MSI vectors share one target, so interrupter 0 takes whatever cpu
+    // that leaves it.
+    uint32_t options = MX_INTERRUPT_PRIORITY_HIGH;
+    uint32_t cpu = MX_INTERRUPT_CPU_ANY;
+    if (irq->interrupter > 0) {
+        options |= MX_INTERRUPT_REAL_TIME;
+        cpu = irq->interrupter % mx_num_cpus();
+    }
+    mx_status_t status = mx_interrupt_set_affinity(irq->handle, cpu, options);
+    if (status != NO_ERROR) {
+        printf("xhci: could not set interrupter %u affinity (%d)\n", irq->interrupter, status);
+    }
 
     while (1) {
         mx_status_t wait_res;
 
-        wait_res = mx_interrupt_wait(uxhci->irq_handle);
+        wait_res = mx_interrupt_wait(irq->handle);
         if (wait_res != NO_ERROR) {
             if (wait_res != ERR_HANDLE_CLOSED) {
                 printf("unexpected pci_wait_interrupt failure (%d)\n", wait_res);
             }
-            mx_interrupt_complete(uxhci->irq_handle);
+            mx_interrupt_complete(irq->handle);
             break;
         }
 
-        mx_interrupt_complete(uxhci->irq_handle);
-        xhci_handle_interrupt(&uxhci->xhci, uxhci->legacy_irq_mode);
+        mx_interrupt_complete(irq->handle);
+        xhci_handle_interrupt(&uxhci->xhci, uxhci->legacy_irq_mode, irq->interrupter);
     }
-    xprintf("xhci_irq_thread done\n");
+    xprintf("xhci_irq_thread %u done\n", irq->interrupter);
     return 0;
 }
 
@@ -225,8 +259,16 @@ static mx_status_t xhci_do_iotxn_queue(xhci_t* xhci, iotxn_t* txn) {
     if (ep_index >= XHCI_NUM_EPS) {
          return ERR_INVALID_ARGS;
     }
-    mx_paddr_t phys_addr;
-    txn->ops->physmap(txn, &phys_addr);
+    // a transfer is at most 64K, which spans at most 17 pages
+    iotxn_sg_t sg[17];
+    uint32_t sg_count;
+    if (txn->ops->physmap_sg(txn, sg, countof(sg), &sg_count) != NO_ERROR) {
+        mx_paddr_t phys_addr;
+        txn->ops->physmap(txn, &phys_addr);
+        sg[0].paddr = phys_addr;
+        sg[0].length = txn->length;
+        sg_count = 1;
+    }
 
     xhci_transfer_context_t* context = malloc(sizeof(xhci_transfer_context_t));
     if (!context) {
@@ -243,7 +285,7 @@ static mx_status_t xhci_do_iotxn_queue(xhci_t* xhci, iotxn_t* txn) {
     } else {
         direction = data->ep_address & USB_ENDPOINT_DIR_MASK;
     }
-    return xhci_queue_transfer(xhci, data->device_id, setup, phys_addr, txn->length,
+    return xhci_queue_transfer(xhci, data->device_id, setup, sg, sg_count, txn->length,
                                  ep_index, direction, data->frame, context, &txn->node);
 }
 
@@ -271,12 +313,14 @@ void xhci_process_deferred_txns(xhci_t* xhci, xhci_transfer_ring_t* ring, bool c
 
     // requeue all deferred transactions
     // this will either add them to the transfer ring or put them back on deferred_txns list
+    xhci_defer_doorbells(xhci);
     while ((txn = list_remove_head_type(&list, iotxn_t, node)) != NULL) {
         mx_status_t status = xhci_do_iotxn_queue(xhci, txn);
         if (status != NO_ERROR && status != ERR_BUFFER_TOO_SMALL) {
             txn->ops->complete(txn, status, 0);
         }
     }
+    xhci_flush_doorbells(xhci);
 }
 
 static void xhci_iotxn_queue(mx_device_t* hci_device, iotxn_t* txn) {
@@ -310,7 +354,6 @@ static mx_protocol_device_t xhci_device_proto = {
 };
 
 static mx_status_t usb_xhci_bind(mx_driver_t* drv, mx_device_t* dev) {
-    mx_handle_t irq_handle = MX_HANDLE_INVALID;
     mx_handle_t mmio_handle = MX_HANDLE_INVALID;
     mx_handle_t cfg_handle = MX_HANDLE_INVALID;
     io_alloc_t* io_alloc = NULL;
@@ -378,8 +421,18 @@ static mx_status_t usb_xhci_bind(mx_driver_t* drv, mx_device_t* dev) {
         goto error_return;
     }
 
-    // select our IRQ mode
-    status = pci_proto->set_irq_mode(dev, MX_PCIE_IRQ_MODE_MSI, 1);
+    // select our IRQ mode: a vector for each interrupter if MSI has enough
+    uint32_t irq_count = 1;
+    uint32_t max_irqs;
+    if ((pci_proto->query_irq_mode_caps(dev, MX_PCIE_IRQ_MODE_MSI, &max_irqs) == NO_ERROR) &&
+        (max_irqs >= XHCI_INTERRUPTERS_MAX)) {
+        irq_count = XHCI_INTERRUPTERS_MAX;
+    }
+    status = pci_proto->set_irq_mode(dev, MX_PCIE_IRQ_MODE_MSI, irq_count);
+    if ((status < 0) && (irq_count > 1)) {
+        irq_count = 1;
+        status = pci_proto->set_irq_mode(dev, MX_PCIE_IRQ_MODE_MSI, irq_count);
+    }
     if (status < 0) {
         mx_status_t status_legacy = pci_proto->set_irq_mode(dev, MX_PCIE_IRQ_MODE_LEGACY, 1);
 
@@ -394,15 +447,19 @@ static mx_status_t usb_xhci_bind(mx_driver_t* drv, mx_device_t* dev) {
     }
 
     // register for interrupts
-    status = pci_proto->map_interrupt(dev, 0);
-    if (status < 0) {
-        printf("usb_xhci_bind map_interrupt failed %d\n", status);
-        goto error_return;
+    for (uint32_t i = 0; i < irq_count; i++) {
+        status = pci_proto->map_interrupt(dev, i);
+        if (status < 0) {
+            printf("usb_xhci_bind map_interrupt failed %d\n", status);
+            goto error_return;
+        }
+        uxhci->irqs[i].uxhci = uxhci;
+        uxhci->irqs[i].handle = status;
+        uxhci->irqs[i].interrupter = i;
+        uxhci->irq_count = i + 1;
     }
-    irq_handle = status;
 
     uxhci->io_alloc = io_alloc;
-    uxhci->irq_handle = irq_handle;
     uxhci->mmio_handle = mmio_handle;
     uxhci->cfg_handle = cfg_handle;
     uxhci->pci_proto = pci_proto;
@@ -412,26 +469,30 @@ static mx_status_t usb_xhci_bind(mx_driver_t* drv, mx_device_t* dev) {
 
     device_init(&uxhci->device, drv, "usb-xhci", &xhci_device_proto);
 
-    status = xhci_init(&uxhci->xhci, mmio);
+    status = xhci_init(&uxhci->xhci, mmio, irq_count);
     if (status < 0)
         goto error_return;
+    xprintf("usb-xhci: %u interrupter(s) on %u %s interrupt(s)\n",
+            uxhci->xhci.num_interrupters, irq_count, uxhci->legacy_irq_mode ? "legacy" : "MSI");
 
     uxhci->device.protocol_id = MX_PROTOCOL_USB_HCI;
     uxhci->device.protocol_ops = &xhci_hci_protocol;
 
     thrd_t thread;
-    thrd_create_with_name(&thread, xhci_irq_thread, uxhci, "xhci_irq_thread");
+    thrd_create_with_name(&thread, xhci_irq_thread, &uxhci->irqs[0], "xhci_irq_thread");
     thrd_detach(thread);
 
     return NO_ERROR;
 
 error_return:
-    if (uxhci)
+    if (uxhci) {
+        for (uint32_t i = 0; i < uxhci->irq_count; i++) {
+            mx_handle_close(uxhci->irqs[i].handle);
+        }
         free(uxhci);
+    }
     if (io_alloc)
         io_alloc_free(io_alloc);
-    if (irq_handle != MX_HANDLE_INVALID)
-        mx_handle_close(irq_handle);
     if (mmio_handle != MX_HANDLE_INVALID)
         mx_handle_close(mmio_handle);
     if (cfg_handle != MX_HANDLE_INVALID)
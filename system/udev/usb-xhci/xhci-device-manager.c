@@ -18,7 +18,8 @@
 #include "xhci-debug.h"
 
 // list of devices pending result of enable slot command
-// list is kept on xhci_t.command_queue
+// list is kept on xhci_t.command_queue, then on xhci_t.running_commands while
+// a device thread runs it
 typedef struct {
     enum {
         ENUMERATE_DEVICE,
@@ -29,8 +30,18 @@ typedef struct {
     uint32_t hub_address;
     uint32_t port;
     usb_speed_t speed;
+    // slot of the device once known, guarded by command_queue_mutex
+    uint32_t slot_id;
 } xhci_device_command_t;
 
+// state of one device thread
+typedef struct {
+    xhci_t* xhci;
+    // DMA buffers for the commands this thread runs
+    uint8_t* input_context;
+    usb_device_descriptor_t* device_descriptor;
+} xhci_device_worker_t;
+
 static uint32_t xhci_get_route_string(xhci_t* xhci, uint32_t hub_address, uint32_t port) {
     if (hub_address == 0) {
         return 0;
@@ -50,8 +61,8 @@ static uint32_t xhci_get_route_string(xhci_t* xhci, uint32_t hub_address, uint32
     return route;
 }
 
-static mx_status_t xhci_address_device(xhci_t* xhci, uint32_t slot_id, uint32_t hub_address,
-                                       uint32_t port, usb_speed_t speed) {
+static mx_status_t xhci_address_device(xhci_t* xhci, uint8_t* input_context, uint32_t slot_id,
+                                       uint32_t hub_address, uint32_t port, usb_speed_t speed) {
     xprintf("xhci_address_device slot_id: %d port: %d hub_address: %d speed: %d\n",
             slot_id, port, hub_address, speed);
 
@@ -83,9 +94,9 @@ static mx_status_t xhci_address_device(xhci_t* xhci, uint32_t slot_id, uint32_t
     if (status < 0)
         return status;
 
-    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&xhci->input_context[0 * xhci->context_size];
-    xhci_slot_context_t* sc = (xhci_slot_context_t*)&xhci->input_context[1 * xhci->context_size];
-    xhci_endpoint_context_t* ep0c = (xhci_endpoint_context_t*)&xhci->input_context[2 * xhci->context_size];
+    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&input_context[0 * xhci->context_size];
+    xhci_slot_context_t* sc = (xhci_slot_context_t*)&input_context[1 * xhci->context_size];
+    xhci_endpoint_context_t* ep0c = (xhci_endpoint_context_t*)&input_context[2 * xhci->context_size];
     memset((void*)icc, 0, xhci->context_size);
     memset((void*)sc, 0, xhci->context_size);
     memset((void*)ep0c, 0, xhci->context_size);
@@ -136,12 +147,17 @@ static mx_status_t xhci_address_device(xhci_t* xhci, uint32_t slot_id, uint32_t
     // install our device context for the slot
     XHCI_WRITE64(&xhci->dcbaa[slot_id], xhci_virt_to_phys(xhci, (mx_vaddr_t)slot->sc));
     // then send the address device command
+    // Until it completes, the device answers to the default address, so
+    // only one device at a time may be getting addressed.  The rest of the
+    // enumeration goes on in parallel.
 
     xhci_sync_command_t command;
     xhci_sync_command_init(&command);
+    mtx_lock(&xhci->address_device_mutex);
     xhci_post_command(xhci, TRB_CMD_ADDRESS_DEVICE, xhci_virt_to_phys(xhci, (mx_vaddr_t)icc),
                       (slot_id << TRB_SLOT_ID_START), &command.context);
     int cc = xhci_sync_command_wait(&command);
+    mtx_unlock(&xhci->address_device_mutex);
     if (cc == TRB_CC_SUCCESS) {
         transfer_ring->enabled = true;
         return NO_ERROR;
@@ -203,9 +219,20 @@ static void xhci_disable_slot(xhci_t* xhci, uint32_t slot_id) {
     memset(slot, 0, sizeof(*slot));
 }
 
-static mx_status_t xhci_handle_enumerate_device(xhci_t* xhci, uint32_t hub_address, uint32_t port,
-                                                usb_speed_t speed) {
+// records the slot of the device |command| is for, see xhci_command_ready_locked()
+static void xhci_set_command_slot(xhci_t* xhci, xhci_device_command_t* command, uint32_t slot_id) {
+    mtx_lock(&xhci->command_queue_mutex);
+    command->slot_id = slot_id;
+    mtx_unlock(&xhci->command_queue_mutex);
+}
+
+static mx_status_t xhci_handle_enumerate_device(xhci_device_worker_t* worker,
+                                                xhci_device_command_t* device_command) {
     xprintf("xhci_handle_enumerate_device\n");
+    xhci_t* xhci = worker->xhci;
+    uint32_t hub_address = device_command->hub_address;
+    uint32_t port = device_command->port;
+    usb_speed_t speed = device_command->speed;
     mx_status_t result = NO_ERROR;
     uint32_t slot_id = 0;
 
@@ -221,21 +248,22 @@ static mx_status_t xhci_handle_enumerate_device(xhci_t* xhci, uint32_t hub_addre
     }
     xhci_slot_t* slot = &xhci->slots[slot_id];
     memset(slot, 0, sizeof(*slot));
+    xhci_set_command_slot(xhci, device_command, slot_id);
 
-    result = xhci_address_device(xhci, slot_id, hub_address, port, speed);
+    result = xhci_address_device(xhci, worker->input_context, slot_id, hub_address, port, speed);
     if (result != NO_ERROR) {
         goto disable_slot_exit;
     }
 
     // read first 8 bytes of device descriptor to fetch ep0 max packet size
     result = xhci_get_descriptor(xhci, slot_id, USB_TYPE_STANDARD, USB_DT_DEVICE << 8, 0,
-                                 xhci->device_descriptor, 8);
+                                 worker->device_descriptor, 8);
     if (result != 8) {
         printf("xhci_get_descriptor failed\n");
         goto disable_slot_exit;
     }
 
-    int mps = xhci->device_descriptor->bMaxPacketSize0;
+    int mps = worker->device_descriptor->bMaxPacketSize0;
     // enforce correct max packet size for ep0
     switch (speed) {
         case USB_SPEED_LOW:
@@ -258,8 +286,8 @@ static mx_status_t xhci_handle_enumerate_device(xhci_t* xhci, uint32_t hub_addre
     }
 
     // update the max packet size in our device context
-    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&xhci->input_context[0 * xhci->context_size];
-    xhci_endpoint_context_t* ep0c = (xhci_endpoint_context_t*)&xhci->input_context[2 * xhci->context_size];
+    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&worker->input_context[0 * xhci->context_size];
+    xhci_endpoint_context_t* ep0c = (xhci_endpoint_context_t*)&worker->input_context[2 * xhci->context_size];
     memset((void*)icc, 0, xhci->context_size);
     memset((void*)ep0c, 0, xhci->context_size);
 
@@ -332,8 +360,12 @@ static bool xhci_stop_endpoint(xhci_t* xhci, uint32_t slot_id, int ep_index) {
     return true;
 }
 
-static mx_status_t xhci_handle_disconnect_device(xhci_t* xhci, uint32_t hub_address, uint32_t port) {
+static mx_status_t xhci_handle_disconnect_device(xhci_device_worker_t* worker,
+                                                 xhci_device_command_t* device_command) {
     xprintf("xhci_handle_disconnect_device\n");
+    xhci_t* xhci = worker->xhci;
+    uint32_t hub_address = device_command->hub_address;
+    uint32_t port = device_command->port;
     xhci_slot_t* slot = NULL;
     uint32_t slot_id;
 
@@ -356,6 +388,7 @@ static mx_status_t xhci_handle_disconnect_device(xhci_t* xhci, uint32_t hub_addr
         printf("slot not found in xhci_handle_disconnect_device\n");
         return ERR_NOT_FOUND;
     }
+    xhci_set_command_slot(xhci, device_command, slot_id);
 
     uint32_t drop_flags = 0;
     for (int i = 0; i < XHCI_NUM_EPS; i++) {
@@ -366,7 +399,7 @@ static mx_status_t xhci_handle_disconnect_device(xhci_t* xhci, uint32_t hub_addr
 
     xhci_remove_device(xhci, slot_id);
 
-    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&xhci->input_context[0 * xhci->context_size];
+    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&worker->input_context[0 * xhci->context_size];
     memset((void*)icc, 0, xhci->context_size);
     XHCI_WRITE32(&icc->drop_context_flags, drop_flags);
 
@@ -384,62 +417,122 @@ static mx_status_t xhci_handle_disconnect_device(xhci_t* xhci, uint32_t hub_addr
     return NO_ERROR;
 }
 
+static bool xhci_same_port(xhci_device_command_t* a, xhci_device_command_t* b) {
+    return a->hub_address == b->hub_address && a->port == b->port;
+}
+
+// Whether the queued |command| may run now.  Commands for one port run in the
+// order they were queued, commands for the ports of a hub wait while a command
+// for the hub itself runs, and START_ROOT_HUBS runs alone.
+static bool xhci_command_ready_locked(xhci_t* xhci, xhci_device_command_t* command) {
+    xhci_device_command_t* other;
+    list_for_every_entry (&xhci->running_commands, other, xhci_device_command_t, node) {
+        if (other->command == START_ROOT_HUBS || command->command == START_ROOT_HUBS)
+            return false;
+        if (xhci_same_port(other, command))
+            return false;
+        if (other->slot_id != 0 && other->slot_id == command->hub_address)
+            return false;
+    }
+    list_for_every_entry (&xhci->command_queue, other, xhci_device_command_t, node) {
+        if (other == command)
+            return true;
+        if (other->command == START_ROOT_HUBS || command->command == START_ROOT_HUBS)
+            return false;
+        if (xhci_same_port(other, command))
+            return false;
+    }
+    return false;
+}
+
+static xhci_device_command_t* xhci_next_command_locked(xhci_t* xhci) {
+    xhci_device_command_t* command;
+    list_for_every_entry (&xhci->command_queue, command, xhci_device_command_t, node) {
+        if (xhci_command_ready_locked(xhci, command))
+            return command;
+    }
+    return NULL;
+}
+
 static int xhci_device_thread(void* arg) {
-    xhci_t* xhci = (xhci_t*)arg;
+    xhci_device_worker_t* worker = (xhci_device_worker_t*)arg;
+    xhci_t* xhci = worker->xhci;
 
-    xhci->input_context = (uint8_t*)xhci_memalign(xhci, 64, xhci->context_size * (XHCI_NUM_EPS + 2));
-    if (!xhci->input_context) {
+    worker->input_context = (uint8_t*)xhci_memalign(xhci, 64, xhci->context_size * (XHCI_NUM_EPS + 2));
+    if (!worker->input_context) {
         printf("out of DMA memory!\n");
+        free(worker);
         return ERR_NO_MEMORY;
     }
-    xhci->device_descriptor = (usb_device_descriptor_t*)xhci_malloc(xhci, sizeof(usb_device_descriptor_t));
-    if (!xhci->device_descriptor) {
+    worker->device_descriptor = (usb_device_descriptor_t*)xhci_malloc(xhci, sizeof(usb_device_descriptor_t));
+    if (!worker->device_descriptor) {
         printf("out of DMA memory!\n");
-        xhci_free(xhci, xhci->input_context);
+        xhci_free(xhci, worker->input_context);
+        free(worker);
         return ERR_NO_MEMORY;
     }
 
     while (1) {
         xprintf("xhci_device_thread top of loop\n");
-        // wait for a device to enumerate
-        completion_wait(&xhci->command_queue_completion, MX_TIME_INFINITE);
-
+        // wait for a command we can run
         mtx_lock(&xhci->command_queue_mutex);
-        list_node_t* node = list_remove_head(&xhci->command_queue);
-        xhci_device_command_t* command = (node ? containerof(node, xhci_device_command_t, node) : NULL);
-        if (list_is_empty(&xhci->command_queue)) {
-            completion_reset(&xhci->command_queue_completion);
+        xhci_device_command_t* command;
+        while ((command = xhci_next_command_locked(xhci)) == NULL) {
+            cnd_wait(&xhci->command_queue_cond, &xhci->command_queue_mutex);
         }
+        list_delete(&command->node);
+        list_add_tail(&xhci->running_commands, &command->node);
         mtx_unlock(&xhci->command_queue_mutex);
 
-        if (!command) {
-            printf("ERROR: command_queue_completion was signaled, but no command was found");
-            break;
-        }
-
         switch (command->command) {
         case ENUMERATE_DEVICE:
-            xhci_handle_enumerate_device(xhci, command->hub_address, command->port, command->speed);
+            xhci_handle_enumerate_device(worker, command);
             break;
         case DISCONNECT_DEVICE:
-            xhci_handle_disconnect_device(xhci, command->hub_address, command->port);
+            xhci_handle_disconnect_device(worker, command);
             break;
         case START_ROOT_HUBS:
             xhci_start_root_hubs(xhci);
         }
-    }
 
-    // free our DMA buffers
-    xhci_free(xhci, xhci->input_context);
-    xhci_free(xhci, xhci->device_descriptor);
-    xhci->input_context = NULL;
-    xhci->device_descriptor = NULL;
+        // commands that waited on this one may run now
+        mtx_lock(&xhci->command_queue_mutex);
+        list_delete(&command->node);
+        cnd_broadcast(&xhci->command_queue_cond);
+        mtx_unlock(&xhci->command_queue_mutex);
+        free(command);
+    }
 
     return 0;
 }
 
-void xhci_start_device_thread(xhci_t* xhci) {
-    thrd_create_with_name(&xhci->device_thread, xhci_device_thread, xhci, "xhci_device_thread");
+void xhci_start_device_threads(xhci_t* xhci) {
+    cnd_init(&xhci->command_queue_cond);
+
+    xhci->input_context = (uint8_t*)xhci_memalign(xhci, 64, xhci->context_size * (XHCI_NUM_EPS + 2));
+    if (!xhci->input_context) {
+        printf("out of DMA memory!\n");
+        return;
+    }
+
+    // no more threads than there are slots to enumerate devices into
+    uint32_t thread_count = XHCI_MAX_DEVICE_THREADS;
+    if (thread_count > xhci->max_slots)
+        thread_count = xhci->max_slots;
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        xhci_device_worker_t* worker = calloc(1, sizeof(xhci_device_worker_t));
+        if (!worker) {
+            printf("out of memory\n");
+            return;
+        }
+        worker->xhci = xhci;
+        if (thrd_create_with_name(&xhci->device_threads[i], xhci_device_thread, worker,
+                                  "xhci_device_thread") != thrd_success) {
+            free(worker);
+            return;
+        }
+    }
 }
 
 static mx_status_t xhci_queue_command(xhci_t* xhci, int command, uint32_t hub_address,
@@ -456,7 +549,7 @@ static mx_status_t xhci_queue_command(xhci_t* xhci, int command, uint32_t hub_ad
 
     mtx_lock(&xhci->command_queue_mutex);
     list_add_tail(&xhci->command_queue, &device_command->node);
-    completion_signal(&xhci->command_queue_completion);
+    cnd_broadcast(&xhci->command_queue_cond);
     mtx_unlock(&xhci->command_queue_mutex);
 
     return NO_ERROR;
@@ -478,6 +571,7 @@ mx_status_t xhci_device_disconnected(xhci_t* xhci, uint32_t hub_address, uint32_
             xprintf("found on pending list\n");
             list_delete(&command->node);
             mtx_unlock(&xhci->command_queue_mutex);
+            free(command);
             return NO_ERROR;
         }
     }
@@ -490,12 +584,8 @@ mx_status_t xhci_queue_start_root_hubs(xhci_t* xhci) {
     return xhci_queue_command(xhci, START_ROOT_HUBS, 0, 0, USB_SPEED_UNDEFINED);
 }
 
-mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_descriptor_t* ep, bool enable) {
-    if (xhci_is_root_hub(xhci, slot_id)) {
-        // nothing to do for root hubs
-        return NO_ERROR;
-    }
-
+static mx_status_t xhci_enable_endpoint_locked(xhci_t* xhci, uint32_t slot_id,
+                                               usb_endpoint_descriptor_t* ep, bool enable) {
     xhci_slot_t* slot = &xhci->slots[slot_id];
     usb_speed_t speed = slot->speed;
     uint32_t index = xhci_endpoint_index(ep->bEndpointAddress);
@@ -572,6 +662,19 @@ mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_de
     return NO_ERROR;
 }
 
+mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_descriptor_t* ep, bool enable) {
+    if (xhci_is_root_hub(xhci, slot_id)) {
+        // nothing to do for root hubs
+        return NO_ERROR;
+    }
+
+    // the drivers of several devices may be configuring them at once
+    mtx_lock(&xhci->input_context_mutex);
+    mx_status_t status = xhci_enable_endpoint_locked(xhci, slot_id, ep, enable);
+    mtx_unlock(&xhci->input_context_mutex);
+    return status;
+}
+
 mx_status_t xhci_configure_hub(xhci_t* xhci, uint32_t slot_id, usb_speed_t speed,
                                usb_hub_descriptor_t* descriptor) {
     xprintf("xhci_configure_hub slot_id: %d speed: %d\n", slot_id, speed);
@@ -13,7 +13,7 @@ typedef struct xhci xhci_t;
 mx_status_t xhci_enumerate_device(xhci_t* xhci, uint32_t hub_address, uint32_t port,
                                   usb_speed_t speed);
 mx_status_t xhci_device_disconnected(xhci_t* xhci, uint32_t hub_address, uint32_t port);
-void xhci_start_device_thread(xhci_t* xhci);
+void xhci_start_device_threads(xhci_t* xhci);
 mx_status_t xhci_queue_start_root_hubs(xhci_t* xhci);
 mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_descriptor_t* ep,
                                  bool enable);
@@ -65,7 +65,8 @@ static mx_status_t xhci_reset_endpoint(xhci_t* xhci, uint32_t slot_id, uint32_t
     return (cc == TRB_CC_SUCCESS ? NO_ERROR : ERR_INTERNAL);
 }
 
-mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup, mx_paddr_t data,
+mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup,
+                        const iotxn_sg_t* sg, uint32_t sg_count,
                         uint16_t length, int endpoint, int direction, uint64_t frame,
                         xhci_transfer_context_t* context, list_node_t* txn_node) {
     xprintf("xhci_queue_transfer slot_id: %d setup: %p endpoint: %d length: %d\n",
@@ -89,9 +90,18 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
         xhci_reset_endpoint(xhci, slot_id, endpoint);
     }
 
-    uint32_t interruptor_target = 0;
     size_t max_transfer_size = 1 << (XFER_TRB_XFER_LENGTH_BITS - 1);
-    size_t data_packets = (length ? (length + max_transfer_size - 1) / max_transfer_size : 0);
+    // one TRB per piece of each scatter-gather entry, for the first length bytes
+    size_t data_packets = 0;
+    size_t counted = 0;
+    for (uint32_t i = 0; i < sg_count && counted < length; i++) {
+        size_t size = sg[i].length < length - counted ? sg[i].length : length - counted;
+        data_packets += (size + max_transfer_size - 1) / max_transfer_size;
+        counted += size;
+    }
+    if (counted < length) {
+        return ERR_INVALID_ARGS;
+    }
     size_t required_trbs = data_packets + 1;   // add 1 for event data TRB
     if (setup) {
         required_trbs += 2;
@@ -105,13 +115,14 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     uint32_t ep_type = XHCI_GET_BITS32(&epc->epc1, EP_CTX_EP_TYPE_START, EP_CTX_EP_TYPE_BITS);
     if (ep_type >= 4) ep_type -= 4;
     bool isochronous = (ep_type == USB_ENDPOINT_ISOCHRONOUS);
+    uint32_t interruptor_target = xhci_transfer_interrupter(xhci, ep_type);
     if (isochronous) {
-        if (!data || !length) return ERR_INVALID_ARGS;
+        if (!length || !sg[0].paddr || sg[0].length < length) return ERR_INVALID_ARGS;
         // we currently do not support isoch buffers that span page boundaries
         // Section 3.2.11 in the XHCI spec describes how to handle this, but since
         // iotxn buffers are always close to the beginning of a page, this shouldn't be necessary.
-        mx_paddr_t start_page = data & ~(xhci->page_size - 1);
-        mx_paddr_t end_page = (data + length - 1) & ~(xhci->page_size - 1);
+        mx_paddr_t start_page = sg[0].paddr & ~(xhci->page_size - 1);
+        mx_paddr_t end_page = (sg[0].paddr + length - 1) & ~(xhci->page_size - 1);
         if (start_page != end_page) {
             printf("isoch buffer spans page boundary in xhci_queue_transfer\n");
             return ERR_INVALID_ARGS;
@@ -173,14 +184,28 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     // Data Stage
     if (length > 0) {
         size_t remaining = length;
+        uint32_t entry = 0;
+        size_t entry_offset = 0;
 
         for (size_t i = 0; i < data_packets; i++) {
-            size_t transfer_size = (remaining > max_transfer_size ? max_transfer_size : remaining);
+            if (entry_offset == sg[entry].length) {
+                entry++;
+                entry_offset = 0;
+            }
+            size_t transfer_size = sg[entry].length - entry_offset;
+            if (transfer_size > max_transfer_size) {
+                transfer_size = max_transfer_size;
+            }
+            if (transfer_size > remaining) {
+                transfer_size = remaining;
+            }
+            mx_paddr_t paddr = sg[entry].paddr + entry_offset;
+            entry_offset += transfer_size;
             remaining -= transfer_size;
 
             xhci_trb_t* trb = ring->current;
             xhci_clear_trb(trb);
-            XHCI_WRITE64(&trb->ptr, data + (i * max_transfer_size));
+            XHCI_WRITE64(&trb->ptr, paddr);
             XHCI_SET_BITS32(&trb->status, XFER_TRB_XFER_LENGTH_START, XFER_TRB_XFER_LENGTH_BITS, transfer_size);
             uint32_t td_size = data_packets - i - 1;
             XHCI_SET_BITS32(&trb->status, XFER_TRB_TD_SIZE_START, XFER_TRB_TD_SIZE_BITS, td_size);
@@ -248,7 +273,7 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     // update dequeue_ptr to TRB following this transaction
     context->dequeue_ptr = ring->current;
 
-    XHCI_WRITE32(&xhci->doorbells[slot_id], endpoint + 1);
+    xhci_ring_doorbell(xhci, slot_id, endpoint + 1);
 
     mtx_unlock(&ring->mutex);
 
@@ -270,7 +295,8 @@ int xhci_control_request(xhci_t* xhci, uint32_t slot_id, uint8_t request_type, u
     xhci_sync_transfer_t xfer;
     xhci_sync_transfer_init(&xfer);
 
-    mx_status_t result = xhci_queue_transfer(xhci, slot_id, &setup, data, length, 0,
+    iotxn_sg_t sg = { .paddr = data, .length = length };
+    mx_status_t result = xhci_queue_transfer(xhci, slot_id, &setup, &sg, 1, length, 0,
                                              request_type & USB_DIR_MASK, 0, &xfer.context, NULL);
     if (result != NO_ERROR)
         return result;
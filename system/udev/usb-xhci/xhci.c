@@ -105,10 +105,11 @@ static void xhci_read_extended_caps(xhci_t* xhci, void* mmio, volatile uint32_t*
     }
 }
 
-mx_status_t xhci_init(xhci_t* xhci, void* mmio) {
+mx_status_t xhci_init(xhci_t* xhci, void* mmio, uint32_t num_interrupts) {
     mx_status_t result = NO_ERROR;
 
     list_initialize(&xhci->command_queue);
+    list_initialize(&xhci->running_commands);
 
     xhci->cap_regs = (xhci_cap_regs_t*)mmio;
     xhci->op_regs = (xhci_op_regs_t*)((uint8_t*)xhci->cap_regs + xhci->cap_regs->length);
@@ -175,10 +176,22 @@ mx_status_t xhci_init(xhci_t* xhci, void* mmio) {
         printf("xhci_command_ring_init failed\n");
         goto fail;
     }
-    result = xhci_event_ring_init(xhci, 0, EVENT_RING_SIZE);
-    if (result != NO_ERROR) {
-        printf("xhci_event_ring_init failed\n");
-        goto fail;
+    xhci->num_interrupters = XHCI_INTERRUPTERS_MAX;
+    if (xhci->num_interrupters > num_interrupts) {
+        xhci->num_interrupters = num_interrupts;
+    }
+    if (xhci->num_interrupters > xhci->max_interruptors) {
+        xhci->num_interrupters = xhci->max_interruptors;
+    }
+    if (xhci->num_interrupters < 1) {
+        xhci->num_interrupters = 1;
+    }
+    for (uint32_t i = 0; i < xhci->num_interrupters; i++) {
+        result = xhci_event_ring_init(xhci, i, EVENT_RING_SIZE);
+        if (result != NO_ERROR) {
+            printf("xhci_event_ring_init failed\n");
+            goto fail;
+        }
     }
 
     xhci->rh_map = (uint8_t *)calloc(xhci->rh_num_ports, sizeof(uint8_t));
@@ -207,7 +220,9 @@ fail:
     }
     free(xhci->rh_map);
     free(xhci->rh_port_map);
-    xhci_event_ring_free(xhci, 0);
+    for (uint32_t i = 0; i < xhci->num_interrupters; i++) {
+        xhci_event_ring_free(xhci, i);
+    }
     xhci_transfer_ring_free(xhci, &xhci->command_ring);
     if (xhci->scratch_pad) {
         for (size_t i = 0; i < scratch_pad_bufs; i++) {
@@ -236,6 +251,9 @@ static void xhci_interruptor_init(xhci_t* xhci, int interruptor) {
 
     xhci_update_erdp(xhci, interruptor);
 
+    // a floor between interrupts, so that a burst of completions is
+    // handled in one go
+    XHCI_SET32(&intr_regs->imod, IMOD_IMODI_MASK, XHCI_IMODI);
     XHCI_SET32(&intr_regs->iman, IMAN_IE, IMAN_IE);
     XHCI_SET32(&intr_regs->erstsz, ERSTSZ_MASK, ERST_ARRAY_SIZE);
     XHCI_WRITE64(&intr_regs->erstba, xhci_virt_to_phys(xhci,
@@ -276,15 +294,16 @@ void xhci_start(xhci_t* xhci) {
     XHCI_SET_BITS32(&op_regs->config, CONFIG_MAX_SLOTS_ENABLED_START,
                     CONFIG_MAX_SLOTS_ENABLED_BITS, xhci->max_slots);
 
-    // initialize interruptor (only using one for now)
-    xhci_interruptor_init(xhci, 0);
+    for (uint32_t i = 0; i < xhci->num_interrupters; i++) {
+        xhci_interruptor_init(xhci, i);
+    }
 
     // start the controller with interrupts and mfindex wrap events enabled
     uint32_t start_flags = USBCMD_RS | USBCMD_INTE | USBCMD_EWE;
     XHCI_SET32(usbcmd, start_flags, start_flags);
     xhci_wait_bits(usbsts, USBSTS_HCH, 0);
 
-    xhci_start_device_thread(xhci);
+    xhci_start_device_threads(xhci);
 }
 
 void xhci_post_command(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t control_bits,
@@ -349,8 +368,47 @@ uint64_t xhci_get_current_frame(xhci_t* xhci) {
     return ((wrap_count * (1 << XHCI_MFINDEX_BITS)) + mfindex) >> 3;
 }
 
+void xhci_ring_doorbell(xhci_t* xhci, uint32_t slot_id, uint32_t endpoint) {
+    mtx_lock(&xhci->doorbell_mutex);
+    if (xhci->doorbell_defer > 0) {
+        xhci->slots[slot_id].doorbells |= (1u << endpoint);
+        xhci->doorbells_pending = true;
+    } else {
+        XHCI_WRITE32(&xhci->doorbells[slot_id], endpoint);
+    }
+    mtx_unlock(&xhci->doorbell_mutex);
+}
+
+void xhci_defer_doorbells(xhci_t* xhci) {
+    mtx_lock(&xhci->doorbell_mutex);
+    xhci->doorbell_defer++;
+    mtx_unlock(&xhci->doorbell_mutex);
+}
+
+void xhci_flush_doorbells(xhci_t* xhci) {
+    mtx_lock(&xhci->doorbell_mutex);
+    if ((--xhci->doorbell_defer == 0) && xhci->doorbells_pending) {
+        for (size_t slot_id = 1; slot_id < xhci->max_slots; slot_id++) {
+            uint32_t doorbells = xhci->slots[slot_id].doorbells;
+            xhci->slots[slot_id].doorbells = 0;
+            while (doorbells) {
+                uint32_t endpoint = __builtin_ctz(doorbells);
+                doorbells &= ~(1u << endpoint);
+                XHCI_WRITE32(&xhci->doorbells[slot_id], endpoint);
+            }
+        }
+        xhci->doorbells_pending = false;
+    }
+    mtx_unlock(&xhci->doorbell_mutex);
+}
+
 static void xhci_handle_events(xhci_t* xhci, int interruptor) {
     xhci_event_ring_t* er = &xhci->event_rings[interruptor];
+    uint32_t handled = 0;
+
+    // transfers queued by the completion callbacks go to the controller
+    // together once the events are dealt with
+    xhci_defer_doorbells(xhci);
 
     // process all TRBs with cycle bit matching our CCS
     while ((XHCI_READ32(&er->current->control) & TRB_C) == er->ccs) {
@@ -378,11 +436,32 @@ static void xhci_handle_events(xhci_t* xhci, int interruptor) {
             er->current = er->start;
             er->ccs ^= TRB_C;
         }
-        xhci_update_erdp(xhci, interruptor);
+        // the controller only needs to hear of the room made often enough
+        // that the ring doesn't fill
+        if (++handled % EVENT_RING_BATCH == 0) {
+            xhci_update_erdp(xhci, interruptor);
+        }
     }
+    xhci_update_erdp(xhci, interruptor);
+
+    xhci_flush_doorbells(xhci);
 }
 
-void xhci_handle_interrupt(xhci_t* xhci, bool legacy) {
+uint32_t xhci_transfer_interrupter(xhci_t* xhci, uint32_t ep_type) {
+    if ((ep_type == USB_ENDPOINT_ISOCHRONOUS) &&
+        (xhci->num_interrupters > XHCI_INTERRUPTER_ISOCH)) {
+        return XHCI_INTERRUPTER_ISOCH;
+    }
+    return 0;
+}
+
+void xhci_handle_interrupt(xhci_t* xhci, bool legacy, uint32_t interrupter) {
+    if (interrupter > 0) {
+        // only transfer events come here, on a vector of their own
+        xhci_handle_events(xhci, interrupter);
+        return;
+    }
+
     volatile uint32_t* usbsts = &xhci->op_regs->usbsts;
     const int interruptor = 0;
 
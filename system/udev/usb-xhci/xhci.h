@@ -17,14 +17,32 @@
 #include "xhci-trb.h"
 
 #define COMMAND_RING_SIZE 8
-#define EVENT_RING_SIZE 64
-#define TRANSFER_RING_SIZE 64
+// a page each, so several scatter-gather transfers can be in flight on an
+// endpoint, and the completions of all of them wait on the event ring
+#define EVENT_RING_SIZE 256
+#define TRANSFER_RING_SIZE 256
+// events handled between updates of the event ring dequeue pointer
+#define EVENT_RING_BATCH 64
+// interrupt moderation interval, in 250ns units
+#define XHCI_IMODI 160
 #define ERST_ARRAY_SIZE 1
 
+// Interrupter 0 takes command completions, port changes and the events of
+// all but isochronous endpoints.  With a second interrupt vector those get
+// interrupter 1, with a thread of its own, so that a busy bulk device
+// doesn't hold up audio and video.
+#define XHCI_INTERRUPTERS_MAX 2
+#define XHCI_INTERRUPTER_ISOCH 1
+
 #define XHCI_RH_USB_2 0 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_USB_3 1 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_COUNT 2 // number of virtual root hub devices
 
+// Threads running the device commands of xhci-device-manager.c, so devices on
+// different ports enumerate at once.  Each has at most one command on the
+// command ring, which must leave room for everyone else's.
+#define XHCI_MAX_DEVICE_THREADS 4
+
 typedef struct xhci_slot {
     xhci_slot_context_t* sc;
     // epcs point into DMA memory past sc
@@ -34,6 +52,8 @@ typedef struct xhci_slot {
     uint32_t port;
     uint32_t rh_port;
     usb_speed_t speed;
+    // endpoints with transfers queued while doorbells were deferred
+    uint32_t doorbells;
 } xhci_slot_t;
 
 typedef struct xhci xhci_t;
@@ -60,8 +80,9 @@ struct xhci {
     xhci_transfer_ring_t command_ring;
     xhci_command_context_t* command_contexts[COMMAND_RING_SIZE];
 
-    // One event ring for now, but we will have multiple if we use multiple interruptors
-    xhci_event_ring_t event_rings[1];
+    // one event ring for each interrupter in use
+    xhci_event_ring_t event_rings[XHCI_INTERRUPTERS_MAX];
+    uint32_t num_interrupters;
 
     size_t page_size;
     size_t max_slots;
@@ -84,17 +105,23 @@ struct xhci {
     uint8_t* rh_port_map;
 
     // device thread stuff
-    thrd_t device_thread;
+    thrd_t device_threads[XHCI_MAX_DEVICE_THREADS];
     xhci_slot_t* slots;
 
     // for command processing in xhci-device-manager.c
     list_node_t command_queue;
+    // commands taken off command_queue by a device thread, not yet done
+    list_node_t running_commands;
     mtx_t command_queue_mutex;
-    completion_t command_queue_completion;
+    // signaled when a command is queued or done
+    cnd_t command_queue_cond;
+
+    // serializes TRB_CMD_ADDRESS_DEVICE, see xhci_address_device()
+    mtx_t address_device_mutex;
 
-    // DMA buffers used by xhci_device_thread in xhci-device-manager.c
+    // DMA buffer used by xhci_enable_endpoint() in xhci-device-manager.c
     uint8_t* input_context;
-    usb_device_descriptor_t* device_descriptor;
+    mtx_t input_context_mutex;
 
     // for xhci_get_current_frame()
     mtx_t mfindex_mutex;
@@ -102,15 +129,32 @@ struct xhci {
     uint64_t mfindex_wrap_count;
    // time of last mfindex wrap
     mx_time_t last_mfindex_wrap;
+
+    // see xhci_defer_doorbells()
+    mtx_t doorbell_mutex;
+    uint32_t doorbell_defer;
+    bool doorbells_pending;
 };
 
-mx_status_t xhci_init(xhci_t* xhci, void* mmio);
+// num_interrupts is how many interrupt vectors there are to spread the
+// interrupters over
+mx_status_t xhci_init(xhci_t* xhci, void* mmio, uint32_t num_interrupts);
 void xhci_start(xhci_t* xhci);
-void xhci_handle_interrupt(xhci_t* xhci, bool legacy);
+void xhci_handle_interrupt(xhci_t* xhci, bool legacy, uint32_t interrupter);
+// the interrupter for the events of transfers on an endpoint of this type
+uint32_t xhci_transfer_interrupter(xhci_t* xhci, uint32_t ep_type);
 void xhci_post_command(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t control_bits,
                        xhci_command_context_t* context);
 void xhci_wait_bits(volatile uint32_t* ptr, uint32_t bits, uint32_t expected);
 
+// Rings the doorbell of the endpoint, which takes the device context index,
+// or leaves it for xhci_flush_doorbells() while doorbells are deferred.
+void xhci_ring_doorbell(xhci_t* xhci, uint32_t slot_id, uint32_t endpoint);
+// Between these, transfers queued from any thread ring their endpoint's
+// doorbell once, at the end, rather than once each.  They nest.
+void xhci_defer_doorbells(xhci_t* xhci);
+void xhci_flush_doorbells(xhci_t* xhci);
+
 // returns monotonically increasing frame count
 uint64_t xhci_get_current_frame(xhci_t* xhci);
 
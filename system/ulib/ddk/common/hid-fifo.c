@@ -39,6 +39,18 @@ ssize_t mx_hid_fifo_peek(mx_hid_fifo_t* fifo, void* out) {
     return 1;
 }
 
+ssize_t mx_hid_fifo_peek_buf(mx_hid_fifo_t* fifo, void* buf, size_t len) {
+    if (!buf) return ERR_INVALID_ARGS;
+    if (fifo->empty) return 0;
+
+    len = min(mx_hid_fifo_size(fifo), len);
+    uint32_t c = fifo->tail;
+    for (size_t i = 0; i < len; i++, c = (c + 1) & HID_FIFO_MASK) {
+        ((uint8_t*)buf)[i] = fifo->buf[c];
+    }
+    return len;
+}
+
 ssize_t mx_hid_fifo_read(mx_hid_fifo_t* fifo, void* buf, size_t len) {
     if (!buf) return ERR_INVALID_ARGS;
     if (fifo->empty) return 0;
@@ -6,6 +6,7 @@
 #include <ddk/common/hid-fifo.h>
 
 #include <magenta/listnode.h>
+#include <magenta/syscalls.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -14,6 +15,7 @@
 
 #define HID_FLAGS_DEAD         (1 << 0)
 #define HID_FLAGS_WRITE_FAILED (1 << 1)
+#define HID_FLAGS_TIMESTAMPS   (1 << 2)
 
 #define USB_HID_DEBUG 0
 
@@ -38,6 +40,7 @@ typedef struct mx_hid_instance {
 
     uint32_t flags;
 
+    // each report is queued after an input_report_header_t
     mx_hid_fifo_t fifo;
 
     struct list_node node;
@@ -217,46 +220,47 @@ static ssize_t hid_read_instance(mx_device_t* dev, void* buf, size_t count, mx_o
         return ERR_REMOTE_CLOSED;
     }
 
-    size_t left;
     mtx_lock(&hid->fifo.lock);
-    size_t xfer;
-    uint8_t rpt_id = 0;
-    if (hid->root->num_reports > 1) {
-        ssize_t r = mx_hid_fifo_peek(&hid->fifo, &rpt_id);
-        if (r < 1) {
-            // fifo is empty
-            mtx_unlock(&hid->fifo.lock);
-            return ERR_SHOULD_WAIT;
+    bool timestamps = hid->flags & HID_FLAGS_TIMESTAMPS;
+    size_t hdr_size = timestamps ? sizeof(input_report_header_t) : 0;
+    uint8_t* out = buf;
+    size_t xfer = 0;
+    input_report_header_t hdr;
+    while (mx_hid_fifo_peek_buf(&hid->fifo, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+        if (xfer + hdr_size + hdr.len > count) {
+            break;
+        }
+        mx_hid_fifo_read(&hid->fifo, &hdr, sizeof(hdr));
+        memcpy(out + xfer, &hdr, hdr_size);
+        mx_hid_fifo_read(&hid->fifo, out + xfer + hdr_size, hdr.len);
+        xfer += hdr_size + hdr.len;
+        // without timestamps the reports can't be told apart, so only one
+        // goes out per read
+        if (!timestamps) {
+            break;
         }
     }
-    xfer = hid_get_report_size_by_id(hid->root, rpt_id, INPUT_REPORT_INPUT);
-    if (xfer == 0) {
-        printf("error reading hid device: unknown report id (%u)!\n", rpt_id);
-        mtx_unlock(&hid->fifo.lock);
-        return ERR_BAD_STATE;
-    }
-#if BOOT_MOUSE_HACK
-    if (hid->root->dev_class != HID_DEV_CLASS_POINTER) {
-#endif
-    if (hid->root->num_reports > 1) {
-        // account for the report id
-        xfer++;
-    }
-#if BOOT_MOUSE_HACK
-    }
-#endif
-    if (xfer > count) {
-        printf("next report: %zd, read count: %zd\n", xfer, count);
-        mtx_unlock(&hid->fifo.lock);
-        return ERR_BUFFER_TOO_SMALL;
-    }
-    ssize_t r = mx_hid_fifo_read(&hid->fifo, buf, xfer);
-    left = mx_hid_fifo_size(&hid->fifo);
+    size_t left = mx_hid_fifo_size(&hid->fifo);
     if (left == 0) {
         device_state_clr(&hid->dev, DEV_STATE_READABLE);
     }
     mtx_unlock(&hid->fifo.lock);
-    return r ? r : (ssize_t)ERR_SHOULD_WAIT;
+
+    if (xfer == 0) {
+        if (left == 0) {
+            return ERR_SHOULD_WAIT;
+        }
+        printf("next report: %zd, read count: %zd\n", hdr_size + hdr.len, count);
+        return ERR_BUFFER_TOO_SMALL;
+    }
+    return xfer;
+}
+
+static mx_status_t hid_enable_timestamps(mx_hid_instance_t* hid) {
+    mtx_lock(&hid->fifo.lock);
+    hid->flags |= HID_FLAGS_TIMESTAMPS;
+    mtx_unlock(&hid->fifo.lock);
+    return NO_ERROR;
 }
 
 static ssize_t hid_ioctl_instance(mx_device_t* dev, uint32_t op,
@@ -283,6 +287,8 @@ static ssize_t hid_ioctl_instance(mx_device_t* dev, uint32_t op,
         return hid_get_report(hid->root, in_buf, in_len, out_buf, out_len);
     case IOCTL_INPUT_SET_REPORT:
         return hid_set_report(hid->root, in_buf, in_len);
+    case IOCTL_INPUT_ENABLE_TIMESTAMPS:
+        return hid_enable_timestamps(hid);
     }
     return ERR_NOT_SUPPORTED;
 }
@@ -584,12 +590,32 @@ mx_protocol_device_t hid_device_proto = {
 };
 
 void hid_io_queue(mx_hid_device_t* hid, const uint8_t* buf, size_t len) {
+    // drivers queue reports as they come in, so this is the time the device
+    // sent it, near enough
+    input_report_header_t hdr = {
+        .timestamp = mx_ticks_get(),
+    };
+#if BOOT_MOUSE_HACK
+    // boot protocol mice may tack vendor data onto the 3 byte report
+    if (hid->dev_class == HID_DEV_CLASS_POINTER && len > 3) len = 3;
+#endif
+    if (len > HID_FIFO_SIZE - sizeof(hdr)) {
+        printf("%s: hid report too large (%zu)\n", hid->dev.name, len);
+        return;
+    }
+    hdr.len = (input_report_size_t)len;
+
     mtx_lock(&hid->instance_lock);
     mx_hid_instance_t* instance;
     foreach_instance(hid, instance) {
         mtx_lock(&instance->fifo.lock);
-        bool was_empty = mx_hid_fifo_size(&instance->fifo) == 0;
-        ssize_t wrote = mx_hid_fifo_write(&instance->fifo, buf, len);
+        size_t size = mx_hid_fifo_size(&instance->fifo);
+        // the header and report go in together or not at all
+        ssize_t wrote = ERR_BUFFER_TOO_SMALL;
+        if (HID_FIFO_SIZE - size >= sizeof(hdr) + len) {
+            mx_hid_fifo_write(&instance->fifo, &hdr, sizeof(hdr));
+            wrote = mx_hid_fifo_write(&instance->fifo, buf, len);
+        }
         if (wrote <= 0) {
             if (!(instance->flags & HID_FLAGS_WRITE_FAILED)) {
                 printf("%s: could not write to hid fifo (ret=%zd)\n",
@@ -598,7 +624,9 @@ void hid_io_queue(mx_hid_device_t* hid, const uint8_t* buf, size_t len) {
             }
         } else {
             instance->flags &= ~HID_FLAGS_WRITE_FAILED;
-            if (was_empty) {
+            // the signal stays up until the fifo is drained, so only the
+            // first report needs to raise it
+            if (size == 0) {
                 device_state_set(&instance->dev, DEV_STATE_READABLE);
             }
         }
@@ -32,6 +32,7 @@ mx_status_t mx_hid_fifo_create(mx_hid_fifo_t** fifo);
 void mx_hid_fifo_init(mx_hid_fifo_t* fifo);
 size_t mx_hid_fifo_size(mx_hid_fifo_t* fifo);
 ssize_t mx_hid_fifo_peek(mx_hid_fifo_t* fifo, void* out);
+ssize_t mx_hid_fifo_peek_buf(mx_hid_fifo_t* fifo, void* buf, size_t len);
 ssize_t mx_hid_fifo_read(mx_hid_fifo_t* fifo, void* buf, size_t len);
 ssize_t mx_hid_fifo_write(mx_hid_fifo_t* fifo, const void* buf, size_t len);
 
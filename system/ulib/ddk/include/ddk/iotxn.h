@@ -8,12 +8,19 @@
 #include <magenta/types.h>
 #include <magenta/listnode.h>
 #include <ddk/driver.h>
+#include <ddk/io-buffer.h>
 
 __BEGIN_CDECLS;
 
 typedef struct iotxn iotxn_t;
 typedef struct iotxn_ops iotxn_ops_t;
 
+// a physically contiguous piece of an iotxn's data
+typedef struct iotxn_sg {
+    mx_paddr_t paddr;
+    uint64_t length;
+} iotxn_sg_t;
+
 // An IO Transaction (iotxn) is an object that records all the state
 // necessary to accomplish an io operation -- the general (len/off)
 // and protocol specific (eg, usb endpoint and transfer type) parameters
@@ -99,9 +106,46 @@ struct iotxn {
 // and extra storage space of extra_size
 mx_status_t iotxn_alloc(iotxn_t** out, uint32_t flags, size_t data_size, size_t extra_size);
 
+// create a new iotxn whose payload is data_size bytes of an existing
+// io_buffer, starting at offset; the buffer must be physically
+// contiguous and must outlive the iotxn, which doesn't own it
+mx_status_t iotxn_alloc_window(iotxn_t** out, io_buffer_t* buffer, mx_off_t offset,
+                               size_t data_size, size_t extra_size);
+
+// create a new iotxn whose payload is data_size bytes of a vmo, starting
+// at offset, which needn't be physically contiguous; the iotxn keeps its
+// own handle to the vmo, and commits and maps the range
+mx_status_t iotxn_alloc_vmo(iotxn_t** out, mx_handle_t vmo, mx_off_t offset, size_t data_size,
+                            size_t extra_size);
+
+// create a clone of txn whose payload is the data_size bytes of txn's
+// starting at offset, so that part of a request can be passed on without
+// copying it; like any clone, it must not outlive txn
+mx_status_t iotxn_clone_window(iotxn_t* txn, iotxn_t** out, mx_off_t offset, size_t data_size,
+                               size_t extra_size);
+
 // queue an iotxn against a device
 void iotxn_queue(mx_device_t* dev, iotxn_t* txn);
 
+// a pool of iotxns whose buffers are allocated once and reused, so that
+// taking one and releasing it again doesn't go to the kernel
+typedef struct iotxn_pool iotxn_pool_t;
+
+// create a pool of count iotxns, each with payload space of data_size
+// and extra storage space of extra_size
+mx_status_t iotxn_pool_create(iotxn_pool_t** out, uint32_t count, size_t data_size,
+                              size_t extra_size);
+
+// take an iotxn with payload space of data_size from the pool; unlike
+// iotxn_alloc() the payload isn't cleared.  ops->release() gives it back.
+// The pool grows if it is empty, and a data_size bigger than the pool's
+// is passed on to iotxn_alloc().
+mx_status_t iotxn_pool_alloc(iotxn_pool_t* pool, iotxn_t** out, size_t data_size);
+
+// free the pool; iotxns taken from it and not yet released are freed
+// when they are
+void iotxn_pool_destroy(iotxn_pool_t* pool);
+
 
 struct iotxn_ops {
     // complete() must be called by the processor when the io operation has
@@ -131,6 +175,13 @@ struct iotxn_ops {
     // be the buffer itself, or a temporary, depending on conditions.
     void (*physmap)(iotxn_t* txn, mx_paddr_t* addr);
 
+    // physmap_sg() fills in the physical pieces of the first txn->length
+    // bytes of the iotxn's data, in order, with neighbouring pages merged,
+    // so that a driver with a scatter-gather list can DMA to and from the
+    // data where it is, however fragmented.  Returns ERR_BUFFER_TOO_SMALL
+    // if it takes more than max pieces.
+    mx_status_t (*physmap_sg)(iotxn_t* txn, iotxn_sg_t* sg, uint32_t max, uint32_t* count);
+
     // mmap() returns a void* pointing at the data in the iotxn's buffer.
     // This may have to do an expensive memory map operation or copy data
     // to a local buffer.  copyfrom(), copyto(), or physmap() are almost
@@ -29,6 +29,22 @@ typedef struct mx_display_protocol {
 
     void (*flush)(mx_device_t* dev);
     // flushes the framebuffer
+
+    void (*flush_region)(mx_device_t* dev, const ioctl_display_region_t* regions, uint32_t count);
+    // flushes count rectangles of the framebuffer, where a driver can do
+    // less than a full flush for them
+
+    mx_status_t (*get_page)(mx_device_t* dev, uint32_t page, void** framebuffer);
+    // gets a pointer to a page of the framebuffer, each of which holds a
+    // whole frame in the current mode.  page 0 is what get_framebuffer
+    // returns; ERR_OUT_OF_RANGE past the last page
+
+    mx_status_t (*flip)(mx_device_t* dev, uint32_t page);
+    // scans out from page, switching at the next vsync so no frame is torn,
+    // and returns once it has switched
+
+    // flush_region, get_page and flip are optional.  a display without them
+    // has a single page, flushed whole
 } mx_display_protocol_t;
 
 __END_CDECLS;
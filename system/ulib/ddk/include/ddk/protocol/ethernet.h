@@ -18,8 +18,33 @@ typedef struct ethernet_protocol {
     mx_status_t (*get_mac_addr)(mx_device_t* device, uint8_t* out_addr);
     bool (*is_online)(mx_device_t* device);
     size_t (*get_mtu)(mx_device_t* device);
+    // optional, returns ETH_FEATURE_* flags
+    uint32_t (*get_features)(mx_device_t* device);
+
+    // Optional, for devices that steer received frames to several queues
+    // by a hash of their flow.  Without them there is one queue, which
+    // recv() serves and the device's DEV_STATE_READABLE follows, as it
+    // still does for queue 0 with them.
+    uint32_t (*get_rx_queues)(mx_device_t* device);
+    // like recv(), for one queue; the flow hash goes in *hash, if that
+    // isn't NULL, or 0 for frames the device couldn't parse
+    mx_status_t (*recv_queue)(mx_device_t* device, uint32_t queue, void* buffer, size_t length,
+                              uint32_t* hash);
+    // an event, owned by the device, with DEV_STATE_READABLE asserted
+    // while the queue has frames
+    mx_handle_t (*get_rx_queue_event)(mx_device_t* device, uint32_t queue);
 } ethernet_protocol_t;
 
 #define ETH_MAC_SIZE 6
 
+// Received frames have had their IPv4 header and TCP or UDP checksums
+// checked, where the device understood the headers, and frames that
+// failed are dropped.
+#define ETH_FEATURE_RX_CSUM (1 << 0)
+// The device can fill in IPv4 header and TCP or UDP checksums of frames
+// it sends.
+#define ETH_FEATURE_TX_CSUM (1 << 1)
+// The device can cut TCP segments bigger than the MTU into frames.
+#define ETH_FEATURE_TSO     (1 << 2)
+
 __END_CDECLS;
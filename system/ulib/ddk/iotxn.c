@@ -7,10 +7,12 @@
 #include <ddk/device.h>
 #include <magenta/syscalls.h>
 #include <sys/param.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <threads.h>
+#include <limits.h>
 
 #define TRACE 0
 
@@ -24,6 +26,8 @@
 
 #define IOTXN_FLAG_CLONE (1 << 0)
 #define IOTXN_FLAG_FREE  (1 << 1)   // for double-free checking
+#define IOTXN_FLAG_VMO   (1 << 2)   // buffer is a mapping of a vmo that
+                                    // may not be physically contiguous
 
 typedef struct iotxn_priv iotxn_priv_t;
 
@@ -38,17 +42,48 @@ struct iotxn_priv {
     // extra data, at the end of this ioxtn_t structure
     size_t extra_size;
 
+    // for IOTXN_FLAG_VMO, where the data starts in the vmo, and a
+    // contiguous copy of it for physmap() if anyone has asked for one
+    mx_off_t vmo_offset;
+    io_buffer_t bounce;
+
+    // the pool the txn goes back to when released, if any
+    iotxn_pool_t* pool;
+
     iotxn_t txn; // must be at the end for extra data, only valid if not a clone
 };
 
 #define get_priv(iotxn) containerof(iotxn, iotxn_priv_t, txn)
 
+struct iotxn_pool {
+    mtx_t lock;
+    list_node_t free_list;
+    size_t data_size;
+    size_t extra_size;
+    // txns taken and not yet given back
+    uint32_t outstanding;
+    bool destroyed;
+};
+
 static list_node_t free_list = LIST_INITIAL_VALUE(free_list);
 static list_node_t clone_list = LIST_INITIAL_VALUE(clone_list); // free list for clones
 static mtx_t free_list_mutex = MTX_INIT;
 static mtx_t clone_list_mutex = MTX_INIT;
 
+static void bounce_release(iotxn_priv_t* priv) {
+    mx_process_unmap_vm(mx_process_self(), (uintptr_t)priv->bounce.virt, priv->bounce.size);
+    io_buffer_release(&priv->bounce);
+}
+
 static void iotxn_complete(iotxn_t* txn, mx_status_t status, mx_off_t actual) {
+    iotxn_priv_t* priv = get_priv(txn);
+    if (io_buffer_is_valid(&priv->bounce)) {
+        if ((txn->opcode == IOTXN_OP_READ) && (status == NO_ERROR)) {
+            memcpy(io_buffer_virt(&priv->buffer), io_buffer_virt(&priv->bounce),
+                   MIN(actual, priv->data_size));
+        }
+        bounce_release(priv);
+    }
     txn->actual = actual;
     txn->status = status;
     if (txn->complete_cb) {
@@ -70,7 +105,73 @@ static void iotxn_copyto(iotxn_t* txn, const void* data, size_t length, size_t o
 
 static void iotxn_physmap(iotxn_t* txn, mx_paddr_t* addr) {
     iotxn_priv_t* priv = get_priv(txn);
-    *addr = priv->buffer.phys;
+    if (!(priv->flags & IOTXN_FLAG_VMO)) {
+        *addr = priv->buffer.phys;
+        return;
+    }
+    // the caller wants one address, so the data goes through a contiguous
+    // buffer, copied back by complete() for reads
+    if (!io_buffer_is_valid(&priv->bounce)) {
+        if (io_buffer_init(&priv->bounce, priv->data_size, IO_BUFFER_RW) != NO_ERROR) {
+            *addr = 0;
+            return;
+        }
+        if (txn->opcode == IOTXN_OP_WRITE) {
+            memcpy(io_buffer_virt(&priv->bounce), io_buffer_virt(&priv->buffer), priv->data_size);
+        }
+    }
+    *addr = io_buffer_phys(&priv->bounce);
+}
+
+static mx_status_t iotxn_physmap_sg(iotxn_t* txn, iotxn_sg_t* sg, uint32_t max, uint32_t* count) {
+    iotxn_priv_t* priv = get_priv(txn);
+    uint64_t length = MIN(txn->length, priv->data_size);
+    *count = 0;
+    if (length == 0) {
+        return NO_ERROR;
+    }
+    if (max == 0) {
+        return ERR_BUFFER_TOO_SMALL;
+    }
+    if (!(priv->flags & IOTXN_FLAG_VMO)) {
+        sg[0].paddr = priv->buffer.phys;
+        sg[0].length = length;
+        *count = 1;
+        return NO_ERROR;
+    }
+
+    // look the pages up a batch at a time, merging the ones that follow
+    // each other in physical memory into one entry
+    mx_paddr_t pages[64];
+    uint32_t n = 0;
+    mx_off_t start = priv->vmo_offset;
+    mx_off_t end = priv->vmo_offset + length;
+    mx_off_t page = start & ~((mx_off_t)PAGE_SIZE - 1);
+    while (page < end) {
+        uint64_t batch = MIN((uint64_t)(sizeof(pages) / sizeof(pages[0])), (end - page + PAGE_SIZE - 1) / PAGE_SIZE);
+        mx_status_t status = mx_vmo_op_range(priv->buffer.vmo_handle, MX_VMO_OP_LOOKUP, page,
+                                             batch * PAGE_SIZE, pages, sizeof(pages));
+        if (status != NO_ERROR) {
+            return status;
+        }
+        for (uint64_t i = 0; i < batch; i++, page += PAGE_SIZE) {
+            mx_off_t lo = MAX(page, start);
+            mx_off_t hi = MIN(page + PAGE_SIZE, end);
+            mx_paddr_t paddr = pages[i] + (lo - page);
+            if ((n > 0) && (sg[n - 1].paddr + sg[n - 1].length == paddr)) {
+                sg[n - 1].length += hi - lo;
+                continue;
+            }
+            if (n == max) {
+                return ERR_BUFFER_TOO_SMALL;
+            }
+            sg[n].paddr = paddr;
+            sg[n].length = hi - lo;
+            n++;
+        }
+    }
+    *count = n;
+    return NO_ERROR;
 }
 
 static void iotxn_mmap(iotxn_t* txn, void** data) {
@@ -78,8 +179,9 @@ static void iotxn_mmap(iotxn_t* txn, void** data) {
     *data = io_buffer_virt(&priv->buffer);
 }
 
-static mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out, size_t extra_size) {
-    iotxn_priv_t* priv = get_priv(txn);
+// gets an iotxn_priv_t that doesn't own its buffer, from the clone list
+// if there's one with enough extra space
+static iotxn_priv_t* clone_priv_get(size_t extra_size) {
     iotxn_t* clone = NULL;
     iotxn_priv_t* cpriv = NULL;
     // look in clone list first for something that fits
@@ -96,10 +198,10 @@ static mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out, size_t extra_size) {
     // found one that fits, skip allocation
     if (found) {
         list_delete(&clone->node);
-        cpriv->flags &= ~IOTXN_FLAG_FREE;
+        cpriv->flags = 0;
         if (cpriv->extra_size) memset(&cpriv[1], 0, cpriv->extra_size);
         mtx_unlock(&clone_list_mutex);
-        goto out;
+        return cpriv;
     }
     mtx_unlock(&clone_list_mutex);
 
@@ -107,21 +209,47 @@ static mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out, size_t extra_size) {
     cpriv = calloc(1, sizeof(iotxn_priv_t) + extra_size);
     if (!cpriv) {
         xprintf("iotxn: out of memory\n");
+        return NULL;
+    }
+    cpriv->extra_size = extra_size;
+    return cpriv;
+}
+
+static mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out, size_t extra_size) {
+    iotxn_priv_t* priv = get_priv(txn);
+    iotxn_priv_t* cpriv = clone_priv_get(extra_size);
+    if (!cpriv) {
         return ERR_NO_MEMORY;
     }
-    memset(cpriv, 0, sizeof(iotxn_priv_t));
 
-out:
-    cpriv->flags |= IOTXN_FLAG_CLONE;
+    cpriv->flags |= IOTXN_FLAG_CLONE | (priv->flags & IOTXN_FLAG_VMO);
     // copy data payload metadata to the clone so the api can just work
     memcpy(&cpriv->buffer, &priv->buffer, sizeof(priv->buffer));
     cpriv->data_size = priv->data_size;
+    cpriv->vmo_offset = priv->vmo_offset;
     memcpy(&cpriv->txn, txn, sizeof(iotxn_t));
     cpriv->txn.complete_cb = NULL; // clear the complete cb
     *out = &cpriv->txn;
     return NO_ERROR;
 }
 
+// frees a txn that owns a contiguous buffer, or none
+static void priv_free(iotxn_priv_t* priv) {
+    if (io_buffer_is_valid(&priv->buffer)) {
+        mx_process_unmap_vm(mx_process_self(), (uintptr_t)priv->buffer.virt, priv->buffer.size);
+        io_buffer_release(&priv->buffer);
+    }
+    free(priv);
+}
+
+static void pool_free(iotxn_pool_t* pool) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&pool->free_list, iotxn_t, node)) != NULL) {
+        priv_free(get_priv(txn));
+    }
+    free(pool);
+}
+
 static void iotxn_release(iotxn_t* txn) {
     xprintf("iotxn_release: txn=%p\n", txn);
     iotxn_priv_t* priv = get_priv(txn);
@@ -130,7 +258,29 @@ static void iotxn_release(iotxn_t* txn) {
         abort();
     }
 
-    if (priv->flags & IOTXN_FLAG_CLONE) {
+    if (io_buffer_is_valid(&priv->bounce)) {
+        bounce_release(priv);
+    }
+    if ((priv->flags & IOTXN_FLAG_VMO) && !(priv->flags & IOTXN_FLAG_CLONE)) {
+        // the mapping and the handle are the txn's own; without them it's
+        // no different from a clone
+        mx_process_unmap_vm(mx_process_self(), (uintptr_t)priv->buffer.virt, priv->buffer.size);
+        mx_handle_close(priv->buffer.vmo_handle);
+        memset(&priv->buffer, 0, sizeof(priv->buffer));
+        priv->flags |= IOTXN_FLAG_CLONE;
+    }
+    if (priv->pool != NULL) {
+        iotxn_pool_t* pool = priv->pool;
+        mtx_lock(&pool->lock);
+        list_add_head(&pool->free_list, &txn->node);
+        priv->flags |= IOTXN_FLAG_FREE;
+        pool->outstanding--;
+        bool last = pool->destroyed && (pool->outstanding == 0);
+        mtx_unlock(&pool->lock);
+        if (last) {
+            pool_free(pool);
+        }
+    } else if (priv->flags & IOTXN_FLAG_CLONE) {
         mtx_lock(&clone_list_mutex);
         list_add_tail(&clone_list, &txn->node);
         priv->flags |= IOTXN_FLAG_FREE;
@@ -148,6 +298,7 @@ static iotxn_ops_t ops = {
     .copyfrom = iotxn_copyfrom,
     .copyto = iotxn_copyto,
     .physmap = iotxn_physmap,
+    .physmap_sg = iotxn_physmap_sg,
     .mmap = iotxn_mmap,
     .clone = iotxn_clone,
     .release = iotxn_release,
@@ -171,8 +322,8 @@ mx_status_t iotxn_alloc(iotxn_t** out, uint32_t flags, size_t data_size, size_t
     // found one that fits, skip allocation
     if (found) {
         list_delete(&txn->node);
-        memset(&txn, 0, sizeof(iotxn_t));
-        memset(io_buffer_virt(&priv->buffer), 0, priv->buffer.size);
+        memset(txn, 0, sizeof(iotxn_t));
+        memset(io_buffer_virt(&priv->buffer), 0, data_size);
         priv->flags &= ~IOTXN_FLAG_FREE;
         mtx_unlock(&free_list_mutex);
         goto out;
@@ -200,6 +351,184 @@ out:
     return NO_ERROR;
 }
 
+mx_status_t iotxn_alloc_window(iotxn_t** out, io_buffer_t* buffer, mx_off_t offset,
+                               size_t data_size, size_t extra_size) {
+    xprintf("iotxn_alloc_window: offset=0x%" PRIx64 " data_size=0x%zx extra_size=0x%zx\n",
+            offset, data_size, extra_size);
+    if ((offset > buffer->size) || (data_size > buffer->size - offset)) {
+        return ERR_INVALID_ARGS;
+    }
+    iotxn_priv_t* priv = clone_priv_get(extra_size);
+    if (!priv) {
+        return ERR_NO_MEMORY;
+    }
+
+    // like a clone, the txn only borrows the buffer
+    priv->flags |= IOTXN_FLAG_CLONE;
+    priv->buffer = *buffer;
+    priv->buffer.virt = io_buffer_virt(buffer) + offset;
+    priv->buffer.phys = io_buffer_phys(buffer) + offset;
+    priv->buffer.offset = 0;
+    priv->buffer.size = data_size;
+    priv->data_size = data_size;
+    memset(&priv->txn, 0, sizeof(iotxn_t));
+    priv->txn.ops = &ops;
+    *out = &priv->txn;
+    return NO_ERROR;
+}
+
+mx_status_t iotxn_alloc_vmo(iotxn_t** out, mx_handle_t vmo, mx_off_t offset, size_t data_size,
+                            size_t extra_size) {
+    xprintf("iotxn_alloc_vmo: vmo=%d offset=0x%" PRIx64 " data_size=0x%zx extra_size=0x%zx\n",
+            vmo, offset, data_size, extra_size);
+    if (data_size == 0) {
+        return ERR_INVALID_ARGS;
+    }
+    mx_off_t map_offset = offset & ~((mx_off_t)PAGE_SIZE - 1);
+    size_t map_size = ((offset + data_size + PAGE_SIZE - 1) & ~((mx_off_t)PAGE_SIZE - 1)) - map_offset;
+
+    mx_handle_t h;
+    mx_status_t status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &h);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    // the pages must be there to be looked up; nothing takes them away
+    // again while the txn holds the vmo, short of its owner decommitting
+    if ((status = mx_vmo_op_range(h, MX_VMO_OP_COMMIT, map_offset, map_size, NULL, 0)) != NO_ERROR) {
+        mx_handle_close(h);
+        return status;
+    }
+    uintptr_t virt;
+    if ((status = mx_process_map_vm(mx_process_self(), h, map_offset, map_size, &virt,
+                                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE)) != NO_ERROR) {
+        mx_handle_close(h);
+        return status;
+    }
+
+    iotxn_priv_t* priv = clone_priv_get(extra_size);
+    if (!priv) {
+        mx_process_unmap_vm(mx_process_self(), virt, map_size);
+        mx_handle_close(h);
+        return ERR_NO_MEMORY;
+    }
+    priv->flags = IOTXN_FLAG_VMO;
+    priv->buffer.vmo_handle = h;
+    priv->buffer.size = map_size;
+    priv->buffer.offset = offset - map_offset;
+    priv->buffer.virt = (void*)virt;
+    priv->buffer.phys = 0;
+    priv->data_size = data_size;
+    priv->vmo_offset = offset;
+    memset(&priv->txn, 0, sizeof(iotxn_t));
+    priv->txn.ops = &ops;
+    *out = &priv->txn;
+    return NO_ERROR;
+}
+
+mx_status_t iotxn_clone_window(iotxn_t* txn, iotxn_t** out, mx_off_t offset, size_t data_size,
+                               size_t extra_size) {
+    iotxn_priv_t* priv = get_priv(txn);
+    if ((offset > priv->data_size) || (data_size > priv->data_size - offset)) {
+        return ERR_INVALID_ARGS;
+    }
+    mx_status_t status = iotxn_clone(txn, out, extra_size);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    iotxn_priv_t* cpriv = get_priv(*out);
+    if (cpriv->flags & IOTXN_FLAG_VMO) {
+        cpriv->buffer.offset += offset;
+        cpriv->vmo_offset += offset;
+    } else {
+        cpriv->buffer.virt = io_buffer_virt(&cpriv->buffer) + offset;
+        cpriv->buffer.phys += offset;
+        cpriv->buffer.offset = 0;
+        cpriv->buffer.size = data_size;
+    }
+    cpriv->data_size = data_size;
+    (*out)->length = data_size;
+    return NO_ERROR;
+}
+
+static iotxn_priv_t* pool_priv_new(iotxn_pool_t* pool) {
+    iotxn_priv_t* priv = calloc(1, sizeof(iotxn_priv_t) + pool->extra_size);
+    if (!priv) {
+        return NULL;
+    }
+    if (io_buffer_init(&priv->buffer, pool->data_size, IO_BUFFER_RW) != NO_ERROR) {
+        free(priv);
+        return NULL;
+    }
+    priv->extra_size = pool->extra_size;
+    priv->pool = pool;
+    return priv;
+}
+
+mx_status_t iotxn_pool_create(iotxn_pool_t** out, uint32_t count, size_t data_size,
+                              size_t extra_size) {
+    if (data_size == 0) {
+        return ERR_INVALID_ARGS;
+    }
+    iotxn_pool_t* pool = calloc(1, sizeof(iotxn_pool_t));
+    if (!pool) {
+        return ERR_NO_MEMORY;
+    }
+    mtx_init(&pool->lock, mtx_plain);
+    list_initialize(&pool->free_list);
+    pool->data_size = data_size;
+    pool->extra_size = extra_size;
+    for (uint32_t i = 0; i < count; i++) {
+        iotxn_priv_t* priv = pool_priv_new(pool);
+        if (!priv) {
+            pool_free(pool);
+            return ERR_NO_MEMORY;
+        }
+        priv->flags = IOTXN_FLAG_FREE;
+        list_add_tail(&pool->free_list, &priv->txn.node);
+    }
+    *out = pool;
+    return NO_ERROR;
+}
+
+mx_status_t iotxn_pool_alloc(iotxn_pool_t* pool, iotxn_t** out, size_t data_size) {
+    if (data_size > pool->data_size) {
+        return iotxn_alloc(out, 0, data_size, pool->extra_size);
+    }
+
+    mtx_lock(&pool->lock);
+    iotxn_t* txn = list_remove_head_type(&pool->free_list, iotxn_t, node);
+    pool->outstanding++;
+    mtx_unlock(&pool->lock);
+
+    iotxn_priv_t* priv;
+    if (txn != NULL) {
+        priv = get_priv(txn);
+        priv->flags = 0;
+        if (priv->extra_size) memset(&priv[1], 0, priv->extra_size);
+    } else if ((priv = pool_priv_new(pool)) == NULL) {
+        // it never came out, so it can't be the last one back
+        mtx_lock(&pool->lock);
+        pool->outstanding--;
+        mtx_unlock(&pool->lock);
+        return ERR_NO_MEMORY;
+    }
+    priv->data_size = data_size;
+    memset(&priv->txn, 0, sizeof(iotxn_t));
+    priv->txn.ops = &ops;
+    *out = &priv->txn;
+    return NO_ERROR;
+}
+
+void iotxn_pool_destroy(iotxn_pool_t* pool) {
+    mtx_lock(&pool->lock);
+    pool->destroyed = true;
+    bool last = (pool->outstanding == 0);
+    mtx_unlock(&pool->lock);
+    if (last) {
+        pool_free(pool);
+    }
+}
+
 void iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     dev->ops->iotxn_queue(dev, txn);
 }
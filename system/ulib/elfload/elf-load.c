@@ -144,14 +144,25 @@ static mx_status_t choose_load_bias(mx_handle_t proc,
     return NO_ERROR;
 }
 
-// TODO(mcgrathr): Temporary hack to avoid modifying the file VMO.
-// This will go away when we have copy-on-write.
+// Get a VMO holding the segment's data that can be written to without
+// modifying the file VMO.  A copy-on-write clone shares the file's pages
+// until they're written; if the file VMO can't be cloned, copy the data.
 static mx_handle_t get_writable_vmo(mx_handle_t proc_self,
                                     mx_handle_t vmo, size_t data_size,
                                     uintptr_t* file_start,
                                     uintptr_t* file_end) {
     mx_handle_t copy_vmo;
-    mx_status_t status = mx_vmo_create(data_size, 0, &copy_vmo);
+    mx_status_t status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE,
+                                      *file_start, data_size, &copy_vmo);
+    if (status == NO_ERROR) {
+        *file_end -= *file_start;
+        *file_start = 0;
+        return copy_vmo;
+    }
+    if (status != ERR_NOT_SUPPORTED)
+        return status;
+
+    status = mx_vmo_create(data_size, 0, &copy_vmo);
     if (status < 0)
         return status;
     uintptr_t window = 0;
@@ -186,10 +197,14 @@ static mx_status_t finish_load_segment(
         ((ph->p_flags & PF_R) ? MX_VM_FLAG_PERM_READ : 0) |
         ((ph->p_flags & PF_W) ? MX_VM_FLAG_PERM_WRITE : 0) |
         ((ph->p_flags & PF_X) ? MX_VM_FLAG_PERM_EXECUTE : 0);
+    // File pages are usually resident already, so map them in batches
+    // rather than taking a fault for each one.
+    const uint32_t file_flags = flags | MX_VM_FLAG_FAULT_AROUND;
 
     if (ph->p_filesz == ph->p_memsz)
         // Straightforward segment, map all the whole pages from the file.
-        return mx_process_map_vm(proc, vmo, file_start, size, &start, flags);
+        return mx_process_map_vm(proc, vmo, file_start, size, &start,
+                                 file_flags);
 
     const size_t file_size = file_end - file_start;
 
@@ -197,7 +212,7 @@ static mx_status_t finish_load_segment(
     // Only the leading portion is directly mapped in from the file.
     if (file_size > 0) {
         mx_status_t status = mx_process_map_vm(proc, vmo, file_start,
-                                               file_size, &start, flags);
+                                               file_size, &start, file_flags);
         if (status != NO_ERROR)
             return status;
         start += file_size;
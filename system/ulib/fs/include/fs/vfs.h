@@ -31,3 +31,40 @@ mx_status_t vfs_close(vnode_t* vn);
 
 mx_status_t vfs_fill_dirent(vdirent_t* de, size_t delen,
                             const char* name, size_t len, uint32_t type);
+
+// VFS page cache (vfs-cache.c)
+//
+// Keeps file contents in one VMO per file, so rereading a hot file is a
+// copy out of memory and every client mapping it shares the same pages.
+// A filesystem keeps a vcache_t* per file, NULL until first used, and
+// passes in how to read the file from the disk.  Unshared caches give up
+// their pages least recently used first past a limit, and all of them
+// under memory pressure.
+typedef struct vcache vcache_t;
+
+// Reads |len| bytes at |off| of the file, all within it, from the disk.
+typedef ssize_t (*vcache_fill_t)(void* cookie, void* data, size_t len, size_t off);
+
+// Reads from the cache of a file of |size| bytes, filling it in as
+// needed.  |len| and |off| are already clipped to the file.
+ssize_t vcache_read(vcache_t** vc, size_t size, void* data, size_t len, size_t off,
+                    vcache_fill_t fill, void* cookie);
+
+// Brings the cache up to date with a write of |len| bytes at |off| to a
+// file that was |size| bytes before it.
+void vcache_write(vcache_t* vc, size_t size, const void* data, size_t len, size_t off);
+
+// Brings the cache up to date with the file being truncated to |len|.
+void vcache_truncate(vcache_t* vc, size_t len);
+
+// Reads all of a file of |size| bytes into its cache and returns a
+// read-only handle to the VMO holding it.  The cache is shared from then
+// on and never evicted.
+mx_handle_t vcache_get_vmo(vcache_t** vc, size_t size, vcache_fill_t fill, void* cookie);
+
+// Frees a file's cache when the file goes away.
+void vcache_release(vcache_t* vc);
+
+// Sets how much unshared caches may hold, 0 for the default, and starts
+// watching for memory pressure.
+mx_status_t vcache_init(size_t limit);
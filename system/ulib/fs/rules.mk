@@ -10,6 +10,7 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/vfs.c \
+    $(LOCAL_DIR)/vfs-cache.c \
 
 MODULE_LIBS := \
     ulib/mxio \
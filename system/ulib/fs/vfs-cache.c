@@ -0,0 +1,358 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fs/trace.h>
+#include <fs/vfs.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <magenta/listnode.h>
+#include <magenta/syscalls.h>
+
+#define VC_PAGE_SIZE 4096u
+#define VC_PAGES(n) (((n) + VC_PAGE_SIZE - 1) / VC_PAGE_SIZE)
+
+// pages read from the disk at most at once to fill a gap
+#define VC_FILL_PAGES 16u
+
+// what may sit in unshared caches before the least recently
+// used ones start giving up their pages
+#define VC_DEFAULT_LIMIT (16u * 1024 * 1024)
+
+struct vcache {
+    // on vc_lru while anything in it may be evicted
+    list_node_t lru;
+
+    mx_handle_t vmo;
+    // the size of the VMO and of the bitmap, in pages
+    size_t pages;
+    // how many pages are set in valid, accounted in vc_total
+    size_t count;
+    // one bit per page: it holds the file's current contents
+    uint8_t* valid;
+
+    // handed out by vcache_get_vmo(): every page is valid and stays so
+    bool shared;
+};
+
+static mtx_t vc_lock = MTX_INIT;
+static list_node_t vc_lru = LIST_INITIAL_VALUE(vc_lru);
+static size_t vc_total;
+static size_t vc_limit = VC_DEFAULT_LIMIT;
+
+static inline bool vc_valid(vcache_t* vc, size_t n) {
+    return vc->valid[n / 8] & (1u << (n % 8));
+}
+
+static void vc_set(vcache_t* vc, size_t n) {
+    if (!vc_valid(vc, n)) {
+        vc->valid[n / 8] |= (uint8_t)(1u << (n % 8));
+        vc->count++;
+        vc_total += VC_PAGE_SIZE;
+    }
+}
+
+static void vc_clear(vcache_t* vc, size_t n) {
+    if (vc_valid(vc, n)) {
+        vc->valid[n / 8] &= (uint8_t)~(1u << (n % 8));
+        vc->count--;
+        vc_total -= VC_PAGE_SIZE;
+    }
+}
+
+// Gives the pages of an unshared cache back, forgetting what they held.
+static void vc_evict(vcache_t* vc) {
+    if (vc->count == 0) {
+        return;
+    }
+    trace(VFS, "vcache: evict %p (%zu pages)\n", vc, vc->count);
+    mx_vmo_op_range(vc->vmo, MX_VMO_OP_DECOMMIT, 0, vc->pages * VC_PAGE_SIZE, NULL, 0);
+    vc_total -= vc->count * VC_PAGE_SIZE;
+    vc->count = 0;
+    memset(vc->valid, 0, (vc->pages + 7) / 8);
+}
+
+// Evicts the least recently used caches, other than |keep|, until the
+// total is within |limit|.
+static void vc_trim(vcache_t* keep, size_t limit) {
+    vcache_t* vc;
+    vcache_t* tmp;
+    list_for_every_entry_safe (&vc_lru, vc, tmp, vcache_t, lru) {
+        if (vc_total <= limit) {
+            break;
+        }
+        if (vc != keep) {
+            vc_evict(vc);
+        }
+    }
+}
+
+static void vc_touch(vcache_t* vc) {
+    if (!vc->shared) {
+        list_delete(&vc->lru);
+        list_add_tail(&vc_lru, &vc->lru);
+    }
+}
+
+// Makes room for |size| bytes of file.
+static mx_status_t vc_grow(vcache_t* vc, size_t size) {
+    size_t pages = VC_PAGES(size);
+    if (pages <= vc->pages) {
+        return NO_ERROR;
+    }
+    size_t bytes = (pages + 7) / 8;
+    size_t old_bytes = (vc->pages + 7) / 8;
+    uint8_t* valid = realloc(vc->valid, bytes);
+    if (valid == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    memset(valid + old_bytes, 0, bytes - old_bytes);
+    vc->valid = valid;
+    mx_status_t r;
+    if ((r = mx_vmo_set_size(vc->vmo, pages * VC_PAGE_SIZE)) < 0) {
+        return r;
+    }
+    vc->pages = pages;
+    return NO_ERROR;
+}
+
+static vcache_t* vc_create(size_t size) {
+    vcache_t* vc;
+    if ((vc = calloc(1, sizeof(vcache_t))) == NULL) {
+        return NULL;
+    }
+    if (mx_vmo_create(0, 0, &vc->vmo) < 0) {
+        free(vc);
+        return NULL;
+    }
+    if (vc_grow(vc, size) < 0) {
+        mx_handle_close(vc->vmo);
+        free(vc->valid);
+        free(vc);
+        return NULL;
+    }
+    list_add_tail(&vc_lru, &vc->lru);
+    return vc;
+}
+
+// Reads in the missing pages of [off, off + len), which must be within
+// the file's |size|.
+static mx_status_t vc_fill(vcache_t* vc, size_t size, size_t off, size_t len,
+                           vcache_fill_t fill, void* cookie) {
+    static uint8_t buf[VC_FILL_PAGES * VC_PAGE_SIZE];
+
+    size_t n = off / VC_PAGE_SIZE;
+    size_t end = VC_PAGES(off + len);
+    while (n < end) {
+        if (vc_valid(vc, n)) {
+            n++;
+            continue;
+        }
+        size_t run = 1;
+        while ((n + run < end) && (run < VC_FILL_PAGES) && !vc_valid(vc, n + run)) {
+            run++;
+        }
+
+        // past the end of the file is zeroes, as it would be in the VMO
+        size_t start = n * VC_PAGE_SIZE;
+        size_t want = run * VC_PAGE_SIZE;
+        if (want > size - start) {
+            want = size - start;
+        }
+        ssize_t r = fill(cookie, buf, want, start);
+        if (r < 0) {
+            return r;
+        }
+        memset(buf + r, 0, run * VC_PAGE_SIZE - r);
+
+        size_t actual;
+        mx_status_t status;
+        if ((status = mx_vmo_write(vc->vmo, buf, start, run * VC_PAGE_SIZE, &actual)) < 0) {
+            return status;
+        }
+        for (size_t i = 0; i < run; i++) {
+            vc_set(vc, n + i);
+        }
+        n += run;
+    }
+    return NO_ERROR;
+}
+
+ssize_t vcache_read(vcache_t** _vc, size_t size, void* data, size_t len, size_t off,
+                    vcache_fill_t fill, void* cookie) {
+    if (len == 0) {
+        return 0;
+    }
+
+    mtx_lock(&vc_lock);
+    vcache_t* vc = *_vc;
+    if ((vc == NULL) && ((vc = *_vc = vc_create(size)) == NULL)) {
+        // no cache to be had, read around it
+        mtx_unlock(&vc_lock);
+        return fill(cookie, data, len, off);
+    }
+
+    ssize_t r;
+    if (vc_grow(vc, size) < 0) {
+        r = fill(cookie, data, len, off);
+    } else if ((r = vc_fill(vc, size, off, len, fill, cookie)) == NO_ERROR) {
+        size_t actual;
+        if ((r = mx_vmo_read(vc->vmo, data, off, len, &actual)) == NO_ERROR) {
+            r = actual;
+        }
+    }
+    vc_touch(vc);
+    vc_trim(vc, vc_limit);
+    mtx_unlock(&vc_lock);
+    return r;
+}
+
+void vcache_write(vcache_t* vc, size_t size, const void* data, size_t len, size_t off) {
+    if ((vc == NULL) || (len == 0)) {
+        return;
+    }
+
+    mtx_lock(&vc_lock);
+    size_t actual;
+    if ((vc_grow(vc, off + len) < 0) || (mx_vmo_write(vc->vmo, data, off, len, &actual) < 0)) {
+        // it no longer matches the file
+        trace(VFS, "vcache: write to %p failed\n", vc);
+        vc_evict(vc);
+        mtx_unlock(&vc_lock);
+        return;
+    }
+
+    // A page the write covers holds the file's contents now, as does one
+    // that started past the end of the file: the rest of it is zeroes.
+    size_t n = off / VC_PAGE_SIZE;
+    size_t end = VC_PAGES(off + len);
+    for (; n < end; n++) {
+        size_t start = n * VC_PAGE_SIZE;
+        if ((start >= size) || ((start >= off) && (start + VC_PAGE_SIZE <= off + len))) {
+            vc_set(vc, n);
+        }
+    }
+    vc_touch(vc);
+    mtx_unlock(&vc_lock);
+}
+
+void vcache_truncate(vcache_t* vc, size_t len) {
+    if (vc == NULL) {
+        return;
+    }
+
+    mtx_lock(&vc_lock);
+    size_t pages = VC_PAGES(len);
+    if (pages < vc->pages) {
+        for (size_t n = pages; n < vc->pages; n++) {
+            vc_clear(vc, n);
+        }
+        if (mx_vmo_set_size(vc->vmo, pages * VC_PAGE_SIZE) == NO_ERROR) {
+            vc->pages = pages;
+        } else {
+            mx_vmo_op_range(vc->vmo, MX_VMO_OP_DECOMMIT, pages * VC_PAGE_SIZE,
+                            (vc->pages - pages) * VC_PAGE_SIZE, NULL, 0);
+        }
+    }
+    if ((len % VC_PAGE_SIZE) && (len / VC_PAGE_SIZE < vc->pages)) {
+        // the rest of the last page reads as zeroes if the file grows again
+        static const uint8_t zeroes[VC_PAGE_SIZE];
+        size_t tail = VC_PAGE_SIZE - len % VC_PAGE_SIZE;
+        size_t actual;
+        if (mx_vmo_write(vc->vmo, zeroes, len, tail, &actual) < 0) {
+            vc_clear(vc, len / VC_PAGE_SIZE);
+        }
+    }
+    mtx_unlock(&vc_lock);
+}
+
+mx_handle_t vcache_get_vmo(vcache_t** _vc, size_t size, vcache_fill_t fill, void* cookie) {
+    mtx_lock(&vc_lock);
+    vcache_t* vc = *_vc;
+    if ((vc == NULL) && ((vc = *_vc = vc_create(size)) == NULL)) {
+        mtx_unlock(&vc_lock);
+        return ERR_NO_MEMORY;
+    }
+
+    mx_status_t r;
+    // the mapping covers the file's last page, if partial, as well
+    if (((r = vc_grow(vc, size ? size : 1)) < 0) ||
+        ((r = vc_fill(vc, size, 0, size, fill, cookie)) < 0)) {
+        mtx_unlock(&vc_lock);
+        return r;
+    }
+    if (!vc->shared) {
+        // mappings of it must never see its pages go away
+        vc->shared = true;
+        list_delete(&vc->lru);
+        vc_trim(NULL, vc_limit);
+    }
+
+    // writes to the file arrive through us, not through the mapping
+    mx_handle_t vmo;
+    r = mx_handle_duplicate(vc->vmo, MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP |
+                                     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER,
+                            &vmo);
+    mtx_unlock(&vc_lock);
+    return (r < 0) ? r : vmo;
+}
+
+void vcache_release(vcache_t* vc) {
+    if (vc == NULL) {
+        return;
+    }
+
+    mtx_lock(&vc_lock);
+    if (!vc->shared) {
+        list_delete(&vc->lru);
+    }
+    vc_total -= vc->count * VC_PAGE_SIZE;
+    mtx_unlock(&vc_lock);
+
+    mx_handle_close(vc->vmo);
+    free(vc->valid);
+    free(vc);
+}
+
+static int vc_pressure_thread(void* arg) {
+    mx_handle_t event = (mx_handle_t)(uintptr_t)arg;
+    for (;;) {
+        mx_signals_t pending;
+        if (mx_handle_wait_one(event, MX_EVENT_SIGNALED, MX_TIME_INFINITE, &pending) < 0) {
+            break;
+        }
+        mtx_lock(&vc_lock);
+        trace(VFS, "vcache: memory pressure, releasing %zu bytes\n", vc_total);
+        vc_trim(NULL, 0);
+        mtx_unlock(&vc_lock);
+
+        // the event stays signaled until memory recovers, so don't spin
+        mx_nanosleep(MX_SEC(1));
+    }
+    mx_handle_close(event);
+    return 0;
+}
+
+mx_status_t vcache_init(size_t limit) {
+    if (limit) {
+        vc_limit = limit;
+    }
+
+    mx_handle_t event;
+    mx_status_t r;
+    if ((r = mx_memory_pressure_event(&event)) < 0) {
+        return r;
+    }
+    thrd_t t;
+    if (thrd_create_with_name(&t, vc_pressure_thread, (void*)(uintptr_t)event,
+                              "vcache-pressure") != thrd_success) {
+        mx_handle_close(event);
+        return ERR_NO_RESOURCES;
+    }
+    thrd_detach(t);
+    return NO_ERROR;
+}
@@ -226,9 +226,12 @@ mx_status_t vfs_fill_dirent(vdirent_t* de, size_t delen,
     return sz;
 }
 
+// The refcount is atomic so that servers may work on one vnode from
+// several threads; whatever tree the vnode is in must be locked by the
+// server to keep a lookup from finding one that's being released.
 void vn_acquire(vnode_t* vn) {
     trace(REFS, "acquire vn=%p ref=%u\n", vn, vn->refcount);
-    vn->refcount++;
+    __atomic_fetch_add(&vn->refcount, 1, __ATOMIC_RELAXED);
 }
 
 // TODO(orr): figure out x-system panic
@@ -236,11 +239,11 @@ void vn_acquire(vnode_t* vn) {
 
 void vn_release(vnode_t* vn) {
     trace(REFS, "release vn=%p ref=%u\n", vn, vn->refcount);
-    if (vn->refcount == 0) {
+    uint32_t refcount = __atomic_fetch_sub(&vn->refcount, 1, __ATOMIC_ACQ_REL);
+    if (refcount == 0) {
         panic("vn %p: ref underflow\n", vn);
     }
-    vn->refcount--;
-    if (vn->refcount == 0) {
+    if (refcount == 1) {
         trace(VFS, "vfs_release: vn=%p\n", vn);
         vn->ops->release(vn);
     }
@@ -20,6 +20,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#elif __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #define TRACE 0
 
@@ -76,6 +83,90 @@ static uint32_t ARGB8888_to_RGB2220(uint32_t in) {
     return out;
 }
 
+// grow the dirty region to cover a rect that has already been clipped
+static void mark_dirty(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height) {
+    gfx_rect* d = &surface->dirty;
+    if (d->width == 0 || d->height == 0) {
+        d->x = x;
+        d->y = y;
+        d->width = width;
+        d->height = height;
+        return;
+    }
+    unsigned x2 = d->x + d->width;
+    unsigned y2 = d->y + d->height;
+    if (x < d->x)
+        d->x = x;
+    if (y < d->y)
+        d->y = y;
+    if (x + width > x2)
+        x2 = x + width;
+    if (y + height > y2)
+        y2 = y + height;
+    d->width = x2 - d->x;
+    d->height = y2 - d->y;
+}
+
+void gfx_mark_dirty(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height) {
+    if (x >= surface->width || y >= surface->height)
+        return;
+    if (width == 0 || height == 0)
+        return;
+    if (width > surface->width - x)
+        width = surface->width - x;
+    if (height > surface->height - y)
+        height = surface->height - y;
+    mark_dirty(surface, x, y, width, height);
+}
+
+// fill and copy runs of pixels, 16 bytes at a time where the cpu can
+static void fill_row32(uint32_t* dest, uint32_t color, unsigned count) {
+    while (count > 0 && ((uintptr_t)dest & 15)) {
+        *dest++ = color;
+        count--;
+    }
+#if __SSE2__
+    __m128i c = _mm_set1_epi32((int)color);
+    for (; count >= 8; count -= 8, dest += 8) {
+        _mm_store_si128((__m128i*)dest, c);
+        _mm_store_si128((__m128i*)(dest + 4), c);
+    }
+#elif __ARM_NEON
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; count >= 8; count -= 8, dest += 8) {
+        vst1q_u32(dest, c);
+        vst1q_u32(dest + 4, c);
+    }
+#endif
+    while (count > 0) {
+        *dest++ = color;
+        count--;
+    }
+}
+
+static void fill_row16(uint16_t* dest, uint16_t color, unsigned count) {
+    if (count > 0 && ((uintptr_t)dest & 2)) {
+        *dest++ = color;
+        count--;
+    }
+    fill_row32((uint32_t*)dest, ((uint32_t)color << 16) | color, count / 2);
+    if (count & 1)
+        dest[count - 1] = color;
+}
+
+// copy height rows of len bytes, in whichever order is safe if they overlap
+static void copy_rows(void* dest, const void* src, size_t len, size_t stride, unsigned height) {
+    if (dest <= src) {
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest + i * stride, src + i * stride, len);
+        }
+    } else {
+        for (unsigned i = height; i > 0; i--) {
+            memmove(dest + (i - 1) * stride, src + (i - 1) * stride, len);
+        }
+    }
+}
+
 /**
  * @brief  Copy a rectangle of pixels from one part of the display to another.
  */
@@ -105,6 +196,7 @@ void gfx_copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width,
         height = surface->height - y2;
 
     surface->copyrect(surface, x, y, width, height, x2, y2);
+    mark_dirty(surface, x2, y2, width, height);
 }
 
 void gfx_copylines(gfx_surface* dst, gfx_surface* src, unsigned srcy, unsigned dsty, unsigned height) {
@@ -117,9 +209,13 @@ void gfx_copylines(gfx_surface* dst, gfx_surface* src, unsigned srcy, unsigned d
     if ((dsty >= dst->height) || (dst->height - dsty) < height) {
         return;
     }
-    memcpy(dst->ptr + dsty * dst->stride * dst->pixelsize,
-           src->ptr + srcy * src->stride * src->pixelsize,
-           height * src->stride * src->pixelsize);
+    if (height == 0) {
+        return;
+    }
+    memmove(dst->ptr + dsty * dst->stride * dst->pixelsize,
+            src->ptr + srcy * src->stride * src->pixelsize,
+            height * src->stride * src->pixelsize);
+    mark_dirty(dst, 0, dsty, dst->width, height);
 }
 
 /**
@@ -144,6 +240,7 @@ void gfx_fillrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width,
         height = surface->height - y;
 
     surface->fillrect(surface, x, y, width, height, color);
+    mark_dirty(surface, x, y, width, height);
 }
 
 /**
@@ -156,6 +253,7 @@ void gfx_putpixel(gfx_surface* surface, unsigned x, unsigned y, unsigned color)
         return;
 
     surface->putpixel(surface, x, y, color);
+    mark_dirty(surface, x, y, 1, 1);
 }
 
 static void putpixel16(gfx_surface* surface, unsigned x, unsigned y, unsigned color) {
@@ -212,6 +310,7 @@ void gfx_putchar(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
         bg = surface->translate_color(bg);
     }
     surface->putchar(surface, font, ch, x, y, fg, bg);
+    mark_dirty(surface, x, y, font->width, font->height);
 }
 
 static void copyrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
@@ -266,102 +365,36 @@ static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned wid
 }
 
 static void copyrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
     const uint16_t* src = &((const uint16_t*)surface->ptr)[x + y * surface->stride];
     uint16_t* dest = &((uint16_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
+    copy_rows(dest, src, width * sizeof(uint16_t), surface->stride * sizeof(uint16_t), height);
 }
 
 static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint16_t* dest = &((uint16_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
     uint16_t color16 = (uint16_t)(surface->translate_color(color));
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color16;
-            dest++;
-        }
-        dest += stride_diff;
+    for (unsigned i = 0; i < height; i++) {
+        fill_row16(dest, color16, width);
+        dest += surface->stride;
     }
 }
 
 static void copyrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
     const uint32_t* src = &((const uint32_t*)surface->ptr)[x + y * surface->stride];
     uint32_t* dest = &((uint32_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
 
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
+    copy_rows(dest, src, width * sizeof(uint32_t), surface->stride * sizeof(uint32_t), height);
 }
 
 static void fillrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint32_t* dest = &((uint32_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color;
-            dest++;
-        }
-        dest += stride_diff;
+    for (unsigned i = 0; i < height; i++) {
+        fill_row32(dest, color, width);
+        dest += surface->stride;
     }
 }
 
@@ -391,6 +424,8 @@ void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsig
     unsigned px = x1;
     unsigned py = y1;
 
+    mark_dirty(surface, MIN(x1, x2), MIN(y1, y2), dxabs + 1, dyabs + 1);
+
     if (dxabs >= dyabs) {
         // mostly horizontal line.
         for (unsigned i = 0; i < dxabs; i++) {
@@ -452,6 +487,88 @@ uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src) {
     return (srca << 24) | (cres[0] << 16) | (cres[1] << 8) | (cres[2]);
 }
 
+// alpha32_add_ignore_destalpha() over a run of pixels, 4 at a time where
+// the cpu can, giving the same results bit for bit
+static void alpha32_add_row(uint32_t* dest, const uint32_t* src, unsigned count) {
+#if __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i inv = _mm_set1_epi16(254);
+    const __m128i amask = _mm_set1_epi32(0xff000000);
+    for (; count >= 4; count -= 4, dest += 4, src += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i d = _mm_loadu_si128((const __m128i*)dest);
+        __m128i a = _mm_and_si128(s, amask);
+        __m128i opaque = _mm_cmpeq_epi32(a, amask);
+        __m128i clear = _mm_cmpeq_epi32(a, zero);
+        if (_mm_movemask_epi8(clear) == 0xffff)
+            continue;
+        if (_mm_movemask_epi8(opaque) == 0xffff) {
+            _mm_storeu_si128((__m128i*)dest, s);
+            continue;
+        }
+
+        // spread alpha across the 16 bit lanes of each pixel
+        __m128i slo = _mm_unpacklo_epi8(s, zero);
+        __m128i shi = _mm_unpackhi_epi8(s, zero);
+        __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xff), 0xff);
+        __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xff), 0xff);
+        __m128i salo = _mm_add_epi16(alo, one);
+        __m128i sahi = _mm_add_epi16(ahi, one);
+
+        __m128i rlo = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(slo, salo), 8),
+                                    _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                                                   _mm_sub_epi16(inv, alo)), 8));
+        __m128i rhi = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(shi, sahi), 8),
+                                    _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                                                   _mm_sub_epi16(inv, ahi)), 8));
+        __m128i r = _mm_packus_epi16(rlo, rhi);
+
+        // the result takes the source alpha plus one
+        r = _mm_or_si128(_mm_andnot_si128(amask, r), _mm_add_epi32(a, _mm_set1_epi32(0x01000000)));
+        r = _mm_or_si128(_mm_and_si128(opaque, s), _mm_andnot_si128(opaque, r));
+        r = _mm_or_si128(_mm_and_si128(clear, d), _mm_andnot_si128(clear, r));
+        _mm_storeu_si128((__m128i*)dest, r);
+    }
+#elif __ARM_NEON
+    const uint32x4_t amask = vdupq_n_u32(0xff000000);
+    const uint16x8_t inv = vdupq_n_u16(254);
+    for (; count >= 4; count -= 4, dest += 4, src += 4) {
+        uint32x4_t s = vld1q_u32(src);
+        uint32x4_t d = vld1q_u32(dest);
+        uint32x4_t a = vandq_u32(s, amask);
+        uint32x4_t opaque = vceqq_u32(a, amask);
+        uint32x4_t clear = vceqq_u32(a, vdupq_n_u32(0));
+
+        // spread alpha across the bytes of each pixel
+        uint8x16_t a8 = vreinterpretq_u8_u32(vorrq_u32(vshrq_n_u32(a, 24),
+                                                       vshlq_n_u32(vshrq_n_u32(a, 24), 8)));
+        a8 = vreinterpretq_u8_u32(vorrq_u32(vreinterpretq_u32_u8(a8),
+                                            vshlq_n_u32(vreinterpretq_u32_u8(a8), 16)));
+        uint8x16_t s8 = vreinterpretq_u8_u32(s);
+        uint8x16_t d8 = vreinterpretq_u8_u32(d);
+
+        uint16x8_t alo = vmovl_u8(vget_low_u8(a8));
+        uint16x8_t ahi = vmovl_u8(vget_high_u8(a8));
+        uint16x8_t rlo = vaddq_u16(vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(s8)), vaddq_u16(alo, vdupq_n_u16(1))), 8),
+                                   vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(d8)), vsubq_u16(inv, alo)), 8));
+        uint16x8_t rhi = vaddq_u16(vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(s8)), vaddq_u16(ahi, vdupq_n_u16(1))), 8),
+                                   vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(d8)), vsubq_u16(inv, ahi)), 8));
+        uint32x4_t r = vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(rlo), vqmovn_u16(rhi)));
+
+        // the result takes the source alpha plus one
+        r = vorrq_u32(vbicq_u32(r, amask), vaddq_u32(a, vdupq_n_u32(0x01000000)));
+        r = vbslq_u32(opaque, s, r);
+        r = vbslq_u32(clear, d, r);
+        vst1q_u32(dest, r);
+    }
+#endif
+    for (; count > 0; count--, dest++, src++) {
+        // XXX ignores destination alpha
+        *dest = alpha32_add_ignore_destalpha(*dest, *src);
+    }
+}
+
 /**
  * @brief  Copy pixels from source to dest.
  *
@@ -489,101 +606,68 @@ void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned
     if (srcy + height > source->height)
         height = source->height - srcy;
 
-    // XXX total hack to deal with various blends
-    if (source->format == MX_PIXEL_FORMAT_RGB_565 && target->format == MX_PIXEL_FORMAT_RGB_565) {
-        // 16 bit to 16 bit
-        const uint16_t* src = &((const uint16_t*)source->ptr)[srcx + srcy * source->stride];
-        uint16_t* dest = &((uint16_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
+    if (width == 0 || height == 0)
+        return;
 
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_ARGB_8888 && target->format == MX_PIXEL_FORMAT_ARGB_8888) {
+    // XXX total hack to deal with various blends
+    if (source->format == MX_PIXEL_FORMAT_ARGB_8888 && target->format == MX_PIXEL_FORMAT_ARGB_8888) {
         // both are 32 bit modes, both alpha
         const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
         uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                // XXX ignores destination alpha
-                *dest = alpha32_add_ignore_destalpha(*dest, *src);
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_RGB_x888 && target->format == MX_PIXEL_FORMAT_RGB_x888) {
-        // both are 32 bit modes, no alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
 
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
+        xprintf("w %u h %u dstride %u sstride %u\n", width, height, target->stride, source->stride);
 
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
+        for (unsigned i = 0; i < height; i++) {
+            alpha32_add_row(dest, src, width);
+            dest += target->stride;
+            src += source->stride;
         }
-    } else if (source->format == MX_PIXEL_FORMAT_MONO_1 && target->format == MX_PIXEL_FORMAT_MONO_1) {
-        // both are 8 bit modes, no alpha
-        const uint8_t* src = &((const uint8_t*)source->ptr)[srcx + srcy * source->stride];
-        uint8_t* dest = &((uint8_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
+    } else if ((source->format == MX_PIXEL_FORMAT_RGB_565 && target->format == MX_PIXEL_FORMAT_RGB_565) ||
+               (source->format == MX_PIXEL_FORMAT_RGB_x888 && target->format == MX_PIXEL_FORMAT_RGB_x888) ||
+               (source->format == MX_PIXEL_FORMAT_MONO_1 && target->format == MX_PIXEL_FORMAT_MONO_1)) {
+        // same format, no alpha
+        const uint8_t* src = source->ptr + (srcx + srcy * source->stride) * source->pixelsize;
+        uint8_t* dest = target->ptr + (destx + desty * target->stride) * target->pixelsize;
+        size_t len = width * target->pixelsize;
+
+        xprintf("w %u h %u dstride %u sstride %u\n", width, height, target->stride, source->stride);
+
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest += target->stride * target->pixelsize;
+            src += source->stride * source->pixelsize;
         }
     } else {
         xprintf("gfx_surface_blend: unimplemented colorspace combination (source %d target %d)\n", source->format, target->format);
         assert(0);
+        return;
     }
+    mark_dirty(target, destx, desty, width, height);
 }
 
 /**
  * @brief  Ensure all graphics rendering is sent to display
+ *
+ * Only the rows of the dirty region are written back, which is all of them
+ * that have been drawn to through gfx since the last flush.
  */
 void gfx_flush(gfx_surface* surface) {
+    gfx_rect* d = &surface->dirty;
+    if (d->width == 0 || d->height == 0)
+        return;
+    unsigned start = d->y;
+    unsigned end = d->y + d->height - 1;
+    d->width = d->height = 0;
+
 #if 0
-    if (surface->flags & GFX_FLAG_FLUSH_CPU_CACHE)
-        arch_clean_cache_range((addr_t)surface->ptr, surface->len);
+    if (surface->flags & GFX_FLAG_FLUSH_CPU_CACHE) {
+        uint32_t runlen = surface->stride * surface->pixelsize;
+        arch_clean_cache_range((addr_t)surface->ptr + start * runlen, (end - start + 1) * runlen);
+    }
 #endif
 
     if (surface->flush)
-        surface->flush(0, surface->height - 1);
+        surface->flush(start, end);
 }
 
 /**
@@ -610,6 +694,11 @@ void gfx_flush_rows(struct gfx_surface* surface, unsigned start, unsigned end) {
 
     if (surface->flush)
         surface->flush(start, end);
+
+    // these rows are no longer dirty, which clears the region if it is within them
+    gfx_rect* d = &surface->dirty;
+    if (d->y >= start && d->y + d->height - 1 <= end)
+        d->width = d->height = 0;
 }
 
 /**
@@ -639,6 +728,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     surface->height = height;
     surface->stride = stride;
     surface->alpha = MAX_ALPHA;
+    surface->dirty = (gfx_rect){ 0, 0, 0, 0 };
 
     // set up some function pointers
     switch (format) {
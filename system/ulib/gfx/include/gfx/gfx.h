@@ -23,6 +23,14 @@
 typedef struct gfx_surface gfx_surface;
 typedef struct gfx_font gfx_font;
 
+// a rectangle of pixels, which is empty if width or height is 0
+typedef struct gfx_rect {
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+} gfx_rect;
+
 /**
  * @brief  Describe a graphics drawing surface
  *
@@ -30,6 +38,9 @@ typedef struct gfx_font gfx_font;
  * to.  Elements include a pointer to the actual pixel memory, its size, its
  * layout, and pointers to basic drawing functions.
  *
+ * Drawing through the gfx_ functions accumulates the bounds of what was
+ * drawn in dirty, which gfx_flush writes back and then clears.
+ *
  * @ingroup graphics
  */
 struct gfx_surface {
@@ -43,6 +54,9 @@ struct gfx_surface {
     size_t len;
     unsigned alpha;
 
+    // the bounds of everything drawn since the last flush
+    gfx_rect dirty;
+
     // function pointers
     uint32_t (*translate_color)(uint32_t input);
     void (*copyrect)(gfx_surface*, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2);
@@ -79,18 +93,23 @@ void gfx_surface_blend(struct gfx_surface* target, struct gfx_surface* source, u
 // blend an area from the source surface to the target surface
 void gfx_blend(struct gfx_surface* target, struct gfx_surface* source, unsigned srcx, unsigned srcy, unsigned width, unsigned height, unsigned destx, unsigned desty);
 
-// copy entire lines from src to dst, which must be the same stride and pixel format
+// copy entire lines from src to dst, which must be the same stride and pixel format,
+// and may be the same surface
 void gfx_copylines(gfx_surface* dst, gfx_surface* src, unsigned srcy, unsigned dsty, unsigned height);
 
-// ensure the surface is written back to memory and optionally backing store
+// add a rect to the dirty region, for drawing done directly through ptr
+void gfx_mark_dirty(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height);
+
+// ensure the dirty region of the surface is written back to memory and
+// optionally backing store, and clear it
 void gfx_flush(struct gfx_surface* surface);
 
-// flush a subset of the surface
+// flush a subset of the surface, whether or not it is dirty
 void gfx_flush_rows(struct gfx_surface* surface, unsigned start, unsigned end);
 
 // clear the entire surface with a color
 static inline void gfx_clear(gfx_surface* surface, unsigned color) {
-    surface->fillrect(surface, 0, 0, surface->width, surface->height, color);
+    gfx_fillrect(surface, 0, 0, surface->width, surface->height, color);
     gfx_flush(surface);
 }
 
@@ -0,0 +1,69 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <inet6/inet6.h>
+
+// The sum is of native 16 bit words, which gives the same checksum, in
+// network order, whatever the byte order (RFC 1071).  Wider native words
+// sum to the same thing once folded, since 2^16 is 1 modulo 0xFFFF, so
+// the data is taken 32 bits at a time into 64 bit sums, which can't
+// overflow, four of them so that their adds are independent and the
+// compiler can make the loop SIMD.
+
+static inline uint16_t fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum;
+}
+
+uint16_t ip6_sum(const void* _data, size_t len, uint16_t _sum) {
+    const uint8_t* data = _data;
+    uint64_t s0 = _sum, s1 = 0, s2 = 0, s3 = 0;
+    while (len >= 32) {
+        uint32_t w[8];
+        memcpy(w, data, sizeof(w));
+        s0 += (uint64_t)w[0] + w[4];
+        s1 += (uint64_t)w[1] + w[5];
+        s2 += (uint64_t)w[2] + w[6];
+        s3 += (uint64_t)w[3] + w[7];
+        data += 32;
+        len -= 32;
+    }
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, data, sizeof(w));
+        s0 += w;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        memcpy(&w, data, sizeof(w));
+        s1 += w;
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        // the odd byte is the first of a word whose second is 0
+        uint16_t w = 0;
+        memcpy(&w, data, 1);
+        s2 += w;
+    }
+    return fold(s0 + s1 + s2 + s3);
+}
+
+uint16_t ip6_checksum_adjust(uint16_t checksum, const void* old_data, const void* new_data,
+                             size_t len) {
+    // RFC 1624: HC' = ~(~HC + ~m + m')
+    uint64_t sum = (uint16_t)~checksum;
+    sum += (uint16_t)~ip6_sum(old_data, len, 0);
+    sum += ip6_sum(new_data, len, 0);
+    return ~fold(sum);
+}
@@ -128,8 +128,23 @@ static inline uint32_t _swap32(uint32_t n) {
 char* ip6toa(char* _out, void* ip6addr);
 #define IP6TOAMAX 40
 
+// The one's complement sums behind the IPv6 pseudo-header, UDP and ICMPv6
+// checksums.  ip6_sum() adds len bytes to sum and returns it folded to
+// 16 bits, but not inverted; data may go in pieces, all but the last of
+// an even length.
+uint16_t ip6_sum(const void* data, size_t len, uint16_t sum);
+
+// Returns checksum corrected for len bytes of what it covers changing
+// from old_data to new_data, without summing the rest again.
+uint16_t ip6_checksum_adjust(uint16_t checksum, const void* old_data, const void* new_data,
+                             size_t len);
+
 // provided by inet6.c
 void ip6_init(void* macaddr);
+// Parses a received frame where it lies and hands UDP payloads to
+// udp6_recv() as pointers into it.  The frame is only read, so the
+// driver can still pass it elsewhere, and it needs to stay put only
+// until this returns.
 void eth_recv(void* data, size_t len);
 
 // provided by interface driver
@@ -26,6 +26,8 @@ int netifc_timer_expired(void);
 // packet is discarded if too large, too small, network offline, etc
 void netifc_send(const void* data, size_t len);
 
+// implement to receive frames; data is in the device's receive buffer,
+// which is given back to it once this returns, so nothing is copied
 void netifc_recv(void* data, size_t len);
 
 void netifc_get_info(uint8_t* addr, uint16_t* mtu);
\ No newline at end of file
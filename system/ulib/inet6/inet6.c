@@ -128,22 +128,6 @@ static int resolve_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip) {
     return -1;
 }
 
-static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
-    while (len > 1) {
-        sum += *data++;
-        len -= 2;
-    }
-    if (len) {
-        sum += (*data & 0xFF);
-    }
-    while (sum > 0xFFFF) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-    return sum;
-}
-
 typedef struct {
     uint8_t eth[16];
     ip6_hdr_t ip6;
@@ -161,9 +145,9 @@ static unsigned ip6_checksum(ip6_hdr_t* ip, unsigned type, size_t length) {
     uint16_t sum;
 
     // length and protocol field for pseudo-header
-    sum = checksum(&ip->length, 2, htons(type));
+    sum = ip6_sum(&ip->length, 2, htons(type));
     // src/dst for pseudo-header + payload
-    sum = checksum(&ip->src, 32 + length, sum);
+    sum = ip6_sum(&ip->src, 32 + length, sum);
 
     // 0 is illegal, so 0xffff remains 0xffff
     if (sum != 0xffff) {
@@ -226,7 +210,9 @@ fail:
 
 #define ICMP6_MAX_PAYLOAD (ETH_MTU - ETH_HDR_LEN - IP6_HDR_LEN)
 
-static int icmp6_send(const void* data, size_t length, const ip6_addr_t* daddr) {
+// the message is copied in, with type and checksum filled in, so the
+// source can be a received frame that is left as it was
+static int icmp6_send(uint8_t type, const void* data, size_t length, const ip6_addr_t* daddr) {
     ip6_pkt_t* p;
     icmp6_hdr_t* icmp;
 
@@ -240,6 +226,8 @@ static int icmp6_send(const void* data, size_t length, const ip6_addr_t* daddr)
 
     icmp = (void*)p->data;
     memcpy(icmp, data, length);
+    icmp->type = type;
+    icmp->checksum = 0;
     icmp->checksum = ip6_checksum(&p->ip6, HDR_ICMP6, length);
     return eth_send(p->eth + 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
 
@@ -254,13 +242,13 @@ void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
 
     if (len < UDP_HDR_LEN)
         BAD("Bogus Header Len");
+    // 0xFFFF stands for a computed 0 and sums the same, so the frame
+    // is checked as it is, without writing to it
     if (udp->checksum == 0)
         BAD("Checksum Invalid");
-    if (udp->checksum == 0xFFFF)
-        udp->checksum = 0;
 
-    sum = checksum(&ip->length, 2, htons(HDR_UDP));
-    sum = checksum(&ip->src, 32 + len, sum);
+    sum = ip6_sum(&ip->length, 2, htons(HDR_UDP));
+    sum = ip6_sum(&ip->src, 32 + len, sum);
     if (sum != 0xFFFF)
         BAD("Checksum Incorrect");
 
@@ -282,11 +270,9 @@ void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
 
     if (icmp->checksum == 0)
         BAD("Checksum Invalid");
-    if (icmp->checksum == 0xFFFF)
-        icmp->checksum = 0;
 
-    sum = checksum(&ip->length, 2, htons(HDR_ICMP6));
-    sum = checksum(&ip->src, 32 + len, sum);
+    sum = ip6_sum(&ip->length, 2, htons(HDR_ICMP6));
+    sum = ip6_sum(&ip->src, 32 + len, sum);
     if (sum != 0xFFFF)
         BAD("Checksum Incorrect");
 
@@ -313,14 +299,12 @@ void icmp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
         msg.opt[1] = 1;
         memcpy(msg.opt + 2, &ll_mac_addr, ETH_ADDR_LEN);
 
-        icmp6_send(&msg, sizeof(msg), (void*)&ip->src);
+        icmp6_send(ICMP6_NDP_N_ADVERTISE, &msg, sizeof(msg), (void*)&ip->src);
         return;
     }
 
     if (icmp->type == ICMP6_ECHO_REQUEST) {
-        icmp->checksum = 0;
-        icmp->type = ICMP6_ECHO_REPLY;
-        icmp6_send(_data, len, (void*)&ip->src);
+        icmp6_send(ICMP6_ECHO_REPLY, _data, len, (void*)&ip->src);
         return;
     }
 
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <magenta/device/ethernet.h>
 #include <magenta/types.h>
 #include <magenta/syscalls.h>
 
@@ -52,7 +53,16 @@ static uint8_t netmac[6];
 
 #define MAX_FILTER 8
 
-#define NUM_BUFFER_PAGES 8
+// Frames move through a send session and a receive session with the
+// device (see magenta/device/ethernet.h), each with a ring of NET_SLOTS
+// entries and one NET_SLOT_SIZE buffer per entry.  The send session's
+// buffers are the ones handed out by eth_get_buffer().  A device that
+// spreads frames over several receive queues gets a receive session for
+// each, up to NET_RX_QUEUES.
+#define NET_SLOTS 32
+#define NET_SLOT_SIZE 2048
+#define NET_RX_QUEUES 4
+
 #define ETH_BUFFER_SIZE 1536
 #define ETH_BUFFER_MAGIC 0x424201020304A7A7UL
 
@@ -63,13 +73,109 @@ struct eth_buffer {
     uint8_t data[0];
 };
 
+typedef struct {
+    mx_handle_t fifo;
+    mx_handle_t vmo;
+    uintptr_t addr;
+    size_t size;
+    eth_fifo_entry_t* ring;
+    uint8_t* data;
+    uint64_t head;
+    uint64_t tail;
+} net_session_t;
+
+static net_session_t tx;
+static net_session_t rx[NET_RX_QUEUES];
+static uint32_t rx_queues;
+
+// the buffer each send slot is using, until the device is done with it
+static eth_buffer_t* tx_inflight[NET_SLOTS];
+
 static eth_buffer_t* eth_buffers = NULL;
 
+static mx_status_t net_session_open(net_session_t* s, uint32_t dir, uint32_t queue,
+                                    uint32_t* queues) {
+    memset(s, 0, sizeof(*s));
+    eth_fifo_config_t config = {
+        .count = NET_SLOTS,
+        .dir = dir,
+        .data_size = NET_SLOTS * NET_SLOT_SIZE,
+        .queue = queue,
+    };
+    eth_fifo_info_t info;
+    ssize_t r = ioctl_ethernet_fifo_create(netfd, &config, &info);
+    if (r < 0) {
+        return r;
+    }
+    s->fifo = info.fifo;
+    s->vmo = info.vmo;
+    *queues = (info.rx_queues > 0) ? info.rx_queues : 1;
+    s->size = info.data_offset + config.data_size;
+    mx_status_t status = mx_process_map_vm(mx_process_self(), s->vmo, 0, s->size, &s->addr,
+                                           MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    if (status < 0) {
+        mx_handle_close(s->fifo);
+        mx_handle_close(s->vmo);
+        s->fifo = s->vmo = MX_HANDLE_INVALID;
+        return status;
+    }
+    s->ring = (eth_fifo_entry_t*)s->addr;
+    s->data = (uint8_t*)s->addr + info.data_offset;
+    return NO_ERROR;
+}
+
+static void net_session_close(net_session_t* s) {
+    if (s->addr) {
+        mx_process_unmap_vm(mx_process_self(), s->addr, s->size);
+    }
+    mx_handle_close(s->fifo);
+    mx_handle_close(s->vmo);
+    memset(s, 0, sizeof(*s));
+}
+
+// Hands the next n entries to the device, waking it only if it had
+// caught up and so may be waiting.
+static void net_session_post(net_session_t* s, uint64_t n) {
+    uint64_t head = s->head;
+    if (mx_fifo_op(s->fifo, MX_FIFO_OP_ADVANCE_HEAD, n, NULL) < 0) {
+        return;
+    }
+    s->head += n;
+    mx_fifo_state_t state;
+    if ((mx_fifo_op(s->fifo, MX_FIFO_OP_READ_STATE, 0, &state) < 0) || (state.tail == head)) {
+        mx_object_signal_peer(s->fifo, 0, ETH_FIFO_SIGNAL);
+    }
+}
+
+void eth_put_buffer(void* data);
+
+// takes back the buffers of the frames the device is done sending
+static void tx_reclaim(void) {
+    mx_fifo_state_t state;
+    if (mx_fifo_op(tx.fifo, MX_FIFO_OP_READ_STATE, 0, &state) < 0) {
+        return;
+    }
+    for (; tx.tail < state.tail; tx.tail++) {
+        uint32_t slot = tx.tail & (NET_SLOTS - 1);
+        eth_put_buffer(tx_inflight[slot]->data);
+        tx_inflight[slot] = NULL;
+    }
+}
+
 void* eth_get_buffer(size_t sz) {
     eth_buffer_t* buf;
     if (sz > ETH_BUFFER_SIZE) {
         return NULL;
     }
+    if ((eth_buffers == NULL) && (tx.fifo != MX_HANDLE_INVALID)) {
+        mx_object_signal(tx.fifo, ETH_FIFO_SIGNAL, 0);
+        tx_reclaim();
+        if ((eth_buffers == NULL) && (tx.tail < tx.head)) {
+            mx_handle_wait_one(tx.fifo, ETH_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED,
+                               MX_MSEC(100), NULL);
+            tx_reclaim();
+        }
+    }
     if (eth_buffers == NULL) {
         printf("out of buffers\n");
         return NULL;
@@ -100,13 +206,22 @@ int eth_send(void* data, size_t len) {
         return len;
     }
 #endif
-    int r = write(netfd, data, len);
-    eth_put_buffer(data);
-    return r;
+    // there are no more buffers than slots, so there's always a slot
+    uint32_t slot = tx.head & (NET_SLOTS - 1);
+    tx_inflight[slot] = (void*)(((uintptr_t)data) & (~31));
+    tx.ring[slot].offset = (uint8_t*)data - tx.data;
+    tx.ring[slot].length = len;
+    tx.ring[slot].flags = 0;
+    net_session_post(&tx, 1);
+    return len;
 }
 
 void netifc_send(const void* data, size_t len) {
-    write(netfd, data, len);
+    void* buf = eth_get_buffer(len);
+    if (buf != NULL) {
+        memcpy(buf, data, len);
+        eth_send(buf, len);
+    }
 }
 
 int eth_add_mcast_filter(const mac_addr_t* addr) {
@@ -141,21 +256,36 @@ static mx_status_t netifc_open_cb(int dirfd, const char* fn, void* cookie) {
         return NO_ERROR;
     }
 
-    if (read(netfd, netmac, 6) != 6) {
-        close(netfd);
-        netfd = -1;
+    uint32_t queues;
+    if ((read(netfd, netmac, 6) != 6) ||
+        (net_session_open(&tx, ETH_FIFO_TX, 0, &queues) < 0)) {
+        netifc_close();
         return NO_ERROR;
     }
+    // frames for netsvc may be steered to any of the queues
+    queues = (queues < NET_RX_QUEUES) ? queues : NET_RX_QUEUES;
+    for (rx_queues = 0; rx_queues < queues; rx_queues++) {
+        uint32_t unused;
+        if (net_session_open(&rx[rx_queues], ETH_FIFO_RX, rx_queues, &unused) < 0) {
+            netifc_close();
+            return NO_ERROR;
+        }
+    }
 
     ip6_init(netmac);
-    for (int i = 0; i < 8; i++) {
-        char* buffer = malloc(sizeof(eth_buffer_t) + ETH_BUFFER_SIZE + 32);
-        buffer = (char*)((((uintptr_t)buffer) + 31) & (~31));
-        if (buffer) {
-            eth_buffer_t* eb = (eth_buffer_t*)buffer;
-            eb->magic = ETH_BUFFER_MAGIC;
-            eth_put_buffer(buffer + sizeof(eth_buffer_t));
+    eth_buffers = NULL;
+    for (int i = 0; i < NET_SLOTS; i++) {
+        eth_buffer_t* eb = (eth_buffer_t*)(tx.data + i * NET_SLOT_SIZE);
+        eb->magic = ETH_BUFFER_MAGIC;
+        eth_put_buffer(eb->data);
+    }
+    for (uint32_t q = 0; q < rx_queues; q++) {
+        for (int i = 0; i < NET_SLOTS; i++) {
+            rx[q].ring[i].offset = i * NET_SLOT_SIZE;
+            rx[q].ring[i].length = NET_SLOT_SIZE;
+            rx[q].ring[i].flags = 0;
         }
+        net_session_post(&rx[q], NET_SLOTS);
     }
 
     // stop polling
@@ -174,6 +304,13 @@ int netifc_open(void) {
 }
 
 void netifc_close(void) {
+    net_session_close(&tx);
+    for (uint32_t q = 0; q < NET_RX_QUEUES; q++) {
+        net_session_close(&rx[q]);
+    }
+    rx_queues = 0;
+    eth_buffers = NULL;
+    memset(tx_inflight, 0, sizeof(tx_inflight));
     close(netfd);
     netfd = -1;
 }
@@ -182,32 +319,73 @@ int netifc_active(void) {
     return (netfd >= 0);
 }
 
-int netifc_poll(void) {
-    uint8_t buffer[2048];
-    mx_status_t r;
-
-    for (;;) {
-        while ((r = read(netfd, buffer, sizeof(buffer))) > 0) {
+// Hands the frames the device has filled in on s to netifc_recv(), and
+// the buffers back to the device, returning how many there were.
+static int64_t net_session_recv(net_session_t* s) {
+    // clear the signal before looking, so frames after this raise it
+    mx_object_signal(s->fifo, ETH_FIFO_SIGNAL, 0);
+    mx_fifo_state_t state;
+    if (mx_fifo_op(s->fifo, MX_FIFO_OP_READ_STATE, 0, &state) < 0) {
+        return -1;
+    }
+    uint64_t n = state.tail - s->tail;
+    for (; s->tail < state.tail; s->tail++) {
+        // each buffer goes back in the slot it came out of
+        eth_fifo_entry_t* e = &s->ring[s->tail & (NET_SLOTS - 1)];
+        if (e->flags & ETH_FIFO_OK) {
 #if DROP_PACKETS
             rxc++;
             if ((random() % DROP_PACKETS) == 0) {
                 printf("rx drop %d\n", rxc);
-                continue;
-            }
+            } else
 #endif
-            netifc_recv(buffer, r);
+            netifc_recv(s->data + e->offset, e->length);
         }
-        if (errno == ENOTCONN) {
-            return -1;
+        e->length = NET_SLOT_SIZE;
+        e->flags = 0;
+    }
+    if (n > 0) {
+        net_session_post(s, n);
+    }
+    return n;
+}
+
+int netifc_poll(void) {
+    for (;;) {
+        uint64_t n = 0;
+        for (uint32_t q = 0; q < rx_queues; q++) {
+            int64_t r = net_session_recv(&rx[q]);
+            if (r < 0) {
+                return -1;
+            }
+            n += r;
+        }
+        if (n > 0) {
+            continue;
         }
+
+        mx_time_t timeout = MX_TIME_INFINITE;
         if (net_timer) {
             mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
             if (now > net_timer) {
                 break;
             }
-            mxio_wait_fd(netfd, MXIO_EVT_READABLE, NULL, net_timer - now + MX_MSEC(1));
-        } else {
-            mxio_wait_fd(netfd, MXIO_EVT_READABLE, NULL, MX_TIME_INFINITE);
+            timeout = net_timer - now + MX_MSEC(1);
+        }
+        mx_wait_item_t items[NET_RX_QUEUES];
+        for (uint32_t q = 0; q < rx_queues; q++) {
+            items[q].handle = rx[q].fifo;
+            items[q].waitfor = ETH_FIFO_SIGNAL | MX_FIFO_PEER_CLOSED;
+            items[q].pending = 0;
+        }
+        mx_status_t status = mx_handle_wait_many(items, rx_queues, timeout);
+        if ((status < 0) && (status != ERR_TIMED_OUT)) {
+            return -1;
+        }
+        for (uint32_t q = 0; (status == NO_ERROR) && (q < rx_queues); q++) {
+            if (items[q].pending & MX_FIFO_PEER_CLOSED) {
+                return -1;
+            }
         }
     }
     return 0;
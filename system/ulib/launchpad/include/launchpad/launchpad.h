@@ -130,6 +130,27 @@ mx_status_t launchpad_elf_load(launchpad_t* lp, mx_handle_t vmo);
 mx_status_t launchpad_elf_load_extra(launchpad_t* lp, mx_handle_t vmo,
                                      mx_vaddr_t* base, mx_vaddr_t* entry);
 
+// A launchpad template holds an ELF file image, and its PT_INTERP
+// file if it has one, with the headers already read and the loader
+// service lookup already done, for launching the same program many
+// times.  launchpad_template_create consumes the VM object handle on
+// success but not on failure, and follows the same rule as
+// launchpad_elf_load_basic for a negative 'vmo' argument.  Once
+// created, a template is never modified, so it can be used by many
+// threads at once.
+typedef struct launchpad_template launchpad_template_t;
+mx_status_t launchpad_template_create(mx_handle_t vmo,
+                                      launchpad_template_t** result);
+void launchpad_template_destroy(launchpad_template_t* tmpl);
+
+// Do the same loading as launchpad_elf_load would for the template's
+// file, without reading any headers or talking to any loader service
+// to find the PT_INTERP file.  The template keeps its VM objects;
+// when the file has a PT_INTERP, a duplicate of the executable's
+// handle goes to the dynamic linker in the bootstrap message.
+mx_status_t launchpad_elf_load_template(launchpad_t* lp,
+                                        const launchpad_template_t* tmpl);
+
 // Discover the entry-point address after a successful call to
 // launchpad_elf_load or launchpad_elf_load_basic.  This can be used
 // in mx_process_start directly rather than calling launchpad_start,
@@ -320,24 +320,23 @@ static mx_handle_t loader_svc_rpc(mx_handle_t loader_svc, uint32_t opcode,
     memcpy(msg.data, data, len);
     msg.data[len] = 0;
 
-    mx_status_t status = mx_channel_write(loader_svc, 0,
-                                          &msg, sizeof(msg.header) + len + 1,
-                                          NULL, 0);
-    if (status != NO_ERROR)
-        return status;
-
-    status = mx_handle_wait_one(loader_svc, MX_SIGNAL_READABLE,
-                                MX_TIME_INFINITE, NULL);
-    if (status != NO_ERROR)
-        return status;
-
     mx_handle_t handle = MX_HANDLE_INVALID;
-    uint32_t reply_size = sizeof(msg.header);
-    uint32_t handle_count = 1;
-    status = mx_channel_read(loader_svc, 0, &msg, reply_size, &reply_size,
-                             &handle, handle_count, &handle_count);
+    const mx_channel_call_args_t call = {
+        .wr_bytes = &msg,
+        .wr_num_bytes = sizeof(msg.header) + len + 1,
+        .rd_bytes = &msg,
+        .rd_num_bytes = sizeof(msg.header),
+        .rd_handles = &handle,
+        .rd_num_handles = 1,
+    };
+    uint32_t reply_size;
+    uint32_t handle_count;
+    mx_status_t read_status = NO_ERROR;
+    mx_status_t status = mx_channel_call(loader_svc, 0, MX_TIME_INFINITE, &call,
+                                         &reply_size, &handle_count,
+                                         &read_status);
     if (status != NO_ERROR)
-        return status;
+        return status == ERR_CALL_FAILED ? read_status : status;
 
     // Check for protocol violations.
     if (reply_size != sizeof(msg.header)) {
@@ -438,7 +437,114 @@ mx_status_t launchpad_elf_load(launchpad_t* lp, mx_handle_t vmo) {
     return status;
 }
 
+struct launchpad_template {
+    mx_handle_t vmo;
+    elf_load_info_t* elf;
+    // The PT_INTERP file, or MX_HANDLE_INVALID for a static executable.
+    mx_handle_t interp_vmo;
+    elf_load_info_t* interp_elf;
+    size_t stack_size;
+};
+
+void launchpad_template_destroy(launchpad_template_t* tmpl) {
+    if (tmpl->interp_vmo != MX_HANDLE_INVALID)
+        mx_handle_close(tmpl->interp_vmo);
+    if (tmpl->interp_elf != NULL)
+        elf_load_destroy(tmpl->interp_elf);
+    if (tmpl->elf != NULL)
+        elf_load_destroy(tmpl->elf);
+    if (tmpl->vmo != MX_HANDLE_INVALID)
+        mx_handle_close(tmpl->vmo);
+    free(tmpl);
+}
+
+mx_status_t launchpad_template_create(mx_handle_t vmo,
+                                      launchpad_template_t** result) {
+    if (vmo < 0)
+        return vmo;
+    if (vmo == MX_HANDLE_INVALID)
+        return ERR_INVALID_ARGS;
+
+    launchpad_template_t* tmpl = calloc(1, sizeof(*tmpl));
+    if (tmpl == NULL)
+        return ERR_NO_MEMORY;
+    tmpl->interp_vmo = MX_HANDLE_INVALID;
+
+    mx_status_t status = elf_load_start(vmo, &tmpl->elf);
+    char* interp = NULL;
+    size_t interp_len;
+    if (status == NO_ERROR)
+        status = elf_load_get_interp(tmpl->elf, vmo, &interp, &interp_len);
+    if (status == NO_ERROR && interp != NULL) {
+        // Look the interpreter up once, with a loader service that
+        // lives just long enough for that.
+        mx_handle_t loader_svc = mxio_loader_service(NULL, NULL);
+        if (loader_svc < 0) {
+            status = loader_svc;
+        } else {
+            mx_handle_t interp_vmo = loader_svc_rpc(
+                loader_svc, LOADER_SVC_OP_LOAD_OBJECT, interp, interp_len);
+            mx_handle_close(loader_svc);
+            if (interp_vmo < 0) {
+                status = interp_vmo;
+            } else {
+                tmpl->interp_vmo = interp_vmo;
+                status = elf_load_start(interp_vmo, &tmpl->interp_elf);
+            }
+        }
+    }
+    free(interp);
+
+    if (status != NO_ERROR) {
+        // The caller keeps the VM object on failure.
+        tmpl->vmo = MX_HANDLE_INVALID;
+        launchpad_template_destroy(tmpl);
+        return status;
+    }
+
+    tmpl->vmo = vmo;
+    tmpl->stack_size = elf_load_get_stack_size(tmpl->elf);
+    *result = tmpl;
+    return NO_ERROR;
+}
+
+mx_status_t launchpad_elf_load_template(launchpad_t* lp,
+                                        const launchpad_template_t* tmpl) {
+    mx_status_t status;
+    if (tmpl->interp_vmo == MX_HANDLE_INVALID) {
+        status = elf_load_finish(lp_proc(lp), tmpl->elf, tmpl->vmo,
+                                 &lp->base, &lp->entry);
+        if (status != NO_ERROR)
+            return status;
+        lp->loader_message = false;
+    } else {
+        status = setup_loader_svc(lp);
+        if (status != NO_ERROR)
+            return status;
+        mx_handle_t exec_vmo;
+        status = mx_handle_duplicate(tmpl->vmo, MX_RIGHT_SAME_RIGHTS,
+                                     &exec_vmo);
+        if (status != NO_ERROR)
+            return status;
+        status = elf_load_finish(lp_proc(lp), tmpl->interp_elf,
+                                 tmpl->interp_vmo, &lp->base, &lp->entry);
+        if (status != NO_ERROR) {
+            mx_handle_close(exec_vmo);
+            return status;
+        }
+        if (lp->special_handles[HND_EXEC_VMO] != MX_HANDLE_INVALID)
+            mx_handle_close(lp->special_handles[HND_EXEC_VMO]);
+        lp->special_handles[HND_EXEC_VMO] = exec_vmo;
+        lp->loader_message = true;
+    }
+    if (tmpl->stack_size > 0)
+        launchpad_set_stack_size(lp, tmpl->stack_size);
+    return NO_ERROR;
+}
+
 static mx_handle_t vdso_vmo = MX_HANDLE_INVALID;
+// The system vDSO's headers, read the first time it's loaded.
+static elf_load_info_t* vdso_elf;
 static mtx_t vdso_mutex = MTX_INIT;
 static void vdso_lock(void) {
     mtx_lock(&vdso_mutex);
@@ -470,6 +576,10 @@ mx_handle_t launchpad_set_vdso_vmo(mx_handle_t new_vdso_vmo) {
     vdso_lock();
     mx_handle_t old = vdso_vmo;
     vdso_vmo = new_vdso_vmo;
+    if (vdso_elf != NULL) {
+        elf_load_destroy(vdso_elf);
+        vdso_elf = NULL;
+    }
     vdso_unlock();
     return old;
 }
@@ -490,8 +600,12 @@ mx_status_t launchpad_load_vdso(launchpad_t* lp, mx_handle_t vmo) {
         return launchpad_elf_load_extra(lp, vmo, &lp->vdso_base, NULL);
     vdso_lock();
     vmo = vdso_get_vmo();
-    mx_status_t status = launchpad_elf_load_extra(lp, vmo,
-                                                  &lp->vdso_base, NULL);
+    mx_status_t status = vmo < 0 ? vmo : NO_ERROR;
+    if (status == NO_ERROR && vdso_elf == NULL)
+        status = elf_load_start(vmo, &vdso_elf);
+    if (status == NO_ERROR)
+        status = elf_load_finish(lp_proc(lp), vdso_elf, vmo,
+                                 &lp->vdso_base, NULL);
     vdso_unlock();
     return status;
 }
@@ -666,26 +780,50 @@ size_t launchpad_set_stack_size(launchpad_t* lp, size_t new_size) {
     return old_size;
 }
 
+// Gets the initial thread, its stack and the bootstrap message ready.
+// With |start|, the stack's mapping and the write of the message are left
+// for mx_process_start_etc(): they're described in |start| and
+// |stack_map|, and start->msg.bytes is for the caller to free.  Without
+// it, they're done here.  The initial stack pointer goes in |sp|.
 static mx_status_t prepare_start(launchpad_t* lp, const char* thread_name,
                                  mx_handle_t to_child,
-                                 mx_handle_t* thread, uintptr_t* sp) {
+                                 mx_handle_t* thread, uintptr_t* sp,
+                                 mx_process_start_t* start,
+                                 mx_process_map_t* stack_map) {
     if (lp->entry == 0)
         return ERR_BAD_STATE;
 
     *sp = 0;
+    if (start != NULL) {
+        start->stack_map = MX_PROCESS_START_NO_MAP;
+        start->bootstrap = MX_HANDLE_INVALID;
+    }
     if (lp->stack_size > 0) {
         // Allocate the initial thread's stack.
         mx_handle_t stack_vmo;
         mx_status_t status = mx_vmo_create(lp->stack_size, 0, &stack_vmo);
         if (status < 0)
             return status;
-        mx_vaddr_t stack_base;
-        status = mx_process_map_vm(
-            lp_proc(lp), stack_vmo, 0, lp->stack_size, &stack_base,
-            MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+        DEBUG_ASSERT(lp->stack_size % PAGE_SIZE == 0);
+        if (start != NULL) {
+            // The mapping is made before the message carrying the VMO
+            // goes, and the stack pointer is offset by where it went.
+            *stack_map = (mx_process_map_t){
+                .vmo = stack_vmo,
+                .flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                .len = lp->stack_size,
+            };
+            start->stack_map = 0;
+            *sp = compute_initial_stack_pointer(0, lp->stack_size);
+        } else {
+            mx_vaddr_t stack_base;
+            status = mx_process_map_vm(
+                lp_proc(lp), stack_vmo, 0, lp->stack_size, &stack_base,
+                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+            if (status == NO_ERROR)
+                *sp = compute_initial_stack_pointer(stack_base, lp->stack_size);
+        }
         if (status == NO_ERROR) {
-            DEBUG_ASSERT(lp->stack_size % PAGE_SIZE == 0);
-            *sp = compute_initial_stack_pointer(stack_base, lp->stack_size);
             // Pass the stack VMO to the process.  Our protocol with the
             // new process is that we warrant that this is the VMO from
             // which the initial stack is mapped and that we've exactly
@@ -750,6 +888,17 @@ static mx_status_t prepare_start(launchpad_t* lp, const char* thread_name,
         return ERR_BUFFER_TOO_SMALL;
     }
 
+    if (start != NULL) {
+        start->bootstrap = to_child;
+        start->msg = (mx_channel_msg_t){
+            .bytes = msg,
+            .handles = lp->handles,
+            .num_bytes = size,
+            .num_handles = lp->handle_count,
+        };
+        return NO_ERROR;
+    }
+
     status = mx_channel_write(to_child, 0, msg, size,
                               lp->handles, lp->handle_count);
     free(msg);
@@ -782,15 +931,28 @@ mx_handle_t launchpad_start(launchpad_t* lp) {
     mx_handle_t to_child = channelh[0];
     mx_handle_t child_bootstrap = channelh[1];
 
+    // The stack is mapped, the bootstrap message sent and the process
+    // started with one mx_process_start_etc() call.
     mx_handle_t thread;
-    uintptr_t sp;
-    status = prepare_start(lp, "main", to_child, &thread, &sp);
-    mx_handle_close(to_child);
+    mx_process_start_t start;
+    mx_process_map_t stack_map;
+    status = prepare_start(lp, "main", to_child, &thread, &start.stack,
+                           &start, &stack_map);
     if (status == NO_ERROR) {
-        status = mx_process_start(proc, thread, lp->entry, sp,
-                                  child_bootstrap, lp->vdso_base);
+        start.entry = lp->entry;
+        start.arg_handle = child_bootstrap;
+        start.arg2 = lp->vdso_base;
+        status = mx_process_start_etc(proc, thread, &start, &stack_map,
+                                      start.stack_map == MX_PROCESS_START_NO_MAP ? 0 : 1);
+        free(start.msg.bytes);
         mx_handle_close(thread);
+
+        // The message's handles are gone whether or not it worked.
+        for (size_t i = 0; i < lp->handle_count; ++i)
+            lp->handles[i] = MX_HANDLE_INVALID;
+        lp->handle_count = 0;
     }
+    mx_handle_close(to_child);
     // process_start consumed child_bootstrap if successful.
     if (status == NO_ERROR)
         return proc;
@@ -805,7 +967,7 @@ mx_status_t launchpad_start_injected(launchpad_t* lp, const char* thread_name,
     mx_handle_t thread;
     uintptr_t sp;
     mx_status_t status = prepare_start(lp, thread_name, to_child,
-                                       &thread, &sp);
+                                       &thread, &sp, NULL, NULL);
     if (status == NO_ERROR) {
         status = mx_thread_start(thread, lp->entry, sp,
                                  bootstrap_handle_in_child, lp->vdso_base);
@@ -0,0 +1,26 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include <magenta/compiler.h>
+#include "private.h"
+
+uint64_t _mx_ticks_get(void) {
+    if (DATA_CONSTANTS.ticks_per_second == 0)
+        return VDSO_mx_clock_get(MX_CLOCK_MONOTONIC);
+    return read_ticks();
+}
+
+uint64_t _mx_ticks_per_second(void) {
+    // Without a counter user mode can read, ticks are nanoseconds.
+    if (DATA_CONSTANTS.ticks_per_second == 0)
+        return 1000000000u;
+    return DATA_CONSTANTS.ticks_per_second;
+}
+
+__typeof(mx_ticks_get) mx_ticks_get
+    __attribute__((weak, alias("_mx_ticks_get")));
+__typeof(mx_ticks_per_second) mx_ticks_per_second
+    __attribute__((weak, alias("_mx_ticks_per_second")));
@@ -0,0 +1,42 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+
+#include <magenta/compiler.h>
+#include "private.h"
+
+// Multiplies |ticks| by the 32.64 fixed point |ns_per_tick_*| constants,
+// rounding to the nearest nanosecond. This is the same arithmetic as
+// u64_mul_u64_fp32_64() in the kernel's <lib/fixed_point.h>, so the
+// result matches what the kernel would return for MX_CLOCK_MONOTONIC.
+static uint64_t ticks_to_ns(uint64_t ticks) {
+    const uint32_t l0 = DATA_CONSTANTS.ns_per_tick_l0;
+    const uint32_t l32 = DATA_CONSTANTS.ns_per_tick_l32;
+    const uint32_t l64 = DATA_CONSTANTS.ns_per_tick_l64;
+    const uint32_t a_r32 = ticks >> 32;
+    const uint32_t a_0 = ticks;
+    uint64_t tmp;
+
+    uint64_t res_0 = ((uint64_t)a_r32 * l0) << 32;
+    res_0 += (uint64_t)a_0 * l0;
+    res_0 += (uint64_t)a_r32 * l32;
+    tmp = (uint64_t)a_0 * l32;
+    res_0 += tmp >> 32;
+    uint64_t res_l32 = (uint32_t)tmp;
+    tmp = (uint64_t)a_r32 * l64;
+    res_0 += tmp >> 32;
+    res_l32 += (uint32_t)tmp;
+    res_l32 += ((uint64_t)a_0 * l64) >> 32;
+    res_0 += res_l32 >> 32;
+    return res_0 + ((uint32_t)res_l32 >> 31);
+}
+
+mx_time_t _mx_time_get(uint32_t clock_id) {
+    if (clock_id == MX_CLOCK_MONOTONIC && DATA_CONSTANTS.ticks_to_time_valid)
+        return ticks_to_ns(read_ticks());
+    return VDSO_mx_clock_get(clock_id);
+}
+
+__typeof(mx_time_get) mx_time_get __attribute__((weak, alias("_mx_time_get")));
@@ -6,6 +6,32 @@
 
 // This defines the struct shared with the kernel.
 #include <lib/vdso-constants.h>
+#include <magenta/types.h>
 
 extern const struct vdso_constants DATA_CONSTANTS
     __attribute__((visibility("hidden")));
+
+// Reads the tick counter described by DATA_CONSTANTS.ticks_per_second.
+// Callers must check that the kernel said there is one.
+static inline uint64_t read_ticks(void) {
+#if defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntpct_el0" : "=r"(ticks));
+    return ticks;
+#elif defined(__arm__)
+    uint64_t ticks;
+    __asm__ volatile("mrrc p15, 0, %Q0, %R0, c14" : "=r"(ticks));
+    return ticks;
+#else
+#error Unsupported architecture
+#endif
+}
+
+// This is the real system call for mx_clock_get(), called directly
+// rather than through the PLT since this DSO has no writable data.
+extern mx_time_t VDSO_mx_clock_get(uint32_t clock_id)
+    __attribute__((visibility("hidden")));
@@ -20,6 +20,8 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/data.c \
     $(LOCAL_DIR)/mx_num_cpus.c \
     $(LOCAL_DIR)/mx_status_get_string.c \
+    $(LOCAL_DIR)/mx_ticks_get.c \
+    $(LOCAL_DIR)/mx_time_get.c \
     $(LOCAL_DIR)/mx_version_get.c \
 
 ifeq ($(ARCH),arm)
@@ -51,6 +51,11 @@ public:
                            uint32_t prot) const {
         return mx_process_protect_vm(get(), address, len, prot);
     }
+
+    mx_status_t advise_vm(uintptr_t address, size_t len,
+                          uint32_t advice) const {
+        return mx_process_advise_vm(get(), address, len, advice);
+    }
 };
 
 } // namespace mx
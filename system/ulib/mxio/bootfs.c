@@ -24,7 +24,8 @@ static const char FSMAGIC[16] = "[BOOTFS]\0\0\0\0\0\0\0\0";
 //   fileoffset (32bit le)
 //   namedata   (namelength bytes, includes \0)
 //
-// - fileoffsets must be page aligned (multiple of 4096)
+// - fileoffsets must be page aligned (multiple of 4096), the low bits are
+//   BOOTFS_FILE_* flags
 
 #define NLEN 0
 #define FSIZ 1
@@ -36,7 +37,7 @@ struct bootfs_magic {
 };
 
 void bootfs_parse(mx_handle_t vmo, size_t len,
-                  void (*cb)(void*, const char* fn, size_t off, size_t len),
+                  void (*cb)(void*, const char* fn, size_t off, size_t len, uint32_t flags),
                   void* cb_arg) {
     size_t rlen;
     mx_off_t off = 0;
@@ -99,8 +100,8 @@ void bootfs_parse(mx_handle_t vmo, size_t len,
             break;
         }
 
-        // require correct alignment
-        if (header[FOFF] & 4095) {
+        // require correct alignment, and no flags we don't know
+        if ((header[FOFF] & BOOTFS_FILE_FLAGS_MASK) & ~BOOTFS_FILE_COMPRESSED) {
             break;
         }
 
@@ -111,6 +112,7 @@ void bootfs_parse(mx_handle_t vmo, size_t len,
         data += header[NLEN];
         name[header[NLEN] - 1] = 0;
 
-        (*cb)(cb_arg, name, header[FOFF], header[FSIZ]);
+        (*cb)(cb_arg, name, header[FOFF] & ~BOOTFS_FILE_FLAGS_MASK, header[FSIZ],
+              header[FOFF] & BOOTFS_FILE_FLAGS_MASK);
     }
 }
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,26 +16,43 @@
 
 #define MXDEBUG 0
 
+#define MAX_WORKERS 16
+
 typedef struct {
     list_node_t node;
     mx_handle_t h;
     uint32_t flags;
     void* cb;
     void* cookie;
+    mx_handle_t ioport;
 } handler_t;
 
 #define FLAG_DISCONNECTED 1
 
+// Each worker thread waits on a port of its own, and handlers are spread
+// across the ports as they are added, so every handler is only ever run
+// by the one thread, in the order its packets arrived, while handlers on
+// different workers run in parallel.
+typedef struct {
+    mxio_dispatcher_t* md;
+    mx_handle_t ioport;
+} worker_t;
+
 struct mxio_dispatcher {
     mtx_t lock;
     list_node_t list;
-    mx_handle_t ioport;
     mxio_dispatcher_cb_t cb;
-    thrd_t t;
+    worker_t workers[MAX_WORKERS];
+    uint32_t worker_count;
+    uint32_t next_worker;
+    uint32_t running;
+    bool started;
 };
 
 static void mxio_dispatcher_destroy(mxio_dispatcher_t* md) {
-    mx_handle_close(md->ioport);
+    for (uint32_t i = 0; i < md->worker_count; i++) {
+        mx_handle_close(md->workers[i].ioport);
+    }
     free(md);
 }
 
@@ -56,20 +74,20 @@ static void disconnect_handler(mxio_dispatcher_t* md, handler_t* handler, bool n
     mx_io_packet_t packet;
     packet.hdr.key = (uint64_t)(uintptr_t)handler;
     packet.signals = need_close_cb ? MX_SIGNAL_SIGNALED : 0;
-    mx_port_queue(md->ioport, &packet, sizeof(packet));
+    mx_port_queue(handler->ioport, &packet, sizeof(packet));
 
     // flag so we know to ignore further events
     handler->flags |= FLAG_DISCONNECTED;
 }
 
-static int mxio_dispatcher_thread(void* _md) {
-    mxio_dispatcher_t* md = _md;
+static int mxio_dispatcher_thread(void* _worker) {
+    worker_t* worker = _worker;
+    mxio_dispatcher_t* md = worker->md;
     mx_status_t r;
 
-again:
     for (;;) {
         mx_io_packet_t packet;
-        if ((r = mx_port_wait(md->ioport, MX_TIME_INFINITE, &packet, sizeof(packet))) < 0) {
+        if ((r = mx_port_wait(worker->ioport, MX_TIME_INFINITE, &packet, sizeof(packet))) < 0) {
             printf("dispatcher: ioport wait failed %d\n", r);
             break;
         }
@@ -99,7 +117,12 @@ again:
     }
 
     printf("dispatcher: FATAL ERROR, EXITING\n");
-    mxio_dispatcher_destroy(md);
+    mtx_lock(&md->lock);
+    bool last = (--md->running == 0);
+    mtx_unlock(&md->lock);
+    if (last) {
+        mxio_dispatcher_destroy(md);
+    }
     return NO_ERROR;
 }
 
@@ -112,35 +135,73 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
     list_initialize(&md->list);
     mtx_init(&md->lock, mtx_plain);
     mx_status_t status;
-    if ((status = mx_port_create(0u, &md->ioport)) < 0) {
+    if ((status = mx_port_create(0u, &md->workers[0].ioport)) < 0) {
         free(md);
         return status;
     }
+    md->workers[0].md = md;
+    md->worker_count = 1;
     md->cb = cb;
     *out = md;
     return NO_ERROR;
 }
 
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name) {
-    mx_status_t r;
+    return mxio_dispatcher_start_threads(md, name, 1);
+}
+
+mx_status_t mxio_dispatcher_start_threads(mxio_dispatcher_t* md, const char* name,
+                                          uint32_t threads) {
+    if (threads == 0 || threads > MAX_WORKERS) {
+        return ERR_INVALID_ARGS;
+    }
     mtx_lock(&md->lock);
-    if (md->t == NULL) {
-        if (thrd_create_with_name(&md->t, mxio_dispatcher_thread, md, name) != thrd_success) {
-            mxio_dispatcher_destroy(md);
-            r = ERR_NO_RESOURCES;
-        } else {
-            thrd_detach(md->t);
-            r = NO_ERROR;
+    if (md->started) {
+        mtx_unlock(&md->lock);
+        return ERR_BAD_STATE;
+    }
+    md->started = true;
+
+    // handles added so far are all on the first worker's port
+    while (md->worker_count < threads) {
+        worker_t* worker = &md->workers[md->worker_count];
+        if (mx_port_create(0u, &worker->ioport) < 0) {
+            break;
+        }
+        worker->md = md;
+        md->worker_count++;
+    }
+    for (uint32_t i = 0; i < md->worker_count; i++) {
+        thrd_t t;
+        if (thrd_create_with_name(&t, mxio_dispatcher_thread, &md->workers[i],
+                                  name) != thrd_success) {
+            break;
         }
-    } else {
-        r = ERR_BAD_STATE;
+        thrd_detach(t);
+        md->running++;
     }
+
+    if (md->running == 0) {
+        mtx_unlock(&md->lock);
+        mxio_dispatcher_destroy(md);
+        return ERR_NO_RESOURCES;
+    }
+    // workers that didn't start must not be handed any handles; fewer
+    // threads than asked for still make a working dispatcher
+    for (uint32_t i = md->running; i < md->worker_count; i++) {
+        mx_handle_close(md->workers[i].ioport);
+    }
+    md->worker_count = md->running;
     mtx_unlock(&md->lock);
-    return r;
+    return NO_ERROR;
 }
 
 void mxio_dispatcher_run(mxio_dispatcher_t* md) {
-    mxio_dispatcher_thread(md);
+    mtx_lock(&md->lock);
+    md->started = true;
+    md->running = 1;
+    mtx_unlock(&md->lock);
+    mxio_dispatcher_thread(&md->workers[0]);
 }
 
 mx_status_t mxio_dispatcher_add(mxio_dispatcher_t* md, mx_handle_t h, void* cb, void* cookie) {
@@ -156,8 +217,10 @@ mx_status_t mxio_dispatcher_add(mxio_dispatcher_t* md, mx_handle_t h, void* cb,
     handler->cookie = cookie;
 
     mtx_lock(&md->lock);
+    handler->ioport = md->workers[md->next_worker].ioport;
+    md->next_worker = (md->next_worker + 1) % md->worker_count;
     list_add_tail(&md->list, &handler->node);
-    if ((r = mx_port_bind(md->ioport, (uint64_t)(uintptr_t)handler, h,
+    if ((r = mx_port_bind(handler->ioport, (uint64_t)(uintptr_t)handler, h,
                              MX_SIGNAL_READABLE | MX_SIGNAL_PEER_CLOSED)) < 0) {
         list_delete(&handler->node);
     }
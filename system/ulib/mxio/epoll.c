@@ -9,7 +9,6 @@
 #include <sys/epoll.h>
 #include <threads.h>
 
-#include <magenta/listnode.h>
 #include <magenta/syscalls.h>
 #include <mxio/io.h>
 #include <mxio/util.h>
@@ -20,52 +19,32 @@
 // TODO: should use a system default
 #define MAX_WAIT_EVENTS 1024
 
+// Registrations live in a table indexed by fd, so epoll_ctl() doesn't
+// search, and the waitset does the waiting, so epoll_wait() only looks at
+// the fds that are ready.  The waitset cookie carries the fd along with a
+// sequence number that is never reused, so a result for an fd that was
+// removed, or removed and added again, after the waitset produced it is
+// recognized and dropped.
 typedef struct mxio_epoll_cookie {
-    list_node_t node;
     mxio_t* io;
     struct epoll_event ep_event;
-    int fd;
+    uint64_t key;
 } mxio_epoll_cookie_t;
 
 typedef struct mxio_epoll {
     mxio_t io;
     mx_handle_t h;
     mtx_t cookies_lock;
-    list_node_t cookies;
+    uint32_t seq;
+    mxio_epoll_cookie_t* cookies[MAX_MXIO_FD];
 } mxio_epoll_t;
 
-static void mxio_epoll_cookie_add(mxio_epoll_t* epio,
-                                  mxio_epoll_cookie_t* cookie) {
-    mtx_lock(&epio->cookies_lock);
-    list_add_head(&epio->cookies, &cookie->node);
-    mtx_unlock(&epio->cookies_lock);
-}
-
-static mxio_epoll_cookie_t* mxio_epoll_cookie_get(mxio_epoll_t* epio, int fd,
-                                                  bool remove) {
-    mxio_epoll_cookie_t* cookie = NULL;
-    mxio_epoll_cookie_t* entry = NULL;
-    mtx_lock(&epio->cookies_lock);
-    list_for_every_entry(&epio->cookies, entry, mxio_epoll_cookie_t, node) {
-        // doesn't have to be _safe as we break immediately after deletion
-        if (entry->fd == fd) {
-            if (remove) {
-                list_delete(&entry->node);
-            }
-            cookie = entry;
-            break;
-        }
-    }
-    mtx_unlock(&epio->cookies_lock);
-    return cookie;
-}
-
-static mxio_epoll_cookie_t* mxio_epoll_cookie_find(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, false);
+static inline uint64_t cookie_key(uint32_t seq, int fd) {
+    return ((uint64_t)seq << 32) | (uint32_t)fd;
 }
 
-static mxio_epoll_cookie_t* mxio_epoll_cookie_remove(mxio_epoll_t* epio, int fd) {
-    return mxio_epoll_cookie_get(epio, fd, true);
+static inline int cookie_key_fd(uint64_t key) {
+    return (int)(key & 0xFFFFFFFF);
 }
 
 static mx_status_t mxio_epoll_close(mxio_t* io) {
@@ -74,12 +53,14 @@ static mx_status_t mxio_epoll_close(mxio_t* io) {
     epio->h = MX_HANDLE_INVALID;
     mx_handle_close(h);
 
-    mxio_epoll_cookie_t* cookie;
     mtx_lock(&epio->cookies_lock);
-    while ((cookie = list_remove_head_type(&epio->cookies, mxio_epoll_cookie_t,
-                                           node))) {
-        mxio_release(cookie->io);
-        free(cookie);
+    for (int fd = 0; fd < MAX_MXIO_FD; fd++) {
+        mxio_epoll_cookie_t* cookie = epio->cookies[fd];
+        if (cookie != NULL) {
+            epio->cookies[fd] = NULL;
+            mxio_release(cookie->io);
+            free(cookie);
+        }
     }
     mtx_unlock(&epio->cookies_lock);
     return NO_ERROR;
@@ -87,7 +68,9 @@ static mx_status_t mxio_epoll_close(mxio_t* io) {
 
 static mxio_ops_t mxio_epoll_ops = {
     .read = mxio_default_read,
+    .read_at = mxio_default_read_at,
     .write = mxio_default_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxio_default_misc,
     .close = mxio_epoll_close,
@@ -96,6 +79,7 @@ static mxio_ops_t mxio_epoll_ops = {
     .ioctl = mxio_default_ioctl,
     .wait_begin = mxio_default_wait_begin,
     .wait_end = mxio_default_wait_end,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_epoll_create(mx_handle_t h) {
@@ -109,7 +93,6 @@ mxio_t* mxio_epoll_create(mx_handle_t h) {
     epio->io.flags |= MXIO_FLAG_EPOLL;
     epio->h = h;
     mtx_init(&epio->cookies_lock, mtx_plain);
-    list_initialize(&epio->cookies);
     return &epio->io;
 }
 
@@ -172,10 +155,11 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         goto fail_no_io;
     }
 
-    mxio_epoll_cookie_t* cookie;
+    mtx_lock(&epio->cookies_lock);
+    mxio_epoll_cookie_t* cookie = epio->cookies[fd];
     switch (op) {
     case EPOLL_CTL_ADD:
-        if (mxio_epoll_cookie_find(epio, fd) != NULL)  {
+        if (cookie != NULL) {
             r = ERR_ALREADY_EXISTS;
             goto end;
         }
@@ -187,20 +171,18 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         }
         mxio_acquire(io);
         cookie->io = io;
-        cookie->fd = fd;
         break;
     case EPOLL_CTL_MOD:
     case EPOLL_CTL_DEL:
-        // or retrieve an existing cookie and remove the current epoll event
-        cookie = mxio_epoll_cookie_remove(epio, fd);
+        // or remove the current epoll event of the existing cookie
         if (cookie == NULL) {
             r = ERR_NOT_FOUND;
             goto end;
         }
-        if ((r = mx_waitset_remove(epio->h, (uint64_t)(uintptr_t)cookie)) < 0) {
-            mxio_epoll_cookie_add(epio, cookie);
+        if ((r = mx_waitset_remove(epio->h, cookie->key)) < 0) {
             goto end;
         }
+        epio->cookies[fd] = NULL;
         break;
     default:
         r = ERR_INVALID_ARGS;
@@ -212,26 +194,28 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ep_event) {
         mxio_release(cookie->io);
         free(cookie);
     } else {
-        // or add a new epoll event and put the cookie into the list
+        // or add a new epoll event and put the cookie in the table
         mx_handle_t h = MX_HANDLE_INVALID;
         mx_signals_t signals = 0;
-        io->ops->wait_begin(io, ep_event->events, &h, &signals);
+        cookie->io->ops->wait_begin(cookie->io, ep_event->events, &h, &signals);
         if (h == MX_HANDLE_INVALID) {
             // wait operation is not applicable to the handle
             r = ERR_INVALID_ARGS;
-            goto end;
+        } else {
+            cookie->ep_event = *ep_event;
+            cookie->key = cookie_key(++epio->seq, fd);
+            r = mx_waitset_add(epio->h, cookie->key, h, signals);
         }
-
-        cookie->ep_event = *ep_event;
-        if ((r = mx_waitset_add(epio->h, (uint64_t)(uintptr_t)cookie, h, signals)) < 0) {
+        if (r < 0) {
             mxio_release(cookie->io);
             free(cookie);
             goto end;
         }
-        mxio_epoll_cookie_add(epio, cookie);
+        epio->cookies[fd] = cookie;
     }
 
  end:
+    mtx_unlock(&epio->cookies_lock);
     mxio_release(io);
  fail_no_io:
     mxio_release(&epio->io);
@@ -269,19 +253,27 @@ int epoll_wait(int epfd, struct epoll_event* ep_events, int maxevents, int timeo
         return (r == ERR_TIMED_OUT) ? 0 : ERROR(r);
     }
 
+    // the cookies may have changed since the waitset gave us the results
+    uint32_t n = 0;
+    mtx_lock(&epio->cookies_lock);
     for (uint32_t i = 0; i < num_results; i++) {
-        mxio_epoll_cookie_t* cookie = (mxio_epoll_cookie_t*)(uintptr_t)results[i].cookie;
+        mxio_epoll_cookie_t* cookie = epio->cookies[cookie_key_fd(results[i].cookie)];
+        if ((cookie == NULL) || (cookie->key != results[i].cookie)) {
+            continue;
+        }
         mxio_t* io = cookie->io;
         uint32_t events;
 
         io->ops->wait_end(io, results[i].observed, &events);
         // mask unrequested events except HUP/ERR
-        ep_events[i].events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR);
+        ep_events[n].events = events & (cookie->ep_event.events | EPOLLHUP | EPOLLERR);
 
-        ep_events[i].data = cookie->ep_event.data;
+        ep_events[n].data = cookie->ep_event.data;
+        n++;
     }
+    mtx_unlock(&epio->cookies_lock);
     mxio_release(io);
-    return (int)num_results;
+    return (int)n;
 }
 
 int epoll_pwait(int epfd, struct epoll_event* events, int maxevents, int timeout, const sigset_t* sigmask) {
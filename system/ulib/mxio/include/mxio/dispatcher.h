@@ -6,6 +6,7 @@
 
 #include <magenta/types.h>
 #include <magenta/compiler.h>
+#include <stdint.h>
 
 __BEGIN_CDECLS
 
@@ -29,6 +30,14 @@ mx_status_t mxio_dispatcher_create(mxio_dispatcher_t** out, mxio_dispatcher_cb_t
 // create a thread for a dispatcher and start it running
 mx_status_t mxio_dispatcher_start(mxio_dispatcher_t* md, const char* name);
 
+// create up to 16 threads for a dispatcher and start them running
+//
+// Handles are spread across the threads as they are added.  Each handle
+// is only ever serviced by its one thread, so the callback only needs to
+// be safe against being called concurrently for different handles.
+mx_status_t mxio_dispatcher_start_threads(mxio_dispatcher_t* md, const char* name,
+                                          uint32_t threads);
+
 // run the dispatcher loop on the current thread, never to return
 void mxio_dispatcher_run(mxio_dispatcher_t* md);
 
@@ -58,6 +58,15 @@ int mxio_handle_fd(mx_handle_t h, mx_signals_t signals_in, mx_signals_t signals_
 // invoke a raw mxio ioctl
 ssize_t mxio_ioctl(int fd, int op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len);
 
+// turn client-side buffering of a remote file on or off
+//
+// With buffering on, reads that follow on from each other are served
+// from a growing read-ahead, and consecutive small writes are collected
+// and sent together when the buffer fills, or on seek, stat, fsync or
+// close.  Meant for streaming through a file; not for O_APPEND files.
+// Returns ERR_NOT_SUPPORTED for fds that aren't remote files.
+mx_status_t mxio_set_buffered(int fd, bool enable);
+
 // create a pipe, installing one half in a fd, returning the other
 // for transport to another process
 mx_status_t mxio_pipe_half(mx_handle_t* handle, uint32_t* type);
@@ -43,10 +43,12 @@ __BEGIN_CDECLS
 #define MXRIO_GETADDRINFO  0x00000017
 #define MXRIO_SETATTR      0x00000018
 #define MXRIO_SYNC         0x00000019
-#define MXRIO_NUM_OPS      26
+#define MXRIO_MMAP         0x0000001a
+#define MXRIO_NUM_OPS      27
 
 #define MXRIO_OP(n)            ((n) & 0xFFFF)
 #define MXRIO_REPLY_CHANNEL    0x01000000
+#define MXRIO_VMO_PAYLOAD      0x02000000
 
 #define MXRIO_OPNAMES { \
     "status", "close", "clone", "open", \
@@ -55,7 +57,7 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync" }
+    "setattr", "sync", "mmap" }
 
 const char* mxio_opname(uint32_t op);
 
@@ -94,7 +96,7 @@ struct mxrio_msg {
         uint32_t protocol;             // rx: Open
         uint32_t op;                   // tx: Ioctl
     } arg2;
-    int32_t reserved;
+    uint32_t txid;                     // tx: transaction id, rx: the same id
     uint32_t hcount;                   // number of valid handles
     mx_handle_t handle[4];             // up to 3 handles + reply channel handle
     uint8_t data[MXIO_CHUNK_SIZE];     // payload
@@ -102,6 +104,8 @@ struct mxrio_msg {
 
 // - msg.datalen is the size of data sent or received and must be <= MXIO_CHUNK_SIZE
 // - msg.arg is the return code on replies
+// - msg.txid is returned unchanged in the reply, so a client with several
+//   requests in flight can tell which one a reply completes
 
 // request---------------------------------------    response------------------------------
 // op          arg        arg2     data              arg2        data            handle[]
@@ -130,6 +134,7 @@ struct mxrio_msg {
 // GETADDRINFO maxreply   0        <getaddrinfo>     0           <getaddrinfo>   -
 // SETATTR     0          0        <vnattr>          0           -               -
 // SYNC        0          0        0                 0           -               -
+// MMAP        0          0        -                 offset      <mx_off_t:len>  vmohandle
 //
 // proposed:
 //
@@ -137,11 +142,21 @@ struct mxrio_msg {
 // MKDIR       0          0        <name>            0           -               -
 // SYMLINK     namelen    0        <name><path>      0           -               -
 // READLINK    maxreply   0        -                 0           <path>          -
-// MMAP        flags      offset   <uint64:len>      offset      -               vmohandle
 // FLUSH       0          0        -                 0           -               -
 // LINK*       0          0        <name>            0           -               -
 //
 // on response arg32 is always mx_status, and may be positive for read/write calls
 // * handle[0] used to pass reference to target object
+//
+// READ, READ_AT, WRITE and WRITE_AT may set MXRIO_VMO_PAYLOAD to move more
+// than MXIO_CHUNK_SIZE bytes in one transaction.  The payload then lives at
+// offset 0 of a VMO passed as handle[0] rather than in data, and arg is its
+// length.  The response carries no data; arg is the number of bytes read into
+// or written from the VMO.  mxrio_handler() splits these into chunk sized
+// calls to the server callback, so servers built on it need no changes.
+//
+// MMAP hands back a VMO holding the file's contents, which start at arg2.off
+// in it and run for len bytes.  Servers may hand out a VMO without write
+// rights, in which case only read-only or private mappings can be made.
 
 __END_CDECLS
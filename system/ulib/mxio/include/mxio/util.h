@@ -24,8 +24,11 @@ mx_status_t mxio_clone_fd(int fd, int newfd, mx_handle_t* handles, uint32_t* typ
 mx_status_t mxio_pipe_pair_raw(mx_handle_t* handles, uint32_t* types);
 mx_status_t mxio_transfer_fd(int fd, int newfd, mx_handle_t* handles, uint32_t* types);
 
+// Calls |cb| for each file in the bootfs image in |vmo|, with its offset and
+// size and any BOOTFS_FILE_* flags.  A file with BOOTFS_FILE_COMPRESSED is an
+// LZ4 frame at |off| that decompresses to |len| bytes.
 void bootfs_parse(mx_handle_t vmo, size_t len,
-                  void (*cb)(void*, const char* fn, size_t off, size_t len),
+                  void (*cb)(void*, const char* fn, size_t off, size_t len, uint32_t flags),
                   void* cb_arg);
 
 // used for bootstrap
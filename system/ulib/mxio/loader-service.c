@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <threads.h>
 #include <unistd.h>
@@ -42,6 +43,89 @@ static const char* libpaths[] = {
     "/boot/lib",
 };
 
+// Library VMOs already read, by path, so that starting a dynamically
+// linked program reads each of its libraries from the filesystem only
+// the first time.  An entry is only used while the file still has the
+// same inode, size and modification time as when it was read, and the
+// handles given out can't write to it.  When the cache is full, the
+// entry used longest ago makes room.
+#define LIB_CACHE_SIZE 32
+
+#define LIB_VMO_RIGHTS (MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | \
+                        MX_RIGHT_EXECUTE | MX_RIGHT_MAP)
+
+typedef struct lib_cache_entry {
+    char path[PATH_MAX];
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    mx_handle_t vmo;
+    uint64_t last_used;
+} lib_cache_entry_t;
+
+static lib_cache_entry_t lib_cache[LIB_CACHE_SIZE];
+static uint64_t lib_cache_clock;
+static mtx_t lib_cache_lock = MTX_INIT;
+
+static bool lib_cache_match(const lib_cache_entry_t* e, const char* path,
+                            const struct stat* s) {
+    return e->vmo > 0 && !strcmp(e->path, path) && e->ino == s->st_ino &&
+           e->size == s->st_size && e->mtime == s->st_mtime;
+}
+
+// Returns a duplicate of the VMO cached for the file, or
+// MX_HANDLE_INVALID if it isn't cached.
+static mx_handle_t lib_cache_lookup(const char* path, const struct stat* s) {
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    mtx_lock(&lib_cache_lock);
+    for (unsigned n = 0; n < LIB_CACHE_SIZE; n++) {
+        lib_cache_entry_t* e = &lib_cache[n];
+        if (lib_cache_match(e, path, s)) {
+            if (mx_handle_duplicate(e->vmo, LIB_VMO_RIGHTS, &vmo) < 0)
+                vmo = MX_HANDLE_INVALID;
+            e->last_used = ++lib_cache_clock;
+            break;
+        }
+    }
+    mtx_unlock(&lib_cache_lock);
+    return vmo;
+}
+
+// Takes the VMO just read for the file, replacing any stale entry for
+// it, and returns a duplicate to give out.  If that can't be made, the
+// VMO itself is returned and not cached.
+static mx_handle_t lib_cache_insert(const char* path, const struct stat* s, mx_handle_t vmo) {
+    mx_handle_t copy;
+    if (mx_handle_duplicate(vmo, LIB_VMO_RIGHTS, &copy) < 0)
+        return vmo;
+
+    mtx_lock(&lib_cache_lock);
+    lib_cache_entry_t* victim = &lib_cache[0];
+    for (unsigned n = 0; n < LIB_CACHE_SIZE; n++) {
+        lib_cache_entry_t* e = &lib_cache[n];
+        if (e->vmo > 0 && !strcmp(e->path, path)) {
+            victim = e;
+            break;
+        }
+        if (e->vmo <= 0 || e->last_used < victim->last_used)
+            victim = e;
+        if (e->vmo <= 0)
+            break;
+    }
+    mx_handle_t old = victim->vmo;
+    strlcpy(victim->path, path, sizeof(victim->path));
+    victim->ino = s->st_ino;
+    victim->size = s->st_size;
+    victim->mtime = s->st_mtime;
+    victim->vmo = vmo;
+    victim->last_used = ++lib_cache_clock;
+    mtx_unlock(&lib_cache_lock);
+
+    if (old > 0)
+        mx_handle_close(old);
+    return copy;
+}
+
 static mx_handle_t default_load_object(void* ignored, const char* fn) {
     char buffer[8192];
     char path[PATH_MAX];
@@ -67,6 +151,11 @@ found:
         goto fail;
     }
 
+    if ((vmo = lib_cache_lookup(path, &s)) > 0) {
+        close(fd);
+        return vmo;
+    }
+
     if ((err = mx_vmo_create(s.st_size, 0, &vmo)) < 0) {
         goto fail;
     }
@@ -92,7 +181,7 @@ found:
         size -= xfer;
     }
     close(fd);
-    return vmo;
+    return lib_cache_insert(path, &s, vmo);
 
 fail:
     close(fd);
@@ -195,6 +284,8 @@ static mx_status_t multiloader_cb(mx_handle_t h, void* cb, void* cookie) {
     return handle_loader_rpc(h, default_load_object, NULL, dispatcher_log);
 }
 
+#define LOADER_DISPATCHER_THREADS 4
+
 static mxio_dispatcher_t* dispatcher;
 static mtx_t dispatcher_lock;
 
@@ -206,7 +297,9 @@ static mx_handle_t mxio_multiloader(void) {
         if ((r = mxio_dispatcher_create(&dispatcher, multiloader_cb)) < 0) {
             goto done;
         }
-        if ((r = mxio_dispatcher_start(dispatcher, "loader-service-dispatcher")) < 0) {
+        // a few threads, so one process's loads don't hold up another's
+        if ((r = mxio_dispatcher_start_threads(dispatcher, "loader-service-dispatcher",
+                                               LOADER_DISPATCHER_THREADS)) < 0) {
             //TODO: destroy dispatcher once support exists
             dispatcher = NULL;
             goto done;
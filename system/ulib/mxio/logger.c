@@ -80,7 +80,9 @@ static mx_status_t log_clone(mxio_t* io, mx_handle_t* handles, uint32_t* types)
 
 static mxio_ops_t log_io_ops = {
     .read = mxio_default_read,
+    .read_at = mxio_default_read_at,
     .write = log_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxio_default_misc,
     .close = log_close,
@@ -89,6 +91,7 @@ static mxio_ops_t log_io_ops = {
     .ioctl = mxio_default_ioctl,
     .wait_begin = mxio_default_wait_begin,
     .wait_end = mxio_default_wait_end,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_logger_create(mx_handle_t handle) {
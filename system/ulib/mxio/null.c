@@ -26,6 +26,16 @@ ssize_t mxio_default_write(mxio_t* io, const void* _data, size_t len) {
     return len;
 }
 
+// positioned io is for files, so pipes and the like can't seek; this is
+// ESPIPE to the posix layer
+ssize_t mxio_default_read_at(mxio_t* io, void* _data, size_t len, off_t offset) {
+    return ERR_WRONG_TYPE;
+}
+
+ssize_t mxio_default_write_at(mxio_t* io, const void* _data, size_t len, off_t offset) {
+    return ERR_WRONG_TYPE;
+}
+
 off_t mxio_default_seek(mxio_t* io, off_t offset, int whence) {
     return ERR_NOT_SUPPORTED;
 }
@@ -46,6 +56,10 @@ mx_status_t mxio_default_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* type
     return ERR_NOT_SUPPORTED;
 }
 
+mx_status_t mxio_default_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len) {
+    return ERR_NOT_SUPPORTED;
+}
+
 mx_status_t mxio_default_close(mxio_t* io) {
     return NO_ERROR;
 }
@@ -65,7 +79,9 @@ void mxio_default_wait_end(mxio_t* io, mx_signals_t signals, uint32_t* _events)
 
 static mxio_ops_t mx_null_ops = {
     .read = mxio_default_read,
+    .read_at = mxio_default_read_at,
     .write = mxio_default_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxio_default_misc,
     .close = mxio_default_close,
@@ -75,6 +91,7 @@ static mxio_ops_t mx_null_ops = {
     .wait_begin = mxio_default_wait_begin,
     .wait_end = mxio_default_wait_end,
     .unwrap = mxio_default_unwrap,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_null_create(void) {
@@ -150,7 +150,9 @@ static mx_status_t mx_pipe_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* ty
 
 static mxio_ops_t mx_pipe_ops = {
     .read = mx_pipe_read,
+    .read_at = mxio_default_read_at,
     .write = mx_pipe_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxio_default_misc,
     .close = mx_pipe_close,
@@ -160,6 +162,7 @@ static mxio_ops_t mx_pipe_ops = {
     .wait_begin = mx_pipe_wait_begin,
     .wait_end = mx_pipe_wait_end,
     .unwrap = mx_pipe_unwrap,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_pipe_create(mx_handle_t h) {
@@ -37,6 +37,9 @@ typedef struct mxio_ops {
     void (*wait_begin)(mxio_t* io, uint32_t events, mx_handle_t* handle, mx_signals_t* signals);
     void (*wait_end)(mxio_t* io, mx_signals_t signals, uint32_t* events);
     ssize_t (*ioctl)(mxio_t* io, uint32_t op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len);
+    // a VMO holding the file's contents, for mmap(): they start at *off
+    // in it and are *len bytes long
+    mx_status_t (*get_vmo)(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len);
 } mxio_ops_t;
 
 // mxio_t flags
@@ -83,6 +86,10 @@ typedef struct mxio {
 // dupcount tracks how many fdtab entries an mxio object
 // is in.  close() reduces the dupcount, and only actually
 // closes the underlying object when it reaches zero.
+//
+// fd lookups take their reference without mxio_lock, so
+// whoever clears an fdtab entry must wait for lookups of
+// that fd to finish before releasing the entry's reference.
 
 #define MXIO_MAGIC 0x4f49584d // MXIO
 
@@ -120,6 +127,9 @@ mxio_t* mxio_vmofile_create(mx_handle_t h, mx_off_t off, mx_off_t len);
 // wraps a socket with an mxio_t using socket io
 mxio_t* mxio_socket_create(mx_handle_t h, mx_handle_t s);
 
+// turns client-side buffering of a remoteio file on or off
+mx_status_t mxrio_set_buffered(mxio_t* io, bool enable);
+
 // creates a message port and pair of simple io mxio_t's
 int mxio_pipe_pair(mxio_t** a, mxio_t** b);
 
@@ -159,6 +169,7 @@ ssize_t mxio_default_ioctl(mxio_t* io, uint32_t op, const void* in_buf, size_t i
 void mxio_default_wait_begin(mxio_t* io, uint32_t events, mx_handle_t* handle, mx_signals_t* _signals);
 void mxio_default_wait_end(mxio_t* io, mx_signals_t signals, uint32_t* _events);
 mx_status_t mxio_default_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* types);
+mx_status_t mxio_default_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len);
 
 void __mxio_startup_handles_init(uint32_t num, mx_handle_t handles[],
                                  uint32_t handle_info[])
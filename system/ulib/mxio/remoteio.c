@@ -37,8 +37,19 @@ struct mxrio {
     mx_handle_t h2;
 
     uint32_t flags;
+
+    // client-side buffering, if turned on with mxio_set_buffered()
+    struct mxrio_buffer* buf;
 };
 
+// the server does not take VMO payloads, always send data inline
+#define MXRIO_FLAG_NO_VMO_PAYLOAD 1
+
+// largest transfer moved in one VMO payload transaction
+#define MXRIO_VMO_PAYLOAD_MAX (1024 * 1024)
+
+static mxio_ops_t mx_remote_ops;
+
 static const char* _opnames[] = MXRIO_OPNAMES;
 const char* mxio_opname(uint32_t op) {
     op = MXRIO_OP(op);
@@ -72,6 +83,76 @@ static void discard_handles(mx_handle_t* handles, unsigned count) {
     }
 }
 
+// Services a read or write whose payload travels in a VMO rather than in
+// the message: the callback is invoked once per chunk, with the data being
+// moved between msg->data and the VMO, so servers need not know about it.
+static mx_status_t handle_vmo_payload(mxrio_msg_t* msg, mxrio_cb_t cb, void* cookie) {
+    uint32_t op = MXRIO_OP(msg->op);
+    if ((msg->hcount != 1) || (msg->datalen != 0) || (msg->arg < 0) ||
+        ((op != MXRIO_READ) && (op != MXRIO_READ_AT) &&
+         (op != MXRIO_WRITE) && (op != MXRIO_WRITE_AT))) {
+        discard_handles(msg->handle, msg->hcount);
+        return ERR_INVALID_ARGS;
+    }
+    bool is_read = (op == MXRIO_READ) || (op == MXRIO_READ_AT);
+    mx_handle_t vmo = msg->handle[0];
+    uint32_t len = msg->arg;
+    int64_t off = msg->arg2.off;
+    uint32_t count = 0;
+    mx_status_t r = NO_ERROR;
+
+    while (count < len) {
+        uint32_t xfer = len - count;
+        if (xfer > MXIO_CHUNK_SIZE) {
+            xfer = MXIO_CHUNK_SIZE;
+        }
+        size_t actual;
+        msg->op = op;
+        msg->arg = xfer;
+        msg->arg2.off = off + count;
+        msg->datalen = 0;
+        msg->hcount = 0;
+        if (!is_read) {
+            if ((r = mx_vmo_read(vmo, msg->data, count, xfer, &actual)) < 0) {
+                break;
+            }
+            msg->datalen = xfer;
+        }
+        // no reply handle, so the callback must answer each chunk directly
+        if ((r = cb(msg, 0, cookie)) < 0) {
+            if (r == ERR_DISPATCHER_INDIRECT) {
+                r = ERR_NOT_SUPPORTED;
+            }
+            break;
+        }
+        discard_handles(msg->handle, msg->hcount);
+        msg->hcount = 0;
+        if ((uint32_t)r > xfer) {
+            r = ERR_IO;
+            break;
+        }
+        if (is_read) {
+            if (((uint32_t)r > msg->datalen) ||
+                ((r = mx_vmo_write(vmo, msg->data, count, r, &actual)) < 0)) {
+                r = (r < 0) ? r : ERR_IO;
+                break;
+            }
+            r = actual;
+        }
+        count += r;
+        // stop at short read or write
+        if ((uint32_t)r < xfer) {
+            break;
+        }
+    }
+    mx_handle_close(vmo);
+
+    // the reply looks like that of the last chunk, but covers all of them
+    msg->datalen = 0;
+    msg->hcount = 0;
+    return count ? (mx_status_t)count : r;
+}
+
 mx_status_t mxrio_handler(mx_handle_t h, void* _cb, void* cookie) {
     mxrio_cb_t cb = _cb;
     mxrio_msg_t msg;
@@ -112,11 +193,16 @@ mx_status_t mxrio_handler(mx_handle_t h, void* _cb, void* cookie) {
     }
 
     bool is_close = (MXRIO_OP(msg.op) == MXRIO_CLOSE);
+    uint32_t txid = msg.txid;
 
     xprintf("handle_rio: op=%s arg=%d len=%u hsz=%d\n",
             mxio_opname(msg.op), msg.arg, msg.datalen, msg.hcount);
 
-    msg.arg = cb(&msg, (rh != h) ? rh : 0, cookie);
+    if (msg.op & MXRIO_VMO_PAYLOAD) {
+        msg.arg = handle_vmo_payload(&msg, cb, cookie);
+    } else {
+        msg.arg = cb(&msg, (rh != h) ? rh : 0, cookie);
+    }
     if (msg.arg == ERR_DISPATCHER_INDIRECT) {
         // callback is handling the reply itself
         // and took ownership of the reply handle
@@ -143,6 +229,7 @@ mx_status_t mxrio_handler(mx_handle_t h, void* _cb, void* cookie) {
     }
 
     msg.op = MXRIO_STATUS;
+    msg.txid = txid;
     if ((r = mx_channel_write(rh, 0, &msg, MXRIO_HDR_SZ + msg.datalen, msg.handle, msg.hcount)) < 0) {
         discard_handles(msg.handle, msg.hcount);
     }
@@ -172,10 +259,38 @@ mx_status_t mxrio_txn_handoff(mx_handle_t srv, mx_handle_t rh, mxrio_msg_t* msg)
     return 0;
 }
 
-// on success, msg->hcount indicates number of valid handles in msg->handle
-// on error there are never any handles
-static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
+// Requests on one connection are each sent with a reply channel of
+// their own, so several can be outstanding at once, and each is matched
+// with its reply by the channel it arrives on and the txid it echoes.
+// A thread keeps MXRIO_MAX_INFLIGHT reply channels around for this.
+#define MXRIO_MAX_INFLIGHT 4
+
+static atomic_uint_fast32_t mxrio_next_txid;
+
+static mx_handle_t (*get_reply_channel(unsigned slot))[2] {
+    static thread_local mx_handle_t (*rchannels)[2] = NULL;
+    if (rchannels == NULL) {
+        if ((rchannels = calloc(MXRIO_MAX_INFLIGHT, sizeof(*rchannels))) == NULL) {
+            return NULL;
+        }
+    }
+    if (rchannels[slot][0] == 0) {
+        if (mx_channel_create(MX_FLAG_REPLY_CHANNEL, &rchannels[slot][0],
+                              &rchannels[slot][1]) < 0) {
+            rchannels[slot][0] = 0;
+            return NULL;
+        }
+    }
+    return &rchannels[slot];
+}
+
+// Sends msg using reply channel |slot|, which must not have a request
+// outstanding.  On success the reply must be collected with
+// mxrio_txn_recv() on the same slot before the slot is used again.
+// On error there are never any handles.
+static mx_status_t mxrio_txn_send(mxrio_t* rio, mxrio_msg_t* msg, unsigned slot) {
     msg->magic = MXRIO_MAGIC;
+    msg->txid = (uint32_t)atomic_fetch_add(&mxrio_next_txid, 1);
     if (!is_message_valid(msg)) {
         return ERR_INVALID_ARGS;
     }
@@ -183,29 +298,33 @@ static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
     xprintf("txn h=%x op=%d len=%u\n", rio->h, msg->op, msg->datalen);
     uint32_t dsize = MXRIO_HDR_SZ + msg->datalen;
 
-    mx_status_t r;
-
-    static thread_local mx_handle_t *rchannel = NULL;
+    mx_handle_t (*rchannel)[2] = get_reply_channel(slot);
     if (rchannel == NULL) {
-        if ((rchannel = malloc(sizeof(mx_handle_t) * 2)) == NULL) {
-            return ERR_NO_MEMORY;
-        }
-        if ((r = mx_channel_create(MX_FLAG_REPLY_CHANNEL, &rchannel[0], &rchannel[1])) < 0) {
-            free(rchannel);
-            rchannel = NULL;
-            return r;
-        }
+        discard_handles(msg->handle, msg->hcount);
+        msg->hcount = 0;
+        return ERR_NO_MEMORY;
     }
     msg->op |= MXRIO_REPLY_CHANNEL;
-    msg->handle[msg->hcount++] = rchannel[1];
+    msg->handle[msg->hcount++] = (*rchannel)[1];
 
+    mx_status_t r;
     if ((r = mx_channel_write(rio->h, 0, msg, dsize, msg->handle, msg->hcount)) < 0) {
-        msg->hcount--;
-        goto fail_discard_handles;
+        discard_handles(msg->handle, --msg->hcount);
+        msg->hcount = 0;
+        return r;
     }
+    return NO_ERROR;
+}
+
+// Waits for the reply to the request with |txid| sent on reply channel
+// |slot|.  On success, msg->hcount indicates number of valid handles in
+// msg->handle; on error there are never any handles.
+static mx_status_t mxrio_txn_recv(mxrio_msg_t* msg, unsigned slot, uint32_t txid) {
+    mx_handle_t (*rchannel)[2] = get_reply_channel(slot);
+    mx_status_t r;
 
     mx_signals_t pending;
-    if ((r = mx_handle_wait_one(rchannel[0], MX_SIGNAL_READABLE | MX_SIGNAL_PEER_CLOSED,
+    if ((r = mx_handle_wait_one((*rchannel)[0], MX_SIGNAL_READABLE | MX_SIGNAL_PEER_CLOSED,
                                 MX_TIME_INFINITE, &pending)) < 0) {
         goto fail_close_reply_channel;
     }
@@ -215,9 +334,9 @@ static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
         goto fail_close_reply_channel;
     }
 
-    dsize = MXRIO_HDR_SZ + MXIO_CHUNK_SIZE;
+    uint32_t dsize = MXRIO_HDR_SZ + MXIO_CHUNK_SIZE;
     msg->hcount = MXIO_MAX_HANDLES + 1;
-    if ((r = mx_channel_read(rchannel[0], 0, msg, dsize, &dsize,
+    if ((r = mx_channel_read((*rchannel)[0], 0, msg, dsize, &dsize,
                              msg->handle, msg->hcount, &msg->hcount)) < 0) {
         goto fail_close_reply_channel;
     }
@@ -225,11 +344,12 @@ static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
     // The kernel ensures that the reply channel endpoint is
     // returned as the last handle in the message's handles.
     // The handle number may have changed, so update it.
-    rchannel[1] = msg->handle[--msg->hcount];
+    (*rchannel)[1] = msg->handle[--msg->hcount];
 
     // check for protocol errors
     if (!is_message_reply_valid(msg, dsize) ||
-        (MXRIO_OP(msg->op) != MXRIO_STATUS)) {
+        (MXRIO_OP(msg->op) != MXRIO_STATUS) ||
+        (msg->txid != txid)) {
         r = ERR_IO;
         goto fail_discard_handles;
     }
@@ -240,25 +360,30 @@ static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
     return r;
 
 fail_discard_handles:
-    // We failed either writing at all (still have the handles)
-    // or after reading (need to abandon any handles we received)
+    // abandon any handles we received
     discard_handles(msg->handle, msg->hcount);
     msg->hcount = 0;
     return r;
 
 fail_close_reply_channel:
-    // We lost the far end of the reply channel, so
-    // close the near end and try to replace it.
-    // If that fails, free rchannel and let the next
-    // txn try again.
-    mx_handle_close(rchannel[0]);
-    if (mx_channel_create(MX_FLAG_REPLY_CHANNEL, &rchannel[0], &rchannel[1]) < 0) {
-        free(rchannel);
-        rchannel = NULL;
-    }
+    // We lost the far end of the reply channel, so close the near end
+    // and let the next txn on this slot make a new one.
+    mx_handle_close((*rchannel)[0]);
+    (*rchannel)[0] = 0;
+    msg->hcount = 0;
     return r;
 }
 
+// on success, msg->hcount indicates number of valid handles in msg->handle
+// on error there are never any handles
+static mx_status_t mxrio_txn(mxrio_t* rio, mxrio_msg_t* msg) {
+    mx_status_t r;
+    if ((r = mxrio_txn_send(rio, msg, 0)) < 0) {
+        return r;
+    }
+    return mxrio_txn_recv(msg, 0, msg->txid);
+}
+
 static ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
                            size_t in_len, void* out_buf, size_t out_len) {
     mxrio_t* rio = (mxrio_t*)io;
@@ -334,6 +459,142 @@ static ssize_t mxrio_ioctl(mxio_t* io, uint32_t op, const void* in_buf,
     return r;
 }
 
+// Moves up to |len| bytes in a single transaction by handing the server a
+// VMO holding the payload (see MXRIO_VMO_PAYLOAD), returning the number of
+// bytes transferred.  Returns ERR_NOT_SUPPORTED if the caller should fall
+// back to inline chunks.
+static ssize_t vmo_payload_txn(mxrio_t* rio, uint32_t op, void* data, size_t len, off_t offset) {
+    bool is_read = (op == MXRIO_READ) || (op == MXRIO_READ_AT);
+    mx_handle_t vmo;
+    size_t actual;
+    mx_status_t r;
+
+    if (len > MXRIO_VMO_PAYLOAD_MAX) {
+        len = MXRIO_VMO_PAYLOAD_MAX;
+    }
+    if (mx_vmo_create(len, 0, &vmo) < 0) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (!is_read && ((r = mx_vmo_write(vmo, data, 0, len, &actual)) < 0)) {
+        goto done;
+    }
+
+    mxrio_msg_t msg;
+    memset(&msg, 0, MXRIO_HDR_SZ);
+    msg.op = op | MXRIO_VMO_PAYLOAD;
+    msg.arg = len;
+    msg.arg2.off = offset;
+    if (mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &msg.handle[0]) < 0) {
+        r = ERR_NOT_SUPPORTED;
+        goto done;
+    }
+    msg.hcount = 1;
+
+    if ((r = mxrio_txn(rio, &msg)) < 0) {
+        if (r == ERR_NOT_SUPPORTED) {
+            rio->flags |= MXRIO_FLAG_NO_VMO_PAYLOAD;
+        }
+        goto done;
+    }
+    discard_handles(msg.handle, msg.hcount);
+
+    if ((size_t)r > len) {
+        r = ERR_IO;
+    } else if (is_read && (r > 0)) {
+        mx_status_t status;
+        if ((status = mx_vmo_read(vmo, data, 0, r, &actual)) < 0) {
+            r = status;
+        }
+    }
+
+done:
+    mx_handle_close(vmo);
+    return r;
+}
+
+// Moves |len| bytes at |offset| in inline chunks, keeping up to
+// MXRIO_MAX_INFLIGHT of them outstanding at once so the transfer isn't
+// bound by one round trip per chunk.  Only for READ_AT and WRITE_AT,
+// whose chunks don't depend on each other; a short or failed chunk ends
+// the transfer, and the replies to any chunks after it are dropped.
+// Returns ERR_NOT_SUPPORTED if the caller should go one chunk at a time.
+static ssize_t pipelined_txn(mxrio_t* rio, uint32_t op, uint8_t* data, size_t len, off_t offset) {
+    bool is_read = (op == MXRIO_READ_AT);
+    mxrio_msg_t* msgs = malloc(MXRIO_MAX_INFLIGHT * sizeof(mxrio_msg_t));
+    if (msgs == NULL) {
+        return ERR_NOT_SUPPORTED;
+    }
+    uint32_t txids[MXRIO_MAX_INFLIGHT];
+    size_t lens[MXRIO_MAX_INFLIGHT];
+    unsigned oldest = 0, inflight = 0;
+    size_t sent = 0;
+    ssize_t count = 0;
+    mx_status_t r = 0;
+    bool stop = false;
+
+    for (;;) {
+        // keep the pipeline full
+        while (!stop && (inflight < MXRIO_MAX_INFLIGHT) && (sent < len)) {
+            unsigned slot = (oldest + inflight) % MXRIO_MAX_INFLIGHT;
+            mxrio_msg_t* msg = &msgs[slot];
+            size_t xfer = (len - sent > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len - sent;
+            memset(msg, 0, MXRIO_HDR_SZ);
+            msg->op = op;
+            msg->arg2.off = offset + sent;
+            if (is_read) {
+                msg->arg = xfer;
+            } else {
+                msg->datalen = xfer;
+                memcpy(msg->data, data + sent, xfer);
+            }
+            if ((r = mxrio_txn_send(rio, msg, slot)) < 0) {
+                stop = true;
+                break;
+            }
+            txids[slot] = msg->txid;
+            lens[slot] = xfer;
+            sent += xfer;
+            inflight++;
+        }
+        if (inflight == 0) {
+            break;
+        }
+
+        // replies are collected in the order the chunks were sent
+        unsigned slot = oldest;
+        mxrio_msg_t* msg = &msgs[slot];
+        oldest = (oldest + 1) % MXRIO_MAX_INFLIGHT;
+        inflight--;
+        mx_status_t status = mxrio_txn_recv(msg, slot, txids[slot]);
+        if (status >= 0) {
+            discard_handles(msg->handle, msg->hcount);
+        }
+        if (stop) {
+            continue;
+        }
+        if (status < 0) {
+            r = status;
+            stop = true;
+        } else if (((size_t)status > lens[slot]) ||
+                   (is_read && ((uint32_t)status > msg->datalen))) {
+            r = ERR_IO;
+            stop = true;
+        } else {
+            if (is_read) {
+                memcpy(data + count, msg->data, status);
+            }
+            count += status;
+            // stop at short read or write
+            if ((size_t)status < lens[slot]) {
+                stop = true;
+            }
+        }
+    }
+
+    free(msgs);
+    return count ? count : r;
+}
+
 static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     const uint8_t* data = _data;
@@ -343,6 +604,20 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     ssize_t xfer;
 
     while (len > 0) {
+        if ((len > MXIO_CHUNK_SIZE) && !(rio->flags & MXRIO_FLAG_NO_VMO_PAYLOAD)) {
+            xfer = (len > MXRIO_VMO_PAYLOAD_MAX) ? MXRIO_VMO_PAYLOAD_MAX : len;
+            r = vmo_payload_txn(rio, op, (void*)data, xfer, offset);
+            if (r != ERR_NOT_SUPPORTED) {
+                goto advance;
+            }
+        }
+        if ((len > MXIO_CHUNK_SIZE) && (op == MXRIO_WRITE_AT)) {
+            xfer = len;
+            r = pipelined_txn(rio, op, (uint8_t*)data, xfer, offset);
+            if (r != ERR_NOT_SUPPORTED) {
+                goto advance;
+            }
+        }
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
         memset(&msg, 0, MXRIO_HDR_SZ);
@@ -352,11 +627,15 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
             msg.arg2.off = offset;
         memcpy(msg.data, data, xfer);
 
-        if ((r = mxrio_txn(rio, &msg)) < 0) {
-            break;
+        r = mxrio_txn(rio, &msg);
+        if (r >= 0) {
+            discard_handles(msg.handle, msg.hcount);
         }
-        discard_handles(msg.handle, msg.hcount);
 
+advance:
+        if (r < 0) {
+            break;
+        }
         if (r > xfer) {
             r = ERR_IO;
             break;
@@ -374,14 +653,6 @@ static ssize_t write_common(uint32_t op, mxio_t* io, const void* _data, size_t l
     return count ? count : r;
 }
 
-static ssize_t mxrio_write(mxio_t* io, const void* _data, size_t len) {
-    return write_common(MXRIO_WRITE, io, _data, len, 0);
-}
-
-static ssize_t mxrio_write_at(mxio_t* io, const void* _data, size_t len, off_t offset) {
-    return write_common(MXRIO_WRITE_AT, io, _data, len, offset);
-}
-
 static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off_t offset) {
     mxrio_t* rio = (mxrio_t*)io;
     uint8_t* data = _data;
@@ -391,6 +662,26 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     ssize_t xfer;
 
     while (len > 0) {
+        if ((len > MXIO_CHUNK_SIZE) && !(rio->flags & MXRIO_FLAG_NO_VMO_PAYLOAD)) {
+            xfer = (len > MXRIO_VMO_PAYLOAD_MAX) ? MXRIO_VMO_PAYLOAD_MAX : len;
+            r = vmo_payload_txn(rio, op, data, xfer, offset);
+            if (r != ERR_NOT_SUPPORTED) {
+                if (r < 0) {
+                    break;
+                }
+                goto advance;
+            }
+        }
+        if ((len > MXIO_CHUNK_SIZE) && (op == MXRIO_READ_AT)) {
+            xfer = len;
+            r = pipelined_txn(rio, op, data, xfer, offset);
+            if (r != ERR_NOT_SUPPORTED) {
+                if (r < 0) {
+                    break;
+                }
+                goto advance;
+            }
+        }
         xfer = (len > MXIO_CHUNK_SIZE) ? MXIO_CHUNK_SIZE : len;
 
         memset(&msg, 0, MXRIO_HDR_SZ);
@@ -409,6 +700,8 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
             break;
         }
         memcpy(data, msg.data, r);
+
+advance:
         count += r;
         data += r;
         len -= r;
@@ -423,16 +716,7 @@ static ssize_t read_common(uint32_t op, mxio_t* io, void* _data, size_t len, off
     return count ? count : r;
 }
 
-static ssize_t mxrio_read(mxio_t* io, void* _data, size_t len) {
-    return read_common(MXRIO_READ, io, _data, len, 0);
-}
-
-static ssize_t mxrio_read_at(mxio_t* io, void* _data, size_t len, off_t offset) {
-    return read_common(MXRIO_READ_AT, io, _data, len, offset);
-}
-
-static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
-    mxrio_t* rio = (mxrio_t*)io;
+static off_t seek_txn(mxrio_t* rio, off_t offset, int whence) {
     mxrio_msg_t msg;
     mx_status_t r;
 
@@ -449,10 +733,293 @@ static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
     return msg.arg2.off;
 }
 
+// Buffering keeps the file position on the client, reading ahead into
+// |rd| once reads look sequential and collecting consecutive small writes
+// in |wr|, and does all its io with READ_AT and WRITE_AT.  So the server's
+// idea of the position goes stale, and is put right before anything that
+// depends on it: a seek, handing the connection on, or turning buffering
+// off.  A buffered write that fails is reported by whichever call flushed
+// it, at the latest fsync or close.  Not meant for an fd opened with
+// O_APPEND, where the server picks the position.
+#define RD_AHEAD_MIN (16 * 1024)
+#define RD_AHEAD_MAX (256 * 1024)
+#define WR_BEHIND_MAX (64 * 1024)
+
+typedef struct mxrio_buffer {
+    mtx_t lock;
+    off_t pos;              // the fd's position
+    bool server_pos_stale;  // the server's position isn't |pos|
+
+    uint8_t* rd;            // bytes [rd_off, rd_off + rd_len) of the file
+    off_t rd_off;
+    size_t rd_len;
+    size_t rd_ahead;        // how much to read ahead, 0 until sequential
+    off_t rd_next;          // where a sequential read would start
+
+    uint8_t* wr;            // bytes to write at [wr_off, wr_off + wr_len)
+    off_t wr_off;
+    size_t wr_len;
+} mxrio_buffer_t;
+
+static mx_status_t buffer_flush(mxrio_t* rio) {
+    mxrio_buffer_t* b = rio->buf;
+    size_t done = 0;
+    mx_status_t status = NO_ERROR;
+    while (done < b->wr_len) {
+        ssize_t r = write_common(MXRIO_WRITE_AT, &rio->io, b->wr + done,
+                                 b->wr_len - done, b->wr_off + done);
+        if (r <= 0) {
+            status = (r < 0) ? (mx_status_t)r : ERR_IO;
+            break;
+        }
+        done += r;
+    }
+    b->wr_len = 0;
+    return status;
+}
+
+// Flushes writes and forgets what was read, before doing something that
+// the buffers don't know about.
+static mx_status_t buffer_sync(mxrio_t* rio) {
+    rio->buf->rd_len = 0;
+    return buffer_flush(rio);
+}
+
+static mx_status_t buffer_sync_server_pos(mxrio_t* rio) {
+    mxrio_buffer_t* b = rio->buf;
+    if (b->server_pos_stale) {
+        off_t r = seek_txn(rio, b->pos, SEEK_SET);
+        if (r < 0) {
+            return (mx_status_t)r;
+        }
+        b->server_pos_stale = false;
+    }
+    return NO_ERROR;
+}
+
+static ssize_t buffered_read_at(mxrio_t* rio, uint8_t* data, size_t len, off_t offset,
+                                bool update_pos) {
+    mxrio_buffer_t* b = rio->buf;
+    mx_status_t r;
+    if ((r = buffer_flush(rio)) < 0) {
+        return r;
+    }
+
+    // grow the read-ahead while reads follow on from each other
+    if (update_pos) {
+        if (offset == b->rd_next) {
+            if (b->rd_ahead == 0) {
+                b->rd_ahead = RD_AHEAD_MIN;
+            } else if (b->rd_ahead < RD_AHEAD_MAX) {
+                b->rd_ahead *= 2;
+            }
+        } else {
+            b->rd_ahead = 0;
+        }
+    }
+
+    size_t count = 0;
+    while (count < len) {
+        off_t off = offset + count;
+        if ((b->rd_len > 0) && (off >= b->rd_off) && (off < b->rd_off + (off_t)b->rd_len)) {
+            size_t avail = b->rd_off + b->rd_len - off;
+            size_t n = (len - count < avail) ? len - count : avail;
+            memcpy(data + count, b->rd + (off - b->rd_off), n);
+            count += n;
+            continue;
+        }
+        size_t want = len - count;
+        if (!update_pos || (want >= b->rd_ahead)) {
+            // nothing to gain from going through the buffer
+            ssize_t n = read_common(MXRIO_READ_AT, &rio->io, data + count, want, off);
+            if (n < 0) {
+                return count ? (ssize_t)count : n;
+            }
+            count += n;
+            break;
+        }
+        if ((b->rd == NULL) && ((b->rd = malloc(RD_AHEAD_MAX)) == NULL)) {
+            b->rd_ahead = 0;
+            continue;
+        }
+        ssize_t n = read_common(MXRIO_READ_AT, &rio->io, b->rd, b->rd_ahead, off);
+        if (n < 0) {
+            b->rd_len = 0;
+            return count ? (ssize_t)count : n;
+        }
+        b->rd_off = off;
+        b->rd_len = n;
+        if (n == 0) {
+            // end of file
+            break;
+        }
+    }
+
+    if (update_pos) {
+        b->pos = offset + count;
+        b->rd_next = b->pos;
+        b->server_pos_stale = true;
+    }
+    return count;
+}
+
+static ssize_t buffered_write_at(mxrio_t* rio, const uint8_t* data, size_t len, off_t offset,
+                                 bool update_pos) {
+    mxrio_buffer_t* b = rio->buf;
+    b->rd_len = 0;
+    mx_status_t r;
+
+    if (!update_pos) {
+        if ((r = buffer_flush(rio)) < 0) {
+            return r;
+        }
+        return write_common(MXRIO_WRITE_AT, &rio->io, data, len, offset);
+    }
+
+    if ((b->wr_len > 0) &&
+        ((offset != b->wr_off + (off_t)b->wr_len) || (b->wr_len + len > WR_BEHIND_MAX))) {
+        if ((r = buffer_flush(rio)) < 0) {
+            return r;
+        }
+    }
+    ssize_t count;
+    if ((len >= WR_BEHIND_MAX) ||
+        ((b->wr == NULL) && ((b->wr = malloc(WR_BEHIND_MAX)) == NULL))) {
+        if ((count = write_common(MXRIO_WRITE_AT, &rio->io, data, len, offset)) < 0) {
+            return count;
+        }
+    } else {
+        if (b->wr_len == 0) {
+            b->wr_off = offset;
+        }
+        memcpy(b->wr + b->wr_len, data, len);
+        b->wr_len += len;
+        count = len;
+    }
+    b->pos = offset + count;
+    b->server_pos_stale = true;
+    return count;
+}
+
+mx_status_t mxrio_set_buffered(mxio_t* io, bool enable) {
+    mxrio_t* rio = (mxrio_t*)io;
+    mx_status_t r = NO_ERROR;
+    if (io->ops != &mx_remote_ops) {
+        r = ERR_NOT_SUPPORTED;
+    } else if (enable && (rio->buf == NULL)) {
+        mxrio_buffer_t* b = calloc(1, sizeof(*b));
+        off_t pos;
+        if (b == NULL) {
+            r = ERR_NO_MEMORY;
+        } else if ((pos = seek_txn(rio, 0, SEEK_CUR)) < 0) {
+            free(b);
+            r = (mx_status_t)pos;
+        } else {
+            mtx_init(&b->lock, mtx_plain);
+            b->pos = pos;
+            b->rd_next = -1;
+            rio->buf = b;
+        }
+    } else if (!enable && (rio->buf != NULL)) {
+        mxrio_buffer_t* b = rio->buf;
+        mtx_lock(&b->lock);
+        r = buffer_flush(rio);
+        mx_status_t status = buffer_sync_server_pos(rio);
+        rio->buf = NULL;
+        mtx_unlock(&b->lock);
+        free(b->rd);
+        free(b->wr);
+        free(b);
+        if (r == NO_ERROR) {
+            r = status;
+        }
+    }
+    return r;
+}
+
+static ssize_t mxrio_write(mxio_t* io, const void* _data, size_t len) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (rio->buf != NULL) {
+        mtx_lock(&rio->buf->lock);
+        ssize_t r = buffered_write_at(rio, _data, len, rio->buf->pos, true);
+        mtx_unlock(&rio->buf->lock);
+        return r;
+    }
+    return write_common(MXRIO_WRITE, io, _data, len, 0);
+}
+
+static ssize_t mxrio_write_at(mxio_t* io, const void* _data, size_t len, off_t offset) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (rio->buf != NULL) {
+        mtx_lock(&rio->buf->lock);
+        ssize_t r = buffered_write_at(rio, _data, len, offset, false);
+        mtx_unlock(&rio->buf->lock);
+        return r;
+    }
+    return write_common(MXRIO_WRITE_AT, io, _data, len, offset);
+}
+
+static ssize_t mxrio_read(mxio_t* io, void* _data, size_t len) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (rio->buf != NULL) {
+        mtx_lock(&rio->buf->lock);
+        ssize_t r = buffered_read_at(rio, _data, len, rio->buf->pos, true);
+        mtx_unlock(&rio->buf->lock);
+        return r;
+    }
+    return read_common(MXRIO_READ, io, _data, len, 0);
+}
+
+static ssize_t mxrio_read_at(mxio_t* io, void* _data, size_t len, off_t offset) {
+    mxrio_t* rio = (mxrio_t*)io;
+    if (rio->buf != NULL) {
+        mtx_lock(&rio->buf->lock);
+        ssize_t r = buffered_read_at(rio, _data, len, offset, false);
+        mtx_unlock(&rio->buf->lock);
+        return r;
+    }
+    return read_common(MXRIO_READ_AT, io, _data, len, offset);
+}
+
+static off_t mxrio_seek(mxio_t* io, off_t offset, int whence) {
+    mxrio_t* rio = (mxrio_t*)io;
+    mxrio_buffer_t* b = rio->buf;
+    if (b == NULL) {
+        return seek_txn(rio, offset, whence);
+    }
+
+    mtx_lock(&b->lock);
+    off_t r = buffer_sync(rio);
+    if (r == NO_ERROR) {
+        if (whence == SEEK_CUR) {
+            offset += b->pos;
+            whence = SEEK_SET;
+        }
+        if ((r = seek_txn(rio, offset, whence)) >= 0) {
+            b->pos = r;
+            b->server_pos_stale = false;
+        }
+    }
+    mtx_unlock(&b->lock);
+    return r;
+}
+
 static mx_status_t mxrio_close(mxio_t* io) {
     mxrio_t* rio = (mxrio_t*)io;
     mxrio_msg_t msg;
     mx_status_t r;
+    mx_status_t flush_status = NO_ERROR;
+
+    if (rio->buf != NULL) {
+        mxrio_buffer_t* b = rio->buf;
+        mtx_lock(&b->lock);
+        flush_status = buffer_flush(rio);
+        rio->buf = NULL;
+        mtx_unlock(&b->lock);
+        free(b->rd);
+        free(b->wr);
+        free(b);
+    }
 
     memset(&msg, 0, MXRIO_HDR_SZ);
     msg.op = MXRIO_CLOSE;
@@ -460,6 +1027,9 @@ static mx_status_t mxrio_close(mxio_t* io) {
     if ((r = mxrio_txn(rio, &msg)) >= 0) {
         discard_handles(msg.handle, msg.hcount);
     }
+    if ((r >= 0) && (flush_status < 0)) {
+        r = flush_status;
+    }
 
     mx_handle_t h = rio->h;
     rio->h = 0;
@@ -482,6 +1052,15 @@ static mx_status_t mxrio_misc(mxio_t* io, uint32_t op, int64_t off,
     if ((len > MXIO_CHUNK_SIZE) || (maxreply > MXIO_CHUNK_SIZE)) {
         return ERR_INVALID_ARGS;
     }
+    if (rio->buf != NULL) {
+        // stat, sync, truncate and the like must see the buffered writes
+        mtx_lock(&rio->buf->lock);
+        r = buffer_sync(rio);
+        mtx_unlock(&rio->buf->lock);
+        if (r < 0) {
+            return r;
+        }
+    }
 
     memset(&msg, 0, MXRIO_HDR_SZ);
     msg.op = op;
@@ -506,6 +1085,38 @@ static mx_status_t mxrio_misc(mxio_t* io, uint32_t op, int64_t off,
     return r;
 }
 
+static mx_status_t mxrio_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len) {
+    mxrio_t* rio = (mxrio_t*)io;
+    mxrio_msg_t msg;
+    mx_status_t r;
+
+    if (rio->buf != NULL) {
+        // the mapping must see what was written before it
+        mtx_lock(&rio->buf->lock);
+        r = buffer_sync(rio);
+        mtx_unlock(&rio->buf->lock);
+        if (r < 0) {
+            return r;
+        }
+    }
+
+    memset(&msg, 0, MXRIO_HDR_SZ);
+    msg.op = MXRIO_MMAP;
+    if ((r = mxrio_txn(rio, &msg)) < 0) {
+        return r;
+    }
+    if ((msg.hcount != 1) || (msg.datalen != sizeof(mx_off_t)) || (msg.arg2.off < 0)) {
+        discard_handles(msg.handle, msg.hcount);
+        return ERR_IO;
+    }
+    mx_off_t size;
+    memcpy(&size, msg.data, sizeof(size));
+    *out = msg.handle[0];
+    *off = msg.arg2.off;
+    *len = size;
+    return NO_ERROR;
+}
+
 mx_status_t mxio_from_handles(uint32_t type, mx_handle_t* handles, int hcount,
                               void* extra, uint32_t esize, mxio_t** out) {
     mx_status_t r;
@@ -643,6 +1254,16 @@ mx_status_t __mxrio_clone(mx_handle_t h, mx_handle_t* handles, uint32_t* types)
 static mx_status_t mxrio_unwrap(mxio_t* io, mx_handle_t* handles, uint32_t* types) {
     mxrio_t* rio = (void*)io;
     mx_status_t r;
+    if (rio->buf != NULL) {
+        // whoever gets the connection next sees the server's position
+        mtx_lock(&rio->buf->lock);
+        buffer_flush(rio);
+        buffer_sync_server_pos(rio);
+        mtx_unlock(&rio->buf->lock);
+        free(rio->buf->rd);
+        free(rio->buf->wr);
+        free(rio->buf);
+    }
     handles[0] = rio->h;
     types[0] = MX_HND_TYPE_MXIO_REMOTE;
     if (rio->h2 != 0) {
@@ -703,6 +1324,7 @@ static mxio_ops_t mx_remote_ops = {
     .wait_begin = mxrio_wait_begin,
     .wait_end = mxrio_wait_end,
     .unwrap = mxrio_unwrap,
+    .get_vmo = mxrio_get_vmo,
 };
 
 mxio_t* mxio_remote_create(mx_handle_t h, mx_handle_t e) {
@@ -862,7 +1484,9 @@ static void mxsio_wait_end(mxio_t* io, mx_signals_t signals, uint32_t* _events)
 
 static mxio_ops_t mxio_socket_ops = {
     .read = mxsio_read,
+    .read_at = mxio_default_read_at,
     .write = mxsio_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxrio_misc,
     .close = mxrio_close,
@@ -872,6 +1496,7 @@ static mxio_ops_t mxio_socket_ops = {
     .wait_begin = mxsio_wait_begin,
     .wait_end = mxsio_wait_end,
     .unwrap = mxio_default_unwrap,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_socket_create(mx_handle_t h, mx_handle_t s) {
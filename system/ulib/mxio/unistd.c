@@ -14,6 +14,7 @@
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
@@ -55,6 +56,16 @@ void mxio_install_root(mxio_t* root) {
     mtx_unlock(&mxio_lock);
 }
 
+// After clearing or replacing an fdtab slot, and before dropping the
+// reference the slot held, wait out any fd_to_io() that may still be
+// taking a reference to the old mxio.  Lookups are a handful of
+// instructions, so this is almost never more than a check.
+static void mxio_fdtab_wait_for_readers(int fd) {
+    while (atomic_load(&mxio_fdtab_readers[fd]) != 0) {
+        thrd_yield();
+    }
+}
+
 // Attaches an mxio to an fdtab slot.
 // The mxio must have been upref'd on behalf of the
 // fdtab prior to binding.
@@ -81,21 +92,21 @@ int mxio_bind_to_fd(mxio_t* io, int fd, int starting_fd) {
         io_to_close = mxio_fdtab[fd];
         if (io_to_close) {
             io_to_close->dupcount--;
-            if (io_to_close->dupcount > 0) {
-                // still alive in another fdtab slot
-                mxio_release(io_to_close);
-                io_to_close = NULL;
-            }
         }
     }
 
 free_fd_found:
     io->dupcount++;
     mxio_fdtab[fd] = io;
+    // once unlocked, nobody else can see dupcount reach zero
+    bool last = (io_to_close != NULL) && (io_to_close->dupcount == 0);
     mtx_unlock(&mxio_lock);
 
     if (io_to_close) {
-        io_to_close->ops->close(io_to_close);
+        mxio_fdtab_wait_for_readers(fd);
+        if (last) {
+            io_to_close->ops->close(io_to_close);
+        }
         mxio_release(io_to_close);
     }
     return fd;
@@ -121,12 +132,15 @@ mx_status_t mxio_unbind_from_fd(int fd, mxio_t** out) {
         status = ERR_UNAVAILABLE;
         goto done;
     }
+    // a lookup underway may be about to take a reference
+    mxio_fdtab[fd] = NULL;
+    mxio_fdtab_wait_for_readers(fd);
     if (atomic_load(&io->refcount) > 1) {
+        mxio_fdtab[fd] = io;
         status = ERR_UNAVAILABLE;
         goto done;
     }
     io->dupcount = 0;
-    mxio_fdtab[fd] = NULL;
     *out = io;
     status = NO_ERROR;
 done:
@@ -138,12 +152,16 @@ mxio_t* __mxio_fd_to_io(int fd) {
     if ((fd < 0) || (fd >= MAX_MXIO_FD)) {
         return NULL;
     }
-    mxio_t* io = NULL;
-    mtx_lock(&mxio_lock);
-    if ((io = mxio_fdtab[fd]) != NULL) {
+    // Don't take mxio_lock: threads doing io on different fds shouldn't
+    // contend here.  Whoever clears the slot waits for the readers count
+    // to drain before dropping the slot's reference, so the mxio can't be
+    // freed between loading it and acquiring it.
+    atomic_fetch_add(&mxio_fdtab_readers[fd], 1);
+    mxio_t* io = mxio_fdtab[fd];
+    if (io != NULL) {
         mxio_acquire(io);
     }
-    mtx_unlock(&mxio_lock);
+    atomic_fetch_sub(&mxio_fdtab_readers[fd], 1);
     return io;
 }
 
@@ -153,6 +171,7 @@ static void mxio_exit(void) {
         mxio_t* io = mxio_fdtab[fd];
         if (io) {
             mxio_fdtab[fd] = NULL;
+            mxio_fdtab_wait_for_readers(fd);
             io->dupcount--;
             if (io->dupcount == 0) {
                 io->ops->close(io);
@@ -483,6 +502,16 @@ ssize_t mxio_ioctl(int fd, int op, const void* in_buf, size_t in_len, void* out_
     return r;
 }
 
+mx_status_t mxio_set_buffered(int fd, bool enable) {
+    mxio_t* io;
+    if ((io = fd_to_io(fd)) == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+    mx_status_t r = mxrio_set_buffered(io, enable);
+    mxio_release(io);
+    return r;
+}
+
 mx_status_t mxio_wait_fd(int fd, uint32_t _events, uint32_t* _pending, mx_time_t timeout) {
     mx_status_t r = NO_ERROR;
     mxio_t* io;
@@ -579,6 +608,7 @@ int mxio_status_to_errno(mx_status_t status) {
     case ERR_NO_RESOURCES: return ENOMEM;
     case ERR_BAD_HANDLE: return EBADF;
     case ERR_ACCESS_DENIED: return EACCES;
+    case ERR_WRONG_TYPE: return ESPIPE;
     case ERR_SHOULD_WAIT: return EAGAIN;
 
     // No specific translation, so return a generic errno value.
@@ -589,44 +619,130 @@ int mxio_status_to_errno(mx_status_t status) {
 // The functions from here on provide implementations of fd and path
 // centric posix-y io operations.
 
-ssize_t readv(int fd, const struct iovec* iov, int num) {
-    ssize_t count = 0;
-    ssize_t r;
-    while (num > 0) {
-        if (iov->iov_len != 0) {
-            r = read(fd, iov->iov_base, iov->iov_len);
-            if (r < 0) {
-                return count ? count : r;
-            }
-            if ((size_t)r < iov->iov_len) {
-                return count + r;
-            }
-            count += r;
+// One read, write, read_at or write_at, waiting for a read to have
+// something to return if |wait| and the fd blocks.  |offset| < 0 means
+// the current position.
+static ssize_t mxio_xfer(mxio_t* io, int fd, void* buf, size_t len, off_t offset,
+                         bool is_write, bool wait) {
+    for (;;) {
+        ssize_t r;
+        if (is_write) {
+            r = (offset < 0) ? io->ops->write(io, buf, len) : io->ops->write_at(io, buf, len, offset);
+        } else {
+            r = (offset < 0) ? io->ops->read(io, buf, len) : io->ops->read_at(io, buf, len, offset);
         }
-        iov++;
-        num--;
+        if ((r != ERR_SHOULD_WAIT) || is_write || !wait || (io->flags & MXIO_FLAG_NONBLOCK)) {
+            return r;
+        }
+        mxio_wait_fd(fd, MXIO_EVT_READABLE, NULL, MX_TIME_INFINITE);
     }
-    return count;
 }
 
-ssize_t writev(int fd, const struct iovec* iov, int num) {
-    ssize_t count = 0;
+// Moves an iovec array in as few transactions as it can.  Arrays that fit
+// in one chunk are gathered into a single read or write, so a stdio flush
+// of its buffer along with the caller's data is one round trip.  Bigger
+// ones go a piece at a time, each of which is carried as efficiently as
+// the transport allows, and once some data has moved the rest only takes
+// what is already there rather than waiting for more.
+static ssize_t mxio_iov(int fd, const struct iovec* iov, int num, off_t offset, bool is_write) {
+    if ((num < 0) || (num > IOV_MAX)) {
+        return ERRNO(EINVAL);
+    }
+    size_t total = 0;
+    for (int i = 0; i < num; i++) {
+        if (iov[i].iov_len > SSIZE_MAX - total) {
+            return ERRNO(EINVAL);
+        }
+        total += iov[i].iov_len;
+    }
+
+    mxio_t* io = fd_to_io(fd);
+    if (io == NULL) {
+        return ERRNO(EBADF);
+    }
     ssize_t r;
-    while (num > 0) {
-        if (iov->iov_len != 0) {
-            r = write(fd, iov->iov_base, iov->iov_len);
-            if (r < 0) {
-                return count ? count : r;
+    if ((num > 1) && (total <= MXIO_CHUNK_SIZE)) {
+        uint8_t buf[MXIO_CHUNK_SIZE];
+        if (is_write) {
+            size_t at = 0;
+            for (int i = 0; i < num; i++) {
+                memcpy(buf + at, iov[i].iov_base, iov[i].iov_len);
+                at += iov[i].iov_len;
+            }
+        }
+        r = mxio_xfer(io, fd, buf, total, offset, is_write, true);
+        if (!is_write && (r > 0)) {
+            size_t at = 0;
+            for (int i = 0; (i < num) && (at < (size_t)r); i++) {
+                size_t n = (size_t)r - at;
+                if (n > iov[i].iov_len) {
+                    n = iov[i].iov_len;
+                }
+                memcpy(iov[i].iov_base, buf + at, n);
+                at += n;
             }
-            if ((size_t)r < iov->iov_len) {
-                return count + r;
+        }
+    } else {
+        ssize_t count = 0;
+        r = 0;
+        for (int i = 0; i < num; i++) {
+            if (iov[i].iov_len == 0) {
+                continue;
+            }
+            r = mxio_xfer(io, fd, iov[i].iov_base, iov[i].iov_len,
+                          (offset < 0) ? offset : offset + count, is_write, count == 0);
+            if (r < 0) {
+                break;
             }
             count += r;
+            if ((size_t)r < iov[i].iov_len) {
+                break;
+            }
         }
-        iov++;
-        num--;
+        if (count > 0) {
+            r = count;
+        }
+    }
+    mxio_release(io);
+    return STATUS(r);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int num) {
+    return mxio_iov(fd, iov, num, -1, false);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int num) {
+    return mxio_iov(fd, iov, num, -1, true);
+}
+
+ssize_t preadv(int fd, const struct iovec* iov, int num, off_t offset) {
+    if (offset < 0) {
+        return ERRNO(EINVAL);
+    }
+    return mxio_iov(fd, iov, num, offset, false);
+}
+
+ssize_t pwritev(int fd, const struct iovec* iov, int num, off_t offset) {
+    if (offset < 0) {
+        return ERRNO(EINVAL);
+    }
+    return mxio_iov(fd, iov, num, offset, true);
+}
+
+ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+    if ((buf == NULL) || (offset < 0)) {
+        return ERRNO(EINVAL);
     }
-    return count;
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    return mxio_iov(fd, &iov, 1, offset, false);
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    if ((buf == NULL) || (offset < 0)) {
+        return ERRNO(EINVAL);
+    }
+    struct iovec iov = { .iov_base = (void*)buf, .iov_len = count };
+    return mxio_iov(fd, &iov, 1, offset, true);
 }
 
 int unlinkat(int dirfd, const char* path, int flags) {
@@ -689,10 +805,12 @@ int close(int fd) {
     if (io->dupcount > 0) {
         // still alive in other fdtab slots
         mtx_unlock(&mxio_lock);
+        mxio_fdtab_wait_for_readers(fd);
         mxio_release(io);
         return NO_ERROR;
     } else {
         mtx_unlock(&mxio_lock);
+        mxio_fdtab_wait_for_readers(fd);
         int r = io->ops->close(io);
         mxio_release(io);
         return STATUS(r);
@@ -1509,3 +1627,74 @@ int ioctl(int fd, int req, ...) {
     mxio_release(io);
     return STATUS(r);
 }
+
+// libc's mmap() only knows anonymous memory
+void* __mmap(void* start, size_t len, int prot, int flags, int fd, off_t off);
+
+// Files are mapped straight from the VMO their server keeps them in.
+// MAP_PRIVATE mappings that may be written get a copy-on-write clone of it,
+// so the file itself is never changed through them.
+void* mmap(void* start, size_t len, int prot, int flags, int fd, off_t off) {
+    if ((flags & MAP_ANON) || (fd < 0)) {
+        return __mmap(start, len, prot, flags, fd, off);
+    }
+    if ((len == 0) || (off < 0) || (off & (PAGE_SIZE - 1)) || (prot == 0) ||
+        (!(flags & MAP_PRIVATE) == !(flags & MAP_SHARED))) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    mxio_t* io;
+    if ((io = fd_to_io(fd)) == NULL) {
+        errno = EBADF;
+        return MAP_FAILED;
+    }
+    mx_handle_t vmo;
+    size_t vmo_off, size;
+    mx_status_t r = io->ops->get_vmo(io, &vmo, &vmo_off, &size);
+    mxio_release(io);
+    if (r < 0) {
+        errno = (r == ERR_NOT_SUPPORTED) ? ENODEV : mxio_status_to_errno(r);
+        return MAP_FAILED;
+    }
+
+    // the pages must lie within the file, the last may be partial, and the
+    // file must start on a page boundary of its VMO to be mapped at all
+    len = (len + PAGE_SIZE - 1) & -PAGE_SIZE;
+    size_t file_pages = (size + PAGE_SIZE - 1) & -PAGE_SIZE;
+    if (((uint64_t)off >= file_pages) || (len > file_pages - off) ||
+        (vmo_off & (PAGE_SIZE - 1))) {
+        mx_handle_close(vmo);
+        errno = (vmo_off & (PAGE_SIZE - 1)) ? ENODEV : ENXIO;
+        return MAP_FAILED;
+    }
+    vmo_off += off;
+
+    if ((flags & MAP_PRIVATE) && (prot & PROT_WRITE)) {
+        mx_handle_t clone;
+        r = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, vmo_off, len, &clone);
+        mx_handle_close(vmo);
+        if (r < 0) {
+            errno = mxio_status_to_errno(r);
+            return MAP_FAILED;
+        }
+        vmo = clone;
+        vmo_off = 0;
+    }
+
+    uint32_t mx_flags = 0;
+    mx_flags |= (prot & PROT_READ) ? MX_VM_FLAG_PERM_READ : 0;
+    mx_flags |= (prot & PROT_WRITE) ? MX_VM_FLAG_PERM_WRITE : 0;
+    mx_flags |= (prot & PROT_EXEC) ? MX_VM_FLAG_PERM_EXECUTE : 0;
+    mx_flags |= (flags & MAP_FIXED) ? MX_VM_FLAG_FIXED : 0;
+
+    uintptr_t ptr = (uintptr_t)start;
+    r = mx_process_map_vm(mx_process_self(), vmo, vmo_off, len, &ptr, mx_flags);
+    mx_handle_close(vmo);
+    if (r < 0) {
+        // a shared writable mapping of a vmo the server handed out read-only
+        errno = mxio_status_to_errno(r);
+        return MAP_FAILED;
+    }
+    return (void*)ptr;
+}
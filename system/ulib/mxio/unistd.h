@@ -6,6 +6,7 @@
 
 #include <mxio/io.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <threads.h>
@@ -19,7 +20,10 @@ typedef struct {
     mode_t umask;
     mxio_t* root;
     mxio_t* cwd;
-    mxio_t* fdtab[MAX_MXIO_FD];
+    // fdtab is written under lock but read without it by fd_to_io(),
+    // which counts itself in fdtab_readers while it takes its reference
+    mxio_t* _Atomic fdtab[MAX_MXIO_FD];
+    atomic_int fdtab_readers[MAX_MXIO_FD];
     char cwd_path[PATH_MAX];
 } mxio_state_t;
 
@@ -31,6 +35,7 @@ extern mxio_state_t __mxio_global_state;
 #define mxio_cwd_lock (__mxio_global_state.cwd_lock)
 #define mxio_cwd_path (__mxio_global_state.cwd_path)
 #define mxio_fdtab (__mxio_global_state.fdtab)
+#define mxio_fdtab_readers (__mxio_global_state.fdtab_readers)
 #define mxio_root_init (__mxio_global_state.init)
 
 mxio_t* __mxio_fd_to_io(int fd);
@@ -47,6 +47,27 @@ static ssize_t vmofile_read(mxio_t* io, void* data, size_t len) {
     }
 }
 
+static ssize_t vmofile_read_at(mxio_t* io, void* data, size_t len, off_t at) {
+    vmofile_t* vf = (vmofile_t*)io;
+
+    // make sure we're within the file's bounds
+    if ((at < 0) || ((mx_off_t)at > (vf->end - vf->off))) {
+        return ERR_INVALID_ARGS;
+    }
+    // adjust to actual vmo offset and clip the length to the end
+    mx_off_t off = vf->off + at;
+    if (len > (vf->end - off)) {
+        len = vf->end - off;
+    }
+
+    mx_status_t status = mx_vmo_read(vf->vmo, data, off, len, &len);
+    if (status < 0) {
+        return status;
+    } else {
+        return len;
+    }
+}
+
 static off_t vmofile_seek(mxio_t* io, off_t offset, int whence) {
     vmofile_t* vf = (vmofile_t*)io;
     mtx_lock(&vf->lock);
@@ -107,9 +128,22 @@ static mx_status_t vmofile_misc(mxio_t* io, uint32_t op, int64_t off, uint32_t m
     }
 }
 
+static mx_status_t vmofile_get_vmo(mxio_t* io, mx_handle_t* out, size_t* off, size_t* len) {
+    vmofile_t* vf = (vmofile_t*)io;
+    mx_status_t status = mx_handle_duplicate(vf->vmo, MX_RIGHT_SAME_RIGHTS, out);
+    if (status < 0) {
+        return status;
+    }
+    *off = vf->off;
+    *len = vf->end - vf->off;
+    return NO_ERROR;
+}
+
 static mxio_ops_t vmofile_ops = {
     .read = vmofile_read,
+    .read_at = vmofile_read_at,
     .write = mxio_default_write,
+    .write_at = mxio_default_write_at,
     .seek = vmofile_seek,
     .misc = vmofile_misc,
     .close = vmofile_close,
@@ -119,6 +153,7 @@ static mxio_ops_t vmofile_ops = {
     .wait_begin = mxio_default_wait_begin,
     .wait_end = mxio_default_wait_end,
     .unwrap = mxio_default_unwrap,
+    .get_vmo = vmofile_get_vmo,
 };
 
 mxio_t* mxio_vmofile_create(mx_handle_t h, mx_off_t off, mx_off_t len) {
@@ -67,7 +67,9 @@ static void mxwio_wait_end(mxio_t* io, mx_signals_t signals, uint32_t* _events)
 
 static mxio_ops_t mxio_waitable_ops = {
     .read = mxio_default_read,
+    .read_at = mxio_default_read_at,
     .write = mxio_default_write,
+    .write_at = mxio_default_write_at,
     .seek = mxio_default_seek,
     .misc = mxio_default_misc,
     .close = mxwio_close,
@@ -76,6 +78,7 @@ static mxio_ops_t mxio_waitable_ops = {
     .ioctl = mxio_default_ioctl,
     .wait_begin = mxwio_wait_begin,
     .wait_end = mxwio_wait_end,
+    .get_vmo = mxio_default_get_vmo,
 };
 
 mxio_t* mxio_waitable_create(mx_handle_t h, mx_signals_t signals_in,
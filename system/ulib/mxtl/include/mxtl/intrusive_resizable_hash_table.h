@@ -0,0 +1,666 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <magenta/assert.h>
+#include <mxtl/intrusive_container_utils.h>
+#include <mxtl/intrusive_pointer_traits.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/macros.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// Fwd decl of sanity checker class used by tests.
+namespace tests {
+namespace intrusive_containers {
+class ResizableHashTableChecker;
+}  // namespace tests
+}  // namespace intrusive_containers
+
+// ResizableHashTable is a HashTable whose number of buckets grows with the
+// number of elements in it, instead of being fixed by a template parameter.
+//
+// Growing is incremental.  When the table decides to grow it allocates a
+// bucket array twice the size of the current one, and each insert after that
+// moves the contents of a few buckets of the old array to the new one, so no
+// one insert pays for moving everything.  Until it is done, elements are in
+// both arrays, but always in the one given by their key, so lookups still look
+// in one bucket.
+//
+// Only inserting can move elements, so erasing while iterating is as safe as
+// it is with HashTable, and inserting invalidates iterators.
+//
+// An empty table has one bucket, held in the table itself, and tables only
+// allocate bucket arrays as they grow.  If an allocation fails the table
+// stays the size it is and the insert goes ahead, so inserting never fails;
+// this matters in the kernel, where a table can be used where failing is not
+// an option.  The bucket arrays are freed by clear() and the destructor; the
+// table does not shrink otherwise.
+
+// DefaultResizableHashTraits defines a default implementation of traits used
+// to define the hash function for a resizable hash table.
+//
+// Unlike the hash traits of a HashTable, GetHash returns the whole hash of the
+// key, which the table maps to a bucket itself as the number of buckets
+// changes.  The mapping multiplies by a large odd constant and takes the top
+// bits, so cheap hashes (even the identity) work, but all of the hash's bits
+// should vary with the key.
+//
+// DefaultResizableHashTraits takes its KeyType, ObjType, and HashType from
+// template parameters.  Users of it only need to implement a static method of
+// ObjType named GetHash which takes a const reference to a KeyType and returns
+// a HashType.
+template <typename KeyType,
+          typename ObjType,
+          typename HashType>
+struct DefaultResizableHashTraits {
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+    static HashType GetHash(const KeyType& key) {
+        return static_cast<HashType>(ObjType::GetHash(key));
+    }
+};
+
+// DefaultHashTableResizePolicy defines when a resizable hash table grows.
+//
+// A resize policy must define...
+//
+// kMinBuckets : The number of buckets to allocate the first time the table
+//               grows.  Must be a power of two.
+// kMaxBuckets : The most buckets the table will have.  Must be a power of two.
+// kRehashStep : The number of old buckets moved to the new array by each
+//               insert while the table is growing.  Must be at least 1.
+// ShouldGrow  : A static method which takes the number of elements the table
+//               will have and the number of buckets it has, and returns true
+//               if it should grow.
+//
+// The default grows when there would be more than two elements per bucket.
+struct DefaultHashTableResizePolicy {
+    static constexpr size_t kMinBuckets = 16;
+    static constexpr size_t kMaxBuckets = 1u << 20;
+    static constexpr size_t kRehashStep = 2;
+
+    static bool ShouldGrow(size_t count, size_t num_buckets) {
+        return count > (num_buckets * 2);
+    }
+};
+
+template <typename  _KeyType,
+          typename  _PtrType,
+          typename  _BucketType   = SinglyLinkedList<_PtrType>,
+          typename  _HashType     = size_t,
+          typename  _KeyTraits    = DefaultKeyedObjectTraits<
+                                      _KeyType,
+                                      typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
+          typename  _HashTraits   = DefaultResizableHashTraits<
+                                      _KeyType,
+                                      typename internal::ContainerPtrTraits<_PtrType>::ValueType,
+                                      _HashType>,
+          typename  _ResizePolicy = DefaultHashTableResizePolicy>
+class ResizableHashTable {
+private:
+    // Private fwd decls of the iterator implementation.
+    template <typename IterTraits> class iterator_impl;
+    struct iterator_traits;
+    struct const_iterator_traits;
+
+public:
+    // Pointer types/traits
+    using PtrType      = _PtrType;
+    using PtrTraits    = internal::ContainerPtrTraits<PtrType>;
+    using ValueType    = typename PtrTraits::ValueType;
+
+    // Key types/traits
+    using KeyType      = _KeyType;
+    using KeyTraits    = _KeyTraits;
+
+    // Hash types/traits
+    using HashType     = _HashType;
+    using HashTraits   = _HashTraits;
+    using ResizePolicy = _ResizePolicy;
+
+    // Bucket types/traits
+    using BucketType   = _BucketType;
+    using NodeTraits   = typename BucketType::NodeTraits;
+
+    // Declarations of the standard iterator types.
+    using iterator       = iterator_impl<iterator_traits>;
+    using const_iterator = iterator_impl<const_iterator_traits>;
+
+    // An alias for the type of this specific ResizableHashTable<...> and its
+    // test sanity checker.
+    using ContainerType = ResizableHashTable<_KeyType, _PtrType, _BucketType, _HashType,
+                                             _KeyTraits, _HashTraits, _ResizePolicy>;
+    using CheckerType   = ::mxtl::tests::intrusive_containers::ResizableHashTableChecker;
+
+    // Hash tables only support constant order erase if their underlying bucket
+    // type does.
+    static constexpr bool SupportsConstantOrderErase = BucketType::SupportsConstantOrderErase;
+    static constexpr bool SupportsConstantOrderSize = true;
+    static constexpr bool IsAssociative = true;
+    static constexpr bool IsSequenced = false;
+
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+    static_assert(ResizePolicy::kMinBuckets > 1 &&
+                  !(ResizePolicy::kMinBuckets & (ResizePolicy::kMinBuckets - 1)),
+                  "kMinBuckets must be a power of two");
+    static_assert(ResizePolicy::kMaxBuckets >= ResizePolicy::kMinBuckets &&
+                  !(ResizePolicy::kMaxBuckets & (ResizePolicy::kMaxBuckets - 1)),
+                  "kMaxBuckets must be a power of two, and no less than kMinBuckets");
+    static_assert(ResizePolicy::kRehashStep > 0, "kRehashStep must be at least 1");
+
+    constexpr ResizableHashTable() {}
+    ~ResizableHashTable() {
+        DEBUG_ASSERT(PtrTraits::IsManaged || is_empty());
+        FreeBuckets(old_buckets_);
+        FreeBuckets(buckets_);
+    }
+
+    // Standard begin/end, cbegin/cend iterator accessors.
+    iterator begin()              { return       iterator(this,       iterator::BEGIN); }
+    const_iterator begin()  const { return const_iterator(this, const_iterator::BEGIN); }
+    const_iterator cbegin() const { return const_iterator(this, const_iterator::BEGIN); }
+
+    iterator end()              { return       iterator(this,       iterator::END); }
+    const_iterator end()  const { return const_iterator(this, const_iterator::END); }
+    const_iterator cend() const { return const_iterator(this, const_iterator::END); }
+
+    // make_iterator : construct an iterator out of a reference to an object.
+    iterator make_iterator(ValueType& obj) {
+        size_t ndx = BucketNdx(KeyTraits::GetKey(obj));
+        return iterator(this, ndx, GetBucket(ndx).make_iterator(obj));
+    }
+
+    void insert(const PtrType& ptr) { insert(PtrType(ptr)); }
+    void insert(PtrType&& ptr) {
+        DEBUG_ASSERT(ptr != nullptr);
+        KeyType key = KeyTraits::GetKey(*ptr);
+        GrowForInsert();
+        BucketType& bucket = GetBucket(BucketNdx(key));
+
+        // Duplicate keys are disallowed.  Debug assert if someone tries to to
+        // insert an element with a duplicate key.  If the user thought that
+        // there might be a duplicate key in the table already, he/she should
+        // have used insert_or_find() instead.
+        DEBUG_ASSERT(FindInBucket(bucket, key).IsValid() == false);
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+    }
+
+    // insert_or_find
+    //
+    // Insert the element pointed to by ptr if it is not already in the
+    // table, or find the element that the ptr collided with instead.
+    //
+    // 'iter' is an optional out parameter pointer to an iterator which
+    // will reference either the newly inserted item, or the item whose key
+    // collided with ptr.
+    //
+    // insert_or_find returns true if there was no collision and the item was
+    // successfully inserted, otherwise it returns false.
+    //
+    bool insert_or_find(const PtrType& ptr, iterator* iter = nullptr) {
+        return insert_or_find(PtrType(ptr), iter);
+    }
+
+    bool insert_or_find(PtrType&& ptr, iterator* iter = nullptr) {
+        DEBUG_ASSERT(ptr != nullptr);
+        KeyType key = KeyTraits::GetKey(*ptr);
+        GrowForInsert();
+        size_t ndx         = BucketNdx(key);
+        auto&  bucket      = GetBucket(ndx);
+        auto   bucket_iter = FindInBucket(bucket, key);
+
+        if (bucket_iter.IsValid()) {
+            if (iter) *iter = iterator(this, ndx, bucket_iter);
+            return false;
+        }
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+        if (iter) *iter = iterator(this, ndx, bucket.begin());
+        return true;
+    }
+
+    iterator find(const KeyType& key) {
+        size_t ndx         = BucketNdx(key);
+        auto&  bucket      = GetBucket(ndx);
+        auto   bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? iterator(this, ndx, bucket_iter)
+                                     : iterator(this, iterator::END);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        size_t      ndx         = BucketNdx(key);
+        const auto& bucket      = GetBucket(ndx);
+        auto        bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? const_iterator(this, ndx, bucket_iter)
+                                     : const_iterator(this, const_iterator::END);
+    }
+
+    PtrType erase(const KeyType& key) {
+        BucketType& bucket = GetBucket(BucketNdx(key));
+
+        PtrType ret = internal::KeyEraseUtils<BucketType, KeyTraits>::erase(bucket, key);
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    PtrType erase(const iterator& iter) {
+        if (!iter.IsValid())
+            return PtrType(nullptr);
+
+        return direct_erase(GetBucket(iter.bucket_ndx_), *iter);
+    }
+
+    PtrType erase(ValueType& obj) {
+        return direct_erase(GetBucket(BucketNdx(KeyTraits::GetKey(obj))), obj);
+    }
+
+    // clear
+    //
+    // Remove everything, and free the bucket arrays, leaving the table as it
+    // was when it was constructed.
+    void clear() {
+        for (size_t i = 0; i < total_buckets(); ++i)
+            GetBucket(i).clear();
+        FreeBuckets(old_buckets_);
+        FreeBuckets(buckets_);
+        buckets_ = &inline_bucket_;
+        shift_ = 0;
+        old_buckets_ = nullptr;
+        old_shift_ = 0;
+        rehash_ndx_ = 0;
+        count_ = 0;
+    }
+
+    size_t size()      const { return count_; }
+    bool   is_empty()  const { return count_ == 0; }
+
+    // The number of buckets elements are being put in.  While the table is
+    // growing, some are still in the buckets of the array it is growing from.
+    size_t bucket_count() const { return static_cast<size_t>(1) << shift_; }
+
+    // erase_if
+    //
+    // Find the first member of the hash table which satisfies the predicate
+    // given by 'fn' and erase it from the list, returning a referenced pointer
+    // to the removed element.  Return nullptr if no member satisfies the
+    // predicate.
+    template <typename UnaryFn>
+    PtrType erase_if(UnaryFn fn) {
+        if (is_empty())
+            return PtrType(nullptr);
+
+        for (size_t i = 0; i < total_buckets(); ++i) {
+            auto& bucket = GetBucket(i);
+            if (!bucket.is_empty()) {
+                PtrType ret = bucket.erase_if(fn);
+                if (ret != nullptr) {
+                    --count_;
+                    return ret;
+                }
+            }
+        }
+
+        return PtrType(nullptr);
+    }
+
+    // find_if
+    //
+    // Find the first member of the hash table which satisfies the predicate
+    // given by 'fn' and return an iterator to it.  Return end() if no member
+    // satisfies the predicate.
+    template <typename UnaryFn>
+    const_iterator find_if(UnaryFn fn) const {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+    template <typename UnaryFn>
+    iterator find_if(UnaryFn fn) {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+private:
+    // The traits of a non-const iterator
+    struct iterator_traits {
+        using RefType    = typename PtrTraits::RefType;
+        using RawPtrType = typename PtrTraits::RawPtrType;
+        using IterType   = typename BucketType::iterator;
+
+        static IterType BucketBegin(BucketType& bucket) { return bucket.begin(); }
+        static IterType BucketEnd  (BucketType& bucket) { return bucket.end(); }
+    };
+
+    // The traits of a const iterator
+    struct const_iterator_traits {
+        using RefType    = typename PtrTraits::ConstRefType;
+        using RawPtrType = typename PtrTraits::ConstRawPtrType;
+        using IterType   = typename BucketType::const_iterator;
+
+        static IterType BucketBegin(const BucketType& bucket) { return bucket.cbegin(); }
+        static IterType BucketEnd  (const BucketType& bucket) { return bucket.cend(); }
+    };
+
+    // The shared implementation of the iterator.  Bucket indices run over the
+    // buckets of the array being grown from, if there is one, and then over
+    // those of the current array.
+    template <class IterTraits>
+    class iterator_impl {
+    public:
+        iterator_impl() { }
+        iterator_impl(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+        }
+
+        iterator_impl& operator=(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+            return *this;
+        }
+
+        bool IsValid() const { return iter_.IsValid(); }
+        bool operator==(const iterator_impl& other) const { return iter_ == other.iter_; }
+        bool operator!=(const iterator_impl& other) const { return iter_ != other.iter_; }
+
+        // Prefix
+        iterator_impl& operator++() {
+            if (!IsValid()) return *this;
+            DEBUG_ASSERT(hash_table_);
+
+            // Bump the bucket iterator and go looking for a new bucket if the
+            // iterator has become invalid.
+            ++iter_;
+            advance_if_invalid_iter();
+
+            return *this;
+        }
+
+        iterator_impl& operator--() {
+            // If we have never been bound to a table instance, the we had
+            // better be invalid.
+            if (!hash_table_) {
+                DEBUG_ASSERT(!IsValid());
+                return *this;
+            }
+
+            // Back up the bucket iterator.  If it is still valid, then we are done.
+            --iter_;
+            if (iter_.IsValid())
+                return *this;
+
+            // If the iterator is invalid after backing up, check previous
+            // buckets to see if they contain any nodes.
+            while (bucket_ndx_) {
+                --bucket_ndx_;
+                auto& bucket = GetBucket(bucket_ndx_);
+                if (!bucket.is_empty()) {
+                    iter_ = --IterTraits::BucketEnd(bucket);
+                    DEBUG_ASSERT(iter_.IsValid());
+                    return *this;
+                }
+            }
+
+            // Looks like we have backed up past the beginning.  Update the
+            // bookkeeping to point at the end of the last bucket.
+            bucket_ndx_ = last_ndx();
+            iter_ = IterTraits::BucketEnd(GetBucket(bucket_ndx_));
+
+            return *this;
+        }
+
+        // Postfix
+        iterator_impl operator++(int) {
+            iterator_impl ret(*this);
+            ++(*this);
+            return ret;
+        }
+
+        iterator_impl operator--(int) {
+            iterator_impl ret(*this);
+            --(*this);
+            return ret;
+        }
+
+        typename PtrTraits::PtrType CopyPointer()          { return iter_.CopyPointer(); }
+        typename IterTraits::RefType operator*()     const { return iter_.operator*(); }
+        typename IterTraits::RawPtrType operator->() const { return iter_.operator->(); }
+
+    private:
+        friend ContainerType;
+        using IterType = typename IterTraits::IterType;
+
+        enum BeginTag { BEGIN };
+        enum EndTag { END };
+
+        iterator_impl(const ContainerType* hash_table, BeginTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(0),
+              iter_(IterTraits::BucketBegin(GetBucket(0))) {
+            advance_if_invalid_iter();
+        }
+
+        iterator_impl(const ContainerType* hash_table, EndTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(last_ndx()),
+              iter_(IterTraits::BucketEnd(GetBucket(bucket_ndx_))) { }
+
+        iterator_impl(const ContainerType* hash_table, size_t bucket_ndx, const IterType& iter)
+            : hash_table_(hash_table),
+              bucket_ndx_(bucket_ndx),
+              iter_(iter) { }
+
+        BucketType& GetBucket(size_t ndx) {
+            return const_cast<ContainerType*>(hash_table_)->GetBucket(ndx);
+        }
+
+        size_t last_ndx() const { return hash_table_->total_buckets() - 1; }
+
+        void advance_if_invalid_iter() {
+            // If the iterator has run off the end of it's current bucket, then
+            // check to see if there are nodes in any of the remaining buckets.
+            if (!iter_.IsValid()) {
+                while (bucket_ndx_ < last_ndx()) {
+                    ++bucket_ndx_;
+                    auto& bucket = GetBucket(bucket_ndx_);
+
+                    if (!bucket.is_empty()) {
+                        iter_ = IterTraits::BucketBegin(bucket);
+                        DEBUG_ASSERT(iter_.IsValid());
+                        break;
+                    } else if (bucket_ndx_ == last_ndx()) {
+                        iter_ = IterTraits::BucketEnd(bucket);
+                    }
+                }
+            }
+        }
+
+        const ContainerType* hash_table_ = nullptr;
+        size_t bucket_ndx_ = 0;
+        IterType iter_;
+    };
+
+    PtrType direct_erase(BucketType& bucket, ValueType& obj) {
+        PtrType ret = internal::DirectEraseUtils<BucketType>::erase(bucket, obj);
+
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    static typename BucketType::iterator FindInBucket(BucketType& bucket,
+                                                      const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    static typename BucketType::const_iterator FindInBucket(const BucketType& bucket,
+                                                            const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    // The test framework's 'checker' class is our friend.
+    friend CheckerType;
+
+    // Iterators need to access our bucket arrays in order to iterate.
+    friend iterator;
+    friend const_iterator;
+
+    // Hash tables may not currently be copied, assigned or moved.
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ResizableHashTable);
+
+    // Map a hash to one of 2^shift buckets.  Multiplying by 2^64 / phi
+    // spreads all of the hash's bits over the top ones, which pick the bucket.
+    static size_t HashToNdx(HashType hash, uint32_t shift) {
+        if (shift == 0)
+            return 0;
+        uint64_t mixed = static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull;
+        return static_cast<size_t>(mixed >> (64 - shift));
+    }
+
+    size_t old_bucket_count() const {
+        return old_buckets_ ? (static_cast<size_t>(1) << old_shift_) : 0;
+    }
+
+    size_t total_buckets() const { return old_bucket_count() + bucket_count(); }
+
+    // The index, as the iterator counts them, of the bucket for |key|.  While
+    // the table is growing, keys go in the old array until their bucket there
+    // has been moved.
+    size_t BucketNdx(const KeyType& key) const {
+        HashType hash = HashTraits::GetHash(key);
+        if (old_buckets_ != nullptr) {
+            size_t ndx = HashToNdx(hash, old_shift_);
+            if (ndx >= rehash_ndx_)
+                return ndx;
+        }
+        return old_bucket_count() + HashToNdx(hash, shift_);
+    }
+
+    BucketType& GetBucket(size_t ndx) {
+        size_t old_count = old_bucket_count();
+        return (ndx < old_count) ? old_buckets_[ndx] : buckets_[ndx - old_count];
+    }
+
+    const BucketType& GetBucket(size_t ndx) const {
+        size_t old_count = old_bucket_count();
+        return (ndx < old_count) ? old_buckets_[ndx] : buckets_[ndx - old_count];
+    }
+
+    void FreeBuckets(BucketType* buckets) {
+        if (buckets != &inline_bucket_)
+            delete[] buckets;
+    }
+
+    // Called before each insert: move some more of the old array, if the
+    // table is growing, or start growing if it is time to.
+    void GrowForInsert() {
+        if (old_buckets_ != nullptr) {
+            Rehash(ResizePolicy::kRehashStep);
+            return;
+        }
+
+        if ((bucket_count() >= ResizePolicy::kMaxBuckets) ||
+            !ResizePolicy::ShouldGrow(count_ + 1, bucket_count()))
+            return;
+
+        uint32_t shift = shift_ + 1;
+        if (shift_ == 0) {
+            while ((static_cast<size_t>(1) << shift) < ResizePolicy::kMinBuckets)
+                ++shift;
+        }
+
+        AllocChecker ac;
+        BucketType* buckets = new (&ac) BucketType[static_cast<size_t>(1) << shift];
+        if (!ac.check())
+            return;
+
+        old_buckets_ = buckets_;
+        old_shift_ = shift_;
+        rehash_ndx_ = 0;
+        buckets_ = buckets;
+        shift_ = shift;
+        Rehash(ResizePolicy::kRehashStep);
+    }
+
+    // Move the contents of up to |count| buckets of the old array into the
+    // current one, and free the old array once it's empty.
+    void Rehash(size_t count) {
+        size_t old_count = old_bucket_count();
+        while (count-- && (rehash_ndx_ < old_count)) {
+            BucketType& bucket = old_buckets_[rehash_ndx_++];
+            while (!bucket.is_empty()) {
+                PtrType ptr = bucket.pop_front();
+                size_t ndx = HashToNdx(HashTraits::GetHash(KeyTraits::GetKey(*ptr)), shift_);
+                buckets_[ndx].push_front(mxtl::move(ptr));
+            }
+        }
+
+        if (rehash_ndx_ == old_count) {
+            FreeBuckets(old_buckets_);
+            old_buckets_ = nullptr;
+            old_shift_ = 0;
+            rehash_ndx_ = 0;
+        }
+    }
+
+    size_t count_ = 0UL;
+    BucketType inline_bucket_;
+    BucketType* buckets_ = &inline_bucket_;
+    uint32_t shift_ = 0;
+
+    // While growing, the array being grown from and the first of its buckets
+    // which still has to be moved.
+    BucketType* old_buckets_ = nullptr;
+    uint32_t old_shift_ = 0;
+    size_t rehash_ndx_ = 0;
+};
+
+// Explicit declaration of constexpr storage.  Appologies for the macro, but the
+// template declarations are just too hideous with it.
+#define RESIZABLE_HASH_TABLE_PROP(_type, _name) \
+template <typename KeyType, typename PtrType, typename BucketType, typename HashType, \
+          typename KeyTraits, typename HashTraits, typename ResizePolicy> \
+constexpr _type ResizableHashTable<KeyType, PtrType, BucketType, HashType, \
+                                   KeyTraits, HashTraits, ResizePolicy>::_name
+
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderErase);
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderSize);
+RESIZABLE_HASH_TABLE_PROP(bool, IsAssociative);
+RESIZABLE_HASH_TABLE_PROP(bool, IsSequenced);
+
+#undef RESIZABLE_HASH_TABLE_PROP
+
+}  // namespace mxtl
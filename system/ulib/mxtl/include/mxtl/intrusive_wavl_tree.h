@@ -57,6 +57,16 @@
 // (AKA, erase operations where the reference to the element to be erased is
 // already known) run in amortized constant time.
 //
+// Trees may optionally be augmented with per-node summaries of the subtree
+// rooted at each node (for example, the largest gap between keys within the
+// subtree) by supplying an AugmentTraits type.  AugmentTraits::Update(node,
+// left, right) is called to recompute the summary for a node from its own
+// contents and the summaries of its children (either of which may be
+// nullptr) any time the shape of the subtree below the node changes.  Keeping
+// the summaries up to date adds an O(log) walk to the root to each insert
+// and erase, and a constant amount of work to each rotation.  Trees which do
+// not supply AugmentTraits pay nothing.
+//
 namespace mxtl {
 
 template <typename PtrType, typename RankType>
@@ -99,13 +109,22 @@ private:
     WAVLTreeNodeState<PtrType, bool> wavl_node_state_;
 };
 
+// The default augmentation for a WAVLTree; keeps no per-subtree state.
+struct DefaultWAVLTreeAugmentTraits {
+    static constexpr bool kEnabled = false;
+
+    template <typename RawPtrType>
+    static void Update(RawPtrType node, RawPtrType left, RawPtrType right) { }
+};
+
 template <typename _KeyType,
           typename _PtrType,
-          typename _KeyTraits  = DefaultKeyedObjectTraits<
-                                    _KeyType,
-                                    typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
-          typename _NodeTraits = DefaultWAVLTreeTraits<_PtrType>,
-          typename _Observer   = tests::intrusive_containers::DefaultWAVLTreeObserver>
+          typename _KeyTraits     = DefaultKeyedObjectTraits<
+                                       _KeyType,
+                                       typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
+          typename _NodeTraits    = DefaultWAVLTreeTraits<_PtrType>,
+          typename _Observer      = tests::intrusive_containers::DefaultWAVLTreeObserver,
+          typename _AugmentTraits = DefaultWAVLTreeAugmentTraits>
 class WAVLTree {
 private:
     // Private fwd decls of the iterator implementation.
@@ -120,10 +139,12 @@ public:
     using KeyTraits     = _KeyTraits;
     using NodeTraits    = _NodeTraits;
     using Observer      = _Observer;
+    using AugmentTraits = _AugmentTraits;
     using PtrTraits     = internal::ContainerPtrTraits<PtrType>;
     using RawPtrType    = typename PtrTraits::RawPtrType;
     using ValueType     = typename PtrTraits::ValueType;
-    using ContainerType = WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Observer>;
+    using ContainerType = WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits,
+                                   Observer, AugmentTraits>;
     using CheckerType   = ::mxtl::tests::intrusive_containers::WAVLTreeChecker;
 
     // Declarations of the standard iterator types.
@@ -397,6 +418,21 @@ public:
     // size : return the current number of elements in the tree.
     size_t size() const { return count_; };
 
+    // root, left_child, right_child
+    //
+    // Raw access to the shape of the tree, for users of augmented trees which
+    // need to descend the tree guided by their per-subtree summaries.  Each
+    // returns nullptr if there is no such node.
+    RawPtrType root() const { return ValidOrNull(root_); }
+    static RawPtrType left_child(RawPtrType node) {
+        DEBUG_ASSERT(PtrTraits::IsValid(node));
+        return ValidOrNull(NodeTraits::node_state(*node).left_);
+    }
+    static RawPtrType right_child(RawPtrType node) {
+        DEBUG_ASSERT(PtrTraits::IsValid(node));
+        return ValidOrNull(NodeTraits::node_state(*node).right_);
+    }
+
     // erase_if
     //
     // Find the first member of the list which satisfies the predicate given by
@@ -644,6 +680,7 @@ private:
             right_most_ = PtrTraits::GetRaw(ptr);
 
             root_ = mxtl::move(ptr);
+            AugmentPathToRoot(PtrTraits::GetRaw(root_));
 
             ++count_;
             Observer::RecordInsert();
@@ -719,6 +756,7 @@ private:
         DEBUG_ASSERT(*owner == nullptr);
         ns.parent_ = parent;
         *owner = mxtl::move(ptr);
+        AugmentPathToRoot(PtrTraits::GetRaw(*owner));
 
         ++count_;
         Observer::RecordInsert();
@@ -859,9 +897,11 @@ private:
         // indicate that it is not in the container.
         DEBUG_ASSERT(ns.IsValid() && !ns.InContainer());
 
-        // Update the count bookkeeping.
+        // Update the count bookkeeping, and the augmented state of every node
+        // whose subtree just lost the target node.
         --count_;
         Observer::RecordErase();
+        AugmentPathToRoot(parent);
 
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
@@ -1102,6 +1142,31 @@ private:
         DEBUG_ASSERT(ns.right_ == nullptr);
     }
 
+    static RawPtrType ValidOrNull(const PtrType& ptr) {
+        return PtrTraits::IsValid(ptr) ? PtrTraits::GetRaw(ptr) : nullptr;
+    }
+
+    // Recompute the augmented state of a single node from its children.
+    static void Augment(RawPtrType node) {
+        if (!AugmentTraits::kEnabled)
+            return;
+
+        auto& ns = NodeTraits::node_state(*node);
+        AugmentTraits::Update(node, ValidOrNull(ns.left_), ValidOrNull(ns.right_));
+    }
+
+    // Recompute the augmented state of node and all of its ancestors.  node may
+    // be the sentinel, in which case there is nothing to do.
+    static void AugmentPathToRoot(RawPtrType node) {
+        if (!AugmentTraits::kEnabled)
+            return;
+
+        while (PtrTraits::IsValid(node)) {
+            Augment(node);
+            node = NodeTraits::node_state(*node).parent_;
+        }
+    }
+
     // After we have swapped contents with another tree, we need to fix up the
     // sentinel values so that they refer to the proper tree.  Otherwise tree
     // A's sentinels will point at tree B's, and vice-versa.
@@ -1241,6 +1306,12 @@ private:
         Z_ns.parent_ = X;
         if (Y)
             NodeTraits::node_state(*Y).parent_ = Z;
+
+        // Z is now X's child, so refresh Z's augmented state before X's.  The
+        // set of nodes under X is what used to be under Z, so nothing above X
+        // needs to change.
+        Augment(Z);
+        Augment(X);
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -1668,13 +1739,24 @@ private:
     size_t     count_      = 0;
 };
 
-template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs>
-constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs>::SupportsConstantOrderErase;
-template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs>
-constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs>::SupportsConstantOrderSize;
-template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs>
-constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs>::IsAssociative;
-template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs>
-constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs>::IsSequenced;
+template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs,
+          typename Aug>
+constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs, Aug>::SupportsConstantOrderErase;
+template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs,
+          typename Aug>
+constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs, Aug>::SupportsConstantOrderSize;
+template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs,
+          typename Aug>
+constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs, Aug>::IsAssociative;
+template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits, typename Obs,
+          typename Aug>
+constexpr bool WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits, Obs, Aug>::IsSequenced;
+
+// A WAVLTree which maintains per-subtree augmented state using AugmentTraits.
+template <typename KeyType, typename PtrType, typename KeyTraits, typename NodeTraits,
+          typename AugmentTraits>
+using AugmentedWAVLTree = WAVLTree<KeyType, PtrType, KeyTraits, NodeTraits,
+                                   tests::intrusive_containers::DefaultWAVLTreeObserver,
+                                   AugmentTraits>;
 
 }  // namespace mxtl
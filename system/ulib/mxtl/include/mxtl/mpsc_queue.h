@@ -0,0 +1,204 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <assert.h>
+#include <mxtl/intrusive_pointer_traits.h>
+#include <mxtl/macros.h>
+#include <mxtl/ref_ptr.h>
+#include <mxtl/unique_ptr.h>
+
+// Usage Notes:
+//
+// mxtl::MpscQueue<> is an intrusive, lock-free, multi-producer/single-consumer
+// FIFO queue.  Any number of threads may push() concurrently; exactly one
+// thread at a time may pop(), is_empty() or clear().
+//
+// As with the other intrusive containers, the bookkeeping needed to be on the
+// queue lives in the objects themselves (see MpscQueueable<> and
+// MpscQueueNodeState<>), so pushing never allocates and may be done from
+// contexts which cannot block.  Supported pointer types are T*, unique_ptr<T>
+// and RefPtr<T>.  A queue of managed pointers holds a reference to each object
+// on it; a queue of unmanaged pointers will ASSERT if destroyed while not
+// empty.
+//
+// Producers push onto a lock-free LIFO stack with a single compare-and-swap.
+// When its private FIFO list runs dry, the consumer takes the whole stack with
+// one atomic exchange and reverses it.  Since only the consumer ever removes
+// nodes, and it removes all of them at once, the stack is not subject to ABA.
+//
+// Example:
+//
+// class Packet : public mxtl::MpscQueueable<Packet*> { ... };
+//
+// mxtl::MpscQueue<Packet*> queue;
+//
+// void Producer(Packet* p) { queue.push(p); }   // any thread
+//
+// void Consumer() {                             // one thread only
+//     Packet* p;
+//     while ((p = queue.pop()) != nullptr)
+//         Process(p);
+// }
+
+namespace mxtl {
+namespace internal {
+
+// Conversions between a container pointer type and the raw pointer the queue
+// actually links, transferring the reference (if any) along with it.
+template <typename T> struct MpscPtrOps;
+
+template <typename T>
+struct MpscPtrOps<T*> {
+    static T* Leak(T* ptr) { return ptr; }
+    static T* Reclaim(T* raw) { return raw; }
+};
+
+template <typename T, typename Deleter>
+struct MpscPtrOps<::mxtl::unique_ptr<T, Deleter>> {
+    using PtrType = ::mxtl::unique_ptr<T, Deleter>;
+    static T* Leak(PtrType&& ptr) { return ptr.release(); }
+    static PtrType Reclaim(T* raw) { return PtrType(raw); }
+};
+
+template <typename T, typename Deleter>
+struct MpscPtrOps<::mxtl::RefPtr<T, Deleter>> {
+    using PtrType = ::mxtl::RefPtr<T, Deleter>;
+    static T* Leak(PtrType&& ptr) { return ptr.leak_ref(); }
+    static PtrType Reclaim(T* raw) { return ::mxtl::internal::MakeRefPtrNoAdopt<T, Deleter>(raw); }
+};
+
+}  // namespace internal
+
+// MpscQueueNodeState<T>
+//
+// The state needed to be a member of an MpscQueue<T>.  Exposed to the queue
+// through the traits; see DefaultMpscQueueTraits<T>.
+template <typename T>
+struct MpscQueueNodeState {
+    using PtrTraits = internal::ContainerPtrTraits<T>;
+    constexpr MpscQueueNodeState() { }
+
+    typename PtrTraits::RawPtrType next_ = nullptr;
+};
+
+// DefaultMpscQueueTraits<T>
+//
+// The default traits for MpscQueue<T>.  An object may be friends with
+// DefaultMpscQueueTraits<T> and have a private mpsc_node_state_ member, or
+// derive from MpscQueueable<T>.
+template <typename T>
+struct DefaultMpscQueueTraits {
+    using PtrTraits = internal::ContainerPtrTraits<T>;
+    static MpscQueueNodeState<T>& node_state(typename PtrTraits::RefType obj) {
+        return obj.mpsc_node_state_;
+    }
+};
+
+// MpscQueueable<T>
+//
+// A helper class which makes it simple to exist on an MpscQueue.
+template <typename T>
+struct MpscQueueable {
+private:
+    friend struct DefaultMpscQueueTraits<T>;
+    MpscQueueNodeState<T> mpsc_node_state_;
+};
+
+template <typename T, typename _NodeTraits = DefaultMpscQueueTraits<T>>
+class MpscQueue {
+public:
+    using PtrTraits  = internal::ContainerPtrTraits<T>;
+    using NodeTraits = _NodeTraits;
+    using PtrType    = typename PtrTraits::PtrType;
+    using RawPtrType = typename PtrTraits::RawPtrType;
+    using PtrOps     = internal::MpscPtrOps<PtrType>;
+
+    constexpr MpscQueue() { }
+
+    ~MpscQueue() {
+        // It is considered an error to allow a queue of unmanaged pointers to
+        // destruct if there are still elements in it.
+        if (!PtrTraits::IsManaged)
+            DEBUG_ASSERT(is_empty());
+        clear();
+    }
+
+    // push
+    //
+    // Safe to call from any number of threads concurrently.
+    void push(const PtrType& ptr) { push(PtrType(ptr)); }
+    void push(PtrType&& ptr) {
+        DEBUG_ASSERT(PtrTraits::IsValid(ptr));
+        RawPtrType obj = PtrOps::Leak(mxtl::move(ptr));
+        auto& ns = NodeTraits::node_state(*obj);
+
+        RawPtrType head = __atomic_load_n(&stack_, __ATOMIC_RELAXED);
+        do {
+            ns.next_ = head;
+        } while (!__atomic_compare_exchange_n(&stack_, &head, obj, true,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    // pop
+    //
+    // Removes and returns the oldest element, or nullptr if the queue is
+    // empty.  Consumer thread only.
+    PtrType pop() {
+        if (fifo_ == nullptr)
+            refill();
+        if (fifo_ == nullptr)
+            return PtrType(nullptr);
+
+        RawPtrType obj = fifo_;
+        auto& ns = NodeTraits::node_state(*obj);
+        fifo_ = ns.next_;
+        ns.next_ = nullptr;
+        return PtrOps::Reclaim(obj);
+    }
+
+    // is_empty
+    //
+    // Consumer thread only.  A concurrent push() may of course make the
+    // answer stale by the time it is returned.
+    bool is_empty() const {
+        return (fifo_ == nullptr) && (__atomic_load_n(&stack_, __ATOMIC_RELAXED) == nullptr);
+    }
+
+    // clear
+    //
+    // Pops everything, releasing the references held on managed pointers.
+    // Consumer thread only.
+    void clear() {
+        while (pop() != nullptr)
+            ;
+    }
+
+private:
+    // Take everything the producers have pushed and reverse it onto the end
+    // of the (empty) consumer list.
+    void refill() {
+        RawPtrType stack = __atomic_exchange_n(&stack_, nullptr, __ATOMIC_ACQUIRE);
+        RawPtrType fifo = nullptr;
+        while (stack != nullptr) {
+            auto& ns = NodeTraits::node_state(*stack);
+            RawPtrType next = ns.next_;
+            ns.next_ = fifo;
+            fifo = stack;
+            stack = next;
+        }
+        fifo_ = fifo;
+    }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(MpscQueue);
+
+    // Pushed by producers, newest first.
+    RawPtrType stack_ = nullptr;
+
+    // Owned by the consumer, oldest first.
+    RawPtrType fifo_ = nullptr;
+};
+
+}  // namespace mxtl
@@ -0,0 +1,104 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+
+// Usage Notes:
+//
+// mxtl::SpscRing<T, N> is a bounded, lock-free, single-producer/single-consumer
+// ring of N elements of type T, stored inline.  N must be a power of two.
+//
+// One thread at a time may push(); one (other) thread at a time may pop().
+// Neither ever blocks: push() fails when the ring is full and pop() fails when
+// it is empty, and it is up to the caller to decide whether to retry, drop or
+// wait on some other primitive.
+//
+// The producer owns tail_ and the consumer owns head_; each only reads the
+// other's index, with acquire/release ordering so that an element's contents
+// are visible before the index which publishes it.  The indices run freely and
+// are reduced modulo N only to address the storage, so all N slots are usable.
+//
+// Example:
+//
+// mxtl::SpscRing<uint32_t, 64> ring;
+//
+// // producer                     // consumer
+// if (!ring.push(value))          uint32_t value;
+//     ++dropped;                  while (ring.pop(&value))
+//                                     Process(value);
+
+namespace mxtl {
+
+template <typename T, size_t N>
+class SpscRing {
+public:
+    static_assert((N > 0) && ((N & (N - 1)) == 0), "SpscRing size must be a power of two");
+    static_assert(N <= (static_cast<size_t>(1) << 31), "SpscRing size is too large");
+
+    SpscRing() { }
+
+    static constexpr size_t capacity() { return N; }
+
+    // push
+    //
+    // Producer thread only.  Returns false if the ring is full.
+    bool push(const T& val) {
+        uint32_t tail = tail_;
+        if (tail - __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == N)
+            return false;
+        storage_[tail & kMask] = val;
+        __atomic_store_n(&tail_, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool push(T&& val) {
+        uint32_t tail = tail_;
+        if (tail - __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == N)
+            return false;
+        storage_[tail & kMask] = mxtl::move(val);
+        __atomic_store_n(&tail_, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // pop
+    //
+    // Consumer thread only.  Moves the oldest element into |out| and returns
+    // true, or returns false if the ring is empty.
+    bool pop(T* out) {
+        uint32_t head = head_;
+        if (__atomic_load_n(&tail_, __ATOMIC_ACQUIRE) == head)
+            return false;
+        *out = mxtl::move(storage_[head & kMask]);
+        __atomic_store_n(&head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Either side may ask, though the answer may be stale by the time it is
+    // returned.
+    bool is_empty() const { return size() == 0; }
+    bool is_full() const { return size() == N; }
+    size_t size() const {
+        // Read head first so that the difference can't go negative; it can
+        // only overshoot, if both sides move between the two loads.
+        uint32_t head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+        uint32_t count = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE) - head;
+        return (count > N) ? N : count;
+    }
+
+private:
+    static constexpr uint32_t kMask = static_cast<uint32_t>(N - 1);
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(SpscRing);
+
+    uint32_t head_ = 0;     // next slot to pop, written by the consumer
+    uint32_t tail_ = 0;     // next slot to push, written by the producer
+    T storage_[N];
+};
+
+}  // namespace mxtl
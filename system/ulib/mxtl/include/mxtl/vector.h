@@ -0,0 +1,185 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <magenta/assert.h>
+#include <mxtl/macros.h>
+#include <mxtl/type_support.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// A growable array whose first |inline_count| elements live inside the Vector
+// itself (e.g., on the stack), moving to the heap only once it outgrows them.
+// Growth never panics: every operation which might allocate takes an
+// AllocChecker, which is always armed and must be checked, and on failure the
+// vector is left exactly as it was.  This is typically used like:
+//
+//   mxtl::Vector<mx_handle_t, 8u> handles;
+//   for (...) {
+//       AllocChecker ac;
+//       handles.push_back(h, &ac);
+//       if (!ac.check())
+//           return ERR_NO_MEMORY;
+//   }
+//
+// Elements are moved, not copied, when the storage grows.
+template <typename T, size_t inline_count = 0u>
+class Vector {
+public:
+    Vector() : ptr_(inline_ptr()), size_(0u), capacity_(inline_count) { }
+
+    Vector(Vector&& other) : ptr_(inline_ptr()), size_(0u), capacity_(inline_count) {
+        take(other);
+    }
+
+    Vector& operator=(Vector&& other) {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~Vector() {
+        reset();
+    }
+
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(Vector);
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool is_empty() const { return size_ == 0u; }
+
+    T* get() const { return ptr_; }
+    T* begin() const { return ptr_; }
+    T* end() const { return ptr_ + size_; }
+
+    T& operator[](size_t i) const {
+        DEBUG_ASSERT(i < size_);
+        return ptr_[i];
+    }
+
+    // Makes room for at least |capacity| elements without further allocation.
+    void reserve(size_t capacity, AllocChecker* ac) {
+        if (capacity <= capacity_) {
+            ac->arm(0u, true);
+            return;
+        }
+        grow(capacity, ac);
+    }
+
+    void push_back(const T& value, AllocChecker* ac) {
+        if (!make_room(ac))
+            return;
+        new (&ptr_[size_]) T(value);
+        size_++;
+    }
+
+    void push_back(T&& value, AllocChecker* ac) {
+        if (!make_room(ac))
+            return;
+        new (&ptr_[size_]) T(mxtl::move(value));
+        size_++;
+    }
+
+    void pop_back() {
+        DEBUG_ASSERT(size_ > 0u);
+        size_--;
+        ptr_[size_].~T();
+    }
+
+    // Removes the element at |index|, shifting the ones after it down.
+    void erase(size_t index) {
+        DEBUG_ASSERT(index < size_);
+        for (size_t i = index + 1; i < size_; i++)
+            ptr_[i - 1] = mxtl::move(ptr_[i]);
+        pop_back();
+    }
+
+    // Destroys the elements, keeping the storage.
+    void clear() {
+        while (size_ > 0u)
+            pop_back();
+    }
+
+    // Destroys the elements and releases any heap storage.
+    void reset() {
+        clear();
+        if (!is_inline()) {
+            operator delete(ptr_);
+            ptr_ = inline_ptr();
+            capacity_ = inline_count;
+        }
+    }
+
+private:
+    bool is_inline() const { return ptr_ == inline_ptr(); }
+
+    T* inline_ptr() const {
+        return inline_count ? reinterpret_cast<T*>(const_cast<char*>(inline_storage_)) : nullptr;
+    }
+
+    bool make_room(AllocChecker* ac) {
+        if (size_ < capacity_) {
+            ac->arm(0u, true);
+            return true;
+        }
+        size_t capacity = capacity_ ? capacity_ * 2 : 4u;
+        return grow(capacity, ac);
+    }
+
+    bool grow(size_t capacity, AllocChecker* ac) {
+        if (capacity > SIZE_MAX / sizeof(T)) {
+            ac->arm(1u, false);
+            return false;
+        }
+        T* ptr = static_cast<T*>(operator new(capacity * sizeof(T), ac));
+        if (ptr == nullptr)
+            return false;
+        for (size_t i = 0; i < size_; i++) {
+            new (&ptr[i]) T(mxtl::move(ptr_[i]));
+            ptr_[i].~T();
+        }
+        if (!is_inline())
+            operator delete(ptr_);
+        ptr_ = ptr;
+        capacity_ = capacity;
+        return true;
+    }
+
+    // Leaves |other| empty, stealing its heap storage or moving its inline
+    // elements.  We must be empty and inline.
+    void take(Vector& other) {
+        if (other.is_inline()) {
+            for (size_t i = 0; i < other.size_; i++)
+                new (&ptr_[i]) T(mxtl::move(other.ptr_[i]));
+            size_ = other.size_;
+            other.clear();
+        } else {
+            ptr_ = other.ptr_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.ptr_ = other.inline_ptr();
+            other.size_ = 0u;
+            other.capacity_ = inline_count;
+        }
+    }
+
+    T* ptr_;
+    size_t size_;
+    size_t capacity_;
+    alignas(T) char inline_storage_[inline_count ? inline_count * sizeof(T) : 1u];
+};
+
+} // namespace mxtl
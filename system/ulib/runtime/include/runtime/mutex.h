@@ -13,6 +13,8 @@ __BEGIN_CDECLS
 
 typedef struct {
     atomic_int futex;
+    // A hint for how long to spin before sleeping in the kernel.
+    atomic_int spins;
 } mxr_mutex_t;
 
 #define MXR_MUTEX_INIT ((mxr_mutex_t){})
@@ -34,6 +36,11 @@ void mxr_mutex_lock(mxr_mutex_t* mutex);
 // Unlocks the lock.
 void mxr_mutex_unlock(mxr_mutex_t* mutex);
 
+// Makes the next unlock wake a waiter. Must be called with the lock
+// held, by code that moved waiters onto the lock's futex with
+// mx_futex_requeue() (e.g. condition variables).
+void mxr_mutex_set_contested(mxr_mutex_t* mutex);
+
 #pragma GCC visibility pop
 
 __END_CDECLS
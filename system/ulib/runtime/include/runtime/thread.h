@@ -21,7 +21,8 @@ typedef struct mxr_thread mxr_thread_t;
 
 // Create a thread. If successful, a pointer to the thread structure
 // is returned via thread_out, and NO_ERROR is returned. Otherwise a
-// failure status is returned.
+// failure status is returned. The kernel thread, and so its handle,
+// is only made once the thread is started.
 mx_status_t mxr_thread_create(const char* name, mxr_thread_t** thread_out);
 
 // Start the thread with the given stack, entrypoint, and
@@ -6,17 +6,32 @@
 
 #include <magenta/syscalls.h>
 #include <stdatomic.h>
-
-// TODO(kulakowski) Reintroduce (correctly) optimization counting waiters.
+#include <stdbool.h>
 
 // These values have to be as such. UNLOCKED == 0 allows locks to be
-// statically allocated, and the ordering of the values is relied upon
-// in the atomic decrement in the unlock routine.
+// statically allocated. CONTESTED means there may be threads waiting in
+// the kernel, so unlocking has to wake one of them.
 enum {
     UNLOCKED = 0,
     LOCKED = 1,
+    CONTESTED = 2,
 };
 
+// Before going to the kernel, a contended lock spins for a while in case
+// the holder is about to let go. How long is tuned per mutex from how long
+// it took the last few times, up to this many iterations.
+#define MAX_SPINS 100
+
+static inline void spin_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
 mx_status_t mxr_mutex_trylock(mxr_mutex_t* mutex) {
     int futex_value = UNLOCKED;
     if (!atomic_compare_exchange_strong(&mutex->futex, &futex_value, LOCKED))
@@ -24,23 +39,47 @@ mx_status_t mxr_mutex_trylock(mxr_mutex_t* mutex) {
     return NO_ERROR;
 }
 
-mx_status_t mxr_mutex_timedlock(mxr_mutex_t* mutex, mx_time_t timeout) {
-    for (;;) {
-        switch (atomic_exchange(&mutex->futex, LOCKED)) {
-        case UNLOCKED:
-            return NO_ERROR;
-        case LOCKED: {
-            mx_status_t status = _mx_futex_wait(&mutex->futex, LOCKED, timeout);
-            if (status == ERR_BAD_STATE) {
-                continue;
-            }
-            if (status != NO_ERROR) {
-                return status;
-            }
-            continue;
-        }
+// Spins until the mutex can be taken with the LOCKED state or the spin
+// budget runs out, and updates the budget from the outcome.
+static bool spin_lock(mxr_mutex_t* mutex) {
+    int spins = atomic_load_explicit(&mutex->spins, memory_order_relaxed);
+    int max = spins * 2 + 10;
+    if (max > MAX_SPINS)
+        max = MAX_SPINS;
+
+    bool locked = false;
+    int count = 0;
+    while (count < max) {
+        ++count;
+        spin_pause();
+        int futex_value = atomic_load_explicit(&mutex->futex, memory_order_relaxed);
+        if (futex_value == CONTESTED)
+            break;  // Others are already sleeping; don't jump the queue.
+        if (futex_value == UNLOCKED &&
+            atomic_compare_exchange_weak(&mutex->futex, &futex_value, LOCKED)) {
+            locked = true;
+            break;
         }
     }
+
+    atomic_store_explicit(&mutex->spins, spins + (count - spins) / 8, memory_order_relaxed);
+    return locked;
+}
+
+mx_status_t mxr_mutex_timedlock(mxr_mutex_t* mutex, mx_time_t timeout) {
+    if (mxr_mutex_trylock(mutex) == NO_ERROR)
+        return NO_ERROR;
+    if (spin_lock(mutex))
+        return NO_ERROR;
+
+    // We can't tell whether anyone else is waiting, so take the lock as
+    // CONTESTED; at worst the unlock makes one unneeded wake call.
+    while (atomic_exchange(&mutex->futex, CONTESTED) != UNLOCKED) {
+        mx_status_t status = _mx_futex_wait(&mutex->futex, CONTESTED, timeout);
+        if (status != NO_ERROR && status != ERR_BAD_STATE)
+            return status;
+    }
+    return NO_ERROR;
 }
 
 void mxr_mutex_lock(mxr_mutex_t* mutex) {
@@ -50,8 +89,13 @@ void mxr_mutex_lock(mxr_mutex_t* mutex) {
 }
 
 void mxr_mutex_unlock(mxr_mutex_t* mutex) {
-    atomic_store(&mutex->futex, UNLOCKED);
-    mx_status_t status = _mx_futex_wake(&mutex->futex, 0x7FFFFFFF);
+    if (atomic_exchange(&mutex->futex, UNLOCKED) != CONTESTED)
+        return;
+    mx_status_t status = _mx_futex_wake(&mutex->futex, 1);
     if (status != NO_ERROR)
         __builtin_trap();
 }
+
+void mxr_mutex_set_contested(mxr_mutex_t* mutex) {
+    atomic_store(&mutex->futex, CONTESTED);
+}
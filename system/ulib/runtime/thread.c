@@ -40,6 +40,11 @@ struct mxr_thread {
 
     mxr_mutex_t state_lock;
     int state;
+
+    // The kernel thread is only made when the thread starts, with one
+    // mx_thread_create_start() call.
+    uint32_t name_length;
+    char name[MX_MAX_NAME_LEN];
 };
 
 static mx_status_t allocate_thread_page(mxr_thread_t** thread_out) {
@@ -78,7 +83,7 @@ static mx_status_t deallocate_thread_page(mxr_thread_t* thread) {
 static mx_status_t thread_cleanup(mxr_thread_t* thread) {
     CHECK_THREAD(thread);
     mx_status_t status = _mx_handle_close(thread->handle);
-    thread->handle = 0;
+    thread->handle = MX_HANDLE_INVALID;
     if (status != NO_ERROR)
         return status;
     return deallocate_thread_page(thread);
@@ -124,22 +129,21 @@ static size_t local_strlen(const char* s) {
 }
 
 mx_status_t mxr_thread_create(const char* name, mxr_thread_t** thread_out) {
-    mxr_thread_t* thread = NULL;
-    mx_status_t status = allocate_thread_page(&thread);
-    if (status < 0)
-        return status;
-
     if (name == NULL)
         name = "";
     size_t name_length = local_strlen(name) + 1;
-    mx_handle_t handle;
-    status = _mx_thread_create(mx_process_self(), name, name_length, 0, &handle);
-    if (status < 0) {
-        deallocate_thread_page(thread);
+    if (name_length > MX_MAX_NAME_LEN)
+        return ERR_INVALID_ARGS;
+
+    mxr_thread_t* thread = NULL;
+    mx_status_t status = allocate_thread_page(&thread);
+    if (status < 0)
         return status;
-    }
 
-    thread->handle = handle;
+    thread->handle = MX_HANDLE_INVALID;
+    for (size_t i = 0; i < name_length; ++i)
+        thread->name[i] = name[i];
+    thread->name_length = (uint32_t)name_length;
 
     *thread_out = thread;
     return NO_ERROR;
@@ -154,14 +158,14 @@ mx_status_t mxr_thread_start(mxr_thread_t* thread, uintptr_t stack_addr, size_t
     // compute the starting address of the stack
     uintptr_t sp = compute_initial_stack_pointer(stack_addr, stack_size);
 
-    // kick off the new thread
-    mx_status_t status = _mx_thread_start(thread->handle,
-                                          (uintptr_t)thread_trampoline, sp,
-                                          (uintptr_t)thread, 0);
+    // kick off the new thread; the kernel fills in its handle before it
+    // can run
+    mx_status_t status = _mx_thread_create_start(mx_process_self(),
+                                                 thread->name, thread->name_length,
+                                                 (uintptr_t)thread_trampoline, sp,
+                                                 (uintptr_t)thread, 0, &thread->handle);
     if (status < 0) {
-        mx_handle_t handle = thread->handle;
         deallocate_thread_page(thread);
-        _mx_handle_close(handle);
         return status;
     }
 
@@ -218,7 +222,8 @@ mx_status_t mxr_thread_detach(mxr_thread_t* thread) {
 
 void mxr_thread_destroy(mxr_thread_t* thread) {
     CHECK_THREAD(thread);
-    _mx_handle_close(thread->handle);
+    if (thread->handle != MX_HANDLE_INVALID)
+        _mx_handle_close(thread->handle);
     deallocate_thread_page(thread);
 }
 
@@ -0,0 +1,33 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <magenta/compiler.h>
+#include <magenta/types.h>
+
+__BEGIN_CDECLS;
+
+// Each thread that wants to trace gets a buffer of its own, which the kernel
+// merges into the ktrace stream, so recording a probe is a handful of stores
+// rather than a call to mx_ktrace_write(). Probe ids come from
+// IOCTL_KTRACE_ADD_PROBE, just as for mx_ktrace_write().
+
+// Gives the calling thread a trace buffer holding at least |size| bytes of
+// records and registers it using |ktrace|, the handle from
+// IOCTL_KTRACE_GET_HANDLE, which must stay open until the buffer is
+// released. Once it is full, the oldest records give way.
+mx_status_t utrace_thread_init(mx_handle_t ktrace, size_t size);
+
+// Unregisters and frees the calling thread's trace buffer, taking its
+// records out of the trace.
+void utrace_thread_release(void);
+
+// Record a probe in the calling thread's trace buffer, if it has one.
+void utrace_probe0(uint32_t id);
+void utrace_probe2(uint32_t id, uint32_t arg0, uint32_t arg1);
+
+__END_CDECLS;
@@ -0,0 +1,139 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <utrace/utrace.h>
+
+#include <limits.h>
+#include <threads.h>
+
+#include <magenta/ktrace.h>
+#include <magenta/syscalls.h>
+
+// The layout is described by ktrace_user_header_t. Only the thread owning
+// the buffer writes to it, so nothing here needs a lock; the kernel reads
+// head and tail to find the records.
+typedef struct utrace_buffer {
+    ktrace_user_header_t* header;
+    uint8_t* buf;
+    uint32_t size;
+    mx_handle_t ktrace;
+    mx_handle_t vmo;
+} utrace_buffer_t;
+
+static thread_local utrace_buffer_t utrace;
+
+mx_status_t utrace_thread_init(mx_handle_t ktrace, size_t size) {
+    utrace_buffer_t* ub = &utrace;
+    if (ub->header != NULL)
+        return ERR_BAD_STATE;
+
+    // the records fill out the pages after the header
+    if (size > UINT32_MAX - PAGE_SIZE)
+        return ERR_INVALID_ARGS;
+    size_t vmo_size = (KTRACE_USER_HDRSIZE + size + PAGE_SIZE - 1) & -PAGE_SIZE;
+
+    mx_handle_t vmo;
+    mx_status_t status = mx_vmo_create(vmo_size, 0, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    uintptr_t addr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, vmo_size, &addr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    if (status != NO_ERROR) {
+        mx_handle_close(vmo);
+        return status;
+    }
+
+    ktrace_user_header_t* header = (ktrace_user_header_t*)addr;
+    header->magic = KTRACE_USER_MAGIC;
+    header->size = (uint32_t)(vmo_size - KTRACE_USER_HDRSIZE);
+
+    // records are written from wherever the thread happens to be, so it
+    // shouldn't fault on them
+    if ((status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, vmo_size, NULL, 0)) != NO_ERROR ||
+        (status = mx_ktrace_control(ktrace, KTRACE_ACTION_ADD_USER_BUFFER, 0, &vmo)) != NO_ERROR) {
+        mx_process_unmap_vm(mx_process_self(), addr, 0);
+        mx_handle_close(vmo);
+        return status;
+    }
+
+    ub->header = header;
+    ub->buf = (uint8_t*)addr + KTRACE_USER_HDRSIZE;
+    ub->size = header->size;
+    ub->ktrace = ktrace;
+    ub->vmo = vmo;
+    return NO_ERROR;
+}
+
+void utrace_thread_release(void) {
+    utrace_buffer_t* ub = &utrace;
+    if (ub->header == NULL)
+        return;
+
+    mx_ktrace_control(ub->ktrace, KTRACE_ACTION_REMOVE_USER_BUFFER, 0, &ub->vmo);
+    mx_process_unmap_vm(mx_process_self(), (uintptr_t)ub->header, 0);
+    mx_handle_close(ub->vmo);
+    ub->header = NULL;
+}
+
+// Makes room for a record with |tag|, dropping the oldest records if need
+// be, and fills in its header. The record belongs to the trace once head is
+// moved to |*next_head|.
+static ktrace_header_t* utrace_reserve(utrace_buffer_t* ub, uint32_t tag, uint64_t* next_head) {
+    ktrace_user_header_t* header = ub->header;
+    uint64_t head = header->head;
+    uint32_t len = KTRACE_LEN(tag);
+    uint32_t off = (uint32_t)(head % ub->size);
+    uint32_t room = ub->size - off;
+
+    // including the skipped end of the buffer if it has to go at the start
+    uint64_t end = head + len + ((room < len) ? room : 0);
+    uint64_t tail = header->tail;
+    if (end - tail > ub->size) {
+        do {
+            uint32_t tail_off = (uint32_t)(tail % ub->size);
+            uint32_t tail_tag = *(uint32_t*)(ub->buf + tail_off);
+            tail += tail_tag ? KTRACE_LEN(tail_tag) : ub->size - tail_off;
+        } while (end - tail > ub->size);
+
+        // the kernel must see the new tail before the records change
+        __atomic_store_n(&header->tail, tail, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+    if (room < len) {
+        *(uint32_t*)(ub->buf + off) = 0;
+        head += room;
+        off = 0;
+    }
+
+    ktrace_header_t* hdr = (ktrace_header_t*)(ub->buf + off);
+    hdr->tag = tag;
+    hdr->tid = 0;
+    hdr->ts = mx_ticks_get();
+    *next_head = head + len;
+    return hdr;
+}
+
+void utrace_probe0(uint32_t id) {
+    utrace_buffer_t* ub = &utrace;
+    if (ub->header == NULL)
+        return;
+
+    uint64_t head;
+    utrace_reserve(ub, TAG_PROBE_16(id), &head);
+    __atomic_store_n(&ub->header->head, head, __ATOMIC_RELEASE);
+}
+
+void utrace_probe2(uint32_t id, uint32_t arg0, uint32_t arg1) {
+    utrace_buffer_t* ub = &utrace;
+    if (ub->header == NULL)
+        return;
+
+    uint64_t head;
+    uint32_t* args = (uint32_t*)(utrace_reserve(ub, TAG_PROBE_24(id), &head) + 1);
+    args[0] = arg0;
+    args[1] = arg1;
+    __atomic_store_n(&ub->header->head, head, __ATOMIC_RELEASE);
+}
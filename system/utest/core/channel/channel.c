@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -437,6 +438,232 @@ static bool channel_may_discard(void) {
     END_TEST;
 }
 
+static bool channel_message_sizes(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    static uint8_t wr_data[65536];
+    static uint8_t rd_data[65536];
+    for (size_t i = 0; i < sizeof(wr_data); i++)
+        wr_data[i] = (uint8_t)(i * 7);
+
+    // sizes on either side of the kernel's packet size classes
+    static const uint32_t sizes[] = { 0u, 1u, 64u, 100u, 200u, 400u, 480u, 1000u, 4096u, 65536u };
+    for (size_t i = 0; i < countof(sizes); i++) {
+        mx_handle_t event;
+        ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+        ASSERT_EQ(mx_channel_write(channel[0], 0u, wr_data, sizes[i], &event, 1u), NO_ERROR, "");
+
+        uint32_t size = sizeof(rd_data);
+        mx_handle_t handle = MX_HANDLE_INVALID;
+        uint32_t num_handles = 1u;
+        ASSERT_EQ(mx_channel_read(channel[1], 0u, rd_data, size, &size,
+                                  &handle, num_handles, &num_handles), NO_ERROR, "");
+        EXPECT_EQ(size, sizes[i], "wrong size");
+        EXPECT_EQ(num_handles, 1u, "wrong number of handles");
+        EXPECT_EQ(memcmp(wr_data, rd_data, size), 0, "data mismatch");
+        EXPECT_EQ(mx_handle_close(handle), NO_ERROR, "bad handle");
+    }
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_kernel_memory_info(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_info_process_kernel_memory_t before;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_KERNEL_MEMORY,
+                                 &before, sizeof(before), NULL, NULL), NO_ERROR, "");
+    EXPECT_GT(before.handle_count, 0u, "");
+    EXPECT_GT(before.thread_count, 0u, "");
+    EXPECT_GT(before.page_table_bytes, 0u, "");
+
+    // the messages count against the process, which holds the reading end
+    static uint8_t data[1000];
+    ASSERT_EQ(mx_channel_write(channel[0], 0u, data, sizeof(data), NULL, 0u), NO_ERROR, "");
+    ASSERT_EQ(mx_channel_write(channel[0], 0u, data, sizeof(data), NULL, 0u), NO_ERROR, "");
+
+    mx_info_process_kernel_memory_t after;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_KERNEL_MEMORY,
+                                 &after, sizeof(after), NULL, NULL), NO_ERROR, "");
+    EXPECT_EQ(after.handle_count, before.handle_count, "");
+    EXPECT_EQ(after.channel_msg_count, before.channel_msg_count + 2u, "");
+    EXPECT_GE(after.channel_msg_bytes, before.channel_msg_bytes + 2u * sizeof(data), "");
+
+    for (int i = 0; i < 2; i++) {
+        uint32_t size = sizeof(data);
+        ASSERT_EQ(mx_channel_read(channel[1], 0u, data, size, &size, NULL, 0u, NULL),
+                  NO_ERROR, "");
+    }
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_KERNEL_MEMORY,
+                                 &after, sizeof(after), NULL, NULL), NO_ERROR, "");
+    EXPECT_EQ(after.channel_msg_count, before.channel_msg_count, "");
+    EXPECT_EQ(after.channel_msg_bytes, before.channel_msg_bytes, "");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool channel_batched_read_write(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    uint32_t values[4] = { 1u, 2u, 3u, 4u };
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    // the third message carries a handle
+    mx_channel_msg_t wr[4];
+    for (int i = 0; i < 4; i++) {
+        wr[i] = (mx_channel_msg_t){ &values[i], NULL, sizeof(uint32_t), 0u };
+    }
+    wr[2].handles = &event;
+    wr[2].num_handles = 1u;
+
+    // a bad handle anywhere fails the whole batch
+    mx_handle_t bad;
+    ASSERT_EQ(mx_event_create(0u, &bad), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(bad), NO_ERROR, "");
+    wr[1].handles = &bad;
+    wr[1].num_handles = 1u;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, wr, 4u), ERR_BAD_HANDLE, "");
+    EXPECT_EQ(mx_handle_wait_one(channel[1], MX_SIGNAL_READABLE, 0u, NULL), ERR_TIMED_OUT,
+              "failed batch was partly written");
+    wr[1].handles = NULL;
+    wr[1].num_handles = 0u;
+
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 4u), NO_ERROR, "");
+
+    // room for three messages, but the second slot is too small
+    uint32_t rd_values[3];
+    mx_handle_t rd_handle = MX_HANDLE_INVALID;
+    mx_channel_msg_t rd[3] = {
+        { &rd_values[0], NULL, sizeof(uint32_t), 0u },
+        { &rd_values[1], NULL, sizeof(uint32_t) - 1, 0u },
+        { &rd_values[2], &rd_handle, sizeof(uint32_t), 1u },
+    };
+    uint32_t actual = 0u;
+    ASSERT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "read past a message that didn't fit");
+    EXPECT_EQ(rd_values[0], 1u, "");
+
+    // now the rest, in order
+    rd[0] = (mx_channel_msg_t){ &rd_values[0], NULL, sizeof(uint32_t), 0u };
+    rd[1] = (mx_channel_msg_t){ &rd_values[1], &rd_handle, sizeof(uint32_t), 1u };
+    rd[2] = (mx_channel_msg_t){ &rd_values[2], NULL, sizeof(uint32_t), 1u };
+    ASSERT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 3u, "");
+    EXPECT_EQ(rd_values[0], 2u, "");
+    EXPECT_EQ(rd_values[1], 3u, "");
+    EXPECT_EQ(rd_values[2], 4u, "");
+    EXPECT_EQ(rd[1].num_handles, 1u, "");
+    EXPECT_EQ(rd[2].num_handles, 0u, "");
+    EXPECT_EQ(mx_handle_close(rd_handle), NO_ERROR, "handle did not come through");
+
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ERR_SHOULD_WAIT, "");
+
+    // the first message not fitting reports its size
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 1u), NO_ERROR, "");
+    rd[0].num_bytes = 0u;
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(rd[0].num_bytes, sizeof(uint32_t), "");
+    EXPECT_EQ(actual, 0u, "");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// Replies to one request on |arg| with the request's bytes plus one.
+static int call_server_thread(void* arg) {
+    mx_handle_t channel = *(mx_handle_t*)arg;
+    uint32_t request;
+    uint32_t size = sizeof(request);
+
+    if (mx_handle_wait_one(channel, MX_SIGNAL_READABLE, MX_TIME_INFINITE, NULL) != NO_ERROR)
+        return -1;
+    if (mx_channel_read(channel, 0u, &request, size, &size, NULL, 0, NULL) != NO_ERROR)
+        return -1;
+    request++;
+    if (mx_channel_write(channel, 0u, &request, sizeof(request), NULL, 0) != NO_ERROR)
+        return -1;
+    return 0;
+}
+
+static bool channel_call(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_create(&thread, call_server_thread, &channel[1]), thrd_success, "");
+
+    uint32_t request = 41u;
+    uint32_t reply = 0u;
+    mx_channel_call_args_t args = {
+        .wr_bytes = &request,
+        .wr_num_bytes = sizeof(request),
+        .rd_bytes = &reply,
+        .rd_num_bytes = sizeof(reply),
+    };
+    uint32_t actual_bytes = 0u;
+    uint32_t actual_handles = 1u;
+    mx_status_t read_status = NO_ERROR;
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args,
+                              &actual_bytes, &actual_handles, &read_status),
+              NO_ERROR, "call failed");
+    EXPECT_EQ(reply, 42u, "wrong reply");
+    EXPECT_EQ(actual_bytes, sizeof(reply), "wrong reply size");
+    EXPECT_EQ(actual_handles, 0u, "wrong reply handle count");
+
+    int server_result = -1;
+    EXPECT_EQ(thrd_join(thread, &server_result), thrd_success, "");
+    EXPECT_EQ(server_result, 0, "server failed");
+
+    // nobody is answering, so the request goes out but the wait times out
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, 1000u * 1000u, &args,
+                              &actual_bytes, &actual_handles, &read_status),
+              ERR_CALL_FAILED, "");
+    EXPECT_EQ(read_status, ERR_TIMED_OUT, "");
+    uint32_t size = sizeof(request);
+    EXPECT_EQ(mx_channel_read(channel[1], 0u, &request, size, &size, NULL, 0, NULL),
+              NO_ERROR, "request was not sent");
+
+    // a reply too large for the buffer stays queued
+    uint64_t big_reply = 0u;
+    EXPECT_EQ(mx_channel_write(channel[1], 0u, &big_reply, sizeof(big_reply), NULL, 0),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args,
+                              &actual_bytes, &actual_handles, &read_status),
+              ERR_CALL_FAILED, "");
+    EXPECT_EQ(read_status, ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(actual_bytes, sizeof(big_reply), "");
+
+    // once the peer is gone the write itself fails
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+    EXPECT_EQ(mx_channel_call(channel[0], 0u, MX_TIME_INFINITE, &args,
+                              &actual_bytes, &actual_handles, &read_status),
+              ERR_BAD_STATE, "");
+
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -445,6 +672,10 @@ RUN_TEST(channel_non_transferable)
 RUN_TEST(channel_duplicate_handles)
 RUN_TEST(channel_multithread_read)
 RUN_TEST(channel_may_discard)
+RUN_TEST(channel_message_sizes)
+RUN_TEST(channel_kernel_memory_info)
+RUN_TEST(channel_batched_read_write)
+RUN_TEST(channel_call)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
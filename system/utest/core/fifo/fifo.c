@@ -0,0 +1,157 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static mx_signals_t get_satisfied_signals(mx_handle_t handle) {
+    mx_signals_t pending = 0;
+    mx_handle_wait_one(handle, 0u, 0u, &pending);
+    return pending;
+}
+
+static bool fifo_create_args(void) {
+    BEGIN_TEST;
+
+    mx_handle_t producer, consumer, vmo;
+    mx_status_t status;
+
+    status = mx_fifo_create(0u, 8u, 0u, &producer, &consumer, &vmo);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "no elements");
+    status = mx_fifo_create(3u, 8u, 0u, &producer, &consumer, &vmo);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "count not a power of two");
+    status = mx_fifo_create(4u, 0u, 0u, &producer, &consumer, &vmo);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "empty elements");
+    status = mx_fifo_create(4u, 8u, 1u, &producer, &consumer, &vmo);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "bad options");
+    status = mx_fifo_create(1u << 20, 1024u, 0u, &producer, &consumer, &vmo);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "too big");
+
+    status = mx_fifo_create(4u, 16u, 0u, &producer, &consumer, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    uint64_t vmo_size = 0u;
+    status = mx_vmo_get_size(vmo, &vmo_size);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_GE(vmo_size, 4u * 16u, "vmo holds the ring");
+
+    mx_handle_close(producer);
+    mx_handle_close(consumer);
+    mx_handle_close(vmo);
+
+    END_TEST;
+}
+
+static bool fifo_ring(void) {
+    BEGIN_TEST;
+
+    const uint32_t kCount = 4u;
+    mx_handle_t producer, consumer, vmo;
+    mx_status_t status = mx_fifo_create(kCount, sizeof(uint64_t), 0u, &producer, &consumer, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    uintptr_t addr = 0u;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, kCount * sizeof(uint64_t), &addr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    ASSERT_EQ(status, NO_ERROR, "");
+    volatile uint64_t* ring = (volatile uint64_t*)addr;
+
+    EXPECT_EQ(get_satisfied_signals(producer) & MX_FIFO_WRITABLE, MX_FIFO_WRITABLE, "");
+    EXPECT_EQ(get_satisfied_signals(consumer) & MX_FIFO_READABLE, 0u, "");
+
+    mx_fifo_state_t state;
+    status = mx_fifo_op(consumer, MX_FIFO_OP_ADVANCE_HEAD, 1u, &state);
+    EXPECT_EQ(status, ERR_NOT_SUPPORTED, "only the producer moves the head");
+    status = mx_fifo_op(producer, MX_FIFO_OP_ADVANCE_TAIL, 1u, &state);
+    EXPECT_EQ(status, ERR_NOT_SUPPORTED, "only the consumer moves the tail");
+    status = mx_fifo_op(consumer, MX_FIFO_OP_ADVANCE_TAIL, 1u, &state);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "nothing to consume");
+
+    // Run a few laps around the ring, filling it each time.
+    uint64_t next = 0u, expected = 0u;
+    for (int lap = 0; lap != 3; ++lap) {
+        status = mx_fifo_op(producer, MX_FIFO_OP_READ_STATE, 0u, &state);
+        EXPECT_EQ(status, NO_ERROR, "");
+        for (uint64_t ix = state.head; ix != state.tail + kCount; ++ix)
+            ring[ix % kCount] = next++;
+        status = mx_fifo_op(producer, MX_FIFO_OP_ADVANCE_HEAD, kCount, &state);
+        EXPECT_EQ(status, NO_ERROR, "");
+        EXPECT_EQ(state.head - state.tail, (uint64_t)kCount, "");
+
+        EXPECT_EQ(get_satisfied_signals(producer) & MX_FIFO_WRITABLE, 0u, "full");
+        EXPECT_EQ(get_satisfied_signals(consumer) & MX_FIFO_READABLE, MX_FIFO_READABLE, "");
+        status = mx_fifo_op(producer, MX_FIFO_OP_ADVANCE_HEAD, 1u, &state);
+        EXPECT_EQ(status, ERR_OUT_OF_RANGE, "no room");
+
+        status = mx_fifo_op(consumer, MX_FIFO_OP_READ_STATE, 0u, &state);
+        EXPECT_EQ(status, NO_ERROR, "");
+        for (uint64_t ix = state.tail; ix != state.head; ++ix) {
+            EXPECT_EQ(ring[ix % kCount], expected, "");
+            expected++;
+            status = mx_fifo_op(consumer, MX_FIFO_OP_ADVANCE_TAIL, 1u, NULL);
+            EXPECT_EQ(status, NO_ERROR, "");
+            EXPECT_EQ(get_satisfied_signals(producer) & MX_FIFO_WRITABLE, MX_FIFO_WRITABLE, "");
+        }
+        EXPECT_EQ(get_satisfied_signals(consumer) & MX_FIFO_READABLE, 0u, "empty");
+    }
+    EXPECT_EQ(expected, next, "");
+
+    status = mx_process_unmap_vm(mx_process_self(), addr, 0);
+    EXPECT_EQ(status, NO_ERROR, "");
+    mx_handle_close(producer);
+    mx_handle_close(consumer);
+    mx_handle_close(vmo);
+
+    END_TEST;
+}
+
+static bool fifo_peer_closed(void) {
+    BEGIN_TEST;
+
+    mx_handle_t producer, consumer, vmo;
+    mx_status_t status = mx_fifo_create(2u, 4u, 0u, &producer, &consumer, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+    mx_handle_close(vmo);
+
+    mx_fifo_state_t state;
+    status = mx_fifo_op(producer, MX_FIFO_OP_ADVANCE_HEAD, 1u, &state);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_handle_close(producer);
+    EXPECT_EQ(get_satisfied_signals(consumer) & MX_FIFO_PEER_CLOSED, MX_FIFO_PEER_CLOSED, "");
+
+    // What was produced can still be consumed.
+    status = mx_fifo_op(consumer, MX_FIFO_OP_ADVANCE_TAIL, 1u, &state);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(state.head, 1u, "");
+    EXPECT_EQ(state.tail, 1u, "");
+
+    mx_handle_close(consumer);
+
+    status = mx_fifo_create(2u, 4u, 0u, &producer, &consumer, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+    mx_handle_close(vmo);
+    mx_handle_close(consumer);
+    EXPECT_EQ(get_satisfied_signals(producer) & MX_FIFO_PEER_CLOSED, MX_FIFO_PEER_CLOSED, "");
+    status = mx_fifo_op(producer, MX_FIFO_OP_ADVANCE_HEAD, 1u, &state);
+    EXPECT_EQ(status, ERR_REMOTE_CLOSED, "");
+    mx_handle_close(producer);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(fifo_tests)
+RUN_TEST(fifo_create_args)
+RUN_TEST(fifo_ring)
+RUN_TEST(fifo_peer_closed)
+END_TEST_CASE(fifo_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
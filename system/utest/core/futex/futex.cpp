@@ -193,6 +193,38 @@ bool test_futex_wakeup_limit() {
     END_TEST;
 }
 
+// Test that futex_wake_etc() with MX_FUTEX_WAKE_LIFO wakes the threads that
+// started waiting last.  It may prefer one which last ran on the waking cpu
+// over the last one, but only among the last few waiters.
+bool test_futex_wakeup_lifo() {
+    BEGIN_TEST;
+    volatile int futex_value = 1;
+    EXPECT_EQ(mx_futex_wake_etc(const_cast<int*>(&futex_value), 1, ~MX_FUTEX_WAKE_LIFO),
+              ERR_INVALID_ARGS, "bad options should be rejected");
+
+    TestThread thread1(&futex_value);
+    TestThread thread2(&futex_value);
+    TestThread thread3(&futex_value);
+    TestThread thread4(&futex_value);
+    TestThread thread5(&futex_value);
+    TestThread thread6(&futex_value);
+    futex_value++;
+    mx_status_t rc = mx_futex_wake_etc(const_cast<int*>(&futex_value), 2, MX_FUTEX_WAKE_LIFO);
+    EXPECT_EQ(rc, NO_ERROR, "error during futex wake");
+    thread1.assert_thread_not_woken();
+    thread2.assert_thread_not_woken();
+
+    // Clean up: Wake the remaining threads so that they can exit.
+    check_futex_wake(&futex_value, INT_MAX);
+    thread1.assert_thread_woken();
+    thread2.assert_thread_woken();
+    thread3.assert_thread_woken();
+    thread4.assert_thread_woken();
+    thread5.assert_thread_woken();
+    thread6.assert_thread_woken();
+    END_TEST;
+}
+
 // Check that futex_wait() and futex_wake() heed their address arguments
 // properly.  A futex_wait() call on one address should not be woken by a
 // futex_wake() call on another address.
@@ -331,6 +363,31 @@ bool test_futex_requeue() {
     END_TEST;
 }
 
+// Requeue between neighbouring futexes in an array, which the kernel keeps
+// in different hash buckets, and check that each wake only finds the
+// threads queued on its own address.
+bool test_futex_requeue_array() {
+    BEGIN_TEST;
+    volatile int futex_values[8] = {};
+    for (int i = 1; i < 8; i++) {
+        TestThread thread(&futex_values[0]);
+
+        mx_status_t rc = mx_futex_requeue(
+            const_cast<int*>(&futex_values[0]), 0, futex_values[0],
+            const_cast<int*>(&futex_values[i]), 1);
+        ASSERT_EQ(rc, NO_ERROR, "Error in requeue");
+        thread.assert_thread_not_woken();
+
+        rc = mx_futex_wake(const_cast<int*>(&futex_values[0]), INT_MAX);
+        ASSERT_EQ(rc, NO_ERROR, "Error in wake");
+        thread.assert_thread_not_woken();
+
+        check_futex_wake(&futex_values[i], INT_MAX);
+        thread.assert_thread_woken();
+    }
+    END_TEST;
+}
+
 // Test the case where futex_wait() times out after having been moved to a
 // different queue by futex_requeue().  Check that futex_wait() removes
 // itself from the correct queue in that case.
@@ -451,6 +508,49 @@ static bool test_event_signaling() {
     END_TEST;
 }
 
+static int pi_owner_thread(void* arg) {
+    volatile int* futex = reinterpret_cast<volatile int*>(arg);
+    // hold the "lock" for a while, then release it
+    mx_nanosleep(100 * 1000 * 1000);
+    *futex = 0;
+    mx_futex_wake(const_cast<int*>(futex), 1);
+    return 0;
+}
+
+static bool test_futex_wait_pi() {
+    BEGIN_TEST;
+    volatile int futex_value = 1;
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+
+    // a thread can't be the owner of a lock it is waiting for
+    mx_status_t rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 1, self, 0);
+    EXPECT_EQ(rc, ERR_INVALID_ARGS, "self as owner should be rejected");
+
+    // the owner must be a thread
+    rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 1, mx_process_self(), 0);
+    EXPECT_EQ(rc, ERR_WRONG_TYPE, "process as owner should be rejected");
+
+    thrd_t owner;
+    ASSERT_EQ(thrd_create_with_name(&owner, pi_owner_thread,
+                                    const_cast<int*>(&futex_value), "pi owner"),
+              thrd_success, "Error during thread creation");
+    mx_handle_t owner_handle = thrd_get_mx_handle(owner);
+
+    rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 2, owner_handle, MX_TIME_INFINITE);
+    EXPECT_EQ(rc, ERR_BAD_STATE, "value mismatch should not block");
+
+    // block until the owner releases the futex
+    while (futex_value != 0) {
+        rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 1, owner_handle,
+                              MX_TIME_INFINITE);
+        if (rc != ERR_BAD_STATE)
+            EXPECT_EQ(rc, NO_ERROR, "wait should have been woken");
+    }
+
+    ASSERT_EQ(thrd_join(owner, NULL), thrd_success, "Error during thread join");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(futex_tests)
 RUN_TEST(test_futex_wait_value_mismatch);
 RUN_TEST(test_futex_wait_timeout);
@@ -458,6 +558,7 @@ RUN_TEST(test_futex_wait_timeout_elapsed);
 RUN_TEST(test_futex_wait_bad_address);
 RUN_TEST(test_futex_wakeup);
 RUN_TEST(test_futex_wakeup_limit);
+RUN_TEST(test_futex_wakeup_lifo);
 RUN_TEST(test_futex_wakeup_address);
 RUN_TEST(test_futex_unqueued_on_timeout);
 RUN_TEST(test_futex_unqueued_on_timeout_2);
@@ -465,8 +566,10 @@ RUN_TEST(test_futex_unqueued_on_timeout_3);
 RUN_TEST(test_futex_requeue_value_mismatch);
 RUN_TEST(test_futex_requeue_same_addr);
 RUN_TEST(test_futex_requeue);
+RUN_TEST(test_futex_requeue_array);
 RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
+RUN_TEST(test_futex_wait_pi);
 RUN_TEST(test_event_signaling);
 END_TEST_CASE(futex_tests)
 
@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
@@ -81,9 +82,101 @@ bool handle_rights_test(void) {
     END_TEST;
 }
 
+#define LOOKUP_THREADS 4
+#define LOOKUP_ITERATIONS 2000
+
+typedef struct lookup_info {
+    mx_handle_t event;
+    mx_koid_t koid;
+    volatile int failures;
+} lookup_info_t;
+
+static int lookup_thread(void* arg) {
+    lookup_info_t* info = arg;
+    for (int ix = 0; ix != LOOKUP_ITERATIONS; ++ix) {
+        mx_info_handle_basic_t basic;
+        if (mx_object_get_info(info->event, MX_INFO_HANDLE_BASIC, &basic, sizeof(basic),
+                               NULL, NULL) != NO_ERROR ||
+            basic.koid != info->koid)
+            info->failures++;
+        if (mx_object_signal(info->event, 0u, MX_USER_SIGNAL_0) != NO_ERROR)
+            info->failures++;
+    }
+    return 0;
+}
+
+// Handle lookups don't take the handle table lock; make sure they stay
+// right while other handles come and go in the same process.
+bool handle_lookup_concurrent_test(void) {
+    BEGIN_TEST;
+
+    lookup_info_t info = {};
+    ASSERT_EQ(mx_event_create(0u, &info.event), 0, "");
+    mx_info_handle_basic_t basic;
+    ASSERT_EQ(mx_object_get_info(info.event, MX_INFO_HANDLE_BASIC, &basic, sizeof(basic),
+                                 NULL, NULL), NO_ERROR, "");
+    info.koid = basic.koid;
+
+    thrd_t threads[LOOKUP_THREADS];
+    for (int ix = 0; ix != LOOKUP_THREADS; ++ix)
+        ASSERT_EQ(thrd_create(&threads[ix], lookup_thread, &info), thrd_success, "");
+
+    for (int ix = 0; ix != LOOKUP_ITERATIONS; ++ix) {
+        mx_handle_t dup;
+        ASSERT_EQ(mx_handle_duplicate(info.event, MX_RIGHT_SAME_RIGHTS, &dup), NO_ERROR, "");
+        ASSERT_EQ(mx_handle_close(dup), NO_ERROR, "");
+    }
+
+    for (int ix = 0; ix != LOOKUP_THREADS; ++ix)
+        thrd_join(threads[ix], NULL);
+    EXPECT_EQ(info.failures, 0, "lookups failed");
+
+    mx_handle_close(info.event);
+
+    END_TEST;
+}
+
+bool handle_many_test(void) {
+    BEGIN_TEST;
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), 0, "");
+
+    mx_handle_t duped[4];
+    ASSERT_EQ(mx_handle_duplicate_many(event, MX_RIGHT_READ, duped, 4u), NO_ERROR, "");
+    for (int ix = 0; ix != 4; ++ix) {
+        mx_info_handle_basic_t info = {};
+        ASSERT_EQ(mx_object_get_info(duped[ix], MX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                                     NULL, NULL), NO_ERROR, "handle should be valid");
+        EXPECT_EQ(info.rights, MX_RIGHT_READ, "wrong set of rights");
+    }
+
+    // A bad or repeated handle closes none of them.
+    mx_handle_t bad[3] = {duped[0], duped[1], duped[0]};
+    EXPECT_EQ(mx_handle_close_many(bad, 3u), ERR_BAD_HANDLE, "");
+    EXPECT_EQ(mx_object_get_info(duped[0], MX_INFO_HANDLE_VALID, NULL, 0u, NULL, NULL), NO_ERROR,
+              "handle should be valid");
+    EXPECT_EQ(mx_object_get_info(duped[1], MX_INFO_HANDLE_VALID, NULL, 0u, NULL, NULL), NO_ERROR,
+              "handle should be valid");
+
+    ASSERT_EQ(mx_handle_close_many(duped, 4u), NO_ERROR, "");
+    for (int ix = 0; ix != 4; ++ix) {
+        EXPECT_EQ(mx_object_get_info(duped[ix], MX_INFO_HANDLE_VALID, NULL, 0u, NULL, NULL),
+                  ERR_BAD_HANDLE, "handle should be closed");
+    }
+
+    EXPECT_EQ(mx_handle_duplicate_many(event, MX_RIGHT_SAME_RIGHTS, duped, 2000u),
+              ERR_OUT_OF_RANGE, "");
+    mx_handle_close(event);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(handle_info_tests)
 RUN_TEST(handle_info_test)
 RUN_TEST(handle_rights_test)
+RUN_TEST(handle_lookup_concurrent_test)
+RUN_TEST(handle_many_test)
 END_TEST_CASE(handle_info_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -227,8 +227,37 @@ bool handle_wait_test(void) {
     END_TEST;
 }
 
+// Waiting on a set of handles of which some are already satisfied returns at
+// once with the state of all of them, and a zero timeout still times out.
+bool handle_wait_many_satisfied_test(void) {
+    BEGIN_TEST;
+
+    mx_wait_item_t items[3];
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(mx_event_create(0u, &items[i].handle), NO_ERROR, "");
+        items[i].waitfor = MX_EVENT_SIGNALED;
+        items[i].pending = 0u;
+    }
+    ASSERT_EQ(mx_object_signal(items[1].handle, 0u, MX_EVENT_SIGNALED), NO_ERROR, "");
+    ASSERT_EQ(mx_object_signal(items[2].handle, 0u, MX_USER_SIGNAL_0), NO_ERROR, "");
+
+    EXPECT_EQ(mx_handle_wait_many(items, 3, MX_TIME_INFINITE), NO_ERROR, "");
+    EXPECT_EQ(items[0].pending & (MX_EVENT_SIGNALED | MX_USER_SIGNAL_0), 0u, "");
+    EXPECT_EQ(items[1].pending & (MX_EVENT_SIGNALED | MX_USER_SIGNAL_0), MX_EVENT_SIGNALED, "");
+    EXPECT_EQ(items[2].pending & (MX_EVENT_SIGNALED | MX_USER_SIGNAL_0), MX_USER_SIGNAL_0, "");
+
+    items[1].pending = 0u;
+    EXPECT_EQ(mx_handle_wait_many(items, 3, 0u), ERR_TIMED_OUT, "");
+    EXPECT_EQ(items[1].pending & MX_EVENT_SIGNALED, MX_EVENT_SIGNALED, "");
+
+    for (int i = 0; i < 3; i++)
+        EXPECT_EQ(mx_handle_close(items[i].handle), NO_ERROR, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(handle_wait_tests)
 RUN_TEST(handle_wait_test);
+RUN_TEST(handle_wait_many_satisfied_test);
 END_TEST_CASE(handle_wait_tests)
 
 #ifndef BUILD_COMBINED_TESTS
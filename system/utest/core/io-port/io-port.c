@@ -113,14 +113,14 @@ static bool queue_and_close_test(void)
     END_TEST;
 }
 
-static bool thread_pool_test(void)
+static bool thread_pool(uint32_t options)
 {
-    BEGIN_TEST;
+    BEGIN_HELPER;
     mx_status_t status;
 
     t_info_t tinfo = {0u, 0, {0}};
 
-    status = mx_port_create(0u, &tinfo.port);
+    status = mx_port_create(options, &tinfo.port);
     EXPECT_EQ(status, 0, "could not create ioport");
 
     thrd_t threads[NUM_IO_THREADS];
@@ -155,6 +155,24 @@ static bool thread_pool_test(void)
     }
     EXPECT_EQ(sum, 145, "bad sum");
 
+    END_HELPER;
+}
+
+static bool thread_pool_test(void)
+{
+    BEGIN_TEST;
+    EXPECT_TRUE(thread_pool(0u), "");
+    END_TEST;
+}
+
+static bool lifo_thread_pool_test(void)
+{
+    BEGIN_TEST;
+    mx_handle_t port;
+    EXPECT_EQ(mx_port_create(~MX_PORT_OPT_LIFO, &port), ERR_INVALID_ARGS,
+              "bad options should be rejected");
+
+    EXPECT_TRUE(thread_pool(MX_PORT_OPT_LIFO), "");
     END_TEST;
 }
 
@@ -466,15 +484,227 @@ static bool port_timeout(void) {
     END_TEST;
 }
 
+static bool wait_async_once_test(void)
+{
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(0u, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_handle_t event;
+    status = mx_event_create(0u, &event);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_object_wait_async(event, port, 3u, 0u, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "no signals");
+
+    status = mx_object_wait_async(event, port, 3u, MX_EVENT_SIGNALED, 7u);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "bad options");
+
+    status = mx_object_wait_async(port, port, 3u, MX_SIGNAL_SIGNALED, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, ERR_NOT_SUPPORTED, "ports are not waitable");
+
+    status = mx_object_wait_async(event, port, 3u, MX_EVENT_SIGNALED, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_io_packet_t io_pkt = {};
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, ERR_TIMED_OUT, "nothing asserted yet");
+
+    status = mx_object_signal(event, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(io_pkt.hdr.key, 3u, "");
+    EXPECT_EQ(io_pkt.hdr.type, MX_PORT_PKT_TYPE_IOSN, "");
+    EXPECT_EQ(io_pkt.signals, MX_EVENT_SIGNALED, "");
+
+    // A one-shot wait is gone once it fires.
+    status = mx_object_signal(event, MX_EVENT_SIGNALED, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_signal(event, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    // Arming on an asserted signal fires right away.
+    status = mx_object_wait_async(event, port, 4u, MX_EVENT_SIGNALED, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(io_pkt.hdr.key, 4u, "");
+
+    // Closing the handle before it fires drops the wait.
+    status = mx_object_signal(event, MX_EVENT_SIGNALED, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_wait_async(event, port, 5u, MX_EVENT_SIGNALED, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_handle_close(event);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool wait_async_repeating_test(void)
+{
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(0u, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_handle_t event;
+    status = mx_event_create(0u, &event);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    const mx_signals_t watched = MX_USER_SIGNAL_0 | MX_USER_SIGNAL_1;
+    status = mx_object_wait_async(event, port, 9u, watched, MX_WAIT_ASYNC_REPEATING);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_io_packet_t io_pkt = {};
+    for (int ix = 0; ix != 3; ++ix) {
+        status = mx_object_signal(event, 0u, MX_USER_SIGNAL_0);
+        EXPECT_EQ(status, NO_ERROR, "");
+        status = mx_object_signal(event, MX_USER_SIGNAL_0, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+
+        status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+        EXPECT_EQ(status, NO_ERROR, "");
+        EXPECT_EQ(io_pkt.hdr.key, 9u, "");
+        EXPECT_EQ(io_pkt.signals, MX_USER_SIGNAL_0, "");
+    }
+
+    // Edges that happen while the packet is queued merge into it.
+    status = mx_object_signal(event, 0u, MX_USER_SIGNAL_0);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_signal(event, 0u, MX_USER_SIGNAL_1);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(io_pkt.signals, watched, "");
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    // Signals that stay asserted don't fire again.
+    status = mx_object_signal(event, MX_USER_SIGNAL_1, 0u);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_port_wait(port, 0ull, &io_pkt, sizeof(io_pkt));
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    // Closing the port with a packet queued, then the event, frees it all.
+    status = mx_object_signal(event, 0u, MX_USER_SIGNAL_1);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_signal(event, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_handle_close(event);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool wait_many_test(void)
+{
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(0u, &port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    for (uint64_t key = 1u; key <= 5u; ++key) {
+        const mx_user_packet_t in = {{key, 0u, 0u}, {}};
+        status = mx_port_queue(port, &in, sizeof(in));
+        EXPECT_EQ(status, NO_ERROR, "");
+    }
+
+    mx_user_packet_t out[8] = {};
+    uint32_t actual = 0u;
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 3u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 3u, "");
+    for (uint32_t ix = 0; ix != actual; ++ix)
+        EXPECT_EQ(out[ix].hdr.key, ix + 1u, "out of order");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 8u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(out[0].hdr.key, 4u, "");
+    EXPECT_EQ(out[1].hdr.key, 5u, "");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 8u, &actual);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 0u, &actual);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+
+    // A packet that does not fit stays queued.
+    const mx_user_packet_t big = {{7u, 0u, 0u}, {}};
+    status = mx_port_queue(port, &big, sizeof(big));
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    mx_packet_header_t small[2];
+    status = mx_port_wait_many(port, 0ull, small, sizeof(small[0]), 2u, &actual);
+    EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+    status = mx_port_wait(port, 0ull, small, sizeof(small[0]));
+    EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 8u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(out[0].hdr.key, 7u, "");
+
+    // Observer packets come out in the same batch as queued ones.
+    mx_handle_t event;
+    status = mx_event_create(0u, &event);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_port_queue(port, &big, sizeof(big));
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_wait_async(event, port, 8u, MX_EVENT_SIGNALED, MX_WAIT_ASYNC_ONCE);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_object_signal(event, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    status = mx_port_wait_many(port, 0ull, out, sizeof(out[0]), 8u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(out[0].hdr.key, 7u, "");
+    EXPECT_EQ(out[1].hdr.key, 8u, "");
+    EXPECT_EQ(out[1].hdr.type, MX_PORT_PKT_TYPE_IOSN, "");
+
+    status = mx_handle_close(event);
+    EXPECT_EQ(status, NO_ERROR, "");
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(thread_pool_test)
+RUN_TEST(lifo_thread_pool_test)
 RUN_TEST(bind_basic_test)
 RUN_TEST(bind_channels_test)
 RUN_TEST(bind_sockets_test)
 RUN_TEST(bind_channels_playback)
 RUN_TEST(port_timeout)
+RUN_TEST(wait_async_once_test)
+RUN_TEST(wait_async_repeating_test)
+RUN_TEST(wait_many_test)
 END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -3,9 +3,11 @@
 // found in the LICENSE file.
 
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
 #include <unittest/unittest.h>
 #include <sys/mman.h>
 
@@ -184,6 +186,123 @@ bool mprotect_test() {
     END_TEST;
 }
 
+bool process_memory_info_test() {
+    BEGIN_TEST;
+
+    const size_t page_size = getpagesize();
+    const size_t len = page_size * 4;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(len, 0, &vmo), NO_ERROR, "vm_object_create");
+
+    uintptr_t addr;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), vmo, 0, len, &addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE),
+              NO_ERROR, "vm_map");
+
+    mx_info_process_memory_t before;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_MEMORY,
+                                 &before, sizeof(before), NULL, NULL),
+              NO_ERROR, "get_info");
+
+    // fault in two of the four pages
+    volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(addr);
+    p[0] = 1;
+    p[page_size * 2] = 1;
+
+    mx_info_process_memory_t after;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_MEMORY,
+                                 &after, sizeof(after), NULL, NULL),
+              NO_ERROR, "get_info");
+    EXPECT_GE(after.major_faults, before.major_faults + 2, "major faults not counted");
+    EXPECT_GE(after.committed_bytes, before.committed_bytes + 2 * page_size, "");
+    EXPECT_GE(after.fault_time, before.fault_time, "");
+
+    // too small a buffer for a fixed size topic
+    EXPECT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_MEMORY,
+                                 &after, sizeof(after) - 1, NULL, NULL),
+              ERR_BUFFER_TOO_SMALL, "");
+
+    // find our mapping in the list of all of them
+    size_t avail = 0;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_MAPS,
+                                 NULL, 0, NULL, &avail),
+              NO_ERROR, "get_info");
+    ASSERT_GT(avail, 0u, "no mappings");
+
+    // leave room for mappings made by other threads in the meantime
+    size_t count = avail + 16;
+    mx_info_maps_t* maps = static_cast<mx_info_maps_t*>(calloc(count, sizeof(mx_info_maps_t)));
+    ASSERT_NONNULL(maps, "");
+    size_t actual = 0;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_PROCESS_MAPS,
+                                 maps, count * sizeof(maps[0]), &actual, &avail),
+              NO_ERROR, "get_info");
+    EXPECT_LE(actual, avail, "");
+
+    bool found = false;
+    for (size_t i = 0; i < actual; i++) {
+        if (i > 0)
+            EXPECT_GT(maps[i].base, maps[i - 1].base, "mappings out of order");
+        if (maps[i].base != addr)
+            continue;
+        found = true;
+        EXPECT_EQ(maps[i].size, len, "");
+        EXPECT_EQ(maps[i].committed_bytes, 2 * page_size, "");
+        EXPECT_EQ(maps[i].flags, MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, "");
+    }
+    EXPECT_TRUE(found, "mapping not reported");
+    free(maps);
+
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr, 0), NO_ERROR, "vm_unmap");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "handle_close");
+
+    END_TEST;
+}
+
+bool zero_page_test() {
+    BEGIN_TEST;
+
+    const size_t page_size = getpagesize();
+    const size_t len = page_size * 2;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(len, 0, &vmo), NO_ERROR, "vm_object_create");
+
+    uintptr_t addr;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), vmo, 0, len, &addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE),
+              NO_ERROR, "vm_map");
+
+    // reading uncommitted memory sees zeros without committing anything
+    volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(addr);
+    EXPECT_EQ(p[0], 0u, "");
+    EXPECT_EQ(p[page_size], 0u, "");
+    mx_paddr_t pa[2];
+    EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, page_size, pa, sizeof(pa)),
+              ERR_NO_MEMORY, "read fault committed a page");
+
+    // the first write gets the page a real page of its own, and leaves the
+    // other one alone
+    p[0] = 1;
+    EXPECT_EQ(p[0], 1u, "");
+    EXPECT_EQ(p[page_size], 0u, "");
+    EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, page_size, pa, sizeof(pa)),
+              NO_ERROR, "write fault didn't commit a page");
+    EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, len, pa, sizeof(pa)),
+              ERR_NO_MEMORY, "");
+
+    // committing the other page through the vmo replaces the zero page in the
+    // mapping
+    uint8_t val = 2;
+    size_t actual;
+    EXPECT_EQ(mx_vmo_write(vmo, &val, page_size, 1, &actual), NO_ERROR, "vm_object_write");
+    EXPECT_EQ(p[page_size], 2u, "mapping still has the zero page");
+
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr, 0), NO_ERROR, "vm_unmap");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "handle_close");
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(memory_mapping_tests)
@@ -193,6 +312,8 @@ RUN_TEST(mmap_offset_test);
 RUN_TEST(mmap_prot_test);
 RUN_TEST(mmap_flags_test);
 RUN_TEST(mprotect_test);
+RUN_TEST(process_memory_info_test);
+RUN_TEST(zero_page_test);
 END_TEST_CASE(memory_mapping_tests)
 
 #ifndef BUILD_COMBINED_TESTS
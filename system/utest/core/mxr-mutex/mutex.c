@@ -155,11 +155,45 @@ static bool test_try_mutexes(void) {
     END_TEST;
 }
 
+// Short critical sections mostly hand the lock over while spinning; check
+// nothing is lost that way and that a timed out waiter doesn't wedge it.
+static int counter = 0;
+
+static int mutex_counter_thread(void* arg) {
+    for (int times = 0; times < 10000; times++) {
+        mxr_mutex_lock(&mutex);
+        counter++;
+        mxr_mutex_unlock(&mutex);
+    }
+    return 0;
+}
+
+static bool test_short_critical_sections(void) {
+    BEGIN_TEST;
+    thrd_t threads[4];
+
+    counter = 0;
+    for (int i = 0; i < 4; i++)
+        thrd_create_with_name(&threads[i], mutex_counter_thread, NULL, "counter");
+    for (int i = 0; i < 4; i++)
+        thrd_join(threads[i], NULL);
+    EXPECT_EQ(counter, 40000, "lost an increment");
+
+    mxr_mutex_lock(&mutex);
+    EXPECT_EQ(mxr_mutex_timedlock(&mutex, MX_MSEC(1)), ERR_TIMED_OUT, "");
+    mxr_mutex_unlock(&mutex);
+    EXPECT_EQ(mxr_mutex_trylock(&mutex), NO_ERROR, "");
+    mxr_mutex_unlock(&mutex);
+
+    END_TEST;
+}
+
 
 BEGIN_TEST_CASE(mxr_mutex_tests)
 RUN_TEST(test_initializer)
 RUN_TEST(test_mutexes)
 RUN_TEST(test_try_mutexes)
+RUN_TEST(test_short_critical_sections)
 END_TEST_CASE(mxr_mutex_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,249 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+#include <unittest/unittest.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#define PAGER_KEY 42u
+
+typedef struct pager_info {
+    mx_handle_t pager;
+    mx_handle_t port;
+    mx_handle_t vmo;
+    uint32_t requests;
+} pager_info_t;
+
+// Fills each page with its page number plus one.
+static int pager_thread(void* arg) {
+    pager_info_t* info = (pager_info_t*)arg;
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+
+    for (;;) {
+        mx_pager_packet_t packet;
+        mx_status_t status = mx_port_wait(info->port, MX_TIME_INFINITE, &packet, sizeof(packet));
+        if (status != NO_ERROR || packet.hdr.type != MX_PORT_PKT_TYPE_PAGER)
+            break;
+        if (packet.hdr.key != PAGER_KEY || packet.command != MX_PAGER_VMO_READ)
+            break;
+        info->requests++;
+
+        mx_handle_t aux;
+        if (mx_vmo_create(packet.length, 0u, &aux) != NO_ERROR)
+            break;
+        uint8_t buffer[page_size];
+        for (uint64_t o = 0; o < packet.length; o += page_size) {
+            memset(buffer, (int)((packet.offset + o) / page_size + 1), page_size);
+            size_t actual;
+            mx_vmo_write(aux, buffer, o, page_size, &actual);
+        }
+        status = mx_pager_supply_pages(info->pager, info->vmo, packet.offset, packet.length, aux);
+        mx_handle_close(aux);
+        if (status != NO_ERROR)
+            break;
+    }
+    return 0;
+}
+
+static void stop_pager_thread(pager_info_t* info, thrd_t thread) {
+    mx_packet_header_t quit = {};
+    mx_port_queue(info->port, &quit, sizeof(quit));
+    thrd_join(thread, NULL);
+}
+
+static bool pager_create_args(void) {
+    BEGIN_TEST;
+
+    mx_handle_t pager, port, vmo;
+    EXPECT_EQ(mx_pager_create(1u, &pager), ERR_INVALID_ARGS, "bad options");
+    ASSERT_EQ(mx_pager_create(0u, &pager), NO_ERROR, "");
+    ASSERT_EQ(mx_port_create(0u, &port), NO_ERROR, "");
+
+    EXPECT_EQ(mx_pager_create_vmo(pager, pager, 0u, 4096u, 0u, &vmo), ERR_WRONG_TYPE,
+              "not a port");
+    EXPECT_EQ(mx_pager_create_vmo(pager, port, 0u, 4096u, 1u, &vmo), ERR_INVALID_ARGS,
+              "bad options");
+    ASSERT_EQ(mx_pager_create_vmo(pager, port, 0u, 4096u * 4, 0u, &vmo), NO_ERROR, "");
+
+    // Its pages only ever come from the pager.
+    mx_handle_t clone;
+    EXPECT_EQ(mx_vmo_set_size(vmo, 4096u), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0u, 4096u, &clone),
+              ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0u, 4096u, NULL, 0u), ERR_NOT_SUPPORTED, "");
+
+    // Pages can only be supplied to the pager's own VMOs.
+    mx_handle_t other, aux;
+    ASSERT_EQ(mx_vmo_create(4096u, 0u, &other), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_create(4096u, 0u, &aux), NO_ERROR, "");
+    EXPECT_EQ(mx_pager_supply_pages(pager, other, 0u, 4096u, aux), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_pager_supply_pages(pager, vmo, 1u, 4096u, aux), ERR_INVALID_ARGS,
+              "unaligned");
+    EXPECT_EQ(mx_pager_supply_pages(pager, vmo, 4096u * 4, 4096u, aux), ERR_OUT_OF_RANGE, "");
+
+    mx_handle_close(aux);
+    mx_handle_close(other);
+    mx_handle_close(vmo);
+    mx_handle_close(port);
+    mx_handle_close(pager);
+
+    END_TEST;
+}
+
+static bool pager_read_and_map(void) {
+    BEGIN_TEST;
+
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+    const size_t vmo_size = page_size * 8;
+
+    pager_info_t info = {};
+    ASSERT_EQ(mx_pager_create(0u, &info.pager), NO_ERROR, "");
+    ASSERT_EQ(mx_port_create(0u, &info.port), NO_ERROR, "");
+    ASSERT_EQ(mx_pager_create_vmo(info.pager, info.port, PAGER_KEY, vmo_size, 0u, &info.vmo),
+              NO_ERROR, "");
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pager_thread, &info, "pager"), thrd_success, "");
+
+    // A read waits for the pager to supply each page it covers.
+    uint8_t buffer[16];
+    size_t actual;
+    ASSERT_EQ(mx_vmo_read(info.vmo, buffer, page_size * 3 - 8, sizeof(buffer), &actual),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, sizeof(buffer), "");
+    EXPECT_EQ(buffer[0], 3u, "");
+    EXPECT_EQ(buffer[15], 4u, "");
+
+    // So does touching a mapping of it, whether reading or writing.
+    uintptr_t addr;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), info.vmo, 0, vmo_size, &addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE),
+              NO_ERROR, "");
+    volatile uint8_t* p = (volatile uint8_t*)addr;
+    EXPECT_EQ(p[page_size * 5], 6u, "");
+    p[page_size * 6 + 1] = 0xffu;
+    EXPECT_EQ(p[page_size * 6], 7u, "");
+    EXPECT_EQ(p[page_size * 6 + 1], 0xffu, "");
+
+    // Pages already there stay there.
+    EXPECT_EQ(p[page_size * 2], 3u, "");
+    EXPECT_EQ(info.requests, 4u, "");
+
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr, 0), NO_ERROR, "");
+    stop_pager_thread(&info, thread);
+    mx_handle_close(info.vmo);
+    mx_handle_close(info.port);
+    mx_handle_close(info.pager);
+
+    END_TEST;
+}
+
+static bool pager_closed(void) {
+    BEGIN_TEST;
+
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+    pager_info_t info = {};
+    ASSERT_EQ(mx_pager_create(0u, &info.pager), NO_ERROR, "");
+    ASSERT_EQ(mx_port_create(0u, &info.port), NO_ERROR, "");
+    ASSERT_EQ(mx_pager_create_vmo(info.pager, info.port, PAGER_KEY, page_size * 2, 0u,
+                                  &info.vmo),
+              NO_ERROR, "");
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pager_thread, &info, "pager"), thrd_success, "");
+    uint8_t byte;
+    size_t actual;
+    ASSERT_EQ(mx_vmo_read(info.vmo, &byte, 0u, 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(byte, 1u, "");
+    stop_pager_thread(&info, thread);
+
+    // With the pager gone, what it supplied can still be read, but nothing
+    // else can.
+    mx_handle_close(info.pager);
+    EXPECT_EQ(mx_vmo_read(info.vmo, &byte, 0u, 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(byte, 1u, "");
+    EXPECT_EQ(mx_vmo_read(info.vmo, &byte, page_size, 1u, &actual), ERR_BAD_STATE, "");
+
+    mx_handle_close(info.vmo);
+    mx_handle_close(info.port);
+
+    END_TEST;
+}
+
+static bool pager_hints(void) {
+    BEGIN_TEST;
+
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+    const size_t vmo_size = page_size * 8;
+
+    pager_info_t info = {};
+    ASSERT_EQ(mx_pager_create(0u, &info.pager), NO_ERROR, "");
+    ASSERT_EQ(mx_port_create(0u, &info.port), NO_ERROR, "");
+    ASSERT_EQ(mx_pager_create_vmo(info.pager, info.port, PAGER_KEY, vmo_size, 0u, &info.vmo),
+              NO_ERROR, "");
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pager_thread, &info, "pager"), thrd_success, "");
+
+    // A sequential mapping asks for the pages after a fault along with it.
+    uintptr_t addr;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), info.vmo, 0, vmo_size, &addr,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_process_advise_vm(mx_process_self(), addr, page_size, MX_VM_ADVICE_RANDOM),
+              ERR_INVALID_ARGS, "len must be 0");
+    EXPECT_EQ(mx_process_advise_vm(mx_process_self(), addr, 0u, 42u), ERR_INVALID_ARGS,
+              "bad advice");
+    ASSERT_EQ(mx_process_advise_vm(mx_process_self(), addr, 0u, MX_VM_ADVICE_SEQUENTIAL),
+              NO_ERROR, "");
+    volatile uint8_t* p = (volatile uint8_t*)addr;
+    EXPECT_EQ(p[0], 1u, "");
+    EXPECT_EQ(p[page_size * 7], 8u, "");
+    EXPECT_EQ(info.requests, 1u, "");
+
+    // Pages nobody wrote are given up, and asked for again when next used.
+    p[page_size * 2] = 0xffu;
+    EXPECT_EQ(mx_vmo_op_range(info.vmo, MX_VMO_OP_DONTNEED, 0u, vmo_size, NULL, 0u), NO_ERROR,
+              "");
+    EXPECT_EQ(p[page_size * 2], 0xffu, "written page is kept");
+    EXPECT_EQ(info.requests, 1u, "");
+    uint8_t byte;
+    size_t actual;
+    ASSERT_EQ(mx_vmo_read(info.vmo, &byte, page_size * 3, 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(byte, 4u, "");
+    EXPECT_EQ(info.requests, 2u, "");
+
+    // Asking for pages ahead of time doesn't change what's read.
+    EXPECT_EQ(mx_vmo_op_range(info.vmo, MX_VMO_OP_WILLNEED, 0u, vmo_size, NULL, 0u), NO_ERROR,
+              "");
+    EXPECT_EQ(p[page_size * 6], 7u, "");
+    EXPECT_EQ(p[page_size * 2], 0xffu, "");
+
+    EXPECT_EQ(mx_process_unmap_vm(mx_process_self(), addr, 0), NO_ERROR, "");
+    stop_pager_thread(&info, thread);
+    mx_handle_close(info.vmo);
+    mx_handle_close(info.port);
+    mx_handle_close(info.pager);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(pager_tests)
+RUN_TEST(pager_create_args)
+RUN_TEST(pager_read_and_map)
+RUN_TEST(pager_closed)
+RUN_TEST(pager_hints)
+END_TEST_CASE(pager_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
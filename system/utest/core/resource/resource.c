@@ -9,6 +9,7 @@
 #include <magenta/syscalls/resource.h>
 #include <unittest/unittest.h>
 #include <stdio.h>
+#include <string.h>
 
 extern mx_handle_t root_resource;
 
@@ -139,7 +140,144 @@ static bool test_resource_connect(void) {
     END_TEST;
 }
 
+static bool test_kernel_heap_info(void) {
+    BEGIN_TEST;
+
+    mx_handle_t rrh = root_resource;
+    ASSERT_NEQ(rrh, MX_HANDLE_INVALID, "no root resource handle");
+
+    mx_info_kernel_heap_t info;
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_HEAP, &info, sizeof(info), NULL, NULL),
+              NO_ERROR, "");
+    EXPECT_GT(info.size, 0u, "empty kernel heap");
+    EXPECT_LE(info.free_bytes + info.cached_bytes, info.size, "more free than heap");
+    EXPECT_GT(info.os_allocations, 0u, "");
+    EXPECT_GE(info.os_alloc_count, info.os_allocations, "");
+
+    // a fixed size topic
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_HEAP, &info, sizeof(info) - 1, NULL, NULL),
+              ERR_BUFFER_TOO_SMALL, "");
+
+    // only the root resource may look
+    mx_handle_t ev;
+    ASSERT_EQ(mx_event_create(0u, &ev), NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_info(ev, MX_INFO_KERNEL_HEAP, &info, sizeof(info), NULL, NULL),
+              ERR_WRONG_TYPE, "");
+
+    size_t actual, avail;
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_HEAP_BUCKETS, NULL, 0, &actual, &avail),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, 0u, "");
+    ASSERT_GT(avail, 0u, "no heap buckets");
+
+    mx_info_kernel_heap_bucket_t buckets[256];
+    ASSERT_LE(avail, countof(buckets), "too many heap buckets");
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_HEAP_BUCKETS, buckets, sizeof(buckets),
+                                 &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, avail, "");
+    for (size_t i = 1; i < actual; i++) {
+        EXPECT_GT(buckets[i].size, buckets[i - 1].size, "buckets out of order");
+    }
+    EXPECT_EQ(mx_object_get_info(ev, MX_INFO_KERNEL_HEAP_BUCKETS, buckets, sizeof(buckets),
+                                 &actual, NULL),
+              ERR_WRONG_TYPE, "");
+
+    mx_handle_close(ev);
+    END_TEST;
+}
+
+static bool test_kernel_syscall_info(void) {
+    BEGIN_TEST;
+
+    mx_handle_t rrh = root_resource;
+    ASSERT_NEQ(rrh, MX_HANDLE_INVALID, "no root resource handle");
+
+    size_t actual, avail;
+    mx_status_t status = mx_object_get_info(rrh, MX_INFO_KERNEL_SYSCALLS, NULL, 0,
+                                            &actual, &avail);
+    if (status == ERR_NOT_SUPPORTED) {
+        // syscall counting is off unless asked for on the command line
+        unittest_printf("syscall counting is off, skipping\n");
+        END_TEST;
+    }
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 0u, "");
+    ASSERT_GT(avail, 0u, "no syscalls");
+
+    static mx_info_kernel_syscall_t syscalls[256];
+    ASSERT_LE(avail, countof(syscalls), "too many syscalls");
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_SYSCALLS, syscalls, sizeof(syscalls),
+                                 &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, avail, "");
+
+    bool found = false;
+    for (size_t i = 0; i < actual; i++) {
+        EXPECT_GT(strlen(syscalls[i].name), 0u, "unnamed syscall");
+        if (!strcmp(syscalls[i].name, "object_get_info"))
+            found = true;
+    }
+    EXPECT_TRUE(found, "object_get_info not listed");
+
+    mx_handle_t ev;
+    ASSERT_EQ(mx_event_create(0u, &ev), NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_info(ev, MX_INFO_KERNEL_SYSCALLS, syscalls, sizeof(syscalls),
+                                 &actual, NULL),
+              ERR_WRONG_TYPE, "");
+    mx_handle_close(ev);
+
+    END_TEST;
+}
+
+static int64_t get_counter(mx_info_kernel_counter_t* counters, size_t count, const char* name) {
+    for (size_t i = 0; i < count; i++) {
+        if (!strcmp(counters[i].name, name))
+            return counters[i].value;
+    }
+    return -1;
+}
+
+static bool test_kernel_counters_info(void) {
+    BEGIN_TEST;
+
+    mx_handle_t rrh = root_resource;
+    ASSERT_NEQ(rrh, MX_HANDLE_INVALID, "no root resource handle");
+
+    size_t actual, avail;
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_COUNTERS, NULL, 0, &actual, &avail),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, 0u, "");
+    ASSERT_GT(avail, 0u, "no counters");
+
+    static mx_info_kernel_counter_t counters[128];
+    ASSERT_LE(avail, countof(counters), "too many counters");
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_COUNTERS, counters, sizeof(counters),
+                                 &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(actual, avail, "");
+    int64_t created = get_counter(counters, actual, "magenta.dispatcher.create");
+    ASSERT_GT(created, 0, "dispatcher creations not counted");
+
+    mx_handle_t ev;
+    ASSERT_EQ(mx_event_create(0u, &ev), NO_ERROR, "");
+    ASSERT_EQ(mx_object_get_info(rrh, MX_INFO_KERNEL_COUNTERS, counters, sizeof(counters),
+                                 &actual, NULL),
+              NO_ERROR, "");
+    EXPECT_GT(get_counter(counters, actual, "magenta.dispatcher.create"), created, "");
+
+    EXPECT_EQ(mx_object_get_info(ev, MX_INFO_KERNEL_COUNTERS, counters, sizeof(counters),
+                                 &actual, NULL),
+              ERR_WRONG_TYPE, "");
+    mx_handle_close(ev);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(resource_tests)
 RUN_TEST(test_resource_actions);
 RUN_TEST(test_resource_connect);
+RUN_TEST(test_kernel_heap_info);
+RUN_TEST(test_kernel_syscall_info);
+RUN_TEST(test_kernel_counters_info);
 END_TEST_CASE(resource_tests)
\ No newline at end of file
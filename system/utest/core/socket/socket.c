@@ -4,10 +4,12 @@
 
 #include <assert.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static mx_signals_t get_satisfied_signals(mx_handle_t handle) {
@@ -306,8 +308,13 @@ static bool socket_short_write(void) {
     status = mx_socket_create(0, &h0, &h1);
     ASSERT_EQ(status, NO_ERROR, "");
 
-    // TODO(qsr): Request socket buffer and use (socket_buffer + 1).
-    const size_t buffer_size = 256 * 1024 + 1;
+    uint32_t socket_buffer = 0;
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE,
+                                    &socket_buffer, sizeof(socket_buffer));
+    ASSERT_EQ(status, NO_ERROR, "");
+    ASSERT_GT(socket_buffer, 0u, "");
+
+    const size_t buffer_size = socket_buffer + 1;
     char* buffer = malloc(buffer_size);
     size_t written = 0;
     status = mx_socket_write(h0, 0u, buffer, buffer_size, &written);
@@ -320,6 +327,292 @@ static bool socket_short_write(void) {
     END_TEST;
 }
 
+static bool socket_buffer_size(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t count;
+
+    mx_handle_t h0, h1;
+    status = mx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    uint32_t size = 1024u * 1024u;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    // Sizes are rounded up to a power of two.
+    size = 3000u * 1024u;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(size, 4096u * 1024u, "");
+
+    size = 1u;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+    size = 0xffffffffu;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+
+    // A write larger than the default buffer now goes through in one piece.
+    const size_t buffer_size = 512u * 1024u;
+    char* buffer = malloc(buffer_size);
+    status = mx_socket_write(h0, 0u, buffer, buffer_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, buffer_size, "");
+
+    // The buffer can't change size under unread data.
+    size = 64u * 1024u;
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    EXPECT_EQ(status, ERR_BAD_STATE, "");
+
+    status = mx_socket_read(h1, 0u, buffer, buffer_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, buffer_size, "");
+    status = mx_object_set_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    free(buffer);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_datagram(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t count;
+
+    mx_handle_t h0, h1;
+    status = mx_socket_create(MX_SOCKET_DATAGRAM, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    static const char first[] = "first";
+    static const char second[] = "the second message";
+    status = mx_socket_write(h0, 0u, first, sizeof(first), &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, sizeof(first), "");
+    status = mx_socket_write(h0, 0u, second, sizeof(second), &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, sizeof(second), "");
+
+    // Outstanding reports the size of the next message.
+    status = mx_socket_read(h1, 0u, NULL, 0, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, sizeof(first), "");
+
+    // Messages are never merged...
+    char buffer[64];
+    status = mx_socket_read(h1, 0u, buffer, sizeof(buffer), &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, sizeof(first), "");
+    EXPECT_EQ(memcmp(buffer, first, sizeof(first)), 0, "");
+
+    // ...and a short read drops the rest of one.
+    status = mx_socket_read(h1, 0u, buffer, 3, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, 3u, "");
+    EXPECT_EQ(memcmp(buffer, second, 3), 0, "");
+
+    status = mx_socket_read(h1, 0u, buffer, sizeof(buffer), &count);
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(get_satisfied_signals(h1) & MX_SOCKET_READABLE, 0u, "");
+
+    // A message bigger than the whole buffer can never be sent.
+    uint32_t size = 0;
+    status = mx_object_get_property(h1, MX_PROP_SOCKET_BUFFER_SIZE, &size, sizeof(size));
+    ASSERT_EQ(status, NO_ERROR, "");
+    char* big = malloc(size);
+    status = mx_socket_write(h0, 0u, big, size, &count);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+
+    // Fill the buffer with messages until the next one does not fit; the
+    // writer then stops seeing WRITABLE until the reader makes room.
+    const size_t msg_size = size / 4;
+    int sent = 0;
+    while ((status = mx_socket_write(h0, 0u, big, msg_size, &count)) == NO_ERROR)
+        sent++;
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(sent, 3, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & MX_SOCKET_WRITABLE, 0u, "");
+
+    status = mx_socket_read(h1, 0u, big, size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, msg_size, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & MX_SOCKET_WRITABLE, MX_SOCKET_WRITABLE, "");
+
+    free(big);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_write_vmo(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t count;
+
+    mx_handle_t h0, h1;
+    status = mx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+    const size_t vmo_size = page_size * 4;
+    mx_handle_t vmo;
+    status = mx_vmo_create(vmo_size, 0, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    char* data = malloc(vmo_size);
+    for (size_t i = 0; i < vmo_size; i++)
+        data[i] = (char)i;
+    status = mx_vmo_write(vmo, data, 0, vmo_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    status = mx_socket_write_vmo(h0, 0u, vmo, 1, page_size, &count);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+
+    // Bytes written before and after the pages stay in order around them.
+    status = mx_socket_write(h0, 0u, "ab", 2, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_socket_write_vmo(h0, 0u, vmo, page_size, page_size * 2, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, page_size * 2, "");
+    status = mx_socket_write(h0, 0u, "cd", 2, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    status = mx_socket_read(h1, 0u, NULL, 0, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, page_size * 2 + 4, "");
+
+    // The pages left the vmo.
+    char* buffer = malloc(vmo_size);
+    status = mx_vmo_read(vmo, buffer, page_size, page_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(buffer[1], 0, "");
+
+    // Read across the boundaries, in odd sized pieces.
+    size_t total = 0;
+    while (total < page_size * 2 + 4) {
+        status = mx_socket_read(h1, 0u, buffer + total, 1000, &count);
+        ASSERT_EQ(status, NO_ERROR, "");
+        total += count;
+    }
+    EXPECT_EQ(total, page_size * 2 + 4, "");
+    EXPECT_EQ(memcmp(buffer, "ab", 2), 0, "");
+    EXPECT_EQ(memcmp(buffer + 2, data + page_size, page_size * 2), 0, "");
+    EXPECT_EQ(memcmp(buffer + 2 + page_size * 2, "cd", 2), 0, "");
+
+    status = mx_socket_read(h1, 0u, buffer, vmo_size, &count);
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(get_satisfied_signals(h1) & MX_SOCKET_READABLE, 0u, "");
+
+    free(buffer);
+    free(data);
+    mx_handle_close(vmo);
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_splice(void) {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t count;
+
+    mx_handle_t a0, a1, b0, b1;
+    status = mx_socket_create(0, &a0, &a1);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_socket_create(0, &b0, &b1);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    const size_t page_size = sysconf(_SC_PAGE_SIZE);
+    const size_t vmo_size = page_size * 2;
+    mx_handle_t vmo;
+    status = mx_vmo_create(vmo_size, 0, &vmo);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    char* data = malloc(vmo_size);
+    for (size_t i = 0; i < vmo_size; i++)
+        data[i] = (char)i;
+    status = mx_vmo_write(vmo, data, 0, vmo_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+
+    // Unaligned ranges of a vmo are copied and stop at its end.
+    status = mx_socket_splice(vmo, a0, 0u, 3, vmo_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, vmo_size - 3, "");
+    status = mx_socket_splice(vmo, a0, 0u, vmo_size, 1, &count);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "");
+    status = mx_socket_splice(vmo, vmo, 0u, 0, 1, &count);
+    EXPECT_EQ(status, ERR_WRONG_TYPE, "");
+
+    // Pages queued by socket_write_vmo move along with the copied bytes.
+    mx_handle_t pages;
+    status = mx_vmo_create(page_size, 0, &pages);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_vmo_write(pages, data, 0, page_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_socket_write_vmo(a0, 0u, pages, 0, page_size, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    mx_handle_close(pages);
+
+    // From one socket into the other.
+    const size_t total = vmo_size - 3 + page_size;
+    status = mx_socket_splice(a1, b0, 0u, 1, total, &count);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+    status = mx_socket_splice(a1, a0, 0u, 0, total, &count);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+    status = mx_socket_splice(a1, b0, 0u, 0, total, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, total, "");
+    EXPECT_EQ(get_satisfied_signals(a1) & MX_SOCKET_READABLE, 0u, "");
+    EXPECT_EQ(get_satisfied_signals(b1) & MX_SOCKET_READABLE, MX_SOCKET_READABLE, "");
+    status = mx_socket_splice(a1, b0, 0u, 0, total, &count);
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "");
+
+    // And back out into a vmo, which takes no more than fits.
+    mx_handle_t out;
+    status = mx_vmo_create(vmo_size, 0, &out);
+    ASSERT_EQ(status, NO_ERROR, "");
+    status = mx_socket_splice(b1, out, 0u, 1, total, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, vmo_size - 1, "");
+
+    char* buffer = malloc(total);
+    status = mx_vmo_read(out, buffer, 1, vmo_size - 1, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(memcmp(buffer, data + 3, vmo_size - 3), 0, "");
+    EXPECT_EQ(memcmp(buffer + vmo_size - 3, data, 2), 0, "");
+
+    // What did not fit is still there to read.
+    status = mx_socket_read(b1, 0u, buffer, total, &count);
+    ASSERT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(count, page_size - 2, "");
+    EXPECT_EQ(memcmp(buffer, data + 2, page_size - 2), 0, "");
+
+    mx_handle_close(b0);
+    status = mx_socket_splice(b1, out, 0u, 0, 1, &count);
+    EXPECT_EQ(status, ERR_REMOTE_CLOSED, "");
+
+    free(buffer);
+    free(data);
+    mx_handle_close(out);
+    mx_handle_close(vmo);
+    mx_handle_close(a0);
+    mx_handle_close(a1);
+    mx_handle_close(b1);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -327,6 +620,10 @@ RUN_TEST(socket_half_close)
 RUN_TEST(socket_bytes_outstanding)
 RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
+RUN_TEST(socket_buffer_size)
+RUN_TEST(socket_datagram)
+RUN_TEST(socket_write_vmo)
+RUN_TEST(socket_splice)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -6,6 +6,7 @@
 #include <unistd.h>
 
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
 #include <unittest/unittest.h>
 #include <runtime/thread.h>
 
@@ -68,6 +69,113 @@ static bool test_thread_start_on_initial_thread(void) {
     END_TEST;
 }
 
+// The same goes for mx_thread_create_start(), which leaves no thread or
+// handle behind when it can't start one.
+static bool test_thread_create_start_on_initial_thread(void) {
+    BEGIN_TEST;
+
+    static const char kProcessName[] = "Test process";
+    static const char kThreadName[] = "Test thread";
+    mx_handle_t process;
+    mx_handle_t thread = MX_HANDLE_INVALID;
+    ASSERT_EQ(mx_process_create(0, kProcessName, sizeof(kProcessName) - 1,
+                                0, &process), NO_ERROR, "");
+    ASSERT_EQ(mx_thread_create_start(process, kThreadName, sizeof(kThreadName) - 1,
+                                     1, 1, 1, 1, &thread), ERR_BAD_STATE, "");
+    if (thread != MX_HANDLE_INVALID)
+        EXPECT_EQ(mx_handle_close(thread), ERR_BAD_HANDLE, "thread handle left behind");
+
+    ASSERT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// mx_process_start_etc() checks the whole request before it maps or
+// starts anything.
+static bool test_process_start_etc_bad_stack_map(void) {
+    BEGIN_TEST;
+
+    static const char kProcessName[] = "Test process";
+    static const char kThreadName[] = "Test thread";
+    mx_handle_t process;
+    mx_handle_t thread;
+    ASSERT_EQ(mx_process_create(0, kProcessName, sizeof(kProcessName) - 1,
+                                0, &process), NO_ERROR, "");
+    ASSERT_EQ(mx_thread_create(process, kThreadName, sizeof(kThreadName) - 1,
+                               0, &thread), NO_ERROR, "");
+
+    const size_t size = 4096u;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(size, 0, &vmo), NO_ERROR, "");
+    mx_process_map_t map = {
+        .vmo = vmo,
+        .flags = MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+        .len = size,
+    };
+    mx_process_start_t start = {
+        .entry = 0,
+        .stack = size,
+        .stack_map = 1,
+        .arg_handle = thread,
+        .bootstrap = MX_HANDLE_INVALID,
+    };
+    EXPECT_EQ(mx_process_start_etc(process, thread, &start, &map, 1), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(map.addr, 0u, "mapped despite the bad request");
+
+    ASSERT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(thread), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// A bootstrap message that can't be sent because one of its handles is bad
+// still takes the good ones with it.
+static bool test_process_start_etc_bad_msg_handle(void) {
+    BEGIN_TEST;
+
+    static const char kProcessName[] = "Test process";
+    static const char kThreadName[] = "Test thread";
+    mx_handle_t process;
+    mx_handle_t thread;
+    ASSERT_EQ(mx_process_create(0, kProcessName, sizeof(kProcessName) - 1,
+                                0, &process), NO_ERROR, "");
+    ASSERT_EQ(mx_thread_create(process, kThreadName, sizeof(kThreadName) - 1,
+                               0, &thread), NO_ERROR, "");
+    mx_handle_t bootstrap[2];
+    ASSERT_EQ(mx_channel_create(0, &bootstrap[0], &bootstrap[1]), NO_ERROR, "");
+
+    mx_handle_t good[2];
+    ASSERT_EQ(mx_event_create(0u, &good[0]), NO_ERROR, "");
+    ASSERT_EQ(mx_event_create(0u, &good[1]), NO_ERROR, "");
+    mx_handle_t bad;
+    ASSERT_EQ(mx_event_create(0u, &bad), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(bad), NO_ERROR, "");
+
+    mx_handle_t handles[] = { good[0], bad, good[1], good[1] };
+    mx_process_start_t start = {
+        .entry = 0,
+        .stack = 0,
+        .stack_map = MX_PROCESS_START_NO_MAP,
+        .arg_handle = thread,
+        .bootstrap = bootstrap[0],
+        .msg = {
+            .handles = handles,
+            .num_handles = countof(handles),
+        },
+    };
+    EXPECT_EQ(mx_process_start_etc(process, thread, &start, NULL, 0), ERR_BAD_HANDLE, "");
+    EXPECT_EQ(mx_handle_close(good[0]), ERR_BAD_HANDLE, "good handle left behind");
+    EXPECT_EQ(mx_handle_close(good[1]), ERR_BAD_HANDLE, "repeated handle left behind");
+
+    ASSERT_EQ(mx_handle_close(bootstrap[0]), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(bootstrap[1]), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(thread), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
 // Test that we don't get an assertion failure (and kernel panic) if we
 // pass a zero instruction pointer when starting a thread (in this case via
 // mx_process_start()).
@@ -94,10 +202,152 @@ static bool test_thread_start_with_zero_instruction_pointer(void) {
     END_TEST;
 }
 
+// A thread that slept has run a little and blocked at least once, and its
+// process has run at least as much as it did.
+static bool test_task_runtime(void) {
+    BEGIN_TEST;
+
+    const size_t stack_size = 256u << 10;
+    mx_handle_t thread_stack_vmo;
+    ASSERT_EQ(mx_vmo_create(stack_size, 0, &thread_stack_vmo), NO_ERROR, "");
+    uintptr_t stack = 0u;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), thread_stack_vmo, 0, stack_size, &stack,
+                                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE), NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(thread_stack_vmo), NO_ERROR, "");
+
+    mxr_thread_t* thread = NULL;
+    ASSERT_EQ(mxr_thread_create("runtime_thread", &thread), NO_ERROR, "");
+    ASSERT_EQ(mxr_thread_start(thread, stack, stack_size, test_thread_fn, NULL), NO_ERROR, "");
+    mx_handle_t handle = mxr_thread_get_handle(thread);
+    ASSERT_EQ(mx_handle_wait_one(handle, MX_SIGNAL_SIGNALED, MX_TIME_INFINITE, NULL),
+              NO_ERROR, "");
+
+    mx_info_task_runtime_t thread_rt;
+    size_t actual, avail;
+    ASSERT_EQ(mx_object_get_info(handle, MX_INFO_TASK_RUNTIME, &thread_rt, sizeof(thread_rt),
+                                 &actual, &avail), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(avail, 1u, "");
+    EXPECT_GT(thread_rt.cpu_time, 0u, "");
+    EXPECT_GT(thread_rt.voluntary_switches, 0u, "");
+
+    mx_info_task_runtime_t process_rt;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_RUNTIME, &process_rt,
+                                 sizeof(process_rt), NULL, NULL), NO_ERROR, "");
+    EXPECT_GE(process_rt.cpu_time, thread_rt.cpu_time, "");
+    EXPECT_GE(process_rt.voluntary_switches, thread_rt.voluntary_switches, "");
+
+    EXPECT_EQ(mx_object_get_info(handle, MX_INFO_TASK_RUNTIME, &thread_rt, 1, &actual, &avail),
+              ERR_BUFFER_TOO_SMALL, "");
+
+    mxr_thread_destroy(thread);
+
+    END_TEST;
+}
+
+typedef struct {
+    volatile uint64_t count;
+    volatile int stop;
+} sched_share_arg_t;
+
+static void spinner_fn(void* arg) {
+    sched_share_arg_t* a = arg;
+    while (!a->stop)
+        a->count++;
+    mx_thread_exit();
+}
+
+static void waker_fn(void* arg) {
+    sched_share_arg_t* a = arg;
+    while (!a->stop) {
+        mx_nanosleep(MX_USEC(500));
+        a->count++;
+    }
+    mx_thread_exit();
+}
+
+typedef struct {
+    mxr_thread_t* thread;
+    uintptr_t stack;
+    size_t stack_size;
+} pinned_thread_t;
+
+// Pins the thread to cpu 0 before it starts, so it never runs anywhere else.
+static bool start_pinned_thread(const char* name, void (*fn)(void*), void* arg,
+                                pinned_thread_t* out) {
+    BEGIN_HELPER;
+
+    out->stack_size = 64u << 10;
+    mx_handle_t thread_stack_vmo;
+    ASSERT_EQ(mx_vmo_create(out->stack_size, 0, &thread_stack_vmo), NO_ERROR, "");
+    out->stack = 0u;
+    ASSERT_EQ(mx_process_map_vm(mx_process_self(), thread_stack_vmo, 0, out->stack_size,
+                                &out->stack, MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE),
+              NO_ERROR, "");
+    ASSERT_EQ(mx_handle_close(thread_stack_vmo), NO_ERROR, "");
+
+    ASSERT_EQ(mxr_thread_create(name, &out->thread), NO_ERROR, "");
+    int32_t cpu = 0;
+    ASSERT_EQ(mx_object_set_property(mxr_thread_get_handle(out->thread), MX_PROP_SCHED_CPU,
+                                     &cpu, sizeof(cpu)), NO_ERROR, "");
+    ASSERT_EQ(mxr_thread_start(out->thread, out->stack, out->stack_size, fn, arg),
+              NO_ERROR, "");
+
+    END_HELPER;
+}
+
+// Waits for a thread started by start_pinned_thread() to exit, then frees it
+// and its stack.
+static bool join_pinned_thread(pinned_thread_t* t) {
+    BEGIN_HELPER;
+
+    ASSERT_EQ(mx_handle_wait_one(mxr_thread_get_handle(t->thread), MX_SIGNAL_SIGNALED,
+                                 MX_TIME_INFINITE, NULL), NO_ERROR, "");
+    mxr_thread_destroy(t->thread);
+    ASSERT_EQ(mx_process_unmap_vm(mx_process_self(), t->stack, t->stack_size), NO_ERROR, "");
+
+    END_HELPER;
+}
+
+// Two equal priority spinners share a cpu with a thread that wakes up every
+// half millisecond. Every wakeup reschedules the cpu, which must not hand
+// the spinner it lands on a fresh quantum, or the other spinner never runs.
+static bool test_sched_quantum_shared_with_waker(void) {
+    BEGIN_TEST;
+
+    sched_share_arg_t a = {}, b = {}, waker = {};
+    pinned_thread_t threads[3];
+    ASSERT_TRUE(start_pinned_thread("spinner_a", spinner_fn, &a, &threads[0]), "");
+    ASSERT_TRUE(start_pinned_thread("spinner_b", spinner_fn, &b, &threads[1]), "");
+    ASSERT_TRUE(start_pinned_thread("waker", waker_fn, &waker, &threads[2]), "");
+
+    // let them all settle on the cpu before sampling
+    mx_nanosleep(MX_MSEC(100));
+    uint64_t a_start = a.count, b_start = b.count, waker_start = waker.count;
+    mx_nanosleep(MX_MSEC(500));
+    uint64_t a_ran = a.count - a_start, b_ran = b.count - b_start;
+    uint64_t waker_ran = waker.count - waker_start;
+
+    a.stop = b.stop = waker.stop = 1;
+    for (int i = 0; i < 3; i++)
+        ASSERT_TRUE(join_pinned_thread(&threads[i]), "");
+
+    EXPECT_GT(waker_ran, 0u, "waker never woke");
+    EXPECT_GT(a_ran, 0u, "spinner a starved");
+    EXPECT_GT(b_ran, 0u, "spinner b starved");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(threads_tests)
 RUN_TEST(threads_test)
 RUN_TEST(test_thread_start_on_initial_thread)
+RUN_TEST(test_thread_create_start_on_initial_thread)
+RUN_TEST(test_process_start_etc_bad_stack_map)
+RUN_TEST(test_process_start_etc_bad_msg_handle)
 RUN_TEST(test_thread_start_with_zero_instruction_pointer)
+RUN_TEST(test_task_runtime)
+RUN_TEST(test_sched_quantum_shared_with_waker)
 END_TEST_CASE(threads_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -0,0 +1,57 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdbool.h>
+
+#include <magenta/syscalls.h>
+
+#include <unittest/unittest.h>
+
+// mx_time_get() is answered by the vDSO when it can be, so check that it
+// agrees with the kernel's own clock.
+bool time_get_monotonic_test(void) {
+    BEGIN_TEST;
+
+    mx_time_t last = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (int i = 0; i < 1000; i++) {
+        mx_time_t kernel = mx_clock_get(MX_CLOCK_MONOTONIC);
+        mx_time_t vdso = mx_time_get(MX_CLOCK_MONOTONIC);
+        ASSERT_GE(kernel, last, "kernel clock went backwards");
+        ASSERT_GE(vdso, kernel, "vDSO clock behind the kernel's");
+        ASSERT_LT(vdso - kernel, MX_SEC(1), "vDSO clock too far ahead");
+        last = vdso;
+    }
+
+    EXPECT_NEQ(mx_time_get(MX_CLOCK_UTC), 0u, "");
+
+    END_TEST;
+}
+
+bool ticks_test(void) {
+    BEGIN_TEST;
+
+    uint64_t per_second = mx_ticks_per_second();
+    ASSERT_GT(per_second, 0u, "no tick rate");
+
+    uint64_t ticks0 = mx_ticks_get();
+    ASSERT_EQ(mx_nanosleep(MX_MSEC(10)), NO_ERROR, "");
+    uint64_t ticks1 = mx_ticks_get();
+    ASSERT_GT(ticks1, ticks0, "ticks did not advance");
+
+    // At least the 10ms we slept should have gone by.
+    EXPECT_GE(ticks1 - ticks0, per_second / 100u, "too few ticks");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(time_tests)
+RUN_TEST(time_get_monotonic_test)
+RUN_TEST(ticks_test)
+END_TEST_CASE(time_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
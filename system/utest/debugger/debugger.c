@@ -487,6 +487,47 @@ static int __NO_INLINE test_segfault_doit2(int* p)
     return test_segfault_doit1(p) + *p;
 }
 
+// The reads and views are of this process, which are done the same way
+// as of an inferior's.
+
+#define READ_MANY_PAGE 4096
+
+static char read_many_data[2 * READ_MANY_PAGE];
+
+static bool debugger_read_memory_many_test(void)
+{
+    BEGIN_TEST;
+
+    for (size_t i = 0; i < sizeof(read_many_data); ++i)
+        read_many_data[i] = (char)i;
+
+    char buf1[16], buf2[16], buf3[16];
+    mx_process_read_t reads[3] = {
+        { (uintptr_t)read_many_data, buf1, sizeof(buf1), 99 },
+        { 0, buf2, sizeof(buf2), 99 },
+        { (uintptr_t)read_many_data + READ_MANY_PAGE, buf3, sizeof(buf3), 99 },
+    };
+    mx_status_t status = mx_process_read_memory_many(mx_process_self(), reads, 3);
+    ASSERT_EQ(status, NO_ERROR, "mx_process_read_memory_many failed");
+    EXPECT_EQ(reads[0].actual, sizeof(buf1), "");
+    EXPECT_EQ(reads[1].actual, 0u, "unmapped read copied something");
+    EXPECT_EQ(reads[2].actual, sizeof(buf3), "");
+    EXPECT_EQ(memcmp(buf1, read_many_data, sizeof(buf1)), 0, "");
+    EXPECT_EQ(memcmp(buf3, read_many_data + READ_MANY_PAGE, sizeof(buf3)), 0, "");
+
+    uintptr_t view;
+    status = mx_process_map_view(mx_process_self(), (uintptr_t)read_many_data + 1,
+                                 sizeof(read_many_data) - 1, &view);
+    ASSERT_EQ(status, NO_ERROR, "mx_process_map_view failed");
+    EXPECT_EQ(memcmp((void*)view, read_many_data + 1, sizeof(read_many_data) - 1), 0, "");
+    read_many_data[1] = 42;
+    EXPECT_EQ(((volatile char*)view)[0], 42, "view does not share pages");
+    status = mx_process_unmap_vm(mx_process_self(), view, 0);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
 // Produce a crash with a moderately interesting backtrace.
 
 static int __NO_INLINE test_segfault(void)
@@ -499,6 +540,7 @@ static int __NO_INLINE test_segfault(void)
 BEGIN_TEST_CASE(debugger_tests)
 RUN_TEST(debugger_test);
 RUN_TEST(debugger_thread_list_test);
+RUN_TEST(debugger_read_memory_many_test);
 END_TEST_CASE(debugger_tests)
 
 static void check_verbosity(int argc, char** argv)
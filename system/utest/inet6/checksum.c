@@ -0,0 +1,114 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <inet6/inet6.h>
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// the 16 bits at a time sum ip6_sum() replaced
+static uint16_t ref_sum(const void* _data, size_t len, uint16_t _sum) {
+    uint32_t sum = _sum;
+    const uint8_t* data = _data;
+    while (len > 1) {
+        uint16_t w;
+        memcpy(&w, data, sizeof(w));
+        sum += w;
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        uint16_t w = 0;
+        memcpy(&w, data, 1);
+        sum += w;
+    }
+    while (sum > 0xFFFF) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+static uint8_t buf[2048 + 8];
+
+static void fill(uint32_t seed) {
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static bool sum_test(void) {
+    BEGIN_TEST;
+    fill(1);
+    for (size_t align = 0; align < 8; align++) {
+        for (size_t len = 0; len <= 2048; len += (len < 80) ? 1 : 37) {
+            EXPECT_EQ(ip6_sum(buf + align, len, 0), ref_sum(buf + align, len, 0), "");
+            EXPECT_EQ(ip6_sum(buf + align, len, 0x1234), ref_sum(buf + align, len, 0x1234), "");
+        }
+    }
+    // all ones, where the carries pile up
+    memset(buf, 0xFF, sizeof(buf));
+    EXPECT_EQ(ip6_sum(buf, 2048, 0xFFFF), ref_sum(buf, 2048, 0xFFFF), "");
+    END_TEST;
+}
+
+static bool adjust_test(void) {
+    BEGIN_TEST;
+    fill(2);
+    for (size_t off = 0; off < 64; off += 2) {
+        for (size_t len = 2; off + len <= 64; len += 2) {
+            uint16_t before = ~ip6_sum(buf, 64, 0);
+            uint8_t old[64];
+            memcpy(old, buf + off, len);
+            for (size_t i = 0; i < len; i++) {
+                buf[off + i] ^= 0x5A + i;
+            }
+            uint16_t after = ~ip6_sum(buf, 64, 0);
+            uint16_t adjusted = ip6_checksum_adjust(before, old, buf + off, len);
+            // one's complement has two zeros
+            EXPECT_TRUE((adjusted == after) || ((uint16_t)(adjusted + after) == 0xFFFF &&
+                        ((adjusted == 0) || (after == 0))), "");
+        }
+    }
+    END_TEST;
+}
+
+// not a pass or fail, but the case for the wide sum, on frames of the
+// sizes that matter
+static bool sum_bench(void) {
+    BEGIN_TEST;
+    fill(3);
+    static const size_t sizes[] = { 64, 576, 1500 };
+    for (size_t i = 0; i < countof(sizes); i++) {
+        const uint32_t iters = 100000;
+        volatile uint16_t sink = 0;
+        mx_time_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (uint32_t n = 0; n < iters; n++) {
+            sink += ref_sum(buf, sizes[i], n);
+        }
+        mx_time_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (uint32_t n = 0; n < iters; n++) {
+            sink += ip6_sum(buf, sizes[i], n);
+        }
+        mx_time_t t2 = mx_time_get(MX_CLOCK_MONOTONIC);
+        unittest_printf("%4zu bytes: 16 bit sum %" PRIu64 " ns, wide sum %" PRIu64 " ns\n",
+                        sizes[i], (t1 - t0) / iters, (t2 - t1) / iters);
+    }
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(inet6_checksum_tests)
+RUN_TEST(sum_test)
+RUN_TEST(adjust_test)
+RUN_TEST(sum_bench)
+END_TEST_CASE(inet6_checksum_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
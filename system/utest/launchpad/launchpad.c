@@ -63,8 +63,54 @@ static bool launchpad_test(void)
     END_TEST;
 }
 
+static bool launchpad_template_test(void)
+{
+    BEGIN_TEST;
+
+    launchpad_template_t* tmpl = NULL;
+    mx_status_t status = launchpad_template_create(launchpad_vmo_from_file(program_path), &tmpl);
+    ASSERT_EQ(status, NO_ERROR, "launchpad_template_create");
+
+    mx_handle_t mxio_job = mxio_get_startup_handle(MX_HND_INFO(MX_HND_TYPE_JOB, 0));
+    ASSERT_GT(mxio_job, 0, "no mxio job object");
+
+    // The same template loads into any number of processes, the same way
+    // launchpad_elf_load would.
+    for (int i = 0; i < 2; i++) {
+        launchpad_t* lp = NULL;
+        status = launchpad_create(mxio_job, test_inferior_child_name, &lp);
+        ASSERT_EQ(status, NO_ERROR, "launchpad_create");
+
+        status = launchpad_elf_load_template(lp, tmpl);
+        ASSERT_EQ(status, NO_ERROR, "launchpad_elf_load_template");
+        EXPECT_TRUE(launchpad_send_loader_message(lp, false), "dynamic linker not loaded");
+
+        mx_vaddr_t base, entry;
+        status = launchpad_get_base_address(lp, &base);
+        ASSERT_EQ(status, NO_ERROR, "launchpad_get_base_address");
+        status = launchpad_get_entry_address(lp, &entry);
+        ASSERT_EQ(status, NO_ERROR, "launchpad_get_entry_address");
+
+        mx_handle_t dynld_vmo = launchpad_vmo_from_file(dynld_path);
+        ASSERT_GT(dynld_vmo, 0, "launchpad_vmo_from_file");
+        elf_load_header_t header;
+        uintptr_t phoff;
+        status = elf_load_prepare(dynld_vmo, &header, &phoff);
+        ASSERT_EQ(status, NO_ERROR, "elf_load_prepare");
+        ASSERT_EQ(entry, base + header.e_entry, "bad value for base or entry");
+        mx_handle_close(dynld_vmo);
+
+        launchpad_destroy(lp);
+    }
+
+    launchpad_template_destroy(tmpl);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(launchpad_test);
+RUN_TEST(launchpad_template_test);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv)
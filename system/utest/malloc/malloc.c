@@ -0,0 +1,96 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unittest/unittest.h>
+
+#define NUM_THREADS 4
+#define ITERATIONS 20000
+#define SLOTS 64
+
+// Each thread keeps a set of live allocations of mixed small sizes,
+// replacing a pseudo-random one each round and checking that what it
+// wrote into the old one is still there.
+static void* stress_thread(void* arg) {
+    uint32_t seed = (uint32_t)(uintptr_t)arg;
+    unsigned char* slots[SLOTS] = {};
+    size_t sizes[SLOTS] = {};
+    bool ok = true;
+
+    for (int i = 0; i < ITERATIONS && ok; i++) {
+        seed = seed * 1103515245 + 12345;
+        int slot = (seed >> 16) % SLOTS;
+        if (slots[slot] != NULL) {
+            for (size_t j = 0; j < sizes[slot]; j++) {
+                if (slots[slot][j] != (unsigned char)(slot + sizes[slot])) {
+                    ok = false;
+                    break;
+                }
+            }
+            free(slots[slot]);
+        }
+        sizes[slot] = (seed >> 8) % 256 + 1;
+        slots[slot] = malloc(sizes[slot]);
+        if (slots[slot] == NULL) {
+            ok = false;
+            break;
+        }
+        memset(slots[slot], slot + sizes[slot], sizes[slot]);
+    }
+
+    for (int i = 0; i < SLOTS; i++)
+        free(slots[i]);
+    return ok ? NULL : (void*)1;
+}
+
+bool malloc_threads_test(void) {
+    BEGIN_TEST;
+
+    pthread_t threads[NUM_THREADS];
+    for (uintptr_t i = 0; i < NUM_THREADS; i++)
+        ASSERT_EQ(pthread_create(&threads[i], NULL, stress_thread, (void*)(i + 1)), 0,
+                  "pthread_create failed");
+    for (int i = 0; i < NUM_THREADS; i++) {
+        void* result;
+        ASSERT_EQ(pthread_join(threads[i], &result), 0, "pthread_join failed");
+        EXPECT_NULL(result, "allocation was corrupted or failed");
+    }
+
+    END_TEST;
+}
+
+bool mallinfo_test(void) {
+    BEGIN_TEST;
+
+    struct mallinfo before = mallinfo();
+    EXPECT_GT(before.arena, 0, "no heap");
+    EXPECT_EQ(before.uordblks + before.fordblks, before.arena, "heap doesn't add up");
+
+    // big enough to be mapped on its own
+    void* big = malloc(1 << 20);
+    ASSERT_NONNULL(big, "malloc failed");
+    struct mallinfo during = mallinfo();
+    EXPECT_EQ(during.hblks, before.hblks + 1, "mapped chunk not counted");
+    EXPECT_GE(during.hblkhd, before.hblkhd + (1 << 20), "mapped bytes not counted");
+    free(big);
+
+    struct mallinfo after = mallinfo();
+    EXPECT_EQ(after.hblks, before.hblks, "mapped chunk still counted");
+    EXPECT_EQ(after.hblkhd, before.hblkhd, "mapped bytes still counted");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(malloc_tests)
+RUN_TEST(malloc_threads_test)
+RUN_TEST(mallinfo_test)
+END_TEST_CASE(malloc_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
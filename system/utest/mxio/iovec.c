@@ -0,0 +1,85 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <mxio/io.h>
+#include <unittest/unittest.h>
+
+// any file that is sure to be in bootfs
+static const char test_file[] = "/boot/lib/ld.so.1";
+
+bool readv_writev_test(void) {
+    BEGIN_TEST;
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0, "pipe() failed");
+
+    // small enough to go as one write, and read back as one
+    char a[] = "abc", b[] = "defgh";
+    struct iovec out[] = {{a, 3}, {NULL, 0}, {b, 5}};
+    EXPECT_EQ(writev(fds[1], out, 3), 8, "");
+    char c[2], d[16];
+    struct iovec in[] = {{c, 2}, {d, sizeof(d)}};
+    EXPECT_EQ(readv(fds[0], in, 2), 8, "");
+    EXPECT_EQ(memcmp(c, "ab", 2), 0, "");
+    EXPECT_EQ(memcmp(d, "cdefgh", 6), 0, "");
+
+    // bigger than a chunk: the reads after the first don't wait for more
+    static char big[3 * MXIO_CHUNK_SIZE];
+    memset(big, 'x', sizeof(big));
+    struct iovec big_out[] = {{big, sizeof(big) / 2}, {big + sizeof(big) / 2, sizeof(big) / 2}};
+    EXPECT_EQ(writev(fds[1], big_out, 2), (ssize_t)sizeof(big), "");
+    static char big_in[sizeof(big) + 100];
+    struct iovec big_iov[] = {{big_in, sizeof(big)}, {big_in + sizeof(big), 100}};
+    EXPECT_EQ(readv(fds[0], big_iov, 2), (ssize_t)sizeof(big), "");
+    EXPECT_EQ(memcmp(big_in, big, sizeof(big)), 0, "");
+
+    // pipes have no position
+    EXPECT_EQ(pread(fds[0], c, 1, 0), -1, "");
+    EXPECT_EQ(errno, ESPIPE, "");
+
+    close(fds[0]);
+    close(fds[1]);
+    END_TEST;
+}
+
+bool pread_test(void) {
+    BEGIN_TEST;
+
+    int fd = open(test_file, O_RDONLY);
+    ASSERT_GE(fd, 0, "cannot open test file");
+    char whole[64];
+    ASSERT_EQ(read(fd, whole, sizeof(whole)), (ssize_t)sizeof(whole), "");
+
+    // pread leaves the position alone
+    char part[8];
+    EXPECT_EQ(pread(fd, part, sizeof(part), 4), (ssize_t)sizeof(part), "");
+    EXPECT_EQ(memcmp(part, whole + 4, sizeof(part)), 0, "");
+    EXPECT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)sizeof(whole), "");
+
+    char x[3], y[5];
+    struct iovec iov[] = {{x, sizeof(x)}, {y, sizeof(y)}};
+    EXPECT_EQ(preadv(fd, iov, 2, 1), 8, "");
+    EXPECT_EQ(memcmp(x, whole + 1, 3), 0, "");
+    EXPECT_EQ(memcmp(y, whole + 4, 5), 0, "");
+
+    EXPECT_EQ(pread(fd, part, sizeof(part), -1), -1, "");
+    EXPECT_EQ(errno, EINVAL, "");
+
+    close(fd);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(iovec_test)
+RUN_TEST(readv_writev_test);
+RUN_TEST(pread_test);
+END_TEST_CASE(iovec_test)
@@ -0,0 +1,120 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <unittest/unittest.h>
+
+// any file that is sure to be in bootfs
+static const char test_file[] = "/boot/lib/ld.so.1";
+
+bool mmap_shared_test(void) {
+    BEGIN_TEST;
+
+    int fd = open(test_file, O_RDONLY);
+    ASSERT_GE(fd, 0, "cannot open test file");
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0, "");
+    ASSERT_GT(st.st_size, 4, "");
+
+    uint8_t* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NEQ(p, MAP_FAILED, "mmap() failed");
+
+    // the mapping holds what read() returns
+    uint8_t buf[PAGE_SIZE];
+    size_t n = st.st_size < PAGE_SIZE ? st.st_size : PAGE_SIZE;
+    ASSERT_EQ(read(fd, buf, n), (ssize_t)n, "");
+    EXPECT_EQ(memcmp(p, buf, n), 0, "mapping differs from the file");
+    EXPECT_EQ(memcmp(p, "\177ELF", 4), 0, "");
+
+    EXPECT_EQ(munmap(p, st.st_size), 0, "");
+
+    // bootfs is read-only, so it can't be shared writable
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    EXPECT_EQ(p, MAP_FAILED, "");
+    EXPECT_EQ(errno, EACCES, "");
+
+    // nor mapped past its end
+    p = mmap(NULL, PAGE_SIZE, PROT_READ, MAP_SHARED, fd,
+             (st.st_size + PAGE_SIZE - 1) & -PAGE_SIZE);
+    EXPECT_EQ(p, MAP_FAILED, "");
+
+    close(fd);
+    END_TEST;
+}
+
+bool mmap_private_test(void) {
+    BEGIN_TEST;
+
+    int fd = open(test_file, O_RDONLY);
+    ASSERT_GE(fd, 0, "cannot open test file");
+
+    uint8_t* p = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ASSERT_NEQ(p, MAP_FAILED, "mmap() failed");
+    EXPECT_EQ(memcmp(p, "\177ELF", 4), 0, "");
+
+    // writes stay in the private copy
+    memset(p, 0, 4);
+    uint8_t buf[4];
+    ASSERT_EQ(read(fd, buf, 4), 4, "");
+    EXPECT_EQ(memcmp(buf, "\177ELF", 4), 0, "file changed by a private mapping");
+
+    uint8_t* q = mmap(NULL, PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    ASSERT_NEQ(q, MAP_FAILED, "mmap() failed");
+    EXPECT_EQ(memcmp(q, "\177ELF", 4), 0, "other mappings changed");
+
+    EXPECT_EQ(munmap(p, PAGE_SIZE), 0, "");
+    EXPECT_EQ(munmap(q, PAGE_SIZE), 0, "");
+    close(fd);
+    END_TEST;
+}
+
+// memfs files live in a VMO of their own, so they can be shared writable
+bool mmap_memfs_test(void) {
+    BEGIN_TEST;
+
+    const char* path = "/tmp/mmap-memfs-test";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0, "cannot create test file");
+    ASSERT_EQ(write(fd, "hello", 5), 5, "");
+
+    uint8_t* p = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NEQ(p, MAP_FAILED, "mmap() failed");
+    EXPECT_EQ(memcmp(p, "hello", 5), 0, "");
+
+    // stores through the mapping are in the file, and writes in the mapping
+    memcpy(p, "HE", 2);
+    ASSERT_EQ(pwrite(fd, "LLO", 3, 2), 3, "");
+    uint8_t buf[5];
+    ASSERT_EQ(pread(fd, buf, 5, 0), 5, "");
+    EXPECT_EQ(memcmp(buf, "HELLO", 5), 0, "file doesn't see the mapping");
+    EXPECT_EQ(memcmp(p, "HELLO", 5), 0, "mapping doesn't see the file");
+    EXPECT_EQ(munmap(p, PAGE_SIZE), 0, "");
+
+    // no cap on the size, and what's cut off by a truncate stays gone
+    const off_t far = 256 * 1024 * 1024;
+    ASSERT_EQ(pwrite(fd, "x", 1, far), 1, "cannot write far into the file");
+    ASSERT_EQ(ftruncate(fd, 2), 0, "");
+    ASSERT_EQ(ftruncate(fd, 5), 0, "");
+    ASSERT_EQ(pread(fd, buf, 5, 0), 5, "");
+    EXPECT_EQ(memcmp(buf, "HE\0\0\0", 5), 0, "truncated data came back");
+
+    close(fd);
+    EXPECT_EQ(unlink(path), 0, "");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(mmap_test)
+RUN_TEST(mmap_shared_test);
+RUN_TEST(mmap_private_test);
+RUN_TEST(mmap_memfs_test);
+END_TEST_CASE(mmap_test)
@@ -4,9 +4,11 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <threads.h>
 #include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -60,6 +62,49 @@ bool epoll_test(void) {
     END_TEST;
 }
 
+bool epoll_many_test(void) {
+    BEGIN_TEST;
+
+    enum { num_fds = 32 };
+    mx_handle_t h[num_fds];
+    int fds[num_fds];
+    int epollfd = epoll_create(0);
+    ASSERT_GT(epollfd, 0, "epoll_create() failed");
+
+    for (int i = 0; i < num_fds; i++) {
+        ASSERT_EQ(NO_ERROR, mx_event_create(0u, &h[i]), "mx_event_create() failed");
+        fds[i] = mxio_handle_fd(h[i], MX_USER_SIGNAL_0, MX_USER_SIGNAL_1, false);
+        ASSERT_GT(fds[i], 0, "mxio_handle_fd() failed");
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        ASSERT_EQ(0, epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[i], &ev), "epoll_ctl() failed");
+    }
+    struct epoll_event ev = { .events = EPOLLIN };
+    EXPECT_EQ(-1, epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[0], &ev), "added twice");
+
+    // only the ready fds are reported
+    ASSERT_EQ(NO_ERROR, mx_object_signal(h[5], 0u, MX_USER_SIGNAL_0), "");
+    ASSERT_EQ(NO_ERROR, mx_object_signal(h[17], 0u, MX_USER_SIGNAL_0), "");
+    struct epoll_event events[num_fds];
+    int nfds = epoll_wait(epollfd, events, num_fds, 0);
+    ASSERT_EQ(nfds, 2, "");
+    EXPECT_EQ(events[0].data.u32 + events[1].data.u32, 5u + 17u, "");
+
+    // a removed fd is not reported, and one added again reports its new data
+    EXPECT_EQ(0, epoll_ctl(epollfd, EPOLL_CTL_DEL, fds[5], NULL), "");
+    ev.data.u32 = 100;
+    EXPECT_EQ(0, epoll_ctl(epollfd, EPOLL_CTL_MOD, fds[17], &ev), "");
+    nfds = epoll_wait(epollfd, events, num_fds, 0);
+    ASSERT_EQ(nfds, 1, "");
+    EXPECT_EQ(events[0].data.u32, 100u, "");
+
+    for (int i = 0; i < num_fds; i++) {
+        close(fds[i]);
+    }
+    close(epollfd);
+
+    END_TEST;
+}
+
 bool close_test(void) {
     BEGIN_TEST;
 
@@ -128,10 +173,54 @@ bool pipe_test(void) {
     END_TEST;
 }
 
+static int lookup_fd;
+static atomic_bool lookup_done;
+
+static int lookup_thread(void* arg) {
+    while (!atomic_load(&lookup_done)) {
+        int available;
+        ioctl(lookup_fd, FIONREAD, &available);
+    }
+    return 0;
+}
+
+// fd lookups don't take the fdtab lock, so race them against the slot
+// being emptied and refilled
+bool fd_lookup_race_test(void) {
+    BEGIN_TEST;
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0, "pipe() failed");
+    lookup_fd = dup(fds[0]);
+    ASSERT_GE(lookup_fd, 0, "dup() failed");
+    atomic_store(&lookup_done, false);
+
+    enum { num_threads = 4 };
+    thrd_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], lookup_thread, NULL), thrd_success, "");
+    }
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(close(lookup_fd), 0, "");
+        EXPECT_EQ(dup2(fds[i & 1], lookup_fd), lookup_fd, "dup2() failed");
+    }
+    atomic_store(&lookup_done, true);
+    for (int i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    close(lookup_fd);
+    close(fds[0]);
+    close(fds[1]);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(mxio_handle_fd_test)
 RUN_TEST(epoll_test);
+RUN_TEST(epoll_many_test);
 RUN_TEST(close_test);
 RUN_TEST(pipe_test);
+RUN_TEST(fd_lookup_race_test);
 END_TEST_CASE(mxio_handle_fd_test)
 
 int main(int argc, char** argv) {
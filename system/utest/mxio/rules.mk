@@ -9,6 +9,8 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := usertest
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/iovec.c \
+    $(LOCAL_DIR)/mmap.c \
     $(LOCAL_DIR)/mxio_handle_fd.c
 
 MODULE_NAME := mxio-test
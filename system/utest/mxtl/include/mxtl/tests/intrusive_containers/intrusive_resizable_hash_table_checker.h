@@ -0,0 +1,61 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <unittest/unittest.h>
+#include <mxtl/intrusive_resizable_hash_table.h>
+#include <mxtl/tests/intrusive_containers/intrusive_doubly_linked_list_checker.h>
+#include <mxtl/tests/intrusive_containers/intrusive_singly_linked_list_checker.h>
+#include <mxtl/tests/intrusive_containers/test_environment_utils.h>
+
+namespace mxtl {
+namespace tests {
+namespace intrusive_containers {
+
+// The resizable hash table sanity checker implementation is shared across
+// ResizableHashTables of all bucket types.
+class ResizableHashTableChecker {
+public:
+    template <typename ContainerType>
+    static bool SanityCheck(const ContainerType& container) {
+        using BucketType    = typename ContainerType::BucketType;
+        using BucketChecker = typename BucketType::CheckerType;
+        using KeyTraits     = typename ContainerType::KeyTraits;
+
+        BEGIN_TEST;
+
+        // While growing, the buckets of the old array which have been moved
+        // must be empty, and there must be some left to move.
+        if (container.old_buckets_ != nullptr) {
+            ASSERT_LT(container.rehash_ndx_, container.old_bucket_count(), "");
+            for (size_t i = 0; i < container.rehash_ndx_; ++i)
+                ASSERT_TRUE(container.old_buckets_[i].is_empty(), "");
+        } else {
+            EXPECT_EQ(container.rehash_ndx_, 0u, "");
+        }
+
+        // Demand that every bucket pass its sanity check.  Keep a running total
+        // of the total size of the table in the process.
+        size_t total_size = 0;
+        for (size_t i = 0; i < container.total_buckets(); ++i) {
+            const BucketType& bucket = container.GetBucket(i);
+            ASSERT_TRUE(BucketChecker::SanityCheck(bucket), "");
+            total_size += SizeUtils<BucketType>::size(bucket);
+
+            // For every element in the bucket, make sure that it is the
+            // bucket its key says it should be in.
+            for (const auto& obj : bucket)
+                ASSERT_EQ(container.BucketNdx(KeyTraits::GetKey(obj)), i, "");
+        }
+
+        EXPECT_EQ(container.size(), total_size, "");
+
+        END_TEST;
+    }
+};
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace mxtl
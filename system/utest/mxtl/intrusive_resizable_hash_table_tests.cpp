@@ -0,0 +1,313 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <unittest/unittest.h>
+#include <mxtl/intrusive_double_list.h>
+#include <mxtl/intrusive_resizable_hash_table.h>
+#include <mxtl/tests/intrusive_containers/associative_container_test_environment.h>
+#include <mxtl/tests/intrusive_containers/intrusive_resizable_hash_table_checker.h>
+#include <mxtl/tests/intrusive_containers/test_thunks.h>
+
+namespace mxtl {
+namespace tests {
+namespace intrusive_containers {
+
+using OtherKeyType  = uint16_t;
+using OtherHashType = uint32_t;
+
+template <typename PtrType>
+struct OtherHashTraits {
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+    using BucketStateType = DoublyLinkedListNodeState<PtrType>;
+
+    // Linked List Traits
+    static BucketStateType& node_state(ObjType& obj) {
+        return obj.other_container_state_.bucket_state_;
+    }
+
+    // Keyed Object Traits
+    static OtherKeyType GetKey(const ObjType& obj) {
+        return obj.other_container_state_.key_;
+    }
+
+    static bool LessThan(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 <  key2;
+    }
+
+    static bool EqualTo(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 == key2;
+    }
+
+    // Hash Traits
+    static OtherHashType GetHash(const OtherKeyType& key) {
+        return static_cast<OtherHashType>(key * 0xaee58187);
+    }
+
+    // Set key is a trait which is only used by the tests, not by the containers
+    // themselves.
+    static void SetKey(ObjType& obj, OtherKeyType key) {
+        obj.other_container_state_.key_ = key;
+    }
+};
+
+template <typename PtrType>
+struct OtherHashState {
+private:
+    friend struct OtherHashTraits<PtrType>;
+    OtherKeyType key_;
+    typename OtherHashTraits<PtrType>::BucketStateType bucket_state_;
+};
+
+// The test environments only use a handful of objects, so grow early and
+// slowly, to have them grow and be part way through growing as much as they
+// can.
+struct EagerResizePolicy {
+    static constexpr size_t kMinBuckets = 2;
+    static constexpr size_t kMaxBuckets = 1u << 20;
+    static constexpr size_t kRehashStep = 1;
+
+    static bool ShouldGrow(size_t count, size_t num_buckets) {
+        return count > num_buckets;
+    }
+};
+
+// The table maps hashes to buckets itself, so the identity will do.
+template <typename KeyType, typename HashType>
+class ResizableHashedTestObjBase : public KeyedTestObjBase<KeyType>  {
+public:
+    explicit ResizableHashedTestObjBase(size_t val) : KeyedTestObjBase<KeyType>(val) { }
+
+    static HashType GetHash(const KeyType& key) {
+        return static_cast<HashType>(key);
+    }
+};
+
+template <typename PtrType>
+class RHTTraits {
+public:
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+
+    using ContainerType           = ResizableHashTable<
+                                        size_t, PtrType, DoublyLinkedList<PtrType>, size_t,
+                                        DefaultKeyedObjectTraits<size_t, ObjType>,
+                                        DefaultResizableHashTraits<size_t, ObjType, size_t>,
+                                        EagerResizePolicy>;
+    using ContainableBaseClass    = DoublyLinkedListable<PtrType>;
+    using ContainerStateType      = DoublyLinkedListNodeState<PtrType>;
+    using KeyType                 = typename ContainerType::KeyType;
+    using HashType                = typename ContainerType::HashType;
+
+    using OtherContainerTraits    = OtherHashTraits<PtrType>;
+    using OtherContainerStateType = OtherHashState<PtrType>;
+    using OtherBucketType         = DoublyLinkedList<PtrType, OtherContainerTraits>;
+    using OtherContainerType      = ResizableHashTable<OtherKeyType,
+                                                       PtrType,
+                                                       OtherBucketType,
+                                                       OtherHashType,
+                                                       OtherContainerTraits,
+                                                       OtherContainerTraits,
+                                                       EagerResizePolicy>;
+
+    using TestObjBaseType  = ResizableHashedTestObjBase<typename ContainerType::KeyType,
+                                                        typename ContainerType::HashType>;
+};
+
+DEFINE_TEST_OBJECTS(RHT);
+using UMTE = DEFINE_TEST_THUNK(Associative, RHT, Unmanaged);
+using UPTE = DEFINE_TEST_THUNK(Associative, RHT, UniquePtr);
+using RPTE = DEFINE_TEST_THUNK(Associative, RHT, RefPtr);
+
+// Objects for the growth tests, which need more of them than the test
+// environments make.
+struct GrowthObj : public DoublyLinkedListable<GrowthObj*> {
+    size_t GetKey() const { return key_; }
+    static size_t GetHash(const size_t& key) { return key; }
+    size_t key_ = 0;
+};
+
+struct SmallResizePolicy {
+    static constexpr size_t kMinBuckets = 2;
+    static constexpr size_t kMaxBuckets = 4;
+    static constexpr size_t kRehashStep = 1;
+
+    static bool ShouldGrow(size_t count, size_t num_buckets) {
+        return count > num_buckets;
+    }
+};
+
+using GrowthTable = ResizableHashTable<size_t, GrowthObj*, DoublyLinkedList<GrowthObj*>>;
+using SmallTable  = ResizableHashTable<size_t, GrowthObj*, DoublyLinkedList<GrowthObj*>, size_t,
+                                       DefaultKeyedObjectTraits<size_t, GrowthObj>,
+                                       DefaultResizableHashTraits<size_t, GrowthObj, size_t>,
+                                       SmallResizePolicy>;
+
+static constexpr size_t kGrowthObjCount = 1000;
+static GrowthObj growth_objs[kGrowthObjCount];
+
+static bool GrowTest() {
+    BEGIN_TEST;
+
+    GrowthTable table;
+    EXPECT_EQ(table.bucket_count(), 1u, "");
+
+    // The keys are spread out, with the low bits the same, to give the
+    // mapping from hashes to buckets something to do.
+    for (size_t i = 0; i < kGrowthObjCount; ++i) {
+        growth_objs[i].key_ = i << 8;
+        table.insert(&growth_objs[i]);
+        ASSERT_TRUE(GrowthTable::CheckerType::SanityCheck(table), "");
+    }
+    EXPECT_EQ(table.size(), kGrowthObjCount, "");
+    EXPECT_GE(table.bucket_count() * 2, kGrowthObjCount, "");
+
+    for (size_t i = 0; i < kGrowthObjCount; ++i) {
+        auto iter = table.find(i << 8);
+        ASSERT_TRUE(iter.IsValid(), "");
+        EXPECT_EQ(&(*iter), &growth_objs[i], "");
+    }
+
+    // Erasing while iterating doesn't move anything.
+    size_t buckets = table.bucket_count();
+    for (auto iter = table.begin(); iter.IsValid(); ) {
+        if ((iter->key_ >> 8) & 1)
+            table.erase(iter++);
+        else
+            ++iter;
+    }
+    ASSERT_TRUE(GrowthTable::CheckerType::SanityCheck(table), "");
+    EXPECT_EQ(table.size(), kGrowthObjCount / 2, "");
+    EXPECT_EQ(table.bucket_count(), buckets, "");
+    for (size_t i = 0; i < kGrowthObjCount; ++i)
+        EXPECT_EQ(table.find(i << 8).IsValid(), !(i & 1), "");
+
+    table.clear();
+    EXPECT_TRUE(table.is_empty(), "");
+    EXPECT_EQ(table.bucket_count(), 1u, "");
+
+    END_TEST;
+}
+
+static bool MaxBucketsTest() {
+    BEGIN_TEST;
+
+    SmallTable table;
+    for (size_t i = 0; i < 100; ++i) {
+        growth_objs[i].key_ = i;
+        table.insert(&growth_objs[i]);
+    }
+    ASSERT_TRUE(SmallTable::CheckerType::SanityCheck(table), "");
+    EXPECT_EQ(table.bucket_count(), SmallResizePolicy::kMaxBuckets, "");
+    for (size_t i = 0; i < 100; ++i)
+        EXPECT_TRUE(table.find(i).IsValid(), "");
+
+    table.clear();
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(resizable_hashtable_tests)
+//////////////////////////////////////////
+// General container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Clear (unmanaged)",            UMTE::ClearTest)
+RUN_NAMED_TEST("Clear (unique)",               UPTE::ClearTest)
+RUN_NAMED_TEST("Clear (RefPtr)",               RPTE::ClearTest)
+
+RUN_NAMED_TEST("IsEmpty (unmanaged)",          UMTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (unique)",             UPTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (RefPtr)",             RPTE::IsEmptyTest)
+
+RUN_NAMED_TEST("Iterate (unmanaged)",          UMTE::IterateTest)
+RUN_NAMED_TEST("Iterate (unique)",             UPTE::IterateTest)
+RUN_NAMED_TEST("Iterate (RefPtr)",             RPTE::IterateTest)
+
+RUN_NAMED_TEST("IterErase (unmanaged)",        UMTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (unique)",           UPTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (RefPtr)",           RPTE::IterEraseTest)
+
+RUN_NAMED_TEST("DirectErase (unmanaged)",      UMTE::DirectEraseTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("DirectErase (unique)",         UPTE::DirectEraseTest)
+#endif
+RUN_NAMED_TEST("DirectErase (RefPtr)",         RPTE::DirectEraseTest)
+
+RUN_NAMED_TEST("MakeIterator (unmanaged)",     UMTE::MakeIteratorTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("MakeIterator (unique)",        UPTE::MakeIteratorTest)
+#endif
+RUN_NAMED_TEST("MakeIterator (RefPtr)",        RPTE::MakeIteratorTest)
+
+RUN_NAMED_TEST("ReverseIterErase (unmanaged)", UMTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (unique)",    UPTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (RefPtr)",    RPTE::ReverseIterEraseTest)
+
+RUN_NAMED_TEST("ReverseIterate (unmanaged)",   UMTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (unique)",      UPTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (RefPtr)",      RPTE::ReverseIterateTest)
+
+// Hash tables do not support swapping or Rvalue operations (Assignment or
+// construction) as doing so would be an O(n) operation (With 'n' == to the
+// number of buckets in the hashtable)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("Swap (unmanaged)",             UMTE::SwapTest)
+RUN_NAMED_TEST("Swap (unique)",                UPTE::SwapTest)
+RUN_NAMED_TEST("Swap (RefPtr)",                RPTE::SwapTest)
+
+RUN_NAMED_TEST("Rvalue Ops (unmanaged)",       UMTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (unique)",          UPTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (RefPtr)",          RPTE::RvalueOpsTest)
+#endif
+
+RUN_NAMED_TEST("Scope (unique)",               UPTE::ScopeTest)
+RUN_NAMED_TEST("Scope (RefPtr)",               RPTE::ScopeTest)
+
+RUN_NAMED_TEST("TwoContainer (unmanaged)",     UMTE::TwoContainerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("TwoContainer (unique)",        UPTE::TwoContainerTest)
+#endif
+RUN_NAMED_TEST("TwoContainer (RefPtr)",        RPTE::TwoContainerTest)
+
+RUN_NAMED_TEST("IterCopyPointer (unmanaged)",  UMTE::IterCopyPointerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("IterCopyPointer (unique)",     UPTE::IterCopyPointerTest)
+#endif
+RUN_NAMED_TEST("IterCopyPointer (RefPtr)",     RPTE::IterCopyPointerTest)
+
+RUN_NAMED_TEST("EraseIf (unmanaged)",          UMTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (unique)",             UPTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (RefPtr)",             RPTE::EraseIfTest)
+
+RUN_NAMED_TEST("FindIf (unmanaged)",           UMTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (unique)",              UPTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (RefPtr)",              RPTE::FindIfTest)
+
+//////////////////////////////////////////
+// Associative container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("InsertByKey (unmanaged)",      UMTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (unique)",         UPTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (RefPtr)",         RPTE::InsertByKeyTest)
+
+RUN_NAMED_TEST("FindByKey (unmanaged)",        UMTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (unique)",           UPTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (RefPtr)",           RPTE::FindByKeyTest)
+
+RUN_NAMED_TEST("EraseByKey (unmanaged)",       UMTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (unique)",          UPTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (RefPtr)",          RPTE::EraseByKeyTest)
+
+RUN_NAMED_TEST("InsertOrFind (unmanaged)",     UMTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (unique)",        UPTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (RefPtr)",        RPTE::InsertOrFindTest)
+
+//////////////////////////////////////////
+// Resizing specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Grow",                         GrowTest)
+RUN_NAMED_TEST("MaxBuckets",                   MaxBucketsTest)
+END_TEST_CASE(resizable_hashtable_tests);
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace mxtl
@@ -0,0 +1,252 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <mxtl/mpsc_queue.h>
+#include <mxtl/spsc_ring.h>
+
+#include <magenta/new.h>
+#include <mxtl/ref_counted.h>
+#include <mxtl/ref_ptr.h>
+#include <mxtl/unique_ptr.h>
+#include <sched.h>
+#include <threads.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+constexpr uint32_t kProducerCount = 4u;
+constexpr uint32_t kItemsPerProducer = 10000u;
+
+struct RawItem : public mxtl::MpscQueueable<RawItem*> {
+    uint32_t producer = 0;
+    uint32_t seq = 0;
+};
+
+struct UniqueItem : public mxtl::MpscQueueable<mxtl::unique_ptr<UniqueItem>> {
+    explicit UniqueItem(uint32_t v) : val(v) { live_count++; }
+    ~UniqueItem() { live_count--; }
+
+    uint32_t val;
+    static size_t live_count;
+};
+size_t UniqueItem::live_count = 0u;
+
+struct RefItem : public mxtl::MpscQueueable<mxtl::RefPtr<RefItem>>,
+                 public mxtl::RefCounted<RefItem> {
+    explicit RefItem(uint32_t v) : val(v) { live_count++; }
+    ~RefItem() { live_count--; }
+
+    int refs() const { return ref_count_debug(); }
+
+    uint32_t val;
+    static size_t live_count;
+};
+size_t RefItem::live_count = 0u;
+
+bool mpsc_fifo_order_test() {
+    BEGIN_TEST;
+
+    RawItem items[8];
+    mxtl::MpscQueue<RawItem*> queue;
+    EXPECT_TRUE(queue.is_empty(), "");
+    EXPECT_NULL(queue.pop(), "");
+
+    // Interleave pushes with pops so that both the consumer's list and the
+    // producers' stack are non-empty at once.
+    for (uint32_t i = 0; i < 4; ++i) {
+        items[i].seq = i;
+        queue.push(&items[i]);
+    }
+    EXPECT_TRUE(queue.pop() == &items[0], "");
+    for (uint32_t i = 4; i < countof(items); ++i) {
+        items[i].seq = i;
+        queue.push(&items[i]);
+    }
+    EXPECT_FALSE(queue.is_empty(), "");
+    for (uint32_t i = 1; i < countof(items); ++i)
+        EXPECT_TRUE(queue.pop() == &items[i], "");
+
+    EXPECT_TRUE(queue.is_empty(), "");
+    EXPECT_NULL(queue.pop(), "");
+
+    END_TEST;
+}
+
+bool mpsc_managed_test() {
+    BEGIN_TEST;
+
+    {
+        mxtl::MpscQueue<mxtl::unique_ptr<UniqueItem>> queue;
+        for (uint32_t i = 0; i < 5; ++i) {
+            AllocChecker ac;
+            mxtl::unique_ptr<UniqueItem> item(new (&ac) UniqueItem(i));
+            ASSERT_TRUE(ac.check(), "");
+            queue.push(mxtl::move(item));
+        }
+        EXPECT_EQ(5u, UniqueItem::live_count, "");
+
+        auto item = queue.pop();
+        ASSERT_NONNULL(item, "");
+        EXPECT_EQ(0u, item->val, "");
+        item.reset();
+        EXPECT_EQ(4u, UniqueItem::live_count, "");
+
+        // The rest are released when the queue goes out of scope.
+    }
+    EXPECT_EQ(0u, UniqueItem::live_count, "");
+
+    {
+        mxtl::MpscQueue<mxtl::RefPtr<RefItem>> queue;
+        AllocChecker ac;
+        auto held = mxtl::AdoptRef(new (&ac) RefItem(7));
+        ASSERT_TRUE(ac.check(), "");
+
+        queue.push(held);
+        EXPECT_EQ(2, held->refs(), "");
+        auto popped = queue.pop();
+        EXPECT_TRUE(held == popped, "");
+        popped.reset();
+        EXPECT_EQ(1, held->refs(), "");
+
+        queue.push(held);
+        held.reset();
+        EXPECT_EQ(1u, RefItem::live_count, "");
+        queue.clear();
+        EXPECT_EQ(0u, RefItem::live_count, "");
+    }
+
+    END_TEST;
+}
+
+struct MpscProducerArgs {
+    mxtl::MpscQueue<RawItem*>* queue;
+    RawItem* items;
+};
+
+int mpsc_producer(void* arg) {
+    auto args = static_cast<MpscProducerArgs*>(arg);
+    for (uint32_t i = 0; i < kItemsPerProducer; ++i)
+        args->queue->push(&args->items[i]);
+    return 0;
+}
+
+bool mpsc_multi_producer_test() {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<RawItem[]> items(new (&ac) RawItem[kProducerCount * kItemsPerProducer]);
+    ASSERT_TRUE(ac.check(), "");
+
+    mxtl::MpscQueue<RawItem*> queue;
+    MpscProducerArgs args[kProducerCount];
+    thrd_t threads[kProducerCount];
+
+    for (uint32_t p = 0; p < kProducerCount; ++p) {
+        args[p].queue = &queue;
+        args[p].items = &items[p * kItemsPerProducer];
+        for (uint32_t i = 0; i < kItemsPerProducer; ++i) {
+            args[p].items[i].producer = p;
+            args[p].items[i].seq = i;
+        }
+    }
+    for (uint32_t p = 0; p < kProducerCount; ++p)
+        ASSERT_EQ(thrd_create(&threads[p], mpsc_producer, &args[p]), thrd_success, "");
+
+    // Every item must arrive exactly once, and each producer's items must
+    // arrive in the order it pushed them.
+    uint32_t next_seq[kProducerCount] = { };
+    uint32_t received = 0;
+    while (received < kProducerCount * kItemsPerProducer) {
+        RawItem* item = queue.pop();
+        if (item == nullptr) {
+            sched_yield();
+            continue;
+        }
+        ASSERT_LT(item->producer, kProducerCount, "");
+        ASSERT_EQ(next_seq[item->producer], item->seq, "");
+        next_seq[item->producer]++;
+        received++;
+    }
+
+    for (uint32_t p = 0; p < kProducerCount; ++p)
+        thrd_join(threads[p], NULL);
+    EXPECT_TRUE(queue.is_empty(), "");
+
+    END_TEST;
+}
+
+bool spsc_basic_test() {
+    BEGIN_TEST;
+
+    mxtl::SpscRing<uint32_t, 4> ring;
+    uint32_t val;
+
+    EXPECT_EQ(4u, ring.capacity(), "");
+    EXPECT_TRUE(ring.is_empty(), "");
+    EXPECT_FALSE(ring.pop(&val), "");
+
+    // Go around a few times so the indices wrap the storage.
+    for (uint32_t round = 0; round < 3; ++round) {
+        for (uint32_t i = 0; i < 4; ++i)
+            EXPECT_TRUE(ring.push(round * 10 + i), "");
+        EXPECT_TRUE(ring.is_full(), "");
+        EXPECT_EQ(4u, ring.size(), "");
+        EXPECT_FALSE(ring.push(99u), "");
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            EXPECT_TRUE(ring.pop(&val), "");
+            EXPECT_EQ(round * 10 + i, val, "");
+        }
+        EXPECT_TRUE(ring.is_empty(), "");
+        EXPECT_FALSE(ring.pop(&val), "");
+
+        // Leave the ring offset by one for the next round.
+        EXPECT_TRUE(ring.push(0u), "");
+        EXPECT_TRUE(ring.pop(&val), "");
+    }
+
+    END_TEST;
+}
+
+using TestRing = mxtl::SpscRing<uint32_t, 64>;
+constexpr uint32_t kRingItemCount = 100000u;
+
+int spsc_producer(void* arg) {
+    auto ring = static_cast<TestRing*>(arg);
+    for (uint32_t i = 0; i < kRingItemCount; ++i) {
+        while (!ring->push(i))
+            sched_yield();
+    }
+    return 0;
+}
+
+bool spsc_threaded_test() {
+    BEGIN_TEST;
+
+    TestRing ring;
+    thrd_t thread;
+    ASSERT_EQ(thrd_create(&thread, spsc_producer, &ring), thrd_success, "");
+
+    for (uint32_t expected = 0; expected < kRingItemCount; ++expected) {
+        uint32_t val;
+        while (!ring.pop(&val))
+            sched_yield();
+        ASSERT_EQ(expected, val, "");
+    }
+
+    thrd_join(thread, NULL);
+    EXPECT_TRUE(ring.is_empty(), "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(lock_free_queue_tests)
+RUN_NAMED_TEST("MpscQueue FIFO order", mpsc_fifo_order_test)
+RUN_NAMED_TEST("MpscQueue managed pointers", mpsc_managed_test)
+RUN_NAMED_TEST("MpscQueue multiple producers", mpsc_multi_producer_test)
+RUN_NAMED_TEST("SpscRing basic", spsc_basic_test)
+RUN_NAMED_TEST("SpscRing threaded", spsc_threaded_test)
+END_TEST_CASE(lock_free_queue_tests);
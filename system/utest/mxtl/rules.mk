@@ -19,13 +19,16 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/intrusive_doubly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_hash_table_dll_tests.cpp \
     $(LOCAL_DIR)/intrusive_hash_table_sll_tests.cpp \
+    $(LOCAL_DIR)/intrusive_resizable_hash_table_tests.cpp \
     $(LOCAL_DIR)/intrusive_singly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_wavl_tree_tests.cpp \
+    $(LOCAL_DIR)/lock_free_queue_tests.cpp \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/ref_counted_tests.cpp \
     $(LOCAL_DIR)/ref_ptr_tests.cpp \
     $(LOCAL_DIR)/type_support_tests.cpp \
-    $(LOCAL_DIR)/unique_ptr_tests.cpp
+    $(LOCAL_DIR)/unique_ptr_tests.cpp \
+    $(LOCAL_DIR)/vector_tests.cpp
 
 MODULE_NAME := mxtl-test
 
@@ -0,0 +1,224 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <mxtl/vector.h>
+
+#include <stddef.h>
+#include <magenta/new.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+struct TestType {
+    TestType() : val(0) { live_count++; }
+    explicit TestType(int v) : val(v) { live_count++; }
+    TestType(const TestType& other) : val(other.val) { live_count++; copy_count++; }
+    TestType(TestType&& other) : val(other.val) { other.val = -1; live_count++; }
+    TestType& operator=(TestType&& other) {
+        val = other.val;
+        other.val = -1;
+        return *this;
+    }
+    ~TestType() { live_count--; }
+
+    static void ResetCounts() {
+        live_count = 0u;
+        copy_count = 0u;
+    }
+
+    int val;
+    static size_t live_count;
+    static size_t copy_count;
+};
+
+size_t TestType::live_count = 0u;
+size_t TestType::copy_count = 0u;
+
+template <size_t N>
+bool push_pop_test() {
+    BEGIN_TEST;
+
+    TestType::ResetCounts();
+    {
+        mxtl::Vector<TestType, N> v;
+        EXPECT_TRUE(v.is_empty(), "");
+        EXPECT_EQ(N, v.capacity(), "");
+
+        // Go well past the inline storage so that it has to grow a few times.
+        for (int i = 0; i < 100; i++) {
+            AllocChecker ac;
+            v.push_back(TestType(i), &ac);
+            ASSERT_TRUE(ac.check(), "");
+            EXPECT_EQ(static_cast<size_t>(i + 1), v.size(), "");
+        }
+        EXPECT_EQ(100u, TestType::live_count, "");
+        EXPECT_EQ(0u, TestType::copy_count, "growth should move, not copy");
+
+        for (size_t i = 0; i < v.size(); i++)
+            EXPECT_EQ(static_cast<int>(i), v[i].val, "");
+
+        int expected = 99;
+        while (!v.is_empty()) {
+            EXPECT_EQ(expected--, v[v.size() - 1].val, "");
+            v.pop_back();
+        }
+        EXPECT_EQ(0u, TestType::live_count, "");
+    }
+    EXPECT_EQ(0u, TestType::live_count, "");
+
+    END_TEST;
+}
+
+bool inline_test() {
+    BEGIN_TEST;
+
+    TestType::ResetCounts();
+    mxtl::Vector<TestType, 4u> v;
+    TestType* inline_ptr = v.get();
+    ASSERT_NONNULL(inline_ptr, "");
+
+    for (int i = 0; i < 4; i++) {
+        AllocChecker ac;
+        v.push_back(TestType(i), &ac);
+        ASSERT_TRUE(ac.check(), "");
+    }
+    EXPECT_EQ(inline_ptr, v.get(), "should not have left the inline storage");
+
+    AllocChecker ac;
+    v.push_back(TestType(4), &ac);
+    ASSERT_TRUE(ac.check(), "");
+    EXPECT_NEQ(inline_ptr, v.get(), "should have moved to the heap");
+    EXPECT_GE(v.capacity(), 5u, "");
+
+    v.reset();
+    EXPECT_EQ(inline_ptr, v.get(), "reset should return to the inline storage");
+    EXPECT_EQ(4u, v.capacity(), "");
+    EXPECT_EQ(0u, TestType::live_count, "");
+
+    END_TEST;
+}
+
+bool reserve_erase_test() {
+    BEGIN_TEST;
+
+    TestType::ResetCounts();
+    mxtl::Vector<TestType> v;
+
+    AllocChecker ac;
+    v.reserve(10u, &ac);
+    ASSERT_TRUE(ac.check(), "");
+    EXPECT_EQ(10u, v.capacity(), "");
+    TestType* ptr = v.get();
+
+    for (int i = 0; i < 10; i++) {
+        AllocChecker ac2;
+        v.push_back(TestType(i), &ac2);
+        ASSERT_TRUE(ac2.check(), "");
+    }
+    EXPECT_EQ(ptr, v.get(), "reserve should have avoided reallocation");
+
+    v.erase(0u);
+    v.erase(4u);
+    v.erase(v.size() - 1);
+    EXPECT_EQ(7u, v.size(), "");
+    static const int expected[] = { 1, 2, 3, 4, 6, 7, 8 };
+    for (size_t i = 0; i < countof(expected); i++)
+        EXPECT_EQ(expected[i], v[i].val, "");
+    EXPECT_EQ(7u, TestType::live_count, "");
+
+    v.clear();
+    EXPECT_TRUE(v.is_empty(), "");
+    EXPECT_EQ(10u, v.capacity(), "clear should keep the storage");
+    EXPECT_EQ(0u, TestType::live_count, "");
+
+    END_TEST;
+}
+
+template <size_t N>
+bool move_test() {
+    BEGIN_TEST;
+
+    TestType::ResetCounts();
+    for (int count = 0; count < 8; count++) {
+        mxtl::Vector<TestType, N> a;
+        for (int i = 0; i < count; i++) {
+            AllocChecker ac;
+            a.push_back(TestType(i), &ac);
+            ASSERT_TRUE(ac.check(), "");
+        }
+
+        mxtl::Vector<TestType, N> b(mxtl::move(a));
+        EXPECT_TRUE(a.is_empty(), "");
+        EXPECT_EQ(static_cast<size_t>(count), b.size(), "");
+
+        mxtl::Vector<TestType, N> c;
+        AllocChecker ac;
+        c.push_back(TestType(42), &ac);
+        ASSERT_TRUE(ac.check(), "");
+        c = mxtl::move(b);
+        EXPECT_TRUE(b.is_empty(), "");
+        ASSERT_EQ(static_cast<size_t>(count), c.size(), "");
+        for (int i = 0; i < count; i++)
+            EXPECT_EQ(i, c[i].val, "");
+
+        EXPECT_EQ(static_cast<size_t>(count), TestType::live_count, "");
+        EXPECT_EQ(0u, TestType::copy_count, "");
+    }
+    EXPECT_EQ(0u, TestType::live_count, "");
+
+    END_TEST;
+}
+
+bool move_only_test() {
+    BEGIN_TEST;
+
+    mxtl::Vector<mxtl::unique_ptr<int>, 2u> v;
+    for (int i = 0; i < 5; i++) {
+        AllocChecker ac;
+        mxtl::unique_ptr<int> p(new (&ac) int(i));
+        ASSERT_TRUE(ac.check(), "");
+        v.push_back(mxtl::move(p), &ac);
+        ASSERT_TRUE(ac.check(), "");
+    }
+
+    int expected = 0;
+    for (const auto& p : v)
+        EXPECT_EQ(expected++, *p, "");
+
+    END_TEST;
+}
+
+bool alloc_failure_test() {
+    BEGIN_TEST;
+
+    mxtl::Vector<TestType, 1u> v;
+    AllocChecker ac;
+    v.push_back(TestType(1), &ac);
+    ASSERT_TRUE(ac.check(), "");
+    TestType* ptr = v.get();
+
+    // An impossible reservation fails through the AllocChecker and leaves
+    // the vector untouched.
+    v.reserve(SIZE_MAX / 2, &ac);
+    EXPECT_FALSE(ac.check(), "");
+    EXPECT_EQ(ptr, v.get(), "");
+    EXPECT_EQ(1u, v.size(), "");
+    EXPECT_EQ(1, v[0].val, "");
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(vector_tests)
+RUN_NAMED_TEST("push/pop no inline", push_pop_test<0u>)
+RUN_NAMED_TEST("push/pop inline", push_pop_test<8u>)
+RUN_NAMED_TEST("inline storage", inline_test)
+RUN_NAMED_TEST("reserve/erase", reserve_erase_test)
+RUN_NAMED_TEST("move no inline", move_test<0u>)
+RUN_NAMED_TEST("move inline", move_test<4u>)
+RUN_NAMED_TEST("move-only elements", move_only_test)
+RUN_NAMED_TEST("allocation failure", alloc_failure_test)
+END_TEST_CASE(vector_tests);
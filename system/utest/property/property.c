@@ -104,9 +104,258 @@ static bool thread_name_test(void)
     END_TEST;
 }
 
+static bool thread_fair_weight_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t main_thread = thrd_get_mx_handle(thrd_current());
+    uint32_t weight = 1;
+
+    // threads start out in the fixed priority class
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              NO_ERROR, "");
+    EXPECT_EQ(weight, 0u, "");
+
+    weight = MX_SCHED_FAIR_WEIGHT_DEFAULT;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              NO_ERROR, "");
+    weight = 0;
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              NO_ERROR, "");
+    EXPECT_EQ(weight, MX_SCHED_FAIR_WEIGHT_DEFAULT, "");
+
+    weight = MX_SCHED_FAIR_WEIGHT_MAX + 1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              ERR_INVALID_ARGS, "");
+
+    // only threads have a scheduling class
+    weight = MX_SCHED_FAIR_WEIGHT_DEFAULT;
+    EXPECT_EQ(mx_object_set_property(mx_process_self(), MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              ERR_WRONG_TYPE, "");
+
+    // back to fixed priority
+    weight = 0;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_FAIR_WEIGHT,
+                                     &weight, sizeof(weight)),
+              NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool thread_timer_slack_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t main_thread = thrd_get_mx_handle(thrd_current());
+    mx_time_t slack = 1;
+
+    // timeouts are exact by default
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(slack, 0ull, "");
+
+    // the kernel keeps whole milliseconds
+    slack = 5000000ull + 1234u;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(slack, 5000000ull, "");
+
+    // a sleep with slack still lasts at least as long as asked
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    EXPECT_EQ(mx_nanosleep(2000000ull), NO_ERROR, "");
+    EXPECT_GE(mx_time_get(MX_CLOCK_MONOTONIC) - start, 2000000ull, "");
+
+    slack = MX_TIMER_SLACK_MAX + 1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              ERR_INVALID_ARGS, "");
+
+    slack = 0;
+    EXPECT_EQ(mx_object_set_property(mx_process_self(), MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              ERR_WRONG_TYPE, "");
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK,
+                                     &slack, sizeof(slack)),
+              NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool thread_sched_cpu_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t main_thread = thrd_get_mx_handle(thrd_current());
+    int32_t cpu = 0;
+
+    // threads may run anywhere by default
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              NO_ERROR, "");
+    EXPECT_EQ(cpu, -1, "");
+
+    // pinning the current thread moves it before returning
+    cpu = (int32_t)mx_num_cpus() - 1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              NO_ERROR, "");
+    cpu = -1;
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              NO_ERROR, "");
+    EXPECT_EQ(cpu, (int32_t)mx_num_cpus() - 1, "");
+
+    cpu = (int32_t)mx_num_cpus();
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              ERR_INVALID_ARGS, "");
+    cpu = -2;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              ERR_INVALID_ARGS, "");
+
+    cpu = -1;
+    EXPECT_EQ(mx_object_set_property(mx_process_self(), MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              ERR_WRONG_TYPE, "");
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              NO_ERROR, "");
+
+    END_TEST;
+}
+
+static bool thread_sched_deadline_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t main_thread = thrd_get_mx_handle(thrd_current());
+    mx_sched_deadline_t params = {};
+
+    // threads aren't in the deadline class by default
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    EXPECT_EQ(params.period, 0u, "");
+
+    params = (mx_sched_deadline_t){MX_MSEC(1), MX_MSEC(10), MX_MSEC(20)};
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    params = (mx_sched_deadline_t){};
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    EXPECT_EQ(params.runtime, MX_MSEC(1), "");
+    EXPECT_EQ(params.deadline, MX_MSEC(10), "");
+    EXPECT_EQ(params.period, MX_MSEC(20), "");
+
+    // a deadline thread stays on the cpu it was admitted on
+    int32_t cpu = -1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_CPU, &cpu, sizeof(cpu)),
+              ERR_BAD_STATE, "");
+
+    params = (mx_sched_deadline_t){MX_MSEC(2), MX_MSEC(1), MX_MSEC(20)};
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              ERR_INVALID_ARGS, "");
+    params = (mx_sched_deadline_t){MX_USEC(1), MX_USEC(10), MX_USEC(100)};
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              ERR_INVALID_ARGS, "");
+
+    // no cpu has room for more than MX_PROP_SCHED_DEADLINE allows, and a
+    // failed change leaves the old reservation in place
+    params = (mx_sched_deadline_t){MX_MSEC(9), MX_MSEC(10), MX_MSEC(10)};
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              ERR_NO_RESOURCES, "");
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    EXPECT_EQ(params.runtime, MX_MSEC(1), "");
+
+    params = (mx_sched_deadline_t){};
+    EXPECT_EQ(mx_object_set_property(mx_process_self(), MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              ERR_WRONG_TYPE, "");
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_SCHED_DEADLINE, &params, sizeof(params)),
+              NO_ERROR, "");
+    EXPECT_EQ(params.period, 0u, "");
+
+    END_TEST;
+}
+
+static bool job_resources_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t parent = mxio_get_startup_handle(MX_HND_INFO(MX_HND_TYPE_JOB, 0));
+    ASSERT_GT(parent, 0, "no mxio job object");
+    mx_handle_t job;
+    ASSERT_EQ(mx_job_create(parent, 0u, &job), NO_ERROR, "");
+
+    // a new job is limited only by its ancestors
+    mx_job_cpu_quota_t quota = {1, 1};
+    EXPECT_EQ(mx_object_get_property(job, MX_PROP_JOB_CPU_QUOTA, &quota, sizeof(quota)),
+              NO_ERROR, "");
+    EXPECT_EQ(quota.period, 0ull, "");
+    uint64_t limit = 1;
+    EXPECT_EQ(mx_object_get_property(job, MX_PROP_JOB_MEMORY_LIMIT, &limit, sizeof(limit)),
+              NO_ERROR, "");
+    EXPECT_EQ(limit, 0ull, "");
+
+    quota.period = MX_MSEC(10);
+    quota.quota = MX_MSEC(5);
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_CPU_QUOTA, &quota, sizeof(quota)),
+              NO_ERROR, "");
+    quota.period = MX_JOB_CPU_PERIOD_MIN - 1;
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_CPU_QUOTA, &quota, sizeof(quota)),
+              ERR_INVALID_ARGS, "");
+    quota.period = MX_MSEC(10);
+    quota.quota = 0;
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_CPU_QUOTA, &quota, sizeof(quota)),
+              ERR_INVALID_ARGS, "");
+
+    // the limit is kept in whole pages
+    limit = 1024u * 1024u + 1;
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_MEMORY_LIMIT, &limit, sizeof(limit)),
+              NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_property(job, MX_PROP_JOB_MEMORY_LIMIT, &limit, sizeof(limit)),
+              NO_ERROR, "");
+    EXPECT_EQ(limit, 1024u * 1024u + 4096u, "");
+
+    uint32_t mask = 0;
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_CPU_AFFINITY, &mask, sizeof(mask)),
+              ERR_INVALID_ARGS, "no cpus");
+    mask = 1u;
+    EXPECT_EQ(mx_object_set_property(job, MX_PROP_JOB_CPU_AFFINITY, &mask, sizeof(mask)),
+              NO_ERROR, "");
+
+    mx_info_job_resources_t info;
+    ASSERT_EQ(mx_object_get_info(job, MX_INFO_JOB_RESOURCES, &info, sizeof(info), NULL, NULL),
+              NO_ERROR, "");
+    EXPECT_EQ(info.committed_bytes, 0ull, "nothing runs in it");
+    EXPECT_EQ(info.memory_limit, 1024u * 1024u + 4096u, "");
+    EXPECT_EQ(info.cpu_period, MX_MSEC(10), "");
+    EXPECT_EQ(info.cpu_quota, MX_MSEC(5), "");
+    EXPECT_EQ(info.cpu_affinity, 1u, "");
+
+    // only jobs have them
+    EXPECT_EQ(mx_object_set_property(mx_process_self(), MX_PROP_JOB_MEMORY_LIMIT,
+                                     &limit, sizeof(limit)),
+              ERR_WRONG_TYPE, "");
+
+    mx_handle_close(job);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(property_tests)
 RUN_TEST(process_name_test);
 RUN_TEST(thread_name_test);
+RUN_TEST(thread_fair_weight_test);
+RUN_TEST(thread_timer_slack_test);
+RUN_TEST(thread_sched_cpu_test);
+RUN_TEST(thread_sched_deadline_test);
+RUN_TEST(job_resources_test);
 END_TEST_CASE(property_tests)
 
 int main(int argc, char **argv)
@@ -0,0 +1,128 @@
+// Copyright 2016 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unittest/unittest.h>
+
+// The x86-64 versions read aligned blocks, which may go past the end of
+// the string but never into the next page. Put every string right
+// against an unmapped page so that any read that strays faults.
+
+static char* guarded_end;
+
+static bool map_guarded(void) {
+    char* p = mmap(NULL, 2 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED)
+        return false;
+    if (munmap(p + PAGE_SIZE, PAGE_SIZE) != 0)
+        return false;
+    guarded_end = p + PAGE_SIZE;
+    return true;
+}
+
+static void unmap_guarded(void) {
+    munmap(guarded_end - PAGE_SIZE, PAGE_SIZE);
+}
+
+// a string of |len| bytes of 'a'..'p' that ends |gap| bytes before the page
+static char* make_string(size_t len, size_t gap) {
+    char* s = guarded_end - len - 1 - gap;
+    for (size_t i = 0; i < len; i++)
+        s[i] = 'a' + (i % 16);
+    s[len] = 0;
+    return s;
+}
+
+static bool strlen_test(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(map_guarded(), "");
+    for (size_t gap = 0; gap < 32; gap++) {
+        for (size_t len = 0; len < 80; len++) {
+            char* s = make_string(len, gap);
+            EXPECT_EQ(strlen(s), len, "");
+        }
+    }
+    unmap_guarded();
+    END_TEST;
+}
+
+static bool strchr_test(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(map_guarded(), "");
+    for (size_t gap = 0; gap < 32; gap++) {
+        for (size_t len = 0; len < 80; len++) {
+            char* s = make_string(len, gap);
+            // the first 16 bytes are all different, so each is found there
+            for (int c = 'a'; c <= 'p'; c++) {
+                size_t at = (size_t)(c - 'a');
+                EXPECT_EQ(strchr(s, c), at < len ? s + at : NULL, "");
+                EXPECT_EQ(strchrnul(s, c), at < len ? s + at : s + len, "");
+            }
+            EXPECT_EQ(strchr(s, 'z'), NULL, "");
+            EXPECT_EQ(strchr(s, 0), s + len, "");
+            // only the low byte of c counts
+            EXPECT_EQ(strchr(s, 256 + 'a'), len ? s : NULL, "");
+        }
+    }
+    unmap_guarded();
+    END_TEST;
+}
+
+static bool memchr_test(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(map_guarded(), "");
+    for (size_t gap = 0; gap < 32; gap++) {
+        for (size_t len = 0; len < 80; len++) {
+            char* s = make_string(len, gap);
+            for (size_t n = 0; n <= len; n++) {
+                EXPECT_EQ(memchr(s, 'b', n), n > 1 ? s + 1 : NULL, "");
+                EXPECT_EQ(memchr(s, 0, n), NULL, "");
+            }
+            EXPECT_EQ(memchr(s, 0, len + 1), s + len, "");
+            // a size that only bounds the search, as for rawmemchr,
+            // hidden from the compiler's object size checks
+            volatile size_t unbounded = SIZE_MAX;
+            EXPECT_EQ(memchr(s, 0, unbounded), s + len, "");
+        }
+    }
+    unmap_guarded();
+    END_TEST;
+}
+
+static bool memcmp_test(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(map_guarded(), "");
+    static char a[128];
+    for (size_t n = 0; n <= sizeof(a); n++) {
+        char* b = guarded_end - n;
+        for (size_t i = 0; i < n; i++)
+            a[i] = b[i] = (char)(i * 7);
+        EXPECT_EQ(memcmp(a, b, n), 0, "");
+        for (size_t i = 0; i < n; i++) {
+            // bytes compare as unsigned
+            b[i] = (char)0x80;
+            a[i] = 0x7f;
+            EXPECT_LT(memcmp(a, b, n), 0, "");
+            EXPECT_GT(memcmp(b, a, n), 0, "");
+            a[i] = b[i] = (char)(i * 7);
+        }
+    }
+    unmap_guarded();
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(string_tests)
+RUN_TEST(strlen_test)
+RUN_TEST(strchr_test)
+RUN_TEST(memchr_test)
+RUN_TEST(memcmp_test)
+END_TEST_CASE(string_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -492,6 +492,327 @@ bool vmo_commit_test() {
     END_TEST;
 }
 
+bool vmo_clone_test() {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t size;
+    mx_handle_t vmo;
+    const size_t len = PAGE_SIZE * 4;
+
+    status = mx_vmo_create(len, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+    // fill the parent with a known pattern
+    char buf[PAGE_SIZE];
+    for (size_t i = 0; i < len; i += PAGE_SIZE) {
+        memset(buf, 'a' + (int)(i / PAGE_SIZE), sizeof(buf));
+        status = mx_vmo_write(vmo, buf, i, sizeof(buf), &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+    }
+
+    // bad options and offsets
+    mx_handle_t clone;
+    status = mx_vmo_clone(vmo, 0, 0, len, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone bad options");
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 1, len, &clone);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_clone unaligned offset");
+
+    // clone the last three pages
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, PAGE_SIZE, len - PAGE_SIZE, &clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone");
+
+    uint64_t clone_size;
+    status = mx_vmo_get_size(clone, &clone_size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_get_size");
+    EXPECT_EQ(len - PAGE_SIZE, clone_size, "clone size");
+
+    uintptr_t ptr, clone_ptr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, len, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+    status = mx_process_map_vm(mx_process_self(), clone, 0, len - PAGE_SIZE, &clone_ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+    EXPECT_EQ(NO_ERROR, status, "vm_map clone");
+
+    // the clone sees the parent's data
+    char* p = (char*)ptr;
+    char* c = (char*)clone_ptr;
+    EXPECT_EQ('b', c[0], "clone reads parent");
+    EXPECT_EQ('d', c[2 * PAGE_SIZE], "clone reads parent");
+
+    // writing to the clone leaves the parent alone
+    c[0] = 'x';
+    EXPECT_EQ('x', c[0], "clone write");
+    EXPECT_EQ('b', c[1], "clone write copies the rest of the page");
+    EXPECT_EQ('b', p[PAGE_SIZE], "parent unchanged by clone write");
+
+    status = mx_vmo_write(clone, "y", PAGE_SIZE, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write clone");
+    EXPECT_EQ('y', c[PAGE_SIZE], "clone write through vmo_write");
+    EXPECT_EQ('c', p[2 * PAGE_SIZE], "parent unchanged by clone vmo_write");
+
+    // writing to the parent shows through pages the clone hasn't written
+    p[3 * PAGE_SIZE] = 'z';
+    EXPECT_EQ('z', c[2 * PAGE_SIZE], "parent write visible in clone");
+    p[PAGE_SIZE] = 'w';
+    EXPECT_EQ('x', c[0], "parent write hidden by clone copy");
+
+    // the parent can go away while the clone is still around
+    status = mx_process_unmap_vm(mx_process_self(), ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    status = mx_vmo_read(clone, buf, 2 * PAGE_SIZE, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read clone");
+    EXPECT_EQ('z', buf[0], "clone read after parent close");
+
+    status = mx_process_unmap_vm(mx_process_self(), clone_ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap clone");
+    status = mx_handle_close(clone);
+    EXPECT_EQ(NO_ERROR, status, "handle_close clone");
+
+    END_TEST;
+}
+
+bool vmo_fault_around_test() {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t size;
+    mx_handle_t vmo;
+    const size_t pages = 32;
+    const size_t len = PAGE_SIZE * pages;
+
+    status = mx_vmo_create(len, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+    // populate every other page so the fault-around window has holes in it
+    char buf[PAGE_SIZE];
+    for (size_t i = 0; i < pages; i += 2) {
+        memset(buf, 'a' + (int)i, sizeof(buf));
+        status = mx_vmo_write(vmo, buf, i * PAGE_SIZE, sizeof(buf), &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+    }
+
+    uintptr_t ptr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, len, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                               MX_VM_FLAG_FAULT_AROUND);
+    EXPECT_EQ(NO_ERROR, status, "vm_map");
+
+    // every page reads back what the object holds, resident or not
+    char* p = (char*)ptr;
+    for (size_t i = 0; i < pages; i++) {
+        char expected = (i % 2 == 0) ? (char)('a' + i) : 0;
+        EXPECT_EQ(expected, p[i * PAGE_SIZE], "fault-around read");
+        EXPECT_EQ(expected, p[i * PAGE_SIZE + PAGE_SIZE - 1], "fault-around read");
+    }
+
+    // writes through pages mapped by fault-around land in the object
+    p[2 * PAGE_SIZE] = 'x';
+    status = mx_vmo_read(vmo, buf, 2 * PAGE_SIZE, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read");
+    EXPECT_EQ('x', buf[0], "fault-around write");
+
+    // neighbors borrowed from a parent must still copy on write
+    mx_handle_t clone;
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, len, &clone);
+    EXPECT_EQ(NO_ERROR, status, "vm_clone");
+
+    uintptr_t clone_ptr;
+    status = mx_process_map_vm(mx_process_self(), clone, 0, len, &clone_ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                               MX_VM_FLAG_FAULT_AROUND);
+    EXPECT_EQ(NO_ERROR, status, "vm_map clone");
+
+    char* c = (char*)clone_ptr;
+    EXPECT_EQ('a', c[0], "clone read");
+    c[4 * PAGE_SIZE] = 'y';
+    EXPECT_EQ('y', c[4 * PAGE_SIZE], "clone write");
+    EXPECT_EQ('a' + 4, p[4 * PAGE_SIZE], "parent unchanged by clone write");
+
+    status = mx_process_unmap_vm(mx_process_self(), clone_ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap clone");
+    status = mx_process_unmap_vm(mx_process_self(), ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(clone);
+    EXPECT_EQ(NO_ERROR, status, "handle_close clone");
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_map_commit_test() {
+    BEGIN_TEST;
+
+    mx_handle_t vmo;
+    mx_status_t status;
+    size_t size;
+    const size_t len = PAGE_SIZE * 4;
+    mx_paddr_t buf[len / PAGE_SIZE];
+
+    status = mx_vmo_create(len, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+    uintptr_t ptr;
+    status = mx_process_map_vm(mx_process_self(), vmo, 0, len, &ptr,
+                               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                               MX_VM_FLAG_COMMIT);
+    EXPECT_EQ(NO_ERROR, status, "vm_map commit");
+
+    // everything is committed before anything touches it
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, 0, len, buf, sizeof(buf));
+    EXPECT_EQ(NO_ERROR, status, "lookup after commit map");
+
+    char* p = (char*)ptr;
+    EXPECT_EQ(0, p[0], "committed pages are zero");
+    p[len - 1] = 'z';
+    char c = 0;
+    status = mx_vmo_read(vmo, &c, len - 1, 1, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read");
+    EXPECT_EQ('z', c, "write through committed mapping");
+
+    status = mx_process_unmap_vm(mx_process_self(), ptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_unmap");
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_purgeable_test() {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    size_t size;
+    mx_handle_t vmo;
+    const size_t len = PAGE_SIZE * 4;
+
+    status = mx_vmo_create(len, 0x80000000u, &vmo);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_object_create bad options");
+
+    // ordinary objects can't be locked
+    status = mx_vmo_create(len, 0, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, len, nullptr, 0);
+    EXPECT_EQ(ERR_NOT_SUPPORTED, status, "vm_op_range unlock");
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    status = mx_vmo_create(len, MX_VMO_PURGEABLE, &vmo);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_create purgeable");
+
+    status = mx_vmo_write(vmo, "abcd", 0, 4, &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+
+    // the lock covers the whole object
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, PAGE_SIZE, len - PAGE_SIZE, nullptr, 0);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_op_range unlock partial");
+
+    // it starts locked, so this lock nests
+    uint32_t state = 0xff;
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, len, &state, sizeof(state));
+    EXPECT_EQ(NO_ERROR, status, "vm_op_range lock");
+    EXPECT_EQ(MX_VMO_LOCK_RETAINED, state, "lock state");
+
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, len, nullptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_op_range unlock");
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, len, nullptr, 0);
+    EXPECT_EQ(NO_ERROR, status, "vm_op_range unlock");
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_UNLOCK, 0, len, nullptr, 0);
+    EXPECT_EQ(ERR_BAD_STATE, status, "vm_op_range unlock too many times");
+
+    // whether the contents survived depends on memory pressure, but either way
+    // they read back as what was written or as zeros
+    state = 0xff;
+    status = mx_vmo_op_range(vmo, MX_VMO_OP_LOCK, 0, len, &state, sizeof(state));
+    EXPECT_EQ(NO_ERROR, status, "vm_op_range lock");
+    EXPECT_TRUE(state == MX_VMO_LOCK_RETAINED || state == MX_VMO_LOCK_PURGED, "lock state");
+
+    char buf[4];
+    status = mx_vmo_read(vmo, buf, 0, sizeof(buf), &size);
+    EXPECT_EQ(NO_ERROR, status, "vm_object_read");
+    if (state == MX_VMO_LOCK_RETAINED)
+        EXPECT_EQ(0, memcmp(buf, "abcd", 4), "contents retained");
+    else
+        EXPECT_EQ(0, memcmp(buf, "\0\0\0\0", 4), "contents purged");
+
+    // purgeable objects can't be cloned
+    mx_handle_t clone;
+    status = mx_vmo_clone(vmo, MX_VMO_CLONE_COPY_ON_WRITE, 0, len, &clone);
+    EXPECT_EQ(ERR_NOT_SUPPORTED, status, "vm_clone purgeable");
+
+    status = mx_handle_close(vmo);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool memory_pressure_event_test() {
+    BEGIN_TEST;
+
+    mx_handle_t event;
+    mx_status_t status = mx_memory_pressure_event(&event);
+    EXPECT_EQ(NO_ERROR, status, "memory_pressure_event");
+
+    // can be waited on but not signaled
+    mx_signals_t observed;
+    status = mx_handle_wait_one(event, MX_EVENT_SIGNALED, 0u, &observed);
+    EXPECT_TRUE(status == NO_ERROR || status == ERR_TIMED_OUT, "wait on memory pressure event");
+    status = mx_object_signal(event, 0u, MX_EVENT_SIGNALED);
+    EXPECT_EQ(ERR_ACCESS_DENIED, status, "signal memory pressure event");
+
+    status = mx_handle_close(event);
+    EXPECT_EQ(NO_ERROR, status, "handle_close");
+
+    END_TEST;
+}
+
+bool vmo_numa_test() {
+    BEGIN_TEST;
+
+    mx_status_t status;
+    mx_handle_t vmo;
+    const size_t len = PAGE_SIZE * 16;
+    char buf[16];
+    size_t size;
+
+    // a node can only be named when binding, and bound objects can't interleave
+    status = mx_vmo_create(len, MX_VMO_NUMA_NODE(1), &vmo);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_object_create node without bind");
+    status = mx_vmo_create(len, MX_VMO_NUMA_BIND | MX_VMO_NUMA_INTERLEAVE, &vmo);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_object_create bind and interleave");
+    status = mx_vmo_create(len, MX_VMO_NUMA_BIND | MX_VMO_NUMA_NODE(255), &vmo);
+    EXPECT_EQ(ERR_INVALID_ARGS, status, "vm_object_create bind to missing node");
+
+    // node 0 always exists
+    const uint32_t options[] = {
+        MX_VMO_NUMA_INTERLEAVE,
+        MX_VMO_NUMA_BIND | MX_VMO_NUMA_NODE(0),
+    };
+    for (uint32_t o : options) {
+        status = mx_vmo_create(len, o, &vmo);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_create");
+
+        status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, len, nullptr, 0);
+        EXPECT_EQ(NO_ERROR, status, "vm_op_range commit");
+
+        status = mx_vmo_write(vmo, "abcd", len - PAGE_SIZE, 4, &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_write");
+        status = mx_vmo_read(vmo, buf, len - PAGE_SIZE, 4, &size);
+        EXPECT_EQ(NO_ERROR, status, "vm_object_read");
+        EXPECT_EQ(0, memcmp(buf, "abcd", 4), "contents");
+
+        status = mx_handle_close(vmo);
+        EXPECT_EQ(NO_ERROR, status, "handle_close");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -501,6 +822,12 @@ RUN_TEST(vmo_resize_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
 RUN_TEST(vmo_commit_test);
+RUN_TEST(vmo_clone_test);
+RUN_TEST(vmo_fault_around_test);
+RUN_TEST(vmo_map_commit_test);
+RUN_TEST(vmo_purgeable_test);
+RUN_TEST(memory_pressure_event_test);
+RUN_TEST(vmo_numa_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {
@@ -14,8 +14,25 @@
 //
 // Author: Marius Schilder
 
+// The kernel is built without the FPU, so only user code gets the SHA
+// instructions, which work on vector registers.
+#if !defined(_KERNEL) && defined(__x86_64__)
+#define SHA256_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif !defined(_KERNEL) && defined(__aarch64__) && \
+    (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+// There's no way to ask Magenta for the cpu's features from user mode, so
+// this is up to the -march the code is built for.
+#define SHA256_ARMV8 1
+#include <arm_neon.h>
+#endif
+
+// After the intrinsics, since some compilers' headers for them break under
+// <magenta/compiler.h>'s __OPTIMIZE().
 #include <lib/crypto/cryptolib.h>
 
+#include <stddef.h>
 #include <string.h>
 
 // Generic HASH code section ===========================================
@@ -108,8 +125,7 @@ int clEqual(const uint8_t* a, int a_len, const uint8_t* b, int b_len) {
 
 // SHA256 code section ==================================================
 
-static void _SHA256_transform(clHASH_CTX* ctx) {
-  static const uint32_t _SHA256_K[64] = {
+static const uint32_t _SHA256_K[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
     0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
     0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -127,66 +143,238 @@ static void _SHA256_transform(clHASH_CTX* ctx) {
     0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
 
+// Runs the compression function over n 64 byte blocks of data.
+typedef void (*_SHA256_blocks_fn)(uint32_t* state, const uint8_t* data, size_t n);
+
+static void _SHA256_blocks_portable(uint32_t* state, const uint8_t* data, size_t n) {
 #define _ROR(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
 #define _SHR(value, bits) ((value) >> (bits))
 
-  uint32_t W[64];
-  uint32_t A, B, C, D, E, F, G, H;
-  const uint8_t* p = ctx->buf;
-  int t;
+  for (; n > 0; --n) {
+    uint32_t W[64];
+    uint32_t A, B, C, D, E, F, G, H;
+    const uint8_t* p = data;
+    int t;
+
+    for(t = 0; t < 16; ++t) {
+      uint32_t tmp =  *p++ << 24;
+      tmp |= *p++ << 16;
+      tmp |= *p++ << 8;
+      tmp |= *p++;
+      W[t] = tmp;
+    }
 
-  for(t = 0; t < 16; ++t) {
-    uint32_t tmp =  *p++ << 24;
-    tmp |= *p++ << 16;
-    tmp |= *p++ << 8;
-    tmp |= *p++;
-    W[t] = tmp;
+    for(; t < 64; t++) {
+      uint32_t s0 = _ROR(W[t-15], 7) ^ _ROR(W[t-15], 18) ^ _SHR(W[t-15], 3);
+      uint32_t s1 = _ROR(W[t-2], 17) ^ _ROR(W[t-2], 19) ^ _SHR(W[t-2], 10);
+      W[t] = W[t-16] + s0 + W[t-7] + s1;
+    }
+
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
+
+    for(t = 0; t < 64; t++) {
+      uint32_t s0 = _ROR(A, 2) ^ _ROR(A, 13) ^ _ROR(A, 22);
+      uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
+      uint32_t t2 = s0 + maj;
+      uint32_t s1 = _ROR(E, 6) ^ _ROR(E, 11) ^ _ROR(E, 25);
+      uint32_t ch = (E & F) ^ ((~E) & G);
+      uint32_t t1 = H + s1 + ch + _SHA256_K[t] + W[t];
+
+      H = G;
+      G = F;
+      F = E;
+      E = D + t1;
+      D = C;
+      C = B;
+      B = A;
+      A = t1 + t2;
+    }
+
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+
+    data += 64;
   }
 
-  for(; t < 64; t++) {
-    uint32_t s0 = _ROR(W[t-15], 7) ^ _ROR(W[t-15], 18) ^ _SHR(W[t-15], 3);
-    uint32_t s1 = _ROR(W[t-2], 17) ^ _ROR(W[t-2], 19) ^ _SHR(W[t-2], 10);
-    W[t] = W[t-16] + s0 + W[t-7] + s1;
+#undef _SHR
+#undef _ROR
+}
+
+#if SHA256_SHANI
+// Four rounds at a time with the SHA extensions.  The state lives as ABEF
+// and CDGH, and the message schedule as four vectors of four words, each
+// group of rounds finishing the words the one after the next will use.
+__attribute__((target("sha,sse4.1")))
+static void _SHA256_blocks_shani(uint32_t* state, const uint8_t* data, size_t n) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xb1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1b);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for (; n > 0; --n) {
+    const __m128i abef = state0;
+    const __m128i cdgh = state1;
+    __m128i m[4];
+    int i;
+
+#pragma GCC unroll 16
+    for (i = 0; i < 16; ++i) {
+      if (i < 4) {
+        m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), mask);
+      }
+      __m128i msg = _mm_add_epi32(m[i % 4], _mm_loadu_si128((const __m128i*)&_SHA256_K[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      if (i >= 3 && i < 15) {
+        tmp = _mm_alignr_epi8(m[i % 4], m[(i + 3) % 4], 4);
+        m[(i + 1) % 4] = _mm_add_epi32(m[(i + 1) % 4], tmp);
+        m[(i + 1) % 4] = _mm_sha256msg2_epu32(m[(i + 1) % 4], m[i % 4]);
+      }
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+      if (i >= 1 && i < 13) {
+        m[(i + 3) % 4] = _mm_sha256msg1_epu32(m[(i + 3) % 4], m[i % 4]);
+      }
+    }
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
   }
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
-  F = ctx->state[5];
-  G = ctx->state[6];
-  H = ctx->state[7];
-
-  for(t = 0; t < 64; t++) {
-    uint32_t s0 = _ROR(A, 2) ^ _ROR(A, 13) ^ _ROR(A, 22);
-    uint32_t maj = (A & B) ^ (A & C) ^ (B & C);
-    uint32_t t2 = s0 + maj;
-    uint32_t s1 = _ROR(E, 6) ^ _ROR(E, 11) ^ _ROR(E, 25);
-    uint32_t ch = (E & F) ^ ((~E) & G);
-    uint32_t t1 = H + s1 + ch + _SHA256_K[t] + W[t];
-
-    H = G;
-    G = F;
-    F = E;
-    E = D + t1;
-    D = C;
-    C = B;
-    B = A;
-    A = t1 + t2;
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xf0));
+  _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static int _SHA256_have_shani(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+    return 0;
   }
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (ebx & bit_SHA) != 0;
+}
+#endif  // SHA256_SHANI
+
+#if SHA256_ARMV8
+// Four rounds at a time with the ARMv8 SHA2 instructions, each group of
+// rounds also working out the message words for the group four later.
+static void _SHA256_blocks_armv8(uint32_t* state, const uint8_t* data, size_t n) {
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+
+  for (; n > 0; --n) {
+    const uint32x4_t abcd = state0;
+    const uint32x4_t efgh = state1;
+    uint32x4_t m[4];
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+      m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+    for (i = 0; i < 16; ++i) {
+      uint32x4_t wk = vaddq_u32(m[i % 4], vld1q_u32(&_SHA256_K[4 * i]));
+      if (i < 12) {
+        m[i % 4] = vsha256su1q_u32(vsha256su0q_u32(m[i % 4], m[(i + 1) % 4]),
+                                   m[(i + 2) % 4], m[(i + 3) % 4]);
+      }
+      uint32x4_t prev = state0;
+      state0 = vsha256hq_u32(state0, state1, wk);
+      state1 = vsha256h2q_u32(state1, prev, wk);
+    }
 
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
-  ctx->state[5] += F;
-  ctx->state[6] += G;
-  ctx->state[7] += H;
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+    data += 64;
+  }
 
-#undef _SHR
-#undef _ROR
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+#endif  // SHA256_ARMV8
+
+// What clSHA256_init() contexts use, picked the first time one is set up.
+// Every thread picks the same, so it doesn't matter who gets there first.
+static _SHA256_blocks_fn _SHA256_blocks;
+static const char* _SHA256_blocks_name;
+
+static void _SHA256_select(void) {
+  _SHA256_blocks_fn fn = _SHA256_blocks_portable;
+  const char* name = "portable";
+#if SHA256_SHANI
+  if (_SHA256_have_shani()) {
+    fn = _SHA256_blocks_shani;
+    name = "sha-ni";
+  }
+#elif SHA256_ARMV8
+  fn = _SHA256_blocks_armv8;
+  name = "armv8";
+#endif
+  _SHA256_blocks_name = name;
+  _SHA256_blocks = fn;
+}
+
+// Like _HASH_update(), but hashes whole blocks straight out of data rather
+// than a byte at a time through ctx->buf.
+static void _SHA256_update_blocks(clHASH_CTX* ctx, const void* data, int len,
+                                  _SHA256_blocks_fn blocks) {
+  size_t i = (size_t) (ctx->count & 63);
+  const uint8_t* p = (const uint8_t*)data;
+  size_t left = (size_t) len;
+
+  ctx->count += len;
+
+  if (i != 0) {
+    size_t fill = 64 - i;
+    if (left < fill) {
+      memcpy(ctx->buf + i, p, left);
+      return;
+    }
+    memcpy(ctx->buf + i, p, fill);
+    blocks(ctx->state, ctx->buf, 1);
+    p += fill;
+    left -= fill;
+  }
+  if (left >= 64) {
+    blocks(ctx->state, p, left / 64);
+    p += left & ~(size_t)63;
+    left &= 63;
+  }
+  memcpy(ctx->buf, p, left);
+}
+
+static void _SHA256_update(clHASH_CTX* ctx, const void* data, int len) {
+  _SHA256_update_blocks(ctx, data, len, _SHA256_blocks);
+}
+
+static void _SHA256_update_portable(clHASH_CTX* ctx, const void* data, int len) {
+  _SHA256_update_blocks(ctx, data, len, _SHA256_blocks_portable);
+}
+
+static void _SHA256_transform(clHASH_CTX* ctx) {
+  _SHA256_blocks(ctx->state, ctx->buf, 1);
+}
+
+static void _SHA256_transform_portable(clHASH_CTX* ctx) {
+  _SHA256_blocks_portable(ctx->state, ctx->buf, 1);
 }
 
 const uint8_t* clSHA256(const void* data, int len, uint8_t* digest) {
@@ -209,15 +397,23 @@ static const uint8_t kExpectedPadRsa2kSha256[clSHA256_DIGEST_SIZE] = {
 
 static const clHASH_vtab _SHA256_vtab = {
   clSHA256_init,
-  _HASH_update,
+  _SHA256_update,
   _HASH_final,
   _SHA256_transform,
   clSHA256_DIGEST_SIZE,
   kExpectedPadRsa2kSha256
 };
 
-void clSHA256_init(clSHA256_CTX* ctx) {
-  ctx->f = &_SHA256_vtab;
+static const clHASH_vtab _SHA256_portable_vtab = {
+  clSHA256_init_portable,
+  _SHA256_update_portable,
+  _HASH_final,
+  _SHA256_transform_portable,
+  clSHA256_DIGEST_SIZE,
+  kExpectedPadRsa2kSha256
+};
+
+static void _SHA256_init_state(clSHA256_CTX* ctx) {
   ctx->state[0] = 0x6a09e667;
   ctx->state[1] = 0xbb67ae85;
   ctx->state[2] = 0x3c6ef372;
@@ -229,6 +425,26 @@ void clSHA256_init(clSHA256_CTX* ctx) {
   ctx->count = 0;
 }
 
+void clSHA256_init(clSHA256_CTX* ctx) {
+  if (_SHA256_blocks == NULL) {
+    _SHA256_select();
+  }
+  ctx->f = &_SHA256_vtab;
+  _SHA256_init_state(ctx);
+}
+
+void clSHA256_init_portable(clSHA256_CTX* ctx) {
+  ctx->f = &_SHA256_portable_vtab;
+  _SHA256_init_state(ctx);
+}
+
+const char* clSHA256_impl(void) {
+  if (_SHA256_blocks == NULL) {
+    _SHA256_select();
+  }
+  return _SHA256_blocks_name;
+}
+
 void clHMAC_SHA256_init(clHMAC_CTX* ctx, const void* key, int len) {
   clSHA256_init(&ctx->hash);
   _HMAC_init(ctx, key, len);
@@ -98,6 +98,12 @@ const uint8_t* clSHA1(const void* data, int len, uint8_t* digest);
 typedef clHASH_CTX clSHA256_CTX;
 
 void clSHA256_init(clSHA256_CTX* ctx);
+// Same as clSHA256_init(), but the context never uses the cpu's SHA
+// instructions. For checking and timing the faster code against.
+void clSHA256_init_portable(clSHA256_CTX* ctx);
+// Which code clSHA256_init() contexts hash with: "portable", "sha-ni" or
+// "armv8".
+const char* clSHA256_impl(void);
 void clHMAC_SHA256_init(clHMAC_CTX* ctx, const void* key, int len);
 const uint8_t* clSHA256(const void* data, int len, uint8_t* digest);
 
@@ -496,13 +496,14 @@ typedef struct {
     volatile int _m_lock;
     volatile int _m_waiters;
     int _m_count;
+    int _m_spins;
 } pthread_mutex_t;
 #define __DEFINED_pthread_mutex_t
 #endif
 
 #if defined(__NEED_mtx_t) && !defined(__DEFINED_mtx_t)
 typedef struct {
-    int __i[1];
+    int __i[2];
 } mtx_t;
 #define __DEFINED_mtx_t
 #endif
@@ -17,6 +17,21 @@ void* memalign(size_t, size_t);
 
 size_t malloc_usable_size(void*);
 
+struct mallinfo {
+    int arena;    /* bytes of heap obtained from the system */
+    int ordblks;  /* free chunks */
+    int smblks;
+    int hblks;    /* chunks mapped on their own */
+    int hblkhd;   /* bytes in those */
+    int usmblks;
+    int fsmblks;
+    int uordblks; /* heap bytes in use */
+    int fordblks; /* heap bytes free */
+    int keepcost;
+};
+
+struct mallinfo mallinfo(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -293,6 +293,32 @@ static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
 
 __attribute__((__visibility__("hidden"))) ptrdiff_t __tlsdesc_static(void), __tlsdesc_dynamic(void);
 
+/* Relocation tables are sorted by symbol (-z combreloc), and C++ code
+ * refers to the same symbols from many places (vtables, typeinfo, the
+ * GOT and PLT), so the same lookups come up again and again.  Each call
+ * to do_relocs remembers its recent results here, tagged with its own
+ * generation so that nothing carries over to another DSO's tables.
+ * The dynamic linker lock (or being single-threaded at startup) keeps
+ * this safe. */
+#define SYMCACHE_SIZE 256
+
+static struct symcache_entry {
+    unsigned gen;
+    int sym_index;
+    int kind;
+    struct symdef def;
+} symcache[SYMCACHE_SIZE];
+static unsigned symcache_gen;
+
+static unsigned symcache_new_gen(void) {
+    if (++symcache_gen == 0) {
+        for (size_t i = 0; i < SYMCACHE_SIZE; i++)
+            symcache[i].gen = 0;
+        symcache_gen = 1;
+    }
+    return symcache_gen;
+}
+
 static void do_relocs(struct dso* dso, size_t* rel, size_t rel_size, size_t stride) {
     unsigned char* base = dso->base;
     Sym* syms = dso->syms;
@@ -308,6 +334,7 @@ static void do_relocs(struct dso* dso, size_t* rel, size_t rel_size, size_t stri
     size_t tls_val;
     size_t addend;
     int skip_relative = 0, reuse_addends = 0, save_slot = 0;
+    unsigned gen = symcache_new_gen();
 
     if (dso == &ldso) {
         /* Only ldso's REL table needs addend saving/reuse. */
@@ -328,8 +355,23 @@ static void do_relocs(struct dso* dso, size_t* rel, size_t rel_size, size_t stri
             sym = syms + sym_index;
             name = strings + sym->st_name;
             ctx = type == REL_COPY ? head->next : head;
-            def = (sym->st_info & 0xf) == STT_SECTION ? (struct symdef){.dso = dso, .sym = sym}
-                                                      : find_sym(ctx, name, type == REL_PLT);
+            if ((sym->st_info & 0xf) == STT_SECTION) {
+                def = (struct symdef){.dso = dso, .sym = sym};
+            } else {
+                /* where the search starts and need_def are all that
+                 * the result depends on, besides the symbol */
+                int kind = type == REL_COPY ? 2 : type == REL_PLT;
+                struct symcache_entry* ce = &symcache[sym_index % SYMCACHE_SIZE];
+                if (ce->gen == gen && ce->sym_index == sym_index && ce->kind == kind) {
+                    def = ce->def;
+                } else {
+                    def = find_sym(ctx, name, type == REL_PLT);
+                    ce->gen = gen;
+                    ce->sym_index = sym_index;
+                    ce->kind = kind;
+                    ce->def = def;
+                }
+            }
             if (!def.sym && (sym->st_shndx != SHN_UNDEF || sym->st_info >> 4 != STB_WEAK)) {
                 error("Error relocating %s: %s: symbol not found", dso->name, name);
                 if (runtime)
@@ -10,6 +10,7 @@
 #include <runtime/thread.h>
 #include <runtime/tls.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -21,6 +22,7 @@ weak_alias(dummy, __pthread_tsd_size);
 static void dummy_0(void) {}
 weak_alias(dummy_0, __acquire_ptc);
 weak_alias(dummy_0, __dl_thread_cleanup);
+weak_alias(dummy_0, __malloc_thread_cleanup);
 weak_alias(dummy_0, __do_orphaned_stdio_locks);
 weak_alias(dummy_0, __pthread_tsd_run_dtors);
 weak_alias(dummy_0, __release_ptc);
@@ -58,8 +60,80 @@ static void start_c11(void* arg) {
     pthread_exit((void*)(intptr_t)start(self->start_arg));
 }
 
-// Allocate stack_size via a vmo, and place the pointer to it in *stack_out.
-static mx_status_t allocate_stack(size_t stack_size, size_t guard_size, uintptr_t* stack_out) {
+// Stacks of joined threads are kept here and handed to new threads that
+// want the same size, saving creating, mapping and eventually unmapping
+// a VM object for every thread that comes and goes. Everything below
+// the TLS area is decommitted while a stack sits here, so a cached
+// stack only holds on to its address space and its top pages.
+#define STACK_CACHE_SIZE 8
+
+static struct {
+    unsigned char* map;
+    size_t size;
+    mx_handle_t vmo;
+} stack_cache[STACK_CACHE_SIZE];
+static int stack_cache_count;
+static mtx_t stack_cache_lock;
+
+// The TLS and thread-specific data at the top of a stack mapping
+// extend down to here.
+static unsigned char* stack_tls_start(unsigned char* map, size_t size) {
+    uintptr_t tls = (uintptr_t)map + size - libc.tls_size - __pthread_tsd_size;
+    return (unsigned char*)(tls & -PAGE_SIZE);
+}
+
+static bool stack_cache_get(size_t size, unsigned char** map, mx_handle_t* vmo) {
+    bool found = false;
+    mtx_lock(&stack_cache_lock);
+    for (int i = 0; i < stack_cache_count; i++) {
+        if (stack_cache[i].size == size) {
+            *map = stack_cache[i].map;
+            *vmo = stack_cache[i].vmo;
+            stack_cache[i] = stack_cache[--stack_cache_count];
+            found = true;
+            break;
+        }
+    }
+    mtx_unlock(&stack_cache_lock);
+    if (found) {
+        // The new thread's TLS is copied in over this, and expects
+        // zeroes where it isn't.
+        unsigned char* tls = stack_tls_start(*map, size);
+        memset(tls, 0, *map + size - tls);
+    }
+    return found;
+}
+
+static void stack_cache_put(unsigned char* map, size_t size, mx_handle_t vmo) {
+    size_t stack_len = stack_tls_start(map, size) - map;
+    if (stack_len > 0)
+        _mx_vmo_op_range(vmo, MX_VMO_OP_DECOMMIT, 0, stack_len, NULL, 0);
+
+    mtx_lock(&stack_cache_lock);
+    if (stack_cache_count < STACK_CACHE_SIZE) {
+        stack_cache[stack_cache_count].map = map;
+        stack_cache[stack_cache_count].size = size;
+        stack_cache[stack_cache_count].vmo = vmo;
+        stack_cache_count++;
+        map = NULL;
+    }
+    mtx_unlock(&stack_cache_lock);
+
+    if (map) {
+        __munmap(map, size);
+        _mx_handle_close(vmo);
+    }
+}
+
+void __pthread_release_stack(pthread_t thread) {
+    if (thread->map_base)
+        stack_cache_put(thread->map_base, thread->map_size, thread->map_vmo);
+}
+
+// Allocate stack_size via a vmo, and place the pointer to it in *stack_out
+// and the vmo in *vmo_out.
+static mx_status_t allocate_stack(size_t stack_size, size_t guard_size, uintptr_t* stack_out,
+                                  mx_handle_t* vmo_out) {
     // TODO(kulakowski) Implement guard pages. For now, bypass all the
     // guard page arithmetic and just map the entire size. When we can
     // break up mapped regions and have PROT_NONE, the guard stuff is
@@ -73,9 +147,13 @@ static mx_status_t allocate_stack(size_t stack_size, size_t guard_size, uintptr_
     status = _mx_process_map_vm(
         _mx_process_self(), thread_stack_vmo, 0, stack_size, stack_out,
         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
-    _mx_handle_close(thread_stack_vmo);
+    if (status < 0) {
+        _mx_handle_close(thread_stack_vmo);
+        return status;
+    }
 
-    return status;
+    *vmo_out = thread_stack_vmo;
+    return NO_ERROR;
 }
 
 int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp, void* (*entry)(void*), void* restrict arg) {
@@ -94,6 +172,7 @@ int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp
     size_t size = 0u;
     size_t guard_size = 0u;
     unsigned char *map = 0, *stack = 0, *tsd = 0, *stack_limit;
+    mx_handle_t map_vmo = MX_HANDLE_INVALID;
 
     if (attr._a_stackaddr) {
         size_t need = libc.tls_size + __pthread_tsd_size;
@@ -137,14 +216,16 @@ int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp
     // stack pointer.
 
     if (!tsd) {
-        uintptr_t addr = 0u;
-        status = allocate_stack(size, guard_size, &addr);
-        if (status < 0) {
-            __release_ptc();
-            mxr_thread_destroy(mxr_thread);
-            return EAGAIN;
+        if (!stack_cache_get(size, &map, &map_vmo)) {
+            uintptr_t addr = 0u;
+            status = allocate_stack(size, guard_size, &addr, &map_vmo);
+            if (status < 0) {
+                __release_ptc();
+                mxr_thread_destroy(mxr_thread);
+                return EAGAIN;
+            }
+            map = (void*)addr;
         }
-        map = (void*)addr;
         tsd = map + size - __pthread_tsd_size;
         if (!stack) {
             stack = tsd - libc.tls_size;
@@ -158,6 +239,7 @@ int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp
     struct pthread* new = __copy_tls(tsd - libc.tls_size);
     new->map_base = map;
     new->map_size = size;
+    new->map_vmo = map_vmo;
     new->stack = stack;
     new->stack_size = stack - stack_limit;
     new->start = entry;
@@ -192,7 +274,7 @@ int pthread_create(pthread_t* restrict res, const pthread_attr_t* restrict attrp
     if (status != NO_ERROR) {
         atomic_fetch_sub(&libc.thread_count, 1);
         if (map)
-            __munmap(map, size);
+            stack_cache_put(map, size, map_vmo);
         mxr_thread_destroy(mxr_thread);
         return status == ERR_ACCESS_DENIED ? EPERM : EAGAIN;
     }
@@ -273,6 +355,7 @@ _Noreturn void pthread_exit(void* result) {
 
     __do_orphaned_stdio_locks();
     __dl_thread_cleanup();
+    __malloc_thread_cleanup();
 
     mxr_thread_exit(mxr_thread);
 }
@@ -5,6 +5,7 @@ int pthread_join(pthread_t t, void** res) {
     case NO_ERROR:
         if (res)
             *res = t->result;
+        __pthread_release_stack(t);
         return 0;
     default:
         return EINVAL;
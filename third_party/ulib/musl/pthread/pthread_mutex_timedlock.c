@@ -1,5 +1,7 @@
 #include "pthread_impl.h"
 
+#define MAX_SPINS 100
+
 int __pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec* restrict at) {
     if ((m->_m_type & 15) == PTHREAD_MUTEX_NORMAL && !a_cas(&m->_m_lock, 0, EBUSY))
         return 0;
@@ -10,9 +12,17 @@ int __pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec
     if (r != EBUSY)
         return r;
 
-    int spins = 100;
-    while (spins-- && m->_m_lock && !m->_m_waiters)
+    /* Spin for a while before sleeping, for about twice as long as it
+     * took recently (a racy hint kept in the mutex), but not forever. */
+    int max = m->_m_spins * 2 + 10;
+    if (max > MAX_SPINS)
+        max = MAX_SPINS;
+    int spins = 0;
+    while (spins < max && m->_m_lock && !m->_m_waiters) {
+        spins++;
         a_spin();
+    }
+    m->_m_spins += (spins - m->_m_spins) / 8;
 
     while ((r = pthread_mutex_trylock(m)) == EBUSY) {
         if (!(r = m->_m_lock) || ((r & 0x40000000) && (m->_m_type & 4)))
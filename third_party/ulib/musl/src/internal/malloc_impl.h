@@ -27,3 +27,8 @@ struct chunk {
 
 void __donate_heap(void* start, void* end)
     __attribute__((visibility("hidden")));
+
+// Give the pages in the range of heap back to the system; they read
+// as zero afterwards.  The range must be page-aligned.
+void __heap_decommit(void* start, size_t len)
+    __attribute__((visibility("hidden")));
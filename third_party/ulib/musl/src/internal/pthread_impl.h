@@ -14,6 +14,10 @@
 
 #define pthread __pthread
 
+#define MALLOC_CACHE_BINS 16
+
+struct chunk;
+
 struct pthread {
     struct pthread* self;
     void **dtv, *unused1, *unused2;
@@ -47,6 +51,12 @@ struct pthread {
     uintptr_t canary_at_end;
     void** dtv_copy;
     mxr_thread_t* mxr_thread;
+    // Small chunks this thread freed, kept for its next allocations
+    // of the same size; see src/malloc/malloc.c.
+    struct chunk* malloc_cache[MALLOC_CACHE_BINS];
+    unsigned char malloc_cache_count[MALLOC_CACHE_BINS];
+    // The VM object behind map_base, kept so the stack can be cached.
+    mx_handle_t map_vmo;
 };
 
 struct __timer {
@@ -102,6 +112,9 @@ void __vm_unlock(void);
 int __timedwait(volatile int*, int, clockid_t, const struct timespec*);
 int __timedwait_cp(volatile int*, int, clockid_t, const struct timespec*);
 
+// Hands a joined thread's stack back to pthread_create for reuse.
+void __pthread_release_stack(pthread_t thread);
+
 void __acquire_ptc(void);
 void __release_ptc(void);
 void __inhibit_ptc(void);
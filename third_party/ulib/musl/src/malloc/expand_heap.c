@@ -1,10 +1,61 @@
 #include "libc.h"
+#include "malloc_impl.h"
 #include <errno.h>
 #include <limits.h>
+#include <magenta/syscalls.h>
+#include <stdatomic.h>
 #include <stdint.h>
-#include <sys/mman.h>
 
-void* __mmap(void*, size_t, int, int, int, off_t);
+/* Each piece of heap is its own VMO, kept so that __heap_decommit can
+ * give the pages of large free chunks back to the system.  Pieces are
+ * only ever added, so lookups need no lock. */
+#define HEAP_REGIONS 64
+
+static struct heap_region {
+    uintptr_t base;
+    size_t len;
+    mx_handle_t vmo;
+} heap_regions[HEAP_REGIONS];
+static atomic_uint heap_region_count;
+
+void __heap_decommit(void* start, size_t len) {
+    /* Pieces mapped back to back make one stretch of heap, so a free
+     * chunk can span several of them. */
+    uintptr_t a = (uintptr_t)start, b = a + len;
+    unsigned n = atomic_load_explicit(&heap_region_count, memory_order_acquire);
+    for (unsigned i = 0; i < n; i++) {
+        const struct heap_region* r = &heap_regions[i];
+        uintptr_t lo = a > r->base ? a : r->base;
+        uintptr_t hi = b < r->base + r->len ? b : r->base + r->len;
+        if (lo < hi)
+            _mx_vmo_op_range(r->vmo, MX_VMO_OP_DECOMMIT, lo - r->base, hi - lo, NULL, 0);
+    }
+}
+
+static void* map_heap(void* base, size_t len) {
+    mx_handle_t vmo;
+    if (_mx_vmo_create(len, 0, &vmo) < 0)
+        return 0;
+    uintptr_t ptr = (uintptr_t)base;
+    mx_status_t status = _mx_process_map_vm(_mx_process_self(), vmo, 0, len, &ptr,
+                                            MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                                                MX_VM_FLAG_FIXED);
+    if (status < 0) {
+        _mx_handle_close(vmo);
+        return 0;
+    }
+
+    /* Callers serialize calls, so only readers race with this. */
+    unsigned n = atomic_load_explicit(&heap_region_count, memory_order_relaxed);
+    if (n < HEAP_REGIONS) {
+        heap_regions[n] = (struct heap_region){ptr, len, vmo};
+        atomic_store_explicit(&heap_region_count, n + 1, memory_order_release);
+    } else {
+        /* The mapping keeps the pages; they just can't be decommitted. */
+        _mx_handle_close(vmo);
+    }
+    return (void*)ptr;
+}
 
 /* Expand the heap in-place if brk can be used, or otherwise via mmap,
  * using an exponential lower bound on growth by mmap to make
@@ -37,9 +88,11 @@ void* __expand_heap(size_t* pn) {
     size_t min = (size_t)PAGE_SIZE << mmap_step / 2;
     if (n < min)
         n = min;
-    void* area = __mmap(next_base, n, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (area == MAP_FAILED)
+    void* area = map_heap(next_base, n);
+    if (!area) {
+        errno = ENOMEM;
         return 0;
+    }
     *pn = n;
     next_base = area + n;
     mmap_step++;
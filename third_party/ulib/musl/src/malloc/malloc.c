@@ -2,8 +2,11 @@
 #include "atomic.h"
 #include "libc.h"
 #include "malloc_impl.h"
+#include "pthread_impl.h"
 #include <errno.h>
 #include <limits.h>
+#include <malloc.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,7 +20,6 @@
 void* __mmap(void*, size_t, int, int, int, off_t);
 int __munmap(void*, size_t);
 void* __fake_mremap(void*, size_t, size_t, int, ...);
-int __madvise(void*, size_t, int);
 
 struct bin {
     mtx_t lock;
@@ -29,6 +31,9 @@ static struct {
     volatile uint64_t binmap;
     struct bin bins[64];
     mtx_t free_lock;
+    /* for mallinfo */
+    size_t heap_size;
+    volatile int mmap_count, mmap_pages;
 } mal;
 
 #define SIZE_ALIGN (4 * sizeof(size_t))
@@ -39,6 +44,16 @@ static struct {
 
 #define FREE_FILL 0x79
 
+/* Each thread keeps up to MALLOC_CACHE_MAX freed chunks of each of the
+ * MALLOC_CACHE_BINS smallest sizes, and hands them straight back out
+ * to its next allocations of the same size, so that threads mostly
+ * allocating and freeing small objects don't fight over the bin locks.
+ * Cached chunks stay marked in use, so to the rest of the heap they are
+ * just allocated memory.  Caching only starts once there is a second
+ * thread: until then there is nobody to contend with, and early in
+ * startup there is not even a thread pointer yet. */
+#define MALLOC_CACHE_MAX 8
+
 #define BIN_TO_CHUNK(i) (MEM_TO_CHUNK(&mal.bins[i].head))
 
 /* Synchronization tools */
@@ -150,6 +165,8 @@ static struct chunk* expand_heap(size_t n) {
         w->psize = 0 | C_INUSE;
     }
 
+    mal.heap_size += n;
+
     /* Record new heap end and fill in footer. */
     end = (char*)p + n;
     w = MEM_TO_CHUNK(end);
@@ -259,6 +276,68 @@ static int pretrim(struct chunk* self, size_t n, int i, int j) {
     return 1;
 }
 
+static void free_chunk(void* p);
+
+static int cache_enabled(void) {
+    return atomic_load_explicit(&libc.thread_count, memory_order_relaxed) > 1;
+}
+
+/* Takes a chunk of exactly size n from this thread's cache, if it has one. */
+static struct chunk* cache_get(size_t n) {
+    size_t i = n / SIZE_ALIGN - 1;
+    if (i >= MALLOC_CACHE_BINS || !cache_enabled())
+        return 0;
+    pthread_t self = __pthread_self();
+    struct chunk* c = self->malloc_cache[i];
+    if (c) {
+        self->malloc_cache[i] = c->next;
+        self->malloc_cache_count[i]--;
+    }
+    return c;
+}
+
+/* Keeps a chunk being freed in this thread's cache, if there's room. */
+static int cache_put(struct chunk* self_chunk) {
+    size_t i = CHUNK_SIZE(self_chunk) / SIZE_ALIGN - 1;
+    if (i >= MALLOC_CACHE_BINS || !cache_enabled())
+        return 0;
+    pthread_t self = __pthread_self();
+    if (self->malloc_cache_count[i] >= MALLOC_CACHE_MAX)
+        return 0;
+
+    /* Crash on corrupted footer or double free, as free would */
+    if (NEXT_CHUNK(self_chunk)->psize != self_chunk->csize)
+        a_crash();
+    for (struct chunk* c = self->malloc_cache[i]; c; c = c->next) {
+        if (c == self_chunk)
+            a_crash();
+    }
+
+#if LK_DEBUGLEVEL > 1
+    memset(CHUNK_TO_MEM(self_chunk), FREE_FILL, CHUNK_SIZE(self_chunk) - OVERHEAD);
+#endif
+    self_chunk->next = self->malloc_cache[i];
+    self->malloc_cache[i] = self_chunk;
+    self->malloc_cache_count[i]++;
+    return 1;
+}
+
+/* Called by an exiting thread: free everything it cached, and keep it
+ * from caching again, since nobody will ever look at its cache after. */
+void __malloc_thread_cleanup(void) {
+    pthread_t self = __pthread_self();
+    for (size_t i = 0; i < MALLOC_CACHE_BINS; i++) {
+        struct chunk* c = self->malloc_cache[i];
+        self->malloc_cache[i] = 0;
+        self->malloc_cache_count[i] = MALLOC_CACHE_MAX;
+        while (c) {
+            struct chunk* next = c->next;
+            free_chunk(CHUNK_TO_MEM(c));
+            c = next;
+        }
+    }
+}
+
 static void trim(struct chunk* self, size_t n) {
     size_t n1 = CHUNK_SIZE(self);
     struct chunk *next, *split;
@@ -274,7 +353,7 @@ static void trim(struct chunk* self, size_t n) {
     next->psize = n1 - n | C_INUSE;
     self->csize = n | C_INUSE;
 
-    free(CHUNK_TO_MEM(split));
+    free_chunk(CHUNK_TO_MEM(split));
 }
 
 void* malloc(size_t n) {
@@ -284,11 +363,16 @@ void* malloc(size_t n) {
     if (adjust_size(&n) < 0)
         return 0;
 
+    if ((c = cache_get(n)))
+        return CHUNK_TO_MEM(c);
+
     if (n > MMAP_THRESHOLD) {
         size_t len = n + OVERHEAD + PAGE_SIZE - 1 & -PAGE_SIZE;
         char* base = __mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
         if (base == (void*)-1)
             return 0;
+        a_inc(&mal.mmap_count);
+        a_fetch_add(&mal.mmap_pages, len / PAGE_SIZE);
         c = (void*)(base + SIZE_ALIGN - OVERHEAD);
         c->csize = len - (SIZE_ALIGN - OVERHEAD);
         c->psize = SIZE_ALIGN - OVERHEAD;
@@ -373,6 +457,7 @@ void* realloc(void* p, size_t n) {
         base = __fake_mremap(base, oldlen, newlen, MREMAP_MAYMOVE);
         if (base == (void*)-1)
             return newlen < oldlen ? p : 0;
+        a_fetch_add(&mal.mmap_pages, (int)(newlen / PAGE_SIZE) - (int)(oldlen / PAGE_SIZE));
         self = (void*)(base + extra);
         self->csize = newlen - extra;
         return CHUNK_TO_MEM(self);
@@ -411,33 +496,47 @@ void* realloc(void* p, size_t n) {
     if (!new)
         return 0;
     memcpy(new, p, n0 - OVERHEAD);
-    free(CHUNK_TO_MEM(self));
+    free_chunk(CHUNK_TO_MEM(self));
     return new;
 }
 
+static void free_mmapped(struct chunk* self) {
+    size_t extra = self->psize;
+    char* base = (char*)self - extra;
+    size_t len = CHUNK_SIZE(self) + extra;
+    /* Crash on double free */
+    if (extra & 1)
+        a_crash();
+    a_dec(&mal.mmap_count);
+    a_fetch_add(&mal.mmap_pages, -(int)(len / PAGE_SIZE));
+    __munmap(base, len);
+}
+
 // This is static so __donate_heap (below) can call it without PLT
 // indirection.  The public name free is an alias for this.
 static void internal_free(void* p) {
     struct chunk* self = MEM_TO_CHUNK(p);
-    struct chunk* next;
-    size_t final_size, new_size, size;
-    int reclaim = 0;
-    int i;
 
     if (!p)
         return;
 
     if (IS_MMAPPED(self)) {
-        size_t extra = self->psize;
-        char* base = (char*)self - extra;
-        size_t len = CHUNK_SIZE(self) + extra;
-        /* Crash on double free */
-        if (extra & 1)
-            a_crash();
-        __munmap(base, len);
+        free_mmapped(self);
         return;
     }
 
+    if (!cache_put(self))
+        free_chunk(p);
+}
+
+/* Returns a heap chunk to the bins, merging it with its free neighbors. */
+static void free_chunk(void* p) {
+    struct chunk* self = MEM_TO_CHUNK(p);
+    struct chunk* next;
+    size_t final_size, new_size, size;
+    int reclaim = 0;
+    int i;
+
 #if LK_DEBUGLEVEL > 1
     memset(p, FREE_FILL, CHUNK_SIZE(self) - OVERHEAD);
 #endif
@@ -494,12 +593,8 @@ static void internal_free(void* p) {
     if (reclaim) {
         uintptr_t a = (uintptr_t)self + SIZE_ALIGN + PAGE_SIZE - 1 & -PAGE_SIZE;
         uintptr_t b = (uintptr_t)next - SIZE_ALIGN & -PAGE_SIZE;
-#if 1
-        __madvise((void*)a, b - a, MADV_DONTNEED);
-#else
-        __mmap((void*)a, b - a, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
-               0);
-#endif
+        if (a < b)
+            __heap_decommit((void*)a, b - a);
     }
 
     unlock_bin(i);
@@ -522,5 +617,28 @@ void __donate_heap(void* startptr, void* endptr) {
     MEM_TO_CHUNK(start)
         ->csize = z->psize = (end - start + OVERHEAD) | C_INUSE;
     z->csize = 0 | C_INUSE;
-    internal_free((void*)start);
+    free_chunk((void*)start);
+}
+
+struct mallinfo mallinfo(void) {
+    struct mallinfo mi = {0};
+
+    /* Chunks sitting in thread caches count as in use. */
+    size_t free_bytes = 0;
+    for (int i = 0; i < 64; i++) {
+        lock_bin(i);
+        for (struct chunk* c = mal.bins[i].head; c != BIN_TO_CHUNK(i); c = c->next) {
+            mi.ordblks++;
+            free_bytes += CHUNK_SIZE(c);
+        }
+        unlock_bin(i);
+    }
+
+    size_t heap_size = mal.heap_size;
+    mi.arena = (int)heap_size;
+    mi.hblks = mal.mmap_count;
+    mi.hblkhd = (int)((size_t)mal.mmap_pages * PAGE_SIZE);
+    mi.fordblks = (int)free_bytes;
+    mi.uordblks = (int)(heap_size > free_bytes ? heap_size - free_bytes : 0);
+    return mi;
 }
@@ -0,0 +1,52 @@
+.global memchr
+.type memchr,@function
+memchr:
+	test %rdx,%rdx
+	jz 9f
+
+	movd %esi,%xmm0
+	punpcklbw %xmm0,%xmm0
+	punpcklwd %xmm0,%xmm0
+	pshufd $0,%xmm0,%xmm0
+
+	mov %rdi,%rax
+	mov %edi,%ecx
+	and $15,%ecx
+	and $-16,%rax
+	movdqa (%rax),%xmm1
+	pcmpeqb %xmm0,%xmm1
+	pmovmskb %xmm1,%r8d
+	shr %cl,%r8d
+	test %r8d,%r8d
+	jz 2f
+	bsf %r8d,%r8d
+	cmp %rdx,%r8
+	jae 9f
+	lea (%rdi,%r8),%rax
+	ret
+
+	# %rdx counts the bytes left from the start of the block at %rax
+2:	mov $16,%r9d
+	sub %ecx,%r9d
+	cmp %r9,%rdx
+	jbe 9f
+	sub %r9,%rdx
+
+1:	add $16,%rax
+	movdqa (%rax),%xmm1
+	pcmpeqb %xmm0,%xmm1
+	pmovmskb %xmm1,%r8d
+	test %r8d,%r8d
+	jnz 3f
+	sub $16,%rdx
+	ja 1b
+	jmp 9f
+
+3:	bsf %r8d,%r8d
+	cmp %rdx,%r8
+	jae 9f
+	add %r8,%rax
+	ret
+
+9:	xor %eax,%eax
+	ret
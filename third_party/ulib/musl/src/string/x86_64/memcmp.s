@@ -0,0 +1,38 @@
+.global memcmp
+.type memcmp,@function
+memcmp:
+	# unaligned loads, so never past the end of either buffer
+	cmp $16,%rdx
+	jb 2f
+
+1:	movdqu (%rdi),%xmm0
+	movdqu (%rsi),%xmm1
+	pcmpeqb %xmm1,%xmm0
+	pmovmskb %xmm0,%eax
+	xor $0xffff,%eax
+	jnz 3f
+	add $16,%rdi
+	add $16,%rsi
+	sub $16,%rdx
+	cmp $16,%rdx
+	jae 1b
+
+2:	test %rdx,%rdx
+	jz 4f
+5:	movzbl (%rdi),%eax
+	movzbl (%rsi),%ecx
+	sub %ecx,%eax
+	jnz 6f
+	inc %rdi
+	inc %rsi
+	dec %rdx
+	jnz 5b
+4:	xor %eax,%eax
+6:	ret
+
+3:	bsf %eax,%eax
+	movzbl (%rdi,%rax),%ecx
+	movzbl (%rsi,%rax),%edx
+	mov %ecx,%eax
+	sub %edx,%eax
+	ret
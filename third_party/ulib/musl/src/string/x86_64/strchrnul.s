@@ -0,0 +1,41 @@
+.global __strchrnul
+.type __strchrnul,@function
+.weak strchrnul
+.type strchrnul,@function
+__strchrnul:
+strchrnul:
+	movd %esi,%xmm0
+	punpcklbw %xmm0,%xmm0
+	punpcklwd %xmm0,%xmm0
+	pshufd $0,%xmm0,%xmm0
+	pxor %xmm2,%xmm2
+
+	mov %rdi,%rax
+	mov %edi,%ecx
+	and $15,%ecx
+	and $-16,%rax
+	movdqa (%rax),%xmm1
+	movdqa %xmm1,%xmm3
+	pcmpeqb %xmm0,%xmm1
+	pcmpeqb %xmm2,%xmm3
+	por %xmm3,%xmm1
+	pmovmskb %xmm1,%edx
+	shr %cl,%edx
+	test %edx,%edx
+	jz 1f
+	bsf %edx,%edx
+	lea (%rdi,%rdx),%rax
+	ret
+
+1:	add $16,%rax
+	movdqa (%rax),%xmm1
+	movdqa %xmm1,%xmm3
+	pcmpeqb %xmm0,%xmm1
+	pcmpeqb %xmm2,%xmm3
+	por %xmm3,%xmm1
+	pmovmskb %xmm1,%edx
+	test %edx,%edx
+	jz 1b
+	bsf %edx,%edx
+	add %rdx,%rax
+	ret
@@ -0,0 +1,30 @@
+.global strlen
+.type strlen,@function
+strlen:
+	# SSE2 is always there on x86-64. Aligned 16 byte loads can't
+	# cross into a page the string doesn't reach.
+	mov %rdi,%rax
+	mov %edi,%ecx
+	and $15,%ecx
+	and $-16,%rax
+	pxor %xmm0,%xmm0
+	movdqa (%rax),%xmm1
+	pcmpeqb %xmm0,%xmm1
+	pmovmskb %xmm1,%edx
+	shr %cl,%edx
+	test %edx,%edx
+	jnz 2f
+
+1:	add $16,%rax
+	movdqa (%rax),%xmm1
+	pcmpeqb %xmm0,%xmm1
+	pmovmskb %xmm1,%edx
+	test %edx,%edx
+	jz 1b
+	bsf %edx,%edx
+	add %rdx,%rax
+	sub %rdi,%rax
+	ret
+
+2:	bsf %edx,%eax
+	ret
@@ -104,17 +104,13 @@ int cnd_timedwait(cnd_t* restrict c, mtx_t* restrict mutex,
     mxr_mutex_lock(m);
 
     if (oldstate != WAITING) {
-        // TODO(kulakowski) If mxr_mutex_t grows a waiters count, increment it here.
-        // if (!node.next)
-        //     a_inc(&mutex->_m_waiters);
-
         /* Unlock the barrier that's holding back the next waiter, and
-         * either wake it or requeue it to the mutex. */
-        if (node.prev)
+         * either wake it or requeue it to the mutex. A requeued waiter
+         * sleeps on the mutex's futex, so make sure our unlock wakes it. */
+        if (node.prev) {
+            mxr_mutex_set_contested(m);
             unlock_requeue(&node.prev->barrier, &m->futex);
-        // TODO(kulakowski) If mxr_mutex_t grows a waiters count, decrement it here.
-        // else
-        //     a_dec(&mutex->_m_waiters);
+        }
     }
 
     switch (e) {